@@ -14,6 +14,10 @@
 # limitations under the License.
 #
 
+import array
+import mmap
+import tempfile
+import threading
 import unittest
 from collections import defaultdict
 
@@ -253,6 +257,163 @@ class PyWrapS2TestCase(unittest.TestCase):
     point = london.ToPoint()
     self.assertTrue(polygon.Contains(point))
 
+  def testS2CellIdsFromLatLngDegrees(self):
+    lats = array.array("d", [51.5001525, -33.8688, 90.0])
+    lngs = array.array("d", [-0.1262355, 151.2093, 0.0])
+    cell_ids = array.array("Q", [0] * len(lats))
+    s2.S2CellIdsFromLatLngDegrees(lats, lngs, 30, cell_ids)
+    for i in range(len(lats)):
+      cell = s2.S2CellId(s2.S2LatLng.FromDegrees(lats[i], lngs[i]))
+      self.assertEqual(cell.id(), cell_ids[i])
+    s2.S2CellIdsFromLatLngDegrees(lats, lngs, 10, cell_ids)
+    self.assertEqual(
+        s2.S2CellId(s2.S2LatLng.FromDegrees(lats[0], lngs[0])).parent(10).id(),
+        cell_ids[0])
+    tokens = s2.S2CellIdsToTokens(cell_ids)
+    self.assertEqual([s2.S2CellId(i).ToToken() for i in cell_ids], tokens)
+
+  def testS2CellIdsFromLatLngDegreesChecksArguments(self):
+    lats = array.array("d", [1.0, 2.0])
+    lngs = array.array("d", [3.0, 4.0])
+    with self.assertRaises(ValueError):
+      s2.S2CellIdsFromLatLngDegrees(lats, lngs, 30, array.array("Q", [0]))
+    with self.assertRaises(ValueError):
+      s2.S2CellIdsFromLatLngDegrees(lats, lngs, 31, array.array("Q", [0, 0]))
+    with self.assertRaises(TypeError):
+      s2.S2CellIdsFromLatLngDegrees(lats, lngs, 30, array.array("d", [0, 0]))
+
+  def testBatchFunctionsRejectWrongBufferTypes(self):
+    lats = array.array("d", [1.0, 2.0])
+    lngs = array.array("d", [3.0, 4.0])
+    # The right itemsize but the wrong format.
+    doubles = array.array("d", [0, 0])
+    with self.assertRaisesRegex(TypeError, "format 'LQ'"):
+      s2.S2CellIdsFromLatLngDegrees(lats, lngs, 30, doubles)
+    # The wrong itemsize.
+    uint32s = array.array("I", [0, 0])
+    with self.assertRaisesRegex(TypeError, "format 'LQ'"):
+      s2.S2CellIdsFromLatLngDegrees(lats, lngs, 30, uint32s)
+    # A read-only buffer where a writable one is required.
+    with self.assertRaises(BufferError):
+      s2.S2CellIdsFromLatLngDegrees(lats, lngs, 30, bytes(16))
+    # The rejected buffers (and the inputs that were accepted before them)
+    # have been released, so the arrays can be resized.
+    doubles.append(0)
+    uint32s.append(0)
+    lats.append(0.0)
+    lngs.append(0.0)
+
+  def testS2PolygonContainsLatLngDegrees(self):
+    london = s2.S2LatLng.FromDegrees(51.5001525, -0.1262355)
+    polygon = s2.S2Polygon(s2.S2Cell(s2.S2CellId(london).parent(10)))
+    lats = array.array("d", [51.5001525, 51.5, -33.8688])
+    lngs = array.array("d", [-0.1262355, -0.126, 151.2093])
+    result = array.array("b", [0] * len(lats))
+    polygon.ContainsLatLngDegrees(lats, lngs, result)
+    for i in range(len(lats)):
+      point = s2.S2LatLng.FromDegrees(lats[i], lngs[i]).ToPoint()
+      self.assertEqual(polygon.Contains(point), bool(result[i]))
+    self.assertTrue(result[0])
+    self.assertFalse(result[2])
+
+  def _EncodeIndexWithCell(self, cell_id):
+    index = s2.MutableS2ShapeIndex()
+    index.Add(s2.S2Polygon(s2.S2Cell(cell_id)))
+    encoder = s2.Encoder()
+    self.assertTrue(index.EncodeWithShapes(encoder))
+    return bytes(encoder.buffer())
+
+  def _CheckEncodedS2ShapeIndexReader(self, reader, polygon):
+    self.assertEqual(1, reader.num_shape_ids())
+    lats = array.array("d", [51.5001525, 51.7, -33.8688])
+    lngs = array.array("d", [-0.1262355, -0.126, 151.2093])
+    result = array.array("b", [0] * len(lats))
+    reader.ContainsLatLngDegrees(lats, lngs, result)
+    self.assertEqual([1, 0, 0], list(result))
+
+    distances = array.array("d", [0.0] * len(lats))
+    shape_ids = array.array("i", [0] * len(lats))
+    edge_ids = array.array("i", [0] * len(lats))
+    reader.FindClosestEdgesLatLngDegrees(lats, lngs, s2.S1Angle.Degrees(1),
+                                         distances, shape_ids, edge_ids)
+    # The first point is inside the polygon.
+    self.assertEqual(0.0, distances[0])
+    self.assertEqual(0, shape_ids[0])
+    self.assertEqual(-1, edge_ids[0])
+    # The second point is near the polygon boundary.
+    point = s2.S2LatLng.FromDegrees(lats[1], lngs[1]).ToPoint()
+    self.assertAlmostEqual(polygon.GetDistance(point).radians(), distances[1])
+    self.assertEqual(0, shape_ids[1])
+    self.assertGreaterEqual(edge_ids[1], 0)
+    # The third point is farther away than the maximum distance.
+    self.assertEqual(float("inf"), distances[2])
+    self.assertEqual(-1, shape_ids[2])
+    self.assertEqual(-1, edge_ids[2])
+
+  def testEncodedS2ShapeIndexReaderFromBuffer(self):
+    london = s2.S2LatLng.FromDegrees(51.5001525, -0.1262355)
+    cell_id = s2.S2CellId(london).parent(10)
+    reader = s2.EncodedS2ShapeIndexReader.FromBuffer(
+        self._EncodeIndexWithCell(cell_id))
+    polygon = s2.S2Polygon(s2.S2Cell(cell_id))
+    self._CheckEncodedS2ShapeIndexReader(reader, polygon)
+
+  def testEncodedS2ShapeIndexReaderFromFile(self):
+    london = s2.S2LatLng.FromDegrees(51.5001525, -0.1262355)
+    cell_id = s2.S2CellId(london).parent(10)
+    polygon = s2.S2Polygon(s2.S2Cell(cell_id))
+    with tempfile.NamedTemporaryFile() as f:
+      f.write(self._EncodeIndexWithCell(cell_id))
+      f.flush()
+      reader = s2.EncodedS2ShapeIndexReader.FromFile(f.name)
+      self._CheckEncodedS2ShapeIndexReader(reader, polygon)
+
+      # The reader holds the buffer of an mmap.mmap, so it cannot be closed
+      # while the reader exists.
+      mapped = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+      reader = s2.EncodedS2ShapeIndexReader.FromBuffer(mapped)
+      self._CheckEncodedS2ShapeIndexReader(reader, polygon)
+      with self.assertRaises(BufferError):
+        mapped.close()
+      del reader
+      mapped.close()
+
+  def testEncodedS2ShapeIndexReaderInThreads(self):
+    # The batch queries release the GIL, and the index is decoded lazily, so
+    # several threads querying one reader at once must agree.
+    london = s2.S2LatLng.FromDegrees(51.5001525, -0.1262355)
+    cell_id = s2.S2CellId(london).parent(10)
+    reader = s2.EncodedS2ShapeIndexReader.FromBuffer(
+        self._EncodeIndexWithCell(cell_id))
+    # A 64x64 grid of points around the cell.
+    lats = array.array("d", [51.4 + 0.2 * (i // 64) / 64 for i in range(4096)])
+    lngs = array.array("d", [-0.3 + 0.3 * (i % 64) / 64 for i in range(4096)])
+    expected = array.array("b", [0] * len(lats))
+    reader.ContainsLatLngDegrees(lats, lngs, expected)
+    self.assertTrue(any(expected))
+    self.assertFalse(all(expected))
+    results = [array.array("b", [0] * len(lats)) for _ in range(4)]
+
+    def Query(i):
+      for _ in range(10):
+        reader.ContainsLatLngDegrees(lats, lngs, results[i])
+
+    threads = [threading.Thread(target=Query, args=(i,)) for i in range(4)]
+    for thread in threads:
+      thread.start()
+    for thread in threads:
+      thread.join()
+    for result in results:
+      self.assertEqual(expected, result)
+
+  def testEncodedS2ShapeIndexReaderErrors(self):
+    with self.assertRaises(OSError):
+      s2.EncodedS2ShapeIndexReader.FromFile("/nonexistent/index.s2")
+    with self.assertRaises(ValueError):
+      s2.EncodedS2ShapeIndexReader.FromBuffer(b"garbage")
+    with self.assertRaises(TypeError):
+      s2.EncodedS2ShapeIndexReader.FromBuffer(array.array("d", [0.0]))
+
   def testS2LoopIsWrappedCorrectly(self):
     london = s2.S2LatLng.FromDegrees(51.5001525, -0.1262355)
     polygon = s2.S2Polygon(s2.S2Cell(s2.S2CellId(london)))
@@ -1013,6 +1174,26 @@ class S2PolygonTestCase(unittest.TestCase):
     loop = polygon3.loop(0)
     self.assertEqual(4, loop.num_vertices())
 
+  def testInitToUnionInThreads(self):
+    # InitToUnion releases the GIL, so several threads can run it at once.
+    results = [None] * 4
+
+    def Union(i):
+      latlng = s2.S2LatLng.FromDegrees(3.0 + 10 * i, 4.0)
+      polygon1 = s2.S2Polygon(s2.S2Cell(s2.S2CellId(latlng).parent(8)))
+      polygon2 = s2.S2Polygon(s2.S2Cell(s2.S2CellId(latlng).parent(9)))
+      results[i] = s2.S2Polygon()
+      results[i].InitToUnion(polygon1, polygon2)
+
+    threads = [threading.Thread(target=Union, args=(i,)) for i in range(4)]
+    for thread in threads:
+      thread.start()
+    for thread in threads:
+      thread.join()
+    for polygon in results:
+      self.assertEqual(1, polygon.num_loops())
+      self.assertEqual(4, polygon.loop(0).num_vertices())
+
   def testInitToUnionDistinct(self):
     cell1 = s2.S2Cell(s2.S2CellId(s2.S2LatLng.FromDegrees(3.0, 4.0)).parent(8))
     polygon1 = s2.S2Polygon(cell1)
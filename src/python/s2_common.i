@@ -4,9 +4,13 @@
 // open source releases of s2.
 
 %{
+#include <cstring>
 #include <sstream>
 #include <string>
+#include <vector>
 
+#include "absl/memory/memory.h"
+#include "s2/encoded_s2shape_index.h"
 #include "s2/s2boolean_operation.h"
 #include "s2/s2buffer_operation.h"
 #include "s2/s2builder.h"
@@ -30,8 +34,203 @@
 #include "s2/s2region_term_indexer.h"
 #include "s2/s2cell.h"
 #include "s2/s2cell_union.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2error.h"
+#include "s2/s2mapped_file.h"
 #include "s2/s2shape_index.h"
 #include "s2/mutable_s2shape_index.h"
+#include "s2/s2shapeutil_coding.h"
+
+// Acquires a one-dimensional contiguous buffer from a Python object that
+// supports the buffer protocol (e.g., a NumPy array or array.array), and
+// releases it when destroyed.  This allows the batch functions below to
+// process large arrays without creating a Python object for each element.
+class PyBufferView {
+public:
+  // "formats" lists the acceptable struct module format characters for the
+  // elements, which must all have the given size in bytes.  On failure a
+  // Python exception is set and ok() returns false.
+  PyBufferView(PyObject *obj, const char *formats, Py_ssize_t itemsize,
+               bool writable) {
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    if (writable) flags |= PyBUF_WRITABLE;
+    if (PyObject_GetBuffer(obj, &view_, flags) != 0) return;
+    const char *format = view_.format;
+    if (format[0] == '@' || format[0] == '=' || format[0] == '<') ++format;
+    if (view_.ndim > 1 || view_.itemsize != itemsize ||
+        format[0] == '\0' || format[1] != '\0' ||
+        strchr(formats, format[0]) == nullptr) {
+      PyErr_Format(PyExc_TypeError,
+                   "expected a one-dimensional array of format '%s'",
+                   formats);
+      PyBuffer_Release(&view_);
+      return;
+    }
+    ok_ = true;
+  }
+
+  ~PyBufferView() {
+    if (ok_) PyBuffer_Release(&view_);
+  }
+
+  bool ok() const { return ok_; }
+  Py_ssize_t size() const { return view_.len / view_.itemsize; }
+
+  template <class T>
+  T *data() const { return static_cast<T *>(view_.buf); }
+
+private:
+  Py_buffer view_;
+  bool ok_ = false;
+
+  PyBufferView(const PyBufferView&) = delete;
+  void operator=(const PyBufferView&) = delete;
+};
+
+// Returns false and sets a Python exception if the given buffers do not all
+// have the same number of elements.
+static bool CheckSameSize(const PyBufferView &a, const PyBufferView &b) {
+  if (a.size() == b.size()) return true;
+  PyErr_SetString(PyExc_ValueError, "arrays must have the same length");
+  return false;
+}
+
+// Returns the points (lat_degrees[i], lng_degrees[i]), which must be float64
+// arrays of the same size.  Does not access any Python objects.
+static std::vector<S2Point> PointsFromLatLngDegrees(
+    const PyBufferView &lat_degrees, const PyBufferView &lng_degrees) {
+  std::vector<S2Point> points(lat_degrees.size());
+  for (Py_ssize_t i = 0; i < lat_degrees.size(); ++i) {
+    points[i] = S2LatLng::FromDegrees(lat_degrees.data<double>()[i],
+                                      lng_degrees.data<double>()[i]).ToPoint();
+  }
+  return points;
+}
+
+// Owns an EncodedS2ShapeIndex together with the encoded data that it refers
+// to, which is either a memory-mapped file (see S2MappedFile) or a Python
+// object that supports the buffer protocol (such as bytes or mmap.mmap).  The
+// buffer is held until the reader is destroyed, so for example an mmap.mmap
+// cannot be closed while the index is still in use.  The data must consist of
+// the output of s2shapeutil::CompactEncodeTaggedShapes() (or
+// FastEncodeTaggedShapes) followed by MutableS2ShapeIndex::Encode().
+//
+// The batch query methods process entire arrays in C++ with the GIL released,
+// and decode only the parts of the index that they actually visit.
+class EncodedS2ShapeIndexReader {
+public:
+  // Maps the given file and initializes the index from its contents.  On
+  // failure a Python exception is set and false is returned.
+  bool InitFromFile(const std::string &filename) {
+    S2Error error;
+    file_ = S2MappedFile::Open(filename, &error);
+    if (file_ == nullptr) {
+      PyErr_SetString(PyExc_OSError, error.text().c_str());
+      return false;
+    }
+    if (!InitIndex(file_->contents())) return false;
+    // Cells are decoded on demand in no particular order.
+    file_->Advise(index_.encoded_cells_data(), S2MappedFile::Advice::RANDOM);
+    return true;
+  }
+
+  // Initializes the index from a buffer of bytes without copying it.  On
+  // failure a Python exception is set and false is returned.
+  bool InitFromBuffer(PyObject *data) {
+    buffer_ = absl::make_unique<PyBufferView>(data, "Bbc", 1, false);
+    if (!buffer_->ok()) return false;
+    return InitIndex(absl::string_view(buffer_->data<char>(),
+                                       buffer_->size()));
+  }
+
+  int num_shape_ids() const { return index_.num_shape_ids(); }
+
+  // Sets result[i] to whether any shape in the index contains the point
+  // (lat_degrees[i], lng_degrees[i]).  The arrays have the same requirements
+  // as in S2Polygon.ContainsLatLngDegrees.
+  PyObject *ContainsLatLngDegrees(PyObject *lat_degrees,
+                                  PyObject *lng_degrees,
+                                  PyObject *result) const {
+    PyBufferView lats(lat_degrees, "d", sizeof(double), false);
+    if (!lats.ok()) return nullptr;
+    PyBufferView lngs(lng_degrees, "d", sizeof(double), false);
+    if (!lngs.ok()) return nullptr;
+    PyBufferView contains(result, "?bB", 1, true);
+    if (!contains.ok()) return nullptr;
+    if (!CheckSameSize(lats, lngs) || !CheckSameSize(lats, contains)) {
+      return nullptr;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    auto query = MakeS2ContainsPointQuery(&index_);
+    std::vector<bool> inside =
+        query.Contains(PointsFromLatLngDegrees(lats, lngs));
+    for (Py_ssize_t i = 0; i < lats.size(); ++i) {
+      contains.data<uint8>()[i] = inside[i];
+    }
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+  }
+
+  // For each point (lat_degrees[i], lng_degrees[i]), finds the closest edge
+  // in the index whose distance is less than "max_distance" and sets
+  // distances[i] to its distance in radians, and shape_ids[i] and edge_ids[i]
+  // to its shape and edge ids.  If there is no such edge then distances[i] is
+  // set to infinity and both ids are set to -1.  Points inside a polygon have
+  // distance zero and edge_ids[i] == -1 (see S2ClosestEdgeQuery).  The inputs
+  // must be float64 arrays, "distances" must be a writable float64 array and
+  // the ids must be writable int32 arrays, all of the same length.
+  PyObject *FindClosestEdgesLatLngDegrees(PyObject *lat_degrees,
+                                          PyObject *lng_degrees,
+                                          S1Angle max_distance,
+                                          PyObject *distances,
+                                          PyObject *shape_ids,
+                                          PyObject *edge_ids) const {
+    PyBufferView lats(lat_degrees, "d", sizeof(double), false);
+    if (!lats.ok()) return nullptr;
+    PyBufferView lngs(lng_degrees, "d", sizeof(double), false);
+    if (!lngs.ok()) return nullptr;
+    PyBufferView dists(distances, "d", sizeof(double), true);
+    if (!dists.ok()) return nullptr;
+    PyBufferView shapes(shape_ids, "il", sizeof(int32), true);
+    if (!shapes.ok()) return nullptr;
+    PyBufferView edges(edge_ids, "il", sizeof(int32), true);
+    if (!edges.ok()) return nullptr;
+    if (!CheckSameSize(lats, lngs) || !CheckSameSize(lats, dists) ||
+        !CheckSameSize(lats, shapes) || !CheckSameSize(lats, edges)) {
+      return nullptr;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    S2ClosestEdgeQuery query(&index_);
+    query.mutable_options()->set_max_distance(max_distance);
+    std::vector<S2Point> points = PointsFromLatLngDegrees(lats, lngs);
+    for (Py_ssize_t i = 0; i < lats.size(); ++i) {
+      S2ClosestEdgeQuery::PointTarget target(points[i]);
+      S2ClosestEdgeQuery::Result result = query.FindClosestEdge(&target);
+      dists.data<double>()[i] = result.distance().ToAngle().radians();
+      shapes.data<int32>()[i] = result.shape_id();
+      edges.data<int32>()[i] = result.edge_id();
+    }
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+  }
+
+private:
+  bool InitIndex(absl::string_view data) {
+    Decoder decoder(data.data(), data.size());
+    if (!index_.Init(&decoder,
+                     s2shapeutil::LazyDecodeShapeFactory(&decoder))) {
+      PyErr_SetString(PyExc_ValueError, "invalid EncodedS2ShapeIndex data");
+      return false;
+    }
+    return true;
+  }
+
+  // The index is declared last so that it is destroyed before its data.
+  std::unique_ptr<S2MappedFile> file_;
+  std::unique_ptr<PyBufferView> buffer_;
+  EncodedS2ShapeIndex index_;
+};
 
 // Wrapper for S2BufferOperation::Options to work around the inability
 // to handle nested classes in SWIG.
@@ -215,6 +414,65 @@ std::vector<S2Polyline *> *out(std::vector<S2Polyline *> temp) {
   }
 %}
 
+// Batch functions that accept any Python objects supporting the buffer
+// protocol, such as NumPy arrays.  Each function processes the entire array
+// in C++ without creating a Python object per element, and releases the GIL
+// while doing so.  For example:
+//
+//   ids = numpy.empty(len(lats), dtype=numpy.uint64)
+//   S2CellIdsFromLatLngDegrees(lats, lngs, 30, ids)
+%inline %{
+  // Sets cell_ids[i] to the id of the S2CellId at the given level that
+  // contains the point (lat_degrees[i], lng_degrees[i]).  The inputs must be
+  // float64 arrays and "cell_ids" must be a writable uint64 array, all of the
+  // same length.
+  static PyObject *S2CellIdsFromLatLngDegrees(PyObject *lat_degrees,
+                                              PyObject *lng_degrees,
+                                              int level, PyObject *cell_ids) {
+    if (level < 0 || level > S2CellId::kMaxLevel) {
+      PyErr_SetString(PyExc_ValueError, "level must be between 0 and 30");
+      return nullptr;
+    }
+    PyBufferView lats(lat_degrees, "d", sizeof(double), false);
+    if (!lats.ok()) return nullptr;
+    PyBufferView lngs(lng_degrees, "d", sizeof(double), false);
+    if (!lngs.ok()) return nullptr;
+    PyBufferView ids(cell_ids, "LQ", sizeof(uint64), true);
+    if (!ids.ok()) return nullptr;
+    if (!CheckSameSize(lats, lngs) || !CheckSameSize(lats, ids)) {
+      return nullptr;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    for (Py_ssize_t i = 0; i < lats.size(); ++i) {
+      S2LatLng ll = S2LatLng::FromDegrees(lats.data<double>()[i],
+                                          lngs.data<double>()[i]);
+      ids.data<uint64>()[i] = S2CellId(ll.Normalized()).parent(level).id();
+    }
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+  }
+
+  // Returns a list containing the token of each S2CellId id in the given
+  // uint64 array (see S2CellId::ToToken).
+  static PyObject *S2CellIdsToTokens(PyObject *cell_ids) {
+    PyBufferView ids(cell_ids, "LQ", sizeof(uint64), false);
+    if (!ids.ok()) return nullptr;
+    PyObject *result = PyList_New(ids.size());
+    if (result == nullptr) return nullptr;
+    for (Py_ssize_t i = 0; i < ids.size(); ++i) {
+      std::string token = S2CellId(ids.data<uint64>()[i]).ToToken();
+      PyObject *const o = PyUnicode_FromStringAndSize(token.data(),
+                                                      token.size());
+      if (!o) {
+        Py_DECREF(result);
+        return nullptr;
+      }
+      PyList_SET_ITEM(result, i, o);
+    }
+    return result;
+  }
+%}
+
 // We provide our own definition of S2Point, because the real one is too
 // difficult to wrap correctly.
 class S2Point {
@@ -297,6 +555,34 @@ class S2Point {
       out->push_back(polyline.release());
     }
   }
+
+  // Sets result[i] to whether the polygon contains the point
+  // (lat_degrees[i], lng_degrees[i]).  The inputs must be float64 arrays and
+  // "result" must be a writable bool (or uint8) array of the same length.
+  // This is much faster than calling Contains() for each point, since the
+  // points are processed in C++ in S2CellId order (see S2ContainsPointQuery).
+  PyObject *ContainsLatLngDegrees(PyObject *lat_degrees,
+                                  PyObject *lng_degrees,
+                                  PyObject *result) const {
+    PyBufferView lats(lat_degrees, "d", sizeof(double), false);
+    if (!lats.ok()) return nullptr;
+    PyBufferView lngs(lng_degrees, "d", sizeof(double), false);
+    if (!lngs.ok()) return nullptr;
+    PyBufferView contains(result, "?bB", 1, true);
+    if (!contains.ok()) return nullptr;
+    if (!CheckSameSize(lats, lngs) || !CheckSameSize(lats, contains)) {
+      return nullptr;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    auto query = MakeS2ContainsPointQuery(&$self->index());
+    std::vector<bool> inside =
+        query.Contains(PointsFromLatLngDegrees(lats, lngs));
+    for (Py_ssize_t i = 0; i < lats.size(); ++i) {
+      contains.data<uint8>()[i] = inside[i];
+    }
+    Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+  }
 }
 
 %extend S2Builder {
@@ -334,6 +620,58 @@ public:
     auto polygon = std::unique_ptr<S2Polygon>(polygon_disown);
     $self->Add(std::unique_ptr<S2Shape>(new S2Polygon::OwningShape(std::move(polygon))));
   }
+
+  // Encodes the shapes followed by the index, in the format expected by
+  // EncodedS2ShapeIndexReader.  Returns false if a shape could not be
+  // encoded.
+  bool EncodeWithShapes(Encoder* encoder) {
+    if (!s2shapeutil::CompactEncodeTaggedShapes(*$self, encoder)) {
+      return false;
+    }
+    $self->Encode(encoder);
+    return true;
+  }
+}
+
+class EncodedS2ShapeIndexReader {
+public:
+  int num_shape_ids() const;
+  PyObject *ContainsLatLngDegrees(PyObject *lat_degrees,
+                                  PyObject *lng_degrees,
+                                  PyObject *result) const;
+  PyObject *FindClosestEdgesLatLngDegrees(PyObject *lat_degrees,
+                                          PyObject *lng_degrees,
+                                          S1Angle max_distance,
+                                          PyObject *distances,
+                                          PyObject *shape_ids,
+                                          PyObject *edge_ids) const;
+};
+
+// EncodedS2ShapeIndexReader is created using these factory functions rather
+// than constructors so that initialization errors raise Python exceptions.
+// For example:
+//
+//   reader = EncodedS2ShapeIndexReader.FromFile("/data/index.s2")
+//   reader.ContainsLatLngDegrees(lats, lngs, result)
+%extend EncodedS2ShapeIndexReader {
+ public:
+  // Maps the given file read-only (see S2MappedFile).
+  static PyObject *FromFile(const std::string &filename) {
+    auto reader = absl::make_unique<EncodedS2ShapeIndexReader>();
+    if (!reader->InitFromFile(filename)) return nullptr;
+    return SWIG_NewPointerObj(reader.release(),
+                              SWIGTYPE_p_EncodedS2ShapeIndexReader,
+                              SWIG_POINTER_OWN);
+  }
+
+  // Uses the contents of "data" (e.g. bytes or mmap.mmap) without copying.
+  static PyObject *FromBuffer(PyObject *data) {
+    auto reader = absl::make_unique<EncodedS2ShapeIndexReader>();
+    if (!reader->InitFromBuffer(data)) return nullptr;
+    return SWIG_NewPointerObj(reader.release(),
+                              SWIGTYPE_p_EncodedS2ShapeIndexReader,
+                              SWIG_POINTER_OWN);
+  }
 }
 
 %extend S2BooleanOperation {
@@ -508,11 +846,58 @@ public:
       raise ValueError("Level must be less than or equal to cell's level.")
 %}
 
+// Releases the GIL while the given function runs, so that other Python
+// threads can run concurrently with long-running geometric operations.  The
+// arguments are converted before the GIL is released and output arguments
+// are converted after it has been reacquired, so the function itself never
+// touches a Python object.
+//
+// However, the C++ objects that the function uses (the object whose method
+// is called and any S2 objects passed as arguments) can still be reached
+// from other Python threads, and nothing in the bindings prevents those
+// threads from using them.  Like the C++ classes they wrap, these objects are
+// thread-compatible.  While such a call is running, other threads may call
+// const methods on its objects but must not modify them, or use the object
+// being modified at all (e.g. an S2Builder during Build(), or the output
+// polygon of an S2BooleanOperation).  Callers that share objects between
+// threads must synchronize access themselves (see README.md).  The batch
+// functions that accept buffers have the same contract for their arrays.
+%define %releasegil(function)
+%exception function {
+  Py_BEGIN_ALLOW_THREADS
+  $action
+  Py_END_ALLOW_THREADS
+}
+%enddef
+
+%releasegil(S2BooleanOperation::Build)
+%releasegil(S2BufferOperation::Build)
+%releasegil(S2Builder::Build)
+%releasegil(S2Loop::IsValid)
+%releasegil(S2Polygon::BoundaryNear)
+%releasegil(S2Polygon::GetOverlapFractions)
+%releasegil(S2Polygon::InitNested)
+%releasegil(S2Polygon::InitToUnion)
+%releasegil(S2Polygon::IntersectWithPolyline)
+%releasegil(S2Polygon::IsValid)
+%releasegil(S2RegionCoverer::GetCovering)
+%releasegil(S2RegionCoverer::GetInteriorCovering)
+%releasegil(S2RegionTermIndexer::GetIndexTerms)
+%releasegil(S2RegionTermIndexer::GetQueryTerms)
+
 %ignoreall
 
+%unignore EncodedS2ShapeIndexReader;
+%unignore EncodedS2ShapeIndexReader::~EncodedS2ShapeIndexReader;
+%unignore EncodedS2ShapeIndexReader::ContainsLatLngDegrees;
+%unignore EncodedS2ShapeIndexReader::FindClosestEdgesLatLngDegrees;
+%unignore EncodedS2ShapeIndexReader::FromBuffer;
+%unignore EncodedS2ShapeIndexReader::FromFile;
+%unignore EncodedS2ShapeIndexReader::num_shape_ids;
 %unignore MutableS2ShapeIndex;
 %unignore MutableS2ShapeIndex::~MutableS2ShapeIndex;
 %unignore MutableS2ShapeIndex::Add(S2Shape*);
+%unignore MutableS2ShapeIndex::EncodeWithShapes(Encoder*);
 %unignore R1Interval;
 %ignore R1Interval::operator[];
 %unignore R1Interval::GetLength;
@@ -814,6 +1199,7 @@ public:
 %unignore S2Polygon::BoundaryNear;
 %unignore S2Polygon::Clone;
 %unignore S2Polygon::Contains;
+%unignore S2Polygon::ContainsLatLngDegrees;
 %unignore S2Polygon::Copy;
 %unignore S2Polygon::Decode;
 %unignore S2Polygon::Encode;
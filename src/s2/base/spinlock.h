@@ -33,6 +33,12 @@ class SpinLock {
     }
   }
 
+  // Acquires the lock if it is free and returns true, or returns false
+  // without waiting if it is held.
+  inline bool TryLock() {
+    return !locked_.exchange(true, std::memory_order_acquire);
+  }
+
   inline void Unlock() {
     locked_.store(false, std::memory_order_release);
   }
@@ -0,0 +1,346 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/composite_s2shape_index.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "s2/base/casts.h"
+#include "s2/s2edge_crosser.h"
+#include "s2/s2wrapped_shape.h"
+
+using absl::make_unique;
+using std::max;
+using std::min;
+using std::unique_ptr;
+using std::vector;
+
+void CompositeS2ShapeIndex::Iterator::Init(
+    const CompositeS2ShapeIndex* index, InitialPosition pos) {
+  index_ = index;
+  iters_.clear();
+  for (const S2ShapeIndex* i : index->indexes_) iters_.emplace_back(i);
+  if (pos == BEGIN) {
+    Begin();
+  } else {
+    Finish();
+  }
+}
+
+void CompositeS2ShapeIndex::Iterator::SeekLeaf(S2CellId x, bool seek) {
+  // The new cell is the largest cell containing "x" that is contained by
+  // every underlying cell containing "x", and that does not intersect any
+  // other underlying cell.  "lo" is the last leaf of any underlying cell
+  // that precedes "x", and "hi" is the first leaf of any underlying cell
+  // that follows "x".
+  S2CellId lo = seek ? S2CellId::None() : x.prev();
+  S2CellId hi = S2CellId::Sentinel();
+  int deepest = -1;
+  for (int i = 0; i < iters_.size(); ++i) {
+    S2ShapeIndex::Iterator& it = iters_[i];
+    if (seek) {
+      it.Seek(x);
+      if (it.Prev()) {
+        if (it.id().range_max() < x) {
+          lo = max(lo, it.id().range_max());
+          it.Next();
+        }
+      }
+    }
+    if (it.done()) continue;
+    if (it.id().range_min() <= x) {
+      if (deepest < 0 || it.id().level() > iters_[deepest].id().level()) {
+        deepest = i;
+      }
+    } else {
+      hi = min(hi, it.id().range_min());
+    }
+  }
+  if (deepest < 0) {
+    if (hi == S2CellId::Sentinel()) {
+      set_finished();
+    } else {
+      // No cell contains "x", so move to the first cell that follows it.
+      SeekLeaf(hi, false);
+    }
+    return;
+  }
+  S2CellId id = iters_[deepest].id();
+  while (id.range_min() <= lo || id.range_max() >= hi) {
+    id = x.parent(id.level() + 1);
+  }
+  set_state(id, nullptr);
+}
+
+void CompositeS2ShapeIndex::Iterator::Begin() {
+  SeekLeaf(S2CellId::Begin(S2CellId::kMaxLevel), true);
+}
+
+void CompositeS2ShapeIndex::Iterator::Finish() {
+  for (S2ShapeIndex::Iterator& it : iters_) it.Finish();
+  set_finished();
+}
+
+void CompositeS2ShapeIndex::Iterator::Next() {
+  S2_DCHECK(!done());
+  // Advance every underlying iterator whose cell ends with the current cell.
+  S2CellId x = id().range_max().next();
+  for (S2ShapeIndex::Iterator& it : iters_) {
+    if (!it.done() && it.id().range_max() < x) it.Next();
+  }
+  SeekLeaf(x, false);
+}
+
+bool CompositeS2ShapeIndex::Iterator::Prev() {
+  // Find the last leaf before the current cell that belongs to any
+  // underlying cell, and then position the iterator at the cell containing
+  // it.
+  S2CellId begin = done() ? S2CellId::End(S2CellId::kMaxLevel)
+                          : id().range_min();
+  S2CellId last = S2CellId::None();
+  for (S2ShapeIndex::Iterator& it : iters_) {
+    it.Seek(begin);
+    if (!it.done() && it.id().range_min() < begin) {
+      last = begin.prev();
+      break;
+    }
+    if (it.Prev()) last = max(last, min(it.id().range_max(), begin.prev()));
+  }
+  if (last == S2CellId::None()) {
+    // There is no previous cell, so restore the original position.
+    if (done()) {
+      Finish();
+    } else {
+      SeekLeaf(begin, true);
+    }
+    return false;
+  }
+  SeekLeaf(last, true);
+  return true;
+}
+
+void CompositeS2ShapeIndex::Iterator::Seek(S2CellId target) {
+  if (target >= S2CellId::End(S2CellId::kMaxLevel)) {
+    Finish();
+    return;
+  }
+  // Find the cell containing the first leaf that follows target.id() in the
+  // S2CellId ordering.  All previous cells have ids less than "target", and
+  // all subsequent cells have ids greater than "target".
+  S2CellId x = target.is_leaf() ? target : target.child(2).range_min();
+  SeekLeaf(x, true);
+  if (!done() && id() < target) Next();
+}
+
+bool CompositeS2ShapeIndex::Iterator::can_prefetch() const {
+  for (const S2ShapeIndex::Iterator& it : iters_) {
+    if (it.can_prefetch()) return true;
+  }
+  return false;
+}
+
+void CompositeS2ShapeIndex::Iterator::Prefetch(S2CellId target) const {
+  for (const S2ShapeIndex::Iterator& it : iters_) {
+    if (it.can_prefetch()) it.Prefetch(target);
+  }
+}
+
+bool CompositeS2ShapeIndex::Iterator::Locate(const S2Point& target) {
+  return LocateImpl(target, this);
+}
+
+CompositeS2ShapeIndex::CellRelation CompositeS2ShapeIndex::Iterator::Locate(
+    S2CellId target) {
+  return LocateImpl(target, this);
+}
+
+const S2ShapeIndexCell* CompositeS2ShapeIndex::Iterator::GetCell() const {
+  // The underlying cells that contain the current cell are exactly those
+  // that do not start after it.
+  const S2CellId id = this->id();
+  int num_cells = 0, last = -1;
+  for (int i = 0; i < iters_.size(); ++i) {
+    if (!iters_[i].done() && iters_[i].id().range_min() <= id.range_min()) {
+      ++num_cells;
+      last = i;
+    }
+  }
+  if (num_cells == 1 && iters_[last].id() == id &&
+      index_->offsets_[last] == 0) {
+    return &iters_[last].cell();
+  }
+  const S2ShapeIndexCell* cell = index_->FindCell(id);
+  if (cell != nullptr) return cell;
+  return index_->AddCell(id, MakeCell());
+}
+
+unique_ptr<S2ShapeIndexCell>
+CompositeS2ShapeIndex::Iterator::MakeCell() const {
+  const S2CellId id = this->id();
+  auto cell = make_unique<S2ShapeIndexCell>();
+  const S2Point center = id.ToPoint();
+  for (int i = 0; i < iters_.size(); ++i) {
+    const S2ShapeIndex::Iterator& it = iters_[i];
+    if (it.done() || it.id().range_min() > id.range_min()) continue;
+    const S2ShapeIndexCell& src = it.cell();
+    const int offset = index_->offsets_[i];
+
+    // If the underlying cell is larger than the current cell, the
+    // contains_center() flags are updated by counting the crossings of each
+    // shape's edges with the segment between the two cell centers.
+    const bool subdivided = (it.id() != id);
+    const S2Point src_center = it.id().ToPoint();
+    S2EdgeCrosser crosser(&src_center, &center);
+    S2ClippedShape* dst = cell->add_shapes(src.num_clipped());
+    for (int j = 0; j < src.num_clipped(); ++j, ++dst) {
+      const S2ClippedShape& clipped = src.clipped(j);
+      const int num_edges = clipped.num_edges();
+      dst->Init(clipped.shape_id() + offset, num_edges);
+      for (int k = 0; k < num_edges; ++k) dst->set_edge(k, clipped.edge(k));
+      bool contains_center = clipped.contains_center();
+      if (subdivided) {
+        const S2Shape& shape = *index_->indexes_[i]->shape(clipped.shape_id());
+        if (shape.dimension() == 2) {
+          for (int k = 0; k < num_edges; ++k) {
+            S2Shape::Edge edge = shape.edge(clipped.edge(k));
+            contains_center ^= crosser.EdgeOrVertexCrossing(&edge.v0,
+                                                            &edge.v1);
+          }
+        }
+      }
+      dst->set_contains_center(contains_center);
+    }
+  }
+  return cell;
+}
+
+unique_ptr<CompositeS2ShapeIndex::IteratorBase>
+CompositeS2ShapeIndex::Iterator::Clone() const {
+  return make_unique<Iterator>(*this);
+}
+
+void CompositeS2ShapeIndex::Iterator::Copy(const IteratorBase& other) {
+  // S2ShapeIndex::Iterator assignment requires an initialized target, so
+  // the underlying iterators are replaced by copies rather than assigned to.
+  const Iterator& it = *down_cast<const Iterator*>(&other);
+  if (&it == this) return;
+  IteratorBase::operator=(it);
+  index_ = it.index_;
+  iters_.clear();
+  for (const S2ShapeIndex::Iterator& i : it.iters_) iters_.emplace_back(i);
+}
+
+CompositeS2ShapeIndex::CompositeS2ShapeIndex()
+    : num_shape_ids_(0), wrap_begin_(0) {
+}
+
+CompositeS2ShapeIndex::CompositeS2ShapeIndex(
+    vector<const S2ShapeIndex*> indexes)
+    : CompositeS2ShapeIndex() {
+  Init(std::move(indexes));
+}
+
+CompositeS2ShapeIndex::~CompositeS2ShapeIndex() {
+  ClearShapes();
+}
+
+void CompositeS2ShapeIndex::Init(vector<const S2ShapeIndex*> indexes) {
+  ClearShapes();
+  Minimize();
+  indexes_ = std::move(indexes);
+  offsets_.clear();
+  num_shape_ids_ = 0;
+  wrap_begin_ = -1;
+  for (const S2ShapeIndex* index : indexes_) {
+    if (num_shape_ids_ > 0 && wrap_begin_ < 0) wrap_begin_ = num_shape_ids_;
+    offsets_.push_back(num_shape_ids_);
+    num_shape_ids_ += index->num_shape_ids();
+  }
+  if (wrap_begin_ < 0) wrap_begin_ = num_shape_ids_;
+  wrapped_shapes_ = vector<AtomicShape>(num_shape_ids_ - wrap_begin_);
+}
+
+void CompositeS2ShapeIndex::ClearShapes() {
+  for (auto& wrapped : wrapped_shapes_) delete wrapped.load();
+  wrapped_shapes_.clear();
+}
+
+void CompositeS2ShapeIndex::Minimize() {
+  absl::MutexLock lock(&cells_mutex_);
+  cells_.clear();
+}
+
+const S2ShapeIndexCell* CompositeS2ShapeIndex::FindCell(S2CellId id) const {
+  absl::MutexLock lock(&cells_mutex_);
+  auto it = cells_.find(id);
+  return it == cells_.end() ? nullptr : it->second.get();
+}
+
+const S2ShapeIndexCell* CompositeS2ShapeIndex::AddCell(
+    S2CellId id, unique_ptr<S2ShapeIndexCell> cell) const {
+  absl::MutexLock lock(&cells_mutex_);
+  // If another thread added the cell first, "cell" is discarded.
+  return cells_.emplace(id, std::move(cell)).first->second.get();
+}
+
+int CompositeS2ShapeIndex::FindIndex(int shape_id) const {
+  return static_cast<int>(
+      std::upper_bound(offsets_.begin(), offsets_.end(), shape_id) -
+      offsets_.begin()) - 1;
+}
+
+S2Shape* CompositeS2ShapeIndex::shape(int id) const {
+  int i = FindIndex(id);
+  S2Shape* shape = indexes_[i]->shape(id - offsets_[i]);
+  if (id < wrap_begin_ || shape == nullptr) return shape;
+  std::atomic<S2Shape*>& wrapped = wrapped_shapes_[id - wrap_begin_];
+  S2Shape* expected = wrapped.load(std::memory_order_acquire);
+  if (expected != nullptr) return expected;
+  auto new_shape = make_unique<S2WrappedShape>(shape);
+  new_shape->id_ = id;
+  if (wrapped.compare_exchange_strong(expected, new_shape.get(),
+                                      std::memory_order_acq_rel)) {
+    return new_shape.release();  // Ownership has been transferred.
+  }
+  return expected;  // Another thread wrapped the shape first.
+}
+
+size_t CompositeS2ShapeIndex::SpaceUsed() const {
+  size_t size = sizeof(*this);
+  size += indexes_.capacity() * sizeof(const S2ShapeIndex*);
+  size += offsets_.capacity() * sizeof(int);
+  size += wrapped_shapes_.capacity() * sizeof(AtomicShape);
+  for (const auto& wrapped : wrapped_shapes_) {
+    if (wrapped.load(std::memory_order_relaxed) != nullptr) {
+      size += sizeof(S2WrappedShape);
+    }
+  }
+  absl::MutexLock lock(&cells_mutex_);
+  size += cells_.capacity() * sizeof(decltype(cells_)::value_type);
+  for (const auto& entry : cells_) {
+    const S2ShapeIndexCell& cell = *entry.second;
+    size += sizeof(S2ShapeIndexCell);
+    for (int i = 0; i < cell.num_clipped(); ++i) {
+      const S2ClippedShape& clipped = cell.clipped(i);
+      size += sizeof(S2ClippedShape);
+      if (!clipped.is_inline()) size += clipped.num_edges() * sizeof(int32);
+    }
+  }
+  return size;
+}
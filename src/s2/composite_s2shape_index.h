@@ -0,0 +1,229 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_COMPOSITE_S2SHAPE_INDEX_H_
+#define S2_COMPOSITE_S2SHAPE_INDEX_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2shape.h"
+#include "s2/s2shape_index.h"
+
+// CompositeS2ShapeIndex is an S2ShapeIndex that presents the union of
+// several other S2ShapeIndexes without building a combined index.  For
+// example, a large static EncodedS2ShapeIndex can be queried together with a
+// small MutableS2ShapeIndex of recent edits:
+//
+//   CompositeS2ShapeIndex index({&encoded_index, &live_index});
+//   auto query = MakeS2ContainsPointQuery(&index);
+//   ... or S2ClosestEdgeQuery, S2BooleanOperation, etc ...
+//
+// The shapes of the i-th index are assigned shape ids starting at
+// shape_id_offset(i), which is the total number of shape ids in the
+// preceding indexes.  (So shape ids of the first index are unchanged.)
+// Shapes from the other indexes are presented through S2WrappedShape
+// objects with the adjusted ids, which means that their type_tag() and
+// user_data() are not available.  It is therefore best to list the largest
+// index first.
+//
+// The iterator merges the cell sequences of the underlying indexes.  Where
+// a cell of one index overlaps smaller cells of another, it is subdivided
+// into cells that contain the corresponding clipped shapes of both indexes
+// (adjusting the contains_center() flags as necessary).  Note that the edges
+// of such a subdivided cell are not reclipped, i.e. a cell may contain a few
+// edges that do not actually intersect it.  This does not affect the results
+// of queries.  Cells that belong to just one index (and do not need their
+// shape ids adjusted) are returned without being copied.  Other cells are
+// assembled the first time they are visited and cached until Init() or
+// Minimize() is called.
+//
+// The underlying indexes must persist for the lifetime of this object.  If
+// any of them is modified, Init() must be called again before this index
+// is used.
+//
+// This class is thread-compatible: const methods are thread safe.
+class CompositeS2ShapeIndex final : public S2ShapeIndex {
+ public:
+  // Creates an index that must be initialized by calling Init().
+  CompositeS2ShapeIndex();
+
+  // Convenience constructor that calls Init().
+  explicit CompositeS2ShapeIndex(std::vector<const S2ShapeIndex*> indexes);
+
+  ~CompositeS2ShapeIndex() override;
+
+  // Initializes the index as the union of the given indexes (see above).
+  // This method invalidates all iterators and shapes previously returned by
+  // this index.
+  void Init(std::vector<const S2ShapeIndex*> indexes);
+
+  // The underlying indexes.
+  int num_indexes() const { return static_cast<int>(indexes_.size()); }
+  const S2ShapeIndex& index(int i) const { return *indexes_[i]; }
+
+  // The shape id in this index of shape 0 in the i-th underlying index.
+  int shape_id_offset(int i) const { return offsets_[i]; }
+
+  // The total number of shape ids in all the underlying indexes.
+  int num_shape_ids() const override { return num_shape_ids_; }
+
+  // Returns a pointer to the shape with the given id, or nullptr if the shape
+  // has been removed from the corresponding index.
+  S2Shape* shape(int id) const override;
+
+  // Returns the number of bytes used by this object itself, including any
+  // cached cells.  The underlying indexes are not included since they are
+  // not owned by this object.
+  size_t SpaceUsed() const override;
+
+  // Discards any cells that have been assembled from the underlying indexes.
+  // This method invalidates all iterators.  (The underlying indexes are not
+  // owned, so they are not minimized.)
+  void Minimize() override;
+
+  class Iterator final : public IteratorBase {
+   public:
+    // Default constructor; must be followed by a call to Init().
+    Iterator();
+
+    // Constructs an iterator positioned as specified.
+    explicit Iterator(const CompositeS2ShapeIndex* index,
+                      InitialPosition pos = UNPOSITIONED);
+
+    Iterator(const Iterator& other);
+    Iterator& operator=(const Iterator& other);
+
+    // Initializes an iterator for the given CompositeS2ShapeIndex.
+    void Init(const CompositeS2ShapeIndex* index,
+              InitialPosition pos = UNPOSITIONED);
+
+    // IteratorBase API:
+    void Begin() override;
+    void Finish() override;
+    void Next() override;
+    bool Prev() override;
+    void Seek(S2CellId target) override;
+    bool Locate(const S2Point& target) override;
+    CellRelation Locate(S2CellId target) override;
+    bool can_prefetch() const override;
+    void Prefetch(S2CellId target) const override;
+
+   protected:
+    const S2ShapeIndexCell* GetCell() const override;
+    std::unique_ptr<IteratorBase> Clone() const override;
+    void Copy(const IteratorBase& other) override;
+
+   private:
+    // Positions the iterator at the cell containing the leaf cell "x", or at
+    // the first cell after "x" if there is none.  If "seek" is false then
+    // every underlying iterator must already be positioned at its first cell
+    // that does not precede "x", and the cell containing "x" (if any) must
+    // begin at "x" (e.g., because the previous cell ends at x.prev()).
+    void SeekLeaf(S2CellId x, bool seek);
+
+    // Returns the current cell assembled from the underlying cells.
+    std::unique_ptr<S2ShapeIndexCell> MakeCell() const;
+
+    const CompositeS2ShapeIndex* index_;
+
+    // One iterator per underlying index, each positioned at the first cell
+    // of that index that does not precede the current cell.
+    std::vector<S2ShapeIndex::Iterator> iters_;
+  };
+
+ protected:
+  std::unique_ptr<IteratorBase> NewIterator(InitialPosition pos) const override;
+
+ private:
+  // Returns the index that contains the given shape id.
+  int FindIndex(int shape_id) const;
+
+  // Deletes any wrapped shapes.
+  void ClearShapes();
+
+  // Returns the cached cell with the given id, or nullptr if none.
+  const S2ShapeIndexCell* FindCell(S2CellId id) const;
+
+  // Caches the given cell and returns it, unless another thread has already
+  // cached a cell with the same id (in which case that cell is returned).
+  const S2ShapeIndexCell* AddCell(
+      S2CellId id, std::unique_ptr<S2ShapeIndexCell> cell) const;
+
+  std::vector<const S2ShapeIndex*> indexes_;
+  std::vector<int> offsets_;
+  int num_shape_ids_;
+
+  // Shape ids less than this value belong to an index whose offset is zero,
+  // and are therefore returned unwrapped.
+  int wrap_begin_;
+
+  // Like std::atomic<S2Shape*>, but defaults to nullptr.
+  class AtomicShape : public std::atomic<S2Shape*> {
+   public:
+    AtomicShape() : std::atomic<S2Shape*>(nullptr) {}
+  };
+
+  // Wrapped shapes indexed by (shape_id - wrap_begin_).  Each shape is
+  // wrapped when it is first requested, using compare_exchange_strong.
+  mutable std::vector<AtomicShape> wrapped_shapes_;
+
+  // Cells that have been assembled from the underlying indexes.  Cells must
+  // remain valid for as long as the index is not modified, so they are owned
+  // by the index rather than by the iterator that created them.
+  mutable absl::Mutex cells_mutex_;
+  mutable absl::flat_hash_map<S2CellId, std::unique_ptr<S2ShapeIndexCell>,
+                              S2CellIdHash>
+      cells_ ABSL_GUARDED_BY(cells_mutex_);
+
+  CompositeS2ShapeIndex(const CompositeS2ShapeIndex&) = delete;
+  void operator=(const CompositeS2ShapeIndex&) = delete;
+};
+
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+inline CompositeS2ShapeIndex::Iterator::Iterator() : index_(nullptr) {
+}
+
+inline CompositeS2ShapeIndex::Iterator::Iterator(
+    const CompositeS2ShapeIndex* index, InitialPosition pos) {
+  Init(index, pos);
+}
+
+inline CompositeS2ShapeIndex::Iterator::Iterator(const Iterator& other)
+    : IteratorBase(other), index_(nullptr) {
+  Copy(other);
+}
+
+inline CompositeS2ShapeIndex::Iterator&
+CompositeS2ShapeIndex::Iterator::operator=(const Iterator& other) {
+  Copy(other);
+  return *this;
+}
+
+inline std::unique_ptr<CompositeS2ShapeIndex::IteratorBase>
+CompositeS2ShapeIndex::NewIterator(InitialPosition pos) const {
+  return absl::make_unique<Iterator>(this, pos);
+}
+
+#endif  // S2_COMPOSITE_S2SHAPE_INDEX_H_
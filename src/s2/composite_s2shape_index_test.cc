@@ -0,0 +1,229 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/composite_s2shape_index.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+
+#include "s2/encoded_s2shape_index.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2boolean_operation.h"
+#include "s2/s2cap.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2lax_polygon_shape.h"
+#include "s2/s2loop.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2shapeutil_contains_brute_force.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// Returns a 10x10 degree square whose southwest corner is at (lat, lng).
+unique_ptr<S2Shape> MakeSquare(int lat, int lng) {
+  return s2textformat::MakeLaxPolygonOrDie(absl::StrFormat(
+      "%d:%d, %d:%d, %d:%d, %d:%d", lat, lng, lat, lng + 10,
+      lat + 10, lng + 10, lat + 10, lng));
+}
+
+// Returns a loop with many vertices so that the index has many cells.
+unique_ptr<S2Shape> MakeLargeShape() {
+  auto loop = S2Loop::MakeRegularLoop(
+      s2textformat::MakePointOrDie("0:0"), S1Angle::Degrees(15), 2000);
+  vector<vector<S2Point>> loops(1);
+  for (int i = 0; i < loop->num_vertices(); ++i) {
+    loops[0].push_back(loop->vertex(i));
+  }
+  return make_unique<S2LaxPolygonShape>(loops);
+}
+
+class CompositeS2ShapeIndexTest : public ::testing::Test {
+ protected:
+  // Builds a static EncodedS2ShapeIndex and two MutableS2ShapeIndexes with
+  // different cell structures, together with an index containing all of
+  // their shapes in the same order.
+  CompositeS2ShapeIndexTest() {
+    MutableS2ShapeIndex base;
+    base.Add(MakeLargeShape());
+    base.Add(s2textformat::MakeLaxPolylineOrDie("-20:-20, 20:20"));
+    s2shapeutil::CompactEncodeTaggedShapes(base, &encoder_);
+    base.Encode(&encoder_);
+    Decoder decoder(encoder_.base(), encoder_.length());
+    EXPECT_TRUE(encoded_.Init(&decoder,
+                              s2shapeutil::LazyDecodeShapeFactory(&decoder)));
+    expected_.Add(MakeLargeShape());
+    expected_.Add(s2textformat::MakeLaxPolylineOrDie("-20:-20, 20:20"));
+
+    MutableS2ShapeIndex::Options options;
+    options.set_max_edges_per_cell(1);
+    live_.Init(options);
+    for (int lat : {-5, 12}) {
+      live_.Add(MakeSquare(lat, 5));
+      expected_.Add(MakeSquare(lat, 5));
+    }
+    extra_.Add(s2textformat::MakeLaxPolylineOrDie("3:3, 3:4"));
+    extra_.Add(MakeSquare(30, 30));
+    expected_.Add(s2textformat::MakeLaxPolylineOrDie("3:3, 3:4"));
+    expected_.Add(MakeSquare(30, 30));
+  }
+
+  // Returns a random point near the test geometry.
+  static S2Point RandomPoint() {
+    return S2Testing::SamplePoint(
+        S2Cap(s2textformat::MakePointOrDie("10:10"), S1Angle::Degrees(35)));
+  }
+
+  Encoder encoder_;
+  EncodedS2ShapeIndex encoded_;
+  MutableS2ShapeIndex live_, extra_, expected_;
+};
+
+TEST_F(CompositeS2ShapeIndexTest, ShapeIds) {
+  CompositeS2ShapeIndex index({&encoded_, &live_, &extra_});
+  ASSERT_EQ(3, index.num_indexes());
+  EXPECT_EQ(0, index.shape_id_offset(0));
+  EXPECT_EQ(2, index.shape_id_offset(1));
+  EXPECT_EQ(4, index.shape_id_offset(2));
+  ASSERT_EQ(6, index.num_shape_ids());
+  for (int id = 0; id < index.num_shape_ids(); ++id) {
+    EXPECT_EQ(id, index.shape(id)->id());
+    EXPECT_EQ(expected_.shape(id)->num_edges(), index.shape(id)->num_edges());
+  }
+  // Shapes of the first index are not wrapped.
+  EXPECT_EQ(encoded_.shape(1), index.shape(1));
+  EXPECT_EQ(index.shape(3), index.shape(3));
+
+  // Removed shapes are reported as such.
+  unique_ptr<S2Shape> removed = live_.Release(0);
+  index.Init({&encoded_, &live_, &extra_});
+  EXPECT_EQ(nullptr, index.shape(2));
+}
+
+TEST_F(CompositeS2ShapeIndexTest, CellsAreConsistent) {
+  CompositeS2ShapeIndex index({&encoded_, &live_, &extra_});
+  vector<S2CellId> ids;
+  int num_shared = 0;
+  for (CompositeS2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN);
+       !it.done(); it.Next()) {
+    if (!ids.empty()) {
+      ASSERT_LT(ids.back().range_max(), it.id().range_min());
+    }
+    ids.push_back(it.id());
+    const S2ShapeIndexCell& cell = it.cell();
+    if (cell.num_clipped() > 1) ++num_shared;
+    for (int i = 0; i < cell.num_clipped(); ++i) {
+      const S2ClippedShape& clipped = cell.clipped(i);
+      if (i > 0) {
+        EXPECT_LT(cell.clipped(i - 1).shape_id(), clipped.shape_id());
+      }
+      EXPECT_EQ(s2shapeutil::ContainsBruteForce(
+                    *expected_.shape(clipped.shape_id()), it.center()),
+                clipped.contains_center());
+    }
+  }
+  EXPECT_GT(num_shared, 0);
+
+  // Check that iterating backward and seeking give consistent results.
+  CompositeS2ShapeIndex::Iterator it(&index, S2ShapeIndex::END);
+  for (int i = ids.size(); --i >= 0;) {
+    ASSERT_TRUE(it.Prev());
+    EXPECT_EQ(ids[i], it.id());
+  }
+  EXPECT_FALSE(it.Prev());
+  EXPECT_EQ(ids[0], it.id());
+  for (int i = 0; i < 1000; ++i) {
+    S2CellId target = (i % 2) ? S2CellId(RandomPoint()).parent(
+                                    S2Testing::rnd.Uniform(31))
+                              : ids[S2Testing::rnd.Uniform(ids.size())];
+    it.Seek(target);
+    auto pos = std::lower_bound(ids.begin(), ids.end(), target);
+    if (pos == ids.end()) {
+      EXPECT_TRUE(it.done());
+    } else {
+      EXPECT_EQ(*pos, it.id());
+    }
+  }
+}
+
+TEST_F(CompositeS2ShapeIndexTest, CopiedIterators) {
+  CompositeS2ShapeIndex index({&encoded_, &live_, &extra_});
+  CompositeS2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN);
+  it.Next();
+  ASSERT_FALSE(it.done());
+
+  // A copy is positioned at the same cell, and moves independently.
+  CompositeS2ShapeIndex::Iterator copy(it);
+  EXPECT_EQ(it.id(), copy.id());
+  EXPECT_EQ(&it.cell(), &copy.cell());
+  copy.Next();
+  EXPECT_NE(it.id(), copy.id());
+  ASSERT_TRUE(copy.Prev());
+  EXPECT_EQ(it.id(), copy.id());
+
+  CompositeS2ShapeIndex::Iterator assigned;
+  assigned = it;
+  EXPECT_EQ(it.id(), assigned.id());
+  EXPECT_EQ(&it.cell(), &assigned.cell());
+}
+
+TEST_F(CompositeS2ShapeIndexTest, Queries) {
+  CompositeS2ShapeIndex index({&encoded_, &live_, &extra_});
+  auto contains_query = MakeS2ContainsPointQuery(&index);
+  auto expected_contains_query = MakeS2ContainsPointQuery(&expected_);
+  S2ClosestEdgeQuery closest_query(&index);
+  S2ClosestEdgeQuery expected_closest_query(&expected_);
+  closest_query.mutable_options()->set_max_results(3);
+  expected_closest_query.mutable_options()->set_max_results(3);
+  for (int i = 0; i < 500; ++i) {
+    S2Point p = RandomPoint();
+    vector<int> ids, expected_ids;
+    for (S2Shape* shape : contains_query.GetContainingShapes(p)) {
+      ids.push_back(shape->id());
+    }
+    for (S2Shape* shape : expected_contains_query.GetContainingShapes(p)) {
+      expected_ids.push_back(shape->id());
+    }
+    EXPECT_EQ(expected_ids, ids);
+
+    S2ClosestEdgeQuery::PointTarget target(p);
+    auto results = closest_query.FindClosestEdges(&target);
+    auto expected_results = expected_closest_query.FindClosestEdges(&target);
+    ASSERT_EQ(expected_results.size(), results.size());
+    for (int j = 0; j < results.size(); ++j) {
+      EXPECT_EQ(expected_results[j].distance(), results[j].distance());
+    }
+  }
+  EXPECT_TRUE(S2BooleanOperation::Equals(expected_, index));
+
+  MutableS2ShapeIndex probe;
+  probe.Add(MakeSquare(16, 10));
+  EXPECT_TRUE(S2BooleanOperation::Intersects(index, probe));
+  EXPECT_FALSE(S2BooleanOperation::Contains(probe, index));
+}
+
+}  // namespace
@@ -0,0 +1,66 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/encoded_s2cell_union.h"
+
+#include "s2/base/logging.h"
+
+namespace s2coding {
+
+void EncodeS2CellUnion(const S2CellUnion& cell_union, Encoder* encoder) {
+  EncodeS2CellIdVector(cell_union.cell_ids(), encoder);
+}
+
+bool EncodedS2CellUnion::Init(Decoder* decoder) {
+  return cell_ids_.Init(decoder);
+}
+
+bool EncodedS2CellUnion::Contains(S2CellId id) const {
+  // Since the cells are sorted and disjoint, the only cells that can contain
+  // "id" are the first cell whose id is at least "id" and its predecessor.
+  S2_DCHECK(id.is_valid()) << id;
+  size_t i = cell_ids_.lower_bound(id);
+  if (i < size() && cell_ids_[i].contains(id)) return true;
+  return i > 0 && cell_ids_[i - 1].contains(id);
+}
+
+bool EncodedS2CellUnion::Intersects(S2CellId id) const {
+  // Similarly, the only cells that can intersect "id" without starting
+  // within its range are the predecessor of its first leaf cell.
+  S2_DCHECK(id.is_valid()) << id;
+  size_t i = cell_ids_.lower_bound(id.range_min());
+  if (i < size() && cell_ids_[i].range_min() <= id.range_max()) return true;
+  return i > 0 && cell_ids_[i - 1].range_max() >= id.range_min();
+}
+
+bool EncodedS2CellUnion::Contains(const S2CellUnion& y) const {
+  for (S2CellId y_id : y) {
+    if (!Contains(y_id)) return false;
+  }
+  return true;
+}
+
+bool EncodedS2CellUnion::Intersects(const S2CellUnion& y) const {
+  for (S2CellId y_id : y) {
+    if (Intersects(y_id)) return true;
+  }
+  return false;
+}
+
+S2CellUnion EncodedS2CellUnion::Decode() const {
+  return S2CellUnion::FromVerbatim(cell_ids_.Decode());
+}
+
+}  // namespace s2coding
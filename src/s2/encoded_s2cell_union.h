@@ -0,0 +1,106 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_ENCODED_S2CELL_UNION_H_
+#define S2_ENCODED_S2CELL_UNION_H_
+
+#include <cstddef>
+
+#include "s2/encoded_s2cell_id_vector.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2point.h"
+
+namespace s2coding {
+
+// Encodes an S2CellUnion in a format that can later be decoded as an
+// EncodedS2CellUnion.  This encoding is usually much smaller than the one
+// produced by S2CellUnion::Encode(), since the cell ids are stored as
+// variable-length deltas from a common base (see EncodeS2CellIdVector).
+//
+// REQUIRES: "encoder" uses the default constructor, so that its buffer
+//           can be enlarged as necessary by calling Ensure(int).
+void EncodeS2CellUnion(const S2CellUnion& cell_union, Encoder* encoder);
+
+// This class represents an S2CellUnion encoded by EncodeS2CellUnion().  It
+// supports the usual S2CellUnion containment and intersection queries
+// directly on the encoded data, decoding only the cell ids visited by the
+// binary search.  Initialization takes constant time and no memory is used
+// beyond the encoded data, which is not owned by this class.  Example usage:
+//
+//   Encoder encoder;
+//   s2coding::EncodeS2CellUnion(covering, &encoder);
+//   ...
+//   Decoder decoder(data, size);
+//   s2coding::EncodedS2CellUnion cell_union;
+//   if (!cell_union.Init(&decoder)) return false;
+//   if (cell_union.Contains(S2CellId(point))) ...
+//
+// All query methods require that the original S2CellUnion was valid (see
+// S2CellUnion::IsValid), which is always true for S2CellUnions constructed
+// normally.
+class EncodedS2CellUnion {
+ public:
+  // Constructs an uninitialized object; requires Init() to be called.
+  EncodedS2CellUnion() {}
+
+  // Initializes the EncodedS2CellUnion.  Returns false if the encoded data
+  // is invalid.
+  //
+  // REQUIRES: The Decoder data buffer must outlive this object.
+  bool Init(Decoder* decoder);
+
+  // Returns the number of cells in the union.
+  size_t size() const { return cell_ids_.size(); }
+  bool empty() const { return size() == 0; }
+
+  // Returns the cell at the given index.
+  S2CellId cell_id(int i) const { return cell_ids_[i]; }
+
+  // Returns true if the cell union contains the given cell id.  Containment
+  // is defined with respect to regions, as in S2CellUnion::Contains().
+  bool Contains(S2CellId id) const;
+
+  // Returns true if the cell union intersects the given cell id.
+  bool Intersects(S2CellId id) const;
+
+  // Returns true if the cell union contains the given point.  The point does
+  // not need to be normalized.
+  bool Contains(const S2Point& p) const;
+
+  // Returns true if the cell union contains or intersects the given
+  // S2CellUnion.  These take time O(m log n), where "m" is the size of "y"
+  // and "n" is the size of this union.
+  bool Contains(const S2CellUnion& y) const;
+  bool Intersects(const S2CellUnion& y) const;
+
+  // Decodes and returns the entire original S2CellUnion.
+  S2CellUnion Decode() const;
+
+ private:
+  EncodedS2CellIdVector cell_ids_;
+};
+
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+inline bool EncodedS2CellUnion::Contains(const S2Point& p) const {
+  return Contains(S2CellId(p));
+}
+
+}  // namespace s2coding
+
+#endif  // S2_ENCODED_S2CELL_UNION_H_
@@ -0,0 +1,109 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/encoded_s2cell_union.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2region_coverer.h"
+#include "s2/s2testing.h"
+
+using std::vector;
+
+namespace s2coding {
+namespace {
+
+// Encodes the given S2CellUnion and returns the corresponding
+// EncodedS2CellUnion (which points into the Encoder's data buffer).
+EncodedS2CellUnion MakeEncodedS2CellUnion(const S2CellUnion& cell_union,
+                                          Encoder* encoder) {
+  EncodeS2CellUnion(cell_union, encoder);
+  Decoder decoder(encoder->base(), encoder->length());
+  EncodedS2CellUnion encoded;
+  EXPECT_TRUE(encoded.Init(&decoder));
+  return encoded;
+}
+
+TEST(EncodedS2CellUnion, Empty) {
+  Encoder encoder;
+  EncodedS2CellUnion encoded = MakeEncodedS2CellUnion(S2CellUnion(), &encoder);
+  EXPECT_TRUE(encoded.empty());
+  EXPECT_FALSE(encoded.Contains(S2CellId::FromFace(0)));
+  EXPECT_FALSE(encoded.Intersects(S2CellId::FromFace(0)));
+  EXPECT_TRUE(encoded.Contains(S2CellUnion()));
+  EXPECT_EQ(S2CellUnion(), encoded.Decode());
+}
+
+TEST(EncodedS2CellUnion, WholeSphere) {
+  Encoder encoder;
+  EncodedS2CellUnion encoded =
+      MakeEncodedS2CellUnion(S2CellUnion::WholeSphere(), &encoder);
+  EXPECT_EQ(6, encoded.size());
+  EXPECT_TRUE(encoded.Contains(S2CellId::Begin(S2CellId::kMaxLevel)));
+  EXPECT_TRUE(encoded.Contains(S2CellId::FromFace(5).child_end().prev()));
+  EXPECT_TRUE(encoded.Contains(S2Point(0, 0, -1)));
+}
+
+TEST(EncodedS2CellUnion, SmallerThanS2CellUnionEncoding) {
+  S2RegionCoverer::Options options;
+  options.set_max_cells(20);
+  S2RegionCoverer coverer(options);
+  S2CellUnion covering = coverer.GetCovering(
+      S2Cap(S2Point(1, 1, 1).Normalize(), S1Angle::Degrees(1)));
+  Encoder raw, compact;
+  covering.Encode(&raw);
+  EncodedS2CellUnion encoded = MakeEncodedS2CellUnion(covering, &compact);
+  EXPECT_LT(2 * compact.length(), raw.length());
+  EXPECT_EQ(covering, encoded.Decode());
+}
+
+TEST(EncodedS2CellUnion, MatchesS2CellUnion) {
+  for (int iter = 0; iter < 100; ++iter) {
+    S2RegionCoverer::Options options;
+    options.set_max_cells(1 + S2Testing::rnd.Uniform(50));
+    S2RegionCoverer coverer(options);
+    S2Cap cap = S2Testing::GetRandomCap(1e-8, 0.1);
+    S2CellUnion covering = coverer.GetCovering(cap);
+    Encoder encoder;
+    EncodedS2CellUnion encoded = MakeEncodedS2CellUnion(covering, &encoder);
+    ASSERT_EQ(covering.size(), encoded.size());
+    for (int i = 0; i < covering.size(); ++i) {
+      EXPECT_EQ(covering.cell_id(i), encoded.cell_id(i));
+    }
+    for (int i = 0; i < 100; ++i) {
+      // Choose cells near the cap so that some of them intersect it.
+      S2Point p = S2Testing::SamplePoint(
+          S2Cap(cap.center(), 2 * cap.GetRadius()));
+      S2CellId id =
+          S2CellId(p).parent(S2Testing::rnd.Uniform(S2CellId::kMaxLevel + 1));
+      EXPECT_EQ(covering.Contains(id), encoded.Contains(id));
+      EXPECT_EQ(covering.Intersects(id), encoded.Intersects(id));
+      EXPECT_EQ(covering.Contains(p), encoded.Contains(p));
+    }
+    S2CellUnion other = coverer.GetCovering(S2Testing::GetRandomCap(1e-8, 0.1));
+    EXPECT_EQ(covering.Contains(other), encoded.Contains(other));
+    EXPECT_EQ(covering.Intersects(other), encoded.Intersects(other));
+    EXPECT_TRUE(encoded.Contains(covering));
+    EXPECT_TRUE(encoded.Intersects(covering));
+  }
+}
+
+}  // namespace
+}  // namespace s2coding
@@ -0,0 +1,108 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/encoded_s2point_index.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "s2/util/coding/varint.h"
+
+using std::unique_ptr;
+using std::vector;
+
+// The current version of the encoding format.
+static constexpr unsigned char kCurrentEncodingVersionNumber = 0;
+
+void EncodeS2PointIndex(const S2PointIndex<int>& index,
+                        s2coding::CodingHint hint, Encoder* encoder) {
+  vector<S2CellId> cell_ids;
+  vector<S2Point> points;
+  vector<uint32> data;
+  cell_ids.reserve(index.num_points());
+  points.reserve(index.num_points());
+  data.reserve(index.num_points());
+  for (S2PointIndex<int>::Iterator it(&index); !it.done(); it.Next()) {
+    cell_ids.push_back(it.id());
+    points.push_back(it.point());
+    data.push_back(static_cast<uint32>(it.data()));
+  }
+  encoder->Ensure(Varint::kMax32);
+  encoder->put_varint32(kCurrentEncodingVersionNumber);
+  s2coding::EncodeS2CellIdVector(cell_ids, encoder);
+  s2coding::EncodeS2PointVector(points, hint, encoder);
+  s2coding::EncodeUintVector<uint32>(data, encoder);
+}
+
+EncodedS2PointIndex::EncodedS2PointIndex() {
+}
+
+EncodedS2PointIndex::~EncodedS2PointIndex() {
+  ReleaseBlocks();
+}
+
+void EncodedS2PointIndex::ReleaseBlocks() {
+  for (auto& block : blocks_) {
+    delete[] block.load(std::memory_order_relaxed);
+  }
+  blocks_.clear();
+}
+
+bool EncodedS2PointIndex::Init(Decoder* decoder) {
+  // Release any blocks decoded from previously initialized data.
+  ReleaseBlocks();
+  uint32 version;
+  if (!decoder->get_varint32(&version)) return false;
+  if (version != kCurrentEncodingVersionNumber) return false;
+  if (!cell_ids_.Init(decoder)) return false;
+  if (!points_.Init(decoder)) return false;
+  if (!data_.Init(decoder)) return false;
+  if (points_.size() != cell_ids_.size() ||
+      data_.size() != cell_ids_.size()) {
+    return false;
+  }
+  // All blocks are initially nullptr (i.e., not decoded).
+  int num_blocks = (cell_ids_.size() + kBlockSize - 1) / kBlockSize;
+  blocks_ = vector<std::atomic<PointData*>>(num_blocks);
+  return true;
+}
+
+const EncodedS2PointIndex::PointData* EncodedS2PointIndex::DecodeBlock(
+    int block) const {
+  // This method is called when a block has not been decoded yet.
+  int begin = block * kBlockSize;
+  int end = std::min<int>(begin + kBlockSize, num_points());
+  unique_ptr<PointData[]> data(new PointData[end - begin]);
+  for (int i = begin; i < end; ++i) {
+    data[i - begin] = PointData(points_[i], static_cast<int>(data_[i]));
+  }
+  PointData* expected = nullptr;
+  if (blocks_[block].compare_exchange_strong(expected, data.get(),
+                                             std::memory_order_acq_rel)) {
+    return data.release();  // Ownership has been transferred to blocks_.
+  }
+  return expected;  // Another thread updated blocks_[block] first.
+}
+
+size_t EncodedS2PointIndex::SpaceUsed() const {
+  size_t size = sizeof(*this);
+  size += blocks_.capacity() * sizeof(blocks_[0]);
+  for (const auto& block : blocks_) {
+    if (block.load(std::memory_order_relaxed) != nullptr) {
+      size += kBlockSize * sizeof(PointData);
+    }
+  }
+  return size;
+}
@@ -0,0 +1,247 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_ENCODED_S2POINT_INDEX_H_
+#define S2_ENCODED_S2POINT_INDEX_H_
+
+#include <atomic>
+#include <vector>
+
+#include "s2/base/integral_types.h"
+#include "s2/base/logging.h"
+#include "s2/util/coding/coder.h"
+#include "s2/encoded_s2cell_id_vector.h"
+#include "s2/encoded_s2point_vector.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2point.h"
+#include "s2/s2point_index.h"
+#include "s2/s2shape.h"
+
+// Encodes an S2PointIndex<int> in a format that can later be decoded as an
+// EncodedS2PointIndex.  The "hint" is used to encode the points as described
+// in EncodeS2PointVector (COMPACT is much smaller when the points have been
+// snapped to S2CellId centers).
+//
+// REQUIRES: "encoder" uses the default constructor, so that its buffer
+//           can be enlarged as necessary by calling Ensure(int).
+void EncodeS2PointIndex(const S2PointIndex<int>& index,
+                        s2coding::CodingHint hint, Encoder* encoder);
+
+// EncodedS2PointIndex is a read-only version of S2PointIndex<int> that works
+// directly with encoded data.  It can be initialized in constant time, and
+// points are decoded incrementally (in small blocks) as they are visited.
+// This makes startup nearly instantaneous for large static collections of
+// points, e.g. when the encoded data is a memory-mapped file.
+//
+// It supports the same Iterator API as S2PointIndex, and can be queried using
+// S2ClosestPointQueryBase.  For example:
+//
+//   Encoder encoder;
+//   EncodeS2PointIndex(index, s2coding::CodingHint::COMPACT, &encoder);
+//   ...
+//   Decoder decoder(encoded.data(), encoded.size());
+//   EncodedS2PointIndex encoded_index;
+//   encoded_index.Init(&decoder);
+//   S2ClosestPointQueryBase<S2MinDistance, int, EncodedS2PointIndex> query(
+//       &encoded_index);
+//
+// Note that EncodedS2PointIndex does not make a copy of the encoded data, and
+// therefore the client must ensure that this data outlives the
+// EncodedS2PointIndex object.
+//
+// EncodedS2PointIndex is thread-compatible, meaning that const methods are
+// thread safe, and non-const methods are not thread safe.
+class EncodedS2PointIndex {
+ public:
+  using PointData = S2PointIndex<int>::PointData;
+
+  // Creates an index that must be initialized by calling Init().
+  EncodedS2PointIndex();
+  ~EncodedS2PointIndex();
+
+  // Initializes the EncodedS2PointIndex, returning true on success.  Init()
+  // may be called more than once, in which case any points decoded from the
+  // previous data are released.
+  //
+  // REQUIRES: The Decoder data buffer must outlive this object.
+  bool Init(Decoder* decoder);
+
+  // Returns the number of points in the index.
+  int num_points() const { return cell_ids_.size(); }
+
+  // Returns the number of bytes currently occupied by the index, not
+  // including the encoded data.
+  size_t SpaceUsed() const;
+
+  // The Iterator class has the same API as S2PointIndex::Iterator.
+  class Iterator {
+   public:
+    // Default constructor; must be followed by a call to Init().
+    Iterator();
+
+    // Convenience constructor that calls Init().
+    explicit Iterator(const EncodedS2PointIndex* index);
+
+    // Initializes an iterator for the given EncodedS2PointIndex.  The
+    // iterator is positioned at the first point.
+    void Init(const EncodedS2PointIndex* index);
+
+    // The S2CellId for the current index entry.
+    // REQUIRES: !done()
+    S2CellId id() const;
+
+    // The point associated with the current index entry.
+    // REQUIRES: !done()
+    const S2Point& point() const;
+
+    // The client-supplied data associated with the current index entry.
+    // REQUIRES: !done()
+    const int& data() const;
+
+    // The (S2Point, data) pair associated with the current index entry.
+    // REQUIRES: !done()
+    const PointData& point_data() const;
+
+    // Returns true if the iterator is positioned past the last index entry.
+    bool done() const;
+
+    // Positions the iterator at the first index entry (if any).
+    void Begin();
+
+    // Positions the iterator so that done() is true.
+    void Finish();
+
+    // Advances the iterator to the next index entry.
+    // REQUIRES: !done()
+    void Next();
+
+    // If the iterator is already positioned at the beginning, returns false.
+    // Otherwise positions the iterator at the previous entry and returns true.
+    bool Prev();
+
+    // Positions the iterator at the first entry with id() >= target, or at
+    // the end of the index if no such entry exists.
+    void Seek(S2CellId target);
+
+   private:
+    const EncodedS2PointIndex* index_;
+    int32 pos_;  // Current position in the sorted vector of points.
+    int32 num_points_;
+  };
+
+ private:
+  // Points are decoded in blocks of this size, which amortizes the cost of
+  // allocating and publishing each block.
+  static constexpr int kBlockSize = 64;
+
+  // Returns the decoded PointData for the point at position "i".
+  const PointData& point_data(int i) const;
+
+  // Decodes the given block of points (see blocks_).
+  const PointData* DecodeBlock(int block) const;
+
+  // Deletes all decoded blocks and clears blocks_.
+  void ReleaseBlocks();
+
+  // The leaf S2CellIds, points, and data of the index in sorted order.
+  s2coding::EncodedS2CellIdVector cell_ids_;
+  s2coding::EncodedS2PointVector points_;
+  s2coding::EncodedUintVector<uint32> data_;
+
+  // The decoded PointData for each block of kBlockSize points, or nullptr if
+  // that block has not been decoded yet.  Blocks are added using
+  // std::atomic::compare_exchange_strong.
+  mutable std::vector<std::atomic<PointData*>> blocks_;
+
+  EncodedS2PointIndex(const EncodedS2PointIndex&) = delete;
+  void operator=(const EncodedS2PointIndex&) = delete;
+};
+
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+inline const EncodedS2PointIndex::PointData& EncodedS2PointIndex::point_data(
+    int i) const {
+  const PointData* block =
+      blocks_[i / kBlockSize].load(std::memory_order_acquire);
+  if (block == nullptr) block = DecodeBlock(i / kBlockSize);
+  return block[i % kBlockSize];
+}
+
+inline EncodedS2PointIndex::Iterator::Iterator()
+    : index_(nullptr), pos_(0), num_points_(0) {
+}
+
+inline EncodedS2PointIndex::Iterator::Iterator(
+    const EncodedS2PointIndex* index) {
+  Init(index);
+}
+
+inline void EncodedS2PointIndex::Iterator::Init(
+    const EncodedS2PointIndex* index) {
+  index_ = index;
+  pos_ = 0;
+  num_points_ = index->num_points();
+}
+
+inline S2CellId EncodedS2PointIndex::Iterator::id() const {
+  S2_DCHECK(!done());
+  return index_->cell_ids_[pos_];
+}
+
+inline const S2Point& EncodedS2PointIndex::Iterator::point() const {
+  return point_data().point();
+}
+
+inline const int& EncodedS2PointIndex::Iterator::data() const {
+  return point_data().data();
+}
+
+inline const EncodedS2PointIndex::PointData&
+EncodedS2PointIndex::Iterator::point_data() const {
+  S2_DCHECK(!done());
+  return index_->point_data(pos_);
+}
+
+inline bool EncodedS2PointIndex::Iterator::done() const {
+  return pos_ == num_points_;
+}
+
+inline void EncodedS2PointIndex::Iterator::Begin() {
+  pos_ = 0;
+}
+
+inline void EncodedS2PointIndex::Iterator::Finish() {
+  pos_ = num_points_;
+}
+
+inline void EncodedS2PointIndex::Iterator::Next() {
+  S2_DCHECK(!done());
+  ++pos_;
+}
+
+inline bool EncodedS2PointIndex::Iterator::Prev() {
+  if (pos_ == 0) return false;
+  --pos_;
+  return true;
+}
+
+inline void EncodedS2PointIndex::Iterator::Seek(S2CellId target) {
+  pos_ = index_->cell_ids_.lower_bound(target);
+}
+
+#endif  // S2_ENCODED_S2POINT_INDEX_H_
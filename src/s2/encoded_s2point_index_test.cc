@@ -0,0 +1,161 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/encoded_s2point_index.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2closest_point_query.h"
+#include "s2/s2closest_point_query_base.h"
+#include "s2/s2testing.h"
+
+using s2coding::CodingHint;
+using std::vector;
+
+namespace {
+
+using EncodedQuery =
+    S2ClosestPointQueryBase<S2MinDistance, int, EncodedS2PointIndex>;
+
+// Encodes "index" into "encoder" and initializes "encoded_index" from it.
+void Encode(const S2PointIndex<int>& index, CodingHint hint, Encoder* encoder,
+            EncodedS2PointIndex* encoded_index) {
+  EncodeS2PointIndex(index, hint, encoder);
+  Decoder decoder(encoder->base(), encoder->length());
+  ASSERT_TRUE(encoded_index->Init(&decoder));
+}
+
+TEST(EncodedS2PointIndex, Empty) {
+  S2PointIndex<int> index;
+  Encoder encoder;
+  EncodedS2PointIndex encoded_index;
+  Encode(index, CodingHint::COMPACT, &encoder, &encoded_index);
+  EXPECT_EQ(0, encoded_index.num_points());
+  EncodedS2PointIndex::Iterator it(&encoded_index);
+  EXPECT_TRUE(it.done());
+  EXPECT_FALSE(it.Prev());
+}
+
+TEST(EncodedS2PointIndex, InvalidData) {
+  Decoder decoder("\x05", 1);
+  EncodedS2PointIndex encoded_index;
+  EXPECT_FALSE(encoded_index.Init(&decoder));
+}
+
+TEST(EncodedS2PointIndex, InitTwice) {
+  // Check that decoded blocks are released when the index is reinitialized.
+  S2PointIndex<int> index1, index2;
+  for (int i = 0; i < 1000; ++i) index1.Add(S2Testing::RandomPoint(), i);
+  for (int i = 0; i < 10; ++i) index2.Add(S2Testing::RandomPoint(), -i);
+  Encoder encoder1, encoder2;
+  EncodedS2PointIndex encoded_index, fresh_index;
+  Encode(index2, CodingHint::COMPACT, &encoder2, &fresh_index);
+  Encode(index1, CodingHint::COMPACT, &encoder1, &encoded_index);
+  for (EncodedS2PointIndex::Iterator it(&encoded_index); !it.done();
+       it.Next()) {
+    it.point_data();  // Decodes every block.
+  }
+  EXPECT_GT(encoded_index.SpaceUsed(), fresh_index.SpaceUsed());
+
+  Decoder decoder(encoder2.base(), encoder2.length());
+  ASSERT_TRUE(encoded_index.Init(&decoder));
+  EXPECT_EQ(index2.num_points(), encoded_index.num_points());
+  EXPECT_EQ(fresh_index.SpaceUsed(), encoded_index.SpaceUsed());
+  S2PointIndex<int>::Iterator it(&index2);
+  EncodedS2PointIndex::Iterator encoded_it(&encoded_index);
+  for (; !it.done(); it.Next(), encoded_it.Next()) {
+    ASSERT_FALSE(encoded_it.done());
+    EXPECT_EQ(it.point_data(), encoded_it.point_data());
+  }
+  EXPECT_TRUE(encoded_it.done());
+}
+
+TEST(EncodedS2PointIndex, IteratorMatchesS2PointIndex) {
+  for (CodingHint hint : {CodingHint::FAST, CodingHint::COMPACT}) {
+    S2PointIndex<int> index;
+    for (int i = 0; i < 1000; ++i) {
+      // Add some duplicates and some points snapped to cell centers.
+      S2Point point = S2Testing::RandomPoint();
+      if (i % 2 == 0) point = S2CellId(point).parent(20).ToPoint();
+      index.Add(point, i - 500);
+      if (i % 10 == 0) index.Add(point, i);
+    }
+    Encoder encoder;
+    EncodedS2PointIndex encoded_index;
+    Encode(index, hint, &encoder, &encoded_index);
+    EXPECT_EQ(index.num_points(), encoded_index.num_points());
+
+    S2PointIndex<int>::Iterator it(&index);
+    EncodedS2PointIndex::Iterator encoded_it(&encoded_index);
+    for (; !it.done(); it.Next(), encoded_it.Next()) {
+      ASSERT_FALSE(encoded_it.done());
+      EXPECT_EQ(it.id(), encoded_it.id());
+      EXPECT_EQ(it.point(), encoded_it.point());
+      EXPECT_EQ(it.data(), encoded_it.data());
+    }
+    EXPECT_TRUE(encoded_it.done());
+
+    for (int i = 0; i < 100; ++i) {
+      S2CellId target = S2Testing::GetRandomCellId();
+      it.Seek(target);
+      encoded_it.Seek(target);
+      ASSERT_EQ(it.done(), encoded_it.done());
+      if (!it.done()) {
+        EXPECT_EQ(it.id(), encoded_it.id());
+      }
+      ASSERT_EQ(it.Prev(), encoded_it.Prev());
+      EXPECT_EQ(it.id(), encoded_it.id());
+    }
+    EXPECT_GT(encoded_index.SpaceUsed(), sizeof(encoded_index));
+  }
+}
+
+TEST(EncodedS2PointIndex, ClosestPointQuery) {
+  S2PointIndex<int> index;
+  S2Cap cap(S2Testing::RandomPoint(), S2Testing::KmToAngle(100));
+  for (int i = 0; i < 10000; ++i) {
+    index.Add(S2Testing::SamplePoint(cap), i);
+  }
+  Encoder encoder;
+  EncodedS2PointIndex encoded_index;
+  Encode(index, CodingHint::COMPACT, &encoder, &encoded_index);
+
+  S2ClosestPointQuery<int> query(&index);
+  EncodedQuery encoded_query(&encoded_index);
+  EncodedQuery::Options options;
+  for (int max_results : {1, 10}) {
+    query.mutable_options()->set_max_results(max_results);
+    options.set_max_results(max_results);
+    for (int i = 0; i < 20; ++i) {
+      S2Point target_point = S2Testing::SamplePoint(cap);
+      S2ClosestPointQuery<int>::PointTarget target(target_point);
+      auto expected = query.FindClosestPoints(&target);
+      auto actual = encoded_query.FindClosestPoints(&target, options);
+      ASSERT_EQ(expected.size(), actual.size());
+      for (int j = 0; j < expected.size(); ++j) {
+        EXPECT_EQ(expected[j].distance(), actual[j].distance());
+        EXPECT_EQ(expected[j].point(), actual[j].point());
+        EXPECT_EQ(expected[j].data(), actual[j].data());
+      }
+    }
+  }
+}
+
+}  // namespace
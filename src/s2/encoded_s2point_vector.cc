@@ -21,6 +21,7 @@
 
 #include "absl/base/internal/unaligned_access.h"
 #include "absl/numeric/bits.h"
+#include "s2/encoded_s2point_vector_internal.h"
 #include "s2/util/bits/bits.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2coords.h"
@@ -33,47 +34,23 @@ using std::vector;
 
 namespace s2coding {
 
-// Like util_bits::InterleaveUint32, but interleaves bit pairs rather than
-// individual bits.  This format is faster to decode than the fully interleaved
-// format, and produces the same results for our use case.
+// The BMI2 versions are used only when the library is compiled for
+// processors that support BMI2 (see util/bits/bit-interleave.cc).
 inline uint64 InterleaveUint32BitPairs(const uint32 val0, const uint32 val1) {
-  uint64 v0 = val0, v1 = val1;
-  v0 = (v0 | (v0 << 16)) & 0x0000ffff0000ffff;
-  v1 = (v1 | (v1 << 16)) & 0x0000ffff0000ffff;
-  v0 = (v0 | (v0 << 8)) & 0x00ff00ff00ff00ff;
-  v1 = (v1 | (v1 << 8)) & 0x00ff00ff00ff00ff;
-  v0 = (v0 | (v0 << 4)) & 0x0f0f0f0f0f0f0f0f;
-  v1 = (v1 | (v1 << 4)) & 0x0f0f0f0f0f0f0f0f;
-  v0 = (v0 | (v0 << 2)) & 0x3333333333333333;
-  v1 = (v1 | (v1 << 2)) & 0x3333333333333333;
-  return v0 | (v1 << 2);
+#ifdef __BMI2__
+  return internal::InterleaveUint32BitPairsBmi2(val0, val1);
+#else
+  return internal::InterleaveUint32BitPairsPortable(val0, val1);
+#endif
 }
 
-// This code is about 50% faster than util_bits::DeinterleaveUint32, which
-// uses a lookup table.  The speed advantage is expected to be even larger in
-// code that mixes bit interleaving with other significant operations since it
-// doesn't require keeping a 256-byte lookup table in the L1 data cache.
 inline void DeinterleaveUint32BitPairs(uint64 code,
                                        uint32 *val0, uint32 *val1) {
-  uint64 v0 = code, v1 = code >> 2;
-  v0 &= 0x3333333333333333;
-  v0 |= v0 >> 2;
-  v1 &= 0x3333333333333333;
-  v1 |= v1 >> 2;
-  v0 &= 0x0f0f0f0f0f0f0f0f;
-  v0 |= v0 >> 4;
-  v1 &= 0x0f0f0f0f0f0f0f0f;
-  v1 |= v1 >> 4;
-  v0 &= 0x00ff00ff00ff00ff;
-  v0 |= v0 >> 8;
-  v1 &= 0x00ff00ff00ff00ff;
-  v1 |= v1 >> 8;
-  v0 &= 0x0000ffff0000ffff;
-  v0 |= v0 >> 16;
-  v1 &= 0x0000ffff0000ffff;
-  v1 |= v1 >> 16;
-  *val0 = v0;
-  *val1 = v1;
+#ifdef __BMI2__
+  internal::DeinterleaveUint32BitPairsBmi2(code, val0, val1);
+#else
+  internal::DeinterleaveUint32BitPairsPortable(code, val0, val1);
+#endif
 }
 
 // Forward declarations.
@@ -122,14 +99,29 @@ bool EncodedS2PointVector::Init(Decoder* decoder) {
 }
 
 vector<S2Point> EncodedS2PointVector::Decode() const {
-  vector<S2Point> points;
-  points.reserve(size_);
-  for (int i = 0; i < size_; ++i) {
-    points.push_back((*this)[i]);
-  }
+  vector<S2Point> points(size_);
+  DecodeRange(0, size_, points.data());
   return points;
 }
 
+void EncodedS2PointVector::DecodeRange(int begin, int end,
+                                       S2Point* output) const {
+  S2_DCHECK(0 <= begin && begin <= end && end <= size_);
+  switch (format_) {
+    case Format::UNCOMPRESSED:
+      std::copy(uncompressed_.points + begin, uncompressed_.points + end,
+                output);
+      break;
+
+    case Format::CELL_IDS:
+      DecodeCellIdsFormatRange(begin, end, output);
+      break;
+
+    default:
+      S2_LOG(DFATAL) << "Unrecognized format";
+  }
+}
+
 // The encoding must be identical to EncodeS2PointVector().
 void EncodedS2PointVector::Encode(Encoder* encoder) const {
   switch (format_) {
@@ -811,11 +803,18 @@ bool EncodedS2PointVector::InitCellIdsFormat(Decoder* decoder) {
   return true;
 }
 
-S2Point EncodedS2PointVector::DecodeCellIdsFormat(int i) const {
-  // This function inverts the encodings documented above.
+// The decoded header of a block in CELL_IDS format.
+struct EncodedS2PointVector::CellIdsBlock {
+  const char* deltas;      // The start of the packed deltas.
+  const char* exceptions;  // The start of the exceptions (if any).
+  uint64 offset;           // The offset added to every delta.
+  int delta_nibbles;       // The number of nibbles per delta.
+};
 
-  // First we decode the block header.
-  const char* ptr = cell_ids_.blocks.GetStart(i >> kBlockShift);
+inline void EncodedS2PointVector::DecodeCellIdsBlock(
+    int block, CellIdsBlock* result) const {
+  // This function inverts the encodings documented above.
+  const char* ptr = cell_ids_.blocks.GetStart(block);
   uint8 header = *ptr++;
   int overlap_nibbles = (header >> 3) & 1;
   int offset_bytes = (header & 7) + overlap_nibbles;
@@ -823,13 +822,23 @@ S2Point EncodedS2PointVector::DecodeCellIdsFormat(int i) const {
 
   // Decode the offset for this block.
   int offset_shift = (delta_nibbles - overlap_nibbles) << 2;
-  uint64 offset = GetUintWithLength<uint64>(ptr, offset_bytes) << offset_shift;
+  result->offset = GetUintWithLength<uint64>(ptr, offset_bytes) << offset_shift;
   ptr += offset_bytes;
+  result->deltas = ptr;
+  result->delta_nibbles = delta_nibbles;
+  if (cell_ids_.have_exceptions) {
+    int block_size = min<int>(kBlockSize, size_ - block * kBlockSize);
+    result->exceptions = ptr + ((block_size * delta_nibbles + 1) >> 1);
+  }
+}
 
+inline S2Point EncodedS2PointVector::DecodeCellIdsValue(
+    const CellIdsBlock& block, int j) const {
   // Decode the delta for the requested value.
-  int delta_nibble_offset = (i & (kBlockSize - 1)) * delta_nibbles;
+  int delta_nibbles = block.delta_nibbles;
+  int delta_nibble_offset = j * delta_nibbles;
   int delta_bytes = (delta_nibbles + 1) >> 1;
-  const char* delta_ptr = ptr + (delta_nibble_offset >> 1);
+  const char* delta_ptr = block.deltas + (delta_nibble_offset >> 1);
   uint64 delta = GetUintWithLength<uint64>(delta_ptr, delta_bytes);
   delta >>= (delta_nibble_offset & 1) << 2;
   delta &= BitMask(delta_nibbles << 2);
@@ -837,16 +846,14 @@ S2Point EncodedS2PointVector::DecodeCellIdsFormat(int i) const {
   // Test whether this point is encoded as an exception.
   if (cell_ids_.have_exceptions) {
     if (delta < kBlockSize) {
-      int block_size = min(kBlockSize, size_ - (i & ~(kBlockSize - 1)));
-      ptr += (block_size * delta_nibbles + 1) >> 1;
-      ptr += delta * sizeof(S2Point);
-      return *reinterpret_cast<const S2Point*>(ptr);
+      return *reinterpret_cast<const S2Point*>(block.exceptions +
+                                               delta * sizeof(S2Point));
     }
     delta -= kBlockSize;
   }
 
   // Otherwise convert the 64-bit value back to an S2Point.
-  uint64 value = cell_ids_.base + offset + delta;
+  uint64 value = cell_ids_.base + block.offset + delta;
   int shift = S2CellId::kMaxLevel - cell_ids_.level;
 
   // The S2CellId version of the following code is:
@@ -860,4 +867,34 @@ S2Point EncodedS2PointVector::DecodeCellIdsFormat(int i) const {
                          S2::STtoUV(S2::SiTitoST(ti))).Normalize();
 }
 
+S2Point EncodedS2PointVector::DecodeCellIdsFormat(int i) const {
+  CellIdsBlock block;
+  DecodeCellIdsBlock(i >> kBlockShift, &block);
+  return DecodeCellIdsValue(block, i & (kBlockSize - 1));
+}
+
+S2Shape::Edge EncodedS2PointVector::DecodeCellIdsFormatEdge(int i,
+                                                            int j) const {
+  CellIdsBlock block;
+  DecodeCellIdsBlock(i >> kBlockShift, &block);
+  S2Point v0 = DecodeCellIdsValue(block, i & (kBlockSize - 1));
+  if ((i >> kBlockShift) != (j >> kBlockShift)) {
+    DecodeCellIdsBlock(j >> kBlockShift, &block);
+  }
+  return S2Shape::Edge(v0, DecodeCellIdsValue(block, j & (kBlockSize - 1)));
+}
+
+void EncodedS2PointVector::DecodeCellIdsFormatRange(int begin, int end,
+                                                    S2Point* output) const {
+  // Each block header is decoded only once.
+  CellIdsBlock block;
+  while (begin < end) {
+    DecodeCellIdsBlock(begin >> kBlockShift, &block);
+    int block_end = min<int>(end, (begin | (kBlockSize - 1)) + 1);
+    for (int j = begin & (kBlockSize - 1); begin < block_end; ++begin, ++j) {
+      *output++ = DecodeCellIdsValue(block, j);
+    }
+  }
+}
+
 }  // namespace s2coding
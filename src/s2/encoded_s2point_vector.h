@@ -62,6 +62,17 @@ class EncodedS2PointVector {
   // Returns the element at the given index.
   S2Point operator[](int i) const;
 
+  // Returns the edge (v[i], v[j]), where "v" is the original vector.  This
+  // is faster than calling operator[] twice (e.g., to return an edge of an
+  // encoded shape), since it decodes the CELL_IDS block header only once when
+  // both points belong to the same block.
+  S2Shape::Edge edge(int i, int j) const;
+
+  // Decodes the elements in the range [begin, end) into the array
+  // "output", which must have room for (end - begin) points.  This is much
+  // faster than calling operator[] for each element.
+  void DecodeRange(int begin, int end, S2Point* output) const;
+
   // Decodes and returns the entire original vector.
   std::vector<S2Point> Decode() const;
 
@@ -69,18 +80,21 @@ class EncodedS2PointVector {
   // encoded shapes created through lazy decoding.
   void Encode(Encoder* encoder) const;
 
-  // TODO(ericv): Consider adding a method that returns an adjacent pair of
-  // points.  This would save some decoding overhead.
-
  private:
   friend void EncodeS2PointVector(absl::Span<const S2Point>, CodingHint,
                                   Encoder*);
   friend void EncodeS2PointVectorFast(absl::Span<const S2Point>, Encoder*);
   friend void EncodeS2PointVectorCompact(absl::Span<const S2Point>, Encoder*);
 
+  struct CellIdsBlock;
+
   bool InitUncompressedFormat(Decoder* decoder);
   bool InitCellIdsFormat(Decoder* decoder);
+  void DecodeCellIdsBlock(int block, CellIdsBlock* result) const;
+  S2Point DecodeCellIdsValue(const CellIdsBlock& block, int j) const;
   S2Point DecodeCellIdsFormat(int i) const;
+  S2Shape::Edge DecodeCellIdsFormatEdge(int i, int j) const;
+  void DecodeCellIdsFormatRange(int begin, int end, S2Point* output) const;
 
   // We use a tagged union to represent multiple formats, as opposed to an
   // abstract base class or templating.  This represents the best compromise
@@ -136,6 +150,20 @@ inline S2Point EncodedS2PointVector::operator[](int i) const {
   }
 }
 
+inline S2Shape::Edge EncodedS2PointVector::edge(int i, int j) const {
+  switch (format_) {
+    case Format::UNCOMPRESSED:
+      return S2Shape::Edge(uncompressed_.points[i], uncompressed_.points[j]);
+
+    case Format::CELL_IDS:
+      return DecodeCellIdsFormatEdge(i, j);
+
+    default:
+      S2_DLOG(FATAL) << "Unrecognized format";
+      return S2Shape::Edge();
+  }
+}
+
 }  // namespace s2coding
 
 #endif  // S2_ENCODED_S2POINT_VECTOR_H_
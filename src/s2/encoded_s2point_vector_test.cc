@@ -17,6 +17,7 @@
 
 #include "s2/encoded_s2point_vector.h"
 
+#include <algorithm>
 #include <cstring>
 #include <vector>
 
@@ -26,6 +27,7 @@
 #include "absl/strings/str_cat.h"
 
 #include "s2/base/log_severity.h"
+#include "s2/encoded_s2point_vector_internal.h"
 #include "s2/util/bits/bit-interleave.h"
 #include "s2/s2loop.h"
 #include "s2/s2polygon.h"
@@ -60,6 +62,22 @@ size_t TestEncodedS2PointVector(const vector<S2Point>& expected,
   EncodedS2PointVector actual;
   EXPECT_TRUE(actual.Init(&decoder));
   EXPECT_EQ(actual.Decode(), expected);
+
+  // Also test random access, including edges whose endpoints are in the same
+  // block and in different blocks, and decoding a range that is not aligned
+  // to block boundaries.
+  const int n = expected.size();
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(expected[i], actual[i]);
+    for (int j : {(i + 1) % n, (i + kBlockSize + 1) % n}) {
+      EXPECT_EQ(S2Shape::Edge(expected[i], expected[j]), actual.edge(i, j));
+    }
+  }
+  if (n >= 2) {
+    vector<S2Point> range(n - 2);
+    actual.DecodeRange(1, n - 1, range.data());
+    EXPECT_TRUE(std::equal(range.begin(), range.end(), expected.begin() + 1));
+  }
   return encoder.length();
 }
 
@@ -431,4 +449,34 @@ TEST(EncodedS2PointVectorTest, RoundtripEncodingCompact) {
   TestRoundtripEncoding(s2coding::CodingHint::COMPACT);
 }
 
+TEST(EncodedS2PointVectorTest, BitPairInterleaving) {
+  // The library uses either the BMI2 or the portable versions depending on
+  // how it was compiled, so both are tested here directly.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+#ifdef S2_ENCODED_S2POINT_VECTOR_HAVE_BMI2_TARGET
+  const bool have_bmi2 = __builtin_cpu_supports("bmi2");
+#endif
+  for (int iter = 0; iter < 10000; ++iter) {
+    uint32 val0 = S2Testing::rnd.Rand32(), val1 = S2Testing::rnd.Rand32();
+    uint64 code = internal::InterleaveUint32BitPairsPortable(val0, val1);
+    // Bits 2k and 2k+1 of "val0" and "val1" go to bits 4k..4k+3 of "code".
+    for (int k = 0; k < 16; ++k) {
+      EXPECT_EQ((val0 >> (2 * k)) & 3, (code >> (4 * k)) & 3);
+      EXPECT_EQ((val1 >> (2 * k)) & 3, (code >> (4 * k + 2)) & 3);
+    }
+    uint32 out0, out1;
+    internal::DeinterleaveUint32BitPairsPortable(code, &out0, &out1);
+    EXPECT_EQ(val0, out0);
+    EXPECT_EQ(val1, out1);
+#ifdef S2_ENCODED_S2POINT_VECTOR_HAVE_BMI2_TARGET
+    if (have_bmi2) {
+      EXPECT_EQ(code, internal::InterleaveUint32BitPairsBmi2(val0, val1));
+      internal::DeinterleaveUint32BitPairsBmi2(code, &out0, &out1);
+      EXPECT_EQ(val0, out0);
+      EXPECT_EQ(val1, out1);
+    }
+#endif
+  }
+}
+
 }  // namespace s2coding
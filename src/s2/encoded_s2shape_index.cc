@@ -17,13 +17,17 @@
 
 #include "s2/encoded_s2shape_index.h"
 
+#include <algorithm>
 #include <memory>
+#include <string>
 
 #include "absl/memory/memory.h"
 #include "s2/util/bits/bits.h"
 #include "s2/mutable_s2shape_index.h"
+#include "s2/s2executor.h"
 
 using absl::make_unique;
+using std::string;
 using std::unique_ptr;
 using std::vector;
 
@@ -47,7 +51,15 @@ void EncodedS2ShapeIndex::Iterator::Copy(const IteratorBase& other)  {
 
 S2Shape* EncodedS2ShapeIndex::GetShape(int id) const {
   // This method is called when a shape has not been decoded yet.
+  const S2DeferredReadScope* scope = S2DeferredReadScope::current();
+  const size_t num_deferred = scope ? scope->deferred().size() : 0;
   unique_ptr<S2Shape> shape = (*shape_factory_)[id];
+  if (shape == nullptr && scope != nullptr &&
+      scope->deferred().size() > num_deferred) {
+    // The read was deferred, so the shape is not cached (see
+    // S2DeferredReadScope).
+    return nullptr;
+  }
   if (shape) shape->id_ = id;
   S2Shape* expected = kUndecodedShape();
   if (shapes_[id].compare_exchange_strong(expected, shape.get(),
@@ -81,9 +93,31 @@ inline const S2ShapeIndexCell* EncodedS2ShapeIndex::GetCell(int i) const {
   // Decode the cell before acquiring the spinlock in order to minimize the
   // time that the lock is held.
   auto cell = make_unique<S2ShapeIndexCell>();
-  Decoder decoder = encoded_cells_.GetDecoder(i);
-  if (!cell->Decode(num_shape_ids(), &decoder)) {
-    return nullptr;
+  if (source_ == nullptr) {
+    Decoder decoder = encoded_cells_.GetDecoder(i);
+    if (!cell->Decode(num_shape_ids(), &decoder)) {
+      return nullptr;
+    }
+  } else {
+    // The cell contents are copied while decoding, so the buffer is only
+    // needed temporarily.
+    string data;
+    const S2DeferredReadScope* scope = S2DeferredReadScope::current();
+    const size_t num_deferred = scope ? scope->deferred().size() : 0;
+    if (!source_cells_.Read(i, &data)) {
+      if (scope != nullptr && scope->deferred().size() > num_deferred) {
+        // The read was deferred, so return an empty cell without caching it
+        // (see S2DeferredReadScope).
+        static const S2ShapeIndexCell* const kEmptyCell =
+            new S2ShapeIndexCell;
+        return kEmptyCell;
+      }
+      return nullptr;
+    }
+    Decoder decoder(data.data(), data.size());
+    if (!cell->Decode(num_shape_ids(), &decoder)) {
+      return nullptr;
+    }
   }
   // Recheck cell_decoded(i) once we hold the lock in case another thread
   // has decoded this cell in the meantime.
@@ -106,6 +140,40 @@ const S2ShapeIndexCell* EncodedS2ShapeIndex::Iterator::GetCell() const {
 EncodedS2ShapeIndex::EncodedS2ShapeIndex() {
 }
 
+// Returns true if item "i" is one of the items selected when choosing the
+// given fraction of items evenly spaced across the whole range.
+static inline bool IsWarmed(int i, double fraction) {
+  return static_cast<int64>((i + 1) * fraction) >
+         static_cast<int64>(i * fraction);
+}
+
+void EncodedS2ShapeIndex::Warm(double fraction, int num_threads,
+                               S2Executor* executor) const {
+  S2_DCHECK_GE(num_threads, 1);
+  fraction = std::min(1.0, std::max(0.0, fraction));
+  if (fraction == 0) return;
+  const int num_cells = cell_ids_.size();
+  const int num_shapes = shapes_.size();
+  num_threads = std::max(1, std::min(S2NumThreads(executor, num_threads),
+                                     num_cells + num_shapes));
+
+  // Each thread decodes a contiguous block of cells and shapes, which keeps
+  // contention on cells_decoded_ and cells_lock_ low.  Cells and shapes are
+  // published through the same atomic operations as lazy decoding.
+  auto warm_block = [=](int block) {
+    int64 cell_end = int64{num_cells} * (block + 1) / num_threads;
+    for (int i = int64{num_cells} * block / num_threads; i < cell_end; ++i) {
+      if (IsWarmed(i, fraction)) GetCell(i);
+    }
+    int64 shape_end = int64{num_shapes} * (block + 1) / num_threads;
+    for (int id = int64{num_shapes} * block / num_threads; id < shape_end;
+         ++id) {
+      if (IsWarmed(id, fraction)) shape(id);
+    }
+  };
+  S2ParallelFor(executor, num_threads, warm_block);
+}
+
 EncodedS2ShapeIndex::~EncodedS2ShapeIndex() {
   // Although Minimize() does slightly more than required for destruction
   // (i.e., it resets vector elements to their default values), this does not
@@ -116,6 +184,35 @@ EncodedS2ShapeIndex::~EncodedS2ShapeIndex() {
 bool EncodedS2ShapeIndex::Init(Decoder* decoder,
                                const ShapeFactory& shape_factory) {
   Minimize();
+  source_ = nullptr;
+  directory_.clear();
+  if (!DecodeHeader(decoder)) return false;
+  InitCells(shape_factory);
+  const char* encoded_cells_begin = decoder->skip(0);
+  if (!encoded_cells_.Init(decoder)) return false;
+  encoded_cells_data_ = absl::string_view(
+      encoded_cells_begin, decoder->skip(0) - encoded_cells_begin);
+  return true;
+}
+
+bool EncodedS2ShapeIndex::Init(const S2ByteSource* source, uint64* offset,
+                               const ShapeFactory& shape_factory) {
+  Minimize();
+  source_ = source;
+  if (!source->ReadPrefix(
+          offset, [this](Decoder* decoder) { return DecodeHeader(decoder); },
+          &directory_)) {
+    return false;
+  }
+  // The S2CellIds are not part of any client buffer in this case.
+  cell_ids_data_ = absl::string_view();
+  encoded_cells_data_ = absl::string_view();
+  InitCells(shape_factory);
+  return source_cells_.Init(source, offset);
+}
+
+// Decodes the encoding version, the options, and the S2CellIds of the index.
+bool EncodedS2ShapeIndex::DecodeHeader(Decoder* decoder) {
   uint64 max_edges_version;
   if (!decoder->get_varint64(&max_edges_version)) return false;
   int version = max_edges_version & 3;
@@ -124,12 +221,20 @@ bool EncodedS2ShapeIndex::Init(Decoder* decoder,
   }
   options_.set_max_edges_per_cell(max_edges_version >> 2);
 
+  const char* cell_ids_begin = decoder->skip(0);
+  if (!cell_ids_.Init(decoder)) return false;
+  cell_ids_data_ = absl::string_view(cell_ids_begin,
+                                     decoder->skip(0) - cell_ids_begin);
+  return true;
+}
+
+// Allocates the decoded shapes and cells once the number of each is known.
+void EncodedS2ShapeIndex::InitCells(const ShapeFactory& shape_factory) {
   // AtomicShape is a subtype of std::atomic<S2Shape*> that changes the
   // default constructor value to kUndecodedShape().  This saves the effort of
   // initializing all the elements twice.
   shapes_ = std::vector<AtomicShape>(shape_factory.size());
   shape_factory_ = shape_factory.Clone();
-  if (!cell_ids_.Init(decoder)) return false;
 
   // The cells_ elements are *uninitialized memory*.  Instead we have bit
   // vector (cells_decoded_) to indicate which elements of cells_ are valid.
@@ -151,8 +256,6 @@ bool EncodedS2ShapeIndex::Init(Decoder* decoder,
   //                                NO NO NO
   cells_.reset(new S2ShapeIndexCell*[cell_ids_.size()]);
   cells_decoded_ = vector<std::atomic<uint64>>((cell_ids_.size() + 63) >> 6);
-
-  return encoded_cells_.Init(decoder);
 }
 
 void EncodedS2ShapeIndex::Minimize() {
@@ -198,5 +301,6 @@ size_t EncodedS2ShapeIndex::SpaceUsed() const {
   size += cell_ids_.size() * sizeof(std::atomic<S2ShapeIndexCell*>);  // cells_
   size += cells_decoded_.capacity() * sizeof(std::atomic<uint64>);
   size += cell_cache_.capacity() * sizeof(int);
+  size += directory_.capacity() + source_cells_.SpaceUsed();
   return size;
 }
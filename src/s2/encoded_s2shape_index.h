@@ -19,10 +19,14 @@
 #define S2_ENCODED_S2SHAPE_INDEX_H_
 
 #include <memory>
+#include <string>
 
+#include "absl/strings/string_view.h"
 #include "s2/encoded_s2cell_id_vector.h"
 #include "s2/encoded_string_vector.h"
 #include "s2/mutable_s2shape_index.h"
+#include "s2/s2byte_source.h"
+#include "s2/s2executor.h"
 
 // EncodedS2ShapeIndex is an S2ShapeIndex implementation that works directly
 // with encoded data.  Rather than decoding everything in advance, geometry is
@@ -86,6 +90,17 @@
 // therefore the client must ensure that this data outlives the
 // EncodedS2ShapeIndex object.
 //
+// In particular the encoded data can be a read-only memory-mapped file (see
+// S2MappedFile), in which case loading the index does not read the file at
+// all and processes that map the same file share its pages.  The sections
+// returned by cell_ids_data() and encoded_cells_data() can be given access
+// pattern hints with S2MappedFile::Advise().
+//
+// Alternatively, an index that is too large to be held in memory can be read
+// on demand from an S2ByteSource (such as a file read with pread()), in which
+// case only the S2CellIds are kept in memory and the contents of each cell
+// are read when the cell is first decoded (see s2byte_source.h).
+//
 // There are a number of built-in classes that work with S2ShapeIndex objects.
 // Generally these classes accept any collection of geometry that can be
 // represented by an S2ShapeIndex, i.e. any combination of points, polylines,
@@ -135,8 +150,31 @@ class EncodedS2ShapeIndex final : public S2ShapeIndex {
   // in the Decoder's data buffer in this example.
   bool Init(Decoder* decoder, const ShapeFactory& shape_factory);
 
+  // Initializes the EncodedS2ShapeIndex from the encoding at "*offset" in
+  // the given byte source, and advances "*offset" past the end of the
+  // encoding.  Returns true on success.  The S2CellIds are read into memory,
+  // and the contents of each cell are read from the source when the cell is
+  // first decoded.  The source must outlive this object.  Example usage:
+  //
+  //   s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+  //   if (!shape_factory.Init(source, &offset) ||
+  //       !index.Init(source, &offset, shape_factory)) { ... }
+  //
+  // Note that read errors while decoding a cell are handled like corrupt
+  // encodings, i.e. the cell is returned as nullptr.
+  bool Init(const S2ByteSource* source, uint64* offset,
+            const ShapeFactory& shape_factory);
+
   const Options& options() const { return options_; }
 
+  // Return the portions of the Decoder's data buffer that hold the encoded
+  // S2CellIds and the encoded cell contents respectively.  These are useful
+  // for giving the operating system access pattern hints when the buffer is
+  // memory-mapped (see S2MappedFile::Advise).  Both are empty if the index
+  // was initialized from an S2ByteSource.
+  absl::string_view cell_ids_data() const { return cell_ids_data_; }
+  absl::string_view encoded_cells_data() const { return encoded_cells_data_; }
+
   // The number of distinct shape ids in the index.  This equals the number of
   // shapes in the index provided that no shapes have ever been removed.
   // (Shape ids are not reused.)
@@ -146,6 +184,16 @@ class EncodedS2ShapeIndex final : public S2ShapeIndex {
   // has been removed from the index.
   S2Shape* shape(int id) const override;
 
+  // Eagerly decodes the given fraction of the index cells (spread evenly
+  // across the index) and the same fraction of the shapes, using up to
+  // "num_threads" threads.  Since cells and shapes are otherwise decoded on
+  // first use, this allows a freshly loaded index to reach its steady-state
+  // query latency before it starts serving.  Like other "const" methods this
+  // is thread-safe, so queries may run while the index is being warmed.
+  // See S2ParallelFor for the meaning of "executor".
+  void Warm(double fraction = 1.0, int num_threads = 1,
+            S2Executor* executor = nullptr) const;
+
   // Minimizes memory usage by requesting that any data structures that can be
   // rebuilt should be discarded.  This method invalidates all iterators.
   //
@@ -224,6 +272,8 @@ class EncodedS2ShapeIndex final : public S2ShapeIndex {
 
   S2Shape* GetShape(int id) const;
   const S2ShapeIndexCell* GetCell(int i) const;
+  bool DecodeHeader(Decoder* decoder);
+  void InitCells(const ShapeFactory& shape_factory);
   bool cell_decoded(int i) const;
   void set_cell_decoded(int i) const;
   int max_cell_cache_size() const;
@@ -244,6 +294,18 @@ class EncodedS2ShapeIndex final : public S2ShapeIndex {
   // A vector containing the encoded contents of each cell in the index.
   s2coding::EncodedStringVector encoded_cells_;
 
+  // The ranges of the Decoder's buffer occupied by cell_ids_ and
+  // encoded_cells_.
+  absl::string_view cell_ids_data_;
+  absl::string_view encoded_cells_data_;
+
+  // If the index was initialized from an S2ByteSource, the source and the
+  // offsets of the encoded cells within it.  In that case "directory_" holds
+  // the encoded S2CellIds, which cell_ids_ points into.
+  const S2ByteSource* source_ = nullptr;
+  S2ByteSourceStringVector source_cells_;
+  std::string directory_;
+
   // A raw array containing the decoded contents of each cell in the index.
   // Initially all values are *uninitialized memory*.  The cells_decoded_
   // field below keeps track of which elements are present.
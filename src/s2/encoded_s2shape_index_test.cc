@@ -18,6 +18,7 @@
 #include "s2/encoded_s2shape_index.h"
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -36,6 +37,7 @@
 #include "s2/s2closest_edge_query.h"
 #include "s2/s2contains_point_query.h"
 #include "s2/s2edge_distances.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
@@ -329,6 +331,65 @@ TEST(EncodedS2ShapeIndex, LazyDecode) {
   test.Run(kNumReaders, kIters);
 }
 
+// A ShapeFactory that counts the shapes decoded by another ShapeFactory.
+class CountingShapeFactory : public S2ShapeIndex::ShapeFactory {
+ public:
+  CountingShapeFactory(const S2ShapeIndex::ShapeFactory& factory,
+                       std::atomic<int>* num_decoded)
+      : factory_(factory.Clone()), num_decoded_(num_decoded) {}
+
+  int size() const override { return factory_->size(); }
+
+  unique_ptr<S2Shape> operator[](int shape_id) const override {
+    ++*num_decoded_;
+    return (*factory_)[shape_id];
+  }
+
+  unique_ptr<ShapeFactory> Clone() const override {
+    return make_unique<CountingShapeFactory>(*factory_, num_decoded_);
+  }
+
+ private:
+  unique_ptr<S2ShapeIndex::ShapeFactory> factory_;
+  std::atomic<int>* num_decoded_;
+};
+
+TEST(EncodedS2ShapeIndex, Warm) {
+  MutableS2ShapeIndex expected;
+  for (int i = 0; i < 10; ++i) {
+    S2Polygon polygon(S2Loop::MakeRegularLoop(S2Testing::RandomPoint(),
+                                              S1Angle::Degrees(5), 100));
+    expected.Add(make_unique<S2LaxPolygonShape>(polygon));
+  }
+  Encoder encoder;
+  s2shapeutil::CompactEncodeTaggedShapes(expected, &encoder);
+  expected.Encode(&encoder);
+  S2ThreadPool pool(4);
+  for (int num_threads : {1, 4, 0}) {
+    // num_threads == 0 means that the threads are taken from "pool".
+    S2Executor* executor = num_threads == 0 ? &pool : nullptr;
+    for (double fraction : {0.0, 0.3, 1.0}) {
+      SCOPED_TRACE(StrCat("num_threads = ", num_threads,
+                          ", fraction = ", fraction));
+      Decoder decoder(encoder.base(), encoder.length());
+      std::atomic<int> num_decoded(0);
+      EncodedS2ShapeIndex actual;
+      ASSERT_TRUE(actual.Init(
+          &decoder,
+          CountingShapeFactory(s2shapeutil::LazyDecodeShapeFactory(&decoder),
+                               &num_decoded)));
+      actual.Warm(fraction, std::max(1, num_threads), executor);
+      EXPECT_EQ(static_cast<int>(fraction * 10), num_decoded);
+
+      // Warming twice is harmless since already decoded data is reused.
+      actual.Warm(fraction, std::max(1, num_threads), executor);
+      EXPECT_EQ(static_cast<int>(fraction * 10), num_decoded);
+      s2testing::ExpectEqual(expected, actual);
+      EXPECT_EQ(10, num_decoded);
+    }
+  }
+}
+
 TEST(EncodedS2ShapeIndex, JavaByteCompatibility) {
   MutableS2ShapeIndex expected;
   expected.Add(make_unique<S2Polyline::OwningShape>(
@@ -44,6 +44,43 @@ void StringVectorEncoder::Encode(Span<const string> v, Encoder* encoder) {
   string_vector.Encode(encoder);
 }
 
+uint64 StringVectorEncoder::EncodeOffsets(
+    Span<const StringVectorEncoder> parts, Encoder* encoder) {
+  // Each part stores the starting offset of each of its strings, whereas the
+  // encoded vector stores the end offset of each string.
+  vector<uint64> offsets;
+  uint64 base = 0;
+  for (const auto& part : parts) {
+    for (size_t i = 1; i < part.offsets_.size(); ++i) {
+      offsets.push_back(base + part.offsets_[i]);
+    }
+    base += part.data_.length();
+    if (!part.offsets_.empty()) offsets.push_back(base);
+  }
+  EncodeUintVector<uint64>(offsets, encoder);
+  return base;
+}
+
+void StringVectorEncoder::Encode(Span<const StringVectorEncoder> parts,
+                                 Encoder* encoder) {
+  encoder->Ensure(EncodeOffsets(parts, encoder));
+  for (const auto& part : parts) {
+    encoder->putn(part.data_.base(), part.data_.length());
+  }
+}
+
+void StringVectorEncoder::Encode(Span<const StringVectorEncoder> parts,
+                                 const Sink& sink) {
+  Encoder offsets;
+  EncodeOffsets(parts, &offsets);
+  sink(string_view(offsets.base(), offsets.length()));
+  for (const auto& part : parts) {
+    if (part.data_.length() > 0) {
+      sink(string_view(part.data_.base(), part.data_.length()));
+    }
+  }
+}
+
 bool EncodedStringVector::Init(Decoder* decoder) {
   if (!offsets_.Init(decoder)) return false;
   data_ = decoder->skip(0);
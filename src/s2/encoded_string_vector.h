@@ -18,6 +18,7 @@
 #ifndef S2_ENCODED_STRING_VECTOR_H_
 #define S2_ENCODED_STRING_VECTOR_H_
 
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -64,7 +65,31 @@ class StringVectorEncoder {
   //           can be enlarged as necessary by calling Ensure(int).
   static void Encode(absl::Span<const std::string> v, Encoder* encoder);
 
+  // Encodes all the strings added to the given encoders (in order) as a
+  // single vector.  The output is identical to adding all the strings to one
+  // StringVectorEncoder, but this allows different parts of the vector to be
+  // built concurrently (e.g., one StringVectorEncoder per thread).
+  //
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  static void Encode(absl::Span<const StringVectorEncoder> parts,
+                     Encoder* encoder);
+
+  // Like the method above, except that the encoded vector is passed to
+  // "sink" as a sequence of pieces (which should be concatenated) rather
+  // than being copied into an Encoder.  For example, the pieces can be
+  // appended to a file.  (The data is still held in memory by "parts"; this
+  // only avoids copying it into one contiguous buffer.)
+  using Sink = std::function<void (absl::string_view data)>;
+  static void Encode(absl::Span<const StringVectorEncoder> parts,
+                     const Sink& sink);
+
  private:
+  // Encodes the offsets of the strings added to the given encoders, and
+  // returns the total length of their data.
+  static uint64 EncodeOffsets(absl::Span<const StringVectorEncoder> parts,
+                              Encoder* encoder);
+
   // A vector consisting of the starting offset of each string in the
   // encoder's data buffer, plus a final entry pointing just past the end of
   // the last string.
@@ -51,6 +51,28 @@ void TestEncodedStringVector(const vector<string>& input,
             string_view(reencoder.base(), reencoder.length()));
 }
 
+TEST(StringVectorEncoder, EncodeParts) {
+  vector<string> input = {"a", "", "bcd", "", "", "efghij", string(300, 'x')};
+  Encoder expected;
+  StringVectorEncoder::Encode(input, &expected);
+  // Split the strings among several parts, including some empty ones.
+  for (int split : {0, 1, 3, 7}) {
+    vector<StringVectorEncoder> parts(3);
+    for (int i = 0; i < input.size(); ++i) {
+      parts[i < split ? 0 : 2].Add(input[i]);
+    }
+    Encoder encoder;
+    StringVectorEncoder::Encode(parts, &encoder);
+    EXPECT_EQ(string_view(expected.base(), expected.length()),
+              string_view(encoder.base(), encoder.length()));
+  }
+  Encoder empty, encoder;
+  StringVectorEncoder::Encode(vector<string>(), &empty);
+  StringVectorEncoder::Encode(vector<StringVectorEncoder>(), &encoder);
+  EXPECT_EQ(string_view(empty.base(), empty.length()),
+            string_view(encoder.base(), encoder.length()));
+}
+
 TEST(EncodedStringVectorTest, Empty) {
   TestEncodedStringVector({}, 1);
 }
@@ -21,6 +21,7 @@
 #include <type_traits>
 #include <vector>
 
+#include "absl/base/internal/prefetch.h"
 #include "absl/base/internal/unaligned_access.h"
 #include "absl/types/span.h"
 
@@ -93,6 +94,7 @@ class EncodedUintVector {
 
  private:
   template <int length> size_t lower_bound(T target) const;
+  template <int length> std::vector<T> Decode() const;
 
   const char* data_;
   uint32 size_;
@@ -278,24 +280,56 @@ size_t EncodedUintVector<T>::lower_bound(T target) const {
 
 template <class T> template <int length>
 inline size_t EncodedUintVector<T>::lower_bound(T target) const {
-  size_t lo = 0, hi = size_;
-  while (lo < hi) {
-    size_t mid = (lo + hi) >> 1;
-    T value = GetUintWithLength<T>(data_ + mid * length, length);
-    if (value < target) {
-      lo = mid + 1;
-    } else {
-      hi = mid;
-    }
+  // The search is written so that the loop body has no data-dependent
+  // branches (the conditional is compiled into a conditional move), since
+  // branch mispredictions dominate the cost of a conventional binary search.
+  // The invariant is that the result is in the range [lo, lo + n].  Once the
+  // range is small enough to fit in a cache line or two, the remaining
+  // values are compared in a single pass that the compiler can vectorize.
+  constexpr size_t kMaxLinearSearch = 8;
+  const char* data = data_;
+  size_t lo = 0, n = size_;
+  while (n > kMaxLinearSearch) {
+    size_t half = n >> 1;
+    // Prefetch both possible midpoints of the next iteration, which
+    // recovers the memory parallelism that a branchy search gets from
+    // speculative execution.
+    size_t next_half = (n - half) >> 1;
+    absl::base_internal::PrefetchT0(data + (lo + next_half) * length);
+    absl::base_internal::PrefetchT0(data + (lo + half + next_half) * length);
+    T value = GetUintWithLength<T>(data + (lo + half) * length, length);
+    lo = (value < target) ? lo + half : lo;
+    n -= half;
   }
-  return lo;
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    count += GetUintWithLength<T>(data + (lo + i) * length, length) < target;
+  }
+  return lo + count;
 }
 
 template <class T>
 std::vector<T> EncodedUintVector<T>::Decode() const {
+  switch (len_) {
+    case 1: return Decode<1>();
+    case 2: return Decode<2>();
+    case 3: return Decode<3>();
+    case 4: return Decode<4>();
+    case 5: return Decode<5>();
+    case 6: return Decode<6>();
+    case 7: return Decode<7>();
+    default: return Decode<8>();
+  }
+}
+
+template <class T> template <int length>
+std::vector<T> EncodedUintVector<T>::Decode() const {
+  // Specializing on the length allows each value to be decoded using a
+  // fixed sequence of loads, which the compiler can unroll and vectorize.
   std::vector<T> result(size_);
-  for (int i = 0; i < size_; ++i) {
-    result[i] = (*this)[i];
+  const char* ptr = data_;
+  for (uint32 i = 0; i < size_; ++i, ptr += length) {
+    result[i] = GetUintWithLength<T>(ptr, length);
   }
   return result;
 }
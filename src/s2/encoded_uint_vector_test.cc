@@ -113,7 +113,7 @@ void TestLowerBound(int bytes_per_value, int num_values) {
 }
 
 TEST(EncodedUintVector, LowerBound) {
-  for (int bytes_per_value = 8; bytes_per_value <= 8; ++bytes_per_value) {
+  for (int bytes_per_value = 1; bytes_per_value <= 8; ++bytes_per_value) {
     TestLowerBound<uint64>(bytes_per_value, 10);
     if (bytes_per_value <= 4) {
       TestLowerBound<uint32>(bytes_per_value, 500);
@@ -124,6 +124,29 @@ TEST(EncodedUintVector, LowerBound) {
   }
 }
 
+TEST(EncodedUintVector, LowerBoundWithDuplicates) {
+  // Test every vector size up to a few times the linear search threshold,
+  // including targets before, between, and after the values.
+  for (int n = 0; n < 40; ++n) {
+    vector<uint32> v;
+    for (int i = 0; i < n; ++i) v.push_back(1000 + 2 * (i / 3));
+    Encoder encoder;
+    auto actual = MakeEncodedVector(v, &encoder);
+    for (uint32 x = 998; x <= 1000 + 2 * n / 3 + 2; ++x) {
+      EXPECT_EQ(std::lower_bound(v.begin(), v.end(), x) - v.begin(),
+                actual.lower_bound(x));
+    }
+  }
+}
+
+TEST(EncodedUintVectorTest, DecodeAllLengths) {
+  for (int bytes_per_value = 1; bytes_per_value <= 8; ++bytes_per_value) {
+    auto v = MakeSortedTestVector<uint64>(bytes_per_value, 100);
+    Encoder encoder;
+    EXPECT_EQ(v, MakeEncodedVector(v, &encoder).Decode());
+  }
+}
+
 TEST(EncodedUintVectorTest, RoundtripEncoding) {
   std::vector<uint64> values{10, 20, 30, 40};
 
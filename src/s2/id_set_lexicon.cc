@@ -52,6 +52,10 @@ void IdSetLexicon::Clear() {
   id_sets_.Clear();
 }
 
+void IdSetLexicon::Reserve(size_t num_sets, size_t num_ids) {
+  id_sets_.Reserve(num_sets, num_ids);
+}
+
 int32 IdSetLexicon::AddInternal(std::vector<int32>* ids) {
   if (ids->empty()) {
     // Empty sets have a special id chosen not to conflict with other ids.
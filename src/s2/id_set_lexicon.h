@@ -82,6 +82,10 @@ class IdSetLexicon {
   // Clears all data from the lexicon.
   void Clear();
 
+  // Reserves space for at least "num_sets" non-singleton sets containing a
+  // total of "num_ids" ids (see SequenceLexicon::Reserve).
+  void Reserve(size_t num_sets, size_t num_ids);
+
   // Add the given set of integers to the lexicon if it is not already
   // present, and return the unique id for this set.  "begin" and "end" are
   // forward iterators over a sequence of values that can be converted to
@@ -19,15 +19,22 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cmath>
+#include <limits>
 #include <memory>
+#include <string>
+#include <thread>
 #include <utility>
 
 #include "s2/base/casts.h"
 #include "s2/base/commandlineflags.h"
 #include "s2/base/spinlock.h"
 #include "absl/base/attributes.h"
+#include "absl/base/internal/prefetch.h"
 #include "absl/flags/flag.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
 #include "absl/utility/utility.h"
 #include "s2/encoded_s2cell_id_vector.h"
 #include "s2/encoded_string_vector.h"
@@ -39,6 +46,7 @@
 #include "s2/s2coords.h"
 #include "s2/s2edge_clipping.h"
 #include "s2/s2edge_crosser.h"
+#include "s2/s2executor.h"
 #include "s2/s2metrics.h"
 #include "s2/s2padded_cell.h"
 #include "s2/s2pointutil.h"
@@ -50,6 +58,7 @@ using std::fabs;
 using std::make_pair;
 using std::max;
 using std::min;
+using std::string;
 using std::unique_ptr;
 using std::vector;
 
@@ -171,6 +180,13 @@ S2_DEFINE_double(
 const double MutableS2ShapeIndex::kCellPadding =
     2 * (S2::kFaceClipErrorUVCoord + S2::kEdgeClipErrorUVCoord);
 
+constexpr int MutableS2ShapeIndex::UpdateStats::kNumBuckets;
+
+// Shapes whose chains have fewer edges than this on average are added one
+// edge at a time, since the per-chain overhead of AddChainEdges() outweighs
+// its benefits for such shapes.
+static constexpr int kMinBatchChainLength = 8;
+
 MutableS2ShapeIndex::Options::Options()
     : max_edges_per_cell_(
           absl::GetFlag(FLAGS_s2shape_index_default_max_edges_per_cell)) {}
@@ -180,6 +196,11 @@ void MutableS2ShapeIndex::Options::set_max_edges_per_cell(
   max_edges_per_cell_ = max_edges_per_cell;
 }
 
+void MutableS2ShapeIndex::Options::set_num_threads(int num_threads) {
+  S2_DCHECK_GE(num_threads, 1);
+  num_threads_ = max(1, num_threads);
+}
+
 bool MutableS2ShapeIndex::Iterator::Locate(const S2Point& target) {
   return LocateImpl(target, this);
 }
@@ -189,6 +210,25 @@ MutableS2ShapeIndex::CellRelation MutableS2ShapeIndex::Iterator::Locate(
   return LocateImpl(target, this);
 }
 
+bool MutableS2ShapeIndex::Iterator::can_prefetch() const {
+  // Only frozen indexes with a lookup table can locate the relevant part of
+  // the index without first loading it.  (Computing the address of the
+  // btree node that contains "target" requires traversing the btree.)
+  return array_ != nullptr && !array_->lookup.empty();
+}
+
+void MutableS2ShapeIndex::Iterator::Prefetch(S2CellId target) const {
+  if (!can_prefetch()) return;
+  const vector<uint32>& lookup = array_->lookup;
+  size_t b = min<uint64>(target.id() >> array_->lookup_shift,
+                              lookup.size() - 1);
+  size_t pos = lookup[b];
+  if (pos < array_->ids.size()) {
+    absl::base_internal::PrefetchT0(&array_->ids[pos]);
+    absl::base_internal::PrefetchT0(&array_->cells[pos]);
+  }
+}
+
 const S2ShapeIndexCell* MutableS2ShapeIndex::Iterator::GetCell() const {
   S2_LOG(DFATAL) << "Should never be called";
   return nullptr;
@@ -448,14 +488,41 @@ MutableS2ShapeIndex::MutableS2ShapeIndex(const Options& options) {
   Init(options);
 }
 
+MutableS2ShapeIndex::MutableS2ShapeIndex(
+    std::shared_ptr<const MutableS2ShapeIndex> base)
+    : base_(std::move(base)), options_(base_->options_) {
+  // Once the base index has been built it is never modified, so its shapes
+  // and cells can be shared without synchronization.
+  base_->ForceBuild();
+  shapes_.reserve(base_->shapes_.size());
+  for (const auto& shape : base_->shapes_) shapes_.emplace_back(shape.get());
+  const CellArray& array = base_->cell_array_;
+  if (!array.ids.empty()) {
+    for (size_t i = 0; i < array.ids.size(); ++i) {
+      cell_map_.insert(cell_map_.end(),
+                       make_pair(array.ids[i], array.cells[i]));
+    }
+  } else {
+    cell_map_ = base_->cell_map_;
+  }
+  pending_additions_begin_ = shapes_.size();
+}
+
 MutableS2ShapeIndex::MutableS2ShapeIndex(MutableS2ShapeIndex&& b)
     : S2ShapeIndex(std::move(b)),
+      // Background tasks refer to "b", so they must finish before it moves.
+      base_((b.WaitForBackgroundBuild(), std::move(b.base_))),
       shapes_(std::move(b.shapes_)),
       cell_map_(std::move(b.cell_map_)),
+      cell_array_(std::move(b.cell_array_)),
       options_(std::move(b.options_)),
+      edge_cache_(std::move(b.edge_cache_)),
       pending_additions_begin_(absl::exchange(b.pending_additions_begin_, 0)),
       pending_removals_(std::move(b.pending_removals_)),
+      removed_shape_ids_(std::move(b.removed_shape_ids_)),
+      build_times_(b.build_times_),
       index_status_(b.index_status_.exchange(FRESH, std::memory_order_relaxed)),
+      update_stats_(std::move(b.update_stats_)),
       mem_tracker_(std::move(b.mem_tracker_)) {}
 
 MutableS2ShapeIndex& MutableS2ShapeIndex::operator=(MutableS2ShapeIndex&& b) {
@@ -463,14 +530,22 @@ MutableS2ShapeIndex& MutableS2ShapeIndex::operator=(MutableS2ShapeIndex&& b) {
   // move any of its private state.  This is a little odd since b is in a
   // half-moved state after calling but is ultimately safe.
   S2ShapeIndex::operator=(static_cast<S2ShapeIndex&&>(b));
+  b.WaitForBackgroundBuild();
+  Clear();
+  base_ = std::move(b.base_);
   shapes_ = std::move(b.shapes_);
   cell_map_ = std::move(b.cell_map_);
+  cell_array_ = std::move(b.cell_array_);
   options_ = std::move(b.options_);
+  edge_cache_ = std::move(b.edge_cache_);
   pending_additions_begin_ = absl::exchange(b.pending_additions_begin_, 0);
   pending_removals_ = std::move(b.pending_removals_);
+  removed_shape_ids_ = std::move(b.removed_shape_ids_);
+  build_times_ = b.build_times_;
   index_status_.store(
       b.index_status_.exchange(FRESH, std::memory_order_relaxed),
       std::memory_order_relaxed);
+  update_stats_ = std::move(b.update_stats_);
   mem_tracker_ = std::move(b.mem_tracker_);
   return *this;
 }
@@ -486,6 +561,7 @@ MutableS2ShapeIndex::~MutableS2ShapeIndex() {
 }
 
 void MutableS2ShapeIndex::set_memory_tracker(S2MemoryTracker* tracker) {
+  WaitForBackgroundBuild();
   mem_tracker_.Tally(-mem_tracker_.client_usage_bytes());
   mem_tracker_.Init(tracker);
   if (mem_tracker_.is_active()) mem_tracker_.Tally(SpaceUsed());
@@ -503,22 +579,51 @@ void MutableS2ShapeIndex::MarkIndexStale() {
 }
 
 void MutableS2ShapeIndex::Minimize() {
+  WaitForBackgroundBuild();
+  MinimizeInternal();
+}
+
+// Like Minimize(), but may be called while updates are being applied (which
+// may be in a background task).
+void MutableS2ShapeIndex::MinimizeInternal() {
   mem_tracker_.Tally(-mem_tracker_.client_usage_bytes());
   Iterator it;
   for (it.InitStale(this, S2ShapeIndex::BEGIN); !it.done(); it.Next()) {
-    delete &it.cell();
+    DeleteCell(it.id(), &it.cell());
   }
   cell_map_.clear();
+  cell_array_ = CellArray();
+  edge_cache_.clear();
   pending_removals_.reset();
+  removed_shape_ids_.clear();
   pending_additions_begin_ = 0;
   MarkIndexStale();
   if (mem_tracker_.is_active()) mem_tracker_.Tally(SpaceUsed());
 }
 
+void MutableS2ShapeIndex::Freeze() {
+  WaitForBackgroundBuild();
+  ForceBuild();
+  if (cell_map_.empty()) return;
+  cell_array_.ids.reserve(cell_map_.size());
+  cell_array_.cells.reserve(cell_map_.size());
+  for (const auto& entry : cell_map_) {
+    cell_array_.ids.push_back(entry.first);
+    cell_array_.cells.push_back(entry.second);
+  }
+  cell_map_.clear();
+  cell_array_.BuildLookup();
+  if (mem_tracker_.is_active()) {
+    mem_tracker_.Tally(-mem_tracker_.client_usage_bytes());
+    mem_tracker_.Tally(SpaceUsed());
+  }
+}
+
 int MutableS2ShapeIndex::Add(unique_ptr<S2Shape> shape) {
   // Additions are processed lazily by ApplyUpdates().  Note that in order to
   // avoid unexpected client behavior, this method continues to add shapes
   // even once the specified S2MemoryTracker limit has been exceeded.
+  WaitForBackgroundBuild();
   const int id = shapes_.size();
   shape->id_ = id;
   mem_tracker_.AddSpace(&shapes_, 1);
@@ -527,71 +632,244 @@ int MutableS2ShapeIndex::Add(unique_ptr<S2Shape> shape) {
   return id;
 }
 
+int MutableS2ShapeIndex::AddAll(vector<unique_ptr<S2Shape>> shapes) {
+  WaitForBackgroundBuild();
+  const int first_id = shapes_.size();
+  mem_tracker_.AddSpace(&shapes_, shapes.size());
+  for (auto& shape : shapes) {
+    S2_DCHECK(shape != nullptr);
+    shape->id_ = shapes_.size();
+    shapes_.push_back(std::move(shape));
+  }
+  if (!shapes.empty()) MarkIndexStale();
+  return first_id;
+}
+
 unique_ptr<S2Shape> MutableS2ShapeIndex::Release(int shape_id) {
   // This class updates itself lazily, because it is much more efficient to
   // process additions and removals in batches.  However this means that when
   // a shape is removed we need to make a copy of all its edges, since the
   // client is free to delete "shape" once this call is finished.
 
+  WaitForBackgroundBuild();
   S2_DCHECK(shapes_[shape_id] != nullptr);
   auto shape = std::move(shapes_[shape_id]);
   if (shape_id >= pending_additions_begin_) {
     // We are removing a shape that has not yet been added to the index,
     // so there is nothing else to do.
+  } else if (options_.lazy_removal()) {
+    mem_tracker_.AddSpace(&removed_shape_ids_, 1);
+    removed_shape_ids_.push_back(shape_id);
   } else {
-    if (!pending_removals_) {
-      if (!mem_tracker_.Tally(sizeof(*pending_removals_))) {
-        Minimize();
-        return shape;
-      }
-      pending_removals_ = make_unique<vector<RemovedShape>>();
-    }
-    RemovedShape removed;
-    removed.shape_id = shape->id();
-    removed.has_interior = (shape->dimension() == 2);
-    removed.contains_tracker_origin =
-        s2shapeutil::ContainsBruteForce(*shape, InteriorTracker::Origin());
-    int num_edges = shape->num_edges();
-    if (!mem_tracker_.AddSpace(&removed.edges, num_edges) ||
-        !mem_tracker_.AddSpace(pending_removals_.get(), 1)) {
-      Minimize();
-      return shape;
-    }
-    for (int e = 0; e < num_edges; ++e) {
-      removed.edges.push_back(shape->edge(e));
-    }
-    pending_removals_->push_back(std::move(removed));
+    QueueRemoval(*shape);
   }
   MarkIndexStale();
+  // Shapes shared with the base index of a clone remain owned by it.
+  if (is_base_shape(shape_id)) shape.release();
   return shape;
 }
 
+// Records the edges of the given shape so that they can be removed from the
+// index by the next update.
+void MutableS2ShapeIndex::QueueRemoval(const S2Shape& shape) {
+  if (!pending_removals_) {
+    if (!mem_tracker_.Tally(sizeof(*pending_removals_))) {
+      Minimize();
+      return;
+    }
+    pending_removals_ = make_unique<vector<RemovedShape>>();
+  }
+  RemovedShape removed;
+  removed.shape_id = shape.id();
+  removed.has_interior = (shape.dimension() == 2);
+  removed.contains_tracker_origin =
+      s2shapeutil::ContainsBruteForce(shape, InteriorTracker::Origin());
+  int num_edges = shape.num_edges();
+  if (!mem_tracker_.AddSpace(&removed.edges, num_edges) ||
+      !mem_tracker_.AddSpace(pending_removals_.get(), 1)) {
+    Minimize();
+    return;
+  }
+  for (int e = 0; e < num_edges; ++e) {
+    removed.edges.push_back(shape.edge(e));
+  }
+  pending_removals_->push_back(std::move(removed));
+}
+
 vector<unique_ptr<S2Shape>> MutableS2ShapeIndex::ReleaseAll() {
+  WaitForBackgroundBuild();
   S2_DCHECK(update_state_ == nullptr);
   vector<unique_ptr<S2Shape>> result;
   result.swap(shapes_);
   Minimize();
+  if (base_ != nullptr) {
+    for (int id = 0; id < base_->num_shape_ids(); ++id) result[id].release();
+    base_.reset();
+  }
   return result;
 }
 
+// Removes the shapes in removed_shape_ids_ from every index cell (see
+// Options::lazy_removal).  Each cell that contains such a shape is replaced
+// by a copy without it, or erased if no other shapes remain.
+void MutableS2ShapeIndex::RemoveShapeIdsFromCells() {
+  vector<bool> is_removed(shapes_.size());
+  for (int shape_id : removed_shape_ids_) is_removed[shape_id] = true;
+  vector<int>().swap(removed_shape_ids_);
+
+  for (auto it = cell_map_.begin(); it != cell_map_.end();) {
+    const S2ShapeIndexCell* cell = it->second;
+    int num_kept = 0;
+    for (int s = 0; s < cell->num_clipped(); ++s) {
+      num_kept += !is_removed[cell->clipped(s).shape_id()];
+    }
+    if (num_kept == cell->num_clipped()) {
+      ++it;
+      continue;
+    }
+    if (num_kept == 0) {
+      DeleteCell(it->first, cell);
+      it = cell_map_.erase(it);
+      continue;
+    }
+    auto new_cell = make_unique<S2ShapeIndexCell>();
+    S2ClippedShape* clipped = new_cell->add_shapes(num_kept);
+    for (int s = 0; s < cell->num_clipped(); ++s) {
+      const S2ClippedShape& old_clipped = cell->clipped(s);
+      if (is_removed[old_clipped.shape_id()]) continue;
+      clipped->Init(old_clipped.shape_id(), old_clipped.num_edges());
+      clipped->set_contains_center(old_clipped.contains_center());
+      for (int i = 0; i < old_clipped.num_edges(); ++i) {
+        clipped->set_edge(i, old_clipped.edge(i));
+      }
+      ++clipped;
+    }
+    if (options_.compact_cells()) new_cell->CompactEdges();
+    if (options_.cache_edges() || options_.cache_float_edges()) {
+      CacheEdges(new_cell.get());
+    }
+    DeleteCell(it->first, cell);
+    it->second = new_cell.release();
+    ++it;
+  }
+  if (mem_tracker_.is_active()) {
+    mem_tracker_.Tally(-mem_tracker_.client_usage_bytes());
+    mem_tracker_.Tally(SpaceUsed());
+  }
+}
+
+// Returns true if the given cell of this index is owned by the base index
+// of a clone, i.e. the base index contains the same cell at the same id.
+bool MutableS2ShapeIndex::IsBaseCell(S2CellId id,
+                                     const S2ShapeIndexCell* cell) const {
+  if (base_ == nullptr) return false;
+  const CellArray& array = base_->cell_array_;
+  if (!array.ids.empty()) {
+    auto it = std::lower_bound(array.ids.begin(), array.ids.end(), id);
+    return it != array.ids.end() && *it == id &&
+           array.cells[it - array.ids.begin()] == cell;
+  }
+  auto it = base_->cell_map_.find(id);
+  return it != base_->cell_map_.end() && it->second == cell;
+}
+
+// Deletes a cell that has been removed from the index, unless it is shared
+// with the base index of a clone.
+void MutableS2ShapeIndex::DeleteCell(S2CellId id,
+                                     const S2ShapeIndexCell* cell) {
+  if (IsBaseCell(id, cell)) return;
+  edge_cache_.erase(cell);
+  delete cell;
+}
+
 void MutableS2ShapeIndex::Clear() {
   ReleaseAll();
 }
 
+void MutableS2ShapeIndex::ForceBuildInBackground(std::function<void()> done) {
+  if (options_.executor() == nullptr) {
+    // A thread created here would have to be detached, since nothing could
+    // join it, so the updates are applied by the calling thread instead.
+    ForceBuild();
+    if (done) done();
+    return;
+  }
+  if (background_ == nullptr) background_ = std::make_shared<BackgroundState>();
+  {
+    absl::MutexLock lock(&background_->mutex);
+    ++background_->num_pending;
+  }
+  // The task holds its own reference to the state because the index may be
+  // destroyed as soon as "num_pending" is decremented.
+  std::shared_ptr<BackgroundState> state = background_;
+  std::function<void()> task = [this, state, done]() {
+    ForceBuild();
+    if (done) done();
+    absl::MutexLock lock(&state->mutex);
+    --state->num_pending;
+  };
+  options_.executor()->Schedule(std::move(task));
+}
+
+void MutableS2ShapeIndex::WaitForBackgroundBuild() const {
+  if (background_ == nullptr) return;
+  BackgroundState* state = background_.get();
+  absl::MutexLock lock(&state->mutex);
+  state->mutex.Await(absl::Condition(
+      +[](int* num_pending) { return *num_pending == 0; },
+      &state->num_pending));
+}
+
+// Adds a duration to a histogram of power-of-two microsecond buckets (see
+// UpdateStats).
+static void AddToHistogram(double seconds,
+                           MutableS2ShapeIndex::UpdateStats::Histogram* h) {
+  using UpdateStats = MutableS2ShapeIndex::UpdateStats;
+  const double micros = seconds * 1e6;
+  int bucket = 0;
+  if (micros >= 1) {
+    int exp;
+    std::frexp(micros, &exp);  // micros is in [2**(exp-1), 2**exp).
+    bucket = std::min(exp, UpdateStats::kNumBuckets - 1);
+  }
+  ++(*h)[bucket];
+}
+
 // Apply any pending updates in a thread-safe way.
 void MutableS2ShapeIndex::ApplyUpdatesThreadSafe() {
-  lock_.Lock();
+  using Clock = std::chrono::steady_clock;
+  // Statistics are only recorded on the paths below that block or apply
+  // updates, so that the common case of a FRESH index is not slowed down.
+  const bool collect_stats = options_.collect_update_stats();
+  LockWithStats();
   if (index_status_.load(std::memory_order_relaxed) == FRESH) {
     lock_.Unlock();
   } else if (index_status_.load(std::memory_order_relaxed) == UPDATING) {
     // Wait until the updating thread is finished.  We do this by attempting
     // to lock a mutex that is held by the updating thread.  When this mutex
     // is unlocked the index_status_ is guaranteed to be FRESH.
-    ++update_state_->num_waiting;
+    int num_waiting = ++update_state_->num_waiting;
+    if (UpdateStats* stats = GetOrCreateUpdateStats()) {
+      stats->max_waiting = std::max(stats->max_waiting, num_waiting);
+    }
     lock_.Unlock();
+    Clock::time_point wait_start;
+    if (collect_stats) wait_start = Clock::now();
     update_state_->wait_mutex.Lock();
-    lock_.Lock();
+    double wait_seconds = 0;
+    if (collect_stats) {
+      wait_seconds =
+          std::chrono::duration<double>(Clock::now() - wait_start).count();
+    }
+    LockWithStats();
     --update_state_->num_waiting;
+    if (UpdateStats* stats = GetOrCreateUpdateStats()) {
+      ++stats->num_waits;
+      stats->total_wait_seconds += wait_seconds;
+      stats->max_wait_seconds = std::max(stats->max_wait_seconds,
+                                         wait_seconds);
+      AddToHistogram(wait_seconds, &stats->wait_micros);
+    }
     UnlockAndSignal();  // Notify other waiting threads.
   } else {
     S2_DCHECK_EQ(STALE, index_status_);
@@ -607,10 +885,27 @@ void MutableS2ShapeIndex::ApplyUpdatesThreadSafe() {
     // lock_.Lock wait_mutex *before* calling Unlock() to ensure that all other
     // threads will block on it.
     update_state_->wait_mutex.Lock();
+    // Count the pending shapes while they cannot change.
+    int64 num_pending = 0;
+    if (collect_stats) {
+      num_pending = (shapes_.size() - pending_additions_begin_ +
+                     removed_shape_ids_.size() +
+                     (pending_removals_ ? pending_removals_->size() : 0));
+    }
     // Release the spinlock before doing any real work.
     lock_.Unlock();
     ApplyUpdatesInternal();
-    lock_.Lock();
+    LockWithStats();
+    if (UpdateStats* stats = GetOrCreateUpdateStats()) {
+      const double seconds = build_times_.total_seconds;
+      ++stats->num_updates;
+      stats->total_update_seconds += seconds;
+      stats->max_update_seconds = std::max(stats->max_update_seconds, seconds);
+      AddToHistogram(seconds, &stats->update_micros);
+      stats->num_pending_shapes += num_pending;
+      stats->max_pending_shapes = std::max(stats->max_pending_shapes,
+                                           num_pending);
+    }
     // index_status_ can be updated to FRESH only while locked *and* using
     // an atomic store operation, so that MaybeApplyUpdates() can check
     // whether the index is FRESH without acquiring the spinlock.
@@ -619,6 +914,36 @@ void MutableS2ShapeIndex::ApplyUpdatesThreadSafe() {
   }
 }
 
+// Locks lock_, and counts the contention in update_stats_ if the lock was
+// held by another thread and statistics are being collected.
+void MutableS2ShapeIndex::LockWithStats() {
+  if (lock_.TryLock()) return;
+  lock_.Lock();
+  if (UpdateStats* stats = GetOrCreateUpdateStats()) {
+    ++stats->num_lock_contentions;
+  }
+}
+
+// Returns update_stats_, allocating it if necessary, or nullptr if update
+// statistics are not being collected.
+// REQUIRES: lock_ is held.
+MutableS2ShapeIndex::UpdateStats*
+MutableS2ShapeIndex::GetOrCreateUpdateStats() {
+  if (!options_.collect_update_stats()) return nullptr;
+  if (update_stats_ == nullptr) update_stats_ = make_unique<UpdateStats>();
+  return update_stats_.get();
+}
+
+MutableS2ShapeIndex::UpdateStats MutableS2ShapeIndex::GetUpdateStats() const {
+  SpinLockHolder l(&lock_);
+  return update_stats_ ? *update_stats_ : UpdateStats();
+}
+
+void MutableS2ShapeIndex::ResetUpdateStats() {
+  SpinLockHolder l(&lock_);
+  update_stats_.reset();
+}
+
 // Releases lock_ and wakes up any waiting threads by releasing wait_mutex.
 // If this was the last waiting thread, also deletes update_state_.
 // REQUIRES: lock_ is held.
@@ -643,19 +968,40 @@ inline void MutableS2ShapeIndex::UnlockAndSignal() {
 // This method updates the index by applying all pending additions and
 // removals.  It does *not* update index_status_ (see ApplyUpdatesThreadSafe).
 void MutableS2ShapeIndex::ApplyUpdatesInternal() {
+  using Clock = std::chrono::steady_clock;
+  auto seconds_since = [](Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  };
+  const Clock::time_point update_start = Clock::now();
+  build_times_ = BuildTimes();
+
   // Check whether we have so many edges to process that we should process
   // them in multiple batches to save memory.  Building the index can use up
   // to 20x as much memory (per edge) as the final index size.
   vector<BatchDescriptor> batches = GetUpdateBatches();
+  build_times_.num_batches = batches.size();
+  if (!removed_shape_ids_.empty()) {
+    if (!cell_array_.ids.empty()) MoveCellArrayToMap();
+    RemoveShapeIdsFromCells();
+  }
   for (const BatchDescriptor& batch : batches) {
+    // Incremental updates are always applied to the btree representation.
+    if (!cell_array_.ids.empty()) MoveCellArrayToMap();
     if (mem_tracker_.is_active()) {
       S2_DCHECK_EQ(mem_tracker_.client_usage_bytes(), SpaceUsed());  // Invariant.
     }
     vector<FaceEdge> all_edges[6];
     ReserveSpace(batch, all_edges);
-    if (!mem_tracker_.ok()) return Minimize();
-
+    if (!mem_tracker_.ok()) return MinimizeInternal();
+
+    // If the index is currently empty then the new cells cannot overlap any
+    // existing index cells, and therefore each face can be built without
+    // consulting cell_map_.  (This is not true when shapes are being removed,
+    // since removed edges are discarded only when existing cells are
+    // absorbed.)
+    const bool disjoint_from_index = cell_map_.empty() && !pending_removals_;
     InteriorTracker tracker;
+    Clock::time_point phase_start = Clock::now();
     if (pending_removals_) {
       // The first batch implicitly includes all shapes being removed.
       for (const auto& pending_removal : *pending_removals_) {
@@ -673,11 +1019,32 @@ void MutableS2ShapeIndex::ApplyUpdatesInternal() {
                                                            : shape->num_edges();
       AddShape(shape, begin.edge_id, edges_end, all_edges, &tracker);
     }
-    for (int face = 0; face < 6; ++face) {
-      UpdateFaceEdges(face, all_edges[face], &tracker);
-      // Save memory by clearing vectors after we are done with them.
-      vector<FaceEdge>().swap(all_edges[face]);
+    build_times_.face_edges_seconds += seconds_since(phase_start);
+    phase_start = Clock::now();
+    if (build_face_ >= 0) {
+      // Only one face is being built, so the tracker must be initialized as
+      // though all the previous faces had been processed.
+      for (int face = 0; face < 6; ++face) {
+        if (face == build_face_) {
+          InteriorTracker face_tracker;
+          InitFaceTracker(batch, face, &face_tracker);
+          UpdateFaceEdges(face, all_edges[face], disjoint_from_index,
+                          &face_tracker);
+        }
+        vector<FaceEdge>().swap(all_edges[face]);
+      }
+    } else if (disjoint_from_index &&
+        (S2NumThreads(options_.executor(), options_.num_threads()) > 1 ||
+         options_.bulk_load())) {
+      BuildFaceRuns(batch, all_edges, &tracker);
+    } else {
+      for (int face = 0; face < 6; ++face) {
+        UpdateFaceEdges(face, all_edges[face], disjoint_from_index, &tracker);
+        // Save memory by clearing vectors after we are done with them.
+        vector<FaceEdge>().swap(all_edges[face]);
+      }
     }
+    build_times_.cells_seconds += seconds_since(phase_start);
     pending_additions_begin_ = batch.end.shape_id;
     if (batch.begin.edge_id > 0 && batch.end.edge_id == 0) {
       // We have just finished adding the edges of shape that was split over
@@ -687,9 +1054,10 @@ void MutableS2ShapeIndex::ApplyUpdatesInternal() {
     }
     if (mem_tracker_.is_active()) {
       mem_tracker_.Tally(-mem_tracker_.client_usage_bytes());
-      if (!mem_tracker_.Tally(SpaceUsed())) return Minimize();
+      if (!mem_tracker_.Tally(SpaceUsed())) return MinimizeInternal();
     }
   }
+  build_times_.total_seconds = seconds_since(update_start);
   // It is the caller's responsibility to update index_status_.
 }
 
@@ -1024,11 +1392,92 @@ void MutableS2ShapeIndex::AddShape(
           s2shapeutil::ContainsBruteForce(*shape, tracker->focus()));
     }
   }
-  for (int e = edges_begin; e < edges_end; ++e) {
-    edge.edge_id = e;
-    edge.edge = shape->edge(e);
-    edge.max_level = GetEdgeMaxLevel(edge.edge);
-    AddFaceEdge(&edge, all_edges);
+  // Edges are added one chain at a time when the chains are long enough that
+  // converting their vertices in batches is worthwhile (see AddChainEdges).
+  // Chains that are split between batches are added one edge at a time.
+  const int num_chains = shape->num_chains();
+  if (shape->dimension() == 0 || edges_begin == edges_end ||
+      num_chains * kMinBatchChainLength > edges_end - edges_begin) {
+    AddEdges(*shape, edges_begin, edges_end, &edge, all_edges);
+    return;
+  }
+  vector<S2Point> tmp_vertices;
+  for (int c = shape->chain_position(edges_begin).chain_id; c < num_chains;
+       ++c) {
+    S2Shape::Chain chain = shape->chain(c);
+    if (chain.start >= edges_end) break;
+    int begin = max(edges_begin, chain.start);
+    int end = min(edges_end, chain.start + chain.length);
+    if (begin == chain.start && end == chain.start + chain.length &&
+        chain.length > 0) {
+      edge.edge_id = chain.start;
+      AddChainEdges(shape->GetChainVertices(c, &tmp_vertices), chain.length,
+                    &edge, all_edges);
+    } else {
+      AddEdges(*shape, begin, end, &edge, all_edges);
+    }
+  }
+}
+
+// Adds the edges of "shape" in the range [begin, end) to "all_edges", using
+// "edge" as a template.
+void MutableS2ShapeIndex::AddEdges(const S2Shape& shape, int begin, int end,
+                                   FaceEdge* edge,
+                                   vector<FaceEdge> all_edges[6]) const {
+  for (int e = begin; e < end; ++e) {
+    edge->edge_id = e;
+    edge->edge = shape.edge(e);
+    edge->max_level = GetEdgeMaxLevel(edge->edge);
+    AddFaceEdge(edge, all_edges);
+  }
+}
+
+// Adds the "num_edges" edges of a chain with the given vertices (see
+// S2Shape::GetChainVertices) to "all_edges", using "edge" as a template
+// whose edge_id is the id of the first edge of the chain.  This is
+// equivalent to calling AddFaceEdge() for each edge, except that the
+// vertices are converted to (face, u, v) coordinates in batches using
+// S2::GetFaceUVs(), so that each vertex is converted only once and the
+// conversion loops can be vectorized.
+void MutableS2ShapeIndex::AddChainEdges(S2PointSpan vertices, int num_edges,
+                                        FaceEdge* edge,
+                                        vector<FaceEdge> all_edges[6]) const {
+  constexpr int kBatchSize = 64;
+  const double kMaxUV = 1 - kCellPadding;
+  const int num_vertices = vertices.size();
+  const int first_edge_id = edge->edge_id;
+  int faces[kBatchSize + 1];
+  R2Point uvs[kBatchSize + 1];
+  for (int begin = 0; begin < num_edges; begin += kBatchSize) {
+    // Convert the vertices of edges [begin, end).  The last edge of a closed
+    // chain ends at vertex 0.
+    const int end = min(num_edges, begin + kBatchSize);
+    const int n = end - begin;
+    if (end == num_vertices) {
+      S2::GetFaceUVs(S2PointSpan(&vertices[begin], n), faces, uvs);
+      S2::GetFaceUVs(S2PointSpan(&vertices[0], 1), faces + n, uvs + n);
+    } else {
+      S2::GetFaceUVs(S2PointSpan(&vertices[begin], n + 1), faces, uvs);
+    }
+    for (int i = 0; i < n; ++i) {
+      const int j = begin + i;
+      edge->edge_id = first_edge_id + j;
+      edge->edge = S2Shape::Edge(vertices[j],
+                                 vertices[j + 1 == num_vertices ? 0 : j + 1]);
+      edge->max_level = GetEdgeMaxLevel(edge->edge);
+      // This is the fast path of AddFaceEdge().
+      const R2Point& a = uvs[i];
+      const R2Point& b = uvs[i + 1];
+      if (faces[i] == faces[i + 1] &&
+          max(max(fabs(a[0]), fabs(a[1])), max(fabs(b[0]), fabs(b[1]))) <=
+              kMaxUV) {
+        edge->a = a;
+        edge->b = b;
+        all_edges[faces[i]].push_back(*edge);
+      } else {
+        AddFaceEdge(edge, all_edges);
+      }
+    }
   }
 }
 
@@ -1051,6 +1500,7 @@ void MutableS2ShapeIndex::RemoveShape(const RemovedShape& removed,
 
 void MutableS2ShapeIndex::FinishPartialShape(int shape_id) {
   if (shape_id < 0) return;  // The partial shape did not have an interior.
+  S2_DCHECK(cell_array_.ids.empty());
   const S2Shape* shape = this->shape(shape_id);
 
   // Filling in the interior of a partial shape can grow the cell_map_
@@ -1085,16 +1535,24 @@ void MutableS2ShapeIndex::FinishPartialShape(int shape_id) {
   // "tmp_edges" below speeds up large polygon index construction by 3-12%.
   vector<S2Shape::Edge> tmp_edges;  // Temporary storage.
   InteriorTracker tracker;
+  S2CellId begin = S2CellId::Begin(S2CellId::kMaxLevel);
+  S2CellId end = S2CellId::End(S2CellId::kMaxLevel);
+  if (build_face_ >= 0) {
+    // Only the cells of one face are being built (see EncodeByFace).
+    S2CellId face_id = S2CellId::FromFace(build_face_);
+    tracker.MoveTo(S2PaddedCell(face_id, kCellPadding).GetEntryVertex());
+    tracker.set_next_cellid(face_id);
+    begin = face_id.range_min();
+    end = face_id.range_max().next();
+  }
   tracker.AddShape(shape_id,
                    s2shapeutil::ContainsBruteForce(*shape, tracker.focus()));
-  S2CellId begin = S2CellId::Begin(S2CellId::kMaxLevel);
   for (CellMap::iterator index_it = cell_map_.begin(); ; ++index_it) {
     if (!tracker.shape_ids().empty()) {
       // Check whether we need to add new cells that are entirely contained by
       // the partial shape.
       S2CellId fill_end =
-          (index_it != cell_map_.end()) ? index_it->first.range_min()
-                                        : S2CellId::End(S2CellId::kMaxLevel);
+          (index_it != cell_map_.end()) ? index_it->first.range_min() : end;
       if (begin != fill_end) {
         for (S2CellId cellid : S2CellUnion::FromBeginEnd(begin, fill_end)) {
           S2ShapeIndexCell* cell = new S2ShapeIndexCell;
@@ -1195,7 +1653,10 @@ int MutableS2ShapeIndex::GetEdgeMaxLevel(const S2Shape::Edge& edge) const {
 // allocated as the recursion does down and freed as it comes back up.
 //
 // It also provides a mutable vector of FaceEdges that is used when
-// incrementally updating the index (see AbsorbIndexCell).
+// incrementally updating the index (see AbsorbIndexCell), and the vectors
+// used to pass edges to the children of each cell (see UpdateEdges).  All of
+// this storage is reused throughout the recursion, so that the number of
+// heap allocations does not grow with the number of cells visited.
 class MutableS2ShapeIndex::EdgeAllocator {
  public:
   EdgeAllocator() : size_(0) {}
@@ -1203,10 +1664,12 @@ class MutableS2ShapeIndex::EdgeAllocator {
   // Return a pointer to a newly allocated edge.  The EdgeAllocator
   // retains ownership.
   ClippedEdge* NewClippedEdge() {
-    if (size_ == clipped_edges_.size()) {
-      clipped_edges_.emplace_back(new ClippedEdge);
+    if (size_ == blocks_.size() * kBlockSize) {
+      blocks_.emplace_back(new ClippedEdge[kBlockSize]);
     }
-    return clipped_edges_[size_++].get();
+    ClippedEdge* edge = &blocks_[size_ / kBlockSize][size_ % kBlockSize];
+    ++size_;
+    return edge;
   }
   // Return the number of allocated edges.
   size_t size() const { return size_; }
@@ -1218,27 +1681,181 @@ class MutableS2ShapeIndex::EdgeAllocator {
     return &face_edges_;
   }
 
+  // Returns the vectors that hold the edges passed to the four children of a
+  // cell at the given level, indexed by [i][j] as in S2PaddedCell.  The
+  // vectors are empty but retain their capacity from previous uses.  They
+  // may be reused once all the descendants of the cell have been visited.
+  using ChildEdges = vector<const ClippedEdge*>[2][2];
+  ChildEdges& child_edges(int level) {
+    ChildEdges& result = child_edges_[level];
+    for (int i = 0; i < 2; ++i) {
+      for (int j = 0; j < 2; ++j) result[i][j].clear();
+    }
+    return result;
+  }
+
  private:
   // We can't use vector<ClippedEdge> because edges are not allowed to move
-  // once they have been allocated.  Instead we keep a pool of allocated edges
-  // that are all deleted together at the end.
+  // once they have been allocated.  Instead we keep a pool of fixed-size
+  // blocks of edges that are all deleted together at the end.
+  static constexpr size_t kBlockSize = 256;
   size_t size_;
-  vector<unique_ptr<ClippedEdge>> clipped_edges_;
+  vector<unique_ptr<ClippedEdge[]>> blocks_;
 
   // On the other hand, we can use vector<FaceEdge> because they are allocated
   // only at one level during the recursion (namely, the level at which we
   // absorb an existing index cell).
   vector<FaceEdge> face_edges_;
 
+  // The child edge vectors for cells at each level.  (Leaf cells do not have
+  // children.)
+  ChildEdges child_edges_[S2CellId::kMaxLevel];
+
   EdgeAllocator(const EdgeAllocator&) = delete;
   void operator=(const EdgeAllocator&) = delete;
 };
 
+// Builds the six faces of a new index, collecting the index cells for each
+// face in a separate sorted run.  If options_.num_threads() > 1 then the
+// faces are processed concurrently, each using its own InteriorTracker and
+// EdgeAllocator.  Since the faces are visited in increasing S2CellId order,
+// the runs can then simply be appended to the index one after another
+// (either to cell_array_ or to cell_map_, depending on bulk_load()).
+//
+// REQUIRES: The index is empty and no shapes are being removed.
+void MutableS2ShapeIndex::BuildFaceRuns(const BatchDescriptor& batch,
+                                        vector<FaceEdge> all_edges[6],
+                                        InteriorTracker* tracker) {
+  S2_DCHECK(cell_map_.empty());
+  S2_DCHECK(cell_array_.ids.empty());
+  std::array<CellRun, 6> face_runs;
+  std::array<CachedEdgesRun, 6> face_edge_caches;
+  face_runs_ = &face_runs;
+  face_edge_caches_ = &face_edge_caches;
+
+  // Faces are assigned to threads in round-robin order.  The calling thread
+  // processes face 0 using the given "tracker", whose focus is already at the
+  // start of face 0 (which is also the start of the S2CellId curve).  When
+  // only one thread is used, this tracker is simply carried over from one
+  // face to the next.
+  const int num_threads =
+      min(S2NumThreads(options_.executor(), options_.num_threads()), 6);
+  auto update_faces = [&](int first_face) {
+    for (int face = first_face; face < 6; face += num_threads) {
+      InteriorTracker face_tracker;
+      InteriorTracker* t = tracker;
+      if (face > 0 && num_threads > 1) {
+        InitFaceTracker(batch, face, &face_tracker);
+        t = &face_tracker;
+      }
+      UpdateFaceEdges(face, all_edges[face], true /*disjoint_from_index*/, t);
+      vector<FaceEdge>().swap(all_edges[face]);
+    }
+  };
+  S2ParallelFor(options_.executor(), num_threads, update_faces);
+  face_runs_ = nullptr;
+  face_edge_caches_ = nullptr;
+  for (CachedEdgesRun& run : face_edge_caches) {
+    for (auto& entry : run) edge_cache_.insert(std::move(entry));
+  }
+
+  if (options_.bulk_load()) {
+    size_t num_cells = 0;
+    for (const CellRun& run : face_runs) num_cells += run.size();
+    cell_array_.ids.reserve(num_cells);
+    cell_array_.cells.reserve(num_cells);
+    for (const CellRun& run : face_runs) {
+      for (const auto& entry : run) {
+        cell_array_.ids.push_back(entry.first);
+        cell_array_.cells.push_back(entry.second);
+      }
+    }
+    cell_array_.BuildLookup();
+  } else {
+    for (const CellRun& run : face_runs) {
+      for (const auto& entry : run) {
+        cell_map_.insert(cell_map_.end(), entry);
+      }
+    }
+  }
+}
+
+void MutableS2ShapeIndex::CellArray::BuildLookup() {
+  // The table is indexed by the cell at level L containing the target, and
+  // L is chosen so that there are about as many table entries as cells.
+  // Levels above 10 are not used since the table would then be too large
+  // to stay in cache (and the remaining binary search is already short).
+  constexpr int kMaxLookupLevel = 10;
+  lookup.clear();
+  if (ids.size() < 6 || ids.size() > std::numeric_limits<uint32>::max()) {
+    return;
+  }
+  int level = 0;
+  while (level < kMaxLookupLevel &&
+         (6ULL << (2 * (level + 1))) <= ids.size()) {
+    ++level;
+  }
+  lookup_shift = 2 * (S2CellId::kMaxLevel - level) + 1;
+  const uint64 num_buckets = 6ULL << (2 * level);
+  lookup.reserve(num_buckets + 1);
+  size_t i = 0;
+  for (uint64 b = 0; b <= num_buckets; ++b) {
+    const uint64 start = b << lookup_shift;
+    while (i < ids.size() && ids[i].id() < start) ++i;
+    lookup.push_back(static_cast<uint32>(i));
+  }
+}
+
+// Transfers all index cells from cell_array_ to cell_map_.  This is done
+// before applying any incremental update, since such updates require
+// inserting and deleting cells in arbitrary positions.
+void MutableS2ShapeIndex::MoveCellArrayToMap() {
+  S2_DCHECK(cell_map_.empty());
+  for (size_t i = 0; i < cell_array_.ids.size(); ++i) {
+    cell_map_.insert(cell_map_.end(),
+                     make_pair(cell_array_.ids[i], cell_array_.cells[i]));
+  }
+  cell_array_ = CellArray();
+  if (mem_tracker_.is_active()) {
+    mem_tracker_.Tally(-mem_tracker_.client_usage_bytes());
+    mem_tracker_.Tally(SpaceUsed());
+  }
+}
+
+// Initializes "tracker" so that its focus is the entry vertex of the given
+// face, and starts tracking the interior of every polygonal shape in "batch".
+// This yields the same state that the tracker would have if all the previous
+// faces had been processed first.
+void MutableS2ShapeIndex::InitFaceTracker(const BatchDescriptor& batch,
+                                          int face,
+                                          InteriorTracker* tracker) const {
+  S2CellId face_id = S2CellId::FromFace(face);
+  tracker->MoveTo(S2PaddedCell(face_id, kCellPadding).GetEntryVertex());
+  tracker->set_next_cellid(face_id);
+  for (auto begin = batch.begin; begin < batch.end;
+       ++begin.shape_id, begin.edge_id = 0) {
+    const S2Shape* shape = this->shape(begin.shape_id);
+    if (shape == nullptr || shape->dimension() != 2) continue;
+    int edges_end = begin.shape_id == batch.end.shape_id ? batch.end.edge_id
+                                                         : shape->num_edges();
+    if (begin.edge_id > 0 || edges_end < shape->num_edges()) {
+      // See AddShape() for how partial shapes are handled.
+      tracker->set_partial_shape_id(begin.shape_id);
+    } else {
+      tracker->AddShape(
+          begin.shape_id,
+          s2shapeutil::ContainsBruteForce(*shape, tracker->focus()));
+    }
+  }
+}
+
 // Given a face and a vector of edges that intersect that face, add or remove
 // all the edges from the index.  (An edge is added if shapes_[id] is not
-// nullptr, and removed otherwise.)
+// nullptr, and removed otherwise.)  "disjoint_from_index" indicates that
+// cell_map_ does not contain any entries that overlap the given face.
 void MutableS2ShapeIndex::UpdateFaceEdges(int face,
                                           const vector<FaceEdge>& face_edges,
+                                          bool disjoint_from_index,
                                           InteriorTracker* tracker) {
   int num_edges = face_edges.size();
   if (num_edges == 0 && tracker->shape_ids().empty()) return;
@@ -1270,13 +1887,10 @@ void MutableS2ShapeIndex::UpdateFaceEdges(int face,
   // "disjoint_from_index" means that the current cell being processed (and
   // all its descendants) are not already present in the index.  It is set to
   // true during the recursion whenever we detect that the current cell is
-  // disjoint from the index.  We could save a tiny bit of work by setting
-  // this flag to true here on the very first update, however currently there
-  // is no easy way to check that.  (It's not sufficient to test whether
-  // cell_map_.empty() or pending_additions_begin_ == 0.)
-  bool disjoint_from_index = false;
+  // disjoint from the index.
   if (num_edges > 0) {
-    S2CellId shrunk_id = ShrinkToFit(pcell, bound);
+    S2CellId shrunk_id = disjoint_from_index ? pcell.ShrinkToFit(bound)
+                                             : ShrinkToFit(pcell, bound);
     if (shrunk_id != pcell.id()) {
       // All the edges are contained by some descendant of the face cell.  We
       // can save a lot of work by starting directly with that cell, but if we
@@ -1412,17 +2026,13 @@ void MutableS2ShapeIndex::UpdateEdges(const S2PaddedCell& pcell,
   // MakeIndexCell checks if the number of edges is small enough, and creates
   // an index cell if possible (returning true when it does so).
   if (!disjoint_from_index || !MakeIndexCell(pcell, *edges, tracker)) {
-    // Reserve space for the edges that will be passed to each child.  This is
-    // important since otherwise the running time is dominated by the time
-    // required to grow the vectors.  The amount of memory involved is
-    // relatively small, so we simply reserve the maximum space for every child.
-    vector<const ClippedEdge*> child_edges[2][2];  // [i][j]
+    // The edges passed to each child are stored in vectors owned by "alloc",
+    // which are reused for every cell at this level.  This is important since
+    // otherwise the running time is dominated by the time required to
+    // allocate and grow the vectors.
+    EdgeAllocator::ChildEdges& child_edges =
+        alloc->child_edges(pcell.level());
     int num_edges = edges->size();
-    for (int i = 0; i < 2; ++i) {
-      for (int j = 0; j < 2; ++j) {
-        child_edges[i][j].reserve(num_edges);
-      }
-    }
 
     // Remember the current size of the EdgeAllocator so that we can free any
     // edges that are allocated during edge splitting.
@@ -1464,16 +2074,6 @@ void MutableS2ShapeIndex::UpdateEdges(const S2PaddedCell& pcell,
         ClipVAxis(right, middle[1], child_edges[1], alloc);
       }
     }
-    // Free any memory reserved for children that turned out to be empty.  This
-    // step is cheap and reduces peak memory usage by about 10% when building
-    // large indexes (> 10M edges).
-    for (int i = 0; i < 2; ++i) {
-      for (int j = 0; j < 2; ++j) {
-        if (child_edges[i][j].empty()) {
-          vector<const ClippedEdge*>().swap(child_edges[i][j]);
-        }
-      }
-    }
     // Now recursively update the edges in each child.  We call the children in
     // increasing order of S2CellId so that when the index is first constructed,
     // all insertions into cell_map_ are at the end (which is much faster).
@@ -1680,7 +2280,7 @@ void MutableS2ShapeIndex::AbsorbIndexCell(const S2PaddedCell& pcell,
   // Update the edge list and delete this cell from the index.
   edges->swap(new_edges);
   cell_map_.erase(pcell.id());
-  delete &cell;
+  DeleteCell(pcell.id(), &cell);
 }
 
 // Attempt to build an index cell containing the given edges, and return true
@@ -1887,12 +2487,36 @@ bool MutableS2ShapeIndex::MakeIndexCell(const S2PaddedCell& pcell,
       }
     }
   }
+  if (options_.compact_cells()) cell->CompactEdges();
+  // The clipped shapes list their edges in the same order as "edges".
+  if ((options_.cache_edges() || options_.cache_float_edges()) &&
+      !edges.empty()) {
+    CachedEdges cached;
+    if (options_.cache_edges()) {
+      cached.edges = absl::make_unique<S2Shape::Edge[]>(edges.size());
+      for (int e = 0; e < edges.size(); ++e) {
+        cached.edges[e] = edges[e]->face_edge->edge;
+      }
+    }
+    if (options_.cache_float_edges()) {
+      cached.float_edges = absl::make_unique<float[]>(6 * edges.size());
+      for (int e = 0; e < edges.size(); ++e) {
+        StoreFloatEdge(edges[e]->face_edge->edge, e, edges.size(),
+                       cached.float_edges.get());
+      }
+    }
+    AddCachedEdges(pcell.id().face(), cell, std::move(cached));
+  }
   // UpdateEdges() visits cells in increasing order of S2CellId, so during
   // initial construction of the index all insertions happen at the end.  It
   // is much faster to give an insertion hint in this case.  Otherwise the
   // hint doesn't do much harm.  With more effort we could provide a hint even
   // during incremental updates, but this is probably not worth the effort.
-  cell_map_.insert(cell_map_.end(), make_pair(pcell.id(), cell));
+  if (face_runs_ != nullptr) {
+    (*face_runs_)[pcell.id().face()].push_back(make_pair(pcell.id(), cell));
+  } else {
+    cell_map_.insert(cell_map_.end(), make_pair(pcell.id(), cell));
+  }
 
   // Shift the InteriorTracker focus point to the exit vertex of this cell.
   if (tracker->is_active() && !edges.empty()) {
@@ -1903,6 +2527,79 @@ bool MutableS2ShapeIndex::MakeIndexCell(const S2PaddedCell& pcell,
   return true;
 }
 
+// Stores "edge" as edge "i" of a single-precision edge array for a cell with
+// "num_edges" edges (see S2ShapeIndex::cached_float_edges).
+/* static */
+void MutableS2ShapeIndex::StoreFloatEdge(const S2Shape::Edge& edge, int i,
+                                         int num_edges, float* coords) {
+  for (int c = 0; c < 3; ++c) {
+    coords[c * num_edges + i] = static_cast<float>(edge.v0[c]);
+    coords[(c + 3) * num_edges + i] = static_cast<float>(edge.v1[c]);
+  }
+}
+
+const S2Shape::Edge* MutableS2ShapeIndex::cached_edges(
+    const S2ShapeIndexCell& cell) const {
+  const CachedEdges* cached = FindCachedEdges(cell);
+  return cached != nullptr ? cached->edges.get() : nullptr;
+}
+
+const float* MutableS2ShapeIndex::cached_float_edges(
+    const S2ShapeIndexCell& cell) const {
+  const CachedEdges* cached = FindCachedEdges(cell);
+  return cached != nullptr ? cached->float_edges.get() : nullptr;
+}
+
+// Returns the edges copied for the given cell by this index or by the index
+// that it was cloned from, or nullptr if there are none.
+const MutableS2ShapeIndex::CachedEdges* MutableS2ShapeIndex::FindCachedEdges(
+    const S2ShapeIndexCell& cell) const {
+  for (const MutableS2ShapeIndex* index = this; index != nullptr;
+       index = index->base_.get()) {
+    auto it = index->edge_cache_.find(&cell);
+    if (it != index->edge_cache_.end()) return &it->second;
+  }
+  return nullptr;
+}
+
+// Records the edges copied for a new cell on the given face.
+void MutableS2ShapeIndex::AddCachedEdges(int face,
+                                         const S2ShapeIndexCell* cell,
+                                         CachedEdges cached) {
+  if (face_edge_caches_ != nullptr) {
+    (*face_edge_caches_)[face].emplace_back(cell, std::move(cached));
+  } else {
+    edge_cache_[cell] = std::move(cached);
+  }
+}
+
+// Copies the endpoints of all edges in the given cell, in double and/or
+// single precision (see Options::cache_edges and Options::cache_float_edges).
+void MutableS2ShapeIndex::CacheEdges(S2ShapeIndexCell* cell) {
+  const int num_edges = cell->num_edges();
+  if (num_edges == 0) return;
+  CachedEdges cached;
+  if (options_.cache_edges()) {
+    cached.edges = absl::make_unique<S2Shape::Edge[]>(num_edges);
+  }
+  if (options_.cache_float_edges()) {
+    cached.float_edges = absl::make_unique<float[]>(6 * num_edges);
+  }
+  int i = 0;
+  for (int s = 0; s < cell->num_clipped(); ++s) {
+    const S2ClippedShape& clipped = cell->clipped(s);
+    const S2Shape* shape = this->shape(clipped.shape_id());
+    for (int j = 0; j < clipped.num_edges(); ++j, ++i) {
+      S2Shape::Edge edge = shape->edge(clipped.edge(j));
+      if (cached.edges) cached.edges[i] = edge;
+      if (cached.float_edges) {
+        StoreFloatEdge(edge, i, num_edges, cached.float_edges.get());
+      }
+    }
+  }
+  edge_cache_[cell] = std::move(cached);
+}
+
 // Call tracker->TestEdge() on all edges from shapes that have interiors.
 /* static */
 void MutableS2ShapeIndex::TestAllEdges(const vector<const ClippedEdge*>& edges,
@@ -1946,6 +2643,10 @@ size_t MutableS2ShapeIndex::SpaceUsed() const {
   // cell_map_ itself is already included in sizeof(*this).
   size += cell_map_.bytes_used() - sizeof(cell_map_);
   size += cell_map_.size() * sizeof(S2ShapeIndexCell);
+  size += cell_array_.ids.capacity() * sizeof(S2CellId);
+  size += cell_array_.cells.capacity() * sizeof(S2ShapeIndexCell*);
+  size += cell_array_.lookup.capacity() * sizeof(uint32);
+  size += cell_array_.ids.size() * sizeof(S2ShapeIndexCell);
   Iterator it;
   for (it.InitStale(this, S2ShapeIndex::BEGIN); !it.done(); it.Next()) {
     const S2ShapeIndexCell& cell = it.cell();
@@ -1957,6 +2658,14 @@ size_t MutableS2ShapeIndex::SpaceUsed() const {
       }
     }
   }
+  size += edge_cache_.capacity() *
+          (sizeof(EdgeCache::value_type) + sizeof(int8));
+  for (const auto& entry : edge_cache_) {
+    const int num_edges = entry.first->num_edges();
+    if (entry.second.edges) size += num_edges * sizeof(S2Shape::Edge);
+    if (entry.second.float_edges) size += 6 * num_edges * sizeof(float);
+  }
+  size += removed_shape_ids_.capacity() * sizeof(int);
   if (pending_removals_ != nullptr) {
     size += sizeof(*pending_removals_);
     size += pending_removals_->capacity() * sizeof(RemovedShape);
@@ -1967,26 +2676,198 @@ size_t MutableS2ShapeIndex::SpaceUsed() const {
   return size;
 }
 
+MutableS2ShapeIndex::Stats MutableS2ShapeIndex::GetStats() const {
+  Stats stats;
+  for (const S2Shape* shape : *this) {
+    if (shape == nullptr) continue;
+    ++stats.num_shapes;
+    stats.num_edges += shape->num_edges();
+  }
+  // Iterator::Init() applies any pending updates.
+  Iterator it(this, S2ShapeIndex::BEGIN);
+  for (; !it.done(); it.Next()) {
+    const S2ShapeIndexCell& cell = it.cell();
+    ++stats.num_cells;
+    ++stats.cells_per_level[it.id().level()];
+    int num_edges = 0;
+    for (int s = 0; s < cell.num_clipped(); ++s) {
+      const S2ClippedShape& clipped = cell.clipped(s);
+      num_edges += clipped.num_edges();
+      if (clipped.num_edges() == 0) ++stats.num_interior_clipped_shapes;
+      if (!clipped.is_inline()) {
+        stats.clipped_shape_bytes += clipped.num_edges() * sizeof(int32);
+      }
+    }
+    stats.clipped_shape_bytes +=
+        cell.shapes_.capacity() * sizeof(S2ClippedShape);
+    stats.num_clipped_shapes += cell.num_clipped();
+    if (num_edges >= stats.edges_per_cell.size()) {
+      stats.edges_per_cell.resize(num_edges + 1);
+    }
+    ++stats.edges_per_cell[num_edges];
+    if (num_edges > options_.max_edges_per_cell()) ++stats.num_long_edge_cells;
+  }
+  stats.cell_map_bytes =
+      cell_map_.bytes_used() +
+      cell_array_.ids.capacity() * sizeof(S2CellId) +
+      cell_array_.cells.capacity() * sizeof(S2ShapeIndexCell*) +
+      cell_array_.lookup.capacity() * sizeof(uint32) +
+      stats.num_cells * sizeof(S2ShapeIndexCell);
+  stats.total_bytes = SpaceUsed();
+  stats.last_build = build_times_;
+  return stats;
+}
+
+string MutableS2ShapeIndex::Stats::ToString() const {
+  string result = absl::StrCat(
+      "shapes: ", num_shapes, ", edges: ", num_edges, ", cells: ", num_cells,
+      ", clipped shapes: ", num_clipped_shapes, " (",
+      num_interior_clipped_shapes, " interior), long-edge cells: ",
+      num_long_edge_cells, "\ncells per level:");
+  for (int level = 0; level <= S2CellId::kMaxLevel; ++level) {
+    if (cells_per_level[level] == 0) continue;
+    absl::StrAppend(&result, " ", level, ":", cells_per_level[level]);
+  }
+  absl::StrAppend(&result, "\nedges per cell:");
+  for (int i = 0; i < edges_per_cell.size(); ++i) {
+    if (edges_per_cell[i] == 0) continue;
+    absl::StrAppend(&result, " ", i, ":", edges_per_cell[i]);
+  }
+  absl::StrAppend(&result, "\nbytes: ", total_bytes, " total, ",
+                  cell_map_bytes, " cell map, ", clipped_shape_bytes,
+                  " clipped shapes\nlast build: ", last_build.num_batches,
+                  " batches, ", last_build.total_seconds, "s total, ",
+                  last_build.face_edges_seconds, "s face edges, ",
+                  last_build.cells_seconds, "s cells\n");
+  return result;
+}
+
+string MutableS2ShapeIndex::UpdateStats::ToString() const {
+  // Appends the non-empty histogram buckets, labelled by their upper bound.
+  auto append_histogram = [](const Histogram& h, string* result) {
+    for (int i = 0; i < kNumBuckets; ++i) {
+      if (h[i] == 0) continue;
+      absl::StrAppend(result, " <", int64{1} << i, "us:", h[i]);
+    }
+  };
+  string result = absl::StrCat(
+      "updates: ", num_updates, ", ", total_update_seconds, "s total, ",
+      max_update_seconds, "s max, pending shapes: ", num_pending_shapes,
+      " total, ", max_pending_shapes, " max\nupdate times:");
+  append_histogram(update_micros, &result);
+  absl::StrAppend(&result, "\nwaits: ", num_waits, ", ", total_wait_seconds,
+                  "s total, ", max_wait_seconds, "s max, ", max_waiting,
+                  " max waiting, lock contentions: ", num_lock_contentions,
+                  "\nwait times:");
+  append_histogram(wait_micros, &result);
+  absl::StrAppend(&result, "\n");
+  return result;
+}
+
 void MutableS2ShapeIndex::Encode(Encoder* encoder) const {
+  EncodeVersion(encoder);
+
+  // The index will be built anyway when we iterate through it, but building
+  // it in advance lets us size the cell_ids vector correctly.
+  ForceBuild();
+  vector<S2CellId> cell_ids;
+  cell_ids.reserve(cell_map_.size() + cell_array_.ids.size());
+  s2coding::StringVectorEncoder encoded_cells;
+  for (Iterator it(this, S2ShapeIndex::BEGIN); !it.done(); it.Next()) {
+    cell_ids.push_back(it.id());
+    it.cell().Encode(num_shape_ids(), encoded_cells.AddViaEncoder());
+  }
+  s2coding::EncodeS2CellIdVector(cell_ids, encoder);
+  encoded_cells.Encode(encoder);
+}
+
+// Encodes the version number and the options needed to decode the index.
+void MutableS2ShapeIndex::EncodeVersion(Encoder* encoder) const {
   // The version number is encoded in 2 bits, under the assumption that by the
   // time we need 5 versions the first version can be permanently retired.
   // This only saves 1 byte, but that's significant for very small indexes.
   encoder->Ensure(Varint::kMax64);
   uint64 max_edges = options_.max_edges_per_cell();
   encoder->put_varint64(max_edges << 2 | kCurrentEncodingVersionNumber);
+}
 
-  // The index will be built anyway when we iterate through it, but building
-  // it in advance lets us size the cell_ids vector correctly.
+// Appends the encoded cell ids to "encoder", and returns the encoded cells
+// as a sequence of groups that can be passed to StringVectorEncoder::Encode().
+vector<s2coding::StringVectorEncoder> MutableS2ShapeIndex::EncodeCells(
+    int num_threads, Encoder* encoder) const {
+  S2_DCHECK_GE(num_threads, 1);
   ForceBuild();
   vector<S2CellId> cell_ids;
-  cell_ids.reserve(cell_map_.size());
-  s2coding::StringVectorEncoder encoded_cells;
+  vector<const S2ShapeIndexCell*> cells;
+  cell_ids.reserve(cell_map_.size() + cell_array_.ids.size());
+  cells.reserve(cell_ids.capacity());
   for (Iterator it(this, S2ShapeIndex::BEGIN); !it.done(); it.Next()) {
     cell_ids.push_back(it.id());
-    it.cell().Encode(num_shape_ids(), encoded_cells.AddViaEncoder());
+    cells.push_back(&it.cell());
   }
   s2coding::EncodeS2CellIdVector(cell_ids, encoder);
-  encoded_cells.Encode(encoder);
+
+  // Cells are encoded in groups of consecutive cells, and each group is
+  // encoded into its own buffer by whichever thread claims it.
+  constexpr int kCellsPerGroup = 1024;
+  const int num_cells = cells.size();
+  const int num_groups = (num_cells + kCellsPerGroup - 1) / kCellsPerGroup;
+  vector<s2coding::StringVectorEncoder> groups(num_groups);
+  std::atomic<int> next_group(0);
+  auto encode_groups = [&]() {
+    for (int g; (g = next_group.fetch_add(1)) < num_groups; ) {
+      int end = min(num_cells, (g + 1) * kCellsPerGroup);
+      for (int i = g * kCellsPerGroup; i < end; ++i) {
+        cells[i]->Encode(num_shape_ids(), groups[g].AddViaEncoder());
+      }
+    }
+  };
+  num_threads = max(
+      1, min(S2NumThreads(options_.executor(), num_threads), num_groups));
+  S2ParallelFor(options_.executor(), num_threads,
+                [&](int) { encode_groups(); });
+  return groups;
+}
+
+void MutableS2ShapeIndex::Encode(int num_threads, Encoder* encoder) const {
+  if (S2NumThreads(options_.executor(), num_threads) <= 1) {
+    return Encode(encoder);
+  }
+  EncodeVersion(encoder);
+  s2coding::StringVectorEncoder::Encode(EncodeCells(num_threads, encoder),
+                                        encoder);
+}
+
+void MutableS2ShapeIndex::Encode(int num_threads,
+                                 const EncodedDataSink& sink) const {
+  // The version and the cell ids are small compared to the cell contents.
+  Encoder encoder;
+  EncodeVersion(&encoder);
+  auto groups = EncodeCells(num_threads, &encoder);
+  sink(absl::string_view(encoder.base(), encoder.length()));
+  s2coding::StringVectorEncoder::Encode(groups, sink);
+}
+
+void MutableS2ShapeIndex::EncodeByFace(const EncodedDataSink& sink) {
+  Minimize();
+  vector<S2CellId> cell_ids;
+  vector<s2coding::StringVectorEncoder> groups(6);
+  for (int face = 0; face < 6; ++face) {
+    build_face_ = face;
+    ForceBuild();
+    for (const auto& entry : cell_map_) {
+      cell_ids.push_back(entry.first);
+      entry.second->Encode(num_shape_ids(), groups[face].AddViaEncoder());
+    }
+    MinimizeInternal();
+  }
+  build_face_ = -1;
+
+  Encoder encoder;
+  EncodeVersion(&encoder);
+  s2coding::EncodeS2CellIdVector(cell_ids, &encoder);
+  sink(absl::string_view(encoder.base(), encoder.length()));
+  s2coding::StringVectorEncoder::Encode(groups, sink);
 }
 
 bool MutableS2ShapeIndex::Init(Decoder* decoder,
@@ -2010,12 +2891,29 @@ bool MutableS2ShapeIndex::Init(Decoder* decoder,
   if (!cell_ids.Init(decoder)) return false;
   if (!encoded_cells.Init(decoder)) return false;
 
+  if (options_.bulk_load()) {
+    cell_array_.ids.reserve(cell_ids.size());
+    cell_array_.cells.reserve(cell_ids.size());
+  }
   for (int i = 0; i < cell_ids.size(); ++i) {
     S2CellId id = cell_ids[i];
     S2ShapeIndexCell* cell = new S2ShapeIndexCell;
     Decoder decoder = encoded_cells.GetDecoder(i);
-    if (!cell->Decode(num_shapes, &decoder)) return false;
-    cell_map_.insert(cell_map_.end(), make_pair(id, cell));
+    if (!cell->Decode(num_shapes, &decoder)) {
+      delete cell;
+      return false;
+    }
+    if (options_.compact_cells()) cell->CompactEdges();
+    if (options_.cache_edges() || options_.cache_float_edges()) {
+      CacheEdges(cell);
+    }
+    if (options_.bulk_load()) {
+      cell_array_.ids.push_back(id);
+      cell_array_.cells.push_back(cell);
+    } else {
+      cell_map_.insert(cell_map_.end(), make_pair(id, cell));
+    }
   }
+  if (options_.bulk_load()) cell_array_.BuildLookup();
   return true;
 }
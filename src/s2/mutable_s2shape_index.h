@@ -18,17 +18,22 @@
 #ifndef S2_MUTABLE_S2SHAPE_INDEX_H_
 #define S2_MUTABLE_S2SHAPE_INDEX_H_
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cstddef>
+#include <functional>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/base/macros.h"
 #include "absl/base/thread_annotations.h"
 #include "absl/container/btree_map.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 
 #include "s2/base/commandlineflags.h"
@@ -36,8 +41,11 @@
 #include "s2/base/logging.h"
 #include "s2/base/spinlock.h"
 #include "s2/_fp_contract_off.h"
+#include "s2/encoded_string_vector.h"
 #include "s2/s2cell_id.h"
+#include "s2/s2executor.h"
 #include "s2/s2memory_tracker.h"
+#include "s2/s2point_span.h"
 #include "s2/s2pointutil.h"
 #include "s2/s2shape.h"
 #include "s2/s2shape_index.h"
@@ -132,6 +140,25 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
  private:
   using CellMap = s2internal::BTreeMap<S2CellId, S2ShapeIndexCell*>;
 
+  // An alternative representation of the index cells as two parallel arrays
+  // sorted by S2CellId (see Options::bulk_load).
+  struct CellArray {
+    std::vector<S2CellId> ids;
+    std::vector<S2ShapeIndexCell*> cells;
+
+    // An optional table that speeds up seeking by narrowing the binary
+    // search to a small range of "ids".  Entry "b" is the position of the
+    // first id that is >= (b << lookup_shift), i.e. the table is indexed by
+    // the cell at a fixed level containing the target.  The final entry
+    // covers all targets beyond the last cell.  Empty if there is no table.
+    std::vector<uint32> lookup;
+    int lookup_shift = 0;
+
+    // Builds the lookup table, choosing its level based on the number of
+    // cells so that it uses at most 4 bytes per cell.
+    void BuildLookup();
+  };
+
  public:
   // Options that affect construction of the MutableS2ShapeIndex.
   class Options {
@@ -158,8 +185,133 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
     int max_edges_per_cell() const { return max_edges_per_cell_; }
     void set_max_edges_per_cell(int max_edges_per_cell);
 
+    // The maximum number of threads used to build the index.  When the index
+    // is built from scratch (i.e., there are no existing index cells), the
+    // six cube faces are independent of each other and can be processed
+    // concurrently.  Each thread produces a sorted run of index cells for the
+    // faces assigned to it, and these runs are then appended to the index in
+    // S2CellId order.  Incremental updates to an existing index are always
+    // applied using a single thread.
+    //
+    // The resulting index is identical to the one built using a single
+    // thread.  Note that each additional face processed in parallel requires
+    // testing whether every polygonal shape contains the start of that face,
+    // so this option is only beneficial for large indexes.
+    //
+    // REQUIRES: The S2Shape methods of all indexed shapes are thread-safe
+    //           (which is true of all S2Shape types in this library).
+    //
+    // DEFAULT: 1
+    int num_threads() const { return num_threads_; }
+    void set_num_threads(int num_threads);
+
+    // If non-null, the parallel parts of building the index are run on this
+    // executor rather than on newly created threads, and num_threads() is
+    // replaced by executor->num_threads().  The executor must outlive the
+    // index.
+    //
+    // DEFAULT: nullptr
+    S2Executor* executor() const { return executor_; }
+    void set_executor(S2Executor* executor) { executor_ = executor; }
+
+    // If true, then when the index is built from scratch the index cells are
+    // written directly to a flat array sorted by S2CellId rather than being
+    // inserted one at a time into a btree.  (This also applies to indexes
+    // decoded via Init(Decoder*, ...).)  The array is converted into a btree
+    // the first time that the index is updated incrementally, i.e. when
+    // shapes are added or removed after the index has been built.
+    //
+    // This option reduces construction time and memory usage for indexes
+    // that are built once and then only queried.  Queries are also somewhat
+    // faster since seeking within the array has better cache locality.  Note
+    // that an index whose construction is split into several batches (see
+    // FLAGS_s2shape_index_tmp_memory_budget) only benefits for the first
+    // batch.
+    //
+    // DEFAULT: false
+    bool bulk_load() const { return bulk_load_; }
+    void set_bulk_load(bool bulk_load) { bulk_load_ = bulk_load; }
+
+    // If true, the index stores a copy of the endpoints of the edges that
+    // intersect each index cell (see cached_edges).  Queries such as
+    // S2ClosestEdgeQuery and S2CrossingEdgeQuery then read edges from this
+    // copy rather than calling S2Shape::edge(), which is faster for
+    // shapes whose edges are expensive to retrieve (e.g., S2Polygon::Shape
+    // with many loops or encoded shapes).  Each edge costs an extra 48 bytes
+    // for every index cell that it intersects, which typically makes the
+    // index 3-4 times larger, so this option is intended for read-heavy
+    // applications.
+    //
+    // DEFAULT: false
+    bool cache_edges() const { return cache_edges_; }
+    void set_cache_edges(bool cache_edges) { cache_edges_ = cache_edges; }
+
+    // If true, the index stores a single-precision copy of the edges that
+    // intersect each index cell (see cached_float_edges).  This
+    // costs 24 bytes per edge per index cell, half as much as cache_edges(),
+    // and allows queries to trade accuracy for memory bandwidth (see
+    // S2ClosestEdgeQuery::Options::use_float_edges).  The two options are
+    // independent and may be combined.
+    //
+    // DEFAULT: false
+    bool cache_float_edges() const { return cache_float_edges_; }
+    void set_cache_float_edges(bool cache_float_edges) {
+      cache_float_edges_ = cache_float_edges;
+    }
+
+    // If true, Release() does not copy the edges of the removed shape.
+    // Instead its shape id is recorded, and the next update removes all such
+    // shape ids from the index in a single pass over the index cells, simply
+    // discarding their clipped shapes (and any cells that become empty)
+    // rather than reclipping their edges.  This makes removal much cheaper
+    // for indexes with high churn (e.g., many short-lived shapes), since the
+    // cost of each update is proportional to the number of index cells
+    // rather than to the number of edges removed times the index depth.
+    //
+    // The drawback is that cells are not merged after shapes are removed, so
+    // the index may be subdivided more finely than necessary until it is
+    // rebuilt (e.g. by calling Minimize()).  This affects only the size of
+    // the index and the speed of queries, not their results.
+    //
+    // DEFAULT: false
+    bool lazy_removal() const { return lazy_removal_; }
+    void set_lazy_removal(bool lazy_removal) { lazy_removal_ = lazy_removal; }
+
+    // If true, the edge ids of each index cell are stored in a single
+    // contiguous allocation rather than in a separate allocation for each
+    // shape with more than two edges in the cell.  This reduces the resident
+    // size of indexes where cells typically contain several such shapes
+    // (since every heap allocation has some overhead) and improves locality
+    // when queries visit all the edges of a cell, at the cost of an extra
+    // copy while building each cell.
+    //
+    // DEFAULT: false
+    bool compact_cells() const { return compact_cells_; }
+    void set_compact_cells(bool compact_cells) {
+      compact_cells_ = compact_cells;
+    }
+
+    // If true, the index records statistics about how threads contend to
+    // apply pending updates (see GetUpdateStats).  The statistics are only
+    // updated when a query finds the index stale or being updated, so the
+    // cost is negligible compared with the cost of the updates themselves.
+    //
+    // DEFAULT: false
+    bool collect_update_stats() const { return collect_update_stats_; }
+    void set_collect_update_stats(bool collect_update_stats) {
+      collect_update_stats_ = collect_update_stats;
+    }
+
    private:
     int max_edges_per_cell_;
+    int num_threads_ = 1;
+    S2Executor* executor_ = nullptr;
+    bool bulk_load_ = false;
+    bool cache_edges_ = false;
+    bool cache_float_edges_ = false;
+    bool lazy_removal_ = false;
+    bool compact_cells_ = false;
+    bool collect_update_stats_ = false;
   };
 
   // Creates a MutableS2ShapeIndex that uses the default option settings.
@@ -169,6 +321,30 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   // Create a MutableS2ShapeIndex with the given options.
   explicit MutableS2ShapeIndex(const Options& options);
 
+  // Creates a copy-on-write clone of "base".  The new index initially
+  // contains the same shapes (with the same shape ids) as "base" and uses the
+  // same options, but it shares the S2Shape objects and index cells of
+  // "base" rather than copying them.  Only the map from S2CellIds to cells is
+  // copied (one pointer per cell), so a clone of an index containing
+  // millions of shapes can be created quickly.  Shapes may then be added to
+  // or removed from the clone, and the cost of updating it is proportional
+  // to the size of the change (just as for any other incremental update).
+  // Any index cell affected by an update is replaced by a new cell owned by
+  // the clone; the cells of "base" are never modified.  For example:
+  //
+  //   auto base = std::make_shared<MutableS2ShapeIndex>();
+  //   ... add shapes to *base ...
+  //   MutableS2ShapeIndex tenant(base);
+  //   tenant.Add(std::move(tenant_shape));
+  //
+  // The clone keeps a reference to "base", and clones of clones are allowed.
+  // Release() and ReleaseAll() do not return ownership of shapes that
+  // belong to "base" (see below).  SpaceUsed() includes the shared cells.
+  //
+  // REQUIRES: No non-const methods of "base" are called while this index (or
+  //           any clone derived from it) exists.
+  explicit MutableS2ShapeIndex(std::shared_ptr<const MutableS2ShapeIndex> base);
+
   ~MutableS2ShapeIndex() override;
 
   MutableS2ShapeIndex(MutableS2ShapeIndex&&);
@@ -247,6 +423,23 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   // Like all non-const methods, this method is not thread-safe.
   void Minimize() override;
 
+  // Applies any pending updates and then converts the index cells into a
+  // compact read-only representation consisting of a contiguous array of
+  // S2CellIds together with a parallel array of cell pointers (the same
+  // representation used by Options::bulk_load).  This reduces the memory
+  // used by the index and speeds up queries, since positioning an iterator
+  // becomes a simple binary search with good cache locality.  A small table
+  // indexed by the cell at a fixed level (up to level 10, depending on the
+  // number of cells) is also built so that Seek() and Locate() only need to
+  // search the few cells that follow the table entry for the target.
+  //
+  // The index may still be updated after calling this method, however the
+  // first update converts the cells back into a btree (in linear time).
+  // This method invalidates all iterators.
+  //
+  // Like all non-const methods, this method is not thread-safe.
+  void Freeze();
+
   // Appends an encoded representation of the S2ShapeIndex to "encoder".
   //
   // This method does not encode the S2Shapes in the index; it is the client's
@@ -271,6 +464,41 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   //           can be enlarged as necessary by calling Ensure(int).
   void Encode(Encoder* encoder) const;
 
+  // Like Encode(), but uses up to "num_threads" threads (including the
+  // calling thread) to encode the index cells.  Each thread encodes groups
+  // of consecutive cells into its own buffers, which are then concatenated.
+  // The output is identical to Encode(encoder).  If options().executor() is
+  // non-null the cells are encoded on it, and "num_threads" is replaced by
+  // executor->num_threads().
+  //
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  void Encode(int num_threads, Encoder* encoder) const;
+
+  // Like Encode(num_threads, encoder), except that the encoded index is
+  // passed to "sink" as a sequence of pieces that should be concatenated
+  // (e.g., by appending each one to a file).  This avoids copying the entire
+  // encoding into one contiguous buffer that grows as it is written.
+  using EncodedDataSink = std::function<void (absl::string_view data)>;
+  void Encode(int num_threads, const EncodedDataSink& sink) const;
+
+  // Like Encode(1, sink), except that the index is built and encoded one cube
+  // face at a time, and the index cells of each face are discarded as soon as
+  // they have been encoded.  This allows encoding very large indexes (e.g.,
+  // planet-scale datasets) whose cells do not fit in memory all at once: the
+  // memory required is that of the cells of one face, plus the encoded cells
+  // of all faces, plus the temporary space used by each update batch (which
+  // is limited by FLAGS_s2shape_index_tmp_memory_budget).  Note that the
+  // encoding is buffered in memory and is passed to "sink" only after every
+  // face has been encoded, so it must fit in memory even though the index
+  // cells do not need to.  The result can be decoded by
+  // Init() or by EncodedS2ShapeIndex, and is identical to the encoding of a
+  // newly built index containing the same shapes.
+  //
+  // Any existing index cells are discarded first, and the index has no cells
+  // afterward (as though Minimize() had been called).
+  void EncodeByFace(const EncodedDataSink& sink);
+
   // Decodes an S2ShapeIndex, returning true on success.
   //
   // This method does not decode the S2Shape objects in the index; this is
@@ -328,6 +556,8 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
     void Seek(S2CellId target) override;
     bool Locate(const S2Point& target) override;
     CellRelation Locate(S2CellId target) override;
+    bool can_prefetch() const override;
+    void Prefetch(S2CellId target) const override;
 
    protected:
     const S2ShapeIndexCell* GetCell() const override;
@@ -338,6 +568,12 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
     void Refresh();  // Updates the IteratorBase fields.
     const MutableS2ShapeIndex* index_;
     CellMap::const_iterator iter_, end_;
+
+    // If the index cells are stored in a CellArray then "array_" points to
+    // it and "pos_" is the array position of the current cell; otherwise
+    // "array_" is nullptr and the btree iterators above are used.
+    const CellArray* array_ = nullptr;
+    size_t pos_ = 0;
   };
 
   // Takes ownership of the given shape and adds it to the index.  Also
@@ -349,13 +585,27 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   // continue to be added even once the specified limit has been reached.
   int Add(std::unique_ptr<S2Shape> shape);
 
+  // Takes ownership of the given shapes and adds them to the index in order,
+  // returning the id assigned to the first one.  This is equivalent to
+  // calling Add() for each shape, but is more efficient when there are many
+  // shapes (e.g., the output of an S2Builder layer) since space for all of
+  // them is reserved at once.
+  //
+  // REQUIRES: All shapes are non-null.
+  int AddAll(std::vector<std::unique_ptr<S2Shape>> shapes);
+
   // Removes the given shape from the index and return ownership to the caller.
   // Invalidates all iterators and their associated data.
+  //
+  // If the index is a clone and the shape belongs to the base index (i.e.,
+  // it was not added to the clone itself), the shape is removed from the
+  // clone but remains owned by the base index, and nullptr is returned.
   std::unique_ptr<S2Shape> Release(int shape_id);
 
   // Resets the index to its original state and returns ownership of all
   // shapes to the caller.  This method is much more efficient than removing
-  // all shapes one at a time.
+  // all shapes one at a time.  (If the index is a clone, the entries for
+  // shapes that belong to the base index are nullptr.)
   std::vector<std::unique_ptr<S2Shape>> ReleaseAll();
 
   // Resets the index to its original state and deletes all shapes.  Any
@@ -367,6 +617,131 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   // as the other "const" methods (see introduction).
   size_t SpaceUsed() const override;
 
+  // Returns the edges copied for the given cell when Options::cache_edges()
+  // is true (see S2ShapeIndex::cached_edges).  The copies are kept in a hash
+  // table keyed by cell rather than in the cells themselves, so that indexes
+  // that don't use this option pay nothing for it.
+  const S2Shape::Edge* cached_edges(
+      const S2ShapeIndexCell& cell) const override;
+
+  // Returns the single-precision copy of the edges of the given cell when
+  // Options::cache_float_edges() is true (see
+  // S2ShapeIndex::cached_float_edges).  It is kept in the same hash table.
+  const float* cached_float_edges(
+      const S2ShapeIndexCell& cell) const override;
+
+  // The time spent in each phase of the most recent index update, i.e. the
+  // most recent call that applied pending additions or removals.
+  struct BuildTimes {
+    // The number of batches that the update was split into (see
+    // FLAGS_s2shape_index_tmp_memory_budget).
+    int num_batches = 0;
+
+    // The time spent clipping the added and removed edges to the cube faces.
+    double face_edges_seconds = 0;
+
+    // The time spent subdividing the cube faces into index cells.
+    double cells_seconds = 0;
+
+    // The total time, including reserving space and finishing each batch.
+    double total_seconds = 0;
+  };
+
+  // Statistics that describe the structure of the index.  These are intended
+  // to help choose the index options (e.g. max_edges_per_cell) and the flag
+  // --s2shape_index_cell_size_to_long_edge_ratio for a given dataset, by
+  // showing how they trade off memory usage against the number of edges that
+  // queries need to test.
+  struct Stats {
+    int num_shapes = 0;       // Not counting removed shapes.
+    int64 num_edges = 0;      // Summed over all shapes.
+    int64 num_cells = 0;
+
+    // cells_per_level[i] is the number of index cells at level i.
+    std::array<int64, S2CellId::kMaxLevel + 1> cells_per_level{};
+
+    // edges_per_cell[i] is the number of index cells that contain exactly "i"
+    // edges (summed over all the clipped shapes in the cell).  The vector
+    // size is one more than the maximum number of edges in any cell.
+    std::vector<int64> edges_per_cell;
+
+    // The number of index cells that contain more than max_edges_per_cell
+    // edges.  Such cells could not be subdivided further because their edges
+    // are "long" relative to the cell size.
+    int64 num_long_edge_cells = 0;
+
+    // The total number of clipped shapes in all index cells, and the number
+    // of those that have no edges (i.e., the cell is entirely contained by
+    // the shape's interior).
+    int64 num_clipped_shapes = 0;
+    int64 num_interior_clipped_shapes = 0;
+
+    // The bytes used to store the map from S2CellId to index cell (including
+    // the S2ShapeIndexCell objects), the clipped shapes and their edge ids,
+    // and the total returned by SpaceUsed().
+    size_t cell_map_bytes = 0;
+    size_t clipped_shape_bytes = 0;
+    size_t total_bytes = 0;
+
+    BuildTimes last_build;
+
+    // Returns a human-readable multi-line summary of these statistics.
+    std::string ToString() const;
+  };
+
+  // Returns statistics describing the structure of the index, after applying
+  // any pending updates.  This method takes time proportional to the number
+  // of index cells.
+  Stats GetStats() const;
+
+  // Cumulative statistics about applying pending updates in the "const"
+  // methods, i.e. how long updates take and how long other threads wait for
+  // them.  These are intended to make contention visible when many threads
+  // query an index that is being modified (see Options::collect_update_stats).
+  struct UpdateStats {
+    // Durations are recorded in histograms where bucket 0 counts durations
+    // under 1 microsecond and bucket i > 0 counts durations in the range
+    // [2**(i-1), 2**i) microseconds.  The last bucket also counts all longer
+    // durations.
+    static constexpr int kNumBuckets = 32;
+    using Histogram = std::array<int64, kNumBuckets>;
+
+    // The number of updates applied, the time spent applying them, and the
+    // number of shapes added or removed by them.
+    int64 num_updates = 0;
+    double total_update_seconds = 0;
+    double max_update_seconds = 0;
+    Histogram update_micros{};
+    int64 num_pending_shapes = 0;
+    int64 max_pending_shapes = 0;
+
+    // The number of times that a thread waited for an update being applied
+    // by another thread, the time spent waiting, and the largest number of
+    // threads that were waiting for the same update.
+    int64 num_waits = 0;
+    double total_wait_seconds = 0;
+    double max_wait_seconds = 0;
+    Histogram wait_micros{};
+    int max_waiting = 0;
+
+    // The number of times that a thread found the spinlock guarding the
+    // update status held by another thread and had to spin.
+    int64 num_lock_contentions = 0;
+
+    // Returns a human-readable multi-line summary of these statistics.
+    std::string ToString() const;
+  };
+
+  // Returns the statistics collected since the index was constructed or
+  // ResetUpdateStats() was called.  All values are zero unless
+  // options().collect_update_stats() is true.  This method is thread-safe
+  // and does not apply pending updates.
+  UpdateStats GetUpdateStats() const;
+
+  // Resets the statistics returned by GetUpdateStats().  This method is
+  // thread-safe.
+  void ResetUpdateStats();
+
   // Calls to Add() and Release() are normally queued and processed on the
   // first subsequent query (in a thread-safe way).  Building the index lazily
   // in this way has several advantages, the most important of which is that
@@ -401,6 +776,36 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   // MaybeApplyUpdates).
   bool is_fresh() const;
 
+  // Starts applying any pending updates in the background and returns
+  // immediately, so that the cost of updating the index is not paid by the
+  // next query.  The updates are applied by a task scheduled on
+  // options().executor().  If "done" is non-null, it is called by that task
+  // once the index is fresh.  For example:
+  //
+  //   for (auto& shape : shapes) index.Add(std::move(shape));
+  //   index.ForceBuildInBackground([&] { ready.Notify(); });
+  //
+  // Queries may be started at any time; a query that starts before the
+  // updates have been applied waits for them as usual.  Methods that modify
+  // the index (Add, Release, Minimize, Freeze, etc, and the destructor) first
+  // wait for all background updates to finish, so it is safe to modify the
+  // index at any time, but modifications made while an update is running
+  // will block.  The "done" callback must not modify the index or call
+  // WaitForBackgroundBuild().
+  //
+  // If options().executor() is null, this method is equivalent to calling
+  // ForceBuild() followed by "done" (i.e., the updates are not applied in
+  // the background).
+  //
+  // Unlike ForceBuild(), this method is not thread-safe.  (It should be
+  // called by the thread that modifies the index.)
+  void ForceBuildInBackground(std::function<void()> done = nullptr);
+
+  // Waits until all updates started by ForceBuildInBackground() have been
+  // applied and their "done" callbacks have returned.  This method may be
+  // called simultaneously with other "const" methods.
+  void WaitForBackgroundBuild() const;
+
  protected:
   std::unique_ptr<IteratorBase> NewIterator(InitialPosition pos) const override;
 
@@ -408,6 +813,7 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   friend class EncodedS2ShapeIndex;
   friend class Iterator;
   friend class MutableS2ShapeIndexTest;
+  friend class OverlayS2ShapeIndex;
   friend class S2Stats;
 
   struct BatchDescriptor;
@@ -427,7 +833,16 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
 
   // Internal methods are documented with their definitions.
   bool is_shape_being_removed(int shape_id) const;
+  bool is_base_shape(int shape_id) const;
+  bool IsBaseCell(S2CellId id, const S2ShapeIndexCell* cell) const;
+  void DeleteCell(S2CellId id, const S2ShapeIndexCell* cell);
+  void QueueRemoval(const S2Shape& shape);
+  void RemoveShapeIdsFromCells();
   void MarkIndexStale();
+  void MinimizeInternal();
+  void EncodeVersion(Encoder* encoder) const;
+  std::vector<s2coding::StringVectorEncoder> EncodeCells(
+      int num_threads, Encoder* encoder) const;
   void MaybeApplyUpdates() const;
   void ApplyUpdatesThreadSafe();
   void ApplyUpdatesInternal();
@@ -441,9 +856,19 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
                    std::vector<FaceEdge> all_edges[6],
                    InteriorTracker* tracker) const;
   void FinishPartialShape(int shape_id);
+  void AddEdges(const S2Shape& shape, int begin, int end, FaceEdge* edge,
+                std::vector<FaceEdge> all_edges[6]) const;
+  void AddChainEdges(S2PointSpan vertices, int num_edges, FaceEdge* edge,
+                     std::vector<FaceEdge> all_edges[6]) const;
   void AddFaceEdge(FaceEdge* edge, std::vector<FaceEdge> all_edges[6]) const;
+  void BuildFaceRuns(const BatchDescriptor& batch,
+                     std::vector<FaceEdge> all_edges[6],
+                     InteriorTracker* tracker);
+  void MoveCellArrayToMap();
+  void InitFaceTracker(const BatchDescriptor& batch, int face,
+                       InteriorTracker* tracker) const;
   void UpdateFaceEdges(int face, const std::vector<FaceEdge>& face_edges,
-                       InteriorTracker* tracker);
+                       bool disjoint_from_index, InteriorTracker* tracker);
   S2CellId ShrinkToFit(const S2PaddedCell& pcell, const R2Rect& bound) const;
   void SkipCellRange(S2CellId begin, S2CellId end, InteriorTracker* tracker,
                      EdgeAllocator* alloc, bool disjoint_from_index);
@@ -459,6 +884,13 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   int GetEdgeMaxLevel(const S2Shape::Edge& edge) const;
   static int CountShapes(const std::vector<const ClippedEdge*>& edges,
                          const ShapeIdSet& cshape_ids);
+  struct CachedEdges;
+  const CachedEdges* FindCachedEdges(const S2ShapeIndexCell& cell) const;
+  void AddCachedEdges(int face, const S2ShapeIndexCell* cell,
+                      CachedEdges cached);
+  void CacheEdges(S2ShapeIndexCell* cell);
+  static void StoreFloatEdge(const S2Shape::Edge& edge, int i, int num_edges,
+                             float* coords);
   bool MakeIndexCell(const S2PaddedCell& pcell,
                      const std::vector<const ClippedEdge*>& edges,
                      InteriorTracker* tracker);
@@ -482,6 +914,13 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   // when clipping line segments to cell boundaries.
   static const double kCellPadding;
 
+  // If this index is a clone, the index it was cloned from.  The shapes and
+  // index cells of "base_" are shared with this index but owned by "base_":
+  // the first base_->num_shape_ids() entries of "shapes_" are never deleted
+  // by this index, and neither is any cell that also appears in "base_" with
+  // the same S2CellId (see DeleteCell).
+  std::shared_ptr<const MutableS2ShapeIndex> base_;
+
   // The shapes in the index, accessed by their shape id.  Removed shapes are
   // replaced by nullptr pointers.
   std::vector<std::unique_ptr<S2Shape>> shapes_;
@@ -493,9 +932,45 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   // (The easiest way to achieve this is simply to use an Iterator.)
   CellMap cell_map_;
 
+  // When Options::bulk_load() is true and the index is built from scratch,
+  // the index cells are stored here rather than in cell_map_.  At most one of
+  // cell_map_ and cell_array_ is non-empty at any time.  The same access
+  // rules apply as for cell_map_.
+  CellArray cell_array_;
+
   // The options supplied for this index.
   Options options_;
 
+  // A sorted run of index cells produced while building a single face.
+  using CellRun = std::vector<std::pair<S2CellId, S2ShapeIndexCell*>>;
+
+  // If non-null, MakeIndexCell() appends new cells to the run for the
+  // corresponding face rather than inserting them into cell_map_.  This is
+  // set only while the faces of a new index are being built (see
+  // BuildFaceRuns), and each face run is accessed by one thread only.
+  std::array<CellRun, 6>* face_runs_ = nullptr;
+
+  // The edges copied from an index cell when Options::cache_edges() and/or
+  // Options::cache_float_edges() is true.
+  struct CachedEdges {
+    std::unique_ptr<S2Shape::Edge[]> edges;
+    std::unique_ptr<float[]> float_edges;
+  };
+
+  // The copied edges of every index cell owned by this index, keyed by cell.
+  // (The edges of cells shared with "base_" are found in base_->edge_cache_.)
+  // This is empty unless Options::cache_edges() or cache_float_edges() is
+  // true.
+  using EdgeCache = absl::flat_hash_map<const S2ShapeIndexCell*, CachedEdges>;
+  EdgeCache edge_cache_;
+
+  // While face runs are being built, the copied edges of the cells of each
+  // face are collected here rather than in edge_cache_ (which is not thread
+  // safe), and are then moved to edge_cache_ (see BuildFaceRuns).
+  using CachedEdgesRun =
+      std::vector<std::pair<const S2ShapeIndexCell*, CachedEdges>>;
+  std::array<CachedEdgesRun, 6>* face_edge_caches_ = nullptr;
+
   // The id of the first shape that has been queued for addition but not
   // processed yet.
   int pending_additions_begin_ = 0;
@@ -514,6 +989,18 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   // only when there are removed shapes to process (to save memory).
   std::unique_ptr<std::vector<RemovedShape>> pending_removals_;
 
+  // The ids of shapes that have been released with Options::lazy_removal()
+  // but not yet removed from the index cells.
+  std::vector<int> removed_shape_ids_;
+
+  // If non-negative, updates only build the index cells of the given face
+  // (see EncodeByFace).
+  int build_face_ = -1;
+
+  // The time spent in each phase of the most recent update (see GetStats).
+  // Only written by the updating thread within ApplyUpdatesInternal().
+  BuildTimes build_times_;
+
   // Additions and removals are queued and processed on the first subsequent
   // query.  There are several reasons to do this:
   //
@@ -569,6 +1056,27 @@ class MutableS2ShapeIndex final : public S2ShapeIndex {
   };
   std::unique_ptr<UpdateState> update_state_;
 
+  // Statistics about applying updates, allocated the first time that an
+  // update is applied or waited for if options_.collect_update_stats() is
+  // true.  Reads and writes to this field are guarded by "lock_".
+  std::unique_ptr<UpdateStats> update_stats_;
+
+#ifndef SWIG
+  // Documented in the .cc file.
+  void LockWithStats() ABSL_EXCLUSIVE_LOCK_FUNCTION(lock_);
+  UpdateStats* GetOrCreateUpdateStats();
+#endif
+
+  // BackgroundState tracks the tasks started by ForceBuildInBackground().  It
+  // is allocated by the first such call and shared with each task, so that
+  // it remains valid until the task has finished using it even if the index
+  // has been destroyed by then.
+  struct BackgroundState {
+    absl::Mutex mutex;
+    int num_pending ABSL_GUARDED_BY(mutex) = 0;
+  };
+  std::shared_ptr<BackgroundState> background_;
+
   S2MemoryTracker::Client mem_tracker_;
 
 #ifndef SWIG
@@ -685,11 +1193,17 @@ inline void MutableS2ShapeIndex::Iterator::Init(
 inline void MutableS2ShapeIndex::Iterator::InitStale(
     const MutableS2ShapeIndex* index, InitialPosition pos) {
   index_ = index;
-  end_ = index_->cell_map_.end();
-  if (pos == BEGIN) {
-    iter_ = index_->cell_map_.begin();
+  if (!index_->cell_array_.ids.empty()) {
+    array_ = &index_->cell_array_;
+    pos_ = (pos == BEGIN) ? 0 : array_->ids.size();
   } else {
-    iter_ = end_;
+    array_ = nullptr;
+    end_ = index_->cell_map_.end();
+    if (pos == BEGIN) {
+      iter_ = index_->cell_map_.begin();
+    } else {
+      iter_ = end_;
+    }
   }
   Refresh();
 }
@@ -701,7 +1215,13 @@ inline const S2ShapeIndexCell& MutableS2ShapeIndex::Iterator::cell() const {
 }
 
 inline void MutableS2ShapeIndex::Iterator::Refresh() {
-  if (iter_ == end_) {
+  if (array_ != nullptr) {
+    if (pos_ == array_->ids.size()) {
+      set_finished();
+    } else {
+      set_state(array_->ids[pos_], array_->cells[pos_]);
+    }
+  } else if (iter_ == end_) {
     set_finished();
   } else {
     set_state(iter_->first, iter_->second);
@@ -711,30 +1231,73 @@ inline void MutableS2ShapeIndex::Iterator::Refresh() {
 inline void MutableS2ShapeIndex::Iterator::Begin() {
   // Make sure that the index has not been modified since Init() was called.
   S2_DCHECK(index_->is_fresh());
-  iter_ = index_->cell_map_.begin();
+  if (array_ != nullptr) {
+    pos_ = 0;
+  } else {
+    iter_ = index_->cell_map_.begin();
+  }
   Refresh();
 }
 
 inline void MutableS2ShapeIndex::Iterator::Finish() {
-  iter_ = end_;
+  if (array_ != nullptr) {
+    pos_ = array_->ids.size();
+  } else {
+    iter_ = end_;
+  }
   Refresh();
 }
 
 inline void MutableS2ShapeIndex::Iterator::Next() {
   S2_DCHECK(!done());
-  ++iter_;
+  if (array_ != nullptr) {
+    ++pos_;
+  } else {
+    ++iter_;
+  }
   Refresh();
 }
 
 inline bool MutableS2ShapeIndex::Iterator::Prev() {
-  if (iter_ == index_->cell_map_.begin()) return false;
-  --iter_;
+  if (array_ != nullptr) {
+    if (pos_ == 0) return false;
+    --pos_;
+  } else {
+    if (iter_ == index_->cell_map_.begin()) return false;
+    --iter_;
+  }
   Refresh();
   return true;
 }
 
 inline void MutableS2ShapeIndex::Iterator::Seek(S2CellId target) {
-  iter_ = index_->cell_map_.lower_bound(target);
+  if (array_ != nullptr) {
+    // Equivalent to std::lower_bound(), but written so that the loop body
+    // compiles to a conditional move rather than an unpredictable branch.
+    // The invariant is that the result is in the range [first, first + n].
+    const S2CellId* first = array_->ids.data();
+    size_t n = array_->ids.size();
+    const std::vector<uint32>& lookup = array_->lookup;
+    if (!lookup.empty()) {
+      // Restrict the search to the cells within the lookup table entry.
+      size_t b = std::min<uint64>(target.id() >> array_->lookup_shift,
+                                  lookup.size() - 1);
+      size_t limit = (b + 1 < lookup.size()) ? lookup[b + 1] : n;
+      first += lookup[b];
+      n = limit - lookup[b];
+    }
+    if (n > 0) {
+      while (n > 1) {
+        size_t half = n / 2;
+        first += (first[half - 1] < target) ? half : 0;
+        n -= half;
+      }
+      first += (*first < target);
+    }
+    pos_ = first - array_->ids.data();
+  } else {
+    iter_ = index_->cell_map_.lower_bound(target);
+  }
   Refresh();
 }
 
@@ -758,6 +1321,11 @@ inline bool MutableS2ShapeIndex::is_shape_being_removed(int shape_id) const {
   return shape_id < pending_additions_begin_;
 }
 
+// Returns true if the given shape is owned by the base index of a clone.
+inline bool MutableS2ShapeIndex::is_base_shape(int shape_id) const {
+  return base_ != nullptr && shape_id < base_->num_shape_ids();
+}
+
 // Ensure that any pending updates have been applied.  This method must be
 // called before accessing the cell_map_ field, even if the index_status_
 // appears to be FRESH, because a memory barrier is required in order to
@@ -18,6 +18,7 @@
 #include "s2/mutable_s2shape_index.h"
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <numeric>
@@ -31,7 +32,9 @@
 #include "absl/flags/reflection.h"
 #include "absl/flags/flag.h"
 #include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
 
 #include "s2/base/commandlineflags.h"
 #include "s2/base/logging.h"
@@ -49,6 +52,7 @@
 #include "s2/s2edge_distances.h"
 #include "s2/s2edge_vector_shape.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2loop.h"
 #include "s2/s2point_vector_shape.h"
@@ -219,6 +223,19 @@ void MutableS2ShapeIndexTest::TestEncodeDecode() {
   MutableS2ShapeIndex index2;
   ASSERT_TRUE(index2.Init(&decoder, s2shapeutil::WrappedShapeFactory(&index_)));
   s2testing::ExpectEqual(index_, index2);
+
+  // The multi-threaded and streaming encodings must be identical.
+  string expected(encoder.base(), encoder.length());
+  for (int num_threads : {1, 3}) {
+    Encoder parallel;
+    index_.Encode(num_threads, &parallel);
+    EXPECT_EQ(expected, string(parallel.base(), parallel.length()));
+    string streamed;
+    index_.Encode(num_threads, [&streamed](absl::string_view data) {
+        streamed.append(data.data(), data.size());
+      });
+    EXPECT_EQ(expected, streamed);
+  }
 }
 
 /*static*/ string MutableS2ShapeIndexTest::ToString(
@@ -434,6 +451,58 @@ TEST_F(MutableS2ShapeIndexTest, SpaceUsed) {
   EXPECT_TRUE(size_after > size_before);
 }
 
+TEST_F(MutableS2ShapeIndexTest, GetStats) {
+  S2Testing::Fractal fractal;
+  fractal.SetLevelForApproxMaxEdges(1000);
+  S2Polygon polygon(fractal.MakeLoop(
+      S2Testing::GetRandomFrameAt(S2Point(1, 0, 0)), S1Angle::Degrees(10)));
+  index_.Add(make_unique<S2LaxPolygonShape>(polygon));
+  // Edges that span the diagonal of a face prevent it from being subdivided.
+  const int kNumLongEdges = 20;
+  S2Point a = S2Point(0.99, 0.99, -1).Normalize();
+  S2Point b = S2Point(-0.99, -0.99, -1).Normalize();
+  for (int i = 0; i < kNumLongEdges; ++i) {
+    index_.Add(make_unique<S2EdgeVectorShape>(a, b));
+  }
+  MutableS2ShapeIndex::Stats stats = index_.GetStats();
+  EXPECT_TRUE(index_.is_fresh());
+  EXPECT_EQ(1 + kNumLongEdges, stats.num_shapes);
+  EXPECT_EQ(polygon.num_vertices() + kNumLongEdges, stats.num_edges);
+
+  int64 num_cells = 0, num_clipped_shapes = 0, edges_in_cells = 0;
+  for (MutableS2ShapeIndex::Iterator it(&index_, S2ShapeIndex::BEGIN);
+       !it.done(); it.Next()) {
+    ++num_cells;
+    num_clipped_shapes += it.cell().num_clipped();
+  }
+  EXPECT_EQ(num_cells, stats.num_cells);
+  EXPECT_EQ(num_cells, std::accumulate(stats.cells_per_level.begin(),
+                                       stats.cells_per_level.end(), int64{0}));
+  EXPECT_EQ(num_cells, std::accumulate(stats.edges_per_cell.begin(),
+                                       stats.edges_per_cell.end(), int64{0}));
+  for (int i = 0; i < stats.edges_per_cell.size(); ++i) {
+    edges_in_cells += i * stats.edges_per_cell[i];
+  }
+  EXPECT_GE(edges_in_cells, stats.num_edges);
+  EXPECT_EQ(num_clipped_shapes, stats.num_clipped_shapes);
+  EXPECT_GT(stats.num_interior_clipped_shapes, 0);
+  EXPECT_EQ(1, stats.num_long_edge_cells);
+  EXPECT_EQ(kNumLongEdges + 1, stats.edges_per_cell.size());
+  EXPECT_EQ(1, stats.cells_per_level[0]);
+
+  EXPECT_EQ(index_.SpaceUsed(), stats.total_bytes);
+  EXPECT_GT(stats.cell_map_bytes, 0);
+  EXPECT_GT(stats.clipped_shape_bytes, 0);
+  EXPECT_LT(stats.cell_map_bytes + stats.clipped_shape_bytes,
+            stats.total_bytes);
+
+  EXPECT_GE(stats.last_build.num_batches, 1);
+  EXPECT_GE(stats.last_build.total_seconds,
+            stats.last_build.face_edges_seconds +
+            stats.last_build.cells_seconds);
+  EXPECT_NE("", stats.ToString());
+}
+
 TEST_F(MutableS2ShapeIndexTest, NoEdges) {
   MutableS2ShapeIndex::Iterator it(&index_, S2ShapeIndex::BEGIN);
   EXPECT_TRUE(it.done());
@@ -631,6 +700,485 @@ TEST_F(MutableS2ShapeIndexTest, RandomUpdates) {
   }
 }
 
+// Adds a variety of geometry spanning all six cube faces to "index".
+static void AddMultiFaceGeometry(const S2Polygon& polygon,
+                                 MutableS2ShapeIndex* index) {
+  index->Add(make_unique<S2Polyline::OwningShape>(
+      MakePolylineOrDie("0:0, 2:1, 0:2, 2:3, 0:4, 2:5, 0:6")));
+  index->Add(make_unique<S2Polyline::OwningShape>(
+      MakePolylineOrDie("-80:-170, 10:-100, 80:10, 10:100")));
+  index->Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+      S2Point(1, 0.5, 0.5).Normalize(), S1Angle::Degrees(89), 20)));
+  for (int i = 0; i < polygon.num_loops(); ++i) {
+    index->Add(make_unique<S2Loop::Shape>(polygon.loop(i)));
+  }
+  // Clockwise loops that contain most of the sphere, including entire faces.
+  index->Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+      S2Point(-1, 1, 1).Normalize(), S1Angle::Radians(M_PI - 0.001), 10)));
+  index->Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+      S2Point(0, 0, -1), S1Angle::Degrees(100), 30)));
+  index->Add(make_unique<S2Loop::OwningShape>(
+      make_unique<S2Loop>(S2Loop::kFull())));
+}
+
+TEST_F(MutableS2ShapeIndexTest, ParallelBuild) {
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, -1, -1).Normalize(), 3, 20,
+                                    &polygon);
+  MutableS2ShapeIndex expected;
+  AddMultiFaceGeometry(polygon, &expected);
+  for (int num_threads : {2, 3, 6, 8}) {
+    MutableS2ShapeIndex::Options options;
+    options.set_num_threads(num_threads);
+    index_.Init(options);
+    AddMultiFaceGeometry(polygon, &index_);
+    QuadraticValidate();
+    s2testing::ExpectEqual(expected, index_);
+    index_.Clear();
+  }
+}
+
+TEST_F(MutableS2ShapeIndexTest, ParallelBuildWithExecutor) {
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, -1, -1).Normalize(), 3, 20,
+                                    &polygon);
+  MutableS2ShapeIndex expected;
+  AddMultiFaceGeometry(polygon, &expected);
+  S2ThreadPool pool(4);
+  MutableS2ShapeIndex::Options options;
+  options.set_executor(&pool);  // Overrides num_threads().
+  index_.Init(options);
+  AddMultiFaceGeometry(polygon, &index_);
+  QuadraticValidate();
+  s2testing::ExpectEqual(expected, index_);
+}
+
+TEST_F(MutableS2ShapeIndexTest, ParallelBuildWithPartialShapes) {
+  // Split the concentric loops polygon across several batches.  Only the
+  // first batch can be built in parallel, since subsequent batches need to
+  // be merged with the existing index cells.
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_s2shape_index_tmp_memory_budget, 10000);
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, -1, -1).Normalize(), 5, 20,
+                                    &polygon);
+  MutableS2ShapeIndex expected;
+  AddMultiFaceGeometry(polygon, &expected);
+  MutableS2ShapeIndex::Options options;
+  options.set_num_threads(4);
+  index_.Init(options);
+  AddMultiFaceGeometry(polygon, &index_);
+  QuadraticValidate();
+  s2testing::ExpectEqual(expected, index_);
+
+  // Incremental updates are applied using a single thread.
+  index_.Release(0);
+  index_.Add(make_unique<S2Polyline::OwningShape>(
+      MakePolylineOrDie("1:0, 3:1, 1:2, 3:3, 1:4, 3:5, 1:6")));
+  QuadraticValidate();
+}
+
+TEST_F(MutableS2ShapeIndexTest, ParallelEncode) {
+  // Enough cells so that the encoding is split into several groups.
+  vector<S2Point> points;
+  for (int i = 0; i < 50000; ++i) points.push_back(S2Testing::RandomPoint());
+  index_.Add(make_unique<S2PointVectorShape>(std::move(points)));
+  index_.ForceBuild();
+  EXPECT_GT(index_.GetStats().num_cells, 2048);
+  TestEncodeDecode();
+}
+
+TEST_F(MutableS2ShapeIndexTest, EncodeByFace) {
+  // Split the polygon into several batches so that partial shapes are tested.
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_s2shape_index_tmp_memory_budget, 10000);
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, -1, -1).Normalize(), 3, 20,
+                                    &polygon);
+  MutableS2ShapeIndex expected;
+  AddMultiFaceGeometry(polygon, &expected);
+  Encoder expected_encoder;
+  expected.Encode(&expected_encoder);
+
+  AddMultiFaceGeometry(polygon, &index_);
+  index_.ForceBuild();
+  string encoded;
+  index_.EncodeByFace([&encoded](absl::string_view data) {
+    encoded.append(data.data(), data.size());
+  });
+  EXPECT_EQ(string(expected_encoder.base(), expected_encoder.length()),
+            encoded);
+  EXPECT_FALSE(index_.is_fresh());  // The cells have been discarded.
+  Decoder decoder(encoded.data(), encoded.size());
+  MutableS2ShapeIndex decoded;
+  ASSERT_TRUE(decoded.Init(&decoder,
+                           s2shapeutil::WrappedShapeFactory(&index_)));
+  s2testing::ExpectEqual(expected, decoded);
+}
+
+TEST_F(MutableS2ShapeIndexTest, BulkLoad) {
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, -1, -1).Normalize(), 3, 20,
+                                    &polygon);
+  MutableS2ShapeIndex expected;
+  AddMultiFaceGeometry(polygon, &expected);
+  for (int num_threads : {1, 4}) {
+    MutableS2ShapeIndex::Options options;
+    options.set_bulk_load(true);
+    options.set_num_threads(num_threads);
+    index_.Init(options);
+    AddMultiFaceGeometry(polygon, &index_);
+    QuadraticValidate();
+    TestIteratorMethods(index_);
+    TestEncodeDecode();
+    s2testing::ExpectEqual(expected, index_);
+    EXPECT_GT(index_.SpaceUsed(), sizeof(index_));
+
+    // The cell array is converted to a btree on the first incremental update.
+    auto released = index_.Release(1);
+    expected.Release(1);
+    QuadraticValidate();
+    index_.Add(std::move(released));
+    expected.Add(make_unique<S2Polyline::OwningShape>(
+        MakePolylineOrDie("-80:-170, 10:-100, 80:10, 10:100")));
+    QuadraticValidate();
+    TestIteratorMethods(index_);
+    s2testing::ExpectEqual(expected, index_);
+    index_.Clear();
+    expected.Clear();
+    AddMultiFaceGeometry(polygon, &expected);
+  }
+}
+
+TEST_F(MutableS2ShapeIndexTest, BulkLoadDecode) {
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, 0, 0), 3, 20, &polygon);
+  AddMultiFaceGeometry(polygon, &index_);
+  Encoder encoder;
+  index_.Encode(&encoder);
+  Decoder decoder(encoder.base(), encoder.length());
+  MutableS2ShapeIndex::Options options;
+  options.set_bulk_load(true);
+  MutableS2ShapeIndex index2(options);
+  ASSERT_TRUE(index2.Init(&decoder, s2shapeutil::WrappedShapeFactory(&index_)));
+  EXPECT_TRUE(index2.options().bulk_load());
+  s2testing::ExpectEqual(index_, index2);
+  TestIteratorMethods(index2);
+}
+
+TEST_F(MutableS2ShapeIndexTest, Freeze) {
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(0, 1, 0), 3, 20, &polygon);
+  MutableS2ShapeIndex expected;
+  AddMultiFaceGeometry(polygon, &expected);
+  AddMultiFaceGeometry(polygon, &index_);
+  index_.ForceBuild();
+  size_t space_before = index_.SpaceUsed();
+  index_.Freeze();
+  EXPECT_TRUE(index_.is_fresh());
+  EXPECT_LT(index_.SpaceUsed(), space_before);
+  QuadraticValidate();
+  TestIteratorMethods(index_);
+  TestEncodeDecode();
+  s2testing::ExpectEqual(expected, index_);
+
+  // Check Seek() against every cell boundary of the frozen index.
+  MutableS2ShapeIndex::Iterator it(&index_), expected_it(&expected);
+  for (MutableS2ShapeIndex::Iterator cell_it(&index_, S2ShapeIndex::BEGIN);
+       !cell_it.done(); cell_it.Next()) {
+    for (S2CellId target : {cell_it.id().range_min().prev(),
+                            cell_it.id(), cell_it.id().range_max().next()}) {
+      it.Seek(target);
+      expected_it.Seek(target);
+      ASSERT_EQ(expected_it.done(), it.done());
+      if (!it.done()) {
+        EXPECT_EQ(expected_it.id(), it.id());
+      }
+    }
+  }
+
+  // Frozen indexes can still be updated.
+  index_.Release(0);
+  QuadraticValidate();
+  index_.Freeze();
+  index_.Freeze();  // Freezing twice has no effect.
+  QuadraticValidate();
+}
+
+TEST_F(MutableS2ShapeIndexTest, FrozenLocate) {
+  // Build an index with enough cells that Freeze() creates a lookup table
+  // above level 0, and check Locate() and Seek() against the btree.
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, 0, 0), 10, 1000, &polygon);
+  MutableS2ShapeIndex expected;
+  expected.Add(absl::make_unique<S2Polygon::Shape>(&polygon));
+  index_.Add(absl::make_unique<S2Polygon::Shape>(&polygon));
+  index_.Freeze();
+  MutableS2ShapeIndex::Iterator it(&index_), expected_it(&expected);
+  // Only the frozen index has a lookup table to prefetch from.
+  EXPECT_TRUE(it.can_prefetch());
+  EXPECT_FALSE(expected_it.can_prefetch());
+  for (int i = 0; i < 1000; ++i) {
+    S2Point p = (i % 2) ? S2Testing::RandomPoint()
+                        : S2Testing::SamplePoint(S2Cap(S2Point(1, 0, 0),
+                                                       S1Angle::Degrees(1)));
+    ASSERT_EQ(expected_it.Locate(p), it.Locate(p));
+    if (!it.done()) {
+      EXPECT_EQ(expected_it.id(), it.id());
+    }
+    S2CellId id(p);
+    S2CellId target = id.parent(S2Testing::rnd.Uniform(31));
+    // Prefetch() is only a hint and does not move the iterator.
+    S2CellId old_id = it.id();
+    it.Prefetch(target);
+    EXPECT_EQ(old_id, it.id());
+    EXPECT_EQ(expected_it.Locate(target), it.Locate(target));
+  }
+  for (S2CellId target : {S2CellId::Begin(0), S2CellId::End(0),
+                          S2CellId::Sentinel(), S2CellId::None()}) {
+    it.Seek(target);
+    expected_it.Seek(target);
+    ASSERT_EQ(expected_it.done(), it.done());
+    if (!it.done()) {
+      EXPECT_EQ(expected_it.id(), it.id());
+    }
+  }
+}
+
+// Verifies that the index keeps a copy of the edges of every cell iff it
+// was built with cache_edges() == true, and similarly for
+// cache_float_edges().
+static void ValidateCachedEdges(const MutableS2ShapeIndex& index) {
+  for (MutableS2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN);
+       !it.done(); it.Next()) {
+    const S2ShapeIndexCell& cell = it.cell();
+    const S2Shape::Edge* cached_edges = index.cached_edges(cell);
+    const float* float_edges = index.cached_float_edges(cell);
+    const int n = cell.num_edges();
+    if (!index.options().cache_edges() || n == 0) {
+      EXPECT_EQ(cached_edges, nullptr);
+    } else {
+      ASSERT_NE(cached_edges, nullptr);
+    }
+    if (!index.options().cache_float_edges() || n == 0) {
+      EXPECT_EQ(float_edges, nullptr);
+    } else {
+      ASSERT_NE(float_edges, nullptr);
+    }
+    for (int s = 0, i = 0; s < cell.num_clipped(); ++s) {
+      const S2ClippedShape& clipped = cell.clipped(s);
+      const S2Shape* shape = index.shape(clipped.shape_id());
+      for (int j = 0; j < clipped.num_edges(); ++j, ++i) {
+        S2Shape::Edge edge = shape->edge(clipped.edge(j));
+        if (cached_edges != nullptr) {
+          EXPECT_EQ(cached_edges[i], edge);
+        }
+        if (float_edges == nullptr) continue;
+        for (int c = 0; c < 3; ++c) {
+          EXPECT_EQ(float_edges[c * n + i], static_cast<float>(edge.v0[c]));
+          EXPECT_EQ(float_edges[(c + 3) * n + i],
+                    static_cast<float>(edge.v1[c]));
+        }
+      }
+    }
+  }
+}
+
+// Adds a copy of each given loop to "index" as an S2LaxPolygonShape.
+void AddLaxLoops(const vector<unique_ptr<S2Loop>>& loops, int begin, int end,
+                 MutableS2ShapeIndex* index) {
+  for (int i = begin; i < end; ++i) {
+    vector<S2Point> vertices(loops[i]->vertices_span().begin(),
+                             loops[i]->vertices_span().end());
+    index->Add(make_unique<S2LaxPolygonShape>(
+        vector<vector<S2Point>>{std::move(vertices)}));
+  }
+}
+
+TEST(MutableS2ShapeIndex, Clone) {
+  vector<unique_ptr<S2Loop>> loops;
+  for (int i = 0; i < 40; ++i) {
+    loops.push_back(S2Loop::MakeRegularLoop(
+        S2Testing::RandomPoint(), S1Angle::Degrees(10), 8));
+  }
+  // Check both representations of the base index cells.
+  for (bool freeze : {false, true}) {
+    auto base = std::make_shared<MutableS2ShapeIndex>();
+    MutableS2ShapeIndex expected_base;
+    AddLaxLoops(loops, 0, 20, base.get());
+    AddLaxLoops(loops, 0, 20, &expected_base);
+    base->ForceBuild();
+    expected_base.ForceBuild();
+    if (freeze) base->Freeze();
+
+    // The expected indexes are updated in the same order as the clones, since
+    // the index cells depend on the order in which shapes were added.
+    auto clone = std::make_shared<MutableS2ShapeIndex>(base);
+    MutableS2ShapeIndex expected;
+    AddLaxLoops(loops, 0, 20, &expected);
+    expected.ForceBuild();
+    s2testing::ExpectEqual(expected, *clone);
+    AddLaxLoops(loops, 20, 30, clone.get());
+    AddLaxLoops(loops, 20, 30, &expected);
+    EXPECT_EQ(nullptr, clone->Release(3));  // Owned by "base".
+    EXPECT_NE(nullptr, clone->Release(25));
+    expected.Release(3);
+    expected.Release(25);
+    s2testing::ExpectEqual(expected, *clone);
+
+    // Clones of clones share the cells of both indexes.
+    MutableS2ShapeIndex clone2(clone);
+    AddLaxLoops(loops, 30, 40, &clone2);
+    clone2.Release(5);
+    clone2.Release(22);
+    MutableS2ShapeIndex expected2;
+    AddLaxLoops(loops, 0, 20, &expected2);
+    expected2.ForceBuild();
+    AddLaxLoops(loops, 20, 30, &expected2);
+    expected2.Release(3);
+    expected2.Release(25);
+    expected2.ForceBuild();
+    AddLaxLoops(loops, 30, 40, &expected2);
+    expected2.Release(5);
+    expected2.Release(22);
+    s2testing::ExpectEqual(expected2, clone2);
+
+    // ReleaseAll() returns only the shapes owned by the clone itself.
+    vector<unique_ptr<S2Shape>> released = clone2.ReleaseAll();
+    ASSERT_EQ(40, released.size());
+    for (int id = 0; id < 40; ++id) {
+      EXPECT_EQ(id >= 30, released[id] != nullptr) << id;
+    }
+
+    // Updating the clones did not change the indexes they were cloned from.
+    s2testing::ExpectEqual(expected, *clone);
+    clone.reset();
+    s2testing::ExpectEqual(expected_base, *base);
+  }
+}
+
+TEST_F(MutableS2ShapeIndexTest, CacheEdges) {
+  // Split the polygon into several batches so that partial shapes are tested.
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_s2shape_index_tmp_memory_budget, 10000);
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, -1, -1).Normalize(), 3, 20,
+                                    &polygon);
+  MutableS2ShapeIndex expected;
+  AddMultiFaceGeometry(polygon, &expected);
+  expected.ForceBuild();
+  for (int num_threads : {1, 4}) {
+    MutableS2ShapeIndex::Options options;
+    options.set_cache_edges(true);
+    options.set_cache_float_edges(num_threads > 1);
+    options.set_num_threads(num_threads);
+    index_.Init(options);
+    AddMultiFaceGeometry(polygon, &index_);
+    QuadraticValidate();
+    ValidateCachedEdges(index_);
+    s2testing::ExpectEqual(expected, index_);
+    EXPECT_GT(index_.SpaceUsed(), expected.SpaceUsed());
+
+    // Cells rebuilt by incremental updates also cache their edges.
+    auto released = index_.Release(1);
+    ValidateCachedEdges(index_);
+    index_.Add(std::move(released));
+    QuadraticValidate();
+    ValidateCachedEdges(index_);
+
+    // So do decoded indexes.
+    Encoder encoder;
+    index_.Encode(&encoder);
+    Decoder decoder(encoder.base(), encoder.length());
+    MutableS2ShapeIndex decoded(options);
+    ASSERT_TRUE(decoded.Init(&decoder,
+                             s2shapeutil::WrappedShapeFactory(&index_)));
+    s2testing::ExpectEqual(index_, decoded);
+    ValidateCachedEdges(decoded);
+
+    // Clones use the copies made by their base index for shared cells.
+    auto base = std::make_shared<MutableS2ShapeIndex>(std::move(decoded));
+    MutableS2ShapeIndex clone(base);
+    ValidateCachedEdges(clone);
+    clone.Add(make_unique<S2Polyline::OwningShape>(
+        MakePolylineOrDie("-10:-10, 10:10")));
+    clone.ForceBuild();
+    ValidateCachedEdges(clone);
+    index_.Clear();
+  }
+  ValidateCachedEdges(expected);
+}
+
+TEST_F(MutableS2ShapeIndexTest, LazyRemoval) {
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, -1, -1).Normalize(), 3, 20,
+                                    &polygon);
+  for (bool cache_edges : {false, true}) {
+    MutableS2ShapeIndex::Options options;
+    options.set_lazy_removal(true);
+    options.set_cache_edges(cache_edges);
+    index_.Init(options);
+    AddMultiFaceGeometry(polygon, &index_);
+    QuadraticValidate();
+
+    // Remove a polyline, a loop, and the full loop (which has no edges).
+    vector<unique_ptr<S2Shape>> released;
+    for (int id : {0, 4, 8}) released.push_back(index_.Release(id));
+    QuadraticValidate();
+    ValidateCachedEdges(index_);
+    for (auto& shape : released) index_.Add(std::move(shape));
+    QuadraticValidate();
+    ValidateCachedEdges(index_);
+
+    // Shapes may be removed and added in the same update.
+    released.clear();
+    released.push_back(index_.Release(1));
+    index_.Add(make_unique<S2Polyline::OwningShape>(
+        MakePolylineOrDie("-10:-10, 10:10")));
+    QuadraticValidate();
+
+    // Once every shape is removed, no cells remain.
+    for (int id = 0; id < index_.num_shape_ids(); ++id) {
+      if (index_.shape(id) != nullptr) released.push_back(index_.Release(id));
+    }
+    EXPECT_TRUE(
+        MutableS2ShapeIndex::Iterator(&index_, S2ShapeIndex::BEGIN).done());
+    index_.Clear();
+  }
+}
+
+TEST_F(MutableS2ShapeIndexTest, CompactCells) {
+  // Use a large max_edges_per_cell() so that many cells contain more than one
+  // shape with more than two edges.
+  S2Polygon polygon;
+  S2Testing::ConcentricLoopsPolygon(S2Point(1, -1, -1).Normalize(), 5, 20,
+                                    &polygon);
+  MutableS2ShapeIndex::Options options;
+  options.set_max_edges_per_cell(30);
+  MutableS2ShapeIndex expected(options);
+  AddMultiFaceGeometry(polygon, &expected);
+  options.set_compact_cells(true);
+  index_.Init(options);
+  AddMultiFaceGeometry(polygon, &index_);
+  QuadraticValidate();
+  s2testing::ExpectEqual(expected, index_);
+
+  // Cells rebuilt by incremental updates and decoded cells are also compact.
+  for (auto* index : {&expected, &index_}) {
+    auto released = index->Release(3);
+    index->Add(std::move(released));
+  }
+  QuadraticValidate();
+  s2testing::ExpectEqual(expected, index_);
+  Encoder encoder;
+  index_.Encode(&encoder);
+  Decoder decoder(encoder.base(), encoder.length());
+  MutableS2ShapeIndex decoded(options);
+  ASSERT_TRUE(
+      decoded.Init(&decoder, s2shapeutil::WrappedShapeFactory(&index_)));
+  s2testing::ExpectEqual(index_, decoded);
+}
+
 // A test that repeatedly updates "index_" in one thread and attempts to
 // concurrently read the index_ from several other threads.  When all threads
 // have finished reading, the first thread makes another update.
@@ -674,6 +1222,109 @@ TEST(MutableS2ShapeIndex, ConstMethodsThreadSafe) {
   test.Run(kNumReaders, kIters);
 }
 
+TEST(MutableS2ShapeIndex, ForceBuildInBackground) {
+  // Check that each "done" callback sees a fresh index, and that modifying or
+  // destroying the index waits for any background updates.
+  S2ThreadPool pool(2);
+  for (S2Executor* executor : {static_cast<S2Executor*>(nullptr),
+                               static_cast<S2Executor*>(&pool)}) {
+    std::atomic<int> num_done(0);
+    {
+      MutableS2ShapeIndex::Options options;
+      options.set_executor(executor);
+      MutableS2ShapeIndex index(options), expected;
+      for (int i = 0; i < 10; ++i) {
+        auto loop = S2Loop::MakeRegularLoop(S2Testing::RandomPoint(),
+                                            S1Angle::Degrees(5), 100);
+        expected.Add(make_unique<S2Loop::Shape>(loop.get()));
+        index.Add(make_unique<S2Loop::OwningShape>(std::move(loop)));
+        if (i % 3 == 2) {
+          expected.Release(i - 1);  // Before the loop is deleted.
+          index.Release(i - 1);
+        }
+        expected.ForceBuild();
+        index.ForceBuildInBackground([&index, &num_done]() {
+          EXPECT_TRUE(index.is_fresh());
+          ++num_done;
+        });
+        if (executor == nullptr) {
+          // Without an executor the updates are applied immediately.
+          EXPECT_TRUE(index.is_fresh());
+          EXPECT_EQ(i + 1, num_done);
+        }
+      }
+      index.WaitForBackgroundBuild();
+      EXPECT_EQ(10, num_done);
+      s2testing::ExpectEqual(expected, index);
+
+      index.Add(make_unique<S2PointVectorShape>(
+          vector<S2Point>{S2Testing::RandomPoint()}));
+      index.ForceBuildInBackground([&num_done]() { ++num_done; });
+    }
+    EXPECT_EQ(11, num_done);
+  }
+}
+
+TEST(MutableS2ShapeIndex, UpdateStats) {
+  MutableS2ShapeIndex::Options options;
+  options.set_collect_update_stats(true);
+  MutableS2ShapeIndex index(options);
+  for (int i = 0; i < 3; ++i) {
+    index.Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+        S2Testing::RandomPoint(), S1Angle::Degrees(1), 10)));
+  }
+  index.ForceBuild();
+  index.ForceBuild();  // Already fresh.
+  index.Release(0);
+  index.ForceBuild();
+  MutableS2ShapeIndex::UpdateStats stats = index.GetUpdateStats();
+  EXPECT_EQ(2, stats.num_updates);
+  EXPECT_EQ(4, stats.num_pending_shapes);
+  EXPECT_EQ(3, stats.max_pending_shapes);
+  EXPECT_GE(stats.total_update_seconds, stats.max_update_seconds);
+  int64 num_recorded = 0;
+  for (int64 count : stats.update_micros) num_recorded += count;
+  EXPECT_EQ(2, num_recorded);
+  EXPECT_EQ(0, stats.num_waits);
+  EXPECT_FALSE(stats.ToString().empty());
+
+  index.ResetUpdateStats();
+  EXPECT_EQ(0, index.GetUpdateStats().num_updates);
+
+  // Nothing is recorded unless the option is set.
+  MutableS2ShapeIndex index2;
+  index2.Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+      S2Testing::RandomPoint(), S1Angle::Degrees(1), 10)));
+  index2.ForceBuild();
+  EXPECT_EQ(0, index2.GetUpdateStats().num_updates);
+}
+
+TEST(MutableS2ShapeIndex, UpdateStatsWithConcurrentQueries) {
+  // Each query that finds the index being updated by another thread waits
+  // for it, so the update is applied exactly once.
+  MutableS2ShapeIndex::Options options;
+  options.set_collect_update_stats(true);
+  MutableS2ShapeIndex index(options);
+  for (int i = 0; i < 20; ++i) {
+    index.Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+        S2Testing::RandomPoint(), S1Angle::Degrees(5), 1000)));
+  }
+  const int kNumThreads = 8;
+  vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&index]() { index.ForceBuild(); });
+  }
+  for (auto& thread : threads) thread.join();
+  MutableS2ShapeIndex::UpdateStats stats = index.GetUpdateStats();
+  EXPECT_EQ(1, stats.num_updates);
+  EXPECT_EQ(20, stats.num_pending_shapes);
+  EXPECT_LE(stats.num_waits, kNumThreads - 1);
+  EXPECT_LE(stats.max_waiting, stats.num_waits);
+  int64 num_recorded = 0;
+  for (int64 count : stats.wait_micros) num_recorded += count;
+  EXPECT_EQ(stats.num_waits, num_recorded);
+}
+
 TEST(MutableS2ShapeIndex, MixedGeometry) {
   // This test used to trigger a bug where the presence of a shape with an
   // interior could cause shapes that don't have an interior to suddenly
@@ -772,6 +1423,23 @@ TEST_F(MutableS2ShapeIndexTest, LongIndexEntriesBound) {
   EXPECT_EQ(sum, 366);
 }
 
+TEST(MutableS2ShapeIndex, AddAll) {
+  MutableS2ShapeIndex index, expected;
+  index.Add(s2textformat::MakeLaxPolylineOrDie("0:0, 0:1"));
+  expected.Add(s2textformat::MakeLaxPolylineOrDie("0:0, 0:1"));
+  vector<unique_ptr<S2Shape>> shapes;
+  for (int i = 1; i <= 3; ++i) {
+    string str = absl::StrCat(i, ":0, ", i, ":1");
+    shapes.push_back(s2textformat::MakeLaxPolylineOrDie(str));
+    expected.Add(s2textformat::MakeLaxPolylineOrDie(str));
+  }
+  EXPECT_EQ(1, index.AddAll(std::move(shapes)));
+  ASSERT_EQ(4, index.num_shape_ids());
+  for (int id = 0; id < 4; ++id) EXPECT_EQ(id, index.shape(id)->id());
+  s2testing::ExpectEqual(expected, index);
+  EXPECT_EQ(4, index.AddAll({}));
+}
+
 // Test move-construct and move-assign functionality of `S2Shape`.  It has an id
 // value which is set when it's added to an index.  So we can create two
 // `S2LaxPolygonShape`s, add them to an index, then
@@ -0,0 +1,367 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/overlay_s2shape_index.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "s2/base/casts.h"
+#include "s2/util/coding/varint.h"
+#include "s2/encoded_string_vector.h"
+#include "s2/mutable_s2shape_index.h"
+
+using absl::make_unique;
+using std::pair;
+using std::unique_ptr;
+using std::vector;
+
+class OverlayS2ShapeIndex::NullShapeFactory : public ShapeFactory {
+ public:
+  explicit NullShapeFactory(int size) : size_(size) {}
+  int size() const override { return size_; }
+  unique_ptr<S2Shape> operator[](int shape_id) const override {
+    return nullptr;
+  }
+  unique_ptr<ShapeFactory> Clone() const override {
+    return make_unique<NullShapeFactory>(*this);
+  }
+
+ private:
+  int size_;
+};
+
+void OverlayS2ShapeIndex::Iterator::Init(const OverlayS2ShapeIndex* index,
+                                         InitialPosition pos) {
+  index_ = index;
+  base_.Init(index->base_, pos);
+  delta_.Init(&index->delta_, pos);
+  if (pos == BEGIN) SkipReplacedBaseCells();
+  Refresh();
+}
+
+inline void OverlayS2ShapeIndex::Iterator::SkipReplacedBaseCells() {
+  // Replaced base cells are always entirely contained by a replaced range, so
+  // we can skip over each range with a single seek.
+  while (!base_.done()) {
+    int range = index_->FindReplacedRange(base_.id().range_min());
+    if (range < 0) return;
+    base_.Seek(index_->replaced_ranges_[2 * range + 1].next());
+  }
+}
+
+bool OverlayS2ShapeIndex::Iterator::PrevBaseCell() {
+  while (base_.Prev()) {
+    int range = index_->FindReplacedRange(base_.id().range_min());
+    if (range < 0) return true;
+    base_.Seek(index_->replaced_ranges_[2 * range]);
+  }
+  return false;
+}
+
+inline void OverlayS2ShapeIndex::Iterator::Refresh() {
+  // Base cells and delta cells never overlap, so the two ids are equal only
+  // when both iterators are done.
+  S2CellId base_id = base_.id(), delta_id = delta_.id();
+  in_delta_ = delta_id < base_id;
+  if (in_delta_) {
+    set_state(delta_id, nullptr);
+  } else if (base_.done()) {
+    set_finished();
+  } else {
+    set_state(base_id, nullptr);
+  }
+}
+
+void OverlayS2ShapeIndex::Iterator::Begin() {
+  base_.Begin();
+  SkipReplacedBaseCells();
+  delta_.Begin();
+  Refresh();
+}
+
+void OverlayS2ShapeIndex::Iterator::Finish() {
+  base_.Finish();
+  delta_.Finish();
+  Refresh();
+}
+
+void OverlayS2ShapeIndex::Iterator::Next() {
+  S2_DCHECK(!done());
+  if (in_delta_) {
+    delta_.Next();
+  } else {
+    base_.Next();
+    SkipReplacedBaseCells();
+  }
+  Refresh();
+}
+
+bool OverlayS2ShapeIndex::Iterator::Prev() {
+  // The previous cell is the larger of the previous base cell and the
+  // previous delta cell.  Whichever iterator does not supply it is restored
+  // to its original position.
+  S2CellId base_id = base_.id();
+  bool has_base = PrevBaseCell();
+  bool has_delta = delta_.Prev();
+  if (!has_base && !has_delta) {
+    base_.Seek(base_id);
+    return false;
+  }
+  if (has_base && (!has_delta || base_.id() > delta_.id())) {
+    if (has_delta) delta_.Next();
+  } else {
+    base_.Seek(base_id);
+  }
+  Refresh();
+  return true;
+}
+
+void OverlayS2ShapeIndex::Iterator::Seek(S2CellId target) {
+  base_.Seek(target);
+  SkipReplacedBaseCells();
+  delta_.Seek(target);
+  Refresh();
+}
+
+bool OverlayS2ShapeIndex::Iterator::can_prefetch() const {
+  return base_.can_prefetch();
+}
+
+void OverlayS2ShapeIndex::Iterator::Prefetch(S2CellId target) const {
+  // The delta is typically small, so only the base index is prefetched.
+  base_.Prefetch(target);
+}
+
+bool OverlayS2ShapeIndex::Iterator::Locate(const S2Point& target) {
+  return LocateImpl(target, this);
+}
+
+OverlayS2ShapeIndex::CellRelation OverlayS2ShapeIndex::Iterator::Locate(
+    S2CellId target) {
+  return LocateImpl(target, this);
+}
+
+const S2ShapeIndexCell* OverlayS2ShapeIndex::Iterator::GetCell() const {
+  return in_delta_ ? &delta_.cell() : &base_.cell();
+}
+
+unique_ptr<OverlayS2ShapeIndex::IteratorBase>
+OverlayS2ShapeIndex::Iterator::Clone() const {
+  return make_unique<Iterator>(*this);
+}
+
+void OverlayS2ShapeIndex::Iterator::Copy(const IteratorBase& other) {
+  // S2ShapeIndex::Iterator assignment requires an initialized target, so
+  // base_ is replaced by a copy rather than assigned to.
+  const Iterator& it = *down_cast<const Iterator*>(&other);
+  IteratorBase::operator=(it);
+  index_ = it.index_;
+  base_ = S2ShapeIndex::Iterator(it.base_);
+  delta_ = it.delta_;
+  in_delta_ = it.in_delta_;
+}
+
+OverlayS2ShapeIndex::OverlayS2ShapeIndex()
+    : base_(nullptr), num_shape_ids_(0) {
+}
+
+OverlayS2ShapeIndex::~OverlayS2ShapeIndex() {
+}
+
+// Returns true if "a" and "b" have the same contents.
+static bool CellsEqual(const S2ShapeIndexCell& a, const S2ShapeIndexCell& b) {
+  if (a.num_clipped() != b.num_clipped()) return false;
+  for (int i = 0; i < a.num_clipped(); ++i) {
+    const S2ClippedShape& x = a.clipped(i);
+    const S2ClippedShape& y = b.clipped(i);
+    if (x.shape_id() != y.shape_id() ||
+        x.contains_center() != y.contains_center() ||
+        x.num_edges() != y.num_edges()) {
+      return false;
+    }
+    for (int j = 0; j < x.num_edges(); ++j) {
+      if (x.edge(j) != y.edge(j)) return false;
+    }
+  }
+  return true;
+}
+
+void OverlayS2ShapeIndex::EncodeDelta(const S2ShapeIndex& base,
+                                      const S2ShapeIndex& updated,
+                                      Encoder* encoder) {
+  S2_DCHECK_GE(updated.num_shape_ids(), base.num_shape_ids());
+  encoder->Ensure(1 + 2 * Varint::kMax32);
+  encoder->put8(kCurrentEncodingVersionNumber);
+  encoder->put_varint32(base.num_shape_ids());
+  encoder->put_varint32(updated.num_shape_ids());
+
+  vector<uint32> removed_shape_ids;
+  for (int id = 0; id < base.num_shape_ids(); ++id) {
+    if (base.shape(id) != nullptr && updated.shape(id) == nullptr) {
+      removed_shape_ids.push_back(id);
+    }
+  }
+  s2coding::EncodeUintVector<uint32>(removed_shape_ids, encoder);
+
+  // Walk both indexes in S2CellId order.  Every cell that is not present with
+  // identical contents in the other index contributes its range of leaf cells
+  // to the replaced ranges, and every such cell of "updated" is stored in the
+  // delta.  Since the cells of each index are disjoint, the cells that match
+  // exactly never intersect a replaced range.
+  vector<pair<S2CellId, S2CellId>> ranges;
+  vector<S2CellId> cell_ids;
+  s2coding::StringVectorEncoder encoded_cells;
+  auto add_range = [&ranges](S2CellId id) {
+    ranges.emplace_back(id.range_min(), id.range_max());
+  };
+  auto add_cell = [&](const S2ShapeIndex::Iterator& it) {
+    cell_ids.push_back(it.id());
+    it.cell().Encode(updated.num_shape_ids(), encoded_cells.AddViaEncoder());
+  };
+  S2ShapeIndex::Iterator a(&base, S2ShapeIndex::BEGIN);
+  S2ShapeIndex::Iterator b(&updated, S2ShapeIndex::BEGIN);
+  while (!a.done() || !b.done()) {
+    if (a.id() == b.id()) {
+      if (!CellsEqual(a.cell(), b.cell())) {
+        add_range(b.id());
+        add_cell(b);
+      }
+      a.Next();
+      b.Next();
+    } else if (a.id() < b.id()) {
+      add_range(a.id());
+      a.Next();
+    } else {
+      add_range(b.id());
+      add_cell(b);
+      b.Next();
+    }
+  }
+
+  // Sort the ranges and merge any that overlap or are adjacent.
+  std::sort(ranges.begin(), ranges.end());
+  vector<S2CellId> replaced_ranges;
+  for (const auto& range : ranges) {
+    if (!replaced_ranges.empty() &&
+        range.first <= replaced_ranges.back().next()) {
+      replaced_ranges.back() = std::max(replaced_ranges.back(), range.second);
+    } else {
+      replaced_ranges.push_back(range.first);
+      replaced_ranges.push_back(range.second);
+    }
+  }
+  s2coding::EncodeS2CellIdVector(replaced_ranges, encoder);
+
+  // The replacement cells use the MutableS2ShapeIndex encoding so that they
+  // can be decoded lazily by an EncodedS2ShapeIndex.
+  encoder->Ensure(Varint::kMax64);
+  uint64 max_edges = MutableS2ShapeIndex::Options().max_edges_per_cell();
+  encoder->put_varint64(max_edges << 2 |
+                        MutableS2ShapeIndex::kCurrentEncodingVersionNumber);
+  s2coding::EncodeS2CellIdVector(cell_ids, encoder);
+  encoded_cells.Encode(encoder);
+}
+
+bool OverlayS2ShapeIndex::Init(const S2ShapeIndex* base, Decoder* decoder,
+                               const ShapeFactory& shape_factory) {
+  Minimize();
+  base_ = base;
+  removed_shape_ids_.clear();
+  added_shapes_.clear();
+
+  if (decoder->avail() < 1) return false;
+  if (decoder->get8() != kCurrentEncodingVersionNumber) return false;
+  uint32 base_num_shape_ids, num_shape_ids;
+  if (!decoder->get_varint32(&base_num_shape_ids)) return false;
+  if (!decoder->get_varint32(&num_shape_ids)) return false;
+  if (base_num_shape_ids != base->num_shape_ids() ||
+      num_shape_ids < base_num_shape_ids ||
+      shape_factory.size() != num_shape_ids - base_num_shape_ids) {
+    return false;
+  }
+  s2coding::EncodedUintVector<uint32> removed_shape_ids;
+  if (!removed_shape_ids.Init(decoder)) return false;
+  if (!replaced_ranges_.Init(decoder)) return false;
+  if (replaced_ranges_.size() % 2 != 0) return false;
+  if (!delta_.Init(decoder, NullShapeFactory(num_shape_ids))) return false;
+
+  // shape() looks up removed shapes by binary search, so the ids must be
+  // sorted and unique, and only base shapes can be removed.
+  removed_shape_ids_.reserve(removed_shape_ids.size());
+  for (uint32 id : removed_shape_ids.Decode()) {
+    if (id >= base_num_shape_ids ||
+        (!removed_shape_ids_.empty() &&
+         static_cast<int>(id) <= removed_shape_ids_.back())) {
+      removed_shape_ids_.clear();
+      return false;
+    }
+    removed_shape_ids_.push_back(id);
+  }
+  num_shape_ids_ = num_shape_ids;
+  added_shapes_.reserve(shape_factory.size());
+  for (int i = 0; i < shape_factory.size(); ++i) {
+    auto shape = shape_factory[i];
+    if (shape) shape->id_ = base_num_shape_ids + i;
+    added_shapes_.push_back(std::move(shape));
+  }
+  return true;
+}
+
+S2Shape* OverlayS2ShapeIndex::shape(int id) const {
+  int base_num_shape_ids = base_->num_shape_ids();
+  if (id >= base_num_shape_ids) {
+    return added_shapes_[id - base_num_shape_ids].get();
+  }
+  if (std::binary_search(removed_shape_ids_.begin(), removed_shape_ids_.end(),
+                         id)) {
+    return nullptr;
+  }
+  return base_->shape(id);
+}
+
+int OverlayS2ShapeIndex::FindReplacedRange(S2CellId id) const {
+  // replaced_ranges_ alternates between range_min and range_max values, so
+  // "id" is inside a range exactly when its lower bound is a range_max, or is
+  // a range_min equal to "id".
+  size_t i = replaced_ranges_.lower_bound(id);
+  if (i == replaced_ranges_.size()) return -1;
+  if ((i & 1) == 0 && replaced_ranges_[i] != id) return -1;
+  return i >> 1;
+}
+
+size_t OverlayS2ShapeIndex::SpaceUsed() const {
+  size_t size = sizeof(*this) - sizeof(delta_) + delta_.SpaceUsed();
+  size += removed_shape_ids_.capacity() * sizeof(int);
+  size += added_shapes_.capacity() * sizeof(unique_ptr<S2Shape>);
+  return size;
+}
+
+void OverlayS2ShapeIndex::Minimize() {
+  delta_.Minimize();
+}
+
+const S2Shape::Edge* OverlayS2ShapeIndex::cached_edges(
+    const S2ShapeIndexCell& cell) const {
+  return base_->cached_edges(cell);
+}
+
+const float* OverlayS2ShapeIndex::cached_float_edges(
+    const S2ShapeIndexCell& cell) const {
+  return base_->cached_float_edges(cell);
+}
@@ -0,0 +1,221 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_OVERLAY_S2SHAPE_INDEX_H_
+#define S2_OVERLAY_S2SHAPE_INDEX_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "s2/util/coding/coder.h"
+#include "s2/encoded_s2cell_id_vector.h"
+#include "s2/encoded_s2shape_index.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2shape.h"
+#include "s2/s2shape_index.h"
+
+// OverlayS2ShapeIndex is an S2ShapeIndex that presents the contents of a
+// "base" index with an encoded delta applied on top of it.  The delta is
+// produced by EncodeDelta(), which compares a base index with an updated
+// version of that index and records only what changed:
+//
+//  - the shape ids that were added or removed, and
+//  - each range of S2CellIds whose index cells differ between the two
+//    versions, together with the replacement cells for those ranges.
+//
+// This is intended for distributing small edits to large indexes.  Rather
+// than re-encoding and shipping the entire updated index, the producer
+// ships only the delta:
+//
+//   // Producer.
+//   Encoder encoder;
+//   OverlayS2ShapeIndex::EncodeDelta(base, updated, &encoder);
+//
+//   // Consumer, holding the existing "base" (e.g. an EncodedS2ShapeIndex).
+//   OverlayS2ShapeIndex index;
+//   Decoder decoder(encoder.base(), encoder.length());
+//   index.Init(&base, &decoder, added_shape_factory);
+//
+// The base index is never re-decoded or modified; index cells outside the
+// replaced ranges are read directly from it.  The delta cells are
+// themselves decoded lazily, exactly as in EncodedS2ShapeIndex.
+//
+// Shapes that were present in the base index keep their shape ids, and
+// EncodeDelta() assumes that any retained shape is geometrically identical
+// in both versions.  (A modified shape should be removed and re-added under
+// a new id.)  Shapes added by the update are supplied to Init() by a
+// ShapeFactory whose i-th shape is the shape with id
+// (base->num_shape_ids() + i).
+//
+// OverlayS2ShapeIndex is thread-compatible in the same way as
+// EncodedS2ShapeIndex: const methods are thread safe, and the only non-const
+// method after initialization is Minimize().
+class OverlayS2ShapeIndex final : public S2ShapeIndex {
+ public:
+  using ShapeFactory = S2ShapeIndex::ShapeFactory;
+
+  // Creates an index that must be initialized by calling Init().
+  OverlayS2ShapeIndex();
+
+  ~OverlayS2ShapeIndex() override;
+
+  // Appends an encoded delta that transforms "base" into "updated".
+  //
+  // REQUIRES: updated.num_shape_ids() >= base.num_shape_ids()
+  // REQUIRES: Every shape with id < base.num_shape_ids() is either absent
+  //           from "updated" or identical to the corresponding base shape.
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  static void EncodeDelta(const S2ShapeIndex& base,
+                          const S2ShapeIndex& updated, Encoder* encoder);
+
+  // Initializes the index as "base" with the encoded delta applied, returning
+  // true on success.  "base" must persist for the lifetime of this object,
+  // and so must the data buffer underlying "decoder" (since the delta is not
+  // copied).  "shape_factory" supplies the shapes added by the delta (see
+  // above), and must have size num_shape_ids() - base->num_shape_ids().
+  //
+  // Returns false if the delta is corrupt or was computed against an index
+  // with a different number of shape ids.
+  bool Init(const S2ShapeIndex* base, Decoder* decoder,
+            const ShapeFactory& shape_factory);
+
+  // The number of distinct shape ids in the updated index.
+  int num_shape_ids() const override { return num_shape_ids_; }
+
+  // Returns a pointer to the shape with the given id, or nullptr if the shape
+  // has been removed from either the base index or the delta.
+  S2Shape* shape(int id) const override;
+
+  // Returns the number of bytes used by the overlay itself.  The base index is
+  // not included since it is not owned by this object.
+  size_t SpaceUsed() const override;
+
+  // Discards any delta cells that have been decoded.  This method invalidates
+  // all iterators.
+  void Minimize() override;
+
+  // Returns the edges cached by the base index for cells that are not
+  // changed by the delta (see S2ShapeIndex::cached_edges and
+  // S2ShapeIndex::cached_float_edges).
+  const S2Shape::Edge* cached_edges(
+      const S2ShapeIndexCell& cell) const override;
+  const float* cached_float_edges(
+      const S2ShapeIndexCell& cell) const override;
+
+  class Iterator final : public IteratorBase {
+   public:
+    // Default constructor; must be followed by a call to Init().
+    Iterator();
+
+    // Constructs an iterator positioned as specified.
+    explicit Iterator(const OverlayS2ShapeIndex* index,
+                      InitialPosition pos = UNPOSITIONED);
+
+    // Initializes an iterator for the given OverlayS2ShapeIndex.
+    void Init(const OverlayS2ShapeIndex* index,
+              InitialPosition pos = UNPOSITIONED);
+
+    // IteratorBase API:
+    void Begin() override;
+    void Finish() override;
+    void Next() override;
+    bool Prev() override;
+    void Seek(S2CellId target) override;
+    bool Locate(const S2Point& target) override;
+    CellRelation Locate(S2CellId target) override;
+    bool can_prefetch() const override;
+    void Prefetch(S2CellId target) const override;
+
+   protected:
+    const S2ShapeIndexCell* GetCell() const override;
+    std::unique_ptr<IteratorBase> Clone() const override;
+    void Copy(const IteratorBase& other) override;
+
+   private:
+    // Advances base_ to the first base cell at or after its current position
+    // that has not been replaced by the delta.
+    void SkipReplacedBaseCells();
+
+    // Positions base_ at the last base cell before its current position that
+    // has not been replaced by the delta, returning false if there is none.
+    // In the latter case base_ is positioned arbitrarily.
+    bool PrevBaseCell();
+
+    void Refresh();  // Updates the IteratorBase fields.
+
+    const OverlayS2ShapeIndex* index_;
+    S2ShapeIndex::Iterator base_;
+    EncodedS2ShapeIndex::Iterator delta_;
+    bool in_delta_;  // True if the current cell comes from delta_.
+  };
+
+ protected:
+  std::unique_ptr<IteratorBase> NewIterator(InitialPosition pos) const override;
+
+ private:
+  // A ShapeFactory of the given size that returns nullptr for every shape.
+  // The delta cells are stored in an EncodedS2ShapeIndex but their shapes are
+  // resolved by OverlayS2ShapeIndex::shape().
+  class NullShapeFactory;
+
+  // The format version number of the delta encoding.
+  static constexpr unsigned char kCurrentEncodingVersionNumber = 0;
+
+  // If the leaf cell "id" lies within one of the replaced ranges, returns the
+  // index of that range (see replaced_ranges_), and otherwise returns -1.
+  int FindReplacedRange(S2CellId id) const;
+
+  const S2ShapeIndex* base_;
+  int num_shape_ids_;
+
+  // The base shape ids removed by the delta, in increasing order.
+  std::vector<int> removed_shape_ids_;
+
+  // The shapes added by the delta, indexed by (id - base_->num_shape_ids()).
+  std::vector<std::unique_ptr<S2Shape>> added_shapes_;
+
+  // The replaced ranges as a sorted sequence of leaf cell ids
+  // [min0, max0, min1, max1, ...] where each range is inclusive.
+  s2coding::EncodedS2CellIdVector replaced_ranges_;
+
+  // The replacement cells for all replaced ranges.
+  EncodedS2ShapeIndex delta_;
+
+  OverlayS2ShapeIndex(const OverlayS2ShapeIndex&) = delete;
+  void operator=(const OverlayS2ShapeIndex&) = delete;
+};
+
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+inline OverlayS2ShapeIndex::Iterator::Iterator()
+    : index_(nullptr), in_delta_(false) {
+}
+
+inline OverlayS2ShapeIndex::Iterator::Iterator(
+    const OverlayS2ShapeIndex* index, InitialPosition pos) {
+  Init(index, pos);
+}
+
+inline std::unique_ptr<OverlayS2ShapeIndex::IteratorBase>
+OverlayS2ShapeIndex::NewIterator(InitialPosition pos) const {
+  return absl::make_unique<Iterator>(this, pos);
+}
+
+#endif  // S2_OVERLAY_S2SHAPE_INDEX_H_
@@ -0,0 +1,238 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/overlay_s2shape_index.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+
+#include "s2/encoded_s2shape_index.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2lax_polygon_shape.h"
+#include "s2/s2loop.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// Returns a 10x10 degree square whose southwest corner is at (0, lng).
+unique_ptr<S2Shape> MakeSquare(int lng) {
+  return s2textformat::MakeLaxPolygonOrDie(absl::StrFormat(
+      "0:%d, 0:%d, 10:%d, 10:%d", lng, lng + 10, lng + 10, lng));
+}
+
+// Returns a loop with many vertices so that the index has many cells.
+unique_ptr<S2Shape> MakeLargeShape() {
+  auto loop = S2Loop::MakeRegularLoop(
+      s2textformat::MakePointOrDie("-20:-20"), S1Angle::Degrees(15), 2000);
+  vector<vector<S2Point>> loops(1);
+  for (int i = 0; i < loop->num_vertices(); ++i) {
+    loops[0].push_back(loop->vertex(i));
+  }
+  return make_unique<S2LaxPolygonShape>(loops);
+}
+
+void ExpectCellsEqual(const S2ShapeIndexCell& a, const S2ShapeIndexCell& b) {
+  ASSERT_EQ(a.num_clipped(), b.num_clipped());
+  for (int i = 0; i < a.num_clipped(); ++i) {
+    const S2ClippedShape& x = a.clipped(i);
+    const S2ClippedShape& y = b.clipped(i);
+    EXPECT_EQ(x.shape_id(), y.shape_id());
+    EXPECT_EQ(x.contains_center(), y.contains_center());
+    ASSERT_EQ(x.num_edges(), y.num_edges());
+    for (int j = 0; j < x.num_edges(); ++j) {
+      EXPECT_EQ(x.edge(j), y.edge(j));
+    }
+  }
+}
+
+// Verifies that "actual" has exactly the same cells as "expected", and that
+// iterating backward and seeking give consistent results.
+void ExpectIndexesEqual(const S2ShapeIndex& expected,
+                        const OverlayS2ShapeIndex& actual) {
+  ASSERT_EQ(expected.num_shape_ids(), actual.num_shape_ids());
+  vector<S2CellId> ids;
+  S2ShapeIndex::Iterator e(&expected, S2ShapeIndex::BEGIN);
+  OverlayS2ShapeIndex::Iterator a(&actual, S2ShapeIndex::BEGIN);
+  for (; !e.done(); e.Next(), a.Next()) {
+    ASSERT_FALSE(a.done());
+    ASSERT_EQ(e.id(), a.id());
+    ExpectCellsEqual(e.cell(), a.cell());
+    ids.push_back(e.id());
+  }
+  EXPECT_TRUE(a.done());
+  for (int i = ids.size(); --i >= 0;) {
+    ASSERT_TRUE(a.Prev());
+    EXPECT_EQ(ids[i], a.id());
+  }
+  EXPECT_FALSE(a.Prev());
+  for (int i = 0; i < 1000; ++i) {
+    S2CellId target = S2Testing::GetRandomCellId();
+    e.Seek(target);
+    a.Seek(target);
+    EXPECT_EQ(e.id(), a.id());
+    EXPECT_EQ(e.Locate(target), a.Locate(target));
+  }
+}
+
+class OverlayS2ShapeIndexTest : public ::testing::Test {
+ protected:
+  // Encodes base_ and decodes it into encoded_base_, so that deltas are
+  // applied to an EncodedS2ShapeIndex as they would be in practice.
+  void EncodeBase() {
+    s2shapeutil::CompactEncodeTaggedShapes(base_, &base_encoder_);
+    base_.Encode(&base_encoder_);
+    Decoder decoder(base_encoder_.base(), base_encoder_.length());
+    ASSERT_TRUE(encoded_base_.Init(
+        &decoder, s2shapeutil::LazyDecodeShapeFactory(&decoder)));
+  }
+
+  // Applies the delta from base_ to updated_ and returns the delta size.
+  size_t ApplyDelta(vector<unique_ptr<S2Shape>> added_shapes) {
+    OverlayS2ShapeIndex::EncodeDelta(base_, updated_, &delta_encoder_);
+    Decoder decoder(delta_encoder_.base(), delta_encoder_.length());
+    EXPECT_TRUE(overlay_.Init(
+        &encoded_base_, &decoder,
+        s2shapeutil::VectorShapeFactory(std::move(added_shapes))));
+    return delta_encoder_.length();
+  }
+
+  MutableS2ShapeIndex base_, updated_;
+  Encoder base_encoder_, delta_encoder_;
+  EncodedS2ShapeIndex encoded_base_;
+  OverlayS2ShapeIndex overlay_;
+};
+
+TEST_F(OverlayS2ShapeIndexTest, AddAndRemoveShapes) {
+  base_.Add(MakeLargeShape());
+  base_.Add(MakeSquare(0));
+  base_.Add(MakeSquare(40));
+  updated_.Add(MakeLargeShape());
+  updated_.Add(MakeSquare(0));
+  updated_.Add(MakeSquare(40));
+  updated_.Release(1);
+  updated_.Add(MakeSquare(80));
+  EncodeBase();
+  vector<unique_ptr<S2Shape>> added;
+  added.push_back(MakeSquare(80));
+  size_t delta_size = ApplyDelta(std::move(added));
+
+  ExpectIndexesEqual(updated_, overlay_);
+  EXPECT_EQ(nullptr, overlay_.shape(1));
+  EXPECT_EQ(encoded_base_.shape(2), overlay_.shape(2));
+  ASSERT_NE(nullptr, overlay_.shape(3));
+  EXPECT_EQ(3, overlay_.shape(3)->id());
+
+  auto query = MakeS2ContainsPointQuery(&overlay_);
+  EXPECT_FALSE(query.Contains(s2textformat::MakePointOrDie("5:5")));
+  EXPECT_TRUE(query.Contains(s2textformat::MakePointOrDie("5:45")));
+  EXPECT_TRUE(query.Contains(s2textformat::MakePointOrDie("5:85")));
+  EXPECT_TRUE(query.Contains(s2textformat::MakePointOrDie("-20:-20")));
+
+  // The delta only needs the cells near the edited squares, which is much
+  // smaller than the index as a whole.
+  EXPECT_LT(4 * delta_size, base_encoder_.length());
+}
+
+TEST_F(OverlayS2ShapeIndexTest, EmptyDelta) {
+  base_.Add(MakeLargeShape());
+  updated_.Add(MakeLargeShape());
+  EncodeBase();
+  ApplyDelta({});
+  ExpectIndexesEqual(updated_, overlay_);
+  OverlayS2ShapeIndex::Iterator it(&overlay_, S2ShapeIndex::BEGIN);
+  EXPECT_FALSE(it.done());
+}
+
+TEST_F(OverlayS2ShapeIndexTest, EmptyBase) {
+  updated_.Add(MakeSquare(0));
+  EncodeBase();
+  vector<unique_ptr<S2Shape>> added;
+  added.push_back(MakeSquare(0));
+  ApplyDelta(std::move(added));
+  ExpectIndexesEqual(updated_, overlay_);
+}
+
+TEST_F(OverlayS2ShapeIndexTest, WrongBase) {
+  base_.Add(MakeSquare(0));
+  updated_.Add(MakeSquare(0));
+  EncodeBase();
+  Encoder encoder;
+  MutableS2ShapeIndex other;
+  OverlayS2ShapeIndex::EncodeDelta(other, updated_, &encoder);
+  Decoder decoder(encoder.base(), encoder.length());
+  vector<unique_ptr<S2Shape>> added;
+  added.push_back(MakeSquare(0));
+  EXPECT_FALSE(overlay_.Init(
+      &encoded_base_, &decoder,
+      s2shapeutil::VectorShapeFactory(std::move(added))));
+}
+
+TEST_F(OverlayS2ShapeIndexTest, InvalidRemovedShapeIds) {
+  for (int i = 0; i < 3; ++i) {
+    base_.Add(MakeSquare(40 * i));
+    updated_.Add(MakeSquare(40 * i));
+  }
+  EncodeBase();
+  Encoder encoder;
+  OverlayS2ShapeIndex::EncodeDelta(base_, updated_, &encoder);
+
+  // Splits the delta around the encoded removed shape ids.
+  Decoder decoder(encoder.base(), encoder.length());
+  decoder.get8();
+  uint32 base_num_shape_ids, num_shape_ids;
+  ASSERT_TRUE(decoder.get_varint32(&base_num_shape_ids));
+  ASSERT_TRUE(decoder.get_varint32(&num_shape_ids));
+  const string prefix(encoder.base(), decoder.pos());
+  s2coding::EncodedUintVector<uint32> removed;
+  ASSERT_TRUE(removed.Init(&decoder));
+  const string suffix(encoder.base() + decoder.pos(), decoder.avail());
+
+  // Returns true if the delta decodes with the given removed shape ids.
+  auto init_with = [&](const vector<uint32>& ids) {
+    Encoder corrupt;
+    corrupt.Ensure(prefix.size());
+    corrupt.putn(prefix.data(), prefix.size());
+    s2coding::EncodeUintVector<uint32>(ids, &corrupt);
+    corrupt.Ensure(suffix.size());
+    corrupt.putn(suffix.data(), suffix.size());
+    Decoder corrupt_decoder(corrupt.base(), corrupt.length());
+    return overlay_.Init(&encoded_base_, &corrupt_decoder,
+                         s2shapeutil::VectorShapeFactory({}));
+  };
+  EXPECT_TRUE(init_with({0, 2}));
+  EXPECT_EQ(nullptr, overlay_.shape(0));
+  EXPECT_NE(nullptr, overlay_.shape(1));
+  EXPECT_FALSE(init_with({2, 0}));  // Not sorted.
+  EXPECT_FALSE(init_with({1, 1}));  // Not unique.
+  EXPECT_FALSE(init_with({3}));     // Not a base shape.
+  EXPECT_TRUE(init_with({}));
+}
+
+}  // namespace
@@ -0,0 +1,684 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Benchmarks for the core operations of the library, intended to catch
+// performance regressions.  All benchmarks use fixed synthetic datasets
+// generated by S2Testing with a fixed random seed, so that results are
+// comparable between runs.  To run a subset of the benchmarks:
+//
+//   ./s2_benchmarks --benchmark_filter=BM_ContainsPointQuery
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "s2/base/integral_types.h"
+#include "s2/encoded_s2shape_index.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/id_set_lexicon.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2boolean_operation.h"
+#include "s2/s2builderutil_s2polygon_layer.h"
+#include "s2/s2builderutil_snap_functions.h"
+#include "s2/s2cap.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2edge_crossings.h"
+#include "s2/s2edge_tessellator.h"
+#include "s2/s2error.h"
+#include "s2/s2latlng.h"
+#include "s2/s2lax_polygon_shape.h"
+#include "s2/s2loop.h"
+#include "s2/s2point.h"
+#include "s2/s2polygon.h"
+#include "s2/s2projections.h"
+#include "s2/s2region_coverer.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2testing.h"
+#include "s2/thread_testing.h"
+#include "s2/util/coding/coder.h"
+
+using absl::make_unique;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// The random seed used to generate all datasets.
+constexpr int kSeed = 12345;
+
+// The number of query points or regions generated for each benchmark.  The
+// benchmarks cycle through these so that the results do not depend on a
+// single (possibly unrepresentative) input.
+constexpr int kNumQueries = 1024;
+
+// The center and radius of the region where all the geometry is generated.
+const S2Point& DatasetCenter() {
+  static const S2Point center = S2LatLng::FromDegrees(37.4, -122.1).ToPoint();
+  return center;
+}
+
+S1Angle DatasetRadius() { return S2Testing::KmToAngle(10); }
+
+// Returns a fractal loop with approximately "num_edges" edges centered at
+// the given point.
+unique_ptr<S2Loop> MakeFractalLoop(const S2Point& center, int num_edges) {
+  S2Testing::Fractal fractal;
+  fractal.SetLevelForApproxMaxEdges(num_edges);
+  return fractal.MakeLoop(S2Testing::GetRandomFrameAt(center),
+                          DatasetRadius());
+}
+
+// Returns "kNumQueries" random points in the dataset region, expanded by a
+// factor of two so that some points are outside the geometry.
+vector<S2Point> MakeQueryPoints() {
+  S2Cap cap(DatasetCenter(), 2 * DatasetRadius());
+  vector<S2Point> points;
+  for (int i = 0; i < kNumQueries; ++i) {
+    points.push_back(S2Testing::SamplePoint(cap));
+  }
+  return points;
+}
+
+void BM_S2CellIdFromPoint(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  vector<S2Point> points;
+  for (int i = 0; i < kNumQueries; ++i) {
+    points.push_back(S2Testing::RandomPoint());
+  }
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(S2CellId(points[i]));
+    if (++i == kNumQueries) i = 0;
+  }
+}
+BENCHMARK(BM_S2CellIdFromPoint);
+
+void BM_S2CellIdToPoint(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  vector<S2CellId> ids;
+  for (int i = 0; i < kNumQueries; ++i) {
+    ids.push_back(S2Testing::GetRandomCellId());
+  }
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ids[i].ToPoint());
+    if (++i == kNumQueries) i = 0;
+  }
+}
+BENCHMARK(BM_S2CellIdToPoint);
+
+void BM_S2CellIdToToken(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  vector<S2CellId> ids;
+  for (int i = 0; i < kNumQueries; ++i) {
+    ids.push_back(S2Testing::GetRandomCellId());
+  }
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ids[i].ToToken());
+    if (++i == kNumQueries) i = 0;
+  }
+}
+BENCHMARK(BM_S2CellIdToToken);
+
+// Measures the per-id cost of converting a batch of ids to tokens.
+void BM_S2CellIdAppendTokens(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  vector<S2CellId> ids;
+  for (int i = 0; i < kNumQueries; ++i) {
+    ids.push_back(S2Testing::GetRandomCellId());
+  }
+  string tokens;
+  for (auto _ : state) {
+    tokens.clear();
+    S2CellId::AppendTokens(ids, ',', &tokens);
+    benchmark::DoNotOptimize(tokens.data());
+  }
+  state.SetItemsProcessed(state.iterations() * ids.size());
+}
+BENCHMARK(BM_S2CellIdAppendTokens);
+
+void BM_S2CellIdFromTokens(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  vector<S2CellId> ids;
+  for (int i = 0; i < kNumQueries; ++i) {
+    ids.push_back(S2Testing::GetRandomCellId());
+  }
+  string tokens;
+  S2CellId::AppendTokens(ids, ',', &tokens);
+  for (auto _ : state) {
+    ids.clear();
+    S2CellId::FromTokens(tokens, ',', &ids);
+    benchmark::DoNotOptimize(ids.data());
+  }
+  state.SetItemsProcessed(state.iterations() * ids.size());
+}
+BENCHMARK(BM_S2CellIdFromTokens);
+
+// The argument is the maximum number of cells in the covering.
+void BM_RegionCovererGetCovering(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  vector<S2Cap> caps;
+  for (int i = 0; i < kNumQueries; ++i) {
+    caps.push_back(S2Testing::GetRandomCap(1e-10, 1e-2));
+  }
+  S2RegionCoverer::Options options;
+  options.set_max_cells(state.range(0));
+  S2RegionCoverer coverer(options);
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(coverer.GetCovering(caps[i]));
+    if (++i == kNumQueries) i = 0;
+  }
+}
+BENCHMARK(BM_RegionCovererGetCovering)->Arg(8)->Arg(100)->Arg(1000);
+
+// Returns a covering of a random cap with about "max_cells" cells, and
+// "num_points" leaf cells sampled from a slightly larger cap so that about
+// half of them are contained by the covering.
+static S2CellUnion GetGeofence(int max_cells, int num_points,
+                               vector<S2CellId>* leaves) {
+  S2Testing::rnd.Reset(kSeed);
+  S2Cap cap = S2Testing::GetRandomCap(1e-6, 1e-6);
+  S2RegionCoverer::Options options;
+  options.set_max_cells(max_cells);
+  S2CellUnion covering = S2RegionCoverer(options).GetCovering(cap);
+  S2Cap sample_cap(cap.center(), 1.4 * cap.GetRadius());
+  for (int i = 0; i < num_points; ++i) {
+    leaves->push_back(S2CellId(S2Testing::SamplePoint(sample_cap)));
+  }
+  return covering;
+}
+
+// The argument is the maximum number of cells in the geofence covering.
+void BM_CellUnionContainsLeaf(benchmark::State& state) {
+  vector<S2CellId> leaves;
+  S2CellUnion covering = GetGeofence(state.range(0), 4096, &leaves);
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(covering.Contains(leaves[i]));
+    if (++i == leaves.size()) i = 0;
+  }
+}
+BENCHMARK(BM_CellUnionContainsLeaf)->Arg(8)->Arg(100)->Arg(1000);
+
+void BM_CellUnionBatchContainsSorted(benchmark::State& state) {
+  vector<S2CellId> leaves;
+  S2CellUnion covering = GetGeofence(state.range(0), 4096, &leaves);
+  std::sort(leaves.begin(), leaves.end());
+  vector<bool> result;
+  for (auto _ : state) {
+    covering.BatchContains(leaves, &result);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations() * leaves.size());
+}
+BENCHMARK(BM_CellUnionBatchContainsSorted)->Arg(8)->Arg(100)->Arg(1000);
+
+// The argument is the approximate number of loop edges.
+void BM_MutableS2ShapeIndexBuild(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  unique_ptr<S2Loop> loop = MakeFractalLoop(DatasetCenter(), state.range(0));
+  for (auto _ : state) {
+    MutableS2ShapeIndex index;
+    index.Add(make_unique<S2Loop::Shape>(loop.get()));
+    index.ForceBuild();
+  }
+  state.SetItemsProcessed(state.iterations() * loop->num_vertices());
+}
+BENCHMARK(BM_MutableS2ShapeIndexBuild)->Arg(48)->Arg(3072)->Arg(49152);
+
+// The argument is the approximate number of loop edges.
+void BM_ContainsPointQuery(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  unique_ptr<S2Loop> loop = MakeFractalLoop(DatasetCenter(), state.range(0));
+  MutableS2ShapeIndex index;
+  index.Add(make_unique<S2Loop::Shape>(loop.get()));
+  index.ForceBuild();
+  vector<S2Point> points = MakeQueryPoints();
+  auto query = MakeS2ContainsPointQuery(&index);
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(query.Contains(points[i]));
+    if (++i == kNumQueries) i = 0;
+  }
+}
+BENCHMARK(BM_ContainsPointQuery)->Arg(48)->Arg(3072)->Arg(49152);
+
+// The argument is the approximate number of loop edges.
+void BM_ClosestEdgeQuery(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  unique_ptr<S2Loop> loop = MakeFractalLoop(DatasetCenter(), state.range(0));
+  MutableS2ShapeIndex index;
+  index.Add(make_unique<S2Loop::Shape>(loop.get()));
+  index.ForceBuild();
+  vector<S2Point> points = MakeQueryPoints();
+  S2ClosestEdgeQuery query(&index);
+  int i = 0;
+  for (auto _ : state) {
+    S2ClosestEdgeQuery::PointTarget target(points[i]);
+    benchmark::DoNotOptimize(query.FindClosestEdge(&target));
+    if (++i == kNumQueries) i = 0;
+  }
+}
+BENCHMARK(BM_ClosestEdgeQuery)->Arg(48)->Arg(3072)->Arg(49152);
+
+// Computes the union of two overlapping fractal polygons.  The argument is
+// the approximate number of edges in each polygon.
+void BM_BooleanOperationUnion(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  S2Point offset_center =
+      (DatasetCenter() + S2Testing::RandomPoint() * DatasetRadius().radians())
+          .Normalize();
+  S2Polygon a(MakeFractalLoop(DatasetCenter(), state.range(0)));
+  S2Polygon b(MakeFractalLoop(offset_center, state.range(0)));
+  for (auto _ : state) {
+    S2Polygon result;
+    S2BooleanOperation op(
+        S2BooleanOperation::OpType::UNION,
+        make_unique<s2builderutil::S2PolygonLayer>(&result));
+    S2Error error;
+    op.Build(a.index(), b.index(), &error);
+    benchmark::DoNotOptimize(result.num_loops());
+  }
+}
+BENCHMARK(BM_BooleanOperationUnion)->Arg(48)->Arg(768)->Arg(3072);
+
+// Returns "n" overlapping random 20-gons in the dataset region.
+vector<unique_ptr<S2Polygon>> MakeUnionInputs(int n) {
+  S2Testing::rnd.Reset(kSeed);
+  S2Cap cap(DatasetCenter(), DatasetRadius());
+  vector<unique_ptr<S2Polygon>> polygons;
+  for (int i = 0; i < n; ++i) {
+    polygons.push_back(make_unique<S2Polygon>(S2Loop::MakeRegularLoop(
+        S2Testing::SamplePoint(cap), 0.2 * DatasetRadius(), 20)));
+  }
+  return polygons;
+}
+
+// Computes the union of many polygons using pairwise unions.  The argument
+// is the number of polygons.
+void BM_PolygonDestructiveUnion(benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto polygons = MakeUnionInputs(state.range(0));
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(
+        S2Polygon::DestructiveUnion(std::move(polygons))->num_loops());
+  }
+}
+BENCHMARK(BM_PolygonDestructiveUnion)->Arg(16)->Arg(256)->Arg(4096);
+
+// Computes the union of many polygons in a single S2Builder pass.  The
+// argument is the number of polygons.
+void BM_PolygonMultiwayUnion(benchmark::State& state) {
+  auto polygons = MakeUnionInputs(state.range(0));
+  vector<const S2Polygon*> inputs;
+  for (const auto& polygon : polygons) inputs.push_back(polygon.get());
+  const auto snap_function =
+      s2builderutil::IdentitySnapFunction(S2::kIntersectionMergeRadius);
+  for (auto _ : state) {
+    S2Polygon result;
+    S2Error error;
+    result.InitToUnion(inputs, snap_function, &error);
+    benchmark::DoNotOptimize(result.num_loops());
+  }
+}
+BENCHMARK(BM_PolygonMultiwayUnion)->Arg(16)->Arg(256)->Arg(4096);
+
+// Projects the boundary of a fractal loop into the Mercator projection with
+// a tolerance of about 10 meters.  The argument is the approximate number of
+// loop edges.
+void BM_EdgeTessellatorAppendProjected(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  auto loop = MakeFractalLoop(DatasetCenter(), state.range(0));
+  S2PointLoopSpan span = loop->vertices_span();
+  vector<S2Point> chain(span.begin(), span.end());
+  chain.push_back(loop->vertex(0));
+  S2::MercatorProjection proj(180);
+  S2EdgeTessellator tessellator(&proj, S2Testing::KmToAngle(0.01));
+  vector<R2Point> vertices;
+  for (auto _ : state) {
+    vertices.clear();
+    tessellator.AppendProjected(chain, &vertices);
+    benchmark::DoNotOptimize(vertices.data());
+  }
+  state.SetItemsProcessed(state.iterations() * chain.size());
+}
+BENCHMARK(BM_EdgeTessellatorAppendProjected)->Arg(48)->Arg(3072)->Arg(49152);
+
+// Decodes an EncodedS2ShapeIndex and then visits all of its cells (which are
+// decoded lazily).  The argument is the approximate number of loop edges.
+void BM_EncodedS2ShapeIndexDecode(benchmark::State& state) {
+  S2Testing::rnd.Reset(kSeed);
+  S2Polygon polygon(MakeFractalLoop(DatasetCenter(), state.range(0)));
+  MutableS2ShapeIndex index;
+  index.Add(make_unique<S2Polygon::Shape>(&polygon));
+  Encoder encoder;
+  s2shapeutil::CompactEncodeTaggedShapes(index, &encoder);
+  index.Encode(&encoder);
+  for (auto _ : state) {
+    Decoder decoder(encoder.base(), encoder.length());
+    EncodedS2ShapeIndex encoded_index;
+    encoded_index.Init(&decoder,
+                       s2shapeutil::LazyDecodeShapeFactory(&decoder));
+    int num_edges = 0;
+    for (EncodedS2ShapeIndex::Iterator it(&encoded_index, S2ShapeIndex::BEGIN);
+         !it.done(); it.Next()) {
+      num_edges += it.cell().num_edges();
+    }
+    benchmark::DoNotOptimize(num_edges);
+  }
+  state.SetBytesProcessed(state.iterations() * encoder.length());
+}
+BENCHMARK(BM_EncodedS2ShapeIndexDecode)->Arg(48)->Arg(3072)->Arg(49152);
+
+// Returns an encoded vector of "n" sorted random 5-byte values.
+s2coding::EncodedUintVector<uint64> MakeEncodedUintVector(int n,
+                                                          Encoder* encoder) {
+  S2Testing::rnd.Reset(kSeed);
+  vector<uint64> values(n);
+  for (uint64& value : values) value = S2Testing::rnd.Rand64() >> 24;
+  std::sort(values.begin(), values.end());
+  s2coding::EncodeUintVector<uint64>(values, encoder);
+  Decoder decoder(encoder->base(), encoder->length());
+  s2coding::EncodedUintVector<uint64> result;
+  result.Init(&decoder);
+  return result;
+}
+
+// Calls lower_bound() on an encoded vector.  The argument is the number of
+// values in the vector.
+void BM_EncodedUintVectorLowerBound(benchmark::State& state) {
+  Encoder encoder;
+  auto values = MakeEncodedUintVector(state.range(0), &encoder);
+  vector<uint64> targets(kNumQueries);
+  for (uint64& target : targets) target = S2Testing::rnd.Rand64() >> 24;
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(values.lower_bound(targets[i]));
+    if (++i == kNumQueries) i = 0;
+  }
+}
+BENCHMARK(BM_EncodedUintVectorLowerBound)->Arg(64)->Arg(4096)->Arg(262144);
+
+// Decodes an entire encoded vector.  The argument is the number of values.
+void BM_EncodedUintVectorDecode(benchmark::State& state) {
+  Encoder encoder;
+  auto values = MakeEncodedUintVector(state.range(0), &encoder);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(values.Decode());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EncodedUintVectorDecode)->Arg(64)->Arg(4096)->Arg(262144);
+
+// Adds random sets of 2 to 4 ids to an IdSetLexicon, as S2Builder does
+// when it tracks the labels or input edge ids of each output edge.  The
+// argument is the number of distinct ids (smaller values yield more sets
+// that are already present in the lexicon).
+void BM_IdSetLexiconAdd(benchmark::State& state) {
+  const int num_ids = state.range(0);
+  S2Testing::rnd.Reset(kSeed);
+  vector<vector<int32>> sets(kNumQueries);
+  for (auto& set : sets) {
+    int size = 2 + S2Testing::rnd.Uniform(3);
+    for (int j = 0; j < size; ++j) {
+      set.push_back(S2Testing::rnd.Uniform(num_ids));
+    }
+  }
+  IdSetLexicon lexicon;
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lexicon.Add(sets[i]));
+    if (++i == kNumQueries) {
+      i = 0;
+      // Keep the lexicon at a steady size.
+      state.PauseTiming();
+      lexicon.Clear();
+      state.ResumeTiming();
+    }
+  }
+}
+BENCHMARK(BM_IdSetLexiconAdd)->Arg(16)->Arg(1024)->Arg(65536);
+
+// The following benchmarks measure how query throughput scales with the
+// number of threads reading the same index.  Items per second are reported
+// in real time, so ideal scaling doubles the throughput with each doubling
+// of the thread count.  The shared datasets are created on first use (while
+// holding a mutex, since S2Testing::rnd is not thread-safe) and are never
+// destroyed.
+
+// The dataset shared by the multi-threaded benchmarks: an index containing
+// a fractal polygon, its encoding, and the query points.  The polygon is
+// represented as an S2LaxPolygonShape so that decoding it lazily (as an
+// EncodedS2LaxPolygonShape) takes constant time.
+struct SharedDataset {
+  MutableS2ShapeIndex index;  // Built before it is shared.
+  string encoded;             // Tagged shapes followed by the index.
+  vector<S2Point> points;
+};
+
+// Returns the shared dataset whose polygon has approximately "num_edges"
+// edges.
+const SharedDataset& GetSharedDataset(int num_edges) {
+  static absl::Mutex* mutex = new absl::Mutex;
+  static auto* datasets = new std::map<int, unique_ptr<SharedDataset>>;
+  absl::MutexLock lock(mutex);
+  unique_ptr<SharedDataset>& dataset = (*datasets)[num_edges];
+  if (dataset == nullptr) {
+    dataset = make_unique<SharedDataset>();
+    S2Testing::rnd.Reset(kSeed);
+    S2Polygon polygon(MakeFractalLoop(DatasetCenter(), num_edges));
+    dataset->index.Add(make_unique<S2LaxPolygonShape>(polygon));
+    dataset->index.ForceBuild();
+    Encoder encoder;
+    s2shapeutil::CompactEncodeTaggedShapes(dataset->index, &encoder);
+    dataset->index.Encode(&encoder);
+    dataset->encoded.assign(encoder.base(), encoder.length());
+    dataset->points = MakeQueryPoints();
+  }
+  return *dataset;
+}
+
+// Returns an EncodedS2ShapeIndex that decodes the dataset lazily.  (The
+// decoded shapes refer to "dataset.encoded" rather than to the Decoder.)
+unique_ptr<EncodedS2ShapeIndex> NewEncodedIndex(const SharedDataset& dataset) {
+  Decoder decoder(dataset.encoded.data(), dataset.encoded.size());
+  auto index = make_unique<EncodedS2ShapeIndex>();
+  index->Init(&decoder, s2shapeutil::LazyDecodeShapeFactory(&decoder));
+  return index;
+}
+
+// Each thread starts at a different query point so that the threads do not
+// visit the same index cells in lockstep.
+int FirstQueryPoint(const benchmark::State& state) {
+  return (state.thread_index() * 97) % kNumQueries;
+}
+
+// Point containment queries on a shared MutableS2ShapeIndex.
+void BM_ConcurrentMutableIndexQuery(benchmark::State& state) {
+  const SharedDataset& dataset = GetSharedDataset(state.range(0));
+  auto query = MakeS2ContainsPointQuery(&dataset.index);
+  int i = FirstQueryPoint(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(query.Contains(dataset.points[i]));
+    if (++i == kNumQueries) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConcurrentMutableIndexQuery)
+    ->Arg(3072)->Arg(49152)->ThreadRange(1, 16)->UseRealTime();
+
+// Point containment queries on a shared EncodedS2ShapeIndex whose shapes and
+// cells have already been decoded (lazily), so this mainly measures the cost
+// of looking up decoded shapes and cells in the shared atomic arrays.
+void BM_ConcurrentEncodedIndexQuery(benchmark::State& state) {
+  const SharedDataset& dataset = GetSharedDataset(state.range(0));
+  static absl::Mutex* mutex = new absl::Mutex;
+  static auto* indexes = new std::map<int, unique_ptr<EncodedS2ShapeIndex>>;
+  const EncodedS2ShapeIndex* index;
+  {
+    absl::MutexLock lock(mutex);
+    unique_ptr<EncodedS2ShapeIndex>& entry = (*indexes)[state.range(0)];
+    if (entry == nullptr) {
+      // Run every query once so that the timing loop starts with all the
+      // cells and shapes that it needs already decoded.
+      entry = NewEncodedIndex(dataset);
+      auto query = MakeS2ContainsPointQuery(entry.get());
+      for (const S2Point& p : dataset.points) {
+        benchmark::DoNotOptimize(query.Contains(p));
+      }
+    }
+    index = entry.get();
+  }
+  auto query = MakeS2ContainsPointQuery(index);
+  int i = FirstQueryPoint(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(query.Contains(dataset.points[i]));
+    if (++i == kNumQueries) i = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConcurrentEncodedIndexQuery)
+    ->Arg(3072)->Arg(49152)->ThreadRange(1, 16)->UseRealTime();
+
+// Like the benchmark above, except that every kQueriesPerIndex consecutive
+// queries (taken by whichever threads are running) go to a newly
+// initialized EncodedS2ShapeIndex.  The threads therefore race to decode the
+// same cells and shapes, which exercises the lazy decoding path
+// (EncodedS2ShapeIndex::AtomicShape and the cell cache).  The number of
+// iterations is fixed so that enough fresh indexes can be created before
+// timing starts.
+constexpr int kLazyDecodeIterations = 1024;
+constexpr int kQueriesPerIndex = 4;
+vector<unique_ptr<EncodedS2ShapeIndex>>* lazy_decode_indexes;
+std::atomic<int> lazy_decode_next_query;
+
+void BM_ConcurrentEncodedIndexLazyDecode(benchmark::State& state) {
+  const SharedDataset& dataset = GetSharedDataset(state.range(0));
+  if (state.thread_index() == 0) {
+    // The library starts all threads' timing loops together, so the other
+    // threads do not access the indexes until this setup is complete.
+    lazy_decode_indexes = new vector<unique_ptr<EncodedS2ShapeIndex>>(
+        kLazyDecodeIterations * state.threads() / kQueriesPerIndex + 1);
+    for (auto& index : *lazy_decode_indexes) index = NewEncodedIndex(dataset);
+    lazy_decode_next_query = 0;
+  }
+  for (auto _ : state) {
+    int k = lazy_decode_next_query.fetch_add(1, std::memory_order_relaxed);
+    const EncodedS2ShapeIndex& index =
+        *(*lazy_decode_indexes)[k / kQueriesPerIndex];
+    benchmark::DoNotOptimize(MakeS2ContainsPointQuery(&index).Contains(
+        dataset.points[k % kNumQueries]));
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    // The library also waits for all threads to finish their timing loops.
+    delete lazy_decode_indexes;
+  }
+}
+BENCHMARK(BM_ConcurrentEncodedIndexLazyDecode)
+    ->Arg(3072)->Arg(49152)->ThreadRange(1, 16)
+    ->Iterations(kLazyDecodeIterations)->UseRealTime();
+
+// Alternates between adding a shape to a MutableS2ShapeIndex and letting a
+// number of reader threads query it, so that the first query after each
+// write applies the update while the other readers wait for it (see
+// s2testing::ReaderWriterTest).  The argument is the number of reader
+// threads.  The "waits_per_update" counter reports how many readers had to
+// wait for each update (see MutableS2ShapeIndex::GetUpdateStats).
+class MixedUpdateBenchmark : public s2testing::ReaderWriterTest {
+ public:
+  static constexpr int kNumLoops = 64;
+  static constexpr int kQueriesPerRead = 64;
+
+  MixedUpdateBenchmark() : index_(MakeOptions()) {
+    S2Testing::rnd.Reset(kSeed);
+    for (int i = 0; i < kNumLoops; ++i) {
+      S2Point center = S2Testing::SamplePoint(
+          S2Cap(DatasetCenter(), DatasetRadius()));
+      loops_.push_back(S2Loop::MakeRegularLoop(
+          center, 0.1 * DatasetRadius(), 64));
+    }
+    points_ = MakeQueryPoints();
+  }
+
+  // Adds the next loop, first removing the oldest loop once all of them
+  // have been added so that the index size stays constant.
+  void WriteOp() override {
+    if (num_added_ >= kNumLoops) index_.Release(num_added_ - kNumLoops);
+    index_.Add(make_unique<S2Loop::Shape>(
+        loops_[num_added_++ % kNumLoops].get()));
+  }
+
+  void ReadOp() override {
+    auto query = MakeS2ContainsPointQuery(&index_);
+    int i = next_point_.fetch_add(kQueriesPerRead, std::memory_order_relaxed);
+    for (int j = 0; j < kQueriesPerRead; ++j) {
+      benchmark::DoNotOptimize(
+          query.Contains(points_[(i + j) % kNumQueries]));
+    }
+  }
+
+  const MutableS2ShapeIndex& index() const { return index_; }
+
+ private:
+  static MutableS2ShapeIndex::Options MakeOptions() {
+    MutableS2ShapeIndex::Options options;
+    options.set_collect_update_stats(true);
+    return options;
+  }
+
+  vector<unique_ptr<S2Loop>> loops_;
+  vector<S2Point> points_;
+  MutableS2ShapeIndex index_;
+  int num_added_ = 0;
+  std::atomic<int> next_point_{0};
+};
+
+void BM_ConcurrentMixedUpdatesAndQueries(benchmark::State& state) {
+  const int num_readers = state.range(0);
+  constexpr int kWritesPerIteration = 64;
+  MixedUpdateBenchmark test;
+  for (auto _ : state) {
+    test.Run(num_readers, kWritesPerIteration);
+  }
+  state.SetItemsProcessed(state.iterations() * kWritesPerIteration *
+                          num_readers * MixedUpdateBenchmark::kQueriesPerRead);
+  MutableS2ShapeIndex::UpdateStats stats = test.index().GetUpdateStats();
+  state.counters["waits_per_update"] =
+      static_cast<double>(stats.num_waits) / std::max<int64>(
+          1, stats.num_updates);
+}
+BENCHMARK(BM_ConcurrentMixedUpdatesAndQueries)
+    ->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,243 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// A benchmark harness that measures query performance on user-supplied
+// geometry rather than the synthetic datasets used by s2_benchmarks.
+// Usage:
+//
+//   s2_dataset_benchmark [--num_queries=N] [--seed=N] FILE...
+//
+// Each FILE is loaded in one of two formats:
+//
+//  - Files ending in ".s2index" contain an encoded S2ShapeIndex, i.e. the
+//    shapes encoded by s2shapeutil::CompactEncodeTaggedShapes() followed by
+//    the index encoded by MutableS2ShapeIndex::Encode().  The file is
+//    queried as an EncodedS2ShapeIndex, so the time to decode it is included
+//    in the load time.
+//
+//  - All other files contain an index in s2textformat::MakeIndex() format,
+//    i.e. "points # polylines # polygons" (newlines are allowed).  The index
+//    is built before any queries are run.
+//
+// For each file the harness reports the load time and then, for each query
+// type, the throughput and the 50th/90th/99th percentile and maximum
+// latencies.  The query points are chosen uniformly at random from the
+// bounding rectangle of the edges, using a fixed seed so that the results
+// are reproducible.  Latencies include the overhead of reading the clock
+// (typically 20-50 nanoseconds).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/string_view.h"
+#include "s2/base/integral_types.h"
+#include "s2/encoded_s2shape_index.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2latlng_rect.h"
+#include "s2/s2latlng_rect_bounder.h"
+#include "s2/s2point.h"
+#include "s2/s2shape_index.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+#include "s2/util/coding/coder.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Returns the given percentile of "sorted_latencies" using the nearest-rank
+// method, i.e. the smallest value such that at least the given percentage of
+// the values are less than or equal to it.
+double Percentile(const vector<double>& sorted_latencies, double percentile) {
+  const int n = sorted_latencies.size();
+  int rank = static_cast<int>(std::ceil(percentile * n / 100));
+  return sorted_latencies[std::max(0, std::min(rank, n) - 1)];
+}
+
+// Calls "query" once for each point in "points" and prints the throughput
+// and latency percentiles.
+void RunQueries(const char* name, const vector<S2Point>& points,
+                const std::function<void(const S2Point&)>& query) {
+  vector<double> latencies;
+  latencies.reserve(points.size());
+  Clock::time_point start = Clock::now();
+  for (const S2Point& point : points) {
+    Clock::time_point query_start = Clock::now();
+    query(point);
+    latencies.push_back(SecondsSince(query_start));
+  }
+  double total = SecondsSince(start);
+  std::sort(latencies.begin(), latencies.end());
+  std::printf("  %-18s %10.0f queries/s  p50 %8.2f us  p90 %8.2f us  "
+              "p99 %8.2f us  max %8.2f us\n",
+              name, points.size() / total, 1e6 * Percentile(latencies, 50),
+              1e6 * Percentile(latencies, 90), 1e6 * Percentile(latencies, 99),
+              1e6 * latencies.back());
+}
+
+// Returns a bounding rectangle for the edges of all shapes in the index.
+// (This is much tighter than the bound of the index cells when the index is
+// small, since in that case the cells are large.)
+S2LatLngRect GetEdgeBound(const S2ShapeIndex& index) {
+  S2LatLngRectBounder bounder;
+  for (const S2Shape* shape : index) {
+    if (shape == nullptr) continue;
+    for (int e = 0; e < shape->num_edges(); ++e) {
+      S2Shape::Edge edge = shape->edge(e);
+      bounder.AddPoint(edge.v0);
+      bounder.AddPoint(edge.v1);
+    }
+  }
+  return bounder.GetBound();
+}
+
+void RunBenchmarks(const S2ShapeIndex& index, int num_queries, int seed) {
+  S2LatLngRect bound = GetEdgeBound(index);
+  if (bound.is_empty()) {
+    std::printf("  (empty index, no queries run)\n");
+    return;
+  }
+  S2Testing::rnd.Reset(seed);
+  vector<S2Point> points;
+  for (int i = 0; i < num_queries; ++i) {
+    points.push_back(S2Testing::SamplePoint(bound));
+  }
+
+  int num_contained = 0;
+  auto contains_query = MakeS2ContainsPointQuery(&index);
+  RunQueries("ContainsPoint", points, [&](const S2Point& point) {
+    num_contained += contains_query.Contains(point);
+  });
+
+  S2ClosestEdgeQuery closest_query(&index);
+  RunQueries("ClosestEdge", points, [&](const S2Point& point) {
+    S2ClosestEdgeQuery::PointTarget target(point);
+    closest_query.FindClosestEdge(&target);
+  });
+
+  S2ClosestEdgeQuery within_query(&index);
+  within_query.mutable_options()->set_max_distance(
+      S2Testing::KmToAngle(1));
+  int64 num_within = 0;
+  RunQueries("EdgesWithin1Km", points, [&](const S2Point& point) {
+    S2ClosestEdgeQuery::PointTarget target(point);
+    num_within += within_query.FindClosestEdges(&target).size();
+  });
+  std::printf("  (%d points contained, %.1f results within 1km on average)\n",
+              num_contained, static_cast<double>(num_within) / num_queries);
+}
+
+bool ReadFile(const string& path, string* contents) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  std::ostringstream buffer;
+  buffer << file.rdbuf();
+  *contents = buffer.str();
+  return true;
+}
+
+// Loads and benchmarks the given file.  Returns false if it cannot be loaded.
+bool BenchmarkFile(const string& path, int num_queries, int seed) {
+  string contents;
+  if (!ReadFile(path, &contents)) {
+    std::fprintf(stderr, "Could not read %s\n", path.c_str());
+    return false;
+  }
+  Clock::time_point start = Clock::now();
+  if (absl::EndsWith(path, ".s2index")) {
+    // The EncodedS2ShapeIndex refers to "contents", which must persist.
+    Decoder decoder(contents.data(), contents.size());
+    EncodedS2ShapeIndex index;
+    if (!index.Init(&decoder, s2shapeutil::LazyDecodeShapeFactory(&decoder))) {
+      std::fprintf(stderr, "Could not decode %s\n", path.c_str());
+      return false;
+    }
+    std::printf("%s: %d shapes, %zu bytes, decoded in %.3f ms\n", path.c_str(),
+                index.num_shape_ids(), contents.size(),
+                1e3 * SecondsSince(start));
+    RunBenchmarks(index, num_queries, seed);
+  } else {
+    auto index = absl::make_unique<MutableS2ShapeIndex>();
+    if (std::count(contents.begin(), contents.end(), '#') != 2 ||
+        !s2textformat::MakeIndex(contents, &index)) {
+      std::fprintf(stderr, "Could not parse %s\n", path.c_str());
+      return false;
+    }
+    index->ForceBuild();
+    std::printf("%s: %d shapes, parsed and built in %.3f ms\n", path.c_str(),
+                index->num_shape_ids(), 1e3 * SecondsSince(start));
+    RunBenchmarks(*index, num_queries, seed);
+  }
+  return true;
+}
+
+// If "arg" has the form "--<name>=<value>", sets "value" and returns true.
+bool ParseIntFlag(absl::string_view arg, absl::string_view name, int* value) {
+  string prefix = "--" + string(name) + "=";
+  if (!absl::StartsWith(arg, prefix)) return false;
+  if (!absl::SimpleAtoi(arg.substr(prefix.size()), value)) {
+    std::fprintf(stderr, "Invalid value for --%s\n", string(name).c_str());
+    std::exit(1);
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int num_queries = 100000;
+  int seed = 1;
+  vector<string> paths;
+  for (int i = 1; i < argc; ++i) {
+    absl::string_view arg = argv[i];
+    if (ParseIntFlag(arg, "num_queries", &num_queries) ||
+        ParseIntFlag(arg, "seed", &seed)) {
+      continue;
+    }
+    paths.push_back(string(arg));
+  }
+  if (paths.empty() || num_queries <= 0) {
+    std::fprintf(stderr,
+                 "Usage: %s [--num_queries=N] [--seed=N] FILE...\n", argv[0]);
+    return 1;
+  }
+  bool ok = true;
+  for (const string& path : paths) {
+    ok &= BenchmarkFile(path, num_queries, seed);
+  }
+  return ok ? 0 : 1;
+}
@@ -836,8 +836,8 @@ void EdgeClippingLayer::Build(const Graph& g, S2Error* error) {
 
 class S2BooleanOperation::Impl {
  public:
-  explicit Impl(S2BooleanOperation* op)
-      : op_(op), index_crossings_first_region_id_(-1),
+  explicit Impl(S2BooleanOperation* op, CrossingCache* cache = nullptr)
+      : op_(op), cache_(cache), index_crossings_first_region_id_(-1),
         tracker_(op->options_.memory_tracker()) {
   }
 
@@ -891,6 +891,7 @@ class S2BooleanOperation::Impl {
     }
   };
   using IndexCrossings = vector<IndexCrossing>;
+  friend struct CrossingCache::Data;
 
   class MemoryTracker : public S2MemoryTracker::Client {
    public:
@@ -939,9 +940,13 @@ class S2BooleanOperation::Impl {
   bool AddIndexCrossing(const ShapeEdge& a, const ShapeEdge& b,
                         bool is_interior, IndexCrossings* crossings);
   bool GetIndexCrossings(int region_id);
+  bool GetCachedIndexCrossings();
   bool AddBoundaryPair(bool invert_a, bool invert_b, bool invert_result,
                        CrossingProcessor* cp);
   bool AreRegionsIdentical() const;
+  bool DecideFromIndexCells(bool* result_empty) const;
+  bool DecideIntersectionFromIndexCells(bool* result_empty) const;
+  bool DecideDifferenceFromIndexCells(bool* result_empty) const;
   bool BuildOpType(OpType op_type);
   bool IsFullPolygonResult(const S2Builder::Graph& g, S2Error* error) const;
   bool IsFullPolygonUnion(const S2ShapeIndex& a,
@@ -959,6 +964,14 @@ class S2BooleanOperation::Impl {
 
   S2BooleanOperation* op_;
 
+  // Optional cache of the edge crossings between the two input regions.
+  CrossingCache* cache_;
+
+  // If non-null, the intersection points of interior crossings are appended
+  // here (in the order they are added to the S2Builder) so that they can be
+  // stored in cache_.
+  vector<S2Point>* cached_intersections_ = nullptr;
+
   // The S2Builder options used to construct the output.
   S2Builder::Options builder_options_;
 
@@ -995,6 +1008,26 @@ class S2BooleanOperation::Impl {
   MemoryTracker tracker_;
 };
 
+struct S2BooleanOperation::CrossingCache::Data {
+  // The regions whose crossings are stored.  The first element of each
+  // crossing is an edge of regions[0].
+  const S2ShapeIndex* regions[2];
+
+  // The sorted crossings (including the final sentinel value), and the
+  // intersection points of the interior crossings in the order that they
+  // were found.
+  Impl::IndexCrossings crossings;
+  vector<S2Point> intersections;
+};
+
+S2BooleanOperation::CrossingCache::CrossingCache() {}
+
+S2BooleanOperation::CrossingCache::~CrossingCache() {}
+
+void S2BooleanOperation::CrossingCache::Clear() {
+  data_.reset();
+}
+
 const s2shapeutil::ShapeEdgeId S2BooleanOperation::Impl::kSentinel(
     std::numeric_limits<int32>::max(), 0);
 
@@ -2180,8 +2213,9 @@ inline bool S2BooleanOperation::Impl::AddIndexCrossing(
     if (s2pred::Sign(a.v0(), a.v1(), b.v0()) > 0) {
       crossing->left_to_right = true;
     }
-    builder_->AddIntersection(
-        S2::GetIntersection(a.v0(), a.v1(), b.v0(), b.v1()));
+    S2Point x = S2::GetIntersection(a.v0(), a.v1(), b.v0(), b.v1());
+    builder_->AddIntersection(x);
+    if (cached_intersections_) cached_intersections_->push_back(x);
   } else {
     // TODO(ericv): This field isn't used unless one shape is a polygon and
     // the other is a polyline or polygon, but we don't have the shape
@@ -2200,8 +2234,18 @@ inline bool S2BooleanOperation::Impl::AddIndexCrossing(
 // as soon as the result is known to be non-empty.
 bool S2BooleanOperation::Impl::GetIndexCrossings(int region_id) {
   if (region_id == index_crossings_first_region_id_) return true;
+  if (index_crossings_first_region_id_ < 0 && cache_ != nullptr &&
+      cache_->data_ != nullptr) {
+    if (!GetCachedIndexCrossings()) return false;
+    if (region_id == index_crossings_first_region_id_) return tracker_.ok();
+  }
   if (index_crossings_first_region_id_ < 0) {
     S2_DCHECK_EQ(region_id, 0);  // For efficiency, not correctness.
+    S2TraceSpan span(op_->options_.tracer(),
+                     "S2BooleanOperation::GetIndexCrossings");
+    vector<S2Point> intersections;
+    if (cache_ != nullptr) cached_intersections_ = &intersections;
+    auto _ = absl::MakeCleanup([this]() { cached_intersections_ = nullptr; });
     // TODO(ericv): This would be more efficient if VisitCrossingEdgePairs()
     // returned the sign (+1 or -1) of the interior crossing, i.e.
     // "int interior_crossing_sign" rather than "bool is_interior".
@@ -2223,10 +2267,18 @@ bool S2BooleanOperation::Impl::GetIndexCrossings(int region_id) {
           std::unique(index_crossings_.begin(), index_crossings_.end()),
           index_crossings_.end());
     }
+    span.counts().num_crossings = index_crossings_.size();
     // Add a sentinel value to simplify the loop logic.
     tracker_.AddSpace(&index_crossings_, 1);
     index_crossings_.push_back(IndexCrossing(kSentinel, kSentinel));
     index_crossings_first_region_id_ = 0;
+    if (cache_ != nullptr && tracker_.ok()) {
+      cache_->data_ = make_unique<CrossingCache::Data>();
+      cache_->data_->regions[0] = op_->regions_[0];
+      cache_->data_->regions[1] = op_->regions_[1];
+      cache_->data_->crossings = index_crossings_;
+      cache_->data_->intersections = std::move(intersections);
+    }
   }
   if (region_id != index_crossings_first_region_id_) {
     for (auto& crossing : index_crossings_) {
@@ -2241,6 +2293,39 @@ bool S2BooleanOperation::Impl::GetIndexCrossings(int region_id) {
   return tracker_.ok();
 }
 
+// Initializes index_crossings_ from cache_ if it contains the crossings of
+// the current pair of regions (in either order), and otherwise discards the
+// cache contents so that they will be recomputed.
+//
+// Supports "early exit" in the case of boolean results by returning false
+// as soon as the result is known to be non-empty.
+bool S2BooleanOperation::Impl::GetCachedIndexCrossings() {
+  const CrossingCache::Data& data = *cache_->data_;
+  int first_region_id;
+  if (data.regions[0] == op_->regions_[0] &&
+      data.regions[1] == op_->regions_[1]) {
+    first_region_id = 0;
+  } else if (data.regions[0] == op_->regions_[1] &&
+             data.regions[1] == op_->regions_[0]) {
+    first_region_id = 1;
+  } else {
+    cache_->Clear();
+    return true;
+  }
+  // As in GetIndexCrossings(), an interior crossing means that the result of
+  // every supported operation is non-empty.
+  if (is_boolean_output() && !data.intersections.empty()) return false;
+  if (!tracker_.AddSpace(&index_crossings_, data.crossings.size())) {
+    return false;
+  }
+  index_crossings_ = data.crossings;
+  if (builder_ != nullptr) {
+    for (const S2Point& x : data.intersections) builder_->AddIntersection(x);
+  }
+  index_crossings_first_region_id_ = first_region_id;
+  return true;
+}
+
 // Supports "early exit" in the case of boolean results by returning false
 // as soon as the result is known to be non-empty.
 bool S2BooleanOperation::Impl::AddBoundaryPair(
@@ -2555,11 +2640,109 @@ bool S2BooleanOperation::Impl::AreRegionsIdentical() const {
   return true;
 }
 
+// Returns true if the given index cell is entirely contained by the interior
+// of some polygon in its index (i.e., the cell has no polygon edges).
+static bool IsInteriorCell(const S2ShapeIndexCell& cell) {
+  for (int i = 0; i < cell.num_clipped(); ++i) {
+    const S2ClippedShape& clipped = cell.clipped(i);
+    if (clipped.contains_center() && clipped.num_edges() == 0) return true;
+  }
+  return false;
+}
+
+// Positions "it" at the first cell that is not entirely before "target", or
+// at the end of the index if there is no such cell.
+static void SeekFirstNotPreceding(S2CellId target,
+                                  S2ShapeIndex::Iterator* it) {
+  it->Seek(target.range_min());
+  if (it->Prev() && it->id().range_max() < target.range_min()) it->Next();
+}
+
+// The geometry of each S2ShapeIndex is contained by the union of its index
+// cells.  Furthermore, since edges are added to every cell that they come
+// within a small padding distance of, any point of the index geometry is in
+// the interior of this union.  This means that certain predicates can be
+// decided exactly just by comparing the cells of the two indexes, without
+// computing any edge crossings.  (Note that boolean predicates do not use the
+// snap function.)
+//
+// Returns true if the result was decided, in which case "result_empty" is
+// set to indicate whether the result is empty.
+bool S2BooleanOperation::Impl::DecideFromIndexCells(bool* result_empty) const {
+  switch (op_->op_type_) {
+    case OpType::INTERSECTION:
+      return DecideIntersectionFromIndexCells(result_empty);
+    case OpType::DIFFERENCE:
+      return DecideDifferenceFromIndexCells(result_empty);
+    default:
+      return false;
+  }
+}
+
+bool S2BooleanOperation::Impl::DecideIntersectionFromIndexCells(
+    bool* result_empty) const {
+  // The intersection is empty if no cell of A intersects a cell of B, and is
+  // non-empty if some cell of A that is inside a polygon of A intersects a
+  // cell of B that is inside a polygon of B (since both cells have positive
+  // area).
+  S2ShapeIndex::Iterator a(op_->regions_[0], S2ShapeIndex::BEGIN);
+  S2ShapeIndex::Iterator b(op_->regions_[1], S2ShapeIndex::BEGIN);
+  bool cells_intersect = false;
+  while (!a.done() && !b.done()) {
+    if (a.id().range_max() < b.id().range_min()) {
+      SeekFirstNotPreceding(b.id(), &a);
+    } else if (b.id().range_max() < a.id().range_min()) {
+      SeekFirstNotPreceding(a.id(), &b);
+    } else {
+      // One cell contains the other.
+      cells_intersect = true;
+      if (IsInteriorCell(a.cell()) && IsInteriorCell(b.cell())) {
+        *result_empty = false;
+        return true;
+      }
+      if (a.id().range_max() < b.id().range_max()) {
+        a.Next();
+      } else {
+        b.Next();
+      }
+    }
+  }
+  if (cells_intersect) return false;
+  *result_empty = true;
+  return true;
+}
+
+bool S2BooleanOperation::Impl::DecideDifferenceFromIndexCells(
+    bool* result_empty) const {
+  // The difference (A - B) is non-empty if some cell of A that is inside a
+  // polygon of A does not intersect any cell of B, and is empty if every
+  // cell of A is contained by a cell that is inside a polygon of B.
+  S2ShapeIndex::Iterator a(op_->regions_[0], S2ShapeIndex::BEGIN);
+  S2ShapeIndex::Iterator b(op_->regions_[1], S2ShapeIndex::UNPOSITIONED);
+  bool a_inside_b = true;
+  for (; !a.done(); a.Next()) {
+    SeekFirstNotPreceding(a.id(), &b);
+    if (b.done() || b.id().range_min() > a.id().range_max()) {
+      if (IsInteriorCell(a.cell())) {
+        *result_empty = false;
+        return true;
+      }
+      a_inside_b = false;
+    } else if (!b.id().contains(a.id()) || !IsInteriorCell(b.cell())) {
+      a_inside_b = false;
+    }
+  }
+  if (!a_inside_b) return false;
+  *result_empty = true;
+  return true;
+}
+
 void S2BooleanOperation::Impl::DoBuild(S2Error* error) {
   if (!tracker_.ok()) return;
   builder_options_ = S2Builder::Options(op_->options_.snap_function());
   builder_options_.set_intersection_tolerance(S2::kIntersectionError);
   builder_options_.set_memory_tracker(tracker_.tracker());
+  builder_options_.set_tracer(op_->options_.tracer());
   if (op_->options_.split_all_crossing_polyline_edges()) {
     builder_options_.set_split_crossing_edges(true);
   }
@@ -2568,10 +2751,17 @@ void S2BooleanOperation::Impl::DoBuild(S2Error* error) {
   builder_options_.set_idempotent(false);
 
   if (is_boolean_output()) {
+    PredicateStats* stats = op_->options_.predicate_stats();
+    if (DecideFromIndexCells(op_->result_empty_)) {
+      if (stats) ++stats->num_decided_by_index_cells;
+      return;
+    }
     // BuildOpType() returns true if and only if the result has no edges.
     S2Builder::Graph g;  // Unused by IsFullPolygonResult() implementation.
+    S2TraceSpan span(op_->options_.tracer(), "S2BooleanOperation::Clip");
     *op_->result_empty_ =
         BuildOpType(op_->op_type_) && !IsFullPolygonResult(g, error);
+    if (stats) ++stats->num_decided_by_edge_crossings;
     return;
   }
   builder_ = make_unique<S2Builder>(builder_options_);
@@ -2584,7 +2774,10 @@ void S2BooleanOperation::Impl::DoBuild(S2Error* error) {
       [this](const S2Builder::Graph& g, S2Error* error) {
         return IsFullPolygonResult(g, error);
       });
-  (void) BuildOpType(op_->op_type_);
+  {
+    S2TraceSpan span(op_->options_.tracer(), "S2BooleanOperation::Clip");
+    (void) BuildOpType(op_->op_type_);
+  }
 
   // Release memory that is no longer needed.
   if (!tracker_.Clear(&index_crossings_)) return;
@@ -2594,6 +2787,7 @@ void S2BooleanOperation::Impl::DoBuild(S2Error* error) {
 bool S2BooleanOperation::Impl::Build(S2Error* error) {
   // This wrapper ensures that memory tracking errors are reported.
   error->Clear();
+  S2TraceSpan span(op_->options_.tracer(), "S2BooleanOperation::Build");
   DoBuild(error);
   if (!tracker_.ok()) *error = tracker_.error();
   return error->ok();
@@ -2618,7 +2812,9 @@ S2BooleanOperation::Options::Options(const Options& options)
       precision_(options.precision_),
       conservative_output_(options.conservative_output_),
       source_id_lexicon_(options.source_id_lexicon_),
-      memory_tracker_(options.memory_tracker_) {
+      memory_tracker_(options.memory_tracker_),
+      predicate_stats_(options.predicate_stats_),
+      tracer_(options.tracer_) {
 }
 
 S2BooleanOperation::Options& S2BooleanOperation::Options::operator=(
@@ -2633,6 +2829,8 @@ S2BooleanOperation::Options& S2BooleanOperation::Options::operator=(
   conservative_output_ = options.conservative_output_;
   source_id_lexicon_ = options.source_id_lexicon_;
   memory_tracker_ = options.memory_tracker_;
+  predicate_stats_ = options.predicate_stats_;
+  tracer_ = options.tracer_;
   return *this;
 }
 
@@ -2700,6 +2898,23 @@ void S2BooleanOperation::Options::set_memory_tracker(S2MemoryTracker* tracker) {
   memory_tracker_ = tracker;
 }
 
+S2BooleanOperation::PredicateStats*
+S2BooleanOperation::Options::predicate_stats() const {
+  return predicate_stats_;
+}
+
+void S2BooleanOperation::Options::set_predicate_stats(PredicateStats* stats) {
+  predicate_stats_ = stats;
+}
+
+S2Tracer* S2BooleanOperation::Options::tracer() const {
+  return tracer_;
+}
+
+void S2BooleanOperation::Options::set_tracer(S2Tracer* tracer) {
+  tracer_ = tracer;
+}
+
 const char* S2BooleanOperation::OpTypeToString(OpType op_type) {
   switch (op_type) {
     case OpType::UNION:                return "UNION";
@@ -2759,6 +2974,14 @@ bool S2BooleanOperation::Build(const S2ShapeIndex& a,
   return Impl(this).Build(error);
 }
 
+bool S2BooleanOperation::Build(const S2ShapeIndex& a,
+                               const S2ShapeIndex& b,
+                               CrossingCache* cache, S2Error* error) {
+  regions_[0] = &a;
+  regions_[1] = &b;
+  return Impl(this, cache).Build(error);
+}
+
 bool S2BooleanOperation::IsEmpty(
     OpType op_type, const S2ShapeIndex& a, const S2ShapeIndex& b,
     const Options& options) {
@@ -218,6 +218,19 @@
 //       absl::make_unique<s2builderutil::PointVectorLayer>(&points),
 //       absl::make_unique<s2builderutil::S2PolylineVectorLayer>(&polylines),
 //       absl::make_unique<S2PolygonLayer>(&polygon));
+//
+// If the output will be added to a MutableS2ShapeIndex (e.g., as the input to
+// further operations), it is more efficient to use the "Indexed" layer
+// types, which add S2LaxPolylineShape and S2LaxPolygonShape objects to the
+// index directly rather than first constructing S2Polyline and S2Polygon
+// objects (which validate and index their own edges):
+//
+//   MutableS2ShapeIndex result;
+//   S2BooleanOperation op(
+//       S2BooleanOperation::OpType::UNION,
+//       absl::make_unique<s2builderutil::IndexedS2PointVectorLayer>(&result),
+//       absl::make_unique<s2builderutil::IndexedLaxPolylineLayer>(&result),
+//       absl::make_unique<s2builderutil::IndexedLaxPolygonLayer>(&result));
 
 class S2BooleanOperation {
  public:
@@ -289,6 +302,22 @@ class S2BooleanOperation {
     int32 edge_id_;
   };
 
+  // Counts how the boolean predicates (IsEmpty, Intersects, Contains, and
+  // Equals) were decided.  See Options::set_predicate_stats().
+  struct PredicateStats {
+    // The number of predicates decided by comparing the cells of the two
+    // S2ShapeIndexes, without computing any edge crossings.  This happens
+    // when no cell of one index intersects a cell of the other, when some
+    // cell is entirely contained by the interiors of both regions, or (for
+    // DIFFERENCE) when every cell of the first region is entirely contained
+    // by the interior of the second region.
+    int64 num_decided_by_index_cells = 0;
+
+    // The number of predicates that required the full boundary crossing
+    // algorithm.
+    int64 num_decided_by_edge_crossings = 0;
+  };
+
   class Options {
    public:
     Options();
@@ -447,6 +476,24 @@ class S2BooleanOperation {
     S2MemoryTracker* memory_tracker() const;
     void set_memory_tracker(S2MemoryTracker* tracker);
 
+    // If non-null, the given PredicateStats object is updated each time a
+    // boolean predicate (see IsEmpty) is evaluated with these options.  The
+    // counters are not synchronized, so each thread should use its own
+    // PredicateStats object.
+    //
+    // DEFAULT: nullptr
+    PredicateStats* predicate_stats() const;
+    void set_predicate_stats(PredicateStats* stats);
+
+    // If non-null, the phases of the operation are reported to this tracer
+    // (see s2tracer.h).  These include finding the crossings between the two
+    // input regions, clipping their boundaries, and the phases of the
+    // S2Builder that assembles the output (see S2Builder::Options::tracer).
+    //
+    // DEFAULT: nullptr
+    S2Tracer* tracer() const;
+    void set_tracer(S2Tracer* tracer);
+
     // Options may be assigned and copied.
     Options(const Options& options);
     Options& operator=(const Options& options);
@@ -461,6 +508,8 @@ class S2BooleanOperation {
     bool conservative_output_ = false;
     ValueLexicon<SourceId>* source_id_lexicon_ = nullptr;
     S2MemoryTracker* memory_tracker_ = nullptr;
+    PredicateStats* predicate_stats_ = nullptr;
+    S2Tracer* tracer_ = nullptr;
   };
 
 #ifndef SWIG
@@ -504,6 +553,52 @@ class S2BooleanOperation {
   bool Build(const S2ShapeIndex& a, const S2ShapeIndex& b,
              S2Error* error);
 
+  // A CrossingCache stores the edge crossings between two S2ShapeIndexes so
+  // that they can be shared by several operations on the same inputs.
+  // Computing these crossings is often the most expensive part of an
+  // operation, so this is useful when several results are needed for the
+  // same pair of regions (e.g., A & B, A - B, and B - A for change
+  // detection).  For example:
+  //
+  //   S2BooleanOperation::CrossingCache cache;
+  //   S2BooleanOperation a_and_b(OpType::INTERSECTION, ...);
+  //   S2BooleanOperation a_minus_b(OpType::DIFFERENCE, ...);
+  //   S2BooleanOperation b_minus_a(OpType::DIFFERENCE, ...);
+  //   if (!a_and_b.Build(a, b, &cache, &error) ||
+  //       !a_minus_b.Build(a, b, &cache, &error) ||
+  //       !b_minus_a.Build(b, a, &cache, &error)) { ... }
+  //
+  // The cache may be used with the two regions in either order, and with
+  // operations that have different options.  The crossings are computed by
+  // the first operation that needs them, and the cache is filled again
+  // automatically if it is used with a different pair of regions.
+  //
+  // The memory used by the cache itself is not tracked by
+  // Options::memory_tracker().  This class is not thread-safe.
+  class CrossingCache {
+   public:
+    CrossingCache();
+    ~CrossingCache();
+
+    // Discards the cached crossings.  This method must be called if either
+    // region is modified while the cache is in use.
+    void Clear();
+
+   private:
+    friend class S2BooleanOperation;
+    struct Data;
+    std::unique_ptr<Data> data_;
+
+    CrossingCache(const CrossingCache&) = delete;
+    void operator=(const CrossingCache&) = delete;
+  };
+
+  // Like Build() above, but uses (and if necessary fills) the given cache of
+  // edge crossings between "a" and "b".  The result is the same as calling
+  // Build(a, b, error).
+  bool Build(const S2ShapeIndex& a, const S2ShapeIndex& b,
+             CrossingCache* cache, S2Error* error);
+
   // Convenience method that returns true if the result of the given operation
   // is empty.
   static bool IsEmpty(OpType op_type,
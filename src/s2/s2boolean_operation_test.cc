@@ -34,6 +34,7 @@
 #include "absl/strings/strip.h"
 
 #include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
 #include "s2/s2builder.h"
 #include "s2/s2builder_graph.h"
 #include "s2/s2builder_layer.h"
@@ -42,14 +43,18 @@
 #include "s2/s2builderutil_s2polyline_vector_layer.h"
 #include "s2/s2builderutil_snap_functions.h"
 #include "s2/s2builderutil_testing.h"
+#include "s2/s2cap.h"
+#include "s2/s2latlng.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
+#include "s2/s2loop.h"
 #include "s2/s2point_vector_shape.h"
 #include "s2/s2polygon.h"
 #include "s2/s2polyline.h"
 #include "s2/s2shapeutil_contains_brute_force.h"
 #include "s2/s2testing.h"
 #include "s2/s2text_format.h"
+#include "s2/s2tracer.h"
 
 S2_DECLARE_int64(s2shape_index_tmp_memory_budget);
 
@@ -1625,6 +1630,97 @@ TEST(S2BooleanOperation, OverlappingDoughnuts) {
       "1:-91, 0:-91, 0:-90, 1:-90");
 }
 
+// Returns the result of the given operation as a string, optionally using
+// the given cache of edge crossings.
+string BuildLaxPolygon(OpType op_type, const S2ShapeIndex& a,
+                       const S2ShapeIndex& b,
+                       S2BooleanOperation::CrossingCache* cache) {
+  S2LaxPolygonShape result;
+  S2BooleanOperation op(op_type, make_unique<LaxPolygonLayer>(&result));
+  S2Error error;
+  bool ok = cache ? op.Build(a, b, cache, &error) : op.Build(a, b, &error);
+  EXPECT_TRUE(ok) << error;
+  return s2textformat::ToString(result);
+}
+
+TEST(S2BooleanOperation, CrossingCache) {
+  // Two overlapping loops with many crossing edges, and a third loop that
+  // crosses the first.
+  auto make_index = [](const char* center, double radius_degrees) {
+    auto index = make_unique<MutableS2ShapeIndex>();
+    index->Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+        s2textformat::MakePointOrDie(center), S1Angle::Degrees(radius_degrees),
+        100)));
+    return index;
+  };
+  auto a = make_index("0:0", 5), b = make_index("1:1", 5);
+  auto c = make_index("-2:1", 4);
+  S2BooleanOperation::CrossingCache cache;
+  for (OpType op_type : {OpType::INTERSECTION, OpType::DIFFERENCE,
+                         OpType::UNION, OpType::SYMMETRIC_DIFFERENCE}) {
+    SCOPED_TRACE(S2BooleanOperation::OpTypeToString(op_type));
+    EXPECT_EQ(BuildLaxPolygon(op_type, *a, *b, nullptr),
+              BuildLaxPolygon(op_type, *a, *b, &cache));
+    // The cache can also be used with the regions in the opposite order.
+    EXPECT_EQ(BuildLaxPolygon(op_type, *b, *a, nullptr),
+              BuildLaxPolygon(op_type, *b, *a, &cache));
+  }
+  // Using the cache with another pair of regions recomputes the crossings.
+  EXPECT_EQ(BuildLaxPolygon(OpType::DIFFERENCE, *a, *c, nullptr),
+            BuildLaxPolygon(OpType::DIFFERENCE, *a, *c, &cache));
+  EXPECT_EQ(BuildLaxPolygon(OpType::DIFFERENCE, *c, *a, nullptr),
+            BuildLaxPolygon(OpType::DIFFERENCE, *c, *a, &cache));
+}
+
+// A tracer that records the name of each span and the crossing count of the
+// most recent "GetIndexCrossings" span.
+class RecordingTracer : public S2Tracer {
+ public:
+  void StartSpan(const char* name) override {
+    events.push_back(absl::StrCat("+", name));
+  }
+  void EndSpan(const char* name, const S2TraceCounts& counts) override {
+    events.push_back(absl::StrCat("-", name));
+    if (string(name) == "S2BooleanOperation::GetIndexCrossings") {
+      num_crossings = counts.num_crossings;
+    }
+  }
+  vector<string> events;
+  int64 num_crossings = -1;
+};
+
+TEST(S2BooleanOperation, Tracer) {
+  auto a = s2textformat::MakeIndexOrDie("# # 0:0, 0:2, 2:2, 2:0");
+  auto b = s2textformat::MakeIndexOrDie("# # 1:1, 1:3, 3:3, 3:1");
+  RecordingTracer tracer;
+  S2BooleanOperation::Options options;
+  options.set_tracer(&tracer);
+  S2LaxPolygonShape result;
+  S2BooleanOperation op(OpType::INTERSECTION,
+                        make_unique<LaxPolygonLayer>(&result), options);
+  S2Error error;
+  ASSERT_TRUE(op.Build(*a, *b, &error)) << error;
+  EXPECT_EQ(4, result.num_vertices());
+  ASSERT_GE(tracer.events.size(), 8);
+  EXPECT_EQ(vector<string>({"+S2BooleanOperation::Build",
+                            "+S2BooleanOperation::Clip",
+                            "+S2BooleanOperation::GetIndexCrossings",
+                            "-S2BooleanOperation::GetIndexCrossings",
+                            "-S2BooleanOperation::Clip",
+                            "+S2Builder::Build"}),
+            vector<string>(tracer.events.begin(), tracer.events.begin() + 6));
+  EXPECT_EQ("-S2Builder::Build", tracer.events.end()[-2]);
+  EXPECT_EQ("-S2BooleanOperation::Build", tracer.events.back());
+  EXPECT_EQ(2, tracer.num_crossings);
+
+  // Boolean predicates are traced as well.
+  tracer.events.clear();
+  EXPECT_TRUE(S2BooleanOperation::Intersects(*a, *b, options));
+  ASSERT_FALSE(tracer.events.empty());
+  EXPECT_EQ("+S2BooleanOperation::Build", tracer.events.front());
+  EXPECT_EQ("-S2BooleanOperation::Build", tracer.events.back());
+}
+
 TEST(S2BooleanOperation, PolylineEnteringRectangle) {
   // A polyline that enters a rectangle very close to one of its vertices.
   S2BooleanOperation::Options options = RoundToE(1);
@@ -2276,4 +2372,84 @@ TEST(S2BooleanOperation, IntersectsEmptyAndFull) {
   EXPECT_TRUE(S2BooleanOperation::Intersects(*full, *full));
 }
 
+// Tests that the boolean predicates are decided without computing edge
+// crossings when the index cells are disjoint or nested.
+TEST(S2BooleanOperation, PredicatesDecidedByIndexCells) {
+  S2BooleanOperation::PredicateStats stats;
+  S2BooleanOperation::Options options;
+  options.set_predicate_stats(&stats);
+  // Use loops with enough vertices that their interiors have index cells
+  // without any edges.
+  auto big_loop = S2Loop::MakeRegularLoop(
+      S2LatLng::FromDegrees(5, 5).ToPoint(), S1Angle::Degrees(4), 1000);
+  auto far_loop = S2Loop::MakeRegularLoop(
+      S2LatLng::FromDegrees(50, 50).ToPoint(), S1Angle::Degrees(4), 1000);
+  MutableS2ShapeIndex big, far;
+  big.Add(make_unique<S2Loop::Shape>(big_loop.get()));
+  far.Add(make_unique<S2Loop::Shape>(far_loop.get()));
+
+  // Build a small index of points, polylines, and polygons around the center
+  // of an index cell in the interior of "big".
+  MutableS2ShapeIndex::Iterator it(&big, S2ShapeIndex::BEGIN);
+  while (it.cell().clipped(0).num_edges() > 0) it.Next();
+  S2Point center = it.id().ToPoint();
+  auto small_loop =
+      S2Loop::MakeRegularLoop(center, S1Angle::Degrees(1e-4), 4);
+  MutableS2ShapeIndex small;
+  small.Add(make_unique<S2PointVectorShape>(vector<S2Point>{center}));
+  small.Add(make_unique<S2LaxPolylineShape>(
+      vector<S2Point>{small_loop->vertex(0), small_loop->vertex(2)}));
+  small.Add(make_unique<S2Loop::Shape>(small_loop.get()));
+
+  auto overlap = s2textformat::MakeIndexOrDie("# # 5:5, 5:15, 15:15, 15:5");
+  auto nearby = s2textformat::MakeIndexOrDie("# # 5:9.1, 5:9.2, 5.1:9.1");
+  auto empty = s2textformat::MakeIndexOrDie("# #");
+
+  EXPECT_FALSE(S2BooleanOperation::Intersects(big, far, options));
+  EXPECT_FALSE(S2BooleanOperation::Intersects(far, big, options));
+  EXPECT_FALSE(S2BooleanOperation::Intersects(big, *empty, options));
+  EXPECT_TRUE(S2BooleanOperation::Intersects(big, big, options));
+  EXPECT_TRUE(S2BooleanOperation::Contains(big, small, options));
+  EXPECT_TRUE(S2BooleanOperation::Contains(big, *empty, options));
+  EXPECT_FALSE(S2BooleanOperation::Contains(big, far, options));
+  EXPECT_EQ(7, stats.num_decided_by_index_cells);
+  EXPECT_EQ(0, stats.num_decided_by_edge_crossings);
+
+  // These predicates depend on the exact position of the edges.
+  EXPECT_TRUE(S2BooleanOperation::Intersects(big, small, options));
+  EXPECT_TRUE(S2BooleanOperation::Intersects(big, *overlap, options));
+  EXPECT_FALSE(S2BooleanOperation::Contains(big, *overlap, options));
+  EXPECT_FALSE(S2BooleanOperation::Intersects(big, *nearby, options));
+  EXPECT_TRUE(S2BooleanOperation::Equals(big, big, options));
+  EXPECT_EQ(7, stats.num_decided_by_index_cells);
+  EXPECT_EQ(5, stats.num_decided_by_edge_crossings);
+}
+
+// Checks the boolean predicates against S2Loop, whose implementation is
+// independent of S2BooleanOperation.
+TEST(S2BooleanOperation, PredicatesMatchS2Loop) {
+  S2BooleanOperation::PredicateStats stats;
+  S2BooleanOperation::Options options;
+  options.set_predicate_stats(&stats);
+  auto& rnd = S2Testing::rnd;
+  for (int iter = 0; iter < 200; ++iter) {
+    S2Point center = S2Testing::RandomPoint();
+    S1Angle radius = S1Angle::Degrees(rnd.UniformDouble(0.01, 5));
+    auto a = S2Loop::MakeRegularLoop(center, radius, 1000);
+    S2Point b_center = S2Testing::SamplePoint(S2Cap(center, 3 * radius));
+    auto b = S2Loop::MakeRegularLoop(
+        b_center, radius * rnd.UniformDouble(0.01, 2), 3 + rnd.Uniform(100));
+    MutableS2ShapeIndex a_index, b_index;
+    a_index.Add(make_unique<S2Loop::Shape>(a.get()));
+    b_index.Add(make_unique<S2Loop::Shape>(b.get()));
+    EXPECT_EQ(a->Intersects(*b),
+              S2BooleanOperation::Intersects(a_index, b_index, options));
+    EXPECT_EQ(a->Contains(*b),
+              S2BooleanOperation::Contains(a_index, b_index, options));
+  }
+  // Make sure that both code paths were exercised.
+  EXPECT_GT(stats.num_decided_by_index_cells, 0);
+  EXPECT_GT(stats.num_decided_by_edge_crossings, 0);
+}
+
 }  // namespace
@@ -55,15 +55,19 @@
 #include <vector>
 
 #include "absl/memory/memory.h"
+#include "s2/base/integral_types.h"
 #include "s2/s2builder.h"
 #include "s2/s2builder_layer.h"
+#include "s2/s2builderutil_s2polygon_layer.h"
 #include "s2/s2builderutil_snap_functions.h"
 #include "s2/s2contains_point_query.h"
 #include "s2/s2edge_crosser.h"
 #include "s2/s2edge_crossings.h"
 #include "s2/s2edge_distances.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2lax_loop_shape.h"
+#include "s2/s2polygon.h"
 #include "s2/s2predicates_internal.h"
 #include "s2/s2shape_measures.h"
 #include "s2/s2shapeutil_contains_brute_force.h"
@@ -148,7 +152,9 @@ S2BufferOperation::Options::Options(const Options& options)
       end_cap_style_(options.end_cap_style_),
       polyline_side_(options.polyline_side_),
       snap_function_(options.snap_function_->Clone()),
-      memory_tracker_(options.memory_tracker_) {
+      memory_tracker_(options.memory_tracker_),
+      num_threads_(options.num_threads_),
+      executor_(options.executor_) {
 }
 
 S2BufferOperation::Options& S2BufferOperation::Options::operator=(
@@ -159,6 +165,8 @@ S2BufferOperation::Options& S2BufferOperation::Options::operator=(
   polyline_side_ = options.polyline_side_;
   snap_function_ = options.snap_function_->Clone();
   memory_tracker_ = options.memory_tracker_;
+  num_threads_ = options.num_threads_;
+  executor_ = options.executor_;
   return *this;
 }
 
@@ -264,6 +272,23 @@ void S2BufferOperation::Options::set_memory_tracker(S2MemoryTracker* tracker) {
   memory_tracker_ = tracker;
 }
 
+int S2BufferOperation::Options::num_threads() const {
+  return num_threads_;
+}
+
+void S2BufferOperation::Options::set_num_threads(int num_threads) {
+  S2_DCHECK_GE(num_threads, 1);
+  num_threads_ = num_threads;
+}
+
+S2Executor* S2BufferOperation::Options::executor() const {
+  return executor_;
+}
+
+void S2BufferOperation::Options::set_executor(S2Executor* executor) {
+  executor_ = executor;
+}
+
 S2BufferOperation::S2BufferOperation() {
 }
 
@@ -277,6 +302,9 @@ void S2BufferOperation::Init(std::unique_ptr<S2Builder::Layer> result_layer,
   options_ = options;
   ref_point_ = S2::Origin();
   ref_winding_ = 0;
+  input_ref_winding_ = 0;
+  buffered_inputs_.clear();
+  current_input_ = BufferedInput();
   have_input_start_ = false;
   have_offset_start_ = false;
   buffer_sign_ = sgn(options_.buffer_radius().radians());
@@ -325,8 +353,15 @@ void S2BufferOperation::Init(std::unique_ptr<S2Builder::Layer> result_layer,
   winding_options.set_include_degeneracies(
       buffer_sign_ == 0 && options_.buffer_radius() >= S1Angle::Zero());
   winding_options.set_memory_tracker(options.memory_tracker());
+  winding_options.set_num_threads(options.num_threads());
+  winding_options.set_executor(options.executor());
   op_.Init(std::move(result_layer), winding_options);
   tracker_.Init(options.memory_tracker());
+
+  // Only positive buffer radii are computed in parallel, since this relies
+  // on the fact that the result is the union of the buffered inputs.
+  parallel_ = S2NumThreads(options_.executor(), options_.num_threads()) > 1 &&
+              buffer_sign_ > 0;
 }
 
 const S2BufferOperation::Options& S2BufferOperation::options() const {
@@ -392,7 +427,14 @@ void S2BufferOperation::CloseBufferRegion() {
 // Outputs the current buffered path (which is assumed to be a loop), and
 // resets the state to prepare for buffering a new loop.
 void S2BufferOperation::OutputPath() {
-  op_.AddLoop(path_);
+  if (parallel_) {
+    if (current_input_.loops.empty() && !path_.empty()) {
+      current_input_.id = S2CellId(path_[0]);
+    }
+    current_input_.loops.push_back(path_);
+  } else {
+    op_.AddLoop(path_);
+  }
   path_.clear();  // Does not change capacity.
   have_input_start_ = false;
   have_offset_start_ = false;
@@ -432,7 +474,26 @@ void S2BufferOperation::AddFullPolygon() {
   ref_winding_ += 1;
 }
 
+// Indicates that the loops output since the previous call (and the
+// corresponding change in ref_winding_) represent an input that can be
+// buffered independently of all other inputs.  This is used only when the
+// buffer is computed in parallel.
+void S2BufferOperation::EndInput() {
+  if (!parallel_) return;
+  current_input_.ref_winding = ref_winding_ - input_ref_winding_;
+  input_ref_winding_ = ref_winding_;
+  if (!current_input_.loops.empty() || current_input_.ref_winding != 0) {
+    buffered_inputs_.push_back(std::move(current_input_));
+  }
+  current_input_ = BufferedInput();
+}
+
 void S2BufferOperation::AddPoint(const S2Point& point) {
+  BufferPoint(point);
+  EndInput();
+}
+
+void S2BufferOperation::BufferPoint(const S2Point& point) {
   // If buffer_radius < 0, points are discarded.
   if (buffer_sign_ < 0) return;
 
@@ -618,7 +679,7 @@ void S2BufferOperation::BufferLoop(S2PointLoopSpan loop) {
   if (loop.empty() || !tracker_.ok()) return;
 
   // Loops with one degenerate edge are treated as points.
-  if (loop.size() == 1) return AddPoint(loop[0]);
+  if (loop.size() == 1) return BufferPoint(loop[0]);
 
   // Buffering by 180 degrees or more always yields the full polygon.
   // Buffering by -180 degrees or more always yields the empty polygon.
@@ -642,6 +703,11 @@ void S2BufferOperation::BufferLoop(S2PointLoopSpan loop) {
 }
 
 void S2BufferOperation::AddPolyline(S2PointSpan polyline) {
+  BufferPolyline(polyline);
+  EndInput();
+}
+
+void S2BufferOperation::BufferPolyline(S2PointSpan polyline) {
   // Left-sided buffering is supported by reversing the polyline and then
   // buffering on the right.
   vector<S2Point> reversed;
@@ -661,7 +727,7 @@ void S2BufferOperation::AddPolyline(S2PointSpan polyline) {
 
   // Polylines with one degenerate edge are treated as points.
   if (n == 2 && polyline[0] == polyline[1]) {
-    return AddPoint(polyline[0]);
+    return BufferPoint(polyline[0]);
   }
 
   // Buffering by 180 degrees or more always yields the full polygon.
@@ -711,6 +777,7 @@ void S2BufferOperation::AddLoop(S2PointLoopSpan loop) {
   ref_winding_ += s2shapeutil::ContainsBruteForce(S2LaxLoopShape(loop),
                                                   ref_point_);
   num_polygon_layers_ += 1;
+  EndInput();
 }
 
 void S2BufferOperation::BufferShape(const S2Shape& shape) {
@@ -720,15 +787,18 @@ void S2BufferOperation::BufferShape(const S2Shape& shape) {
     S2Shape::Chain chain = shape.chain(c);
     if (chain.length == 0) continue;
     if (dimension == 0) {
-      AddPoint(shape.edge(c).v0);
+      BufferPoint(shape.edge(c).v0);
     } else {
-      S2::GetChainVertices(shape, c, &tmp_vertices_);
+      S2PointSpan vertices = shape.GetChainVertices(c, &tmp_vertices_);
       if (dimension == 1) {
-        AddPolyline(S2PointSpan(tmp_vertices_));
+        BufferPolyline(vertices);
       } else {
-        BufferLoop(S2PointLoopSpan(tmp_vertices_));
+        BufferLoop(S2PointLoopSpan(vertices.data(), vertices.size()));
       }
     }
+    // Each point and polyline can be buffered independently, whereas the
+    // loops of a polygon must be buffered together.
+    if (dimension < 2) EndInput();
   }
 }
 
@@ -736,6 +806,7 @@ void S2BufferOperation::AddShape(const S2Shape& shape) {
   BufferShape(shape);
   ref_winding_ += s2shapeutil::ContainsBruteForce(shape, ref_point_);
   num_polygon_layers_ += (shape.dimension() == 2);
+  EndInput();
 }
 
 void S2BufferOperation::AddShapeIndex(const S2ShapeIndex& index) {
@@ -744,8 +815,16 @@ void S2BufferOperation::AddShapeIndex(const S2ShapeIndex& index) {
     if (shape == nullptr) continue;
     max_dimension = max(max_dimension, shape->dimension());
     BufferShape(*shape);
+    if (parallel_) {
+      // Since polygon interiors are disjoint, the index contains ref_point_
+      // if and only if exactly one of its shapes does.
+      ref_winding_ += s2shapeutil::ContainsBruteForce(*shape, ref_point_);
+      EndInput();
+    }
+  }
+  if (!parallel_) {
+    ref_winding_ += MakeS2ContainsPointQuery(&index).Contains(ref_point_);
   }
-  ref_winding_ += MakeS2ContainsPointQuery(&index).Contains(ref_point_);
   num_polygon_layers_ += (max_dimension == 2);
 }
 
@@ -755,6 +834,81 @@ bool S2BufferOperation::Build(S2Error* error) {
                 "Negative buffer radius requires at most one polygon layer");
     return false;
   }
+  if (parallel_) return BuildParallel(error);
   return op_.Build(ref_point_, ref_winding_,
                    S2WindingOperation::WindingRule::POSITIVE, error);
 }
+
+bool S2BufferOperation::BuildParallel(S2Error* error) {
+  if (!tracker_.ok()) {
+    *error = tracker_.error();
+    return false;
+  }
+  // Sort the inputs so that each group covers a compact region, and then
+  // divide them into groups with roughly equal numbers of vertices.
+  std::sort(buffered_inputs_.begin(), buffered_inputs_.end(),
+            [](const BufferedInput& a, const BufferedInput& b) {
+              return a.id < b.id;
+            });
+  int64 num_vertices = 0;
+  for (const BufferedInput& input : buffered_inputs_) {
+    for (const auto& loop : input.loops) num_vertices += loop.size();
+  }
+  const int num_inputs = buffered_inputs_.size();
+  const int num_threads = max(
+      1, min(S2NumThreads(options_.executor(), options_.num_threads()),
+             num_inputs));
+  vector<int> group_start = {0};
+  int64 group_vertices = 0;
+  for (int i = 0; i + 1 < num_inputs && group_start.size() < num_threads;
+       ++i) {
+    for (const auto& loop : buffered_inputs_[i].loops) {
+      group_vertices += loop.size();
+    }
+    if (group_vertices * num_threads >= num_vertices * group_start.size()) {
+      group_start.push_back(i + 1);
+    }
+  }
+  group_start.push_back(num_inputs);
+  const int num_groups = group_start.size() - 1;
+
+  // Compute the union of the buffered inputs in each group.
+  vector<S2Polygon> results(num_groups);
+  vector<S2Error> errors(num_groups);
+  auto build_group = [&](int t) {
+    S2WindingOperation op(
+        make_unique<s2builderutil::S2PolygonLayer>(&results[t]),
+        S2WindingOperation::Options{options_.snap_function()});
+    int ref_winding = 0;
+    for (int i = group_start[t]; i < group_start[t + 1]; ++i) {
+      ref_winding += buffered_inputs_[i].ref_winding;
+      for (const auto& loop : buffered_inputs_[i].loops) op.AddLoop(loop);
+    }
+    op.Build(ref_point_, ref_winding,
+             S2WindingOperation::WindingRule::POSITIVE, &errors[t]);
+  };
+  S2ParallelFor(options_.executor(), num_groups, build_group);
+  buffered_inputs_.clear();
+
+  // Merge the results using a final winding operation.
+  int ref_winding = 0;
+  for (int t = 0; t < num_groups; ++t) {
+    if (!errors[t].ok()) {
+      *error = errors[t];
+      return false;
+    }
+    const S2Polygon& result = results[t];
+    ref_winding += result.Contains(ref_point_);
+    for (int i = 0; i < result.num_loops(); ++i) {
+      const S2Loop& loop = *result.loop(i);
+      if (loop.is_empty_or_full()) continue;
+      tmp_vertices_.clear();
+      for (int j = 0; j < loop.num_vertices(); ++j) {
+        tmp_vertices_.push_back(loop.oriented_vertex(j));
+      }
+      op_.AddLoop(tmp_vertices_);
+    }
+  }
+  return op_.Build(ref_point_, ref_winding,
+                   S2WindingOperation::WindingRule::POSITIVE, error);
+}
@@ -24,6 +24,8 @@
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2builder.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2executor.h"
 #include "s2/s2point_span.h"
 #include "s2/s2winding_operation.h"
 
@@ -199,6 +201,34 @@ class S2BufferOperation {
     S2MemoryTracker* memory_tracker() const;
     void set_memory_tracker(S2MemoryTracker* tracker);
 
+    // Specifies the maximum number of threads that Build() may use.  When
+    // this is greater than one and the buffer radius is positive, the input
+    // layers are divided into spatially coherent groups (each polygon shape,
+    // polyline, or point is assigned to one group) that are buffered and
+    // unioned in parallel, and the results are then merged using a final
+    // S2WindingOperation.  This is much faster for large inputs consisting
+    // of many separate shapes (e.g. a road network).  Note that the result
+    // may differ slightly from the single-threaded result because the
+    // snap_function() is applied twice, and that memory used by the parallel
+    // groups is not tracked by memory_tracker() (which is not thread-safe).
+    // The final S2WindingOperation also uses this many threads (see
+    // S2WindingOperation::Options::num_threads).
+    //
+    // REQUIRES: num_threads >= 1
+    //
+    // DEFAULT: 1
+    int num_threads() const;
+    void set_num_threads(int num_threads);
+
+    // If non-null, the parallel parts of Build() (including the final
+    // S2WindingOperation) are run on this executor rather than on newly
+    // created threads, and num_threads() is replaced by
+    // executor->num_threads().  The executor must outlive the operation.
+    //
+    // DEFAULT: nullptr
+    S2Executor* executor() const;
+    void set_executor(S2Executor* executor);
+
     // Options may be assigned and copied.
     Options(const Options& options);
     Options& operator=(const Options& options);
@@ -211,6 +241,8 @@ class S2BufferOperation {
     PolylineSide polyline_side_ = PolylineSide::BOTH;
     std::unique_ptr<S2Builder::SnapFunction> snap_function_;
     S2MemoryTracker* memory_tracker_ = nullptr;
+    int num_threads_ = 1;
+    S2Executor* executor_ = nullptr;
   };
 
   // Default constructor; requires Init() to be called.
@@ -290,6 +322,8 @@ class S2BufferOperation {
   void OutputPath();
   void UpdateRefWinding(const S2Point& a, const S2Point& b, const S2Point& c);
   void AddFullPolygon();
+  void EndInput();
+  bool BuildParallel(S2Error* error);
   S2Point GetEdgeAxis(const S2Point& a, const S2Point& b) const;
   void AddVertexArc(const S2Point& v, const S2Point& start, const S2Point& end);
   void CloseVertexArc(const S2Point& v, const S2Point& end);
@@ -299,6 +333,8 @@ class S2BufferOperation {
                            const S2Point& c);
   void AddStartCap(const S2Point& a, const S2Point& b);
   void AddEndCap(const S2Point& a, const S2Point& b);
+  void BufferPoint(const S2Point& point);
+  void BufferPolyline(S2PointSpan polyline);
   void BufferLoop(S2PointLoopSpan loop);
   void BufferShape(const S2Shape& shape);
 
@@ -347,6 +383,20 @@ class S2BufferOperation {
   // Used internally as a temporary to avoid excessive memory allocation.
   std::vector<S2Point> tmp_vertices_;
 
+  // When the buffer is computed in parallel (see Options::num_threads), the
+  // buffered loops are not added to op_ directly.  Instead they are grouped
+  // by input (i.e., each polygon shape, polyline, or point), along with the
+  // contribution of that input to the winding number of ref_point_.
+  struct BufferedInput {
+    S2CellId id;  // The leaf cell containing the first vertex (if any).
+    int ref_winding = 0;
+    std::vector<std::vector<S2Point>> loops;
+  };
+  bool parallel_ = false;
+  std::vector<BufferedInput> buffered_inputs_;
+  BufferedInput current_input_;
+  int input_ref_winding_;  // The value of ref_winding_ at the last EndInput.
+
   S2MemoryTracker::Client tracker_;
 };
 
@@ -38,6 +38,7 @@
 #include "s2/s2closest_edge_query.h"
 #include "s2/s2contains_point_query.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2lax_loop_shape.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
@@ -341,7 +342,8 @@ void TestHausdorffDistance(const MutableS2ShapeIndex& input,
 // Buffers the given input with the given buffer_radius and error_fraction and
 // verifies that the output is correct.
 void TestBuffer(const MutableS2ShapeIndex& input, S1Angle buffer_radius,
-                double error_fraction) {
+                double error_fraction, int num_threads = 1,
+                S2Executor* executor = nullptr) {
   // Ideally we would verify the correctness of buffering as follows.  Suppose
   // that B = Buffer(A, r) and let ~X denote the complement of region X.  Then
   // if r > 0, we would verify:
@@ -380,6 +382,8 @@ void TestBuffer(const MutableS2ShapeIndex& input, S1Angle buffer_radius,
   S2BufferOperation::Options options;
   options.set_buffer_radius(buffer_radius);
   options.set_error_fraction(error_fraction);
+  options.set_num_threads(num_threads);
+  options.set_executor(executor);
   MutableS2ShapeIndex output;
   output.Add(DoBuffer(
       [&input](S2BufferOperation* op) { op->AddShapeIndex(input); }, options));
@@ -415,6 +419,43 @@ void TestSignedBuffer(absl::string_view index_str, S1Angle buffer_radius,
   TestBuffer(index_str, -buffer_radius, error_fraction);
 }
 
+TEST(S2BufferOperation, ParallelBuffering) {
+  // Buffer many separate points, polylines, and polygons (one of which
+  // contains the reference point S2::Origin()) using several threads.
+  S2Testing::rnd.Reset(1);
+  MutableS2ShapeIndex input;
+  vector<S2Point> points;
+  for (int i = 0; i < 50; ++i) points.push_back(S2Testing::RandomPoint());
+  input.Add(make_unique<S2PointVectorShape>(std::move(points)));
+  vector<vector<S2Point>> polylines;
+  for (int i = 0; i < 50; ++i) {
+    S2Point start = S2Testing::RandomPoint();
+    polylines.push_back({start, (start + 0.05 * S2Testing::RandomPoint())
+                                    .Normalize()});
+  }
+  for (const auto& polyline : polylines) {
+    input.Add(make_unique<S2LaxPolylineShape>(polyline));
+  }
+  input.Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+      S2::Origin(), S1Angle::Degrees(5), 20)));
+  input.Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+      -S2::Origin(), S1Angle::Degrees(5), 20)));
+  for (int num_threads : {1, 4}) {
+    SCOPED_TRACE(absl::StrFormat("num_threads = %d", num_threads));
+    TestBuffer(input, S1Angle::Degrees(1), 0.01, num_threads);
+  }
+  S2ThreadPool pool(4);
+  TestBuffer(input, S1Angle::Degrees(1), 0.01, 1, &pool);
+
+  // Buffering the full polygon in parallel yields the full polygon.
+  S2BufferOperation::Options options(S1Angle::Degrees(1));
+  options.set_num_threads(4);
+  EXPECT_TRUE(DoBuffer([](S2BufferOperation* op) {
+      op->AddShapeIndex(*s2textformat::MakeIndexOrDie("# # full"));
+      op->AddPoint(S2Point(1, 0, 0));
+    }, options)->is_full());
+}
+
 TEST(S2BufferOperation, PointShell) {
   TestSignedBuffer("# # 0:0", S1Angle::Radians(M_PI_2), 0.01);
 }
@@ -86,6 +86,7 @@
 #include "s2/util/bits/bits.h"
 #include "s2/id_set_lexicon.h"
 #include "s2/mutable_s2shape_index.h"
+#include "s2/r2rect.h"
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2builder_graph.h"
@@ -93,10 +94,14 @@
 #include "s2/s2builderutil_snap_functions.h"
 #include "s2/s2closest_edge_query.h"
 #include "s2/s2closest_point_query.h"
+#include "s2/s2coords.h"
+#include "s2/s2edge_clipping.h"
 #include "s2/s2edge_crossings.h"
 #include "s2/s2edge_distances.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2loop.h"
+#include "s2/s2metrics.h"
 #include "s2/s2point_index.h"
 #include "s2/s2pointutil.h"
 #include "s2/s2polygon.h"
@@ -111,6 +116,7 @@ using gtl::compact_array;
 using gtl::dense_hash_set;
 using absl::make_unique;
 using std::max;
+using std::min;
 using std::pair;
 using std::unique_ptr;
 using std::vector;
@@ -130,19 +136,29 @@ S2Builder::Options::Options(const SnapFunction& snap_function)
 S2Builder::Options::Options(const Options& options)
     : snap_function_(options.snap_function_->Clone()),
       split_crossing_edges_(options.split_crossing_edges_),
+      crossing_algorithm_(options.crossing_algorithm_),
       intersection_tolerance_(options.intersection_tolerance_),
       simplify_edge_chains_(options.simplify_edge_chains_),
       idempotent_(options.idempotent_),
-      memory_tracker_(options.memory_tracker_) {
+      memory_tracker_(options.memory_tracker_),
+      num_threads_(options.num_threads_),
+      executor_(options.executor_),
+      compact_vertices_(options.compact_vertices_),
+      tracer_(options.tracer_) {
 }
 
 S2Builder::Options& S2Builder::Options::operator=(const Options& options) {
   snap_function_ = options.snap_function_->Clone();
   split_crossing_edges_ = options.split_crossing_edges_;
+  crossing_algorithm_ = options.crossing_algorithm_;
   intersection_tolerance_ = options.intersection_tolerance_;
   simplify_edge_chains_ = options.simplify_edge_chains_;
   idempotent_ = options.idempotent_;
   memory_tracker_ = options.memory_tracker_;
+  num_threads_ = options.num_threads_;
+  executor_ = options.executor_;
+  compact_vertices_ = options.compact_vertices_;
+  tracer_ = options.tracer_;
   return *this;
 }
 
@@ -183,6 +199,10 @@ bool operator==(const S2Builder::GraphOptions& x,
 
 // Helper functions for computing error bounds:
 
+// The minimum number of edges processed by each thread when multiple threads
+// are used (see Options::num_threads).
+static constexpr int kMinEdgesPerThread = 1000;
+
 static S1ChordAngle RoundUp(S1Angle a) {
   S1ChordAngle ca(a);
   return ca.PlusError(ca.GetS1AngleConstructorMaxError());
@@ -400,38 +420,99 @@ void S2Builder::AddEdge(const S2Point& v0, const S2Point& v1) {
   InputVertexId j1 = AddVertex(v1);
   if (!tracker_.AddSpace(&input_edges_, 1)) return;
   input_edges_.push_back(InputEdge(j0, j1));
+  AttachLabelSet(1);
+}
 
-  // If there are any labels, then attach them to this input edge.
+// Attaches the current label set to the last "num_edges" input edges.
+void S2Builder::AttachLabelSet(int num_edges) {
+  if (num_edges == 0) return;
   if (label_set_modified_) {
     if (label_set_ids_.empty()) {
       // Populate the missing entries with empty label sets.
-      label_set_ids_.assign(input_edges_.size() - 1, label_set_id_);
+      label_set_ids_.assign(input_edges_.size() - num_edges, label_set_id_);
     }
     label_set_id_ = label_set_lexicon_.Add(label_set_);
-    label_set_ids_.push_back(label_set_id_);
+    label_set_ids_.resize(input_edges_.size(), label_set_id_);
     label_set_modified_ = false;
   } else if (!label_set_ids_.empty()) {
-    label_set_ids_.push_back(label_set_id_);
+    label_set_ids_.resize(input_edges_.size(), label_set_id_);
   }
 }
 
-void S2Builder::AddPolyline(S2PointSpan polyline) {
-  for (int i = 1; i < polyline.size(); ++i) {
-    AddEdge(polyline[i - 1], polyline[i]);
+void S2Builder::AddEdges(absl::Span<const S2Shape::Edge> edges) {
+  S2_DCHECK(!layers_.empty()) << "Call StartLayer before adding any edges";
+  const bool discard_degenerate = (layer_options_.back().degenerate_edges() ==
+                                   GraphOptions::DegenerateEdges::DISCARD);
+  if (!tracker_.AddSpace(&input_vertices_, 2 * edges.size()) ||
+      !tracker_.AddSpace(&input_edges_, edges.size())) {
+    return;
+  }
+  const size_t old_num_edges = input_edges_.size();
+  for (const S2Shape::Edge& edge : edges) {
+    if (discard_degenerate && edge.v0 == edge.v1) continue;
+    // As in AddVertex(), consecutive duplicate vertices are stored once.
+    for (const S2Point& v : {edge.v0, edge.v1}) {
+      if (input_vertices_.empty() || v != input_vertices_.back()) {
+        input_vertices_.push_back(v);
+      }
+    }
+    InputVertexId j1 = input_vertices_.size() - 1;
+    InputVertexId j0 = edge.v0 == edge.v1 ? j1 : j1 - 1;
+    input_edges_.push_back(InputEdge(j0, j1));
   }
+  AttachLabelSet(input_edges_.size() - old_num_edges);
 }
 
-void S2Builder::AddPolyline(const S2Polyline& polyline) {
-  const int n = polyline.num_vertices();
-  for (int i = 1; i < n; ++i) {
-    AddEdge(polyline.vertex(i - 1), polyline.vertex(i));
+// Adds the edges of a chain with the given vertices, where the last vertex
+// is connected to the first one if "closed" is true (as in AddLoop).
+void S2Builder::AddChain(S2PointSpan vertices, bool closed) {
+  S2_DCHECK(!layers_.empty()) << "Call StartLayer before adding any edges";
+  const int n = vertices.size();
+  const int num_edges = closed ? n : n - 1;
+  if (num_edges <= 0) return;
+  const bool discard_degenerate = (layer_options_.back().degenerate_edges() ==
+                                   GraphOptions::DegenerateEdges::DISCARD);
+  if (!tracker_.AddSpace(&input_vertices_, n) ||
+      !tracker_.AddSpace(&input_edges_, num_edges)) {
+    return;
+  }
+  const size_t old_num_vertices = input_vertices_.size();
+  const size_t old_num_edges = input_edges_.size();
+  InputVertexId first = -1, prev = -1;
+  for (int i = 0; i < n; ++i) {
+    if (input_vertices_.empty() || vertices[i] != input_vertices_.back()) {
+      input_vertices_.push_back(vertices[i]);
+    }
+    InputVertexId j = input_vertices_.size() - 1;
+    if (i == 0) {
+      first = j;
+    } else if (!discard_degenerate || vertices[i] != vertices[i - 1]) {
+      input_edges_.push_back(InputEdge(prev, j));
+    }
+    prev = j;
   }
+  if (closed && (!discard_degenerate || vertices[n - 1] != vertices[0])) {
+    input_edges_.push_back(InputEdge(prev, first));
+  }
+  if (input_edges_.size() == old_num_edges) {
+    // All the edges were degenerate and discarded, so (as in AddEdge) their
+    // vertices should not be added either.
+    input_vertices_.resize(old_num_vertices);
+    return;
+  }
+  AttachLabelSet(input_edges_.size() - old_num_edges);
+}
+
+void S2Builder::AddPolyline(S2PointSpan polyline) {
+  AddChain(polyline, false);
+}
+
+void S2Builder::AddPolyline(const S2Polyline& polyline) {
+  AddChain(polyline.vertices_span(), false);
 }
 
 void S2Builder::AddLoop(S2PointLoopSpan loop) {
-  for (int i = 0; i < loop.size(); ++i) {
-    AddEdge(loop[i], loop[i + 1]);
-  }
+  AddChain(loop, true);
 }
 
 void S2Builder::AddLoop(const S2Loop& loop) {
@@ -446,6 +527,10 @@ void S2Builder::AddLoop(const S2Loop& loop) {
   // need to build a clockwise loop with vertex order (n-1, n-2, ..., 0).
   // This is done by adding the edge (n-1, n-2) first, and then ensuring that
   // Build() assembles loops starting from edges in the order they were added.
+  if (!loop.is_hole()) {
+    AddChain(loop.vertices_span(), true);
+    return;
+  }
   const int n = loop.num_vertices();
   for (int i = 0; i < n; ++i) {
     AddEdge(loop.oriented_vertex(i), loop.oriented_vertex(i + 1));
@@ -459,9 +544,12 @@ void S2Builder::AddPolygon(const S2Polygon& polygon) {
 }
 
 void S2Builder::AddShape(const S2Shape& shape) {
-  for (int e = 0, n = shape.num_edges(); e < n; ++e) {
-    S2Shape::Edge edge = shape.edge(e);
-    AddEdge(edge.v0, edge.v1);
+  // Points and polygon loops are closed chains (a point being a chain with
+  // one vertex and one degenerate edge), while polylines are open chains.
+  const bool closed = shape.dimension() != 1;
+  std::vector<S2Point> tmp;
+  for (int i = 0, n = shape.num_chains(); i < n; ++i) {
+    AddChain(shape.GetChainVertices(i, &tmp), closed);
   }
 }
 
@@ -528,8 +616,21 @@ bool S2Builder::Build(S2Error* error) {
   if (snapping_requested_ && !options_.idempotent()) {
     snapping_needed_ = true;
   }
-  ChooseSites();
-  BuildLayers();
+  S2Tracer* tracer = options_.tracer();
+  S2TraceSpan build_span(tracer, "S2Builder::Build");
+  {
+    S2TraceSpan span(tracer, "S2Builder::ChooseSites");
+    ChooseSites();
+    span.counts().num_sites = sites_.size();
+    span.counts().num_edges = input_edges_.size();
+  }
+  // The counts are recorded here because BuildLayers() may release the sites.
+  build_span.counts().num_sites = sites_.size();
+  build_span.counts().num_edges = input_edges_.size();
+  {
+    S2TraceSpan span(tracer, "S2Builder::BuildLayers");
+    BuildLayers();
+  }
   Reset();
   if (!tracker_.ok()) *error_ = tracker_.error();
   return error_->ok();
@@ -562,20 +663,35 @@ void S2Builder::ChooseSites() {
   input_edge_index.set_memory_tracker(tracker_.tracker());
   input_edge_index.Add(make_unique<VertexIdEdgeVectorShape>(input_edges_,
                                                             input_vertices_));
+  S2Tracer* tracer = options_.tracer();
   if (options_.split_crossing_edges()) {
+    S2TraceSpan span(tracer, "S2Builder::AddEdgeCrossings");
+    const int64 num_vertices = input_vertices_.size();
     AddEdgeCrossings(input_edge_index);
+    span.counts().num_crossings = input_vertices_.size() - num_vertices;
+    span.counts().num_edges = input_edges_.size();
   }
 
   if (snapping_requested_) {
     S2PointIndex<SiteId> site_index;
     auto _ = absl::MakeCleanup([&]() { tracker_.DoneSiteIndex(site_index); });
-    AddForcedSites(&site_index);
-    ChooseInitialSites(&site_index);
+    {
+      S2TraceSpan span(tracer, "S2Builder::ChooseInitialSites");
+      AddForcedSites(&site_index);
+      ChooseInitialSites(&site_index);
+      span.counts().num_sites = sites_.size();
+    }
     if (!tracker_.FixSiteIndexTally(site_index)) return;
+    S2TraceSpan span(tracer, "S2Builder::CollectSiteEdges");
     CollectSiteEdges(site_index);
+    span.counts().num_sites = sites_.size();
+    span.counts().num_edges = input_edges_.size();
   }
   if (snapping_needed_) {
+    S2TraceSpan span(tracer, "S2Builder::AddExtraSites");
     AddExtraSites(input_edge_index);
+    span.counts().num_sites = sites_.size();
+    span.counts().num_edges = input_edges_.size();
   } else {
     ChooseAllVerticesAsSites();
   }
@@ -680,23 +796,27 @@ vector<S2Builder::InputVertexKey> S2Builder::SortInputVertices() {
 // points to input_vertices_.  (The intersection points will be snapped and
 // merged with the other vertices during site selection.)
 void S2Builder::AddEdgeCrossings(const MutableS2ShapeIndex& input_edge_index) {
-  input_edge_index.ForceBuild();
-  if (!tracker_.ok()) return;
-
   // We need to build a list of intersections and add them afterwards so that
   // we don't reallocate vertices_ during the VisitCrossings() call.
   vector<S2Point> new_vertices;
   auto _ = absl::MakeCleanup([&]() { tracker_.Untally(new_vertices); });
-  s2shapeutil::VisitCrossingEdgePairs(
-      input_edge_index, s2shapeutil::CrossingType::INTERIOR,
-      [this, &new_vertices](const s2shapeutil::ShapeEdge& a,
-                            const s2shapeutil::ShapeEdge& b, bool) {
-        if (!tracker_.AddSpace(&new_vertices, 1)) return false;
-        new_vertices.push_back(
-            S2::GetIntersection(a.v0(), a.v1(), b.v0(), b.v1()));
-        return true;
-      });
-  if (new_vertices.empty()) return;
+  if (options_.crossing_algorithm() ==
+      Options::CrossingAlgorithm::CELL_SORT) {
+    FindCrossingsByCellSort(&new_vertices);
+  } else {
+    input_edge_index.ForceBuild();
+    if (!tracker_.ok()) return;
+    s2shapeutil::VisitCrossingEdgePairs(
+        input_edge_index, s2shapeutil::CrossingType::INTERIOR,
+        [this, &new_vertices](const s2shapeutil::ShapeEdge& a,
+                              const s2shapeutil::ShapeEdge& b, bool) {
+          if (!tracker_.AddSpace(&new_vertices, 1)) return false;
+          new_vertices.push_back(
+              S2::GetIntersection(a.v0(), a.v1(), b.v0(), b.v1()));
+          return true;
+        });
+  }
+  if (!tracker_.ok() || new_vertices.empty()) return;
 
   snapping_needed_ = true;
   if (!tracker_.AddSpaceExact(&input_vertices_, new_vertices.size())) return;
@@ -704,6 +824,129 @@ void S2Builder::AddEdgeCrossings(const MutableS2ShapeIndex& input_edge_index) {
                          new_vertices.begin(), new_vertices.end());
 }
 
+// The amount by which the (u,v) bounds of each cell are expanded when
+// deciding which cells an edge passes through.  This covers the error in
+// clipping the edge to a cube face and the error in S2::IntersectsRect(), so
+// that every cell whose closed boundary contains a point of the edge is
+// reported.
+static const double kCellSortPadding =
+    2 * (S2::kFaceClipErrorUVCoord + S2::kIntersectsRectErrorUVDist);
+
+// Appends to "cells" every cell at the given level whose padded (u,v) bound
+// intersects the clipped edge (a_uv, b_uv) on the face of "id".
+static void GetEdgeCellsUV(S2CellId id, const R2Point& a_uv,
+                           const R2Point& b_uv, int level,
+                           vector<S2CellId>* cells) {
+  if (id.level() == level) {
+    cells->push_back(id);
+    return;
+  }
+  const S2CellId end = id.child_end();
+  for (S2CellId child = id.child_begin(); child != end; child = child.next()) {
+    if (S2::IntersectsRect(a_uv, b_uv,
+                           child.GetBoundUV().Expanded(kCellSortPadding))) {
+      GetEdgeCellsUV(child, a_uv, b_uv, level, cells);
+    }
+  }
+}
+
+// Appends to "cells" every cell at the given level that the edge AB passes
+// through, including cells whose boundary the edge comes within rounding
+// error of.  The level should be chosen so that cells are at least as wide as
+// the edge is long, which means that only a handful of cells are returned.
+static void GetEdgeCells(const S2Point& a, const S2Point& b, int level,
+                         vector<S2CellId>* cells) {
+  // Fast path: most edges lie strictly inside a single cell at this level.
+  S2CellId id = S2CellId(a).parent(level);
+  int face = id.face();
+  R2Point a_uv, b_uv;
+  if (S2::GetFace(b) == face && S2::FaceXYZtoUV(face, a, &a_uv) &&
+      S2::FaceXYZtoUV(face, b, &b_uv)) {
+    R2Rect inner = id.GetBoundUV().Expanded(-2 * kCellSortPadding);
+    if (inner.Contains(a_uv) && inner.Contains(b_uv)) {
+      cells->push_back(id);
+      return;
+    }
+  }
+  for (face = 0; face < 6; ++face) {
+    if (S2::ClipToPaddedFace(a, b, face, kCellSortPadding, &a_uv, &b_uv)) {
+      GetEdgeCellsUV(S2CellId::FromFace(face), a_uv, b_uv, level, cells);
+    }
+  }
+}
+
+// Finds all pairs of input edges that cross at an interior point and appends
+// their intersection points to "new_vertices", without building an
+// S2ShapeIndex.  Each edge is assigned to the cells at a level proportional
+// to its length that it passes through (see GetEdgeCells).  If two edges
+// cross at X, then the cell assigned to the shorter edge that contains X is
+// a descendant of (or equal to) the cell assigned to the longer edge that
+// contains X.  So after sorting the (cell, edge) pairs in S2CellId order with
+// ancestors first, a single sweep that keeps a stack of the enclosing cells
+// visits every crossing edge pair at least once.
+void S2Builder::FindCrossingsByCellSort(vector<S2Point>* new_vertices) {
+  using CellEdge = std::pair<S2CellId, InputEdgeId>;
+  vector<CellEdge> cell_edges;
+  auto _ = absl::MakeCleanup([&]() { tracker_.Untally(cell_edges); });
+  vector<S2CellId> cells;
+  for (InputEdgeId e = 0; e < input_edges_.size(); ++e) {
+    const S2Point& a = input_vertices_[input_edges_[e].first];
+    const S2Point& b = input_vertices_[input_edges_[e].second];
+    if (a == b) continue;  // Degenerate edges have no interior crossings.
+    int level = S2::kMinWidth.GetLevelForMinValue(S1Angle(a, b).radians());
+    cells.clear();
+    GetEdgeCells(a, b, level, &cells);
+    if (!tracker_.AddSpace(&cell_edges, cells.size())) return;
+    for (S2CellId id : cells) cell_edges.push_back(CellEdge(id, e));
+  }
+  std::sort(cell_edges.begin(), cell_edges.end(),
+            [](const CellEdge& x, const CellEdge& y) {
+      if (x.first.range_min() != y.first.range_min()) {
+        return x.first.range_min() < y.first.range_min();
+      }
+      if (x.first.level() != y.first.level()) {
+        return x.first.level() < y.first.level();
+      }
+      return x.second < y.second;
+    });
+
+  // An edge pair may be found in several cells, so we collect the pairs and
+  // remove duplicates before computing the intersection points.
+  vector<std::pair<InputEdgeId, InputEdgeId>> crossings;
+  auto _2 = absl::MakeCleanup([&]() { tracker_.Untally(crossings); });
+  vector<CellEdge> stack;
+  for (const CellEdge& cell_edge : cell_edges) {
+    while (!stack.empty() && !stack.back().first.contains(cell_edge.first)) {
+      stack.pop_back();
+    }
+    const InputEdge& e = input_edges_[cell_edge.second];
+    const S2Point& a = input_vertices_[e.first];
+    const S2Point& b = input_vertices_[e.second];
+    for (const CellEdge& enclosing : stack) {
+      if (enclosing.second == cell_edge.second) continue;
+      const InputEdge& f = input_edges_[enclosing.second];
+      if (S2::CrossingSign(a, b, input_vertices_[f.first],
+                           input_vertices_[f.second]) > 0) {
+        if (!tracker_.AddSpace(&crossings, 1)) return;
+        crossings.push_back(
+            std::minmax(enclosing.second, cell_edge.second));
+      }
+    }
+    stack.push_back(cell_edge);
+  }
+  std::sort(crossings.begin(), crossings.end());
+  crossings.erase(std::unique(crossings.begin(), crossings.end()),
+                  crossings.end());
+  if (!tracker_.AddSpace(new_vertices, crossings.size())) return;
+  for (const auto& crossing : crossings) {
+    const InputEdge& e = input_edges_[crossing.first];
+    const InputEdge& f = input_edges_[crossing.second];
+    new_vertices->push_back(S2::GetIntersection(
+        input_vertices_[e.first], input_vertices_[e.second],
+        input_vertices_[f.first], input_vertices_[f.second]));
+  }
+}
+
 void S2Builder::AddForcedSites(S2PointIndex<SiteId>* site_index) {
   // Sort the forced sites and remove duplicates.
   std::sort(sites_.begin(), sites_.end());
@@ -742,6 +985,15 @@ void S2Builder::ChooseInitialSites(S2PointIndex<SiteId>* site_index) {
   if (!tracker_.Tally(input_vertices_.size() * sizeof(InputVertexKey))) return;
   vector<InputVertexKey> sorted_keys = SortInputVertices();
   auto _ = absl::MakeCleanup([&]() { tracker_.Untally(sorted_keys); });
+
+  // If the snap function guarantees that distinct sites are far enough apart
+  // (e.g., S2CellIdSnapFunction at its minimum snap radius), then every
+  // distinct snapped vertex is a site and we don't need to search for nearby
+  // sites.  Vertices that snap to the same site are adjacent in S2CellId
+  // order, so it is sufficient to compare each site with the previous one.
+  const bool sites_are_separated =
+      num_forced_sites_ == 0 &&
+      options_.snap_function().snap_sites_are_separated();
   for (const InputVertexKey& key : sorted_keys) {
     const S2Point& vertex = input_vertices_[key.second];
     S2Point site = SnapSite(vertex);
@@ -749,7 +1001,7 @@ void S2Builder::ChooseInitialSites(S2PointIndex<SiteId>* site_index) {
     snapping_needed_ = snapping_needed_ || site != vertex;
 
     bool add_site = true;
-    if (site_snap_radius_ca_ == S1ChordAngle::Zero()) {
+    if (site_snap_radius_ca_ == S1ChordAngle::Zero() || sites_are_separated) {
       add_site = sites_.empty() || site != sites_.back();
     } else {
       // FindClosestPoints() measures distances conservatively, so we need to
@@ -800,6 +1052,43 @@ S2Point S2Builder::SnapSite(const S2Point& point) const {
 // checks whether the input vertices and edges may already satisfy the output
 // criteria.  If any problems are found then snapping_needed_ is set to true.
 void S2Builder::CollectSiteEdges(const S2PointIndex<SiteId>& site_index) {
+  if (!tracker_.AddSpaceExact(&edge_sites_, input_edges_.size())) return;
+  edge_sites_.resize(input_edges_.size());  // Construct all elements.
+
+  // The sites near each edge are found independently, so the input edges can
+  // be divided among several threads.  Each thread processes a contiguous
+  // range of edges (which typically have good spatial locality) and the
+  // results do not depend on the number of threads.
+  const int num_edges = input_edges_.size();
+  const int num_threads =
+      max(1, min(S2NumThreads(options_.executor(), options_.num_threads()),
+                 num_edges / kMinEdgesPerThread));
+  if (num_threads == 1) {
+    snapping_needed_ = CollectSiteEdges(site_index, 0, num_edges, true);
+    return;
+  }
+  vector<char> snapping_needed(num_threads);
+  auto collect_block = [&](int block) {
+    snapping_needed[block] = CollectSiteEdges(
+        site_index, int64{num_edges} * block / num_threads,
+        int64{num_edges} * (block + 1) / num_threads, false);
+  };
+  S2ParallelFor(options_.executor(), num_threads, collect_block);
+  for (char needed : snapping_needed) {
+    snapping_needed_ = snapping_needed_ || needed;
+  }
+  for (const auto& sites : edge_sites_) {
+    if (!tracker_.TallyEdgeSites(sites)) return;
+  }
+}
+
+// Finds the sites near each edge in the range [begin, end) and stores them
+// in edge_sites_.  Returns true if any problems were found that require
+// snapping.  If "tally" is true, the memory used is also tallied as each edge
+// is processed.
+bool S2Builder::CollectSiteEdges(const S2PointIndex<SiteId>& site_index,
+                                 InputEdgeId begin, InputEdgeId end,
+                                 bool tally) {
   // Find all points whose distance is <= edge_site_query_radius_ca_.
   //
   // Memory used by S2ClosestPointQuery is not tracked, but it is temporary,
@@ -808,9 +1097,8 @@ void S2Builder::CollectSiteEdges(const S2PointIndex<SiteId>& site_index) {
   options.set_conservative_max_distance(edge_site_query_radius_ca_);
   S2ClosestPointQuery<SiteId> site_query(&site_index, options);
   vector<S2ClosestPointQuery<SiteId>::Result> results;
-  if (!tracker_.AddSpaceExact(&edge_sites_, input_edges_.size())) return;
-  edge_sites_.resize(input_edges_.size());  // Construct all elements.
-  for (InputEdgeId e = 0; e < input_edges_.size(); ++e) {
+  bool snapping_needed = snapping_needed_;
+  for (InputEdgeId e = begin; e < end; ++e) {
     const InputEdge& edge = input_edges_[e];
     const S2Point& v0 = input_vertices_[edge.first];
     const S2Point& v1 = input_vertices_[edge.second];
@@ -824,17 +1112,18 @@ void S2Builder::CollectSiteEdges(const S2PointIndex<SiteId>& site_index) {
     sites->reserve(results.size());
     for (const auto& result : results) {
       sites->push_back(result.data());
-      if (!snapping_needed_ &&
+      if (!snapping_needed &&
           result.distance() < min_edge_site_separation_ca_limit_ &&
           result.point() != v0 && result.point() != v1 &&
           s2pred::CompareEdgeDistance(result.point(), v0, v1,
                                       min_edge_site_separation_ca_) < 0) {
-        snapping_needed_ = true;
+        snapping_needed = true;
       }
     }
     SortSitesByDistance(v0, sites);
-    if (!tracker_.TallyEdgeSites(*sites)) return;
+    if (tally && !tracker_.TallyEdgeSites(*sites)) break;
   }
+  return snapping_needed;
 }
 
 // Sorts the sites in increasing order of distance to X.
@@ -1254,18 +1543,33 @@ void S2Builder::BuildLayers() {
   // Each output edge has an "input edge id set id" (an int32) representing
   // the set of input edge ids that were snapped to this edge.  The actual
   // InputEdgeIds can be retrieved using "input_edge_id_set_lexicon".
-  vector<vector<Edge>> layer_edges;
-  vector<vector<InputEdgeIdSetId>> layer_input_edge_ids;
-  IdSetLexicon input_edge_id_set_lexicon;
+  //
+  // The edge vectors are retained from the previous call to Build(), so
+  // their existing capacity needs to be tallied before it is reused.
+  vector<vector<Edge>>& layer_edges = layer_edges_;
+  vector<vector<InputEdgeIdSetId>>& layer_input_edge_ids =
+      layer_input_edge_ids_;
+  IdSetLexicon& input_edge_id_set_lexicon = input_edge_id_set_lexicon_;
+  for (int i = 0; i < min<int>(layers_.size(), layer_edges.size()); ++i) {
+    tracker_.Tally(layer_edges[i]);
+    tracker_.Tally(layer_input_edge_ids[i]);
+  }
   vector<vector<S2Point>> layer_vertices;
+  vector<vector<S2CellId>> layer_vertex_ids;
+  vector<S2CellId> site_vertex_ids;
   BuildLayerEdges(&layer_edges, &layer_input_edge_ids,
                   &input_edge_id_set_lexicon);
   auto _ = absl::MakeCleanup([&]() {
       for (int i = 0; i < layers_.size(); ++i) {
         tracker_.Untally(layer_edges[i]);
         tracker_.Untally(layer_input_edge_ids[i]);
+        layer_edges[i].clear();
+        layer_input_edge_ids[i].clear();
         if (!layer_vertices.empty()) tracker_.Untally(layer_vertices[i]);
+        if (!layer_vertex_ids.empty()) tracker_.Untally(layer_vertex_ids[i]);
       }
+      tracker_.Untally(site_vertex_ids);
+      input_edge_id_set_lexicon.Clear();
     });
 
   // If there are a large number of layers, then we build a minimal subset of
@@ -1301,19 +1605,71 @@ void S2Builder::BuildLayers() {
   }
   if (!tracker_.ok()) return;
 
+  // Optionally convert the vertices of each layer to S2CellIds (see
+  // Options::compact_vertices).  Each vector is converted only if all of its
+  // vertices are cell centers at the snap level, in which case the original
+  // vector is released.
+  const int level = options_.snap_function().snap_cell_level();
+  if (options_.compact_vertices() && level >= 0) {
+    if (layer_vertices.empty()) {
+      if (!CompactVertices(level, &sites_, &site_vertex_ids)) return;
+    } else {
+      layer_vertex_ids.resize(layers_.size());
+      for (int i = 0; i < layers_.size(); ++i) {
+        if (!CompactVertices(level, &layer_vertices[i],
+                             &layer_vertex_ids[i])) {
+          return;
+        }
+      }
+    }
+  }
+
   for (int i = 0; i < layers_.size(); ++i) {
     const vector<S2Point>& vertices = (layer_vertices.empty() ?
                                        sites_ : layer_vertices[i]);
-    Graph graph(layer_options_[i], &vertices, &layer_edges[i],
-                &layer_input_edge_ids[i], &input_edge_id_set_lexicon,
-                &label_set_ids_, &label_set_lexicon_,
-                layer_is_full_polygon_predicates_[i]);
+    const vector<S2CellId>& vertex_ids = (layer_vertex_ids.empty() ?
+                                          site_vertex_ids :
+                                          layer_vertex_ids[i]);
+    Graph graph = vertex_ids.empty() ?
+        Graph(layer_options_[i], &vertices, &layer_edges[i],
+              &layer_input_edge_ids[i], &input_edge_id_set_lexicon,
+              &label_set_ids_, &label_set_lexicon_,
+              layer_is_full_polygon_predicates_[i]) :
+        Graph(layer_options_[i], &vertex_ids, &layer_edges[i],
+              &layer_input_edge_ids[i], &input_edge_id_set_lexicon,
+              &label_set_ids_, &label_set_lexicon_,
+              layer_is_full_polygon_predicates_[i]);
+    graph.set_num_threads(options_.num_threads());
+    graph.set_executor(options_.executor());
+    S2TraceSpan span(options_.tracer(), "S2Builder::BuildLayer");
+    span.counts().num_sites = graph.num_vertices();
+    span.counts().num_edges = graph.num_edges();
     layers_[i]->Build(graph, error_);
     // Don't free the layer data until all layers have been built, in order to
     // support building multiple layers at once (e.g. ClosedSetNormalizer).
   }
 }
 
+// If every point of "vertices" is the center of an S2Cell at the given level,
+// stores the corresponding cell ids in "vertex_ids" and releases "vertices".
+// Otherwise leaves both vectors unchanged.  Returns false if the memory limit
+// was exceeded.
+bool S2Builder::CompactVertices(int level, vector<S2Point>* vertices,
+                                vector<S2CellId>* vertex_ids) {
+  if (vertices->empty()) return true;
+  if (!tracker_.AddSpaceExact(vertex_ids, vertices->size())) return false;
+  for (const S2Point& p : *vertices) {
+    S2CellId id = S2CellId(p).parent(level);
+    if (id.ToPoint() != p) {
+      tracker_.Clear(vertex_ids);
+      return true;
+    }
+    vertex_ids->push_back(id);
+  }
+  tracker_.Clear(vertices);  // Releases memory.
+  return true;
+}
+
 static void DumpEdges(const vector<S2Builder::Graph::Edge>& edges,
                       const vector<S2Point>& vertices) {
   for (const auto& e : edges) {
@@ -1370,7 +1726,8 @@ void S2Builder::BuildLayerEdges(
     // record them and continue.
     Graph::ProcessEdges(&layer_options_[i], &(*layer_edges)[i],
                         &(*layer_input_edge_ids)[i],
-                        input_edge_id_set_lexicon, error_, &tracker_);
+                        input_edge_id_set_lexicon, error_, &tracker_,
+                        options_.num_threads(), options_.executor());
     if (!tracker_.ok()) return;
   }
 }
@@ -1452,33 +1809,66 @@ class S2Builder::EdgeChainSimplifier {
   // from SiteId to the set of InputVertexIds that were snapped to that site.
   // "layer_edges" and "layer_input_edge_ids" are output arguments where the
   // simplified edge chains will be placed.  The input and output edges are
-  // not sorted.
+  // not sorted.  Edge chains are simplified using up to "num_threads"
+  // threads; the output does not depend on the number of threads.
   EdgeChainSimplifier(
       const S2Builder& builder, const Graph& g,
       const vector<int>& edge_layers,
       const vector<compact_array<InputVertexId>>& site_vertices,
       vector<vector<Edge>>* layer_edges,
       vector<vector<InputEdgeIdSetId>>* layer_input_edge_ids,
-      IdSetLexicon* input_edge_id_set_lexicon);
+      IdSetLexicon* input_edge_id_set_lexicon, int num_threads);
 
   void Run();
 
  private:
   using VertexId = Graph::VertexId;
 
+  // The steps performed by Run(), in the order that they are visited by
+  // ForEachStep().  Each step is identified by a graph edge.
+  enum class Step : uint8 {
+    OUTPUT_EDGE,             // Copy the edge to the output.
+    SIMPLIFY_CHAIN,          // Simplify the edge chain starting at the edge.
+    OUTPUT_DEGENERATE_EDGE,  // Copy the edge unless it is already used.
+  };
+
+  // The output edges after simplification, along with the graph edges that
+  // were consumed to produce them.  When several threads are used, each
+  // thread has its own ChainOutput (with its own IdSetLexicon) and the
+  // results are merged in the order that a single thread would have
+  // produced them.
+  struct ChainOutput {
+    explicit ChainOutput(IdSetLexicon* _lexicon);
+
+    vector<Edge> edges;
+    vector<InputEdgeIdSetId> input_edge_ids;  // Ids from "lexicon".
+    vector<int> edge_layers;
+    IdSetLexicon* lexicon;
+    vector<EdgeId> used_edges;
+
+    // Temporary objects declared here to avoid repeated allocation.
+    vector<VertexId> tmp_vertices;
+    dense_hash_set<VertexId> tmp_vertex_set;
+  };
+
   class InteriorVertexMatcher;
-  void OutputEdge(EdgeId e);
+  template <class StepFunction>
+  void ForEachStep(const StepFunction& step_function);
+  void RunParallel();
+  void MarkChainUsed(VertexId v0, VertexId v1);
+  void MarkUsed(ChainOutput* out);
+  void OutputEdge(EdgeId e, ChainOutput* out) const;
   int graph_edge_layer(EdgeId e) const;
   int input_edge_layer(InputEdgeId id) const;
   bool IsInterior(VertexId v);
-  void SimplifyChain(VertexId v0, VertexId v1);
+  void SimplifyChain(VertexId v0, VertexId v1, ChainOutput* out) const;
   Graph::VertexId FollowChain(VertexId v0, VertexId v1) const;
-  void OutputAllEdges(VertexId v0, VertexId v1);
+  void OutputAllEdges(VertexId v0, VertexId v1, ChainOutput* out) const;
   bool TargetInputVertices(VertexId v, S2PolylineSimplifier* simplifier) const;
   bool AvoidSites(VertexId v0, VertexId v1, VertexId v2,
                   dense_hash_set<VertexId>* used_vertices,
                   S2PolylineSimplifier* simplifier) const;
-  void MergeChain(const vector<VertexId>& vertices);
+  void MergeChain(const vector<VertexId>& vertices, ChainOutput* out) const;
   void AssignDegenerateEdges(
       const vector<InputEdgeId>& degenerate_ids,
       vector<vector<InputEdgeId>>* merged_ids) const;
@@ -1493,6 +1883,7 @@ class S2Builder::EdgeChainSimplifier {
   vector<vector<Edge>>* layer_edges_;
   vector<vector<InputEdgeIdSetId>>* layer_input_edge_ids_;
   IdSetLexicon* input_edge_id_set_lexicon_;
+  int num_threads_;
 
   // Convenience member copied from builder_.
   const std::vector<InputEdgeId>& layer_begins_;
@@ -1506,15 +1897,11 @@ class S2Builder::EdgeChainSimplifier {
   // used_[e] indicates that EdgeId "e" has already been processed.
   vector<bool> used_;
 
-  // Temporary objects declared here to avoid repeated allocation.
-  vector<VertexId> tmp_vertices_;
+  // Temporary object declared here to avoid repeated allocation.
   vector<EdgeId> tmp_edges_;
-  dense_hash_set<VertexId> tmp_vertex_set_;
 
   // The output edges after simplification.
-  vector<Edge> new_edges_;
-  vector<InputEdgeIdSetId> new_input_edge_ids_;
-  vector<int> new_edge_layers_;
+  ChainOutput output_;
 };
 
 // Simplifies edge chains, updating its input/output arguments as necessary.
@@ -1524,7 +1911,15 @@ void S2Builder::SimplifyEdgeChains(
     vector<vector<InputEdgeIdSetId>>* layer_input_edge_ids,
     IdSetLexicon* input_edge_id_set_lexicon) {
   if (layers_.empty()) return;
-  if (!tracker_.TallySimplifyEdgeChains(site_vertices, *layer_edges)) return;
+  int num_edges = 0;
+  for (const auto& edges : *layer_edges) num_edges += edges.size();
+  const int num_threads =
+      max(1, min(S2NumThreads(options_.executor(), options_.num_threads()),
+                 num_edges / kMinEdgesPerThread));
+  if (!tracker_.TallySimplifyEdgeChains(site_vertices, *layer_edges,
+                                        num_threads)) {
+    return;
+  }
 
   // Merge the edges from all layers (in order to build a single graph).
   vector<Edge> merged_edges;
@@ -1548,7 +1943,8 @@ void S2Builder::SimplifyEdgeChains(
               IsFullPolygonPredicate());
   EdgeChainSimplifier simplifier(
       *this, graph, merged_edge_layers, site_vertices,
-      layer_edges, layer_input_edge_ids, input_edge_id_set_lexicon);
+      layer_edges, layer_input_edge_ids, input_edge_id_set_lexicon,
+      num_threads);
   simplifier.Run();
 }
 // LINT.ThenChange(:TallySimplifyEdgeChains)
@@ -1597,23 +1993,29 @@ inline bool S2Builder::StableLessThan(
   return ai < bi;  // Stable sort.
 }
 
+S2Builder::EdgeChainSimplifier::ChainOutput::ChainOutput(
+    IdSetLexicon* _lexicon)
+    : lexicon(_lexicon), tmp_vertex_set(16) /*expected_max_elements*/ {
+  tmp_vertex_set.set_empty_key(-1);
+}
+
 S2Builder::EdgeChainSimplifier::EdgeChainSimplifier(
     const S2Builder& builder, const Graph& g, const vector<int>& edge_layers,
     const vector<compact_array<InputVertexId>>& site_vertices,
     vector<vector<Edge>>* layer_edges,
     vector<vector<InputEdgeIdSetId>>* layer_input_edge_ids,
-    IdSetLexicon* input_edge_id_set_lexicon)
+    IdSetLexicon* input_edge_id_set_lexicon, int num_threads)
     : builder_(builder), g_(g), in_(g), out_(g), edge_layers_(edge_layers),
       site_vertices_(site_vertices), layer_edges_(layer_edges),
       layer_input_edge_ids_(layer_input_edge_ids),
       input_edge_id_set_lexicon_(input_edge_id_set_lexicon),
+      num_threads_(num_threads),
       layer_begins_(builder_.layer_begins_),
       is_interior_(g.num_vertices()), used_(g.num_edges()),
-      tmp_vertex_set_(16) /*expected_max_elements*/ {
-  tmp_vertex_set_.set_empty_key(-1);
-  new_edges_.reserve(g.num_edges());
-  new_input_edge_ids_.reserve(g.num_edges());
-  new_edge_layers_.reserve(g.num_edges());
+      output_(input_edge_id_set_lexicon) {
+  output_.edges.reserve(g.num_edges());
+  output_.input_edge_ids.reserve(g.num_edges());
+  output_.edge_layers.reserve(g.num_edges());
 }
 
 void S2Builder::EdgeChainSimplifier::Run() {
@@ -1621,6 +2023,37 @@ void S2Builder::EdgeChainSimplifier::Run() {
   for (VertexId v = 0; v < g_.num_vertices(); ++v) {
     is_interior_[v] = IsInterior(v);
   }
+  if (num_threads_ > 1) {
+    RunParallel();
+  } else {
+    ForEachStep([this](Step step, EdgeId e) {
+      if (step == Step::SIMPLIFY_CHAIN) {
+        SimplifyChain(g_.edge(e).first, g_.edge(e).second, &output_);
+      } else {
+        OutputEdge(e, &output_);
+      }
+      MarkUsed(&output_);
+    });
+  }
+  // TODO(ericv): The graph is not needed past here, so we could save some
+  // memory by clearing the underlying Edge and InputEdgeIdSetId vectors.
+
+  // Finally, copy the output edges into the appropriate layers.  They don't
+  // need to be sorted because the input edges were also unsorted.
+  for (int e = 0; e < output_.edges.size(); ++e) {
+    int layer = output_.edge_layers[e];
+    (*layer_edges_)[layer].push_back(output_.edges[e]);
+    (*layer_input_edge_ids_)[layer].push_back(output_.input_edge_ids[e]);
+  }
+}
+
+// Calls "step_function(step, e)" for each step of the simplification, in
+// order.  "step_function" is responsible for marking the edges that it
+// consumes as used, except that OUTPUT_DEGENERATE_EDGE steps do not need to
+// be marked (since no later step depends on them).
+template <class StepFunction>
+void S2Builder::EdgeChainSimplifier::ForEachStep(
+    const StepFunction& step_function) {
   // Attempt to simplify all edge chains that start from a non-interior
   // vertex.  (This takes care of all chains except loops.)
   for (EdgeId e = 0; e < g_.num_edges(); ++e) {
@@ -1628,9 +2061,10 @@ void S2Builder::EdgeChainSimplifier::Run() {
     Edge edge = g_.edge(e);
     if (is_interior_[edge.first]) continue;
     if (!is_interior_[edge.second]) {
-      OutputEdge(e);  // An edge between two non-interior vertices.
+      // An edge between two non-interior vertices.
+      step_function(Step::OUTPUT_EDGE, e);
     } else {
-      SimplifyChain(edge.first, edge.second);
+      step_function(Step::SIMPLIFY_CHAIN, e);
     }
   }
   // If there are any edges left, they form one or more disjoint loops where
@@ -1652,29 +2086,113 @@ void S2Builder::EdgeChainSimplifier::Run() {
       // Note that it is safe to output degenerate edges as we go along,
       // because this vertex has at least one non-degenerate outgoing edge and
       // therefore we will (or just did) start an edge chain here.
-      OutputEdge(e);
+      step_function(Step::OUTPUT_DEGENERATE_EDGE, e);
     } else {
-      SimplifyChain(edge.first, edge.second);
+      step_function(Step::SIMPLIFY_CHAIN, e);
     }
   }
-  // TODO(ericv): The graph is not needed past here, so we could save some
-  // memory by clearing the underlying Edge and InputEdgeIdSetId vectors.
+}
 
-  // Finally, copy the output edges into the appropriate layers.  They don't
-  // need to be sorted because the input edges were also unsorted.
-  for (int e = 0; e < new_edges_.size(); ++e) {
-    int layer = new_edge_layers_[e];
-    (*layer_edges_)[layer].push_back(new_edges_[e]);
-    (*layer_input_edge_ids_)[layer].push_back(new_input_edge_ids_[e]);
+// Simplifies the edge chains using multiple threads.  First the steps are
+// determined by marking all the non-degenerate edges of each chain as used
+// (which does not depend on how the chain is simplified).  The chains are
+// then simplified independently, and finally the results are merged in step
+// order so that the output is exactly the same as with a single thread.
+void S2Builder::EdgeChainSimplifier::RunParallel() {
+  vector<pair<Step, EdgeId>> steps;
+  vector<EdgeId> chains;
+  ForEachStep([this, &steps, &chains](Step step, EdgeId e) {
+    steps.push_back(std::make_pair(step, e));
+    if (step == Step::OUTPUT_EDGE) {
+      used_[e] = true;
+    } else if (step == Step::SIMPLIFY_CHAIN) {
+      MarkChainUsed(g_.edge(e).first, g_.edge(e).second);
+      chains.push_back(e);
+    }
+  });
+  // Each thread simplifies a contiguous range of chains.  "chain_ends[i]"
+  // records the output size of the thread after simplifying chain "i".
+  const int num_chains = chains.size();
+  const int num_threads = max(1, min(num_threads_, num_chains));
+  vector<IdSetLexicon> lexicons(num_threads);
+  vector<ChainOutput> outputs;
+  for (auto& lexicon : lexicons) outputs.emplace_back(&lexicon);
+  vector<pair<int, int>> chain_ends(num_chains);
+  auto block_begin = [&](int block) {
+    return static_cast<int>(int64{num_chains} * block / num_threads);
+  };
+  auto simplify_block = [&](int block) {
+    ChainOutput* out = &outputs[block];
+    for (int i = block_begin(block); i < block_begin(block + 1); ++i) {
+      SimplifyChain(g_.edge(chains[i]).first, g_.edge(chains[i]).second, out);
+      chain_ends[i] = std::make_pair(out->edges.size(), out->used_edges.size());
+    }
+  };
+  S2ParallelFor(builder_.options_.executor(), num_threads, simplify_block);
+
+  // Now merge the results in step order.  This also marks the edges used by
+  // each chain, which determines whether later degenerate edges are output.
+  int chain = 0, block = 0;
+  pair<int, int> begin(0, 0);
+  for (const auto& step : steps) {
+    if (step.first == Step::OUTPUT_EDGE) {
+      OutputEdge(step.second, &output_);
+    } else if (step.first == Step::OUTPUT_DEGENERATE_EDGE) {
+      if (!used_[step.second]) OutputEdge(step.second, &output_);
+    } else {
+      while (chain == block_begin(block + 1)) {
+        ++block;
+        begin = std::make_pair(0, 0);
+      }
+      const ChainOutput& out = outputs[block];
+      pair<int, int> end = chain_ends[chain++];
+      for (int i = begin.first; i < end.first; ++i) {
+        output_.edges.push_back(out.edges[i]);
+        output_.input_edge_ids.push_back(input_edge_id_set_lexicon_->Add(
+            out.lexicon->id_set(out.input_edge_ids[i])));
+        output_.edge_layers.push_back(out.edge_layers[i]);
+      }
+      for (int i = begin.second; i < end.second; ++i) {
+        used_[out.used_edges[i]] = true;
+      }
+      begin = end;
+    }
+  }
+  output_.used_edges.clear();
+}
+
+// Marks all edges of the edge chain starting with (v0, v1) as used, in both
+// directions.  Degenerate edges are not marked.  This corresponds to the
+// edges consumed by SimplifyChain(v0, v1).
+void S2Builder::EdgeChainSimplifier::MarkChainUsed(VertexId v0, VertexId v1) {
+  VertexId vstart = v0;
+  for (;;) {
+    for (EdgeId e : out_.edge_ids(v0, v1)) used_[e] = true;
+    for (EdgeId e : out_.edge_ids(v1, v0)) used_[e] = true;
+    if (!is_interior_[v1] || v1 == vstart) break;
+    VertexId vprev = v0;
+    v0 = v1;
+    v1 = FollowChain(vprev, v0);
   }
 }
 
-// Copies the given edge to the output and marks it as used.
-inline void S2Builder::EdgeChainSimplifier::OutputEdge(EdgeId e) {
-  new_edges_.push_back(g_.edge(e));
-  new_input_edge_ids_.push_back(g_.input_edge_id_set_id(e));
-  new_edge_layers_.push_back(edge_layers_[e]);
-  used_[e] = true;
+// Marks the edges consumed by "out" so far as used.
+void S2Builder::EdgeChainSimplifier::MarkUsed(ChainOutput* out) {
+  for (EdgeId e : out->used_edges) used_[e] = true;
+  out->used_edges.clear();
+}
+
+// Copies the given edge to the output and records that it was used.
+inline void S2Builder::EdgeChainSimplifier::OutputEdge(
+    EdgeId e, ChainOutput* out) const {
+  out->edges.push_back(g_.edge(e));
+  if (out->lexicon == input_edge_id_set_lexicon_) {
+    out->input_edge_ids.push_back(g_.input_edge_id_set_id(e));
+  } else {
+    out->input_edge_ids.push_back(out->lexicon->Add(g_.input_edge_ids(e)));
+  }
+  out->edge_layers.push_back(edge_layers_[e]);
+  out->used_edges.push_back(e);
 }
 
 // Returns the layer that a given graph edge belongs to.
@@ -1795,13 +2313,14 @@ bool S2Builder::EdgeChainSimplifier::IsInterior(VertexId v) {
 // Follows the edge chain starting with (v0, v1) until either we find a
 // non-interior vertex or we return to the original vertex v0.  At each vertex
 // we simplify a subchain of edges that is as long as possible.
-void S2Builder::EdgeChainSimplifier::SimplifyChain(VertexId v0, VertexId v1) {
+void S2Builder::EdgeChainSimplifier::SimplifyChain(
+    VertexId v0, VertexId v1, ChainOutput* out) const {
   // Avoid allocating "chain" each time by reusing it.
-  vector<VertexId>& chain = tmp_vertices_;
+  vector<VertexId>& chain = out->tmp_vertices;
   // Contains the set of vertices that have either been avoided or added to
   // the chain so far.  This is necessary so that AvoidSites() doesn't try to
   // avoid vertices that have already been added to the chain.
-  dense_hash_set<VertexId>& used_vertices = tmp_vertex_set_;
+  dense_hash_set<VertexId>& used_vertices = out->tmp_vertex_set;
   S2PolylineSimplifier simplifier;
   VertexId vstart = v0;
   bool done = false;
@@ -1829,9 +2348,9 @@ void S2Builder::EdgeChainSimplifier::SimplifyChain(VertexId v0, VertexId v1) {
              simplifier.Extend(g_.vertex(v1)));
 
     if (chain.size() == 2) {
-      OutputAllEdges(chain[0], chain[1]);  // Could not simplify.
+      OutputAllEdges(chain[0], chain[1], out);  // Could not simplify.
     } else {
-      MergeChain(chain);
+      MergeChain(chain, out);
     }
     // Note that any degenerate edges that were not merged into a chain are
     // output by EdgeChainSimplifier::Run().
@@ -1853,9 +2372,10 @@ S2Builder::Graph::VertexId S2Builder::EdgeChainSimplifier::FollowChain(
 }
 
 // Copies all input edges between v0 and v1 (in both directions) to the output.
-void S2Builder::EdgeChainSimplifier::OutputAllEdges(VertexId v0, VertexId v1) {
-  for (EdgeId e : out_.edge_ids(v0, v1)) OutputEdge(e);
-  for (EdgeId e : out_.edge_ids(v1, v0)) OutputEdge(e);
+void S2Builder::EdgeChainSimplifier::OutputAllEdges(
+    VertexId v0, VertexId v1, ChainOutput* out) const {
+  for (EdgeId e : out_.edge_ids(v0, v1)) OutputEdge(e, out);
+  for (EdgeId e : out_.edge_ids(v1, v0)) OutputEdge(e, out);
 }
 
 // Ensures that the simplified edge passes within "edge_snap_radius" of all
@@ -1951,7 +2471,7 @@ bool S2Builder::EdgeChainSimplifier::AvoidSites(
 // there may be more than one copy of an edge chain (in either direction)
 // within a single layer.
 void S2Builder::EdgeChainSimplifier::MergeChain(
-    const vector<VertexId>& vertices) {
+    const vector<VertexId>& vertices, ChainOutput* out) const {
   // Suppose that all interior vertices have M outgoing edges and N incoming
   // edges.  Our goal is to group the edges into M outgoing chains and N
   // incoming chains, and then replace each chain by a single edge.
@@ -1980,7 +2500,7 @@ void S2Builder::EdgeChainSimplifier::MergeChain(
         for (InputEdgeId id : g_.input_edge_ids(e)) {
           degenerate_ids.push_back(id);
         }
-        used_[e] = true;
+        out->used_edges.push_back(e);
       }
     }
     // Because the edges were created in layer order, and all sorts used are
@@ -1991,14 +2511,14 @@ void S2Builder::EdgeChainSimplifier::MergeChain(
       for (InputEdgeId id : g_.input_edge_ids(e)) {
         merged_input_ids[j].push_back(id);
       }
-      used_[e] = true;
+      out->used_edges.push_back(e);
       ++j;
     }
     for (EdgeId e : in_edges) {
       for (InputEdgeId id : g_.input_edge_ids(e)) {
         merged_input_ids[j].push_back(id);
       }
-      used_[e] = true;
+      out->used_edges.push_back(e);
       ++j;
     }
     S2_DCHECK_EQ(merged_input_ids.size(), j);
@@ -2010,15 +2530,15 @@ void S2Builder::EdgeChainSimplifier::MergeChain(
   // Output the merged edges.
   VertexId v0 = vertices[0], v1 = vertices[1], vb = vertices.back();
   for (EdgeId e : out_.edge_ids(v0, v1)) {
-    new_edges_.push_back(Edge(v0, vb));
-    new_edge_layers_.push_back(graph_edge_layer(e));
+    out->edges.push_back(Edge(v0, vb));
+    out->edge_layers.push_back(graph_edge_layer(e));
   }
   for (EdgeId e : out_.edge_ids(v1, v0)) {
-    new_edges_.push_back(Edge(vb, v0));
-    new_edge_layers_.push_back(graph_edge_layer(e));
+    out->edges.push_back(Edge(vb, v0));
+    out->edge_layers.push_back(graph_edge_layer(e));
   }
   for (const auto& ids : merged_input_ids) {
-    new_input_edge_ids_.push_back(input_edge_id_set_lexicon_->Add(ids));
+    out->input_edge_ids.push_back(out->lexicon->Add(ids));
   }
 }
 
@@ -2143,7 +2663,7 @@ bool S2Builder::MemoryTracker::DoneSiteIndex(
 // LINT.IfChange(TallySimplifyEdgeChains)
 bool S2Builder::MemoryTracker::TallySimplifyEdgeChains(
     const vector<compact_array<InputVertexId>>& site_vertices,
-    const vector<vector<Edge>>& layer_edges) {
+    const vector<vector<Edge>>& layer_edges, int num_threads) {
   if (!is_active()) return true;
 
   // The simplify_edge_chains() option uses temporary memory per site
@@ -2164,21 +2684,35 @@ bool S2Builder::MemoryTracker::TallySimplifyEdgeChains(
   //  vector<Edge> merged_edges;                       // SimplifyEdgeChains
   //  vector<InputEdgeIdSetId> merged_input_edge_ids;  // SimplifyEdgeChains
   //  vector<int> merged_edge_layers;                  // SimplifyEdgeChains
-  //  vector<Edge> new_edges_;                         // EdgeChainSimplifier
-  //  vector<InputEdgeIdSetId> new_input_edge_ids_;    // EdgeChainSimplifier
-  //  vector<int> new_edge_layers_;                    // EdgeChainSimplifier
+  //  vector<Edge> output_.edges;                      // EdgeChainSimplifier
+  //  vector<InputEdgeIdSetId> output_.input_edge_ids; // EdgeChainSimplifier
+  //  vector<int> output_.edge_layers;                 // EdgeChainSimplifier
   //
   // Note that the temporary vector<LayerEdgeId> in MergeLayerEdges() does not
   // affect peak usage.
-  const int64 kTempPerEdge =
+  //
+  // If multiple threads are used, the following is also needed (as an upper
+  // bound) per output edge:
+  //  vector<pair<Step, EdgeId>> steps;  // EdgeChainSimplifier::RunParallel
+  //  vector<EdgeId> chains;             // EdgeChainSimplifier::RunParallel
+  //  vector<pair<int, int>> chain_ends; // EdgeChainSimplifier::RunParallel
+  //  ChainOutput::{edges, input_edge_ids, edge_layers, used_edges}
+  //
+  // The space used by the per-thread IdSetLexicons is not tallied.
+  int64 temp_per_edge =
       sizeof(bool) + sizeof(EdgeId) + 2 * sizeof(Edge) +
       2 * sizeof(InputEdgeIdSetId) + 2 * sizeof(int);
+  if (num_threads > 1) {
+    temp_per_edge += 2 * sizeof(EdgeId) + sizeof(pair<int, EdgeId>) +
+                     sizeof(pair<int, int>) + sizeof(Edge) +
+                     sizeof(InputEdgeIdSetId) + sizeof(int);
+  }
   int64 simplify_bytes = site_vertices.size() * kTempPerSite;
   for (const auto& array : site_vertices) {
     simplify_bytes += GetCompactArrayAllocBytes(array);
   }
   for (const auto& edges : layer_edges) {
-    simplify_bytes += edges.size() * kTempPerEdge;
+    simplify_bytes += edges.size() * temp_per_edge;
   }
   return TallyTemp(simplify_bytes);
 }
@@ -38,11 +38,14 @@
 #include "s2/s2cell_id.h"
 #include "s2/s2edge_distances.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2memory_tracker.h"
 #include "s2/s2point_index.h"
 #include "s2/s2point_span.h"
 #include "s2/s2shape_index.h"
+#include "s2/s2tracer.h"
 #include "s2/util/gtl/compact_array.h"
+#include "s2/util/gtl/dense_hash_set.h"
 
 class S2Loop;
 class S2Polygon;
@@ -258,6 +261,19 @@ class S2Builder {
     // distance from "x" is no greater than "snap_radius".
     virtual S2Point SnapPoint(const S2Point& point) const = 0;
 
+    // Returns true if any two distinct snap sites returned by SnapPoint() are
+    // guaranteed to be more than min_vertex_separation() apart, and the
+    // points that snap to a given site are contiguous in S2CellId order.  In
+    // that case S2Builder can select the snapped input vertices as sites
+    // without searching for nearby sites.  The default returns false.
+    virtual bool snap_sites_are_separated() const { return false; }
+
+    // If every snap site returned by SnapPoint() is the center of an S2Cell
+    // at a single fixed level, returns that level.  This allows S2Builder to
+    // store the output vertices as S2CellIds (see Options::compact_vertices).
+    // The default returns -1, meaning that there is no such level.
+    virtual int snap_cell_level() const { return -1; }
+
     // Returns a deep copy of this SnapFunction.
     virtual std::unique_ptr<SnapFunction> Clone() const = 0;
   };
@@ -326,6 +342,28 @@ class S2Builder {
     bool split_crossing_edges() const;
     void set_split_crossing_edges(bool split_crossing_edges);
 
+    // Specifies how crossing edges are found when split_crossing_edges() is
+    // true.  Both algorithms find exactly the same set of crossings.
+    //
+    //  - SHAPE_INDEX builds a MutableS2ShapeIndex of the input edges and
+    //    visits all crossing edge pairs.  The index is then reused when
+    //    adding extra sites, so this is the best choice when the snap radius
+    //    is positive and most edges need to be checked against nearby sites.
+    //
+    //  - CELL_SORT assigns each edge to the few S2Cells at a level
+    //    proportional to its length that it passes through, sorts these
+    //    (cell, edge) pairs, and tests each edge only against the edges
+    //    assigned to the same cell or to one of its ancestors.  This avoids
+    //    building the index entirely unless it is later needed to add extra
+    //    sites, which makes it considerably faster for large inputs with few
+    //    crossings that are otherwise unsnapped (e.g., IdentitySnapFunction
+    //    with a zero snap radius).
+    enum class CrossingAlgorithm { SHAPE_INDEX, CELL_SORT };
+
+    // DEFAULT: CrossingAlgorithm::SHAPE_INDEX
+    CrossingAlgorithm crossing_algorithm() const;
+    void set_crossing_algorithm(CrossingAlgorithm crossing_algorithm);
+
     // Specifes the maximum allowable distance between a vertex added by
     // AddIntersection() and the edge(s) that it is intended to snap to.  This
     // method must be called before AddIntersection() can be used.  It has the
@@ -465,6 +503,58 @@ class S2Builder {
     S2MemoryTracker* memory_tracker() const;
     void set_memory_tracker(S2MemoryTracker* tracker);
 
+    // The maximum number of threads used to snap the input edges.  Currently
+    // this parallelizes finding the Voronoi sites near each input edge,
+    // which is usually the most expensive part of snapping when the snap
+    // radius is large relative to the edge lengths, and simplifying edge
+    // chains (see simplify_edge_chains).  It is also used to sort the output
+    // edges of each layer and is passed to the Graph given to each layer
+    // (see Graph::num_threads).  The output does not depend on the number of
+    // threads.
+    //
+    // Note that when multiple threads are used, memory used by the nearby
+    // sites of each edge is tallied (and checked against the memory limit)
+    // only after all of them have been found.
+    //
+    // DEFAULT: 1
+    int num_threads() const;
+    void set_num_threads(int num_threads);
+
+    // If true, and the snap function snaps to S2Cell centers at a fixed level
+    // (e.g., s2builderutil::S2CellIdSnapFunction), then the vertices of the
+    // Graph passed to each layer are stored as S2CellIds rather than S2Points.
+    // This reduces the memory used by the output vertices from 24 to 8 bytes
+    // each while the layers are being built, at the cost of converting each
+    // vertex back to an S2Point whenever Graph::vertex() is called.  Layers
+    // must not call Graph::vertices() when this option is used (see
+    // Graph::has_vertex_ids).  The option has no effect on a layer if any of
+    // its vertices is not such a cell center (e.g., vertices added using
+    // ForceVertex(), or input vertices that were not moved because
+    // idempotent() is true).
+    //
+    // DEFAULT: false
+    bool compact_vertices() const;
+    void set_compact_vertices(bool compact_vertices);
+
+    // If non-null, the parallel parts of building are run on this executor
+    // rather than on newly created threads, and num_threads() is replaced by
+    // executor->num_threads().  The executor must outlive the S2Builder.
+    //
+    // DEFAULT: nullptr
+    S2Executor* executor() const;
+    void set_executor(S2Executor* executor);
+
+    // If non-null, the phases of Build() are reported to this tracer (see
+    // s2tracer.h).  The spans include choosing the Voronoi sites, finding
+    // edge crossings, snapping the input edges, and building each layer
+    // (which includes any work done by the layer itself, such as
+    // s2builderutil::ClosedSetNormalizer).  The tracer must outlive the
+    // S2Builder.
+    //
+    // DEFAULT: nullptr
+    S2Tracer* tracer() const;
+    void set_tracer(S2Tracer* tracer);
+
     // Options may be assigned and copied.
     Options(const Options& options);
     Options& operator=(const Options& options);
@@ -472,10 +562,15 @@ class S2Builder {
    private:
     std::unique_ptr<SnapFunction> snap_function_;
     bool split_crossing_edges_ = false;
+    CrossingAlgorithm crossing_algorithm_ = CrossingAlgorithm::SHAPE_INDEX;
     S1Angle intersection_tolerance_ = S1Angle::Zero();
     bool simplify_edge_chains_ = false;
     bool idempotent_ = true;
     S2MemoryTracker* memory_tracker_ = nullptr;
+    int num_threads_ = 1;
+    S2Executor* executor_ = nullptr;
+    bool compact_vertices_ = false;
+    S2Tracer* tracer_ = nullptr;
   };
 
   // The following classes are only needed by Layer implementations.
@@ -551,6 +646,16 @@ class S2Builder {
   // Adds the given edge to the current layer.
   void AddEdge(const S2Point& v0, const S2Point& v1);
 
+  // Adds the given edges to the current layer.  This is equivalent to
+  // calling AddEdge() for each edge, except that space is reserved and the
+  // current label set is attached once for the whole batch.
+  //
+  // The methods below that accept contiguous vertex arrays (AddPolyline,
+  // AddLoop, AddShape) are batched in the same way, and in addition they
+  // store each chain vertex only once.  They are therefore the fastest way to
+  // add large numbers of shapes.
+  void AddEdges(absl::Span<const S2Shape::Edge> edges);
+
   // Adds the edges in the given polyline.  Note that polylines with 0 or 1
   // vertices are defined to have no edges.
   void AddPolyline(S2PointSpan polyline);
@@ -571,7 +676,8 @@ class S2Builder {
   // i.e. adding a full polygon has the same effect as adding an empty one.
   void AddPolygon(const S2Polygon& polygon);
 
-  // Adds the edges of the given shape to the current layer.
+  // Adds the edges of the given shape to the current layer.  The vertices of
+  // each chain are read using S2Shape::GetChainVertices().
   void AddShape(const S2Shape& shape);
 
   // If "vertex" is the intersection point of two edges AB and CD (as computed
@@ -709,6 +815,11 @@ class S2Builder {
 
   // Clears all input data and resets the builder state.  Any options
   // specified are preserved.
+  //
+  // The storage used for the input and output edges is retained, so that
+  // reusing an S2Builder for many small operations (e.g., one per feature)
+  // avoids most of the memory allocation that would otherwise be needed.
+  // This storage is released when the S2Builder is destroyed.
   void Reset();
 
   ///////////////////////////////////////////////////////////////////////////
@@ -796,7 +907,7 @@ class S2Builder {
 
     bool TallySimplifyEdgeChains(
         const std::vector<gtl::compact_array<InputVertexId>>& site_vertices,
-        const std::vector<std::vector<Edge>>& layer_edges);
+        const std::vector<std::vector<Edge>>& layer_edges, int num_threads);
 
     bool TallyFilterVertices(int num_sites,
                              const std::vector<std::vector<Edge>>& layer_edges);
@@ -814,15 +925,20 @@ class S2Builder {
   };
 
   InputVertexId AddVertex(const S2Point& v);
+  void AddChain(S2PointSpan vertices, bool closed);
+  void AttachLabelSet(int num_edges);
   void ChooseSites();
   void ChooseAllVerticesAsSites();
   std::vector<InputVertexKey> SortInputVertices();
   void AddEdgeCrossings(const MutableS2ShapeIndex& input_edge_index);
+  void FindCrossingsByCellSort(std::vector<S2Point>* new_vertices);
   void AddForcedSites(S2PointIndex<SiteId>* site_index);
   bool is_forced(SiteId v) const;
   void ChooseInitialSites(S2PointIndex<SiteId>* site_index);
   S2Point SnapSite(const S2Point& point) const;
   void CollectSiteEdges(const S2PointIndex<SiteId>& site_index);
+  bool CollectSiteEdges(const S2PointIndex<SiteId>& site_index,
+                        InputEdgeId begin, InputEdgeId end, bool tally);
   void SortSitesByDistance(const S2Point& x,
                            gtl::compact_array<SiteId>* sites) const;
   void InsertSiteByDistance(SiteId new_site_id, const S2Point& x,
@@ -843,6 +959,8 @@ class S2Builder {
   void SnapEdge(InputEdgeId e, std::vector<SiteId>* chain) const;
 
   void BuildLayers();
+  bool CompactVertices(int level, std::vector<S2Point>* vertices,
+                       std::vector<S2CellId>* vertex_ids);
   void BuildLayerEdges(
       std::vector<std::vector<Edge>>* layer_edges,
       std::vector<std::vector<InputEdgeIdSetId>>* layer_input_edge_ids,
@@ -975,6 +1093,14 @@ class S2Builder {
   // the "sites to avoid" (needed for simplification).
   std::vector<gtl::compact_array<SiteId>> edge_sites_;
 
+  // The snapped edges of each layer and the sets of input edges that they
+  // correspond to.  These are only used in BuildLayers(), but they are kept
+  // here so that their storage can be reused by subsequent calls to Build().
+  // (Their capacity is tallied by the memory tracker only while in use.)
+  std::vector<std::vector<Edge>> layer_edges_;
+  std::vector<std::vector<InputEdgeIdSetId>> layer_input_edge_ids_;
+  IdSetLexicon input_edge_id_set_lexicon_;
+
   // An object to track the memory usage of this class.
   MemoryTracker tracker_;
 
@@ -1198,6 +1324,16 @@ inline void S2Builder::Options::set_split_crossing_edges(
   split_crossing_edges_ = split_crossing_edges;
 }
 
+inline S2Builder::Options::CrossingAlgorithm
+S2Builder::Options::crossing_algorithm() const {
+  return crossing_algorithm_;
+}
+
+inline void S2Builder::Options::set_crossing_algorithm(
+    CrossingAlgorithm crossing_algorithm) {
+  crossing_algorithm_ = crossing_algorithm;
+}
+
 inline S1Angle S2Builder::Options::intersection_tolerance() const {
   if (!split_crossing_edges()) return intersection_tolerance_;
   return std::max(intersection_tolerance_, S2::kIntersectionError);
@@ -1242,6 +1378,39 @@ inline void S2Builder::Options::set_memory_tracker(
   memory_tracker_ = tracker;
 }
 
+inline int S2Builder::Options::num_threads() const {
+  return num_threads_;
+}
+
+inline void S2Builder::Options::set_num_threads(int num_threads) {
+  S2_DCHECK_GE(num_threads, 1);
+  num_threads_ = num_threads;
+}
+
+inline S2Executor* S2Builder::Options::executor() const {
+  return executor_;
+}
+
+inline void S2Builder::Options::set_executor(S2Executor* executor) {
+  executor_ = executor;
+}
+
+inline S2Tracer* S2Builder::Options::tracer() const {
+  return tracer_;
+}
+
+inline void S2Builder::Options::set_tracer(S2Tracer* tracer) {
+  tracer_ = tracer;
+}
+
+inline bool S2Builder::Options::compact_vertices() const {
+  return compact_vertices_;
+}
+
+inline void S2Builder::Options::set_compact_vertices(bool compact_vertices) {
+  compact_vertices_ = compact_vertices;
+}
+
 inline S2Builder::GraphOptions::EdgeType
 S2Builder::GraphOptions::edge_type() const {
   return edge_type_;
@@ -61,11 +61,59 @@ Graph::Graph(const GraphOptions& options,
   S2_DCHECK_EQ(edges->size(), input_edge_id_set_ids->size());
 }
 
+Graph::Graph(const GraphOptions& options,
+             const vector<S2CellId>* vertex_ids,
+             const vector<Edge>* edges,
+             const vector<InputEdgeIdSetId>* input_edge_id_set_ids,
+             const IdSetLexicon* input_edge_id_set_lexicon,
+             const vector<LabelSetId>* label_set_ids,
+             const IdSetLexicon* label_set_lexicon,
+             IsFullPolygonPredicate is_full_polygon_predicate)
+    : options_(options), num_vertices_(vertex_ids->size()), vertices_(nullptr),
+      vertex_ids_(vertex_ids), edges_(edges),
+      input_edge_id_set_ids_(input_edge_id_set_ids),
+      input_edge_id_set_lexicon_(input_edge_id_set_lexicon),
+      label_set_ids_(label_set_ids),
+      label_set_lexicon_(label_set_lexicon),
+      is_full_polygon_predicate_(std::move(is_full_polygon_predicate)) {
+  S2_DCHECK(std::is_sorted(edges->begin(), edges->end()));
+  S2_DCHECK_EQ(edges->size(), input_edge_id_set_ids->size());
+}
+
+Graph Graph::WithEdges(const GraphOptions& options,
+                       const vector<Edge>* edges,
+                       const vector<InputEdgeIdSetId>* input_edge_id_set_ids,
+                       const IdSetLexicon* input_edge_id_set_lexicon) const {
+  S2_DCHECK(std::is_sorted(edges->begin(), edges->end()));
+  S2_DCHECK_EQ(edges->size(), input_edge_id_set_ids->size());
+  Graph graph = *this;
+  graph.options_ = options;
+  graph.edges_ = edges;
+  graph.input_edge_id_set_ids_ = input_edge_id_set_ids;
+  graph.input_edge_id_set_lexicon_ = input_edge_id_set_lexicon;
+  return graph;
+}
+
+// The minimum number of edges that each thread should process when the edges
+// of a graph are sorted or scanned in parallel.  Sorting is cheap per edge,
+// so smaller blocks are not worth the overhead of starting threads.
+static constexpr int kMinEdgesPerThread = 10000;
+
+// Returns the number of threads that should be used to process "num_edges"
+// edges given the "num_threads" and "executor" options.
+static int GetNumThreads(int num_threads, const S2Executor* executor,
+                         int64 num_edges) {
+  return static_cast<int>(
+      max<int64>(1, min<int64>(S2NumThreads(executor, num_threads),
+                               num_edges / kMinEdgesPerThread)));
+}
+
 vector<Graph::EdgeId> Graph::GetInEdgeIds() const {
   vector<EdgeId> in_edge_ids(num_edges());
   std::iota(in_edge_ids.begin(), in_edge_ids.end(), 0);
-  std::sort(in_edge_ids.begin(), in_edge_ids.end(),
-            [this](EdgeId ai, EdgeId bi) {
+  S2ParallelSort(executor_, GetNumThreads(num_threads_, executor_, num_edges()),
+                 in_edge_ids.begin(), in_edge_ids.end(),
+                 [this](EdgeId ai, EdgeId bi) {
       return StableLessThan(reverse(edge(ai)), reverse(edge(bi)), ai, bi);
     });
   return in_edge_ids;
@@ -224,11 +272,19 @@ static void AddVertexEdges(Graph::EdgeId out_begin, Graph::EdgeId out_end,
   }
 }
 
-bool Graph::GetLeftTurnMap(const vector<EdgeId>& in_edge_ids,
-                           vector<EdgeId>* left_turn_map,
-                           S2Error* error) const {
-  left_turn_map->assign(num_edges(), -1);
-  if (num_edges() == 0) return true;
+// Adds the left turn map entries for the incoming edges of a contiguous range
+// of vertices, whose outgoing edges are [out, out_end) and whose incoming
+// edges are in_edge_ids[in, in_end).  Returns false and sets "error" if it
+// is not possible to make a left turn from every such edge.
+static bool GetVertexRangeLeftTurns(const Graph& g,
+                                    const vector<Graph::EdgeId>& in_edge_ids,
+                                    Graph::EdgeId out, Graph::EdgeId out_end,
+                                    int in, int in_end,
+                                    vector<Graph::EdgeId>* left_turn_map,
+                                    S2Error* error) {
+  using Edge = Graph::Edge;
+  using EdgeId = Graph::EdgeId;
+  using VertexId = Graph::VertexId;
 
   // Declare vectors outside the loop to avoid reallocating them each time.
   vector<VertexEdge> v0_edges;
@@ -238,30 +294,31 @@ bool Graph::GetLeftTurnMap(const vector<EdgeId>& in_edge_ids,
   // gather all the edges incident to each vertex.  Then we sort those edges
   // and add an entry to the left turn map from each incoming edge to the
   // immediately following outgoing edge in clockwise order.
-  int out = 0, in = 0;
-  const Edge* out_edge = &edge(out);
-  const Edge* in_edge = &edge(in_edge_ids[in]);
-  Edge sentinel(num_vertices(), num_vertices());
-  Edge min_edge = min(*out_edge, reverse(*in_edge));
+  Edge sentinel(g.num_vertices(), g.num_vertices());
+  const Edge* out_edge = (out == out_end) ? &sentinel : &g.edge(out);
+  const Edge* in_edge = (in == in_end) ? &sentinel : &g.edge(in_edge_ids[in]);
+  Edge min_edge = min(*out_edge, Graph::reverse(*in_edge));
   while (min_edge != sentinel) {
     // Gather all incoming and outgoing edges around vertex "v0".
     VertexId v0 = min_edge.first;
-    for (; min_edge.first == v0; min_edge = min(*out_edge, reverse(*in_edge))) {
+    for (; min_edge.first == v0;
+         min_edge = min(*out_edge, Graph::reverse(*in_edge))) {
       VertexId v1 = min_edge.second;
       // Count the number of copies of "min_edge" in each direction.
       int out_begin = out, in_begin = in;
       while (*out_edge == min_edge) {
-        out_edge = (++out == num_edges()) ? &sentinel : &edge(out);
+        out_edge = (++out == out_end) ? &sentinel : &g.edge(out);
       }
-      while (reverse(*in_edge) == min_edge) {
-        in_edge = (++in == num_edges()) ? &sentinel : &edge(in_edge_ids[in]);
+      while (Graph::reverse(*in_edge) == min_edge) {
+        in_edge = (++in == in_end) ? &sentinel : &g.edge(in_edge_ids[in]);
       }
       if (v0 != v1) {
         AddVertexEdges(out_begin, out, in_begin, in, v1, &v0_edges);
       } else {
         // Each degenerate edge becomes its own loop.
         for (; in_begin < in; ++in_begin) {
-          (*left_turn_map)[in_begin] = in_begin;
+          EdgeId e = in_edge_ids[in_begin];
+          (*left_turn_map)[e] = e;
         }
       }
     }
@@ -270,13 +327,13 @@ bool Graph::GetLeftTurnMap(const vector<EdgeId>& in_edge_ids,
     // Sort the edges in clockwise order around "v0".
     VertexId min_endpoint = v0_edges.front().endpoint;
     std::sort(v0_edges.begin() + 1, v0_edges.end(),
-              [v0, min_endpoint, this](const VertexEdge& a,
-                                       const VertexEdge& b) {
+              [v0, min_endpoint, &g](const VertexEdge& a,
+                                     const VertexEdge& b) {
         if (a.endpoint == b.endpoint) return a.rank < b.rank;
         if (a.endpoint == min_endpoint) return true;
         if (b.endpoint == min_endpoint) return false;
-        return !s2pred::OrderedCCW(vertex(a.endpoint), vertex(b.endpoint),
-                                   vertex(min_endpoint), vertex(v0));
+        return !s2pred::OrderedCCW(g.vertex(a.endpoint), g.vertex(b.endpoint),
+                                   g.vertex(min_endpoint), g.vertex(v0));
       });
     // Match incoming with outgoing edges.  We do this by keeping a stack of
     // unmatched incoming edges.  We also keep a stack of outgoing edges with
@@ -310,6 +367,55 @@ bool Graph::GetLeftTurnMap(const vector<EdgeId>& in_edge_ids,
   return error->ok();
 }
 
+bool Graph::GetLeftTurnMap(const vector<EdgeId>& in_edge_ids,
+                           vector<EdgeId>* left_turn_map,
+                           S2Error* error) const {
+  left_turn_map->assign(num_edges(), -1);
+  if (num_edges() == 0) return true;
+
+  // Each vertex is processed independently, so the vertices can be divided
+  // into blocks with roughly the same number of outgoing edges and the
+  // blocks can be processed in parallel.  Each incoming edge belongs to the
+  // block of its destination vertex, so every entry of the left turn map is
+  // written by exactly one thread.
+  const int num_blocks = GetNumThreads(num_threads_, executor_, num_edges());
+  if (num_blocks == 1) {
+    return GetVertexRangeLeftTurns(*this, in_edge_ids, 0, num_edges(),
+                                   0, num_edges(), left_turn_map, error);
+  }
+  vector<EdgeId> out_begins(num_blocks + 1), in_begins(num_blocks + 1);
+  for (int block = 0; block <= num_blocks; ++block) {
+    if (block == 0 || block == num_blocks) {
+      out_begins[block] = in_begins[block] = block ? num_edges() : 0;
+      continue;
+    }
+    VertexId v = edge(int64{num_edges()} * block / num_blocks).first;
+    out_begins[block] =
+        std::lower_bound(edges().begin(), edges().end(), Edge(v, 0)) -
+        edges().begin();
+    in_begins[block] =
+        std::partition_point(in_edge_ids.begin(), in_edge_ids.end(),
+                             [this, v](EdgeId e) {
+          return edge(e).second < v;
+        }) - in_edge_ids.begin();
+  }
+  vector<S2Error> errors(num_blocks);
+  S2ParallelFor(executor_, num_blocks, [&](int block) {
+    GetVertexRangeLeftTurns(*this, in_edge_ids, out_begins[block],
+                            out_begins[block + 1], in_begins[block],
+                            in_begins[block + 1], left_turn_map,
+                            &errors[block]);
+  });
+  // Report the same error as a single-threaded scan would have.
+  for (const S2Error& block_error : errors) {
+    if (!block_error.ok()) {
+      if (error->ok()) *error = block_error;
+      break;
+    }
+  }
+  return error->ok();
+}
+
 void Graph::CanonicalizeLoopOrder(const vector<InputEdgeId>& min_input_ids,
                                   vector<EdgeId>* loop) {
   if (loop->empty()) return;
@@ -842,7 +948,8 @@ class Graph::EdgeProcessor {
   EdgeProcessor(const GraphOptions& options,
                 vector<Edge>* edges,
                 vector<InputEdgeIdSetId>* input_ids,
-                IdSetLexicon* id_set_lexicon);
+                IdSetLexicon* id_set_lexicon,
+                int num_threads, S2Executor* executor);
   void Run(S2Error* error);
 
  private:
@@ -868,7 +975,8 @@ class Graph::EdgeProcessor {
 void Graph::ProcessEdges(
     GraphOptions* options, std::vector<Edge>* edges,
     std::vector<InputEdgeIdSetId>* input_ids, IdSetLexicon* id_set_lexicon,
-    S2Error* error, S2MemoryTracker::Client* tracker) {
+    S2Error* error, S2MemoryTracker::Client* tracker,
+    int num_threads, S2Executor* executor) {
   // Graph::EdgeProcessor uses 8 bytes per input edge (out_edges_ and
   // in_edges_) plus 12 bytes per output edge (new_edges_, new_input_ids_).
   // For simplicity we assume that num_input_edges == num_output_edges, since
@@ -890,7 +998,8 @@ void Graph::ProcessEdges(
     tracker->Tally(-edges->capacity() * kFinalPerEdge);
   }
   if (!tracker || tracker->ok()) {
-    EdgeProcessor processor(*options, edges, input_ids, id_set_lexicon);
+    EdgeProcessor processor(*options, edges, input_ids, id_set_lexicon,
+                            num_threads, executor);
     processor.Run(error);
   }
   // Certain values of sibling_pairs() discard half of the edges and change
@@ -907,19 +1016,24 @@ void Graph::ProcessEdges(
 Graph::EdgeProcessor::EdgeProcessor(const GraphOptions& options,
                                     vector<Edge>* edges,
                                     vector<InputEdgeIdSetId>* input_ids,
-                                    IdSetLexicon* id_set_lexicon)
+                                    IdSetLexicon* id_set_lexicon,
+                                    int num_threads, S2Executor* executor)
     : options_(options), edges_(*edges),
       input_ids_(*input_ids), id_set_lexicon_(id_set_lexicon),
       out_edges_(edges_.size()), in_edges_(edges_.size()) {
   // Sort the outgoing and incoming edges in lexigraphic order.  We use a
   // stable sort to ensure that each undirected edge becomes a sibling pair,
-  // even if there are multiple identical input edges.
+  // even if there are multiple identical input edges.  Since ties are broken
+  // by edge id, the result does not depend on the number of threads.
+  num_threads = GetNumThreads(num_threads, executor, edges_.size());
   std::iota(out_edges_.begin(), out_edges_.end(), 0);
-  std::sort(out_edges_.begin(), out_edges_.end(), [this](EdgeId a, EdgeId b) {
+  S2ParallelSort(executor, num_threads, out_edges_.begin(), out_edges_.end(),
+                 [this](EdgeId a, EdgeId b) {
       return StableLessThan(edges_[a], edges_[b], a, b);
     });
   std::iota(in_edges_.begin(), in_edges_.end(), 0);
-  std::sort(in_edges_.begin(), in_edges_.end(), [this](EdgeId a, EdgeId b) {
+  S2ParallelSort(executor, num_threads, in_edges_.begin(), in_edges_.end(),
+                 [this](EdgeId a, EdgeId b) {
       return StableLessThan(reverse(edges_[a]), reverse(edges_[b]), a, b);
     });
   new_edges_.reserve(edges_.size());
@@ -1140,9 +1254,11 @@ Graph Graph::MakeSubgraph(
     }
   }
   Graph::ProcessEdges(&new_options, new_edges, new_input_edge_id_set_ids,
-                      new_input_edge_id_set_lexicon, error, tracker);
+                      new_input_edge_id_set_lexicon, error, tracker,
+                      num_threads_, executor_);
   if (tracker && !tracker->ok()) return Graph();  // Graph would be invalid.
-  return Graph(new_options, &vertices(), new_edges, new_input_edge_id_set_ids,
-               new_input_edge_id_set_lexicon, &label_set_ids(),
-               &label_set_lexicon(), std::move(is_full_polygon_predicate));
+  Graph graph = WithEdges(new_options, new_edges, new_input_edge_id_set_ids,
+                          new_input_edge_id_set_lexicon);
+  graph.is_full_polygon_predicate_ = std::move(is_full_polygon_predicate);
+  return graph;
 }
@@ -29,7 +29,9 @@
 #include "s2/base/integral_types.h"
 #include "s2/id_set_lexicon.h"
 #include "s2/s2builder.h"
+#include "s2/s2cell_id.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2memory_tracker.h"
 
 // An S2Builder::Graph represents a collection of snapped edges that is passed
@@ -86,7 +88,8 @@ class S2Builder::Graph {
   //    - the GraphOptions used to build the Graph.  In some cases these
   //      can be different than the options provided by the Layer.
   // "vertices":
-  //   - a vector of S2Points indexed by VertexId.
+  //   - a vector of S2Points indexed by VertexId.  (See also the constructor
+  //     below that accepts S2CellIds.)
   // "edges":
   //   - a vector of VertexId pairs (sorted in lexicographic order)
   //     indexed by EdgeId.
@@ -117,17 +120,54 @@ class S2Builder::Graph {
         const IdSetLexicon* label_set_lexicon,
         IsFullPolygonPredicate is_full_polygon_predicate);
 
+  // Like the constructor above, except that the vertices are stored as a
+  // vector of S2CellIds (8 bytes per vertex rather than 24).  Each vertex is
+  // the center of the corresponding cell, i.e. vertex(v) returns
+  // (*vertex_ids)[v].ToPoint().  S2Builder uses this representation when
+  // Options::compact_vertices() is true.
+  Graph(const GraphOptions& options,
+        const std::vector<S2CellId>* vertex_ids,
+        const std::vector<Edge>* edges,
+        const std::vector<InputEdgeIdSetId>* input_edge_id_set_ids,
+        const IdSetLexicon* input_edge_id_set_lexicon,
+        const std::vector<LabelSetId>* label_set_ids,
+        const IdSetLexicon* label_set_lexicon,
+        IsFullPolygonPredicate is_full_polygon_predicate);
+
+  // Returns a graph with the given options and edges that shares everything
+  // else (vertices, labels, is_full_polygon_predicate, and threading options)
+  // with this graph.  Unlike MakeSubgraph(), the edges are used as given,
+  // i.e. they must already be sorted and satisfy "options".  This is the
+  // preferred way to derive one graph from another, since it works with
+  // either vertex representation.
+  Graph WithEdges(const GraphOptions& options,
+                  const std::vector<Edge>* edges,
+                  const std::vector<InputEdgeIdSetId>* input_edge_id_set_ids,
+                  const IdSetLexicon* input_edge_id_set_lexicon) const;
+
   const GraphOptions& options() const;
 
   // Returns the number of vertices in the graph.
   VertexId num_vertices() const;
 
-  // Returns the vertex at the given index.
-  const S2Point& vertex(VertexId v) const;
+  // Returns the vertex at the given index.  Note that the vertex is returned
+  // by value, since it may need to be decoded from an S2CellId.
+  S2Point vertex(VertexId v) const;
 
   // Returns the entire set of vertices.
+  //
+  // REQUIRES: !has_vertex_ids()
   const std::vector<S2Point>& vertices() const;
 
+  // Returns true if the vertices are stored as S2CellIds (see above), in
+  // which case vertex_ids() must be used instead of vertices().
+  bool has_vertex_ids() const;
+
+  // Returns the S2CellIds whose centers are the vertices of the graph.
+  //
+  // REQUIRES: has_vertex_ids()
+  const std::vector<S2CellId>& vertex_ids() const;
+
   // Returns the total number of edges in the graph.
   EdgeId num_edges() const;
 
@@ -394,6 +434,18 @@ class S2Builder::Graph {
   // (see s2builder.h for details).
   const IsFullPolygonPredicate& is_full_polygon_predicate() const;
 
+  // The maximum number of threads used by methods that process all the edges
+  // of the graph at once (GetInEdgeIds, GetSiblingMap, GetLeftTurnMap, and
+  // MakeSubgraph).  S2Builder sets these from its own Options before passing
+  // the graph to each layer.  The results do not depend on these values (see
+  // S2Builder::Options::num_threads and executor).
+  //
+  // DEFAULT: 1 thread and no executor
+  int num_threads() const;
+  void set_num_threads(int num_threads);
+  S2Executor* executor() const;
+  void set_executor(S2Executor* executor);
+
   // Returns a map "m" that maps each edge e=(v0,v1) to the following outgoing
   // edge around "v1" in clockwise order.  (This corresponds to making a "left
   // turn" at the vertex.)  By starting at a given edge and making only left
@@ -608,10 +660,15 @@ class S2Builder::Graph {
   // already being tracked, i.e. their current memory usage is reflected in
   // "tracker".  Note that "id_set_lexicon" typically uses a negligible amount
   // of memory and is not tracked.
+  //
+  // The edges are sorted using up to "num_threads" threads, optionally on the
+  // given "executor" (see S2Builder::Options).  The result does not depend on
+  // the number of threads.
   static void ProcessEdges(
       GraphOptions* options, std::vector<Edge>* edges,
       std::vector<InputEdgeIdSetId>* input_ids, IdSetLexicon* id_set_lexicon,
-      S2Error* error, S2MemoryTracker::Client* tracker = nullptr);
+      S2Error* error, S2MemoryTracker::Client* tracker = nullptr,
+      int num_threads = 1, S2Executor* executor = nullptr);
 
   // Given a set of vertices and edges, removes all vertices that do not have
   // any edges and returned the new, minimal set of vertices.  Also updates
@@ -684,12 +741,15 @@ class S2Builder::Graph {
   VertexId num_vertices_;  // Cached to avoid division by 24.
 
   const std::vector<S2Point>* vertices_;
+  const std::vector<S2CellId>* vertex_ids_ = nullptr;
   const std::vector<Edge>* edges_;
   const std::vector<InputEdgeIdSetId>* input_edge_id_set_ids_;
   const IdSetLexicon* input_edge_id_set_lexicon_;
   const std::vector<LabelSetId>* label_set_ids_;
   const IdSetLexicon* label_set_lexicon_;
   IsFullPolygonPredicate is_full_polygon_predicate_;
+  int num_threads_ = 1;
+  S2Executor* executor_ = nullptr;
 };
 
 
@@ -710,14 +770,25 @@ inline S2Builder::Graph::VertexId S2Builder::Graph::num_vertices() const {
   return num_vertices_;  // vertices_.size() requires division by 24.
 }
 
-inline const S2Point& S2Builder::Graph::vertex(VertexId v) const {
-  return vertices()[v];
+inline S2Point S2Builder::Graph::vertex(VertexId v) const {
+  if (vertex_ids_ != nullptr) return (*vertex_ids_)[v].ToPoint();
+  return (*vertices_)[v];
 }
 
 inline const std::vector<S2Point>& S2Builder::Graph::vertices() const {
+  S2_DCHECK(!has_vertex_ids());
   return *vertices_;
 }
 
+inline bool S2Builder::Graph::has_vertex_ids() const {
+  return vertex_ids_ != nullptr;
+}
+
+inline const std::vector<S2CellId>& S2Builder::Graph::vertex_ids() const {
+  S2_DCHECK(has_vertex_ids());
+  return *vertex_ids_;
+}
+
 inline S2Builder::Graph::EdgeId S2Builder::Graph::num_edges() const {
   return static_cast<S2Builder::Graph::EdgeId>(edges().size());
 }
@@ -839,6 +910,23 @@ S2Builder::Graph::is_full_polygon_predicate() const {
   return is_full_polygon_predicate_;
 }
 
+inline int S2Builder::Graph::num_threads() const {
+  return num_threads_;
+}
+
+inline void S2Builder::Graph::set_num_threads(int num_threads) {
+  S2_DCHECK_GE(num_threads, 1);
+  num_threads_ = num_threads;
+}
+
+inline S2Executor* S2Builder::Graph::executor() const {
+  return executor_;
+}
+
+inline void S2Builder::Graph::set_executor(S2Executor* executor) {
+  executor_ = executor;
+}
+
 inline bool S2Builder::Graph::StableLessThan(
     const Edge& a, const Edge& b, EdgeId ai, EdgeId bi) {
   // The following is simpler but the compiler (2016) doesn't optimize it as
@@ -20,6 +20,7 @@
 
 #include "s2/s2builder_graph.h"
 
+#include <algorithm>
 #include <iosfwd>
 #include <memory>
 #include <vector>
@@ -28,7 +29,10 @@
 #include "absl/memory/memory.h"
 #include "s2/id_set_lexicon.h"
 #include "s2/s2builderutil_testing.h"
+#include "s2/s2executor.h"
+#include "s2/s2latlng.h"
 #include "s2/s2lax_polyline_shape.h"
+#include "s2/s2testing.h"
 #include "s2/s2text_format.h"
 
 using s2builderutil::GraphClone;
@@ -481,6 +485,100 @@ TEST(ProcessEdges, CreateUndirectedSiblingPairsMergeDuplicates) {
   EXPECT_EQ(EdgeType::DIRECTED, options.edge_type());
 }
 
+TEST(ProcessEdges, ResultDoesNotDependOnNumThreads) {
+  // Use enough edges (including many duplicates) to be split among threads.
+  vector<Edge> input_edges;
+  vector<InputEdgeIdSetId> input_id_set_ids;
+  IdSetLexicon id_set_lexicon;
+  for (int i = 0; i < 60000; ++i) {
+    input_edges.push_back(Edge(S2Testing::rnd.Uniform(3000),
+                               S2Testing::rnd.Uniform(3000)));
+    input_id_set_ids.push_back(id_set_lexicon.Add(vector<InputEdgeId>{i}));
+  }
+  S2ThreadPool pool(3);
+  for (auto edge_type : {EdgeType::DIRECTED, EdgeType::UNDIRECTED}) {
+    for (auto duplicate_edges : {DuplicateEdges::KEEP, DuplicateEdges::MERGE}) {
+      vector<Edge> edges[2];
+      vector<InputEdgeIdSetId> input_ids[2];
+      for (int i = 0; i < 2; ++i) {
+        GraphOptions options(edge_type, DegenerateEdges::DISCARD_EXCESS,
+                             duplicate_edges, SiblingPairs::KEEP);
+        edges[i] = input_edges;
+        input_ids[i] = input_id_set_ids;
+        S2Error error;
+        Graph::ProcessEdges(&options, &edges[i], &input_ids[i],
+                            &id_set_lexicon, &error, nullptr,
+                            1, i ? &pool : nullptr);
+      }
+      EXPECT_EQ(edges[0], edges[1]);
+      EXPECT_EQ(input_ids[0], input_ids[1]);
+    }
+  }
+}
+
+TEST(GetLeftTurnMap, DegenerateEdges) {
+  // Each degenerate edge should become its own loop, even when its position
+  // in the incoming edge order differs from its edge id.
+  GraphOptions options(EdgeType::DIRECTED, DegenerateEdges::KEEP,
+                       DuplicateEdges::KEEP, SiblingPairs::KEEP);
+  auto vertices = ParsePointsOrDie("0:0, 0:1, 1:1");
+  vector<Edge> edges{{0, 1}, {1, 1}, {1, 2}, {2, 0}};
+  vector<InputEdgeIdSetId> input_edge_id_set_ids(edges.size(), 0);
+  vector<LabelSetId> label_set_ids;
+  IdSetLexicon input_edge_id_set_lexicon, label_set_lexicon;
+  Graph g(options, &vertices, &edges, &input_edge_id_set_ids,
+          &input_edge_id_set_lexicon, &label_set_ids, &label_set_lexicon,
+          nullptr);
+  vector<EdgeId> left_turn_map;
+  S2Error error;
+  ASSERT_TRUE(g.GetLeftTurnMap(g.GetInEdgeIds(), &left_turn_map, &error));
+  EXPECT_EQ((vector<EdgeId>{2, 1, 3, 0}), left_turn_map);
+}
+
+TEST(GetLeftTurnMap, ResultDoesNotDependOnNumThreads) {
+  // Build a grid where every edge has a sibling, together with a degenerate
+  // edge at every vertex.
+  const int kSize = 120;
+  vector<S2Point> vertices;
+  vector<Edge> edges;
+  for (int i = 0; i < kSize; ++i) {
+    for (int j = 0; j < kSize; ++j) {
+      vertices.push_back(S2LatLng::FromDegrees(0.01 * i, 0.01 * j).ToPoint());
+      VertexId v = i * kSize + j;
+      edges.push_back(Edge(v, v));
+      if (i > 0) edges.push_back(Edge(v, v - kSize));
+      if (i + 1 < kSize) edges.push_back(Edge(v, v + kSize));
+      if (j > 0) edges.push_back(Edge(v, v - 1));
+      if (j + 1 < kSize) edges.push_back(Edge(v, v + 1));
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  vector<InputEdgeIdSetId> input_edge_id_set_ids(edges.size(), 0);
+  vector<LabelSetId> label_set_ids;
+  IdSetLexicon input_edge_id_set_lexicon, label_set_lexicon;
+  GraphOptions options(EdgeType::DIRECTED, DegenerateEdges::KEEP,
+                       DuplicateEdges::KEEP, SiblingPairs::KEEP);
+  Graph g(options, &vertices, &edges, &input_edge_id_set_ids,
+          &input_edge_id_set_lexicon, &label_set_ids, &label_set_lexicon,
+          nullptr);
+  vector<EdgeId> in_edge_ids = g.GetInEdgeIds();
+  vector<EdgeId> left_turn_map;
+  S2Error error;
+  ASSERT_TRUE(g.GetLeftTurnMap(in_edge_ids, &left_turn_map, &error));
+  for (EdgeId e = 0; e < g.num_edges(); ++e) {
+    EXPECT_EQ(g.edge(e).second, g.edge(left_turn_map[e]).first);
+    if (g.edge(e).first == g.edge(e).second) {
+      EXPECT_EQ(e, left_turn_map[e]);
+    }
+  }
+
+  g.set_num_threads(4);
+  EXPECT_EQ(in_edge_ids, g.GetInEdgeIds());
+  vector<EdgeId> parallel_left_turn_map;
+  ASSERT_TRUE(g.GetLeftTurnMap(in_edge_ids, &parallel_left_turn_map, &error));
+  EXPECT_EQ(left_turn_map, parallel_left_turn_map);
+}
+
 void TestMakeSubgraph(
     const Graph& g,
     IdSetLexicon new_input_edge_id_set_lexicon,
@@ -22,6 +22,7 @@
 #include <cmath>
 #include <cstdint>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -50,14 +51,17 @@
 #include "s2/s2edge_crossings.h"
 #include "s2/s2edge_distances.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng.h"
 #include "s2/s2lax_polyline_shape.h"
 #include "s2/s2loop.h"
+#include "s2/s2point_vector_shape.h"
 #include "s2/s2polygon.h"
 #include "s2/s2polyline.h"
 #include "s2/s2predicates.h"
 #include "s2/s2testing.h"
 #include "s2/s2text_format.h"
+#include "s2/s2tracer.h"
 
 using absl::StrAppend;
 using absl::StrCat;
@@ -127,6 +131,89 @@ TEST(S2Builder, AddShape) {
   ExpectPolygonsEqual(*input, output);
 }
 
+// Adds the same geometry to "builder" either using the batched methods or
+// one edge at a time, changing the label set along the way.
+static void AddBatchTestGeometry(bool batched, S2Builder* builder) {
+  auto polygon = MakePolygonOrDie("0:0, 0:5, 5:5, 5:0; 1:1, 1:4, 4:4, 4:1");
+  const S2Shape& polygon_shape = *polygon->index().shape(0);
+  S2PointVectorShape points({MakePointOrDie("7:7"), MakePointOrDie("8:8")});
+  vector<S2Point> polyline = s2textformat::ParsePointsOrDie(
+      "0:0, 0:0, 1:2, 2:2, 3:3");
+  vector<S2Point> loop = s2textformat::ParsePointsOrDie(
+      "10:10, 10:11, 11:11, 10:10");
+  vector<S2Shape::Edge> edges = {
+      {MakePointOrDie("6:6"), MakePointOrDie("6:7")},
+      {MakePointOrDie("6:7"), MakePointOrDie("6:7")},
+      {MakePointOrDie("6:8"), MakePointOrDie("6:9")}};
+  auto add_shape = [&](const S2Shape& shape) {
+    if (batched) {
+      builder->AddShape(shape);
+    } else {
+      for (int e = 0; e < shape.num_edges(); ++e) {
+        builder->AddEdge(shape.edge(e).v0, shape.edge(e).v1);
+      }
+    }
+  };
+  add_shape(polygon_shape);
+  builder->set_label(5);
+  add_shape(points);
+  if (batched) {
+    builder->AddPolyline(polyline);
+  } else {
+    for (int i = 1; i < polyline.size(); ++i) {
+      builder->AddEdge(polyline[i - 1], polyline[i]);
+    }
+  }
+  builder->push_label(6);
+  if (batched) {
+    builder->AddLoop(loop);
+  } else {
+    for (int i = 0; i < loop.size(); ++i) {
+      builder->AddEdge(loop[i], loop[(i + 1) % loop.size()]);
+    }
+  }
+  builder->clear_labels();
+  if (batched) {
+    builder->AddEdges(edges);
+  } else {
+    for (const auto& edge : edges) builder->AddEdge(edge.v0, edge.v1);
+  }
+}
+
+TEST(S2Builder, BatchedAddMethodsMatchAddEdge) {
+  // The batched methods must produce the same input edges (in the same
+  // order) and labels as adding the edges one at a time.
+  for (auto degenerate_edges : {GraphOptions::DegenerateEdges::KEEP,
+                                GraphOptions::DegenerateEdges::DISCARD}) {
+    GraphClone clones[2];
+    for (int batched = 0; batched < 2; ++batched) {
+      S2Builder builder{S2Builder::Options()};
+      builder.StartLayer(make_unique<s2builderutil::GraphCloningLayer>(
+          GraphOptions(EdgeType::DIRECTED, degenerate_edges,
+                       GraphOptions::DuplicateEdges::KEEP,
+                       GraphOptions::SiblingPairs::KEEP),
+          &clones[batched]));
+      AddBatchTestGeometry(batched, &builder);
+      S2Error error;
+      ASSERT_TRUE(builder.Build(&error)) << error;
+    }
+    const S2Builder::Graph& g0 = clones[0].graph();
+    const S2Builder::Graph& g1 = clones[1].graph();
+    EXPECT_EQ(g0.vertices(), g1.vertices());
+    ASSERT_EQ(g0.edges(), g1.edges());
+    for (int e = 0; e < g0.num_edges(); ++e) {
+      auto ids0 = g0.input_edge_ids(e), ids1 = g1.input_edge_ids(e);
+      ASSERT_EQ(vector<int>(ids0.begin(), ids0.end()),
+                vector<int>(ids1.begin(), ids1.end()));
+      for (int id : ids0) {
+        auto labels0 = g0.labels(id), labels1 = g1.labels(id);
+        EXPECT_EQ(vector<int>(labels0.begin(), labels0.end()),
+                  vector<int>(labels1.begin(), labels1.end()));
+      }
+    }
+  }
+}
+
 TEST(S2Builder, SimpleVertexMerging) {
   // When IdentitySnapFunction is used (i.e., no special requirements on
   // vertex locations), check that vertices closer together than the snap
@@ -1445,6 +1532,45 @@ TEST(S2Builder, SelfIntersectionStressTest) {
   }
 }
 
+TEST(S2Builder, CrossingAlgorithmsAgree) {
+  // Checks that CrossingAlgorithm::CELL_SORT finds the same crossings as
+  // CrossingAlgorithm::SHAPE_INDEX, using inputs that range from tiny regions
+  // to edges that span several cube faces.
+  const int kIters = 50 * absl::GetFlag(FLAGS_iteration_multiplier);
+  for (int iter = 0; iter < kIters; ++iter) {
+    S2Testing::rnd.Reset(iter + 1);  // Easier to reproduce a specific case.
+    S2Cap cap = S2Testing::GetRandomCap(1e-14, 2.0);
+    vector<S2Point> vertices(S2Testing::rnd.Uniform(40) + 3);
+    for (S2Point& vertex : vertices) {
+      vertex = S2Testing::SamplePoint(cap);
+    }
+    vertices.back() = vertices.front();
+    S2Polyline input(vertices, S2Debug::DISABLE);
+
+    S2Builder::Options options;
+    options.set_split_crossing_edges(true);
+    if (S2Testing::rnd.OneIn(2)) {
+      int exponent = IntLatLngSnapFunction::ExponentForMaxSnapRadius(
+          cap.GetRadius() * 1e-3);
+      options.set_snap_function(IntLatLngSnapFunction(
+          min(IntLatLngSnapFunction::kMaxExponent, exponent)));
+    }
+    S2Polygon outputs[2];
+    for (int i = 0; i < 2; ++i) {
+      options.set_crossing_algorithm(
+          i == 0 ? S2Builder::Options::CrossingAlgorithm::SHAPE_INDEX
+                 : S2Builder::Options::CrossingAlgorithm::CELL_SORT);
+      S2Builder builder(options);
+      builder.StartLayer(make_unique<S2PolygonLayer>(
+          &outputs[i], S2PolygonLayer::Options(EdgeType::UNDIRECTED)));
+      builder.AddPolyline(input);
+      S2Error error;
+      ASSERT_TRUE(builder.Build(&error)) << error;
+    }
+    ExpectPolygonsEqual(outputs[0], outputs[1]);
+  }
+}
+
 TEST(S2Builder, FractalStressTest) {
   const int kIters =
       (google::DEBUG_MODE ? 100 : 1000) * absl::GetFlag(FLAGS_iteration_multiplier);
@@ -1716,6 +1842,314 @@ TEST(S2Builder, IncorrectSeparationSiteBug) {
   ASSERT_TRUE(builder.Build(&error)) << error;
 }
 
+TEST(S2Builder, MultipleThreadsGiveSameResult) {
+  // Snap two crossing loops whose vertices are much closer together than the
+  // snap radius, and check that the output does not depend on the number of
+  // threads.
+  vector<unique_ptr<S2Loop>> input;
+  input.push_back(S2Loop::MakeRegularLoop(
+      S2LatLng::FromDegrees(10, 20).ToPoint(), S1Angle::Degrees(1), 5000));
+  input.push_back(S2Loop::MakeRegularLoop(
+      S2LatLng::FromDegrees(10.5, 20).ToPoint(), S1Angle::Degrees(1), 3000));
+  vector<unique_ptr<S2Polyline>> outputs[2];
+  for (int num_threads : {1, 4}) {
+    S2Builder::Options options(IntLatLngSnapFunction(2));
+    options.set_split_crossing_edges(true);
+    options.set_num_threads(num_threads);
+    S2Builder builder(options);
+    auto* output = &outputs[num_threads > 1];
+    builder.StartLayer(make_unique<S2PolylineVectorLayer>(output));
+    for (const auto& loop : input) builder.AddLoop(*loop);
+    S2Error error;
+    ASSERT_TRUE(builder.Build(&error)) << error;
+  }
+  ASSERT_EQ(outputs[0].size(), outputs[1].size());
+  for (int i = 0; i < outputs[0].size(); ++i) {
+    EXPECT_TRUE(outputs[0][i]->Equals(*outputs[1][i]));
+  }
+}
+
+TEST(S2Builder, ExecutorGivesSameResult) {
+  // Like the test above, but also simplifies edge chains and runs all the
+  // parallel work on a shared executor.
+  vector<unique_ptr<S2Loop>> input;
+  input.push_back(S2Loop::MakeRegularLoop(
+      S2LatLng::FromDegrees(10, 20).ToPoint(), S1Angle::Degrees(1), 5000));
+  input.push_back(S2Loop::MakeRegularLoop(
+      S2LatLng::FromDegrees(10.5, 20).ToPoint(), S1Angle::Degrees(1), 3000));
+  S2ThreadPool pool(4);
+  vector<unique_ptr<S2Polyline>> outputs[2];
+  for (S2Executor* executor : {static_cast<S2Executor*>(nullptr),
+                               static_cast<S2Executor*>(&pool)}) {
+    S2Builder::Options options(IntLatLngSnapFunction(2));
+    options.set_split_crossing_edges(true);
+    options.set_simplify_edge_chains(true);
+    options.set_executor(executor);
+    S2Builder builder(options);
+    auto* output = &outputs[executor != nullptr];
+    builder.StartLayer(make_unique<S2PolylineVectorLayer>(output));
+    for (const auto& loop : input) builder.AddLoop(*loop);
+    S2Error error;
+    ASSERT_TRUE(builder.Build(&error)) << error;
+  }
+  ASSERT_EQ(outputs[0].size(), outputs[1].size());
+  for (int i = 0; i < outputs[0].size(); ++i) {
+    EXPECT_TRUE(outputs[0][i]->Equals(*outputs[1][i]));
+  }
+}
+
+// A SnapFunction that delegates to another SnapFunction, but does not claim
+// that its snap sites are separated.  This forces S2Builder to use the
+// general site selection algorithm.
+class GeneralSnapFunction : public S2Builder::SnapFunction {
+ public:
+  explicit GeneralSnapFunction(const S2Builder::SnapFunction& snap_function)
+      : snap_function_(snap_function.Clone()) {}
+  S1Angle snap_radius() const override {
+    return snap_function_->snap_radius();
+  }
+  S1Angle min_vertex_separation() const override {
+    return snap_function_->min_vertex_separation();
+  }
+  S1Angle min_edge_vertex_separation() const override {
+    return snap_function_->min_edge_vertex_separation();
+  }
+  S2Point SnapPoint(const S2Point& point) const override {
+    return snap_function_->SnapPoint(point);
+  }
+  unique_ptr<SnapFunction> Clone() const override {
+    return make_unique<GeneralSnapFunction>(*snap_function_);
+  }
+
+ private:
+  unique_ptr<SnapFunction> snap_function_;
+};
+
+TEST(S2Builder, SeparatedSnapSitesGiveSameResult) {
+  // Snap random walks whose steps are comparable to the cell size, and check
+  // that selecting every snapped vertex as a site (which S2CellIdSnapFunction
+  // allows at its minimum snap radius) gives the same result as the general
+  // site selection algorithm.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  for (int iter = 0; iter < 50; ++iter) {
+    S2CellIdSnapFunction snap_function(S2Testing::rnd.Uniform(25) + 5);
+    ASSERT_TRUE(snap_function.snap_sites_are_separated());
+    const S1Angle step = 3 * snap_function.snap_radius();
+    vector<S2Point> walk;
+    S2Point p = S2Testing::RandomPoint();
+    for (int i = 0; i < 200; ++i) {
+      walk.push_back(p);
+      p = S2Testing::SamplePoint(S2Cap(p, step));
+    }
+    vector<unique_ptr<S2Polyline>> outputs[2];
+    for (int general = 0; general < 2; ++general) {
+      S2Builder::Options options;
+      if (general) {
+        options.set_snap_function(GeneralSnapFunction(snap_function));
+      } else {
+        options.set_snap_function(snap_function);
+      }
+      options.set_split_crossing_edges(iter % 2 == 0);
+      S2Builder builder(options);
+      builder.StartLayer(make_unique<S2PolylineVectorLayer>(&outputs[general]));
+      builder.AddPolyline(walk);
+      S2Error error;
+      ASSERT_TRUE(builder.Build(&error)) << error;
+    }
+    ASSERT_EQ(outputs[0].size(), outputs[1].size());
+    for (int i = 0; i < outputs[0].size(); ++i) {
+      EXPECT_TRUE(outputs[0][i]->Equals(*outputs[1][i]));
+    }
+  }
+  // A larger snap radius requires the general algorithm.
+  S2CellIdSnapFunction snap_function(10);
+  snap_function.set_snap_radius(2 * snap_function.snap_radius());
+  EXPECT_FALSE(snap_function.snap_sites_are_separated());
+}
+
+TEST(S2Builder, CompactVertices) {
+  // Check that storing the output vertices as S2CellIds gives the same
+  // result, both with a single layer and with enough layers that the
+  // vertices of each layer are filtered separately.
+  S2CellIdSnapFunction snap_function(12);
+  ASSERT_EQ(12, snap_function.snap_cell_level());
+  for (int num_layers : {1, 10}) {
+    vector<unique_ptr<S2Polygon>> outputs[2];
+    GraphClone graph_clone;
+    for (int compact = 0; compact < 2; ++compact) {
+      S2Builder::Options options(snap_function);
+      options.set_compact_vertices(compact);
+      S2Builder builder(options);
+      for (int i = 0; i < num_layers; ++i) {
+        outputs[compact].push_back(make_unique<S2Polygon>());
+        builder.StartLayer(
+            make_unique<S2PolygonLayer>(outputs[compact].back().get()));
+        builder.AddLoop(*S2Loop::MakeRegularLoop(
+            S2LatLng::FromDegrees(i, 0).ToPoint(), S1Angle::Degrees(0.5),
+            100));
+      }
+      builder.StartLayer(make_unique<s2builderutil::GraphCloningLayer>(
+          GraphOptions(), &graph_clone));
+      builder.AddPolyline(*MakePolylineOrDie("0:0, 1:1"));
+      S2Error error;
+      ASSERT_TRUE(builder.Build(&error)) << error;
+      EXPECT_EQ(compact, graph_clone.graph().has_vertex_ids());
+    }
+    for (int i = 0; i < num_layers; ++i) {
+      EXPECT_TRUE(outputs[0][i]->Equals(*outputs[1][i]));
+    }
+  }
+  // Vertices that are not cell centers prevent the conversion.
+  S2Builder::Options options(snap_function);
+  options.set_compact_vertices(true);
+  S2Builder builder(options);
+  GraphClone graph_clone;
+  builder.StartLayer(make_unique<s2builderutil::GraphCloningLayer>(
+      GraphOptions(), &graph_clone));
+  builder.ForceVertex(MakePointOrDie("0.1:0.1"));
+  builder.AddPolyline(*MakePolylineOrDie("0:0, 1:1"));
+  S2Error error;
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  EXPECT_FALSE(graph_clone.graph().has_vertex_ids());
+  EXPECT_EQ(IdentitySnapFunction().snap_cell_level(), -1);
+}
+
+TEST(S2Builder, SimplifyEdgeChainsWithMultipleThreads) {
+  // Simplify a zig-zag polyline that crosses a loop, where all the loop
+  // vertices are interior vertices of edge chains, and check that the output
+  // edges and labels do not depend on the number of threads.
+  vector<S2Point> zigzag;
+  for (int i = 0; i < 4000; ++i) {
+    zigzag.push_back(
+        S2LatLng::FromDegrees(10 + 1e-4 * (i % 2), 18 + 1e-3 * i).ToPoint());
+  }
+  auto loop = S2Loop::MakeRegularLoop(
+      S2LatLng::FromDegrees(10, 20).ToPoint(), S1Angle::Degrees(1), 3000);
+  vector<unique_ptr<S2Polyline>> outputs[2];
+  S2PolylineVectorLayer::LabelSetIds label_set_ids[2];
+  IdSetLexicon label_set_lexicons[2];
+  for (int num_threads : {1, 4}) {
+    S2Builder::Options options(IntLatLngSnapFunction(3));
+    options.set_split_crossing_edges(true);
+    options.set_simplify_edge_chains(true);
+    options.set_num_threads(num_threads);
+    S2Builder builder(options);
+    int k = num_threads > 1;
+    builder.StartLayer(make_unique<S2PolylineVectorLayer>(
+        &outputs[k], &label_set_ids[k], &label_set_lexicons[k]));
+    builder.set_label(1);
+    builder.AddPolyline(S2Polyline(zigzag));
+    builder.set_label(2);
+    builder.AddLoop(*loop);
+    S2Error error;
+    ASSERT_TRUE(builder.Build(&error)) << error;
+  }
+  int num_vertices = 0;
+  for (const auto& polyline : outputs[0]) {
+    num_vertices += polyline->num_vertices();
+  }
+  EXPECT_LT(num_vertices, 1000);  // Most vertices were simplified away.
+  ASSERT_EQ(outputs[0].size(), outputs[1].size());
+  for (int i = 0; i < outputs[0].size(); ++i) {
+    EXPECT_TRUE(outputs[0][i]->Equals(*outputs[1][i]));
+    ASSERT_EQ(label_set_ids[0][i].size(), label_set_ids[1][i].size());
+    for (int j = 0; j < label_set_ids[0][i].size(); ++j) {
+      auto labels0 = label_set_lexicons[0].id_set(label_set_ids[0][i][j]);
+      auto labels1 = label_set_lexicons[1].id_set(label_set_ids[1][i][j]);
+      EXPECT_EQ(vector<int32>(labels0.begin(), labels0.end()),
+                vector<int32>(labels1.begin(), labels1.end()));
+    }
+  }
+}
+
+TEST(S2Builder, ReuseAcrossBuilds) {
+  // Check that an S2Builder can be reused with different numbers of layers,
+  // and that the tracked memory usage does not grow when the same operations
+  // are repeated.
+  S2MemoryTracker tracker;
+  S2Builder::Options options(IntLatLngSnapFunction(7));
+  options.set_memory_tracker(&tracker);
+  S2Builder builder(options);
+  vector<int64> usage;
+  for (int iter = 0; iter < 6; ++iter) {
+    int num_layers = 1 + iter % 3;
+    vector<S2Polygon> outputs(num_layers);
+    for (int i = 0; i < num_layers; ++i) {
+      builder.StartLayer(make_unique<S2PolygonLayer>(&outputs[i]));
+      builder.AddLoop(*S2Loop::MakeRegularLoop(
+          S2LatLng::FromDegrees(i, iter).ToPoint(), S1Angle::Degrees(0.1),
+          10 * num_layers));
+    }
+    S2Error error;
+    ASSERT_TRUE(builder.Build(&error)) << error;
+    for (int i = 0; i < num_layers; ++i) {
+      EXPECT_EQ(10 * num_layers, outputs[i].num_vertices());
+    }
+    usage.push_back(tracker.usage_bytes());
+  }
+  EXPECT_EQ(usage[2], usage[5]);
+  EXPECT_LE(usage[3], usage[2]);
+  EXPECT_LE(usage[4], usage[2]);
+}
+
+// A tracer that records each span as "+name" or "-name", and the counts of
+// the most recent span with each name.
+class RecordingTracer : public S2Tracer {
+ public:
+  void StartSpan(const char* name) override {
+    events_.push_back(StrCat("+", name));
+  }
+  void EndSpan(const char* name, const S2TraceCounts& counts) override {
+    events_.push_back(StrCat("-", name));
+    counts_[name] = counts;
+  }
+  const vector<string>& events() const { return events_; }
+  const S2TraceCounts& counts(const string& name) { return counts_[name]; }
+
+ private:
+  vector<string> events_;
+  std::map<string, S2TraceCounts> counts_;
+};
+
+TEST(S2Builder, Tracer) {
+  // Two crossing polylines are split at their intersection point, which is
+  // then snapped to the nearest E7 point.
+  RecordingTracer tracer;
+  S2Builder::Options options(IntLatLngSnapFunction(7));
+  options.set_split_crossing_edges(true);
+  options.set_tracer(&tracer);
+  S2Builder builder(options);
+  vector<unique_ptr<S2Polyline>> output;
+  builder.StartLayer(make_unique<S2PolylineVectorLayer>(&output));
+  builder.AddPolyline(*MakePolylineOrDie("0:0, 2:2"));
+  builder.AddPolyline(*MakePolylineOrDie("0:2, 2:0"));
+  S2Error error;
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  EXPECT_EQ(vector<string>({"+S2Builder::Build",
+                            "+S2Builder::ChooseSites",
+                            "+S2Builder::AddEdgeCrossings",
+                            "-S2Builder::AddEdgeCrossings",
+                            "+S2Builder::ChooseInitialSites",
+                            "-S2Builder::ChooseInitialSites",
+                            "+S2Builder::CollectSiteEdges",
+                            "-S2Builder::CollectSiteEdges",
+                            "+S2Builder::AddExtraSites",
+                            "-S2Builder::AddExtraSites",
+                            "-S2Builder::ChooseSites",
+                            "+S2Builder::BuildLayers",
+                            "+S2Builder::BuildLayer",
+                            "-S2Builder::BuildLayer",
+                            "-S2Builder::BuildLayers",
+                            "-S2Builder::Build"}),
+            tracer.events());
+  EXPECT_EQ(1, tracer.counts("S2Builder::AddEdgeCrossings").num_crossings);
+  EXPECT_EQ(5, tracer.counts("S2Builder::ChooseSites").num_sites);
+  EXPECT_EQ(2, tracer.counts("S2Builder::Build").num_edges);
+  EXPECT_EQ(5, tracer.counts("S2Builder::BuildLayer").num_sites);
+  EXPECT_EQ(4, tracer.counts("S2Builder::BuildLayer").num_edges);
+  EXPECT_EQ(-1, tracer.counts("S2Builder::BuildLayers").num_edges);
+}
+
 TEST(S2Builder, PushPopLabel) {
   // TODO(b/232074544): Test more thoroughly.
   S2Builder builder;
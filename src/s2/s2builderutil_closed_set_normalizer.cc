@@ -80,7 +80,7 @@ const vector<Graph>& ClosedSetNormalizer::Run(
   if (options_.suppress_lower_dimensions()) {
     // Build the auxiliary data needed to suppress lower-dimensional edges.
     in_edges2_ = g[2].GetInEdgeIds();
-    is_suppressed_.resize(g[0].vertices().size());
+    is_suppressed_.resize(g[0].num_vertices());
     for (int dim = 1; dim <= 2; ++dim) {
       for (int e = 0; e < g[dim].num_edges(); ++e) {
         Edge edge = g[dim].edge(e);
@@ -111,11 +111,10 @@ const vector<Graph>& ClosedSetNormalizer::Run(
     for (int dim = 0; dim < 3; ++dim) {
       // Copy the graphs to ensure that they have the GraphOptions that were
       // originally requested.
-      new_graphs_.push_back(Graph(
-          graph_options_out_[dim], &g[dim].vertices(), &g[dim].edges(),
-          &g[dim].input_edge_id_set_ids(), &g[dim].input_edge_id_set_lexicon(),
-          &g[dim].label_set_ids(), &g[dim].label_set_lexicon(),
-          g[dim].is_full_polygon_predicate()));
+      new_graphs_.push_back(g[dim].WithEdges(
+          graph_options_out_[dim], &g[dim].edges(),
+          &g[dim].input_edge_id_set_ids(),
+          &g[dim].input_edge_id_set_lexicon()));
     }
   } else {
     // Make a copy of input_edge_id_set_lexicon() so that ProcessEdges can
@@ -127,11 +126,9 @@ const vector<Graph>& ClosedSetNormalizer::Run(
                             &new_input_edge_ids_[dim],
                             &new_input_edge_id_set_lexicon_, error);
       }
-      new_graphs_.push_back(Graph(
-          graph_options_out_[dim], &g[dim].vertices(), &new_edges_[dim],
-          &new_input_edge_ids_[dim], &new_input_edge_id_set_lexicon_,
-          &g[dim].label_set_ids(), &g[dim].label_set_lexicon(),
-          g[dim].is_full_polygon_predicate()));
+      new_graphs_.push_back(g[dim].WithEdges(
+          graph_options_out_[dim], &new_edges_[dim],
+          &new_input_edge_ids_[dim], &new_input_edge_id_set_lexicon_));
     }
   }
   return new_graphs_;
@@ -18,6 +18,7 @@
 #include "s2/s2builderutil_find_polygon_degeneracies.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <memory>
 #include <utility>
@@ -27,9 +28,11 @@
 #include "s2/mutable_s2shape_index.h"
 #include "s2/s2builder_graph.h"
 #include "s2/s2builderutil_graph_shape.h"
+#include "s2/s2cell_id.h"
 #include "s2/s2contains_vertex_query.h"
 #include "s2/s2crossing_edge_query.h"
 #include "s2/s2edge_crosser.h"
+#include "s2/s2executor.h"
 #include "s2/s2pointutil.h"
 #include "s2/s2predicates.h"
 
@@ -67,12 +70,21 @@ struct Component {
   // +1 if "root" inside the polygon, -1 if outside, and 0 if unknown.
   int root_sign = 0;
 
+  // The vertices of this component in the order that they were visited,
+  // starting with "root".  The vertex from which each other vertex was
+  // reached is recorded in DegeneracyFinder::parent_.
+  vector<VertexId> vertices;
+
   // The degeneracies found in this component.  "is_hole" is expressed
   // relative to the root vertex: the degeneracy is a hole iff the root vertex
   // turns out to be inside the polygon (i.e., root_sign > 0).
   vector<PolygonDegeneracy> degeneracies;
 };
 
+// The minimum number of component vertices that each thread should classify
+// when components are classified in parallel.
+constexpr int kMinVerticesPerThread = 500;
+
 // The actual implementation of FindPolygonDegeneracies.
 class DegeneracyFinder {
  public:
@@ -85,14 +97,14 @@ class DegeneracyFinder {
   // Methods are documented below.
   int ComputeDegeneracies();
   Component BuildComponent(VertexId root);
+  void ClassifyComponents(vector<Component>* components, int num_vertices);
+  void ClassifyComponent(Component* component);
   bool CrossingParity(VertexId v0, VertexId v1, bool include_same) const;
   VertexId FindUnbalancedVertex() const;
   int ContainsVertexSign(VertexId v0) const;
-  void ComputeUnknownSignsBruteForce(VertexId known_vertex,
-                                     int known_vertex_sign,
-                                     vector<Component>* components) const;
-  void ComputeUnknownSignsIndexed(VertexId known_vertex, int known_vertex_sign,
-                                  vector<Component>* components) const;
+  void ComputeUnknownSigns(VertexId known_vertex, int known_vertex_sign,
+                           int num_unknown_signs,
+                           vector<Component>* components) const;
   vector<PolygonDegeneracy> MergeDegeneracies(
       const vector<Component>& components) const;
 
@@ -102,6 +114,13 @@ class DegeneracyFinder {
   vector<bool> is_vertex_used_;        // Has vertex been visited?
   vector<bool> is_edge_degeneracy_;    // Belongs to a degeneracy?
   vector<bool> is_vertex_unbalanced_;  // Has unbalanced sibling pairs?
+  vector<VertexId> parent_;            // Vertex from which each was reached.
+
+  // Whether each component vertex is on the same side of the polygon
+  // boundary as its root vertex (or -1 if not yet known).  This is a vector
+  // of int8 rather than bool so that components can be classified by
+  // separate threads.
+  vector<int8> same_inside_;
 };
 
 vector<PolygonDegeneracy> DegeneracyFinder::Run(S2Error* error) {
@@ -124,50 +143,52 @@ vector<PolygonDegeneracy> DegeneracyFinder::Run(S2Error* error) {
 
   // Otherwise repeatedly build components starting from an unvisited
   // degeneracy.  (This avoids building components that don't contain any
-  // degeneracies.)  Each component records the "is_hole" status of each
-  // degeneracy relative to the root vertex of that component.  If the
-  // component contains any non-degenerate portions, then we also determine
-  // whether the root vertex is contained by the component (root_sign).
-  // In addition we keep track of the number of components that were
-  // completely degenerate (to help us decide whether to build an index).
+  // degeneracies.)  Building a component only determines its vertices; the
+  // geometric work is done afterwards by ClassifyComponents(), which handles
+  // each component independently (and possibly in parallel).
   vector<Component> components;
-  VertexId known_vertex = -1;
-  int known_vertex_sign = 0;
-  int num_unknown_signs = 0;
+  int num_component_vertices = 0;
   is_vertex_used_.resize(g_.num_vertices());
+  parent_.resize(g_.num_vertices());
   for (int e = 0; e < g_.num_edges(); ++e) {
     if (is_edge_degeneracy_[e]) {
       VertexId root = g_.edge(e).first;
       if (is_vertex_used_[root]) continue;
-      Component component = BuildComponent(root);
-      if (component.root_sign == 0) {
-        ++num_unknown_signs;
-      } else {
-        known_vertex = root;
-        known_vertex_sign = component.root_sign;
-      }
-      components.push_back(component);
+      components.push_back(BuildComponent(root));
+      num_component_vertices += components.back().vertices.size();
+    }
+  }
+
+  // Each component records the "is_hole" status of each degeneracy relative
+  // to the root vertex of that component.  If the component contains any
+  // non-degenerate portions, then we also determine whether the root vertex
+  // is contained by the component (root_sign).  In addition we keep track of
+  // the number of components that were completely degenerate (to help us
+  // decide whether to build an index).
+  ClassifyComponents(&components, num_component_vertices);
+  VertexId known_vertex = -1;
+  int known_vertex_sign = 0;
+  int num_unknown_signs = 0;
+  for (const Component& component : components) {
+    if (component.root_sign == 0) {
+      ++num_unknown_signs;
+    } else {
+      known_vertex = component.root;
+      known_vertex_sign = component.root_sign;
     }
   }
 
   // If some components have an unknown root_sign (i.e., it is unknown whether
   // the root vertex is contained by the polygon or not), we determine the
   // sign of those root vertices by counting crossings starting from a vertex
-  // whose sign is known.  Depending on how many components we need to do this
-  // for, it may be worthwhile to build an index first.
+  // whose sign is known.
   if (num_unknown_signs > 0) {
     if (known_vertex_sign == 0) {
       known_vertex = FindUnbalancedVertex();
       known_vertex_sign = ContainsVertexSign(known_vertex);
     }
-    const int kMaxUnindexedSignComputations = 25;  // Tuned using benchmarks.
-    if (num_unknown_signs <= kMaxUnindexedSignComputations) {
-      ComputeUnknownSignsBruteForce(known_vertex, known_vertex_sign,
-                                    &components);
-    } else {
-      ComputeUnknownSignsIndexed(known_vertex, known_vertex_sign,
-                                 &components);
-    }
+    ComputeUnknownSigns(known_vertex, known_vertex_sign, num_unknown_signs,
+                        &components);
   }
   // Finally we convert the "is_hole" status of each degeneracy from a
   // relative value (compared to the component's root vertex) to an absolute
@@ -206,41 +227,84 @@ int DegeneracyFinder::ComputeDegeneracies() {
   return num_degeneracies;
 }
 
-// Build a connected component starting at the given root vertex.  The
-// information returned includes: the root vertex, whether the containment
-// status of the root vertex could be determined using only the edges in this
-// component, and a vector of the edges that belong to degeneracies along with
-// the shell/hole status of each such edge relative to the root vertex.
+// Builds a connected component starting at the given root vertex.  This
+// only determines the vertices of the component (see Component::vertices);
+// ClassifyComponent() then computes the containment status of the root
+// vertex (if it can be determined using only the edges in this component)
+// and the shell/hole status of each degeneracy relative to the root vertex.
 Component DegeneracyFinder::BuildComponent(VertexId root) {
   Component result;
   result.root = root;
-  // We keep track of the frontier of unexplored vertices, and whether each
-  // vertex is on the same side of the polygon boundary as the root vertex.
-  vector<pair<VertexId, bool>> frontier;
-  frontier.push_back(make_pair(root, true));
+  // We keep track of the frontier of unexplored vertices.
+  vector<VertexId> frontier;
+  frontier.push_back(root);
   is_vertex_used_[root] = true;
+  parent_[root] = -1;
   while (!frontier.empty()) {
-    VertexId v0 = frontier.back().first;
-    bool v0_same_inside = frontier.back().second;  // Same as root vertex?
+    VertexId v0 = frontier.back();
     frontier.pop_back();
-    if (result.root_sign == 0 && is_vertex_unbalanced_[v0]) {
+    result.vertices.push_back(v0);
+    for (EdgeId e : out_.edge_ids(v0)) {
+      VertexId v1 = g_.edge(e).second;
+      if (is_vertex_used_[v1]) continue;
+      frontier.push_back(v1);
+      is_vertex_used_[v1] = true;
+      parent_[v1] = v0;
+    }
+  }
+  return result;
+}
+
+// Classifies the given components using up to the number of threads
+// specified by the graph.  Components do not share any vertices, so they can
+// be classified independently.
+void DegeneracyFinder::ClassifyComponents(vector<Component>* components,
+                                          int num_vertices) {
+  same_inside_.assign(g_.num_vertices(), -1);
+  const int num_components = components->size();
+  const int num_threads = std::max(
+      1, std::min({S2NumThreads(g_.executor(), g_.num_threads()),
+                   num_components, num_vertices / kMinVerticesPerThread}));
+  if (num_threads == 1) {
+    for (Component& component : *components) ClassifyComponent(&component);
+    return;
+  }
+  // Components vary greatly in size, so each thread repeatedly takes the
+  // next unclassified component.
+  std::atomic<int> next(0);
+  S2ParallelFor(g_.executor(), num_threads, [&](int) {
+    for (int i; (i = next++) < num_components;) {
+      ClassifyComponent(&(*components)[i]);
+    }
+  });
+}
+
+// Computes the root_sign and degeneracies of the given component.  Each
+// vertex is on the same side of the polygon boundary as the root vertex iff
+// the path to it from the root crosses the boundary an even number of times.
+void DegeneracyFinder::ClassifyComponent(Component* component) {
+  for (VertexId v0 : component->vertices) {
+    if (v0 == component->root) same_inside_[v0] = true;
+    bool v0_same_inside = same_inside_[v0];  // Same as root vertex?
+    if (component->root_sign == 0 && is_vertex_unbalanced_[v0]) {
       int v0_sign = ContainsVertexSign(v0);
       S2_DCHECK_NE(v0_sign, 0);
-      result.root_sign = v0_same_inside ? v0_sign : -v0_sign;
+      component->root_sign = v0_same_inside ? v0_sign : -v0_sign;
     }
     for (EdgeId e : out_.edge_ids(v0)) {
       VertexId v1 = g_.edge(e).second;
       bool same_inside = v0_same_inside ^ CrossingParity(v0, v1, false);
       if (is_edge_degeneracy_[e]) {
-        result.degeneracies.push_back(PolygonDegeneracy(e, same_inside));
+        component->degeneracies.push_back(PolygonDegeneracy(e, same_inside));
       }
-      if (is_vertex_used_[v1]) continue;
-      same_inside ^= CrossingParity(v1, v0, true);
-      frontier.push_back(make_pair(v1, same_inside));
-      is_vertex_used_[v1] = true;
+      // Each vertex other than the root was first reached from its parent.
+      if (parent_[v1] != v0 || same_inside_[v1] >= 0 ||
+          v1 == component->root) {
+        continue;
+      }
+      same_inside_[v1] = same_inside ^ CrossingParity(v1, v0, true);
     }
   }
-  return result;
 }
 
 // Counts the number of times that (v0, v1) crosses the edges incident to v0,
@@ -295,49 +359,58 @@ int DegeneracyFinder::ContainsVertexSign(VertexId v0) const {
 }
 
 // Determines any unknown signs of component root vertices by counting
-// crossings starting from a vertex whose sign is known.  This version simply
-// tests all edges for crossings.
-void DegeneracyFinder::ComputeUnknownSignsBruteForce(
-    VertexId known_vertex, int known_vertex_sign,
+// crossings starting from a vertex whose sign is known.  Rather than counting
+// the crossings between the known vertex and each root vertex, the root
+// vertices are visited in S2CellId order and the crossings are counted
+// between consecutive vertices.  This makes the query edges much shorter on
+// average, so that when an index is used each query finds few candidates.
+// Depending on how many components we need to do this for, it may be
+// worthwhile to build an index first.
+void DegeneracyFinder::ComputeUnknownSigns(
+    VertexId known_vertex, int known_vertex_sign, int num_unknown_signs,
     vector<Component>* components) const {
-  S2EdgeCrosser crosser;
+  vector<pair<S2CellId, Component*>> unknown;
+  unknown.reserve(num_unknown_signs);
   for (Component& component : *components) {
     if (component.root_sign != 0) continue;
-    bool inside = known_vertex_sign > 0;
-    crosser.Init(&g_.vertex(known_vertex), &g_.vertex(component.root));
-    for (EdgeId e = 0; e < g_.num_edges(); ++e) {
-      if (is_edge_degeneracy_[e]) continue;
-      const Edge& edge = g_.edge(e);
-      inside ^= crosser.EdgeOrVertexCrossing(&g_.vertex(edge.first),
-                                             &g_.vertex(edge.second));
-    }
-    component.root_sign = inside ? 1 : -1;
+    unknown.push_back(
+        make_pair(S2CellId(g_.vertex(component.root)), &component));
   }
-}
+  std::sort(unknown.begin(), unknown.end());
 
-// Like ComputeUnknownSignsBruteForce, except that this method uses an index
-// to find the set of edges that cross a given edge.
-void DegeneracyFinder::ComputeUnknownSignsIndexed(
-    VertexId known_vertex, int known_vertex_sign,
-    vector<Component>* components) const {
+  const int kMaxUnindexedSignComputations = 25;  // Tuned using benchmarks.
   MutableS2ShapeIndex index;
-  index.Add(make_unique<GraphShape>(&g_));
-  S2CrossingEdgeQuery query(&index);
+  std::unique_ptr<S2CrossingEdgeQuery> query;
+  if (num_unknown_signs > kMaxUnindexedSignComputations) {
+    index.Add(make_unique<GraphShape>(&g_));
+    query = make_unique<S2CrossingEdgeQuery>(&index);
+  }
   vector<ShapeEdgeId> crossing_edges;
-  S2EdgeCrosser crosser;
-  for (Component& component : *components) {
-    if (component.root_sign != 0) continue;
-    bool inside = known_vertex_sign > 0;
-    crosser.Init(&g_.vertex(known_vertex), &g_.vertex(component.root));
-    query.GetCandidates(g_.vertex(known_vertex), g_.vertex(component.root),
-                       *index.shape(0), &crossing_edges);
-    for (ShapeEdgeId id : crossing_edges) {
-      int e = id.edge_id;
-      if (is_edge_degeneracy_[e]) continue;
-      inside ^= crosser.EdgeOrVertexCrossing(&g_.vertex(g_.edge(e).first),
-                                             &g_.vertex(g_.edge(e).second));
+  S2CopyingEdgeCrosser crosser;
+  S2Point a = g_.vertex(known_vertex);
+  bool inside = known_vertex_sign > 0;
+  for (const auto& entry : unknown) {
+    Component* component = entry.second;
+    S2Point b = g_.vertex(component->root);
+    crosser.Init(a, b);
+    if (query == nullptr) {
+      for (EdgeId e = 0; e < g_.num_edges(); ++e) {
+        if (is_edge_degeneracy_[e]) continue;
+        const Edge& edge = g_.edge(e);
+        inside ^= crosser.EdgeOrVertexCrossing(g_.vertex(edge.first),
+                                               g_.vertex(edge.second));
+      }
+    } else {
+      query->GetCandidates(a, b, *index.shape(0), &crossing_edges);
+      for (ShapeEdgeId id : crossing_edges) {
+        int e = id.edge_id;
+        if (is_edge_degeneracy_[e]) continue;
+        inside ^= crosser.EdgeOrVertexCrossing(g_.vertex(g_.edge(e).first),
+                                               g_.vertex(g_.edge(e).second));
+      }
     }
-    component.root_sign = inside ? 1 : -1;
+    component->root_sign = inside ? 1 : -1;
+    a = b;
   }
 }
 
@@ -32,6 +32,7 @@
 #include "s2/s2builder_layer.h"
 #include "s2/s2cap.h"
 #include "s2/s2lax_polygon_shape.h"
+#include "s2/s2loop.h"
 #include "s2/s2pointutil.h"
 #include "s2/s2testing.h"
 #include "s2/s2text_format.h"
@@ -181,4 +182,61 @@ TEST(FindPolygonDegeneracies, SiblingPairHolesWithinFull) {
     });
 }
 
+// A layer that checks that every sibling pair is a hole iff it is inside the
+// given loop, and records the degeneracies found.
+class SiblingPairCheckingLayer : public S2Builder::Layer {
+ public:
+  SiblingPairCheckingLayer(const S2Loop* loop,
+                           vector<PolygonDegeneracy>* degeneracies)
+      : loop_(loop), degeneracies_(degeneracies) {
+  }
+  GraphOptions graph_options() const override {
+    return GraphOptions(EdgeType::DIRECTED, DegenerateEdges::DISCARD_EXCESS,
+                        DuplicateEdges::KEEP, SiblingPairs::DISCARD_EXCESS);
+  }
+  void Build(const Graph& g, S2Error* error) override {
+    *degeneracies_ = FindPolygonDegeneracies(g, error);
+    for (const auto& degeneracy : *degeneracies_) {
+      S2Point p = g.vertex(g.edge(degeneracy.edge_id).first);
+      EXPECT_EQ(loop_->Contains(p), degeneracy.is_hole);
+    }
+  }
+
+ private:
+  const S2Loop* loop_;
+  vector<PolygonDegeneracy>* degeneracies_;
+};
+
+TEST(FindPolygonDegeneracies, ManyComponentsWithMultipleThreads) {
+  // Many short isolated sibling pairs inside and outside a loop.  Each pair
+  // is a separate component whose sign must be determined by counting
+  // crossings.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  auto loop = S2Loop::MakeRegularLoop(s2textformat::MakePointOrDie("0:0"),
+                                      S1Angle::Degrees(10), 100);
+  S2Cap cap(loop->GetCentroid().Normalize(), S1Angle::Degrees(20));
+  vector<vector<S2Point>> loops(1);
+  for (int i = 0; i < loop->num_vertices(); ++i) {
+    loops[0].push_back(loop->vertex(i));
+  }
+  for (int i = 0; i < 2000; ++i) {
+    S2Point a = S2Testing::SamplePoint(cap);
+    S2Point b = S2Testing::SamplePoint(S2Cap(a, S1Angle::Degrees(0.01)));
+    loops.push_back({a, b});
+  }
+  vector<PolygonDegeneracy> degeneracies[2];
+  for (int i = 0; i < 2; ++i) {
+    S2Builder::Options options;
+    options.set_num_threads(i ? 4 : 1);
+    S2Builder builder(options);
+    builder.StartLayer(
+        make_unique<SiblingPairCheckingLayer>(loop.get(), &degeneracies[i]));
+    builder.AddShape(S2LaxPolygonShape(loops));
+    S2Error error;
+    ASSERT_TRUE(builder.Build(&error)) << error;
+  }
+  EXPECT_EQ(4000, degeneracies[0].size());
+  EXPECT_EQ(degeneracies[0], degeneracies[1]);
+}
+
 }  // namespace s2builderutil
@@ -0,0 +1,201 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2builderutil_incremental_builder.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1chord_angle.h"
+#include "s2/s2builder_graph.h"
+#include "s2/s2builder_layer.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2edge_vector_shape.h"
+
+using absl::make_unique;
+using std::vector;
+
+namespace s2builderutil {
+
+using Label = IncrementalBuilder::Label;
+
+namespace {
+
+// A layer that returns the snapped edges together with their labels.
+class LabeledEdgeLayer : public S2Builder::Layer {
+ public:
+  LabeledEdgeLayer(vector<S2Shape::Edge>* edges, vector<vector<Label>>* labels)
+      : edges_(edges), labels_(labels) {}
+
+  GraphOptions graph_options() const override {
+    return GraphOptions(S2Builder::EdgeType::DIRECTED,
+                        GraphOptions::DegenerateEdges::DISCARD,
+                        GraphOptions::DuplicateEdges::MERGE,
+                        GraphOptions::SiblingPairs::KEEP);
+  }
+
+  void Build(const Graph& g, S2Error* error) override {
+    Graph::LabelFetcher fetcher(g, S2Builder::EdgeType::DIRECTED);
+    vector<Label> labels;
+    for (Graph::EdgeId e = 0; e < g.num_edges(); ++e) {
+      fetcher.Fetch(e, &labels);
+      edges_->push_back(
+          S2Shape::Edge(g.vertex(g.edge(e).first), g.vertex(g.edge(e).second)));
+      labels_->push_back(labels);
+    }
+  }
+
+ private:
+  vector<S2Shape::Edge>* edges_;
+  vector<vector<Label>>* labels_;
+};
+
+}  // namespace
+
+IncrementalBuilder::IncrementalBuilder(const S2Builder::Options& options)
+    : options_(options) {
+}
+
+void IncrementalBuilder::AddEdge(const S2Point& v0, const S2Point& v1,
+                                 Label label) {
+  added_.push_back({S2Shape::Edge(v0, v1), label});
+}
+
+void IncrementalBuilder::RemoveEdges(Label label) {
+  added_.erase(std::remove_if(added_.begin(), added_.end(),
+                              [label](const InputEdge& input) {
+                                return input.label == label;
+                              }),
+               added_.end());
+  if (built_) removed_.push_back(label);
+}
+
+S1Angle IncrementalBuilder::snap_distance() const {
+  return options_.snap_function().snap_radius() +
+         2 * options_.max_edge_deviation();
+}
+
+bool IncrementalBuilder::Build(S2Error* error) {
+  error->Clear();
+  if (!built_) {
+    vector<S2Shape::Edge> edges;
+    vector<vector<Label>> labels;
+    if (!Snap({}, {}, {}, &edges, &labels, error)) return false;
+    edges_ = std::move(edges);
+    labels_ = std::move(labels);
+    built_ = true;
+    added_.clear();
+    return true;
+  }
+
+  // Remove the labels of the removed edges, and discard output edges that
+  // no longer have any labels.
+  std::sort(removed_.begin(), removed_.end());
+  vector<int> kept;
+  vector<vector<Label>> kept_labels(edges_.size());
+  for (int e = 0; e < edges_.size(); ++e) {
+    for (Label label : labels_[e]) {
+      if (!std::binary_search(removed_.begin(), removed_.end(), label)) {
+        kept_labels[e].push_back(label);
+      }
+    }
+    if (!kept_labels[e].empty()) kept.push_back(e);
+  }
+
+  // Find the output edges near the added edges, which need to be re-snapped.
+  vector<bool> resnap(edges_.size(), false);
+  if (!added_.empty()) {
+    auto added_shape = make_unique<S2EdgeVectorShape>();
+    for (const InputEdge& input : added_) {
+      added_shape->Add(input.edge.v0, input.edge.v1);
+    }
+    MutableS2ShapeIndex added_index;
+    added_index.Add(std::move(added_shape));
+    S2ClosestEdgeQuery query(&added_index);
+    S1ChordAngle limit(snap_distance());
+    for (int e : kept) {
+      S2ClosestEdgeQuery::EdgeTarget target(edges_[e].v0, edges_[e].v1);
+      resnap[e] = query.IsConservativeDistanceLessOrEqual(&target, limit);
+    }
+  }
+
+  // Vertices shared with edges that are not re-snapped must not move.
+  vector<S2Point> fixed_vertices;
+  vector<int> resnapped;
+  for (int e : kept) {
+    if (resnap[e]) {
+      resnapped.push_back(e);
+    } else {
+      fixed_vertices.push_back(edges_[e].v0);
+      fixed_vertices.push_back(edges_[e].v1);
+    }
+  }
+  std::sort(fixed_vertices.begin(), fixed_vertices.end());
+  vector<S2Point> forced_vertices;
+  for (int e : resnapped) {
+    for (const S2Point& v : {edges_[e].v0, edges_[e].v1}) {
+      if (std::binary_search(fixed_vertices.begin(), fixed_vertices.end(),
+                             v)) {
+        forced_vertices.push_back(v);
+      }
+    }
+  }
+
+  vector<S2Shape::Edge> edges;
+  vector<vector<Label>> labels;
+  if (!Snap(resnapped, kept_labels, forced_vertices, &edges, &labels, error)) {
+    return false;
+  }
+
+  // Splice the re-snapped edges into the edges that were not affected.
+  for (int e : kept) {
+    if (resnap[e]) continue;
+    edges.push_back(edges_[e]);
+    labels.push_back(std::move(kept_labels[e]));
+  }
+  edges_ = std::move(edges);
+  labels_ = std::move(labels);
+  added_.clear();
+  removed_.clear();
+  return true;
+}
+
+// Snaps the given output edges (with labels "edge_labels") together with the
+// added input edges.
+bool IncrementalBuilder::Snap(const vector<int>& resnapped,
+                              const vector<vector<Label>>& edge_labels,
+                              const vector<S2Point>& forced_vertices,
+                              vector<S2Shape::Edge>* edges,
+                              vector<vector<Label>>* labels, S2Error* error) {
+  S2Builder builder(options_);
+  builder.StartLayer(make_unique<LabeledEdgeLayer>(edges, labels));
+  for (const S2Point& v : forced_vertices) builder.ForceVertex(v);
+  for (int e : resnapped) {
+    builder.clear_labels();
+    for (Label label : edge_labels[e]) builder.push_label(label);
+    builder.AddEdge(edges_[e].v0, edges_[e].v1);
+  }
+  for (const InputEdge& input : added_) {
+    builder.set_label(input.label);
+    builder.AddEdge(input.edge.v0, input.edge.v1);
+  }
+  return builder.Build(error);
+}
+
+}  // namespace s2builderutil
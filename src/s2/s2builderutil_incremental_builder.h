@@ -0,0 +1,133 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2BUILDERUTIL_INCREMENTAL_BUILDER_H_
+#define S2_S2BUILDERUTIL_INCREMENTAL_BUILDER_H_
+
+#include <vector>
+
+#include "absl/types/span.h"
+#include "s2/s1angle.h"
+#include "s2/s2builder.h"
+#include "s2/s2error.h"
+#include "s2/s2point.h"
+#include "s2/s2shape.h"
+
+namespace s2builderutil {
+
+// IncrementalBuilder snaps a collection of labeled edges (such as a road
+// network) and then keeps the snapped result up to date as edges are added
+// and removed, without re-snapping the whole collection after every edit.
+//
+// The first call to Build() snaps all the edges added so far using an
+// S2Builder with the given options.  Each later call to Build() only
+// re-snaps the previous output edges that are within snap_distance() of the
+// newly added edges, together with the new edges themselves.  The vertices
+// that these edges share with the rest of the output are kept fixed (using
+// S2Builder::ForceVertex), and the result is spliced into the previous
+// output.  Only the neighborhood of an edit is snapped, rather than the
+// entire input.  However each call to Build() still examines every output
+// edge and sorts the vertices of the edges that are not re-snapped, so an
+// edit also costs O(n log n) time where "n" is the number of output edges
+// (which is much cheaper than snapping them).
+//
+// The output satisfies the same guarantees as a full S2Builder run with
+// respect to the current input edges (e.g., all vertices are separated by
+// at least min_vertex_separation(), and crossing edges are split when
+// split_crossing_edges() is true).  However it is not necessarily identical
+// to the result of a full rebuild, since vertices that were created for
+// edges that have since been removed are not removed from the other edges.
+//
+// The output is a set of directed edges, each labeled with the labels of
+// the input edges that snapped to it.  Degenerate edges are discarded and
+// duplicate edges are merged.
+//
+// Example usage:
+//
+//   S2Builder::Options options(s2builderutil::IntLatLngSnapFunction(7));
+//   options.set_split_crossing_edges(true);
+//   IncrementalBuilder builder(options);
+//   for (const Road& road : roads) builder.AddEdge(road.a, road.b, road.id);
+//   S2Error error;
+//   if (!builder.Build(&error)) { ... }
+//   ...
+//   builder.RemoveEdges(edited.id);
+//   builder.AddEdge(edited.a, edited.b, edited.id);
+//   if (!builder.Build(&error)) { ... }
+class IncrementalBuilder {
+ public:
+  using Label = S2Builder::Label;
+
+  // REQUIRES: options.snap_function() is idempotent, i.e. snapping a vertex
+  //           that has already been snapped returns the same vertex.  This
+  //           is true of all the standard snap functions.
+  explicit IncrementalBuilder(const S2Builder::Options& options);
+
+  const S2Builder::Options& options() const { return options_; }
+
+  // Adds an input edge with the given label.  The edge takes effect when
+  // Build() is next called.  Several edges may have the same label (for
+  // example, the edges of one polyline).
+  void AddEdge(const S2Point& v0, const S2Point& v1, Label label);
+
+  // Removes all input edges with the given label (including any that were
+  // added since Build() was last called).  The removal takes effect when
+  // Build() is next called.
+  void RemoveEdges(Label label);
+
+  // Updates the output to reflect the edges added and removed since the
+  // last call.  Returns false and sets "error" if S2Builder reports an
+  // error, in which case the output and the pending edits are unchanged.
+  bool Build(S2Error* error);
+
+  // The distance from the new input edges within which previous output
+  // edges are re-snapped.  New sites are within the vertex snap radius of
+  // the new edges, and other edges are only affected by a site if they pass
+  // within the edge snap radius of it.  Conversely the snapped new edges
+  // move by at most max_edge_deviation() and must stay further than
+  // min_edge_vertex_separation() from other vertices.  Both quantities are
+  // bounded by max_edge_deviation(), giving a distance of
+  // snap_radius() + 2 * max_edge_deviation().
+  S1Angle snap_distance() const;
+
+  // The current output edges.  The labels of each edge are sorted and
+  // deduplicated.
+  int num_edges() const { return static_cast<int>(edges_.size()); }
+  const S2Shape::Edge& edge(int e) const { return edges_[e]; }
+  absl::Span<const Label> labels(int e) const { return labels_[e]; }
+
+ private:
+  struct InputEdge {
+    S2Shape::Edge edge;
+    Label label;
+  };
+
+  bool Snap(const std::vector<int>& resnapped,
+            const std::vector<std::vector<Label>>& edge_labels,
+            const std::vector<S2Point>& forced_vertices,
+            std::vector<S2Shape::Edge>* edges,
+            std::vector<std::vector<Label>>* labels, S2Error* error);
+
+  S2Builder::Options options_;
+  bool built_ = false;
+  std::vector<InputEdge> added_;
+  std::vector<Label> removed_;
+  std::vector<S2Shape::Edge> edges_;
+  std::vector<std::vector<Label>> labels_;
+};
+
+}  // namespace s2builderutil
+
+#endif  // S2_S2BUILDERUTIL_INCREMENTAL_BUILDER_H_
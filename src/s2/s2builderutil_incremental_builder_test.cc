@@ -0,0 +1,241 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2builderutil_incremental_builder.h"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "s2/s1angle.h"
+#include "s2/s1chord_angle.h"
+#include "s2/s2builder.h"
+#include "s2/s2builderutil_snap_functions.h"
+#include "s2/s2cap.h"
+#include "s2/s2edge_crossings.h"
+#include "s2/s2error.h"
+#include "s2/s2latlng.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using s2textformat::MakePointOrDie;
+using std::set;
+using std::vector;
+
+namespace s2builderutil {
+
+namespace {
+
+using Label = IncrementalBuilder::Label;
+
+// Returns the output edges as (v0, v1, labels) tuples in sorted order.
+vector<std::pair<std::pair<S2Point, S2Point>, vector<Label>>> SortedEdges(
+    const IncrementalBuilder& builder) {
+  vector<std::pair<std::pair<S2Point, S2Point>, vector<Label>>> result;
+  for (int e = 0; e < builder.num_edges(); ++e) {
+    auto labels = builder.labels(e);
+    result.push_back({{builder.edge(e).v0, builder.edge(e).v1},
+                      vector<Label>(labels.begin(), labels.end())});
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// Returns the index of the first output edge with the given label, or -1.
+int FindEdge(const IncrementalBuilder& builder, Label label) {
+  for (int e = 0; e < builder.num_edges(); ++e) {
+    auto labels = builder.labels(e);
+    if (std::count(labels.begin(), labels.end(), label)) return e;
+  }
+  return -1;
+}
+
+// Checks that no two output edges cross and that all output vertices are
+// separated by at least the minimum vertex separation.
+void ExpectValidOutput(const IncrementalBuilder& builder) {
+  set<S2Point> vertex_set;
+  for (int e = 0; e < builder.num_edges(); ++e) {
+    vertex_set.insert(builder.edge(e).v0);
+    vertex_set.insert(builder.edge(e).v1);
+    for (int f = 0; f < e; ++f) {
+      EXPECT_LE(S2::CrossingSign(builder.edge(e).v0, builder.edge(e).v1,
+                                 builder.edge(f).v0, builder.edge(f).v1),
+                0);
+    }
+  }
+  vector<S2Point> vertices(vertex_set.begin(), vertex_set.end());
+  S1ChordAngle min_separation(
+      builder.options().snap_function().min_vertex_separation());
+  for (int i = 0; i < vertices.size(); ++i) {
+    for (int j = 0; j < i; ++j) {
+      EXPECT_GE(S1ChordAngle(vertices[i], vertices[j]), min_separation);
+    }
+  }
+}
+
+TEST(IncrementalBuilder, InitialBuildMatchesS2Builder) {
+  S2Builder::Options options(IntLatLngSnapFunction(1));
+  IncrementalBuilder builder(options);
+  builder.AddEdge(MakePointOrDie("0:0"), MakePointOrDie("0:10.03"), 1);
+  builder.AddEdge(MakePointOrDie("0:10.03"), MakePointOrDie("10:10"), 2);
+  S2Error error;
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  ASSERT_EQ(2, builder.num_edges());
+  int e = FindEdge(builder, 1);
+  ASSERT_GE(e, 0);
+  EXPECT_EQ(MakePointOrDie("0:0"), builder.edge(e).v0);
+  EXPECT_EQ(MakePointOrDie("0:10"), builder.edge(e).v1);
+  EXPECT_EQ(1, builder.labels(e).size());
+}
+
+TEST(IncrementalBuilder, AddCrossingEdge) {
+  S2Builder::Options options(IntLatLngSnapFunction(2));
+  options.set_split_crossing_edges(true);
+  IncrementalBuilder builder(options);
+  builder.AddEdge(MakePointOrDie("0:0"), MakePointOrDie("0:10"), 1);
+  builder.AddEdge(MakePointOrDie("30:30"), MakePointOrDie("30:31"), 2);
+  S2Error error;
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  S2Shape::Edge far_edge = builder.edge(1);
+
+  // The new edge crosses edge 1 but is far from edge 2.
+  builder.AddEdge(MakePointOrDie("-5:5"), MakePointOrDie("5:5"), 3);
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  ExpectValidOutput(builder);
+  EXPECT_EQ(5, builder.num_edges());
+  int num_at_crossing = 0;
+  for (int e = 0; e < builder.num_edges(); ++e) {
+    if (builder.edge(e).v1 == MakePointOrDie("0:5")) ++num_at_crossing;
+  }
+  EXPECT_EQ(2, num_at_crossing);
+  auto edges = SortedEdges(builder);
+  EXPECT_TRUE(std::count(edges.begin(), edges.end(),
+                         std::make_pair(std::make_pair(far_edge.v0,
+                                                       far_edge.v1),
+                                        vector<Label>{2})));
+}
+
+TEST(IncrementalBuilder, RemoveAndReplaceEdges) {
+  S2Builder::Options options(IntLatLngSnapFunction(2));
+  IncrementalBuilder builder(options);
+  builder.AddEdge(MakePointOrDie("0:0"), MakePointOrDie("0:10"), 1);
+  builder.AddEdge(MakePointOrDie("0:0"), MakePointOrDie("0:10"), 2);
+  builder.AddEdge(MakePointOrDie("5:0"), MakePointOrDie("5:10"), 3);
+  S2Error error;
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  ASSERT_EQ(2, builder.num_edges());
+
+  // Removing one of two merged edges keeps the edge with the other label.
+  builder.RemoveEdges(1);
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  ASSERT_EQ(2, builder.num_edges());
+  EXPECT_EQ(-1, FindEdge(builder, 1));
+  int e = FindEdge(builder, 2);
+  ASSERT_GE(e, 0);
+  EXPECT_EQ(1, builder.labels(e).size());
+
+  // Replacing an edge with the same label.
+  builder.RemoveEdges(3);
+  builder.AddEdge(MakePointOrDie("6:0"), MakePointOrDie("6:10"), 3);
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  ASSERT_EQ(2, builder.num_edges());
+  e = FindEdge(builder, 3);
+  ASSERT_GE(e, 0);
+  EXPECT_EQ(MakePointOrDie("6:0"), builder.edge(e).v0);
+
+  // Edges removed before they are built are never added.
+  builder.AddEdge(MakePointOrDie("7:0"), MakePointOrDie("7:10"), 4);
+  builder.RemoveEdges(4);
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  EXPECT_EQ(2, builder.num_edges());
+}
+
+TEST(IncrementalBuilder, NoCrossingsAfterEdits) {
+  // Builds a grid one edge at a time, where each new edge crosses several
+  // existing edges, and checks after every edit that the crossings have
+  // been split.
+  S2Builder::Options options(IntLatLngSnapFunction(1));
+  options.set_split_crossing_edges(true);
+  IncrementalBuilder builder(options);
+  auto point = [](double lat, double lng) {
+    return S2LatLng::FromDegrees(lat, lng).ToPoint();
+  };
+  for (int i = 1; i <= 4; ++i) {
+    builder.AddEdge(point(i, 0), point(i, 5), i);
+  }
+  S2Error error;
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  for (int j = 1; j <= 4; ++j) {
+    builder.AddEdge(point(0, j), point(5, j), 10 + j);
+    ASSERT_TRUE(builder.Build(&error)) << error;
+    ExpectValidOutput(builder);
+    // Each horizontal edge is split by the "j" vertical edges, and each
+    // vertical edge is split by the 4 horizontal edges.
+    EXPECT_EQ(4 * (j + 1) + 5 * j, builder.num_edges());
+  }
+
+  // Moving a horizontal edge splits the vertical edges at new points.  (The
+  // vertical edges keep the vertices where the old edge crossed them.)
+  builder.RemoveEdges(2);
+  builder.AddEdge(point(2.5, 0), point(2.5, 5), 2);
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  ExpectValidOutput(builder);
+  EXPECT_EQ(4 * 5 + 6 * 4, builder.num_edges());
+}
+
+TEST(IncrementalBuilder, RandomEdits) {
+  // Applies random edits to a random network and checks that the output
+  // remains valid and contains exactly the labels of the current edges.
+  for (int iter = 0; iter < 10; ++iter) {
+    S2Testing::rnd.Reset(iter + 1);
+    S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(1));
+    S2Builder::Options options(IntLatLngSnapFunction(
+        IntLatLngSnapFunction::ExponentForMaxSnapRadius(
+            S1Angle::Degrees(0.01))));
+    options.set_split_crossing_edges(true);
+    IncrementalBuilder builder(options);
+    set<Label> labels;
+    Label next_label = 0;
+    auto add_random_edge = [&]() {
+      builder.AddEdge(S2Testing::SamplePoint(cap),
+                      S2Testing::SamplePoint(cap), next_label);
+      labels.insert(next_label++);
+    };
+    for (int i = 0; i < 30; ++i) add_random_edge();
+    S2Error error;
+    ASSERT_TRUE(builder.Build(&error)) << error;
+    for (int edit = 0; edit < 10; ++edit) {
+      if (S2Testing::rnd.OneIn(2)) {
+        Label label = *std::next(labels.begin(),
+                                 S2Testing::rnd.Uniform(labels.size()));
+        builder.RemoveEdges(label);
+        labels.erase(label);
+      }
+      add_random_edge();
+      ASSERT_TRUE(builder.Build(&error)) << error;
+      ExpectValidOutput(builder);
+      set<Label> output_labels;
+      for (int e = 0; e < builder.num_edges(); ++e) {
+        for (Label label : builder.labels(e)) output_labels.insert(label);
+      }
+      EXPECT_EQ(labels, output_labels);
+    }
+  }
+}
+
+}  // namespace
+
+}  // namespace s2builderutil
@@ -0,0 +1,127 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2builderutil_lod_builder.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "s2/base/logging.h"
+#include "s2/s2builderutil_lax_polyline_layer.h"
+#include "s2/s2builderutil_s2point_vector_layer.h"
+#include "s2/s2builderutil_snap_functions.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2lax_polygon_shape.h"
+#include "s2/s2lax_polyline_shape.h"
+#include "s2/s2point_vector_shape.h"
+
+using absl::make_unique;
+using std::unique_ptr;
+using std::vector;
+
+namespace s2builderutil {
+
+LevelOfDetailBuilder::Options::Options() {
+}
+
+LevelOfDetailBuilder::LevelOfDetailBuilder(vector<int> levels,
+                                           const Options& options)
+    : levels_(std::move(levels)), options_(options) {
+  for (int i = 0; i < levels_.size(); ++i) {
+    S2_DCHECK_GE(levels_[i], 0);
+    S2_DCHECK_LE(levels_[i], S2CellId::kMaxLevel);
+    if (i > 0) S2_DCHECK_LT(levels_[i], levels_[i - 1]);
+  }
+}
+
+bool LevelOfDetailBuilder::Build(
+    const S2ShapeIndex& input, vector<unique_ptr<MutableS2ShapeIndex>>* output,
+    S2Error* error) {
+  output->clear();
+  error->Clear();
+  const S2ShapeIndex* previous = &input;
+  for (int level : levels_) {
+    auto index = make_unique<MutableS2ShapeIndex>();
+    if (!BuildLevel(*previous, level, index.get(), error)) return false;
+    output->push_back(std::move(index));
+    previous = output->back().get();
+  }
+  return true;
+}
+
+bool LevelOfDetailBuilder::BuildLevel(const S2ShapeIndex& input, int level,
+                                      MutableS2ShapeIndex* output,
+                                      S2Error* error) {
+  S2Builder::Options builder_options = options_.builder_options();
+  builder_options.set_snap_function(S2CellIdSnapFunction(level));
+  builder_.Init(builder_options);
+
+  // Each input shape is built in its own layer.  Points are collected in
+  // "points" and converted to shapes after the layers have been built.
+  const int num_shape_ids = input.num_shape_ids();
+  vector<unique_ptr<S2Shape>> shapes(num_shape_ids);
+  vector<vector<S2Point>> points(num_shape_ids);
+  for (int id = 0; id < num_shape_ids; ++id) {
+    const S2Shape* shape = input.shape(id);
+    if (shape == nullptr) continue;
+    switch (shape->dimension()) {
+      case 0:
+        builder_.StartLayer(make_unique<S2PointVectorLayer>(&points[id]));
+        break;
+      case 1: {
+        if (shape->num_chains() > 1) {
+          error->Init(S2Error::INVALID_ARGUMENT,
+                      "Shape %d is a polyline with %d chains", id,
+                      shape->num_chains());
+          return false;
+        }
+        auto polyline = make_unique<S2LaxPolylineShape>();
+        builder_.StartLayer(make_unique<LaxPolylineLayer>(polyline.get()));
+        shapes[id] = std::move(polyline);
+        break;
+      }
+      default: {
+        auto polygon = make_unique<S2LaxPolygonShape>();
+        builder_.StartLayer(make_unique<LaxPolygonLayer>(
+            polygon.get(), options_.polygon_options()));
+        builder_.AddIsFullPolygonPredicate(
+            S2Builder::IsFullPolygon(shape->is_full()));
+        shapes[id] = std::move(polygon);
+        break;
+      }
+    }
+    builder_.AddShape(*shape);
+  }
+  if (!builder_.Build(error)) return false;
+
+  for (int id = 0; id < num_shape_ids; ++id) {
+    const S2Shape* shape = input.shape(id);
+    if (shape == nullptr) {
+      // Keep the shape ids of the input by adding a placeholder shape and
+      // then removing it.
+      output->Add(make_unique<S2PointVectorShape>());
+      output->Release(id);
+    } else if (shape->dimension() == 0) {
+      output->Add(make_unique<S2PointVectorShape>(std::move(points[id])));
+    } else {
+      output->Add(std::move(shapes[id]));
+    }
+  }
+  return true;
+}
+
+}  // namespace s2builderutil
@@ -0,0 +1,134 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2BUILDERUTIL_LOD_BUILDER_H_
+#define S2_S2BUILDERUTIL_LOD_BUILDER_H_
+
+#include <memory>
+#include <vector>
+
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s2builder.h"
+#include "s2/s2builderutil_lax_polygon_layer.h"
+#include "s2/s2error.h"
+#include "s2/s2shape_index.h"
+
+namespace s2builderutil {
+
+// LevelOfDetailBuilder snaps a collection of geometry to a sequence of
+// increasingly coarse S2CellId levels, producing one MutableS2ShapeIndex per
+// level.  This is useful for generating map tiles at several zoom levels.
+//
+// Rather than snapping the input geometry once for every level, each level
+// is snapped from the output of the previous (finer) level.  Since the finer
+// output has typically far fewer vertices than the input (especially when
+// simplify_edge_chains() is enabled), the total cost is usually not much more
+// than snapping the input once.  The same S2Builder is reused for all levels
+// so that its internal storage is only allocated once.
+//
+// Because each level is snapped from the previous one, the vertices of each
+// level are within the sum of the snap radii of all levels so far from the
+// input geometry (rather than just the snap radius of that level).  With
+// S2CellIdSnapFunction the snap radius halves with each finer level, so this
+// is at most about twice the snap radius of the coarsest level produced so far.
+//
+// Each output index has the same number of shape ids as the input index, and
+// shape i of each output index is the snapped version of input shape i:
+//
+//  - points (dimension 0) are returned as S2PointVectorShapes,
+//  - polylines (dimension 1) as S2LaxPolylineShapes, and
+//  - polygons (dimension 2) as S2LaxPolygonShapes.
+//
+// Shapes that collapse entirely are returned as empty shapes, and shape ids
+// that are missing from the input (i.e. removed shapes) are also missing
+// from the output.
+//
+// Example usage:
+//
+//   LevelOfDetailBuilder::Options options;
+//   S2Builder::Options builder_options;
+//   builder_options.set_simplify_edge_chains(true);
+//   options.set_builder_options(builder_options);
+//   LevelOfDetailBuilder builder({20, 18, 16, 14}, options);
+//   vector<unique_ptr<MutableS2ShapeIndex>> levels;
+//   S2Error error;
+//   if (!builder.Build(input_index, &levels, &error)) { ... }
+class LevelOfDetailBuilder {
+ public:
+  class Options {
+   public:
+    Options();
+
+    // The S2Builder options used to snap each level.  The snap function is
+    // replaced by an S2CellIdSnapFunction for the level being built.
+    //
+    // DEFAULT: S2Builder::Options()
+    const S2Builder::Options& builder_options() const {
+      return builder_options_;
+    }
+    void set_builder_options(const S2Builder::Options& builder_options) {
+      builder_options_ = builder_options;
+    }
+
+    // The options used to assemble polygons.  Polygons that collapse to
+    // degenerate boundaries at coarse levels can be removed by setting
+    // degenerate_boundaries() to DISCARD.
+    //
+    // DEFAULT: LaxPolygonLayer::Options()
+    const LaxPolygonLayer::Options& polygon_options() const {
+      return polygon_options_;
+    }
+    void set_polygon_options(const LaxPolygonLayer::Options& polygon_options) {
+      polygon_options_ = polygon_options;
+    }
+
+   private:
+    S2Builder::Options builder_options_;
+    LaxPolygonLayer::Options polygon_options_;
+  };
+
+  // Specifies the S2CellId levels to snap to, from finest to coarsest.
+  //
+  // REQUIRES: "levels" is strictly decreasing and each level is in the range
+  //           [0, S2CellId::kMaxLevel].
+  explicit LevelOfDetailBuilder(std::vector<int> levels,
+                                const Options& options = Options());
+
+  const std::vector<int>& levels() const { return levels_; }
+  const Options& options() const { return options_; }
+
+  // Snaps the geometry in "input" to each level, setting (*output)[i] to the
+  // geometry snapped to levels()[i].  Returns false and sets "error" if an
+  // error occurs, in which case "output" contains the levels that were built
+  // successfully.
+  //
+  // REQUIRES: Every 1-dimensional input shape has at most one chain (an
+  //           INVALID_ARGUMENT error is returned otherwise).
+  bool Build(const S2ShapeIndex& input,
+             std::vector<std::unique_ptr<MutableS2ShapeIndex>>* output,
+             S2Error* error);
+
+ private:
+  bool BuildLevel(const S2ShapeIndex& input, int level,
+                  MutableS2ShapeIndex* output, S2Error* error);
+
+  std::vector<int> levels_;
+  Options options_;
+  S2Builder builder_;
+};
+
+}  // namespace s2builderutil
+
+#endif  // S2_S2BUILDERUTIL_LOD_BUILDER_H_
@@ -0,0 +1,133 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2builderutil_lod_builder.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2builderutil_snap_functions.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2edge_vector_shape.h"
+#include "s2/s2error.h"
+#include "s2/s2loop.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using s2textformat::MakeIndexOrDie;
+using std::unique_ptr;
+using std::vector;
+
+namespace s2builderutil {
+
+namespace {
+
+TEST(LevelOfDetailBuilder, SnapsEachLevelFromThePrevious) {
+  auto input = MakeIndexOrDie(
+      "1:2 | 1.5:2.5 # 0:0, 0.3:5, 0.1:10, 1:20 # 0:0, 0:10, 10:10, 10:0");
+  input->Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+      S2LatLng::FromDegrees(-20, 30).ToPoint(), S1Angle::Degrees(5), 1000)));
+  const vector<int> levels = {20, 15, 10, 5};
+  LevelOfDetailBuilder::Options options;
+  S2Builder::Options builder_options;
+  builder_options.set_simplify_edge_chains(true);
+  options.set_builder_options(builder_options);
+  LevelOfDetailBuilder builder(levels, options);
+
+  vector<unique_ptr<MutableS2ShapeIndex>> output;
+  S2Error error;
+  ASSERT_TRUE(builder.Build(*input, &output, &error)) << error;
+  ASSERT_EQ(levels.size(), output.size());
+  S1Angle max_error = S1Angle::Zero();
+  for (int i = 0; i < levels.size(); ++i) {
+    const MutableS2ShapeIndex& index = *output[i];
+    ASSERT_EQ(input->num_shape_ids(), index.num_shape_ids());
+    max_error += S2CellIdSnapFunction(levels[i]).snap_radius();
+    S2ClosestEdgeQuery query(input.get());
+    query.mutable_options()->set_include_interiors(false);
+    int num_vertices = 0;
+    for (int id = 0; id < index.num_shape_ids(); ++id) {
+      const S2Shape& shape = *index.shape(id);
+      EXPECT_EQ(input->shape(id)->dimension(), shape.dimension());
+      for (int e = 0; e < shape.num_edges(); ++e) {
+        // Every vertex is the center of a cell at this level, and is close
+        // to the input geometry.
+        S2Point v = shape.edge(e).v0;
+        EXPECT_EQ(S2CellId(v).parent(levels[i]).ToPoint(), v);
+        S2ClosestEdgeQuery::PointTarget target(v);
+        EXPECT_LE(query.GetDistance(&target).ToAngle(),
+                  max_error + S1Angle::Radians(1e-15));
+        ++num_vertices;
+      }
+    }
+    // The regular loop is simplified at coarser levels.
+    if (i == 0) {
+      EXPECT_GT(num_vertices, 900);
+    }
+    if (i == levels.size() - 1) {
+      EXPECT_LT(num_vertices, 100);
+    }
+  }
+}
+
+TEST(LevelOfDetailBuilder, PreservesShapeIds) {
+  auto input = MakeIndexOrDie("1:2 # 0:0, 0:1 | 5:5, 5:6 # 0:0, 0:1, 1:0");
+  input->Release(1);
+  // The polygons collapse at the coarsest level and are discarded.
+  input->Add(s2textformat::MakeLaxPolygonOrDie("30:30, 30:30.001, 30.001:30"));
+  LevelOfDetailBuilder::Options options;
+  LaxPolygonLayer::Options polygon_options;
+  polygon_options.set_degenerate_boundaries(
+      LaxPolygonLayer::Options::DegenerateBoundaries::DISCARD);
+  options.set_polygon_options(polygon_options);
+  LevelOfDetailBuilder builder({20, 2}, options);
+  vector<unique_ptr<MutableS2ShapeIndex>> output;
+  S2Error error;
+  ASSERT_TRUE(builder.Build(*input, &output, &error)) << error;
+  ASSERT_EQ(2, output.size());
+  for (const auto& index : output) {
+    ASSERT_EQ(5, index->num_shape_ids());
+    EXPECT_EQ(1, index->shape(0)->num_edges());
+    EXPECT_EQ(nullptr, index->shape(1));
+    EXPECT_EQ(1, index->shape(2)->num_edges());
+  }
+  EXPECT_EQ(3, output[0]->shape(3)->num_edges());
+  EXPECT_EQ(3, output[0]->shape(4)->num_edges());
+  EXPECT_EQ(0, output[1]->shape(3)->num_edges());
+  EXPECT_EQ(0, output[1]->shape(4)->num_edges());
+}
+
+TEST(LevelOfDetailBuilder, MultiChainPolylineIsAnError) {
+  MutableS2ShapeIndex input;
+  auto edges = make_unique<S2EdgeVectorShape>();
+  edges->Add(S2Point(1, 0, 0), S2Point(0, 1, 0));
+  edges->Add(S2Point(0, 0, 1), S2Point(0, 1, 0));
+  input.Add(std::move(edges));
+  LevelOfDetailBuilder builder({10});
+  vector<unique_ptr<MutableS2ShapeIndex>> output;
+  S2Error error;
+  EXPECT_FALSE(builder.Build(input, &output, &error));
+  EXPECT_EQ(S2Error::INVALID_ARGUMENT, error.code());
+  EXPECT_TRUE(output.empty());
+}
+
+}  // namespace
+
+}  // namespace s2builderutil
@@ -0,0 +1,85 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2builderutil_polyline_callback_layer.h"
+
+#include <utility>
+#include <vector>
+
+#include "s2/base/logging.h"
+#include "s2/s2polyline.h"
+
+using std::vector;
+
+using Graph = S2Builder::Graph;
+using GraphOptions = S2Builder::GraphOptions;
+using Label = S2Builder::Label;
+
+using DegenerateEdges = GraphOptions::DegenerateEdges;
+
+using EdgeId = Graph::EdgeId;
+
+namespace s2builderutil {
+
+PolylineCallbackLayer::PolylineCallbackLayer(PolylineCallback callback,
+                                             const Options& options)
+    : PolylineCallbackLayer(std::move(callback), nullptr, options) {}
+
+PolylineCallbackLayer::PolylineCallbackLayer(PolylineCallback callback,
+                                             IdSetLexicon* label_set_lexicon,
+                                             const Options& options)
+    : callback_(std::move(callback)),
+      label_set_lexicon_(label_set_lexicon),
+      options_(options) {
+  S2_DCHECK(callback_);
+}
+
+GraphOptions PolylineCallbackLayer::graph_options() const {
+  return GraphOptions(options_.edge_type(), DegenerateEdges::DISCARD,
+                      options_.duplicate_edges(), options_.sibling_pairs());
+}
+
+void PolylineCallbackLayer::Build(const Graph& g, S2Error* error) {
+  // Only the edge ids of each polyline are materialized here; the vertices
+  // and labels are generated one polyline at a time.
+  vector<Graph::EdgePolyline> edge_polylines =
+      g.GetPolylines(options_.polyline_type());
+  Graph::LabelFetcher fetcher(g, options_.edge_type());
+  vector<S2Point> vertices;  // Temporary storage for vertices.
+  vector<Label> labels;  // Temporary storage for labels.
+  vector<LabelSetId> label_set_ids;  // Temporary storage for label set ids.
+  for (const auto& edge_polyline : edge_polylines) {
+    vertices.clear();
+    vertices.push_back(g.vertex(g.edge(edge_polyline[0]).first));
+    for (EdgeId e : edge_polyline) {
+      vertices.push_back(g.vertex(g.edge(e).second));
+    }
+    if (options_.validate()) {
+      S2Polyline(vertices, S2Debug::DISABLE).FindValidationError(error);
+      if (!error->ok()) return;
+    }
+    label_set_ids.clear();
+    if (label_set_lexicon_) {
+      for (EdgeId e : edge_polyline) {
+        fetcher.Fetch(e, &labels);
+        label_set_ids.push_back(label_set_lexicon_->Add(labels));
+      }
+    }
+    callback_(vertices, label_set_ids, error);
+    if (!error->ok()) return;
+  }
+}
+
+}  // namespace s2builderutil
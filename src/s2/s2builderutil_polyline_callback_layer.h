@@ -0,0 +1,96 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2BUILDERUTIL_POLYLINE_CALLBACK_LAYER_H_
+#define S2_S2BUILDERUTIL_POLYLINE_CALLBACK_LAYER_H_
+
+#include <functional>
+
+#include "absl/types/span.h"
+#include "s2/id_set_lexicon.h"
+#include "s2/s2builder.h"
+#include "s2/s2builder_graph.h"
+#include "s2/s2builder_layer.h"
+#include "s2/s2builderutil_s2polyline_vector_layer.h"
+#include "s2/s2error.h"
+#include "s2/s2point.h"
+
+namespace s2builderutil {
+
+// A layer type that assembles edges into polylines exactly like
+// S2PolylineVectorLayer, except that rather than collecting the polylines in
+// a vector, each polyline is passed to a client-supplied callback as soon as
+// it has been assembled.  The vertex storage is reused for the next polyline,
+// so the memory used by this layer does not grow with the size of the
+// output.  This is useful when the output is very large and is written
+// somewhere else (e.g., to disk) as it is produced.  Example usage:
+//
+//   S2Builder builder{S2Builder::Options()};
+//   builder.StartLayer(std::make_unique<PolylineCallbackLayer>(
+//       [&writer](absl::Span<const S2Point> vertices,
+//                 absl::Span<const LabelSetId> label_set_ids,
+//                 S2Error* error) {
+//         writer.WritePolyline(vertices);
+//       }));
+//
+// Note that S2Builder still constructs the complete S2Builder::Graph for the
+// layer before Build() is called (since snapping may move any vertex), so
+// this layer only avoids materializing the output geometry.
+//
+// The callback may report an error by setting "error", in which case no
+// further polylines are assembled and the error is returned by
+// S2Builder::Build().  If options.validate() is true then each polyline is
+// validated before it is passed to the callback, and the layer stops at the
+// first invalid polyline.  (Since no S2Polyline is
+// constructed otherwise, options.s2debug_override() has no effect.)
+class PolylineCallbackLayer : public S2Builder::Layer {
+ public:
+  using Options = S2PolylineVectorLayer::Options;
+
+  // The arguments are the polyline vertices and, if a label set lexicon was
+  // specified, the label set id of each polyline edge (otherwise this span
+  // is empty).  Both spans are only valid for the duration of the call.
+  using PolylineCallback =
+      std::function<void(absl::Span<const S2Point> vertices,
+                         absl::Span<const LabelSetId> label_set_ids,
+                         S2Error* error)>;
+
+  // Specifies that the given callback should be called for each polyline
+  // constructed using the given options.
+  explicit PolylineCallbackLayer(PolylineCallback callback,
+                                 const Options& options = Options());
+
+  // As above, but also passes the labels attached to the input edges to the
+  // callback.  The labels associated with edge "vertices[j], vertices[j+1]"
+  // can be retrieved as follows:
+  //
+  //   for (int32 label : label_set_lexicon.id_set(label_set_ids[j])) {...}
+  PolylineCallbackLayer(PolylineCallback callback,
+                        IdSetLexicon* label_set_lexicon,
+                        const Options& options = Options());
+
+  // Layer interface:
+  GraphOptions graph_options() const override;
+  void Build(const Graph& g, S2Error* error) override;
+
+ private:
+  PolylineCallback callback_;
+  IdSetLexicon* label_set_lexicon_;
+  Options options_;
+};
+
+}  // namespace s2builderutil
+
+#endif  // S2_S2BUILDERUTIL_POLYLINE_CALLBACK_LAYER_H_
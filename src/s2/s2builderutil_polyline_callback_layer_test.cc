@@ -0,0 +1,121 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2builderutil_polyline_callback_layer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "absl/strings/str_join.h"
+#include "s2/s2builderutil_snap_functions.h"
+#include "s2/s2builderutil_s2polyline_vector_layer.h"
+#include "s2/s2polyline.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using s2builderutil::PolylineCallbackLayer;
+using s2builderutil::S2PolylineVectorLayer;
+using s2textformat::MakePolylineOrDie;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+using EdgeType = S2Builder::EdgeType;
+using LabelSetId = S2Builder::Layer::LabelSetId;
+
+namespace {
+
+TEST(PolylineCallbackLayer, MatchesS2PolylineVectorLayer) {
+  // Snapping merges some vertices and splits the polylines where they cross.
+  vector<const char*> input_strs = {
+    "0:0, 0:10, 10:10", "5:5, 5:15", "0:0.01, 2:2, 3:3", "20:20, 21:21"};
+  S2Builder::Options builder_options(
+      s2builderutil::IntLatLngSnapFunction(0));
+  builder_options.set_split_crossing_edges(true);
+  for (EdgeType edge_type : {EdgeType::DIRECTED, EdgeType::UNDIRECTED}) {
+    S2PolylineVectorLayer::Options layer_options(edge_type);
+    S2Builder builder(builder_options);
+    vector<unique_ptr<S2Polyline>> expected;
+    builder.StartLayer(
+        make_unique<S2PolylineVectorLayer>(&expected, layer_options));
+    for (auto input_str : input_strs) {
+      builder.AddPolyline(*MakePolylineOrDie(input_str));
+    }
+    vector<string> actual;
+    builder.StartLayer(make_unique<PolylineCallbackLayer>(
+        [&actual](absl::Span<const S2Point> vertices,
+                  absl::Span<const LabelSetId> label_set_ids, S2Error*) {
+          EXPECT_TRUE(label_set_ids.empty());
+          actual.push_back(s2textformat::ToString(vertices));
+        },
+        layer_options));
+    for (auto input_str : input_strs) {
+      builder.AddPolyline(*MakePolylineOrDie(input_str));
+    }
+    S2Error error;
+    ASSERT_TRUE(builder.Build(&error)) << error;
+    vector<string> expected_strs;
+    for (const auto& polyline : expected) {
+      expected_strs.push_back(s2textformat::ToString(*polyline));
+    }
+    EXPECT_GT(expected_strs.size(), input_strs.size());
+    EXPECT_EQ(absl::StrJoin(expected_strs, "; "), absl::StrJoin(actual, "; "));
+  }
+}
+
+TEST(PolylineCallbackLayer, Labels) {
+  S2Builder builder{S2Builder::Options()};
+  IdSetLexicon label_set_lexicon;
+  vector<vector<int32>> labels;
+  builder.StartLayer(make_unique<PolylineCallbackLayer>(
+      [&](absl::Span<const S2Point> vertices,
+          absl::Span<const LabelSetId> label_set_ids, S2Error*) {
+        EXPECT_EQ(vertices.size(), label_set_ids.size() + 1);
+        for (LabelSetId id : label_set_ids) {
+          auto label_set = label_set_lexicon.id_set(id);
+          labels.emplace_back(label_set.begin(), label_set.end());
+        }
+      },
+      &label_set_lexicon));
+  builder.set_label(5);
+  builder.AddPolyline(*MakePolylineOrDie("0:0, 0:1"));
+  builder.set_label(7);
+  builder.AddPolyline(*MakePolylineOrDie("0:1, 0:2"));
+  S2Error error;
+  ASSERT_TRUE(builder.Build(&error)) << error;
+  EXPECT_EQ((vector<vector<int32>>{{5}, {7}}), labels);
+}
+
+TEST(PolylineCallbackLayer, CallbackError) {
+  S2Builder builder{S2Builder::Options()};
+  int num_calls = 0;
+  builder.StartLayer(make_unique<PolylineCallbackLayer>(
+      [&num_calls](absl::Span<const S2Point>, absl::Span<const LabelSetId>,
+                   S2Error* error) {
+        ++num_calls;
+        error->Init(S2Error::DATA_LOSS, "Disk full");
+      }));
+  builder.AddPolyline(*MakePolylineOrDie("0:0, 0:1"));
+  builder.AddPolyline(*MakePolylineOrDie("5:0, 5:1"));
+  S2Error error;
+  EXPECT_FALSE(builder.Build(&error));
+  EXPECT_EQ(S2Error::DATA_LOSS, error.code());
+  EXPECT_EQ(1, num_calls);
+}
+
+}  // namespace
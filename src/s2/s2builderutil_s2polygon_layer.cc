@@ -85,7 +85,8 @@ void S2PolygonLayer::AppendS2Loops(const Graph& g,
       vertices.push_back(g.vertex(g.edge(edge_id).first));
     }
     loops->push_back(
-        make_unique<S2Loop>(vertices, polygon_->s2debug_override()));
+        make_unique<S2Loop>(vertices, polygon_->memory_resource(),
+                            polygon_->s2debug_override()));
     vertices.clear();
   }
 }
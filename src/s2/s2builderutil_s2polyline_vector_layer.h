@@ -196,10 +196,14 @@ class IndexedS2PolylineVectorLayer : public S2Builder::Layer {
   void Build(const Graph& g, S2Error* error) override {
     layer_.Build(g, error);
     if (error->ok()) {
+      std::vector<std::unique_ptr<S2Shape>> shapes;
+      shapes.reserve(polylines_.size());
       for (auto& polyline : polylines_) {
-        index_->Add(
+        shapes.push_back(
             absl::make_unique<S2Polyline::OwningShape>(std::move(polyline)));
       }
+      polylines_.clear();
+      index_->AddAll(std::move(shapes));
     }
   }
 
@@ -203,6 +203,14 @@ S2Point S2CellIdSnapFunction::SnapPoint(const S2Point& point) const {
   return S2CellId(point).parent(level_).ToPoint();
 }
 
+bool S2CellIdSnapFunction::snap_sites_are_separated() const {
+  return snap_radius_ == MinSnapRadiusForLevel(level_);
+}
+
+int S2CellIdSnapFunction::snap_cell_level() const {
+  return level_;
+}
+
 unique_ptr<S2Builder::SnapFunction> S2CellIdSnapFunction::Clone() const {
   return make_unique<S2CellIdSnapFunction>(*this);
 }
@@ -135,6 +135,16 @@ class S2CellIdSnapFunction : public S2Builder::SnapFunction {
 
   S2Point SnapPoint(const S2Point& point) const override;
 
+  // Returns true if snap_radius() is the minimum allowable value for level().
+  // Distinct cell centers are then always further apart than
+  // min_vertex_separation(), and all points that snap to a given cell center
+  // belong to that cell.
+  bool snap_sites_are_separated() const override;
+
+  // Returns level(), since every snap site is the center of a cell at that
+  // level.
+  int snap_cell_level() const override;
+
   std::unique_ptr<SnapFunction> Clone() const override;
 
  private:
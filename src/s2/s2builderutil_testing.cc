@@ -39,17 +39,27 @@ namespace s2builderutil {
 
 void GraphClone::Init(const Graph& g) {
   options_ = g.options();
-  vertices_ = g.vertices();
   edges_ = g.edges();
   input_edge_id_set_ids_ = g.input_edge_id_set_ids();
   input_edge_id_set_lexicon_ = g.input_edge_id_set_lexicon();
   label_set_ids_ = g.label_set_ids();
   label_set_lexicon_ = g.label_set_lexicon();
   is_full_polygon_predicate_ = g.is_full_polygon_predicate();
-  g_ = S2Builder::Graph(
-      options_, &vertices_, &edges_, &input_edge_id_set_ids_,
-      &input_edge_id_set_lexicon_, &label_set_ids_, &label_set_lexicon_,
-      is_full_polygon_predicate_);
+  if (g.has_vertex_ids()) {
+    vertices_.clear();
+    vertex_ids_ = g.vertex_ids();
+    g_ = S2Builder::Graph(
+        options_, &vertex_ids_, &edges_, &input_edge_id_set_ids_,
+        &input_edge_id_set_lexicon_, &label_set_ids_, &label_set_lexicon_,
+        is_full_polygon_predicate_);
+  } else {
+    vertices_ = g.vertices();
+    vertex_ids_.clear();
+    g_ = S2Builder::Graph(
+        options_, &vertices_, &edges_, &input_edge_id_set_ids_,
+        &input_edge_id_set_lexicon_, &label_set_ids_, &label_set_lexicon_,
+        is_full_polygon_predicate_);
+  }
 }
 
 string IndexMatchingLayer::ToString(const EdgeVector& edges) {
@@ -40,6 +40,7 @@ class GraphClone {
  private:
   S2Builder::GraphOptions options_;
   std::vector<S2Point> vertices_;
+  std::vector<S2CellId> vertex_ids_;
   std::vector<S2Builder::Graph::Edge> edges_;
   std::vector<S2Builder::Graph::InputEdgeIdSetId> input_edge_id_set_ids_;
   IdSetLexicon input_edge_id_set_lexicon_;
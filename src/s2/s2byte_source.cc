@@ -0,0 +1,380 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2byte_source.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "s2/base/logging.h"
+
+using std::make_shared;
+using std::max;
+using std::min;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+bool S2ByteSource::ReadPrefix(uint64* offset, const DecodeFunction& decode,
+                              string* buffer, size_t initial_size) const {
+  if (*offset > size()) return false;
+  const uint64 available = size() - *offset;
+  size_t length = min<uint64>(max<size_t>(initial_size, 1), available);
+  size_t consumed;
+  for (;;) {
+    buffer->resize(length);
+    if (!Read(*offset, length, &(*buffer)[0])) return false;
+    Decoder decoder(buffer->data(), length);
+    if (decode(&decoder)) {
+      consumed = decoder.pos();
+      break;
+    }
+    if (length == available) return false;
+    length = min<uint64>(2 * static_cast<uint64>(length), available);
+  }
+  // Release the unused part of the buffer, and decode again so that any
+  // decoded objects point into the final buffer.
+  buffer->resize(consumed);
+  buffer->shrink_to_fit();
+  Decoder decoder(buffer->data(), buffer->size());
+  if (!decode(&decoder)) return false;
+  *offset += consumed;
+  return true;
+}
+
+bool S2StringByteSource::Read(uint64 offset, size_t length,
+                              char* dest) const {
+  if (offset > data_.size() || length > data_.size() - offset) return false;
+  if (length > 0) memcpy(dest, data_.data() + offset, length);
+  return true;
+}
+
+#ifndef _WIN32
+
+unique_ptr<S2FileByteSource> S2FileByteSource::Open(const string& filename,
+                                                    S2Error* error) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error->Init(S2Error::INVALID_ARGUMENT, "Cannot open %s: %s", filename,
+                strerror(errno));
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    error->Init(S2Error::INVALID_ARGUMENT, "Cannot stat %s: %s", filename,
+                strerror(errno));
+    close(fd);
+    return nullptr;
+  }
+  return unique_ptr<S2FileByteSource>(new S2FileByteSource(fd, st.st_size));
+}
+
+S2FileByteSource::~S2FileByteSource() {
+  close(fd_);
+}
+
+bool S2FileByteSource::Read(uint64 offset, size_t length, char* dest) const {
+  if (offset > size_ || length > size_ - offset) return false;
+  // pread() may return fewer bytes than requested, so read in a loop.
+  while (length > 0) {
+    ssize_t n = pread(fd_, dest, length, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    dest += n;
+    offset += n;
+    length -= n;
+  }
+  return true;
+}
+
+#else  // _WIN32
+
+unique_ptr<S2FileByteSource> S2FileByteSource::Open(const string& filename,
+                                                    S2Error* error) {
+  error->Init(S2Error::UNIMPLEMENTED,
+              "S2FileByteSource is not supported on this platform");
+  return nullptr;
+}
+
+S2FileByteSource::~S2FileByteSource() {}
+
+bool S2FileByteSource::Read(uint64 offset, size_t length, char* dest) const {
+  return false;
+}
+
+#endif  // _WIN32
+
+S2CachingByteSource::S2CachingByteSource(const S2ByteSource* source,
+                                         size_t capacity_bytes,
+                                         size_t block_size)
+    : source_(source), capacity_bytes_(capacity_bytes),
+      block_size_(block_size) {
+  S2_DCHECK_GT(block_size, 0);
+}
+
+bool S2CachingByteSource::Read(uint64 offset, size_t length,
+                               char* dest) const {
+  const uint64 size = source_->size();
+  if (offset > size || length > size - offset) return false;
+  if (length == 0) return true;
+
+  // Large reads would evict most of the cache, so they are not cached.
+  if (length > capacity_bytes_ / 2) return source_->Read(offset, length, dest);
+
+  const uint64 end = offset + length;
+  for (uint64 index = offset / block_size_; offset < end; ++index) {
+    const uint64 block_start = index * block_size_;
+    const uint64 block_end = min<uint64>(block_start + block_size_, end);
+    if (!ReadBlock(index, offset - block_start, block_end - block_start,
+                   dest)) {
+      return false;
+    }
+    dest += block_end - offset;
+    offset = block_end;
+  }
+  return true;
+}
+
+bool S2CachingByteSource::IsAvailable(uint64 offset, size_t length) const {
+  if (length > capacity_bytes_ / 2) {
+    return source_->IsAvailable(offset, length);
+  }
+  const uint64 end = offset + length;
+  absl::MutexLock lock(&mutex_);
+  for (uint64 index = offset / block_size_; index * block_size_ < end;
+       ++index) {
+    if (!block_map_.contains(index)) return false;
+  }
+  return true;
+}
+
+void S2CachingByteSource::Fetch(uint64 offset, size_t length,
+                                FetchCallback done) const {
+  if (length > capacity_bytes_ / 2) {
+    source_->Fetch(offset, length, std::move(done));
+    return;
+  }
+  if (IsAvailable(offset, length)) {
+    done(true);
+    return;
+  }
+  // Fetch the whole blocks containing the range, and then read them (which
+  // adds them to the cache).
+  const uint64 size = source_->size();
+  if (offset > size || length > size - offset) {
+    done(false);
+    return;
+  }
+  const uint64 start = offset / block_size_ * block_size_;
+  const uint64 end =
+      min(size, (offset + length + block_size_ - 1) / block_size_ *
+                    block_size_);
+  source_->Fetch(start, end - start, [this, offset, length, done](bool ok) {
+    string buffer(length, '\0');
+    done(ok && Read(offset, length, &buffer[0]));
+  });
+}
+
+bool S2CachingByteSource::ReadBlock(uint64 index, size_t begin, size_t end,
+                                    char* dest) const {
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = block_map_.find(index);
+    if (it != block_map_.end()) {
+      ++num_hits_;
+      blocks_.splice(blocks_.begin(), blocks_, it->second);
+      memcpy(dest, it->second->data.data() + begin, end - begin);
+      return true;
+    }
+    ++num_misses_;
+  }
+  // Read the block without holding the lock.  If several threads miss on the
+  // same block at once they each read it, and only the first copy is
+  // inserted.
+  const uint64 block_start = index * block_size_;
+  Block block{index, string(min<uint64>(block_size_,
+                                        source_->size() - block_start), '\0')};
+  if (!source_->Read(block_start, block.data.size(), &block.data[0])) {
+    return false;
+  }
+  memcpy(dest, block.data.data() + begin, end - begin);
+
+  absl::MutexLock lock(&mutex_);
+  if (block_map_.contains(index)) return true;
+  cache_bytes_ += block.data.size();
+  blocks_.push_front(std::move(block));
+  block_map_.emplace(index, blocks_.begin());
+  EvictBlocks();
+  return true;
+}
+
+void S2CachingByteSource::EvictBlocks() const {
+  while (cache_bytes_ > capacity_bytes_) {
+    const Block& lru = blocks_.back();
+    cache_bytes_ -= lru.data.size();
+    block_map_.erase(lru.index);
+    blocks_.pop_back();
+  }
+}
+
+size_t S2CachingByteSource::cache_bytes() const {
+  absl::MutexLock lock(&mutex_);
+  return cache_bytes_;
+}
+
+int64 S2CachingByteSource::num_hits() const {
+  absl::MutexLock lock(&mutex_);
+  return num_hits_;
+}
+
+int64 S2CachingByteSource::num_misses() const {
+  absl::MutexLock lock(&mutex_);
+  return num_misses_;
+}
+
+namespace {
+
+// The innermost S2DeferredReadScope on the current thread.
+thread_local S2DeferredReadScope* current_deferred_read_scope = nullptr;
+
+// The state shared by the attempts of one S2RunWithoutBlocking() call.
+struct NonBlockingRun {
+  std::function<void ()> attempt;
+  std::function<void (bool ok)> done;
+  std::atomic<int> num_pending;
+  std::atomic<bool> fetch_ok;
+};
+
+void RunAttempt(const shared_ptr<NonBlockingRun>& run) {
+  vector<S2DeferredReadScope::Range> deferred;
+  {
+    S2DeferredReadScope scope;
+    run->attempt();
+    deferred = scope.deferred();
+  }
+  if (deferred.empty()) {
+    run->done(true);
+    return;
+  }
+  // Fetch each distinct range once.
+  auto key = [](const S2DeferredReadScope::Range& r) {
+    return std::make_tuple(r.source, r.offset, r.length);
+  };
+  std::sort(deferred.begin(), deferred.end(),
+            [&key](const S2DeferredReadScope::Range& a,
+                   const S2DeferredReadScope::Range& b) {
+              return key(a) < key(b);
+            });
+  deferred.erase(std::unique(deferred.begin(), deferred.end(),
+                             [&key](const S2DeferredReadScope::Range& a,
+                                    const S2DeferredReadScope::Range& b) {
+                               return key(a) == key(b);
+                             }),
+                 deferred.end());
+  // The counter is set before any fetch is started, since fetches may
+  // complete immediately.
+  run->num_pending = deferred.size();
+  run->fetch_ok = true;
+  for (const auto& range : deferred) {
+    range.source->Fetch(range.offset, range.length, [run](bool ok) {
+      if (!ok) run->fetch_ok = false;
+      if (--run->num_pending > 0) return;
+      if (run->fetch_ok) {
+        RunAttempt(run);
+      } else {
+        run->done(false);
+      }
+    });
+  }
+}
+
+}  // namespace
+
+bool S2ByteSource::IsAvailable(uint64 offset, size_t length) const {
+  return true;
+}
+
+void S2ByteSource::Fetch(uint64 offset, size_t length,
+                         FetchCallback done) const {
+  done(true);
+}
+
+S2DeferredReadScope::S2DeferredReadScope()
+    : previous_(current_deferred_read_scope) {
+  current_deferred_read_scope = this;
+}
+
+S2DeferredReadScope::~S2DeferredReadScope() {
+  current_deferred_read_scope = previous_;
+}
+
+S2DeferredReadScope* S2DeferredReadScope::current() {
+  return current_deferred_read_scope;
+}
+
+void S2DeferredReadScope::Defer(const S2ByteSource* source, uint64 offset,
+                                size_t length) {
+  deferred_.push_back(Range{source, offset, length});
+}
+
+void S2RunWithoutBlocking(std::function<void ()> attempt,
+                          std::function<void (bool ok)> done) {
+  auto run = make_shared<NonBlockingRun>();
+  run->attempt = std::move(attempt);
+  run->done = std::move(done);
+  RunAttempt(run);
+}
+
+bool S2ByteSourceStringVector::Init(const S2ByteSource* source,
+                                    uint64* offset) {
+  source_ = source;
+  if (!source->ReadPrefix(
+          offset, [this](Decoder* decoder) { return offsets_.Init(decoder); },
+          &offsets_data_)) {
+    return false;
+  }
+  data_offset_ = *offset;
+  uint64 length = (offsets_.size() == 0) ? 0 : offsets_[offsets_.size() - 1];
+  if (length > source->size() - data_offset_) return false;
+  *offset += length;
+  return true;
+}
+
+bool S2ByteSourceStringVector::Read(int i, string* str) const {
+  uint64 start = (i == 0) ? 0 : offsets_[i - 1];
+  uint64 limit = offsets_[i];
+  S2DeferredReadScope* scope = S2DeferredReadScope::current();
+  if (scope != nullptr &&
+      !source_->IsAvailable(data_offset_ + start, limit - start)) {
+    scope->Defer(source_, data_offset_ + start, limit - start);
+    return false;
+  }
+  str->resize(limit - start);
+  return source_->Read(data_offset_ + start, limit - start, &(*str)[0]);
+}
@@ -0,0 +1,295 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2BYTE_SOURCE_H_
+#define S2_S2BYTE_SOURCE_H_
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "s2/base/integral_types.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/s2error.h"
+#include "s2/util/coding/coder.h"
+
+// S2ByteSource is an abstract source of bytes that are read on demand, such
+// as a file that is too large to be loaded into memory.  It allows encoded S2
+// data structures to be used without holding the entire encoding in memory:
+// the small "directory" portions of the encoding (e.g., the S2CellIds of an
+// EncodedS2ShapeIndex) are read into memory when the structure is
+// initialized, and the bulk data (e.g., the contents of each index cell and
+// each shape) is read only when it is needed.  Example usage:
+//
+//   S2Error error;
+//   auto file = S2FileByteSource::Open("/data/index.s2", &error);
+//   if (file == nullptr) return error;
+//   S2CachingByteSource source(file.get(), 1 << 30);  // 1 GB cache
+//   uint64 offset = 0;
+//   s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+//   EncodedS2ShapeIndex index;
+//   if (!shape_factory.Init(&source, &offset) ||
+//       !index.Init(&source, &offset, shape_factory)) {
+//     return S2Error(...);
+//   }
+//
+// Compared with S2MappedFile, this approach gives the client control over how
+// the data is read and how much memory is used to cache it (the page cache
+// may evict a memory-mapped index arbitrarily).  Clients can implement
+// S2ByteSource themselves, e.g. to read from a remote storage service.
+//
+// All implementations must be thread-safe.
+class S2ByteSource {
+ public:
+  virtual ~S2ByteSource() = default;
+
+  // Returns the total number of bytes available.
+  virtual uint64 size() const = 0;
+
+  // Copies the "length" bytes starting at "offset" to "dest".  Returns false
+  // if the bytes could not be read (e.g., because the range extends past the
+  // end of the source or due to an I/O error).
+  virtual bool Read(uint64 offset, size_t length, char* dest) const = 0;
+
+  // Reads a prefix of the data starting at "offset" into "*buffer" that is
+  // just long enough for "decode" to succeed.  This is useful for reading
+  // self-describing structures whose size is not known in advance.  "decode"
+  // is called with a Decoder over a prefix of the data, which is doubled
+  // (starting from "initial_size") until "decode" returns true or the end of
+  // the source is reached.  On success, "*buffer" is resized to the number
+  // of bytes consumed by "decode", which is called one last time with a
+  // Decoder over the final buffer (so that decoded objects may point into
+  // it), and "offset" is advanced past the consumed bytes.
+  using DecodeFunction = std::function<bool (Decoder* decoder)>;
+  bool ReadPrefix(uint64* offset, const DecodeFunction& decode,
+                  std::string* buffer, size_t initial_size = 4096) const;
+
+  // The following methods allow data to be read without blocking a thread
+  // while waiting for I/O, e.g. when the source is backed by a remote
+  // storage service (see S2RunWithoutBlocking below).  The default
+  // implementations treat all data as available, in which case Read() simply
+  // blocks as usual.
+
+  // Returns true if Read() of the given range does not need to wait for I/O.
+  virtual bool IsAvailable(uint64 offset, size_t length) const;
+
+  // Starts making the given range available, and calls "done" once this is
+  // finished (possibly on another thread, or before Fetch() returns).  "ok"
+  // is false if the data could not be read.
+  using FetchCallback = std::function<void (bool ok)>;
+  virtual void Fetch(uint64 offset, size_t length, FetchCallback done) const;
+};
+
+// An S2ByteSource that reads from a string in memory, mainly for testing.
+// The string must outlive this object.
+class S2StringByteSource final : public S2ByteSource {
+ public:
+  explicit S2StringByteSource(absl::string_view data) : data_(data) {}
+
+  uint64 size() const override { return data_.size(); }
+  bool Read(uint64 offset, size_t length, char* dest) const override;
+
+ private:
+  const absl::string_view data_;
+};
+
+// An S2ByteSource that reads a file using pread(), so that any number of
+// threads can read from it concurrently.  This class is only supported on
+// POSIX systems; on other platforms Open() fails with S2Error::UNIMPLEMENTED.
+class S2FileByteSource final : public S2ByteSource {
+ public:
+  // Opens the given file, or returns nullptr and sets "error" if the file
+  // could not be opened.
+  static std::unique_ptr<S2FileByteSource> Open(const std::string& filename,
+                                                S2Error* error);
+
+  // Closes the file.
+  ~S2FileByteSource() override;
+
+  uint64 size() const override { return size_; }
+  bool Read(uint64 offset, size_t length, char* dest) const override;
+
+ private:
+  S2FileByteSource(int fd, uint64 size) : fd_(fd), size_(size) {}
+
+  const int fd_;
+  const uint64 size_;
+
+  S2FileByteSource(const S2FileByteSource&) = delete;
+  void operator=(const S2FileByteSource&) = delete;
+};
+
+// An S2ByteSource that caches the data read from another S2ByteSource in
+// fixed-size blocks, evicting the least recently used blocks so that the
+// total size of the cache does not exceed a given limit.  Reads that are
+// larger than half the cache are passed through without being cached.
+class S2CachingByteSource final : public S2ByteSource {
+ public:
+  // The source must outlive this object.
+  // REQUIRES: block_size > 0
+  S2CachingByteSource(const S2ByteSource* source, size_t capacity_bytes,
+                      size_t block_size = 64 << 10);
+
+  uint64 size() const override { return source_->size(); }
+  bool Read(uint64 offset, size_t length, char* dest) const override;
+
+  // A range is available if all of its blocks are cached.  Fetch() fetches
+  // the missing blocks from the underlying source and adds them to the cache
+  // (where they may of course be evicted again by later reads).
+  bool IsAvailable(uint64 offset, size_t length) const override;
+  void Fetch(uint64 offset, size_t length, FetchCallback done) const override;
+
+  // Statistics about the cache.  The hit and miss counts are the number of
+  // block lookups that were found in the cache and that had to be read from
+  // the underlying source respectively.
+  size_t cache_bytes() const;
+  int64 num_hits() const;
+  int64 num_misses() const;
+
+ private:
+  struct Block {
+    uint64 index;
+    std::string data;
+  };
+  using BlockList = std::list<Block>;
+
+  // Copies the bytes of block "index" in [begin, end) to "dest".
+  bool ReadBlock(uint64 index, size_t begin, size_t end, char* dest) const;
+
+  // Evicts blocks until the cache size is at most capacity_bytes_.
+  void EvictBlocks() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const S2ByteSource* const source_;
+  const size_t capacity_bytes_;
+  const size_t block_size_;
+
+  mutable absl::Mutex mutex_;
+
+  // Blocks are ordered from most to least recently used.
+  mutable BlockList blocks_ ABSL_GUARDED_BY(mutex_);
+
+  // Maps each block index to its entry in "blocks_".
+  mutable absl::flat_hash_map<uint64, BlockList::iterator> block_map_
+      ABSL_GUARDED_BY(mutex_);
+
+  mutable size_t cache_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+  mutable int64 num_hits_ ABSL_GUARDED_BY(mutex_) = 0;
+  mutable int64 num_misses_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  S2CachingByteSource(const S2CachingByteSource&) = delete;
+  void operator=(const S2CachingByteSource&) = delete;
+};
+
+// While an S2DeferredReadScope is active on the current thread, reads from
+// an S2ByteSourceStringVector (and therefore the on-demand reads of
+// EncodedS2ShapeIndex cells and ByteSourceTaggedShapeFactory shapes) do not
+// block when the data is not available.  Instead the range is recorded in
+// the scope and the read fails, in which case EncodedS2ShapeIndex treats
+// the cell as empty and the shape as missing without caching them.  The
+// results of any work done while reads were deferred are therefore wrong
+// and must be discarded; see S2RunWithoutBlocking() below.
+class S2DeferredReadScope {
+ public:
+  struct Range {
+    const S2ByteSource* source;
+    uint64 offset;
+    size_t length;
+  };
+
+  S2DeferredReadScope();
+  ~S2DeferredReadScope();
+
+  // Returns the innermost scope active on the current thread, or nullptr.
+  static S2DeferredReadScope* current();
+
+  // Records a read that was deferred.
+  void Defer(const S2ByteSource* source, uint64 offset, size_t length);
+
+  // Returns the reads deferred so far (possibly with duplicates).
+  const std::vector<Range>& deferred() const { return deferred_; }
+
+ private:
+  S2DeferredReadScope* const previous_;
+  std::vector<Range> deferred_;
+
+  S2DeferredReadScope(const S2DeferredReadScope&) = delete;
+  void operator=(const S2DeferredReadScope&) = delete;
+};
+
+// Runs "attempt" within an S2DeferredReadScope.  If any reads were deferred,
+// fetches the missing data asynchronously (see S2ByteSource::Fetch) and
+// runs "attempt" again once it has arrived, until an attempt completes
+// without deferring any reads.  Then calls done(true), or done(false) if a
+// fetch failed.  This allows a small number of threads to serve many
+// concurrent queries against an EncodedS2ShapeIndex whose data is read on
+// demand, since no thread waits for I/O.  For example:
+//
+//   auto query = make_shared<S2ClosestEdgeQuery>(&index);
+//   auto results = make_shared<vector<S2ClosestEdgeQuery::Result>>();
+//   S2RunWithoutBlocking(
+//       [=]() {
+//         S2ClosestEdgeQuery::PointTarget target(point);
+//         query->FindClosestEdges(&target, results.get());
+//       },
+//       [=](bool ok) { ... use *results ... });
+//
+// "attempt" must be safe to run several times, with only the last run's
+// results being used.  Each attempt reads all the data decoded by earlier
+// attempts from memory, so the number of attempts is bounded by the number
+// of distinct "waves" of data the computation needs (e.g., the depth of
+// the index cells visited by a query).  Attempts after the first, and
+// "done", run on the thread that completes the last fetch; sources can
+// direct this to a thread pool by calling their FetchCallbacks from it.
+void S2RunWithoutBlocking(std::function<void ()> attempt,
+                          std::function<void (bool ok)> done);
+
+// A vector of strings encoded by s2coding::StringVectorEncoder whose offsets
+// are read into memory, but whose contents are read from an S2ByteSource on
+// demand.  This is the S2ByteSource counterpart of EncodedStringVector.
+class S2ByteSourceStringVector {
+ public:
+  // Constructs an empty vector.
+  S2ByteSourceStringVector() { offsets_.Clear(); }
+
+  // Initializes the vector from the encoding at "*offset" in "source", and
+  // advances "*offset" past the end of the vector.  Returns false if the
+  // encoding could not be read.  The source must outlive this object.
+  bool Init(const S2ByteSource* source, uint64* offset);
+
+  // Returns the number of strings in the vector.
+  size_t size() const { return offsets_.size(); }
+
+  // Reads the i-th string into "*str".  Returns false on read errors, or if
+  // the read was deferred (see S2DeferredReadScope).
+  bool Read(int i, std::string* str) const;
+
+  // Returns the number of bytes of heap memory used to hold the offsets.
+  size_t SpaceUsed() const { return offsets_data_.capacity(); }
+
+ private:
+  const S2ByteSource* source_ = nullptr;
+  uint64 data_offset_ = 0;
+  std::string offsets_data_;
+  s2coding::EncodedUintVector<uint64> offsets_;
+};
+
+#endif  // S2_S2BYTE_SOURCE_H_
@@ -0,0 +1,410 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2byte_source.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "s2/encoded_s2shape_index.h"
+#include "s2/encoded_string_vector.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2loop.h"
+#include "s2/s2polygon.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2shapeutil_testing.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using std::string;
+using std::vector;
+
+namespace {
+
+TEST(S2StringByteSource, Read) {
+  S2StringByteSource source("abcdef");
+  EXPECT_EQ(6, source.size());
+  char buf[4];
+  ASSERT_TRUE(source.Read(2, 3, buf));
+  EXPECT_EQ("cde", string(buf, 3));
+  EXPECT_TRUE(source.Read(6, 0, buf));
+  EXPECT_FALSE(source.Read(4, 3, buf));
+  EXPECT_FALSE(source.Read(7, 0, buf));
+}
+
+TEST(S2ByteSource, ReadPrefix) {
+  Encoder encoder;
+  encoder.Ensure(Varint::kMax64 + 1);
+  encoder.put_varint64(uint64{1} << 40);
+  encoder.put8(0x80);  // An incomplete varint.
+  string data(encoder.base(), encoder.length());
+  S2StringByteSource source(data);
+
+  // Start with a 1-byte prefix so that the prefix must be enlarged.
+  uint64 offset = 0, value = 0;
+  string buffer;
+  ASSERT_TRUE(source.ReadPrefix(
+      &offset, [&value](Decoder* d) { return d->get_varint64(&value); },
+      &buffer, 1));
+  EXPECT_EQ(uint64{1} << 40, value);
+  EXPECT_EQ(data.size() - 1, offset);
+  EXPECT_EQ(data.substr(0, offset), buffer);
+
+  // Decoding fails once the end of the source is reached.
+  EXPECT_FALSE(source.ReadPrefix(
+      &offset, [&value](Decoder* d) { return d->get_varint64(&value); },
+      &buffer));
+  EXPECT_EQ(data.size() - 1, offset);
+}
+
+TEST(S2CachingByteSource, CachesBlocks) {
+  string data;
+  for (int i = 0; i < 1000; ++i) data.push_back('a' + i % 26);
+  S2StringByteSource base(data);
+  S2CachingByteSource source(&base, 400, 100);
+  EXPECT_EQ(1000, source.size());
+
+  string buf(150, '\0');
+  ASSERT_TRUE(source.Read(50, 150, &buf[0]));  // Blocks 0 and 1.
+  EXPECT_EQ(data.substr(50, 150), buf);
+  EXPECT_EQ(0, source.num_hits());
+  EXPECT_EQ(2, source.num_misses());
+  EXPECT_EQ(200, source.cache_bytes());
+
+  ASSERT_TRUE(source.Read(120, 150, &buf[0]));  // Blocks 1 and 2.
+  EXPECT_EQ(data.substr(120, 150), buf);
+  EXPECT_EQ(1, source.num_hits());
+  EXPECT_EQ(3, source.num_misses());
+
+  // Reading blocks 7..9 evicts the least recently used blocks (0 and 1).
+  ASSERT_TRUE(source.Read(750, 150, &buf[0]));
+  ASSERT_TRUE(source.Read(900, 100, &buf[0]));
+  EXPECT_EQ(data.substr(900, 100), buf.substr(0, 100));
+  EXPECT_EQ(400, source.cache_bytes());
+  EXPECT_EQ(6, source.num_misses());
+  ASSERT_TRUE(source.Read(250, 10, &buf[0]));  // Block 2 is still cached.
+  EXPECT_EQ(data.substr(250, 10), buf.substr(0, 10));
+  EXPECT_EQ(2, source.num_hits());
+  ASSERT_TRUE(source.Read(150, 10, &buf[0]));
+  EXPECT_EQ(7, source.num_misses());
+  EXPECT_EQ(400, source.cache_bytes());
+
+  // Large reads bypass the cache.
+  int64 misses = source.num_misses();
+  string large(300, '\0');
+  ASSERT_TRUE(source.Read(300, 300, &large[0]));
+  EXPECT_EQ(data.substr(300, 300), large);
+  EXPECT_EQ(misses, source.num_misses());
+
+  EXPECT_FALSE(source.Read(950, 100, &buf[0]));
+}
+
+TEST(S2ByteSourceStringVector, Read) {
+  vector<string> strings = {"", "hello", "", "s2", string(5000, 'x')};
+  s2coding::StringVectorEncoder encoder;
+  for (const string& str : strings) encoder.Add(str);
+  Encoder data_encoder;
+  data_encoder.Ensure(1);
+  data_encoder.put8('!');  // Check that a nonzero offset is handled.
+  encoder.Encode(&data_encoder);
+  data_encoder.Ensure(1);
+  data_encoder.put8('!');
+  string data(data_encoder.base(), data_encoder.length());
+  S2StringByteSource source(data);
+
+  S2ByteSourceStringVector vec;
+  EXPECT_EQ(0, vec.size());
+  uint64 offset = 1;
+  ASSERT_TRUE(vec.Init(&source, &offset));
+  EXPECT_EQ(data.size() - 1, offset);
+  ASSERT_EQ(strings.size(), vec.size());
+  for (int i = 0; i < strings.size(); ++i) {
+    string str;
+    ASSERT_TRUE(vec.Read(i, &str));
+    EXPECT_EQ(strings[i], str);
+  }
+}
+
+// Encodes the given index together with its shapes.
+string EncodeIndex(const MutableS2ShapeIndex& index) {
+  Encoder encoder;
+  s2shapeutil::FastEncodeTaggedShapes(index, &encoder);
+  index.Encode(&encoder);
+  return string(encoder.base(), encoder.length());
+}
+
+TEST(S2ByteSource, EncodedS2ShapeIndex) {
+  S2Testing::rnd.Reset(1);
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 20; ++i) {
+    index.Add(make_unique<S2Polygon::OwningShape>(
+        make_unique<S2Polygon>(S2Loop::MakeRegularLoop(
+            S2Testing::RandomPoint(), S1Angle::Degrees(5), 100))));
+  }
+  string data = EncodeIndex(index);
+  S2StringByteSource base(data);
+  S2CachingByteSource source(&base, 16 << 10, 1 << 10);
+
+  uint64 offset = 0;
+  s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+  EncodedS2ShapeIndex actual;
+  ASSERT_TRUE(shape_factory.Init(&source, &offset));
+  ASSERT_TRUE(actual.Init(&source, &offset, shape_factory));
+  EXPECT_EQ(data.size(), offset);
+  EXPECT_TRUE(actual.cell_ids_data().empty());
+  // Only the S2CellIds and offsets are read during initialization.
+  EXPECT_LT(source.num_misses() * 1024, data.size());
+
+  s2testing::ExpectEqual(index, actual);
+  EXPECT_LE(source.cache_bytes(), 16 << 10);
+
+  auto expected_query = MakeS2ContainsPointQuery(&index);
+  auto actual_query = MakeS2ContainsPointQuery(&actual);
+  for (int i = 0; i < 100; ++i) {
+    S2Point p = S2Testing::RandomPoint();
+    EXPECT_EQ(expected_query.Contains(p), actual_query.Contains(p));
+  }
+}
+
+TEST(S2ByteSource, TruncatedEncodedS2ShapeIndex) {
+  auto index = s2textformat::MakeIndexOrDie("0:0 # 1:1, 2:2 # 3:3, 3:4, 4:3");
+  string data = EncodeIndex(*index);
+  data.resize(data.size() - 1);
+  S2StringByteSource source(data);
+  uint64 offset = 0;
+  s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+  EncodedS2ShapeIndex actual;
+  ASSERT_TRUE(shape_factory.Init(&source, &offset));
+  EXPECT_FALSE(actual.Init(&source, &offset, shape_factory));
+}
+
+// An S2ByteSource that simulates remote storage: data must be fetched before
+// it can be read without blocking, and fetches complete only when
+// CompleteFetches() is called.
+class FetchingByteSource final : public S2ByteSource {
+ public:
+  explicit FetchingByteSource(absl::string_view data)
+      : data_(data), fetched_(data.size(), false) {}
+
+  uint64 size() const override { return data_.size(); }
+
+  bool Read(uint64 offset, size_t length, char* dest) const override {
+    if (offset > size() || length > size() - offset) return false;
+    if (!IsAvailable(offset, length)) {
+      absl::MutexLock lock(&mutex_);
+      ++num_blocking_reads_;
+    }
+    memcpy(dest, data_.data() + offset, length);
+    return true;
+  }
+
+  bool IsAvailable(uint64 offset, size_t length) const override {
+    absl::MutexLock lock(&mutex_);
+    for (uint64 i = offset; i < offset + length; ++i) {
+      if (!fetched_[i]) return false;
+    }
+    return true;
+  }
+
+  void Fetch(uint64 offset, size_t length,
+             FetchCallback done) const override {
+    absl::MutexLock lock(&mutex_);
+    pending_.push_back(PendingFetch{offset, length, std::move(done)});
+  }
+
+  // Completes all pending fetches with the given status, and returns the
+  // number of fetches completed.
+  int CompleteFetches(bool ok = true) {
+    vector<PendingFetch> pending;
+    {
+      absl::MutexLock lock(&mutex_);
+      pending.swap(pending_);
+    }
+    for (const auto& fetch : pending) {
+      if (ok) {
+        absl::MutexLock lock(&mutex_);
+        for (uint64 i = fetch.offset; i < fetch.offset + fetch.length; ++i) {
+          fetched_[i] = true;
+        }
+      }
+      fetch.done(ok);
+    }
+    return pending.size();
+  }
+
+  int num_blocking_reads() const {
+    absl::MutexLock lock(&mutex_);
+    return num_blocking_reads_;
+  }
+
+ private:
+  struct PendingFetch {
+    uint64 offset;
+    size_t length;
+    FetchCallback done;
+  };
+
+  const absl::string_view data_;
+  mutable absl::Mutex mutex_;
+  vector<bool> fetched_;
+  mutable vector<PendingFetch> pending_;
+  mutable int num_blocking_reads_ = 0;
+};
+
+TEST(S2RunWithoutBlocking, EncodedS2ShapeIndexQueries) {
+  S2Testing::rnd.Reset(1);
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 20; ++i) {
+    index.Add(make_unique<S2Polygon::OwningShape>(
+        make_unique<S2Polygon>(S2Loop::MakeRegularLoop(
+            S2Testing::RandomPoint(), S1Angle::Degrees(5), 100))));
+  }
+  string data = EncodeIndex(index);
+  FetchingByteSource remote(data);
+  S2CachingByteSource source(&remote, 1 << 20, 1 << 10);
+  uint64 offset = 0;
+  s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+  EncodedS2ShapeIndex actual;
+  ASSERT_TRUE(shape_factory.Init(&source, &offset));
+  ASSERT_TRUE(actual.Init(&source, &offset, shape_factory));
+  const int num_init_reads = remote.num_blocking_reads();
+
+  auto expected_query = MakeS2ContainsPointQuery(&index);
+  S2ClosestEdgeQuery expected_closest(&index);
+  expected_closest.mutable_options()->set_max_results(3);
+  S2ClosestEdgeQuery actual_closest(&actual, expected_closest.options());
+  int max_attempts = 0;
+  for (int i = 0; i < 20; ++i) {
+    S2Point p = S2Testing::RandomPoint();
+    S2ClosestEdgeQuery::PointTarget target(p);
+    bool contains = false;
+    vector<S2ClosestEdgeQuery::Result> results;
+    int num_attempts = 0;
+    bool finished = false;
+    S2RunWithoutBlocking(
+        [&]() {
+          ++num_attempts;
+          contains = MakeS2ContainsPointQuery(&actual).Contains(p);
+          actual_closest.FindClosestEdges(&target, &results);
+        },
+        [&](bool ok) {
+          EXPECT_TRUE(ok);
+          finished = true;
+        });
+    while (remote.CompleteFetches() > 0) {}
+    ASSERT_TRUE(finished);
+    EXPECT_EQ(expected_query.Contains(p), contains);
+    EXPECT_EQ(expected_closest.FindClosestEdges(&target), results);
+    max_attempts = std::max(max_attempts, num_attempts);
+  }
+  // Queries fetched the data they needed rather than reading it directly.
+  EXPECT_EQ(num_init_reads, remote.num_blocking_reads());
+  EXPECT_GT(max_attempts, 1);
+}
+
+TEST(S2RunWithoutBlocking, FetchFails) {
+  auto index = s2textformat::MakeIndexOrDie("# # 0:0, 0:10, 10:10, 10:0");
+  string data = EncodeIndex(*index);
+  FetchingByteSource remote(data);
+  uint64 offset = 0;
+  s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+  EncodedS2ShapeIndex actual;
+  ASSERT_TRUE(shape_factory.Init(&remote, &offset));
+  ASSERT_TRUE(actual.Init(&remote, &offset, shape_factory));
+
+  int num_done = 0;
+  S2RunWithoutBlocking(
+      [&]() {
+        MakeS2ContainsPointQuery(&actual).Contains(
+            s2textformat::MakePointOrDie("5:5"));
+      },
+      [&](bool ok) {
+        EXPECT_FALSE(ok);
+        ++num_done;
+      });
+  EXPECT_EQ(0, num_done);
+  EXPECT_GT(remote.CompleteFetches(false), 0);
+  EXPECT_EQ(1, num_done);
+}
+
+TEST(S2RunWithoutBlocking, AvailableDataRunsOnce) {
+  auto index = s2textformat::MakeIndexOrDie("# # 0:0, 0:10, 10:10, 10:0");
+  string data = EncodeIndex(*index);
+  S2StringByteSource source(data);
+  uint64 offset = 0;
+  s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+  EncodedS2ShapeIndex actual;
+  ASSERT_TRUE(shape_factory.Init(&source, &offset));
+  ASSERT_TRUE(actual.Init(&source, &offset, shape_factory));
+  int num_attempts = 0;
+  bool contains = false, finished = false;
+  S2RunWithoutBlocking(
+      [&]() {
+        ++num_attempts;
+        contains = MakeS2ContainsPointQuery(&actual).Contains(
+            s2textformat::MakePointOrDie("5:5"));
+      },
+      [&](bool ok) { finished = ok; });
+  EXPECT_TRUE(finished);
+  EXPECT_TRUE(contains);
+  EXPECT_EQ(1, num_attempts);
+}
+
+#ifndef _WIN32
+
+TEST(S2FileByteSource, EncodedS2ShapeIndex) {
+  auto index = s2textformat::MakeIndexOrDie(
+      "# # 0:0, 0:10, 10:10, 10:0; 20:20, 20:30, 30:30, 30:20");
+  string data = EncodeIndex(*index);
+  string filename = ::testing::TempDir() + "/s2byte_source_test.s2";
+  FILE* file = fopen(filename.c_str(), "wb");
+  ASSERT_NE(nullptr, file);
+  ASSERT_EQ(data.size(), fwrite(data.data(), 1, data.size(), file));
+  fclose(file);
+
+  S2Error error;
+  auto source = S2FileByteSource::Open(filename, &error);
+  ASSERT_NE(nullptr, source) << error;
+  EXPECT_EQ(data.size(), source->size());
+  uint64 offset = 0;
+  s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+  EncodedS2ShapeIndex actual;
+  ASSERT_TRUE(shape_factory.Init(source.get(), &offset));
+  ASSERT_TRUE(actual.Init(source.get(), &offset, shape_factory));
+  s2testing::ExpectEqual(*index, actual);
+  remove(filename.c_str());
+}
+
+TEST(S2FileByteSource, OpenMissingFile) {
+  S2Error error;
+  EXPECT_EQ(nullptr, S2FileByteSource::Open(
+      ::testing::TempDir() + "/no_such_file.s2", &error));
+  EXPECT_EQ(S2Error::INVALID_ARGUMENT, error.code());
+}
+
+#endif  // _WIN32
+
+}  // namespace
@@ -0,0 +1,165 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2caching_region_coverer.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "s2/base/logging.h"
+#include "s2/s2memory_tracker.h"
+#include "s2/s2region.h"
+
+using absl::string_view;
+using std::string;
+using std::vector;
+
+// Returns a cache key prefix that identifies the given covering options.
+static string EncodeOptions(const S2RegionCoverer::Options& options,
+                            bool interior) {
+  Encoder encoder;
+  encoder.Ensure(1 + 4 * Varint::kMax32);
+  encoder.put8(interior);
+  encoder.put_varint32(options.max_cells());
+  encoder.put_varint32(options.min_level());
+  encoder.put_varint32(options.max_level());
+  encoder.put_varint32(options.level_mod());
+  return string(encoder.base(), encoder.length());
+}
+
+S2CachingRegionCoverer::S2CachingRegionCoverer()
+    : S2CachingRegionCoverer(Options()) {}
+
+S2CachingRegionCoverer::S2CachingRegionCoverer(const Options& options)
+    : options_(options),
+      covering_prefix_(EncodeOptions(options, false)),
+      interior_prefix_(EncodeOptions(options, true)) {
+  S2_DCHECK_LE(options.min_level(), options.max_level());
+  S2_DCHECK(options.memory_tracker() == nullptr)
+      << "S2CachingRegionCoverer does not support memory_tracker()";
+}
+
+S2CellUnion S2CachingRegionCoverer::GetCovering(const S2Region& region,
+                                                string_view fingerprint) {
+  vector<S2CellId> covering;
+  GetCoveringInternal(region, fingerprint, false, &covering);
+  return S2CellUnion::FromVerbatim(std::move(covering));
+}
+
+S2CellUnion S2CachingRegionCoverer::GetInteriorCovering(
+    const S2Region& region, string_view fingerprint) {
+  vector<S2CellId> interior;
+  GetCoveringInternal(region, fingerprint, true, &interior);
+  return S2CellUnion::FromVerbatim(std::move(interior));
+}
+
+void S2CachingRegionCoverer::GetCovering(const S2Region& region,
+                                         string_view fingerprint,
+                                         vector<S2CellId>* covering) {
+  GetCoveringInternal(region, fingerprint, false, covering);
+}
+
+void S2CachingRegionCoverer::GetInteriorCovering(const S2Region& region,
+                                                 string_view fingerprint,
+                                                 vector<S2CellId>* interior) {
+  GetCoveringInternal(region, fingerprint, true, interior);
+}
+
+void S2CachingRegionCoverer::GetCoveringInternal(const S2Region& region,
+                                                 string_view fingerprint,
+                                                 bool interior,
+                                                 vector<S2CellId>* result) {
+  string key =
+      absl::StrCat(interior ? interior_prefix_ : covering_prefix_, fingerprint);
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = map_.find(key);
+    if (it != map_.end()) {
+      ++num_hits_;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      *result = it->second->cells;
+      return;
+    }
+    ++num_misses_;
+  }
+  // Compute the covering without holding the lock.  If several threads miss
+  // on the same key at once they each compute the covering, and only the
+  // first result is inserted.
+  S2RegionCoverer coverer(options_);
+  if (interior) {
+    coverer.GetInteriorCovering(region, result);
+  } else {
+    coverer.GetCovering(region, result);
+  }
+  // A covering that was cut short by a memory limit is not cached.
+  S2MemoryTracker* tracker = options_.memory_tracker();
+  if (tracker != nullptr && !tracker->ok()) return;
+  Entry entry{std::move(key), *result};
+  size_t bytes = EntryBytes(entry);
+  if (bytes > options_.max_cache_bytes()) return;
+
+  absl::MutexLock lock(&mutex_);
+  if (map_.contains(entry.key)) return;
+  entries_.push_front(std::move(entry));
+  map_.emplace(entries_.front().key, entries_.begin());
+  cache_bytes_ += bytes;
+  EvictEntries();
+}
+
+size_t S2CachingRegionCoverer::EntryBytes(const Entry& entry) {
+  // Include an estimate of the list node and hash table overhead so that
+  // caches of many small coverings are also bounded accurately.
+  return (entry.key.size() + entry.cells.size() * sizeof(S2CellId) +
+          sizeof(EntryList::value_type) + 4 * sizeof(void*) +
+          sizeof(decltype(map_)::value_type));
+}
+
+void S2CachingRegionCoverer::EvictEntries() {
+  while (cache_bytes_ > options_.max_cache_bytes()) {
+    const Entry& lru = entries_.back();
+    cache_bytes_ -= EntryBytes(lru);
+    map_.erase(lru.key);
+    entries_.pop_back();
+  }
+}
+
+void S2CachingRegionCoverer::Clear() {
+  absl::MutexLock lock(&mutex_);
+  map_.clear();
+  entries_.clear();
+  cache_bytes_ = 0;
+}
+
+int S2CachingRegionCoverer::num_entries() const {
+  absl::MutexLock lock(&mutex_);
+  return entries_.size();
+}
+
+size_t S2CachingRegionCoverer::cache_bytes() const {
+  absl::MutexLock lock(&mutex_);
+  return cache_bytes_;
+}
+
+int64 S2CachingRegionCoverer::num_hits() const {
+  absl::MutexLock lock(&mutex_);
+  return num_hits_;
+}
+
+int64 S2CachingRegionCoverer::num_misses() const {
+  absl::MutexLock lock(&mutex_);
+  return num_misses_;
+}
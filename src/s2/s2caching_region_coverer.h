@@ -0,0 +1,214 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2CACHING_REGION_COVERER_H_
+#define S2_S2CACHING_REGION_COVERER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "s2/base/integral_types.h"
+#include "s2/util/coding/coder.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2region_coverer.h"
+
+class S2Region;
+
+// S2CachingRegionCoverer computes coverings exactly like S2RegionCoverer,
+// but remembers the most recently used coverings so that repeated requests
+// for the same region are answered without running the covering algorithm
+// again.  This is useful for servers that cover the same set of regions
+// (e.g., delivery zones or common viewports) over and over.  Example usage:
+//
+//   S2CachingRegionCoverer::Options options;
+//   options.set_max_cells(20);
+//   options.set_max_cache_bytes(64 << 20);
+//   S2CachingRegionCoverer coverer(options);
+//   S2CellUnion covering = coverer.GetCovering(polygon);
+//
+// Each cached covering is keyed by a fingerprint of the region plus the
+// covering options.  The templated methods use a tag identifying the region
+// type followed by the region's own encoding (i.e., Region::Encode(Encoder*))
+// as the fingerprint, which is available for all the standard region types
+// (S2Cap, S2Cell, S2CellUnion, S2LatLngRect, S2Loop, S2Polygon, S2Polyline,
+// S2PointRegion).  Two regions of the same type with the same encoding
+// therefore share a cache entry, while regions of different types never do
+// (even if their encodings happen to be equal).  For other regions, or when the
+// caller already has a stable identifier for the region, the fingerprint can
+// be supplied explicitly.  The caller is then responsible for ensuring that
+// different regions have different fingerprints.
+//
+// The total size of the cached coverings and their keys is bounded by
+// max_cache_bytes(); the least recently used entries are evicted first.
+//
+// This class is thread-safe.  Cache lookups hold an internal lock only
+// briefly, and coverings are computed without holding the lock.
+class S2CachingRegionCoverer {
+ public:
+  class Options : public S2RegionCoverer::Options {
+   public:
+    Options() = default;
+    explicit Options(const S2RegionCoverer::Options& options)
+        : S2RegionCoverer::Options(options) {}
+
+    // The cache is shared by all threads, so options().memory_tracker() is
+    // not supported (S2MemoryTracker is not thread-safe, and a covering
+    // truncated by a memory limit must not be cached).  It must be nullptr.
+
+    // The maximum number of bytes used by the cache, including both the
+    // cached cell ids and their keys.  Coverings that are larger than this
+    // are computed but not cached.
+    //
+    // DEFAULT: 16 MiB
+    static constexpr size_t kDefaultMaxCacheBytes = 16 << 20;
+    size_t max_cache_bytes() const { return max_cache_bytes_; }
+    void set_max_cache_bytes(size_t max_cache_bytes) {
+      max_cache_bytes_ = max_cache_bytes;
+    }
+
+   private:
+    size_t max_cache_bytes_ = kDefaultMaxCacheBytes;
+  };
+
+  // Default constructor; uses the default options.
+  S2CachingRegionCoverer();
+
+  // Constructs a coverer with the given options.  Unlike S2RegionCoverer, the
+  // options cannot be changed after construction.
+  explicit S2CachingRegionCoverer(const Options& options);
+
+  S2CachingRegionCoverer(const S2CachingRegionCoverer&) = delete;
+  S2CachingRegionCoverer& operator=(const S2CachingRegionCoverer&) = delete;
+
+  const Options& options() const { return options_; }
+
+  // Returns the same result as S2RegionCoverer::GetCovering(region) and
+  // GetInteriorCovering(region), using Region::Encode() to compute the
+  // fingerprint of "region".
+  template <class Region>
+  S2CellUnion GetCovering(const Region& region);
+  template <class Region>
+  S2CellUnion GetInteriorCovering(const Region& region);
+
+  // As above, but "fingerprint" is used to identify the region rather than
+  // its encoding.  Regions with the same fingerprint must be identical.
+  S2CellUnion GetCovering(const S2Region& region,
+                          absl::string_view fingerprint);
+  S2CellUnion GetInteriorCovering(const S2Region& region,
+                                  absl::string_view fingerprint);
+
+  // Like the methods above, but works directly with a vector of S2CellIds.
+  void GetCovering(const S2Region& region, absl::string_view fingerprint,
+                   std::vector<S2CellId>* covering);
+  void GetInteriorCovering(const S2Region& region,
+                           absl::string_view fingerprint,
+                           std::vector<S2CellId>* interior);
+
+  // Returns the fingerprint used by the templated methods above.  It starts
+  // with a tag that is unique to "Region" within the current process, so
+  // fingerprints must not be persisted or shared with other processes.
+  template <class Region>
+  static std::string Fingerprint(const Region& region);
+
+  // Removes all cached coverings.
+  void Clear();
+
+  // Statistics about the cache.  The hit and miss counts are cumulative and
+  // are not reset by Clear().
+  int num_entries() const;
+  size_t cache_bytes() const;
+  int64 num_hits() const;
+  int64 num_misses() const;
+
+ private:
+  struct Entry {
+    std::string key;
+    std::vector<S2CellId> cells;
+  };
+  using EntryList = std::list<Entry>;
+
+  void GetCoveringInternal(const S2Region& region,
+                           absl::string_view fingerprint, bool interior,
+                           std::vector<S2CellId>* result);
+
+  // Returns an address that is unique to the type "Region".
+  template <class Region>
+  static const void* RegionTypeTag();
+
+  // Returns the number of bytes charged to the given entry.
+  static size_t EntryBytes(const Entry& entry);
+
+  // Evicts entries until the cache size is at most max_cache_bytes().
+  void EvictEntries() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const Options options_;
+
+  // The cache key prefix that encodes "options_".  There are separate
+  // prefixes for regular and interior coverings.
+  std::string covering_prefix_, interior_prefix_;
+
+  mutable absl::Mutex mutex_;
+
+  // Entries are ordered from most to least recently used.
+  EntryList entries_ ABSL_GUARDED_BY(mutex_);
+
+  // Maps each key to its entry.  The keys point into the key strings of
+  // "entries_", which are not moved while they are in the list.
+  absl::flat_hash_map<absl::string_view, EntryList::iterator> map_
+      ABSL_GUARDED_BY(mutex_);
+
+  size_t cache_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+  int64 num_hits_ ABSL_GUARDED_BY(mutex_) = 0;
+  int64 num_misses_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+template <class Region>
+const void* S2CachingRegionCoverer::RegionTypeTag() {
+  static const char kTag = 0;
+  return &kTag;
+}
+
+template <class Region>
+std::string S2CachingRegionCoverer::Fingerprint(const Region& region) {
+  Encoder encoder;
+  encoder.Ensure(sizeof(uint64));
+  encoder.put64(reinterpret_cast<uintptr_t>(RegionTypeTag<Region>()));
+  region.Encode(&encoder);
+  return std::string(encoder.base(), encoder.length());
+}
+
+template <class Region>
+S2CellUnion S2CachingRegionCoverer::GetCovering(const Region& region) {
+  return GetCovering(region, Fingerprint(region));
+}
+
+template <class Region>
+S2CellUnion S2CachingRegionCoverer::GetInteriorCovering(const Region& region) {
+  return GetInteriorCovering(region, Fingerprint(region));
+}
+
+#endif  // S2_S2CACHING_REGION_COVERER_H_
@@ -0,0 +1,176 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2caching_region_coverer.h"
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "s2/s1angle.h"
+#include "s2/util/coding/coder.h"
+#include "s2/s2cap.h"
+#include "s2/s2cell.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2latlng_rect.h"
+#include "s2/s2memory_tracker.h"
+#include "s2/s2polygon.h"
+#include "s2/s2region.h"
+#include "s2/s2region_coverer.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using std::vector;
+
+namespace {
+
+TEST(S2CachingRegionCoverer, MatchesRegionCoverer) {
+  S2CachingRegionCoverer::Options options;
+  options.set_max_cells(8);
+  options.set_max_level(20);
+  S2CachingRegionCoverer caching_coverer(options);
+  S2RegionCoverer coverer(options);
+  auto polygon = s2textformat::MakePolygonOrDie("0:0, 0:5, 5:5, 5:0");
+  for (int iter = 0; iter < 2; ++iter) {
+    EXPECT_EQ(coverer.GetCovering(*polygon),
+              caching_coverer.GetCovering(*polygon));
+    EXPECT_EQ(coverer.GetInteriorCovering(*polygon),
+              caching_coverer.GetInteriorCovering(*polygon));
+  }
+  EXPECT_EQ(2, caching_coverer.num_entries());
+  EXPECT_EQ(2, caching_coverer.num_misses());
+  EXPECT_EQ(2, caching_coverer.num_hits());
+
+  // A different region with the same fingerprint returns the cached result.
+  S2Cap cap(S2Point(1, 0, 0), S1Angle::Degrees(1));
+  EXPECT_EQ(coverer.GetCovering(*polygon),
+            caching_coverer.GetCovering(cap, S2CachingRegionCoverer::
+                                                 Fingerprint(*polygon)));
+  EXPECT_EQ(coverer.GetCovering(cap), caching_coverer.GetCovering(cap));
+  EXPECT_EQ(3, caching_coverer.num_entries());
+
+  caching_coverer.Clear();
+  EXPECT_EQ(0, caching_coverer.num_entries());
+  EXPECT_EQ(0, caching_coverer.cache_bytes());
+}
+
+// A region type whose encoding is the same as S2Cap's.
+class OtherCap final : public S2Region {
+ public:
+  explicit OtherCap(const S2Cap& cap) : cap_(cap) {}
+  OtherCap* Clone() const override { return new OtherCap(cap_); }
+  S2Cap GetCapBound() const override { return cap_.GetCapBound(); }
+  S2LatLngRect GetRectBound() const override { return cap_.GetRectBound(); }
+  bool Contains(const S2Cell& cell) const override {
+    return cap_.Contains(cell);
+  }
+  bool MayIntersect(const S2Cell& cell) const override {
+    return cap_.MayIntersect(cell);
+  }
+  bool Contains(const S2Point& p) const override { return cap_.Contains(p); }
+  void Encode(Encoder* encoder) const { cap_.Encode(encoder); }
+
+ private:
+  S2Cap cap_;
+};
+
+TEST(S2CachingRegionCoverer, FingerprintIncludesRegionType) {
+  S2Cap cap(S2Point(1, 0, 0), S1Angle::Degrees(1));
+  OtherCap other(cap);
+  EXPECT_EQ(S2CachingRegionCoverer::Fingerprint(cap),
+            S2CachingRegionCoverer::Fingerprint(S2Cap(cap)));
+  EXPECT_NE(S2CachingRegionCoverer::Fingerprint(cap),
+            S2CachingRegionCoverer::Fingerprint(other));
+
+  // The two regions are covered separately even though they are equal.
+
+  S2CachingRegionCoverer::Options options;
+  options.set_max_cells(8);
+  S2CachingRegionCoverer caching_coverer(options);
+  S2RegionCoverer coverer(options);
+  EXPECT_EQ(coverer.GetCovering(cap), caching_coverer.GetCovering(cap));
+  EXPECT_EQ(coverer.GetCovering(other), caching_coverer.GetCovering(other));
+  EXPECT_EQ(2, caching_coverer.num_entries());
+}
+
+TEST(S2CachingRegionCoverer, MemoryTrackerIsNotSupported) {
+  S2MemoryTracker tracker;
+  S2CachingRegionCoverer::Options options;
+  options.set_memory_tracker(&tracker);
+  EXPECT_DEBUG_DEATH(S2CachingRegionCoverer coverer(options),
+                     "memory_tracker");
+}
+
+TEST(S2CachingRegionCoverer, EvictsLeastRecentlyUsed) {
+  S2CachingRegionCoverer::Options options;
+  options.set_max_cells(20);
+  options.set_max_cache_bytes(2000);
+  S2CachingRegionCoverer coverer(options);
+  vector<S2Cap> caps;
+  for (int i = 0; i < 50; ++i) {
+    caps.emplace_back(S2Testing::RandomPoint(), S1Angle::Degrees(1));
+  }
+  for (int iter = 0; iter < 3; ++iter) {
+    for (const S2Cap& cap : caps) {
+      coverer.GetCovering(cap);
+      // Keep the first cap in the cache by using it frequently.
+      coverer.GetCovering(caps[0]);
+      EXPECT_LE(coverer.cache_bytes(), options.max_cache_bytes());
+    }
+  }
+  EXPECT_GT(coverer.num_entries(), 0);
+  EXPECT_LT(coverer.num_entries(), caps.size());
+  int64 hits = coverer.num_hits();
+  coverer.GetCovering(caps[0]);
+  EXPECT_EQ(hits + 1, coverer.num_hits());
+}
+
+TEST(S2CachingRegionCoverer, OversizedCoveringIsNotCached) {
+  S2CachingRegionCoverer::Options options;
+  options.set_max_cells(1000);
+  options.set_max_cache_bytes(100);
+  S2CachingRegionCoverer coverer(options);
+  S2Cap cap(S2Point(0, 1, 0), S1Angle::Degrees(10));
+  EXPECT_GT(coverer.GetCovering(cap).size(), 100);
+  EXPECT_EQ(0, coverer.num_entries());
+}
+
+TEST(S2CachingRegionCoverer, MultipleThreads) {
+  S2CachingRegionCoverer::Options options;
+  options.set_max_cells(10);
+  options.set_max_cache_bytes(20000);
+  S2CachingRegionCoverer caching_coverer(options);
+  vector<S2Cap> caps;
+  vector<S2CellUnion> expected;
+  S2RegionCoverer coverer(options);
+  for (int i = 0; i < 100; ++i) {
+    caps.emplace_back(S2Testing::RandomPoint(), S1Angle::Degrees(2));
+    expected.push_back(coverer.GetCovering(caps.back()));
+  }
+  vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 1000; ++i) {
+        int j = (i * 7 + t) % caps.size();
+        EXPECT_EQ(expected[j], caching_coverer.GetCovering(caps[j]));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(4000, caching_coverer.num_hits() + caching_coverer.num_misses());
+}
+
+}  // namespace
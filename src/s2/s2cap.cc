@@ -17,6 +17,7 @@
 
 #include "s2/s2cap.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 #include <iosfwd>
@@ -287,6 +288,98 @@ bool S2Cap::MayIntersect(const S2Cell& cell) const {
   return Intersects(cell, vertices);
 }
 
+namespace {
+
+// Cells are processed in blocks of this size by the batch methods below.
+constexpr int kCellBlockSize = 64;
+
+// Holds the vertices of a block of cells in structure-of-arrays form.
+struct CellVertexBlock {
+  double x[4][kCellBlockSize], y[4][kCellBlockSize], z[4][kCellBlockSize];
+
+  S2Point vertex(int k, int i) const {
+    return S2Point(x[i][k], y[i][k], z[i][k]);
+  }
+};
+
+// Computes the vertices of the given cells (at most kCellBlockSize), and
+// sets num_contained[k] to the number of vertices of cell k whose distance
+// from "center" is at most "radius".  The second pass computes
+// S1ChordAngle(center, v) <= radius exactly as S2Cap::Contains() does, but
+// without branches so that it can be vectorized.
+void GetContainedVertices(const S2Cell* cells, int n, const S2Point& center,
+                          S1ChordAngle radius, CellVertexBlock* block,
+                          int num_contained[]) {
+  for (int k = 0; k < n; ++k) {
+    for (int i = 0; i < 4; ++i) {
+      S2Point v = cells[k].GetVertex(i);
+      block->x[i][k] = v.x();
+      block->y[i][k] = v.y();
+      block->z[i][k] = v.z();
+    }
+  }
+  const double r2 = radius.length2();
+  for (int k = 0; k < n; ++k) {
+    int count = 0;
+    for (int i = 0; i < 4; ++i) {
+      double dx = center.x() - block->x[i][k];
+      double dy = center.y() - block->y[i][k];
+      double dz = center.z() - block->z[i][k];
+      count += std::min(4.0, dx * dx + dy * dy + dz * dz) <= r2;
+    }
+    num_contained[k] = count;
+  }
+}
+
+}  // namespace
+
+void S2Cap::ContainsBatch(absl::Span<const S2Cell> cells,
+                          absl::Span<bool> result) const {
+  S2_DCHECK_EQ(cells.size(), result.size());
+  const S2Cap complement = Complement();
+  CellVertexBlock block;
+  int num_contained[kCellBlockSize];
+  for (size_t begin = 0; begin < cells.size(); begin += kCellBlockSize) {
+    const int n = std::min<size_t>(kCellBlockSize, cells.size() - begin);
+    const S2Cell* cell = cells.data() + begin;
+    GetContainedVertices(cell, n, center_, radius_, &block, num_contained);
+    // As in Contains(S2Cell), only cells whose vertices are all contained
+    // need to be tested against the complement of the cap.
+    for (int k = 0; k < n; ++k) {
+      if (num_contained[k] < 4) {
+        result[begin + k] = false;
+      } else {
+        S2Point vertices[4];
+        for (int i = 0; i < 4; ++i) vertices[i] = block.vertex(k, i);
+        result[begin + k] = !complement.Intersects(cell[k], vertices);
+      }
+    }
+  }
+}
+
+void S2Cap::MayIntersectBatch(absl::Span<const S2Cell> cells,
+                              absl::Span<bool> result) const {
+  S2_DCHECK_EQ(cells.size(), result.size());
+  CellVertexBlock block;
+  int num_contained[kCellBlockSize];
+  for (size_t begin = 0; begin < cells.size(); begin += kCellBlockSize) {
+    const int n = std::min<size_t>(kCellBlockSize, cells.size() - begin);
+    const S2Cell* cell = cells.data() + begin;
+    GetContainedVertices(cell, n, center_, radius_, &block, num_contained);
+    // Only cells that don't have a vertex inside the cap need the more
+    // expensive edge test.
+    for (int k = 0; k < n; ++k) {
+      if (num_contained[k] > 0) {
+        result[begin + k] = true;
+      } else {
+        S2Point vertices[4];
+        for (int i = 0; i < 4; ++i) vertices[i] = block.vertex(k, i);
+        result[begin + k] = Intersects(cell[k], vertices);
+      }
+    }
+  }
+}
+
 bool S2Cap::Contains(const S2Point& p) const {
   S2_DCHECK(S2::IsUnitLength(p));
   return S1ChordAngle(center_, p) <= radius_;
@@ -23,6 +23,7 @@
 #include <iosfwd>
 #include <vector>
 
+#include "absl/types/span.h"
 #include "s2/base/logging.h"
 #include "s2/_fp_contract_off.h"
 #include "s2/s1angle.h"
@@ -186,6 +187,15 @@ class S2Cap final : public S2Region {
   bool Contains(const S2Cell& cell) const override;
   bool MayIntersect(const S2Cell& cell) const override;
 
+  // These give the same results as Contains(S2Cell) and MayIntersect(S2Cell),
+  // but compute the cell vertices in blocks and test them against the cap in
+  // a single branch-free pass.
+  void ContainsBatch(absl::Span<const S2Cell> cells,
+                     absl::Span<bool> result) const override;
+  void MayIntersectBatch(absl::Span<const S2Cell> cells,
+                         absl::Span<bool> result) const override;
+  bool HasFastCellContains() const override { return true; }
+
   // The point "p" should be a unit-length vector.
   bool Contains(const S2Point& p) const override;
 
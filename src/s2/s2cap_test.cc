@@ -17,7 +17,9 @@
 
 #include "s2/s2cap.h"
 
+#include <algorithm>
 #include <cfloat>
+#include <memory>
 
 #include <gtest/gtest.h>
 #include "s2/r1interval.h"
@@ -289,6 +291,36 @@ TEST(S2Cap, S2CellMethods) {
   }
 }
 
+TEST(S2Cap, ContainsAndMayIntersectBatch) {
+  // Test the children of random cells against random caps near them, so that
+  // all the different cases are exercised.
+  for (int iter = 0; iter < 1000; ++iter) {
+    S2CellId id = S2Testing::GetRandomCellId();
+    if (id.is_leaf()) id = id.parent();
+    vector<S2Cell> cells;
+    for (S2CellId c = id.child_begin(std::min(S2CellId::kMaxLevel,
+                                              id.level() + 3));
+         c != id.child_end(std::min(S2CellId::kMaxLevel, id.level() + 3));
+         c = c.next()) {
+      cells.push_back(S2Cell(c));
+    }
+    S2Cap cap(S2Testing::SamplePoint(S2Cell(id).GetCapBound()),
+              S1Angle::Radians(S2Testing::rnd.RandDouble() *
+                               S2::kMaxDiag.GetValue(id.level())));
+    if (iter == 0) cap = S2Cap::Empty();
+    if (iter == 1) cap = S2Cap::Full();
+    std::unique_ptr<bool[]> contains(new bool[cells.size()]);
+    std::unique_ptr<bool[]> intersects(new bool[cells.size()]);
+    cap.ContainsBatch(cells, absl::MakeSpan(contains.get(), cells.size()));
+    cap.MayIntersectBatch(cells,
+                          absl::MakeSpan(intersects.get(), cells.size()));
+    for (int k = 0; k < cells.size(); ++k) {
+      EXPECT_EQ(cap.Contains(cells[k]), contains[k]) << cells[k].id();
+      EXPECT_EQ(cap.MayIntersect(cells[k]), intersects[k]) << cells[k].id();
+    }
+  }
+}
+
 TEST(S2Cap, GetCellUnionBoundLevel1Radius) {
   // Check that a cap whose radius is approximately the width of a level 1
   // S2Cell can be covered by only 3 faces.
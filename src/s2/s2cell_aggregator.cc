@@ -0,0 +1,178 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2cell_aggregator.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "s2/encoded_s2cell_id_vector.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/s2cell_id_sort.h"
+
+using std::vector;
+
+static const unsigned char kCurrentEncodingVersionNumber = 1;
+
+S2CellAggregator::S2CellAggregator() {
+}
+
+S2CellAggregator::S2CellAggregator(int level) {
+  Init(level);
+}
+
+void S2CellAggregator::Init(int level) {
+  S2_DCHECK_GE(level, 0);
+  S2_DCHECK_LE(level, S2CellId::kMaxLevel);
+  level_ = level;
+  cell_ids_.clear();
+  stats_.clear();
+  pending_.clear();
+}
+
+void S2CellAggregator::Build() {
+  if (pending_.empty()) return;
+  S2RadixSort(absl::MakeSpan(pending_),
+              [](const std::pair<S2CellId, Stats>& x) {
+                return x.first.id();
+              });
+
+  // Merge the sorted pending values with the existing cells, combining the
+  // statistics of equal cells.
+  vector<S2CellId> cell_ids;
+  vector<Stats> stats;
+  cell_ids.reserve(cell_ids_.size() + pending_.size());
+  stats.reserve(cell_ids_.size() + pending_.size());
+  size_t i = 0, j = 0;
+  while (i < cell_ids_.size() || j < pending_.size()) {
+    S2CellId id;
+    Stats s;
+    if (j == pending_.size() ||
+        (i < cell_ids_.size() && cell_ids_[i] < pending_[j].first)) {
+      id = cell_ids_[i];
+      s = stats_[i++];
+    } else {
+      id = pending_[j].first;
+      s = pending_[j++].second;
+    }
+    if (!cell_ids.empty() && cell_ids.back() == id) {
+      stats.back().Merge(s);
+    } else {
+      cell_ids.push_back(id);
+      stats.push_back(s);
+    }
+  }
+  cell_ids_.swap(cell_ids);
+  stats_.swap(stats);
+  pending_.clear();
+}
+
+void S2CellAggregator::Merge(const S2CellAggregator& other) {
+  S2_DCHECK_GE(other.level_, level_);
+  S2_DCHECK(other.pending_.empty());
+  pending_.reserve(pending_.size() + other.cell_ids_.size());
+  for (size_t i = 0; i < other.cell_ids_.size(); ++i) {
+    Add(other.cell_ids_[i], other.stats_[i]);
+  }
+  Build();
+}
+
+int S2CellAggregator::LowerBound(S2CellId id) const {
+  return static_cast<int>(
+      std::lower_bound(cell_ids_.begin(), cell_ids_.end(), id) -
+      cell_ids_.begin());
+}
+
+S2CellAggregator::Stats S2CellAggregator::GetStats(S2CellId id) const {
+  S2_DCHECK(pending_.empty());
+  if (id.level() > level_) id = id.parent(level_);
+  Stats result;
+  S2CellId limit = id.range_max();
+  for (int i = LowerBound(id.range_min());
+       i < num_cells() && cell_ids_[i] <= limit; ++i) {
+    result.Merge(stats_[i]);
+  }
+  return result;
+}
+
+S2CellAggregator S2CellAggregator::RollUp(int level) const {
+  S2_DCHECK_LE(level, level_);
+  S2_DCHECK(pending_.empty());
+  // Since S2CellId::parent() preserves the ordering of cells, the result is
+  // already sorted and equal parents are adjacent.
+  S2CellAggregator result(level);
+  for (int i = 0; i < num_cells(); ++i) {
+    S2CellId parent = cell_ids_[i].parent(level);
+    if (!result.cell_ids_.empty() && result.cell_ids_.back() == parent) {
+      result.stats_.back().Merge(stats_[i]);
+    } else {
+      result.cell_ids_.push_back(parent);
+      result.stats_.push_back(stats_[i]);
+    }
+  }
+  return result;
+}
+
+void S2CellAggregator::Encode(Encoder* const encoder) const {
+  S2_DCHECK(pending_.empty());
+  encoder->Ensure(2 * sizeof(unsigned char));
+  encoder->put8(kCurrentEncodingVersionNumber);
+  encoder->put8(level_);
+  s2coding::EncodeS2CellIdVector(cell_ids_, encoder);
+  vector<uint64> counts;
+  counts.reserve(stats_.size());
+  for (const Stats& s : stats_) counts.push_back(s.count);
+  s2coding::EncodeUintVector<uint64>(counts, encoder);
+  encoder->Ensure(3 * sizeof(double) * stats_.size());
+  for (const Stats& s : stats_) {
+    encoder->putdouble(s.sum);
+    encoder->putdouble(s.min);
+    encoder->putdouble(s.max);
+  }
+}
+
+bool S2CellAggregator::Decode(Decoder* const decoder) {
+  if (decoder->avail() < 2 * sizeof(unsigned char)) return false;
+  unsigned char version = decoder->get8();
+  if (version > kCurrentEncodingVersionNumber) return false;
+  int level = decoder->get8();
+  if (level > S2CellId::kMaxLevel) return false;
+
+  s2coding::EncodedS2CellIdVector cell_ids;
+  if (!cell_ids.Init(decoder)) return false;
+  s2coding::EncodedUintVector<uint64> counts;
+  if (!counts.Init(decoder)) return false;
+  size_t n = cell_ids.size();
+  if (counts.size() != n) return false;
+  if (decoder->avail() / (3 * sizeof(double)) < n) return false;
+
+  // GetStats() and RollUp() require distinct valid cells at "level" in
+  // increasing order.
+  vector<S2CellId> ids = cell_ids.Decode();
+  for (size_t i = 0; i < n; ++i) {
+    if (!ids[i].is_valid() || ids[i].level() != level) return false;
+    if (i > 0 && ids[i] <= ids[i - 1]) return false;
+  }
+  Init(level);
+  cell_ids_ = std::move(ids);
+  stats_.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    stats_[i].count = counts[i];
+    stats_[i].sum = decoder->getdouble();
+    stats_[i].min = decoder->getdouble();
+    stats_[i].max = decoder->getdouble();
+  }
+  return true;
+}
@@ -0,0 +1,193 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2CELL_AGGREGATOR_H_
+#define S2_S2CELL_AGGREGATOR_H_
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "s2/base/integral_types.h"
+#include "s2/base/logging.h"
+#include "s2/util/coding/coder.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2point.h"
+
+// S2CellAggregator accumulates statistics (count, sum, minimum and maximum)
+// of values that are associated with S2CellIds, such as events binned into
+// the cells of a heatmap.  Values are stored as a sorted vector of distinct
+// cells at a fixed level, so that coarser levels can be computed by a single
+// linear pass (see RollUp) and the statistics of any cell can be found by
+// binary search (see GetStats).  This is much more cache-friendly than
+// accumulating values in a hash map keyed by S2CellId.
+//
+// Aggregators built by different threads can be combined with Merge(), and
+// aggregators can be serialized with Encode() (the cell ids are encoded
+// using EncodeS2CellIdVector).
+//
+// Example usage:
+//
+//   S2CellAggregator aggregator(13);
+//   for (const auto& event : events) {
+//     aggregator.Add(event.point, event.value);
+//   }
+//   aggregator.Build();
+//   S2CellAggregator coarse = aggregator.RollUp(10);
+//   for (int i = 0; i < coarse.num_cells(); ++i) {
+//     Draw(coarse.cell_id(i), coarse.stats(i).sum);
+//   }
+//
+// This class is not thread-safe while values are being added, but the const
+// methods may be called concurrently once Build() has been called.
+class S2CellAggregator {
+ public:
+  // The statistics accumulated for each cell.
+  struct Stats {
+    int64 count = 0;
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    // Adds a single value.
+    void Add(double value);
+
+    // Adds all the values represented by "other".
+    void Merge(const Stats& other);
+
+    // Returns sum / count, or 0 if there are no values.
+    double mean() const { return count == 0 ? 0 : sum / count; }
+  };
+
+  // Default constructor; requires Init() to be called.
+  S2CellAggregator();
+
+  // Convenience constructor that calls Init().
+  explicit S2CellAggregator(int level);
+
+  // Initializes an empty aggregator whose values are aggregated into cells
+  // at the given level.
+  //
+  // REQUIRES: 0 <= level <= S2CellId::kMaxLevel
+  void Init(int level);
+
+  // The level of the cells that values are aggregated into.
+  int level() const { return level_; }
+
+  // Adds a value to the cell at level() containing "id".
+  //
+  // REQUIRES: id.level() >= level()
+  void Add(S2CellId id, double value);
+
+  // Adds a value to the cell at level() containing "p".
+  void Add(const S2Point& p, double value);
+
+  // Adds the given statistics to the cell at level() containing "id".
+  //
+  // REQUIRES: id.level() >= level()
+  void Add(S2CellId id, const Stats& stats);
+
+  // Sorts the values added since the last call and combines them with the
+  // existing cells.  This method must be called before any of the methods
+  // below.  It may be called again after more values have been added.
+  void Build();
+
+  // Adds all the cells of "other" to this aggregator.  This can be used to
+  // combine aggregators that were built in parallel by different threads.
+  //
+  // REQUIRES: other.level() >= level()
+  // REQUIRES: Build() has been called on both aggregators.
+  void Merge(const S2CellAggregator& other);
+
+  // Returns the number of distinct cells that have at least one value.
+  int num_cells() const { return static_cast<int>(cell_ids_.size()); }
+
+  // Returns the i-th distinct cell (in increasing S2CellId order) and its
+  // statistics.
+  S2CellId cell_id(int i) const { return cell_ids_[i]; }
+  const Stats& stats(int i) const { return stats_[i]; }
+
+  // Returns all the distinct cells in increasing order.
+  const std::vector<S2CellId>& cell_ids() const { return cell_ids_; }
+
+  // Returns the combined statistics of all values in the given cell, which
+  // may be at any level.  (If the cell is smaller than level(), this is the
+  // statistics of the cell at level() that contains it.)
+  Stats GetStats(S2CellId id) const;
+
+  // Returns a new aggregator where the cells are replaced by their ancestors
+  // at the given (coarser) level.
+  //
+  // REQUIRES: level <= level()
+  S2CellAggregator RollUp(int level) const;
+
+  // Appends an encoded representation of the aggregator to "encoder".
+  //
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  // REQUIRES: Build() has been called.
+  void Encode(Encoder* const encoder) const;
+
+  // Decodes an aggregator encoded with Encode().  Returns true on success.
+  bool Decode(Decoder* const decoder);
+
+ private:
+  // Returns the index of the first cell that is >= "id".
+  int LowerBound(S2CellId id) const;
+
+  int level_ = -1;
+
+  // The distinct cells at level_ in increasing order, and their statistics.
+  std::vector<S2CellId> cell_ids_;
+  std::vector<Stats> stats_;
+
+  // Values added since the last call to Build().
+  std::vector<std::pair<S2CellId, Stats>> pending_;
+};
+
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+inline void S2CellAggregator::Stats::Add(double value) {
+  ++count;
+  sum += value;
+  if (value < min) min = value;
+  if (value > max) max = value;
+}
+
+inline void S2CellAggregator::Stats::Merge(const Stats& other) {
+  count += other.count;
+  sum += other.sum;
+  if (other.min < min) min = other.min;
+  if (other.max > max) max = other.max;
+}
+
+inline void S2CellAggregator::Add(S2CellId id, double value) {
+  Stats stats;
+  stats.Add(value);
+  Add(id, stats);
+}
+
+inline void S2CellAggregator::Add(const S2Point& p, double value) {
+  Add(S2CellId(p), value);
+}
+
+inline void S2CellAggregator::Add(S2CellId id, const Stats& stats) {
+  S2_DCHECK_GE(id.level(), level_);
+  pending_.push_back(std::make_pair(id.parent(level_), stats));
+}
+
+#endif  // S2_S2CELL_AGGREGATOR_H_
@@ -0,0 +1,182 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2cell_aggregator.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "s2/util/coding/coder.h"
+#include "s2/encoded_s2cell_id_vector.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2testing.h"
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace {
+
+struct Event {
+  S2CellId id;
+  double value;
+};
+
+// Returns events clustered in a small cap, so that many share a cell.
+vector<Event> RandomEvents(int num_events) {
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(0.5));
+  vector<Event> events;
+  for (int i = 0; i < num_events; ++i) {
+    events.push_back(Event{S2CellId(S2Testing::SamplePoint(cap)),
+                           S2Testing::rnd.UniformDouble(-10, 10)});
+  }
+  return events;
+}
+
+void ExpectStatsEqual(const S2CellAggregator::Stats& expected,
+                      const S2CellAggregator::Stats& actual) {
+  EXPECT_EQ(expected.count, actual.count);
+  EXPECT_NEAR(expected.sum, actual.sum, 1e-10);
+  EXPECT_EQ(expected.min, actual.min);
+  EXPECT_EQ(expected.max, actual.max);
+}
+
+// Checks "aggregator" against a brute force aggregation of "events".
+void CheckAggregator(const vector<Event>& events,
+                     const S2CellAggregator& aggregator) {
+  map<S2CellId, S2CellAggregator::Stats> expected;
+  for (const Event& event : events) {
+    expected[event.id.parent(aggregator.level())].Add(event.value);
+  }
+  ASSERT_EQ(expected.size(), aggregator.num_cells());
+  int i = 0;
+  for (const auto& entry : expected) {
+    EXPECT_EQ(entry.first, aggregator.cell_id(i));
+    ExpectStatsEqual(entry.second, aggregator.stats(i));
+    ++i;
+  }
+}
+
+TEST(S2CellAggregator, Empty) {
+  S2CellAggregator aggregator(10);
+  aggregator.Build();
+  EXPECT_EQ(0, aggregator.num_cells());
+  EXPECT_EQ(0, aggregator.GetStats(S2CellId::FromFace(0)).count);
+  EXPECT_EQ(0, aggregator.RollUp(5).num_cells());
+}
+
+TEST(S2CellAggregator, AddAndBuild) {
+  vector<Event> events = RandomEvents(1000);
+  S2CellAggregator aggregator(12);
+  // Build in two stages to check that new values are combined with the
+  // existing cells.
+  for (int i = 0; i < 500; ++i) aggregator.Add(events[i].id, events[i].value);
+  aggregator.Build();
+  for (int i = 500; i < 1000; ++i) {
+    aggregator.Add(events[i].id, events[i].value);
+  }
+  aggregator.Build();
+  CheckAggregator(events, aggregator);
+}
+
+TEST(S2CellAggregator, RollUpAndGetStats) {
+  vector<Event> events = RandomEvents(1000);
+  S2CellAggregator aggregator(14);
+  for (const Event& event : events) aggregator.Add(event.id, event.value);
+  aggregator.Build();
+  for (int level = 14; level >= 0; level -= 3) {
+    S2CellAggregator rolled_up = aggregator.RollUp(level);
+    EXPECT_EQ(level, rolled_up.level());
+    CheckAggregator(events, rolled_up);
+    for (int i = 0; i < rolled_up.num_cells(); ++i) {
+      ExpectStatsEqual(rolled_up.stats(i),
+                       aggregator.GetStats(rolled_up.cell_id(i)));
+    }
+  }
+  // Cells smaller than the aggregation level return the statistics of the
+  // containing cell.
+  ExpectStatsEqual(aggregator.stats(0),
+                   aggregator.GetStats(aggregator.cell_id(0).child_begin(20)));
+}
+
+TEST(S2CellAggregator, Merge) {
+  vector<Event> events = RandomEvents(1000);
+  S2CellAggregator a(10), b(13);
+  for (int i = 0; i < 1000; ++i) {
+    (i % 2 ? a : b).Add(events[i].id, events[i].value);
+  }
+  a.Build();
+  b.Build();
+  a.Merge(b);
+  CheckAggregator(events, a);
+}
+
+TEST(S2CellAggregator, EncodeDecode) {
+  vector<Event> events = RandomEvents(1000);
+  S2CellAggregator aggregator(11);
+  for (const Event& event : events) aggregator.Add(event.id, event.value);
+  aggregator.Build();
+  Encoder encoder;
+  aggregator.Encode(&encoder);
+  Decoder decoder(encoder.base(), encoder.length());
+  S2CellAggregator decoded;
+  ASSERT_TRUE(decoded.Decode(&decoder));
+  EXPECT_EQ(0, decoder.avail());
+  EXPECT_EQ(aggregator.level(), decoded.level());
+  CheckAggregator(events, decoded);
+
+  // Truncated encodings are rejected.
+  for (size_t n = 0; n < encoder.length(); ++n) {
+    Decoder truncated(encoder.base(), n);
+    EXPECT_FALSE(decoded.Decode(&truncated)) << n;
+  }
+}
+
+// Returns an encoding of the given cells, each with a count of 1.
+static string EncodeCells(int level, const vector<S2CellId>& ids) {
+  Encoder encoder;
+  encoder.Ensure(2);
+  encoder.put8(1);
+  encoder.put8(level);
+  s2coding::EncodeS2CellIdVector(ids, &encoder);
+  s2coding::EncodeUintVector<uint64>(vector<uint64>(ids.size(), 1), &encoder);
+  encoder.Ensure(3 * sizeof(double) * ids.size());
+  for (size_t i = 0; i < 3 * ids.size(); ++i) encoder.putdouble(1.0);
+  return string(encoder.base(), encoder.length());
+}
+
+TEST(S2CellAggregator, DecodeCorrupt) {
+  const S2CellId a = S2CellId::FromFace(1).child_begin(3);
+  const S2CellId b = a.next();
+  auto decode = [](int level, const vector<S2CellId>& ids) {
+    string encoded = EncodeCells(level, ids);
+    Decoder decoder(encoded.data(), encoded.size());
+    S2CellAggregator aggregator;
+    return aggregator.Decode(&decoder);
+  };
+  EXPECT_TRUE(decode(3, {a, b}));
+  EXPECT_FALSE(decode(3, {b, a}));            // Not sorted.
+  EXPECT_FALSE(decode(3, {a, a}));            // Not distinct.
+  EXPECT_FALSE(decode(2, {a, b}));            // Wrong level.
+  EXPECT_FALSE(decode(3, {a, S2CellId()}));   // Invalid cell.
+  EXPECT_FALSE(decode(31, {}));               // Invalid level.
+}
+
+}  // namespace
@@ -0,0 +1,413 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2cell_bitmap.h"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "absl/numeric/bits.h"
+#include "s2/base/logging.h"
+#include "s2/util/coding/varint.h"
+
+using std::max;
+using std::min;
+using std::vector;
+
+static const unsigned char kCurrentEncodingVersionNumber = 1;
+
+// Each container holds the cells of a range of (1 << kChunkBits) positions.
+static constexpr int kChunkBits = 16;
+static constexpr uint32 kChunkSize = 1 << kChunkBits;
+static constexpr int kNumWords = kChunkSize / 64;
+
+// Containers with more cells than this are stored as bitmaps.
+static constexpr int kMaxArraySize = 4096;
+
+// Returns a mask of the bits of word "w" that correspond to the offsets
+// [begin, end), which must overlap that word.
+static inline uint64 WordMask(uint32 w, uint32 begin, uint32 end) {
+  uint32 lo = max(begin, 64 * w) - 64 * w;
+  uint32 hi = min(end, 64 * w + 64) - 64 * w;
+  return (hi - lo == 64) ? ~uint64{0} : ((uint64{1} << (hi - lo)) - 1) << lo;
+}
+
+bool S2CellBitmap::Container::Contains(uint32 offset) const {
+  if (!bits.empty()) return (bits[offset >> 6] >> (offset & 63)) & 1;
+  return std::binary_search(array.begin(), array.end(), offset);
+}
+
+int S2CellBitmap::Container::CountRange(uint32 begin, uint32 end) const {
+  if (bits.empty()) {
+    return std::lower_bound(array.begin(), array.end(), end) -
+           std::lower_bound(array.begin(), array.end(), begin);
+  }
+  int count = 0;
+  for (uint32 w = begin >> 6; w <= (end - 1) >> 6; ++w) {
+    count += absl::popcount(bits[w] & WordMask(w, begin, end));
+  }
+  return count;
+}
+
+void S2CellBitmap::Container::AddRange(uint32 begin, uint32 end) {
+  if (bits.empty()) {
+    int new_cardinality =
+        cardinality + (end - begin) - CountRange(begin, end);
+    if (new_cardinality <= kMaxArraySize) {
+      auto first = std::lower_bound(array.begin(), array.end(), begin);
+      auto last = std::lower_bound(first, array.end(), end);
+      vector<uint16> range;
+      for (uint32 offset = begin; offset < end; ++offset) {
+        range.push_back(offset);
+      }
+      auto pos = array.erase(first, last);
+      array.insert(pos, range.begin(), range.end());
+      cardinality = new_cardinality;
+      return;
+    }
+    ToBitmap();
+  }
+  for (uint32 w = begin >> 6; w <= (end - 1) >> 6; ++w) {
+    uint64 old_bits = bits[w];
+    bits[w] |= WordMask(w, begin, end);
+    cardinality += absl::popcount(bits[w]) - absl::popcount(old_bits);
+  }
+}
+
+void S2CellBitmap::Container::ToBitmap() {
+  if (!bits.empty()) return;
+  bits.assign(kNumWords, 0);
+  for (uint16 offset : array) bits[offset >> 6] |= uint64{1} << (offset & 63);
+  vector<uint16>().swap(array);
+}
+
+void S2CellBitmap::Container::Optimize() {
+  if (bits.empty() || cardinality > kMaxArraySize) return;
+  array.clear();
+  array.reserve(cardinality);
+  for (int w = 0; w < kNumWords; ++w) {
+    for (uint64 word = bits[w]; word != 0; word &= word - 1) {
+      array.push_back(64 * w + absl::countr_zero(word));
+    }
+  }
+  vector<uint64>().swap(bits);
+}
+
+bool S2CellBitmap::Container::operator==(const Container& other) const {
+  return key == other.key && cardinality == other.cardinality &&
+         array == other.array && bits == other.bits;
+}
+
+S2CellBitmap::S2CellBitmap() {
+}
+
+S2CellBitmap::S2CellBitmap(int level) {
+  Init(level);
+}
+
+void S2CellBitmap::Init(int level) {
+  S2_DCHECK_GE(level, 0);
+  S2_DCHECK_LE(level, S2CellId::kMaxLevel);
+  level_ = level;
+  containers_.clear();
+}
+
+S2CellBitmap S2CellBitmap::FromCellUnion(const S2CellUnion& cell_union,
+                                         int level) {
+  S2CellBitmap result(level);
+  for (S2CellId id : cell_union) result.Add(id);
+  return result;
+}
+
+int64 S2CellBitmap::num_cells() const {
+  int64 count = 0;
+  for (const Container& c : containers_) count += c.cardinality;
+  return count;
+}
+
+size_t S2CellBitmap::SpaceUsed() const {
+  size_t size = containers_.capacity() * sizeof(Container);
+  for (const Container& c : containers_) {
+    size += c.array.capacity() * sizeof(uint16);
+    size += c.bits.capacity() * sizeof(uint64);
+  }
+  return size;
+}
+
+uint64 S2CellBitmap::GetPosition(S2CellId id) const {
+  S2_DCHECK(id.is_valid());
+  S2_DCHECK_GE(id.level(), level_);
+  return id.parent(level_).id() >> (2 * (S2CellId::kMaxLevel - level_) + 1);
+}
+
+void S2CellBitmap::GetPositionRange(S2CellId id, uint64* begin,
+                                    uint64* end) const {
+  if (id.level() >= level_) {
+    *begin = GetPosition(id);
+    *end = *begin + 1;
+  } else {
+    *begin = GetPosition(id.child_begin(level_));
+    *end = *begin + (uint64{1} << (2 * (level_ - id.level())));
+  }
+}
+
+int S2CellBitmap::LowerBound(uint64 key) const {
+  return std::lower_bound(containers_.begin(), containers_.end(), key,
+                          [](const Container& c, uint64 key) {
+                            return c.key < key;
+                          }) - containers_.begin();
+}
+
+int64 S2CellBitmap::CountRange(uint64 begin, uint64 end) const {
+  int64 count = 0;
+  uint64 last_key = (end - 1) >> kChunkBits;
+  for (int i = LowerBound(begin >> kChunkBits);
+       i < containers_.size() && containers_[i].key <= last_key; ++i) {
+    const Container& c = containers_[i];
+    uint64 start = c.key << kChunkBits;
+    count += c.CountRange(max(begin, start) - start,
+                          min(end, start + kChunkSize) - start);
+  }
+  return count;
+}
+
+void S2CellBitmap::AddRange(uint64 begin, uint64 end) {
+  int i = LowerBound(begin >> kChunkBits);
+  for (uint64 key = begin >> kChunkBits; key <= (end - 1) >> kChunkBits;
+       ++key, ++i) {
+    if (i == containers_.size() || containers_[i].key != key) {
+      Container c;
+      c.key = key;
+      containers_.insert(containers_.begin() + i, std::move(c));
+    }
+    uint64 start = key << kChunkBits;
+    containers_[i].AddRange(max(begin, start) - start,
+                            min(end, start + kChunkSize) - start);
+  }
+}
+
+void S2CellBitmap::Add(S2CellId id) {
+  uint64 begin, end;
+  GetPositionRange(id, &begin, &end);
+  AddRange(begin, end);
+}
+
+bool S2CellBitmap::Contains(S2CellId id) const {
+  uint64 begin, end;
+  GetPositionRange(id, &begin, &end);
+  return CountRange(begin, end) == end - begin;
+}
+
+bool S2CellBitmap::Intersects(S2CellId id) const {
+  uint64 begin, end;
+  GetPositionRange(id, &begin, &end);
+  return CountRange(begin, end) > 0;
+}
+
+bool S2CellBitmap::Contains(const S2Point& p) const {
+  uint64 pos = GetPosition(S2CellId(p));
+  int i = LowerBound(pos >> kChunkBits);
+  return (i < containers_.size() && containers_[i].key == pos >> kChunkBits &&
+          containers_[i].Contains(pos & (kChunkSize - 1)));
+}
+
+S2CellBitmap S2CellBitmap::Union(const S2CellBitmap& other) const {
+  S2_DCHECK_EQ(level_, other.level_);
+  S2CellBitmap result(level_);
+  auto i = containers_.begin(), j = other.containers_.begin();
+  while (i != containers_.end() || j != other.containers_.end()) {
+    if (j == other.containers_.end() ||
+        (i != containers_.end() && i->key < j->key)) {
+      result.containers_.push_back(*i++);
+    } else if (i == containers_.end() || j->key < i->key) {
+      result.containers_.push_back(*j++);
+    } else {
+      Container c;
+      c.key = i->key;
+      if (i->bits.empty() && j->bits.empty()) {
+        std::set_union(i->array.begin(), i->array.end(),
+                       j->array.begin(), j->array.end(),
+                       std::back_inserter(c.array));
+        c.cardinality = c.array.size();
+        if (c.cardinality > kMaxArraySize) c.ToBitmap();
+      } else {
+        Container x = *i, y = *j;
+        x.ToBitmap();
+        y.ToBitmap();
+        c.bits.resize(kNumWords);
+        for (int w = 0; w < kNumWords; ++w) {
+          c.bits[w] = x.bits[w] | y.bits[w];
+          c.cardinality += absl::popcount(c.bits[w]);
+        }
+      }
+      result.containers_.push_back(std::move(c));
+      ++i;
+      ++j;
+    }
+  }
+  return result;
+}
+
+S2CellBitmap S2CellBitmap::Intersection(const S2CellBitmap& other) const {
+  S2_DCHECK_EQ(level_, other.level_);
+  S2CellBitmap result(level_);
+  auto i = containers_.begin(), j = other.containers_.begin();
+  while (i != containers_.end() && j != other.containers_.end()) {
+    if (i->key < j->key) {
+      ++i;
+    } else if (j->key < i->key) {
+      ++j;
+    } else {
+      Container c;
+      c.key = i->key;
+      if (i->bits.empty() && j->bits.empty()) {
+        std::set_intersection(i->array.begin(), i->array.end(),
+                              j->array.begin(), j->array.end(),
+                              std::back_inserter(c.array));
+        c.cardinality = c.array.size();
+      } else if (i->bits.empty() || j->bits.empty()) {
+        const Container& array = i->bits.empty() ? *i : *j;
+        const Container& bitmap = i->bits.empty() ? *j : *i;
+        for (uint16 offset : array.array) {
+          if (bitmap.Contains(offset)) c.array.push_back(offset);
+        }
+        c.cardinality = c.array.size();
+      } else {
+        c.bits.resize(kNumWords);
+        for (int w = 0; w < kNumWords; ++w) {
+          c.bits[w] = i->bits[w] & j->bits[w];
+          c.cardinality += absl::popcount(c.bits[w]);
+        }
+        c.Optimize();
+      }
+      if (c.cardinality > 0) result.containers_.push_back(std::move(c));
+      ++i;
+      ++j;
+    }
+  }
+  return result;
+}
+
+vector<S2CellId> S2CellBitmap::GetCellIds() const {
+  const int shift = 2 * (S2CellId::kMaxLevel - level_) + 1;
+  const uint64 lsb = uint64{1} << (shift - 1);
+  vector<S2CellId> result;
+  result.reserve(num_cells());
+  for (const Container& c : containers_) {
+    uint64 start = c.key << kChunkBits;
+    if (c.bits.empty()) {
+      for (uint16 offset : c.array) {
+        result.push_back(S2CellId(((start + offset) << shift) | lsb));
+      }
+    } else {
+      for (int w = 0; w < kNumWords; ++w) {
+        for (uint64 word = c.bits[w]; word != 0; word &= word - 1) {
+          uint64 pos = start + 64 * w + absl::countr_zero(word);
+          result.push_back(S2CellId((pos << shift) | lsb));
+        }
+      }
+    }
+  }
+  return result;
+}
+
+S2CellUnion S2CellBitmap::ToCellUnion() const {
+  return S2CellUnion(GetCellIds());
+}
+
+bool operator==(const S2CellBitmap& x, const S2CellBitmap& y) {
+  return x.level_ == y.level_ && x.containers_ == y.containers_;
+}
+
+void S2CellBitmap::Encode(Encoder* const encoder) const {
+  encoder->Ensure(2 * sizeof(unsigned char) + Varint::kMax64);
+  encoder->put8(kCurrentEncodingVersionNumber);
+  encoder->put8(level_);
+  encoder->put_varint64(containers_.size());
+  for (const Container& c : containers_) {
+    encoder->Ensure(Varint::kMax64 + Varint::kMax32 +
+                    c.array.size() * sizeof(uint16) +
+                    c.bits.size() * sizeof(uint64));
+    encoder->put_varint64(c.key);
+    encoder->put_varint32(c.cardinality);
+    for (uint16 offset : c.array) encoder->put16(offset);
+    for (uint64 word : c.bits) encoder->put64(word);
+  }
+}
+
+bool S2CellBitmap::Decode(Decoder* const decoder) {
+  if (decoder->avail() < 2 * sizeof(unsigned char)) return false;
+  unsigned char version = decoder->get8();
+  if (version > kCurrentEncodingVersionNumber) return false;
+  int level = decoder->get8();
+  if (level > S2CellId::kMaxLevel) return false;
+  uint64 num_containers;
+  if (!decoder->get_varint64(&num_containers)) return false;
+
+  // There are 6 * 4**level cells at the given level.  Each container uses at
+  // least 4 bytes (its key, its cardinality and one 16-bit position), which
+  // bounds the number of containers before any memory is allocated.
+  const uint64 num_positions = uint64{6} << (2 * level);
+  const uint64 max_key = (num_positions - 1) >> kChunkBits;
+  if (num_containers > max_key + 1 || num_containers > decoder->avail() / 4) {
+    return false;
+  }
+  vector<Container> containers;
+  containers.reserve(num_containers);
+  for (uint64 i = 0; i < num_containers; ++i) {
+    Container c;
+    uint32 cardinality;
+    if (!decoder->get_varint64(&c.key)) return false;
+    if (!decoder->get_varint32(&cardinality)) return false;
+    if (c.key > max_key) return false;
+    if (!containers.empty() && c.key <= containers.back().key) return false;
+    // The last container may cover fewer than kChunkSize positions.
+    const uint64 chunk_size =
+        std::min<uint64>(kChunkSize, num_positions - (c.key << kChunkBits));
+    if (cardinality == 0 || cardinality > chunk_size) return false;
+    c.cardinality = cardinality;
+    if (cardinality <= kMaxArraySize) {
+      if (decoder->avail() < cardinality * sizeof(uint16)) return false;
+      c.array.resize(cardinality);
+      for (uint32 k = 0; k < cardinality; ++k) {
+        c.array[k] = decoder->get16();
+        if (k > 0 && c.array[k] <= c.array[k - 1]) return false;
+      }
+      if (c.array.back() >= chunk_size) return false;
+    } else {
+      if (decoder->avail() < kNumWords * sizeof(uint64)) return false;
+      c.bits.resize(kNumWords);
+      uint32 count = 0;
+      for (int w = 0; w < kNumWords; ++w) {
+        c.bits[w] = decoder->get64();
+        count += absl::popcount(c.bits[w]);
+      }
+      if (count != cardinality) return false;
+      if (chunk_size < kChunkSize) {
+        // No positions beyond the end of the last container may be set.
+        int w = chunk_size >> 6;
+        if ((c.bits[w] >> (chunk_size & 63)) != 0) return false;
+        while (++w < kNumWords) {
+          if (c.bits[w] != 0) return false;
+        }
+      }
+    }
+    containers.push_back(std::move(c));
+  }
+  level_ = level;
+  containers_.swap(containers);
+  return true;
+}
@@ -0,0 +1,158 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2CELL_BITMAP_H_
+#define S2_S2CELL_BITMAP_H_
+
+#include <vector>
+
+#include "s2/base/integral_types.h"
+#include "s2/util/coding/coder.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2point.h"
+
+// S2CellBitmap represents a set of cells at a single fixed level as a
+// compressed bitmap over their positions along the Hilbert curve.  It is an
+// alternative to S2CellUnion for fixed-level coverings (such as those
+// computed by S2RegionCoverer with set_fixed_level()), where storing a
+// 64-bit S2CellId per cell is wasteful.
+//
+// The representation is similar to "Roaring" bitmaps: the Hilbert curve
+// positions are divided into chunks of 65536 consecutive cells, and the
+// cells present in each non-empty chunk are stored either as a sorted array
+// of 16-bit offsets (if there are at most 4096 of them) or as a bitmap of
+// 65536 bits.  This uses at most 2 bytes per cell, and much less for dense
+// sets (e.g., the interior of a large region).
+//
+// Example usage:
+//
+//   S2RegionCoverer coverer;
+//   coverer.mutable_options()->set_fixed_level(14);
+//   S2CellBitmap a = S2CellBitmap::FromCellUnion(coverer.GetCovering(x), 14);
+//   S2CellBitmap b = S2CellBitmap::FromCellUnion(coverer.GetCovering(y), 14);
+//   if (a.Intersection(b).num_cells() > 100) { ... }
+//
+// This class is thread-compatible.
+class S2CellBitmap {
+ public:
+  // Default constructor; requires Init() to be called.
+  S2CellBitmap();
+
+  // Convenience constructor that calls Init().
+  explicit S2CellBitmap(int level);
+
+  // Initializes an empty set of cells at the given level.
+  //
+  // REQUIRES: 0 <= level <= S2CellId::kMaxLevel
+  void Init(int level);
+
+  // Returns the set of cells at the given level that intersect "cell_union".
+  // (Cells of "cell_union" that are smaller than "level" are replaced by
+  // their ancestor at that level, and larger cells are replaced by all their
+  // descendants at that level.)
+  static S2CellBitmap FromCellUnion(const S2CellUnion& cell_union, int level);
+
+  // The level of the cells in the set.
+  int level() const { return level_; }
+
+  // Returns true if the set contains no cells.
+  bool empty() const { return containers_.empty(); }
+
+  // Returns the number of cells in the set.
+  int64 num_cells() const;
+
+  // Returns the number of bytes used by the set (not including sizeof(*this)).
+  size_t SpaceUsed() const;
+
+  // Adds all the cells at level() that intersect the given cell.  Note that
+  // if "id" is larger than level(), this takes time proportional to the
+  // number of descendants at level() divided by 64.
+  void Add(S2CellId id);
+
+  // Returns true if the set contains all the cells at level() that intersect
+  // the given cell.
+  bool Contains(S2CellId id) const;
+
+  // Returns true if the set contains any cell at level() that intersects the
+  // given cell.
+  bool Intersects(S2CellId id) const;
+
+  // Returns true if the set contains the cell at level() containing "p".
+  bool Contains(const S2Point& p) const;
+
+  // Returns the union or intersection of this set with "other".
+  //
+  // REQUIRES: other.level() == level()
+  S2CellBitmap Union(const S2CellBitmap& other) const;
+  S2CellBitmap Intersection(const S2CellBitmap& other) const;
+
+  // Returns the cells of the set in increasing order.
+  std::vector<S2CellId> GetCellIds() const;
+
+  // Returns the set as a normalized S2CellUnion (where groups of four
+  // sibling cells are replaced by their parent).
+  S2CellUnion ToCellUnion() const;
+
+  friend bool operator==(const S2CellBitmap& x, const S2CellBitmap& y);
+  friend bool operator!=(const S2CellBitmap& x, const S2CellBitmap& y) {
+    return !(x == y);
+  }
+
+  // Appends an encoded representation of the set to "encoder".
+  //
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  void Encode(Encoder* const encoder) const;
+
+  // Decodes a set encoded with Encode().  Returns true on success.
+  bool Decode(Decoder* const decoder);
+
+ private:
+  // The cells whose Hilbert curve positions have the same high-order bits.
+  // Exactly one of "array" and "bits" is non-empty.
+  struct Container {
+    uint64 key;                  // Position >> 16.
+    int cardinality = 0;         // Number of cells present.
+    std::vector<uint16> array;   // Sorted low 16 bits of each position.
+    std::vector<uint64> bits;    // Bitmap of low 16 bits (1024 words).
+
+    bool Contains(uint32 offset) const;
+    int CountRange(uint32 begin, uint32 end) const;
+    void AddRange(uint32 begin, uint32 end);
+    void ToBitmap();
+    void Optimize();
+    bool operator==(const Container& other) const;
+  };
+
+  // Returns the Hilbert curve position of the cell at level_ containing "id",
+  // or the range of positions of the cells at level_ within "id".
+  uint64 GetPosition(S2CellId id) const;
+  void GetPositionRange(S2CellId id, uint64* begin, uint64* end) const;
+
+  // Returns the number of cells in the set in the given range of positions.
+  int64 CountRange(uint64 begin, uint64 end) const;
+
+  // Adds the cells in the given range of positions.
+  void AddRange(uint64 begin, uint64 end);
+
+  // Returns the index of the first container whose key is >= "key".
+  int LowerBound(uint64 key) const;
+
+  int level_ = -1;
+  std::vector<Container> containers_;  // Sorted by key.
+};
+
+#endif  // S2_S2CELL_BITMAP_H_
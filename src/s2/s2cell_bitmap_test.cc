@@ -0,0 +1,171 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2cell_bitmap.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "s2/util/coding/coder.h"
+#include "s2/util/coding/varint.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2region_coverer.h"
+#include "s2/s2testing.h"
+
+using std::vector;
+
+namespace {
+
+// Returns the normalized covering of a random cap at the given fixed level.
+S2CellUnion GetRandomCovering(int level, double radius_degrees) {
+  S2RegionCoverer::Options options;
+  options.set_fixed_level(level);
+  options.set_max_cells(1000);
+  S2RegionCoverer coverer(options);
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(radius_degrees));
+  return S2CellUnion(coverer.GetCovering(cap).Release());
+}
+
+TEST(S2CellBitmap, Empty) {
+  S2CellBitmap bitmap(10);
+  EXPECT_TRUE(bitmap.empty());
+  EXPECT_EQ(0, bitmap.num_cells());
+  EXPECT_FALSE(bitmap.Intersects(S2CellId::FromFace(0)));
+  EXPECT_TRUE(bitmap.ToCellUnion().empty());
+}
+
+TEST(S2CellBitmap, AddAndContains) {
+  S2CellBitmap bitmap(8);
+  S2CellId id = S2CellId::FromFace(3).child_begin(8).advance(70000);
+  bitmap.Add(id);
+  EXPECT_EQ(1, bitmap.num_cells());
+  EXPECT_TRUE(bitmap.Contains(id));
+  EXPECT_TRUE(bitmap.Contains(id.child_begin(20)));
+  EXPECT_TRUE(bitmap.Contains(id.ToPoint()));
+  EXPECT_FALSE(bitmap.Contains(id.next()));
+  EXPECT_FALSE(bitmap.Contains(id.parent()));
+  EXPECT_TRUE(bitmap.Intersects(id.parent()));
+
+  // Adding a larger cell adds all its descendants at the bitmap level.
+  bitmap.Add(id.parent(3));
+  EXPECT_EQ(1 << 10, bitmap.num_cells());
+  EXPECT_TRUE(bitmap.Contains(id.parent(3)));
+  EXPECT_EQ(S2CellUnion({id.parent(3)}), bitmap.ToCellUnion());
+}
+
+TEST(S2CellBitmap, ArrayAndBitmapContainers) {
+  // Dense sets use bitmap containers and much less space than S2CellIds.
+  S2CellBitmap dense(12);
+  dense.Add(S2CellId::FromFace(1).child_begin(3));
+  EXPECT_EQ(1 << 18, dense.num_cells());
+  EXPECT_LT(dense.SpaceUsed(), dense.num_cells() / 4);
+
+  // Sparse sets use array containers.
+  S2CellBitmap sparse(12);
+  S2CellId id = S2CellId::FromFace(1).child_begin(12);
+  for (int i = 0; i < 1000; ++i) sparse.Add(id.advance(97 * i));
+  EXPECT_EQ(1000, sparse.num_cells());
+  EXPECT_LT(sparse.SpaceUsed(), 4 * sparse.num_cells());
+
+  // Intersecting them converts the result back to an array container.
+  S2CellBitmap both = dense.Intersection(sparse);
+  EXPECT_EQ(sparse, both);
+}
+
+TEST(S2CellBitmap, MatchesCellUnion) {
+  for (int iter = 0; iter < 20; ++iter) {
+    int level = S2Testing::rnd.Uniform(6) + 8;
+    double radius = S2Testing::rnd.UniformDouble(0.1, 2.0);
+    S2CellUnion a = GetRandomCovering(level, radius);
+    S2CellUnion b = GetRandomCovering(level, radius);
+    // Make the caps overlap.
+    b = b.Union(GetRandomCovering(level, radius));
+    S2CellBitmap a_bitmap = S2CellBitmap::FromCellUnion(a, level);
+    S2CellBitmap b_bitmap = S2CellBitmap::FromCellUnion(b, level);
+    EXPECT_EQ(a, a_bitmap.ToCellUnion());
+    EXPECT_EQ(a.Union(b), a_bitmap.Union(b_bitmap).ToCellUnion());
+    EXPECT_EQ(a.Intersection(b),
+              a_bitmap.Intersection(b_bitmap).ToCellUnion());
+    S2CellBitmap c_bitmap = S2CellBitmap::FromCellUnion(a.Union(b), level);
+    EXPECT_EQ(c_bitmap, a_bitmap.Union(b_bitmap));
+    for (S2CellId id : a) {
+      EXPECT_TRUE(a_bitmap.Contains(id));
+      EXPECT_EQ(b.Intersects(id), b_bitmap.Intersects(id));
+      EXPECT_EQ(b.Contains(id), b_bitmap.Contains(id));
+    }
+  }
+}
+
+TEST(S2CellBitmap, EncodeDecode) {
+  S2CellBitmap bitmap(14);
+  bitmap.Add(S2CellId::FromFace(5).child_begin(5));
+  for (S2CellId id : GetRandomCovering(14, 1.0)) bitmap.Add(id);
+  Encoder encoder;
+  bitmap.Encode(&encoder);
+  Decoder decoder(encoder.base(), encoder.length());
+  S2CellBitmap decoded;
+  ASSERT_TRUE(decoded.Decode(&decoder));
+  EXPECT_EQ(0, decoder.avail());
+  EXPECT_EQ(bitmap, decoded);
+
+  Decoder truncated(encoder.base(), encoder.length() - 1);
+  EXPECT_FALSE(decoded.Decode(&truncated));
+}
+
+// Decodes an encoding that consists of a version, a level, a number of
+// containers and then the given container data.
+static bool DecodeRaw(int level, uint64 num_containers,
+                      const vector<uint16>& data) {
+  Encoder encoder;
+  encoder.Ensure(2 + Varint::kMax64 + 2 * data.size());
+  encoder.put8(1);
+  encoder.put8(level);
+  encoder.put_varint64(num_containers);
+  for (uint16 x : data) encoder.put16(x);
+  Decoder decoder(encoder.base(), encoder.length());
+  S2CellBitmap bitmap;
+  return bitmap.Decode(&decoder);
+}
+
+TEST(S2CellBitmap, DecodeCorrupt) {
+  // Every prefix of a valid encoding is rejected.
+  S2CellBitmap bitmap(7);
+  for (S2CellId id : GetRandomCovering(7, 10.0)) bitmap.Add(id);
+  Encoder encoder;
+  bitmap.Encode(&encoder);
+  for (size_t n = 0; n < encoder.length(); ++n) {
+    Decoder decoder(encoder.base(), n);
+    S2CellBitmap decoded;
+    EXPECT_FALSE(decoded.Decode(&decoder)) << n;
+  }
+
+  // Each container below starts with a one-byte varint key and cardinality
+  // (written as a single little-endian 16-bit value), followed by its
+  // positions.  Level 1 has 24 positions.
+  EXPECT_TRUE(DecodeRaw(1, 1, {0x0200, 3, 23}));
+  EXPECT_FALSE(DecodeRaw(1, 1, {0x0200, 3, 24}));   // Position out of range.
+  EXPECT_FALSE(DecodeRaw(1, 1, {0x0200, 3, 3}));    // Positions not sorted.
+  EXPECT_FALSE(DecodeRaw(1, 1, {0x0101, 3}));       // Key out of range.
+  EXPECT_FALSE(DecodeRaw(1, 1, {0x1900, 0}));       // Too many positions.
+  EXPECT_FALSE(DecodeRaw(1, 2, {0x0100, 0}));       // Too many containers.
+  EXPECT_FALSE(DecodeRaw(1, 1000000000, {}));       // Too many containers.
+  EXPECT_FALSE(DecodeRaw(20, uint64{1} << 60, {}));
+  EXPECT_FALSE(DecodeRaw(31, 0, {}));               // Level out of range.
+}
+
+}  // namespace
@@ -22,22 +22,23 @@
 #include <cmath>
 #include <cstring>
 #include <iosfwd>
-#include <mutex>
 #include <vector>
 
-#include "absl/base/call_once.h"
 #include "absl/base/casts.h"
 #include "absl/strings/str_cat.h"
+#include "absl/utility/utility.h"
 
 #include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
 #include "s2/util/bits/bits.h"
 #include "s2/util/coding/coder.h"
+#include "s2/util/endian/endian.h"
 #include "s2/r1interval.h"
 #include "s2/s2coords.h"
 #include "s2/s2latlng.h"
 
 using absl::StrCat;
+using S2::internal::kIJtoPos;
 using S2::internal::kSwapMask;
 using S2::internal::kInvertMask;
 using S2::internal::kPosToIJ;
@@ -76,43 +77,79 @@ const int S2CellId::kMaxLevel;
 const int S2CellId::kPosBits;
 const int S2CellId::kMaxSize;
 
-static const int kLookupBits = 4;
-static uint16 lookup_pos[1 << (2 * kLookupBits + 2)];
-static uint16 lookup_ij[1 << (2 * kLookupBits + 2)];
+static constexpr int kLookupBits = 4;
+static constexpr int kLookupSize = 1 << (2 * kLookupBits + 2);
 
-static void InitLookupCell(int level, int i, int j, int orig_orientation,
-                           int pos, int orientation) {
-  if (level == kLookupBits) {
-    int ij = (i << kLookupBits) + j;
-    lookup_pos[(ij << 2) + orig_orientation] = (pos << 2) + orientation;
-    lookup_ij[(pos << 2) + orig_orientation] = (ij << 2) + orientation;
-  } else {
-    level++;
-    i <<= 1;
-    j <<= 1;
-    pos <<= 2;
-    const int* r = kPosToIJ[orientation];
-    InitLookupCell(level, i + (r[0] >> 1), j + (r[0] & 1), orig_orientation,
-                   pos, orientation ^ kPosToOrientation[0]);
-    InitLookupCell(level, i + (r[1] >> 1), j + (r[1] & 1), orig_orientation,
-                   pos + 1, orientation ^ kPosToOrientation[1]);
-    InitLookupCell(level, i + (r[2] >> 1), j + (r[2] & 1), orig_orientation,
-                   pos + 2, orientation ^ kPosToOrientation[2]);
-    InitLookupCell(level, i + (r[3] >> 1), j + (r[3] & 1), orig_orientation,
-                   pos + 3, orientation ^ kPosToOrientation[3]);
-  }
+namespace {
+
+constexpr int LookupPos(int i, int j, int orientation, int level, int pos);
+constexpr int LookupIJ(int pos, int orientation, int level, int i, int j);
+
+// Helpers for LookupPos() and LookupIJ() that descend into the child at
+// Hilbert curve position "child".
+constexpr int LookupPosChild(int i, int j, int orientation, int level,
+                             int pos, int child) {
+  return LookupPos(i, j, orientation ^ kPosToOrientation[child], level - 1,
+                   (pos << 2) + child);
+}
+
+constexpr int LookupIJChild(int pos, int orientation, int level, int i, int j,
+                            int child) {
+  return LookupIJ(pos, orientation ^ kPosToOrientation[child], level - 1,
+                  (i << 1) + (kPosToIJ[orientation][child] >> 1),
+                  (j << 1) + (kPosToIJ[orientation][child] & 1));
+}
+
+// Returns the "lookup_pos" value for the subcell containing the low "level"
+// bits of "i" and "j", given the orientation of the current cell and the
+// Hilbert curve position "pos" of the bits already consumed.
+constexpr int LookupPos(int i, int j, int orientation, int level, int pos) {
+  return level == 0 ? (pos << 2) + orientation
+      : LookupPosChild(i, j, orientation, level, pos,
+                       kIJtoPos[orientation][(((i >> (level - 1)) & 1) << 1) +
+                                             ((j >> (level - 1)) & 1)]);
 }
 
-static absl::once_flag flag;
-inline static void MaybeInit() {
-  absl::call_once(flag, []{
-    InitLookupCell(0, 0, 0, 0, 0, 0);
-    InitLookupCell(0, 0, 0, kSwapMask, 0, kSwapMask);
-    InitLookupCell(0, 0, 0, kInvertMask, 0, kInvertMask);
-    InitLookupCell(0, 0, 0, kSwapMask|kInvertMask, 0, kSwapMask|kInvertMask);
-  });
+// Returns the "lookup_ij" value for the subcell at the low 2 * "level" bits
+// of the Hilbert curve position "pos", given the orientation of the current
+// cell and the bits of "i" and "j" already computed.
+constexpr int LookupIJ(int pos, int orientation, int level, int i, int j) {
+  return level == 0 ? (((i << kLookupBits) + j) << 2) + orientation
+      : LookupIJChild(pos, orientation, level, i, j,
+                      (pos >> (2 * (level - 1))) & 3);
 }
 
+// The lookup tables are computed at compile time, so that they do not need
+// to be initialized before the first call to FromFaceIJ() or
+// ToFaceIJOrientation().  Each table is indexed by a value of the form
+// "xxxxxxxxoo", where "oo" is the orientation of the current cell.
+template <class Sequence>
+struct LookupTables;
+
+template <size_t... Ks>
+struct LookupTables<absl::index_sequence<Ks...>> {
+  static constexpr uint16 pos[sizeof...(Ks)] = {
+    static_cast<uint16>(LookupPos(Ks >> (kLookupBits + 2),
+                                  (Ks >> 2) & ((1 << kLookupBits) - 1),
+                                  Ks & 3, kLookupBits, 0))...
+  };
+  static constexpr uint16 ij[sizeof...(Ks)] = {
+    static_cast<uint16>(LookupIJ(Ks >> 2, Ks & 3, kLookupBits, 0, 0))...
+  };
+};
+
+template <size_t... Ks>
+constexpr uint16 LookupTables<absl::index_sequence<Ks...>>::pos[];
+template <size_t... Ks>
+constexpr uint16 LookupTables<absl::index_sequence<Ks...>>::ij[];
+
+using Lookup = LookupTables<absl::make_index_sequence<kLookupSize>>;
+
+}  // namespace
+
+static constexpr const uint16* lookup_pos = Lookup::pos;
+static constexpr const uint16* lookup_ij = Lookup::ij;
+
 S2CellId S2CellId::advance(int64 steps) const {
   if (steps == 0) return *this;
 
@@ -198,12 +235,49 @@ int S2CellId::GetCommonAncestorLevel(S2CellId other) const {
   return max(60 - Bits::FindMSBSetNonZero64(bits), -1) >> 1;
 }
 
-// Print the num_digits low order hex digits.
-static string HexFormatString(uint64 val, size_t num_digits) {
-  string result(num_digits, ' ');
-  for (; num_digits--; val >>= 4)
-    result[num_digits] = "0123456789abcdef"[val & 0xF];
-  return result;
+constexpr int S2CellId::kMaxTokenLength;
+
+// Converts the 8 nibbles of "x" to 8 lowercase hex digits, returned as the
+// bytes of a uint64 with the most significant digit in the most significant
+// byte.  All 8 digits are computed at once using ordinary 64-bit integer
+// arithmetic on the bytes of "v", without a branch or table lookup per digit.
+static inline uint64 HexDigits8(uint32 x) {
+  // Spread the nibbles so that nibble "i" occupies byte "i".
+  uint64 v = x;
+  v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+  v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+  v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  // Bytes with values >= 10 have bit 4 set after adding 6.
+  uint64 letters = ((v + 0x0606060606060606ULL) >> 4) & 0x0101010101010101ULL;
+  return v + 0x3030303030303030ULL + letters * ('a' - '0' - 10);
+}
+
+// Maps each character to its hex value, or 0xff if it is not a hex digit.
+static const uint8* HexValues() {
+  static const uint8* const values = []() {
+    static uint8 table[256];
+    for (int c = 0; c < 256; ++c) {
+      table[c] = ('0' <= c && c <= '9') ? c - '0'
+               : ('a' <= c && c <= 'f') ? c - 'a' + 10
+               : ('A' <= c && c <= 'F') ? c - 'A' + 10 : 0xff;
+    }
+    return table;
+  }();
+  return values;
+}
+
+int S2CellId::ToToken(char* buf) const {
+  // "0" with trailing 0s stripped is the empty string, which is not a
+  // reasonable token.  Encode as "X".
+  if (id_ == 0) {
+    buf[0] = 'X';
+    return 1;
+  }
+  // Write all 16 digits (big-endian so that the most significant digit comes
+  // first) and then trim the trailing zeros.
+  BigEndian::Store64(buf, HexDigits8(id_ >> 32));
+  BigEndian::Store64(buf + 8, HexDigits8(id_));
+  return kMaxTokenLength - Bits::FindLSBSetNonZero64(id_) / 4;
 }
 
 string S2CellId::ToToken() const {
@@ -216,33 +290,50 @@ string S2CellId::ToToken() const {
   // Using base 64 would produce slightly shorter tokens, but for typical cell
   // sizes used during indexing (up to level 15 or so) the average savings
   // would be less than 2 bytes per cell which doesn't seem worth it.
-
-  // "0" with trailing 0s stripped is the empty string, which is not a
-  // reasonable token.  Encode as "X".
-  if (id_ == 0) return "X";
-  const size_t num_zero_digits = Bits::FindLSBSetNonZero64(id_) / 4;
-  return HexFormatString(id_ >> (4 * num_zero_digits), 16 - num_zero_digits);
+  char buf[kMaxTokenLength];
+  return string(buf, ToToken(buf));
 }
 
 S2CellId S2CellId::FromToken(const absl::string_view token) {
-  if (token.length() > 16) return S2CellId::None();
+  if (token.length() > kMaxTokenLength) return S2CellId::None();
+  // Invalid characters are detected by accumulating the high bits of their
+  // table entries, which avoids a branch per character.
+  const uint8* values = HexValues();
   uint64 id = 0;
+  uint32 invalid = 0;
   for (int i = 0, pos = 60; i < token.length(); ++i, pos -= 4) {
-    uint64 d;
-    if ('0' <= token[i] && token[i] <= '9') {
-      d = token[i] - '0';
-    } else if ('a' <= token[i] && token[i] <= 'f') {
-      d = token[i] - 'a' + 10;
-    } else if ('A' <= token[i] && token[i] <= 'F') {
-      d = token[i] - 'A' + 10;
-    } else {
-      return S2CellId::None();
-    }
-    id |= d << pos;
+    uint32 d = values[static_cast<uint8>(token[i])];
+    invalid |= d;
+    id |= static_cast<uint64>(d & 0xf) << pos;
   }
+  if (invalid & 0xf0) return S2CellId::None();
   return S2CellId(id);
 }
 
+void S2CellId::AppendTokens(absl::Span<const S2CellId> ids, char delimiter,
+                            string* out) {
+  // Reserve room for the longest possible output and then shrink the string
+  // to the actual length, so that characters can be written directly.
+  size_t size = out->size();
+  out->resize(size + ids.size() * (kMaxTokenLength + 1));
+  char* p = &(*out)[0] + size;
+  for (S2CellId id : ids) {
+    p += id.ToToken(p);
+    *p++ = delimiter;
+  }
+  out->resize(p - out->data());
+}
+
+void S2CellId::FromTokens(absl::string_view tokens, char delimiter,
+                          vector<S2CellId>* ids) {
+  while (!tokens.empty()) {
+    size_t end = tokens.find(delimiter);
+    if (end == absl::string_view::npos) end = tokens.size();
+    ids->push_back(FromToken(tokens.substr(0, end)));
+    tokens.remove_prefix(min(end + 1, tokens.size()));
+  }
+}
+
 void S2CellId::Encode(Encoder* const encoder) const {
   encoder->Ensure(sizeof(uint64));  // A single uint64.
   encoder->put64(id_);
@@ -255,16 +346,13 @@ bool S2CellId::Decode(Decoder* const decoder) {
 }
 
 S2CellId S2CellId::FromFaceIJ(int face, int i, int j) {
-  // Initialization if not done yet
-  MaybeInit();
-
   // Optimization notes:
   //  - Non-overlapping bit fields can be combined with either "+" or "|".
   //    Generally "+" seems to produce better code, but not always.
 
   // Note that this value gets shifted one bit to the left at the end
   // of the function.
-  uint64 n = absl::implicit_cast<uint64>(face) << (kPosBits - 1);
+  uint64 n = absl::implicit_cast<uint64>(face) << (S2CellId::kPosBits - 1);
 
   // Alternating faces have opposite Hilbert curve orientations; this
   // is necessary in order for all faces to have a right-handed
@@ -310,9 +398,67 @@ S2CellId::S2CellId(const S2LatLng& ll)
   : S2CellId(ll.ToPoint()) {
 }
 
+// The (face, u, v) coordinate permutation used by S2::ValidFaceXYZtoUV(),
+// expressed as tables so that it can be applied without branches: for each
+// face, u = kUSign * p[kUAxis] / p[face % 3] and similarly for v.
+static constexpr int kUAxis[6] = {1, 0, 0, 2, 2, 1};
+static constexpr int kVAxis[6] = {2, 2, 1, 1, 0, 0};
+static constexpr double kUSign[6] = {1, -1, -1, 1, 1, -1};
+static constexpr double kVSign[6] = {1, 1, -1, 1, -1, -1};
+
+void S2CellId::FromPoints(absl::Span<const S2Point> points,
+                          absl::Span<S2CellId> ids) {
+  S2_DCHECK_EQ(points.size(), ids.size());
+
+  // Points are converted in blocks.  The first pass computes (face, i, j)
+  // using only conditional moves and table lookups, which avoids the branch
+  // mispredictions of S2::XYZtoFaceUV() when consecutive points lie on
+  // different faces.  The second pass maps (face, i, j) to Hilbert curve
+  // positions.  Negating the numerator by multiplying it by -1 is exact, so
+  // the results are identical to the scalar code.
+  constexpr int kBlockSize = 64;
+  int face[kBlockSize], i[kBlockSize], j[kBlockSize];
+  for (size_t begin = 0; begin < points.size(); begin += kBlockSize) {
+    const int n = min<size_t>(kBlockSize, points.size() - begin);
+    const S2Point* p = points.data() + begin;
+    for (int k = 0; k < n; ++k) {
+      // This is S2::GetFace(), written so that it compiles without branches.
+      double x = fabs(p[k][0]), y = fabs(p[k][1]), z = fabs(p[k][2]);
+      int axis = (x > y) ? ((x > z) ? 0 : 2) : ((y > z) ? 1 : 2);
+      int f = axis + 3 * (p[k][axis] < 0);
+      double w = p[k][axis];
+      double u = kUSign[f] * p[k][kUAxis[f]] / w;
+      double v = kVSign[f] * p[k][kVAxis[f]] / w;
+      face[k] = f;
+      i[k] = S2::STtoIJ(S2::UVtoST(u));
+      j[k] = S2::STtoIJ(S2::UVtoST(v));
+    }
+    S2CellId* out = ids.data() + begin;
+    for (int k = 0; k < n; ++k) {
+      out[k] = FromFaceIJ(face[k], i[k], j[k]);
+    }
+  }
+}
+
+void S2CellId::FromLatLngs(absl::Span<const S2LatLng> latlngs,
+                           absl::Span<S2CellId> ids) {
+  S2_DCHECK_EQ(latlngs.size(), ids.size());
+  constexpr int kBlockSize = 64;
+  S2Point points[kBlockSize];
+  for (size_t begin = 0; begin < latlngs.size(); begin += kBlockSize) {
+    const int n = min<size_t>(kBlockSize, latlngs.size() - begin);
+    for (int k = 0; k < n; ++k) points[k] = latlngs[begin + k].ToPoint();
+    FromPoints(absl::MakeConstSpan(points, n), ids.subspan(begin, n));
+  }
+}
+
+void S2CellId::ToPoints(absl::Span<const S2CellId> ids,
+                        absl::Span<S2Point> points) {
+  S2_DCHECK_EQ(ids.size(), points.size());
+  for (size_t k = 0; k < ids.size(); ++k) points[k] = ids[k].ToPoint();
+}
+
 int S2CellId::ToFaceIJOrientation(int* pi, int* pj, int* orientation) const {
-  // Initialization if not done yet
-  MaybeInit();
 
   int i = 0, j = 0;
   int face = this->face();
@@ -586,6 +732,106 @@ void S2CellId::AppendAllNeighbors(int nbr_level,
   }
 }
 
+int S2CellId::GetAllNeighbors(S2CellId neighbors[8]) const {
+  int i, j;
+  int level = this->level();
+  int size = GetSizeIJ(level);
+  int face = ToFaceIJOrientation(&i, &j, nullptr);
+  i &= -size;
+  j &= -size;
+
+  int num_neighbors = 0;
+  for (int di = -1; di <= 1; ++di) {
+    int ni = i + di * size;
+    bool isame = (ni >= 0 && ni < kMaxSize);
+    for (int dj = -1; dj <= 1; ++dj) {
+      if (di == 0 && dj == 0) continue;
+      int nj = j + dj * size;
+      bool jsame = (nj >= 0 && nj < kMaxSize);
+      // If both coordinates are on a different face then the diagonal
+      // neighbor would be beyond a cube vertex, where there is no cell.
+      if (!isame && !jsame) continue;
+      neighbors[num_neighbors++] =
+          FromFaceIJSame(face, ni, nj, isame && jsame).parent(level);
+    }
+  }
+  return num_neighbors;
+}
+
+bool S2CellId::VisitDisk(int k, const CellDistanceVisitor& visitor) const {
+  return VisitDistanceRange(0, k, visitor);
+}
+
+bool S2CellId::VisitRing(int k, const CellDistanceVisitor& visitor) const {
+  return VisitDistanceRange(k, k, visitor);
+}
+
+bool S2CellId::VisitDistanceRange(int min_k, int max_k,
+                                  const CellDistanceVisitor& visitor) const {
+  S2_DCHECK_GE(min_k, 0);
+  S2_DCHECK_LE(min_k, max_k);
+  int i, j;
+  int level = this->level();
+  int size = GetSizeIJ(level);
+  int face = ToFaceIJOrientation(&i, &j, nullptr);
+  i &= -size;
+  j &= -size;
+
+  // If the disk of radius "max_k" is contained by this face, then the cells
+  // at distance "d" are simply the boundary of a square of (2 * d + 1) cells
+  // on a side, which we can enumerate directly.
+  int64 reach = int64{max_k} * size;
+  if (i - reach >= 0 && i + reach + size <= kMaxSize &&
+      j - reach >= 0 && j + reach + size <= kMaxSize) {
+    for (int d = min_k; d <= max_k; ++d) {
+      auto visit = [&](int di, int dj) {
+        return visitor(FromFaceIJ(face, i + di * size, j + dj * size)
+                       .parent(level), d);
+      };
+      if (d == 0) {
+        if (!visitor(*this, 0)) return false;
+        continue;
+      }
+      for (int t = -d; t <= d; ++t) {
+        if (!visit(t, -d) || !visit(t, d)) return false;
+      }
+      for (int t = -d + 1; t < d; ++t) {
+        if (!visit(-d, t) || !visit(d, t)) return false;
+      }
+    }
+    return true;
+  }
+
+  // Otherwise we do a breadth-first search.  The neighbors of the cells at
+  // distance "d" are all at distance (d - 1), d, or (d + 1), so it is
+  // sufficient to keep the last two layers of cells (sorted by id) in order
+  // to determine which neighbors are new.
+  vector<S2CellId> prev, curr(1, *this), next;
+  S2CellId neighbors[8];
+  for (int d = 0; !curr.empty(); ++d) {
+    if (d >= min_k) {
+      for (S2CellId id : curr) {
+        if (!visitor(id, d)) return false;
+      }
+    }
+    if (d == max_k) break;
+    next.clear();
+    for (S2CellId id : curr) {
+      int n = id.GetAllNeighbors(neighbors);
+      next.insert(next.end(), neighbors, neighbors + n);
+    }
+    std::sort(next.begin(), next.end());
+    next.erase(std::unique(next.begin(), next.end()), next.end());
+    next.erase(std::remove_if(next.begin(), next.end(), [&](S2CellId id) {
+        return (std::binary_search(prev.begin(), prev.end(), id) ||
+                std::binary_search(curr.begin(), curr.end(), id));
+      }), next.end());
+    prev.swap(curr);
+    curr.swap(next);
+  }
+  return true;
+}
+
 string S2CellId::ToString() const {
   if (!is_valid()) {
     return StrCat("Invalid: ", absl::Hex(id(), absl::kZeroPad16));
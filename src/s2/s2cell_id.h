@@ -27,6 +27,7 @@
 
 #include "absl/hash/hash.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 #include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
@@ -116,6 +117,25 @@ class S2CellId {
   // Construct a leaf cell containing the given normalized S2LatLng.
   explicit S2CellId(const S2LatLng& ll);
 
+  // Converts each element of "points" (or "latlngs") to the leaf cell
+  // containing it, i.e. sets ids[k] = S2CellId(points[k]).  This gives
+  // exactly the same results as the constructors above but is much faster
+  // for large batches, because points are processed in blocks using
+  // separate passes without data-dependent branches.  The points do not
+  // need to be normalized.
+  //
+  // REQUIRES: ids.size() == points.size()
+  static void FromPoints(absl::Span<const S2Point> points,
+                         absl::Span<S2CellId> ids);
+  static void FromLatLngs(absl::Span<const S2LatLng> latlngs,
+                          absl::Span<S2CellId> ids);
+
+  // Sets points[k] = ids[k].ToPoint() for each cell id.
+  //
+  // REQUIRES: points.size() == ids.size()
+  static void ToPoints(absl::Span<const S2CellId> ids,
+                       absl::Span<S2Point> points);
+
   // The default constructor returns an invalid cell id.
   IFNDEF_SWIG(constexpr) S2CellId() : id_(0) {}
   // Returns an invalid cell id.
@@ -380,6 +400,28 @@ class S2CellId {
   std::string ToToken() const;
   static S2CellId FromToken(absl::string_view token);
 
+  // The maximum length of a token.
+  static constexpr int kMaxTokenLength = 16;
+
+  // Like ToToken(), but writes the token to "buf" rather than allocating a
+  // string, and returns its length.  "buf" must have room for
+  // kMaxTokenLength characters (the token is not NUL-terminated).
+  int ToToken(char* buf) const;
+
+  // Appends the tokens of all the given cell ids to "out", each followed by
+  // "delimiter".  This is much faster than calling ToToken() for each id,
+  // since it converts 8 hex digits at a time and allocates only when "out"
+  // needs to grow.
+  static void AppendTokens(absl::Span<const S2CellId> ids, char delimiter,
+                           std::string* out);
+
+  // Parses a sequence of tokens separated (or terminated) by "delimiter",
+  // such as the output of AppendTokens(), and appends the corresponding
+  // cell ids to "ids".  Malformed tokens yield S2CellId::None() as in
+  // FromToken(), so that the output has one id per input token.
+  static void FromTokens(absl::string_view tokens, char delimiter,
+                         std::vector<S2CellId>* ids);
+
   // Use encoder to generate a serialized representation of this cell id.
   // Can also encode an invalid cell.
   void Encode(Encoder* const encoder) const;
@@ -427,6 +469,41 @@ class S2CellId {
   // REQUIRES: nbr_level >= this->level().
   void AppendAllNeighbors(int nbr_level, std::vector<S2CellId>* output) const;
 
+  // Like AppendAllNeighbors(level()), but writes the neighbors to
+  // "neighbors" and returns their number rather than allocating memory.  All
+  // neighbors are guaranteed to be distinct.  There are normally 8 neighbors,
+  // but cells adjacent to one of the 8 cube vertices have only 7 (and the
+  // face cells have only 4).
+  int GetAllNeighbors(S2CellId neighbors[8]) const;
+
+  // The grid distance between two cells at the same level is the minimum
+  // number of steps between neighboring cells (as defined by
+  // GetAllNeighbors) needed to get from one cell to the other.  Within a
+  // single face, this is the Chebyshev distance between the cells' (i,j)
+  // coordinates measured in units of the cell size.
+  //
+  // A CellDistanceVisitor is called with a cell and its grid distance from
+  // the origin cell.  It returns false to stop the enumeration.
+  using CellDistanceVisitor = std::function<bool (S2CellId id, int distance)>;
+
+  // Visits every cell at this cell's level whose grid distance from this
+  // cell is at most "k" (the "disk" of radius "k", including this cell at
+  // distance 0).  Each cell is visited exactly once, in non-decreasing order
+  // of distance.  Returns false if the visitor returned false.
+  //
+  // If the disk is contained by a single face, its cells are enumerated
+  // directly without allocating memory.  Otherwise a breadth-first search is
+  // used that allocates temporary storage proportional to "k".
+  //
+  // REQUIRES: k >= 0
+  bool VisitDisk(int k, const CellDistanceVisitor& visitor) const;
+
+  // Like VisitDisk(), but only visits the cells whose grid distance from
+  // this cell is exactly "k" (the "ring" of radius "k").
+  //
+  // REQUIRES: k >= 0
+  bool VisitRing(int k, const CellDistanceVisitor& visitor) const;
+
   /////////////////////////////////////////////////////////////////////
   // Low-level methods.
 
@@ -478,6 +555,11 @@ class S2CellId {
   // or FromFaceIJWrap if "same_face" is false.
   static S2CellId FromFaceIJSame(int face, int i, int j, bool same_face);
 
+  // Visits the cells whose grid distance from this cell is in the range
+  // [min_k, max_k] (see VisitDisk).
+  bool VisitDistanceRange(int min_k, int max_k,
+                          const CellDistanceVisitor& visitor) const;
+
   uint64 id_;
 } ABSL_ATTRIBUTE_PACKED;  // Necessary so that structures containing S2CellId's
                           // can be ABSL_ATTRIBUTE_PACKED.
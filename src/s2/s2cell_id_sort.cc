@@ -0,0 +1,29 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2cell_id_sort.h"
+
+#include <algorithm>
+
+void S2SortCellIds(absl::Span<S2CellId> ids, int num_threads,
+                   S2Executor* executor) {
+  // Small inputs don't need a stable sort.
+  if (ids.size() < s2internal::kMinRadixSortSize) {
+    std::sort(ids.begin(), ids.end());
+    return;
+  }
+  S2RadixSort(ids, [](S2CellId id) { return id.id(); }, num_threads,
+              executor);
+}
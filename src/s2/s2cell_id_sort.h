@@ -0,0 +1,144 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2CELL_ID_SORT_H_
+#define S2_S2CELL_ID_SORT_H_
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "s2/base/integral_types.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2executor.h"
+
+// Sorts "ids" into increasing order.  This is equivalent to std::sort, but
+// uses a radix sort for large vectors, which is about 1.3 times faster when
+// sorting millions of random S2CellIds.  If "num_threads" > 1, large vectors
+// are sorted using up to that many threads (see S2RadixSort).
+void S2SortCellIds(absl::Span<S2CellId> ids, int num_threads = 1,
+                   S2Executor* executor = nullptr);
+
+// Sorts "values" into increasing order of key(value), where "key" returns a
+// uint64.  The sort is stable, i.e. values with equal keys keep their
+// relative order.  This can be used to sort records by an S2CellId field,
+// e.g.
+//
+//   S2RadixSort(absl::MakeSpan(records),
+//               [](const Record& r) { return r.cell_id.id(); });
+//
+// The implementation is a least-significant-digit radix sort that processes
+// 8 bits per pass.  Digits that are the same for all keys are skipped (which
+// is common for S2CellIds, e.g. the low-order bits of cells at the same
+// level), so the number of passes is often less than 8.
+//
+// If "num_threads" > 1, large inputs are sorted using up to that many
+// threads.  "key" must then be safe to call concurrently.  Each pass runs
+// in parallel, so the threads are taken from "executor" if it is non-null
+// (in which case "num_threads" is replaced by executor->num_threads()), and
+// otherwise from an S2ThreadPool that is created once for the whole sort.
+template <class T, class KeyFunction>
+void S2RadixSort(absl::Span<T> values, const KeyFunction& key,
+                 int num_threads = 1, S2Executor* executor = nullptr);
+
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+namespace s2internal {
+
+// Inputs smaller than this are sorted using the standard library, and each
+// thread of a parallel sort processes at least this many values.
+constexpr int kMinRadixSortSize = 256;
+constexpr int kMinRadixSortValuesPerThread = 100000;
+
+}  // namespace s2internal
+
+template <class T, class KeyFunction>
+void S2RadixSort(absl::Span<T> values, const KeyFunction& key,
+                 int num_threads, S2Executor* executor) {
+  using s2internal::kMinRadixSortSize;
+  using s2internal::kMinRadixSortValuesPerThread;
+  const size_t n = values.size();
+  if (n < kMinRadixSortSize) {
+    std::stable_sort(values.begin(), values.end(),
+                     [&key](const T& x, const T& y) {
+                       return key(x) < key(y);
+                     });
+    return;
+  }
+  num_threads = std::max(1, static_cast<int>(std::min<size_t>(
+      S2NumThreads(executor, num_threads), n / kMinRadixSortValuesPerThread)));
+  std::unique_ptr<S2ThreadPool> pool;
+  if (executor == nullptr && num_threads > 1) {
+    pool.reset(new S2ThreadPool(num_threads));
+    executor = pool.get();
+  }
+
+  // Each thread processes a contiguous block of the input.
+  std::vector<size_t> bounds(num_threads + 1);
+  for (int t = 0; t <= num_threads; ++t) bounds[t] = n * t / num_threads;
+
+  // Find the bits that are not the same in every key.
+  std::vector<uint64> diffs(num_threads, 0);
+  const uint64 first_key = key(values[0]);
+  S2ParallelFor(executor, num_threads, [&](int t) {
+    uint64 diff = 0;
+    for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) {
+      diff |= key(values[i]) ^ first_key;
+    }
+    diffs[t] = diff;
+  });
+  uint64 diff = 0;
+  for (uint64 d : diffs) diff |= d;
+
+  // Each pass stably distributes the values from "src" to "dst" according
+  // to one byte of the key.  "offsets[t][b]" is the position in "dst" of the
+  // next value with byte "b" from the block of thread "t".
+  std::vector<T> buffer(values.begin(), values.end());
+  T* src = values.data();
+  T* dst = buffer.data();
+  std::vector<std::vector<size_t>> offsets(num_threads,
+                                           std::vector<size_t>(256));
+  for (int shift = 0; shift < 64; shift += 8) {
+    if (((diff >> shift) & 0xff) == 0) continue;
+    S2ParallelFor(executor, num_threads, [&](int t) {
+      std::vector<size_t>& count = offsets[t];
+      std::fill(count.begin(), count.end(), 0);
+      for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) {
+        ++count[(key(src[i]) >> shift) & 0xff];
+      }
+    });
+    size_t sum = 0;
+    for (int b = 0; b < 256; ++b) {
+      for (int t = 0; t < num_threads; ++t) {
+        size_t count = offsets[t][b];
+        offsets[t][b] = sum;
+        sum += count;
+      }
+    }
+    S2ParallelFor(executor, num_threads, [&](int t) {
+      std::vector<size_t>& offset = offsets[t];
+      for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) {
+        dst[offset[(key(src[i]) >> shift) & 0xff]++] = src[i];
+      }
+    });
+    std::swap(src, dst);
+  }
+  if (src != values.data()) std::copy(src, src + n, values.data());
+}
+
+#endif  // S2_S2CELL_ID_SORT_H_
@@ -0,0 +1,105 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2cell_id_sort.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/types/span.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2executor.h"
+#include "s2/s2testing.h"
+
+using std::pair;
+using std::vector;
+
+namespace {
+
+// Returns random cells at the given level, or at random levels if "level"
+// is negative.
+vector<S2CellId> RandomCellIds(int num_cells, int level) {
+  vector<S2CellId> ids;
+  for (int i = 0; i < num_cells; ++i) {
+    ids.push_back(level < 0 ? S2Testing::GetRandomCellId()
+                            : S2Testing::GetRandomCellId(level));
+  }
+  return ids;
+}
+
+void TestSortCellIds(vector<S2CellId> ids, int num_threads) {
+  vector<S2CellId> expected = ids;
+  std::sort(expected.begin(), expected.end());
+  S2SortCellIds(absl::MakeSpan(ids), num_threads);
+  EXPECT_EQ(expected, ids);
+}
+
+TEST(S2SortCellIds, SmallInputs) {
+  TestSortCellIds({}, 1);
+  TestSortCellIds(RandomCellIds(1, -1), 1);
+  TestSortCellIds(RandomCellIds(100, -1), 1);
+}
+
+TEST(S2SortCellIds, MixedLevels) {
+  TestSortCellIds(RandomCellIds(10000, -1), 1);
+}
+
+TEST(S2SortCellIds, SameLevel) {
+  // Cells at the same level have identical low-order bits, so some radix
+  // passes are skipped.
+  TestSortCellIds(RandomCellIds(10000, 5), 1);
+  TestSortCellIds(RandomCellIds(10000, S2CellId::kMaxLevel), 1);
+}
+
+TEST(S2SortCellIds, Duplicates) {
+  vector<S2CellId> ids = RandomCellIds(1000, 10);
+  vector<S2CellId> copy = ids;
+  ids.insert(ids.end(), copy.begin(), copy.end());
+  TestSortCellIds(ids, 1);
+}
+
+TEST(S2SortCellIds, MultipleThreads) {
+  TestSortCellIds(RandomCellIds(500000, -1), 4);
+}
+
+TEST(S2SortCellIds, Executor) {
+  vector<S2CellId> ids = RandomCellIds(500000, -1);
+  vector<S2CellId> expected = ids;
+  std::sort(expected.begin(), expected.end());
+  S2ThreadPool pool(4);
+  S2SortCellIds(absl::MakeSpan(ids), 1, &pool);
+  EXPECT_EQ(expected, ids);
+}
+
+TEST(S2RadixSort, IsStable) {
+  // Sort (cell, index) pairs by cell only, and check that pairs with the
+  // same cell keep their original order.
+  vector<S2CellId> ids = RandomCellIds(3000, 3);
+  vector<pair<S2CellId, int>> values;
+  for (int i = 0; i < ids.size(); ++i) values.push_back({ids[i], i});
+  vector<pair<S2CellId, int>> expected = values;
+  std::stable_sort(expected.begin(), expected.end(),
+                   [](const pair<S2CellId, int>& x,
+                      const pair<S2CellId, int>& y) {
+                     return x.first < y.first;
+                   });
+  S2RadixSort(absl::MakeSpan(values),
+              [](const pair<S2CellId, int>& x) { return x.first.id(); });
+  EXPECT_EQ(expected, values);
+}
+
+}  // namespace
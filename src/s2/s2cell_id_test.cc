@@ -22,12 +22,18 @@
 #include <cstdio>
 #include <iosfwd>
 #include <iostream>
+#include <map>
+#include <utility>
 #include <vector>
 
 #include <gtest/gtest.h>
 
 #include "absl/base/macros.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/types/span.h"
 
 #include "s2/base/logging.h"
 #include "s2/r2.h"
@@ -285,6 +291,38 @@ TEST(S2CellId, Inverses) {
   }
 }
 
+TEST(S2CellId, BatchConversions) {
+  // Include points on face boundaries and at cell corners, where face
+  // selection and rounding are most delicate, and a count that is not a
+  // multiple of the block size.
+  vector<S2Point> points;
+  for (int i = 0; i < 1000; ++i) {
+    points.push_back(S2Testing::RandomPoint());
+    points.push_back(S2Testing::GetRandomCellId().ToPointRaw() * 3);
+  }
+  for (int face = 0; face < 6; ++face) {
+    points.push_back(S2::GetNorm(face));
+    points.push_back(S2::FaceUVtoXYZ(face, 1, 1));
+    points.push_back(S2::FaceUVtoXYZ(face, -1, 0));
+  }
+  points.push_back(S2Point(1, 1, 1));
+  points.push_back(S2Point(-1, 1, -1));
+  vector<S2CellId> ids(points.size());
+  S2CellId::FromPoints(points, absl::MakeSpan(ids));
+  vector<S2LatLng> latlngs;
+  for (int i = 0; i < points.size(); ++i) {
+    EXPECT_EQ(S2CellId(points[i]), ids[i]) << points[i];
+    latlngs.push_back(S2LatLng(points[i]));
+  }
+  S2CellId::FromLatLngs(latlngs, absl::MakeSpan(ids));
+  vector<S2Point> centers(ids.size());
+  S2CellId::ToPoints(ids, absl::MakeSpan(centers));
+  for (int i = 0; i < latlngs.size(); ++i) {
+    EXPECT_EQ(S2CellId(latlngs[i]), ids[i]);
+    EXPECT_EQ(ids[i].ToPoint(), centers[i]);
+  }
+}
+
 TEST(S2CellId, Tokens) {
   // Test random cell ids at all levels.
   for (int i = 0; i < 10000; ++i) {
@@ -314,6 +352,52 @@ TEST(S2CellId, Tokens) {
   EXPECT_EQ(S2CellId::None(), S2CellId::FromToken(" 876bee99"));
 }
 
+TEST(S2CellId, TokensMatchHexFormat) {
+  // Compare against an independent implementation, including ids with
+  // every hex digit in every position.
+  vector<S2CellId> ids;
+  for (int i = 0; i < 10000; ++i) {
+    ids.push_back(S2CellId(S2Testing::rnd.Rand64()));
+  }
+  for (int i = 0; i < 16; ++i) {
+    for (uint64 d = 1; d < 16; ++d) ids.push_back(S2CellId(d << (4 * i)));
+  }
+  for (S2CellId id : ids) {
+    string expected = absl::StrFormat("%016x", id.id());
+    expected.erase(expected.find_last_not_of('0') + 1);
+    EXPECT_EQ(expected, id.ToToken());
+    EXPECT_EQ(id, S2CellId::FromToken(absl::AsciiStrToUpper(expected)));
+  }
+}
+
+TEST(S2CellId, BatchTokens) {
+  vector<S2CellId> ids = {S2CellId::None(), S2CellId::Sentinel(),
+                          S2CellId::FromFace(3)};
+  for (int i = 0; i < 1000; ++i) ids.push_back(S2Testing::GetRandomCellId());
+
+  string tokens = "prefix,";
+  S2CellId::AppendTokens(ids, ',', &tokens);
+  string expected = "prefix,";
+  for (S2CellId id : ids) absl::StrAppend(&expected, id.ToToken(), ",");
+  EXPECT_EQ(expected, tokens);
+
+  vector<S2CellId> decoded;
+  S2CellId::FromTokens(absl::string_view(tokens).substr(7), ',', &decoded);
+  EXPECT_EQ(ids, decoded);
+
+  // Malformed tokens become S2CellId::None(), and a missing final delimiter
+  // is allowed.
+  decoded.clear();
+  S2CellId::FromTokens("89c25 x 0123456789abcdef0 1", ' ', &decoded);
+  EXPECT_EQ((vector<S2CellId>{S2CellId::FromToken("89c25"), S2CellId::None(),
+                              S2CellId::None(), S2CellId::FromToken("1")}),
+            decoded);
+
+  string empty;
+  S2CellId::AppendTokens({}, ',', &empty);
+  EXPECT_EQ("", empty);
+}
+
 TEST(S2CellId, EncodeDecode) {
   S2CellId id(0x7837423);
   Encoder encoder;
@@ -529,6 +613,98 @@ TEST(S2CellId, Neighbors) {
   }
 }
 
+// Returns the grid distance from "id" to every cell within grid distance
+// "k", computed by a breadth-first search using AppendAllNeighbors.
+static std::map<S2CellId, int> GetDiskDistances(S2CellId id, int k) {
+  std::map<S2CellId, int> distances = {{id, 0}};
+  vector<S2CellId> frontier = {id};
+  for (int d = 1; d <= k; ++d) {
+    vector<S2CellId> nbrs, next;
+    for (S2CellId c : frontier) c.AppendAllNeighbors(c.level(), &nbrs);
+    for (S2CellId nbr : nbrs) {
+      if (distances.insert({nbr, d}).second) next.push_back(nbr);
+    }
+    frontier = std::move(next);
+  }
+  return distances;
+}
+
+TEST(S2CellId, GetAllNeighbors) {
+  for (int i = 0; i < 1000; ++i) {
+    // The first 100 cells are adjacent to a cube vertex.
+    S2CellId id = S2Testing::GetRandomCellId();
+    if (i < 100) id = S2CellId::FromFacePosLevel(i % 6, 0, id.level());
+    S2CellId nbrs[8];
+    int n = id.GetAllNeighbors(nbrs);
+    vector<S2CellId> actual(nbrs, nbrs + n), expected;
+    id.AppendAllNeighbors(id.level(), &expected);
+    std::sort(actual.begin(), actual.end());
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()),
+                   expected.end());
+    EXPECT_EQ(expected, actual);
+    if (id.is_face()) {
+      EXPECT_EQ(4, n);
+    } else if (i < 100) {
+      EXPECT_EQ(7, n);
+    }
+  }
+}
+
+TEST(S2CellId, VisitDiskAndRing) {
+  static const int kMaxIJ = S2CellId::kMaxSize - 1;
+  for (int iter = 0; iter < 500; ++iter) {
+    // Choose cells near the face boundaries about half the time.
+    S2CellId id = S2Testing::GetRandomCellId();
+    if (iter % 2 == 0) {
+      int i, j;
+      int face = id.ToFaceIJOrientation(&i, &j, nullptr);
+      i = (iter % 4 == 0) ? (i & 0xff) : kMaxIJ - (i & 0xff);
+      id = S2CellId::FromFaceIJ(face, i, j).parent(id.level());
+    }
+    const int k = S2Testing::rnd.Uniform(5);
+    auto expected = GetDiskDistances(id, k);
+    std::map<S2CellId, int> actual;
+    int last_distance = 0;
+    EXPECT_TRUE(id.VisitDisk(k, [&](S2CellId c, int d) {
+                  EXPECT_EQ(id.level(), c.level());
+                  EXPECT_GE(d, last_distance);
+                  last_distance = d;
+                  EXPECT_TRUE(actual.insert({c, d}).second) << c;
+                  return true;
+                }));
+    EXPECT_EQ(expected, actual);
+
+    int ring_size = 0;
+    EXPECT_TRUE(id.VisitRing(k, [&](S2CellId c, int d) {
+                  EXPECT_EQ(k, d);
+                  EXPECT_EQ(k, expected[c]);
+                  ++ring_size;
+                  return true;
+                }));
+    EXPECT_EQ(std::count_if(expected.begin(), expected.end(),
+                            [k](const std::pair<const S2CellId, int>& p) {
+                              return p.second == k;
+                            }),
+              ring_size);
+
+    // The enumeration stops as soon as the visitor returns false.
+    int num_visited = 0;
+    EXPECT_FALSE(id.VisitDisk(k + 1, [&](S2CellId, int) {
+                   return ++num_visited < 2;
+                 }));
+    EXPECT_EQ(2, num_visited);
+  }
+  // The disk of a face cell with radius 2 contains the entire sphere.
+  int num_faces = 0;
+  EXPECT_TRUE(S2CellId::FromFace(3).VisitDisk(5, [&](S2CellId c, int d) {
+                ++num_faces;
+                EXPECT_EQ(c.face() == 0 ? 2 : c.face() == 3 ? 0 : 1, d);
+                return true;
+              }));
+  EXPECT_EQ(6, num_faces);
+}
+
 // Returns a random point on the boundary of the given rectangle.
 static R2Point SampleBoundary(const R2Rect& rect) {
   R2Point uv;
@@ -17,9 +17,19 @@
 
 #include "s2/s2cell_index.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
 #include "absl/container/flat_hash_set.h"
+#include "absl/types/span.h"
+#include "s2/s2cell_id_sort.h"
+#include "s2/util/coding/coder.h"
+#include "s2/util/endian/endian.h"
 
 using absl::flat_hash_set;
+using util::bitmap::Bitmap64;
 using std::vector;
 
 using Label = S2CellIndex::Label;
@@ -67,70 +77,207 @@ void S2CellIndex::Add(const S2CellUnion& cell_ids, Label label) {
   }
 }
 
-void S2CellIndex::Build() {
-  // To build the cell tree and leaf cell ranges, we maintain a stack of
-  // (cell_id, label) pairs that contain the current leaf cell.  This class
-  // represents an instruction to push or pop a (cell_id, label) pair.
+void S2CellIndex::Build(int num_threads) {
+  // To build the cell tree and leaf cell ranges, we walk through the
+  // (cell_id, label) pairs in order of their leaf cell ranges while
+  // maintaining a stack of the pairs that contain the current leaf cell.
+  // Pairs are sorted first by range_min(), then in reverse order by cell_id,
+  // and then by label.  This is necessary to ensure that larger cells are
+  // pushed on the stack before the smaller cells that they contain.
   //
-  // If label >= 0, the (cell_id, label) pair is pushed on the stack.
-  // If cell_id == S2CellId::Sentinel(), a pair is popped from the stack.
-  // Otherwise the stack is unchanged but a RangeNode is still emitted.
-  struct Delta {
-    S2CellId start_id, cell_id;
-    Label label;
-
-    Delta(S2CellId _start_id, S2CellId _cell_id, Label _label)
-        : start_id(_start_id), cell_id(_cell_id), label(_label) {}
-
-    // Deltas are sorted first by start_id, then in reverse order by cell_id,
-    // and then by label.  This is necessary to ensure that (1) larger cells
-    // are pushed on the stack before smaller cells, and (2) cells are popped
-    // off the stack before any new cells are added.
-    bool operator<(const Delta& y) const {
-      if (start_id < y.start_id) return true;
-      if (y.start_id < start_id) return false;
-      if (y.cell_id < cell_id) return true;
-      if (cell_id < y.cell_id) return false;
-      return label < y.label;
-    }
+  // Since the pairs are stored in this order by the previous call to Build(),
+  // only the pairs added since then need to be sorted.
+  if (decoded_in_place_) CopyEncodedData();
+  auto less = [](const CellNode& x, const CellNode& y) {
+    S2CellId x_min = x.cell_id.range_min(), y_min = y.cell_id.range_min();
+    if (x_min < y_min) return true;
+    if (y_min < x_min) return false;
+    if (y.cell_id < x.cell_id) return true;
+    if (x.cell_id < y.cell_id) return false;
+    return x.label < y.label;
   };
+  // The new pairs are radix sorted by range_min(), and then each run of pairs
+  // with the same range_min() (which is usually short) is sorted using the
+  // remaining criteria.
+  auto added = cell_tree_.begin() + num_built_;
+  S2RadixSort(absl::MakeSpan(cell_tree_.data() + num_built_,
+                             cell_tree_.size() - num_built_),
+              [](const CellNode& x) { return x.cell_id.range_min().id(); },
+              num_threads);
+  for (auto run = added; run != cell_tree_.end(); ) {
+    S2CellId range_min = run->cell_id.range_min();
+    auto run_end = run + 1;
+    while (run_end != cell_tree_.end() &&
+           run_end->cell_id.range_min() == range_min) {
+      ++run_end;
+    }
+    if (run_end - run > 1) std::sort(run, run_end, less);
+    run = run_end;
+  }
+  std::inplace_merge(cell_tree_.begin(), added, cell_tree_.end(), less);
+  num_built_ = cell_tree_.size();
 
-  vector<Delta> deltas;
-  deltas.reserve(2 * cell_tree_.size() + 2);
-  // Create two deltas for each (cell_id, label) pair: one to add the pair to
-  // the stack (at the start of its leaf cell range), and one to remove it from
-  // the stack (at the end of its leaf cell range).
-  for (const CellNode& node : cell_tree_) {
-    deltas.push_back(Delta(node.cell_id.range_min(), node.cell_id, node.label));
-    deltas.push_back(Delta(node.cell_id.range_max().next(),
-                           S2CellId::Sentinel(), -1));
-  }
-  // We also create two special deltas to ensure that a RangeNode is emitted at
-  // the beginning and end of the S2CellId range.
-  deltas.push_back(
-      Delta(S2CellId::Begin(S2CellId::kMaxLevel), S2CellId::None(), -1));
-  deltas.push_back(
-      Delta(S2CellId::End(S2CellId::kMaxLevel), S2CellId::None(), -1));
-  std::sort(deltas.begin(), deltas.end());
-
-  // Now walk through the deltas to build the leaf cell ranges and cell tree
-  // (which is essentially a permanent form of the "stack" described above).
-  cell_tree_.clear();
-  range_nodes_.reserve(deltas.size());
+  // Now walk through the pairs to build the leaf cell ranges.  The cell tree
+  // is essentially a permanent form of the stack described above: each node
+  // points to the node below it on the stack, and "contents" is the top of
+  // the stack.  A RangeNode is emitted at every position where a pair is
+  // pushed or popped, and also at the beginning and end of the S2CellId range.
+  range_nodes_.clear();
+  range_nodes_.reserve(2 * cell_tree_.size() + 2);
   int contents = -1;
-  for (int i = 0; i < deltas.size(); ) {
-    S2CellId start_id = deltas[i].start_id;
-    // Process all the deltas associated with the current start_id.
-    for (; i < deltas.size() && deltas[i].start_id == start_id; ++i) {
-      if (deltas[i].label >= 0) {
-        cell_tree_.push_back({deltas[i].cell_id, deltas[i].label, contents});
-        contents = cell_tree_.size() - 1;
-      } else if (deltas[i].cell_id == S2CellId::Sentinel()) {
+
+  // Pops all the pairs whose leaf cell ranges end at or before "limit", and
+  // emits a RangeNode wherever this happens before "limit".
+  auto pop_until = [this, &contents](S2CellId limit) {
+    while (contents >= 0) {
+      S2CellId end = cell_tree_[contents].cell_id.range_max().next();
+      if (end > limit) break;
+      do {
         contents = cell_tree_[contents].parent;
-      }
+      } while (contents >= 0 &&
+               cell_tree_[contents].cell_id.range_max().next() == end);
+      if (end < limit) range_nodes_.push_back({end, contents});
+    }
+  };
+  S2CellId begin = S2CellId::Begin(S2CellId::kMaxLevel);
+  if (cell_tree_.empty() || cell_tree_[0].cell_id.range_min() != begin) {
+    range_nodes_.push_back({begin, -1});
+  }
+  for (int i = 0; i < cell_tree_.size(); ) {
+    S2CellId start_id = cell_tree_[i].cell_id.range_min();
+    pop_until(start_id);
+    // Push all the pairs whose leaf cell ranges start at "start_id".
+    for (; i < cell_tree_.size() &&
+             cell_tree_[i].cell_id.range_min() == start_id; ++i) {
+      cell_tree_[i].parent = contents;
+      contents = i;
     }
     range_nodes_.push_back({start_id, contents});
   }
+  S2CellId end = S2CellId::End(S2CellId::kMaxLevel);
+  pop_until(end);
+  range_nodes_.push_back({end, contents});
+  cells_ = cell_tree_;
+  ranges_ = range_nodes_;
+}
+
+// The size in bytes of each encoded CellNode and RangeNode.
+// The encoded records have the same layout as CellNode and RangeNode on
+// little-endian hosts.  (RangeNode is only 12 bytes because S2CellId is
+// packed.)
+static constexpr int kEncodedCellNodeSize = 16;
+static constexpr int kEncodedRangeNodeSize = 12;
+
+void S2CellIndex::Encode(Encoder* encoder) const {
+  // Decode() uses the records in place, so they must be aligned correctly
+  // (see below).
+  static_assert(alignof(CellNode) <= 8, "Unexpected alignment");
+  static_assert(alignof(RangeNode) <= 8, "Unexpected alignment");
+  S2_DCHECK(!ranges_.empty()) << "Call Build() first.";
+  S2_DCHECK_EQ(num_built_, num_cells()) << "Call Build() first.";
+
+  // The header consists of the version number, the number of cells and
+  // ranges, and the number of padding bytes needed to align the records.
+  encoder->Ensure(1 + 2 * Encoder::kVarintMax64 + 1 + 7 +
+                  kEncodedCellNodeSize * cells_.size() +
+                  kEncodedRangeNodeSize * ranges_.size());
+  encoder->put8(kCurrentEncodingVersionNumber);
+  encoder->put_varint64(cells_.size());
+  encoder->put_varint64(ranges_.size());
+  int padding = (8 - (encoder->length() + 1) % 8) % 8;
+  encoder->put8(padding);
+  for (int i = 0; i < padding; ++i) encoder->put8(0);
+  for (const CellNode& node : cells_) {
+    encoder->put64(node.cell_id.id());
+    encoder->put32(node.label);
+    encoder->put32(node.parent);
+  }
+  for (const RangeNode& range : ranges_) {
+    encoder->put64(range.start_id.id());
+    encoder->put32(range.contents);
+  }
+}
+
+bool S2CellIndex::Decode(Decoder* decoder) {
+  Clear();
+  uint64 num_cells, num_ranges;
+  if (decoder->avail() < 1) return false;
+  if (decoder->get8() > kCurrentEncodingVersionNumber) return false;
+  if (!decoder->get_varint64(&num_cells)) return false;
+  if (!decoder->get_varint64(&num_ranges)) return false;
+  if (decoder->avail() < 1) return false;
+  int padding = decoder->get8();
+  if (padding > 7 || decoder->avail() < padding) return false;
+  decoder->skip(padding);
+
+  // A built index has at least two ranges, since there is always a range
+  // starting at S2CellId::Begin() and a sentinel range at S2CellId::End().
+  if (num_cells > std::numeric_limits<int32>::max() ||
+      num_ranges < 2 || num_ranges > 2 * num_cells + 2 ||
+      decoder->avail() < kEncodedCellNodeSize * num_cells +
+                             kEncodedRangeNodeSize * num_ranges) {
+    return false;
+  }
+  const char* data = decoder->skip(kEncodedCellNodeSize * num_cells +
+                                   kEncodedRangeNodeSize * num_ranges);
+  const char* range_data = data + kEncodedCellNodeSize * num_cells;
+  auto last_range = range_data + kEncodedRangeNodeSize * (num_ranges - 1);
+  if (LittleEndian::Load64(range_data) !=
+          S2CellId::Begin(S2CellId::kMaxLevel).id() ||
+      LittleEndian::Load64(last_range) !=
+          S2CellId::End(S2CellId::kMaxLevel).id()) {
+    return false;
+  }
+  // Check that every node refers to a valid cell so that corrupt data cannot
+  // cause out-of-bounds reads.  Each cell's parent precedes it in the cell
+  // tree, which also ensures that following parent links terminates.
+  for (int32 i = 0; i < static_cast<int32>(num_cells); ++i) {
+    int32 parent = LittleEndian::Load32(data + kEncodedCellNodeSize * i + 12);
+    if (parent < -1 || parent >= i) return false;
+  }
+  for (const char* p = range_data; p <= last_range;
+       p += kEncodedRangeNodeSize) {
+    int32 contents = LittleEndian::Load32(p + 8);
+    if (contents < -1 || contents >= static_cast<int32>(num_cells)) {
+      return false;
+    }
+  }
+  if (LittleEndian::IsLittleEndian() &&
+      sizeof(CellNode) == kEncodedCellNodeSize &&
+      sizeof(RangeNode) == kEncodedRangeNodeSize &&
+      reinterpret_cast<uintptr_t>(data) % alignof(CellNode) == 0 &&
+      reinterpret_cast<uintptr_t>(range_data) % alignof(RangeNode) == 0) {
+    cells_ = absl::MakeConstSpan(reinterpret_cast<const CellNode*>(data),
+                                 num_cells);
+    ranges_ = absl::MakeConstSpan(
+        reinterpret_cast<const RangeNode*>(range_data), num_ranges);
+    decoded_in_place_ = true;
+  } else {
+    cell_tree_.reserve(num_cells);
+    for (const char* p = data; p < range_data; p += kEncodedCellNodeSize) {
+      cell_tree_.push_back(CellNode(S2CellId(LittleEndian::Load64(p)),
+                                    LittleEndian::Load32(p + 8),
+                                    LittleEndian::Load32(p + 12)));
+    }
+    range_nodes_.reserve(num_ranges);
+    for (const char* p = range_data; p <= last_range;
+         p += kEncodedRangeNodeSize) {
+      range_nodes_.push_back(RangeNode(S2CellId(LittleEndian::Load64(p)),
+                                       LittleEndian::Load32(p + 8)));
+    }
+    cells_ = cell_tree_;
+    ranges_ = range_nodes_;
+  }
+  num_built_ = num_cells;
+  return true;
+}
+
+void S2CellIndex::CopyEncodedData() {
+  cell_tree_.assign(cells_.begin(), cells_.end());
+  range_nodes_.assign(ranges_.begin(), ranges_.end());
+  cells_ = cell_tree_;
+  ranges_ = range_nodes_;
+  decoded_in_place_ = false;
 }
 
 flat_hash_set<Label> S2CellIndex::GetIntersectingLabels(
@@ -148,3 +295,50 @@ void S2CellIndex::GetIntersectingLabels(const S2CellUnion& target,
     return true;
   });
 }
+
+void S2CellIndex::GetIntersectingLabels(const S2CellUnion& target,
+                                        Bitmap64* seen,
+                                        vector<Label>* labels) const {
+  labels->clear();
+  RangeIterator range(this);
+  range.Begin();
+  AppendIntersectingLabels(target, &range, seen, labels);
+}
+
+void S2CellIndex::GetIntersectingLabels(absl::Span<const S2CellUnion> targets,
+                                        Bitmap64* seen,
+                                        vector<vector<Label>>* labels) const {
+  labels->resize(targets.size());
+  vector<int> order;
+  order.reserve(targets.size());
+  for (int i = 0; i < targets.size(); ++i) {
+    (*labels)[i].clear();
+    if (!targets[i].empty()) order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), [&targets](int i, int j) {
+      return targets[i][0] < targets[j][0];
+    });
+  RangeIterator range(this);
+  range.Begin();
+  for (int i : order) {
+    AppendIntersectingLabels(targets[i], &range, seen, &(*labels)[i]);
+  }
+}
+
+void S2CellIndex::AppendIntersectingLabels(const S2CellUnion& target,
+                                           RangeIterator* range,
+                                           Bitmap64* seen,
+                                           vector<Label>* labels) const {
+  int start = labels->size();
+  VisitIntersectingCells(target, range, [seen, labels](S2CellId cell_id,
+                                                       Label label) {
+      if (!seen->Get(label)) {
+        seen->Set(label, true);
+        labels->push_back(label);
+      }
+      return true;
+    });
+  for (int i = start; i < labels->size(); ++i) {
+    seen->Set((*labels)[i], false);
+  }
+}
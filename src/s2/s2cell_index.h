@@ -22,13 +22,19 @@
 #include <functional>
 #include <vector>
 
+#include "absl/base/optimization.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/types/span.h"
 
 #include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
 #include "s2/base/log_severity.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2cell_union.h"
+#include "s2/util/bitmap/bitmap.h"
+
+class Decoder;
+class Encoder;
 
 // S2CellIndex stores a collection of (cell_id, label) pairs.  The S2CellIds
 // may be overlapping or contain duplicate values.  For example, an
@@ -61,8 +67,9 @@
 //
 //     index.Add(cell_union, label);
 //
-// Note that the index is not dynamic; the contents of the index cannot be
-// changed once it has been built.
+// Note that the index is not dynamic: if more pairs are added after the
+// index has been built, Build() must be called again before the index is
+// used (see Build() for details).
 //
 // There are several options for retrieving data from the index.  The simplest
 // is to use a built-in method such as GetIntersectingLabels (which returns
@@ -140,7 +147,9 @@ class S2CellIndex {
   int num_cells() const;
 
   // Adds the given (cell_id, label) pair to the index.  Note that the index
-  // is not valid until Build() is called.
+  // is not valid until Build() is called.  Pairs may also be added after the
+  // index has been built, in which case Build() must be called again before
+  // the index is used.
   //
   // The S2CellIds in the index may overlap (including duplicate values).
   // Duplicate (cell_id, label) pairs are also allowed, although be aware that
@@ -152,13 +161,53 @@ class S2CellIndex {
   // Convenience function that adds a collection of cells with the same label.
   void Add(const S2CellUnion& cell_ids, Label label);
 
-  // Constructs the index.  This method may only be called once.  No iterators
-  // may be used until the index is built.
-  void Build();
+  // Constructs the index.  No iterators may be used until the index is
+  // built.  The pairs are sorted using up to "num_threads" threads (small
+  // indexes are sorted using fewer threads).
+  //
+  // Build() may be called again after adding more pairs.  The pairs that
+  // were already indexed are kept in sorted order, so only the new pairs are
+  // sorted and then merged with the existing ones in linear time.  This is
+  // much faster than a full rebuild when the number of new pairs is small.
+  // Note that existing iterators are invalidated.
+  void Build(int num_threads = 1);
 
   // Clears the index so that it can be re-used.
   void Clear();
 
+  // Appends an encoded representation of the index to "encoder".  The cell
+  // tree and leaf cell ranges are stored as fixed-size records (16 bytes per
+  // (cell_id, label) pair plus 12 bytes per leaf cell range) that Decode()
+  // can use in place.  The records are aligned to a multiple of 8 bytes
+  // relative to the start of the encoder's buffer.
+  //
+  // REQUIRES: Build() has been called since the last call to Add().
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  void Encode(Encoder* encoder) const;
+
+  // Decodes an index encoded by Encode(), returning true on success.  The
+  // decoded index is already built, i.e. it may be used immediately without
+  // calling Build().
+  //
+  // If the host is little-endian and the records are aligned (e.g. because
+  // the encoding starts at the beginning of a memory-mapped file), the index
+  // uses the encoded data in place rather than copying it.  In that case
+  // decoding only makes one validation pass over the records (see below).
+  // Calling Add() or Build() on such an index first copies the data.
+  //
+  // Returns false if the references between records are out of range, so
+  // that queries on the decoded index cannot read outside the encoded data.
+  // (Other inconsistencies, such as ranges that are not sorted, may produce
+  // incorrect query results but are not detected.)
+  //
+  // REQUIRES: The Decoder data buffer must outlive this object.
+  bool Decode(Decoder* decoder);
+
+  // Returns true if the index was decoded in place and still refers to the
+  // encoded data (see Decode).
+  bool is_decoded_in_place() const { return decoded_in_place_; }
+
   // A function that is called with each (cell_id, label) pair to be visited.
   // The function may return false in order to indicate that no further
   // (cell_id, label) pairs are needed.
@@ -182,6 +231,33 @@ class S2CellIndex {
   void GetIntersectingLabels(const S2CellUnion& target,
                              absl::flat_hash_set<Label>* labels) const;
 
+  // This version uses a bitmap indexed by label to eliminate duplicates,
+  // which is faster than a hash set when the labels are small integers
+  // (e.g., indexes into a vector of zones).  The labels are returned in
+  // "labels" in an unspecified order.  The bitmap is only used as scratch
+  // space: it must contain at least (max_label + 1) bits, all of which must
+  // be false, and they are all false again when this method returns.
+  // This means that a single bitmap can be reused for many calls:
+  //
+  //   util::bitmap::Bitmap64 seen(num_labels, false);
+  //   vector<S2CellIndex::Label> labels;
+  //   for (const S2CellUnion& target : targets) {
+  //     index.GetIntersectingLabels(target, &seen, &labels);
+  //     ...
+  //   }
+  void GetIntersectingLabels(const S2CellUnion& target,
+                             util::bitmap::Bitmap64* seen,
+                             std::vector<Label>* labels) const;
+
+  // Batch version of the method above that sets (*labels)[i] to the labels
+  // of all indexed cells that intersect targets[i].  The targets are visited
+  // in S2CellId order using a single RangeIterator, so that targets that are
+  // near each other (such as the tiles of a map viewport) can often reuse
+  // the current leaf cell range rather than seeking.
+  void GetIntersectingLabels(absl::Span<const S2CellUnion> targets,
+                             util::bitmap::Bitmap64* seen,
+                             std::vector<std::vector<Label>>* labels) const;
+
  private:
   // Represents a node in the set of non-overlapping leaf cell ranges.
   struct RangeNode;
@@ -234,7 +310,7 @@ class S2CellIndex {
    private:
     // NOTE(ericv): There is a potential optimization that would require this
     // class to iterate over both cell_tree_ *and* range_nodes_.
-    std::vector<CellNode>::const_iterator cell_it_, cell_end_;
+    absl::Span<const CellNode>::const_iterator cell_it_, cell_end_;
   };
 
   // An iterator that seeks and iterates over a set of non-overlapping leaf
@@ -293,15 +369,15 @@ class S2CellIndex {
    private:
     // A special value used to indicate that the RangeIterator has not yet
     // been initialized by calling Begin() or Seek().
-    std::vector<RangeNode>::const_iterator kUninitialized() const {
+    absl::Span<const RangeNode>::const_iterator kUninitialized() const {
       // Note that since the last element of range_nodes_ is a sentinel value,
       // it_ will never legitimately be positioned at range_nodes_->end().
       return range_nodes_->end();
     }
 
     friend class ContentsIterator;
-    const std::vector<RangeNode>* range_nodes_;
-    std::vector<RangeNode>::const_iterator it_;
+    const absl::Span<const RangeNode>* range_nodes_;
+    absl::Span<const RangeNode>::const_iterator it_;
   };
 
   // Like RangeIterator, but only visits leaf cell ranges that overlap at
@@ -388,7 +464,7 @@ class S2CellIndex {
     void set_done() { node_.label = kDoneContents; }
 
     // A pointer to the cell tree itself (owned by the S2CellIndex).
-    const std::vector<CellNode>* cell_tree_;
+    const absl::Span<const CellNode>* cell_tree_;
 
     // The value of it.start_id() from the previous call to StartUnion().
     // This is used to check whether these values are monotonically
@@ -418,6 +494,11 @@ class S2CellIndex {
   // cells can be represented by pointing to a node of this tree.
   std::vector<CellNode> cell_tree_;
 
+  // The number of elements of cell_tree_ that were indexed by the most
+  // recent call to Build() (or by Decode()).  Any further elements were
+  // added since then and are not yet sorted.
+  int num_built_ = 0;
+
   // A RangeNode represents a range of leaf S2CellIds.  The range starts at
   // "start_id" (a leaf cell) and ends at the "start_id" field of the next
   // RangeNode.  "contents" points to the node of cell_tree_ representing the
@@ -439,6 +520,36 @@ class S2CellIndex {
   // in order to represent the range covered by the previous element.
   std::vector<RangeNode> range_nodes_;
 
+  // The cell tree and leaf cell ranges of the built index.  These refer
+  // either to cell_tree_ and range_nodes_, or to the encoded data if the
+  // index was decoded in place (in which case cell_tree_ and range_nodes_
+  // are empty).  Iterators access the index through these fields.
+  absl::Span<const CellNode> cells_;
+  absl::Span<const RangeNode> ranges_;
+  bool decoded_in_place_ = false;
+
+  static constexpr unsigned char kCurrentEncodingVersionNumber = 0;
+
+  // Like VisitIntersectingCells(), but avoids the std::function overhead and
+  // uses the given RangeIterator, which may be positioned anywhere.
+  // Seeking is avoided when "range" is already positioned at or before the
+  // first range that intersects "target".
+  template <class Visitor>
+  bool VisitIntersectingCells(const S2CellUnion& target, RangeIterator* range,
+                              const Visitor& visitor) const;
+
+  // Appends the labels of all indexed cells that intersect "target" to
+  // "labels", skipping labels that are already set in "seen".  The bits of
+  // the appended labels are cleared again before returning.
+  void AppendIntersectingLabels(const S2CellUnion& target,
+                                RangeIterator* range,
+                                util::bitmap::Bitmap64* seen,
+                                std::vector<Label>* labels) const;
+
+  // Copies the encoded data used by an index that was decoded in place, so
+  // that the index can be modified.
+  void CopyEncodedData();
+
   S2CellIndex(const S2CellIndex&) = delete;
   void operator=(const S2CellIndex&) = delete;
 };
@@ -448,9 +559,9 @@ std::ostream& operator<<(std::ostream& os, S2CellIndex::LabelledCell x);
 
 
 inline S2CellIndex::CellIterator::CellIterator(const S2CellIndex* index)
-    : cell_it_(index->cell_tree_.begin()),
-      cell_end_(index->cell_tree_.end()) {
-  S2_DCHECK(!index->range_nodes_.empty()) << "Call Build() first.";
+    : cell_it_(index->cells_.begin()),
+      cell_end_(index->cells_.end()) {
+  S2_DCHECK(!index->ranges_.empty()) << "Call Build() first.";
 }
 
 inline S2CellId S2CellIndex::CellIterator::cell_id() const {
@@ -479,7 +590,7 @@ inline void S2CellIndex::CellIterator::Next() {
 }
 
 inline S2CellIndex::RangeIterator::RangeIterator(const S2CellIndex* index)
-    : range_nodes_(&index->range_nodes_), it_() {
+    : range_nodes_(&index->ranges_), it_() {
   S2_DCHECK(!range_nodes_->empty()) << "Call Build() first.";
   if (google::DEBUG_MODE) it_ = kUninitialized();  // See done().
 }
@@ -571,7 +682,7 @@ inline S2CellIndex::ContentsIterator::ContentsIterator(
 }
 
 inline void S2CellIndex::ContentsIterator::Init(const S2CellIndex* index) {
-  cell_tree_ = &index->cell_tree_;
+  cell_tree_ = &index->cells_;
   Clear();
 }
 
@@ -614,33 +725,48 @@ inline void S2CellIndex::ContentsIterator::Next() {
 }
 
 inline int S2CellIndex::num_cells() const {
-  return cell_tree_.size();
+  return decoded_in_place_ ? cells_.size() : cell_tree_.size();
 }
 
 inline void S2CellIndex::Add(S2CellId cell_id, Label label) {
   S2_DCHECK(cell_id.is_valid());
   S2_DCHECK_GE(label, 0);
+  if (ABSL_PREDICT_FALSE(decoded_in_place_)) CopyEncodedData();
   cell_tree_.push_back(CellNode(cell_id, label, -1));
 }
 
 inline void S2CellIndex::Clear() {
   cell_tree_.clear();
+  num_built_ = 0;
   range_nodes_.clear();
+  cells_ = {};
+  ranges_ = {};
+  decoded_in_place_ = false;
 }
 
 inline bool S2CellIndex::VisitIntersectingCells(
     const S2CellUnion& target, const CellVisitor& visitor) const {
+  RangeIterator range(this);
+  range.Begin();
+  return VisitIntersectingCells(target, &range, visitor);
+}
+
+template <class Visitor>
+bool S2CellIndex::VisitIntersectingCells(const S2CellUnion& target,
+                                         RangeIterator* range,
+                                         const Visitor& visitor) const {
   if (target.empty()) return true;
   auto it = target.begin();
   ContentsIterator contents(this);
-  RangeIterator range(this);
-  range.Begin();
+  if (it->range_min() < range->start_id()) {
+    range->Seek(it->range_min());  // The iterator is past the target.
+  }
   do {
-    if (range.limit_id() <= it->range_min()) {
-      range.Seek(it->range_min());  // Only seek when necessary.
+    if (range->limit_id() <= it->range_min()) {
+      range->Seek(it->range_min());  // Only seek when necessary.
     }
-    for (; range.start_id() <= it->range_max(); range.Next()) {
-      for (contents.StartUnion(range); !contents.done(); contents.Next()) {
+    for (; range->start_id() <= it->range_max(); range->Next()) {
+      for (contents.StartUnion(*range); !contents.done(); contents.Next()) {
         if (!visitor(contents.cell_id(), contents.label())) {
           return false;
         }
@@ -650,10 +776,10 @@ inline bool S2CellIndex::VisitIntersectingCells(
     // range that we just processed.  If so, we can skip over all such cells
     // using binary search.  This speeds up benchmarks by between 2x and 10x
     // when the average number of intersecting cells is small (< 1).
-    if (++it != target.end() && it->range_max() < range.start_id()) {
+    if (++it != target.end() && it->range_max() < range->start_id()) {
       // Skip to the first target cell that extends past the previous range.
-      it = std::lower_bound(it + 1, target.end(), range.start_id());
-      if ((it - 1)->range_max() >= range.start_id()) --it;
+      it = std::lower_bound(it + 1, target.end(), range->start_id());
+      if ((it - 1)->range_max() >= range->start_id()) --it;
     }
   } while (it != target.end());
   return true;
@@ -31,11 +31,15 @@
 #include "s2/s2cell_id.h"
 #include "s2/s2cell_union.h"
 #include "s2/s2testing.h"
+#include "s2/util/bitmap/bitmap.h"
+#include "s2/util/coding/coder.h"
+#include "s2/util/endian/endian.h"
 
 using absl::flat_hash_set;
 using std::pair;
 using std::string;
 using std::vector;
+using util::bitmap::Bitmap64;
 
 using Label = S2CellIndex::Label;
 using LabelledCell = S2CellIndex::LabelledCell;
@@ -276,6 +280,176 @@ TEST_F(S2CellIndexTest, RandomCellUnions) {
   QuadraticValidate();
 }
 
+// Verifies that "a" and "b" have the same cell tree and leaf cell ranges.
+void ExpectSameStructure(const S2CellIndex& a, const S2CellIndex& b) {
+  S2CellIndex::CellIterator a_cell(&a), b_cell(&b);
+  for (; !a_cell.done() && !b_cell.done(); a_cell.Next(), b_cell.Next()) {
+    EXPECT_EQ(b_cell.cell_id(), a_cell.cell_id());
+    EXPECT_EQ(b_cell.label(), a_cell.label());
+  }
+  EXPECT_TRUE(a_cell.done() && b_cell.done());
+
+  S2CellIndex::RangeIterator a_range(&a), b_range(&b);
+  S2CellIndex::ContentsIterator a_contents(&a), b_contents(&b);
+  for (a_range.Begin(), b_range.Begin(); !a_range.done() && !b_range.done();
+       a_range.Next(), b_range.Next()) {
+    ASSERT_EQ(b_range.start_id(), a_range.start_id());
+    a_contents.StartUnion(a_range);
+    b_contents.StartUnion(b_range);
+    for (; !a_contents.done() && !b_contents.done();
+         a_contents.Next(), b_contents.Next()) {
+      EXPECT_EQ(b_contents.cell_id(), a_contents.cell_id());
+      EXPECT_EQ(b_contents.label(), a_contents.label());
+    }
+    EXPECT_TRUE(a_contents.done() && b_contents.done());
+  }
+  EXPECT_TRUE(a_range.done() && b_range.done());
+}
+
+TEST_F(S2CellIndexTest, IncrementalBuild) {
+  // Build the index several times, adding more cells in between.  The result
+  // should be the same as building the index from scratch.
+  for (int batch = 0; batch < 5; ++batch) {
+    for (int i = 0; i < 20; ++i) {
+      Add(GetRandomCellUnion(), 20 * batch + i);
+    }
+    // Also add cells that share their range_min() with existing cells.
+    S2CellId id = contents_[S2Testing::rnd.Uniform(contents_.size())].cell_id;
+    if (!id.is_leaf()) Add(id.child_begin(), batch);
+    if (!id.is_face()) Add(id.parent(), batch);
+    Add(id, batch);
+    QuadraticValidate();
+
+    S2CellIndex expected;
+    for (LabelledCell x : contents_) expected.Add(x.cell_id, x.label);
+    expected.Build();
+    ExpectSameStructure(index_, expected);
+  }
+  // Building again without adding any cells does not change the index.
+  S2CellIndex expected;
+  for (LabelledCell x : contents_) expected.Add(x.cell_id, x.label);
+  expected.Build();
+  Build();
+  ExpectSameStructure(index_, expected);
+}
+
+TEST_F(S2CellIndexTest, ParallelBuild) {
+  // Use enough cells that several threads are used.
+  S2CellIndex expected;
+  for (int i = 0; i < 10000; ++i) {
+    S2CellUnion cell_union = GetRandomCellUnion();
+    index_.Add(cell_union, i);
+    expected.Add(cell_union, i);
+  }
+  expected.Build();
+  index_.Build(4);
+  ExpectSameStructure(index_, expected);
+
+  // Parallel builds can also be incremental.
+  for (int i = 0; i < 5000; ++i) {
+    S2CellUnion cell_union = GetRandomCellUnion();
+    index_.Add(cell_union, i);
+    expected.Add(cell_union, i);
+  }
+  expected.Build();
+  index_.Build(3);
+  ExpectSameStructure(index_, expected);
+}
+
+TEST_F(S2CellIndexTest, EncodeDecode) {
+  for (int i = 0; i < 100; ++i) {
+    Add(GetRandomCellUnion(), i);
+  }
+  Build();
+  Encoder encoder;
+  encoder.Ensure(1);
+  encoder.put8(17);  // Test that the records are aligned by Encode().
+  index_.Encode(&encoder);
+
+  // The encoder's buffer is suitably aligned, so this index is decoded in
+  // place.
+  Decoder decoder(encoder.base(), encoder.length());
+  EXPECT_EQ(17, decoder.get8());
+  S2CellIndex decoded;
+  ASSERT_TRUE(decoded.Decode(&decoder));
+  EXPECT_EQ(LittleEndian::IsLittleEndian(), decoded.is_decoded_in_place());
+  EXPECT_EQ(0, decoder.avail());
+  EXPECT_EQ(index_.num_cells(), decoded.num_cells());
+  ExpectSameStructure(decoded, index_);
+
+  // The encoded data is copied when it is not aligned.
+  vector<char> unaligned(encoder.length() + 1);
+  std::copy(encoder.base() + 1, encoder.base() + encoder.length(),
+            unaligned.begin() + 2);
+  Decoder unaligned_decoder(unaligned.data() + 2, encoder.length() - 1);
+  S2CellIndex copied;
+  ASSERT_TRUE(copied.Decode(&unaligned_decoder));
+  EXPECT_FALSE(copied.is_decoded_in_place());
+  ExpectSameStructure(copied, index_);
+
+  // A decoded index can be modified.
+  S2CellUnion cell_union = GetRandomCellUnion();
+  decoded.Add(cell_union, 100);
+  EXPECT_FALSE(decoded.is_decoded_in_place());
+  decoded.Build();
+  Add(cell_union, 100);
+  Build();
+  ExpectSameStructure(decoded, index_);
+
+  // Truncated encodings are rejected.
+  for (int length = 1; length < encoder.length(); length += 97) {
+    Decoder truncated(encoder.base() + 1, length - 1);
+    EXPECT_FALSE(S2CellIndex().Decode(&truncated));
+  }
+}
+
+TEST_F(S2CellIndexTest, DecodeRejectsOutOfRangeNodes) {
+  for (int i = 0; i < 20; ++i) {
+    Add(GetRandomCellUnion(), i);
+  }
+  Build();
+  Encoder encoder;
+  index_.Encode(&encoder);
+  string data(encoder.base(), encoder.length());
+  Decoder header(data.data(), data.size());
+  header.get8();
+  uint64 num_cells, num_ranges;
+  ASSERT_TRUE(header.get_varint64(&num_cells));
+  ASSERT_TRUE(header.get_varint64(&num_ranges));
+  const size_t ranges_start = data.size() - 12 * num_ranges;
+  const size_t cells_start = ranges_start - 16 * num_cells;
+
+  // Replaces the 32-bit value at the given offset and tries to decode.
+  auto decode_with = [&data](size_t offset, int32 value) {
+    string corrupt = data;
+    LittleEndian::Store32(&corrupt[offset], value);
+    Decoder decoder(corrupt.data(), corrupt.size());
+    return S2CellIndex().Decode(&decoder);
+  };
+  // The parent of the last cell must be an earlier cell (or -1).
+  const size_t last_parent = cells_start + 16 * (num_cells - 1) + 12;
+  EXPECT_TRUE(decode_with(last_parent, -1));
+  EXPECT_FALSE(decode_with(last_parent, num_cells - 1));
+  EXPECT_FALSE(decode_with(last_parent, num_cells));
+  EXPECT_FALSE(decode_with(last_parent, -2));
+  // The contents of every range must be a cell (or -1).
+  const size_t first_contents = ranges_start + 8;
+  EXPECT_TRUE(decode_with(first_contents, num_cells - 1));
+  EXPECT_FALSE(decode_with(first_contents, num_cells));
+  EXPECT_FALSE(decode_with(first_contents, -2));
+}
+
+TEST_F(S2CellIndexTest, EncodeDecodeEmpty) {
+  Build();
+  Encoder encoder;
+  index_.Encode(&encoder);
+  Decoder decoder(encoder.base(), encoder.length());
+  S2CellIndex decoded;
+  ASSERT_TRUE(decoded.Decode(&decoder));
+  EXPECT_EQ(0, decoded.num_cells());
+  ExpectSameStructure(decoded, index_);
+}
+
 // Given an S2CellId "target_str" in human-readable form, expects that the
 // first leaf cell contained by this target will intersect the exact set of
 // (cell_id, label) pairs given by "expected_strs".
@@ -357,6 +531,14 @@ void S2CellIndexTest::TestIntersection(const S2CellUnion& target) {
   ExpectEqual(expected, actual);
   flat_hash_set<Label> actual_labels = index_.GetIntersectingLabels(target);
   EXPECT_EQ(expected_labels, actual_labels);
+
+  Bitmap64 seen(1000, false);
+  vector<Label> label_vector;
+  index_.GetIntersectingLabels(target, &seen, &label_vector);
+  EXPECT_EQ(expected_labels.size(), label_vector.size());  // No duplicates.
+  EXPECT_EQ(expected_labels, flat_hash_set<Label>(label_vector.begin(),
+                                                  label_vector.end()));
+  EXPECT_TRUE(seen.IsAllZeroes());
 }
 
 S2CellUnion MakeCellUnion(const vector<string>& strs) {
@@ -394,6 +576,36 @@ TEST_F(S2CellIndexTest, IntersectionRandomUnions) {
   }
 }
 
+TEST_F(S2CellIndexTest, BatchIntersectingLabels) {
+  for (int i = 0; i < 100; ++i) {
+    Add(GetRandomCellUnion(), i);
+  }
+  Build();
+  // Use both random targets and groups of adjacent targets, which share
+  // leaf cell ranges.  Also include an empty target.
+  vector<S2CellUnion> targets;
+  for (int i = 0; i < 50; ++i) {
+    targets.push_back(GetRandomCellUnion());
+    S2CellId id = S2Testing::GetRandomCellId();
+    for (int j = 0; j < 4; ++j, id = id.next_wrap()) {
+      targets.push_back(S2CellUnion({id}));
+    }
+  }
+  targets.push_back(S2CellUnion());
+  Bitmap64 seen(100, false);
+  vector<vector<Label>> labels;
+  index_.GetIntersectingLabels(targets, &seen, &labels);
+  ASSERT_EQ(targets.size(), labels.size());
+  for (int i = 0; i < targets.size(); ++i) {
+    vector<Label> expected;
+    index_.GetIntersectingLabels(targets[i], &seen, &expected);
+    std::sort(expected.begin(), expected.end());
+    std::sort(labels[i].begin(), labels[i].end());
+    EXPECT_EQ(expected, labels[i]);
+  }
+  EXPECT_TRUE(seen.IsAllZeroes());
+}
+
 TEST_F(S2CellIndexTest, IntersectionSemiRandomUnions) {
   // This test also uses random S2CellUnions, but the unions are specially
   // constructed so that interesting cases are more likely to arise.
@@ -18,12 +18,14 @@
 #include "s2/s2cell_union.h"
 
 #include <algorithm>
+#include <iterator>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 
 #include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
@@ -31,6 +33,8 @@
 #include "s2/s2cap.h"
 #include "s2/s2cell.h"
 #include "s2/s2cell_id.h"
+#include "s2/s2cell_id_sort.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng_rect.h"
 #include "s2/s2metrics.h"
 #include "s2/util/coding/coder.h"
@@ -156,36 +160,84 @@ bool S2CellUnion::IsNormalized() const {
   return true;
 }
 
-void S2CellUnion::Normalize() {
-  Normalize(&cell_ids_);
+void S2CellUnion::Normalize(int num_threads, S2Executor* executor) {
+  Normalize(&cell_ids_, num_threads, executor);
 }
 
-/*static*/ void S2CellUnion::Normalize(vector<S2CellId>* ids) {
+// Normalizes the sorted range [begin, end) in place and returns the end of
+// the normalized range.
+static S2CellId* NormalizeSorted(S2CellId* begin, S2CellId* end) {
   // Optimize the representation by discarding cells contained by other cells,
   // and looking for cases where all subcells of a parent cell are present.
-
-  std::sort(ids->begin(), ids->end());
-  int out = 0;
-  for (S2CellId id : *ids) {
+  S2CellId* out = begin;
+  for (S2CellId* it = begin; it != end; ++it) {
+    S2CellId id = *it;
     S2_DCHECK(id.is_valid()) << id;
     // Check whether this cell is contained by the previous cell.
-    if (out > 0 && (*ids)[out-1].contains(id)) continue;
+    if (out > begin && out[-1].contains(id)) continue;
 
     // Discard any previous cells contained by this cell.
-    while (out > 0 && id.contains((*ids)[out-1])) --out;
+    while (out > begin && id.contains(out[-1])) --out;
 
     // Check whether the last 3 elements plus "id" can be collapsed into a
     // single parent cell.
-    while (out >= 3 && AreSiblings((*ids)[out - 3], (*ids)[out - 2],
-                                   (*ids)[out - 1], id)) {
+    while (out - begin >= 3 && AreSiblings(out[-3], out[-2], out[-1], id)) {
       // Replace four children by their parent cell.
       id = id.parent();
       out -= 3;
     }
-    (*ids)[out++] = id;
+    *out++ = id;
   }
-  if (ids->size() != out)
-    ids->resize(out);
+  return out;
+}
+
+/*static*/ void S2CellUnion::Normalize(vector<S2CellId>* ids,
+                                       int num_threads,
+                                       S2Executor* executor) {
+  if (!is_sorted(ids->begin(), ids->end())) {
+    S2SortCellIds(absl::MakeSpan(*ids), num_threads, executor);
+  }
+  S2CellId* data = ids->data();
+  const size_t size = ids->size();
+
+  // Large inputs are split into blocks that are normalized in parallel.  The
+  // results are then concatenated and normalized again in a single pass,
+  // which discards or collapses cells that are contained by or siblings of
+  // cells in an adjacent block.
+  static constexpr int kMinCellsPerThread = 100000;
+  num_threads = std::max(1, static_cast<int>(std::min<size_t>(
+      S2NumThreads(executor, num_threads), size / kMinCellsPerThread)));
+  size_t num_cells = size;
+  if (num_threads > 1) {
+    vector<size_t> bounds;
+    for (int t = 0; t <= num_threads; ++t) {
+      bounds.push_back(size * t / num_threads);
+    }
+    vector<S2CellId*> ends(num_threads);
+    S2ParallelFor(executor, num_threads, [&](int t) {
+      ends[t] = NormalizeSorted(data + bounds[t], data + bounds[t + 1]);
+    });
+    S2CellId* out = ends[0];
+    for (int t = 1; t < num_threads; ++t) {
+      out = std::copy(data + bounds[t], ends[t], out);
+    }
+    num_cells = out - data;
+  }
+  num_cells = NormalizeSorted(data, data + num_cells) - data;
+  if (size != num_cells) ids->resize(num_cells);
+}
+
+// Returns the level that a cell at the given level is expanded to by
+// Denormalize().
+static int DenormalizedLevel(int level, int min_level, int level_mod) {
+  int new_level = max(min_level, level);
+  if (level_mod > 1) {
+    // Round up so that (new_level - min_level) is a multiple of level_mod.
+    // (Note that S2CellId::kMaxLevel is a multiple of 1, 2, and 3.)
+    new_level += (S2CellId::kMaxLevel - (new_level - min_level)) % level_mod;
+    new_level = min(S2CellId::kMaxLevel, new_level);
+  }
+  return new_level;
 }
 
 void S2CellUnion::Denormalize(int min_level, int level_mod,
@@ -206,13 +258,7 @@ void S2CellUnion::Denormalize(const vector<S2CellId>& in,
   out->reserve(in.size());
   for (S2CellId id : in) {
     int level = id.level();
-    int new_level = max(min_level, level);
-    if (level_mod > 1) {
-      // Round up so that (new_level - min_level) is a multiple of level_mod.
-      // (Note that S2CellId::kMaxLevel is a multiple of 1, 2, and 3.)
-      new_level += (S2CellId::kMaxLevel - (new_level - min_level)) % level_mod;
-      new_level = min(S2CellId::kMaxLevel, new_level);
-    }
+    int new_level = DenormalizedLevel(level, min_level, level_mod);
     if (new_level == level) {
       out->push_back(id);
     } else {
@@ -224,6 +270,17 @@ void S2CellUnion::Denormalize(const vector<S2CellId>& in,
   }
 }
 
+uint64 S2CellUnion::DenormalizedSize(const vector<S2CellId>& in,
+                                     int min_level, int level_mod) {
+  uint64 size = 0;
+  for (S2CellId id : in) {
+    int level = id.level();
+    size += uint64{1} << (2 * (DenormalizedLevel(level, min_level, level_mod) -
+                               level));
+  }
+  return size;
+}
+
 S2Cap S2CellUnion::GetCapBound() const {
   // Compute the approximate centroid of the region.  This won't produce the
   // bounding cap of minimal area, but it should be close enough.
@@ -272,6 +329,53 @@ static inline bool EntirelyPrecedes(S2CellId a, S2CellId b) {
   return a.range_max() < b.range_min();
 }
 
+// Returns the first position in [first, last) where "pred" is false, given
+// that "pred" is true for some prefix of the range and false afterwards.
+// This is equivalent to std::partition_point() except that it uses galloping
+// (exponential) search, so that it takes O(log d) time where "d" is the
+// distance from "first" to the result.  When merging two sorted vectors of
+// sizes n <= m, this gives O(n log(m/n)) time rather than O(n log m), and
+// most probes stay close to the current position.
+template <class Iter, class Pred>
+static Iter GallopPartitionPoint(Iter first, Iter last, Pred pred) {
+  // Invariant: "pred" is true for all elements before "first".
+  typename std::iterator_traits<Iter>::difference_type step = 1;
+  while (step < last - first && pred(first[step])) {
+    first += step + 1;
+    step *= 2;
+  }
+  // Either "pred" is false for first[step], or the range has at most "step"
+  // elements left.
+  return std::partition_point(
+      first, (step < last - first) ? first + step + 1 : last, pred);
+}
+
+// Returns the first cell in [first, last) that does not entirely precede
+// "target", using galloping search (see above).
+template <class Iter>
+static Iter FindFirstNotPreceding(Iter first, Iter last, S2CellId target) {
+  return GallopPartitionPoint(first, last, [target](S2CellId a) {
+    return EntirelyPrecedes(a, target);
+  });
+}
+
+// Equivalent to std::lower_bound(first, last, target, EntirelyPrecedes),
+// except that the loop has no data-dependent branches (the comparison result
+// is used to select the next position, which compiles to a conditional
+// move).  This avoids branch mispredictions, which dominate the cost of
+// binary search over arrays that fit in cache.
+template <class Iter>
+static Iter BranchlessLowerBound(Iter first, Iter last, S2CellId target) {
+  auto n = last - first;
+  if (n == 0) return first;
+  while (n > 1) {
+    auto half = n / 2;
+    first = EntirelyPrecedes(first[half - 1], target) ? first + half : first;
+    n -= half;
+  }
+  return first + EntirelyPrecedes(*first, target);
+}
+
 bool S2CellUnion::Contains(S2CellId id) const {
   // This is an exact test.  Each cell occupies a linear span of the S2
   // space-filling curve, and the cell id is simply the position at the center
@@ -281,7 +385,7 @@ bool S2CellUnion::Contains(S2CellId id) const {
   // There is containment if and only if this cell id contains the target id.
   S2_DCHECK(id.is_valid()) << id;
 
-  const auto i = std::lower_bound(begin(), end(), id, EntirelyPrecedes);
+  const auto i = BranchlessLowerBound(begin(), end(), id);
   return i != end() && i->contains(id);
 }
 
@@ -289,10 +393,51 @@ bool S2CellUnion::Intersects(S2CellId id) const {
   // This is an exact test; see the comments for Contains() above.
   S2_DCHECK(id.is_valid()) << id;
 
-  const auto i = std::lower_bound(begin(), end(), id, EntirelyPrecedes);
+  const auto i = BranchlessLowerBound(begin(), end(), id);
   return i != end() && i->intersects(id);
 }
 
+// Sets (*result)[k] to "test(*i, ids[k])", where "i" is the first cell of
+// the union that does not entirely precede ids[k] (or false if there is no
+// such cell).
+template <class Test>
+static void BatchLookup(const vector<S2CellId>& cells,
+                        absl::Span<const S2CellId> ids, Test test,
+                        vector<bool>* result) {
+  result->assign(ids.size(), false);
+  auto i = cells.begin();
+  // All cells before "i" entirely precede any cell whose range starts at or
+  // after "prev_min".
+  S2CellId prev_min(0);
+  for (size_t k = 0; k < ids.size(); ++k) {
+    S2CellId id = ids[k];
+    S2_DCHECK(id.is_valid()) << id;
+    S2CellId id_min = id.range_min();
+    if (id_min >= prev_min) {
+      // Sorted input: continue from the previous position.  Galloping search
+      // finds nearby cells in a few probes.
+      i = FindFirstNotPreceding(i, cells.end(), id);
+    } else {
+      i = BranchlessLowerBound(cells.begin(), cells.end(), id);
+    }
+    if (i != cells.end() && test(*i, id)) (*result)[k] = true;
+    prev_min = id_min;
+  }
+}
+
+void S2CellUnion::BatchContains(absl::Span<const S2CellId> ids,
+                                vector<bool>* result) const {
+  BatchLookup(cell_ids_, ids,
+              [](S2CellId x, S2CellId id) { return x.contains(id); }, result);
+}
+
+void S2CellUnion::BatchIntersects(absl::Span<const S2CellId> ids,
+                                  vector<bool>* result) const {
+  BatchLookup(cell_ids_, ids,
+              [](S2CellId x, S2CellId id) { return x.intersects(id); },
+              result);
+}
+
 bool S2CellUnion::Contains(const S2CellUnion& y) const {
   if (y.empty()) return true;
   if (empty()) return false;
@@ -301,7 +446,7 @@ bool S2CellUnion::Contains(const S2CellUnion& y) const {
     // If our first cell ends before the one we need to contain, advance
     // where we start searching.
     if (EntirelyPrecedes(*i, y_id)) {
-      i = std::lower_bound(i + 1, end(), y_id, EntirelyPrecedes);
+      i = FindFirstNotPreceding(i + 1, end(), y_id);
       // If we're at the end, we don't contain the current y_id.
       if (i == end()) return false;
     }
@@ -315,12 +460,12 @@ bool S2CellUnion::Intersects(const S2CellUnion& y) const {
   for (auto i = begin(), j = y.begin(); i != end() && j != y.end(); ) {
     if (EntirelyPrecedes(*i, *j)) {
       // Advance "i" to the first cell that might overlap *j.
-      i = std::lower_bound(i + 1, end(), *j, EntirelyPrecedes);
+      i = FindFirstNotPreceding(i + 1, end(), *j);
       continue;
     }
     if (EntirelyPrecedes(*j, *i)) {
       // Advance "j" to the first cell that might overlap *i.
-      j = std::lower_bound(j + 1, y.end(), *i, EntirelyPrecedes);
+      j = FindFirstNotPreceding(j + 1, y.end(), *i);
       continue;
     }
     // Neither cell is to the left of the other, so they must intersect.
@@ -331,10 +476,9 @@ bool S2CellUnion::Intersects(const S2CellUnion& y) const {
 }
 
 S2CellUnion S2CellUnion::Union(const S2CellUnion& y) const {
-  vector<S2CellId> cell_ids;
-  cell_ids.reserve(num_cells() + y.num_cells());
-  cell_ids = cell_ids_;
-  cell_ids.insert(cell_ids.end(), y.cell_ids_.begin(), y.cell_ids_.end());
+  // Merging the two sorted vectors allows Normalize() to skip sorting.
+  vector<S2CellId> cell_ids(num_cells() + y.num_cells());
+  std::merge(begin(), end(), y.begin(), y.end(), cell_ids.begin());
   return S2CellUnion(std::move(cell_ids));
 }
 
@@ -356,12 +500,19 @@ S2CellUnion S2CellUnion::Intersection(S2CellId id) const {
 
 S2CellUnion S2CellUnion::Intersection(const S2CellUnion& y) const {
   S2CellUnion result;
-  GetIntersection(cell_ids_, y.cell_ids_, &result.cell_ids_);
-  // The output is normalized as long as both inputs are normalized.
-  S2_DCHECK(result.IsNormalized() || !IsNormalized() || !y.IsNormalized());
+  Intersection(y, &result);
   return result;
 }
 
+void S2CellUnion::Intersection(const S2CellUnion& y,
+                               S2CellUnion* result) const {
+  S2_DCHECK_NE(result, this);
+  S2_DCHECK_NE(result, &y);
+  GetIntersection(cell_ids_, y.cell_ids_, &result->cell_ids_);
+  // The output is normalized as long as both inputs are normalized.
+  S2_DCHECK(result->IsNormalized() || !IsNormalized() || !y.IsNormalized());
+}
+
 /*static*/ void S2CellUnion::GetIntersection(const vector<S2CellId>& x,
                                              const vector<S2CellId>& y,
                                              vector<S2CellId>* out) {
@@ -370,9 +521,10 @@ S2CellUnion S2CellUnion::Intersection(const S2CellUnion& y) const {
   S2_DCHECK(is_sorted(x.begin(), x.end()));
   S2_DCHECK(is_sorted(y.begin(), y.end()));
 
-  // This is a fairly efficient calculation that uses binary search to skip
+  // This is a fairly efficient calculation that uses galloping search to skip
   // over sections of both input vectors.  It takes logarithmic time if all the
-  // cells of "x" come before or after all the cells of "y" in S2CellId order.
+  // cells of "x" come before or after all the cells of "y" in S2CellId order,
+  // and O(n log(m/n)) time in general where n <= m are the input sizes.
 
   out->clear();
   vector<S2CellId>::const_iterator i = x.begin();
@@ -386,14 +538,14 @@ S2CellUnion S2CellUnion::Intersection(const S2CellUnion& y) const {
         out->push_back(*i++);
       } else {
         // Advance "j" to the first cell that might overlap *i.
-        j = std::lower_bound(j + 1, y.end(), *i, EntirelyPrecedes);
+        j = FindFirstNotPreceding(j + 1, y.end(), *i);
       }
     } else if (jmin > imin) {
       // Identical to the code above with "i" and "j" reversed.
       if (*j <= i->range_max()) {
         out->push_back(*j++);
       } else {
-        i = std::lower_bound(i + 1, x.end(), *j, EntirelyPrecedes);
+        i = FindFirstNotPreceding(i + 1, x.end(), *j);
       }
     } else {
       // "i" and "j" have the same range_min(), so one contains the other.
@@ -407,30 +559,44 @@ S2CellUnion S2CellUnion::Intersection(const S2CellUnion& y) const {
   S2_DCHECK(is_sorted(out->begin(), out->end()));
 }
 
-static void GetDifferenceInternal(S2CellId cell,
-                                  const S2CellUnion& y,
+// Adds the difference between "cell" and "y" to "cell_ids", where "y" is a
+// sorted vector of disjoint cells that consists of exactly those cells of the
+// subtrahend that intersect "cell".  If they intersect but the difference is
+// non-empty, divide and conquer.
+static void GetDifferenceInternal(S2CellId cell, absl::Span<const S2CellId> y,
                                   vector<S2CellId>* cell_ids) {
-  // Add the difference between cell and y to cell_ids.
-  // If they intersect but the difference is non-empty, divide and conquer.
-  if (!y.Intersects(cell)) {
+  if (y.empty()) {
     cell_ids->push_back(cell);
-  } else if (!y.Contains(cell)) {
-    S2CellId child = cell.child_begin();
-    for (int i = 0; ; ++i) {
-      GetDifferenceInternal(child, y, cell_ids);
-      if (i == 3) break;  // Avoid unnecessary next() computation.
-      child = child.next();
-    }
+    return;
+  }
+  // If some cell of "y" contains "cell" then it is the only one that
+  // intersects "cell".  Otherwise every cell of "y" is a descendant of "cell",
+  // and so it is contained by exactly one child of "cell".
+  if (y[0].contains(cell)) return;
+  S2CellId child = cell.child_begin();
+  for (int i = 0; ; ++i) {
+    auto first = std::lower_bound(y.begin(), y.end(), child.range_min());
+    auto last = std::upper_bound(first, y.end(), child.range_max());
+    GetDifferenceInternal(child, absl::MakeConstSpan(first, last), cell_ids);
+    if (i == 3) break;  // Avoid unnecessary next() computation.
+    child = child.next();
   }
 }
 
 S2CellUnion S2CellUnion::Difference(const S2CellUnion& y) const {
-  // TODO(ericv): this is approximately O(N*log(N)), but could probably
-  // use similar techniques as GetIntersection() to be more efficient.
-
+  // Both vectors are walked in order.  For each cell of this union, we find
+  // the range of cells in "y" that intersect it using galloping search, so
+  // the running time is roughly linear in the size of the inputs plus the
+  // output.
   S2CellUnion result;
+  auto j = y.begin();
   for (S2CellId id : *this) {
-    GetDifferenceInternal(id, y, &result.cell_ids_);
+    j = FindFirstNotPreceding(j, y.end(), id);
+    auto k = GallopPartitionPoint(
+        j, y.end(), [id](S2CellId b) { return !EntirelyPrecedes(id, b); });
+    GetDifferenceInternal(
+        id, absl::MakeConstSpan(y.cell_ids().data() + (j - y.begin()), k - j),
+        &result.cell_ids_);
   }
   // The output is normalized as long as the first argument is normalized.
   S2_DCHECK(result.IsNormalized() || !IsNormalized());
@@ -555,7 +721,8 @@ std::string S2CellUnion::ToString() const {
   string output = absl::StrCat("Size:", size(), " S2CellIds:");
   for (int i = 0, limit = min(kMaxCount, size()); i < limit; ++i) {
     if (i > 0) output += ",";
-    output += cell_id(i).ToToken();
+    char token[S2CellId::kMaxTokenLength];
+    output.append(token, cell_id(i).ToToken(token));
   }
   if (size() > kMaxCount) output += ",...";
   return output;
@@ -26,12 +26,14 @@
 #include "absl/base/macros.h"
 #include "absl/flags/flag.h"
 #include "absl/hash/hash.h"
+#include "absl/types/span.h"
 
 #include "s2/base/commandlineflags.h"
 #include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
 #include "s2/_fp_contract_off.h"
 #include "s2/s2cell_id.h"
+#include "s2/s2executor.h"
 #include "s2/s2region.h"
 
 class Decoder;
@@ -163,7 +165,10 @@ class S2CellUnion final : public S2Region {
   // Normalizes the cell union by discarding cells that are contained by other
   // cells, replacing groups of 4 child cells by their parent cell whenever
   // possible, and sorting all the cell ids in increasing order.
-  void Normalize();
+  //
+  // Large cell unions are normalized using up to "num_threads" threads (see
+  // S2ParallelFor for the meaning of "executor").
+  void Normalize(int num_threads = 1, S2Executor* executor = nullptr);
 
   // Replaces "output" with an expanded version of the cell union where any
   // cells whose level is less than "min_level" or where (level - min_level)
@@ -199,6 +204,19 @@ class S2CellUnion final : public S2Region {
   // This is a fast operation (logarithmic in the size of the cell union).
   bool Intersects(S2CellId id) const;
 
+  // Batch versions of Contains(S2CellId) and Intersects(S2CellId) that set
+  // (*result)[i] to the result for ids[i].  When "ids" is sorted, the cell
+  // union is traversed in a single merge-like pass using galloping search,
+  // which takes O(n log(m/n)) time for "n" ids and "m" union cells rather
+  // than O(n log m).  Unsorted ids are also supported; in that case each
+  // out-of-order id starts a new search.
+  //
+  // Like Contains(S2CellId), the ids must be valid.
+  void BatchContains(absl::Span<const S2CellId> ids,
+                     std::vector<bool>* result) const;
+  void BatchIntersects(absl::Span<const S2CellId> ids,
+                       std::vector<bool>* result) const;
+
   // Returns true if this cell union contains the given other cell union.
   //
   // CAVEAT: If you have constructed a non-normalized S2CellUnion using
@@ -216,6 +234,13 @@ class S2CellUnion final : public S2Region {
   // Returns the intersection of the two given cell unions.
   S2CellUnion Intersection(const S2CellUnion& y) const;
 
+  // Like the method above, but stores the result in "result", reusing its
+  // existing storage.  When the same "result" object is reused across many
+  // calls, no memory is allocated once its capacity is large enough.
+  //
+  // REQUIRES: result != this && result != &y
+  void Intersection(const S2CellUnion& y, S2CellUnion* result) const;
+
   // Specialized version of GetIntersection() that returns the intersection of
   // a cell union with an S2CellId.  This can be useful for splitting a cell
   // union into pieces.
@@ -301,6 +326,8 @@ class S2CellUnion final : public S2Region {
   bool Contains(const S2Point& p) const override;
 
   // Appends a serialized representation of the S2CellUnion to "encoder".
+  // (See s2coding::EncodeS2CellUnion for a more compact encoding that can
+  // be queried without decoding.)
   //
   // REQUIRES: "encoder" uses the default constructor, so that its buffer
   //           can be enlarged as necessary by calling Ensure(int).
@@ -316,7 +343,8 @@ class S2CellUnion final : public S2Region {
   // Like Normalize(), but works with a vector of S2CellIds.
   // Equivalent to:
   //   *cell_ids = S2CellUnion(std::move(*cell_ids)).Release();
-  static void Normalize(std::vector<S2CellId>* cell_ids);
+  static void Normalize(std::vector<S2CellId>* cell_ids, int num_threads = 1,
+                        S2Executor* executor = nullptr);
 
   // Like Denormalize(), but works with a vector of S2CellIds.
   // REQUIRES: out != &in
@@ -324,6 +352,13 @@ class S2CellUnion final : public S2Region {
                           int min_level, int level_mod,
                           std::vector<S2CellId>* out);
 
+  // Returns the number of cells that Denormalize() would output for the
+  // given arguments without actually generating them.  This can be used to
+  // check whether the output would be too large before allocating it (e.g.,
+  // a single face cell denormalized with min_level == 20 yields 4**20 cells).
+  static uint64 DenormalizedSize(const std::vector<S2CellId>& in,
+                                 int min_level, int level_mod);
+
   // Like GetIntersection(), but works directly with vectors of S2CellIds,
   // Equivalent to:
   //
@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <random>
 #include <string>
 #include <utility>
 #include <vector>
@@ -36,6 +37,7 @@
 #include "s2/s2cell.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2edge_distances.h"
+#include "s2/s2executor.h"
 #include "s2/s2metrics.h"
 #include "s2/s2region_coverer.h"
 #include "s2/s2testing.h"
@@ -186,6 +188,34 @@ static void AddCells(S2CellId id, bool selected,
   }
 }
 
+TEST(S2CellUnion, NormalizeMultipleThreads) {
+  // Every block boundary falls inside a run of siblings that collapses into
+  // coarser cells, and some cells contain cells in other blocks.
+  vector<S2CellId> input;
+  S2CellId parent = S2Testing::GetRandomCellId(4);
+  for (S2CellId id = parent.child_begin(14); id != parent.child_end(14);
+       id = id.next()) {
+    if (rnd.OneIn(50)) continue;
+    input.push_back(id);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    input.push_back(parent.child_begin(5 + rnd.Uniform(8)).advance(
+        rnd.Uniform(4)));
+  }
+  std::shuffle(input.begin(), input.end(), std::mt19937(1));
+  vector<S2CellId> expected = input;
+  S2CellUnion::Normalize(&expected);
+  vector<S2CellId> actual = input;
+  S2CellUnion::Normalize(&actual, 4);
+  EXPECT_EQ(expected, actual);
+  EXPECT_TRUE(S2CellUnion::FromNormalized(actual).IsNormalized());
+
+  S2ThreadPool pool(4);
+  actual = input;
+  S2CellUnion::Normalize(&actual, 1, &pool);
+  EXPECT_EQ(expected, actual);
+}
+
 TEST(S2CellUnion, Normalize) {
   // Try a bunch of random test cases, and keep track of average
   // statistics for normalization (to see if they agree with the
@@ -333,6 +363,46 @@ static double GetRadius(const S2CellUnion& covering, const S2Point& axis) {
   return max_dist;
 }
 
+// Returns a normalized union of random cells near the given cell.
+static S2CellUnion MakeRandomUnion(S2CellId ancestor, int num_cells) {
+  vector<S2CellId> ids;
+  for (int i = 0; i < num_cells; ++i) {
+    int level = ancestor.level() + 2 + S2Testing::rnd.Uniform(10);
+    uint64 range = ancestor.range_max().id() - ancestor.range_min().id();
+    S2CellId id(ancestor.range_min().id() +
+                (S2Testing::rnd.Rand64() % range & ~uint64{1}));
+    id = id.parent(level);
+    ids.push_back(id);
+  }
+  return S2CellUnion(std::move(ids));
+}
+
+TEST(S2CellUnion, LargeBooleanOps) {
+  // Check the set identities that relate the boolean operations on large,
+  // heavily interleaved inputs of different sizes.
+  S2CellId ancestor = S2CellId::FromFace(2).child_begin(4);
+  S2CellUnion result;
+  for (int iter = 0; iter < 10; ++iter) {
+    S2CellUnion x = MakeRandomUnion(ancestor, 20000);
+    S2CellUnion y = MakeRandomUnion(ancestor, 100 << (iter % 8));
+    S2CellUnion x_and_y = x.Intersection(y);
+    S2CellUnion x_minus_y = x.Difference(y);
+    S2CellUnion y_minus_x = y.Difference(x);
+    EXPECT_EQ(x_and_y, y.Intersection(x));
+    x.Intersection(y, &result);
+    EXPECT_EQ(x_and_y, result);
+    EXPECT_TRUE(x.Contains(x_and_y));
+    EXPECT_TRUE(y.Contains(x_and_y));
+    EXPECT_TRUE(x.Contains(x_minus_y));
+    EXPECT_FALSE(x_minus_y.Intersects(y));
+    EXPECT_FALSE(y_minus_x.Intersects(x));
+    EXPECT_EQ(x, x_minus_y.Union(x_and_y));
+    EXPECT_EQ(x.Union(y), x_minus_y.Union(y));
+    EXPECT_EQ(x.Union(y), y_minus_x.Union(x));
+    EXPECT_EQ(x.Intersects(y), !x_and_y.empty());
+  }
+}
+
 TEST(S2CellUnion, Expand) {
   // This test generates coverings for caps of random sizes, expands
   // the coverings by a random radius, and then make sure that the new
@@ -616,6 +686,51 @@ TEST(S2CellUnion, LeafCellsCovered) {
   EXPECT_EQ(expected, cell_union.LeafCellsCovered());
 }
 
+TEST(S2CellUnion, BatchContainsAndIntersects) {
+  for (int iter = 0; iter < 100; ++iter) {
+    vector<S2CellId> input;
+    int num_cells = S2Testing::rnd.Uniform(20);
+    for (int i = 0; i < num_cells; ++i) {
+      input.push_back(S2Testing::GetRandomCellId());
+    }
+    S2CellUnion cell_union(input);
+
+    // Query cells at random levels, some of which are descendants of the
+    // union cells so that both results are frequently true.
+    vector<S2CellId> ids;
+    for (int i = 0; i < 200; ++i) {
+      S2CellId id = S2Testing::GetRandomCellId();
+      if (!cell_union.empty() && S2Testing::rnd.OneIn(2)) {
+        S2CellId x = cell_union.cell_id(
+            S2Testing::rnd.Uniform(cell_union.num_cells()));
+        int level = x.level() +
+            S2Testing::rnd.Uniform(S2CellId::kMaxLevel - x.level() + 1);
+        id = x.child_begin(level).advance(S2Testing::rnd.Uniform(4) - 1);
+        if (!id.is_valid()) id = x;
+      }
+      ids.push_back(id);
+    }
+    for (int order = 0; order < 3; ++order) {
+      if (order == 1) std::sort(ids.begin(), ids.end());
+      if (order == 2) {
+        // Sorted by range_min(), which is the order of leaf cells.
+        std::sort(ids.begin(), ids.end(), [](S2CellId a, S2CellId b) {
+          return a.range_min() < b.range_min();
+        });
+      }
+      vector<bool> contains, intersects;
+      cell_union.BatchContains(ids, &contains);
+      cell_union.BatchIntersects(ids, &intersects);
+      ASSERT_EQ(ids.size(), contains.size());
+      ASSERT_EQ(ids.size(), intersects.size());
+      for (int i = 0; i < ids.size(); ++i) {
+        EXPECT_EQ(cell_union.Contains(ids[i]), contains[i]) << ids[i];
+        EXPECT_EQ(cell_union.Intersects(ids[i]), intersects[i]) << ids[i];
+      }
+    }
+  }
+}
+
 TEST(S2CellUnion, WorksInContainers) {
   vector<S2CellId> ids(1, S2CellId::FromFace(1));
   S2CellUnion cell_union0(ids);
@@ -651,6 +766,24 @@ TEST(S2CellUnion, ToStringOver500Cells) {
   EXPECT_EQ(result.substr(result.size() - 4), ",...");
 }
 
+TEST(S2CellUnion, DenormalizedSize) {
+  S2CellId face = S2CellId::FromFace(1);
+  vector<S2CellId> ids = {face.child(0), face.child(1).child(2),
+                          face.child(3).child_begin(S2CellId::kMaxLevel)};
+  for (int min_level : {0, 1, 3, 6}) {
+    for (int level_mod : {1, 2, 3}) {
+      vector<S2CellId> output;
+      S2CellUnion::Denormalize(ids, min_level, level_mod, &output);
+      EXPECT_EQ(output.size(),
+                S2CellUnion::DenormalizedSize(ids, min_level, level_mod));
+    }
+  }
+  // The size is computed even when the output would not fit in memory.
+  EXPECT_EQ(6 * (uint64{1} << 60),
+            S2CellUnion::DenormalizedSize(
+                S2CellUnion::WholeSphere().cell_ids(), 30, 1));
+}
+
 TEST(S2CellUnion, IntersectionOneInputNormalized) {
   S2CellId id = S2CellId::FromFace(3);  // arbitrary
   S2CellUnion parent({id});
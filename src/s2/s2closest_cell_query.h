@@ -105,6 +105,9 @@ class S2ClosestCellQuery {
   //   const Label& label() const;
   using Result = Base::Result;
 
+  // Statistics about the work done by queries (see set_stats).
+  using Stats = Base::Stats;
+
   // Options that control the set of cells returned.  Note that by default
   // *all* cells are returned, so you will always want to set either the
   // max_results() option or the max_distance() option (or both).
@@ -236,6 +239,14 @@ class S2ClosestCellQuery {
   const Options& options() const;
   Options* mutable_options();
 
+  // Specifies an object that the statistics of each subsequent query should
+  // be added to, or nullptr to stop collecting statistics.  This can be used
+  // to tune the query options for a given dataset.  See Stats for details.
+  //
+  // DEFAULT: nullptr
+  Stats* stats() const { return base_.stats(); }
+  void set_stats(Stats* stats) { base_.set_stats(stats); }
+
   // Returns the closest cells to the given target that satisfy the current
   // options.  This method may be called multiple times.
   std::vector<Result> FindClosestCells(Target* target);
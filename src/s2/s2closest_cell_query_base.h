@@ -20,18 +20,25 @@
 #ifndef S2_S2CLOSEST_CELL_QUERY_BASE_H_
 #define S2_S2CLOSEST_CELL_QUERY_BASE_H_
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <vector>
 
+#include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
 #include "absl/container/btree_set.h"
 #include "absl/container/inlined_vector.h"
 #include "absl/hash/hash.h"
+#include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2cap.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2cell_index.h"
 #include "s2/s2cell_union.h"
 #include "s2/s2distance_target.h"
+#include "s2/s2metrics.h"
 #include "s2/s2region_coverer.h"
 #include "s2/util/gtl/dense_hash_set.h"
 
@@ -155,6 +162,48 @@ class S2ClosestCellQueryBase {
   // allocate temporary data structures in order to improve performance.
   using Target = S2DistanceTarget<Distance>;
 
+  // Statistics about the work done by queries.  These can be used to tune
+  // the query options (e.g., max_error()) for a given dataset.  The
+  // statistics are summed over all queries made while the Stats object is
+  // attached to the query (see set_stats).
+  struct Stats {
+    // The number of queries, and the number of those that used the brute
+    // force algorithm (because the index was small or use_brute_force() was
+    // specified).
+    int64 num_queries = 0;
+    int64 num_brute_force_queries = 0;
+
+    // The number of S2Cells whose distance to the target was computed in
+    // order to decide whether to add them to the priority queue.
+    int64 num_cells_visited = 0;
+
+    // The number of indexed (cell_id, label) pairs whose distance to the
+    // target was computed.
+    int64 num_cells_evaluated = 0;
+
+    // The number of S2Cells (either candidates for the priority queue or
+    // indexed cells) that were discarded using a cheap distance bound,
+    // without computing their distance to the target.
+    int64 num_cells_pruned = 0;
+
+    // The maximum size of the priority queue during any query.
+    int64 max_queue_size = 0;
+
+    // The time spent computing the covering of the index, which is done by
+    // the first optimized query after each call to Init() or ReInit().
+    double init_covering_seconds = 0;
+
+    void Add(const Stats& other) {
+      num_queries += other.num_queries;
+      num_brute_force_queries += other.num_brute_force_queries;
+      num_cells_visited += other.num_cells_visited;
+      num_cells_evaluated += other.num_cells_evaluated;
+      num_cells_pruned += other.num_cells_pruned;
+      max_queue_size = std::max(max_queue_size, other.max_queue_size);
+      init_covering_seconds += other.init_covering_seconds;
+    }
+  };
+
   // Each "Result" object represents a closest (cell_id, label) pair.
   class Result {
    public:
@@ -235,6 +284,15 @@ class S2ClosestCellQueryBase {
   // Return a reference to the underlying S2CellIndex.
   const S2CellIndex& index() const;
 
+  // Specifies an object that the statistics of each subsequent query should
+  // be added to, or nullptr to stop collecting statistics.  The object must
+  // persist until it is detached (or the query is destroyed), and it may be
+  // shared by several queries only if they are not used concurrently.
+  //
+  // DEFAULT: nullptr
+  Stats* stats() const { return stats_; }
+  void set_stats(Stats* stats) { stats_ = stats; }
+
   // Returns the closest (cell_id, label) pairs to the given target that
   // satisfy the given options.  This method may be called multiple times.
   std::vector<Result> FindClosestCells(Target* target, const Options& options);
@@ -267,11 +325,18 @@ class S2ClosestCellQueryBase {
   void MaybeAddResult(S2CellId cell_id, Label label);
   bool ProcessOrEnqueue(S2CellId id, NonEmptyRangeIterator* iter, bool seek);
   void AddRange(const RangeIterator& range);
+  bool CanPrune(S2CellId id);
+  static S1ChordAngle GetCellRadiusBound(int level);
 
   const S2CellIndex* index_;
   const Options* options_;
   Target* target_;
 
+  // The statistics of the current query, which are added to *stats_ (if
+  // non-null) when the query finishes.
+  Stats* stats_ = nullptr;
+  Stats query_stats_;
+
   // True if max_error() must be subtracted from priority queue cell distances
   // in order to ensure that such distances are measured conservatively.  This
   // is true only if the target takes advantage of max_error() in order to
@@ -358,6 +423,19 @@ class S2ClosestCellQueryBase {
       std::priority_queue<QueueEntry, absl::InlinedVector<QueueEntry, 16>>;
   CellQueue queue_;
 
+  // A cap bounding the target (or its antipode, for S2MaxDistance targets),
+  // used by CanPrune().  This is computed only by the optimized algorithm;
+  // otherwise "use_cell_bound_" is false.
+  S2Cap target_cap_;
+  bool use_cell_bound_;
+
+  // The most recent cell evaluated by MaybeAddResult, its distance, and
+  // whether it could be a result.  Index cells are often duplicated with
+  // different labels, and such cells are visited consecutively.
+  S2CellId last_cell_id_;
+  Distance last_cell_distance_;
+  bool last_cell_ok_;
+
   // Used to iterate over the contents of an S2CellIndex range.  It is defined
   // here to take advantage of the fact that when multiple ranges are visited
   // in increasing order, duplicates can automatically be eliminated.
@@ -487,6 +565,7 @@ S2ClosestCellQueryBase<Distance>::FindClosestCell(
     Target* target, const Options& options) {
   S2_DCHECK_EQ(options.max_results(), 1);
   FindClosestCellsInternal(target, options);
+  if (stats_ != nullptr) stats_->Add(query_stats_);
   return result_singleton_;
 }
 
@@ -494,6 +573,7 @@ template <class Distance>
 void S2ClosestCellQueryBase<Distance>::FindClosestCells(
     Target* target, const Options& options, std::vector<Result>* results) {
   FindClosestCellsInternal(target, options);
+  if (stats_ != nullptr) stats_->Add(query_stats_);
   results->clear();
   if (options.max_results() == 1) {
     if (!result_singleton_.is_empty()) {
@@ -515,9 +595,13 @@ void S2ClosestCellQueryBase<Distance>::FindClosestCellsInternal(
     Target* target, const Options& options) {
   target_ = target;
   options_ = &options;
+  query_stats_ = Stats();
+  query_stats_.num_queries = 1;
 
   tested_cells_.clear();
   contents_it_.Clear();
+  use_cell_bound_ = false;
+  last_cell_id_ = S2CellId::None();
   distance_limit_ = options.max_distance();
   result_singleton_ = Result();
   S2_DCHECK(result_vector_.empty());
@@ -566,6 +650,7 @@ void S2ClosestCellQueryBase<Distance>::FindClosestCellsInternal(
   if (options.use_brute_force() ||
       index_->num_cells() <= target_->max_brute_force_index_size()) {
     avoid_duplicates_ = false;
+    query_stats_.num_brute_force_queries = 1;
     FindClosestCellsBruteForce();
   } else {
     // If the target takes advantage of max_error() then we need to avoid
@@ -619,6 +704,8 @@ void S2ClosestCellQueryBase<Distance>::InitQueue() {
   // save a lot of work when the search region is small.
   S2Cap cap = target_->GetCapBound();
   if (cap.is_empty()) return;  // Empty target.
+  target_cap_ = cap;
+  use_cell_bound_ = true;
   if (options().max_results() == 1) {
     // If the user is searching for just the closest cell, we can compute an
     // upper bound on search radius by seeking to the center of the target's
@@ -659,7 +746,16 @@ void S2ClosestCellQueryBase<Distance>::InitQueue() {
   // that contain each covering cell by seeking to covering_cell.range_min(),
   // (3) replacing each covering cell by the largest such cell (if any), and
   // (4) normalizing the result.
-  if (index_covering_.empty()) InitCovering();
+  if (index_covering_.empty()) {
+    if (stats_ == nullptr) {
+      InitCovering();
+    } else {
+      auto start = std::chrono::steady_clock::now();
+      InitCovering();
+      query_stats_.init_covering_seconds += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+    }
+  }
   const std::vector<S2CellId>* initial_cells = &index_covering_;
   if (distance_limit_ < Distance::Infinity()) {
     S2RegionCoverer coverer;
@@ -752,16 +848,26 @@ void S2ClosestCellQueryBase<Distance>::MaybeAddResult(S2CellId cell_id,
     return;
   }
 
-  // TODO(ericv): It may be relatively common to add the same S2CellId
-  // multiple times with different labels.  This could be optimized by
-  // remembering the last "cell_id" argument and its distance.  However this
-  // may not be beneficial when Options::max_results() == 1, for example.
-  S2Cell cell(cell_id);
-  Distance distance = distance_limit_;
-  if (!target_->UpdateMinDistance(cell, &distance)) return;
-
-  const S2Region* region = options().region();
-  if (region && !region->MayIntersect(cell)) return;
+  Distance distance;
+  if (cell_id == last_cell_id_) {
+    // The distance limit can only decrease, so the previous result is still
+    // valid.
+    if (!last_cell_ok_ || !(last_cell_distance_ < distance_limit_)) return;
+    distance = last_cell_distance_;
+  } else {
+    last_cell_id_ = cell_id;
+    last_cell_ok_ = false;
+    if (CanPrune(cell_id)) return;
+    ++query_stats_.num_cells_evaluated;
+    S2Cell cell(cell_id);
+    distance = distance_limit_;
+    if (!target_->UpdateMinDistance(cell, &distance)) return;
+
+    const S2Region* region = options().region();
+    if (region && !region->MayIntersect(cell)) return;
+    last_cell_ok_ = true;
+    last_cell_distance_ = distance;
+  }
 
   Result result(distance, cell_id, label);
   if (options().max_results() == 1) {
@@ -808,6 +914,8 @@ bool S2ClosestCellQueryBase<Distance>::ProcessOrEnqueue(
   RangeIterator max_it = *iter;
   if (max_it.Advance(kMinRangesToEnqueue - 1) && max_it.start_id() <= last) {
     // This cell intersects at least kMinRangesToEnqueue ranges, so enqueue it.
+    if (CanPrune(id)) return true;
+    ++query_stats_.num_cells_visited;
     S2Cell cell(id);
     Distance distance = distance_limit_;
     // We check "region_" second because it may be relatively expensive.
@@ -818,6 +926,8 @@ bool S2ClosestCellQueryBase<Distance>::ProcessOrEnqueue(
         distance = distance - options().max_error();
       }
       queue_.push(QueueEntry(distance, id));
+      query_stats_.max_queue_size =
+          std::max<int64>(query_stats_.max_queue_size, queue_.size());
     }
     return true;  // Seek to next child.
   }
@@ -836,4 +946,45 @@ void S2ClosestCellQueryBase<Distance>::AddRange(const RangeIterator& range) {
   }
 }
 
+// Returns true if "id" is certainly too far from the target to contain any
+// results.  This conservative test is much cheaper than constructing an
+// S2Cell and calling Target::UpdateMinDistance(), since it only measures the
+// distance from the center of target_cap_ to the center of "id".  Note that
+// this works generically for all Distance types because target_cap_ and
+// GetChordAngleBound() have the same relationship as in InitQueue().
+template <class Distance>
+bool S2ClosestCellQueryBase<Distance>::CanPrune(S2CellId id) {
+  if (!use_cell_bound_ || !(distance_limit_ < Distance::Infinity())) {
+    return false;
+  }
+  S1ChordAngle radius = target_cap_.radius() +
+                        distance_limit_.GetChordAngleBound() +
+                        GetCellRadiusBound(id.level());
+  if (radius >= S1ChordAngle::Straight()) return false;
+  S1ChordAngle dist(target_cap_.center(), id.ToPoint());
+  if (dist.PlusError(-dist.GetS2PointConstructorMaxError()) <=
+      radius.PlusError(radius.GetS1AngleConstructorMaxError())) {
+    return false;
+  }
+  ++query_stats_.num_cells_pruned;
+  return true;
+}
+
+// Returns an upper bound on the distance from S2CellId::ToPoint() to any
+// point of a cell at the given level.
+template <class Distance>
+S1ChordAngle S2ClosestCellQueryBase<Distance>::GetCellRadiusBound(int level) {
+  // The diameter of a cell is at most its maximum diagonal.
+  static const std::array<S1ChordAngle, S2CellId::kMaxLevel + 1> kBounds =
+      []() {
+        std::array<S1ChordAngle, S2CellId::kMaxLevel + 1> bounds;
+        for (int level = 0; level <= S2CellId::kMaxLevel; ++level) {
+          bounds[level] = S1ChordAngle(S1Angle::Radians(std::min(
+              M_PI, S2::kMaxDiag.GetValue(level))));
+        }
+        return bounds;
+      }();
+  return kBounds[level];
+}
+
 #endif  // S2_S2CLOSEST_CELL_QUERY_BASE_H_
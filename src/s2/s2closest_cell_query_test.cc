@@ -24,6 +24,7 @@
 
 #include <gtest/gtest.h>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/str_format.h"
@@ -63,6 +64,37 @@ TEST(S2ClosestCellQuery, NoCells) {
   EXPECT_EQ(S1ChordAngle::Infinity(), query.GetDistance(&target));
 }
 
+TEST(S2ClosestCellQuery, Stats) {
+  S2CellIndex index;
+  absl::flat_hash_set<S2CellId> distinct_ids;
+  for (int i = 0; i < 1000; ++i) {
+    S2CellId id = S2Testing::GetRandomCellId();
+    index.Add(id, i);
+    distinct_ids.insert(id);
+  }
+  index.Build();
+  S2ClosestCellQuery query(&index);
+  S2ClosestCellQuery::Stats stats;
+  query.set_stats(&stats);
+  query.mutable_options()->set_max_results(5);
+  S2ClosestCellQuery::PointTarget target(S2Testing::RandomPoint());
+  query.FindClosestCells(&target);
+  EXPECT_EQ(1, stats.num_queries);
+  EXPECT_EQ(0, stats.num_brute_force_queries);
+  EXPECT_GT(stats.num_cells_visited, 0);
+  EXPECT_GT(stats.max_queue_size, 0);
+  EXPECT_GT(stats.num_cells_evaluated, 0);
+  EXPECT_LT(stats.num_cells_evaluated, 1000);
+  EXPECT_GT(stats.num_cells_pruned, 0);
+
+  query.mutable_options()->set_use_brute_force(true);
+  query.FindClosestCells(&target);
+  EXPECT_EQ(2, stats.num_queries);
+  EXPECT_EQ(1, stats.num_brute_force_queries);
+  // The distance to each distinct cell is computed once.
+  EXPECT_GE(stats.num_cells_evaluated, distinct_ids.size());
+}
+
 TEST(S2ClosestCellQuery, OptionsNotModified) {
   // Tests that FindClosestCell(), GetDistance(), and IsDistanceLess() do not
   // modify query.options(), even though all of these methods have their own
@@ -17,6 +17,8 @@
 
 #include "s2/s2closest_edge_query.h"
 
+#include <cmath>
+#include <limits>
 #include <memory>
 
 #include "absl/memory/memory.h"
@@ -28,6 +30,7 @@
 #include "s2/s2edge_distances.h"
 #include "s2/s2region_coverer.h"
 #include "s2/s2shape_index_region.h"
+#include "s2/util/coding/varint.h"
 
 void S2ClosestEdgeQuery::Options::set_conservative_max_distance(
     S1ChordAngle max_distance) {
@@ -78,7 +81,7 @@ S2ClosestEdgeQuery::~S2ClosestEdgeQuery() {
 }
 
 bool S2ClosestEdgeQuery::IsDistanceLess(Target* target, S1ChordAngle limit) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 64, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   tmp_options.set_max_distance(limit);
@@ -88,7 +91,7 @@ bool S2ClosestEdgeQuery::IsDistanceLess(Target* target, S1ChordAngle limit) {
 
 bool S2ClosestEdgeQuery::IsDistanceLessOrEqual(Target* target,
                                                S1ChordAngle limit) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 64, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   tmp_options.set_inclusive_max_distance(limit);
@@ -98,10 +101,66 @@ bool S2ClosestEdgeQuery::IsDistanceLessOrEqual(Target* target,
 
 bool S2ClosestEdgeQuery::IsConservativeDistanceLessOrEqual(
     Target* target, S1ChordAngle limit) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 64, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   tmp_options.set_conservative_max_distance(limit);
   tmp_options.set_max_error(S1ChordAngle::Straight());
   return !base_.FindClosestEdge(target, tmp_options).is_empty();
 }
+
+namespace {
+
+// Decodes a distance encoded as its squared chord length.
+bool DecodeDistance(Decoder* decoder, S1ChordAngle* distance) {
+  if (decoder->avail() < sizeof(double)) return false;
+  double length2 = decoder->getdouble();
+  if (std::isinf(length2) && length2 > 0) {
+    *distance = S1ChordAngle::Infinity();
+  } else if (length2 >= 0 && length2 <= 4) {
+    *distance = S1ChordAngle::FromLength2(length2);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+void S2ClosestEdgeQuery::EncodePartialResult(const PartialResult& result,
+                                             Encoder* encoder) {
+  encoder->Ensure(Varint::kMax32 + sizeof(double));
+  encoder->put_varint32(result.results.size());
+  encoder->putdouble(S1ChordAngle(result.unsearched_distance).length2());
+  for (const Result& r : result.results) {
+    encoder->Ensure(sizeof(double) + 2 * Varint::kMax32);
+    encoder->putdouble(S1ChordAngle(r.distance()).length2());
+    encoder->put_varint32(r.shape_id());
+    // Interior results have edge_id() == -1.
+    encoder->put_varint32(r.edge_id() + 1);
+  }
+}
+
+bool S2ClosestEdgeQuery::DecodePartialResult(Decoder* decoder,
+                                             PartialResult* result) {
+  uint32 num_results;
+  if (!decoder->get_varint32(&num_results)) return false;
+  S1ChordAngle unsearched;
+  if (!DecodeDistance(decoder, &unsearched)) return false;
+  result->unsearched_distance = S2MinDistance(unsearched);
+  result->results.clear();
+  for (uint32 i = 0; i < num_results; ++i) {
+    S1ChordAngle distance;
+    uint32 shape_id, edge_id;
+    if (!DecodeDistance(decoder, &distance) ||
+        !decoder->get_varint32(&shape_id) ||
+        !decoder->get_varint32(&edge_id) ||
+        shape_id > static_cast<uint32>(std::numeric_limits<int32>::max()) ||
+        edge_id > static_cast<uint32>(std::numeric_limits<int32>::max())) {
+      return false;
+    }
+    result->results.push_back(Result(S2MinDistance(distance), shape_id,
+                                     static_cast<int32>(edge_id) - 1));
+  }
+  return true;
+}
@@ -26,6 +26,7 @@
 #include "s2/base/logging.h"
 #include "absl/base/macros.h"
 #include "absl/container/inlined_vector.h"
+#include "absl/types/span.h"
 #include "s2/_fp_contract_off.h"
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
@@ -35,6 +36,7 @@
 #include "s2/s2edge_distances.h"
 #include "s2/s2min_distance_targets.h"
 #include "s2/s2shape_index.h"
+#include "s2/util/coding/coder.h"
 
 // S2ClosestEdgeQuery is a helper class for searching within an S2ShapeIndex
 // to find the closest edge(s) to a given point, edge, S2Cell, or geometry
@@ -133,6 +135,9 @@ class S2ClosestEdgeQuery {
   //   bool is_empty() const;
   using Result = Base::Result;
 
+  // Statistics about the work done by queries (see set_stats).
+  using Stats = Base::Stats;
+
   // Options that control the set of edges returned.  Note that by default
   // *all* edges are returned, so you will always want to set either the
   // max_results() option or the max_distance() option (or both).
@@ -182,6 +187,9 @@ class S2ClosestEdgeQuery {
     using Base::Options::set_max_results;
     using Base::Options::set_include_interiors;
     using Base::Options::set_use_brute_force;
+    using Base::Options::set_num_threads;
+    using Base::Options::set_max_cells_visited;
+    using Base::Options::set_max_query_seconds;
   };
 
   // "Target" represents the geometry to which the distance is measured.
@@ -254,6 +262,23 @@ class S2ClosestEdgeQuery {
   const Options& options() const;
   Options* mutable_options();
 
+  // Specifies an object that the statistics of each subsequent query should
+  // be added to, or nullptr to stop collecting statistics.  This can be used
+  // to tune the query options for a given dataset.  See Stats for details.
+  //
+  // DEFAULT: nullptr
+  Stats* stats() const { return base_.stats(); }
+  void set_stats(Stats* stats) { base_.set_stats(stats); }
+
+  // Returns true if the most recent query stopped early because it exceeded
+  // options().max_cells_visited() or options().max_query_seconds(), in which
+  // case the results are the best found so far and every edge closer than
+  // unsearched_distance() was examined.  (See S2ClosestEdgeQueryBase.)
+  bool budget_exceeded() const { return base_.budget_exceeded(); }
+  S1ChordAngle unsearched_distance() const {
+    return base_.unsearched_distance();
+  }
+
   // Returns the closest edges to the given target that satisfy the current
   // options.  This method may be called multiple times.
   //
@@ -265,8 +290,37 @@ class S2ClosestEdgeQuery {
 
   // This version can be more efficient when this method is called many times,
   // since it does not require allocating a new vector on each call.
+  //
+  // When answering many queries with the same S2ClosestEdgeQuery object
+  // (e.g., a batch of GPS fixes), it is worth issuing them in S2CellId order
+  // of the target locations.  Consecutive queries then visit nearby index
+  // cells, which improves memory locality (and the hit rate of lazy decoding
+  // for EncodedS2ShapeIndex).  For example:
+  //
+  //   std::sort(points.begin(), points.end(),
+  //             [](const S2Point& a, const S2Point& b) {
+  //               return S2CellId(a) < S2CellId(b);
+  //             });
   void FindClosestEdges(Target* target, std::vector<Result>* results);
 
+  // A function that is called with each result of VisitClosestEdges().  The
+  // function may return false in order to indicate that no further results
+  // are needed.
+  using ResultVisitor = Base::ResultVisitor;
+
+  // Calls "visitor" with each of the closest edges to the given target, in
+  // the same order as FindClosestEdges() would return them, and returns false
+  // if the visitor returned false.  This avoids copying the results into a
+  // vector.  When max_results() <= Base::kMaxSmallResults (8), the query
+  // itself does not allocate memory for the results either.  For example:
+  //
+  //   query.mutable_options()->set_max_results(5);
+  //   query.VisitClosestEdges(&target, [&](const Result& result) {
+  //       ...
+  //       return true;
+  //     });
+  bool VisitClosestEdges(Target* target, const ResultVisitor& visitor);
+
   //////////////////////// Convenience Methods ////////////////////////
 
   // Returns the closest edge to the target.  If no edge satisfies the search
@@ -309,6 +363,51 @@ class S2ClosestEdgeQuery {
   // are guaranteed to not intersect after snapping.
   bool IsConservativeDistanceLessOrEqual(Target* target, S1ChordAngle limit);
 
+  //////////////////////// Partitioned Queries ////////////////////////
+
+  // The closest edges found in one shard of a partitioned collection of
+  // geometry, together with the distance below which they are complete.
+  // See S2ClosestEdgeQueryBase::PartialResult for details.
+  using PartialResult = Base::PartialResult;
+
+  // Like FindClosestEdges(), but also records the distance below which the
+  // results are known to be complete (see Options::set_max_cells_visited).
+  void FindPartialResult(Target* target, PartialResult* result);
+
+  // Merges the partial results of running a query with the given options
+  // over each shard.  The shape ids must already be translated to a common
+  // numbering.  The result is the same as that of a single query over the
+  // union of the shards, except that edges that belong to several shards
+  // are reported only once.  For example:
+  //
+  //   vector<S2ClosestEdgeQuery::PartialResult> partials(num_shards);
+  //   for (int i = 0; i < num_shards; ++i) {
+  //     ... run FindPartialResult() on shard i, send it to the coordinator
+  //     ... using EncodePartialResult(), and map its shape ids ...
+  //     options.set_max_distance(
+  //         S2ClosestEdgeQuery::GetDistanceLimit(merged_so_far, options));
+  //   }
+  //   auto merged = S2ClosestEdgeQuery::MergeResults(partials, options);
+  static PartialResult MergeResults(
+      absl::Span<const PartialResult> partial_results, const Options& options);
+
+  // Returns a max_distance() that can be used to prune the queries over the
+  // remaining shards given the results merged so far.  This is either the
+  // distance of the max_results()-th merged result, or options.max_distance()
+  // if fewer results have been found.
+  static S1ChordAngle GetDistanceLimit(const PartialResult& merged,
+                                       const Options& options);
+
+  // Appends an encoded representation of "result" to "encoder", so that it
+  // can be sent from a shard to the coordinating process.  Distances are
+  // encoded exactly.
+  static void EncodePartialResult(const PartialResult& result,
+                                  Encoder* encoder);
+
+  // Decodes a PartialResult encoded by EncodePartialResult().  Returns false
+  // if the encoded data is invalid.
+  static bool DecodePartialResult(Decoder* decoder, PartialResult* result);
+
   // Returns the endpoints of the given result edge.
   // REQUIRES: !result.is_interior()
   S2Shape::Edge GetEdge(const Result& result) const;
@@ -407,14 +506,34 @@ inline void S2ClosestEdgeQuery::FindClosestEdges(Target* target,
   base_.FindClosestEdges(target, options_, results);
 }
 
+inline bool S2ClosestEdgeQuery::VisitClosestEdges(
+    Target* target, const ResultVisitor& visitor) {
+  return base_.VisitClosestEdges(target, options_, visitor);
+}
+
 inline S2ClosestEdgeQuery::Result S2ClosestEdgeQuery::FindClosestEdge(
     Target* target) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 64, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   return base_.FindClosestEdge(target, tmp_options);
 }
 
+inline void S2ClosestEdgeQuery::FindPartialResult(Target* target,
+                                                  PartialResult* result) {
+  base_.FindPartialResult(target, options_, result);
+}
+
+inline S2ClosestEdgeQuery::PartialResult S2ClosestEdgeQuery::MergeResults(
+    absl::Span<const PartialResult> partial_results, const Options& options) {
+  return Base::MergeResults(partial_results, options);
+}
+
+inline S1ChordAngle S2ClosestEdgeQuery::GetDistanceLimit(
+    const PartialResult& merged, const Options& options) {
+  return Base::GetDistanceLimit(merged, options);
+}
+
 inline S1ChordAngle S2ClosestEdgeQuery::GetDistance(Target* target) {
   return FindClosestEdge(target).distance();
 }
@@ -18,12 +18,21 @@
 #ifndef S2_S2CLOSEST_EDGE_QUERY_BASE_H_
 #define S2_S2CLOSEST_EDGE_QUERY_BASE_H_
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <utility>
 #include <vector>
 
+#include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
 #include "absl/container/btree_set.h"
 #include "absl/container/inlined_vector.h"
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
 #include "s2/_fp_contract_off.h"
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
@@ -32,9 +41,12 @@
 #include "s2/s2cell_id.h"
 #include "s2/s2cell_union.h"
 #include "s2/s2distance_target.h"
+#include "s2/s2executor.h"
+#include "s2/s2memory_tracker.h"
 #include "s2/s2region_coverer.h"
 #include "s2/s2shape_index.h"
 #include "s2/s2shapeutil_count_edges.h"
+#include "s2/s2shapeutil_get_edges.h"
 #include "s2/s2shapeutil_shape_edge_id.h"
 #include "s2/util/gtl/dense_hash_set.h"
 
@@ -143,12 +155,143 @@ class S2ClosestEdgeQueryBase {
     bool use_brute_force() const;
     void set_use_brute_force(bool use_brute_force);
 
+    // Specifies that the edges of index cells built with
+    // MutableS2ShapeIndex::Options::cache_float_edges() should be read from
+    // their single-precision copies, halving the memory traffic of the
+    // innermost query loop.  The distances of the returned edges are then
+    // only approximate, and edges whose true distances differ by less than
+    // the error bound may be ranked in the wrong order.  This is intended
+    // for ranking workloads that can tolerate such errors (for example, by
+    // re-ranking the returned edges exactly).
+    //
+    // The error bound depends on the target and is documented by each target
+    // that supports this option (e.g. S2MinDistancePointTarget::
+    // kFloatEdgeMaxError).  Other targets, cells without float edges, and the
+    // brute force algorithm compute exact distances as usual.
+    //
+    // DEFAULT: false
+    bool use_float_edges() const;
+    void set_use_float_edges(bool use_float_edges);
+
+    // Specifies the maximum number of threads used to process a single query.
+    // This is useful for queries that return many edges, such as finding all
+    // edges within a large max_distance().  The cells of the initial index
+    // covering are divided among the threads, each of which searches its own
+    // portion of the index, and the results are then merged.
+    //
+    // This option currently only has an effect when max_results() is
+    // kMaxMaxResults (since only then are the threads independent), and when
+    // the target does not take advantage of max_error().
+    //
+    // REQUIRES: num_threads >= 1
+    // REQUIRES: If num_threads > 1, the Target distance methods must be safe
+    //           to call concurrently.  This is true of the point, edge, and
+    //           cell targets but not of S2ShapeIndex targets.
+    // DEFAULT: 1
+    int num_threads() const;
+    void set_num_threads(int num_threads);
+
+    // If non-null, the threads used to process a single query (see
+    // num_threads) are taken from this executor rather than newly created,
+    // and num_threads() is replaced by executor->num_threads().  The
+    // executor must outlive the query.
+    //
+    // DEFAULT: nullptr
+    S2Executor* executor() const;
+    void set_executor(S2Executor* executor);
+
+    // Specifies that the memory used by each query should be tracked and
+    // limited using the given S2MemoryTracker.  This includes the result set
+    // (which can be very large if max_results() is large and max_distance()
+    // is not small) and the priority queue of cells to be processed.  If the
+    // limit is exceeded then the query stops early, and the results found so
+    // far are returned even though they may be incomplete.  Clients should
+    // therefore check tracker->ok() after each query.
+    //
+    // Memory is only tallied while a query is running.  Queries use just one
+    // thread when a memory tracker is specified (see num_threads), since
+    // S2MemoryTracker is not thread-safe.
+    //
+    // DEFAULT: nullptr (memory tracking disabled)
+    S2MemoryTracker* memory_tracker() const;
+    void set_memory_tracker(S2MemoryTracker* tracker);
+
+    // Specifies a budget for the work done by each query, expressed as the
+    // number of S2Cells visited (see Stats::num_cells_visited) and/or as a
+    // time limit.  If either limit is reached then the query stops early and
+    // returns the best results found so far, and budget_exceeded() returns
+    // true.  The cell limit is deterministic, so it is the better choice when
+    // results need to be reproducible; the time limit is checked once per
+    // priority queue entry.
+    //
+    // The budget only applies to the optimized algorithm; the brute force
+    // algorithm is only chosen automatically for small indexes.  When a
+    // budget is specified, queries use just one thread (see num_threads).
+    //
+    // DEFAULT: kMaxMaxCellsVisited / Infinity (no limit)
+    int64 max_cells_visited() const;
+    void set_max_cells_visited(int64 max_cells_visited);
+    static constexpr int64 kMaxMaxCellsVisited =
+        std::numeric_limits<int64>::max();
+
+    double max_query_seconds() const;
+    void set_max_query_seconds(double max_query_seconds);
+
+    // Returns true if max_cells_visited() or max_query_seconds() is set.
+    bool has_budget() const;
+
    private:
     Distance max_distance_ = Distance::Infinity();
     Delta max_error_ = Delta::Zero();
     int max_results_ = kMaxMaxResults;
+    int num_threads_ = 1;
+    int64 max_cells_visited_ = kMaxMaxCellsVisited;
+    double max_query_seconds_ = std::numeric_limits<double>::infinity();
+    S2MemoryTracker* memory_tracker_ = nullptr;
+    S2Executor* executor_ = nullptr;
     bool include_interiors_ = true;
     bool use_brute_force_ = false;
+    bool use_float_edges_ = false;
+  };
+
+  // Statistics about the work done by queries.  These can be used to tune
+  // the query options (e.g., max_error()) and the index options (e.g.,
+  // MutableS2ShapeIndex::Options::max_edges_per_cell()) for a given dataset.
+  // The statistics are summed over all queries made while the Stats object
+  // is attached to the query (see set_stats).
+  struct Stats {
+    // The number of queries, and the number of those that used the brute
+    // force algorithm (because the index was small or use_brute_force() was
+    // specified).
+    int64 num_queries = 0;
+    int64 num_brute_force_queries = 0;
+
+    // The number of S2Cells whose distance to the target was computed in
+    // order to decide whether to add them to the priority queue.
+    int64 num_cells_visited = 0;
+
+    // The number of S2ShapeIndexCells whose edges were processed.
+    int64 num_index_cells_processed = 0;
+
+    // The number of edges whose distance to the target was computed.
+    int64 num_edges_evaluated = 0;
+
+    // The maximum size of the priority queue during any query.
+    int64 max_queue_size = 0;
+
+    // The time spent computing the covering of the index, which is done by
+    // the first optimized query after each call to Init() or ReInit().
+    double init_covering_seconds = 0;
+
+    void Add(const Stats& other) {
+      num_queries += other.num_queries;
+      num_brute_force_queries += other.num_brute_force_queries;
+      num_cells_visited += other.num_cells_visited;
+      num_index_cells_processed += other.num_index_cells_processed;
+      num_edges_evaluated += other.num_edges_evaluated;
+      max_queue_size = std::max(max_queue_size, other.max_queue_size);
+      init_covering_seconds += other.init_covering_seconds;
+    }
   };
 
   // The Target class represents the geometry to which the distance is
@@ -247,6 +390,15 @@ class S2ClosestEdgeQueryBase {
   // Returns a reference to the underlying S2ShapeIndex.
   const S2ShapeIndex& index() const;
 
+  // Specifies an object that the statistics of each subsequent query should
+  // be added to, or nullptr to stop collecting statistics.  The object must
+  // persist until it is detached (or the query is destroyed), and it may be
+  // shared by several queries only if they are not used concurrently.
+  //
+  // DEFAULT: nullptr
+  Stats* stats() const { return stats_; }
+  void set_stats(Stats* stats) { stats_ = stats; }
+
   // Returns the closest edges to the given target that satisfy the given
   // options.  This method may be called multiple times.
   //
@@ -260,6 +412,23 @@ class S2ClosestEdgeQueryBase {
   void FindClosestEdges(Target* target, const Options& options,
                         std::vector<Result>* results);
 
+  // A function that is called with each result of VisitClosestEdges().  The
+  // function may return false in order to indicate that no further results
+  // are needed.
+  using ResultVisitor = std::function<bool (const Result& result)>;
+
+  // Calls "visitor" with each of the closest edges to the given target, in
+  // the same order as FindClosestEdges() would return them, and returns false
+  // if the visitor returned false.  Unlike FindClosestEdges(), the results
+  // are not copied into a vector, and no memory is allocated for them when
+  // options.max_results() <= kMaxSmallResults.
+  bool VisitClosestEdges(Target* target, const Options& options,
+                         const ResultVisitor& visitor);
+
+  // Results are kept in a fixed-capacity container (rather than a btree_set)
+  // when options.max_results() is at most this value.
+  static constexpr int kMaxSmallResults = 8;
+
   // Convenience method that returns exactly one edge.  If no edges satisfy
   // the given search criteria, then a Result with distance == Infinity() and
   // shape_id == edge_id == -1 is returned.
@@ -271,27 +440,111 @@ class S2ClosestEdgeQueryBase {
   // REQUIRES: options.max_results() == 1
   Result FindClosestEdge(Target* target, const Options& options);
 
+  // Returns true if the most recent query stopped early because it exceeded
+  // the budget given by options().max_cells_visited() or
+  // options().max_query_seconds().  The results of such a query are the best
+  // found so far: every edge closer than unsearched_distance() was examined,
+  // but more distant edges may be missing from the results.  For example, if
+  // FindClosestEdge() returns an edge at distance D, the true minimum
+  // distance is at least min(D, unsearched_distance()).
+  bool budget_exceeded() const { return budget_exceeded_; }
+
+  // Returns a lower bound on the distance to any edge that the most recent
+  // query did not examine, or Distance::Infinity() if the query was not
+  // stopped early.
+  Distance unsearched_distance() const { return unsearched_distance_; }
+
+  // The following methods support queries over geometry that has been
+  // partitioned among several indexes (e.g., the shards of an
+  // S2ShapeIndexShardMap), possibly on different machines.  Each shard runs
+  // the query with the same options and returns a PartialResult, and these
+  // are then combined using MergeResults().  The shape ids in each partial
+  // result must first be translated to a common numbering (e.g., using
+  // S2ShapeIndexShardMap::shard_shape_ids()).
+  //
+  // The work done by later shards can be reduced by querying the shards in
+  // sequence (or in waves) and using GetDistanceLimit() of the results
+  // merged so far as their max_distance().
+  struct PartialResult {
+    // The closest edges in one shard, sorted as by FindClosestEdges().
+    std::vector<Result> results;
+
+    // A lower bound on the distance to any edge that the query did not
+    // examine (see unsearched_distance()).  This is Infinity() unless the
+    // query exceeded its budget.
+    Distance unsearched_distance = Distance::Infinity();
+  };
+
+  // Like FindClosestEdges(), but also records unsearched_distance().
+  void FindPartialResult(Target* target, const Options& options,
+                         PartialResult* result);
+
+  // Merges the results of running a query with the given options over
+  // several shards, returning the results that the same query over the
+  // union of the shards would have returned.  Edges that belong to more than
+  // one shard are reported only once.  The unsearched distance of the merged
+  // result is the minimum over all the partial results, so merged results
+  // may themselves be merged further.
+  static PartialResult MergeResults(
+      absl::Span<const PartialResult> partial_results, const Options& options);
+
+  // Returns a max_distance() that can be used when querying the remaining
+  // shards, given the results merged so far: edges at or beyond this
+  // distance cannot affect the final merged result.  (The only exception is
+  // that edges exactly as distant as the last merged result are excluded,
+  // so a different subset of tied edges may be returned.)
+  static Distance GetDistanceLimit(const PartialResult& merged,
+                                   const Options& options);
+
  private:
   struct QueueEntry;
 
   const Options& options() const { return *options_; }
   void FindClosestEdgesInternal(Target* target, const Options& options);
+  template <class Visitor>
+  bool VisitAndClearResults(const Visitor& visitor);
   void FindClosestEdgesBruteForce();
   void FindClosestEdgesOptimized();
+  void ProcessQueue();
+  void ProcessQueueInParallel();
   void InitQueue();
   void InitCovering();
   void AddInitialRange(const S2ShapeIndex::Iterator& first,
                        const S2ShapeIndex::Iterator& last);
   void MaybeAddResult(const S2Shape& shape, int edge_id);
+  void MaybeAddResult(const S2Shape& shape, int edge_id,
+                      const S2Shape::Edge& edge);
   void AddResult(const Result& result);
   void ProcessEdges(const QueueEntry& entry);
   void ProcessOrEnqueue(S2CellId id);
   void ProcessOrEnqueue(S2CellId id, const S2ShapeIndexCell* index_cell);
+  bool BudgetExceeded() const;
 
   const S2ShapeIndex* index_;
   const Options* options_;
   Target* target_;
 
+  // The statistics of the current query, which are added to *stats_ (if
+  // non-null) when the query finishes.
+  Stats* stats_ = nullptr;
+  Stats query_stats_;
+
+  // The results of BudgetExceeded() for the current query (see
+  // budget_exceeded() and unsearched_distance()).  "deadline_" is only
+  // meaningful when options().max_query_seconds() is finite.
+  std::chrono::steady_clock::time_point deadline_;
+  bool budget_exceeded_ = false;
+  Distance unsearched_distance_ = Distance::Infinity();
+
+  // True if the edges of each index cell should be passed through
+  // Target::FilterEdges() before their distances are computed.
+  bool use_edge_filter_;
+
+  // True if the distances to the edges of index cells that have a
+  // single-precision copy of their edges should be computed from that copy
+  // using Target::GetFloatEdgeDistances().
+  bool use_float_edges_;
+
   // True if max_error() must be subtracted from priority queue cell distances
   // in order to ensure that such distances are measured conservatively.  This
   // is true only if the target takes advantage of max_error() in order to
@@ -333,6 +586,9 @@ class S2ClosestEdgeQueryBase {
   //  - If max_results() == "infinity", results are appended to result_vector_
   //    and sorted/uniqued at the end.
   //
+  //  - If max_results() <= kMaxSmallResults, results are kept in sorted
+  //    order in result_small_, which never allocates.
+  //
   //  - Otherwise results are kept in a btree_set so that we can progressively
   //    reduce the distance limit once max_results() results have been found.
   //    (A priority queue is not sufficient because we need to be able to
@@ -342,6 +598,7 @@ class S2ClosestEdgeQueryBase {
   // when result_set_ is used so that we could use a priority queue instead.
   Result result_singleton_;
   std::vector<Result> result_vector_;
+  absl::InlinedVector<Result, kMaxSmallResults + 1> result_small_;
   absl::btree_set<Result> result_set_;
 
   // When the result edges are stored in a btree_set (see above), usually
@@ -391,13 +648,30 @@ class S2ClosestEdgeQueryBase {
       return other.distance < distance;
     }
   };
-  using CellQueue =
-      std::priority_queue<QueueEntry, absl::InlinedVector<QueueEntry, 16>>;
+  // A priority queue that can be cleared without releasing its storage, so
+  // that heap allocations are reused across queries.
+  class CellQueue : public std::priority_queue<
+      QueueEntry, absl::InlinedVector<QueueEntry, 16>> {
+   public:
+    void clear() { this->c.erase(this->c.begin(), this->c.end()); }
+  };
   CellQueue queue_;
 
+  // Tracks the memory used by the current query (see memory_tracker() above).
+  // If the memory limit is exceeded, the query is stopped by setting
+  // distance_limit_ to zero.
+  S2MemoryTracker::Client mem_tracker_;
+
+  // The number of queue entries whose memory has been tallied so far by the
+  // current query.
+  std::size_t tallied_queue_size_ = 0;
+
   // Temporaries, defined here to avoid multiple allocations / initializations.
 
   S2ShapeIndex::Iterator iter_;
+  std::vector<S2Shape::Edge> edges_;
+  absl::InlinedVector<bool, 16> keep_edges_;
+  std::vector<Distance> float_edge_distances_;
   std::vector<S2CellId> max_distance_covering_;
   std::vector<S2CellId> initial_cells_;
 };
@@ -469,6 +743,84 @@ inline void S2ClosestEdgeQueryBase<Distance>::Options::set_use_brute_force(
   use_brute_force_ = use_brute_force;
 }
 
+template <class Distance>
+inline bool S2ClosestEdgeQueryBase<Distance>::Options::use_float_edges() const {
+  return use_float_edges_;
+}
+
+template <class Distance>
+inline void S2ClosestEdgeQueryBase<Distance>::Options::set_use_float_edges(
+    bool use_float_edges) {
+  use_float_edges_ = use_float_edges;
+}
+
+template <class Distance>
+inline int S2ClosestEdgeQueryBase<Distance>::Options::num_threads() const {
+  return num_threads_;
+}
+
+template <class Distance>
+inline void S2ClosestEdgeQueryBase<Distance>::Options::set_num_threads(
+    int num_threads) {
+  S2_DCHECK_GE(num_threads, 1);
+  num_threads_ = num_threads;
+}
+
+template <class Distance>
+inline S2Executor* S2ClosestEdgeQueryBase<Distance>::Options::executor() const {
+  return executor_;
+}
+
+template <class Distance>
+inline void S2ClosestEdgeQueryBase<Distance>::Options::set_executor(
+    S2Executor* executor) {
+  executor_ = executor;
+}
+
+template <class Distance>
+inline S2MemoryTracker*
+S2ClosestEdgeQueryBase<Distance>::Options::memory_tracker() const {
+  return memory_tracker_;
+}
+
+template <class Distance>
+inline void S2ClosestEdgeQueryBase<Distance>::Options::set_memory_tracker(
+    S2MemoryTracker* tracker) {
+  memory_tracker_ = tracker;
+}
+
+template <class Distance>
+inline int64
+S2ClosestEdgeQueryBase<Distance>::Options::max_cells_visited() const {
+  return max_cells_visited_;
+}
+
+template <class Distance>
+inline void S2ClosestEdgeQueryBase<Distance>::Options::set_max_cells_visited(
+    int64 max_cells_visited) {
+  S2_DCHECK_GE(max_cells_visited, 0);
+  max_cells_visited_ = max_cells_visited;
+}
+
+template <class Distance>
+inline double
+S2ClosestEdgeQueryBase<Distance>::Options::max_query_seconds() const {
+  return max_query_seconds_;
+}
+
+template <class Distance>
+inline void S2ClosestEdgeQueryBase<Distance>::Options::set_max_query_seconds(
+    double max_query_seconds) {
+  S2_DCHECK_GE(max_query_seconds, 0);
+  max_query_seconds_ = max_query_seconds;
+}
+
+template <class Distance>
+inline bool S2ClosestEdgeQueryBase<Distance>::Options::has_budget() const {
+  return (max_cells_visited_ != kMaxMaxCellsVisited ||
+          max_query_seconds_ != std::numeric_limits<double>::infinity());
+}
+
 template <class Distance>
 S2ClosestEdgeQueryBase<Distance>::S2ClosestEdgeQueryBase()
     : tested_edges_(1) /* expected_max_elements*/ {
@@ -522,6 +874,8 @@ S2ClosestEdgeQueryBase<Distance>::FindClosestEdge(Target* target,
                                                   const Options& options) {
   S2_DCHECK_EQ(options.max_results(), 1);
   FindClosestEdgesInternal(target, options);
+  if (stats_ != nullptr) stats_->Add(query_stats_);
+  mem_tracker_.Tally(-mem_tracker_.client_usage_bytes());
   return result_singleton_;
 }
 
@@ -530,20 +884,97 @@ void S2ClosestEdgeQueryBase<Distance>::FindClosestEdges(
     Target* target, const Options& options,
     std::vector<Result>* results) {
   FindClosestEdgesInternal(target, options);
+  if (stats_ != nullptr) stats_->Add(query_stats_);
   results->clear();
-  if (options.max_results() == 1) {
+  VisitAndClearResults([results](const Result& result) {
+      results->push_back(result);
+      return true;
+    });
+}
+
+template <class Distance>
+void S2ClosestEdgeQueryBase<Distance>::FindPartialResult(
+    Target* target, const Options& options, PartialResult* result) {
+  FindClosestEdges(target, options, &result->results);
+  result->unsearched_distance = unsearched_distance_;
+}
+
+template <class Distance>
+typename S2ClosestEdgeQueryBase<Distance>::PartialResult
+S2ClosestEdgeQueryBase<Distance>::MergeResults(
+    absl::Span<const PartialResult> partial_results, const Options& options) {
+  PartialResult merged;
+  for (const PartialResult& partial : partial_results) {
+    merged.results.insert(merged.results.end(), partial.results.begin(),
+                          partial.results.end());
+    merged.unsearched_distance =
+        std::min(merged.unsearched_distance, partial.unsearched_distance);
+  }
+  // An edge that belongs to several shards has the same distance in each of
+  // them, so after sorting any duplicates are adjacent.
+  auto& results = merged.results;
+  std::sort(results.begin(), results.end());
+  results.erase(std::unique(results.begin(), results.end()), results.end());
+  while (!results.empty() &&
+         !(results.back().distance() < options.max_distance())) {
+    results.pop_back();
+  }
+  if (results.size() > static_cast<size_t>(options.max_results())) {
+    results.resize(options.max_results());
+  }
+  return merged;
+}
+
+template <class Distance>
+Distance S2ClosestEdgeQueryBase<Distance>::GetDistanceLimit(
+    const PartialResult& merged, const Options& options) {
+  int k = options.max_results();
+  if (merged.results.size() < static_cast<size_t>(k)) {
+    return options.max_distance();
+  }
+  return std::min(options.max_distance(), merged.results[k - 1].distance());
+}
+
+template <class Distance>
+bool S2ClosestEdgeQueryBase<Distance>::VisitClosestEdges(
+    Target* target, const Options& options, const ResultVisitor& visitor) {
+  FindClosestEdgesInternal(target, options);
+  if (stats_ != nullptr) stats_->Add(query_stats_);
+  return VisitAndClearResults(visitor);
+}
+
+// Calls "visitor" with each result of the current query in sorted order
+// (stopping early if it returns false), and then clears the result set.
+template <class Distance>
+template <class Visitor>
+bool S2ClosestEdgeQueryBase<Distance>::VisitAndClearResults(
+    const Visitor& visitor) {
+  bool keep_going = true;
+  if (options().max_results() == 1) {
     if (result_singleton_.shape_id() >= 0) {
-      results->push_back(result_singleton_);
+      keep_going = visitor(result_singleton_);
     }
-  } else if (options.max_results() == Options::kMaxMaxResults) {
+  } else if (options().max_results() == Options::kMaxMaxResults) {
     std::sort(result_vector_.begin(), result_vector_.end());
-    std::unique_copy(result_vector_.begin(), result_vector_.end(),
-                     std::back_inserter(*results));
+    for (int i = 0; i < result_vector_.size() && keep_going; ++i) {
+      if (i > 0 && result_vector_[i] == result_vector_[i - 1]) continue;
+      keep_going = visitor(result_vector_[i]);
+    }
     result_vector_.clear();
+  } else if (options().max_results() <= kMaxSmallResults) {
+    for (int i = 0; i < result_small_.size() && keep_going; ++i) {
+      keep_going = visitor(result_small_[i]);
+    }
+    result_small_.clear();
   } else {
-    results->assign(result_set_.begin(), result_set_.end());
+    for (auto it = result_set_.begin(); it != result_set_.end() && keep_going;
+         ++it) {
+      keep_going = visitor(*it);
+    }
     result_set_.clear();
   }
+  mem_tracker_.Tally(-mem_tracker_.client_usage_bytes());
+  return keep_going;
 }
 
 template <class Distance>
@@ -551,11 +982,27 @@ void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesInternal(
     Target* target, const Options& options) {
   target_ = target;
   options_ = &options;
+  use_edge_filter_ = target->can_filter_edges();
+  use_float_edges_ = options.use_float_edges() &&
+                     target->can_use_float_edges();
+  query_stats_ = Stats();
+  query_stats_.num_queries = 1;
+  mem_tracker_.Init(options.memory_tracker());
+  mem_tracker_.Tally(result_vector_);  // Capacity kept from earlier queries.
+  tallied_queue_size_ = 0;
+  budget_exceeded_ = false;
+  unsearched_distance_ = Distance::Infinity();
+  if (options.max_query_seconds() != std::numeric_limits<double>::infinity()) {
+    deadline_ = std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(options.max_query_seconds()));
+  }
 
   tested_edges_.clear();
   distance_limit_ = options.max_distance();
   result_singleton_ = Result();
   S2_DCHECK(result_vector_.empty());
+  S2_DCHECK(result_small_.empty());
   S2_DCHECK(result_set_.empty());
   S2_DCHECK_GE(target->max_brute_force_index_size(), 0);
   if (distance_limit_ == Distance::Zero()) return;
@@ -566,13 +1013,30 @@ void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesInternal(
   }
 
   if (options.include_interiors()) {
-    absl::btree_set<int32> shape_ids;
-    (void) target->VisitContainingShapes(
-        *index_, [&shape_ids, &options](S2Shape* containing_shape,
-                                        const S2Point& /*target_point*/) {
-          shape_ids.insert(containing_shape->id());
-          return shape_ids.size() < options.max_results();
-        });
+    // The shape ids are kept in sorted order without duplicates.  When
+    // max_results() is small they are kept in a sorted array, which does not
+    // allocate; otherwise a btree_set is used so that each insertion takes
+    // logarithmic time.
+    absl::InlinedVector<int32, kMaxSmallResults> shape_ids;
+    if (options.max_results() <= kMaxSmallResults) {
+      (void) target->VisitContainingShapes(
+          *index_, [&shape_ids, &options](S2Shape* containing_shape,
+                                          const S2Point& /*target_point*/) {
+            int32 id = containing_shape->id();
+            auto it = std::lower_bound(shape_ids.begin(), shape_ids.end(), id);
+            if (it == shape_ids.end() || *it != id) shape_ids.insert(it, id);
+            return shape_ids.size() < options.max_results();
+          });
+    } else {
+      absl::btree_set<int32> shape_id_set;
+      (void) target->VisitContainingShapes(
+          *index_, [&shape_id_set, &options](S2Shape* containing_shape,
+                                             const S2Point& /*target_point*/) {
+            shape_id_set.insert(containing_shape->id());
+            return shape_id_set.size() < options.max_results();
+          });
+      shape_ids.assign(shape_id_set.begin(), shape_id_set.end());
+    }
     for (int shape_id : shape_ids) {
       AddResult(Result(Distance::Zero(), shape_id, -1));
     }
@@ -624,6 +1088,7 @@ void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesInternal(
   if (options.use_brute_force() || index_num_edges_ < min_optimized_edges) {
     // The brute force algorithm considers each edge exactly once.
     avoid_duplicates_ = false;
+    query_stats_.num_brute_force_queries = 1;
     FindClosestEdgesBruteForce();
   } else {
     // If the target takes advantage of max_error() then we need to avoid
@@ -635,11 +1100,21 @@ void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesInternal(
 
 template <class Distance>
 void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesBruteForce() {
+  // The vertices of each chain are read directly from the shape when
+  // possible (see S2Shape::GetChainVertices).
+  std::vector<S2Point> tmp;
   for (S2Shape* shape : *index_) {
     if (shape == nullptr) continue;
-    int num_edges = shape->num_edges();
-    for (int e = 0; e < num_edges; ++e) {
-      MaybeAddResult(*shape, e);
+    int num_chains = shape->num_chains();
+    for (int chain_id = 0; chain_id < num_chains; ++chain_id) {
+      S2Shape::Chain chain = shape->chain(chain_id);
+      S2PointSpan vertices = shape->GetChainVertices(chain_id, &tmp);
+      int n = static_cast<int>(vertices.size());
+      for (int j = 0; j < chain.length; ++j) {
+        int k = (j + 1 == n) ? 0 : j + 1;
+        MaybeAddResult(*shape, chain.start + j,
+                       S2Shape::Edge(vertices[j], vertices[k]));
+      }
     }
   }
 }
@@ -647,8 +1122,23 @@ void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesBruteForce() {
 template <class Distance>
 void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesOptimized() {
   InitQueue();
+  if (S2NumThreads(options().executor(), options().num_threads()) > 1 &&
+      !mem_tracker_.is_active() &&
+      !options().has_budget() &&
+      options().max_results() == Options::kMaxMaxResults &&
+      !avoid_duplicates_ && queue_.size() > 1) {
+    ProcessQueueInParallel();
+  } else {
+    ProcessQueue();
+  }
+}
+
+template <class Distance>
+void S2ClosestEdgeQueryBase<Distance>::ProcessQueue() {
   // Repeatedly find the closest S2Cell to "target" and either split it into
-  // its four children or process all of its edges.
+  // its four children or process all of its edges.  Prefetching is a virtual
+  // call, so it is only done for iterators that support it.
+  const bool prefetch = iter_.can_prefetch();
   while (!queue_.empty()) {
     // We need to copy the top entry before removing it, and we need to
     // remove it before adding any new entries to the queue.
@@ -658,7 +1148,15 @@ void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesOptimized() {
     // entry.distance.
     Distance distance = entry.distance;
     if (!(distance < distance_limit_)) {
-      queue_ = CellQueue();  // Clear any remaining entries.
+      queue_.clear();  // Clear any remaining entries.
+      break;
+    }
+    // Since entries are processed in order of increasing distance, every
+    // unexamined edge is at least as far away as this entry.
+    if (options().has_budget() && BudgetExceeded()) {
+      budget_exceeded_ = true;
+      unsearched_distance_ = distance;
+      queue_.clear();
       break;
     }
     // If this is already known to be an index cell, just process it.
@@ -670,7 +1168,10 @@ void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesOptimized() {
     // child back to the queue, we first check whether it is empty.  We do
     // this in two seek operations rather than four by seeking to the key
     // between children 0 and 1 and to the key between children 2 and 3.
+    // The second seek target is prefetched first (if supported) so that its
+    // memory latency overlaps with the first seek.
     S2CellId id = entry.id;
+    if (prefetch) iter_.Prefetch(id.child(3).range_min());
     iter_.Seek(id.child(1).range_min());
     if (!iter_.done() && iter_.id() <= id.child(1).range_max()) {
       ProcessOrEnqueue(id.child(1));
@@ -688,6 +1189,53 @@ void S2ClosestEdgeQueryBase<Distance>::FindClosestEdgesOptimized() {
   }
 }
 
+template <class Distance>
+bool S2ClosestEdgeQueryBase<Distance>::BudgetExceeded() const {
+  if (query_stats_.num_cells_visited >= options().max_cells_visited()) {
+    return true;
+  }
+  return (options().max_query_seconds() !=
+              std::numeric_limits<double>::infinity() &&
+          std::chrono::steady_clock::now() >= deadline_);
+}
+
+// Divides the entries of queue_ among several worker queries that process
+// them concurrently, and then merges their results.  Since max_results() is
+// kMaxMaxResults, distance_limit_ never changes and so the workers can run
+// independently.  Duplicate edges are removed by FindClosestEdges().
+template <class Distance>
+void S2ClosestEdgeQueryBase<Distance>::ProcessQueueInParallel() {
+  int num_workers = std::min<int>(
+      S2NumThreads(options().executor(), options().num_threads()),
+      queue_.size());
+  std::vector<std::unique_ptr<S2ClosestEdgeQueryBase>> workers;
+  for (int i = 0; i < num_workers; ++i) {
+    auto worker = absl::make_unique<S2ClosestEdgeQueryBase>(index_);
+    worker->options_ = options_;
+    worker->target_ = target_;
+    worker->use_edge_filter_ = use_edge_filter_;
+    worker->use_float_edges_ = use_float_edges_;
+    worker->distance_limit_ = distance_limit_;
+    worker->use_conservative_cell_distance_ = use_conservative_cell_distance_;
+    worker->avoid_duplicates_ = false;
+    worker->iter_.Init(index_, S2ShapeIndex::UNPOSITIONED);
+    workers.push_back(std::move(worker));
+  }
+  // Deal out the entries in priority order so that each worker receives a
+  // similar mix of near and far cells.
+  for (int i = 0; !queue_.empty(); ++i) {
+    workers[i % num_workers]->queue_.push(queue_.top());
+    queue_.pop();
+  }
+  S2ParallelFor(options().executor(), num_workers,
+                [&workers](int i) { workers[i]->ProcessQueue(); });
+  for (const auto& worker : workers) {
+    result_vector_.insert(result_vector_.end(), worker->result_vector_.begin(),
+                          worker->result_vector_.end());
+    query_stats_.Add(worker->query_stats_);
+  }
+}
+
 template <class Distance>
 void S2ClosestEdgeQueryBase<Distance>::InitQueue() {
   S2_DCHECK(queue_.empty());
@@ -715,7 +1263,16 @@ void S2ClosestEdgeQueryBase<Distance>::InitQueue() {
     // Skip the rest of the algorithm if we found an intersecting edge.
     if (distance_limit_ == Distance::Zero()) return;
   }
-  if (index_covering_.empty()) InitCovering();
+  if (index_covering_.empty()) {
+    if (stats_ == nullptr) {
+      InitCovering();
+    } else {
+      auto start = std::chrono::steady_clock::now();
+      InitCovering();
+      query_stats_.init_covering_seconds += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+    }
+  }
   if (distance_limit_ == Distance::Infinity()) {
     // Start with the precomputed index covering.
     for (int i = 0; i < index_covering_.size(); ++i) {
@@ -845,6 +1402,7 @@ void S2ClosestEdgeQueryBase<Distance>::MaybeAddResult(
       !tested_edges_.insert(ShapeEdgeId(shape.id(), edge_id)).second) {
     return;
   }
+  ++query_stats_.num_edges_evaluated;
   auto edge = shape.edge(edge_id);
   Distance distance = distance_limit_;
   if (target_->UpdateMinDistance(edge.v0, edge.v1, &distance)) {
@@ -852,6 +1410,21 @@ void S2ClosestEdgeQueryBase<Distance>::MaybeAddResult(
   }
 }
 
+// As above, but for an edge that has already been retrieved from "shape".
+template <class Distance>
+void S2ClosestEdgeQueryBase<Distance>::MaybeAddResult(
+    const S2Shape& shape, int edge_id, const S2Shape::Edge& edge) {
+  if (avoid_duplicates_ &&
+      !tested_edges_.insert(ShapeEdgeId(shape.id(), edge_id)).second) {
+    return;
+  }
+  ++query_stats_.num_edges_evaluated;
+  Distance distance = distance_limit_;
+  if (target_->UpdateMinDistance(edge.v0, edge.v1, &distance)) {
+    AddResult(Result(distance, shape.id(), edge_id));
+  }
+}
+
 template <class Distance>
 void S2ClosestEdgeQueryBase<Distance>::AddResult(const Result& result) {
   if (options().max_results() == 1) {
@@ -859,20 +1432,40 @@ void S2ClosestEdgeQueryBase<Distance>::AddResult(const Result& result) {
     result_singleton_ = result;
     distance_limit_ = result.distance() - options().max_error();
   } else if (options().max_results() == Options::kMaxMaxResults) {
+    if (!mem_tracker_.AddSpace(&result_vector_, 1)) {
+      distance_limit_ = Distance::Zero();  // Memory limit exceeded.
+      return;
+    }
     result_vector_.push_back(result);  // Sort/unique at end.
+  } else if (options().max_results() <= kMaxSmallResults) {
+    // As below, except that the results are kept in a sorted array.
+    auto it = std::lower_bound(result_small_.begin(), result_small_.end(),
+                               result);
+    if (it != result_small_.end() && *it == result) return;
+    result_small_.insert(it, result);
+    int size = result_small_.size();
+    if (size >= options().max_results()) {
+      if (size > options().max_results()) result_small_.pop_back();
+      distance_limit_ = result_small_.back().distance() -
+                        options().max_error();
+    }
   } else {
     // Add this edge to result_set_.  Note that even if we already have enough
     // edges, we can't erase an element before insertion because the "new"
-    // edge might in fact be a duplicate.
-    result_set_.insert(result);
+    // edge might in fact be a duplicate.  (The memory tally ignores the
+    // btree node overhead.)
+    constexpr int64 kEntryBytes = sizeof(Result);
+    if (result_set_.insert(result).second) mem_tracker_.Tally(kEntryBytes);
     int size = result_set_.size();
     if (size >= options().max_results()) {
       if (size > options().max_results()) {
         result_set_.erase(--result_set_.end());
+        mem_tracker_.Tally(-kEntryBytes);
       }
       distance_limit_ = (--result_set_.end())->distance() -
                         options().max_error();
     }
+    if (!mem_tracker_.ok()) distance_limit_ = Distance::Zero();
   }
 }
 
@@ -888,12 +1481,74 @@ inline static int CountEdges(const S2ShapeIndexCell* cell) {
 // Process all the edges of the given index cell.
 template <class Distance>
 void S2ClosestEdgeQueryBase<Distance>::ProcessEdges(const QueueEntry& entry) {
+  // Gathering the edges for FilterEdges() only pays off for shapes with
+  // enough edges in this cell.
+  static constexpr int kMinEdgesToFilter = 8;
+  ++query_stats_.num_index_cells_processed;
   const S2ShapeIndexCell* index_cell = entry.index_cell;
-  for (int s = 0; s < index_cell->num_clipped(); ++s) {
+  // If the index keeps a copy of the cell's edges, we read them from there.
+  const S2Shape::Edge* cached_edges = index_->cached_edges(*index_cell);
+  const float* float_edges =
+      use_float_edges_ ? index_->cached_float_edges(*index_cell) : nullptr;
+  const int cell_num_edges =
+      float_edges != nullptr ? index_cell->num_edges() : 0;
+  for (int s = 0, offset = 0; s < index_cell->num_clipped(); ++s) {
     const S2ClippedShape& clipped = index_cell->clipped(s);
     const S2Shape* shape = index_->shape(clipped.shape_id());
-    for (int j = 0; j < clipped.num_edges(); ++j) {
-      MaybeAddResult(*shape, clipped.edge(j));
+    int num_edges = clipped.num_edges();
+    int edge_offset = offset;
+    offset += num_edges;
+    if (shape == nullptr) {
+      // The shape could not be read (e.g., see S2DeferredReadScope).
+      if (cached_edges != nullptr) cached_edges += num_edges;
+      continue;
+    }
+    if (float_edges != nullptr) {
+      // Approximate distances are computed for all the edges at once, which
+      // reads only the single-precision copies of their endpoints.
+      float_edge_distances_.resize(num_edges);
+      target_->GetFloatEdgeDistances(float_edges + edge_offset,
+                                     cell_num_edges, num_edges,
+                                     float_edge_distances_.data());
+      for (int j = 0; j < num_edges; ++j) {
+        int edge_id = clipped.edge(j);
+        if (avoid_duplicates_ &&
+            !tested_edges_.insert(ShapeEdgeId(shape->id(), edge_id)).second) {
+          continue;
+        }
+        ++query_stats_.num_edges_evaluated;
+        if (float_edge_distances_[j] < distance_limit_) {
+          AddResult(Result(float_edge_distances_[j], shape->id(), edge_id));
+        }
+      }
+      continue;
+    }
+    // Gather the edges of this shape.  Unless they are cached in the index
+    // cell, they are fetched using s2shapeutil::GetClippedEdges(), which
+    // avoids a virtual call per edge for the shape types in this library.
+    absl::Span<const S2Shape::Edge> edges;
+    if (cached_edges != nullptr) {
+      edges = absl::MakeConstSpan(cached_edges, num_edges);
+      cached_edges += num_edges;
+    } else {
+      edges_.resize(num_edges);
+      s2shapeutil::GetClippedEdges(*shape, clipped, 0, num_edges,
+                                   edges_.data());
+      edges = edges_;
+    }
+    if (!use_edge_filter_ || num_edges < kMinEdgesToFilter ||
+        distance_limit_ == Distance::Infinity()) {
+      for (int j = 0; j < num_edges; ++j) {
+        MaybeAddResult(*shape, clipped.edge(j), edges[j]);
+      }
+      continue;
+    }
+    // Let the target discard most of the edges using a cheap bound before
+    // the exact distances are computed.
+    keep_edges_.assign(num_edges, true);
+    target_->FilterEdges(edges, distance_limit_, keep_edges_.data());
+    for (int j = 0; j < num_edges; ++j) {
+      if (keep_edges_[j]) MaybeAddResult(*shape, clipped.edge(j), edges[j]);
     }
   }
 }
@@ -933,6 +1588,7 @@ void S2ClosestEdgeQueryBase<Distance>::ProcessOrEnqueue(
   }
   // Otherwise compute the minimum distance to any point in the cell and add
   // it to the priority queue.
+  ++query_stats_.num_cells_visited;
   S2Cell cell(id);
   Distance distance = distance_limit_;
   if (!target_->UpdateMinDistance(cell, &distance)) return;
@@ -941,6 +1597,14 @@ void S2ClosestEdgeQueryBase<Distance>::ProcessOrEnqueue(
     distance = distance - options().max_error();  // operator-=() not defined.
   }
   queue_.push(QueueEntry(distance, id, index_cell));
+  query_stats_.max_queue_size =
+      std::max<int64>(query_stats_.max_queue_size, queue_.size());
+  if (queue_.size() > tallied_queue_size_) {
+    tallied_queue_size_ = queue_.size();
+    if (!mem_tracker_.Tally(sizeof(QueueEntry))) {
+      distance_limit_ = Distance::Zero();  // Memory limit exceeded.
+    }
+  }
 }
 
 #endif  // S2_S2CLOSEST_EDGE_QUERY_BASE_H_
@@ -17,8 +17,11 @@
 
 #include "s2/s2closest_edge_query.h"
 
+#include <algorithm>
 #include <cmath>
 #include <memory>
+#include <set>
+#include <utility>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -34,7 +37,11 @@
 #include "s2/s2cell_id.h"
 #include "s2/s2closest_edge_query_testing.h"
 #include "s2/s2edge_distances.h"
+#include "s2/s2error.h"
+#include "s2/s2executor.h"
+#include "s2/s2lax_polyline_shape.h"
 #include "s2/s2loop.h"
+#include "s2/s2memory_tracker.h"
 #include "s2/s2metrics.h"
 #include "s2/s2point_vector_shape.h"
 #include "s2/s2polygon.h"
@@ -42,6 +49,9 @@
 #include "s2/s2shapeutil_coding.h"
 #include "s2/s2testing.h"
 #include "s2/s2text_format.h"
+#include "s2/s2wrapped_shape.h"
+#include "s2/thread_testing.h"
+#include "s2/util/coding/coder.h"
 
 using s2shapeutil::ShapeEdgeId;
 using s2textformat::MakeIndexOrDie;
@@ -167,6 +177,452 @@ TEST(S2ClosestEdgeQuery, TestReuseOfQuery) {
   EXPECT_EQ(results1.size(), results2.size());
 }
 
+TEST(S2ClosestEdgeQuery, MultipleThreads) {
+  // A query that returns all edges within a large radius must give the same
+  // results whether or not it is split across threads.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(10));
+  MutableS2ShapeIndex index;
+  s2testing::FractalLoopShapeIndexFactory().AddEdges(cap, 10000, &index);
+  S2ClosestEdgeQuery query(&index);
+  query.mutable_options()->set_max_distance(S1Angle::Degrees(5));
+  for (int iter = 0; iter < 10; ++iter) {
+    S2ClosestEdgeQuery::PointTarget target(S2Testing::SamplePoint(cap));
+    query.mutable_options()->set_num_threads(1);
+    auto expected = query.FindClosestEdges(&target);
+    query.mutable_options()->set_num_threads(4);
+    EXPECT_EQ(expected, query.FindClosestEdges(&target));
+  }
+
+  // The same threads may also be taken from an executor.
+  S2ThreadPool pool(4);
+  query.mutable_options()->set_num_threads(1);
+  query.mutable_options()->set_executor(&pool);
+  S2ClosestEdgeQuery::PointTarget target(cap.center());
+  auto results = query.FindClosestEdges(&target);
+  query.mutable_options()->set_executor(nullptr);
+  EXPECT_EQ(query.FindClosestEdges(&target), results);
+}
+
+// Runs multithreaded queries for point, edge, and cell targets in several
+// threads at once.  Each query calls the target's distance methods from
+// several threads, which Options::num_threads() requires to be safe.
+class ParallelQueryTest : public s2testing::ReaderWriterTest {
+ public:
+  ParallelQueryTest() {
+    S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+    S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(10));
+    s2testing::FractalLoopShapeIndexFactory().AddEdges(cap, 10000, &index_);
+    index_.ForceBuild();
+    a_ = S2Testing::SamplePoint(cap);
+    b_ = S2Testing::SamplePoint(cap);
+    cell_id_ = S2CellId(S2Testing::SamplePoint(cap)).parent(8);
+    S2ClosestEdgeQuery query(&index_);
+    query.mutable_options()->set_max_distance(S1Angle::Degrees(5));
+    S2ClosestEdgeQuery::PointTarget point_target(a_);
+    S2ClosestEdgeQuery::EdgeTarget edge_target(a_, b_);
+    S2ClosestEdgeQuery::CellTarget cell_target((S2Cell(cell_id_)));
+    expected_point_ = query.FindClosestEdges(&point_target);
+    expected_edge_ = query.FindClosestEdges(&edge_target);
+    expected_cell_ = query.FindClosestEdges(&cell_target);
+  }
+
+  void WriteOp() override {}
+
+  void ReadOp() override {
+    S2ClosestEdgeQuery query(&index_);
+    query.mutable_options()->set_max_distance(S1Angle::Degrees(5));
+    query.mutable_options()->set_num_threads(4);
+    S2ClosestEdgeQuery::PointTarget point_target(a_);
+    S2ClosestEdgeQuery::EdgeTarget edge_target(a_, b_);
+    S2ClosestEdgeQuery::CellTarget cell_target((S2Cell(cell_id_)));
+    EXPECT_EQ(expected_point_, query.FindClosestEdges(&point_target));
+    EXPECT_EQ(expected_edge_, query.FindClosestEdges(&edge_target));
+    EXPECT_EQ(expected_cell_, query.FindClosestEdges(&cell_target));
+  }
+
+ private:
+  MutableS2ShapeIndex index_;
+  S2Point a_, b_;
+  S2CellId cell_id_;
+  vector<S2ClosestEdgeQuery::Result> expected_point_, expected_edge_,
+      expected_cell_;
+};
+
+TEST(S2ClosestEdgeQuery, MultipleThreadsConcurrentTargets) {
+  ParallelQueryTest test;
+  test.Run(4, 10);
+}
+
+TEST(S2ClosestEdgeQuery, MemoryTracker) {
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(10));
+  MutableS2ShapeIndex index;
+  s2testing::FractalLoopShapeIndexFactory().AddEdges(cap, 10000, &index);
+  S2ClosestEdgeQuery::PointTarget target(cap.center());
+  S2ClosestEdgeQuery query(&index);
+  query.mutable_options()->set_max_distance(S1Angle::Degrees(20));
+  for (int max_results : {S2ClosestEdgeQuery::Options::kMaxMaxResults, 5000}) {
+    query.mutable_options()->set_max_results(max_results);
+    query.mutable_options()->set_memory_tracker(nullptr);
+    auto expected = query.FindClosestEdges(&target);
+
+    // Without a limit, tracking does not affect the results and all of the
+    // tracked memory is released afterwards.
+    S2MemoryTracker tracker;
+    query.mutable_options()->set_memory_tracker(&tracker);
+    query.mutable_options()->set_num_threads(4);
+    EXPECT_EQ(expected, query.FindClosestEdges(&target));
+    EXPECT_TRUE(tracker.ok());
+    EXPECT_EQ(0, tracker.usage_bytes());
+    EXPECT_GT(tracker.max_usage_bytes(),
+              expected.size() * sizeof(S2ClosestEdgeQuery::Result));
+
+    // With a small limit the query stops early.
+    tracker.Reset();
+    tracker.set_limit_bytes(10000);
+    auto results = query.FindClosestEdges(&target);
+    EXPECT_EQ(S2Error::RESOURCE_EXHAUSTED, tracker.error().code());
+    EXPECT_LT(results.size(), expected.size());
+    EXPECT_EQ(0, tracker.usage_bytes());
+    query.mutable_options()->set_num_threads(1);
+  }
+}
+
+TEST(S2ClosestEdgeQuery, CachedEdges) {
+  // Reading the edges from the index cells must not change the results.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(10));
+  MutableS2ShapeIndex index;
+  s2testing::FractalLoopShapeIndexFactory().AddEdges(cap, 1000, &index);
+  MutableS2ShapeIndex::Options options;
+  options.set_cache_edges(true);
+  MutableS2ShapeIndex cached_index(options);
+  for (const S2Shape* shape : index) {
+    cached_index.Add(make_unique<S2WrappedShape>(shape));
+  }
+  for (int iter = 0; iter < 20; ++iter) {
+    S2Point point = S2Testing::SamplePoint(cap);
+    S2ClosestEdgeQuery::PointTarget target(point);
+    S2ClosestEdgeQuery::EdgeTarget edge_target(
+        point, S2Testing::SamplePoint(cap));
+    for (int max_results :
+         {1, 10, S2ClosestEdgeQuery::Options::kMaxMaxResults}) {
+      S2ClosestEdgeQuery query(&index), cached_query(&cached_index);
+      query.mutable_options()->set_max_results(max_results);
+      query.mutable_options()->set_max_distance(S1Angle::Degrees(1));
+      *cached_query.mutable_options() = query.options();
+      EXPECT_EQ(query.FindClosestEdges(&target),
+                cached_query.FindClosestEdges(&target));
+      EXPECT_EQ(query.FindClosestEdges(&edge_target),
+                cached_query.FindClosestEdges(&edge_target));
+    }
+  }
+}
+
+TEST(S2ClosestEdgeQuery, FloatEdges) {
+  // Distances computed from single-precision edges must be within the
+  // documented error bound, and the approximate results must include every
+  // edge that is closer than the limit by more than the error bound.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  const double kMaxError = S2MinDistancePointTarget::kFloatEdgeMaxError;
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(10));
+  MutableS2ShapeIndex index;
+  s2testing::FractalLoopShapeIndexFactory().AddEdges(cap, 1000, &index);
+  MutableS2ShapeIndex::Options options;
+  options.set_cache_float_edges(true);
+  MutableS2ShapeIndex float_index(options);
+  for (const S2Shape* shape : index) {
+    float_index.Add(make_unique<S2WrappedShape>(shape));
+  }
+  const S1ChordAngle kMaxDistance(S1Angle::Degrees(1));
+  S2ClosestEdgeQuery::Stats stats;
+  for (int iter = 0; iter < 50; ++iter) {
+    S2Point point = S2Testing::SamplePoint(cap);
+    S2ClosestEdgeQuery::PointTarget target(point);
+    S2ClosestEdgeQuery query(&index), float_query(&float_index);
+    query.mutable_options()->set_max_distance(kMaxDistance);
+    float_query.mutable_options()->set_max_distance(kMaxDistance);
+    float_query.mutable_options()->set_use_float_edges(true);
+    float_query.set_stats(&stats);
+    std::set<std::pair<int, int>> found;
+    for (const auto& result : float_query.FindClosestEdges(&target)) {
+      if (result.is_interior()) continue;
+      found.insert({result.shape_id(), result.edge_id()});
+      S2Shape::Edge edge = float_query.GetEdge(result);
+      S1ChordAngle distance = S1ChordAngle::Infinity();
+      S2::UpdateMinDistance(point, edge.v0, edge.v1, &distance);
+      EXPECT_NEAR(sqrt(distance.length2()), sqrt(result.distance().length2()),
+                  kMaxError);
+    }
+    auto exact_results = query.FindClosestEdges(&target);
+    for (const auto& result : exact_results) {
+      if (result.is_interior()) continue;
+      if (sqrt(result.distance().length2()) <
+          sqrt(kMaxDistance.length2()) - kMaxError) {
+        EXPECT_EQ(found.count({result.shape_id(), result.edge_id()}), 1);
+      }
+    }
+
+    // Without float edges in the index, the option has no effect.
+    query.mutable_options()->set_use_float_edges(true);
+    EXPECT_EQ(exact_results, query.FindClosestEdges(&target));
+  }
+  EXPECT_GT(stats.num_edges_evaluated, 0);
+}
+
+TEST(S2ClosestEdgeQuery, FloatEdgeDistanceError) {
+  // Measures the error of GetFloatEdgeDistances() directly, including very
+  // short edges and points close to the edges.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  double max_error = 0;
+  for (int iter = 0; iter < 10000; ++iter) {
+    S2Point a = S2Testing::RandomPoint();
+    double len = 1e-9 * pow(1e9, S2Testing::rnd.RandDouble());
+    S2Point b = S2::GetPointOnLine(a, S2Testing::RandomPoint(),
+                                   S1Angle::Radians(len));
+    double dist = 1e-9 * pow(1e9, S2Testing::rnd.RandDouble());
+    S2Point x = S2::GetPointOnLine(
+        S2::Interpolate(a, b, S2Testing::rnd.RandDouble() * 1.4 - 0.2),
+        S2Testing::RandomPoint(), S1Angle::Radians(dist));
+    float coords[6];
+    for (int c = 0; c < 3; ++c) {
+      coords[c] = a[c];
+      coords[c + 3] = b[c];
+    }
+    S2MinDistancePointTarget target(x);
+    S2MinDistance approx;
+    target.GetFloatEdgeDistances(coords, 1, 1, &approx);
+    S1ChordAngle exact = S1ChordAngle::Infinity();
+    S2::UpdateMinDistance(x, a, b, &exact);
+    max_error = std::max(max_error, std::fabs(sqrt(approx.length2()) -
+                                              sqrt(exact.length2())));
+  }
+  EXPECT_LE(max_error, S2MinDistancePointTarget::kFloatEdgeMaxError);
+}
+
+TEST(S2ClosestEdgeQuery, VisitClosestEdges) {
+  // The distances to the closest k edges must be a prefix of the distances
+  // to all the edges within some radius, whichever container is used to
+  // collect them.  (Edges at the same distance may be chosen arbitrarily.)
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(10));
+  MutableS2ShapeIndex index;
+  s2testing::FractalLoopShapeIndexFactory().AddEdges(cap, 1000, &index);
+  S2ClosestEdgeQuery query(&index);
+  query.mutable_options()->set_max_distance(S1Angle::Degrees(5));
+  using Result = S2ClosestEdgeQuery::Result;
+  auto get_distances = [](const vector<Result>& results) {
+    vector<S2MinDistance> distances;
+    for (const auto& result : results) distances.push_back(result.distance());
+    return distances;
+  };
+  for (int iter = 0; iter < 20; ++iter) {
+    S2ClosestEdgeQuery::PointTarget target(S2Testing::SamplePoint(cap));
+    query.mutable_options()->set_max_results(
+        S2ClosestEdgeQuery::Options::kMaxMaxResults);
+    vector<Result> all = query.FindClosestEdges(&target);
+    for (int max_results : {1, 2, 5, 8, 9, 20,
+                            S2ClosestEdgeQuery::Options::kMaxMaxResults}) {
+      query.mutable_options()->set_max_results(max_results);
+      vector<Result> expected = query.FindClosestEdges(&target);
+      vector<Result> prefix(
+          all.begin(), all.begin() + std::min<size_t>(max_results, all.size()));
+      EXPECT_EQ(get_distances(prefix), get_distances(expected));
+      vector<Result> actual;
+      EXPECT_TRUE(query.VisitClosestEdges(&target, [&](const Result& result) {
+          actual.push_back(result);
+          return true;
+        }));
+      EXPECT_EQ(expected, actual);
+
+      // Stop after the first result.
+      if (expected.empty()) continue;
+      actual.clear();
+      EXPECT_FALSE(query.VisitClosestEdges(&target, [&](const Result& result) {
+          actual.push_back(result);
+          return false;
+        }));
+      EXPECT_EQ(vector<Result>{expected[0]}, actual);
+    }
+  }
+}
+
+TEST(S2ClosestEdgeQuery, Stats) {
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(5));
+  MutableS2ShapeIndex index;
+  s2testing::FractalLoopShapeIndexFactory().AddEdges(cap, 1000, &index);
+  S2ClosestEdgeQuery query(&index);
+  S2ClosestEdgeQuery::Stats stats;
+  query.set_stats(&stats);
+  EXPECT_EQ(&stats, query.stats());
+  S2ClosestEdgeQuery::PointTarget target(S2Testing::SamplePoint(cap));
+  query.FindClosestEdge(&target);
+  EXPECT_EQ(1, stats.num_queries);
+  EXPECT_EQ(0, stats.num_brute_force_queries);
+  EXPECT_GT(stats.num_index_cells_processed, 0);
+  EXPECT_GT(stats.num_edges_evaluated, 0);
+  EXPECT_LT(stats.num_edges_evaluated, s2shapeutil::CountEdges(index));
+  EXPECT_GE(stats.init_covering_seconds, 0);
+
+  // Statistics are summed over queries.
+  query.mutable_options()->set_max_results(10);
+  query.FindClosestEdges(&target);
+  EXPECT_EQ(2, stats.num_queries);
+  EXPECT_GT(stats.num_cells_visited, 0);
+  EXPECT_GT(stats.max_queue_size, 0);
+
+  // The brute force algorithm evaluates every edge exactly once.
+  S2ClosestEdgeQuery::Stats brute_force_stats;
+  query.set_stats(&brute_force_stats);
+  query.mutable_options()->set_use_brute_force(true);
+  query.FindClosestEdges(&target);
+  EXPECT_EQ(1, brute_force_stats.num_brute_force_queries);
+  EXPECT_EQ(s2shapeutil::CountEdges(index),
+            brute_force_stats.num_edges_evaluated);
+  EXPECT_EQ(0, brute_force_stats.num_cells_visited);
+
+  // Detaching the stats object stops collection.
+  query.set_stats(nullptr);
+  query.FindClosestEdges(&target);
+  EXPECT_EQ(1, brute_force_stats.num_queries);
+}
+
+TEST(S2ClosestEdgeQuery, Budget) {
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(5));
+  MutableS2ShapeIndex index;
+  s2testing::FractalLoopShapeIndexFactory().AddEdges(cap, 1000, &index);
+  S2ClosestEdgeQuery query(&index);
+  query.mutable_options()->set_max_results(20);
+  S2ClosestEdgeQuery::PointTarget target(S2Testing::SamplePoint(cap));
+  auto expected = query.FindClosestEdges(&target);
+  EXPECT_FALSE(query.budget_exceeded());
+  EXPECT_EQ(S1ChordAngle::Infinity(), query.unsearched_distance());
+
+  // Every edge closer than unsearched_distance() is found even when the
+  // query is stopped early.
+  query.mutable_options()->set_max_cells_visited(5);
+  auto results = query.FindClosestEdges(&target);
+  ASSERT_TRUE(query.budget_exceeded());
+  EXPECT_LT(query.unsearched_distance(), S1ChordAngle::Infinity());
+  int num_checked = 0;
+  for (int i = 0; i < expected.size(); ++i) {
+    if (!(expected[i].distance() < query.unsearched_distance())) break;
+    ASSERT_LT(i, results.size());
+    EXPECT_EQ(expected[i], results[i]);
+    ++num_checked;
+  }
+  EXPECT_LT(num_checked, expected.size());
+
+  // A zero time limit stops the query at the first priority queue entry.
+  query.mutable_options()->set_max_cells_visited(
+      S2ClosestEdgeQuery::Options::kMaxMaxCellsVisited);
+  query.mutable_options()->set_max_query_seconds(0);
+  query.FindClosestEdges(&target);
+  EXPECT_TRUE(query.budget_exceeded());
+
+  // A generous budget has no effect.
+  query.mutable_options()->set_max_cells_visited(1000000);
+  query.mutable_options()->set_max_query_seconds(1000);
+  EXPECT_EQ(expected, query.FindClosestEdges(&target));
+  EXPECT_FALSE(query.budget_exceeded());
+}
+
+TEST(S2ClosestEdgeQuery, PartitionedQuery) {
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(5));
+  constexpr int kNumShards = 3;
+  MutableS2ShapeIndex index, shards[kNumShards];
+  vector<int> shard_shape_ids[kNumShards];
+  for (int i = 0; i < 12; ++i) {
+    vector<S2Point> vertices;
+    for (int j = 0; j < 10; ++j) {
+      vertices.push_back(S2Testing::SamplePoint(cap));
+    }
+    index.Add(make_unique<S2LaxPolylineShape>(vertices));
+    // Shape 0 belongs to every shard, to test that duplicates are removed.
+    for (int s = 0; s < kNumShards; ++s) {
+      if (i == 0 || i % kNumShards == s) {
+        shards[s].Add(make_unique<S2LaxPolylineShape>(vertices));
+        shard_shape_ids[s].push_back(i);
+      }
+    }
+  }
+  S2ClosestEdgeQuery::Options options;
+  options.set_max_results(10);
+  options.set_max_distance(S1Angle::Degrees(3));
+  S2ClosestEdgeQuery query(&index, options);
+  for (int iter = 0; iter < 5; ++iter) {
+    S2ClosestEdgeQuery::PointTarget target(S2Testing::SamplePoint(cap));
+    auto expected = query.FindClosestEdges(&target);
+
+    // Query the shards in sequence, pruning each query using the results
+    // merged so far, and send each partial result through an encoding.
+    S2ClosestEdgeQuery::PartialResult merged;
+    for (int s = 0; s < kNumShards; ++s) {
+      S2ClosestEdgeQuery::Options shard_options = options;
+      shard_options.set_max_distance(
+          S2ClosestEdgeQuery::GetDistanceLimit(merged, options));
+      S2ClosestEdgeQuery shard_query(&shards[s], shard_options);
+      S2ClosestEdgeQuery::PartialResult partial;
+      shard_query.FindPartialResult(&target, &partial);
+
+      Encoder encoder;
+      S2ClosestEdgeQuery::EncodePartialResult(partial, &encoder);
+      Decoder decoder(encoder.base(), encoder.length());
+      S2ClosestEdgeQuery::PartialResult decoded;
+      ASSERT_TRUE(S2ClosestEdgeQuery::DecodePartialResult(&decoder, &decoded));
+      EXPECT_EQ(partial.results, decoded.results);
+      EXPECT_EQ(0, decoder.avail());
+      for (auto& result : decoded.results) {
+        result = S2ClosestEdgeQuery::Result(
+            result.distance(), shard_shape_ids[s][result.shape_id()],
+            result.edge_id());
+      }
+      merged = S2ClosestEdgeQuery::MergeResults({merged, decoded}, options);
+    }
+    EXPECT_EQ(expected, merged.results);
+    EXPECT_EQ(S1ChordAngle::Infinity(), merged.unsearched_distance);
+
+    // Merging all the shards at once gives the same result.
+    vector<S2ClosestEdgeQuery::PartialResult> partials(kNumShards);
+    for (int s = 0; s < kNumShards; ++s) {
+      S2ClosestEdgeQuery shard_query(&shards[s], options);
+      shard_query.FindPartialResult(&target, &partials[s]);
+      for (auto& result : partials[s].results) {
+        result = S2ClosestEdgeQuery::Result(
+            result.distance(), shard_shape_ids[s][result.shape_id()],
+            result.edge_id());
+      }
+    }
+    EXPECT_EQ(expected,
+              S2ClosestEdgeQuery::MergeResults(partials, options).results);
+  }
+}
+
+TEST(S2ClosestEdgeQuery, PartialResultCoding) {
+  S2ClosestEdgeQuery::PartialResult partial;
+  partial.results.push_back(S2ClosestEdgeQuery::Result(
+      S2MinDistance(S1ChordAngle::Zero()), 3, -1));
+  partial.results.push_back(S2ClosestEdgeQuery::Result(
+      S2MinDistance(S1ChordAngle::Degrees(1)), 0, 7));
+  partial.unsearched_distance = S2MinDistance(S1ChordAngle::Degrees(2));
+  Encoder encoder;
+  S2ClosestEdgeQuery::EncodePartialResult(partial, &encoder);
+  Decoder decoder(encoder.base(), encoder.length());
+  S2ClosestEdgeQuery::PartialResult decoded;
+  ASSERT_TRUE(S2ClosestEdgeQuery::DecodePartialResult(&decoder, &decoded));
+  EXPECT_EQ(partial.results, decoded.results);
+  EXPECT_TRUE(decoded.results[0].is_interior());
+  EXPECT_EQ(partial.unsearched_distance, decoded.unsearched_distance);
+
+  // Truncated data is rejected.
+  Decoder truncated(encoder.base(), encoder.length() - 1);
+  EXPECT_FALSE(S2ClosestEdgeQuery::DecodePartialResult(&truncated, &decoded));
+}
+
 TEST(S2ClosestEdgeQuery, TargetPointInsideIndexedPolygon) {
   // Tests a target point in the interior of an indexed polygon.
   // (The index also includes a polyline loop with no interior.)
@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "s2/base/logging.h"
+#include "absl/types/span.h"
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2closest_point_query_base.h"
@@ -223,6 +224,9 @@ class S2ClosestPointQuery {
   //   const Data& data() const;
   using Result = typename Base::Result;
 
+  // Statistics about the work done by queries (see set_stats).
+  using Stats = typename Base::Stats;
+
   using Options = S2ClosestPointQueryOptions;
 
   // The available target types (see definitions above).
@@ -259,6 +263,23 @@ class S2ClosestPointQuery {
   const Options& options() const;
   Options* mutable_options();
 
+  // Specifies an object that the statistics of each subsequent query should
+  // be added to, or nullptr to stop collecting statistics.  This can be used
+  // to tune the query options for a given dataset.  See Stats for details.
+  //
+  // DEFAULT: nullptr
+  Stats* stats() const { return base_.stats(); }
+  void set_stats(Stats* stats) { base_.set_stats(stats); }
+
+  // Returns true if the most recent query stopped early because it exceeded
+  // options().max_cells_visited() or options().max_query_seconds(), in which
+  // case the results are the best found so far and every point closer than
+  // unsearched_distance() was examined.  (See S2ClosestPointQueryBase.)
+  bool budget_exceeded() const { return base_.budget_exceeded(); }
+  S1ChordAngle unsearched_distance() const {
+    return base_.unsearched_distance();
+  }
+
   // Returns the closest points to the given target that satisfy the current
   // options.  This method may be called multiple times.
   std::vector<Result> FindClosestPoints(Target* target);
@@ -267,6 +288,20 @@ class S2ClosestPointQuery {
   // since it does not require allocating a new vector on each call.
   void FindClosestPoints(Target* target, std::vector<Result>* results);
 
+  // Merges the results of running a query with the given options over each
+  // of several S2PointIndexes that partition a set of points, and returns a
+  // max_distance() that can be used to prune the queries over the remaining
+  // indexes given the results merged so far.  See S2ClosestPointQueryBase.
+  static std::vector<Result> MergeResults(
+      absl::Span<const std::vector<Result>> partial_results,
+      const Options& options) {
+    return Base::MergeResults(partial_results, options);
+  }
+  static S1ChordAngle GetDistanceLimit(absl::Span<const Result> merged,
+                                       const Options& options) {
+    return Base::GetDistanceLimit(merged, options);
+  }
+
   //////////////////////// Convenience Methods ////////////////////////
 
   // Returns the closest point to the target.  If no point satisfies the search
@@ -418,7 +453,7 @@ inline void S2ClosestPointQuery<Data>::FindClosestPoints(
 template <class Data>
 inline typename S2ClosestPointQuery<Data>::Result
 S2ClosestPointQuery<Data>::FindClosestPoint(Target* target) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 48, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   return base_.FindClosestPoint(target, tmp_options);
@@ -432,7 +467,7 @@ inline S1ChordAngle S2ClosestPointQuery<Data>::GetDistance(Target* target) {
 template <class Data>
 bool S2ClosestPointQuery<Data>::IsDistanceLess(
     Target* target, S1ChordAngle limit) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 48, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   tmp_options.set_max_distance(limit);
@@ -443,7 +478,7 @@ bool S2ClosestPointQuery<Data>::IsDistanceLess(
 template <class Data>
 bool S2ClosestPointQuery<Data>::IsDistanceLessOrEqual(
     Target* target, S1ChordAngle limit) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 48, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   tmp_options.set_inclusive_max_distance(limit);
@@ -454,7 +489,7 @@ bool S2ClosestPointQuery<Data>::IsDistanceLessOrEqual(
 template <class Data>
 bool S2ClosestPointQuery<Data>::IsConservativeDistanceLessOrEqual(
     Target* target, S1ChordAngle limit) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 48, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   tmp_options.set_conservative_max_distance(limit);
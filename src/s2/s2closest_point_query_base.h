@@ -20,10 +20,16 @@
 #ifndef S2_S2CLOSEST_POINT_QUERY_BASE_H_
 #define S2_S2CLOSEST_POINT_QUERY_BASE_H_
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <utility>
 #include <vector>
 
+#include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
 #include "absl/container/inlined_vector.h"
+#include "absl/types/span.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2cap.h"
 #include "s2/s2cell_id.h"
@@ -111,12 +117,33 @@ class S2ClosestPointQueryBaseOptions {
   bool use_brute_force() const;
   void set_use_brute_force(bool use_brute_force);
 
+  // Specifies a budget for the work done by each query, expressed as the
+  // number of S2Cells visited (see Stats::num_cells_visited) and/or as a
+  // time limit.  If either limit is reached then the query stops early and
+  // returns the best results found so far (see
+  // S2ClosestPointQueryBase::budget_exceeded).  The budget only applies to
+  // the optimized algorithm.
+  //
+  // DEFAULT: kMaxMaxCellsVisited / Infinity (no limit)
+  int64 max_cells_visited() const;
+  void set_max_cells_visited(int64 max_cells_visited);
+  static constexpr int64 kMaxMaxCellsVisited =
+      std::numeric_limits<int64>::max();
+
+  double max_query_seconds() const;
+  void set_max_query_seconds(double max_query_seconds);
+
+  // Returns true if max_cells_visited() or max_query_seconds() is set.
+  bool has_budget() const;
+
  private:
   Distance max_distance_ = Distance::Infinity();
   Delta max_error_ = Delta::Zero();
   const S2Region* region_ = nullptr;
   int max_results_ = kMaxMaxResults;
   bool use_brute_force_ = false;
+  int64 max_cells_visited_ = kMaxMaxCellsVisited;
+  double max_query_seconds_ = std::numeric_limits<double>::infinity();
 };
 
 // S2ClosestPointQueryBase is a templatized class for finding the closest
@@ -141,11 +168,17 @@ class S2ClosestPointQueryBaseOptions {
 // used as long as it implements the Distance concept described in
 // s2distance_target.h.  For example this can be used to measure maximum
 // distances, to get more accuracy, or to measure non-spheroidal distances.
-template <class Distance, class Data>
+//
+// The IndexType template argument is the type of the point index.  Usually
+// it is S2PointIndex<Data>, but any class that provides the same PointData
+// type, num_points() method, and Iterator API may be used instead (see
+// EncodedS2PointIndex).  The PointData objects returned by the iterator
+// must remain valid for the lifetime of the index.
+template <class Distance, class Data, class IndexType = S2PointIndex<Data>>
 class S2ClosestPointQueryBase {
  public:
   using Delta = typename Distance::Delta;
-  using Index = S2PointIndex<Data>;
+  using Index = IndexType;
   using PointData = typename Index::PointData;
   using Options = S2ClosestPointQueryBaseOptions<Distance>;
 
@@ -158,6 +191,41 @@ class S2ClosestPointQueryBase {
   // allocate temporary data structures in order to improve performance.
   using Target = S2DistanceTarget<Distance>;
 
+  // Statistics about the work done by queries.  These can be used to tune
+  // the query options (e.g., max_error()) for a given dataset.  The
+  // statistics are summed over all queries made while the Stats object is
+  // attached to the query (see set_stats).
+  struct Stats {
+    // The number of queries, and the number of those that used the brute
+    // force algorithm (because the index was small or use_brute_force() was
+    // specified).
+    int64 num_queries = 0;
+    int64 num_brute_force_queries = 0;
+
+    // The number of S2Cells whose distance to the target was computed in
+    // order to decide whether to add them to the priority queue.
+    int64 num_cells_visited = 0;
+
+    // The number of points whose distance to the target was computed.
+    int64 num_points_evaluated = 0;
+
+    // The maximum size of the priority queue during any query.
+    int64 max_queue_size = 0;
+
+    // The time spent computing the covering of the index, which is done by
+    // the first optimized query after each call to Init() or ReInit().
+    double init_covering_seconds = 0;
+
+    void Add(const Stats& other) {
+      num_queries += other.num_queries;
+      num_brute_force_queries += other.num_brute_force_queries;
+      num_cells_visited += other.num_cells_visited;
+      num_points_evaluated += other.num_points_evaluated;
+      max_queue_size = std::max(max_queue_size, other.max_queue_size);
+      init_covering_seconds += other.init_covering_seconds;
+    }
+  };
+
   // Each "Result" object represents a closest point.
   class Result {
    public:
@@ -224,9 +292,18 @@ class S2ClosestPointQueryBase {
   // underlying index is modified.
   void ReInit();
 
-  // Return a reference to the underlying S2PointIndex.
+  // Return a reference to the underlying point index.
   const Index& index() const;
 
+  // Specifies an object that the statistics of each subsequent query should
+  // be added to, or nullptr to stop collecting statistics.  The object must
+  // persist until it is detached (or the query is destroyed), and it may be
+  // shared by several queries only if they are not used concurrently.
+  //
+  // DEFAULT: nullptr
+  Stats* stats() const { return stats_; }
+  void set_stats(Stats* stats) { stats_ = stats; }
+
   // Returns the closest points to the given target that satisfy the given
   // options.  This method may be called multiple times.
   std::vector<Result> FindClosestPoints(Target* target, const Options& options);
@@ -243,6 +320,48 @@ class S2ClosestPointQueryBase {
   // REQUIRES: options.max_results() == 1
   Result FindClosestPoint(Target* target, const Options& options);
 
+  // Finds the closest points to each of the given targets, storing the
+  // results for targets[i] in (*results)[i].  This simply calls
+  // FindClosestPoints() for each target; no traversal work is shared between
+  // targets.  However the targets are processed in S2CellId order of their
+  // bounding cap centers, so that nearby targets visit the same parts of the
+  // index consecutively (which improves cache locality), and the existing
+  // vectors in "results" are reused to avoid allocations.
+  void FindClosestPoints(absl::Span<Target* const> targets,
+                         const Options& options,
+                         std::vector<std::vector<Result>>* results);
+
+  // Returns true if the most recent query stopped early because it exceeded
+  // the budget given by options().max_cells_visited() or
+  // options().max_query_seconds().  The results of such a query are the best
+  // found so far: every point closer than unsearched_distance() was
+  // examined, but more distant points may be missing from the results.
+  bool budget_exceeded() const { return budget_exceeded_; }
+
+  // Returns a lower bound on the distance to any point that the most recent
+  // query did not examine, or Distance::Infinity() if the query was not
+  // stopped early.
+  Distance unsearched_distance() const { return unsearched_distance_; }
+
+  // Merges the results of running a query with the given options over
+  // several indexes that partition a set of points, returning the results
+  // that the same query over all the points would have returned.  Since
+  // each Result refers to the PointData stored in its index, the indexes
+  // must persist while the merged results are in use.  (Points stored in
+  // several indexes are reported once per index.)
+  static std::vector<Result> MergeResults(
+      absl::Span<const std::vector<Result>> partial_results,
+      const Options& options);
+
+  // Returns a max_distance() that can be used when querying the remaining
+  // indexes, given the results merged so far.  This is the distance of the
+  // max_results()-th merged result, or options.max_distance() if fewer
+  // results have been found.  (Points exactly as distant as the last merged
+  // result are excluded, so a different subset of tied points may be
+  // returned.)
+  static Distance GetDistanceLimit(absl::Span<const Result> merged,
+                                   const Options& options);
+
  private:
   using Iterator = typename Index::Iterator;
 
@@ -255,11 +374,24 @@ class S2ClosestPointQueryBase {
   void AddInitialRange(S2CellId first_id, S2CellId last_id);
   void MaybeAddResult(const PointData* point_data);
   bool ProcessOrEnqueue(S2CellId id, Iterator* iter, bool seek);
+  bool BudgetExceeded() const;
 
   const Index* index_;
   const Options* options_;
   Target* target_;
 
+  // The statistics of the current query, which are added to *stats_ (if
+  // non-null) when the query finishes.
+  Stats* stats_ = nullptr;
+  Stats query_stats_;
+
+  // The results of BudgetExceeded() for the current query (see
+  // budget_exceeded() and unsearched_distance()).  "deadline_" is only
+  // meaningful when options().max_query_seconds() is finite.
+  std::chrono::steady_clock::time_point deadline_;
+  bool budget_exceeded_ = false;
+  Distance unsearched_distance_ = Distance::Infinity();
+
   // True if max_error() must be subtracted from priority queue cell distances
   // in order to ensure that such distances are measured conservatively.  This
   // is true only if the target takes advantage of max_error() in order to
@@ -394,62 +526,97 @@ inline void S2ClosestPointQueryBaseOptions<Distance>::set_use_brute_force(
   use_brute_force_ = use_brute_force;
 }
 
-template <class Distance, class Data>
-S2ClosestPointQueryBase<Distance, Data>::S2ClosestPointQueryBase() {
+template <class Distance>
+inline int64
+S2ClosestPointQueryBaseOptions<Distance>::max_cells_visited() const {
+  return max_cells_visited_;
+}
+
+template <class Distance>
+inline void S2ClosestPointQueryBaseOptions<Distance>::set_max_cells_visited(
+    int64 max_cells_visited) {
+  S2_DCHECK_GE(max_cells_visited, 0);
+  max_cells_visited_ = max_cells_visited;
+}
+
+template <class Distance>
+inline double
+S2ClosestPointQueryBaseOptions<Distance>::max_query_seconds() const {
+  return max_query_seconds_;
+}
+
+template <class Distance>
+inline void S2ClosestPointQueryBaseOptions<Distance>::set_max_query_seconds(
+    double max_query_seconds) {
+  S2_DCHECK_GE(max_query_seconds, 0);
+  max_query_seconds_ = max_query_seconds;
+}
+
+template <class Distance>
+inline bool S2ClosestPointQueryBaseOptions<Distance>::has_budget() const {
+  return (max_cells_visited_ != kMaxMaxCellsVisited ||
+          max_query_seconds_ != std::numeric_limits<double>::infinity());
 }
 
-template <class Distance, class Data>
-S2ClosestPointQueryBase<Distance, Data>::~S2ClosestPointQueryBase() {
+template <class Distance, class Data, class IndexType>
+S2ClosestPointQueryBase<Distance, Data, IndexType>::S2ClosestPointQueryBase() {
+}
+
+template <class Distance, class Data, class IndexType>
+S2ClosestPointQueryBase<Distance, Data, IndexType>::~S2ClosestPointQueryBase() {
   // Prevent inline destructor bloat by providing a definition.
 }
 
-template <class Distance, class Data>
-inline S2ClosestPointQueryBase<Distance, Data>::S2ClosestPointQueryBase(
-    const S2PointIndex<Data>* index) : S2ClosestPointQueryBase() {
+template <class Distance, class Data, class IndexType>
+inline S2ClosestPointQueryBase<Distance, Data, IndexType>::
+S2ClosestPointQueryBase(const IndexType* index) : S2ClosestPointQueryBase() {
   Init(index);
 }
 
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::Init(
-    const S2PointIndex<Data>* index) {
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::Init(
+    const IndexType* index) {
   index_ = index;
   ReInit();
 }
 
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::ReInit() {
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::ReInit() {
   iter_.Init(index_);
   index_covering_.clear();
 }
 
-template <class Distance, class Data>
-inline const S2PointIndex<Data>&
-S2ClosestPointQueryBase<Distance, Data>::index() const {
+template <class Distance, class Data, class IndexType>
+inline const IndexType&
+S2ClosestPointQueryBase<Distance, Data, IndexType>::index() const {
   return *index_;
 }
 
-template <class Distance, class Data>
-inline std::vector<typename S2ClosestPointQueryBase<Distance, Data>::Result>
-S2ClosestPointQueryBase<Distance, Data>::FindClosestPoints(
+template <class Distance, class Data, class IndexType>
+inline std::vector<
+    typename S2ClosestPointQueryBase<Distance, Data, IndexType>::Result>
+S2ClosestPointQueryBase<Distance, Data, IndexType>::FindClosestPoints(
     Target* target, const Options& options) {
   std::vector<Result> results;
   FindClosestPoints(target, options, &results);
   return results;
 }
 
-template <class Distance, class Data>
-typename S2ClosestPointQueryBase<Distance, Data>::Result
-S2ClosestPointQueryBase<Distance, Data>::FindClosestPoint(
+template <class Distance, class Data, class IndexType>
+typename S2ClosestPointQueryBase<Distance, Data, IndexType>::Result
+S2ClosestPointQueryBase<Distance, Data, IndexType>::FindClosestPoint(
     Target* target, const Options& options) {
   S2_DCHECK_EQ(options.max_results(), 1);
   FindClosestPointsInternal(target, options);
+  if (stats_ != nullptr) stats_->Add(query_stats_);
   return result_singleton_;
 }
 
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::FindClosestPoints(
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::FindClosestPoints(
     Target* target, const Options& options, std::vector<Result>* results) {
   FindClosestPointsInternal(target, options);
+  if (stats_ != nullptr) stats_->Add(query_stats_);
   results->clear();
   if (options.max_results() == 1) {
     if (!result_singleton_.is_empty()) {
@@ -471,11 +638,69 @@ void S2ClosestPointQueryBase<Distance, Data>::FindClosestPoints(
   }
 }
 
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::FindClosestPointsInternal(
-    Target* target, const Options& options) {
+template <class Distance, class Data, class IndexType>
+std::vector<typename S2ClosestPointQueryBase<Distance, Data, IndexType>::Result>
+S2ClosestPointQueryBase<Distance, Data, IndexType>::MergeResults(
+    absl::Span<const std::vector<Result>> partial_results,
+    const Options& options) {
+  std::vector<Result> results;
+  for (const auto& partial : partial_results) {
+    results.insert(results.end(), partial.begin(), partial.end());
+  }
+  std::sort(results.begin(), results.end());
+  while (!results.empty() &&
+         !(results.back().distance() < options.max_distance())) {
+    results.pop_back();
+  }
+  if (results.size() > static_cast<size_t>(options.max_results())) {
+    results.resize(options.max_results());
+  }
+  return results;
+}
+
+template <class Distance, class Data, class IndexType>
+Distance S2ClosestPointQueryBase<Distance, Data, IndexType>::GetDistanceLimit(
+    absl::Span<const Result> merged, const Options& options) {
+  int k = options.max_results();
+  if (merged.size() < static_cast<size_t>(k)) return options.max_distance();
+  return std::min(options.max_distance(), merged[k - 1].distance());
+}
+
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::FindClosestPoints(
+    absl::Span<Target* const> targets, const Options& options,
+    std::vector<std::vector<Result>>* results) {
+  // Sort the targets so that nearby targets are processed consecutively.
+  // Empty targets are given an arbitrary position.
+  std::vector<std::pair<S2CellId, int>> order;
+  order.reserve(targets.size());
+  for (int i = 0; i < targets.size(); ++i) {
+    S2Cap cap = targets[i]->GetCapBound();
+    order.emplace_back(cap.is_empty() ? S2CellId::None()
+                                      : S2CellId(cap.center()), i);
+  }
+  std::sort(order.begin(), order.end());
+  results->resize(targets.size());
+  for (const auto& entry : order) {
+    FindClosestPoints(targets[entry.second], options,
+                      &(*results)[entry.second]);
+  }
+}
+
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::
+FindClosestPointsInternal(Target* target, const Options& options) {
   target_ = target;
   options_ = &options;
+  query_stats_ = Stats();
+  query_stats_.num_queries = 1;
+  budget_exceeded_ = false;
+  unsearched_distance_ = Distance::Infinity();
+  if (options.max_query_seconds() != std::numeric_limits<double>::infinity()) {
+    deadline_ = std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(options.max_query_seconds()));
+  }
 
   distance_limit_ = options.max_distance();
   result_singleton_ = Result();
@@ -526,21 +751,24 @@ void S2ClosestPointQueryBase<Distance, Data>::FindClosestPointsInternal(
   // duplicate points in the results.
   if (options.use_brute_force() ||
       index_->num_points() <= target_->max_brute_force_index_size()) {
+    query_stats_.num_brute_force_queries = 1;
     FindClosestPointsBruteForce();
   } else {
     FindClosestPointsOptimized();
   }
 }
 
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::FindClosestPointsBruteForce() {
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::
+FindClosestPointsBruteForce() {
   for (iter_.Begin(); !iter_.done(); iter_.Next()) {
     MaybeAddResult(&iter_.point_data());
   }
 }
 
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::FindClosestPointsOptimized() {
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::
+FindClosestPointsOptimized() {
   InitQueue();
   while (!queue_.empty()) {
     // We need to copy the top entry before removing it, and we need to remove
@@ -554,6 +782,14 @@ void S2ClosestPointQueryBase<Distance, Data>::FindClosestPointsOptimized() {
       queue_ = CellQueue();  // Clear any remaining entries.
       break;
     }
+    // Since entries are processed in order of increasing distance, every
+    // unexamined point is at least as far away as this entry.
+    if (options().has_budget() && BudgetExceeded()) {
+      budget_exceeded_ = true;
+      unsearched_distance_ = distance;
+      queue_ = CellQueue();
+      break;
+    }
     S2CellId child = entry.id.child_begin();
     // We already know that it has too many points, so process its children.
     // Each child may either be processed directly or enqueued again.  The
@@ -565,8 +801,19 @@ void S2ClosestPointQueryBase<Distance, Data>::FindClosestPointsOptimized() {
   }
 }
 
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::InitQueue() {
+template <class Distance, class Data, class IndexType>
+bool S2ClosestPointQueryBase<Distance, Data, IndexType>::BudgetExceeded()
+    const {
+  if (query_stats_.num_cells_visited >= options().max_cells_visited()) {
+    return true;
+  }
+  return (options().max_query_seconds() !=
+              std::numeric_limits<double>::infinity() &&
+          std::chrono::steady_clock::now() >= deadline_);
+}
+
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::InitQueue() {
   S2_DCHECK(queue_.empty());
 
   // Optimization: rather than starting with the entire index, see if we can
@@ -601,7 +848,16 @@ void S2ClosestPointQueryBase<Distance, Data>::InitQueue() {
   }
   // We start with a covering of the set of indexed points, then intersect it
   // with the given region (if any) and maximum search radius disc (if any).
-  if (index_covering_.empty()) InitCovering();
+  if (index_covering_.empty()) {
+    if (stats_ == nullptr) {
+      InitCovering();
+    } else {
+      auto start = std::chrono::steady_clock::now();
+      InitCovering();
+      query_stats_.init_covering_seconds += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+    }
+  }
   const std::vector<S2CellId>* initial_cells = &index_covering_;
   if (options().region()) {
     S2RegionCoverer coverer;
@@ -628,8 +884,8 @@ void S2ClosestPointQueryBase<Distance, Data>::InitQueue() {
   }
 }
 
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::InitCovering() {
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::InitCovering() {
   // Compute the "index covering", which is a small number of S2CellIds that
   // cover the indexed points.  There are two cases:
   //
@@ -679,8 +935,8 @@ void S2ClosestPointQueryBase<Distance, Data>::InitCovering() {
 // Adds a cell to index_covering_ that covers the given inclusive range.
 //
 // REQUIRES: "first" and "last" have a common ancestor.
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::AddInitialRange(
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::AddInitialRange(
     S2CellId first_id, S2CellId last_id) {
   // Add the lowest common ancestor of the given range.
   int level = first_id.GetCommonAncestorLevel(last_id);
@@ -688,9 +944,10 @@ void S2ClosestPointQueryBase<Distance, Data>::AddInitialRange(
   index_covering_.push_back(first_id.parent(level));
 }
 
-template <class Distance, class Data>
-void S2ClosestPointQueryBase<Distance, Data>::MaybeAddResult(
+template <class Distance, class Data, class IndexType>
+void S2ClosestPointQueryBase<Distance, Data, IndexType>::MaybeAddResult(
     const PointData* point_data) {
+  ++query_stats_.num_points_evaluated;
   Distance distance = distance_limit_;
   if (!target_->UpdateMinDistance(point_data->point(), &distance)) return;
 
@@ -726,8 +983,8 @@ void S2ClosestPointQueryBase<Distance, Data>::MaybeAddResult(
 // Returns "true" if the cell was added to the queue, and "false" if it was
 // processed immediately, in which case "iter" is left positioned at the next
 // cell in S2CellId order.
-template <class Distance, class Data>
-bool S2ClosestPointQueryBase<Distance, Data>::ProcessOrEnqueue(
+template <class Distance, class Data, class IndexType>
+bool S2ClosestPointQueryBase<Distance, Data, IndexType>::ProcessOrEnqueue(
     S2CellId id, Iterator* iter, bool seek) {
   if (seek) iter->Seek(id.range_min());
   if (id.is_leaf()) {
@@ -742,6 +999,7 @@ bool S2ClosestPointQueryBase<Distance, Data>::ProcessOrEnqueue(
   for (; !iter->done() && iter->id() <= last; iter->Next()) {
     if (num_points == kMinPointsToEnqueue - 1) {
       // This cell has too many points (including this one), so enqueue it.
+      ++query_stats_.num_cells_visited;
       S2Cell cell(id);
       Distance distance = distance_limit_;
       // We check "region_" second because it may be relatively expensive.
@@ -752,6 +1010,8 @@ bool S2ClosestPointQueryBase<Distance, Data>::ProcessOrEnqueue(
           distance = distance - options().max_error();
         }
         queue_.push(QueueEntry(distance, id));
+        query_stats_.max_queue_size =
+            std::max<int64>(query_stats_.max_queue_size, queue_.size());
       }
       return true;  // Seek to next child.
     }
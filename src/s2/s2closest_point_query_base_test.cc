@@ -20,10 +20,20 @@
 
 #include "s2/s2closest_point_query_base.h"
 
+#include <memory>
+#include <vector>
+
 #include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2closest_point_query.h"
 #include "s2/s2max_distance_targets.h"
+#include "s2/s2testing.h"
 #include "s2/s2text_format.h"
 
+using std::vector;
+
 namespace {
 
 // This is a proof-of-concept prototype of a possible S2FurthestPointQuery
@@ -60,4 +70,30 @@ TEST(S2ClosestPointQueryBase, MaxDistance) {
               1e-13);
 }
 
+TEST(S2ClosestPointQueryBase, BatchQuery) {
+  using Query = S2ClosestPointQueryBase<S2MinDistance, int>;
+  S2PointIndex<int> index;
+  S2Cap cap(S2Testing::RandomPoint(), S2Testing::KmToAngle(100));
+  for (int i = 0; i < 1000; ++i) {
+    index.Add(S2Testing::SamplePoint(cap), i);
+  }
+  vector<std::unique_ptr<Query::Target>> targets;
+  vector<Query::Target*> target_ptrs;
+  for (int i = 0; i < 50; ++i) {
+    targets.push_back(absl::make_unique<S2ClosestPointQuery<int>::PointTarget>(
+        S2Testing::SamplePoint(cap)));
+    target_ptrs.push_back(targets.back().get());
+  }
+  Query query(&index);
+  Query::Options options;
+  options.set_max_results(5);
+  // The results vector is reused, so start with some stale contents.
+  vector<vector<Query::Result>> results(3, vector<Query::Result>(2));
+  query.FindClosestPoints(target_ptrs, options, &results);
+  ASSERT_EQ(targets.size(), results.size());
+  for (int i = 0; i < targets.size(); ++i) {
+    EXPECT_EQ(query.FindClosestPoints(targets[i].get(), options), results[i]);
+  }
+}
+
 }  // namespace
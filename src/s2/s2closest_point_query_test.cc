@@ -64,6 +64,120 @@ TEST(S2ClosestPointQuery, ManyDuplicatePoints) {
   EXPECT_EQ(kNumPoints, results.size());
 }
 
+TEST(S2ClosestPointQuery, PayloadColumns) {
+  // An index whose data is the row of each point can be used to look up
+  // payloads stored in separate columns.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  vector<S2Point> points;
+  vector<double> payloads;
+  for (int i = 0; i < 1000; ++i) {
+    points.push_back(S2Testing::RandomPoint());
+    payloads.push_back(points.back().x());
+  }
+  TestIndex index(points);
+  TestQuery query(&index);
+  query.mutable_options()->set_max_results(10);
+  S2ClosestPointQueryPointTarget target(S2Testing::RandomPoint());
+  const auto results = query.FindClosestPoints(&target);
+  ASSERT_EQ(10, results.size());
+  for (const auto& result : results) {
+    EXPECT_EQ(points[result.data()], result.point());
+    EXPECT_EQ(payloads[result.data()], result.point().x());
+  }
+}
+
+TEST(S2ClosestPointQuery, Stats) {
+  TestIndex index;
+  for (int i = 0; i < 1000; ++i) {
+    index.Add(S2Testing::RandomPoint(), i);
+  }
+  TestQuery query(&index);
+  TestQuery::Stats stats;
+  query.set_stats(&stats);
+  query.mutable_options()->set_max_results(5);
+  S2ClosestPointQueryPointTarget target(S2Testing::RandomPoint());
+  query.FindClosestPoints(&target);
+  EXPECT_EQ(1, stats.num_queries);
+  EXPECT_EQ(0, stats.num_brute_force_queries);
+  EXPECT_GT(stats.num_cells_visited, 0);
+  EXPECT_GT(stats.max_queue_size, 0);
+  EXPECT_GT(stats.num_points_evaluated, 0);
+  EXPECT_LT(stats.num_points_evaluated, 1000);
+
+  query.mutable_options()->set_use_brute_force(true);
+  query.FindClosestPoints(&target);
+  EXPECT_EQ(2, stats.num_queries);
+  EXPECT_EQ(1, stats.num_brute_force_queries);
+}
+
+TEST(S2ClosestPointQuery, Budget) {
+  TestIndex index;
+  for (int i = 0; i < 1000; ++i) {
+    index.Add(S2Testing::RandomPoint(), i);
+  }
+  TestQuery query(&index);
+  query.mutable_options()->set_max_results(10);
+  S2ClosestPointQueryPointTarget target(S2Testing::RandomPoint());
+  auto expected = query.FindClosestPoints(&target);
+  EXPECT_FALSE(query.budget_exceeded());
+  EXPECT_EQ(S1ChordAngle::Infinity(), query.unsearched_distance());
+
+  // Every point closer than unsearched_distance() is found even when the
+  // query is stopped early.
+  query.mutable_options()->set_max_cells_visited(1);
+  auto results = query.FindClosestPoints(&target);
+  ASSERT_TRUE(query.budget_exceeded());
+  for (int i = 0; i < expected.size(); ++i) {
+    if (!(expected[i].distance() < query.unsearched_distance())) break;
+    ASSERT_LT(i, results.size());
+    EXPECT_EQ(expected[i].data(), results[i].data());
+  }
+
+  query.mutable_options()->set_max_cells_visited(
+      TestQuery::Options::kMaxMaxCellsVisited);
+  query.mutable_options()->set_max_query_seconds(0);
+  query.FindClosestPoints(&target);
+  EXPECT_TRUE(query.budget_exceeded());
+
+  query.mutable_options()->set_max_query_seconds(1000);
+  EXPECT_EQ(expected.size(), query.FindClosestPoints(&target).size());
+  EXPECT_FALSE(query.budget_exceeded());
+}
+
+TEST(S2ClosestPointQuery, PartitionedQuery) {
+  constexpr int kNumShards = 3;
+  TestIndex index, shards[kNumShards];
+  for (int i = 0; i < 300; ++i) {
+    S2Point p = S2Testing::RandomPoint();
+    index.Add(p, i);
+    shards[i % kNumShards].Add(p, i);
+  }
+  TestQuery::Options options;
+  options.set_max_results(10);
+  TestQuery query(&index, options);
+  for (int iter = 0; iter < 5; ++iter) {
+    S2ClosestPointQueryPointTarget target(S2Testing::RandomPoint());
+    auto expected = query.FindClosestPoints(&target);
+
+    // Query the shards in sequence, pruning each query using the results
+    // merged so far.
+    vector<TestQuery::Result> merged;
+    for (int s = 0; s < kNumShards; ++s) {
+      TestQuery::Options shard_options = options;
+      shard_options.set_max_distance(
+          TestQuery::GetDistanceLimit(merged, options));
+      TestQuery shard_query(&shards[s], shard_options);
+      auto partial = shard_query.FindClosestPoints(&target);
+      merged = TestQuery::MergeResults({merged, partial}, options);
+    }
+    ASSERT_EQ(expected.size(), merged.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i].distance(), merged[i].distance());
+      EXPECT_EQ(expected[i].data(), merged[i].data());
+    }
+  }
+}
+
 TEST(S2ClosestPointQuery, EmptyTargetOptimized) {
   // Ensure that the optimized algorithm handles empty targets when a distance
   // limit is specified.
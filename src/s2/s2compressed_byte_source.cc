@@ -0,0 +1,201 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2compressed_byte_source.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "s2/base/logging.h"
+#include "s2/util/coding/varint.h"
+
+using std::min;
+using std::string;
+using std::vector;
+
+// When adding a new encoding, be aware that old binaries will not be able
+// to decode it.
+static const unsigned char kCurrentEncodingVersionNumber = 1;
+
+// The compressed format is a sequence of (literals, match) pairs, where each
+// pair consists of
+//
+//   varint64 literal_length
+//   literal_length bytes of literal data
+//   varint64 match_length
+//   varint64 match_distance (> 0)
+//
+// A match copies "match_length" bytes starting "match_distance" bytes before
+// the current output position (the two ranges may overlap).  The last pair
+// consists only of the literals.
+void S2LzBlockCodec::Compress(absl::string_view data,
+                              string* output) const {
+  constexpr int kMinMatchLength = 4;
+  constexpr int kHashBits = 14;
+  const char* base = data.data();
+  const size_t n = data.size();
+
+  // Maps a hash of each 4-byte sequence to the most recent position where
+  // that hash was seen (or -1).
+  vector<int64> table(1 << kHashBits, -1);
+  Encoder encoder;
+  size_t anchor = 0;  // The start of the pending literals.
+  for (size_t i = 0; i + kMinMatchLength <= n;) {
+    uint32 v;
+    memcpy(&v, base + i, sizeof(v));
+    uint32 hash = (v * 2654435761u) >> (32 - kHashBits);
+    int64 candidate = table[hash];
+    table[hash] = i;
+    if (candidate < 0 || memcmp(base + candidate, base + i, kMinMatchLength)) {
+      ++i;
+      continue;
+    }
+    size_t length = kMinMatchLength;
+    while (i + length < n && base[candidate + length] == base[i + length]) {
+      ++length;
+    }
+    encoder.Ensure(3 * Varint::kMax64 + (i - anchor));
+    encoder.put_varint64(i - anchor);
+    encoder.putn(base + anchor, i - anchor);
+    encoder.put_varint64(length);
+    encoder.put_varint64(i - candidate);
+    i += length;
+    anchor = i;
+  }
+  encoder.Ensure(Varint::kMax64 + (n - anchor));
+  encoder.put_varint64(n - anchor);
+  encoder.putn(base + anchor, n - anchor);
+  output->append(encoder.base(), encoder.length());
+}
+
+bool S2LzBlockCodec::Decompress(absl::string_view data,
+                                size_t uncompressed_size, char* dest) const {
+  Decoder decoder(data.data(), data.size());
+  char* out = dest;
+  char* const limit = dest + uncompressed_size;
+  for (;;) {
+    uint64 literal_length;
+    if (!decoder.get_varint64(&literal_length)) return false;
+    if (literal_length > decoder.avail() ||
+        literal_length > static_cast<uint64>(limit - out)) {
+      return false;
+    }
+    decoder.getn(out, literal_length);
+    out += literal_length;
+    if (decoder.avail() == 0) break;
+
+    uint64 length, distance;
+    if (!decoder.get_varint64(&length) || !decoder.get_varint64(&distance)) {
+      return false;
+    }
+    if (distance == 0 || distance > static_cast<uint64>(out - dest) ||
+        length > static_cast<uint64>(limit - out)) {
+      return false;
+    }
+    // The source and destination may overlap, so copy one byte at a time.
+    for (const char* src = out - distance; length > 0; --length) {
+      *out++ = *src++;
+    }
+  }
+  return out == limit;
+}
+
+void S2CompressedByteSource::Encode(absl::string_view data,
+                                    const S2BlockCodec& codec,
+                                    size_t block_size, Encoder* encoder) {
+  S2_DCHECK_GT(block_size, 0);
+  string blocks;
+  vector<uint64> block_offsets;
+  for (size_t start = 0; start < data.size(); start += block_size) {
+    codec.Compress(data.substr(start, block_size), &blocks);
+    block_offsets.push_back(blocks.size());
+  }
+  encoder->Ensure(1 + 2 * Varint::kMax64);
+  encoder->put8(kCurrentEncodingVersionNumber);
+  encoder->put_varint64(data.size());
+  encoder->put_varint64(block_size);
+  s2coding::EncodeUintVector<uint64>(block_offsets, encoder);
+  encoder->Ensure(blocks.size());
+  encoder->putn(blocks.data(), blocks.size());
+}
+
+bool S2CompressedByteSource::Init(const S2ByteSource* source,
+                                  const S2BlockCodec* codec) {
+  source_ = source;
+  codec_ = codec;
+  uint64 offset = 0;
+  uint64 size = 0, block_size = 0;
+  if (!source->ReadPrefix(
+          &offset,
+          [&](Decoder* decoder) {
+            if (decoder->avail() < 1) return false;
+            if (decoder->get8() != kCurrentEncodingVersionNumber) return false;
+            return decoder->get_varint64(&size) &&
+                   decoder->get_varint64(&block_size) &&
+                   block_offsets_.Init(decoder);
+          },
+          &block_offsets_data_, 256)) {
+    return false;
+  }
+  if (block_size == 0) return false;
+  uint64 num_blocks = size / block_size + (size % block_size != 0);
+  if (block_offsets_.size() != num_blocks) return false;
+  uint64 length = (num_blocks == 0) ? 0 : block_offsets_[num_blocks - 1];
+  if (length > source->size() - offset) return false;
+  size_ = size;
+  block_size_ = block_size;
+  data_offset_ = offset;
+  return true;
+}
+
+bool S2CompressedByteSource::Read(uint64 offset, size_t length,
+                                  char* dest) const {
+  if (offset > size_ || length > size_ - offset) return false;
+  const uint64 end = offset + length;
+  for (uint64 index = offset / block_size_; offset < end; ++index) {
+    const uint64 block_start = index * block_size_;
+    const uint64 block_end = min<uint64>(block_start + block_size_, end);
+    if (!ReadBlock(index, offset - block_start, block_end - block_start,
+                   dest)) {
+      return false;
+    }
+    dest += block_end - offset;
+    offset = block_end;
+  }
+  return true;
+}
+
+bool S2CompressedByteSource::ReadBlock(uint64 index, size_t begin,
+                                       size_t end, char* dest) const {
+  uint64 start = (index == 0) ? 0 : block_offsets_[index - 1];
+  uint64 limit = block_offsets_[index];
+  if (start > limit) return false;
+  string compressed(limit - start, '\0');
+  if (!source_->Read(data_offset_ + start, compressed.size(),
+                     &compressed[0])) {
+    return false;
+  }
+  const size_t size = min<uint64>(block_size_, size_ - index * block_size_);
+  if (begin == 0 && end == size) {
+    return codec_->Decompress(compressed, size, dest);
+  }
+  string block(size, '\0');
+  if (!codec_->Decompress(compressed, size, &block[0])) return false;
+  memcpy(dest, block.data() + begin, end - begin);
+  return true;
+}
@@ -0,0 +1,134 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2COMPRESSED_BYTE_SOURCE_H_
+#define S2_S2COMPRESSED_BYTE_SOURCE_H_
+
+#include <cstddef>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "s2/base/integral_types.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/s2byte_source.h"
+#include "s2/util/coding/coder.h"
+
+// S2BlockCodec is an abstract interface for compressing independent blocks
+// of data.  Clients can implement it using a general-purpose compression
+// library (e.g., LZ4 or zstd); S2LzBlockCodec below is a simple built-in
+// implementation.  All implementations must be thread-safe.
+class S2BlockCodec {
+ public:
+  virtual ~S2BlockCodec() = default;
+
+  // Appends a compressed representation of "data" to "*output".
+  virtual void Compress(absl::string_view data, std::string* output) const = 0;
+
+  // Decompresses "data" into "dest", which has room for exactly
+  // "uncompressed_size" bytes.  Returns false if "data" is not a valid
+  // compressed representation of a block of that size.
+  virtual bool Decompress(absl::string_view data, size_t uncompressed_size,
+                          char* dest) const = 0;
+};
+
+// A fast LZ77-style codec with no external dependencies.  It finds repeated
+// sequences of 4 or more bytes using a hash table and replaces them with
+// back-references.  It works well on encoded S2 data (which contains many
+// repeated varints, cell ids, and shape ids), although general-purpose
+// libraries compress better.
+class S2LzBlockCodec final : public S2BlockCodec {
+ public:
+  void Compress(absl::string_view data, std::string* output) const override;
+  bool Decompress(absl::string_view data, size_t uncompressed_size,
+                  char* dest) const override;
+};
+
+// An S2ByteSource that decompresses data produced by
+// S2CompressedByteSource::Encode().  The data is divided into fixed-size
+// blocks that are compressed independently, so that any range of bytes can
+// be read by decompressing only the blocks that contain it.  This is useful
+// for storing encoded S2 data structures (e.g., an EncodedS2ShapeIndex and
+// its shapes) in cold storage, trading some CPU time for much smaller files.
+//
+// This class does not cache decompressed blocks itself.  To bound the
+// amount of decompressed data kept in memory, wrap it in an
+// S2CachingByteSource that uses the same block size:
+//
+//   // Writing:
+//   Encoder encoder;
+//   s2shapeutil::CompactEncodeTaggedShapes(index, &encoder);
+//   index.Encode(&encoder);
+//   Encoder compressed;
+//   S2LzBlockCodec codec;
+//   S2CompressedByteSource::Encode(
+//       absl::string_view(encoder.base(), encoder.length()), codec,
+//       64 << 10, &compressed);
+//
+//   // Reading:
+//   S2CompressedByteSource decompressed;
+//   if (!decompressed.Init(file.get(), &codec)) return ...;
+//   S2CachingByteSource source(&decompressed, 16 << 20,
+//                              decompressed.block_size());
+//   uint64 offset = 0;
+//   s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+//   EncodedS2ShapeIndex index;
+//   if (!shape_factory.Init(&source, &offset) ||
+//       !index.Init(&source, &offset, shape_factory)) { ... }
+class S2CompressedByteSource final : public S2ByteSource {
+ public:
+  // Compresses "data" in blocks of "block_size" bytes using the given codec,
+  // and appends the result to "encoder".
+  //
+  // REQUIRES: block_size > 0
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  static void Encode(absl::string_view data, const S2BlockCodec& codec,
+                     size_t block_size, Encoder* encoder);
+
+  // Constructs an empty source; requires Init() to be called.
+  S2CompressedByteSource() { block_offsets_.Clear(); }
+
+  // Initializes this object from data produced by Encode().  Only the block
+  // directory is read.  Returns false if the directory could not be read or
+  // is invalid.  The source and codec must outlive this object.
+  bool Init(const S2ByteSource* source, const S2BlockCodec* codec);
+
+  // Returns the size of the uncompressed blocks (except possibly the last).
+  size_t block_size() const { return block_size_; }
+
+  uint64 size() const override { return size_; }
+  bool Read(uint64 offset, size_t length, char* dest) const override;
+
+ private:
+  // Decompresses the bytes [begin, end) of the given block into "dest".
+  bool ReadBlock(uint64 index, size_t begin, size_t end, char* dest) const;
+
+  const S2ByteSource* source_ = nullptr;
+  const S2BlockCodec* codec_ = nullptr;
+  uint64 size_ = 0;
+  size_t block_size_ = 1;
+
+  // The offset of the first compressed block in "source_".
+  uint64 data_offset_ = 0;
+
+  // The end of each compressed block relative to data_offset_.
+  std::string block_offsets_data_;
+  s2coding::EncodedUintVector<uint64> block_offsets_;
+
+  S2CompressedByteSource(const S2CompressedByteSource&) = delete;
+  void operator=(const S2CompressedByteSource&) = delete;
+};
+
+#endif  // S2_S2COMPRESSED_BYTE_SOURCE_H_
@@ -0,0 +1,149 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2compressed_byte_source.h"
+
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "absl/memory/memory.h"
+#include "s2/encoded_s2shape_index.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2byte_source.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2loop.h"
+#include "s2/s2polygon.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2shapeutil_testing.h"
+#include "s2/s2testing.h"
+
+using absl::make_unique;
+using std::string;
+
+namespace {
+
+void TestRoundtrip(const string& data) {
+  S2LzBlockCodec codec;
+  string compressed;
+  codec.Compress(data, &compressed);
+  string actual(data.size(), '\0');
+  ASSERT_TRUE(codec.Decompress(compressed, data.size(), &actual[0]));
+  EXPECT_EQ(data, actual);
+
+  // Decompression fails if the size is wrong.
+  string longer(data.size() + 1, '\0');
+  EXPECT_FALSE(codec.Decompress(compressed, longer.size(), &longer[0]));
+}
+
+TEST(S2LzBlockCodec, Roundtrip) {
+  TestRoundtrip("");
+  TestRoundtrip("a");
+  TestRoundtrip("abcd");
+  TestRoundtrip(string(1000, 'x'));
+  TestRoundtrip("abcabcabcabcabcabcabcdabcdabcd");
+  string random;
+  for (int i = 0; i < 10000; ++i) {
+    random.push_back(S2Testing::rnd.Uniform(256));
+  }
+  TestRoundtrip(random);
+}
+
+TEST(S2LzBlockCodec, CompressesRepetitiveData) {
+  string data;
+  for (int i = 0; i < 1000; ++i) data += "0123456789";
+  string compressed;
+  S2LzBlockCodec().Compress(data, &compressed);
+  EXPECT_LT(compressed.size(), data.size() / 100);
+}
+
+TEST(S2CompressedByteSource, Read) {
+  string data;
+  for (int i = 0; i < 5000; ++i) {
+    data.push_back('a' + S2Testing::rnd.Uniform(4));
+  }
+  S2LzBlockCodec codec;
+  Encoder encoder;
+  S2CompressedByteSource::Encode(data, codec, 1000, &encoder);
+  string encoded(encoder.base(), encoder.length());
+  S2StringByteSource base(encoded);
+  S2CompressedByteSource source;
+  ASSERT_TRUE(source.Init(&base, &codec));
+  EXPECT_EQ(data.size(), source.size());
+  EXPECT_EQ(1000, source.block_size());
+
+  // Read ranges that start and end both at and between block boundaries.
+  for (int start : {0, 999, 1000, 2500, 4999, 5000}) {
+    for (int length : {0, 1, 1000, 1501}) {
+      if (start + length > data.size()) continue;
+      string actual(length, '\0');
+      ASSERT_TRUE(source.Read(start, length, &actual[0]));
+      EXPECT_EQ(data.substr(start, length), actual);
+    }
+  }
+  char buf[2];
+  EXPECT_FALSE(source.Read(4999, 2, buf));
+
+  // Corrupt or truncated data is detected.
+  S2StringByteSource truncated(
+      absl::string_view(encoded).substr(0, encoded.size() - 1));
+  EXPECT_FALSE(source.Init(&truncated, &codec));
+}
+
+TEST(S2CompressedByteSource, EncodedS2ShapeIndex) {
+  S2Testing::rnd.Reset(1);
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 20; ++i) {
+    index.Add(make_unique<S2Polygon::OwningShape>(
+        make_unique<S2Polygon>(S2Loop::MakeRegularLoop(
+            S2Testing::RandomPoint(), S1Angle::Degrees(5), 100))));
+  }
+  Encoder encoder;
+  s2shapeutil::CompactEncodeTaggedShapes(index, &encoder);
+  index.Encode(&encoder);
+  absl::string_view data(encoder.base(), encoder.length());
+
+  S2LzBlockCodec codec;
+  Encoder compressed_encoder;
+  S2CompressedByteSource::Encode(data, codec, 4 << 10, &compressed_encoder);
+  absl::string_view compressed(compressed_encoder.base(),
+                               compressed_encoder.length());
+  EXPECT_LT(compressed.size(), data.size());
+
+  S2StringByteSource base(compressed);
+  S2CompressedByteSource decompressed;
+  ASSERT_TRUE(decompressed.Init(&base, &codec));
+  S2CachingByteSource source(&decompressed, 16 << 10,
+                             decompressed.block_size());
+  uint64 offset = 0;
+  s2shapeutil::ByteSourceTaggedShapeFactory shape_factory;
+  EncodedS2ShapeIndex actual;
+  ASSERT_TRUE(shape_factory.Init(&source, &offset));
+  ASSERT_TRUE(actual.Init(&source, &offset, shape_factory));
+  EXPECT_EQ(data.size(), offset);
+  s2testing::ExpectEqual(index, actual);
+  EXPECT_LE(source.cache_bytes(), 16 << 10);
+
+  auto expected_query = MakeS2ContainsPointQuery(&index);
+  auto actual_query = MakeS2ContainsPointQuery(&actual);
+  for (int i = 0; i < 100; ++i) {
+    S2Point p = S2Testing::RandomPoint();
+    EXPECT_EQ(expected_query.Contains(p), actual_query.Contains(p));
+  }
+}
+
+}  // namespace
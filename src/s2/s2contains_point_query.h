@@ -18,13 +18,23 @@
 #ifndef S2_S2CONTAINS_POINT_QUERY_H_
 #define S2_S2CONTAINS_POINT_QUERY_H_
 
+#include <algorithm>
 #include <functional>
+#include <utility>
 #include <vector>
 
+#include "absl/types/span.h"
+#include "s2/base/integral_types.h"
+#include "s2/base/logging.h"
+#include "s2/s2cell_id.h"
 #include "s2/s2edge_crosser.h"
 #include "s2/s2shape_index.h"
+#include "s2/s2shapeutil_get_edges.h"
 #include "s2/s2shapeutil_shape_edge.h"
 
+template <class Data>
+class S2PointIndex;
+
 // Defines whether shapes are considered to contain their vertices.  Note that
 // these definitions differ from the ones used by S2BooleanOperation.
 //
@@ -60,8 +70,41 @@ class S2ContainsPointQueryOptions {
   S2VertexModel vertex_model() const;
   void set_vertex_model(S2VertexModel model);
 
+  // If positive, the query object remembers the index cells that contain
+  // recently tested points, so that later points near them are tested
+  // without searching the index.  This helps when most queries fall in a
+  // relatively small set of "hot" regions.  The cache has the given number
+  // of entries (rounded up to a power of two), and uses about 24 bytes per
+  // entry.  It is used by the single-point methods (Contains(p),
+  // ShapeContains(shape, p), VisitContainingShapes(p), and
+  // VisitIncidentEdges(p)); these methods then do not reposition
+  // mutable_iter() when a cached cell is used.
+  //
+  // The cache points to cells owned by the index, so Init() must be called
+  // again if the index is modified (or if EncodedS2ShapeIndex::Minimize()
+  // is called).
+  //
+  // DEFAULT: 0 (no cache)
+  int cell_cache_size() const;
+  void set_cell_cache_size(int cell_cache_size);
+
+  // The cache is organized by the S2CellId of each query point at this
+  // level.  Each cache entry remembers the index cell that contains (or
+  // overlaps) one such cell, or that no index cell intersects it.  This works
+  // best when the level is close to the level of the index cells where most
+  // points are tested: if the index cells are much larger, many cache
+  // entries are needed to cover them; if they are much smaller, a point only
+  // uses the cache when it is in the same index cell as the previous point
+  // that used the same entry.  Only relevant when cell_cache_size() > 0.
+  //
+  // DEFAULT: 14 (about 600 meters across)
+  int cell_cache_level() const;
+  void set_cell_cache_level(int level);
+
  private:
   S2VertexModel vertex_model_ = S2VertexModel::SEMI_OPEN;
+  int cell_cache_size_ = 0;
+  int8 cell_cache_level_ = 14;
 };
 
 // S2ContainsPointQuery determines whether one or more shapes in an
@@ -143,6 +186,47 @@ class S2ContainsPointQuery {
   using EdgeVisitor = std::function<bool (const s2shapeutil::ShapeEdge&)>;
   bool VisitIncidentEdges(const S2Point& p, const EdgeVisitor& visitor);
 
+  //////////////////////////// Batch Methods /////////////////////////////
+  //
+  // The following methods are equivalent to calling the corresponding
+  // single-point method for every point in a batch, but they are much faster
+  // when the batch is large (e.g., point-in-polygon joins).  The points are
+  // processed in S2CellId order, so that the index iterator only moves
+  // forward and consecutive points that fall in the same index cell are
+  // tested without repositioning it.
+
+  // Returns a vector whose i-th element is Contains(points[i]).
+  std::vector<bool> Contains(absl::Span<const S2Point> points);
+
+  // Visits all pairs (i, shape) such that "shape" contains points[i],
+  // terminating early if the given visitor returns false (in which case
+  // VisitContainingShapes returns false as well).  The pairs are visited in
+  // S2CellId order of the points (with ties broken by "i"), and each shape is
+  // visited at most once per point.
+  //
+  // ENSURES: shape != nullptr
+  using PointShapeVisitor = std::function<bool (int i, S2Shape* shape)>;
+  bool VisitContainingShapes(absl::Span<const S2Point> points,
+                             const PointShapeVisitor& visitor);
+
+  // Visits all pairs (point_data, shape) such that "shape" contains the point
+  // of an entry in the given S2PointIndex, terminating early if the given
+  // visitor returns false (in which case VisitContainedPoints returns false
+  // as well).  The two indexes are merged in S2CellId order, so that each
+  // point is tested only against the index cell that contains it and no
+  // geometric tests at all are needed for points in index cells that do not
+  // contain any edges (e.g., the interior of large polygons).  The pairs are
+  // visited in S2CellId order of the points.
+  //
+  // ENSURES: shape != nullptr
+  template <class Data>
+  using PointDataVisitor = std::function<
+      bool (const typename S2PointIndex<Data>::PointData& point_data,
+            S2Shape* shape)>;
+  template <class Data>
+  bool VisitContainedPoints(const S2PointIndex<Data>& point_index,
+                            const PointDataVisitor<Data>& visitor);
+
   /////////////////////////// Low-Level Methods ////////////////////////////
   //
   // Most clients will not need the following methods.  They can be slightly
@@ -159,9 +243,41 @@ class S2ContainsPointQuery {
                      const S2Point& p) const;
 
  private:
+  // Returns the indices of "points" sorted by the S2CellId of each point,
+  // with each index paired with the corresponding S2CellId.
+  static std::vector<std::pair<S2CellId, int>> SortByCellId(
+      absl::Span<const S2Point> points);
+
+  // Positions the iterator at the index cell containing "target" and returns
+  // true, or returns false if no index cell contains "target".
+  //
+  // REQUIRES: "target" is a leaf cell that is greater than or equal to the
+  //           target of the previous call since it_.Begin() was called.
+  bool LocateInOrder(S2CellId target);
+
+  // Returns the index cell containing "p" and sets "cell_id" to its id, or
+  // returns nullptr if no index cell contains "p".  Uses the cell cache if
+  // it is enabled (see Options::cell_cache_size).
+  const S2ShapeIndexCell* LocateCell(const S2Point& p, S2CellId* cell_id);
+
+  // Resizes and clears the cell cache according to options_.
+  void InitCellCache();
+
+  // An entry in the cell cache.  If "cell" is nullptr, no index cell
+  // intersects "key".  Otherwise "cell" is an index cell that intersects
+  // "key", but it may not contain the query point when the index cells are
+  // smaller than "key".
+  struct CellCacheEntry {
+    S2CellId key = S2CellId::None();
+    S2CellId cell_id;
+    const S2ShapeIndexCell* cell = nullptr;
+  };
+
   const IndexType* index_;
   Options options_;
   Iterator it_;
+  std::vector<CellCacheEntry> cell_cache_;
+  int cell_cache_shift_;  // Used to map a key to its cache entry.
 };
 
 // Returns an S2ContainsPointQuery for the given S2ShapeIndex.  Note that
@@ -191,6 +307,26 @@ inline void S2ContainsPointQueryOptions::set_vertex_model(S2VertexModel model) {
   vertex_model_ = model;
 }
 
+inline int S2ContainsPointQueryOptions::cell_cache_size() const {
+  return cell_cache_size_;
+}
+
+inline void S2ContainsPointQueryOptions::set_cell_cache_size(
+    int cell_cache_size) {
+  S2_DCHECK_GE(cell_cache_size, 0);
+  cell_cache_size_ = cell_cache_size;
+}
+
+inline int S2ContainsPointQueryOptions::cell_cache_level() const {
+  return cell_cache_level_;
+}
+
+inline void S2ContainsPointQueryOptions::set_cell_cache_level(int level) {
+  S2_DCHECK_GE(level, 0);
+  S2_DCHECK_LE(level, S2CellId::kMaxLevel);
+  cell_cache_level_ = level;
+}
+
 template <class IndexType>
 inline S2ContainsPointQuery<IndexType>::S2ContainsPointQuery()
     : index_(nullptr) {
@@ -200,6 +336,7 @@ template <class IndexType>
 inline S2ContainsPointQuery<IndexType>::S2ContainsPointQuery(
     const IndexType* index, const Options& options)
     : index_(index), options_(options), it_(index_) {
+  InitCellCache();
 }
 
 template <class IndexType>
@@ -214,16 +351,66 @@ void S2ContainsPointQuery<IndexType>::Init(const IndexType* index,
   index_ = index;
   options_ = options;
   it_.Init(index);
+  InitCellCache();
+}
+
+template <class IndexType>
+void S2ContainsPointQuery<IndexType>::InitCellCache() {
+  cell_cache_.clear();
+  if (options_.cell_cache_size() == 0) return;
+  int log2_size = 1;
+  while ((1 << log2_size) < options_.cell_cache_size()) ++log2_size;
+  cell_cache_.resize(1 << log2_size);
+  cell_cache_shift_ = 64 - log2_size;
+}
+
+template <class IndexType>
+const S2ShapeIndexCell* S2ContainsPointQuery<IndexType>::LocateCell(
+    const S2Point& p, S2CellId* cell_id) {
+  if (cell_cache_.empty()) {
+    if (!it_.Locate(p)) return nullptr;
+    *cell_id = it_.id();
+    return &it_.cell();
+  }
+  S2CellId target(p);
+  S2CellId key = target.parent(options_.cell_cache_level());
+  // The entry is chosen using the high bits of a multiplicative hash.
+  CellCacheEntry& entry =
+      cell_cache_[(key.id() * 0x9e3779b97f4a7c15ULL) >> cell_cache_shift_];
+  if (entry.key == key) {
+    if (entry.cell == nullptr) return nullptr;
+    if (entry.cell_id.contains(target)) {
+      *cell_id = entry.cell_id;
+      return entry.cell;
+    }
+  }
+  // Otherwise find out how "key" is related to the index cells.
+  entry.key = key;
+  S2ShapeIndex::CellRelation relation = it_.Locate(key);
+  if (relation == S2ShapeIndex::DISJOINT) {
+    entry.cell = nullptr;
+    return nullptr;
+  }
+  if (relation == S2ShapeIndex::SUBDIVIDED && !it_.Locate(p)) {
+    // The point is not in any index cell, but other points in "key" are.
+    entry.key = S2CellId::None();
+    return nullptr;
+  }
+  entry.cell_id = it_.id();
+  entry.cell = &it_.cell();
+  *cell_id = entry.cell_id;
+  return entry.cell;
 }
 
 template <class IndexType>
 bool S2ContainsPointQuery<IndexType>::Contains(const S2Point& p) {
-  if (!it_.Locate(p)) return false;
+  S2CellId cell_id;
+  const S2ShapeIndexCell* cell = LocateCell(p, &cell_id);
+  if (cell == nullptr) return false;
 
-  const S2ShapeIndexCell& cell = it_.cell();
-  int num_clipped = cell.num_clipped();
+  int num_clipped = cell->num_clipped();
   for (int s = 0; s < num_clipped; ++s) {
-    if (ShapeContains(it_.id(), cell.clipped(s), p)) return true;
+    if (ShapeContains(cell_id, cell->clipped(s), p)) return true;
   }
   return false;
 }
@@ -231,10 +418,12 @@ bool S2ContainsPointQuery<IndexType>::Contains(const S2Point& p) {
 template <class IndexType>
 bool S2ContainsPointQuery<IndexType>::ShapeContains(const S2Shape& shape,
                                                     const S2Point& p) {
-  if (!it_.Locate(p)) return false;
-  const S2ClippedShape* clipped = it_.cell().find_clipped(shape.id());
+  S2CellId cell_id;
+  const S2ShapeIndexCell* cell = LocateCell(p, &cell_id);
+  if (cell == nullptr) return false;
+  const S2ClippedShape* clipped = cell->find_clipped(shape.id());
   if (clipped == nullptr) return false;
-  return ShapeContains(it_.id(), *clipped, p);
+  return ShapeContains(cell_id, *clipped, p);
 }
 
 template <class IndexType>
@@ -242,16 +431,16 @@ bool S2ContainsPointQuery<IndexType>::VisitContainingShapes(
     const S2Point& p, const ShapeVisitor& visitor) {
   // This function returns "false" only if the algorithm terminates early
   // because the "visitor" function returned false.
-  if (!it_.Locate(p)) return true;
+  S2CellId cell_id;
+  const S2ShapeIndexCell* cell = LocateCell(p, &cell_id);
+  if (cell == nullptr) return true;
 
-  const S2ShapeIndexCell& cell = it_.cell();
-  int num_clipped = cell.num_clipped();
+  int num_clipped = cell->num_clipped();
   for (int s = 0; s < num_clipped; ++s) {
-    const S2ClippedShape& clipped = cell.clipped(s);
-    if (ShapeContains(it_.id(), clipped, p) &&
-        !visitor(index_->shape(clipped.shape_id()))) {
-      return false;
-    }
+    const S2ClippedShape& clipped = cell->clipped(s);
+    if (!ShapeContains(cell_id, clipped, p)) continue;
+    S2Shape* shape = index_->shape(clipped.shape_id());
+    if (shape != nullptr && !visitor(shape)) return false;
   }
   return true;
 }
@@ -261,15 +450,19 @@ bool S2ContainsPointQuery<IndexType>::VisitIncidentEdges(
     const S2Point& p, const EdgeVisitor& visitor) {
   // This function returns "false" only if the algorithm terminates early
   // because the "visitor" function returned false.
-  if (!it_.Locate(p)) return true;
+  S2CellId cell_id;
+  const S2ShapeIndexCell* cell_ptr = LocateCell(p, &cell_id);
+  if (cell_ptr == nullptr) return true;
 
-  const S2ShapeIndexCell& cell = it_.cell();
+  const S2ShapeIndexCell& cell = *cell_ptr;
   int num_clipped = cell.num_clipped();
   for (int s = 0; s < num_clipped; ++s) {
     const S2ClippedShape& clipped = cell.clipped(s);
     int num_edges = clipped.num_edges();
     if (num_edges == 0) continue;
-    const S2Shape& shape = *index_->shape(clipped.shape_id());
+    const S2Shape* shape_ptr = index_->shape(clipped.shape_id());
+    if (shape_ptr == nullptr) continue;  // See S2DeferredReadScope.
+    const S2Shape& shape = *shape_ptr;
     for (int i = 0; i < num_edges; ++i) {
       int edge_id = clipped.edge(i);
       auto edge = shape.edge(edge_id);
@@ -282,6 +475,115 @@ bool S2ContainsPointQuery<IndexType>::VisitIncidentEdges(
   return true;
 }
 
+template <class IndexType>
+std::vector<bool> S2ContainsPointQuery<IndexType>::Contains(
+    absl::Span<const S2Point> points) {
+  std::vector<bool> results(points.size());
+  it_.Begin();
+  for (const auto& entry : SortByCellId(points)) {
+    if (!LocateInOrder(entry.first)) continue;
+    const S2ShapeIndexCell& cell = it_.cell();
+    int num_clipped = cell.num_clipped();
+    for (int s = 0; s < num_clipped; ++s) {
+      if (ShapeContains(it_.id(), cell.clipped(s), points[entry.second])) {
+        results[entry.second] = true;
+        break;
+      }
+    }
+  }
+  return results;
+}
+
+template <class IndexType>
+bool S2ContainsPointQuery<IndexType>::VisitContainingShapes(
+    absl::Span<const S2Point> points, const PointShapeVisitor& visitor) {
+  it_.Begin();
+  for (const auto& entry : SortByCellId(points)) {
+    if (!LocateInOrder(entry.first)) continue;
+    const S2ShapeIndexCell& cell = it_.cell();
+    int num_clipped = cell.num_clipped();
+    for (int s = 0; s < num_clipped; ++s) {
+      const S2ClippedShape& clipped = cell.clipped(s);
+      if (ShapeContains(it_.id(), clipped, points[entry.second]) &&
+          !visitor(entry.second, index_->shape(clipped.shape_id()))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template <class IndexType>
+template <class Data>
+bool S2ContainsPointQuery<IndexType>::VisitContainedPoints(
+    const S2PointIndex<Data>& point_index,
+    const PointDataVisitor<Data>& visitor) {
+  typename S2PointIndex<Data>::Iterator pi(&point_index);
+  it_.Begin();
+  while (!pi.done() && !it_.done()) {
+    if (it_.id().range_max() < pi.id()) {
+      // Skip the index cells that precede the current point.
+      it_.Seek(pi.id());
+      if (it_.Prev() && it_.id().range_max() < pi.id()) it_.Next();
+      continue;
+    }
+    if (it_.id().range_min() > pi.id()) {
+      // Skip the points that precede the current index cell.
+      pi.Seek(it_.id().range_min());
+      continue;
+    }
+    // Test all the points in the current index cell.  Note that
+    // ShapeContains() does not need to test any edges for clipped shapes
+    // whose num_edges() is zero.
+    const S2CellId cell_id = it_.id();
+    const S2CellId range_max = cell_id.range_max();
+    const S2ShapeIndexCell& cell = it_.cell();
+    const int num_clipped = cell.num_clipped();
+    for (; !pi.done() && pi.id() <= range_max; pi.Next()) {
+      for (int s = 0; s < num_clipped; ++s) {
+        const S2ClippedShape& clipped = cell.clipped(s);
+        if (ShapeContains(cell_id, clipped, pi.point()) &&
+            !visitor(pi.point_data(), index_->shape(clipped.shape_id()))) {
+          return false;
+        }
+      }
+    }
+    it_.Next();
+  }
+  return true;
+}
+
+template <class IndexType>
+std::vector<std::pair<S2CellId, int>>
+S2ContainsPointQuery<IndexType>::SortByCellId(
+    absl::Span<const S2Point> points) {
+  std::vector<std::pair<S2CellId, int>> sorted;
+  sorted.reserve(points.size());
+  for (int i = 0; i < points.size(); ++i) {
+    sorted.push_back(std::make_pair(S2CellId(points[i]), i));
+  }
+  std::sort(sorted.begin(), sorted.end());
+  return sorted;
+}
+
+template <class IndexType>
+bool S2ContainsPointQuery<IndexType>::LocateInOrder(S2CellId target) {
+  // The iterator is positioned at or just before the first index cell whose
+  // range extends past the previous target, so usually "target" belongs
+  // either to the current cell or to the next one.  Otherwise we fall back
+  // to a binary search.  If the iterator is done then all remaining targets
+  // follow the last index cell.
+  if (it_.done()) return false;
+  if (it_.id().range_max() < target) {
+    it_.Next();
+    if (it_.done()) return false;
+    if (it_.id().range_max() < target) {
+      return it_.Locate(target) == S2ShapeIndex::INDEXED;
+    }
+  }
+  return it_.id().range_min() <= target;
+}
+
 template <class IndexType>
 std::vector<S2Shape*> S2ContainsPointQuery<IndexType>::GetContainingShapes(
     const S2Point& p) {
@@ -300,7 +602,10 @@ bool S2ContainsPointQuery<IndexType>::ShapeContains(
   bool inside = clipped.contains_center();
   const int num_edges = clipped.num_edges();
   if (num_edges > 0) {
-    const S2Shape& shape = *index_->shape(clipped.shape_id());
+    // Shapes that could not be read (see S2DeferredReadScope) are ignored.
+    const S2Shape* shape_ptr = index_->shape(clipped.shape_id());
+    if (shape_ptr == nullptr) return false;
+    const S2Shape& shape = *shape_ptr;
     if (shape.dimension() < 2) {
       // Points and polylines can be ignored unless the vertex model is CLOSED.
       if (options_.vertex_model() != S2VertexModel::CLOSED) return false;
@@ -313,21 +618,30 @@ bool S2ContainsPointQuery<IndexType>::ShapeContains(
       return false;
     }
     // Test containment by drawing a line segment from the cell center to the
-    // given point and counting edge crossings.
+    // given point and counting edge crossings.  The edges are fetched in
+    // blocks using s2shapeutil::GetClippedEdges(), which avoids a virtual
+    // call per edge for the shape types defined in this library.
+    static constexpr int kEdgeBlockSize = 16;
+    S2Shape::Edge edges[kEdgeBlockSize];
     S2CopyingEdgeCrosser crosser(cell_id.ToPoint(), p);
-    for (int i = 0; i < num_edges; ++i) {
-      auto edge = shape.edge(clipped.edge(i));
-      int sign = crosser.CrossingSign(edge.v0, edge.v1);
-      if (sign < 0) continue;
-      if (sign == 0) {
-        // For the OPEN and CLOSED models, check whether "p" is a vertex.
-        if (options_.vertex_model() != S2VertexModel::SEMI_OPEN &&
-            (edge.v0 == p || edge.v1 == p)) {
-          return (options_.vertex_model() == S2VertexModel::CLOSED);
+    for (int begin = 0; begin < num_edges; begin += kEdgeBlockSize) {
+      int end = std::min(begin + kEdgeBlockSize, num_edges);
+      s2shapeutil::GetClippedEdges(shape, clipped, begin, end, edges);
+      for (int i = 0; i < end - begin; ++i) {
+        const S2Shape::Edge& edge = edges[i];
+        int sign = crosser.CrossingSign(edge.v0, edge.v1);
+        if (sign < 0) continue;
+        if (sign == 0) {
+          // For the OPEN and CLOSED models, check whether "p" is a vertex.
+          if (options_.vertex_model() != S2VertexModel::SEMI_OPEN &&
+              (edge.v0 == p || edge.v1 == p)) {
+            return (options_.vertex_model() == S2VertexModel::CLOSED);
+          }
+          sign = S2::VertexCrossing(crosser.a(), crosser.b(),
+                                    edge.v0, edge.v1);
         }
-        sign = S2::VertexCrossing(crosser.a(), crosser.b(), edge.v0, edge.v1);
+        inside ^= sign;
       }
-      inside ^= sign;
     }
   }
   return inside;
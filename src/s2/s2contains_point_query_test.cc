@@ -17,7 +17,10 @@
 
 #include "s2/s2contains_point_query.h"
 
+#include <algorithm>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "s2/base/casts.h"
 #include <gtest/gtest.h>
@@ -25,6 +28,7 @@
 #include "s2/mutable_s2shape_index.h"
 #include "s2/s2cap.h"
 #include "s2/s2loop.h"
+#include "s2/s2point_index.h"
 #include "s2/s2testing.h"
 #include "s2/s2text_format.h"
 
@@ -134,6 +138,153 @@ TEST(S2ContainsPointQuery, GetContainingShapes) {
   }
 }
 
+TEST(S2ContainsPointQuery, BatchMethods) {
+  const S1Angle kMaxLoopRadius = S2Testing::KmToAngle(10);
+  const S2Cap center_cap(S2Testing::RandomPoint(), kMaxLoopRadius);
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 100; ++i) {
+    std::unique_ptr<S2Loop> loop = S2Loop::MakeRegularLoop(
+        S2Testing::SamplePoint(center_cap),
+        S2Testing::rnd.RandDouble() * kMaxLoopRadius, 10);
+    index.Add(make_unique<S2Loop::OwningShape>(std::move(loop)));
+  }
+  // Include points outside the loops, duplicate points, and vertices.
+  const S2Cap query_cap(center_cap.center(), 3 * kMaxLoopRadius);
+  vector<S2Point> points;
+  for (int i = 0; i < 1000; ++i) {
+    points.push_back(S2Testing::SamplePoint(query_cap));
+  }
+  points.push_back(points[0]);
+  points.push_back(index.shape(0)->edge(0).v0);
+  S2ContainsPointQueryOptions options(S2VertexModel::CLOSED);
+
+  auto query = MakeS2ContainsPointQuery(&index, options);
+  vector<bool> contained = query.Contains(points);
+  vector<vector<S2Shape*>> containing(points.size());
+  EXPECT_TRUE(query.VisitContainingShapes(
+      points, [&containing](int i, S2Shape* shape) {
+        containing[i].push_back(shape);
+        return true;
+      }));
+  int num_contained = 0;
+  for (int i = 0; i < points.size(); ++i) {
+    EXPECT_EQ(query.Contains(points[i]), contained[i]);
+    EXPECT_EQ(query.GetContainingShapes(points[i]), containing[i]);
+    num_contained += contained[i];
+  }
+  EXPECT_GT(num_contained, 0);
+  EXPECT_LT(num_contained, points.size());
+
+  // Check that the visitor can terminate early.
+  int num_visited = 0;
+  EXPECT_FALSE(query.VisitContainingShapes(
+      points, [&num_visited](int i, S2Shape* shape) {
+        return ++num_visited < 3;
+      }));
+  EXPECT_EQ(3, num_visited);
+
+  MutableS2ShapeIndex empty_index;
+  auto empty_query = MakeS2ContainsPointQuery(&empty_index);
+  EXPECT_EQ(vector<bool>(points.size()), empty_query.Contains(points));
+}
+
+TEST(S2ContainsPointQuery, CellCache) {
+  const S1Angle kMaxLoopRadius = S2Testing::KmToAngle(10);
+  const S2Cap center_cap(S2Testing::RandomPoint(), kMaxLoopRadius);
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 100; ++i) {
+    std::unique_ptr<S2Loop> loop = S2Loop::MakeRegularLoop(
+        S2Testing::SamplePoint(center_cap),
+        S2Testing::rnd.RandDouble() * kMaxLoopRadius, 10);
+    index.Add(make_unique<S2Loop::OwningShape>(std::move(loop)));
+  }
+  // Most points are near a few "hot" locations, and some are vertices.
+  const S2Cap query_cap(center_cap.center(), 3 * kMaxLoopRadius);
+  vector<S2Point> points;
+  for (int i = 0; i < 5; ++i) {
+    S2Cap hot_cap(S2Testing::SamplePoint(query_cap), S2Testing::KmToAngle(1));
+    for (int j = 0; j < 200; ++j) {
+      points.push_back(S2Testing::SamplePoint(hot_cap));
+    }
+  }
+  for (int i = 0; i < 200; ++i) {
+    points.push_back(S2Testing::SamplePoint(query_cap));
+  }
+  for (int i = 0; i < 10; ++i) points.push_back(index.shape(i)->edge(0).v0);
+  S2ContainsPointQueryOptions options(S2VertexModel::CLOSED);
+  auto expected_query = MakeS2ContainsPointQuery(&index, options);
+  for (int cache_size : {1, 64}) {
+    for (int level : {0, 8, 14, 20, S2CellId::kMaxLevel}) {
+      options.set_cell_cache_size(cache_size);
+      options.set_cell_cache_level(level);
+      auto query = MakeS2ContainsPointQuery(&index, options);
+      for (int iter = 0; iter < 2; ++iter) {
+        for (const S2Point& p : points) {
+          EXPECT_EQ(expected_query.Contains(p), query.Contains(p));
+          EXPECT_EQ(expected_query.GetContainingShapes(p),
+                    query.GetContainingShapes(p));
+          EXPECT_EQ(expected_query.ShapeContains(*index.shape(0), p),
+                    query.ShapeContains(*index.shape(0), p));
+          int num_expected = 0, num_actual = 0;
+          expected_query.VisitIncidentEdges(
+              p, [&](const s2shapeutil::ShapeEdge&) {
+                ++num_expected;
+                return true;
+              });
+          query.VisitIncidentEdges(p, [&](const s2shapeutil::ShapeEdge&) {
+              ++num_actual;
+              return true;
+            });
+          EXPECT_EQ(num_expected, num_actual);
+        }
+      }
+    }
+  }
+}
+
+TEST(S2ContainsPointQuery, VisitContainedPoints) {
+  const S1Angle kMaxLoopRadius = S2Testing::KmToAngle(10);
+  const S2Cap center_cap(S2Testing::RandomPoint(), kMaxLoopRadius);
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 20; ++i) {
+    std::unique_ptr<S2Loop> loop = S2Loop::MakeRegularLoop(
+        S2Testing::SamplePoint(center_cap),
+        S2Testing::rnd.RandDouble() * kMaxLoopRadius, 10);
+    index.Add(make_unique<S2Loop::OwningShape>(std::move(loop)));
+  }
+  const S2Cap query_cap(center_cap.center(), 2 * kMaxLoopRadius);
+  S2PointIndex<int> point_index;
+  for (int i = 0; i < 1000; ++i) {
+    point_index.Add(S2Testing::SamplePoint(query_cap), i);
+  }
+  auto query = MakeS2ContainsPointQuery(&index);
+  vector<std::pair<int, int>> expected, actual;
+  for (S2PointIndex<int>::Iterator it(&point_index); !it.done(); it.Next()) {
+    for (S2Shape* shape : query.GetContainingShapes(it.point())) {
+      expected.push_back(std::make_pair(it.data(), shape->id()));
+    }
+  }
+  EXPECT_FALSE(expected.empty());
+  EXPECT_TRUE(query.VisitContainedPoints(
+      point_index, [&actual](const S2PointIndex<int>::PointData& point_data,
+                             S2Shape* shape) {
+        actual.push_back(std::make_pair(point_data.data(), shape->id()));
+        return true;
+      }));
+  std::sort(expected.begin(), expected.end());
+  std::sort(actual.begin(), actual.end());
+  EXPECT_EQ(expected, actual);
+
+  // Check that the visitor can terminate early.
+  int num_visited = 0;
+  EXPECT_FALSE(query.VisitContainedPoints(
+      point_index,
+      [&num_visited](const S2PointIndex<int>::PointData&, S2Shape*) {
+        return ++num_visited < 3;
+      }));
+  EXPECT_EQ(3, num_visited);
+}
+
 using EdgeIdVector = vector<ShapeEdgeId>;
 
 void ExpectIncidentEdgeIds(const EdgeIdVector& expected,
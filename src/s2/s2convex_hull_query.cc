@@ -17,14 +17,17 @@
 //
 // This implements Andrew's monotone chain algorithm, which is a variant of the
 // Graham scan (see https://en.wikipedia.org/wiki/Graham_scan).  The time
-// complexity is O(n log n), and the space required is O(n).  In fact only the
-// call to "sort" takes O(n log n) time; the rest of the algorithm is linear.
+// complexity is O(n log n).  In fact only the call to "sort" takes O(n log n)
+// time; the rest of the algorithm is linear.  The points are periodically
+// replaced by their convex hull vertices so that the space required is
+// proportional to the size of the hull (see MaybeCompact).
 //
 // Demonstration of the algorithm and code:
 // en.wikibooks.org/wiki/Algorithm_Implementation/Geometry/Convex_hull/Monotone_chain
 
 #include "s2/s2convex_hull_query.h"
 
+#include <algorithm>
 #include <memory>
 
 #include "absl/memory/memory.h"
@@ -37,13 +40,19 @@ using absl::make_unique;
 using std::unique_ptr;
 using std::vector;
 
+// The minimum number of points that are accumulated before they are replaced
+// by their convex hull vertices.  This amortizes the cost of sorting.
+static constexpr size_t kMinCompactSize = 4096;
+
 S2ConvexHullQuery::S2ConvexHullQuery()
-    : bound_(S2LatLngRect::Empty()), points_() {
+    : bound_(S2LatLngRect::Empty()), points_(),
+      compact_size_(kMinCompactSize) {
 }
 
 void S2ConvexHullQuery::AddPoint(const S2Point& point) {
   bound_.AddPoint(point);
   points_.push_back(point);
+  if (points_.size() >= compact_size_) MaybeCompact();
 }
 
 void S2ConvexHullQuery::AddPolyline(const S2Polyline& polyline) {
@@ -51,6 +60,7 @@ void S2ConvexHullQuery::AddPolyline(const S2Polyline& polyline) {
   for (int i = 0; i < polyline.num_vertices(); ++i) {
     points_.push_back(polyline.vertex(i));
   }
+  if (points_.size() >= compact_size_) MaybeCompact();
 }
 
 void S2ConvexHullQuery::AddLoop(const S2Loop& loop) {
@@ -63,6 +73,7 @@ void S2ConvexHullQuery::AddLoop(const S2Loop& loop) {
   for (int i = 0; i < loop.num_vertices(); ++i) {
     points_.push_back(loop.vertex(i));
   }
+  if (points_.size() >= compact_size_) MaybeCompact();
 }
 
 void S2ConvexHullQuery::AddPolygon(const S2Polygon& polygon) {
@@ -75,6 +86,31 @@ void S2ConvexHullQuery::AddPolygon(const S2Polygon& polygon) {
   }
 }
 
+void S2ConvexHullQuery::Merge(const S2ConvexHullQuery& other) {
+  // Merging a query with itself does not change its convex hull.
+  if (&other == this) return;
+  bound_ = bound_.Union(other.bound_);
+  points_.insert(points_.end(), other.points_.begin(), other.points_.end());
+  if (points_.size() >= compact_size_) MaybeCompact();
+}
+
+// Replaces the points by their convex hull vertices, which does not change
+// the convex hull since every other point is contained by it.  This is also
+// true of collinear points, because s2pred::Sign() breaks ties using
+// symbolic perturbations, which are consistent for any subset of the points.
+// This is done whenever the number of points doubles, so the amortized cost
+// per point is constant (plus the logarithmic cost of sorting).
+void S2ConvexHullQuery::MaybeCompact() {
+  // If the cap bound is not convex, GetConvexHull() returns a full loop.  We
+  // keep all the points anyway since S2LatLngRect::GetCapBound() is not
+  // guaranteed to be monotonic (see the TODO in the unit test).
+  S2Cap cap = GetCapBound();
+  if (cap.height() < 1 - 10 * s2pred::DBL_ERR) {
+    ReduceToHullVertices(cap.center().Ortho());
+  }
+  compact_size_ = std::max(kMinCompactSize, 2 * points_.size());
+}
+
 S2Cap S2ConvexHullQuery::GetCapBound() {
   // We keep track of a rectangular bound rather than a spherical cap because
   // it is easy to compute a tight bound for a union of rectangles, whereas it
@@ -119,12 +155,7 @@ unique_ptr<S2Loop> S2ConvexHullQuery::GetConvexHull() {
   // ensures that as we scan through the points, each new point can only
   // belong at the end of the chain (i.e., the chain is monotone in terms of
   // the angle around O from the starting point).
-  S2Point origin = cap.center().Ortho();
-  std::sort(points_.begin(), points_.end(), OrderedCcwAround(origin));
-
-  // Remove duplicates.  We need to do this before checking whether there are
-  // fewer than 3 points.
-  points_.erase(std::unique(points_.begin(), points_.end()), points_.end());
+  ReduceToHullVertices(cap.center().Ortho());
 
   // Special cases for fewer than 3 points.
   if (points_.size() < 3) {
@@ -136,6 +167,21 @@ unique_ptr<S2Loop> S2ConvexHullQuery::GetConvexHull() {
       return GetSingleEdgeLoop(points_[0], points_[1]);
     }
   }
+  return make_unique<S2Loop>(points_);
+}
+
+// Sorts the points in CCW order around "origin" and removes duplicates.  If
+// at least 3 points remain, they are then replaced by the vertices of their
+// convex hull in CCW order.
+//
+// REQUIRES: All points lie within a 180 degree span around "origin".
+void S2ConvexHullQuery::ReduceToHullVertices(const S2Point& origin) {
+  std::sort(points_.begin(), points_.end(), OrderedCcwAround(origin));
+
+  // Remove duplicates.  We need to do this before checking whether there are
+  // fewer than 3 points.
+  points_.erase(std::unique(points_.begin(), points_.end()), points_.end());
+  if (points_.size() < 3) return;
 
   // Verify that all points lie within a 180 degree span around the origin.
   S2_DCHECK_GE(s2pred::Sign(origin, points_.front(), points_.back()), 0);
@@ -154,7 +200,7 @@ unique_ptr<S2Loop> S2ConvexHullQuery::GetConvexHull() {
   lower.pop_back();
   upper.pop_back();
   lower.insert(lower.end(), upper.begin(), upper.end());
-  return make_unique<S2Loop>(lower);
+  points_.swap(lower);
 }
 
 // Iterate through the given points, selecting the maximal subset of points
@@ -56,6 +56,17 @@
 // hull again.  If you want to start from scratch, simply declare a new
 // S2ConvexHullQuery object (they are cheap to create).
 //
+// The input points are not all kept: whenever enough points have been added,
+// they are replaced by the vertices of their convex hull (which does not
+// change the result).  This means that memory usage is proportional to the
+// number of convex hull vertices rather than the number of input points, so
+// that very large point streams can be processed.  (The exception is input
+// geometry whose bounding cap is not convex, which yields a full loop anyway;
+// in that case the points continue to accumulate.)
+//
+// To compute the convex hull of a point stream using several threads, give
+// each thread its own S2ConvexHullQuery and then combine them using Merge().
+//
 // This class is not thread-safe.  There are no "const" methods.
 class S2ConvexHullQuery {
  public:
@@ -73,6 +84,11 @@ class S2ConvexHullQuery {
   // Add a polygon to the input geometry.
   void AddPolygon(const S2Polygon& polygon);
 
+  // Add all the geometry that was added to "other".  The result is the same
+  // as if the geometry had been added to this query directly.  Merging a
+  // query with itself has no effect.
+  void Merge(const S2ConvexHullQuery& other);
+
   // Compute a bounding cap for the input geometry provided.
   //
   // Note that this method does not clear the geometry; you can continue
@@ -96,6 +112,8 @@ class S2ConvexHullQuery {
   std::unique_ptr<S2Loop> GetConvexHull();
 
  private:
+  void MaybeCompact();
+  void ReduceToHullVertices(const S2Point& origin);
   void GetMonotoneChain(std::vector<S2Point>* output);
   std::unique_ptr<S2Loop> GetSinglePointLoop(const S2Point& p);
   std::unique_ptr<S2Loop> GetSingleEdgeLoop(const S2Point& a, const S2Point& b);
@@ -103,6 +121,10 @@ class S2ConvexHullQuery {
   S2LatLngRect bound_;
   std::vector<S2Point> points_;
 
+  // When points_ reaches this size, it is replaced by the convex hull
+  // vertices of those points.
+  size_t compact_size_;
+
   S2ConvexHullQuery(const S2ConvexHullQuery&) = delete;
   void operator=(const S2ConvexHullQuery&) = delete;
 };
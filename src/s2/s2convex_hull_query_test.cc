@@ -20,8 +20,14 @@
 #include <cmath>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
+#include "absl/flags/flag.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2latlng.h"
+#include "s2/s2loop.h"
 #include "s2/s2testing.h"
 #include "s2/s2text_format.h"
 
@@ -228,4 +234,63 @@ TEST(S2ConvexHullQuery, PointsInsideHull) {
   }
 }
 
+TEST(S2ConvexHullQuery, ManyPointsInsideLoop) {
+  // Stream enough points that they are compacted several times, and check
+  // that the result is the loop that contains them.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  const S2Point center = MakePointOrDie("10:20");
+  auto loop = S2Loop::MakeRegularLoop(center, S1Angle::Degrees(5), 8);
+  S2Cap cap(center, S1Angle::Degrees(3));
+  S2ConvexHullQuery query;
+  for (int i = 0; i < 100000; ++i) {
+    query.AddPoint(S2Testing::SamplePoint(cap));
+    if (i == 50000) query.AddLoop(*loop);
+  }
+  unique_ptr<S2Loop> hull(query.GetConvexHull());
+  EXPECT_TRUE(hull->BoundaryEquals(*loop));
+}
+
+TEST(S2ConvexHullQuery, MergeGivesSameResult) {
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  S2Cap cap = S2Testing::GetRandomCap(0.01, 0.1);
+  S2ConvexHullQuery all;
+  vector<unique_ptr<S2ConvexHullQuery>> parts;
+  for (int i = 0; i < 4; ++i) parts.emplace_back(new S2ConvexHullQuery);
+  for (int i = 0; i < 20000; ++i) {
+    S2Point p = S2Testing::SamplePoint(cap);
+    all.AddPoint(p);
+    parts[i % parts.size()]->AddPoint(p);
+  }
+  S2ConvexHullQuery merged;
+  for (const auto& part : parts) merged.Merge(*part);
+  unique_ptr<S2Loop> expected(all.GetConvexHull());
+  unique_ptr<S2Loop> actual(merged.GetConvexHull());
+  EXPECT_TRUE(actual->Equals(*expected));
+  EXPECT_EQ(all.GetCapBound(), merged.GetCapBound());
+}
+
+TEST(S2ConvexHullQuery, MergeWithSelf) {
+  S2ConvexHullQuery query;
+  query.AddLoop(*s2textformat::MakeLoopOrDie("0:0, 0:10, 10:0"));
+  unique_ptr<S2Loop> expected(query.GetConvexHull());
+  query.Merge(query);
+  unique_ptr<S2Loop> actual(query.GetConvexHull());
+  EXPECT_TRUE(actual->Equals(*expected));
+}
+
+TEST(S2ConvexHullQuery, ManyCollinearPoints) {
+  // Points on the equator are exactly collinear, so their convex hull is
+  // determined by symbolic perturbations.  Every point is a vertex of the
+  // result, and this must not change when the points are compacted.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  const int kNumPoints = 10000;
+  S2ConvexHullQuery query;
+  for (int i = 0; i < kNumPoints; ++i) {
+    query.AddPoint(S2LatLng::FromDegrees(
+        0, S2Testing::rnd.UniformDouble(0, 10)).ToPoint());
+  }
+  unique_ptr<S2Loop> hull(query.GetConvexHull());
+  EXPECT_EQ(kNumPoints, hull->num_vertices());
+}
+
 }  // namespace
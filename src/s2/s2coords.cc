@@ -27,32 +27,6 @@ namespace internal {
 
 static_assert(kSwapMask == 0x01 && kInvertMask == 0x02, "masks changed");
 
-// kIJtoPos[orientation][ij] -> pos
-const int kIJtoPos[4][4] = {
-  // (0,0) (0,1) (1,0) (1,1)
-  {     0,    1,    3,    2  },  // canonical order
-  {     0,    3,    1,    2  },  // axes swapped
-  {     2,    3,    1,    0  },  // bits inverted
-  {     2,    1,    3,    0  },  // swapped & inverted
-};
-
-// kPosToIJ[orientation][pos] -> ij
-const int kPosToIJ[4][4] = {
-  // 0  1  2  3
-  {  0, 1, 3, 2 },    // canonical order:    (0,0), (0,1), (1,1), (1,0)
-  {  0, 2, 3, 1 },    // axes swapped:       (0,0), (1,0), (1,1), (0,1)
-  {  3, 2, 0, 1 },    // bits inverted:      (1,1), (1,0), (0,0), (0,1)
-  {  3, 1, 0, 2 },    // swapped & inverted: (1,1), (0,1), (0,0), (1,0)
-};
-
-// kPosToOrientation[pos] -> orientation_modifier
-const int kPosToOrientation[4] = {
-  kSwapMask,
-  0,
-  0,
-  kInvertMask + kSwapMask,
-};
-
 const int kFaceUVWFaces[6][3][2] = {
   { { 4, 1 }, { 5, 2 }, { 3, 0 } },
   { { 0, 3 }, { 5, 2 }, { 4, 1 } },
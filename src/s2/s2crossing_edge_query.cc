@@ -20,12 +20,14 @@
 #include <algorithm>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "s2/base/logging.h"
 #include "s2/r1interval.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2edge_clipping.h"
 #include "s2/s2edge_crosser.h"
 #include "s2/s2shapeutil_count_edges.h"
+#include "s2/s2shapeutil_get_edges.h"
 
 using s2shapeutil::ShapeEdge;
 using s2shapeutil::ShapeEdgeId;
@@ -44,6 +46,8 @@ S2CrossingEdgeQuery::~S2CrossingEdgeQuery() {
 void S2CrossingEdgeQuery::Init(const S2ShapeIndex* index) {
   index_ = index;
   iter_.Init(index);
+  // VisitSegmentCells() expects the iterator to be positioned.
+  iter_.Finish();
 }
 
 vector<s2shapeutil::ShapeEdge> S2CrossingEdgeQuery::GetCrossingEdges(
@@ -65,22 +69,133 @@ void S2CrossingEdgeQuery::GetCrossingEdges(
     const S2Point& a0, const S2Point& a1, CrossingType type,
     vector<ShapeEdge>* edges) {
   edges->clear();
-  GetCandidates(a0, a1, &tmp_candidates_);
   int min_sign = (type == CrossingType::ALL) ? 0 : 1;
   S2CopyingEdgeCrosser crosser(a0, a1);
-  int shape_id = -1;
-  const S2Shape* shape = nullptr;
-  for (ShapeEdgeId candidate : tmp_candidates_) {
-    if (candidate.shape_id != shape_id) {
-      shape_id = candidate.shape_id;
-      shape = index_->shape(shape_id);
+  int num_edges = s2shapeutil::CountEdgesUpTo(*index_, kMaxBruteForceEdges + 1);
+  if (num_edges <= kMaxBruteForceEdges) {
+    GetCandidates(a0, a1, &tmp_candidates_);
+  } else {
+    // Edges that are stored in their index cells (see
+    // MutableS2ShapeIndex::Options::cache_edges) are tested as the cells are
+    // visited.  This may test an edge more than once, so duplicates are
+    // removed at the end.  The remaining edges are gathered as candidates.
+    tmp_candidates_.clear();
+    VisitCells(a0, a1, [&](const S2ShapeIndexCell& cell) {
+        const S2Shape::Edge* cached_edges = index_->cached_edges(cell);
+        for (int s = 0; s < cell.num_clipped(); ++s) {
+          const S2ClippedShape& clipped = cell.clipped(s);
+          for (int j = 0; j < clipped.num_edges(); ++j) {
+            if (cached_edges == nullptr) {
+              tmp_candidates_.push_back(
+                  ShapeEdgeId(clipped.shape_id(), clipped.edge(j)));
+            } else {
+              const S2Shape::Edge& b = *cached_edges++;
+              if (crosser.CrossingSign(b.v0, b.v1) >= min_sign) {
+                edges->push_back(
+                    ShapeEdge(clipped.shape_id(), clipped.edge(j), b));
+              }
+            }
+          }
+        }
+        return true;
+      });
+    if (tmp_candidates_.size() > 1) {
+      std::sort(tmp_candidates_.begin(), tmp_candidates_.end());
+      tmp_candidates_.erase(
+          std::unique(tmp_candidates_.begin(), tmp_candidates_.end()),
+          tmp_candidates_.end());
+    }
+  }
+  bool tested_cached_edges = !edges->empty();
+  // Consecutive candidates generally belong to the same shape, so their
+  // edges are fetched one run of candidates at a time (which avoids a virtual
+  // call per edge, see s2shapeutil::GetEdges).
+  tmp_edges_.resize(tmp_candidates_.size());
+  for (size_t i = 0, j; i < tmp_candidates_.size(); i = j) {
+    int shape_id = tmp_candidates_[i].shape_id;
+    for (j = i + 1; j < tmp_candidates_.size() &&
+                    tmp_candidates_[j].shape_id == shape_id; ++j) {
     }
-    int edge_id = candidate.edge_id;
-    S2Shape::Edge b = shape->edge(edge_id);
+    s2shapeutil::GetEdges(
+        *index_->shape(shape_id),
+        absl::MakeConstSpan(tmp_candidates_.data() + i, j - i),
+        tmp_edges_.data() + i);
+  }
+  for (size_t i = 0; i < tmp_candidates_.size(); ++i) {
+    const S2Shape::Edge& b = tmp_edges_[i];
     if (crosser.CrossingSign(b.v0, b.v1) >= min_sign) {
-      edges->push_back(ShapeEdge(shape_id, edge_id, b));
+      edges->push_back(ShapeEdge(tmp_candidates_[i].shape_id,
+                                 tmp_candidates_[i].edge_id, b));
     }
   }
+  if (tested_cached_edges) {
+    auto by_id = [](const ShapeEdge& x, const ShapeEdge& y) {
+      return x.id() < y.id();
+    };
+    std::sort(edges->begin(), edges->end(), by_id);
+    edges->erase(std::unique(edges->begin(), edges->end(),
+                             [](const ShapeEdge& x, const ShapeEdge& y) {
+                               return x.id() == y.id();
+                             }),
+                 edges->end());
+  }
+}
+
+vector<int> S2CrossingEdgeQuery::GetCrossingShapeIds(S2PointSpan polyline,
+                                                     CrossingType type) {
+  vector<int> shape_ids;
+  GetCrossingShapeIds(polyline, type, &shape_ids);
+  return shape_ids;
+}
+
+void S2CrossingEdgeQuery::GetCrossingShapeIds(S2PointSpan polyline,
+                                              CrossingType type,
+                                              vector<int>* shape_ids) {
+  shape_ids->clear();
+  int min_sign = (type == CrossingType::ALL) ? 0 : 1;
+  int num_edges = s2shapeutil::CountEdgesUpTo(*index_, kMaxBruteForceEdges + 1);
+  absl::flat_hash_set<int> crossed;
+  for (int i = 0; i + 1 < static_cast<int>(polyline.size()); ++i) {
+    S2CopyingEdgeCrosser crosser(polyline[i], polyline[i + 1]);
+    if (num_edges <= kMaxBruteForceEdges) {
+      for (int s = 0; s < index_->num_shape_ids(); ++s) {
+        const S2Shape* shape = index_->shape(s);
+        if (shape == nullptr || crossed.contains(s)) continue;
+        for (int e = 0; e < shape->num_edges(); ++e) {
+          S2Shape::Edge b = shape->edge(e);
+          if (crosser.CrossingSign(b.v0, b.v1) >= min_sign) {
+            crossed.insert(s);
+            break;
+          }
+        }
+      }
+      continue;
+    }
+    VisitCells(polyline[i], polyline[i + 1], [&](const S2ShapeIndexCell& cell) {
+        const S2Shape::Edge* cached_edges = index_->cached_edges(cell);
+        for (int s = 0; s < cell.num_clipped(); ++s) {
+          const S2ClippedShape& clipped = cell.clipped(s);
+          int shape_id = clipped.shape_id();
+          if (crossed.contains(shape_id)) {
+            if (cached_edges != nullptr) cached_edges += clipped.num_edges();
+            continue;
+          }
+          const S2Shape* shape = index_->shape(shape_id);
+          for (int j = 0; j < clipped.num_edges(); ++j) {
+            S2Shape::Edge b = (cached_edges != nullptr) ?
+                              cached_edges[j] : shape->edge(clipped.edge(j));
+            if (crosser.CrossingSign(b.v0, b.v1) >= min_sign) {
+              crossed.insert(shape_id);
+              break;
+            }
+          }
+          if (cached_edges != nullptr) cached_edges += clipped.num_edges();
+        }
+        return true;
+      });
+  }
+  shape_ids->assign(crossed.begin(), crossed.end());
+  std::sort(shape_ids->begin(), shape_ids->end());
 }
 
 void S2CrossingEdgeQuery::GetCrossingEdges(
@@ -90,11 +205,12 @@ void S2CrossingEdgeQuery::GetCrossingEdges(
   GetCandidates(a0, a1, shape, &tmp_candidates_);
   int min_sign = (type == CrossingType::ALL) ? 0 : 1;
   S2CopyingEdgeCrosser crosser(a0, a1);
-  for (ShapeEdgeId candidate : tmp_candidates_) {
-    int edge_id = candidate.edge_id;
-    S2Shape::Edge b = shape.edge(edge_id);
+  tmp_edges_.resize(tmp_candidates_.size());
+  s2shapeutil::GetEdges(shape, tmp_candidates_, tmp_edges_.data());
+  for (size_t i = 0; i < tmp_candidates_.size(); ++i) {
+    const S2Shape::Edge& b = tmp_edges_[i];
     if (crosser.CrossingSign(b.v0, b.v1) >= min_sign) {
-      edges->push_back(ShapeEdge(shape.id(), edge_id, b));
+      edges->push_back(ShapeEdge(shape.id(), tmp_candidates_[i].edge_id, b));
     }
   }
 }
@@ -148,6 +264,37 @@ void S2CrossingEdgeQuery::GetCandidates(const S2Point& a0, const S2Point& a1,
   }
 }
 
+vector<ShapeEdgeId> S2CrossingEdgeQuery::GetCandidates(S2PointSpan polyline) {
+  vector<ShapeEdgeId> edges;
+  GetCandidates(polyline, &edges);
+  return edges;
+}
+
+void S2CrossingEdgeQuery::GetCandidates(S2PointSpan polyline,
+                                        vector<ShapeEdgeId>* edges) {
+  edges->clear();
+  if (polyline.size() < 2) return;
+  int num_edges = s2shapeutil::CountEdgesUpTo(*index_, kMaxBruteForceEdges + 1);
+  if (num_edges <= kMaxBruteForceEdges) {
+    // Every edge is a candidate for the first polyline edge already.
+    GetCandidates(polyline[0], polyline[1], edges);
+    return;
+  }
+  VisitCells(polyline, [edges](const S2ShapeIndexCell& cell) {
+      for (int s = 0; s < cell.num_clipped(); ++s) {
+        const S2ClippedShape& clipped = cell.clipped(s);
+        for (int j = 0; j < clipped.num_edges(); ++j) {
+          edges->push_back(ShapeEdgeId(clipped.shape_id(), clipped.edge(j)));
+        }
+      }
+      return true;
+    });
+  if (edges->size() > 1) {
+    std::sort(edges->begin(), edges->end());
+    edges->erase(std::unique(edges->begin(), edges->end()), edges->end());
+  }
+}
+
 bool S2CrossingEdgeQuery::VisitRawCandidates(
     const S2Point& a0, const S2Point& a1, const ShapeEdgeIdVisitor& visitor) {
   int num_edges = s2shapeutil::CountEdgesUpTo(*index_, kMaxBruteForceEdges + 1);
@@ -202,41 +349,86 @@ bool S2CrossingEdgeQuery::VisitCells(const S2Point& a0, const S2Point& a1,
   S2::FaceSegmentVector segments;
   S2::GetFaceSegments(a0, a1, &segments);
   for (const auto& segment : segments) {
-    a0_ = segment.a;
-    a1_ = segment.b;
+    if (!VisitSegmentCells(segment)) return false;
+  }
+  return true;
+}
 
-    // Optimization: rather than always starting the recursive subdivision at
-    // the top level face cell, instead we start at the smallest S2CellId that
-    // contains the edge (the "edge root cell").  This typically lets us skip
-    // quite a few levels of recursion since most edges are short.
-    R2Rect edge_bound = R2Rect::FromPointPair(a0_, a1_);
-    S2PaddedCell pcell(S2CellId::FromFace(segment.face), 0);
-    S2CellId edge_root = pcell.ShrinkToFit(edge_bound);
-
-    // Now we need to determine how the edge root cell is related to the cells
-    // in the spatial index (cell_map_).  There are three cases:
-    //
-    //  1. edge_root is an index cell or is contained within an index cell.
-    //     In this case we only need to look at the contents of that cell.
-    //  2. edge_root is subdivided into one or more index cells.  In this case
-    //     we recursively subdivide to find the cells intersected by a0a1.
-    //  3. edge_root does not intersect any index cells.  In this case there
-    //     is nothing to do.
-    S2ShapeIndex::CellRelation relation = iter_.Locate(edge_root);
-    if (relation == S2ShapeIndex::INDEXED) {
-      // edge_root is an index cell or is contained by an index cell (case 1).
-      S2_DCHECK(iter_.id().contains(edge_root));
-      if (!visitor(iter_.cell())) return false;
-    } else if (relation == S2ShapeIndex::SUBDIVIDED) {
-      // edge_root is subdivided into one or more index cells (case 2).  We
-      // find the cells intersected by a0a1 using recursive subdivision.
-      if (!edge_root.is_face()) pcell = S2PaddedCell(edge_root, 0);
-      if (!VisitCells(pcell, edge_bound)) return false;
+bool S2CrossingEdgeQuery::VisitCells(S2PointSpan polyline,
+                                     const CellVisitor& visitor) {
+  // A cell may be intersected by several polyline edges (e.g. consecutive
+  // edges always share the cell containing their common vertex), so we keep
+  // track of the cells that have already been visited.  The iterator is
+  // positioned at the cell being visited when the visitor is called.
+  absl::flat_hash_set<S2CellId> visited;
+  CellVisitor visit_once = [&](const S2ShapeIndexCell& cell) {
+    if (!visited.insert(iter_.id()).second) return true;
+    return visitor(cell);
+  };
+  visitor_ = &visit_once;
+  S2::FaceSegmentVector segments;
+  const int n = polyline.size();
+  const bool prefetch = iter_.can_prefetch();
+  for (int i = 0; i + 1 < n; ++i) {
+    // Start loading the index data for the end of the next edge while this
+    // edge is being processed (if the iterator supports it).  The last edge
+    // has no next edge, so the vertex after polyline[i + 1] must not be
+    // accessed.
+    if (prefetch && i + 2 < n) iter_.Prefetch(S2CellId(polyline[i + 2]));
+    S2::GetFaceSegments(polyline[i], polyline[i + 1], &segments);
+    for (const auto& segment : segments) {
+      if (!VisitSegmentCells(segment)) return false;
     }
   }
   return true;
 }
 
+// Calls visitor_ for each index cell that might intersect the given edge
+// segment, and sets a0_ and a1_ to the segment endpoints.
+bool S2CrossingEdgeQuery::VisitSegmentCells(const S2::FaceSegment& segment) {
+  a0_ = segment.a;
+  a1_ = segment.b;
+
+  // Optimization: rather than always starting the recursive subdivision at
+  // the top level face cell, instead we start at the smallest S2CellId that
+  // contains the edge (the "edge root cell").  This typically lets us skip
+  // quite a few levels of recursion since most edges are short.
+  R2Rect edge_bound = R2Rect::FromPointPair(a0_, a1_);
+  S2PaddedCell pcell(S2CellId::FromFace(segment.face), 0);
+  S2CellId edge_root = pcell.ShrinkToFit(edge_bound);
+
+  // Now we need to determine how the edge root cell is related to the cells
+  // in the spatial index (cell_map_).  There are three cases:
+  //
+  //  1. edge_root is an index cell or is contained within an index cell.
+  //     In this case we only need to look at the contents of that cell.
+  //  2. edge_root is subdivided into one or more index cells.  In this case
+  //     we recursively subdivide to find the cells intersected by a0a1.
+  //  3. edge_root does not intersect any index cells.  In this case there
+  //     is nothing to do.
+  //
+  // Queries often consist of nearby edges (e.g. the edges of a polyline), so
+  // we first check whether the cell where the iterator was left by the
+  // previous edge contains edge_root, which avoids seeking in the index.
+  S2ShapeIndex::CellRelation relation;
+  if (!iter_.done() && iter_.id().contains(edge_root)) {
+    relation = S2ShapeIndex::INDEXED;
+  } else {
+    relation = iter_.Locate(edge_root);
+  }
+  if (relation == S2ShapeIndex::INDEXED) {
+    // edge_root is an index cell or is contained by an index cell (case 1).
+    S2_DCHECK(iter_.id().contains(edge_root));
+    return (*visitor_)(iter_.cell());
+  } else if (relation == S2ShapeIndex::SUBDIVIDED) {
+    // edge_root is subdivided into one or more index cells (case 2).  We
+    // find the cells intersected by a0a1 using recursive subdivision.
+    if (!edge_root.is_face()) pcell = S2PaddedCell(edge_root, 0);
+    return VisitCells(pcell, edge_bound);
+  }
+  return true;
+}
+
 bool S2CrossingEdgeQuery::VisitCells(
     const S2Point& a0, const S2Point& a1, const S2PaddedCell& root,
     const CellVisitor& visitor) {
@@ -27,7 +27,9 @@
 #include "s2/_fp_contract_off.h"
 #include "s2/r2.h"
 #include "s2/r2rect.h"
+#include "s2/s2edge_clipping.h"
 #include "s2/s2padded_cell.h"
+#include "s2/s2point_span.h"
 #include "s2/s2shape_index.h"
 #include "s2/s2shapeutil_shape_edge.h"
 #include "s2/s2shapeutil_shape_edge_id.h"
@@ -105,6 +107,24 @@ class S2CrossingEdgeQuery {
                         const S2Shape& shape, CrossingType type,
                         std::vector<s2shapeutil::ShapeEdge>* edges);
 
+  // Returns the ids of all shapes that have at least one edge intersecting
+  // some edge of the given polyline with the given CrossingType (ALL or
+  // INTERIOR).  Shape ids are sorted and unique.
+  //
+  // This is faster than calling GetCrossingEdges() for each polyline edge,
+  // since consecutive edges are located starting from the index cell where
+  // the previous edge ended, and the remaining edges of a shape are not
+  // tested once that shape is known to be crossed.
+  //
+  // Note that shapes that contain the polyline without being crossed by it
+  // are not reported (see S2ContainsPointQuery).
+  std::vector<int> GetCrossingShapeIds(S2PointSpan polyline, CrossingType type);
+
+  // This version can be more efficient when it is called many times, since it
+  // does not require allocating a new vector on each call.
+  void GetCrossingShapeIds(S2PointSpan polyline, CrossingType type,
+                           std::vector<int>* shape_ids);
+
 
   /////////////////////////// Low-Level Methods ////////////////////////////
   //
@@ -132,6 +152,17 @@ class S2CrossingEdgeQuery {
   void GetCandidates(const S2Point& a0, const S2Point& a1, const S2Shape& shape,
                      std::vector<s2shapeutil::ShapeEdgeId>* edges);
 
+  // Returns a superset of the edges that intersect any edge of the given
+  // polyline.  Edges are sorted and unique.  This is faster than calling
+  // GetCandidates() for each polyline edge and merging the results (see
+  // VisitCells() below).
+  std::vector<s2shapeutil::ShapeEdgeId> GetCandidates(S2PointSpan polyline);
+
+  // This version can be more efficient when it is called many times, since it
+  // does not require allocating a new vector on each call.
+  void GetCandidates(S2PointSpan polyline,
+                     std::vector<s2shapeutil::ShapeEdgeId>* edges);
+
   // A function that is called with each candidate intersecting edge.  The
   // function may return false in order to request that the algorithm should
   // be terminated, i.e. no further crossings are needed.
@@ -164,6 +195,17 @@ class S2CrossingEdgeQuery {
   bool VisitCells(const S2Point& a0, const S2Point& a1,
                   const CellVisitor& visitor);
 
+  // Visits all S2ShapeIndexCells that might contain edges intersecting some
+  // edge of the given polyline, terminating early if the given CellVisitor
+  // returns false (in which case this function returns false as well).  Each
+  // edge is located starting from the index cell where the previous edge
+  // ended, which avoids searching the index from scratch when consecutive
+  // edges are short.
+  //
+  // NOTE: Each candidate cell is visited exactly once, even if it is
+  // intersected by several polyline edges.
+  bool VisitCells(S2PointSpan polyline, const CellVisitor& visitor);
+
   // Visits all S2ShapeIndexCells within "root" that might contain edges
   // intersecting the given query edge (a0, a1), terminating early if the
   // given CellVisitor returns false (in which case this function returns
@@ -189,6 +231,7 @@ class S2CrossingEdgeQuery {
  private:
   // Internal methods are documented with their definitions.
   bool VisitCells(const S2PaddedCell& pcell, const R2Rect& edge_bound);
+  bool VisitSegmentCells(const S2::FaceSegment& segment);
   bool ClipVAxis(const R2Rect& edge_bound, double center, int i,
                  const S2PaddedCell& pcell);
   void SplitUBound(const R2Rect& edge_bound, double u,
@@ -208,6 +251,7 @@ class S2CrossingEdgeQuery {
 
   // Avoids repeated allocation when methods are called many times.
   std::vector<s2shapeutil::ShapeEdgeId> tmp_candidates_;
+  std::vector<S2Shape::Edge> tmp_edges_;
 };
 
 
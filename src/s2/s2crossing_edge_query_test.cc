@@ -37,6 +37,7 @@
 #include "s2/s2edge_crossings.h"
 #include "s2/s2edge_distances.h"
 #include "s2/s2edge_vector_shape.h"
+#include "s2/s2loop.h"
 #include "s2/s2metrics.h"
 #include "s2/s2polyline.h"
 #include "s2/s2testing.h"
@@ -125,6 +126,14 @@ void TestAllCrossings(const vector<TestEdge>& edges) {
   MutableS2ShapeIndex index(options);
   const int shape_id = index.Add(absl::WrapUnique(shape));
   EXPECT_EQ(0, shape_id);
+  // Also build an index whose cells store their edges.
+  options.set_cache_edges(true);
+  MutableS2ShapeIndex cached_index(options);
+  auto cached_shape = make_unique<S2EdgeVectorShape>();
+  for (const TestEdge& edge : edges) {
+    cached_shape->Add(edge.first, edge.second);
+  }
+  cached_index.Add(std::move(cached_shape));
   // To check that candidates are being filtered reasonably, we count the
   // total number of candidates that the total number of edge pairs that
   // either intersect or are very close to intersecting.
@@ -192,6 +201,14 @@ void TestAllCrossings(const vector<TestEdge>& edges) {
         query.GetCrossingEdges(a, b, *shape, CrossingType::INTERIOR);
     EXPECT_EQ(expected_interior_crossings,
               GetShapeEdgeIds(actual_interior_crossings));
+
+    // Verify that the cached edges yield the same crossings.
+    S2CrossingEdgeQuery cached_query(&cached_index);
+    EXPECT_EQ(expected_crossings, GetShapeEdgeIds(cached_query.GetCrossingEdges(
+                                      a, b, CrossingType::ALL)));
+    EXPECT_EQ(expected_interior_crossings,
+              GetShapeEdgeIds(cached_query.GetCrossingEdges(
+                  a, b, CrossingType::INTERIOR)));
   }
   // There is nothing magical about this particular ratio; this check exists
   // to catch changes that dramatically increase the number of candidates.
@@ -327,6 +344,98 @@ TEST(GetCrossings, ShapeIdsAreCorrect) {
   TestPolylineCrossings(index, MakePointOrDie("1:-10"), MakePointOrDie("1:30"));
 }
 
+// Checks that the polyline versions of GetCandidates() and
+// GetCrossingShapeIds() agree with calling the edge versions for each edge.
+void TestPolylineQuery(const S2ShapeIndex& index, S2PointSpan a) {
+  S2CrossingEdgeQuery query(&index);
+  vector<ShapeEdgeId> expected_candidates;
+  vector<int> expected_all, expected_interior;
+  for (int i = 0; i + 1 < a.size(); ++i) {
+    for (const auto& id : query.GetCandidates(a[i], a[i + 1])) {
+      expected_candidates.push_back(id);
+    }
+    for (const auto& edge :
+             query.GetCrossingEdges(a[i], a[i + 1], CrossingType::ALL)) {
+      expected_all.push_back(edge.id().shape_id);
+    }
+    for (const auto& edge :
+             query.GetCrossingEdges(a[i], a[i + 1], CrossingType::INTERIOR)) {
+      expected_interior.push_back(edge.id().shape_id);
+    }
+  }
+  for (auto* ids : {&expected_all, &expected_interior}) {
+    std::sort(ids->begin(), ids->end());
+    ids->erase(std::unique(ids->begin(), ids->end()), ids->end());
+  }
+  std::sort(expected_candidates.begin(), expected_candidates.end());
+  expected_candidates.erase(
+      std::unique(expected_candidates.begin(), expected_candidates.end()),
+      expected_candidates.end());
+  EXPECT_EQ(expected_candidates, query.GetCandidates(a));
+  EXPECT_EQ(expected_all, query.GetCrossingShapeIds(a, CrossingType::ALL));
+  EXPECT_EQ(expected_interior,
+            query.GetCrossingShapeIds(a, CrossingType::INTERIOR));
+
+  // Check that each cell is visited exactly once.
+  vector<const S2ShapeIndexCell*> cells;
+  query.VisitCells(a, [&cells](const S2ShapeIndexCell& cell) {
+      cells.push_back(&cell);
+      return true;
+    });
+  std::sort(cells.begin(), cells.end());
+  EXPECT_TRUE(std::adjacent_find(cells.begin(), cells.end()) == cells.end());
+}
+
+TEST(GetCrossings, PolylineQueries) {
+  S2Testing::rnd.Reset(1);
+  // Choose a center near a cube vertex so that the queries span several faces.
+  S2Point center = S2Point(1, 1, 1 + 1e-4).Normalize();
+  const S2Cap cap(center, S1Angle::Degrees(5));
+  MutableS2ShapeIndex::Options options;
+  options.set_max_edges_per_cell(2);
+  MutableS2ShapeIndex index(options);
+  options.set_cache_edges(true);
+  MutableS2ShapeIndex cached_index(options);
+  for (int i = 0; i < 50; ++i) {
+    auto loop = S2Loop::MakeRegularLoop(S2Testing::SamplePoint(cap),
+                                        S1Angle::Degrees(0.3), 8);
+    cached_index.Add(make_unique<S2Loop::Shape>(loop.get()));
+    index.Add(make_unique<S2Loop::OwningShape>(std::move(loop)));
+  }
+  // A closed route around the center and a random walk with short edges.
+  vector<S2Point> route = S2Testing::MakeRegularPoints(
+      center, S1Angle::Degrees(2), 200);
+  route.push_back(route[0]);
+  vector<S2Point> walk = {S2Testing::SamplePoint(cap)};
+  for (int i = 0; i < 300; ++i) {
+    walk.push_back(S2Testing::SamplePoint(
+        S2Cap(walk.back(), S1Angle::Degrees(0.1))));
+  }
+  for (const auto& a : {route, walk}) {
+    TestPolylineQuery(index, a);
+    TestPolylineQuery(cached_index, a);
+    EXPECT_FALSE(S2CrossingEdgeQuery(&index).GetCrossingShapeIds(
+        a, CrossingType::ALL).empty());
+  }
+
+  // Frozen indexes prefetch the end of the next edge while processing each
+  // edge.  Test short polylines stored in vectors of exactly their size, so
+  // that sanitizers detect any access past the last vertex.
+  index.Freeze();
+  for (int n : {1, 2, 3, 10}) {
+    vector<S2Point> a(walk.begin(), walk.begin() + n);
+    a.shrink_to_fit();
+    TestPolylineQuery(index, a);
+  }
+
+  // Test a small index (which uses brute force) and degenerate polylines.
+  auto small_index = s2textformat::MakeIndexOrDie("# 0:0, 0:2 | 3:3, 4:4 #");
+  TestPolylineQuery(*small_index, MakePolylineOrDie("1:-1, 1:1, -1:1")
+                                      ->vertices_span());
+  TestPolylineQuery(*small_index, {MakePointOrDie("0:1")});
+  TestPolylineQuery(*small_index, {});
+}
+
 // Verifies that when VisitCells() is called with a specified root cell and a
 // query edge that barely intersects that cell, that at least one cell is
 // visited.  (At one point this was not always true, because when the query edge
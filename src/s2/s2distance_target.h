@@ -20,6 +20,7 @@
 
 #include <functional>
 
+#include "absl/types/span.h"
 #include "s2/s2cap.h"
 #include "s2/s2cell.h"
 #include "s2/s2shape_index.h"
@@ -109,6 +110,35 @@ class S2DistanceTarget {
   // returns false.
   virtual bool UpdateMinDistance(const S2Cell& cell, Distance* min_dist) = 0;
 
+  // Returns true if FilterEdges() is implemented by this target.
+  virtual bool can_filter_edges() const { return false; }
+
+  // Sets keep[i] to false for each edge in "edges" whose distance to the
+  // target is certainly not less than "limit", i.e. for which
+  // UpdateMinDistance(edges[i].v0, edges[i].v1, &limit) would return false.
+  // The other entries of "keep" are not modified.  Edges may be kept even if
+  // they turn out not to be closer than "limit".
+  //
+  // This allows callers that test many edges at once (such as all the edges
+  // of an S2ShapeIndexCell) to skip the exact distance calculation for most
+  // of them using a cheap bound computed for the whole batch.  It is only
+  // called if can_filter_edges() returns true.
+  virtual void FilterEdges(absl::Span<const S2Shape::Edge> edges,
+                           Distance limit, bool* keep) const {}
+
+  // Returns true if GetFloatEdgeDistances() is implemented by this target.
+  virtual bool can_use_float_edges() const { return false; }
+
+  // Sets distances[i] to an approximation of the distance to edge "i" of
+  // "num_edges" single-precision edges, for 0 <= i < num_edges.  Coordinate
+  // "c" of endpoint "k" of edge "i" is coords[(3 * k + c) * stride + i]
+  // (see S2ShapeIndex::cached_float_edges).  The documentation of each
+  // target that implements this method states the error bound.  It is only
+  // called if can_use_float_edges() returns true.
+  virtual void GetFloatEdgeDistances(const float* coords, int stride,
+                                     int num_edges,
+                                     Distance* distances) const {}
+
   // Finds all polygons in the given "query_index" that completely contain a
   // connected component of the target geometry.  (For example, if the
   // target consists of 10 points, this method finds polygons that contain
@@ -19,6 +19,8 @@
 
 #include <algorithm>
 
+#include "s2/base/logging.h"
+
 namespace {
 
 // http://en.wikipedia.org/wiki/Haversine_formula
@@ -30,8 +32,130 @@ double Haversine(const double radians) {
   return sinHalf * sinHalf;
 }
 
+// The functions below compute distances in two passes.  The first pass sets
+// each result[i] to the squared chord length between the two points (as in
+// S1ChordAngle::length2()), and the second pass converts these values to
+// distances.  Converting a chord length close to 2 loses precision, so when
+// the angle between the points exceeds 90 degrees the first pass stores the
+// negated squared length of the chord between "a" and "-b" instead, and the
+// second pass returns the supplement of the corresponding angle.  (The sign
+// bit is used so that exactly antipodal points, which yield -0.0, work too.)
+inline double GetSignedLength2(const S2Point& a, const S2Point& b) {
+  double d2 = (a - b).Norm2();
+  double s2 = (a + b).Norm2();
+  return d2 <= s2 ? d2 : -s2;
+}
+
+void GetLength2(absl::Span<const S2Point> a, absl::Span<const S2Point> b,
+                absl::Span<double> result) {
+  S2_DCHECK_EQ(a.size(), b.size());
+  S2_DCHECK_EQ(a.size(), result.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    result[i] = GetSignedLength2(a[i], b[i]);
+  }
+}
+
+void GetLength2(const S2Point& a, absl::Span<const S2Point> b,
+                absl::Span<double> result) {
+  S2_DCHECK_EQ(b.size(), result.size());
+  for (size_t i = 0; i < b.size(); ++i) {
+    result[i] = GetSignedLength2(a, b[i]);
+  }
+}
+
+// Like the functions above, but uses the Haversine formula (see
+// S2LatLng::GetDistance).  Note that the squared chord length is 4 times the
+// haversine of the angle.
+void GetLength2(absl::Span<const S2LatLng> a, absl::Span<const S2LatLng> b,
+                absl::Span<double> result) {
+  S2_DCHECK_EQ(a.size(), b.size());
+  S2_DCHECK_EQ(a.size(), result.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    double lat1 = a[i].lat().radians(), lng1 = a[i].lng().radians();
+    double lat2 = b[i].lat().radians(), lng2 = b[i].lng().radians();
+    double dlat = sin(0.5 * (lat2 - lat1));
+    double dlng = sin(0.5 * (lng2 - lng1));
+    result[i] = 4 * (dlat * dlat + dlng * dlng * cos(lat1) * cos(lat2));
+  }
+}
+
+void GetLength2(const S2LatLng& a, absl::Span<const S2LatLng> b,
+                absl::Span<double> result) {
+  S2_DCHECK_EQ(b.size(), result.size());
+  double lat1 = a.lat().radians(), lng1 = a.lng().radians();
+  double cos_lat1 = cos(lat1);
+  for (size_t i = 0; i < b.size(); ++i) {
+    double lat2 = b[i].lat().radians(), lng2 = b[i].lng().radians();
+    double dlat = sin(0.5 * (lat2 - lat1));
+    double dlng = sin(0.5 * (lng2 - lng1));
+    result[i] = 4 * (dlat * dlat + dlng * dlng * cos_lat1 * cos(lat2));
+  }
+}
+
+// Converts each (signed) squared chord length in "result" to a distance on a
+// sphere of the given radius.
+void Length2ToDistance(double radius, absl::Span<double> result) {
+  for (double& x : result) {
+    double angle = 2 * asin(0.5 * sqrt(std::min(4.0, std::fabs(x))));
+    x = radius * (std::signbit(x) ? M_PI - angle : angle);
+  }
+}
+
 }  // namespace
 
+void S2Earth::GetDistanceMeters(absl::Span<const S2Point> a,
+                                absl::Span<const S2Point> b,
+                                absl::Span<double> result) {
+  GetLength2(a, b, result);
+  Length2ToDistance(RadiusMeters(), result);
+}
+
+void S2Earth::GetDistanceMeters(absl::Span<const S2LatLng> a,
+                                absl::Span<const S2LatLng> b,
+                                absl::Span<double> result) {
+  GetLength2(a, b, result);
+  Length2ToDistance(RadiusMeters(), result);
+}
+
+void S2Earth::GetDistanceKm(absl::Span<const S2Point> a,
+                            absl::Span<const S2Point> b,
+                            absl::Span<double> result) {
+  GetLength2(a, b, result);
+  Length2ToDistance(RadiusKm(), result);
+}
+
+void S2Earth::GetDistanceKm(absl::Span<const S2LatLng> a,
+                            absl::Span<const S2LatLng> b,
+                            absl::Span<double> result) {
+  GetLength2(a, b, result);
+  Length2ToDistance(RadiusKm(), result);
+}
+
+void S2Earth::GetDistanceMeters(const S2Point& a, absl::Span<const S2Point> b,
+                                absl::Span<double> result) {
+  GetLength2(a, b, result);
+  Length2ToDistance(RadiusMeters(), result);
+}
+
+void S2Earth::GetDistanceMeters(const S2LatLng& a,
+                                absl::Span<const S2LatLng> b,
+                                absl::Span<double> result) {
+  GetLength2(a, b, result);
+  Length2ToDistance(RadiusMeters(), result);
+}
+
+void S2Earth::GetDistanceKm(const S2Point& a, absl::Span<const S2Point> b,
+                            absl::Span<double> result) {
+  GetLength2(a, b, result);
+  Length2ToDistance(RadiusKm(), result);
+}
+
+void S2Earth::GetDistanceKm(const S2LatLng& a, absl::Span<const S2LatLng> b,
+                            absl::Span<double> result) {
+  GetLength2(a, b, result);
+  Length2ToDistance(RadiusKm(), result);
+}
+
 double S2Earth::MetersToLongitudeRadians(double meters,
                                          double latitude_radians) {
   double scalar = cos(latitude_radians);
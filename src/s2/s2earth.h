@@ -21,6 +21,7 @@
 #ifndef S2_S2EARTH_H_
 #define S2_S2EARTH_H_
 
+#include "absl/types/span.h"
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2latlng.h"
@@ -105,6 +106,44 @@ class S2Earth {
   static inline double GetDistanceKm(const S2Point& a, const S2Point& b);
   static inline double GetDistanceKm(const S2LatLng& a, const S2LatLng& b);
 
+  // Batch versions of the methods above that set result[i] to the distance
+  // between a[i] and b[i].  The distances are first computed as squared
+  // chord lengths (see S1ChordAngle) and then converted to distances in a
+  // separate loop that does not depend on the input type, which allows both
+  // loops to be vectorized.  The S2LatLng versions use the same Haversine
+  // formula as S2LatLng::GetDistance() and give identical results.  The
+  // S2Point versions agree with the methods above to within about 1e-15
+  // radians.
+  //
+  // REQUIRES: a.size() == b.size() && a.size() == result.size()
+  static void GetDistanceMeters(absl::Span<const S2Point> a,
+                                absl::Span<const S2Point> b,
+                                absl::Span<double> result);
+  static void GetDistanceMeters(absl::Span<const S2LatLng> a,
+                                absl::Span<const S2LatLng> b,
+                                absl::Span<double> result);
+  static void GetDistanceKm(absl::Span<const S2Point> a,
+                            absl::Span<const S2Point> b,
+                            absl::Span<double> result);
+  static void GetDistanceKm(absl::Span<const S2LatLng> a,
+                            absl::Span<const S2LatLng> b,
+                            absl::Span<double> result);
+
+  // Like the methods above, but set result[i] to the distance between "a"
+  // and b[i].  A distance matrix can be computed by calling these methods
+  // once per row.
+  //
+  // REQUIRES: b.size() == result.size()
+  static void GetDistanceMeters(const S2Point& a, absl::Span<const S2Point> b,
+                                absl::Span<double> result);
+  static void GetDistanceMeters(const S2LatLng& a,
+                                absl::Span<const S2LatLng> b,
+                                absl::Span<double> result);
+  static void GetDistanceKm(const S2Point& a, absl::Span<const S2Point> b,
+                            absl::Span<double> result);
+  static void GetDistanceKm(const S2LatLng& a, absl::Span<const S2LatLng> b,
+                            absl::Span<double> result);
+
   // CAVEAT: These versions are not as accurate because util::units::Meters
   // uses "float" rather than "double" as the underlying representation.
   static inline util::units::Meters GetDistance(const S2Point& a,
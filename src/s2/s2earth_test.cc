@@ -19,10 +19,14 @@
 
 #include <cmath>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
+#include "s2/s2testing.h"
 #include "s2/util/units/physical-units.h"
 
+using std::vector;
+
 TEST(S2EarthTest, TestAngleConversion) {
   // Functions that use meters:
   EXPECT_DOUBLE_EQ(S2Earth::MetersToAngle(S2Earth::RadiusMeters()).radians(),
@@ -159,3 +163,53 @@ TEST(S2EarthTest, TestGetDistance) {
                                               S2LatLng::FromDegrees(55, -153)),
                    1000 * S2Earth::RadiusKm() * M_PI / 4);
 }
+
+TEST(S2EarthTest, TestGetDistanceBatch) {
+  const int kNumPoints = 100;
+  vector<S2Point> a, b;
+  vector<S2LatLng> a_ll, b_ll;
+  for (int i = 0; i < kNumPoints; ++i) {
+    a.push_back(S2Testing::RandomPoint());
+    // Include some nearly identical and nearly antipodal pairs.
+    if (i % 10 == 0) {
+      b.push_back(a.back());
+    } else if (i % 10 == 1) {
+      b.push_back(-a.back());
+    } else {
+      b.push_back(S2Testing::RandomPoint());
+    }
+    a_ll.push_back(S2LatLng(a.back()));
+    b_ll.push_back(S2LatLng(b.back()));
+  }
+  vector<double> meters(kNumPoints), km(kNumPoints);
+  S2Earth::GetDistanceMeters(a_ll, b_ll, absl::MakeSpan(meters));
+  S2Earth::GetDistanceKm(a_ll, b_ll, absl::MakeSpan(km));
+  for (int i = 0; i < kNumPoints; ++i) {
+    EXPECT_EQ(S2Earth::GetDistanceMeters(a_ll[i], b_ll[i]), meters[i]);
+    EXPECT_EQ(S2Earth::GetDistanceKm(a_ll[i], b_ll[i]), km[i]);
+  }
+  S2Earth::GetDistanceMeters(a_ll[0], b_ll, absl::MakeSpan(meters));
+  S2Earth::GetDistanceKm(a_ll[0], b_ll, absl::MakeSpan(km));
+  for (int i = 0; i < kNumPoints; ++i) {
+    EXPECT_EQ(S2Earth::GetDistanceMeters(a_ll[0], b_ll[i]), meters[i]);
+    EXPECT_EQ(S2Earth::GetDistanceKm(a_ll[0], b_ll[i]), km[i]);
+  }
+
+  const double kMaxErrorMeters = 1e-14 * S2Earth::RadiusMeters();
+  S2Earth::GetDistanceMeters(a, b, absl::MakeSpan(meters));
+  S2Earth::GetDistanceKm(a, b, absl::MakeSpan(km));
+  for (int i = 0; i < kNumPoints; ++i) {
+    EXPECT_NEAR(S2Earth::GetDistanceMeters(a[i], b[i]), meters[i],
+                kMaxErrorMeters);
+    EXPECT_NEAR(S2Earth::GetDistanceKm(a[i], b[i]), km[i],
+                1e-3 * kMaxErrorMeters);
+  }
+  S2Earth::GetDistanceMeters(a[0], b, absl::MakeSpan(meters));
+  S2Earth::GetDistanceKm(a[0], b, absl::MakeSpan(km));
+  for (int i = 0; i < kNumPoints; ++i) {
+    EXPECT_NEAR(S2Earth::GetDistanceMeters(a[0], b[i]), meters[i],
+                kMaxErrorMeters);
+    EXPECT_NEAR(S2Earth::GetDistanceKm(a[0], b[i]), km[i],
+                1e-3 * kMaxErrorMeters);
+  }
+}
@@ -326,6 +326,21 @@ static int ClipDestination(
   return score;
 }
 
+void GetFaceUVs(S2PointSpan points, int* faces, R2Point* uvs) {
+  const int n = points.size();
+  for (int i = 0; i < n; ++i) {
+    // Equivalent to GetFace(), but written without branches (ties are broken
+    // in the same way as LargestAbsComponent).
+    const S2Point& p = points[i];
+    double x = std::fabs(p[0]), y = std::fabs(p[1]), z = std::fabs(p[2]);
+    int axis = (x > y) ? ((x > z) ? 0 : 2) : ((y > z) ? 1 : 2);
+    faces[i] = axis + 3 * (p[axis] < 0);
+  }
+  for (int i = 0; i < n; ++i) {
+    ValidFaceXYZtoUV(faces[i], points[i], &uvs[i]);
+  }
+}
+
 bool ClipToPaddedFace(const S2Point& a_xyz, const S2Point& b_xyz, int face,
                       double padding, R2Point* a_uv, R2Point* b_uv) {
   S2_DCHECK_GE(padding, 0);
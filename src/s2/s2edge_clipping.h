@@ -36,6 +36,7 @@
 #include "s2/r2.h"
 #include "s2/r2rect.h"
 #include "s2/s2point.h"
+#include "s2/s2point_span.h"
 
 namespace S2 {
 
@@ -74,6 +75,18 @@ bool ClipToFace(const S2Point& a, const S2Point& b, int face,
 bool ClipToPaddedFace(const S2Point& a, const S2Point& b, int face,
                       double padding, R2Point* a_uv, R2Point* b_uv);
 
+// Sets faces[i] and uvs[i] to the face containing points[i] and the (u,v)
+// coordinates of points[i] on that face, for all i.  The results are
+// identical to calling S2::XYZtoFaceUV() for each point.  This is intended
+// for clipping the edges of a chain of vertices to faces (where each vertex
+// is shared by two edges): clients can convert all the vertices in one pass,
+// and then only need to call ClipToPaddedFace() for edges whose endpoints are
+// on different faces or near a face boundary.  The faces are computed in a
+// separate branch-free loop, which compilers can vectorize.
+//
+// REQUIRES: "faces" and "uvs" have room for points.size() elements.
+void GetFaceUVs(S2PointSpan points, int* faces, R2Point* uvs);
+
 // The maximum error in the vertices returned by GetFaceSegments and
 // ClipToFace (compared to an exact calculation):
 //
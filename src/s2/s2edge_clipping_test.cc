@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <vector>
 
 #include "s2/base/logging.h"
 #include <gtest/gtest.h>
@@ -36,6 +37,28 @@
 using absl::StrCat;
 using std::fabs;
 using std::max;
+using std::vector;
+
+TEST(S2, GetFaceUVs) {
+  // Check that GetFaceUVs agrees with XYZtoFaceUV, including for points
+  // whose largest coordinates are tied.
+  vector<S2Point> points = {
+      S2Point(1, 0, 0), S2Point(0, -1, 0), S2Point(0, 0, 1),
+      S2Point(1, 1, 0), S2Point(-1, -1, 0), S2Point(0, 1, -1),
+      S2Point(1, 1, 1), S2Point(-1, -1, -1), S2Point(1, -1, 1)};
+  for (S2Point& p : points) p = p.Normalize();
+  for (int i = 0; i < 1000; ++i) {
+    points.push_back(S2Testing::RandomPoint());
+  }
+  vector<int> faces(points.size());
+  vector<R2Point> uvs(points.size());
+  S2::GetFaceUVs(points, faces.data(), uvs.data());
+  for (int i = 0; i < points.size(); ++i) {
+    double u, v;
+    EXPECT_EQ(S2::XYZtoFaceUV(points[i], &u, &v), faces[i]) << points[i];
+    EXPECT_EQ(R2Point(u, v), uvs[i]) << points[i];
+  }
+}
 
 void TestFaceClipping(const S2Point& a_raw, const S2Point& b_raw) {
   S2Point a = a_raw.Normalize();
@@ -17,6 +17,10 @@
 
 #include "s2/s2edge_crosser.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
 #include "s2/base/logging.h"
 #include "s2/s2pointutil.h"
 #include "s2/s2predicates.h"
@@ -91,6 +95,70 @@ inline int S2EdgeCrosserBase<PointRep>::CrossingSignInternal2(
   return (dac != acb_) ? -1 : 1;
 }
 
+namespace {
+
+// Converts a chain vertex to the argument type of the given PointRep.
+template <class ArgType>
+ArgType ToArg(const S2Point& p);
+
+template <>
+inline const S2Point* ToArg<const S2Point*>(const S2Point& p) {
+  return &p;
+}
+
+template <>
+inline const S2Point& ToArg<const S2Point&>(const S2Point& p) {
+  return p;
+}
+
+}  // namespace
+
+template <class PointRep>
+int S2EdgeCrosserBase<PointRep>::FirstChainCrossing(
+    absl::Span<const S2Point> chain) {
+  return ChainCrossingsInternal(chain, nullptr);
+}
+
+template <class PointRep>
+void S2EdgeCrosserBase<PointRep>::GetChainCrossings(
+    absl::Span<const S2Point> chain, std::vector<int>* crossings) {
+  ChainCrossingsInternal(chain, crossings);
+}
+
+template <class PointRep>
+int S2EdgeCrosserBase<PointRep>::ChainCrossingsInternal(
+    absl::Span<const S2Point> chain, std::vector<int>* crossings) {
+  // This is the same error bound as s2pred::TriageSign(), so an edge is
+  // skipped below exactly when CrossingSign() would return -1 without
+  // leaving its fast path.
+  const double kMaxDetError = 1.8274 * DBL_EPSILON;
+  constexpr int kBlockSize = 64;
+  int signs[kBlockSize + 1];
+  const int num_edges = static_cast<int>(chain.size()) - 1;
+  int first = -1;
+  for (int start = 0; start < num_edges; start += kBlockSize) {
+    const int end = std::min(start + kBlockSize, num_edges);
+    const S2Point* v = &chain[start];
+    for (int i = 0; i <= end - start; ++i) {
+      S2_DCHECK(S2::IsUnitLength(v[i]));
+      double det = a_cross_b_.DotProd(v[i]);
+      signs[i] = (det > kMaxDetError) - (det < -kMaxDetError);
+    }
+    for (int i = 0; i < end - start; ++i) {
+      // If both vertices are strictly on the same side of the great circle
+      // through AB then the edges do not cross.
+      if (signs[i] * signs[i + 1] > 0) continue;
+      if (CrossingSign(ToArg<ArgType>(v[i]), ToArg<ArgType>(v[i + 1])) < 0) {
+        continue;
+      }
+      if (first < 0) first = start + i;
+      if (crossings == nullptr) return first;
+      crossings->push_back(start + i);
+    }
+  }
+  return first;
+}
+
 // Explicitly instantiate the classes we need so that the methods above can be
 // omitted from the .h file (and to reduce compilation time).
 template class S2EdgeCrosserBase<S2::internal::S2Point_PointerRep>;
@@ -18,6 +18,9 @@
 #ifndef S2_S2EDGE_CROSSER_H_
 #define S2_S2EDGE_CROSSER_H_
 
+#include <vector>
+
+#include "absl/types/span.h"
 #include "s2/base/logging.h"
 #include "s2/_fp_contract_off.h"
 #include "s2/s2edge_crossings.h"
@@ -248,7 +251,33 @@ class S2EdgeCrosserBase {
   // const S2Point& S2CopyingEdgeCrosser::c();
   ArgType c() { return c_; }
 
+  // Tests the fixed edge AB against each edge (chain[i], chain[i+1]) of the
+  // given vertex chain, and returns the smallest "i" such that
+  // CrossingSign(chain[i], chain[i+1]) >= 0 (i.e., the edges cross or share
+  // a vertex), or -1 if there is no such edge.
+  //
+  // This is faster than calling CrossingSign() for each vertex when the
+  // chain is long.  The orientation of every vertex with respect to AB is
+  // first computed by a branch-free loop over a block of vertices (which the
+  // compiler can vectorize), and only the edges that might cross the great
+  // circle through AB are then tested individually.
+  //
+  // For S2EdgeCrosser (only), "chain" must persist until the next call.
+  // The current vertex c() is unspecified afterwards, so RestartAt() must be
+  // called before using the single-vertex methods above.
+  int FirstChainCrossing(absl::Span<const S2Point> chain);
+
+  // Like FirstChainCrossing(), but appends the indices of all such edges to
+  // "crossings" (in increasing order).
+  void GetChainCrossings(absl::Span<const S2Point> chain,
+                         std::vector<int>* crossings);
+
  private:
+  // Implements the chain methods above.  If "crossings" is nullptr, returns
+  // as soon as the first crossing is found.
+  int ChainCrossingsInternal(absl::Span<const S2Point> chain,
+                             std::vector<int>* crossings);
+
   // These functions handle the "slow path" of CrossingSign().
   int CrossingSignInternal(PointRep d);
   int CrossingSignInternal2(const S2Point& d);
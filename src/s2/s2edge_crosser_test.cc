@@ -303,3 +303,65 @@ TEST(S2, CoincidentZeroLengthEdgesThatDontTouch) {
   }
 }
 
+// Returns the indices of the chain edges for which CrossingSign() >= 0,
+// computed one edge at a time.
+static vector<int> GetExpectedChainCrossings(const S2Point& a,
+                                             const S2Point& b,
+                                             const vector<S2Point>& chain) {
+  vector<int> expected;
+  for (int i = 0; i + 1 < chain.size(); ++i) {
+    if (S2::CrossingSign(a, b, chain[i], chain[i + 1]) >= 0) {
+      expected.push_back(i);
+    }
+  }
+  return expected;
+}
+
+TEST(S2, ChainCrossingsMatchCrossingSign) {
+  const int kIters = 200;
+  for (int iter = 0; iter < kIters; ++iter) {
+    // Build a long chain that zigzags across the edge AB, and include some
+    // vertices that are exactly equal to A or B, or lie on the great circle
+    // through AB.
+    S2Point a = S2Testing::RandomPoint();
+    S2Point b = S2::Interpolate(a, S2Testing::RandomPoint(), 0.01);
+    S2Point normal = S2::RobustCrossProd(a, b).Normalize();
+    vector<S2Point> chain;
+    int num_vertices = S2Testing::rnd.Uniform(300);
+    for (int i = 0; i < num_vertices; ++i) {
+      S2Point p = S2::Interpolate(a, b, 5 * S2Testing::rnd.RandDouble() - 2);
+      switch (S2Testing::rnd.Uniform(10)) {
+        case 0: p = a; break;
+        case 1: p = b; break;
+        case 2: break;  // On the great circle through AB.
+        default:
+          p = (p + 1e-3 * (S2Testing::rnd.RandDouble() - 0.5) * normal)
+              .Normalize();
+      }
+      chain.push_back(p);
+    }
+    vector<int> expected = GetExpectedChainCrossings(a, b, chain);
+
+    S2EdgeCrosser crosser(&a, &b);
+    vector<int> actual;
+    crosser.GetChainCrossings(chain, &actual);
+    EXPECT_EQ(expected, actual);
+    EXPECT_EQ(expected.empty() ? -1 : expected[0],
+              crosser.FirstChainCrossing(chain));
+
+    S2CopyingEdgeCrosser copying_crosser(a, b);
+    actual.clear();
+    copying_crosser.GetChainCrossings(chain, &actual);
+    EXPECT_EQ(expected, actual);
+  }
+}
+
+TEST(S2, ChainCrossingsShortChains) {
+  S2Point a(1, 0, 0), b(0, 1, 0);
+  S2EdgeCrosser crosser(&a, &b);
+  EXPECT_EQ(-1, crosser.FirstChainCrossing({}));
+  vector<S2Point> chain = {S2Point(1, 1, 1).Normalize()};
+  EXPECT_EQ(-1, crosser.FirstChainCrossing(chain));
+  chain.push_back(S2Point(1, 1, -1).Normalize());
+  EXPECT_EQ(0, crosser.FirstChainCrossing(chain));
+}
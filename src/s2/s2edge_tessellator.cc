@@ -222,6 +222,23 @@ void S2EdgeTessellator::AppendProjected(
   AppendProjected(pa, a, pb, b, vertices);
 }
 
+void S2EdgeTessellator::AppendProjected(
+    S2PointSpan chain, vector<R2Point>* vertices) const {
+  if (chain.size() < 2) return;
+  R2Point pa = proj_.Project(chain[0]);
+  if (vertices->empty()) {
+    vertices->push_back(pa);
+  } else {
+    pa = proj_.WrapDestination(vertices->back(), pa);
+    S2_DCHECK_EQ(vertices->back(), pa) << "Appended edges must form a chain";
+  }
+  for (int i = 1; i < chain.size(); ++i) {
+    AppendProjected(pa, chain[i - 1], proj_.Project(chain[i]), chain[i],
+                    vertices);
+    pa = vertices->back();
+  }
+}
+
 // Given a geodesic edge AB, split the edge as necessary and append all
 // projected vertices except the first to "vertices".
 //
@@ -259,6 +276,23 @@ void S2EdgeTessellator::AppendUnprojected(
   AppendUnprojected(pa, a, pb, b, vertices);
 }
 
+void S2EdgeTessellator::AppendUnprojected(
+    absl::Span<const R2Point> chain, vector<S2Point>* vertices) const {
+  if (chain.size() < 2) return;
+  S2Point a = proj_.Unproject(chain[0]);
+  if (vertices->empty()) {
+    vertices->push_back(a);
+  } else {
+    S2_DCHECK(S2::ApproxEquals(vertices->back(), a))
+        << "Appended edges must form a chain";
+  }
+  for (int i = 1; i < chain.size(); ++i) {
+    S2Point b = proj_.Unproject(chain[i]);
+    AppendUnprojected(chain[i - 1], a, chain[i], b, vertices);
+    a = b;
+  }
+}
+
 // Like AppendProjected, but interpolates a projected edge and appends the
 // corresponding points on the sphere.
 void S2EdgeTessellator::AppendUnprojected(
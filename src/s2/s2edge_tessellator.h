@@ -20,9 +20,11 @@
 
 #include <vector>
 
+#include "absl/types/span.h"
 #include "s2/r2.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2point.h"
+#include "s2/s2point_span.h"
 #include "s2/s2projections.h"
 
 // Given an edge in some 2D projection (e.g., Mercator), S2EdgeTessellator
@@ -76,6 +78,18 @@ class S2EdgeTessellator {
   void AppendUnprojected(const R2Point& a, const R2Point& b,
                          std::vector<S2Point>* vertices) const;
 
+  // Like the methods above, but converts an entire chain of edges (e.g. a
+  // polyline, or a loop whose first vertex is repeated at the end).  This is
+  // equivalent to calling the corresponding method for each edge, except
+  // that each vertex is projected or unprojected only once, which is
+  // significantly faster when the chain has many vertices (e.g. when
+  // rendering a coastline into many tiles).  Chains with fewer than two
+  // vertices have no edges, and nothing is appended.
+  void AppendProjected(S2PointSpan chain,
+                       std::vector<R2Point>* vertices) const;
+  void AppendUnprojected(absl::Span<const R2Point> chain,
+                         std::vector<S2Point>* vertices) const;
+
   // Returns the minimum supported tolerance (which corresponds to a distance
   // less than one micrometer on the Earth's surface).
   static S1Angle kMinTolerance();
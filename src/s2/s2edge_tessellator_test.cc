@@ -259,6 +259,41 @@ TEST(S2EdgeTessellator, ProjectedWrappingMultipleCrossings) {
   EXPECT_EQ(640, max_lng);
 }
 
+TEST(S2EdgeTessellator, ChainsMatchEdges) {
+  // Converting an entire chain should yield the same vertices as converting
+  // each edge separately.
+  auto chain = ParsePointsOrDie("0:160, 0:-40, 0:120, 0:-80, 10:120, "
+                                "10:-40, 0:160");
+  S2::PlateCarreeProjection plate_carree(180);
+  S2::MercatorProjection mercator(180);
+  for (const S2::Projection* proj :
+           {static_cast<const S2::Projection*>(&plate_carree),
+            static_cast<const S2::Projection*>(&mercator)}) {
+    S2EdgeTessellator tess(proj, S1Angle::E7(1));
+    vector<R2Point> expected_projected, projected;
+    for (int i = 0; i + 1 < chain.size(); ++i) {
+      tess.AppendProjected(chain[i], chain[i + 1], &expected_projected);
+    }
+    tess.AppendProjected(chain, &projected);
+    EXPECT_EQ(expected_projected, projected);
+
+    vector<S2Point> expected_unprojected, unprojected;
+    for (int i = 0; i + 1 < projected.size(); ++i) {
+      tess.AppendUnprojected(projected[i], projected[i + 1],
+                             &expected_unprojected);
+    }
+    tess.AppendUnprojected(projected, &unprojected);
+    EXPECT_EQ(expected_unprojected, unprojected);
+  }
+
+  // Chains with fewer than two vertices are ignored.
+  S2EdgeTessellator tess(&plate_carree, S1Angle::E7(1));
+  vector<R2Point> projected;
+  tess.AppendProjected(S2PointSpan(), &projected);
+  tess.AppendProjected(S2PointSpan(&chain[0], 1), &projected);
+  EXPECT_TRUE(projected.empty());
+}
+
 TEST(S2EdgeTessellator, InfiniteRecursionBug) {
   S2::PlateCarreeProjection proj(180);
   S1Angle kOneMicron = S1Angle::Radians(1e-6 / 6371.0);
@@ -0,0 +1,115 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2executor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include "absl/synchronization/notification.h"
+#include "s2/base/logging.h"
+
+using std::vector;
+
+void S2Executor::ParallelFor(int n, const std::function<void(int)>& body) {
+  const int num_tasks = std::min(n, num_threads()) - 1;
+  if (num_tasks <= 0) {
+    for (int i = 0; i < n; ++i) body(i);
+    return;
+  }
+  // Scheduled tasks may start after this method has returned, so the state
+  // they share is reference counted.  A task only calls "body" after taking
+  // an index, which is not possible once this method has returned.
+  struct State {
+    std::atomic<int> next{0};
+    std::atomic<int> num_done{0};
+    absl::Notification done;
+  };
+  auto state = std::make_shared<State>();
+  const std::function<void(int)>* body_ptr = &body;
+  auto run = [state, body_ptr, n]() {
+    for (int i; (i = state->next.fetch_add(1)) < n; ) {
+      (*body_ptr)(i);
+      if (state->num_done.fetch_add(1) + 1 == n) state->done.Notify();
+    }
+  };
+  for (int t = 0; t < num_tasks; ++t) Schedule(run);
+  run();
+  state->done.WaitForNotification();
+}
+
+S2ThreadPool::S2ThreadPool(int num_threads)
+    : num_threads_(std::max(1, num_threads)) {
+  S2_DCHECK_GE(num_threads, 1);
+  workers_.reserve(num_threads_ - 1);
+  for (int i = 1; i < num_threads_; ++i) {
+    workers_.emplace_back(&S2ThreadPool::RunWorker, this);
+  }
+}
+
+S2ThreadPool::~S2ThreadPool() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+  }
+  for (auto& worker : workers_) worker.join();
+}
+
+void S2ThreadPool::Schedule(std::function<void()> task) {
+  if (workers_.empty()) {
+    task();
+    return;
+  }
+  absl::MutexLock lock(&mutex_);
+  tasks_.push_back(std::move(task));
+}
+
+void S2ThreadPool::RunWorker() {
+  auto ready = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return !tasks_.empty() || stopping_;
+  };
+  for (;;) {
+    std::function<void()> task;
+    {
+      absl::MutexLock lock(&mutex_, absl::Condition(&ready));
+      // Tasks that are still queued when the pool is stopped are run first.
+      if (tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+S2FunctionExecutor::S2FunctionExecutor(int num_threads,
+                                       ScheduleFunction schedule)
+    : num_threads_(std::max(1, num_threads)), schedule_(std::move(schedule)) {
+  S2_DCHECK_GE(num_threads, 1);
+}
+
+void S2FunctionExecutor::Schedule(std::function<void()> task) {
+  schedule_(std::move(task));
+}
+
+void S2ParallelFor(S2Executor* executor, int n,
+                   const std::function<void(int)>& body) {
+  if (executor != nullptr) return executor->ParallelFor(n, body);
+  vector<std::thread> threads;
+  for (int i = 1; i < n; ++i) threads.emplace_back(body, i);
+  if (n > 0) body(0);
+  for (auto& thread : threads) thread.join();
+}
@@ -0,0 +1,173 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2EXECUTOR_H_
+#define S2_S2EXECUTOR_H_
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "s2/base/integral_types.h"
+
+// S2Executor is an interface for running the parallel parts of S2
+// algorithms on a client-supplied set of threads.  Classes that support it
+// accept an executor through their Options (e.g., MutableS2ShapeIndex and
+// S2Builder), which allows a service to run all S2 work on its own scheduler
+// rather than having each operation create its own threads.  Example usage:
+//
+//   S2ThreadPool pool(8);               // Shared by all operations.
+//   MutableS2ShapeIndex::Options options;
+//   options.set_executor(&pool);
+//   MutableS2ShapeIndex index(options);
+//
+// Parallel algorithms divide their work into at most num_threads() pieces
+// and call ParallelFor(), in which the calling thread also does work.  This
+// means that an executor whose threads are all busy cannot cause deadlock
+// (the calling thread then simply does all the work itself), so S2 methods
+// may be called from tasks running on the executor.
+//
+// All methods must be thread-safe.
+class S2Executor {
+ public:
+  virtual ~S2Executor() = default;
+
+  // Returns the number of threads that should work on each parallel
+  // operation, including the calling thread (at least 1).
+  virtual int num_threads() const = 0;
+
+  // Runs "task" at some point in the future, on any thread.
+  virtual void Schedule(std::function<void()> task) = 0;
+
+  // Calls body(i) for every i in [0, n) and returns once all calls have
+  // finished.  The calls are made by the calling thread together with up to
+  // (num_threads() - 1) tasks passed to Schedule(), each taking the next
+  // unprocessed index until none remain.  Tasks that do not start until all
+  // indices have been taken return immediately.
+  virtual void ParallelFor(int n, const std::function<void(int)>& body);
+};
+
+// An executor that runs tasks on a fixed set of threads owned by this object.
+// This is the default implementation for clients that do not have their own
+// thread pool.  Tasks are run in the order they were scheduled; ParallelFor()
+// balances the load by having each thread take one index at a time.
+class S2ThreadPool final : public S2Executor {
+ public:
+  // Creates a pool that uses "num_threads" threads for each parallel
+  // operation.  Since the thread calling ParallelFor() also does work, this
+  // starts (num_threads - 1) worker threads.
+  //
+  // REQUIRES: num_threads >= 1
+  explicit S2ThreadPool(int num_threads);
+
+  // Waits for all scheduled tasks to finish.
+  ~S2ThreadPool() override;
+
+  int num_threads() const override { return num_threads_; }
+
+  // If the pool has no worker threads, the task is run immediately.
+  void Schedule(std::function<void()> task) override;
+
+ private:
+  void RunWorker();
+
+  const int num_threads_;
+  absl::Mutex mutex_;
+  std::deque<std::function<void()>> tasks_ ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+  std::vector<std::thread> workers_;
+
+  S2ThreadPool(const S2ThreadPool&) = delete;
+  void operator=(const S2ThreadPool&) = delete;
+};
+
+// Adapts a client thread pool to the S2Executor interface, given a function
+// that schedules a task on that pool.  For example:
+//
+//   S2FunctionExecutor executor(
+//       service_pool->size(),
+//       [service_pool](std::function<void()> task) {
+//         service_pool->Submit(std::move(task));
+//       });
+class S2FunctionExecutor final : public S2Executor {
+ public:
+  using ScheduleFunction = std::function<void(std::function<void()>)>;
+
+  // REQUIRES: num_threads >= 1
+  S2FunctionExecutor(int num_threads, ScheduleFunction schedule);
+
+  int num_threads() const override { return num_threads_; }
+  void Schedule(std::function<void()> task) override;
+
+ private:
+  const int num_threads_;
+  const ScheduleFunction schedule_;
+};
+
+// Calls body(i) for every i in [0, n).  If "executor" is non-null this is
+// equivalent to executor->ParallelFor(n, body); otherwise body(0) is called on
+// the calling thread and each other index is processed by a new thread.
+// This is the helper used by S2 classes that accept an executor, where "n"
+// is the number of pieces that the work has been divided into (see
+// S2NumThreads below).
+void S2ParallelFor(S2Executor* executor, int n,
+                   const std::function<void(int)>& body);
+
+// Returns the number of threads that a parallel operation should use given
+// an optional executor and a "num_threads" option: the executor's thread
+// count if it is non-null, and "num_threads" otherwise.
+inline int S2NumThreads(const S2Executor* executor, int num_threads) {
+  return executor ? executor->num_threads() : num_threads;
+}
+
+// Sorts the range [begin, end) using up to "num_threads" threads (see
+// S2ParallelFor for the meaning of "executor").  The range is divided into
+// num_threads blocks that are sorted in parallel and then merged pairwise in
+// rounds, with the merges of each round also running in parallel.  The
+// result is the same as std::sort(begin, end, comp) whenever "comp" is a
+// strict total order (e.g., when ties are broken by an element id), so the
+// output does not depend on the number of threads.
+template <class RandomIt, class Compare>
+void S2ParallelSort(S2Executor* executor, int num_threads,
+                    RandomIt begin, RandomIt end, Compare comp) {
+  const int64 n = end - begin;
+  if (num_threads > n) num_threads = static_cast<int>(n);
+  if (num_threads <= 1) {
+    std::sort(begin, end, comp);
+    return;
+  }
+  auto block_begin = [=](int64 block) {
+    return begin + n * block / num_threads;
+  };
+  S2ParallelFor(executor, num_threads, [&](int block) {
+    std::sort(block_begin(block), block_begin(block + 1), comp);
+  });
+  for (int width = 1; width < num_threads; width *= 2) {
+    const int num_merges = (num_threads + 2 * width - 1) / (2 * width);
+    S2ParallelFor(executor, num_merges, [&](int i) {
+      const int64 first = int64{2} * width * i;
+      const int64 middle = std::min<int64>(first + width, num_threads);
+      const int64 last = std::min<int64>(middle + width, num_threads);
+      std::inplace_merge(block_begin(first), block_begin(middle),
+                         block_begin(last), comp);
+    });
+  }
+}
+
+#endif  // S2_S2EXECUTOR_H_
@@ -0,0 +1,128 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2executor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/synchronization/notification.h"
+
+using std::vector;
+
+namespace {
+
+// Checks that ParallelFor() calls body(i) exactly once for each i.
+void TestParallelFor(S2Executor* executor, int n) {
+  vector<std::atomic<int>> counts(n);
+  for (auto& count : counts) count = 0;
+  S2ParallelFor(executor, n, [&counts](int i) { ++counts[i]; });
+  for (int i = 0; i < n; ++i) EXPECT_EQ(1, counts[i]) << i;
+}
+
+TEST(S2ThreadPool, ParallelFor) {
+  for (int num_threads : {1, 2, 4}) {
+    S2ThreadPool pool(num_threads);
+    EXPECT_EQ(num_threads, pool.num_threads());
+    for (int n : {0, 1, 3, 100}) TestParallelFor(&pool, n);
+  }
+}
+
+TEST(S2ParallelFor, NoExecutor) {
+  for (int n : {0, 1, 4}) TestParallelFor(nullptr, n);
+}
+
+TEST(S2ThreadPool, ScheduleRunsTasksBeforeDestruction) {
+  std::atomic<int> num_run(0);
+  {
+    S2ThreadPool pool(3);
+    for (int i = 0; i < 50; ++i) pool.Schedule([&num_run]() { ++num_run; });
+  }
+  EXPECT_EQ(50, num_run);
+}
+
+TEST(S2ThreadPool, SingleThreadRunsTasksInline) {
+  S2ThreadPool pool(1);
+  bool run = false;
+  pool.Schedule([&run]() { run = true; });
+  EXPECT_TRUE(run);
+}
+
+TEST(S2ThreadPool, NestedParallelForDoesNotDeadlock) {
+  // Every worker thread is busy running an outer body when the inner loops
+  // are started, so the inner loops are completed by their calling threads.
+  S2ThreadPool pool(3);
+  std::atomic<int> total(0);
+  pool.ParallelFor(6, [&](int) {
+    pool.ParallelFor(10, [&](int i) { total += i; });
+  });
+  EXPECT_EQ(6 * 45, total);
+}
+
+TEST(S2ThreadPool, ParallelForWithBlockedWorkers) {
+  // Block the only worker thread; ParallelFor() must still complete using
+  // the calling thread alone.
+  S2ThreadPool pool(2);
+  absl::Notification release;
+  pool.Schedule([&release]() { release.WaitForNotification(); });
+  TestParallelFor(&pool, 20);
+  release.Notify();
+}
+
+TEST(S2FunctionExecutor, AdaptsClientPool) {
+  S2ThreadPool client_pool(4);
+  std::atomic<int> num_scheduled(0);
+  S2FunctionExecutor executor(
+      3, [&client_pool, &num_scheduled](std::function<void()> task) {
+        ++num_scheduled;
+        client_pool.Schedule(std::move(task));
+      });
+  EXPECT_EQ(3, executor.num_threads());
+  TestParallelFor(&executor, 100);
+  EXPECT_EQ(2, num_scheduled);
+}
+
+TEST(S2NumThreads, PrefersExecutor) {
+  S2ThreadPool pool(5);
+  EXPECT_EQ(5, S2NumThreads(&pool, 2));
+  EXPECT_EQ(2, S2NumThreads(nullptr, 2));
+}
+
+TEST(S2ParallelSort, MatchesSerialSort) {
+  S2ThreadPool pool(3);
+  for (int n : {0, 1, 2, 5, 1000}) {
+    vector<int> values(n);
+    for (int i = 0; i < n; ++i) values[i] = (i * 7919) % 101;
+    vector<int> expected = values;
+    std::sort(expected.begin(), expected.end());
+    for (int num_threads : {1, 2, 3, 7}) {
+      vector<int> actual = values;
+      S2ParallelSort(nullptr, num_threads, actual.begin(), actual.end(),
+                     std::less<int>());
+      EXPECT_EQ(expected, actual);
+    }
+    vector<int> actual = values;
+    S2ParallelSort(&pool, pool.num_threads(), actual.begin(), actual.end(),
+                   std::less<int>());
+    EXPECT_EQ(expected, actual);
+  }
+}
+
+}  // namespace
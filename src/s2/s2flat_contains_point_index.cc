@@ -0,0 +1,128 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2flat_contains_point_index.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "s2/s2edge_crosser.h"
+#include "s2/s2shape.h"
+
+using std::vector;
+
+S2FlatContainsPointIndex::S2FlatContainsPointIndex(
+    const S2ShapeIndex& index) {
+  Init(index);
+}
+
+void S2FlatContainsPointIndex::Init(const S2ShapeIndex& index) {
+  cell_ids_.clear();
+  cell_starts_.assign(1, 0);
+  shape_ids_.clear();
+  contains_center_.clear();
+  edge_starts_.assign(1, 0);
+  edge_vertices_.clear();
+  for (S2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN); !it.done();
+       it.Next()) {
+    const S2ShapeIndexCell& cell = it.cell();
+    for (int i = 0; i < cell.num_clipped(); ++i) {
+      const S2ClippedShape& clipped = cell.clipped(i);
+      const S2Shape* shape = index.shape(clipped.shape_id());
+      if (shape == nullptr || shape->dimension() != 2) continue;
+      shape_ids_.push_back(clipped.shape_id());
+      contains_center_.push_back(clipped.contains_center());
+      for (int j = 0; j < clipped.num_edges(); ++j) {
+        S2Shape::Edge edge = shape->edge(clipped.edge(j));
+        edge_vertices_.push_back(edge.v0);
+        edge_vertices_.push_back(edge.v1);
+      }
+      edge_starts_.push_back(edge_vertices_.size() / 2);
+    }
+    if (shape_ids_.size() > cell_starts_.back()) {
+      cell_ids_.push_back(it.id().id());
+      cell_starts_.push_back(shape_ids_.size());
+    }
+  }
+}
+
+void S2FlatContainsPointIndex::AppendContainingShapeIds(
+    const S2Point& p, vector<int>* result) const {
+  // Find the cell containing "p", which is either the first cell whose id
+  // is at least the leaf cell id of "p" or the cell before it.
+  S2CellId target(p);
+  int i = std::lower_bound(cell_ids_.begin(), cell_ids_.end(), target.id()) -
+          cell_ids_.begin();
+  if (i == cell_ids_.size() ||
+      S2CellId(cell_ids_[i]).range_min() > target) {
+    if (i == 0 || S2CellId(cell_ids_[i - 1]).range_max() < target) return;
+    --i;
+  }
+  S2CopyingEdgeCrosser crosser(S2CellId(cell_ids_[i]).ToPoint(), p);
+  for (int j = cell_starts_[i]; j < cell_starts_[i + 1]; ++j) {
+    bool inside = contains_center_[j];
+    for (int k = edge_starts_[j]; k < edge_starts_[j + 1]; ++k) {
+      inside ^= crosser.EdgeOrVertexCrossing(edge_vertices_[2 * k],
+                                             edge_vertices_[2 * k + 1]);
+    }
+    if (inside) result->push_back(shape_ids_[j]);
+  }
+}
+
+vector<int> S2FlatContainsPointIndex::GetContainingShapeIds(
+    const S2Point& p) const {
+  vector<int> result;
+  AppendContainingShapeIds(p, &result);
+  return result;
+}
+
+void S2FlatContainsPointIndex::GetContainingShapeIds(
+    absl::Span<const S2Point> points, vector<int>* offsets,
+    vector<int>* shape_ids, int num_threads, S2Executor* executor) const {
+  offsets->assign(1, 0);
+  shape_ids->clear();
+  if (points.empty()) return;
+  num_threads = std::min<int>(
+      std::max(1, S2NumThreads(executor, num_threads)), points.size());
+
+  // Each thread processes a contiguous range of points, and the results are
+  // concatenated afterwards.
+  vector<vector<int>> thread_offsets(num_threads), thread_ids(num_threads);
+  S2ParallelFor(executor, num_threads, [&](int t) {
+    size_t begin = points.size() * t / num_threads;
+    size_t end = points.size() * (t + 1) / num_threads;
+    vector<int>& ids = thread_ids[t];
+    thread_offsets[t].reserve(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      AppendContainingShapeIds(points[i], &ids);
+      thread_offsets[t].push_back(ids.size());
+    }
+  });
+  offsets->reserve(points.size() + 1);
+  for (int t = 0; t < num_threads; ++t) {
+    int base = shape_ids->size();
+    for (int offset : thread_offsets[t]) offsets->push_back(base + offset);
+    shape_ids->insert(shape_ids->end(), thread_ids[t].begin(),
+                      thread_ids[t].end());
+  }
+}
+
+size_t S2FlatContainsPointIndex::SpaceUsed() const {
+  return sizeof(*this) + cell_ids_.capacity() * sizeof(uint64) +
+         (cell_starts_.capacity() + shape_ids_.capacity() +
+          edge_starts_.capacity()) * sizeof(int) +
+         contains_center_.capacity() * sizeof(uint8) +
+         edge_vertices_.capacity() * sizeof(S2Point);
+}
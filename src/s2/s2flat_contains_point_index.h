@@ -0,0 +1,110 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2FLAT_CONTAINS_POINT_INDEX_H_
+#define S2_S2FLAT_CONTAINS_POINT_INDEX_H_
+
+#include <vector>
+
+#include "absl/types/span.h"
+#include "s2/base/integral_types.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2executor.h"
+#include "s2/s2point.h"
+#include "s2/s2shape_index.h"
+
+// S2FlatContainsPointIndex is a copy of the information in an S2ShapeIndex
+// that is needed for point containment queries, stored as a few flat arrays
+// without pointers or virtual calls.  It is intended for large batch joins
+// of points against polygons, where the arrays can be processed in bulk
+// (e.g., copied to an accelerator or memory-mapped), and it answers batches
+// of queries in parallel.
+//
+// The results are identical to those of S2ContainsPointQuery with the
+// default S2VertexModel::SEMI_OPEN (in which points and polylines contain
+// nothing), since the same exact predicates are used.  The arrays are:
+//
+//  - cell_ids(): the index cells that intersect some polygon, in increasing
+//    order.
+//  - cell_starts(): for each cell i, the range of clipped shapes
+//    [cell_starts()[i], cell_starts()[i + 1]).
+//  - shape_ids() and contains_center(): the shape id of each clipped shape
+//    and whether the shape contains the cell center.
+//  - edge_starts(): for each clipped shape j, the range of its edges
+//    [edge_starts()[j], edge_starts()[j + 1]).
+//  - edge_vertices(): the vertices of each edge k at positions 2 * k and
+//    2 * k + 1.
+//
+// The point "p" is contained by the shape of clipped shape j in cell i if
+// contains_center()[j] is true and the segment from the center of cell i to
+// "p" crosses the edges of j an even number of times, or vice versa (as
+// determined by S2EdgeCrosser::EdgeOrVertexCrossing).
+//
+// The edges of polygons that intersect several cells are stored once per
+// cell, so the memory used is somewhat larger than that of a
+// MutableS2ShapeIndex.  The object is immutable once initialized and may be
+// used from several threads concurrently.
+class S2FlatContainsPointIndex {
+ public:
+  // Constructs an empty object.
+  S2FlatContainsPointIndex() = default;
+
+  // Convenience constructor that calls Init().
+  explicit S2FlatContainsPointIndex(const S2ShapeIndex& index);
+
+  // Copies the polygons of "index" (i.e., the shapes of dimension 2).
+  void Init(const S2ShapeIndex& index);
+
+  // Returns the ids of the shapes that contain "p" in increasing order.
+  std::vector<int> GetContainingShapeIds(const S2Point& p) const;
+
+  // Finds the shapes that contain each point in "points", using up to
+  // "num_threads" threads (see S2ParallelFor for the meaning of "executor").
+  // The ids of the shapes containing points[i] are returned in increasing
+  // order as shape_ids[offsets[i]] through shape_ids[offsets[i + 1] - 1],
+  // where "offsets" has points.size() + 1 elements.
+  void GetContainingShapeIds(absl::Span<const S2Point> points,
+                             std::vector<int>* offsets,
+                             std::vector<int>* shape_ids,
+                             int num_threads = 1,
+                             S2Executor* executor = nullptr) const;
+
+  // The flat arrays described above.
+  absl::Span<const uint64> cell_ids() const { return cell_ids_; }
+  absl::Span<const int> cell_starts() const { return cell_starts_; }
+  absl::Span<const int> shape_ids() const { return shape_ids_; }
+  absl::Span<const uint8> contains_center() const {
+    return contains_center_;
+  }
+  absl::Span<const int> edge_starts() const { return edge_starts_; }
+  absl::Span<const S2Point> edge_vertices() const { return edge_vertices_; }
+
+  // Returns the approximate number of bytes used by the arrays.
+  size_t SpaceUsed() const;
+
+ private:
+  // Appends the ids of the shapes that contain "p" to "result".
+  void AppendContainingShapeIds(const S2Point& p,
+                                std::vector<int>* result) const;
+
+  std::vector<uint64> cell_ids_;
+  std::vector<int> cell_starts_;
+  std::vector<int> shape_ids_;
+  std::vector<uint8> contains_center_;
+  std::vector<int> edge_starts_;
+  std::vector<S2Point> edge_vertices_;
+};
+
+#endif  // S2_S2FLAT_CONTAINS_POINT_INDEX_H_
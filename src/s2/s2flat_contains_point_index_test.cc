@@ -0,0 +1,102 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2flat_contains_point_index.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2executor.h"
+#include "s2/s2loop.h"
+#include "s2/s2shape.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using std::vector;
+
+namespace {
+
+vector<int> GetExpectedShapeIds(const MutableS2ShapeIndex& index,
+                                const S2Point& p) {
+  vector<int> result;
+  auto query = MakeS2ContainsPointQuery(&index);
+  for (S2Shape* shape : query.GetContainingShapes(p)) {
+    result.push_back(shape->id());
+  }
+  return result;
+}
+
+TEST(S2FlatContainsPointIndex, Empty) {
+  MutableS2ShapeIndex index;
+  S2FlatContainsPointIndex flat(index);
+  EXPECT_TRUE(flat.cell_ids().empty());
+  EXPECT_TRUE(flat.GetContainingShapeIds(S2Point(1, 0, 0)).empty());
+}
+
+TEST(S2FlatContainsPointIndex, IgnoresPointsAndPolylines) {
+  auto index = s2textformat::MakeIndexOrDie(
+      "0:0 # 0:0, 1:1 # -1:-1, -1:2, 2:2, 2:-1 | 0:0, 0:0.5, 0.5:0");
+  S2FlatContainsPointIndex flat(*index);
+  S2Point p = s2textformat::MakePointOrDie("1:0.1");
+  EXPECT_EQ(vector<int>{2}, flat.GetContainingShapeIds(p));
+  EXPECT_EQ(GetExpectedShapeIds(*index, p), flat.GetContainingShapeIds(p));
+}
+
+TEST(S2FlatContainsPointIndex, MatchesS2ContainsPointQuery) {
+  // Overlapping random polygons tested against random points and against
+  // their own vertices (which tests the semi-open vertex model).
+  MutableS2ShapeIndex index;
+  S2Cap cap(S2Point(1, 0, 0), S1Angle::Degrees(10));
+  vector<S2Point> points;
+  for (int i = 0; i < 100; ++i) {
+    S1Angle radius = S1Angle::Degrees(S2Testing::rnd.RandDouble() * 5);
+    auto loop = S2Loop::MakeRegularLoop(S2Testing::SamplePoint(cap), radius,
+                                        3 + S2Testing::rnd.Uniform(20));
+    for (int j = 0; j < loop->num_vertices(); ++j) {
+      points.push_back(loop->vertex(j));
+    }
+    index.Add(make_unique<S2Loop::OwningShape>(std::move(loop)));
+  }
+  for (int i = 0; i < 2000; ++i) {
+    points.push_back(S2Testing::SamplePoint(cap));
+  }
+  S2FlatContainsPointIndex flat(index);
+  for (const S2Point& p : points) {
+    EXPECT_EQ(GetExpectedShapeIds(index, p), flat.GetContainingShapeIds(p));
+  }
+
+  S2ThreadPool pool(3);
+  for (S2Executor* executor : {static_cast<S2Executor*>(nullptr),
+                               static_cast<S2Executor*>(&pool)}) {
+    vector<int> offsets, shape_ids;
+    flat.GetContainingShapeIds(points, &offsets, &shape_ids, 4, executor);
+    ASSERT_EQ(points.size() + 1, offsets.size());
+    EXPECT_EQ(shape_ids.size(), offsets.back());
+    for (int i = 0; i < points.size(); ++i) {
+      EXPECT_EQ(GetExpectedShapeIds(index, points[i]),
+                vector<int>(shape_ids.begin() + offsets[i],
+                            shape_ids.begin() + offsets[i + 1]));
+    }
+  }
+}
+
+}  // namespace
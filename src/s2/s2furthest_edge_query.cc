@@ -79,7 +79,7 @@ void S2FurthestEdgeQuery::FindFurthestEdges(
 
 S2FurthestEdgeQuery::Result S2FurthestEdgeQuery::FindFurthestEdge(
     Target* target) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 64, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   Base::Result base_result = base_.FindClosestEdge(target, tmp_options);
@@ -88,7 +88,7 @@ S2FurthestEdgeQuery::Result S2FurthestEdgeQuery::FindFurthestEdge(
 
 bool S2FurthestEdgeQuery::IsDistanceGreater(
     Target* target, S1ChordAngle limit) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 64, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   tmp_options.set_min_distance(limit);
@@ -98,7 +98,7 @@ bool S2FurthestEdgeQuery::IsDistanceGreater(
 
 bool S2FurthestEdgeQuery::IsDistanceGreaterOrEqual(
     Target* target, S1ChordAngle limit) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 64, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   tmp_options.set_inclusive_min_distance(limit);
@@ -108,7 +108,7 @@ bool S2FurthestEdgeQuery::IsDistanceGreaterOrEqual(
 
 bool S2FurthestEdgeQuery::IsConservativeDistanceGreaterOrEqual(
     Target* target, S1ChordAngle limit) {
-  static_assert(sizeof(Options) <= 32, "Consider not copying Options here");
+  static_assert(sizeof(Options) <= 64, "Consider not copying Options here");
   Options tmp_options = options_;
   tmp_options.set_max_results(1);
   tmp_options.set_conservative_min_distance(limit);
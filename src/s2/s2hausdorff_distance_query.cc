@@ -15,18 +15,29 @@
 
 #include "s2/s2hausdorff_distance_query.h"
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "s2/base/integral_types.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2closest_edge_query.h"
+#include "s2/s2executor.h"
 #include "s2/s2point.h"
+#include "s2/s2point_span.h"
 
 using DirectedResult = S2HausdorffDistanceQuery::DirectedResult;
 using Options = S2HausdorffDistanceQuery::Options;
 using Result = S2HausdorffDistanceQuery::Result;
 
 namespace {
+
+// The minimum number of target vertices that are worth processing in a
+// separate thread.
+constexpr int kMinVerticesPerThread = 100;
+
 // This internally used function computes the closest edge distance from point
 // to the source index via closest_edge_query, and, if necessary, updates the
 // max_distance, the target_point and the source_point.
@@ -55,6 +66,64 @@ void UpdateMaxDistance(const S2Point& point,
     source_point = closest_edge_query.Project(point, closest_edge);
   }
 }
+
+// Calls "visitor" with each target vertex that the discrete Hausdorff distance
+// is computed over, stopping early if it returns false.
+//
+// This approximation of Haussdorff distance is based on computing closest
+// point distances from the _vertices_ of the target index to _edges_ of the
+// source index.  Hence we iterate over all shapes in the target index, then
+// over all chains in those shapes, then over all edges in those chains, and
+// then over the edges' vertices.
+template <class Visitor>
+void VisitTargetVertices(const S2ShapeIndex* target, const Visitor& visitor) {
+  for (const S2Shape* shape : *target) {
+    for (int chain_id = 0; chain_id < shape->num_chains(); ++chain_id) {
+      const int chain_length = shape->chain(chain_id).length;
+      // We include the first vertex (v0) of an edge only if this is the first
+      // edge of a polyline. For point shapes (dim == 0) the first vertex is not
+      // needed since it coincides with the second vertex (v1). For polygon
+      // shapes (dim == 2) the first vertex is not needed since it coincides
+      // with the second vertex of the previous edge (or of the last) edge.
+      // TODO(b/212844787): Avoid loading vertices twice by using chain vertex
+      // iterators.
+      bool include_first_vertex = shape->dimension() == 1;
+      for (int offset = 0; offset < chain_length; ++offset) {
+        const S2Shape::Edge edge = shape->chain_edge(chain_id, offset);
+
+        if (include_first_vertex) {
+          if (!visitor(edge.v0)) return;
+          include_first_vertex = false;
+        }
+        if (!visitor(edge.v1)) return;
+      }
+    }
+  }
+}
+
+// Divides the target vertices into at most "max_blocks" contiguous blocks and
+// calls process_block(t, points) for each block t = 0, 1, ... in parallel
+// (see S2ParallelFor), where "points" spans the vertices of the block.
+template <class ProcessBlock>
+void ProcessTargetBlocks(const S2ShapeIndex* target, int max_blocks,
+                         S2Executor* executor,
+                         const ProcessBlock& process_block) {
+  std::vector<S2Point> points;
+  VisitTargetVertices(target, [&points](const S2Point& point) {
+    points.push_back(point);
+    return true;
+  });
+  const int num_points = points.size();
+  const int num_blocks =
+      std::max(1, std::min(max_blocks, num_points / kMinVerticesPerThread));
+  auto run_block = [&](int t) {
+    int begin = int64{num_points} * t / num_blocks;
+    int end = int64{num_points} * (t + 1) / num_blocks;
+    process_block(t, absl::MakeConstSpan(points.data() + begin, end - begin));
+  };
+  S2ParallelFor(executor, num_blocks, run_block);
+}
+
 }  // namespace
 
 S2HausdorffDistanceQuery::S2HausdorffDistanceQuery(
@@ -84,6 +153,56 @@ absl::optional<Result> S2HausdorffDistanceQuery::GetResult(
   }
 }
 
+bool S2HausdorffDistanceQuery::IsDirectedDistanceLess(
+    const S2ShapeIndex* target, const S2ShapeIndex* source,
+    S1ChordAngle limit) const {
+  // The distance is infinite if either index is empty.
+  if (target->num_shape_ids() == 0 || source->num_shape_ids() == 0) {
+    return false;
+  }
+  // Every target vertex must be within "limit" of the source index.  Each
+  // vertex is tested with S2ClosestEdgeQuery::IsDistanceLess(), which stops
+  // as soon as it finds any edge closer than "limit", and the whole test
+  // stops at the first vertex that is not.
+  std::atomic<bool> is_less(true), found_vertex(false);
+  auto test_vertex = [&](S2ClosestEdgeQuery* query, const S2Point& point) {
+    found_vertex.store(true, std::memory_order_relaxed);
+    S2ClosestEdgeQuery::PointTarget point_target(point);
+    if (!query->IsDistanceLess(&point_target, limit)) {
+      is_less.store(false, std::memory_order_relaxed);
+    }
+    return is_less.load(std::memory_order_relaxed);
+  };
+  const int num_threads =
+      S2NumThreads(options_.executor(), options_.num_threads());
+  if (num_threads == 1) {
+    S2ClosestEdgeQuery closest_edge_query(source);
+    closest_edge_query.mutable_options()->set_include_interiors(
+        options_.include_interiors());
+    VisitTargetVertices(target, [&](const S2Point& point) {
+      return test_vertex(&closest_edge_query, point);
+    });
+  } else {
+    ProcessTargetBlocks(target, num_threads, options_.executor(),
+                        [&](int t, S2PointSpan points) {
+      S2ClosestEdgeQuery closest_edge_query(source);
+      closest_edge_query.mutable_options()->set_include_interiors(
+          options_.include_interiors());
+      for (const S2Point& point : points) {
+        if (!test_vertex(&closest_edge_query, point)) return;
+      }
+    });
+  }
+  return is_less.load() && found_vertex.load();
+}
+
+bool S2HausdorffDistanceQuery::IsDistanceLess(const S2ShapeIndex* target,
+                                              const S2ShapeIndex* source,
+                                              S1ChordAngle limit) const {
+  return IsDirectedDistanceLess(target, source, limit) &&
+         IsDirectedDistanceLess(source, target, limit);
+}
+
 S1ChordAngle S2HausdorffDistanceQuery::GetDirectedDistance(
     const S2ShapeIndex* target, const S2ShapeIndex* source) const {
   absl::optional<DirectedResult> directed_result =
@@ -94,39 +213,51 @@ S1ChordAngle S2HausdorffDistanceQuery::GetDirectedDistance(
 
 absl::optional<DirectedResult> S2HausdorffDistanceQuery::GetDirectedResult(
     const S2ShapeIndex* target, const S2ShapeIndex* source) const {
-  S2ClosestEdgeQuery closest_edge_query(source);
-  closest_edge_query.mutable_options()->set_max_results(1);
-  closest_edge_query.mutable_options()->set_include_interiors(
-      options_.include_interiors());
+  const S1ChordAngle distance_limit = options_.distance_limit();
   S1ChordAngle max_distance = S1ChordAngle::Negative();
-  S2Point source_point, target_point;
-
-  // This approximation of Haussdorff distance is based on computing closest
-  // point distances from the _vertices_ of the target index to _edges_ of the
-  // source index.  Hence we iterate over all shapes in the target index, then
-  // over all chains in those shapes, then over all edges in those chains, and
-  // then over the edges' vertices.
-  for (const S2Shape* shape : *target) {
-    for (int chain_id = 0; chain_id < shape->num_chains(); ++chain_id) {
-      const int chain_length = shape->chain(chain_id).length;
-      // We include the first vertex (v0) of an edge only if this is the first
-      // edge of a polyline. For point shapes (dim == 0) the first vertex is not
-      // needed since it coincides with the second vertex (v1). For polygon
-      // shapes (dim == 2) the first vertex is not needed since it coincides
-      // with the second vertex of the previous edge (or of the last) edge.
-      // TODO(b/212844787): Avoid loading vertices twice by using chain vertex
-      // iterators.
-      bool include_first_vertex = shape->dimension() == 1;
-      for (int offset = 0; offset < chain_length; ++offset) {
-        const S2Shape::Edge edge = shape->chain_edge(chain_id, offset);
-
-        if (include_first_vertex) {
-          UpdateMaxDistance(edge.v0, closest_edge_query, max_distance,
-                            target_point, source_point);
-          include_first_vertex = false;
+  S2Point target_point;
+  const int num_threads =
+      S2NumThreads(options_.executor(), options_.num_threads());
+  if (num_threads == 1) {
+    S2ClosestEdgeQuery closest_edge_query(source);
+    closest_edge_query.mutable_options()->set_max_results(1);
+    closest_edge_query.mutable_options()->set_include_interiors(
+        options_.include_interiors());
+    S2Point source_point;
+    VisitTargetVertices(target, [&](const S2Point& point) {
+      UpdateMaxDistance(point, closest_edge_query, max_distance, target_point,
+                        source_point);
+      return max_distance <= distance_limit;
+    });
+  } else {
+    // The closest edge queries are independent, so the target vertices are
+    // divided into contiguous blocks that are processed in parallel, each
+    // with its own S2ClosestEdgeQuery.  The block maxima are then combined in
+    // order, which yields the same target point as a single-threaded query.
+    std::vector<S1ChordAngle> max_distances(num_threads,
+                                            S1ChordAngle::Negative());
+    std::vector<S2Point> target_points(num_threads);
+    std::atomic<bool> limit_exceeded(false);
+    ProcessTargetBlocks(target, num_threads, options_.executor(),
+                        [&](int t, S2PointSpan points) {
+      S2ClosestEdgeQuery closest_edge_query(source);
+      closest_edge_query.mutable_options()->set_max_results(1);
+      closest_edge_query.mutable_options()->set_include_interiors(
+          options_.include_interiors());
+      S2Point source_point;
+      for (const S2Point& point : points) {
+        if (limit_exceeded.load(std::memory_order_relaxed)) return;
+        UpdateMaxDistance(point, closest_edge_query, max_distances[t],
+                          target_points[t], source_point);
+        if (max_distances[t] > distance_limit) {
+          limit_exceeded.store(true, std::memory_order_relaxed);
         }
-        UpdateMaxDistance(edge.v1, closest_edge_query, max_distance,
-                          target_point, source_point);
+      }
+    });
+    for (int t = 0; t < num_threads; ++t) {
+      if (max_distance < max_distances[t]) {
+        max_distance = max_distances[t];
+        target_point = target_points[t];
       }
     }
   }
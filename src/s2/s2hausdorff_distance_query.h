@@ -20,8 +20,10 @@
 #include <algorithm>
 
 #include "absl/types/optional.h"
+#include "s2/base/logging.h"
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
+#include "s2/s2executor.h"
 #include "s2/s2min_distance_targets.h"
 #include "s2/s2point.h"
 #include "s2/s2shape_index.h"
@@ -104,8 +106,45 @@ class S2HausdorffDistanceQuery {
       include_interiors_ = include_interiors;
     }
 
+    // If the directed distance is found to exceed distance_limit, the query
+    // stops early and returns a result whose distance exceeds distance_limit
+    // but may be smaller than the true directed distance.  This is useful
+    // when only the comparison with a threshold matters (e.g. for change
+    // detection).  Results that do not exceed distance_limit are exact.
+    //
+    // DEFAULT: S1ChordAngle::Infinity()
+    S1ChordAngle distance_limit() const { return distance_limit_; }
+    void set_distance_limit(S1ChordAngle distance_limit) {
+      distance_limit_ = distance_limit;
+    }
+
+    // The maximum number of threads used to compute the closest edge
+    // distances from the target vertices.  The vertices are divided into
+    // contiguous blocks, so the result does not depend on this value (except
+    // when the query stops early due to distance_limit).
+    //
+    // REQUIRES: "source" allows concurrent queries (e.g. MutableS2ShapeIndex).
+    //
+    // DEFAULT: 1
+    int num_threads() const { return num_threads_; }
+    void set_num_threads(int num_threads) {
+      S2_DCHECK_GE(num_threads, 1);
+      num_threads_ = num_threads;
+    }
+
+    // If non-null, the target vertices are processed on this executor rather
+    // than on newly created threads, and num_threads() is replaced by
+    // executor->num_threads().  The executor must outlive the query.
+    //
+    // DEFAULT: nullptr
+    S2Executor* executor() const { return executor_; }
+    void set_executor(S2Executor* executor) { executor_ = executor; }
+
    private:
     bool include_interiors_ = true;
+    S1ChordAngle distance_limit_ = S1ChordAngle::Infinity();
+    int num_threads_ = 1;
+    S2Executor* executor_ = nullptr;
   };
 
   // DirectedResult stores the results of directed Hausdorff distance queries
@@ -199,6 +238,21 @@ class S2HausdorffDistanceQuery {
   S1ChordAngle GetDistance(const S2ShapeIndex* target,
                            const S2ShapeIndex* source) const;
 
+  // Returns true if the directed Hausdorff distance from the target index to
+  // the source index is less than "limit" (and false if either index is
+  // empty).  This method is usually much faster than GetDirectedDistance(),
+  // since each target vertex only needs to be proven within "limit" of some
+  // source edge (see S2ClosestEdgeQuery::IsDistanceLess), and the query stops
+  // at the first vertex that is not.
+  bool IsDirectedDistanceLess(const S2ShapeIndex* target,
+                              const S2ShapeIndex* source,
+                              S1ChordAngle limit) const;
+
+  // Returns true if the [undirected] Hausdorff distance between the target
+  // index and the source index is less than "limit".
+  bool IsDistanceLess(const S2ShapeIndex* target, const S2ShapeIndex* source,
+                      S1ChordAngle limit) const;
+
  private:
   Options options_;
 };
@@ -24,12 +24,15 @@
 #include "s2/mutable_s2shape_index.h"
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
 #include "s2/s2point.h"
 #include "s2/s2point_vector_shape.h"
 #include "s2/s2predicates.h"
+#include "s2/s2testing.h"
 #include "s2/s2text_format.h"
 
 using absl::make_unique;
@@ -249,3 +252,98 @@ TEST(S2HausdorffDistanceQueryTest, OverlappingPolygons) {
   EXPECT_NEAR(a_to_b_2->distance().degrees(), 0.5, kEpsilon);
   EXPECT_EQ(a_to_b_2->target_point(), expected_target_point_2);
 }
+
+// Test that multi-threaded queries return the same results as single-threaded
+// ones, and that distance_limit stops the query early.
+TEST(S2HausdorffDistanceQueryTest, MultipleThreadsAndDistanceLimit) {
+  S2Testing::rnd.Reset(1);
+  const S2Point center = S2Testing::RandomPoint();
+  std::vector<S2Point> a_points, b_points;
+  for (int i = 0; i < 2000; ++i) {
+    a_points.push_back(S2Testing::SamplePoint(
+        S2Cap(center, S1Angle::Degrees(1))));
+    b_points.push_back(S2Testing::SamplePoint(
+        S2Cap(center, S1Angle::Degrees(1.2))));
+  }
+  MutableS2ShapeIndex a, b;
+  a.Add(make_unique<S2PointVectorShape>(a_points));
+  b.Add(make_unique<S2LaxPolylineShape>(b_points));
+
+  S2HausdorffDistanceQuery query;
+  const absl::optional<Result> expected = query.GetResult(&a, &b);
+  ASSERT_TRUE(expected);
+  for (int num_threads : {2, 4, 100}) {
+    query.mutable_options()->set_num_threads(num_threads);
+    absl::optional<Result> result = query.GetResult(&a, &b);
+    ASSERT_TRUE(result);
+    EXPECT_EQ(result->distance(), expected->distance());
+    EXPECT_EQ(result->target_to_source().target_point(),
+              expected->target_to_source().target_point());
+    EXPECT_EQ(result->source_to_target().target_point(),
+              expected->source_to_target().target_point());
+  }
+  S2ThreadPool pool(4);
+  query.mutable_options()->set_num_threads(1);
+  query.mutable_options()->set_executor(&pool);
+  absl::optional<Result> pool_result = query.GetResult(&a, &b);
+  ASSERT_TRUE(pool_result);
+  EXPECT_EQ(pool_result->distance(), expected->distance());
+  EXPECT_EQ(pool_result->target_to_source().target_point(),
+            expected->target_to_source().target_point());
+  query.mutable_options()->set_executor(nullptr);
+  const MutableS2ShapeIndex empty_index;
+  EXPECT_FALSE(query.GetDirectedResult(&empty_index, &a));
+
+  const S1ChordAngle exact = expected->target_to_source().distance();
+  for (int num_threads : {1, 4}) {
+    query.mutable_options()->set_num_threads(num_threads);
+    // A limit that is not exceeded does not change the result.
+    query.mutable_options()->set_distance_limit(exact);
+    EXPECT_EQ(query.GetDirectedDistance(&a, &b), exact);
+
+    // Otherwise the result exceeds the limit but may be smaller.
+    const S1ChordAngle limit = S1ChordAngle::Radians(1e-9);
+    query.mutable_options()->set_distance_limit(limit);
+    const S1ChordAngle distance = query.GetDirectedDistance(&a, &b);
+    EXPECT_GT(distance, limit);
+    EXPECT_LE(distance, exact);
+  }
+}
+
+// Test that IsDistanceLess() agrees with GetDistance().
+TEST(S2HausdorffDistanceQueryTest, IsDistanceLess) {
+  S2Testing::rnd.Reset(2);
+  const S2Point center = S2Testing::RandomPoint();
+  std::vector<S2Point> a_points, b_points;
+  for (int i = 0; i < 500; ++i) {
+    a_points.push_back(S2Testing::SamplePoint(
+        S2Cap(center, S1Angle::Degrees(1))));
+    b_points.push_back(S2Testing::SamplePoint(
+        S2Cap(center, S1Angle::Degrees(1.2))));
+  }
+  MutableS2ShapeIndex a, b;
+  a.Add(make_unique<S2PointVectorShape>(a_points));
+  b.Add(make_unique<S2LaxPolylineShape>(b_points));
+  const MutableS2ShapeIndex empty_index;
+
+  for (int num_threads : {1, 4}) {
+    S2HausdorffDistanceQuery query;
+    query.mutable_options()->set_num_threads(num_threads);
+    for (const auto& indexes : {std::make_pair(&a, &b),
+                                std::make_pair(&b, &a)}) {
+      const S2ShapeIndex* target = indexes.first;
+      const S2ShapeIndex* source = indexes.second;
+      const S1ChordAngle directed = query.GetDirectedDistance(target, source);
+      EXPECT_FALSE(query.IsDirectedDistanceLess(target, source, directed));
+      EXPECT_TRUE(query.IsDirectedDistanceLess(target, source,
+                                               directed.Successor()));
+      EXPECT_FALSE(query.IsDirectedDistanceLess(target, &empty_index,
+                                                S1ChordAngle::Infinity()));
+      EXPECT_FALSE(query.IsDirectedDistanceLess(&empty_index, source,
+                                                S1ChordAngle::Infinity()));
+    }
+    const S1ChordAngle distance = query.GetDistance(&a, &b);
+    EXPECT_FALSE(query.IsDistanceLess(&a, &b, distance));
+    EXPECT_TRUE(query.IsDistanceLess(&a, &b, distance.Successor()));
+  }
+}
@@ -18,6 +18,7 @@
 #include "s2/s2latlng.h"
 
 #include <algorithm>
+#include <cmath>
 #include <ostream>
 
 #include "s2/base/logging.h"
@@ -43,6 +44,128 @@ S2Point S2LatLng::ToPoint() const {
   return S2Point(cos(theta) * cosphi, sin(theta) * cosphi, sin(phi));
 }
 
+namespace {
+
+// The functions below approximate sin(), cos() and atan2() using the
+// polynomial and rational approximations of the Cephes math library.  They
+// do not branch (except where the compiler can use conditional moves), so
+// that loops calling them can be vectorized.
+
+// pi/2 split into three parts such that q * kPiOver2Hi and q * kPiOver2Mid
+// are exact for the small integers "q" used below (Cody-Waite reduction).
+constexpr double kPiOver2Hi = 1.57079625129699707031;
+constexpr double kPiOver2Mid = 7.54978941586159635335E-8;
+constexpr double kPiOver2Lo = 5.39030285815811905290E-15;
+
+// The low-order bits of M_PI_2, i.e. (pi/2 - M_PI_2).
+constexpr double kPiOver2LoBits = 6.123233995736765886130E-17;
+
+// Sets "s" and "c" to sin(x) and cos(x).
+//
+// REQUIRES: |x| <= M_PI
+inline void FastSinCos(double x, double* s, double* c) {
+  // Reduce "x" to the range [-pi/4, pi/4] by subtracting a multiple "q" of
+  // pi/2, and then compute the sine and cosine of the remainder "r".
+  double q = std::floor(x * M_2_PI + 0.5);
+  double r = ((x - q * kPiOver2Hi) - q * kPiOver2Mid) - q * kPiOver2Lo;
+  double z = r * r;
+  double sin_r = r + r * z * ((((((1.58962301576546568060E-10 * z -
+                                   2.50507477628578072866E-8) * z +
+                                  2.75573136213857245213E-6) * z -
+                                 1.98412698295895385996E-4) * z +
+                                8.33333333332211858878E-3) * z -
+                               1.66666666666666307295E-1));
+  double cos_r = 1.0 - 0.5 * z + z * z * ((((((-1.13585365213876817300E-11 *
+                                               z + 2.08757008419747316778E-9) *
+                                              z - 2.75573141792967388112E-7) *
+                                             z + 2.48015872888517045348E-5) *
+                                            z - 1.38888888888730564116E-3) *
+                                           z + 4.16666666666665929218E-2));
+
+  // Adjust the results according to the quadrant q mod 4.
+  double quadrant = q - 4 * std::floor(q * 0.25);
+  bool swap = (quadrant == 1 || quadrant == 3);
+  double sin_x = swap ? cos_r : sin_r;
+  double cos_x = swap ? sin_r : cos_r;
+  *s = (quadrant >= 2) ? -sin_x : sin_x;
+  *c = (quadrant == 1 || quadrant == 2) ? -cos_x : cos_x;
+}
+
+// Returns atan2(y, x), with the same conventions as S2LatLng::Longitude()
+// (i.e., -0.0 is treated as +0.0 and atan2(0, 0) == 0).
+//
+// REQUIRES: "x" and "y" are finite.
+inline double FastAtan2(double y, double x) {
+  y += 0.0;
+  x += 0.0;
+  double ax = std::fabs(x), ay = std::fabs(y);
+  double max_xy = std::max(ax, ay), min_xy = std::min(ax, ay);
+
+  // Compute atan(t) for t in [0, 1].  Values above 0.66 are reduced using
+  // atan(t) = pi/4 + atan((t - 1) / (t + 1)).
+  double t = (max_xy == 0) ? 0 : min_xy / max_xy;
+  bool reduce = t > 0.66;
+  double u = reduce ? (t - 1) / (t + 1) : t;
+  double z = u * u;
+  double p = (((-8.750608600031904122785E-1 * z -
+                1.615753718733365076637E1) * z -
+               7.500855792314704667340E1) * z -
+              1.228866684490136173410E2) * z -
+             6.485021904942025371773E1;
+  double q = ((((z + 2.485846490142306297962E1) * z +
+                1.650270098316988542046E2) * z +
+               4.328810604912902668951E2) * z +
+              4.853903996359136964868E2) * z +
+             1.945506571482613964425E2;
+  double r = u + u * (z * p / q);
+  r = reduce ? M_PI_4 + (r + 0.5 * kPiOver2LoBits) : r;
+
+  // Map the result back to the correct octant.
+  r = (ay > ax) ? (M_PI_2 - r) + kPiOver2LoBits : r;
+  r = (x < 0) ? (M_PI - r) + 2 * kPiOver2LoBits : r;
+  return (y < 0) ? -r : r;
+}
+
+}  // namespace
+
+void S2LatLng::ToPoints(absl::Span<const S2LatLng> latlngs,
+                        absl::Span<S2Point> points) {
+  S2_DCHECK_EQ(latlngs.size(), points.size());
+  const size_t n = latlngs.size();
+  for (size_t i = 0; i < n; ++i) {
+    double sin_lat, cos_lat, sin_lng, cos_lng;
+    FastSinCos(latlngs[i].coords_[0], &sin_lat, &cos_lat);
+    FastSinCos(latlngs[i].coords_[1], &sin_lng, &cos_lng);
+    points[i] = S2Point(cos_lng * cos_lat, sin_lng * cos_lat, sin_lat);
+  }
+  // The approximations above are only accurate for valid inputs, so convert
+  // any other inputs (including NaNs) using the exact method.  This is done
+  // in a separate pass so that the loop above can be vectorized.
+  for (size_t i = 0; i < n; ++i) {
+    if (!latlngs[i].is_valid()) points[i] = latlngs[i].ToPoint();
+  }
+}
+
+void S2LatLng::FromPoints(absl::Span<const S2Point> points,
+                          absl::Span<S2LatLng> latlngs) {
+  S2_DCHECK_EQ(points.size(), latlngs.size());
+  const size_t n = points.size();
+  for (size_t i = 0; i < n; ++i) {
+    const S2Point& p = points[i];
+    latlngs[i].coords_ = R2Point(
+        FastAtan2(p[2], sqrt(p[0] * p[0] + p[1] * p[1])),
+        FastAtan2(p[1], p[0]));
+  }
+  // As above, use the exact method for inputs not handled above.
+  for (size_t i = 0; i < n; ++i) {
+    const S2Point& p = points[i];
+    if (!(std::isfinite(p[0]) && std::isfinite(p[1]) &&
+          std::isfinite(p[2]))) {
+      latlngs[i] = S2LatLng(p);
+    }
+  }
+}
+
 S2LatLng::S2LatLng(const S2Point& p)
   : coords_(Latitude(p).radians(), Longitude(p).radians()) {
   // The latitude and longitude are already normalized.
@@ -24,6 +24,7 @@
 #include <string>
 
 #include "absl/hash/hash.h"
+#include "absl/types/span.h"
 
 #include "s2/base/integral_types.h"
 #include "s2/_fp_contract_off.h"
@@ -100,6 +101,31 @@ class S2LatLng {
   // Converts to an S2Point (equivalent to the operator above).
   S2Point ToPoint() const;
 
+  // Converts each S2LatLng in "latlngs" to an S2Point and stores it in the
+  // corresponding element of "points".  This is equivalent to calling
+  // ToPoint() on each element, except that it is several times faster
+  // because sin() and cos() are computed using polynomial approximations
+  // that can be vectorized.  Each coordinate of the result is within
+  // 2 * DBL_EPSILON of the coordinate computed by ToPoint().  Elements that
+  // are not valid (see is_valid()) are converted using ToPoint() itself.
+  //
+  // REQUIRES: latlngs.size() == points.size()
+  static void ToPoints(absl::Span<const S2LatLng> latlngs,
+                       absl::Span<S2Point> points);
+
+  // Converts each S2Point in "points" to an S2LatLng and stores it in the
+  // corresponding element of "latlngs".  This is equivalent to calling
+  // S2LatLng(S2Point) on each element, except that it is several times
+  // faster because atan2() is computed using a rational approximation that
+  // can be vectorized.  The latitude and longitude of each result are within
+  // 2 * DBL_EPSILON radians of those computed by S2LatLng(S2Point).  Points
+  // that have non-finite coordinates are converted using S2LatLng(S2Point)
+  // itself.
+  //
+  // REQUIRES: points.size() == latlngs.size()
+  static void FromPoints(absl::Span<const S2Point> points,
+                         absl::Span<S2LatLng> latlngs);
+
   // Returns the distance (measured along the surface of the sphere) to the
   // given S2LatLng, implemented using the Haversine formula.  This is
   // equivalent to
@@ -340,6 +340,22 @@ bool S2LatLngRect::MayIntersect(const S2Cell& cell) const {
   return Intersects(cell.GetRectBound());
 }
 
+void S2LatLngRect::ContainsBatch(absl::Span<const S2Cell> cells,
+                                 absl::Span<bool> result) const {
+  S2_DCHECK_EQ(cells.size(), result.size());
+  for (size_t k = 0; k < cells.size(); ++k) {
+    result[k] = Contains(cells[k].GetRectBound());
+  }
+}
+
+void S2LatLngRect::MayIntersectBatch(absl::Span<const S2Cell> cells,
+                                     absl::Span<bool> result) const {
+  S2_DCHECK_EQ(cells.size(), result.size());
+  for (size_t k = 0; k < cells.size(); ++k) {
+    result[k] = Intersects(cells[k].GetRectBound());
+  }
+}
+
 void S2LatLngRect::Encode(Encoder* encoder) const {
   encoder->Ensure(40);  // sufficient
 
@@ -22,6 +22,7 @@
 #include <iosfwd>
 #include <iostream>
 
+#include "absl/types/span.h"
 #include "s2/base/logging.h"
 #include "s2/_fp_contract_off.h"
 #include "s2/r1interval.h"
@@ -337,6 +338,14 @@ class S2LatLngRect final : public S2Region {
   // method goes up as the cells get smaller.
   bool MayIntersect(const S2Cell& cell) const override;
 
+  // Batch versions of Contains(S2Cell) and MayIntersect(S2Cell) that avoid a
+  // virtual call per cell.
+  void ContainsBatch(absl::Span<const S2Cell> cells,
+                     absl::Span<bool> result) const override;
+  void MayIntersectBatch(absl::Span<const S2Cell> cells,
+                         absl::Span<bool> result) const override;
+  bool HasFastCellContains() const override { return true; }
+
   // The point 'p' does not need to be normalized.
   bool Contains(const S2Point& p) const override;
 
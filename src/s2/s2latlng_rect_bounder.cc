@@ -30,6 +30,8 @@ using std::fabs;
 using std::max;
 using std::min;
 
+constexpr int S2LatLngRectBounder::kBlockSize;
+
 void S2LatLngRectBounder::AddPoint(const S2Point& b) {
   S2_DCHECK(S2::IsUnitLength(b));
   AddInternal(b, S2LatLng(b));
@@ -39,6 +41,59 @@ void S2LatLngRectBounder::AddLatLng(const S2LatLng& b_latlng) {
   AddInternal(b_latlng.ToPoint(), b_latlng);
 }
 
+void S2LatLngRectBounder::AddPoints(S2PointSpan points) {
+  for (size_t i = 0; i < points.size(); i += kBlockSize) {
+    AddBlock(points.data() + i,
+             static_cast<int>(min<size_t>(kBlockSize, points.size() - i)));
+  }
+}
+
+void S2LatLngRectBounder::AddBlock(const S2Point* points, int n) {
+  S2LatLng latlngs[kBlockSize];
+  for (int i = 0; i < n; ++i) {
+    S2_DCHECK(S2::IsUnitLength(points[i]));
+    latlngs[i] = S2LatLng(points[i]);
+  }
+  // For each edge ending at points[i], compute the norm of the normal N and
+  // the projections "m_a" and "m_b" exactly as AddInternal() does.  Edge 0
+  // starts at a_, which is only meaningful if bound_ is non-empty.
+  double n_norm[kBlockSize], m_a[kBlockSize], m_b[kBlockSize];
+  for (int i = 0; i < n; ++i) {
+    const S2Point& a = (i == 0) ? a_ : points[i - 1];
+    const S2Point& b = points[i];
+    Vector3_d normal = (a - b).CrossProd(a + b);
+    Vector3_d m = normal.CrossProd(S2Point(0, 0, 1));
+    n_norm[i] = normal.Norm();
+    m_a[i] = m.DotProd(a);
+    m_b[i] = m.DotProd(b);
+  }
+  for (int i = 0; i < n; ++i) {
+    const S2Point& b = points[i];
+    const S2LatLng& b_latlng = latlngs[i];
+    double m_error = 6.06638e-16 * n_norm[i] + 6.83174e-31;
+    if (bound_.is_empty() || n_norm[i] < 1.91346e-15 ||
+        m_a[i] * m_b[i] < 0 || fabs(m_a[i]) <= m_error ||
+        fabs(m_b[i]) <= m_error) {
+      // The edge is degenerate or may attain its minimum or maximum latitude
+      // in its interior, so we use the general code.
+      AddInternal(b, b_latlng);
+      continue;
+    }
+    // Otherwise the latitude range of the edge is spanned by its endpoints.
+    // This is the same computation as in AddInternal().
+    S1Interval lng_ab = S1Interval::FromPointPair(a_latlng_.lng().radians(),
+                                                  b_latlng.lng().radians());
+    if (lng_ab.GetLength() >= M_PI - 2 * DBL_EPSILON) {
+      lng_ab = S1Interval::Full();
+    }
+    R1Interval lat_ab = R1Interval::FromPointPair(a_latlng_.lat().radians(),
+                                                  b_latlng.lat().radians());
+    bound_ = bound_.Union(S2LatLngRect(lat_ab, lng_ab));
+    a_ = b;
+    a_latlng_ = b_latlng;
+  }
+}
+
 void S2LatLngRectBounder::AddInternal(const S2Point& b,
                                       const S2LatLng& b_latlng) {
   // Simple consistency check to verify that b and b_latlng are alternate
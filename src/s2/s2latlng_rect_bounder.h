@@ -21,6 +21,7 @@
 #include "s2/s2latlng.h"
 #include "s2/s2latlng_rect.h"
 #include "s2/s2point.h"
+#include "s2/s2point_span.h"
 
 // This class computes a bounding rectangle that contains all edges defined
 // by a vertex chain v0, v1, v2, ...  All vertices must be unit length.
@@ -46,6 +47,14 @@ class S2LatLngRectBounder {
   // represented as an S2LatLng.  Repeated vertices are ignored.
   void AddLatLng(const S2LatLng& b_latlng);
 
+  // Equivalent to calling AddPoint() for each element of "points" in order,
+  // but faster for long vertex chains.  The points are processed in blocks
+  // so that the arithmetic that decides whether an edge may attain its
+  // minimum or maximum latitude in its interior is done in simple loops that
+  // the compiler can vectorize; only the edges that may do so take the
+  // expensive path.
+  void AddPoints(S2PointSpan points);
+
   // Returns the bounding rectangle of the edge chain that connects the
   // vertices defined so far.  This bound satisfies the guarantee made
   // above, i.e. if the edge chain defines a loop, then the bound contains
@@ -78,6 +87,10 @@ class S2LatLngRectBounder {
   // must refer to the same vertex.
   void AddInternal(const S2Point& b, const S2LatLng& b_latlng);
 
+  // Adds points[0, n) where n <= kBlockSize.  Used by AddPoints().
+  static constexpr int kBlockSize = 64;
+  void AddBlock(const S2Point* points, int n);
+
   S2Point a_;             // The previous vertex in the chain.
   S2LatLng a_latlng_;     // The corresponding latitude-longitude.
   S2LatLngRect bound_;    // The current bounding rectangle.
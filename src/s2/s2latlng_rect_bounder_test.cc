@@ -31,6 +31,7 @@
 #include "s2/s2testing.h"
 
 using absl::StrCat;
+using std::vector;
 
 S2LatLngRect GetEdgeBound(const S2Point& a, const S2Point& b) {
   S2LatLngRectBounder bounder;
@@ -218,6 +219,44 @@ TEST(RectBounder, NearlyIdenticalOrAntipodalPoints) {
   }
 }
 
+TEST(RectBounder, AddPointsMatchesAddPoint) {
+  // Build vertex chains that mix short edges, long edges, edges through the
+  // poles, and repeated or antipodal vertices, and check that AddPoints()
+  // computes exactly the same bound as calling AddPoint() repeatedly (both
+  // in a single call and when the chain is split into several calls).
+  S2Testing::Random* rnd = &S2Testing::rnd;
+  for (int iter = 0; iter < 200; ++iter) {
+    SCOPED_TRACE(StrCat("Iteration ", iter));
+    vector<S2Point> points;
+    int n = rnd->Uniform(300);
+    for (int i = 0; i < n; ++i) {
+      S2Point prev = points.empty() ? S2Testing::RandomPoint() : points.back();
+      S2Point next;
+      switch (rnd->Uniform(6)) {
+        case 0: next = S2Testing::RandomPoint(); break;
+        case 1: next = PerturbATowardsB(prev, PointNearPole()); break;
+        case 2: next = PerturbATowardsB(prev, PointNearEquator()); break;
+        case 3: next = PerturbATowardsB(prev, S2Testing::RandomPoint()); break;
+        case 4: next = prev; break;
+        case 5: next = -prev; break;
+      }
+      points.push_back(next);
+    }
+    S2LatLngRectBounder expected;
+    for (const S2Point& p : points) expected.AddPoint(p);
+
+    S2LatLngRectBounder actual;
+    actual.AddPoints(points);
+    EXPECT_EQ(expected.GetBound(), actual.GetBound());
+
+    S2LatLngRectBounder split;
+    int k = n == 0 ? 0 : rnd->Uniform(n);
+    split.AddPoints(S2PointSpan(points.data(), k));
+    split.AddPoints(S2PointSpan(points.data() + k, n - k));
+    EXPECT_EQ(expected.GetBound(), split.GetBound());
+  }
+}
+
 S2LatLngRect GetSubregionBound(double x_lat, double x_lng,
                                double y_lat, double y_lng) {
   S2LatLngRect in = S2LatLngRect::FromPointPair(
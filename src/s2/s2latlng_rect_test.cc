@@ -23,6 +23,8 @@
 
 #include <algorithm>
 #include <cmath>
+#include <memory>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include "s2/util/coding/coder.h"
@@ -38,6 +40,7 @@
 using s2textformat::MakePointOrDie;
 using std::fabs;
 using std::min;
+using std::vector;
 
 static S2LatLngRect RectFromDegrees(double lat_lo, double lng_lo,
                                     double lat_hi, double lng_hi) {
@@ -530,6 +533,27 @@ static void TestCellOps(const S2LatLngRect& r, const S2Cell& cell,
   EXPECT_EQ(r.Contains(cell), level >= 4);
 }
 
+TEST(S2LatLngRect, BatchCellOps) {
+  S2LatLngRect rect = RectFromDegrees(10, 20, 30, 50);
+  vector<S2Cell> cells;
+  S2CellId id(S2LatLng::FromDegrees(30, 20));
+  for (int level = 2; level <= 10; ++level) {
+    S2CellId parent = id.parent(level);
+    for (S2CellId c = parent.child_begin(level + 2);
+         c != parent.child_end(level + 2); c = c.next()) {
+      cells.push_back(S2Cell(c));
+    }
+  }
+  std::unique_ptr<bool[]> contains(new bool[cells.size()]);
+  std::unique_ptr<bool[]> intersects(new bool[cells.size()]);
+  rect.ContainsBatch(cells, absl::MakeSpan(contains.get(), cells.size()));
+  rect.MayIntersectBatch(cells, absl::MakeSpan(intersects.get(), cells.size()));
+  for (int k = 0; k < cells.size(); ++k) {
+    EXPECT_EQ(rect.Contains(cells[k]), contains[k]);
+    EXPECT_EQ(rect.MayIntersect(cells[k]), intersects[k]);
+  }
+}
+
 TEST(S2LatLngRect, CellOps) {
   // Contains(S2Cell), MayIntersect(S2Cell), Intersects(S2Cell)
 
@@ -17,14 +17,18 @@
 
 #include "s2/s2latlng.h"
 
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
 #include <cstdio>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include "absl/base/macros.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 
 #include "s2/base/logging.h"
 #include "s2/s2pointutil.h"
@@ -118,6 +122,73 @@ TEST(S2LatLng, NegativeZeros) {
       S2LatLng::Longitude(S2Point(-0., -0., 1.)).radians(), +0.));
 }
 
+TEST(S2LatLng, ToPointsMatchesToPoint) {
+  std::vector<S2LatLng> latlngs = {
+      S2LatLng::FromDegrees(90, 65), S2LatLng::FromDegrees(-90, 0),
+      S2LatLng::FromDegrees(12.2, 180), S2LatLng::FromRadians(0.1, -M_PI),
+      S2LatLng::FromRadians(-0.0, -0.0), S2LatLng::FromDegrees(45, -45),
+      S2LatLng::FromDegrees(100, 400),  // Invalid.
+      S2LatLng::FromRadians(NAN, 0)};
+  for (int i = 0; i < 100000; ++i) {
+    latlngs.push_back(S2LatLng(S2Testing::RandomPoint()));
+  }
+  std::vector<S2Point> points(latlngs.size());
+  S2LatLng::ToPoints(latlngs, absl::MakeSpan(points));
+  double max_error = 0;
+  for (int i = 0; i < latlngs.size(); ++i) {
+    S2Point expected = latlngs[i].ToPoint();
+    if (std::isnan(expected[0])) {
+      EXPECT_TRUE(std::isnan(points[i][0]));
+      continue;
+    }
+    for (int j = 0; j < 3; ++j) {
+      max_error = std::max(max_error, fabs(points[i][j] - expected[j]));
+    }
+  }
+  EXPECT_LE(max_error, 2 * DBL_EPSILON);
+}
+
+TEST(S2LatLng, FromPointsMatchesConstructor) {
+  std::vector<S2Point> points = {
+      S2Point(1, 0, 0), S2Point(-1, 0, 0), S2Point(0, 1, 0),
+      S2Point(0, -1, 0), S2Point(0, 0, 1), S2Point(0, 0, -1),
+      S2Point(0, 0, 0), S2Point(1., -0., -0.), S2Point(-1., -0., 0.),
+      S2Point(-0., -0., 1.), S2Point(1, 1, 1), S2Point(-3, 1e-300, 2),
+      S2Point(INFINITY, 0, 0), S2Point(NAN, 1, 0)};
+  for (int i = 0; i < 100000; ++i) {
+    points.push_back(S2Testing::RandomPoint());
+  }
+  std::vector<S2LatLng> latlngs(points.size());
+  S2LatLng::FromPoints(points, absl::MakeSpan(latlngs));
+  double max_error = 0;
+  for (int i = 0; i < points.size(); ++i) {
+    S2LatLng expected(points[i]);
+    if (std::isnan(expected.lat().radians()) ||
+        std::isnan(expected.lng().radians())) {
+      EXPECT_EQ(std::isnan(expected.lat().radians()),
+                std::isnan(latlngs[i].lat().radians()));
+      EXPECT_EQ(std::isnan(expected.lng().radians()),
+                std::isnan(latlngs[i].lng().radians()));
+      continue;
+    }
+    max_error = std::max({max_error,
+                          fabs(latlngs[i].lat().radians() -
+                               expected.lat().radians()),
+                          fabs(latlngs[i].lng().radians() -
+                               expected.lng().radians())});
+  }
+  EXPECT_LE(max_error, 2 * DBL_EPSILON);
+
+  // The special cases of S2LatLng(S2Point) are handled identically.
+  for (int i = 0; i < 10; ++i) {
+    S2LatLng expected(points[i]);
+    EXPECT_TRUE(IsIdentical(expected.lat().radians(),
+                            latlngs[i].lat().radians())) << points[i];
+    EXPECT_TRUE(IsIdentical(expected.lng().radians(),
+                            latlngs[i].lng().radians())) << points[i];
+  }
+}
+
 TEST(S2LatLng, TestDistance) {
   EXPECT_EQ(0.0,
             S2LatLng::FromDegrees(90, 0).GetDistance(
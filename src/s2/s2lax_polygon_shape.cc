@@ -17,6 +17,7 @@
 
 #include "s2/s2lax_polygon_shape.h"
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 
@@ -65,7 +66,8 @@ S2LaxPolygonShape::S2LaxPolygonShape(S2LaxPolygonShape&& b)
       prev_loop_(b.prev_loop_.exchange(0, std::memory_order_relaxed)),
       num_vertices_(absl::exchange(b.num_vertices_, 0)),
       vertices_(std::move(b.vertices_)),
-      loop_starts_(std::move(b.loop_starts_)) {}
+      loop_starts_(std::move(b.loop_starts_)),
+      resource_(b.resource_) {}
 
 S2LaxPolygonShape& S2LaxPolygonShape::operator=(S2LaxPolygonShape&& b) {
   using std::memory_order_relaxed;
@@ -80,6 +82,7 @@ S2LaxPolygonShape& S2LaxPolygonShape::operator=(S2LaxPolygonShape&& b) {
   num_vertices_ = absl::exchange(b.num_vertices_, 0);
   vertices_ = std::move(b.vertices_);
   loop_starts_ = std::move(b.loop_starts_);
+  resource_ = b.resource_;
   return *this;
 }
 
@@ -128,18 +131,18 @@ void S2LaxPolygonShape::Init(Span<const Span<const S2Point>> loops) {
     // Note that even absl::make_unique_for_overwrite<> and c++20's
     // absl::make_unique_for_overwrite<T[]> default-construct all elements when
     // T is a class type.
-    vertices_ = make_unique<S2Point[]>(num_vertices_);
+    vertices_ = S2ResourceArray<S2Point>(num_vertices_, resource_);
     std::copy(loops[0].begin(), loops[0].end(), vertices_.get());
   } else {
-    // Don't use make_unique<> here in order to avoid zero initialization.
-    loop_starts_ = make_unique_for_overwrite<uint32[]>(num_loops_ + 1);
+    // S2ResourceArray does not zero-initialize trivial element types.
+    loop_starts_ = S2ResourceArray<uint32>(num_loops_ + 1, resource_);
     num_vertices_ = 0;
     for (int i = 0; i < num_loops_; ++i) {
       loop_starts_[i] = num_vertices_;
       num_vertices_ += loops[i].size();
     }
     loop_starts_[num_loops_] = num_vertices_;
-    vertices_ = make_unique<S2Point[]>(num_vertices_);  // TODO(see above)
+    vertices_ = S2ResourceArray<S2Point>(num_vertices_, resource_);
     for (int i = 0; i < num_loops_; ++i) {
       std::copy(loops[i].begin(), loops[i].end(),
                 vertices_.get() + loop_starts_[i]);
@@ -194,14 +197,14 @@ bool S2LaxPolygonShape::Init(Decoder* decoder) {
     num_vertices_ = 0;
   } else {
     num_vertices_ = vertices.size();
-    vertices_ = make_unique<S2Point[]>(num_vertices_);  // TODO(see above)
+    vertices_ = S2ResourceArray<S2Point>(num_vertices_, resource_);
     for (int i = 0; i < num_vertices_; ++i) {
       vertices_[i] = vertices[i];
     }
     if (num_loops_ > 1) {
       s2coding::EncodedUintVector<uint32> loop_starts;
       if (!loop_starts.Init(decoder)) return false;
-      loop_starts_ = make_unique_for_overwrite<uint32[]>(loop_starts.size());
+      loop_starts_ = S2ResourceArray<uint32>(loop_starts.size(), resource_);
       for (int i = 0; i < loop_starts.size(); ++i) {
         loop_starts_[i] = loop_starts[i];
       }
@@ -230,6 +233,12 @@ S2Shape::Chain S2LaxPolygonShape::chain(int i) const {
   }
 }
 
+S2PointSpan S2LaxPolygonShape::GetChainVertices(
+    int i, vector<S2Point>* tmp) const {
+  Chain chain = S2LaxPolygonShape::chain(i);  // Avoid virtual call.
+  return S2PointSpan(vertices_.get() + chain.start, chain.length);
+}
+
 EncodedS2LaxPolygonShape::EncodedS2LaxPolygonShape(EncodedS2LaxPolygonShape&& b)
     : S2Shape(std::move(b)),
       num_loops_(absl::exchange(b.num_loops_, 0)),
@@ -312,7 +321,7 @@ S2Shape::Edge EncodedS2LaxPolygonShape::edge(int e) const {
   int e1 = e + 1;
   if (num_loops() == 1) {
     if (e1 == vertices_.size()) { e1 = 0; }
-    return Edge(vertices_[e], vertices_[e1]);
+    return vertices_.edge(e, e1);
   } else {
     // Method names are fully specified to enable inlining.
     ChainPosition pos = EncodedS2LaxPolygonShape::chain_position(e);
@@ -333,3 +342,142 @@ S2Shape::Chain EncodedS2LaxPolygonShape::chain(int i) const {
     return Chain(start, loop_starts_[i + 1] - start);
   }
 }
+
+S2PointSpan EncodedS2LaxPolygonShape::GetChainVertices(
+    int i, vector<S2Point>* tmp) const {
+  Chain chain = EncodedS2LaxPolygonShape::chain(i);  // Avoid virtual call.
+  tmp->resize(chain.length);
+  vertices_.DecodeRange(chain.start, chain.start + chain.length, tmp->data());
+  return *tmp;
+}
+
+QuantizedS2LaxPolygonShape::QuantizedS2LaxPolygonShape(
+    const vector<S2LaxPolygonShape::Loop>& loops) {
+  Init(loops);
+}
+
+QuantizedS2LaxPolygonShape::QuantizedS2LaxPolygonShape(
+    Span<const Span<const S2Point>> loops) {
+  Init(loops);
+}
+
+void QuantizedS2LaxPolygonShape::Init(
+    const vector<S2LaxPolygonShape::Loop>& loops) {
+  vector<Span<const S2Point>> spans;
+  spans.reserve(loops.size());
+  for (const S2LaxPolygonShape::Loop& loop : loops) {
+    spans.emplace_back(loop);
+  }
+  Init(spans);
+}
+
+void QuantizedS2LaxPolygonShape::Init(Span<const Span<const S2Point>> loops) {
+  num_loops_ = loops.size();
+  prev_loop_.store(0, std::memory_order_relaxed);
+  num_vertices_ = 0;
+  loop_starts_.reset();
+  if (num_loops_ > 1) {
+    loop_starts_ = make_unique_for_overwrite<uint32[]>(num_loops_ + 1);
+  }
+  for (int i = 0; i < num_loops_; ++i) {
+    if (loop_starts_) loop_starts_[i] = num_vertices_;
+    num_vertices_ += loops[i].size();
+  }
+  if (loop_starts_) loop_starts_[num_loops_] = num_vertices_;
+  vertices_ = make_unique_for_overwrite<uint64[]>(num_vertices_);
+  uint64* vertex = vertices_.get();
+  for (Span<const S2Point> loop : loops) {
+    for (const S2Point& p : loop) *vertex++ = S2CellId(p).id();
+  }
+}
+
+int QuantizedS2LaxPolygonShape::num_loop_vertices(int i) const {
+  S2_DCHECK_LT(i, num_loops());
+  if (num_loops() == 1) {
+    return num_vertices_;
+  } else {
+    return loop_starts_[i + 1] - loop_starts_[i];
+  }
+}
+
+S2Point QuantizedS2LaxPolygonShape::loop_vertex(int i, int j) const {
+  S2_DCHECK_LT(i, num_loops());
+  S2_DCHECK_LT(j, num_loop_vertices(i));
+  if (num_loops() == 1) {
+    return vertex(j);
+  } else {
+    return vertex(loop_starts_[i] + j);
+  }
+}
+
+// The encoding must be identical to S2LaxPolygonShape::Encode().
+void QuantizedS2LaxPolygonShape::Encode(Encoder* encoder,
+                                        s2coding::CodingHint hint) const {
+  encoder->Ensure(1 + Varint::kMax32);
+  encoder->put8(kCurrentEncodingVersionNumber);
+  encoder->put_varint32(num_loops());
+  vector<S2Point> vertices(num_vertices());
+  for (int k = 0; k < num_vertices(); ++k) {
+    vertices[k] = vertex(k);
+  }
+  s2coding::EncodeS2PointVector(vertices, hint, encoder);
+  if (num_loops() > 1) {
+    s2coding::EncodeUintVector<uint32>(
+        MakeSpan(loop_starts_.get(), num_loops() + 1), encoder);
+  }
+}
+
+S2Shape::Edge QuantizedS2LaxPolygonShape::edge(int e) const {
+  // Method names are fully specified to enable inlining.
+  ChainPosition pos = QuantizedS2LaxPolygonShape::chain_position(e);
+  return QuantizedS2LaxPolygonShape::chain_edge(pos.chain_id, pos.offset);
+}
+
+S2Shape::ReferencePoint QuantizedS2LaxPolygonShape::GetReferencePoint() const {
+  return s2shapeutil::GetReferencePoint(*this);
+}
+
+S2Shape::Chain QuantizedS2LaxPolygonShape::chain(int i) const {
+  S2_DCHECK_LT(i, num_loops());
+  if (num_loops() == 1) {
+    return Chain(0, num_vertices_);
+  } else {
+    int start = loop_starts_[i];
+    return Chain(start, loop_starts_[i + 1] - start);
+  }
+}
+
+S2Shape::Edge QuantizedS2LaxPolygonShape::chain_edge(int i, int j) const {
+  S2_DCHECK_LT(i, num_loops());
+  S2_DCHECK_LT(j, num_loop_vertices(i));
+  int n = num_loop_vertices(i);
+  int k = (j + 1 == n) ? 0 : j + 1;
+  int start = (num_loops() == 1) ? 0 : loop_starts_[i];
+  return Edge(vertex(start + j), vertex(start + k));
+}
+
+S2Shape::ChainPosition QuantizedS2LaxPolygonShape::chain_position(
+    int e) const {
+  S2_DCHECK_LT(e, num_edges());
+  if (num_loops() == 1) {
+    return ChainPosition(0, e);
+  }
+  // Test if this edge belongs to the loop returned by the previous call.
+  int i = prev_loop_.load(std::memory_order_relaxed);
+  if (e < loop_starts_[i] || e >= loop_starts_[i + 1]) {
+    const uint32* starts = loop_starts_.get();
+    i = std::upper_bound(starts + 1, starts + num_loops(), e) - starts - 1;
+    prev_loop_.store(i, std::memory_order_relaxed);
+  }
+  return ChainPosition(i, e - loop_starts_[i]);
+}
+
+S2PointSpan QuantizedS2LaxPolygonShape::GetChainVertices(
+    int i, vector<S2Point>* tmp) const {
+  Chain chain = QuantizedS2LaxPolygonShape::chain(i);  // Avoid virtual call.
+  tmp->resize(chain.length);
+  for (int j = 0; j < chain.length; ++j) {
+    (*tmp)[j] = vertex(chain.start + j);
+  }
+  return *tmp;
+}
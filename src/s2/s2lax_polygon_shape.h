@@ -28,6 +28,8 @@
 #include "s2/base/logging.h"
 #include "s2/encoded_s2point_vector.h"
 #include "s2/encoded_uint_vector.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2memory_resource.h"
 #include "s2/s2polygon.h"
 #include "s2/s2shape.h"
 
@@ -84,6 +86,12 @@ class S2LaxPolygonShape : public S2Shape {
   // Constructs an empty polygon.
   S2LaxPolygonShape() : num_loops_(0), num_vertices_(0) {}
 
+  // Constructs an empty polygon whose vertex and loop arrays are allocated
+  // from the given memory resource by subsequent calls to Init() (see
+  // s2memory_resource.h).  The resource must outlive this object.
+  explicit S2LaxPolygonShape(S2MemoryResource* resource)
+      : num_loops_(0), num_vertices_(0), resource_(resource) {}
+
   S2LaxPolygonShape(const S2LaxPolygonShape&) = delete;
   S2LaxPolygonShape(S2LaxPolygonShape&& b);
   S2LaxPolygonShape& operator=(S2LaxPolygonShape&& b);
@@ -117,6 +125,10 @@ class S2LaxPolygonShape : public S2Shape {
   // Returns the total number of vertices in all loops.
   int num_vertices() const { return num_vertices_; }
 
+  // Returns the resource used for vertex storage, or nullptr if vertices are
+  // allocated from the global heap.
+  S2MemoryResource* memory_resource() const { return resource_; }
+
   // Returns the number of vertices in the given loop.
   int num_loop_vertices(int i) const;
 
@@ -144,6 +156,8 @@ class S2LaxPolygonShape : public S2Shape {
   Chain chain(int i) const final;
   Edge chain_edge(int i, int j) const final;
   ChainPosition chain_position(int e) const final;
+  S2PointSpan GetChainVertices(int i,
+                               std::vector<S2Point>* tmp) const final;
   TypeTag type_tag() const override { return kTypeTag; }
 
  private:
@@ -158,11 +172,13 @@ class S2LaxPolygonShape : public S2Shape {
   mutable std::atomic<int> prev_loop_{0};
 
   int32 num_vertices_;
-  std::unique_ptr<S2Point[]> vertices_;
+  S2ResourceArray<S2Point> vertices_;
 
   // When num_loops_ > 1, stores an array of size (num_loops_ + 1) where
   // element "i" represents the total number of vertices in loops 0..i-1.
-  std::unique_ptr<uint32[]> loop_starts_;
+  S2ResourceArray<uint32> loop_starts_;
+
+  S2MemoryResource* resource_ = nullptr;
 };
 
 // Exactly like S2LaxPolygonShape, except that the vertices are kept in an
@@ -207,6 +223,8 @@ class EncodedS2LaxPolygonShape : public S2Shape {
   Chain chain(int i) const final;
   Edge chain_edge(int i, int j) const final;
   ChainPosition chain_position(int e) const final;
+  S2PointSpan GetChainVertices(int i,
+                               std::vector<S2Point>* tmp) const final;
   TypeTag type_tag() const override { return kTypeTag; }
 
  private:
@@ -221,6 +239,81 @@ class EncodedS2LaxPolygonShape : public S2Shape {
   s2coding::EncodedUintVector<uint32> loop_starts_;
 };
 
+// Like S2LaxPolygonShape, except that each vertex is snapped to the center of
+// the leaf S2Cell that contains it and is stored as an S2CellId.  This uses
+// 8 bytes per vertex rather than 24, at the cost of moving each vertex by up
+// to S2::kMaxDiag.GetValue(S2CellId::kMaxLevel) / 2 radians (about 1cm on
+// the Earth's surface) and decoding vertices as they are accessed.  This is
+// useful for keeping very large numbers of polygons in memory.
+//
+// Snapping can create degeneracies (e.g., duplicate adjacent vertices), and
+// it can also create crossing edges when vertices or edges are closer than
+// the snapping distance.  Use S2Builder instead if the snapped result needs
+// to be valid.  The shape is encoded in the same format as S2LaxPolygonShape
+// (with the snapped vertices), and can be decoded as either
+// S2LaxPolygonShape or EncodedS2LaxPolygonShape.
+class QuantizedS2LaxPolygonShape : public S2Shape {
+ public:
+  static constexpr TypeTag kTypeTag = S2LaxPolygonShape::kTypeTag;
+
+  // Constructs an empty polygon.
+  QuantizedS2LaxPolygonShape() : num_loops_(0), num_vertices_(0) {}
+
+  // Constructs a QuantizedS2LaxPolygonShape from the given vertex loops.
+  explicit QuantizedS2LaxPolygonShape(
+      const std::vector<S2LaxPolygonShape::Loop>& loops);
+
+  // Alternative version that can be used to avoid copying all the vertex data
+  // when it is stored using something other than std::vector.
+  explicit QuantizedS2LaxPolygonShape(
+      absl::Span<const absl::Span<const S2Point>> loops);
+
+  // Initializes a QuantizedS2LaxPolygonShape from the given vertex loops.
+  void Init(const std::vector<S2LaxPolygonShape::Loop>& loops);
+  void Init(absl::Span<const absl::Span<const S2Point>> loops);
+
+  int num_loops() const { return num_loops_; }
+  int num_vertices() const { return num_vertices_; }
+  int num_loop_vertices(int i) const;
+  S2Point loop_vertex(int i, int j) const;
+
+  // Appends an encoded representation of the shape to "encoder".
+  //
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  void Encode(Encoder* encoder, s2coding::CodingHint hint) const override;
+
+  // S2Shape interface:
+  int num_edges() const final { return num_vertices(); }
+  Edge edge(int e) const final;
+  int dimension() const final { return 2; }
+  ReferencePoint GetReferencePoint() const final;
+  int num_chains() const final { return num_loops(); }
+  Chain chain(int i) const final;
+  Edge chain_edge(int i, int j) const final;
+  ChainPosition chain_position(int e) const final;
+  S2PointSpan GetChainVertices(int i,
+                               std::vector<S2Point>* tmp) const final;
+  TypeTag type_tag() const override { return kTypeTag; }
+
+ private:
+  S2Point vertex(int k) const { return S2CellId(vertices_[k]).ToPoint(); }
+
+  int32 num_loops_;
+
+  // The loop that contained the edge returned by the previous call to the
+  // edge() method.  This is used as a hint to speed up edge location when
+  // there are many loops.
+  mutable std::atomic<int> prev_loop_{0};
+
+  int32 num_vertices_;
+  std::unique_ptr<uint64[]> vertices_;  // Leaf S2CellIds.
+
+  // As in S2LaxPolygonShape, when num_loops_ > 1 stores an array of size
+  // (num_loops_ + 1) where element "i" is the total number of vertices in
+  // loops 0..i-1.
+  std::unique_ptr<uint32[]> loop_starts_;
+};
 
 //////////////////   Implementation details follow   ////////////////////
 
@@ -275,10 +368,10 @@ inline S2Shape::Edge EncodedS2LaxPolygonShape::chain_edge(int i, int j) const {
   int n = num_loop_vertices(i);
   int k = (j + 1 == n) ? 0 : j + 1;
   if (num_loops() == 1) {
-    return Edge(vertices_[j], vertices_[k]);
+    return vertices_.edge(j, k);
   } else {
     int start = loop_starts_[i];
-    return Edge(vertices_[start + j], vertices_[start + k]);
+    return vertices_.edge(start + j, start + k);
   }
 }
 
@@ -377,3 +377,71 @@ TEST(S2LaxPolygonShape, CompareToS2Loop) {
     CompareS2LoopToShape(*loop, make_unique<S2LaxPolygonShape>(loops));
   }
 }
+
+TEST(QuantizedS2LaxPolygonShape, MatchesSnappedS2LaxPolygonShape) {
+  // Use enough loops so that binary search is used to find the loop
+  // containing a given edge, and include empty and degenerate loops.
+  vector<vector<S2Point>> loops, snapped_loops;
+  for (int i = 0; i < 100; ++i) {
+    S2Point center(S2LatLng::FromDegrees(0, i));
+    loops.push_back(
+        S2Testing::MakeRegularPoints(center, S1Angle::Degrees(0.1),
+                                     S2Testing::rnd.Uniform(5)));
+    snapped_loops.emplace_back();
+    for (const S2Point& p : loops.back()) {
+      snapped_loops.back().push_back(S2CellId(p).ToPoint());
+    }
+  }
+  QuantizedS2LaxPolygonShape shape(loops);
+  S2LaxPolygonShape expected(snapped_loops);
+  s2testing::ExpectEqual(expected, shape);
+  EXPECT_EQ(expected.num_loops(), shape.num_loops());
+  EXPECT_EQ(expected.num_vertices(), shape.num_vertices());
+  EXPECT_EQ(expected.GetReferencePoint(), shape.GetReferencePoint());
+  for (int i = 0; i < expected.num_loops(); ++i) {
+    ASSERT_EQ(expected.num_loop_vertices(i), shape.num_loop_vertices(i));
+    for (int j = 0; j < expected.num_loop_vertices(i); ++j) {
+      EXPECT_EQ(expected.loop_vertex(i, j), shape.loop_vertex(i, j));
+    }
+  }
+  // Test the edges in a random order to exercise the prev_loop_ hint.
+  vector<int> edge_ids(expected.num_edges());
+  std::iota(edge_ids.begin(), edge_ids.end(), 0);
+  std::shuffle(edge_ids.begin(), edge_ids.end(), std::mt19937_64());
+  for (int e : edge_ids) {
+    EXPECT_EQ(expected.chain_position(e), shape.chain_position(e));
+    EXPECT_EQ(expected.edge(e), shape.edge(e));
+  }
+
+  // The encoding is the same as that of the snapped S2LaxPolygonShape.
+  Encoder encoder, expected_encoder;
+  shape.Encode(&encoder, s2coding::CodingHint::COMPACT);
+  expected.Encode(&expected_encoder, s2coding::CodingHint::COMPACT);
+  EXPECT_EQ(absl::string_view(expected_encoder.base(),
+                              expected_encoder.length()),
+            absl::string_view(encoder.base(), encoder.length()));
+}
+
+TEST(QuantizedS2LaxPolygonShape, SingleLoopAndEmpty) {
+  QuantizedS2LaxPolygonShape empty;
+  EXPECT_EQ(0, empty.num_loops());
+  EXPECT_TRUE(empty.is_empty());
+
+  QuantizedS2LaxPolygonShape full(vector<S2LaxPolygonShape::Loop>{{}});
+  EXPECT_TRUE(full.is_full());
+
+  vector<S2Point> vertices = s2textformat::ParsePointsOrDie("0:0, 0:1, 1:1");
+  auto shape = make_unique<QuantizedS2LaxPolygonShape>(
+      vector<S2LaxPolygonShape::Loop>{vertices});
+  EXPECT_EQ(1, shape->num_chains());
+  EXPECT_EQ(3, shape->num_edges());
+  EXPECT_EQ(S2CellId(vertices[2]).ToPoint(), shape->edge(2).v0);
+  EXPECT_EQ(S2CellId(vertices[0]).ToPoint(), shape->edge(2).v1);
+
+  // The shape can be indexed like any other S2Shape.
+  MutableS2ShapeIndex index;
+  index.Add(std::move(shape));
+  auto query = MakeS2ContainsPointQuery(&index);
+  EXPECT_TRUE(query.Contains(s2textformat::MakePointOrDie("0.5:0.7")));
+  EXPECT_FALSE(query.Contains(s2textformat::MakePointOrDie("0.7:0.5")));
+}
@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "s2/base/logging.h"
 #include "absl/memory/memory.h"
@@ -29,16 +30,19 @@
 using absl::MakeSpan;
 using absl::Span;
 using absl::make_unique;
+using std::vector;
 
 S2LaxPolylineShape::S2LaxPolylineShape(S2LaxPolylineShape&& other)
     : S2Shape(std::move(other)),
       num_vertices_(absl::exchange(other.num_vertices_, 0)),
-      vertices_(std::move(other.vertices_)) {}
+      vertices_(std::move(other.vertices_)),
+      resource_(other.resource_) {}
 
 S2LaxPolylineShape& S2LaxPolylineShape::operator=(S2LaxPolylineShape&& other) {
   S2Shape::operator=(static_cast<S2Shape&&>(other));
   num_vertices_ = absl::exchange(other.num_vertices_, 0);
   vertices_ = std::move(other.vertices_);
+  resource_ = other.resource_;
   return *this;
 }
 
@@ -54,7 +58,7 @@ void S2LaxPolylineShape::Init(Span<const S2Point> vertices) {
   num_vertices_ = vertices.size();
   S2_LOG_IF(WARNING, num_vertices_ == 1)
       << "s2shapeutil::S2LaxPolylineShape with one vertex has no edges";
-  vertices_ = make_unique<S2Point[]>(num_vertices_);
+  vertices_ = S2ResourceArray<S2Point>(num_vertices_, resource_);
   std::copy(vertices.begin(), vertices.end(), vertices_.get());
 }
 
@@ -62,7 +66,7 @@ void S2LaxPolylineShape::Init(const S2Polyline& polyline) {
   num_vertices_ = polyline.num_vertices();
   S2_LOG_IF(WARNING, num_vertices_ == 1)
       << "s2shapeutil::S2LaxPolylineShape with one vertex has no edges";
-  vertices_ = make_unique<S2Point[]>(num_vertices_);
+  vertices_ = S2ResourceArray<S2Point>(num_vertices_, resource_);
   std::copy(&polyline.vertex(0), &polyline.vertex(0) + num_vertices_,
             vertices_.get());
 }
@@ -77,7 +81,7 @@ bool S2LaxPolylineShape::Init(Decoder* decoder) {
   s2coding::EncodedS2PointVector vertices;
   if (!vertices.Init(decoder)) return false;
   num_vertices_ = vertices.size();
-  vertices_ = make_unique<S2Point[]>(vertices.size());
+  vertices_ = S2ResourceArray<S2Point>(vertices.size(), resource_);
   for (int i = 0; i < num_vertices_; ++i) {
     vertices_[i] = vertices[i];
   }
@@ -107,6 +111,12 @@ S2Shape::ChainPosition S2LaxPolylineShape::chain_position(int e) const {
   return S2Shape::ChainPosition(0, e);
 }
 
+S2PointSpan S2LaxPolylineShape::GetChainVertices(
+    int i, vector<S2Point>* tmp) const {
+  S2_DCHECK_EQ(i, 0);
+  return S2PointSpan(vertices_.get(), num_vertices_);
+}
+
 bool EncodedS2LaxPolylineShape::Init(Decoder* decoder) {
   return vertices_.Init(decoder);
 }
@@ -119,7 +129,7 @@ void EncodedS2LaxPolylineShape::Encode(Encoder* encoder,
 
 S2Shape::Edge EncodedS2LaxPolylineShape::edge(int e) const {
   S2_DCHECK_LT(e, num_edges());
-  return Edge(vertex(e), vertex(e + 1));
+  return vertices_.edge(e, e + 1);
 }
 
 int EncodedS2LaxPolylineShape::num_chains() const {
@@ -133,9 +143,73 @@ S2Shape::Chain EncodedS2LaxPolylineShape::chain(int i) const {
 S2Shape::Edge EncodedS2LaxPolylineShape::chain_edge(int i, int j) const {
   S2_DCHECK_EQ(i, 0);
   S2_DCHECK_LT(j, num_edges());
-  return Edge(vertex(j), vertex(j + 1));
+  return vertices_.edge(j, j + 1);
 }
 
 S2Shape::ChainPosition EncodedS2LaxPolylineShape::chain_position(int e) const {
   return S2Shape::ChainPosition(0, e);
 }
+
+S2PointSpan EncodedS2LaxPolylineShape::GetChainVertices(
+    int i, vector<S2Point>* tmp) const {
+  S2_DCHECK_EQ(i, 0);
+  tmp->resize(num_vertices());
+  vertices_.DecodeRange(0, num_vertices(), tmp->data());
+  return *tmp;
+}
+
+QuantizedS2LaxPolylineShape::QuantizedS2LaxPolylineShape(
+    Span<const S2Point> vertices) {
+  Init(vertices);
+}
+
+void QuantizedS2LaxPolylineShape::Init(Span<const S2Point> vertices) {
+  num_vertices_ = vertices.size();
+  S2_LOG_IF(WARNING, num_vertices_ == 1)
+      << "QuantizedS2LaxPolylineShape with one vertex has no edges";
+  vertices_ = make_unique<uint64[]>(num_vertices_);
+  for (int i = 0; i < num_vertices_; ++i) {
+    vertices_[i] = S2CellId(vertices[i]).id();
+  }
+}
+
+// The encoding must be identical to S2LaxPolylineShape::Encode().
+void QuantizedS2LaxPolylineShape::Encode(Encoder* encoder,
+                                         s2coding::CodingHint hint) const {
+  vector<S2Point> vertices;
+  s2coding::EncodeS2PointVector(GetChainVertices(0, &vertices), hint, encoder);
+}
+
+S2Shape::Edge QuantizedS2LaxPolylineShape::edge(int e) const {
+  S2_DCHECK_LT(e, num_edges());
+  return Edge(vertex(e), vertex(e + 1));
+}
+
+int QuantizedS2LaxPolylineShape::num_chains() const {
+  return std::min(1, QuantizedS2LaxPolylineShape::num_edges());
+}
+
+S2Shape::Chain QuantizedS2LaxPolylineShape::chain(int i) const {
+  return Chain(0, QuantizedS2LaxPolylineShape::num_edges());
+}
+
+S2Shape::Edge QuantizedS2LaxPolylineShape::chain_edge(int i, int j) const {
+  S2_DCHECK_EQ(i, 0);
+  S2_DCHECK_LT(j, num_edges());
+  return Edge(vertex(j), vertex(j + 1));
+}
+
+S2Shape::ChainPosition QuantizedS2LaxPolylineShape::chain_position(
+    int e) const {
+  return S2Shape::ChainPosition(0, e);
+}
+
+S2PointSpan QuantizedS2LaxPolylineShape::GetChainVertices(
+    int i, vector<S2Point>* tmp) const {
+  S2_DCHECK_EQ(i, 0);
+  tmp->resize(num_vertices());
+  for (int j = 0; j < num_vertices(); ++j) {
+    (*tmp)[j] = vertex(j);
+  }
+  return *tmp;
+}
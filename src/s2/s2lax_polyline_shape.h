@@ -24,6 +24,8 @@
 
 #include "absl/types/span.h"
 #include "s2/encoded_s2point_vector.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2memory_resource.h"
 #include "s2/s2polyline.h"
 #include "s2/s2shape.h"
 
@@ -45,6 +47,12 @@ class S2LaxPolylineShape : public S2Shape {
   // Constructs an empty polyline.
   S2LaxPolylineShape() : num_vertices_(0) {}
 
+  // Constructs an empty polyline whose vertex array is allocated from the
+  // given memory resource by subsequent calls to Init() (see
+  // s2memory_resource.h).  The resource must outlive this object.
+  explicit S2LaxPolylineShape(S2MemoryResource* resource)
+      : num_vertices_(0), resource_(resource) {}
+
   S2LaxPolylineShape(S2LaxPolylineShape&& other);
 
   S2LaxPolylineShape& operator=(S2LaxPolylineShape&& other);
@@ -66,6 +74,10 @@ class S2LaxPolylineShape : public S2Shape {
   int num_vertices() const { return num_vertices_; }
   const S2Point& vertex(int i) const { return vertices_[i]; }
 
+  // Returns the resource used for vertex storage, or nullptr if vertices are
+  // allocated from the global heap.
+  S2MemoryResource* memory_resource() const { return resource_; }
+
   // Appends an encoded representation of the S2LaxPolylineShape to "encoder".
   //
   // REQUIRES: "encoder" uses the default constructor, so that its buffer
@@ -87,13 +99,16 @@ class S2LaxPolylineShape : public S2Shape {
   Chain chain(int i) const final;
   Edge chain_edge(int i, int j) const final;
   ChainPosition chain_position(int e) const final;
+  S2PointSpan GetChainVertices(int i,
+                               std::vector<S2Point>* tmp) const final;
   TypeTag type_tag() const override { return kTypeTag; }
 
  private:
   // For clients that have many small polylines, we save some memory by
   // representing the vertices as an array rather than using std::vector.
   int32 num_vertices_;
-  std::unique_ptr<S2Point[]> vertices_;
+  S2ResourceArray<S2Point> vertices_;
+  S2MemoryResource* resource_ = nullptr;
 };
 
 // Exactly like S2LaxPolylineShape, except that the vertices are kept in an
@@ -138,10 +153,68 @@ class EncodedS2LaxPolylineShape : public S2Shape {
   Chain chain(int i) const final;
   Edge chain_edge(int i, int j) const final;
   ChainPosition chain_position(int e) const final;
+  S2PointSpan GetChainVertices(int i,
+                               std::vector<S2Point>* tmp) const final;
   TypeTag type_tag() const override { return kTypeTag; }
 
  private:
   s2coding::EncodedS2PointVector vertices_;
 };
 
+// Like S2LaxPolylineShape, except that each vertex is snapped to the center
+// of the leaf S2Cell that contains it and is stored as an S2CellId.  This
+// uses 8 bytes per vertex rather than 24, at the cost of moving each vertex
+// by up to S2::kMaxDiag.GetValue(S2CellId::kMaxLevel) / 2 radians (about
+// 1cm on the Earth's surface) and decoding vertices as they are accessed.
+// This is useful for keeping very large numbers of polylines in memory.
+//
+// Note that snapping can create duplicate adjacent vertices; these are
+// allowed by S2LaxPolylineShape.  The shape is encoded in the same format as
+// S2LaxPolylineShape (with the snapped vertices), and can be decoded as
+// either S2LaxPolylineShape or EncodedS2LaxPolylineShape.
+class QuantizedS2LaxPolylineShape : public S2Shape {
+ public:
+  // Define as enum so we don't have to declare storage.
+  // TODO(user, b/210097200): Use static constexpr when C++17 is allowed
+  // in opensource.
+  enum : TypeTag { kTypeTag = S2LaxPolylineShape::kTypeTag };
+
+  // Constructs an empty polyline.
+  QuantizedS2LaxPolylineShape() : num_vertices_(0) {}
+
+  // Constructs a QuantizedS2LaxPolylineShape with the given vertices.
+  explicit QuantizedS2LaxPolylineShape(absl::Span<const S2Point> vertices);
+
+  // Initializes a QuantizedS2LaxPolylineShape with the given vertices.
+  void Init(absl::Span<const S2Point> vertices);
+
+  int num_vertices() const { return num_vertices_; }
+  S2Point vertex(int i) const { return S2CellId(vertices_[i]).ToPoint(); }
+
+  // Appends an encoded representation of the shape to "encoder".
+  //
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  void Encode(Encoder* encoder, s2coding::CodingHint hint) const override;
+
+  // S2Shape interface:
+  int num_edges() const final { return std::max(0, num_vertices() - 1); }
+  Edge edge(int e) const final;
+  int dimension() const final { return 1; }
+  ReferencePoint GetReferencePoint() const final {
+    return ReferencePoint::Contained(false);
+  }
+  int num_chains() const final;
+  Chain chain(int i) const final;
+  Edge chain_edge(int i, int j) const final;
+  ChainPosition chain_position(int e) const final;
+  S2PointSpan GetChainVertices(int i,
+                               std::vector<S2Point>* tmp) const final;
+  TypeTag type_tag() const override { return kTypeTag; }
+
+ private:
+  int32 num_vertices_;
+  std::unique_ptr<uint64[]> vertices_;  // Leaf S2CellIds.
+};
+
 #endif  // S2_S2LAX_POLYLINE_SHAPE_H_
@@ -21,6 +21,9 @@
 #include <utility>
 
 #include <gtest/gtest.h>
+#include "s2/s1angle.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2metrics.h"
 #include "s2/s2shapeutil_testing.h"
 #include "s2/s2text_format.h"
 
@@ -110,3 +113,28 @@ TEST(EncodedS2LaxPolylineShape, RoundtripEncoding) {
   ASSERT_TRUE(b_shape.Init(&b_decoder));
   s2testing::ExpectEqual(shape, b_shape);
 }
+
+TEST(QuantizedS2LaxPolylineShape, MatchesSnappedS2LaxPolylineShape) {
+  vector<S2Point> vertices =
+      s2textformat::ParsePointsOrDie("0:0, 0:1, 1:1, 1:1, 2:3");
+  QuantizedS2LaxPolylineShape shape(vertices);
+  vector<S2Point> snapped;
+  for (const S2Point& p : vertices) {
+    snapped.push_back(S2CellId(p).ToPoint());
+    EXPECT_LE(S1Angle(p, snapped.back()), S1Angle::Radians(
+        S2::kMaxDiag.GetValue(S2CellId::kMaxLevel) / 2));
+  }
+  s2testing::ExpectEqual(S2LaxPolylineShape(snapped), shape);
+  ASSERT_EQ(vertices.size(), shape.num_vertices());
+  for (int i = 0; i < shape.num_vertices(); ++i) {
+    EXPECT_EQ(snapped[i], shape.vertex(i));
+  }
+
+  // The encoding can be decoded as an S2LaxPolylineShape.
+  Encoder encoder;
+  shape.Encode(&encoder, s2coding::CodingHint::COMPACT);
+  Decoder decoder(encoder.base(), encoder.length());
+  S2LaxPolylineShape decoded;
+  ASSERT_TRUE(decoded.Init(&decoder));
+  s2testing::ExpectEqual(shape, decoded);
+}
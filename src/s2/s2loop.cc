@@ -50,6 +50,7 @@
 #include "s2/s2edge_crosser.h"
 #include "s2/s2edge_distances.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng_rect_bounder.h"
 #include "s2/s2measures.h"
 #include "s2/s2padded_cell.h"
@@ -103,6 +104,7 @@ S2Loop::S2Loop(S2Loop&& b)
       depth_(absl::exchange(b.depth_, 0)),
       num_vertices_(absl::exchange(b.num_vertices_, 0)),
       vertices_(absl::exchange(b.vertices_, nullptr)),
+      resource_(b.resource_),
       owns_vertices_(absl::exchange(b.owns_vertices_, false)),
       s2debug_override_(std::move(b.s2debug_override_)),
       origin_inside_(std::move(b.origin_inside_)),
@@ -113,14 +115,13 @@ S2Loop::S2Loop(S2Loop&& b)
       index_(std::move(b.index_)) {}
 
 S2Loop& S2Loop::operator=(S2Loop&& b) {
-  if (owns_vertices_) {
-    delete[] vertices_;
-  }
+  FreeVertices();
 
   S2Region::operator=(static_cast<S2Region&&>(b));
   depth_ = absl::exchange(b.depth_, 0);
   num_vertices_ = absl::exchange(b.num_vertices_, 0);
   vertices_ = absl::exchange(b.vertices_, nullptr);
+  resource_ = b.resource_;
   owns_vertices_ = absl::exchange(b.owns_vertices_, false);
   s2debug_override_ = std::move(b.s2debug_override_);
   origin_inside_ = std::move(b.origin_inside_);
@@ -143,6 +144,39 @@ S2Loop::S2Loop(Span<const S2Point> vertices, S2Debug override)
   Init(vertices);
 }
 
+S2Loop::S2Loop(S2MemoryResource* resource) : resource_(resource) {
+}
+
+S2Loop::S2Loop(Span<const S2Point> vertices, S2MemoryResource* resource,
+               S2Debug override)
+  : resource_(resource), s2debug_override_(override) {
+  Init(vertices);
+}
+
+void S2Loop::AllocateVertices(int num_vertices) {
+  FreeVertices();
+  num_vertices_ = num_vertices;
+  if (resource_ == nullptr) {
+    vertices_ = new S2Point[num_vertices];
+  } else {
+    vertices_ = static_cast<S2Point*>(resource_->Allocate(
+        num_vertices * sizeof(S2Point), alignof(S2Point)));
+  }
+  owns_vertices_ = true;
+}
+
+void S2Loop::FreeVertices() {
+  if (!owns_vertices_) return;
+  if (resource_ == nullptr) {
+    delete[] vertices_;
+  } else {
+    resource_->Deallocate(vertices_, num_vertices_ * sizeof(S2Point),
+                          alignof(S2Point));
+  }
+  vertices_ = nullptr;
+  owns_vertices_ = false;
+}
+
 void S2Loop::set_s2debug_override(S2Debug override) {
   s2debug_override_ = override;
 }
@@ -158,11 +192,8 @@ void S2Loop::ClearIndex() {
 
 void S2Loop::Init(Span<const S2Point> vertices) {
   ClearIndex();
-  if (owns_vertices_) delete[] vertices_;
-  num_vertices_ = vertices.size();
-  vertices_ = new S2Point[num_vertices_];
+  AllocateVertices(vertices.size());
   std::copy(vertices.begin(), vertices.end(), &vertices_[0]);
-  owns_vertices_ = true;
   InitOriginAndBound();
 }
 
@@ -176,8 +207,14 @@ bool S2Loop::IsValid() const {
 }
 
 bool S2Loop::FindValidationError(S2Error* error) const {
+  return FindValidationError(error, 1);
+}
+
+bool S2Loop::FindValidationError(S2Error* error, int num_threads,
+                                 S2Executor* executor) const {
   return (FindValidationErrorNoIndex(error) ||
-          s2shapeutil::FindSelfIntersection(index_, error));
+          s2shapeutil::FindSelfIntersection(index_, error, num_threads,
+                                            executor));
 }
 
 bool S2Loop::FindValidationErrorNoIndex(S2Error* error) const {
@@ -290,9 +327,8 @@ void S2Loop::InitBound() {
   // Note that a small clockwise loop near the equator contains both poles.
 
   S2LatLngRectBounder bounder;
-  for (int i = 0; i <= num_vertices(); ++i) {
-    bounder.AddPoint(vertex(i));
-  }
+  bounder.AddPoints(S2PointSpan(vertices_, num_vertices()));
+  bounder.AddPoint(vertex(0));
   S2LatLngRect b = bounder.GetBound();
   if (Contains(S2Point(0, 0, 1))) {
     b = S2LatLngRect(R1Interval(b.lat().lo(), M_PI_2), S1Interval::Full());
@@ -322,11 +358,9 @@ void S2Loop::InitIndex() {
 
 S2Loop::S2Loop(const S2Cell& cell)
     : depth_(0),
-      num_vertices_(4),
-      vertices_(new S2Point[num_vertices_]),
-      owns_vertices_(true),
       s2debug_override_(S2Debug::ALLOW),
       unindexed_contains_calls_(0) {
+  AllocateVertices(4);
   for (int i = 0; i < 4; ++i) {
     vertices_[i] = cell.GetVertex(i);
   }
@@ -336,19 +370,18 @@ S2Loop::S2Loop(const S2Cell& cell)
 }
 
 S2Loop::~S2Loop() {
-  if (owns_vertices_) delete[] vertices_;
+  FreeVertices();
 }
 
 S2Loop::S2Loop(const S2Loop& src)
     : depth_(src.depth_),
-      num_vertices_(src.num_vertices_),
-      vertices_(new S2Point[num_vertices_]),
-      owns_vertices_(true),
+      resource_(src.resource_),
       s2debug_override_(src.s2debug_override_),
       origin_inside_(src.origin_inside_),
       unindexed_contains_calls_(0),
       bound_(src.bound_),
       subregion_bound_(src.subregion_bound_) {
+  AllocateVertices(src.num_vertices_);
   std::copy(&src.vertices_[0], &src.vertices_[num_vertices_], &vertices_[0]);
   InitIndex();
 }
@@ -566,14 +599,13 @@ bool S2Loop::Contains(const S2Point& p) const {
   // competitive ratio of 2; look up "competitive algorithms" for details.)
   // We set the limit somewhat lower than this (20 rather than 50) because
   // building the index may be forced anyway by other API calls, and so we
-  // want to err on the side of building it too early.
-
-  static const int kMaxBruteForceVertices = 32;
-  static const int kMaxUnindexedContainsCalls = 20;  // See notes above.
+  // want to err on the side of building it too early.  The limit is also
+  // adjusted for the number of vertices (see GetMaxUnindexedContainsCalls).
+  const int max_unindexed_calls = GetMaxUnindexedContainsCalls(num_vertices());
   if (index_.num_shape_ids() == 0 ||  // InitIndex() not called yet
-      num_vertices() <= kMaxBruteForceVertices ||
+      max_unindexed_calls < 0 ||
       (!index_.is_fresh() &&
-       ++unindexed_contains_calls_ != kMaxUnindexedContainsCalls)) {
+       ++unindexed_contains_calls_ != max_unindexed_calls)) {
     return BruteForceContains(p);
   }
   // Otherwise we look up the S2ShapeIndex cell containing this point.  Note
@@ -583,6 +615,28 @@ bool S2Loop::Contains(const S2Point& p) const {
   return Contains(it, p);
 }
 
+int S2Loop::GetMaxUnindexedContainsCalls(int num_vertices) {
+  // An indexed Contains() call costs about as much as testing this many edges
+  // by brute force (including the cost of locating the index cell), so for
+  // loops this small an index is never worthwhile.
+  static const int kMaxBruteForceVertices = 32;
+
+  // The number of calls after which a large loop builds its index.  See
+  // S2Loop::Contains(S2Point) for details.
+  static const int kMaxUnindexedContainsCalls = 20;
+
+  // Building the index costs roughly a fixed number of brute force calls,
+  // but each indexed call only saves the cost of testing the edges beyond
+  // kMaxBruteForceVertices.  Therefore loops that are only slightly larger
+  // than this threshold need proportionally more calls before building the
+  // index pays off.
+  if (num_vertices <= kMaxBruteForceVertices) return -1;
+  int64 n = num_vertices;
+  return static_cast<int>(
+      (kMaxUnindexedContainsCalls * n + (n - kMaxBruteForceVertices - 1)) /
+      (n - kMaxBruteForceVertices));
+}
+
 bool S2Loop::BruteForceContains(const S2Point& p) const {
   // Empty and full loops don't need a special case, but invalid loops with
   // zero vertices do, so we might as well handle them all at once.
@@ -651,6 +705,26 @@ bool S2Loop::DecodeWithinScope(Decoder* const decoder) {
   return false;
 }
 
+/* static */
+bool S2Loop::SkipEncoded(Decoder* decoder, EncodedProperties* properties) {
+  if (decoder->avail() < sizeof(uint8) + sizeof(uint32)) return false;
+  if (decoder->get8() != kCurrentLosslessEncodingVersionNumber) return false;
+  const uint32 num_vertices = decoder->get32();
+  if (num_vertices > absl::GetFlag(FLAGS_s2polygon_decode_max_num_vertices)) {
+    return false;
+  }
+  if (decoder->avail() < (num_vertices * sizeof(S2Point) +
+                          sizeof(uint8) + sizeof(uint32))) {
+    return false;
+  }
+  decoder->skip(num_vertices * sizeof(S2Point));
+  decoder->get8();  // origin_inside
+  properties->num_vertices = num_vertices;
+  properties->depth = decoder->get32();
+  properties->has_bound = true;
+  return properties->bound.Decode(decoder);
+}
+
 bool S2Loop::DecodeInternal(Decoder* const decoder,
                             bool within_scope) {
   // Perform all checks before modifying vertex state. Empty loops are
@@ -666,8 +740,7 @@ bool S2Loop::DecodeInternal(Decoder* const decoder,
     return false;
   }
   ClearIndex();
-  if (owns_vertices_) delete[] vertices_;
-  num_vertices_ = num_vertices;
+  FreeVertices();
 
   // x86 can do unaligned floating-point reads; however, many other
   // platforms cannot. Do not use the zero-copy version if we are on
@@ -681,14 +754,13 @@ bool S2Loop::DecodeInternal(Decoder* const decoder,
       reinterpret_cast<intptr_t>(decoder->skip(0)) % sizeof(double) != 0;
 #endif
   if (within_scope && !is_misaligned) {
+    num_vertices_ = num_vertices;
     vertices_ = const_cast<S2Point *>(reinterpret_cast<const S2Point*>(
                     decoder->skip(0)));
     decoder->skip(num_vertices_ * sizeof(*vertices_));
-    owns_vertices_ = false;
   } else {
-    vertices_ = new S2Point[num_vertices_];
+    AllocateVertices(num_vertices);
     decoder->getn(vertices_, num_vertices_ * sizeof(*vertices_));
-    owns_vertices_ = true;
   }
   origin_inside_ = decoder->get8();
   depth_ = decoder->get32();
@@ -1443,10 +1515,7 @@ bool S2Loop::DecodeCompressed(Decoder* decoder, int snap_level) {
     return false;
   }
   ClearIndex();
-  if (owns_vertices_) delete[] vertices_;
-  num_vertices_ = unsigned_num_vertices;
-  vertices_ = new S2Point[num_vertices_];
-  owns_vertices_ = true;
+  AllocateVertices(unsigned_num_vertices);
 
   if (!S2DecodePointsCompressed(decoder, snap_level,
                                 MakeSpan(vertices_, num_vertices_))) {
@@ -1477,6 +1546,30 @@ bool S2Loop::DecodeCompressed(Decoder* decoder, int snap_level) {
   return true;
 }
 
+/* static */
+bool S2Loop::SkipCompressed(Decoder* decoder, int snap_level,
+                            EncodedProperties* properties) {
+  uint32 num_vertices;
+  if (!decoder->get_varint32(&num_vertices)) return false;
+  if (num_vertices == 0 ||
+      num_vertices > absl::GetFlag(FLAGS_s2polygon_decode_max_num_vertices)) {
+    return false;
+  }
+  if (!S2SkipPointsCompressed(decoder, snap_level, num_vertices)) {
+    return false;
+  }
+  uint32 properties_uint32, depth;
+  if (!decoder->get_varint32(&properties_uint32) ||
+      !decoder->get_varint32(&depth)) {
+    return false;
+  }
+  properties->num_vertices = num_vertices;
+  properties->depth = depth;
+  properties->has_bound =
+      std::bitset<kNumProperties>(properties_uint32).test(kBoundEncoded);
+  return !properties->has_bound || properties->bound.Decode(decoder);
+}
+
 std::bitset<kNumProperties> S2Loop::GetCompressedEncodingProperties() const {
   std::bitset<kNumProperties> properties;
   if (origin_inside_) {
@@ -1497,6 +1590,25 @@ std::bitset<kNumProperties> S2Loop::GetCompressedEncodingProperties() const {
   return properties;
 }
 
+/* static */
+vector<std::unique_ptr<S2Loop>> S2Loop::MakeLoops(
+    Span<const vector<S2Point>> vertices, int num_threads, S2Debug override,
+    S2Executor* executor) {
+  S2_DCHECK_GE(num_threads, 1);
+  const int num_loops = vertices.size();
+  vector<std::unique_ptr<S2Loop>> loops(num_loops);
+  std::atomic<int> next_loop(0);
+  auto make_loops = [&]() {
+    for (int i; (i = next_loop.fetch_add(1)) < num_loops; ) {
+      loops[i] = make_unique<S2Loop>(vertices[i], override);
+    }
+  };
+  S2ParallelFor(executor,
+                std::min(S2NumThreads(executor, num_threads), num_loops),
+                [&](int) { make_loops(); });
+  return loops;
+}
+
 /* static */
 std::unique_ptr<S2Loop> S2Loop::MakeRegularLoop(const S2Point& center,
                                                 S1Angle radius,
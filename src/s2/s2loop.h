@@ -35,8 +35,10 @@
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2debug.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng_rect.h"
 #include "s2/s2loop_measures.h"
+#include "s2/s2memory_resource.h"
 #include "s2/s2pointutil.h"
 #include "s2/s2region.h"
 #include "s2/s2shape_index.h"
@@ -113,6 +115,22 @@ class S2Loop final : public S2Region {
   // IsValid() explicitly.  See set_s2debug_override() for details.
   S2Loop(absl::Span<const S2Point> vertices, S2Debug override);
 
+  // Constructs a loop whose vertices are allocated from the given memory
+  // resource (see s2memory_resource.h) rather than the global heap.  The
+  // loop must be initialized by calling Init() or Decode() before it is
+  // used.  The resource is preserved across calls to Init() and Decode(),
+  // and is also used by the copy made by Clone().  It must outlive the loop.
+  explicit S2Loop(S2MemoryResource* resource);
+
+  // Convenience constructor that calls Init() with the given vertices, which
+  // are allocated from "resource".
+  S2Loop(absl::Span<const S2Point> vertices, S2MemoryResource* resource,
+         S2Debug override = S2Debug::ALLOW);
+
+  // Returns the resource that the vertices are allocated from, or nullptr if
+  // they are allocated from the global heap.
+  S2MemoryResource* memory_resource() const { return resource_; }
+
   // Initialize a loop with given vertices.  The last vertex is implicitly
   // connected to the first.  All points should be unit length.  Loops must
   // have at least 3 vertices (except for the empty and full loops, see
@@ -174,6 +192,13 @@ class S2Loop final : public S2Region {
   // REQUIRES: error != nullptr
   bool FindValidationError(S2Error* error) const;
 
+  // As above, but uses up to "num_threads" threads to check for edge
+  // crossings, which is the most expensive part of validating large loops.
+  // The result (including the error) is the same as above.  See
+  // S2ParallelFor for the meaning of "executor".
+  bool FindValidationError(S2Error* error, int num_threads,
+                           S2Executor* executor = nullptr) const;
+
   int num_vertices() const { return num_vertices_; }
 
   // For convenience, we make two entire copies of the vertex list available:
@@ -382,6 +407,20 @@ class S2Loop final : public S2Region {
                                                  S1Angle radius,
                                                  int num_vertices);
 
+  // Constructs one loop for each vertex chain in "vertices" using up to
+  // "num_threads" threads.  Each loop is equivalent to
+  // S2Loop(vertices[i], override).  This is useful when building polygons
+  // with thousands of loops, since initializing a loop computes its bound
+  // and whether it contains S2::Origin(), which takes time proportional to
+  // its number of vertices.  (Loop indexes are still built lazily unless
+  // --s2loop_lazy_indexing is false.)  See S2ParallelFor for the meaning of
+  // "executor".
+  //
+  // REQUIRES: num_threads >= 1
+  static std::vector<std::unique_ptr<S2Loop>> MakeLoops(
+      absl::Span<const std::vector<S2Point>> vertices, int num_threads,
+      S2Debug override = S2Debug::ALLOW, S2Executor* executor = nullptr);
+
   // Returns the total number of bytes used by the loop.
   size_t SpaceUsed() const;
 
@@ -529,6 +568,7 @@ class S2Loop final : public S2Region {
   friend class S2LoopTestBase;
   friend class LoopCrosser;
   friend class s2builderutil::S2PolygonLayer;
+  friend class EncodedS2Polygon;
 
   // Internal copy constructor used only by Clone() that makes a deep copy of
   // its argument.
@@ -551,12 +591,25 @@ class S2Loop final : public S2Region {
   // Used by the S2Polygon implementation.
   bool BruteForceContains(const S2Point& p) const;
 
+  // Returns the number of unindexed calls to Contains(S2Point) after which
+  // the S2ShapeIndex of a loop or polygon with the given number of vertices
+  // should be built, or -1 if brute force is always faster.  Used by the
+  // S2Polygon implementation.
+  static int GetMaxUnindexedContainsCalls(int num_vertices);
+
   // Like FindValidationError(), but skips any checks that would require
   // building the S2ShapeIndex (i.e., self-intersection tests).  This is used
   // by the S2Polygon implementation, which uses its own index to check for
   // loop self-intersections.
   bool FindValidationErrorNoIndex(S2Error* error) const;
 
+  // Replaces the vertex array with an uninitialized array of the given size
+  // that is owned by this loop, allocated from resource_ if it is non-null.
+  void AllocateVertices(int num_vertices);
+
+  // Frees the vertex array if it is owned by this loop.
+  void FreeVertices();
+
   // Internal implementation of the Decode and DecodeWithinScope methods above.
   // If within_scope is true, memory is allocated for vertices_ and data
   // is copied from the decoder using std::copy. If it is false, vertices_
@@ -583,6 +636,23 @@ class S2Loop final : public S2Region {
   // same as the one used when EncodeCompressed was called.
   bool DecodeCompressed(Decoder* decoder, int snap_level);
 
+  // The properties of an encoded loop that can be read without decoding its
+  // vertices.  "bound" is only valid if "has_bound" is true.
+  struct EncodedProperties {
+    uint32 num_vertices = 0;
+    int depth = 0;
+    bool has_bound = false;
+    S2LatLngRect bound;
+  };
+
+  // Advance "decoder" past a loop encoded with Encode() or EncodeCompressed()
+  // respectively without decoding its vertices, and return the properties of
+  // the encoded loop.  Loops encoded with Encode() always include the bound,
+  // while EncodeCompressed() only encodes the bound of large loops.
+  static bool SkipEncoded(Decoder* decoder, EncodedProperties* properties);
+  static bool SkipCompressed(Decoder* decoder, int snap_level,
+                             EncodedProperties* properties);
+
   // Returns a bitset of properties used by EncodeCompressed
   // to efficiently encode boolean values.  Properties are
   // origin_inside and whether the bound was encoded.
@@ -642,9 +712,11 @@ class S2Loop final : public S2Region {
   // would be relatively expensive (due to division by sizeof(S2Point) == 24).
   // When DecodeWithinScope is used to initialize the loop, we do not
   // take ownership of the memory for vertices_, and the owns_vertices_ field
-  // is used to prevent deallocation and overwriting.
+  // is used to prevent deallocation and overwriting.  Owned vertices are
+  // allocated from "resource_" if it is non-null.
   int num_vertices_ = 0;
   S2Point* vertices_ = nullptr;
+  S2MemoryResource* resource_ = nullptr;
   bool owns_vertices_ = false;
 
   S2Debug s2debug_override_ = S2Debug::ALLOW;
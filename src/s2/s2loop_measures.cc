@@ -28,6 +28,7 @@
 #include "s2/s2edge_distances.h"
 #include "s2/s2measures.h"
 #include "s2/s2pointutil.h"
+#include "s2/s2predicates.h"
 
 using std::fabs;
 using std::max;
@@ -45,6 +46,84 @@ S1Angle GetPerimeter(S2PointLoopSpan loop) {
   return perimeter;
 }
 
+// Returns the same value as S2::SignedArea() to within a small absolute error
+// (a few DBL_EPSILON times the product of two side lengths), but is much
+// faster.  The area E is computed using the formula of Van Oosterom and
+// Strackee,
+//
+//   tan(E / 2) = det(A, B, C) / (1 + A.B + B.C + C.A),
+//
+// rather than with l'Huilier's formula, which requires three calls to
+// S2Point::Angle() and five other transcendental functions.  Evaluating the
+// determinant as det(A, B - A, C - A) keeps its relative error small for
+// small triangles, and for those the arctangent is evaluated using a short
+// power series.  For triangles whose orientation is not certain (including
+// degenerate ones) the sign is taken from s2pred::Sign() instead, as in
+// S2::SignedArea().  (This is also more accurate than S2::SignedArea() for
+// long, thin triangles, where l'Huilier's formula loses precision.)
+static double FastSignedArea(const S2Point& a, const S2Point& b,
+                             const S2Point& c) {
+  // Conservative bound on the error in "det" relative to |B-A| * |C-A|.
+  constexpr double kDetError = 8 * DBL_EPSILON;
+  // For |t| < kMaxSeries, truncating the series for atan(t) after the t^7
+  // term has a relative error of less than 1e-20.
+  constexpr double kMaxSeries = 1e-3;
+  Vector3_d ab = b - a, ac = c - a;
+  double det = a.DotProd(ab.CrossProd(ac));
+  double denom = 1 + a.DotProd(b) + b.DotProd(c) + c.DotProd(a);
+  double area;
+  if (denom > 0 && fabs(det) < kMaxSeries * denom) {
+    double t = det / denom, t2 = t * t;
+    area = 2 * t * (1 - t2 * (1.0 / 3 - t2 * (1.0 / 5 - t2 * (1.0 / 7))));
+  } else {
+    area = 2 * atan2(det, denom);
+  }
+  if (det * det <= kDetError * kDetError * ab.Norm2() * ac.Norm2()) {
+    return s2pred::Sign(a, b, c) * fabs(area);
+  }
+  return area;
+}
+
+// Returns the same value as S2::TrueCentroid(a, b, c) to within a few
+// DBL_EPSILON relative error, but is several times faster for triangles
+// whose sides are all shorter than about 3.6 degrees.  For such triangles the
+// factor "angle / sin(angle)" for each side is evaluated using a power series
+// in u = sin^2(angle / 2) = |X - Y|^2 / 4, which replaces three
+// S2Point::Angle() and three sin() calls by a few multiplications.
+static S2Point FastTrueCentroid(const S2Point& a, const S2Point& b,
+                                const S2Point& c) {
+  // With u < 1e-3, truncating the series after kNumTerms terms has a
+  // relative error of less than 1e-18.
+  constexpr double kMaxU = 1e-3;
+  constexpr int kNumTerms = 7;
+  double ua = 0.25 * (b - c).Norm2();
+  double ub = 0.25 * (c - a).Norm2();
+  double uc = 0.25 * (a - b).Norm2();
+  if (max(ua, max(ub, uc)) >= kMaxU) return S2::TrueCentroid(a, b, c);
+
+  // angle / sin(angle) = sum_n c_n * u^n, where c_0 = 1 and
+  // c_n = c_{n-1} * (2n) / (2n + 1).  The series is evaluated using Horner's
+  // rule with precomputed coefficients.
+  static constexpr double kCoeffs[kNumTerms] = {
+      1.0, 2.0 / 3, 8.0 / 15, 16.0 / 35, 128.0 / 315, 256.0 / 693,
+      1024.0 / 3003};
+  auto series = [](double u) {
+    double sum = kCoeffs[kNumTerms - 1];
+    for (int n = kNumTerms - 2; n >= 0; --n) sum = sum * u + kCoeffs[n];
+    return sum;
+  };
+  double ra = series(ua), rb = series(ub), rc = series(uc);
+
+  // The remaining calculation is the same as in S2::TrueCentroid().
+  S2Point x(a.x(), b.x() - a.x(), c.x() - a.x());
+  S2Point y(a.y(), b.y() - a.y(), c.y() - a.y());
+  S2Point z(a.z(), b.z() - a.z(), c.z() - a.z());
+  S2Point r(ra, rb - ra, rc - ra);
+  return 0.5 * S2Point(y.CrossProd(z).DotProd(r),
+                       z.CrossProd(x).DotProd(r),
+                       x.CrossProd(y).DotProd(r));
+}
+
 double GetArea(S2PointLoopSpan loop) {
   double area = GetSignedArea(loop);
   S2_DCHECK_LE(fabs(area), 2 * M_PI);
@@ -119,7 +198,7 @@ double GetSignedArea(S2PointLoopSpan loop) {
 
   // The signed area should be between approximately -4*Pi and 4*Pi.
   // Normalize it to be in the range [-2*Pi, 2*Pi].
-  double area = GetSurfaceIntegral(loop, S2::SignedArea);
+  double area = GetSurfaceIntegral(loop, FastSignedArea);
   double max_error = GetCurvatureMaxError(loop);
 
   // Normalize the area to be in the range (-2*Pi, 2*Pi].  Effectively this
@@ -245,7 +324,7 @@ S2Point GetCentroid(S2PointLoopSpan loop) {
   // interior, or the negative of the integral of position over the loop
   // exterior.  But these two values are the same (!), because the integral of
   // position over the entire sphere is (0, 0, 0).
-  return GetSurfaceIntegral(loop, S2::TrueCentroid);
+  return GetSurfaceIntegral(loop, FastTrueCentroid);
 }
 
 static inline bool IsOrderLess(LoopOrder order1, LoopOrder order2,
@@ -220,6 +220,11 @@ T GetSurfaceIntegral(S2PointLoopSpan loop,
   // reduced further if desired.
   static const double kMaxLength = M_PI - 1e-5;
 
+  // Edge lengths are compared with kMaxLength using dot products, which is
+  // much cheaper than S2Point::Angle() and accurate enough for this purpose
+  // (the origin is always within a few DBL_EPSILON of unit length).
+  static const double kMinDotProd = std::cos(kMaxLength);
+
   // The default constructor for T must initialize the value to zero.
   // (This is true for built-in types such as "double".)
   T sum = T();
@@ -240,7 +245,7 @@ T GetSurfaceIntegral(S2PointLoopSpan loop,
     S2_DCHECK(i == 1 || origin.Angle(loop[i]) < kMaxLength);
     S2_DCHECK(origin == loop[0] || std::fabs(origin.DotProd(loop[0])) < 1e-15);
 
-    if (loop[i + 1].Angle(origin) > kMaxLength) {
+    if (loop[i + 1].DotProd(origin) < kMinDotProd) {
       // We are about to create an unstable edge, so choose a new origin O'
       // for the triangle fan.
       S2Point old_origin = origin;
@@ -249,7 +254,7 @@ T GetSurfaceIntegral(S2PointLoopSpan loop,
         // therefore V_i+1 as well).  Moving the origin transforms the leading
         // edge of the triangle fan into a two-edge chain (V_0, O', V_i).
         origin = S2::RobustCrossProd(loop[0], loop[i]).Normalize();
-      } else if (loop[i].Angle(loop[0]) < kMaxLength) {
+      } else if (loop[i].DotProd(loop[0]) > kMinDotProd) {
         // All edges of the triangle (O, V_0, V_i) are stable, so we can
         // revert to using V_0 as the origin.  This changes the leading edge
         // chain (V_0, O, V_i) back into a single edge (V_0, V_i).
@@ -23,6 +23,7 @@
 
 #include <gtest/gtest.h>
 #include "absl/strings/string_view.h"
+#include "s2/s2centroids.h"
 #include "s2/s2latlng.h"
 #include "s2/s2loop.h"
 #include "s2/s2measures.h"
@@ -255,8 +256,45 @@ TEST_F(LoopTestBase, GetAreaConsistentWithOrientation) {
 }
 
 TEST_F(LoopTestBase, GetAreaAccuracy) {
-  // TODO(ericv): Test that GetArea() has an accuracy significantly better
-  // than 1e-15 on loops whose area is small.
+  // Small loops are nearly planar, so their area is very close to the area of
+  // their projection onto the tangent plane at a nearby point (the relative
+  // difference is proportional to radius**2).  The projected area is computed
+  // from the vertex differences, which are exact for nearby points, so that
+  // rounding the vertices to double precision does not affect the comparison.
+  // Check that the relative error is much smaller than 1e-15 / area.
+  for (double radius : {1e-6, 1e-8, 1e-10}) {
+    for (int n : {3, 10, 1000}) {
+      S2Point center = S2Testing::RandomPoint();
+      vector<S2Point> loop = S2Testing::MakeRegularPoints(
+          center, S1Angle::Radians(radius), n);
+      double planar_area = 0;
+      for (int i = 0; i < n; ++i) {
+        S2Point a = loop[i] - center, b = loop[(i + 1) % n] - center;
+        planar_area += 0.5 * center.DotProd(a.CrossProd(b));
+      }
+      EXPECT_NEAR(1.0, S2::GetArea(loop) / planar_area, 1e-10)
+          << "radius=" << radius << ", n=" << n;
+    }
+  }
+}
+
+TEST(GetCentroid, MatchesTrueCentroidIntegral) {
+  // GetCentroid() uses a faster triangle kernel than S2::TrueCentroid() for
+  // small triangles; check that the results agree.
+  S2Point (*true_centroid)(const S2Point&, const S2Point&,
+                           const S2Point&) = S2::TrueCentroid;
+  for (int iter = 0; iter < 100; ++iter) {
+    S2Testing::Fractal fractal;
+    fractal.SetLevelForApproxMaxEdges(
+        S2Testing::rnd.Uniform(2) ? 10 : 1000);
+    double radius_deg = pow(10, S2Testing::rnd.UniformDouble(-6, 1.5));
+    auto loop = fractal.MakeLoop(S2Testing::GetRandomFrame(),
+                                 S1Angle::Degrees(radius_deg));
+    S2PointLoopSpan span = loop->vertices_span();
+    S2Point expected = S2::GetSurfaceIntegral(span, true_centroid);
+    EXPECT_LE((S2::GetCentroid(span) - expected).Norm(),
+              1e-15 + 1e-12 * expected.Norm());
+  }
 }
 
 TEST_F(LoopTestBase, GetAreaAndCentroid) {
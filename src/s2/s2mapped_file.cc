@@ -0,0 +1,147 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2mapped_file.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "s2/base/logging.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+#ifndef _WIN32
+
+unique_ptr<S2MappedFile> S2MappedFile::Open(const string& filename,
+                                            S2Error* error) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error->Init(S2Error::INVALID_ARGUMENT, "Cannot open %s: %s", filename,
+                strerror(errno));
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    error->Init(S2Error::INVALID_ARGUMENT, "Cannot stat %s: %s", filename,
+                strerror(errno));
+    close(fd);
+    return nullptr;
+  }
+  size_t size = st.st_size;
+  const char* data = nullptr;
+  if (size > 0) {
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      error->Init(S2Error::RESOURCE_EXHAUSTED, "Cannot mmap %s: %s", filename,
+                  strerror(errno));
+      close(fd);
+      return nullptr;
+    }
+    data = static_cast<const char*>(addr);
+  }
+  // The mapping remains valid after the file descriptor is closed.
+  close(fd);
+  return unique_ptr<S2MappedFile>(new S2MappedFile(data, size));
+}
+
+S2MappedFile::~S2MappedFile() {
+  if (size_ > 0) munmap(const_cast<char*>(data_), size_);
+}
+
+void S2MappedFile::GetPageRange(absl::string_view range, const char** begin,
+                                const char** end) const {
+  S2_DCHECK(range.empty() || (range.data() >= data_ &&
+                              range.data() + range.size() <= data_ + size_));
+  uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t lo = reinterpret_cast<uintptr_t>(range.data());
+  uintptr_t hi = lo + range.size();
+  lo &= ~(page_size - 1);
+  hi = (hi + page_size - 1) & ~(page_size - 1);
+  *begin = reinterpret_cast<const char*>(lo);
+  *end = reinterpret_cast<const char*>(hi);
+}
+
+bool S2MappedFile::Advise(absl::string_view range, Advice advice) const {
+  if (range.empty()) return true;
+  int value = POSIX_MADV_NORMAL;
+  switch (advice) {
+    case Advice::NORMAL:     value = POSIX_MADV_NORMAL;     break;
+    case Advice::RANDOM:     value = POSIX_MADV_RANDOM;     break;
+    case Advice::SEQUENTIAL: value = POSIX_MADV_SEQUENTIAL; break;
+    case Advice::WILLNEED:   value = POSIX_MADV_WILLNEED;   break;
+    case Advice::DONTNEED:   value = POSIX_MADV_DONTNEED;   break;
+  }
+  const char *begin, *end;
+  GetPageRange(range, &begin, &end);
+  return posix_madvise(const_cast<char*>(begin), end - begin, value) == 0;
+}
+
+size_t S2MappedFile::ResidentBytes(absl::string_view range) const {
+  if (range.empty()) return 0;
+  const char *begin, *end;
+  GetPageRange(range, &begin, &end);
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t num_pages = (end - begin) / page_size;
+#ifdef __APPLE__
+  vector<char> residency(num_pages);
+#else
+  vector<unsigned char> residency(num_pages);
+#endif
+  if (mincore(const_cast<char*>(begin), end - begin, residency.data()) != 0) {
+    return 0;
+  }
+  size_t resident_pages = 0;
+  for (auto r : residency) resident_pages += r & 1;
+  return resident_pages * page_size;
+}
+
+#else  // _WIN32
+
+unique_ptr<S2MappedFile> S2MappedFile::Open(const string& filename,
+                                            S2Error* error) {
+  error->Init(S2Error::UNIMPLEMENTED,
+              "S2MappedFile is not supported on this platform");
+  return nullptr;
+}
+
+S2MappedFile::~S2MappedFile() {}
+
+void S2MappedFile::GetPageRange(absl::string_view range, const char** begin,
+                                const char** end) const {
+  *begin = range.data();
+  *end = range.data() + range.size();
+}
+
+bool S2MappedFile::Advise(absl::string_view range, Advice advice) const {
+  return false;
+}
+
+size_t S2MappedFile::ResidentBytes(absl::string_view range) const {
+  return 0;
+}
+
+#endif  // _WIN32
@@ -0,0 +1,110 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2MAPPED_FILE_H_
+#define S2_S2MAPPED_FILE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "s2/util/coding/coder.h"
+#include "s2/s2error.h"
+
+// S2MappedFile maps a file read-only into memory so that encoded S2 data
+// structures (such as EncodedS2ShapeIndex) can be used directly from the
+// mapping without copying the file contents into a std::string first.
+// Because the mapping is shared, multiple processes that load the same file
+// share a single copy in the page cache, and loading an index costs only the
+// pages that are actually accessed.  Example usage:
+//
+//   S2Error error;
+//   auto file = S2MappedFile::Open("/data/index.s2", &error);
+//   if (file == nullptr) return error;
+//   Decoder decoder = file->decoder();
+//   EncodedS2ShapeIndex index;
+//   index.Init(&decoder, s2shapeutil::LazyDecodeShapeFactory(&decoder));
+//   file->Advise(index.encoded_cells_data(), S2MappedFile::Advice::RANDOM);
+//
+// Lifetime: every object decoded from the mapping (including the index, its
+// shape factory and any shapes it has decoded) refers to the mapped bytes,
+// so the S2MappedFile must outlive all of them.
+//
+// Alignment: the mapping starts on a page boundary, but the encoded formats
+// in this library do not require any alignment, so the data may also be
+// located at an arbitrary offset within the file.
+//
+// S2MappedFile is only supported on POSIX systems; on other platforms Open()
+// fails with S2Error::UNIMPLEMENTED.  All methods are thread-safe.
+class S2MappedFile {
+ public:
+  // Access patterns that can be declared for a range of the mapping (see
+  // Advise).  These correspond to the posix_madvise() values.
+  enum class Advice {
+    NORMAL,      // No special treatment.
+    RANDOM,      // Pages are accessed in random order (disables readahead).
+    SEQUENTIAL,  // Pages are accessed sequentially.
+    WILLNEED,    // Pages will be needed soon (starts reading them in).
+    DONTNEED,    // Pages will not be needed soon.
+  };
+
+  // Maps the given file read-only, or returns nullptr and sets "error" if the
+  // file could not be opened or mapped.
+  static std::unique_ptr<S2MappedFile> Open(const std::string& filename,
+                                            S2Error* error);
+
+  // Unmaps the file.
+  ~S2MappedFile();
+
+  // Returns the mapped bytes.
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  absl::string_view contents() const { return {data_, size_}; }
+
+  // Returns a Decoder over the entire file.
+  Decoder decoder() const { return Decoder(data_, size_); }
+
+  // Declares the expected access pattern for the pages spanned by "range",
+  // which must be a subrange of contents() (for example the sections returned
+  // by EncodedS2ShapeIndex::cell_ids_data() and encoded_cells_data()).
+  // This is only a hint; returns false if the system rejected it.
+  bool Advise(absl::string_view range, Advice advice) const;
+
+  // Returns the number of bytes of "range" (rounded outward to whole pages)
+  // that are currently resident in memory.  When a range has been advised as
+  // RANDOM, this is a good approximation of the number of bytes that have
+  // actually been touched, which is useful for sizing hosts.  Returns 0 if
+  // residency information is not available.
+  size_t ResidentBytes(absl::string_view range) const;
+
+  // Convenience method that returns ResidentBytes(contents()).
+  size_t ResidentBytes() const { return ResidentBytes(contents()); }
+
+ private:
+  S2MappedFile(const char* data, size_t size) : data_(data), size_(size) {}
+
+  // Returns the page-aligned bounds of "range" in [*begin, *end).
+  void GetPageRange(absl::string_view range, const char** begin,
+                    const char** end) const;
+
+  const char* const data_;
+  const size_t size_;
+
+  S2MappedFile(const S2MappedFile&) = delete;
+  void operator=(const S2MappedFile&) = delete;
+};
+
+#endif  // S2_S2MAPPED_FILE_H_
@@ -0,0 +1,105 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2mapped_file.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "s2/encoded_s2shape_index.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2text_format.h"
+
+using std::string;
+
+namespace {
+
+#ifndef _WIN32
+
+// Writes "contents" to a new file in the test temporary directory and
+// returns its name.
+string WriteTempFile(const string& basename, const string& contents) {
+  string filename = ::testing::TempDir() + "/" + basename;
+  FILE* file = fopen(filename.c_str(), "wb");
+  EXPECT_NE(nullptr, file);
+  EXPECT_EQ(contents.size(),
+            fwrite(contents.data(), 1, contents.size(), file));
+  fclose(file);
+  return filename;
+}
+
+TEST(S2MappedFile, EncodedS2ShapeIndex) {
+  auto index = s2textformat::MakeIndexOrDie(
+      "# # 0:0, 0:10, 10:10, 10:0; 20:20, 20:30, 30:30, 30:20");
+  Encoder encoder;
+  s2shapeutil::CompactEncodeTaggedShapes(*index, &encoder);
+  index->Encode(&encoder);
+  string filename = WriteTempFile(
+      "s2mapped_file_test.s2", string(encoder.base(), encoder.length()));
+
+  S2Error error;
+  auto file = S2MappedFile::Open(filename, &error);
+  ASSERT_NE(nullptr, file) << error;
+  EXPECT_EQ(encoder.length(), file->size());
+
+  Decoder decoder = file->decoder();
+  EncodedS2ShapeIndex encoded;
+  ASSERT_TRUE(encoded.Init(&decoder,
+                           s2shapeutil::LazyDecodeShapeFactory(&decoder)));
+
+  // The cell sections lie within the mapping and do not overlap.
+  absl::string_view cell_ids = encoded.cell_ids_data();
+  absl::string_view cells = encoded.encoded_cells_data();
+  EXPECT_GE(cell_ids.data(), file->data());
+  EXPECT_EQ(cell_ids.data() + cell_ids.size(), cells.data());
+  EXPECT_EQ(file->data() + file->size(), cells.data() + cells.size());
+  EXPECT_TRUE(file->Advise(cell_ids, S2MappedFile::Advice::WILLNEED));
+  EXPECT_TRUE(file->Advise(cells, S2MappedFile::Advice::RANDOM));
+
+  auto query = MakeS2ContainsPointQuery(&encoded);
+  EXPECT_TRUE(query.Contains(s2textformat::MakePointOrDie("5:5")));
+  EXPECT_TRUE(query.Contains(s2textformat::MakePointOrDie("25:25")));
+  EXPECT_FALSE(query.Contains(s2textformat::MakePointOrDie("15:15")));
+
+  // The data has just been accessed, so at least one page is resident.
+  EXPECT_GT(file->ResidentBytes(), 0);
+  EXPECT_LE(file->ResidentBytes(cells), file->ResidentBytes());
+  remove(filename.c_str());
+}
+
+TEST(S2MappedFile, EmptyFile) {
+  string filename = WriteTempFile("s2mapped_file_test.empty", "");
+  S2Error error;
+  auto file = S2MappedFile::Open(filename, &error);
+  ASSERT_NE(nullptr, file) << error;
+  EXPECT_EQ(0, file->size());
+  EXPECT_EQ(0, file->ResidentBytes());
+  remove(filename.c_str());
+}
+
+#endif  // _WIN32
+
+TEST(S2MappedFile, MissingFile) {
+  S2Error error;
+  EXPECT_EQ(nullptr, S2MappedFile::Open("/nonexistent/s2mapped_file", &error));
+  EXPECT_FALSE(error.ok());
+}
+
+}  // namespace
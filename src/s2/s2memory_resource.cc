@@ -0,0 +1,58 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2memory_resource.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "absl/base/optimization.h"
+#include "s2/base/logging.h"
+
+using std::max;
+
+// Blocks are never larger than this unless a single allocation requires it.
+static constexpr size_t kMaxBlockSize = 1 << 20;
+
+S2MonotonicBufferResource::S2MonotonicBufferResource(size_t initial_block_size)
+    : initial_block_size_(max<size_t>(initial_block_size, 64)),
+      next_block_size_(initial_block_size_) {
+}
+
+void* S2MonotonicBufferResource::Allocate(size_t bytes, size_t alignment) {
+  S2_DCHECK_EQ(0, alignment & (alignment - 1));
+  uintptr_t p = reinterpret_cast<uintptr_t>(next_);
+  uintptr_t aligned = (p + alignment - 1) & ~(alignment - 1);
+  if (next_ == nullptr || aligned + bytes > reinterpret_cast<uintptr_t>(end_)) {
+    // Start a new block large enough for this allocation.
+    size_t size = max(next_block_size_, bytes + alignment);
+    next_block_size_ = std::min(2 * next_block_size_, kMaxBlockSize);
+    blocks_.emplace_back(new char[size]);
+    bytes_reserved_ += size;
+    next_ = blocks_.back().get();
+    end_ = next_ + size;
+    p = reinterpret_cast<uintptr_t>(next_);
+    aligned = (p + alignment - 1) & ~(alignment - 1);
+  }
+  next_ += (aligned - p) + bytes;
+  return reinterpret_cast<void*>(aligned);
+}
+
+void S2MonotonicBufferResource::Release() {
+  blocks_.clear();
+  next_block_size_ = initial_block_size_;
+  bytes_reserved_ = 0;
+  next_ = end_ = nullptr;
+}
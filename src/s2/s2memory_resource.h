@@ -0,0 +1,185 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2MEMORY_RESOURCE_H_
+#define S2_S2MEMORY_RESOURCE_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// S2MemoryResource is an interface for supplying the memory used to store
+// the vertices of S2 geometry objects.  It has the same semantics as C++17's
+// std::pmr::memory_resource, so that clients using C++17 can forward to any
+// std::pmr resource with a trivial adapter:
+//
+//   class PmrResource : public S2MemoryResource {
+//    public:
+//     explicit PmrResource(std::pmr::memory_resource* r) : r_(r) {}
+//     void* Allocate(size_t bytes, size_t alignment) override {
+//       return r_->allocate(bytes, alignment);
+//     }
+//     void Deallocate(void* p, size_t bytes, size_t alignment) override {
+//       r_->deallocate(p, bytes, alignment);
+//     }
+//    private:
+//     std::pmr::memory_resource* r_;
+//   };
+//
+// Classes that support it (S2Loop, S2Polygon, S2LaxPolygonShape and
+// S2LaxPolylineShape) accept a resource in their constructor.  The most
+// common use is to allocate all the temporary geometry of a request from an
+// S2MonotonicBufferResource (see below), which is much faster than the
+// global heap and frees everything at once.  Note that only the vertex data
+// (which usually dominates) is allocated from the resource; the objects
+// themselves, their indexes and any cached data still use the global heap.
+//
+// A resource must outlive all the objects that use it.  A resource may be
+// used by several threads only if its implementation is thread-safe (which
+// S2MonotonicBufferResource is not).
+class S2MemoryResource {
+ public:
+  virtual ~S2MemoryResource() = default;
+
+  // Returns at least "bytes" bytes of memory aligned to "alignment" (a power
+  // of two).  Does not return nullptr.
+  virtual void* Allocate(size_t bytes, size_t alignment) = 0;
+
+  // Releases memory returned by a previous call to Allocate() with the same
+  // "bytes" and "alignment".
+  virtual void Deallocate(void* p, size_t bytes, size_t alignment) = 0;
+};
+
+// A resource that allocates memory sequentially from a list of blocks, like
+// std::pmr::monotonic_buffer_resource.  Deallocate() does nothing; instead
+// all memory is returned to the heap when Release() is called or the
+// resource is destroyed.  Each block is twice as large as the previous one
+// (up to a limit), so the number of heap allocations is logarithmic in the
+// total memory used.  This class is not thread-safe.
+//
+//   S2MonotonicBufferResource arena;
+//   S2Polygon polygon(&arena);
+//   polygon.Decode(&decoder);  // Vertices are allocated from "arena".
+class S2MonotonicBufferResource final : public S2MemoryResource {
+ public:
+  // "initial_block_size" is the size of the first block allocated from the
+  // heap.
+  explicit S2MonotonicBufferResource(size_t initial_block_size = 4096);
+  ~S2MonotonicBufferResource() override = default;
+
+  void* Allocate(size_t bytes, size_t alignment) override;
+  void Deallocate(void* p, size_t bytes, size_t alignment) override {}
+
+  // Returns all memory to the heap.  All objects that use this resource must
+  // have been destroyed.  The next block allocated has the initial size.
+  void Release();
+
+  // Returns the number of bytes allocated from the heap (including unused
+  // space at the end of each block).
+  size_t bytes_reserved() const { return bytes_reserved_; }
+
+ private:
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  size_t initial_block_size_;
+  size_t next_block_size_;
+  size_t bytes_reserved_ = 0;
+  char* next_ = nullptr;  // The next free byte in the current block.
+  char* end_ = nullptr;   // The end of the current block.
+
+  S2MonotonicBufferResource(const S2MonotonicBufferResource&) = delete;
+  void operator=(const S2MonotonicBufferResource&) = delete;
+};
+
+// An owning pointer to an array of "T" that was allocated either from an
+// S2MemoryResource or (if the resource is nullptr) using new[].  This is a
+// drop-in replacement for std::unique_ptr<T[]> for classes that accept an
+// S2MemoryResource.  "T" must be trivially destructible, and the elements
+// are left uninitialized.
+template <class T>
+class S2ResourceArray {
+ public:
+  static_assert(std::is_trivially_destructible<T>::value,
+                "S2ResourceArray elements must be trivially destructible");
+
+  // Constructs a null array.
+  S2ResourceArray() = default;
+
+  // Allocates an array of "size" elements from "resource", or using new[]
+  // if "resource" is nullptr.
+  S2ResourceArray(size_t size, S2MemoryResource* resource);
+
+  ~S2ResourceArray() { reset(); }
+
+  S2ResourceArray(S2ResourceArray&& b)
+      : data_(b.data_), size_(b.size_), resource_(b.resource_) {
+    b.data_ = nullptr;
+  }
+  S2ResourceArray& operator=(S2ResourceArray&& b) {
+    if (this != &b) {
+      reset();
+      data_ = b.data_;
+      size_ = b.size_;
+      resource_ = b.resource_;
+      b.data_ = nullptr;
+    }
+    return *this;
+  }
+
+  T* get() const { return data_; }
+  T& operator[](size_t i) const { return data_[i]; }
+  explicit operator bool() const { return data_ != nullptr; }
+
+  // Frees the array, leaving it null.
+  void reset();
+
+ private:
+  T* data_ = nullptr;
+  size_t size_ = 0;
+  S2MemoryResource* resource_ = nullptr;
+
+  S2ResourceArray(const S2ResourceArray&) = delete;
+  void operator=(const S2ResourceArray&) = delete;
+};
+
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+template <class T>
+S2ResourceArray<T>::S2ResourceArray(size_t size, S2MemoryResource* resource)
+    : size_(size), resource_(resource) {
+  if (resource == nullptr) {
+    data_ = new T[size];
+  } else {
+    data_ = static_cast<T*>(resource->Allocate(size * sizeof(T), alignof(T)));
+    for (size_t i = 0; i < size; ++i) new (&data_[i]) T;
+  }
+}
+
+template <class T>
+void S2ResourceArray<T>::reset() {
+  if (data_ == nullptr) return;
+  if (resource_ == nullptr) {
+    delete[] data_;
+  } else {
+    resource_->Deallocate(data_, size_ * sizeof(T), alignof(T));
+  }
+  data_ = nullptr;
+}
+
+#endif  // S2_S2MEMORY_RESOURCE_H_
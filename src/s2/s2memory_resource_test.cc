@@ -0,0 +1,238 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2memory_resource.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "s2/util/coding/coder.h"
+#include "s2/s2boolean_operation.h"
+#include "s2/s2builder.h"
+#include "s2/s2builderutil_s2polygon_layer.h"
+#include "s2/s2lax_polygon_shape.h"
+#include "s2/s2lax_polyline_shape.h"
+#include "s2/s2loop.h"
+#include "s2/s2polygon.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// A resource that forwards to the global heap and counts the number of
+// outstanding allocations and bytes.
+class CountingResource : public S2MemoryResource {
+ public:
+  void* Allocate(size_t bytes, size_t alignment) override {
+    ++num_allocations_;
+    bytes_ += bytes;
+    return ::operator new(bytes);
+  }
+  void Deallocate(void* p, size_t bytes, size_t alignment) override {
+    --num_allocations_;
+    bytes_ -= bytes;
+    ::operator delete(p);
+  }
+  int num_allocations() const { return num_allocations_; }
+  size_t bytes() const { return bytes_; }
+
+ private:
+  int num_allocations_ = 0;
+  size_t bytes_ = 0;
+};
+
+TEST(S2MonotonicBufferResource, AlignmentAndGrowth) {
+  S2MonotonicBufferResource arena(100);
+  EXPECT_EQ(0, arena.bytes_reserved());
+  char* p = static_cast<char*>(arena.Allocate(1, 1));
+  EXPECT_EQ(100, arena.bytes_reserved());
+  for (size_t alignment : {2, 4, 8, 16, 32}) {
+    void* q = arena.Allocate(3, alignment);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(q) % alignment);
+  }
+  p[0] = 'x';  // Still valid.
+
+  // A request larger than the next block size gets a block of its own.
+  arena.Allocate(10000, 8);
+  EXPECT_GE(arena.bytes_reserved(), 100 + 10000);
+  arena.Release();
+  EXPECT_EQ(0, arena.bytes_reserved());
+}
+
+TEST(S2MonotonicBufferResource, ManySmallAllocations) {
+  S2MonotonicBufferResource arena;
+  vector<int*> ptrs;
+  for (int i = 0; i < 10000; ++i) {
+    int* p = static_cast<int*>(arena.Allocate(sizeof(int), alignof(int)));
+    *p = i;
+    ptrs.push_back(p);
+  }
+  for (int i = 0; i < 10000; ++i) EXPECT_EQ(i, *ptrs[i]);
+  // Blocks double in size, so very little space is wasted.
+  EXPECT_LT(arena.bytes_reserved(), 4 * 10000 * sizeof(int));
+}
+
+TEST(S2ResourceArray, HeapAndResource) {
+  S2ResourceArray<int> heap(10, nullptr);
+  heap[9] = 5;
+  EXPECT_EQ(5, heap.get()[9]);
+
+  CountingResource resource;
+  {
+    S2ResourceArray<int> a(10, &resource);
+    EXPECT_EQ(1, resource.num_allocations());
+    EXPECT_EQ(10 * sizeof(int), resource.bytes());
+    S2ResourceArray<int> b(std::move(a));
+    EXPECT_FALSE(a);
+    EXPECT_TRUE(b);
+    a = S2ResourceArray<int>(5, &resource);
+    EXPECT_EQ(2, resource.num_allocations());
+    b = std::move(a);
+    EXPECT_EQ(1, resource.num_allocations());
+    b.reset();
+    EXPECT_EQ(0, resource.num_allocations());
+  }
+  EXPECT_EQ(0, resource.bytes());
+}
+
+TEST(S2MemoryResource, S2Loop) {
+  CountingResource resource;
+  auto expected = s2textformat::MakeLoopOrDie("0:0, 0:1, 1:1, 1:0");
+  vector<S2Point> vertices(&expected->vertex(0), &expected->vertex(0) + 4);
+  {
+    S2Loop loop(vertices, &resource);
+    EXPECT_EQ(&resource, loop.memory_resource());
+    EXPECT_EQ(1, resource.num_allocations());
+    EXPECT_TRUE(loop.Equals(*expected));
+
+    // Copies and moves keep the resource.
+    unique_ptr<S2Loop> copy(loop.Clone());
+    EXPECT_EQ(&resource, copy->memory_resource());
+    EXPECT_EQ(2, resource.num_allocations());
+    S2Loop moved(std::move(*copy));
+    EXPECT_EQ(&resource, moved.memory_resource());
+    EXPECT_EQ(2, resource.num_allocations());
+
+    // Decoding reuses the resource for the new vertices.
+    Encoder encoder;
+    expected->Encode(&encoder);
+    Decoder decoder(encoder.base(), encoder.length());
+    S2Loop decoded(&resource);
+    ASSERT_TRUE(decoded.Decode(&decoder));
+    EXPECT_TRUE(decoded.Equals(*expected));
+    EXPECT_EQ(3, resource.num_allocations());
+  }
+  EXPECT_EQ(0, resource.num_allocations());
+}
+
+TEST(S2MemoryResource, S2PolygonDecode) {
+  auto expected = s2textformat::MakePolygonOrDie(
+      "0:0, 0:10, 10:10, 10:0; 1:1, 2:2, 2:1");
+  for (int level : {-1, S2CellId::kMaxLevel}) {
+    Encoder encoder;
+    if (level < 0) {
+      expected->EncodeUncompressed(&encoder);
+    } else {
+      // Snap the vertices so that the compressed encoding is used.
+      S2Polygon snapped;
+      snapped.InitToSnapped(*expected);
+      snapped.Encode(&encoder);
+    }
+    CountingResource resource;
+    {
+      S2Polygon polygon(&resource);
+      Decoder decoder(encoder.base(), encoder.length());
+      ASSERT_TRUE(polygon.Decode(&decoder));
+      EXPECT_EQ(2, polygon.num_loops());
+      EXPECT_EQ(2, resource.num_allocations());
+      for (int i = 0; i < polygon.num_loops(); ++i) {
+        EXPECT_EQ(&resource, polygon.loop(i)->memory_resource());
+      }
+      S2Polygon moved(std::move(polygon));
+      EXPECT_EQ(&resource, moved.memory_resource());
+    }
+    EXPECT_EQ(0, resource.num_allocations());
+  }
+}
+
+TEST(S2MemoryResource, S2PolygonBooleanOperation) {
+  auto a = s2textformat::MakePolygonOrDie("0:0, 0:3, 3:3, 3:0");
+  auto b = s2textformat::MakePolygonOrDie("1:1, 1:4, 4:4, 4:1");
+  S2MonotonicBufferResource arena;
+  {
+    S2Polygon result(&arena);
+    result.InitToUnion(*a, *b);
+    EXPECT_EQ(1, result.num_loops());
+    EXPECT_EQ(&arena, result.loop(0)->memory_resource());
+    EXPECT_GT(arena.bytes_reserved(), 0);
+
+    S2Polygon expected;
+    expected.InitToUnion(*a, *b);
+    EXPECT_TRUE(result.Equals(expected));
+  }
+  arena.Release();
+}
+
+TEST(S2MemoryResource, S2LaxPolygonShape) {
+  CountingResource resource;
+  auto polygon = s2textformat::MakePolygonOrDie(
+      "0:0, 0:10, 10:10, 10:0; 1:1, 2:2, 2:1");
+  {
+    S2LaxPolygonShape shape(&resource);
+    shape.Init(*polygon);
+    EXPECT_EQ(7, shape.num_vertices());
+    // The vertices and the loop start offsets.
+    EXPECT_EQ(2, resource.num_allocations());
+    EXPECT_EQ(polygon->loop(0)->vertex(2), shape.loop_vertex(0, 2));
+
+    Encoder encoder;
+    shape.Encode(&encoder, s2coding::CodingHint::FAST);
+    Decoder decoder(encoder.base(), encoder.length());
+    S2LaxPolygonShape decoded(&resource);
+    ASSERT_TRUE(decoded.Init(&decoder));
+    EXPECT_EQ(4, resource.num_allocations());
+    EXPECT_EQ(shape.loop_vertex(1, 2), decoded.loop_vertex(1, 2));
+
+    S2LaxPolygonShape moved(std::move(decoded));
+    EXPECT_EQ(&resource, moved.memory_resource());
+    EXPECT_EQ(4, resource.num_allocations());
+  }
+  EXPECT_EQ(0, resource.num_allocations());
+}
+
+TEST(S2MemoryResource, S2LaxPolylineShape) {
+  CountingResource resource;
+  auto polyline = s2textformat::MakePolylineOrDie("0:0, 0:1, 1:1");
+  {
+    S2LaxPolylineShape shape(&resource);
+    shape.Init(*polyline);
+    EXPECT_EQ(1, resource.num_allocations());
+    EXPECT_EQ(3 * sizeof(S2Point), resource.bytes());
+    EXPECT_EQ(polyline->vertex(2), shape.vertex(2));
+
+    // Reinitializing frees the old vertices.
+    shape.Init(vector<S2Point>{polyline->vertex(0), polyline->vertex(1)});
+    EXPECT_EQ(1, resource.num_allocations());
+    EXPECT_EQ(2, shape.num_vertices());
+  }
+  EXPECT_EQ(0, resource.num_allocations());
+}
+
+}  // namespace
@@ -17,6 +17,9 @@
 
 #include "s2/s2memory_tracker.h"
 
+#include <algorithm>
+#include <utility>
+
 void S2MemoryTracker::SetError(S2Error error) {
   error_ = std::move(error);
 }
@@ -28,6 +31,112 @@ void S2MemoryTracker::SetLimitExceededError() {
               usage_bytes_, limit_bytes_);
 }
 
+S2MemoryTracker::~S2MemoryTracker() {
+  if (budget_reserved_bytes_ > 0) budget_->Release(budget_reserved_bytes_);
+}
+
+S2MemoryTracker::S2MemoryTracker(const S2MemoryTracker& other) {
+  *this = other;
+}
+
+S2MemoryTracker& S2MemoryTracker::operator=(const S2MemoryTracker& other) {
+  if (this != &other) {
+    CopyFrom(other);
+    if (budget_ != nullptr) UpdateBudgetReservation();
+  }
+  return *this;
+}
+
+S2MemoryTracker::S2MemoryTracker(S2MemoryTracker&& other) {
+  *this = std::move(other);
+}
+
+S2MemoryTracker& S2MemoryTracker::operator=(S2MemoryTracker&& other) {
+  if (this != &other) {
+    CopyFrom(other);
+    std::swap(budget_reserved_bytes_, other.budget_reserved_bytes_);
+  }
+  return *this;
+}
+
+void S2MemoryTracker::CopyFrom(const S2MemoryTracker& other) {
+  if (budget_reserved_bytes_ > 0) budget_->Release(budget_reserved_bytes_);
+  usage_bytes_ = other.usage_bytes_;
+  max_usage_bytes_ = other.max_usage_bytes_;
+  limit_bytes_ = other.limit_bytes_;
+  alloc_bytes_ = other.alloc_bytes_;
+  error_ = other.error_;
+  callback_ = other.callback_;
+  callback_alloc_delta_bytes_ = other.callback_alloc_delta_bytes_;
+  callback_alloc_limit_bytes_ = other.callback_alloc_limit_bytes_;
+  budget_ = other.budget_;
+  budget_batch_bytes_ = other.budget_batch_bytes_;
+  budget_reserved_bytes_ = 0;
+}
+
+void S2MemoryTracker::set_budget(S2MemoryBudget* budget, int64 batch_bytes) {
+  S2_DCHECK_EQ(usage_bytes_, 0);
+  S2_DCHECK_GT(batch_bytes, 0);
+  if (budget_reserved_bytes_ > 0) budget_->Release(budget_reserved_bytes_);
+  budget_ = budget;
+  budget_batch_bytes_ = batch_bytes;
+  budget_reserved_bytes_ = 0;
+}
+
+// Not inline in order to avoid code bloat.
+void S2MemoryTracker::UpdateBudgetReservation() {
+  // Reserve enough whole batches to cover the current usage.
+  int64 usage = std::max(int64{0}, usage_bytes_);
+  int64 target = (usage + budget_batch_bytes_ - 1) / budget_batch_bytes_ *
+                 budget_batch_bytes_;
+  if (target < budget_reserved_bytes_) {
+    budget_->Release(budget_reserved_bytes_ - target);
+    budget_reserved_bytes_ = target;
+  } else if (target > budget_reserved_bytes_ && ok()) {
+    // Once an error has occurred we stop reserving memory, since the current
+    // operation is being cancelled anyway.
+    if (budget_->Reserve(target - budget_reserved_bytes_)) {
+      budget_reserved_bytes_ = target;
+    } else {
+      error_.Init(S2Error::RESOURCE_EXHAUSTED,
+                  "Memory budget exceeded (tracked usage %d bytes, "
+                  "budget usage %d bytes, budget limit %d bytes)",
+                  usage_bytes_, budget_->usage_bytes(),
+                  budget_->limit_bytes());
+    }
+  }
+}
+
+S2MemoryBudget::~S2MemoryBudget() {
+  S2_DCHECK_EQ(usage_bytes(), 0);
+}
+
+bool S2MemoryBudget::Reserve(int64 bytes) {
+  S2_DCHECK_GE(bytes, 0);
+  int64 old_usage = usage_bytes_.load(std::memory_order_relaxed);
+  int64 new_usage;
+  do {
+    new_usage = old_usage + bytes;
+    if (new_usage > limit_bytes_) return false;
+  } while (!usage_bytes_.compare_exchange_weak(old_usage, new_usage,
+                                               std::memory_order_relaxed));
+  if (parent_ != nullptr && !parent_->Reserve(bytes)) {
+    usage_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    return false;
+  }
+  int64 max_usage = max_usage_bytes_.load(std::memory_order_relaxed);
+  while (max_usage < new_usage &&
+         !max_usage_bytes_.compare_exchange_weak(max_usage, new_usage,
+                                                 std::memory_order_relaxed)) {
+  }
+  return true;
+}
+
+void S2MemoryBudget::Release(int64 bytes) {
+  usage_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+  if (parent_ != nullptr) parent_->Release(bytes);
+}
+
 bool S2MemoryTracker::Client::TallyTemp(int64 delta_bytes) {
   Tally(delta_bytes);
   return Tally(-delta_bytes);
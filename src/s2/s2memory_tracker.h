@@ -18,9 +18,13 @@
 #ifndef S2_S2MEMORY_TRACKER_H_
 #define S2_S2MEMORY_TRACKER_H_
 
+#include <atomic>
+
 #include "s2/s2error.h"
 #include "s2/util/gtl/compact_array.h"
 
+class S2MemoryBudget;
+
 // S2MemoryTracker is a helper class for tracking and limiting the memory
 // usage of S2 operations.  It provides the following functionality:
 //
@@ -68,7 +72,10 @@
 // has control over what type of error is generated.
 //
 // This class is not thread-safe and therefore all objects associated with a
-// single S2MemoryTracker should be accessed using a single thread.
+// single S2MemoryTracker should be accessed using a single thread.  To share
+// a memory limit among operations running on several threads, give each
+// operation its own S2MemoryTracker and attach them all to the same
+// S2MemoryBudget (see set_budget() below).
 //
 // Implementation Notes
 // --------------------
@@ -92,6 +99,18 @@ class S2MemoryTracker {
  public:
   S2MemoryTracker() = default;
 
+  // Returns any memory reserved from budget() to the budget.
+  ~S2MemoryTracker();
+
+  // Trackers are copyable and movable.  If the tracker is attached to a
+  // budget (see set_budget), a copy reserves memory for its own usage from
+  // the same budget, while a move transfers the reservation (so that the
+  // moved-from tracker reserves memory again the next time its usage grows).
+  S2MemoryTracker(const S2MemoryTracker& other);
+  S2MemoryTracker& operator=(const S2MemoryTracker& other);
+  S2MemoryTracker(S2MemoryTracker&& other);
+  S2MemoryTracker& operator=(S2MemoryTracker&& other);
+
   // The current tracked memory usage.
   //
   // CAVEAT: When an operation is cancelled (e.g. due to a memory limit being
@@ -119,6 +138,25 @@ class S2MemoryTracker {
   // Indicates that memory usage is unlimited.
   static constexpr int64 kNoLimit = std::numeric_limits<int64>::max();
 
+  // Attaches this tracker to a thread-safe S2MemoryBudget that may be shared
+  // with trackers used by other threads.  In addition to limit_bytes(), the
+  // tracked memory usage is then bounded by the budget: the tracker reserves
+  // memory from the budget in multiples of "batch_bytes" (so that the shared
+  // counters are updated only occasionally rather than on every Tally), and
+  // an error of type S2Error::RESOURCE_EXHAUSTED is generated if a
+  // reservation would exceed the limit of the budget or one of its
+  // ancestors.  Reserved memory is returned when usage falls by more than
+  // two batches, and when Reset() is called or the tracker is destroyed.
+  //
+  // The budget must outlive this tracker.
+  // REQUIRES: usage_bytes() == 0 and batch_bytes > 0.
+  void set_budget(S2MemoryBudget* budget,
+                  int64 batch_bytes = kDefaultBudgetBatchBytes);
+  S2MemoryBudget* budget() const { return budget_; }
+
+  // The default granularity of reservations from an S2MemoryBudget.
+  static constexpr int64 kDefaultBudgetBatchBytes = 1 << 20;
+
   // Returns the tracker's current error status.  Whenever an error exists
   // the current S2 operation will be cancelled.
   const S2Error& error() const { return error_; }
@@ -171,6 +209,7 @@ class S2MemoryTracker {
     error_.Clear();
     usage_bytes_ = max_usage_bytes_ = alloc_bytes_ = 0;
     callback_alloc_limit_bytes_ = callback_alloc_delta_bytes_;
+    if (budget_reserved_bytes_ > 0) UpdateBudgetReservation();
   }
 
   //////////////////////////////////////////////////////////////////////
@@ -332,6 +371,14 @@ class S2MemoryTracker {
   bool Tally(int64 delta_bytes);
   void SetLimitExceededError();
 
+  // Reserves memory from (or returns memory to) budget_ so that the
+  // reservation covers usage_bytes_.
+  void UpdateBudgetReservation();
+
+  // Returns any memory reserved from budget_ and then copies all the fields
+  // of "other" except for its reservation.
+  void CopyFrom(const S2MemoryTracker& other);
+
   int64 usage_bytes_ = 0;
   int64 max_usage_bytes_ = 0;
   int64 limit_bytes_ = kNoLimit;
@@ -340,6 +387,72 @@ class S2MemoryTracker {
   PeriodicCallback callback_;
   int64 callback_alloc_delta_bytes_ = 0;
   int64 callback_alloc_limit_bytes_ = kNoLimit;
+  S2MemoryBudget* budget_ = nullptr;
+  int64 budget_batch_bytes_ = kDefaultBudgetBatchBytes;
+  int64 budget_reserved_bytes_ = 0;
+};
+
+// S2MemoryBudget is a thread-safe memory limit that can be shared by several
+// S2MemoryTrackers, typically one per thread or per concurrent operation.
+// Each tracker accounts for its own memory locally and reserves memory from
+// the budget in batches (see S2MemoryTracker::set_budget), so the budget's
+// atomic counters are rarely contended.
+//
+// Budgets can be nested: every reservation from a budget is also made from
+// its parent (and so on up the hierarchy), and fails if any of them would
+// exceed its limit.  For example, a per-request budget can be a child of a
+// process-wide budget:
+//
+//   S2MemoryBudget process_budget(8LL << 30);  // 8 GB for all requests.
+//   ...
+//   // In each request handler:
+//   S2MemoryBudget request_budget(500 << 20, &process_budget);
+//   S2MemoryTracker tracker;   // One per thread used by the request.
+//   tracker.set_budget(&request_budget);
+//   S2Builder::Options options;
+//   options.set_memory_tracker(&tracker);
+//
+// This class is thread-safe.
+class S2MemoryBudget {
+ public:
+  // Constructs a budget with the given limit whose reservations are also
+  // made from "parent" (if non-null), which must outlive this budget.
+  explicit S2MemoryBudget(int64 limit_bytes = S2MemoryTracker::kNoLimit,
+                          S2MemoryBudget* parent = nullptr)
+      : limit_bytes_(limit_bytes), parent_(parent) {}
+
+  // REQUIRES: All reservations have been released.
+  ~S2MemoryBudget();
+
+  S2MemoryBudget(const S2MemoryBudget&) = delete;
+  S2MemoryBudget& operator=(const S2MemoryBudget&) = delete;
+
+  int64 limit_bytes() const { return limit_bytes_; }
+  S2MemoryBudget* parent() const { return parent_; }
+
+  // The memory currently reserved from this budget by trackers and child
+  // budgets, and the maximum value it has attained.
+  int64 usage_bytes() const {
+    return usage_bytes_.load(std::memory_order_relaxed);
+  }
+  int64 max_usage_bytes() const {
+    return max_usage_bytes_.load(std::memory_order_relaxed);
+  }
+
+  // Reserves "bytes" from this budget and all of its ancestors.  Returns
+  // false (and reserves nothing) if any of their limits would be exceeded.
+  //
+  // REQUIRES: bytes >= 0
+  bool Reserve(int64 bytes);
+
+  // Returns "bytes" previously reserved using Reserve().
+  void Release(int64 bytes);
+
+ private:
+  const int64 limit_bytes_;
+  S2MemoryBudget* const parent_;
+  std::atomic<int64> usage_bytes_{0};
+  std::atomic<int64> max_usage_bytes_{0};
 };
 
 
@@ -357,6 +470,11 @@ inline bool S2MemoryTracker::Tally(int64 delta_bytes) {
   alloc_bytes_ += std::max(int64{0}, delta_bytes);
   max_usage_bytes_ = std::max(max_usage_bytes_, usage_bytes_);
   if (usage_bytes_ > limit_bytes_ && ok()) SetLimitExceededError();
+  if (budget_ != nullptr &&
+      (usage_bytes_ > budget_reserved_bytes_ ||
+       usage_bytes_ < budget_reserved_bytes_ - 2 * budget_batch_bytes_)) {
+    UpdateBudgetReservation();
+  }
   if (callback_ && alloc_bytes_ >= callback_alloc_limit_bytes_) {
     callback_alloc_limit_bytes_ = alloc_bytes_ + callback_alloc_delta_bytes_;
     if (ok()) callback_();
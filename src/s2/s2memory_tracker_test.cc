@@ -17,6 +17,11 @@
 
 #include "s2/s2memory_tracker.h"
 
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 TEST(S2MemoryTracker, PeriodicCallback) {
@@ -46,3 +51,110 @@ TEST(S2MemoryTracker, PeriodicCallback) {
   client.Tally(1);
   EXPECT_EQ(callback_count, 4);
 }
+
+TEST(S2MemoryTracker, BudgetReservesInBatches) {
+  S2MemoryBudget budget(1000);
+  {
+    S2MemoryTracker tracker;
+    tracker.set_budget(&budget, 100);
+    S2MemoryTracker::Client client(&tracker);
+    EXPECT_TRUE(client.Tally(1));
+    EXPECT_EQ(100, budget.usage_bytes());
+    EXPECT_TRUE(client.Tally(99));
+    EXPECT_EQ(100, budget.usage_bytes());
+    EXPECT_TRUE(client.Tally(250));
+    EXPECT_EQ(400, budget.usage_bytes());
+
+    // Memory is returned only once usage falls by more than two batches.
+    EXPECT_TRUE(client.Tally(-150));
+    EXPECT_EQ(400, budget.usage_bytes());
+    EXPECT_TRUE(client.Tally(-150));
+    EXPECT_EQ(100, budget.usage_bytes());
+    EXPECT_EQ(400, budget.max_usage_bytes());
+
+    // Exceeding the budget is an error, even though the tracker has no limit.
+    EXPECT_FALSE(client.Tally(1000));
+    EXPECT_EQ(S2Error::RESOURCE_EXHAUSTED, tracker.error().code());
+    EXPECT_EQ(100, budget.usage_bytes());
+  }
+  // Destroying the tracker returns its reservation.
+  EXPECT_EQ(0, budget.usage_bytes());
+}
+
+TEST(S2MemoryTracker, CopyAndMoveWithBudget) {
+  S2MemoryBudget budget(1000);
+  S2MemoryTracker tracker;
+  tracker.set_budget(&budget, 100);
+  S2MemoryTracker::Client client(&tracker);
+  EXPECT_TRUE(client.Tally(150));
+  EXPECT_EQ(200, budget.usage_bytes());
+  {
+    // A copy reserves memory for its own usage.
+    S2MemoryTracker copy(tracker);
+    EXPECT_EQ(150, copy.usage_bytes());
+    EXPECT_EQ(&budget, copy.budget());
+    EXPECT_EQ(400, budget.usage_bytes());
+
+    // A move transfers the reservation.
+    S2MemoryTracker moved(std::move(copy));
+    EXPECT_EQ(150, moved.usage_bytes());
+    EXPECT_EQ(400, budget.usage_bytes());
+    copy = moved;
+    EXPECT_EQ(600, budget.usage_bytes());
+  }
+  EXPECT_EQ(200, budget.usage_bytes());
+  S2MemoryTracker assigned;
+  assigned = std::move(tracker);
+  EXPECT_EQ(200, budget.usage_bytes());
+  assigned.Reset();
+  EXPECT_EQ(0, budget.usage_bytes());
+}
+
+TEST(S2MemoryTracker, NestedBudgets) {
+  S2MemoryBudget process_budget(500);
+  S2MemoryBudget request_budget1(400, &process_budget);
+  S2MemoryBudget request_budget2(400, &process_budget);
+  S2MemoryTracker tracker1, tracker2;
+  tracker1.set_budget(&request_budget1, 100);
+  tracker2.set_budget(&request_budget2, 100);
+  S2MemoryTracker::Client client1(&tracker1), client2(&tracker2);
+  EXPECT_TRUE(client1.Tally(300));
+  EXPECT_EQ(300, process_budget.usage_bytes());
+  EXPECT_FALSE(client1.Tally(200));  // Exceeds request_budget1.
+  EXPECT_EQ(300, process_budget.usage_bytes());
+  EXPECT_FALSE(client2.Tally(300));  // Exceeds process_budget.
+  EXPECT_EQ(0, request_budget2.usage_bytes());
+  EXPECT_EQ(300, process_budget.usage_bytes());
+
+  // Reset() returns the reservation and clears the error.
+  tracker1.Reset();
+  EXPECT_EQ(0, process_budget.usage_bytes());
+  tracker2.Reset();
+  S2MemoryTracker::Client client3(&tracker2);
+  EXPECT_TRUE(client3.Tally(350));
+  EXPECT_EQ(400, process_budget.usage_bytes());
+}
+
+TEST(S2MemoryTracker, BudgetSharedByThreads) {
+  S2MemoryBudget budget(1 << 20);
+  std::atomic<int> num_failures(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() {
+      S2MemoryTracker tracker;
+      tracker.set_budget(&budget, 1000);
+      S2MemoryTracker::Client client(&tracker);
+      for (int i = 0; i < 2000; ++i) {
+        if (!client.Tally(1000)) {
+          ++num_failures;
+          tracker.Reset();
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  // Each thread tries to use 2 MB, which exceeds the budget.
+  EXPECT_GT(num_failures, 0);
+  EXPECT_LE(budget.max_usage_bytes(), budget.limit_bytes());
+  EXPECT_EQ(0, budget.usage_bytes());
+}
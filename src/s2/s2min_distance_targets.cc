@@ -17,6 +17,9 @@
 
 #include "s2/s2min_distance_targets.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <memory>
 
 #include "absl/memory/memory.h"
@@ -49,6 +52,71 @@ bool S2MinDistancePointTarget::UpdateMinDistance(
   return min_dist->UpdateMin(S2MinDistance(cell.GetDistance(point_)));
 }
 
+void S2MinDistancePointTarget::FilterEdges(
+    absl::Span<const S2Shape::Edge> edges, S2MinDistance limit,
+    bool* keep) const {
+  // This performs the same initial tests as S2::UpdateMinDistance(), using
+  // only squared chord lengths: an edge is discarded if neither endpoint is
+  // closer than "limit" and the planar triangle test shows that the closest
+  // point cannot lie in the edge interior.  Since the calculations are
+  // identical, every discarded edge would also have been rejected by
+  // UpdateMinDistance().  Edges that pass (a small fraction of the total)
+  // are then tested exactly.
+  //
+  // Unlike UpdateMinDistance(), the loop body has no branches and no calls,
+  // which allows the compiler to vectorize it.
+  const double limit2 = limit.length2();
+  const S2Point& x = point_;
+  for (int i = 0; i < edges.size(); ++i) {
+    const S2Point& a = edges[i].v0;
+    const S2Point& b = edges[i].v1;
+    double xa2 = (x - a).Norm2(), xb2 = (x - b).Norm2();
+    double ab2 = (a - b).Norm2();
+    double max_error = (4.75 * DBL_EPSILON * (xa2 + xb2 + ab2) +
+                        8 * DBL_EPSILON * DBL_EPSILON);
+    bool far = ((std::fabs(xa2 - xb2) >= ab2 + max_error) &
+                (std::min(xa2, xb2) >= limit2));
+    keep[i] &= !far;
+  }
+}
+
+constexpr double S2MinDistancePointTarget::kFloatEdgeMaxError;
+
+void S2MinDistancePointTarget::GetFloatEdgeDistances(
+    const float* coords, int stride, int num_edges,
+    S2MinDistance* distances) const {
+  // This is a branch-free version of S2::UpdateMinDistance() that reads the
+  // edge vertices from separate coordinate arrays, so that the loop can be
+  // vectorized.  The distance to the edge interior is used when the closest
+  // point on the edge's great circle lies strictly between the endpoints,
+  // and otherwise the distance to the closer endpoint.
+  const S2Point& x = point_;
+  const float* ax = coords;
+  const float* ay = coords + stride;
+  const float* az = coords + 2 * stride;
+  const float* bx = coords + 3 * stride;
+  const float* by = coords + 4 * stride;
+  const float* bz = coords + 5 * stride;
+  for (int i = 0; i < num_edges; ++i) {
+    S2Point a(ax[i], ay[i], az[i]), b(bx[i], by[i], bz[i]);
+    double xa2 = (x - a).Norm2(), xb2 = (x - b).Norm2();
+    double ab2 = (a - b).Norm2();
+    Vector3_d c = a.CrossProd(b);
+    double c2 = std::max(c.Norm2(), DBL_MIN);
+    // x.DotProd(c) is computed relative to "x", which keeps it accurate when
+    // "x" is close to the edge.
+    double x_dot_c = (a - x).CrossProd(b - x).DotProd(x);
+    Vector3_d cx = c.CrossProd(x);
+    bool interior = ((std::fabs(xa2 - xb2) < ab2) &
+                     (a.DotProd(cx) < 0) & (b.DotProd(cx) > 0));
+    double s2 = std::min(x_dot_c * x_dot_c / c2, 1.0);
+    double qr = s2 / (1 + std::sqrt(1 - s2));
+    double dist2 = interior ? s2 + qr * qr : std::min(xa2, xb2);
+    distances[i] = S2MinDistance(
+        S1ChordAngle::FromLength2(std::min(dist2, 4.0)));
+  }
+}
+
 bool S2MinDistancePointTarget::VisitContainingShapes(
     const S2ShapeIndex& index, const ShapeVisitor& visitor) {
   return MakeS2ContainsPointQuery(&index).VisitContainingShapes(
@@ -228,8 +296,19 @@ bool S2MinDistanceShapeIndexTarget::set_max_error(
   return true;  // Indicates that we may return suboptimal results.
 }
 
+void S2MinDistanceShapeIndexTarget::ReInit() {
+  query_->ReInit();
+  has_cap_bound_ = false;
+  has_containment_points_ = false;
+  containment_points_.clear();
+}
+
 S2Cap S2MinDistanceShapeIndexTarget::GetCapBound() {
-  return MakeS2ShapeIndexRegion(index_).GetCapBound();
+  if (!has_cap_bound_) {
+    cap_bound_ = MakeS2ShapeIndexRegion(index_).GetCapBound();
+    has_cap_bound_ = true;
+  }
+  return cap_bound_;
 }
 
 inline bool S2MinDistanceShapeIndexTarget::UpdateMinDistance(
@@ -267,7 +346,17 @@ bool S2MinDistanceShapeIndexTarget::VisitContainingShapes(
   //
   // TODO(ericv): Do this by merge-joining the two S2ShapeIndexes, and share
   // the code with S2BooleanOperation.
+  if (!has_containment_points_) InitContainmentPoints();
+  for (const S2Point& p : containment_points_) {
+    S2MinDistancePointTarget target(p);
+    if (!target.VisitContainingShapes(query_index, visitor)) {
+      return false;
+    }
+  }
+  return true;
+}
 
+void S2MinDistanceShapeIndexTarget::InitContainmentPoints() {
   for (S2Shape* shape : *index_) {
     if (shape == nullptr) continue;
     int num_chains = shape->num_chains();
@@ -277,21 +366,13 @@ bool S2MinDistanceShapeIndexTarget::VisitContainingShapes(
       S2Shape::Chain chain = shape->chain(c);
       if (chain.length == 0) continue;
       tested_point = true;
-      S2Point v0 = shape->chain_edge(c, 0).v0;
-      S2MinDistancePointTarget target(v0);
-      if (!target.VisitContainingShapes(query_index, visitor)) {
-        return false;
-      }
+      containment_points_.push_back(shape->chain_edge(c, 0).v0);
     }
     if (!tested_point) {
       // Special case to handle full polygons.
       S2Shape::ReferencePoint ref = shape->GetReferencePoint();
-      if (!ref.contained) continue;
-      S2MinDistancePointTarget target(ref.point);
-      if (!target.VisitContainingShapes(query_index, visitor)) {
-        return false;
-      }
+      if (ref.contained) containment_points_.push_back(ref.point);
     }
   }
-  return true;
+  has_containment_points_ = true;
 }
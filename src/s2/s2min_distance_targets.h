@@ -24,10 +24,12 @@
 #define S2_S2MIN_DISTANCE_TARGETS_H_
 
 #include <memory>
+#include <vector>
 
 #include "s2/_fp_contract_off.h"
 #include "s2/s1angle.h"
 #include "s2/s1chord_angle.h"
+#include "s2/s2cap.h"
 #include "s2/s2cell.h"
 #include "s2/s2cell_index.h"
 #include "s2/s2distance_target.h"
@@ -79,6 +81,19 @@ class S2MinDistancePointTarget : public S2MinDistanceTarget {
                          S2MinDistance* min_dist) final;
   bool UpdateMinDistance(const S2Cell& cell,
                          S2MinDistance* min_dist) final;
+  bool can_filter_edges() const final { return true; }
+  void FilterEdges(absl::Span<const S2Shape::Edge> edges, S2MinDistance limit,
+                   bool* keep) const final;
+
+  // The distances computed by GetFloatEdgeDistances() are within this
+  // chord length (see S1ChordAngle) of the exact distances.  The error is
+  // dominated by rounding the edge vertices to single precision; the
+  // arithmetic itself is done in double precision.
+  static constexpr double kFloatEdgeMaxError = 4e-7;
+
+  bool can_use_float_edges() const final { return true; }
+  void GetFloatEdgeDistances(const float* coords, int stride, int num_edges,
+                             S2MinDistance* distances) const final;
   bool VisitContainingShapes(const S2ShapeIndex& index,
                              const ShapeVisitor& visitor) final;
 
@@ -190,6 +205,13 @@ class S2MinDistanceCellUnionTarget : public S2MinDistanceTarget {
 //         ... do something with "target_point" ...
 //         return false;  // Terminate search
 //       }));
+//
+// The target caches its cap bound, the points used by
+// VisitContainingShapes(), and the S2ClosestEdgeQuery used to measure
+// distances to its edges (including that query's covering of the target
+// index).  It is therefore much cheaper to reuse one target for many queries
+// (even against different query indexes) than to construct a new target for
+// each query.  ReInit() must be called if the target index is modified.
 class S2MinDistanceShapeIndexTarget : public S2MinDistanceTarget {
  public:
   explicit S2MinDistanceShapeIndexTarget(const S2ShapeIndex* index);
@@ -209,6 +231,10 @@ class S2MinDistanceShapeIndexTarget : public S2MinDistanceTarget {
   bool use_brute_force() const;
   void set_use_brute_force(bool use_brute_force);
 
+  // Discards all cached information about the target index.  This method
+  // must be called whenever the target index is modified.
+  void ReInit();
+
   // Note that set_max_error() should not be called directly by clients; it is
   // used internally by the S2Closest*Query implementations.
   bool set_max_error(const S1ChordAngle& max_error) override;
@@ -224,9 +250,18 @@ class S2MinDistanceShapeIndexTarget : public S2MinDistanceTarget {
 
  private:
   bool UpdateMinDistance(S2MinDistanceTarget* target, S2MinDistance* min_dist);
+  void InitContainmentPoints();
 
   const S2ShapeIndex* index_;
   std::unique_ptr<S2ClosestEdgeQuery> query_;
+
+  // Cached values of GetCapBound() and of the points tested by
+  // VisitContainingShapes() (one vertex per connected component of edges,
+  // plus the reference point of each full polygon).
+  bool has_cap_bound_ = false;
+  S2Cap cap_bound_;
+  bool has_containment_points_ = false;
+  std::vector<S2Point> containment_points_;
 };
 
 
@@ -27,6 +27,7 @@
 #include "s2/s2cell.h"
 #include "s2/s2edge_distances.h"
 #include "s2/s2shape_index.h"
+#include "s2/s2testing.h"
 #include "s2/s2text_format.h"
 
 using s2textformat::MakeIndexOrDie;
@@ -54,6 +55,39 @@ TEST(PointTarget, UpdateMinDistanceToCellWhenEqual) {
   EXPECT_FALSE(target.UpdateMinDistance(cell, &dist));
 }
 
+TEST(PointTarget, FilterEdgesIsConservative) {
+  // Every edge that UpdateMinDistance() would accept must be kept, including
+  // edges whose distance is very close to the limit.
+  S2Testing::rnd.Reset(1);
+  int num_filtered = 0;
+  for (int iter = 0; iter < 100; ++iter) {
+    S2Point x = S2Testing::RandomPoint();
+    S2MinDistancePointTarget target(x);
+    ASSERT_TRUE(target.can_filter_edges());
+    S2Cap cap(x, S1Angle::Degrees(S2Testing::rnd.RandDouble() * 90));
+    vector<S2Shape::Edge> edges;
+    for (int i = 0; i < 100; ++i) {
+      S2Point a = S2Testing::SamplePoint(cap);
+      S2Point b = S2Testing::rnd.OneIn(2) ? a : S2Testing::SamplePoint(cap);
+      edges.push_back(S2Shape::Edge(a, b));
+    }
+    // Use the exact distance to one of the edges as the limit.
+    S2MinDistance limit = S2MinDistance::Infinity();
+    target.UpdateMinDistance(edges[0].v0, edges[0].v1, &limit);
+    bool keep[100];
+    std::fill(keep, keep + 100, true);
+    target.FilterEdges(edges, limit, keep);
+    for (int i = 0; i < edges.size(); ++i) {
+      S2MinDistance dist = limit;
+      if (target.UpdateMinDistance(edges[i].v0, edges[i].v1, &dist)) {
+        EXPECT_TRUE(keep[i]);
+      }
+      num_filtered += !keep[i];
+    }
+  }
+  EXPECT_GT(num_filtered, 0);
+}
+
 TEST(EdgeTarget, UpdateMinDistanceToEdgeWhenEqual) {
   S2MinDistanceEdgeTarget target(MakePointOrDie("1:0"), MakePointOrDie("1:1"));
   S2MinDistance dist(S1ChordAngle::Infinity());
@@ -237,3 +271,28 @@ TEST(ShapeIndexTarget, VisitContainingShapesEmptyAndFull) {
   S2MinDistanceShapeIndexTarget empty_target(empty_polygon_index.get());
   EXPECT_EQ((vector<int>{}), GetContainingShapes(&empty_target, *index, 5));
 }
+
+TEST(ShapeIndexTarget, ReusedAcrossIndexes) {
+  // A target caches information about its index, so that it can be used
+  // efficiently with many query indexes.
+  auto index1 = MakeIndexOrDie("# # 0:0, 0:3, 3:0");
+  auto index2 = MakeIndexOrDie("# # 10:10, 10:13, 13:10");
+  auto target_index = MakeIndexOrDie("1:1 # #");
+  S2MinDistanceShapeIndexTarget target(target_index.get());
+  S2Cap cap = target.GetCapBound();
+  EXPECT_TRUE(cap.Contains(MakePointOrDie("1:1")));
+  EXPECT_EQ((vector<int>{0}), GetContainingShapes(&target, *index1, 5));
+  EXPECT_EQ((vector<int>{}), GetContainingShapes(&target, *index2, 5));
+  EXPECT_EQ((vector<int>{0}), GetContainingShapes(&target, *index1, 5));
+
+  // ReInit() must be called after the target index is modified.
+  target_index->Add(s2textformat::MakeLaxPolylineOrDie("11:11, 11:12"));
+  EXPECT_FALSE(target.GetCapBound().Contains(MakePointOrDie("11:11")));
+  target.ReInit();
+  EXPECT_TRUE(target.GetCapBound().Contains(MakePointOrDie("11:11")));
+  EXPECT_EQ((vector<int>{0}), GetContainingShapes(&target, *index2, 5));
+  S2MinDistance dist(S1ChordAngle::Infinity());
+  S2Cell cell{S2CellId(MakePointOrDie("11:11"))};
+  EXPECT_TRUE(target.UpdateMinDistance(cell, &dist));
+  EXPECT_EQ(S1ChordAngle::Zero(), dist);
+}
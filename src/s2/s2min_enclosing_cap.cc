@@ -0,0 +1,219 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2min_enclosing_cap.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <random>
+#include <vector>
+
+#include "s2/base/integral_types.h"
+#include "s2/s1chord_angle.h"
+#include "s2/s2pointutil.h"
+
+using std::max;
+using std::min;
+using std::vector;
+
+namespace S2 {
+
+namespace {
+
+// The number of points in the initial sample.  This is large enough that the
+// sample cap usually contains all the points after the first round, and small
+// enough that its cost is negligible for large inputs.
+constexpr int kInitialSampleSize = 4096;
+
+// The maximum number of points outside the current cap that are added to
+// the sample in each round.
+constexpr int kMaxPointsAdded = 4096;
+
+// Each round adds points that are not in the sample, so this limit is only
+// reached if numerical errors cause sample points to be added again.  The
+// result still contains all the points, since its radius is computed from
+// the final center.
+constexpr int kMaxRounds = 100;
+
+// Points that are within this distance (as a squared chord length) outside a
+// cap are considered to be contained during the incremental algorithm.  This
+// prevents numerical errors from causing points on the boundary to be added
+// repeatedly.  The final radius is computed exactly (see below).
+constexpr double kTolerance = 16 * DBL_EPSILON;
+
+bool ContainsApprox(const S2Cap& cap, const S2Point& p) {
+  return S1ChordAngle(cap.center(), p) <= cap.radius().PlusError(kTolerance);
+}
+
+// The incremental algorithm fails if the points do not fit in a hemisphere.
+// In that case "*ok" is set to false and an arbitrary cap is returned.
+S2Cap CapFromTwoPoints(const S2Point& a, const S2Point& b, bool* ok) {
+  S2Point center = a + b;
+  if (center.Norm2() == 0) {
+    *ok = false;
+    return S2Cap::FromPoint(a);
+  }
+  center = center.Normalize();
+  return S2Cap(center, max(S1ChordAngle(center, a), S1ChordAngle(center, b)));
+}
+
+// Returns the smallest cap whose boundary passes through "a", "b", and "c".
+// This is the circumcircle on the side of the plane through the three points
+// closer to them, which is smaller than a hemisphere.
+S2Cap CapFromThreePoints(const S2Point& a, const S2Point& b, const S2Point& c,
+                         bool* ok) {
+  S2Point center = (b - a).CrossProd(c - a);
+  if (center.Norm2() < 1e-30) {
+    // The points are (nearly) collinear in 3D space, i.e. nearly coincident
+    // or nearly on a great circle.  Use the smallest cap through two of them
+    // that contains the third.
+    S2Cap best = S2Cap::Full();
+    const S2Point* points[3] = {&a, &b, &c};
+    for (int i = 0; i < 3; ++i) {
+      S2Cap cap = CapFromTwoPoints(*points[i], *points[(i + 1) % 3], ok);
+      if (ContainsApprox(cap, *points[(i + 2) % 3]) &&
+          cap.radius() < best.radius()) {
+        best = cap;
+      }
+    }
+    if (best.is_full()) *ok = false;
+    return best;
+  }
+  center = center.Normalize();
+  if (center.DotProd(a) < 0) center = -center;
+  S1ChordAngle radius = max(S1ChordAngle(center, a),
+                            max(S1ChordAngle(center, b),
+                                S1ChordAngle(center, c)));
+  if (radius >= S1ChordAngle::Right()) *ok = false;
+  return S2Cap(center, radius);
+}
+
+// Returns the smallest cap containing "points" using Welzl's algorithm in its
+// iterative form.  The points should be in random order.
+//
+// When the points fit in a hemisphere the expected number of containment
+// tests is linear.  Otherwise the caps chosen above are not enclosing and
+// the algorithm can take cubic time, so it gives up (setting "*ok" to false)
+// once the number of tests is well above the expected number.
+S2Cap MinEnclosingCapOfSample(const vector<S2Point>& points, bool* ok) {
+  int64 budget = 100 * static_cast<int64>(points.size()) + 1000;
+  S2Cap cap = S2Cap::FromPoint(points[0]);
+  for (int i = 1; i < points.size(); ++i) {
+    if (ContainsApprox(cap, points[i])) continue;
+    // points[i] is on the boundary of the smallest cap containing points
+    // [0..i].
+    cap = S2Cap::FromPoint(points[i]);
+    for (int j = 0; j < i; ++j) {
+      if (ContainsApprox(cap, points[j])) continue;
+      // points[i] and points[j] are both on the boundary.
+      cap = CapFromTwoPoints(points[i], points[j], ok);
+      budget -= j;
+      for (int k = 0; k < j; ++k) {
+        if (ContainsApprox(cap, points[k])) continue;
+        cap = CapFromThreePoints(points[i], points[j], points[k], ok);
+      }
+      if (!*ok || budget < 0) {
+        *ok = false;
+        return cap;
+      }
+    }
+    budget -= i;
+  }
+  return cap;
+}
+
+// Returns a cap with the given center that contains all the points, using up
+// to "num_threads" threads.
+S2Cap CapWithCenter(absl::Span<const S2Point> points, const S2Point& center,
+                    int num_threads, S2Executor* executor) {
+  vector<S1ChordAngle> radii(num_threads, S1ChordAngle::Zero());
+  S2ParallelFor(executor, num_threads, [&](int t) {
+    size_t begin = points.size() * t / num_threads;
+    size_t end = points.size() * (t + 1) / num_threads;
+    S1ChordAngle radius = S1ChordAngle::Zero();
+    for (size_t i = begin; i < end; ++i) {
+      // This is the same calculation as S2Cap::Contains(), which guarantees
+      // that the result contains all the points.
+      radius = max(radius, S1ChordAngle(center, points[i]));
+    }
+    radii[t] = radius;
+  });
+  return S2Cap(center, *std::max_element(radii.begin(), radii.end()));
+}
+
+}  // namespace
+
+S2Cap GetMinEnclosingCap(absl::Span<const S2Point> points, int num_threads,
+                         S2Executor* executor) {
+  if (points.empty()) return S2Cap::Empty();
+  const size_t n = points.size();
+  num_threads = static_cast<int>(
+      min<size_t>(max(1, S2NumThreads(executor, num_threads)), n));
+
+  // Choose a random sample of the points.  The sample is always chosen in
+  // the same way so that the result is deterministic.
+  std::mt19937_64 rnd(0x5eed);
+  vector<S2Point> sample;
+  if (n <= kInitialSampleSize) {
+    sample.assign(points.begin(), points.end());
+  } else {
+    for (int i = 0; i < kInitialSampleSize; ++i) {
+      sample.push_back(points[rnd() % n]);
+    }
+  }
+
+  bool ok = true;
+  S2Cap cap;
+  vector<vector<S2Point>> outside(num_threads);
+  for (int round = 0; round < kMaxRounds; ++round) {
+    std::shuffle(sample.begin(), sample.end(), rnd);
+    cap = MinEnclosingCapOfSample(sample, &ok);
+    if (!ok) break;
+
+    // Find the first kMaxPointsAdded points that are not contained by the
+    // cap.  Each thread finds the first kMaxPointsAdded in its range, so the
+    // result does not depend on the number of threads.
+    S2ParallelFor(executor, num_threads, [&](int t) {
+      size_t begin = n * t / num_threads;
+      size_t end = n * (t + 1) / num_threads;
+      outside[t].clear();
+      for (size_t i = begin; i < end; ++i) {
+        if (!ContainsApprox(cap, points[i])) {
+          outside[t].push_back(points[i]);
+          if (outside[t].size() == kMaxPointsAdded) break;
+        }
+      }
+    });
+    size_t num_added = 0;
+    for (const auto& v : outside) {
+      for (const S2Point& p : v) {
+        if (num_added == kMaxPointsAdded) break;
+        sample.push_back(p);
+        ++num_added;
+      }
+    }
+    if (num_added == 0) break;
+  }
+  if (ok) return CapWithCenter(points, cap.center(), num_threads, executor);
+
+  // The points do not fit in a hemisphere.  Center the cap on the centroid
+  // direction instead, which gives a reasonable (but not minimal) bound.
+  S2Point sum;
+  for (const S2Point& p : points) sum += p;
+  S2Point center = (sum.Norm2() > 0) ? sum.Normalize() : points[0];
+  return CapWithCenter(points, center, num_threads, executor);
+}
+
+}  // namespace S2
@@ -0,0 +1,53 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2MIN_ENCLOSING_CAP_H_
+#define S2_S2MIN_ENCLOSING_CAP_H_
+
+#include "absl/types/span.h"
+#include "s2/s2cap.h"
+#include "s2/s2executor.h"
+#include "s2/s2point.h"
+
+namespace S2 {
+
+// Returns the smallest cap that contains all the given points (which must be
+// unit length).  Unlike a cap built by calling S2Cap::AddPoint() for each
+// point, whose center is simply the first point, this cap is tight: its
+// center is chosen so that the radius is minimized.  It is also usually
+// smaller than S2ConvexHullQuery::GetCapBound(), and does not require
+// computing the convex hull.  This makes it a good bound for summarizing
+// point clusters and for pruning queries against them.
+//
+// The algorithm is a randomized incremental (Welzl-style) algorithm that
+// takes expected linear time.  It is applied to a random sample of the
+// points, and the cap is then checked against all the points using up to
+// "num_threads" threads (see S2ParallelFor for the meaning of "executor").
+// Points outside the cap are added to the sample and the process is
+// repeated; usually one or two rounds suffice.  The sequence of random
+// choices is fixed, so the result does not depend on the number of threads.
+//
+// The result always contains every point (as determined by S2Cap::Contains).
+// Its radius is minimal up to numerical errors of a few times 1e-15 when
+// measured as a squared chord length (see S1ChordAngle), which is about
+// 1e-15 / r radians for a cap of radius "r".  If the points do not fit in
+// any hemisphere, the result is a valid but not necessarily minimal cap.
+// Returns an empty cap if "points" is empty.
+S2Cap GetMinEnclosingCap(absl::Span<const S2Point> points,
+                         int num_threads = 1, S2Executor* executor = nullptr);
+
+}  // namespace S2
+
+#endif  // S2_S2MIN_ENCLOSING_CAP_H_
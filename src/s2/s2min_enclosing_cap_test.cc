@@ -0,0 +1,159 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2min_enclosing_cap.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "s2/s1angle.h"
+#include "s2/s1chord_angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2convex_hull_query.h"
+#include "s2/s2executor.h"
+#include "s2/s2testing.h"
+
+using std::vector;
+
+namespace {
+
+// Returns the smallest cap through two or three of the points that contains
+// all of them.  This takes O(n^4) time.
+S2Cap BruteForceMinEnclosingCap(const vector<S2Point>& points) {
+  // The tolerance (a squared chord length) allows for the errors in
+  // computing circumcenters of points that are not exactly unit length.
+  auto contains_all = [&](const S2Cap& cap) {
+    for (const S2Point& p : points) {
+      if (S1ChordAngle(cap.center(), p) > cap.radius().PlusError(1e-14)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  S2Cap best = S2Cap::Full();
+  auto consider = [&](const S2Cap& cap) {
+    if (cap.radius() < best.radius() && contains_all(cap)) best = cap;
+  };
+  if (points.size() == 1) return S2Cap::FromPoint(points[0]);
+  for (int i = 0; i < points.size(); ++i) {
+    for (int j = i + 1; j < points.size(); ++j) {
+      S2Point center = (points[i] + points[j]).Normalize();
+      consider(S2Cap(center, S1ChordAngle(center, points[i])));
+      for (int k = j + 1; k < points.size(); ++k) {
+        S2Point c = (points[j] - points[i])
+                        .CrossProd(points[k] - points[i]).Normalize();
+        if (c.DotProd(points[i]) < 0) c = -c;
+        consider(S2Cap(c, S1ChordAngle(c, points[i])));
+      }
+    }
+  }
+  return best;
+}
+
+void ExpectContainsAll(const S2Cap& cap, const vector<S2Point>& points) {
+  for (const S2Point& p : points) EXPECT_TRUE(cap.Contains(p));
+}
+
+TEST(GetMinEnclosingCap, EmptyAndSinglePoint) {
+  EXPECT_TRUE(S2::GetMinEnclosingCap({}).is_empty());
+  S2Point p(1, 0, 0);
+  S2Cap cap = S2::GetMinEnclosingCap({p});
+  EXPECT_EQ(p, cap.center());
+  EXPECT_EQ(S1ChordAngle::Zero(), cap.radius());
+}
+
+TEST(GetMinEnclosingCap, TwoPoints) {
+  S2Point a(1, 0, 0), b(0, 1, 0);
+  S2Cap cap = S2::GetMinEnclosingCap({a, b});
+  EXPECT_NEAR(45, cap.GetRadius().degrees(), 1e-13);
+  EXPECT_TRUE(S2::ApproxEquals(S2Point(1, 1, 0).Normalize(), cap.center()));
+}
+
+TEST(GetMinEnclosingCap, MatchesBruteForce) {
+  for (int iter = 0; iter < 200; ++iter) {
+    S2Cap region = S2Testing::GetRandomCap(1e-12, 1.0);
+    vector<S2Point> points;
+    int num_points = 1 + S2Testing::rnd.Uniform(12);
+    for (int i = 0; i < num_points; ++i) {
+      points.push_back(S2Testing::SamplePoint(region));
+    }
+    S2Cap expected = BruteForceMinEnclosingCap(points);
+    S2Cap actual = S2::GetMinEnclosingCap(points);
+    ExpectContainsAll(actual, points);
+    EXPECT_NEAR(expected.radius().length2(), actual.radius().length2(),
+                1e-14);
+  }
+}
+
+TEST(GetMinEnclosingCap, TighterThanOtherBounds) {
+  for (int iter = 0; iter < 20; ++iter) {
+    S2Cap region = S2Testing::GetRandomCap(1e-8, 0.5);
+    vector<S2Point> points;
+    S2ConvexHullQuery hull;
+    S2Cap incremental;
+    for (int i = 0; i < 1000; ++i) {
+      points.push_back(S2Testing::SamplePoint(region));
+      hull.AddPoint(points.back());
+      incremental.AddPoint(points.back());
+    }
+    S2Cap cap = S2::GetMinEnclosingCap(points);
+    ExpectContainsAll(cap, points);
+    EXPECT_LE(cap.radius(), incremental.radius());
+    EXPECT_LE(cap.GetRadius().radians(),
+              hull.GetCapBound().GetRadius().radians() + 1e-14);
+    // The sampled region encloses the points, so it can't be smaller.
+    EXPECT_LE(cap.GetRadius().radians(),
+              region.GetRadius().radians() + 1e-14);
+  }
+}
+
+TEST(GetMinEnclosingCap, LargeInputIndependentOfThreads) {
+  // More points than the initial sample, including a few outliers that the
+  // sample is unlikely to contain.
+  S2Cap region = S2Testing::GetRandomCap(1e-4, 1e-4);
+  vector<S2Point> points;
+  for (int i = 0; i < 100000; ++i) {
+    points.push_back(S2Testing::SamplePoint(region));
+  }
+  S2Cap outer(region.center(), 2 * region.GetRadius());
+  for (int i = 0; i < 5; ++i) {
+    points.push_back(S2Testing::SamplePoint(outer));
+  }
+  S2Cap cap = S2::GetMinEnclosingCap(points);
+  ExpectContainsAll(cap, points);
+  EXPECT_LE(cap.GetRadius(), outer.GetRadius());
+
+  S2ThreadPool pool(4);
+  for (int num_threads : {2, 3, 7}) {
+    S2Cap parallel = S2::GetMinEnclosingCap(points, num_threads);
+    EXPECT_EQ(cap.center(), parallel.center());
+    EXPECT_EQ(cap.radius(), parallel.radius());
+  }
+  S2Cap pooled = S2::GetMinEnclosingCap(points, 1, &pool);
+  EXPECT_EQ(cap.center(), pooled.center());
+  EXPECT_EQ(cap.radius(), pooled.radius());
+}
+
+TEST(GetMinEnclosingCap, NotInHemisphere) {
+  // The result is not minimal but must contain all the points.
+  vector<S2Point> points = {S2Point(1, 0, 0), S2Point(-1, 0, 0),
+                            S2Point(0, 1, 0), S2Point(0, 0, 1),
+                            S2Point(0, 0, -1)};
+  ExpectContainsAll(S2::GetMinEnclosingCap(points), points);
+  for (int i = 0; i < 1000; ++i) points.push_back(S2Testing::RandomPoint());
+  ExpectContainsAll(S2::GetMinEnclosingCap(points, 3), points);
+}
+
+}  // namespace
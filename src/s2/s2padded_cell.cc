@@ -29,6 +29,7 @@ using std::min;
 using S2::internal::kSwapMask;
 using S2::internal::kInvertMask;
 using S2::internal::kIJtoPos;
+using S2::internal::kPosToIJ;
 using S2::internal::kPosToOrientation;
 
 S2PaddedCell::S2PaddedCell(S2CellId id, double padding)
@@ -72,6 +73,12 @@ S2PaddedCell::S2PaddedCell(const S2PaddedCell& parent, int i, int j)
   bound_[1][1-j] = middle[1][1-j];
 }
 
+void S2PaddedCell::GetChildIJ(int pos, int* i, int* j) const {
+  int ij = kPosToIJ[orientation_][pos];
+  *i = ij >> 1;
+  *j = ij & 1;
+}
+
 const R2Rect& S2PaddedCell::middle() const {
   // We compute this field lazily because it is not needed the majority of the
   // time (i.e., for cells where the recursion terminates).
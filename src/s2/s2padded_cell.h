@@ -95,14 +95,4 @@ class S2PaddedCell {
   int level_;        // Level of this cell (see s2coords.h)
 };
 
-
-//////////////////   Implementation details follow   ////////////////////
-
-
-inline void S2PaddedCell::GetChildIJ(int pos, int* i, int* j) const {
-  int ij = S2::internal::kPosToIJ[orientation_][pos];
-  *i = ij >> 1;
-  *j = ij & 1;
-}
-
 #endif  // S2_S2PADDED_CELL_H_
@@ -0,0 +1,96 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2page_buffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using std::unique_ptr;
+
+constexpr size_t S2PageBuffer::kHugePageSize;
+
+unique_ptr<S2PageBuffer> S2PageBuffer::Copy(absl::string_view contents,
+                                            bool huge_pages, S2Error* error) {
+  auto buffer = Create(contents.size(), huge_pages, error);
+  if (buffer != nullptr && !contents.empty()) {
+    memcpy(buffer->data(), contents.data(), contents.size());
+  }
+  return buffer;
+}
+
+#ifndef _WIN32
+
+unique_ptr<S2PageBuffer> S2PageBuffer::Create(size_t size, bool huge_pages,
+                                              S2Error* error) {
+  // Round up to whole pages (or huge pages), and map at least one page so
+  // that data() is never null.
+  size_t alignment = huge_pages ? kHugePageSize : sysconf(_SC_PAGESIZE);
+  size_t mapped_size =
+      (std::max<size_t>(size, 1) + alignment - 1) & ~(alignment - 1);
+
+  // mmap() only guarantees page alignment, so for huge pages we map an extra
+  // huge page and then unmap the unaligned portions at either end.
+  size_t extra = huge_pages ? kHugePageSize : 0;
+  void* addr = mmap(nullptr, mapped_size + extra, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    error->Init(S2Error::RESOURCE_EXHAUSTED, "Cannot map %d bytes: %s",
+                mapped_size, strerror(errno));
+    return nullptr;
+  }
+  char* data = static_cast<char*>(addr);
+  if (extra > 0) {
+    uintptr_t p = reinterpret_cast<uintptr_t>(data);
+    uintptr_t aligned = (p + alignment - 1) & ~(alignment - 1);
+    size_t head = aligned - p;
+    if (head > 0) munmap(data, head);
+    if (extra - head > 0) {
+      munmap(reinterpret_cast<char*>(aligned) + mapped_size, extra - head);
+    }
+    data = reinterpret_cast<char*>(aligned);
+  }
+  bool accepted = false;
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) accepted = madvise(data, mapped_size, MADV_HUGEPAGE) == 0;
+#endif
+  return unique_ptr<S2PageBuffer>(
+      new S2PageBuffer(data, size, mapped_size, accepted));
+}
+
+S2PageBuffer::~S2PageBuffer() {
+  munmap(data_, mapped_size_);
+}
+
+#else  // _WIN32
+
+unique_ptr<S2PageBuffer> S2PageBuffer::Create(size_t size, bool huge_pages,
+                                              S2Error* error) {
+  error->Init(S2Error::UNIMPLEMENTED,
+              "S2PageBuffer is not supported on this platform");
+  return nullptr;
+}
+
+S2PageBuffer::~S2PageBuffer() {}
+
+#endif  // _WIN32
@@ -0,0 +1,90 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2PAGE_BUFFER_H_
+#define S2_S2PAGE_BUFFER_H_
+
+#include <cstddef>
+#include <memory>
+
+#include "absl/strings/string_view.h"
+#include "s2/s2error.h"
+
+// S2PageBuffer is a writable, page-aligned block of anonymous memory that is
+// intended to hold large read-mostly data such as an encoded S2ShapeIndex
+// (see s2replicated_index.h).  Compared to a std::string it offers two
+// placement controls that matter for multi-gigabyte indexes:
+//
+//  - Huge pages.  If requested, the buffer is aligned and sized to a
+//    multiple of the huge page size and the kernel is asked to back it with
+//    transparent huge pages, which greatly reduces TLB misses for random
+//    access patterns.  This is only a hint (see huge_pages() below).
+//
+//  - NUMA placement.  The memory is not touched when the buffer is created,
+//    so under the default "first touch" policy each page is allocated on the
+//    NUMA node of the thread that first writes it.  Filling the buffer from
+//    a thread that runs on a given node therefore places it on that node.
+//
+// S2PageBuffer is only supported on POSIX systems; on other platforms
+// Create() fails with S2Error::UNIMPLEMENTED.
+class S2PageBuffer {
+ public:
+  // Creates a buffer of at least "size" bytes, or returns nullptr and sets
+  // "error" if the memory could not be mapped.  If "huge_pages" is true, the
+  // kernel is asked to use transparent huge pages for the buffer.
+  static std::unique_ptr<S2PageBuffer> Create(size_t size, bool huge_pages,
+                                              S2Error* error);
+
+  // Convenience function that creates a buffer and copies "contents" into it
+  // on the calling thread.
+  static std::unique_ptr<S2PageBuffer> Copy(absl::string_view contents,
+                                            bool huge_pages, S2Error* error);
+
+  // Unmaps the buffer.
+  ~S2PageBuffer();
+
+  char* data() { return data_; }
+  const char* data() const { return data_; }
+
+  // Returns the size requested in Create().  (The mapping itself may be
+  // larger.)
+  size_t size() const { return size_; }
+
+  absl::string_view contents() const { return {data_, size_}; }
+
+  // Returns true if huge pages were requested and the kernel accepted the
+  // request.  Even then, the kernel only uses huge pages when it can find
+  // contiguous physical memory.
+  bool huge_pages() const { return huge_pages_; }
+
+  // The size of huge pages assumed when aligning the buffer (2 MB, which is
+  // the transparent huge page size on x86-64 and most ARM64 kernels).
+  static constexpr size_t kHugePageSize = 2 << 20;
+
+ private:
+  S2PageBuffer(char* data, size_t size, size_t mapped_size, bool huge_pages)
+      : data_(data), size_(size), mapped_size_(mapped_size),
+        huge_pages_(huge_pages) {}
+
+  char* const data_;
+  const size_t size_;
+  const size_t mapped_size_;
+  const bool huge_pages_;
+
+  S2PageBuffer(const S2PageBuffer&) = delete;
+  void operator=(const S2PageBuffer&) = delete;
+};
+
+#endif  // S2_S2PAGE_BUFFER_H_
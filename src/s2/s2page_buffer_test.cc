@@ -0,0 +1,77 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2page_buffer.h"
+
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using std::string;
+
+namespace {
+
+#ifndef _WIN32
+
+TEST(S2PageBuffer, Create) {
+  for (bool huge_pages : {false, true}) {
+    S2Error error;
+    auto buffer = S2PageBuffer::Create(12345, huge_pages, &error);
+    ASSERT_NE(nullptr, buffer) << error;
+    EXPECT_EQ(12345, buffer->size());
+    if (huge_pages) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(buffer->data()) %
+                       S2PageBuffer::kHugePageSize);
+    } else {
+      EXPECT_FALSE(buffer->huge_pages());
+    }
+    // The whole buffer is writable and initially zero.
+    EXPECT_EQ(0, buffer->data()[0]);
+    EXPECT_EQ(0, buffer->data()[12344]);
+    buffer->data()[0] = 'a';
+    buffer->data()[12344] = 'z';
+    EXPECT_EQ('z', buffer->contents().back());
+  }
+}
+
+TEST(S2PageBuffer, Copy) {
+  string contents(100000, 'x');
+  contents[5] = 'y';
+  S2Error error;
+  auto buffer = S2PageBuffer::Copy(contents, true, &error);
+  ASSERT_NE(nullptr, buffer) << error;
+  EXPECT_EQ(contents, buffer->contents());
+}
+
+TEST(S2PageBuffer, Empty) {
+  S2Error error;
+  auto buffer = S2PageBuffer::Copy("", false, &error);
+  ASSERT_NE(nullptr, buffer) << error;
+  EXPECT_EQ(0, buffer->size());
+  EXPECT_NE(nullptr, buffer->data());
+}
+
+#else  // _WIN32
+
+TEST(S2PageBuffer, Unimplemented) {
+  S2Error error;
+  EXPECT_EQ(nullptr, S2PageBuffer::Create(100, false, &error));
+  EXPECT_EQ(S2Error::UNIMPLEMENTED, error.code());
+}
+
+#endif  // _WIN32
+
+}  // namespace
@@ -16,6 +16,7 @@
 
 #include "s2/s2point_compression.h"
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 
@@ -35,6 +36,7 @@
 #include "s2/util/endian/endian.h"
 
 using absl::Span;
+using std::min;
 using std::pair;
 using std::vector;
 
@@ -42,6 +44,11 @@ namespace {
 
 const int kDerivativeEncodingOrder = 2;
 
+// Points after the first are encoded and decoded in blocks of this size, so
+// that the bit interleaving can use the batch functions in bit-interleave.h
+// (which the compiler can vectorize).
+const int kBlockSize = 64;
+
 // Pair of face number and count for run-length encoding.
 struct FaceRun {
   FaceRun() : face(-1), count(0) {}
@@ -81,24 +88,6 @@ struct FaceRun {
 // Run-length encoder/decoder for face numbers.
 class Faces {
  public:
-  class Iterator {
-   public:
-    explicit Iterator(const Faces& faces);
-
-    // Return the next face.
-    int Next();
-
-   private:
-    // The faces_ vector of the Faces object for which this is an iterator.
-    const vector<FaceRun>& faces_;
-
-    // The index that the next face will come from.
-    int face_index_;
-
-    // Number of faces already consumed for face_index_.
-    int num_faces_used_for_index_;
-  };
-
   Faces() {}
 
   // Add the face to the list of face runs, combining with the last if
@@ -111,10 +100,9 @@ class Faces {
   // Decodes the faces, returning true on success.
   bool Decode(int num_vertices, Decoder* decoder);
 
-  Iterator GetIterator() const {
-    Iterator iterator(*this);
-    return iterator;
-  }
+  // Returns the face runs.  Note that the count of the last run may exceed
+  // the number of vertices when decoding invalid input.
+  const vector<FaceRun>& runs() const { return faces_; }
 
  private:
   // Run-length encoded list of faces.
@@ -149,23 +137,6 @@ bool Faces::Decode(int num_vertices, Decoder* decoder) {
   return true;
 }
 
-Faces::Iterator::Iterator(const Faces& faces)
-    : faces_(faces.faces_), face_index_(0),
-      num_faces_used_for_index_(0) {
-}
-
-int Faces::Iterator::Next() {
-  S2_DCHECK_NE(faces_.size(), face_index_);
-  S2_DCHECK_LE(num_faces_used_for_index_, faces_[face_index_].count);
-  if (num_faces_used_for_index_ == faces_[face_index_].count) {
-    ++face_index_;
-    num_faces_used_for_index_ = 0;
-  }
-
-  ++num_faces_used_for_index_;
-  return faces_[face_index_].face;
-}
-
 // Unused function (for documentation purposes only).
 inline int STtoPiQi(double s, int level) {
   // We introduce a new coordinate system (pi, qi), which is (si, ti)
@@ -191,18 +162,21 @@ inline int SiTitoPiQi(unsigned int si, int level) {
   return si >> (S2::kMaxCellLevel + 1 - level);
 }
 
-inline double PiQitoST(int pi, int level) {
+inline double PiQitoST(int pi, double scale) {
   // We want to recover the position at the center of the cell.  If the point
   // was snapped to the center of the cell, then modf(s * 2^level) == 0.5.
   // Inverting STtoPiQi gives:
   // s = (pi + 0.5) / 2^level.
-  return (pi + 0.5) / (1 << level);
+  //
+  // "scale" is 2^-level, so this multiplication gives exactly the same result
+  // as the division above but is considerably faster.
+  return (pi + 0.5) * scale;
 }
 
-S2Point FacePiQitoXYZ(int face, int pi, int qi, int level) {
+S2Point FacePiQitoXYZ(int face, int pi, int qi, double scale) {
   return S2::FaceUVtoXYZ(face,
-                         S2::STtoUV(PiQitoST(pi, level)),
-                         S2::STtoUV(PiQitoST(qi, level))).Normalize();
+                         S2::STtoUV(PiQitoST(pi, scale)),
+                         S2::STtoUV(PiQitoST(qi, scale))).Normalize();
 }
 
 void EncodeFirstPointFixedLength(const pair<int, int>& vertex_pi_qi,
@@ -226,46 +200,46 @@ void EncodeFirstPointFixedLength(const pair<int, int>& vertex_pi_qi,
   S2_DCHECK_GE(encoder->avail(), 0);
 }
 
-void EncodePointCompressed(const pair<int, int>& vertex_pi_qi,
-                           int level,
-                           NthDerivativeCoder* pi_coder,
-                           NthDerivativeCoder* qi_coder,
-                           Encoder* encoder) {
-  // ZigZagEncode, as varint requires the maximum number of bytes for
-  // negative numbers.
-  const uint32 zig_zag_encoded_deriv_pi =
-      ZigZagEncode(pi_coder->Encode(vertex_pi_qi.first));
-  const uint32 zig_zag_encoded_deriv_qi =
-      ZigZagEncode(qi_coder->Encode(vertex_pi_qi.second));
-  // Interleave to reduce overhead from two partial bytes to one.
-  const uint64 interleaved_zig_zag_encoded_derivs =
-      util_bits::InterleaveUint32(zig_zag_encoded_deriv_pi,
-                                  zig_zag_encoded_deriv_qi);
+// Encodes the points after the first as interleaved, zig-zag encoded
+// derivatives.  The points are processed in blocks of kBlockSize.
+void EncodePointsCompressed(Span<const pair<int, int>> vertices_pi_qi,
+                            NthDerivativeCoder* pi_coder,
+                            NthDerivativeCoder* qi_coder,
+                            Encoder* encoder) {
+  uint32 derivs_pi[kBlockSize], derivs_qi[kBlockSize];
+  uint64 interleaved_derivs[kBlockSize];
+  for (int start = 0; start < vertices_pi_qi.size(); start += kBlockSize) {
+    const int n = min<int>(kBlockSize, vertices_pi_qi.size() - start);
+    for (int i = 0; i < n; ++i) {
+      // ZigZagEncode, as varint requires the maximum number of bytes for
+      // negative numbers.
+      derivs_pi[i] =
+          ZigZagEncode(pi_coder->Encode(vertices_pi_qi[start + i].first));
+      derivs_qi[i] =
+          ZigZagEncode(qi_coder->Encode(vertices_pi_qi[start + i].second));
+    }
+    // Interleave to reduce overhead from two partial bytes to one.
+    util_bits::InterleaveUint32(derivs_pi, derivs_qi, n, interleaved_derivs);
 
-  encoder->Ensure(Encoder::kVarintMax64);
-  encoder->put_varint64(interleaved_zig_zag_encoded_derivs);
-  S2_DCHECK_GE(encoder->avail(), 0);
+    encoder->Ensure(n * Encoder::kVarintMax64);
+    for (int i = 0; i < n; ++i) encoder->put_varint64(interleaved_derivs[i]);
+    S2_DCHECK_GE(encoder->avail(), 0);
+  }
 }
 
 void EncodePointsCompressed(Span<const pair<int, int>> vertices_pi_qi,
                             int level, Encoder* encoder) {
+  if (vertices_pi_qi.empty()) return;
   NthDerivativeCoder pi_coder(kDerivativeEncodingOrder);
   NthDerivativeCoder qi_coder(kDerivativeEncodingOrder);
-  for (int i = 0; i < vertices_pi_qi.size(); ++i) {
-    if (i == 0) {
-      // The first point will be just the (pi, qi) coordinates
-      // of the S2Point.  NthDerivativeCoder will not save anything
-      // in that case, so we encode in fixed format rather than varint
-      // to avoid the varint overhead.
-      EncodeFirstPointFixedLength(vertices_pi_qi[i], level,
-                                  &pi_coder, &qi_coder, encoder);
-    } else {
-      EncodePointCompressed(vertices_pi_qi[i], level,
-                            &pi_coder, &qi_coder, encoder);
-    }
-  }
 
-  S2_DCHECK_GE(encoder->avail(), 0);
+  // The first point will be just the (pi, qi) coordinates of the S2Point.
+  // NthDerivativeCoder will not save anything in that case, so we encode in
+  // fixed format rather than varint to avoid the varint overhead.
+  EncodeFirstPointFixedLength(vertices_pi_qi[0], level,
+                              &pi_coder, &qi_coder, encoder);
+  EncodePointsCompressed(vertices_pi_qi.subspan(1), &pi_coder, &qi_coder,
+                         encoder);
 }
 
 bool DecodeFirstPointFixedLength(Decoder* decoder,
@@ -290,26 +264,33 @@ bool DecodeFirstPointFixedLength(Decoder* decoder,
   return true;
 }
 
-bool DecodePointCompressed(Decoder* decoder,
-                           int level,
-                           NthDerivativeCoder* pi_coder,
-                           NthDerivativeCoder* qi_coder,
-                           pair<int, int>* vertex_pi_qi) {
-  uint64 interleaved_zig_zag_encoded_deriv_pi_qi;
-  if (!decoder->get_varint64(&interleaved_zig_zag_encoded_deriv_pi_qi)) {
-    return false;
+// Decodes the (pi, qi) coordinates of the points after the first, which
+// were encoded by EncodePointsCompressed() above.  "pi[0]" and "qi[0]" must
+// already contain the first point.  This is the hot loop when decoding
+// compressed polylines and loops, so rather than calling
+// NthDerivativeCoder::Decode() for each value it inverts the second
+// derivative encoding using local variables (with the same wraparound
+// arithmetic), and the varints of each block are parsed and deinterleaved
+// in batches.
+static_assert(kDerivativeEncodingOrder == 2,
+              "DecodePointsCompressed assumes second derivative encoding");
+bool DecodePointsCompressed(Decoder* decoder, Span<uint32> pi,
+                            Span<uint32> qi) {
+  S2_DCHECK_EQ(pi.size(), qi.size());
+  uint64 interleaved_derivs[kBlockSize];
+  uint32 delta_pi = 0, delta_qi = 0;
+  for (int start = 1; start < pi.size(); start += kBlockSize) {
+    const int n = min<int>(kBlockSize, pi.size() - start);
+    if (!decoder->get_varint64_array(n, interleaved_derivs)) return false;
+    util_bits::DeinterleaveUint32(interleaved_derivs, n, &pi[start],
+                                  &qi[start]);
+    for (int i = start; i < start + n; ++i) {
+      delta_pi += static_cast<uint32>(ZigZagDecode(pi[i]));
+      delta_qi += static_cast<uint32>(ZigZagDecode(qi[i]));
+      pi[i] = pi[i - 1] + delta_pi;
+      qi[i] = qi[i - 1] + delta_qi;
+    }
   }
-
-  uint32 zig_zag_encoded_deriv_pi, zig_zag_encoded_deriv_qi;
-  util_bits::DeinterleaveUint32(interleaved_zig_zag_encoded_deriv_pi_qi,
-                                &zig_zag_encoded_deriv_pi,
-                                &zig_zag_encoded_deriv_qi);
-
-  vertex_pi_qi->first =
-      pi_coder->Decode(ZigZagDecode(zig_zag_encoded_deriv_pi));
-  vertex_pi_qi->second =
-      qi_coder->Decode(ZigZagDecode(zig_zag_encoded_deriv_qi));
-
   return true;
 }
 
@@ -352,26 +333,31 @@ bool S2DecodePointsCompressed(Decoder* decoder, int level,
     return false;
   }
 
-  NthDerivativeCoder pi_coder(kDerivativeEncodingOrder);
-  NthDerivativeCoder qi_coder(kDerivativeEncodingOrder);
-  Faces::Iterator faces_iterator = faces.GetIterator();
-  for (int i = 0; i < points.size(); ++i) {
-    pair<int, int> vertex_pi_qi;
-    if (i == 0) {
-      if (!DecodeFirstPointFixedLength(decoder, level, &pi_coder, &qi_coder,
-                                       &vertex_pi_qi)) {
-        return false;
-      }
-    } else {
-      if (!DecodePointCompressed(decoder, level, &pi_coder, &qi_coder,
-                                 &vertex_pi_qi)) {
-        return false;
+  // The (pi, qi) coordinates are decoded first, and then converted to
+  // points one face run at a time.
+  if (!points.empty()) {
+    NthDerivativeCoder pi_coder(kDerivativeEncodingOrder);
+    NthDerivativeCoder qi_coder(kDerivativeEncodingOrder);
+    absl::FixedArray<uint32> pi(points.size()), qi(points.size());
+    pair<int, int> first_pi_qi;
+    if (!DecodeFirstPointFixedLength(decoder, level, &pi_coder, &qi_coder,
+                                     &first_pi_qi)) {
+      return false;
+    }
+    pi[0] = first_pi_qi.first;
+    qi[0] = first_pi_qi.second;
+    if (!DecodePointsCompressed(decoder, absl::MakeSpan(pi),
+                                absl::MakeSpan(qi))) {
+      return false;
+    }
+    const double scale = 1.0 / (1 << level);
+    int i = 0;
+    for (const FaceRun& run : faces.runs()) {
+      const int end = min<int>(i + run.count, points.size());
+      for (; i < end; ++i) {
+        points[i] = FacePiQitoXYZ(run.face, pi[i], qi[i], scale);
       }
     }
-
-    int face = faces_iterator.Next();
-    points[i] =
-        FacePiQitoXYZ(face, vertex_pi_qi.first, vertex_pi_qi.second, level);
   }
 
   unsigned int num_off_center;
@@ -389,3 +375,34 @@ bool S2DecodePointsCompressed(Decoder* decoder, int level,
   }
   return true;
 }
+
+bool S2SkipPointsCompressed(Decoder* decoder, int level, int num_points) {
+  S2_DCHECK_LE(level, S2::kMaxCellLevel);
+  for (int num_faces_parsed = 0; num_faces_parsed < num_points; ) {
+    FaceRun face_run;
+    if (!face_run.Decode(decoder)) return false;
+    num_faces_parsed += face_run.count;
+  }
+  if (num_points > 0) {
+    const int bytes_required = (level + 7) / 8 * 2;
+    if (decoder->avail() < bytes_required) return false;
+    decoder->skip(bytes_required);
+    uint64 interleaved_derivs[kBlockSize];
+    for (int start = 1; start < num_points; start += kBlockSize) {
+      const int n = min<int>(kBlockSize, num_points - start);
+      if (!decoder->get_varint64_array(n, interleaved_derivs)) return false;
+    }
+  }
+  unsigned int num_off_center;
+  if (!decoder->get_varint32(&num_off_center) ||
+      num_off_center > num_points) {
+    return false;
+  }
+  for (int i = 0; i < num_off_center; ++i) {
+    uint32 index;
+    if (!decoder->get_varint32(&index) || index >= num_points) return false;
+    if (decoder->avail() < sizeof(S2Point)) return false;
+    decoder->skip(sizeof(S2Point));
+  }
+  return true;
+}
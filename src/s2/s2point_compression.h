@@ -75,4 +75,11 @@ void S2EncodePointsCompressed(absl::Span<const S2XYZFaceSiTi> points,
 bool S2DecodePointsCompressed(Decoder* decoder, int level,
                               absl::Span<S2Point> points);
 
+// Advances "decoder" past "num_points" points encoded with
+// S2EncodePointsCompressed at the given level, without converting them to
+// S2Points.  This is several times faster than S2DecodePointsCompressed and
+// allows encodings that contain compressed points to be scanned without
+// decoding them.  Returns true on success.
+bool S2SkipPointsCompressed(Decoder* decoder, int level, int num_points);
+
 #endif  // S2_S2POINT_COMPRESSION_H_
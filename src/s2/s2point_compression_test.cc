@@ -276,6 +276,26 @@ TEST_F(S2PointCompressionTest, StraightLineCompressesWell) {
   EXPECT_EQ(line_.size() + 17, encoder_.length());
 }
 
+TEST_F(S2PointCompressionTest, RoundtripsManyBlocks) {
+  // The points after the first are processed in blocks, so check a loop with
+  // many blocks, several faces, and multi-byte deltas.
+  vector<S2Point> loop = MakeRegularPoints(1000, 1000, S2::kMaxCellLevel);
+  Roundtrip(loop, S2::kMaxCellLevel);
+  EXPECT_GT(encoder_.length(), 3 * loop.size());
+}
+
+TEST_F(S2PointCompressionTest, TruncatedInput) {
+  vector<S2Point> loop = MakeRegularPoints(1000, 1000, S2::kMaxCellLevel);
+  Encode(loop, S2::kMaxCellLevel);
+  vector<S2Point> points(loop.size());
+  for (size_t length : {size_t{0}, size_t{1}, size_t{20},
+                        encoder_.length() / 2, encoder_.length() - 1}) {
+    Decoder decoder(encoder_.base(), length);
+    EXPECT_FALSE(S2DecodePointsCompressed(&decoder, S2::kMaxCellLevel,
+                                          MakeSpan(points)));
+  }
+}
+
 TEST_F(S2PointCompressionTest, FirstPointOnFaceEdge) {
   // This test used to trigger a bug in which EncodeFirstPointFixedLength()
   // tried to encode a pi/qi value of (2**level) in "level" bits (which did
@@ -18,11 +18,19 @@
 #ifndef S2_S2POINT_INDEX_H_
 #define S2_S2POINT_INDEX_H_
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
 #include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "absl/container/btree_map.h"
+#include "absl/types/span.h"
 
+#include "s2/base/integral_types.h"
+#include "s2/base/logging.h"
 #include "s2/s2cell_id.h"
 
 namespace s2internal {
@@ -92,6 +100,23 @@ class BTreeMultimap : public absl::btree_multimap<Key, Value> {
 //     DoSomething(it.id(), it.point(), it.data());
 //   }
 //
+// Large indexes that are built once and then only queried should be
+// constructed from a vector of points instead (see the constructor below),
+// which is much faster and uses less memory than calling Add() repeatedly.
+//
+// Large per-point payloads should not be stored as Data, since every query
+// that touches a point also brings its payload into cache.  Instead, keep the
+// payloads in separate arrays ("columns") addressed by the position of each
+// point in its input vector (its "row"), and index the points with an integer
+// Data type holding the row (see the S2PointIndex(Span<const S2Point>)
+// constructor).  S2ClosestPointQuery then returns row indices as data():
+//
+//   S2PointIndex<int32> index(poi_points);  // Data is the row.
+//   S2ClosestPointQuery<int32> query(&index);
+//   for (const auto& result : query.FindClosestPoints(&target)) {
+//     DoSomething(poi_names[result.data()], poi_ratings[result.data()]);
+//   }
+//
 // TODO(ericv): Consider adding an S2PointIndexRegion class, which could be
 // used to efficiently compute coverings of a collection of S2Points.
 //
@@ -128,6 +153,25 @@ class S2PointIndex {
   // Default constructor.
   S2PointIndex();
 
+  // Constructs an index containing the given points, which may be in any
+  // order.  The points are sorted once and stored in a flat array sorted by
+  // S2CellId (with the S2CellIds stored separately from the points, so that
+  // seeking only touches the S2CellIds) rather than being inserted one at a
+  // time into a btree.  This reduces construction time and memory usage for
+  // indexes that are built once and then only queried.  Iteration is also
+  // somewhat faster since seeking within the array has better cache locality.
+  //
+  // The array is converted into a btree the first time that the index is
+  // modified, i.e. when points are added or removed.
+  explicit S2PointIndex(std::vector<PointData> points);
+
+  // Constructs an index in the same way as above, where the data of each
+  // point is its position in "points" (see the class comment).  Points
+  // with the same S2CellId are therefore visited in increasing row order.
+  //
+  // REQUIRES: Data is an integral type that can represent points.size() - 1.
+  explicit S2PointIndex(absl::Span<const S2Point> points);
+
   // Returns the number of points in the index.
   int num_points() const;
 
@@ -147,6 +191,35 @@ class S2PointIndex {
   // Convenience function for the case when Data is an empty class.
   void Remove(const S2Point& point);
 
+  // Replaces the given point with "new_point_data".  This is equivalent to
+  // calling Remove(old_point_data) followed by Add(new_point_data) if the
+  // point was present, except that it is much faster when both points have
+  // the same S2CellId: in that case the entry is modified in place (keeping
+  // its position among the points with that S2CellId), which does not
+  // invalidate any iterators, and an index constructed from a vector is not
+  // converted to a btree.  Returns false (and does nothing) if the old point
+  // was not present.
+  bool Update(const PointData& old_point_data,
+              const PointData& new_point_data);
+
+  // Convenience function that moves a point to "new_point" while keeping its
+  // data, e.g. to track moving objects.
+  bool Update(const S2Point& old_point, const S2Point& new_point,
+              const Data& data);
+
+  // Applies a batch of updates, where each element is an (old, new) pair of
+  // arguments to Update() above.  The updates are sorted by S2CellId and
+  // applied in a single pass over the index, and then the points that
+  // changed S2CellId are reinserted in S2CellId order.  This is much faster
+  // than calling Update() for each element when the batch is large.
+  // Returns the number of updates whose old point was present.
+  //
+  // The result is the same as calling Update() for each element, provided
+  // that the old point of each update is not the new point of another
+  // update in the batch.  (Chained updates of the same point should be
+  // combined before calling this method.)
+  int Update(absl::Span<const std::pair<PointData, PointData>> updates);
+
   // Resets the index to its original empty state.  Invalidates all iterators.
   void Clear();
 
@@ -154,9 +227,16 @@ class S2PointIndex {
   size_t SpaceUsed() const;
 
  private:
-  // Defined here because the Iterator class below uses it.
+  // Defined here because the Iterator class below uses them.
   using Map = s2internal::BTreeMultimap<S2CellId, PointData>;
 
+  // The representation of an index constructed from a vector of points: two
+  // parallel arrays sorted by S2CellId.
+  struct PointArray {
+    std::vector<S2CellId> ids;
+    std::vector<PointData> points;
+  };
+
  public:
   class Iterator {
    public:
@@ -212,11 +292,57 @@ class S2PointIndex {
    private:
     const Map* map_;
     typename Map::const_iterator iter_, end_;
+
+    // If the points are stored in a PointArray then "array_" points to it
+    // and "pos_" is the array position of the current entry; otherwise
+    // "array_" is nullptr and the btree iterators above are used.
+    const PointArray* array_ = nullptr;
+    size_t pos_ = 0;
   };
 
  private:
   friend class Iterator;
+
+  // Returns the given points paired with their positions (see the
+  // S2PointIndex(Span<const S2Point>) constructor).
+  static std::vector<PointData> MakeRows(absl::Span<const S2Point> points);
+
+  // Inserts the contents of array_ into map_ (before the index is modified).
+  void MoveArrayToMap();
+
+  // An element of a batch of updates (see Update) together with the
+  // S2CellIds of its points.
+  struct UpdateEntry {
+    S2CellId old_id, new_id;
+    int index;
+    bool found;
+  };
+
+  // Applies a batch of updates whose entries are sorted by (old_id, index)
+  // by merging them with the current contents of map_ into a new map.  This
+  // is faster than erasing and reinserting the points individually when a
+  // large fraction of the points change S2CellId.  Returns the number of
+  // updates whose old point was present.
+  int RebuildMap(absl::Span<const std::pair<PointData, PointData>> updates,
+                 std::vector<UpdateEntry>* entries);
+
+  // Returns the array entry with the given S2CellId equal to "point_data",
+  // or nullptr if there is no such entry.
+  PointData* FindInArray(S2CellId id, const PointData& point_data);
+
+  // Returns the first map entry with S2CellId >= "id", searching forward
+  // from "it".  REQUIRES: it == map_.end() or it->first <= id.
+  typename Map::iterator SeekInMap(typename Map::iterator it, S2CellId id);
+
+  // Returns the first map entry at or after "it" that has the given S2CellId
+  // and is equal to "point_data", or map_.end() if there is no such entry.
+  // REQUIRES: "it" is the first entry with S2CellId >= "id".
+  typename Map::iterator FindInMap(typename Map::iterator it, S2CellId id,
+                                   const PointData& point_data);
+
+  // At most one of map_ and array_ is non-empty at any time.
   Map map_;
+  PointArray array_;
 
   S2PointIndex(const S2PointIndex&) = delete;
   void operator=(const S2PointIndex&) = delete;
@@ -230,13 +356,60 @@ template <class Data>
 S2PointIndex<Data>::S2PointIndex() {
 }
 
+template <class Data>
+S2PointIndex<Data>::S2PointIndex(std::vector<PointData> points) {
+  // Sort the points by S2CellId, preserving the input order of points with
+  // the same S2CellId (as Add() does).
+  std::vector<std::pair<S2CellId, int>> order;
+  order.reserve(points.size());
+  for (int i = 0; i < points.size(); ++i) {
+    order.push_back(std::make_pair(S2CellId(points[i].point()), i));
+  }
+  std::sort(order.begin(), order.end());
+  array_.ids.reserve(order.size());
+  array_.points.reserve(order.size());
+  for (const auto& entry : order) {
+    array_.ids.push_back(entry.first);
+    array_.points.push_back(std::move(points[entry.second]));
+  }
+}
+
+template <class Data>
+S2PointIndex<Data>::S2PointIndex(absl::Span<const S2Point> points)
+    : S2PointIndex(MakeRows(points)) {
+}
+
+template <class Data>
+std::vector<typename S2PointIndex<Data>::PointData>
+S2PointIndex<Data>::MakeRows(absl::Span<const S2Point> points) {
+  static_assert(std::is_integral<Data>::value, "Data must be integral");
+  S2_DCHECK_LE(points.size(),
+               static_cast<uint64>(std::numeric_limits<Data>::max()) + 1);
+  std::vector<PointData> rows;
+  rows.reserve(points.size());
+  for (size_t i = 0; i < points.size(); ++i) {
+    rows.push_back(PointData(points[i], static_cast<Data>(i)));
+  }
+  return rows;
+}
+
 template <class Data>
 inline int S2PointIndex<Data>::num_points() const {
-  return map_.size();
+  return map_.size() + array_.ids.size();
+}
+
+template <class Data>
+void S2PointIndex<Data>::MoveArrayToMap() {
+  S2_DCHECK(map_.empty());
+  for (size_t i = 0; i < array_.ids.size(); ++i) {
+    map_.insert(map_.end(), std::make_pair(array_.ids[i], array_.points[i]));
+  }
+  array_ = PointArray();
 }
 
 template <class Data>
 void S2PointIndex<Data>::Add(const PointData& point_data) {
+  if (!array_.ids.empty()) MoveArrayToMap();
   S2CellId id(point_data.point());
   map_.insert(std::make_pair(id, point_data));
 }
@@ -252,17 +425,47 @@ void S2PointIndex<Data>::Add(const S2Point& point) {
   Add(point, {});
 }
 
+template <class Data>
+typename S2PointIndex<Data>::PointData* S2PointIndex<Data>::FindInArray(
+    S2CellId id, const PointData& point_data) {
+  for (size_t i = std::lower_bound(array_.ids.begin(), array_.ids.end(), id) -
+                  array_.ids.begin();
+       i < array_.ids.size() && array_.ids[i] == id; ++i) {
+    if (array_.points[i] == point_data) return &array_.points[i];
+  }
+  return nullptr;
+}
+
+template <class Data>
+typename S2PointIndex<Data>::Map::iterator S2PointIndex<Data>::SeekInMap(
+    typename Map::iterator it, S2CellId id) {
+  // Consecutive seeks are often close together, so step forward a few
+  // entries before falling back to a btree search.
+  constexpr int kMaxSteps = 8;
+  for (int i = 0; i < kMaxSteps && it != map_.end() && it->first < id; ++i) {
+    ++it;
+  }
+  if (it != map_.end() && it->first < id) it = map_.lower_bound(id);
+  return it;
+}
+
+template <class Data>
+typename S2PointIndex<Data>::Map::iterator S2PointIndex<Data>::FindInMap(
+    typename Map::iterator it, S2CellId id, const PointData& point_data) {
+  for (; it != map_.end() && it->first == id; ++it) {
+    if (it->second == point_data) return it;
+  }
+  return map_.end();
+}
+
 template <class Data>
 bool S2PointIndex<Data>::Remove(const PointData& point_data) {
+  if (!array_.ids.empty()) MoveArrayToMap();
   S2CellId id(point_data.point());
-  for (typename Map::iterator it = map_.lower_bound(id), end = map_.end();
-       it != end && it->first == id; ++it) {
-    if (it->second == point_data) {
-      map_.erase(it);
-      return true;
-    }
-  }
-  return false;
+  auto it = FindInMap(map_.lower_bound(id), id, point_data);
+  if (it == map_.end()) return false;
+  map_.erase(it);
+  return true;
 }
 
 template <class Data>
@@ -276,14 +479,173 @@ void S2PointIndex<Data>::Remove(const S2Point& point) {
   Remove(point, {});
 }
 
+template <class Data>
+bool S2PointIndex<Data>::Update(const PointData& old_point_data,
+                                const PointData& new_point_data) {
+  S2CellId old_id(old_point_data.point());
+  S2CellId new_id(new_point_data.point());
+  if (!array_.ids.empty()) {
+    if (old_id == new_id) {
+      PointData* entry = FindInArray(old_id, old_point_data);
+      if (entry == nullptr) return false;
+      *entry = new_point_data;
+      return true;
+    }
+    MoveArrayToMap();
+  }
+  auto it = FindInMap(map_.lower_bound(old_id), old_id, old_point_data);
+  if (it == map_.end()) return false;
+  if (old_id == new_id) {
+    it->second = new_point_data;
+  } else {
+    map_.erase(it);
+    map_.insert(std::make_pair(new_id, new_point_data));
+  }
+  return true;
+}
+
+template <class Data>
+bool S2PointIndex<Data>::Update(const S2Point& old_point,
+                                const S2Point& new_point, const Data& data) {
+  return Update(PointData(old_point, data), PointData(new_point, data));
+}
+
+template <class Data>
+int S2PointIndex<Data>::Update(
+    absl::Span<const std::pair<PointData, PointData>> updates) {
+  // Sort the updates by the S2CellId of the old point, keeping updates with
+  // the same S2CellId in their original order.
+  std::vector<UpdateEntry> entries;
+  entries.reserve(updates.size());
+  size_t num_moves = 0;
+  for (int i = 0; i < updates.size(); ++i) {
+    UpdateEntry entry{S2CellId(updates[i].first.point()),
+                      S2CellId(updates[i].second.point()), i, false};
+    if (entry.old_id != entry.new_id) ++num_moves;
+    entries.push_back(entry);
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const UpdateEntry& x, const UpdateEntry& y) {
+              return x.old_id < y.old_id ||
+                     (x.old_id == y.old_id && x.index < y.index);
+            });
+  int num_found = 0;
+  if (!array_.ids.empty()) {
+    if (num_moves == 0) {
+      for (const UpdateEntry& entry : entries) {
+        PointData* point_data =
+            FindInArray(entry.old_id, updates[entry.index].first);
+        if (point_data == nullptr) continue;
+        *point_data = updates[entry.index].second;
+        ++num_found;
+      }
+      return num_found;
+    }
+    MoveArrayToMap();
+  }
+  if (num_moves >= map_.size() / 8) return RebuildMap(updates, &entries);
+
+  // Modify or remove the old entries in a single pass over the map, and
+  // remember the updates whose points need to be reinserted.
+  std::vector<const UpdateEntry*> moved;
+  auto it = map_.begin();
+  for (const UpdateEntry& entry : entries) {
+    it = SeekInMap(it, entry.old_id);
+    auto match = FindInMap(it, entry.old_id, updates[entry.index].first);
+    if (match == map_.end()) continue;
+    ++num_found;
+    if (entry.old_id == entry.new_id) {
+      match->second = updates[entry.index].second;
+      continue;
+    }
+    // Erasing an entry invalidates all other iterators.
+    bool is_first = match == it;
+    auto next = map_.erase(match);
+    it = is_first ? next : map_.lower_bound(entry.old_id);
+    moved.push_back(&entry);
+  }
+  // Reinserting the points in S2CellId order allows each insertion to use
+  // the previous one as a hint.
+  std::sort(moved.begin(), moved.end(),
+            [](const UpdateEntry* x, const UpdateEntry* y) {
+              return x->new_id < y->new_id ||
+                     (x->new_id == y->new_id && x->index < y->index);
+            });
+  auto hint = map_.end();
+  for (const UpdateEntry* entry : moved) {
+    hint = std::next(map_.insert(
+        hint, std::make_pair(entry->new_id, updates[entry->index].second)));
+  }
+  return num_found;
+}
+
+template <class Data>
+int S2PointIndex<Data>::RebuildMap(
+    absl::Span<const std::pair<PointData, PointData>> updates,
+    std::vector<UpdateEntry>* entries) {
+  // First find the entries that keep their S2CellId (applying any updates
+  // to them) and the updates whose points move to a different S2CellId.
+  std::vector<std::pair<S2CellId, PointData>> kept;
+  kept.reserve(map_.size());
+  std::vector<const UpdateEntry*> moved;
+  int num_found = 0;
+  auto begin = entries->begin();
+  for (const auto& entry : map_) {
+    while (begin != entries->end() && begin->old_id < entry.first) ++begin;
+    auto match = begin;
+    for (; match != entries->end() && match->old_id == entry.first; ++match) {
+      if (!match->found && updates[match->index].first == entry.second) break;
+    }
+    if (match == entries->end() || match->old_id != entry.first) {
+      kept.push_back(entry);
+      continue;
+    }
+    match->found = true;
+    ++num_found;
+    if (match->new_id == entry.first) {
+      kept.push_back(std::make_pair(entry.first, updates[match->index].second));
+    } else {
+      moved.push_back(&*match);
+    }
+  }
+  // Then merge the two sequences in S2CellId order, so that every insertion
+  // is at the end of the new map.  Moved points are inserted after existing
+  // points with the same S2CellId, as Add() does.
+  std::sort(moved.begin(), moved.end(),
+            [](const UpdateEntry* x, const UpdateEntry* y) {
+              return x->new_id < y->new_id ||
+                     (x->new_id == y->new_id && x->index < y->index);
+            });
+  Map map;
+  auto next_moved = moved.begin();
+  auto insert_moved = [&](S2CellId limit) {
+    for (; next_moved != moved.end() && (*next_moved)->new_id < limit;
+         ++next_moved) {
+      const UpdateEntry& update = **next_moved;
+      map.insert(map.end(), std::make_pair(update.new_id,
+                                           updates[update.index].second));
+    }
+  };
+  for (auto& entry : kept) {
+    insert_moved(entry.first);
+    map.insert(map.end(), std::move(entry));
+  }
+  insert_moved(S2CellId::Sentinel());
+  map_ = std::move(map);
+  return num_found;
+}
+
 template <class Data>
 void S2PointIndex<Data>::Clear() {
   map_.clear();
+  array_ = PointArray();
 }
 
 template <class Data>
 size_t S2PointIndex<Data>::SpaceUsed() const {
-  return sizeof(*this) - sizeof(map_) + map_.bytes_used();
+  return sizeof(*this) - sizeof(map_) + map_.bytes_used() +
+         array_.ids.capacity() * sizeof(S2CellId) +
+         array_.points.capacity() * sizeof(PointData);
 }
 
 template <class Data>
@@ -302,64 +664,89 @@ inline void S2PointIndex<Data>::Iterator::Init(
   map_ = &index->map_;
   iter_ = map_->begin();
   end_ = map_->end();
+  array_ = index->array_.ids.empty() ? nullptr : &index->array_;
+  pos_ = 0;
 }
 
 template <class Data>
 inline S2CellId S2PointIndex<Data>::Iterator::id() const {
   S2_DCHECK(!done());
+  if (array_ != nullptr) return array_->ids[pos_];
   return iter_->first;
 }
 
 template <class Data>
 inline const S2Point& S2PointIndex<Data>::Iterator::point() const {
-  S2_DCHECK(!done());
-  return iter_->second.point();
+  return point_data().point();
 }
 
 template <class Data>
 inline const Data& S2PointIndex<Data>::Iterator::data() const {
-  S2_DCHECK(!done());
-  return iter_->second.data();
+  return point_data().data();
 }
 
 template <class Data>
 inline const typename S2PointIndex<Data>::PointData&
 S2PointIndex<Data>::Iterator::point_data() const {
   S2_DCHECK(!done());
+  if (array_ != nullptr) return array_->points[pos_];
   return iter_->second;
 }
 
 template <class Data>
 inline bool S2PointIndex<Data>::Iterator::done() const {
+  if (array_ != nullptr) return pos_ == array_->ids.size();
   return iter_ == end_;
 }
 
 template <class Data>
 inline void S2PointIndex<Data>::Iterator::Begin() {
-  iter_ = map_->begin();
+  if (array_ != nullptr) {
+    pos_ = 0;
+  } else {
+    iter_ = map_->begin();
+  }
 }
 
 template <class Data>
 inline void S2PointIndex<Data>::Iterator::Finish() {
-  iter_ = end_;
+  if (array_ != nullptr) {
+    pos_ = array_->ids.size();
+  } else {
+    iter_ = end_;
+  }
 }
 
 template <class Data>
 inline void S2PointIndex<Data>::Iterator::Next() {
   S2_DCHECK(!done());
-  ++iter_;
+  if (array_ != nullptr) {
+    ++pos_;
+  } else {
+    ++iter_;
+  }
 }
 
 template <class Data>
 inline bool S2PointIndex<Data>::Iterator::Prev() {
-  if (iter_ == map_->begin()) return false;
-  --iter_;
+  if (array_ != nullptr) {
+    if (pos_ == 0) return false;
+    --pos_;
+  } else {
+    if (iter_ == map_->begin()) return false;
+    --iter_;
+  }
   return true;
 }
 
 template <class Data>
 inline void S2PointIndex<Data>::Iterator::Seek(S2CellId target) {
-  iter_ = map_->lower_bound(target);
+  if (array_ != nullptr) {
+    pos_ = std::lower_bound(array_->ids.begin(), array_->ids.end(), target) -
+           array_->ids.begin();
+  } else {
+    iter_ = map_->lower_bound(target);
+  }
 }
 
 #endif  // S2_S2POINT_INDEX_H_
@@ -17,9 +17,13 @@
 
 #include "s2/s2point_index.h"
 
+#include <memory>
 #include <set>
+#include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
+#include "absl/memory/memory.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2cell_union.h"
 #include "s2/s2testing.h"
@@ -29,19 +33,48 @@ class S2PointIndexTest : public ::testing::Test {
   using Index = S2PointIndex<int>;
   using PointData = Index::PointData;
   using Contents = std::multiset<PointData>;
-  Index index_;
+  std::unique_ptr<Index> index_ = absl::make_unique<Index>();
   Contents contents_;
 
  public:
   void Add(const S2Point& point, int data) {
-    index_.Add(point, data);
+    index_->Add(point, data);
     contents_.insert(PointData(point, data));
   }
 
   void Remove(const S2Point& point, int data) {
     // If there are multiple copies, remove only one.
     contents_.erase(contents_.find(PointData(point, data)));
-    index_.Remove(point, data);  // Invalidates "point".
+    index_->Remove(point, data);  // Invalidates "point".
+  }
+
+  // Returns true if the old point was present.
+  bool Update(const PointData& old_point_data,
+              const PointData& new_point_data) {
+    auto it = contents_.find(old_point_data);
+    if (it == contents_.end()) return false;
+    contents_.erase(it);
+    contents_.insert(new_point_data);
+    return true;
+  }
+
+  // Returns a random update of a point in the index: either a move within
+  // the same leaf cell, a move to a random point, or (occasionally) an
+  // update of a point that is not present.
+  std::pair<PointData, PointData> RandomUpdate() {
+    auto it = contents_.begin();
+    std::advance(it, S2Testing::rnd.Uniform(contents_.size()));
+    PointData old_point_data = *it;
+    switch (S2Testing::rnd.Uniform(3)) {
+      case 0: {
+        S2Point p = S2CellId(old_point_data.point()).ToPoint();
+        return {old_point_data, PointData(p, old_point_data.data())};
+      }
+      case 1:
+        return {old_point_data, PointData(S2Testing::RandomPoint(), 1000)};
+      default:
+        return {PointData(S2Testing::RandomPoint(), -1), old_point_data};
+    }
   }
 
   void Verify() {
@@ -51,7 +84,7 @@ class S2PointIndexTest : public ::testing::Test {
 
   void VerifyContents() {
     Contents remaining = contents_;
-    for (Index::Iterator it(&index_); !it.done(); it.Next()) {
+    for (Index::Iterator it(index_.get()); !it.done(); it.Next()) {
       Contents::iterator element = remaining.find(it.point_data());
       EXPECT_TRUE(element != remaining.end());
       remaining.erase(element);
@@ -60,7 +93,7 @@ class S2PointIndexTest : public ::testing::Test {
   }
 
   void VerifyIteratorMethods() {
-    Index::Iterator it(&index_);
+    Index::Iterator it(index_.get());
     EXPECT_FALSE(it.Prev());
     it.Finish();
     EXPECT_TRUE(it.done());
@@ -73,7 +106,7 @@ class S2PointIndexTest : public ::testing::Test {
       EXPECT_EQ(cellid, S2CellId(it.point()));
       EXPECT_GE(cellid, prev_cellid);
 
-      typename Index::Iterator it2(&index_);
+      typename Index::Iterator it2(index_.get());
       if (cellid == prev_cellid) {
         it2.Seek(cellid);
       }
@@ -126,7 +159,7 @@ TEST_F(S2PointIndexTest, RandomPoints) {
   Verify();
   // Now remove some of the points.
   for (int i = 0; i < 10; ++i) {
-    S2PointIndex<int>::Iterator it(&index_);
+    S2PointIndex<int>::Iterator it(index_.get());
     do {
       it.Seek(S2Testing::GetRandomCellId(S2CellId::kMaxLevel));
     } while (it.done());
@@ -135,6 +168,116 @@ TEST_F(S2PointIndexTest, RandomPoints) {
   }
 }
 
+TEST_F(S2PointIndexTest, ConstructFromVector) {
+  std::vector<PointData> points;
+  for (int i = 0; i < 100; ++i) {
+    points.push_back(PointData(S2Testing::RandomPoint(), i));
+  }
+  // Include some duplicate points.
+  for (int i = 0; i < 10; ++i) {
+    points.push_back(PointData(points[i].point(), 100 + i));
+    points.push_back(points[i]);
+  }
+  contents_.insert(points.begin(), points.end());
+  index_ = absl::make_unique<Index>(points);
+  EXPECT_EQ(points.size(), index_->num_points());
+  Verify();
+
+  // Points with the same S2CellId are kept in their original order.
+  Index::Iterator it(index_.get());
+  it.Seek(S2CellId(points[0].point()));
+  EXPECT_EQ(0, it.data());
+  it.Next();
+  EXPECT_EQ(100, it.data());
+
+  // Modifying the index converts it to the btree representation.
+  for (int i = 0; i < 10; ++i) {
+    Remove(points[i].point(), points[i].data());
+    Add(S2Testing::RandomPoint(), 200 + i);
+  }
+  Verify();
+  index_->Clear();
+  EXPECT_EQ(0, index_->num_points());
+}
+
+TEST_F(S2PointIndexTest, ConstructFromRows) {
+  std::vector<S2Point> points;
+  for (int i = 0; i < 100; ++i) points.push_back(S2Testing::RandomPoint());
+  // Include some duplicate points.
+  for (int i = 0; i < 10; ++i) points.push_back(points[i]);
+  for (int i = 0; i < points.size(); ++i) {
+    contents_.insert(PointData(points[i], i));
+  }
+  index_ = absl::make_unique<Index>(points);
+  Verify();
+
+  // Each point's data is its row, and duplicates are visited in row order.
+  Index::Iterator it(index_.get());
+  for (; !it.done(); it.Next()) EXPECT_EQ(points[it.data()], it.point());
+  it.Seek(S2CellId(points[0]));
+  EXPECT_EQ(0, it.data());
+  it.Next();
+  EXPECT_EQ(100, it.data());
+}
+
+TEST_F(S2PointIndexTest, Update) {
+  for (int i = 0; i < 100; ++i) {
+    Add(S2Testing::RandomPoint(), S2Testing::rnd.Uniform(10));
+  }
+  for (int i = 0; i < 100; ++i) {
+    auto update = RandomUpdate();
+    bool found = Update(update.first, update.second);
+    EXPECT_EQ(found, index_->Update(update.first, update.second));
+  }
+  Verify();
+
+  // The convenience method keeps the data.
+  PointData old_point_data = *contents_.begin();
+  S2Point new_point = S2Testing::RandomPoint();
+  EXPECT_TRUE(index_->Update(old_point_data.point(), new_point,
+                             old_point_data.data()));
+  Update(old_point_data, PointData(new_point, old_point_data.data()));
+  Verify();
+}
+
+TEST_F(S2PointIndexTest, UpdateBatch) {
+  // Test both an index constructed from a vector and one built by Add(),
+  // batches where every point stays in the same leaf cell, and batches that
+  // are small enough to be applied without rebuilding the btree.
+  for (int iter = 0; iter < 6; ++iter) {
+    contents_.clear();
+    std::vector<PointData> points;
+    for (int i = 0; i < 200; ++i) {
+      points.push_back(PointData(S2Testing::RandomPoint(), i % 50));
+    }
+    contents_.insert(points.begin(), points.end());
+    index_ = absl::make_unique<Index>(points);
+    if (iter >= 2) {
+      index_->Add(points[0]);  // Converts the index to a btree.
+      contents_.insert(points[0]);
+    }
+    std::vector<std::pair<PointData, PointData>> updates;
+    int num_found = 0;
+    for (int i = 0; i < (iter < 4 ? 100 : 10); ++i) {
+      auto update = RandomUpdate();
+      if (iter % 2 == 1) {
+        update.second = PointData(S2CellId(update.first.point()).ToPoint(),
+                                  update.first.data());
+      }
+      // Updates must not be chained (see S2PointIndex::Update).
+      bool chained = false;
+      for (const auto& other : updates) {
+        chained |= other.second == update.first || other == update;
+      }
+      if (chained) continue;
+      num_found += Update(update.first, update.second);
+      updates.push_back(update);
+    }
+    EXPECT_EQ(num_found, index_->Update(updates));
+    Verify();
+  }
+}
+
 TEST(S2PointIndex, EmptyData) {
   // Verify that when Data is an empty class, no space is used.
   EXPECT_EQ(sizeof(S2Point), sizeof(S2PointIndex<>::PointData));
@@ -29,6 +29,10 @@
 // vertices.
 //
 // This class is useful for adding a collection of points to an S2ShapeIndex.
+// The edge id of each point is its position in the vector, so per-point
+// payloads can be stored in separate arrays addressed by the edge ids
+// returned by queries (e.g. S2ClosestEdgeQuery::Result::edge_id), rather
+// than in a custom S2Shape subtype.
 class S2PointVectorShape : public S2Shape {
  public:
   // Define as enum so we don't have to declare storage.
@@ -90,6 +94,10 @@ class S2PointVectorShape : public S2Shape {
   ChainPosition chain_position(int e) const final {
     return ChainPosition(e, 0);
   }
+  S2PointSpan GetChainVertices(int i,
+                               std::vector<S2Point>* tmp) const final {
+    return S2PointSpan(&points_[i], 1);
+  }
   TypeTag type_tag() const override { return kTypeTag; }
 
  private:
@@ -145,6 +153,11 @@ class EncodedS2PointVectorShape : public S2Shape {
   ChainPosition chain_position(int e) const final {
     return ChainPosition(e, 0);
   }
+  S2PointSpan GetChainVertices(int i,
+                               std::vector<S2Point>* tmp) const final {
+    tmp->assign(1, points_[i]);
+    return *tmp;
+  }
   TypeTag type_tag() const override { return kTypeTag; }
 
  private:
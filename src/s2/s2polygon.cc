@@ -19,6 +19,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
 #include <cstddef>
 #include <memory>
@@ -57,11 +58,13 @@
 #include "s2/s2edge_crosser.h"
 #include "s2/s2edge_crossings.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng.h"
 #include "s2/s2latlng_rect.h"
 #include "s2/s2latlng_rect_bounder.h"
 #include "s2/s2loop.h"
 #include "s2/s2measures.h"
+#include "s2/s2memory_tracker.h"
 #include "s2/s2metrics.h"
 #include "s2/s2point_compression.h"
 #include "s2/s2polyline.h"
@@ -69,6 +72,7 @@
 #include "s2/s2shape_index.h"
 #include "s2/s2shape_index_region.h"
 #include "s2/s2shapeutil_visit_crossing_edge_pairs.h"
+#include "s2/s2winding_operation.h"
 #include "s2/util/coding/coder.h"
 
 using absl::flat_hash_set;
@@ -90,6 +94,14 @@ S2_DEFINE_bool(
     "significant amounts of memory and time when geometry is constructed but "
     "never queried, for example when converting from one format to another.");
 
+S2_DEFINE_bool(
+    s2polygon_minimize_loop_indexes, false,
+    "Discard the S2ShapeIndex cells of each loop once the polygon has been "
+    "initialized (see S2Polygon::MinimizeLoopIndexes).  This reduces the "
+    "memory used by polygons whose loop indexes were built during nesting "
+    "or validation, at the cost of rebuilding them if loop-level methods "
+    "are called later.");
+
 // The maximum number of loops we'll allow when decoding a polygon.
 // The default value of 10 million is 200x bigger than the number of
 S2_DEFINE_int32(
@@ -124,10 +136,15 @@ S2Polygon::S2Polygon(const S2Cell& cell)
   Init(make_unique<S2Loop>(cell));
 }
 
+S2Polygon::S2Polygon(S2MemoryResource* resource) : S2Polygon() {
+  resource_ = resource;
+}
+
 S2Polygon::S2Polygon(S2Polygon&& b)
     : S2Region(std::move(b)),
       loops_(std::move(b.loops_)),
       s2debug_override_(std::move(b.s2debug_override_)),
+      resource_(b.resource_),
       error_inconsistent_loop_orientations_(
           absl::exchange(b.error_inconsistent_loop_orientations_, 0)),
       num_vertices_(absl::exchange(b.num_vertices_, 0)),
@@ -151,6 +168,7 @@ S2Polygon& S2Polygon::operator=(S2Polygon&& b) {
   S2Region::operator=(static_cast<S2Region&&>(b));
   loops_ = std::move(b.loops_);
   s2debug_override_ = std::move(b.s2debug_override_);
+  resource_ = b.resource_;
   error_inconsistent_loop_orientations_ =
       absl::exchange(b.error_inconsistent_loop_orientations_, 0);
   num_vertices_ = absl::exchange(b.num_vertices_, 0);
@@ -231,6 +249,11 @@ bool S2Polygon::IsValid() const {
 }
 
 bool S2Polygon::FindValidationError(S2Error* error) const {
+  return FindValidationError(error, 1);
+}
+
+bool S2Polygon::FindValidationError(S2Error* error, int num_threads,
+                                    S2Executor* executor) const {
   for (int i = 0; i < num_loops(); ++i) {
     // Check for loop errors that don't require building an S2ShapeIndex.
     if (loop(i)->FindValidationErrorNoIndex(error)) {
@@ -254,7 +277,10 @@ bool S2Polygon::FindValidationError(S2Error* error) const {
 
   // Check for loop self-intersections and loop pairs that cross
   // (including duplicate edges and vertices).
-  if (s2shapeutil::FindSelfIntersection(index_, error)) return true;
+  if (s2shapeutil::FindSelfIntersection(index_, error, num_threads,
+                                        executor)) {
+    return true;
+  }
 
   // Check whether InitOriented detected inconsistent loop orientations.
   if (error_inconsistent_loop_orientations_) {
@@ -357,6 +383,16 @@ void S2Polygon::InitIndex() {
     // Note that FLAGS_s2debug is false in optimized builds (by default).
     S2_CHECK(IsValid());
   }
+  if (absl::GetFlag(FLAGS_s2polygon_minimize_loop_indexes)) {
+    MinimizeLoopIndexes();
+  }
+}
+
+void S2Polygon::MinimizeLoopIndexes() {
+  for (const auto& loop : loops_) {
+    loop->unindexed_contains_calls_.store(0, std::memory_order_relaxed);
+    loop->index_.Minimize();
+  }
 }
 
 void S2Polygon::ClearIndex() {
@@ -413,6 +449,12 @@ void S2Polygon::InitOneLoop() {
 }
 
 void S2Polygon::InitOriented(vector<unique_ptr<S2Loop>> loops) {
+  InitOriented(std::move(loops), 1);
+}
+
+void S2Polygon::InitOriented(vector<unique_ptr<S2Loop>> loops,
+                             int num_threads, S2Executor* executor) {
+  S2_DCHECK_GE(num_threads, 1);
   // Here is the algorithm:
   //
   // 1. Remember which of the given loops contain S2::Origin().
@@ -449,20 +491,30 @@ void S2Polygon::InitOriented(vector<unique_ptr<S2Loop>> loops) {
   //    necessary if the polygon requires at least one non-normalized loop to
   //    represent it.
 
-  flat_hash_set<const S2Loop*> contained_origin;
-  for (int i = 0; i < loops.size(); ++i) {
-    S2Loop* loop = loops[i].get();
-    if (loop->contains_origin()) {
-      contained_origin.insert(loop);
-    }
-    double angle = loop->GetCurvature();
-    if (fabs(angle) > loop->GetCurvatureMaxError()) {
-      // Normalize the loop.
-      if (angle < 0) loop->Invert();
-    } else {
-      // Ensure that the loop does not contain the origin.
-      if (loop->contains_origin()) loop->Invert();
+  const int num_input_loops = loops.size();
+  vector<char> loop_contained_origin(num_input_loops);
+  std::atomic<int> next_loop(0);
+  auto normalize_loops = [&]() {
+    for (int i; (i = next_loop.fetch_add(1)) < num_input_loops; ) {
+      S2Loop* loop = loops[i].get();
+      loop_contained_origin[i] = loop->contains_origin();
+      double angle = loop->GetCurvature();
+      if (fabs(angle) > loop->GetCurvatureMaxError()) {
+        // Normalize the loop.
+        if (angle < 0) loop->Invert();
+      } else {
+        // Ensure that the loop does not contain the origin.
+        if (loop->contains_origin()) loop->Invert();
+      }
     }
+  };
+  S2ParallelFor(executor,
+                std::min(S2NumThreads(executor, num_threads), num_input_loops),
+                [&](int) { normalize_loops(); });
+
+  flat_hash_set<const S2Loop*> contained_origin;
+  for (int i = 0; i < num_input_loops; ++i) {
+    if (loop_contained_origin[i]) contained_origin.insert(loops[i].get());
   }
   InitNested(std::move(loops));
   if (num_loops() > 0) {
@@ -689,11 +741,11 @@ bool S2Polygon::Contains(const S2Point& p) const {
   // Otherwise we keep track of the number of calls to Contains() and only
   // build the index once enough calls have been made so that we think it is
   // worth the effort.  See S2Loop::Contains(S2Point) for detailed comments.
-  static const int kMaxBruteForceVertices = 32;
-  static const int kMaxUnindexedContainsCalls = 20;
-  if (num_vertices() <= kMaxBruteForceVertices ||
+  const int max_unindexed_calls =
+      S2Loop::GetMaxUnindexedContainsCalls(num_vertices());
+  if (max_unindexed_calls < 0 ||
       (!index_.is_fresh() &&
-       ++unindexed_contains_calls_ != kMaxUnindexedContainsCalls)) {
+       ++unindexed_contains_calls_ != max_unindexed_calls)) {
     bool inside = false;
     for (int i = 0; i < num_loops(); ++i) {
       // Use brute force to avoid building the loop's S2ShapeIndex.
@@ -812,7 +864,7 @@ bool S2Polygon::DecodeUncompressed(Decoder* const decoder, bool within_scope) {
   loops_.reserve(num_loops);
   num_vertices_ = 0;
   for (int i = 0; i < num_loops; ++i) {
-    loops_.push_back(make_unique<S2Loop>());
+    loops_.push_back(make_unique<S2Loop>(resource_));
     loops_.back()->set_s2debug_override(s2debug_override());
     if (within_scope) {
       if (!loops_.back()->DecodeWithinScope(decoder)) return false;
@@ -1322,6 +1374,157 @@ unique_ptr<S2Polygon> S2Polygon::DestructiveUnion(
     return std::move(queue.begin()->second);
 }
 
+unique_ptr<S2Polygon> S2Polygon::DestructiveUnion(
+    vector<unique_ptr<S2Polygon>> polygons,
+    const S2Builder::SnapFunction& snap_function, int num_threads,
+    S2Executor* executor) {
+  S2_DCHECK_GE(num_threads, 1);
+  num_threads = S2NumThreads(executor, num_threads);
+  if (polygons.empty()) return make_unique<S2Polygon>();
+  while (polygons.size() > 1) {
+    // Pair up polygons of similar sizes, and union each pair in parallel.  If
+    // the number of polygons is odd, the largest one is left for the next
+    // round.
+    std::sort(polygons.begin(), polygons.end(),
+              [](const unique_ptr<S2Polygon>& a,
+                 const unique_ptr<S2Polygon>& b) {
+                return a->num_vertices() < b->num_vertices();
+              });
+    const int num_pairs = polygons.size() / 2;
+    std::atomic<int> next_pair(0);
+    auto union_pairs = [&]() {
+      for (int i; (i = next_pair.fetch_add(1)) < num_pairs; ) {
+        auto union_polygon = make_unique<S2Polygon>();
+        union_polygon->InitToUnion(*polygons[2 * i], *polygons[2 * i + 1],
+                                   snap_function);
+        polygons[2 * i] = std::move(union_polygon);
+        polygons[2 * i + 1].reset();
+      }
+    };
+    S2ParallelFor(executor, std::min(num_threads, num_pairs),
+                  [&](int) { union_pairs(); });
+    polygons.erase(std::remove(polygons.begin(), polygons.end(), nullptr),
+                   polygons.end());
+  }
+  return std::move(polygons[0]);
+}
+
+bool S2Polygon::DestructiveUnion(
+    vector<unique_ptr<S2Polygon>> polygons,
+    const S2Builder::SnapFunction& snap_function, int num_threads,
+    S2MemoryTracker* tracker, unique_ptr<S2Polygon>* result,
+    S2Error* error, S2Executor* executor) {
+  S2_DCHECK_GE(num_threads, 1);
+  S2_DCHECK(tracker != nullptr);
+  num_threads = S2NumThreads(executor, num_threads);
+  S2MemoryTracker::Client client(tracker);
+  int64 polygon_bytes = 0;
+  for (const auto& polygon : polygons) polygon_bytes += polygon->SpaceUsed();
+  if (!client.Tally(polygon_bytes)) {
+    *error = client.error();
+    return false;
+  }
+  while (polygons.size() > 1) {
+    // This loop is the same as above, except that each thread tracks the
+    // memory used by its unions using its own S2MemoryTracker.  The threads
+    // share the memory that remains under the tracker's limit.
+    std::sort(polygons.begin(), polygons.end(),
+              [](const unique_ptr<S2Polygon>& a,
+                 const unique_ptr<S2Polygon>& b) {
+                return a->num_vertices() < b->num_vertices();
+              });
+    const int num_pairs = polygons.size() / 2;
+    const int num_workers = std::min(num_threads, num_pairs);
+    S2MemoryBudget budget(std::max<int64>(
+        0, tracker->limit_bytes() - tracker->usage_bytes()));
+    vector<S2MemoryTracker> trackers(num_workers);
+    vector<S2Error> errors(num_workers);
+    std::atomic<int> next_pair(0);
+    std::atomic<bool> ok(true);
+    auto union_pairs = [&](int t) {
+      trackers[t].set_budget(&budget);
+      S2BooleanOperation::Options options(snap_function);
+      options.set_memory_tracker(&trackers[t]);
+      for (int i; ok && (i = next_pair.fetch_add(1)) < num_pairs; ) {
+        auto union_polygon = make_unique<S2Polygon>();
+        S2BooleanOperation op(S2BooleanOperation::OpType::UNION,
+                              make_unique<S2PolygonLayer>(union_polygon.get()),
+                              options);
+        if (!op.Build(polygons[2 * i]->index_, polygons[2 * i + 1]->index_,
+                      &errors[t])) {
+          ok = false;
+          return;
+        }
+        polygons[2 * i] = std::move(union_polygon);
+        polygons[2 * i + 1].reset();
+      }
+    };
+    S2ParallelFor(executor, num_workers, union_pairs);
+    for (const S2Error& thread_error : errors) {
+      if (!thread_error.ok()) {
+        tracker->SetError(thread_error);
+        *error = thread_error;
+        return false;
+      }
+    }
+    // Record the peak memory used by this round, and update the memory used
+    // by the polygons (which also gives the periodic callback a chance to
+    // cancel the operation).
+    int64 round_bytes = 0;
+    for (const S2MemoryTracker& thread_tracker : trackers) {
+      round_bytes += thread_tracker.max_usage_bytes();
+    }
+    polygons.erase(std::remove(polygons.begin(), polygons.end(), nullptr),
+                   polygons.end());
+    int64 new_polygon_bytes = 0;
+    for (const auto& polygon : polygons) {
+      new_polygon_bytes += polygon->SpaceUsed();
+    }
+    if (!client.TallyTemp(round_bytes) ||
+        !client.Tally(new_polygon_bytes - polygon_bytes)) {
+      *error = client.error();
+      return false;
+    }
+    polygon_bytes = new_polygon_bytes;
+  }
+  if (polygons.empty()) {
+    *result = make_unique<S2Polygon>();
+  } else {
+    *result = std::move(polygons[0]);
+  }
+  return true;
+}
+
+bool S2Polygon::InitToUnion(absl::Span<const S2Polygon* const> polygons,
+                            const S2Builder::SnapFunction& snap_function,
+                            S2Error* error) {
+  // The winding number of the reference point is the number of polygons
+  // that contain it, and each region of the result has a winding number
+  // equal to the number of polygons that contain it.  (The loop of a full
+  // polygon has no edges and only contributes to the reference winding.)
+  const S2Point ref_p = S2::Origin();
+  int ref_winding = 0;
+  S2WindingOperation op(make_unique<S2PolygonLayer>(this),
+                        S2WindingOperation::Options(snap_function));
+  vector<S2Point> reversed;
+  for (const S2Polygon* polygon : polygons) {
+    ref_winding += polygon->Contains(ref_p);
+    for (const auto& loop : polygon->loops_) {
+      if (loop->is_empty_or_full()) continue;
+      if (!loop->is_hole()) {
+        op.AddLoop(loop->vertices_span());
+      } else {
+        // Holes are oriented clockwise so that their interior is excluded.
+        reversed.assign(loop->vertices_span().rbegin(),
+                        loop->vertices_span().rend());
+        op.AddLoop(reversed);
+      }
+    }
+  }
+  return op.Build(ref_p, ref_winding,
+                  S2WindingOperation::WindingRule::POSITIVE, error);
+}
+
 void S2Polygon::InitToCellUnionBorder(const S2CellUnion& cells) {
   // We use S2Builder to compute the union.  Due to rounding errors, we can't
   // compute an exact union - when a small cell is adjacent to a larger cell,
@@ -1488,7 +1691,7 @@ bool S2Polygon::DecodeCompressed(Decoder* decoder) {
     return false;
   loops_.reserve(num_loops);
   for (int i = 0; i < num_loops; ++i) {
-    auto loop = make_unique<S2Loop>();
+    auto loop = make_unique<S2Loop>(resource_);
     loop->set_s2debug_override(s2debug_override());
     if (!loop->DecodeCompressed(decoder, snap_level)) {
       return false;
@@ -1559,6 +1762,21 @@ S2Shape::Chain S2Polygon::Shape::chain(int i) const {
   }
 }
 
+S2PointSpan S2Polygon::Shape::GetChainVertices(
+    int i, vector<S2Point>* tmp) const {
+  // S2Polygon represents a full loop as a loop with one vertex, while
+  // S2Shape represents a full loop as a chain with no vertices.
+  const S2Loop* loop = polygon_->loop(i);
+  if (loop->is_full()) return S2PointSpan();
+  if (!loop->is_hole()) return loop->vertices_span();
+
+  // The edges of holes are reversed (see S2Loop::oriented_vertex), so their
+  // vertices are copied in reverse order.
+  S2PointSpan vertices = loop->vertices_span();
+  tmp->assign(vertices.rbegin(), vertices.rend());
+  return *tmp;
+}
+
 size_t S2Polygon::SpaceUsed() const {
   size_t size = sizeof(*this);
   for (int i = 0; i < num_loops(); ++i) {
@@ -1567,3 +1785,102 @@ size_t S2Polygon::SpaceUsed() const {
   size += index_.SpaceUsed() - sizeof(index_);
   return size;
 }
+
+bool EncodedS2Polygon::Init(Decoder* decoder) {
+  data_ = decoder->skip(0);
+  num_vertices_ = 0;
+  loops_.clear();
+  if (decoder->avail() < sizeof(uint8)) return false;
+  const unsigned char version = decoder->get8();
+  uint32 num_loops;
+  if (version == kCurrentUncompressedEncodingVersionNumber) {
+    compressed_ = false;
+    if (decoder->avail() < 2 * sizeof(uint8) + sizeof(uint32)) return false;
+    decoder->get8();  // Ignore the obsolete owns_loops_ value.
+    decoder->get8();  // Ignore the obsolete has_holes_ value.
+    num_loops = decoder->get32();
+  } else if (version == kCurrentCompressedEncodingVersionNumber) {
+    compressed_ = true;
+    if (decoder->avail() < sizeof(uint8)) return false;
+    snap_level_ = decoder->get8();
+    if (snap_level_ > S2CellId::kMaxLevel) return false;
+    if (!decoder->get_varint32(&num_loops)) return false;
+  } else {
+    return false;
+  }
+  if (num_loops > absl::GetFlag(FLAGS_s2polygon_decode_max_num_loops))
+    return false;
+  loops_.reserve(num_loops);
+  for (int i = 0; i < num_loops; ++i) {
+    Loop loop;
+    loop.data = decoder->skip(0);
+    if (compressed_) {
+      if (!S2Loop::SkipCompressed(decoder, snap_level_, &loop)) return false;
+    } else {
+      if (!S2Loop::SkipEncoded(decoder, &loop)) return false;
+    }
+    loop.size = decoder->skip(0) - loop.data;
+    num_vertices_ += loop.num_vertices;
+    loops_.push_back(loop);
+  }
+  if (!compressed_ && !bound_.Decode(decoder)) return false;
+  size_ = decoder->skip(0) - data_;
+  return true;
+}
+
+unique_ptr<S2Loop> EncodedS2Polygon::DecodeLoop(int i) const {
+  S2_DCHECK_GE(i, 0);
+  S2_DCHECK_LT(i, num_loops());
+  auto loop = make_unique<S2Loop>();
+  Decoder decoder(loops_[i].data, loops_[i].size);
+  // Init() has already validated the encoding, so decoding cannot fail.
+  if (compressed_) {
+    S2_CHECK(loop->DecodeCompressed(&decoder, snap_level_));
+  } else {
+    S2_CHECK(loop->DecodeWithinScope(&decoder));
+  }
+  return loop;
+}
+
+unique_ptr<S2Polygon> EncodedS2Polygon::Decode() const {
+  auto polygon = make_unique<S2Polygon>();
+  Decoder decoder(data_, size_);
+  S2_CHECK(polygon->DecodeWithinScope(&decoder));
+  return polygon;
+}
+
+S2LatLngRect EncodedS2Polygon::GetRectBound() const {
+  if (!compressed_) return bound_;
+
+  // This is equivalent to S2Polygon::InitLoopProperties().
+  S2LatLngRect bound = S2LatLngRect::Empty();
+  for (int i = 0; i < num_loops(); ++i) {
+    if (loops_[i].depth != 0) continue;
+    if (loops_[i].has_bound) {
+      bound = bound.Union(loops_[i].bound);
+    } else {
+      bound = bound.Union(DecodeLoop(i)->GetRectBound());
+    }
+  }
+  return bound;
+}
+
+double EncodedS2Polygon::GetArea() const {
+  double area = 0;
+  for (int i = 0; i < num_loops(); ++i) {
+    unique_ptr<S2Loop> loop = DecodeLoop(i);
+    area += loop->sign() * loop->GetArea();
+  }
+  return area;
+}
+
+bool EncodedS2Polygon::Contains(const S2Point& p) const {
+  if (!compressed_ && !bound_.Contains(p)) return false;
+  bool inside = false;
+  for (int i = 0; i < num_loops(); ++i) {
+    // A loop that does not contain "p" does not affect the result.
+    if (loops_[i].has_bound && !loops_[i].bound.Contains(p)) continue;
+    inside ^= DecodeLoop(i)->BruteForceContains(p);
+  }
+  return inside;
+}
@@ -28,6 +28,7 @@
 #include "absl/base/attributes.h"
 #include "absl/base/macros.h"
 #include "absl/container/node_hash_map.h"
+#include "absl/types/span.h"
 
 #include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
@@ -38,8 +39,10 @@
 #include "s2/s2builder.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2debug.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng_rect.h"
 #include "s2/s2loop.h"
+#include "s2/s2memory_resource.h"
 #include "s2/s2polyline.h"
 #include "s2/s2region.h"
 #include "s2/s2shape_index.h"
@@ -148,6 +151,19 @@ class S2Polygon final : public S2Region {
   // corresponding to the given cell.
   explicit S2Polygon(const S2Cell& cell);
 
+  // Creates an empty polygon that allocates the vertices of the loops it
+  // creates itself from the given memory resource (see s2memory_resource.h).
+  // This applies to loops created by Decode(), DecodeWithinScope() and
+  // s2builderutil::S2PolygonLayer (and hence by S2BooleanOperation and the
+  // InitToXXX methods).  Loops passed to InitNested() etc. keep their own
+  // resource.  The resource is preserved across such calls and must outlive
+  // the polygon.
+  explicit S2Polygon(S2MemoryResource* resource);
+
+  // Returns the resource used for the vertices of the loops created by this
+  // polygon, or nullptr if they are allocated from the global heap.
+  S2MemoryResource* memory_resource() const { return resource_; }
+
 #ifndef SWIG
   // Convenience constructor that calls Init(S2Loop*).  Note that this method
   // automatically converts the special empty loop (see S2Loop) into an empty
@@ -179,6 +195,17 @@ class S2Polygon final : public S2Region {
   // inverted.)
   void InitOriented(std::vector<std::unique_ptr<S2Loop> > loops);
 
+  // Like the above, but uses up to "num_threads" threads to normalize the
+  // loops (which requires computing the curvature of every loop, and
+  // recomputing the bound of any loop that is inverted).  This is worthwhile
+  // for polygons with thousands of loops; see also S2Loop::MakeLoops().
+  // The result does not depend on "num_threads".  See S2ParallelFor for the
+  // meaning of "executor".
+  //
+  // REQUIRES: num_threads >= 1
+  void InitOriented(std::vector<std::unique_ptr<S2Loop>> loops,
+                    int num_threads, S2Executor* executor = nullptr);
+
   // Initialize a polygon from a single loop.  Note that this method
   // automatically converts the special empty loop (see S2Loop) into an empty
   // polygon, unlike the vector-of-loops InitNested() method which does not
@@ -231,6 +258,13 @@ class S2Polygon final : public S2Region {
   // REQUIRES: error != nullptr
   bool FindValidationError(S2Error* error) const;
 
+  // As above, but uses up to "num_threads" threads to check for edge
+  // crossings, which is the most expensive part of validating large
+  // polygons.  The result (including the error) is the same as above.  See
+  // S2ParallelFor for the meaning of "executor".
+  bool FindValidationError(S2Error* error, int num_threads,
+                           S2Executor* executor = nullptr) const;
+
   // Return true if this is the empty polygon (consisting of no loops).
   bool is_empty() const { return loops_.empty(); }
 
@@ -610,6 +644,52 @@ class S2Polygon final : public S2Region {
   static std::unique_ptr<S2Polygon> DestructiveUnion(
       std::vector<std::unique_ptr<S2Polygon> > polygons,
       const S2Builder::SnapFunction& snap_function);
+
+  // Like the above, but computes the union using up to "num_threads"
+  // threads.  The polygons are unioned in rounds: each round sorts the
+  // polygons by size and unions adjacent pairs in parallel, so that the
+  // depth of the computation is logarithmic in the number of polygons.  The
+  // result does not depend on "num_threads", but it may differ slightly from
+  // the methods above (when snapping is used) because the polygons are
+  // combined in a different order.  If "executor" is non-null, the unions
+  // run on it and "num_threads" is replaced by executor->num_threads().
+  //
+  // REQUIRES: num_threads >= 1
+  static std::unique_ptr<S2Polygon> DestructiveUnion(
+      std::vector<std::unique_ptr<S2Polygon> > polygons,
+      const S2Builder::SnapFunction& snap_function, int num_threads,
+      S2Executor* executor = nullptr);
+
+  // Like the above, but bounds the memory used by the union using the given
+  // S2MemoryTracker.  The memory used by the polygons themselves (see
+  // SpaceUsed) is tallied in "tracker", and the remaining memory is shared
+  // (using an S2MemoryBudget) by the pairwise unions that run concurrently
+  // in each round.
+  // Returns true and sets "result" to the union on success.  Otherwise
+  // returns false and sets "error", e.g. to S2Error::RESOURCE_EXHAUSTED if
+  // the memory limit would be exceeded (in which case "result" is not
+  // modified).  Since S2MemoryTracker is not thread-safe, the periodic
+  // callback of "tracker" (if any) is invoked only between rounds.
+  //
+  // REQUIRES: num_threads >= 1
+  // REQUIRES: tracker != nullptr
+  static bool DestructiveUnion(
+      std::vector<std::unique_ptr<S2Polygon> > polygons,
+      const S2Builder::SnapFunction& snap_function, int num_threads,
+      S2MemoryTracker* tracker, std::unique_ptr<S2Polygon>* result,
+      S2Error* error, S2Executor* executor = nullptr);
+
+  // Initializes this polygon to the union of the given polygons.  Unlike
+  // DestructiveUnion, the polygons are not combined pairwise: the loops of
+  // all the polygons are snapped together in a single S2Builder pass (using
+  // S2WindingOperation with WindingRule::POSITIVE).  This avoids snapping the
+  // intermediate results and is usually much faster when there are many
+  // polygons.  Returns false and sets "error" if the operation fails.
+  //
+  // Note that this polygon may be one of the input polygons.
+  bool InitToUnion(absl::Span<const S2Polygon* const> polygons,
+                   const S2Builder::SnapFunction& snap_function,
+                   S2Error* error);
 #endif  // !defined(SWIG)
 
   // Initialize this polygon to the outline of the given cell union.
@@ -692,6 +772,19 @@ class S2Polygon final : public S2Region {
   // Returns the total number of bytes used by the polygon.
   size_t SpaceUsed() const;
 
+  // Discards the S2ShapeIndex cells of every loop, keeping only the
+  // polygon-level index().  Each S2Loop owns its own index, which is built
+  // when loop-level methods are used (including during InitNested() and
+  // validation), and so a polygon whose loop indexes have been built uses
+  // roughly twice as much index memory as necessary.  S2Polygon methods use
+  // the polygon-level index for point containment and crossing queries, so a
+  // loop index is rebuilt only if loop-level methods are called again.
+  //
+  // This method is called automatically at the end of initialization when
+  // --s2polygon_minimize_loop_indexes is true.  It invalidates iterators
+  // over the loop indexes and is not thread-safe.
+  void MinimizeLoopIndexes();
+
   ////////////////////////////////////////////////////////////////////////
   // S2Region interface (see s2region.h for details):
 
@@ -790,6 +883,8 @@ class S2Polygon final : public S2Region {
     Chain chain(int i) const final;
     Edge chain_edge(int i, int j) const final;
     ChainPosition chain_position(int e) const final;
+    S2PointSpan GetChainVertices(int i,
+                                 std::vector<S2Point>* tmp) const final;
     TypeTag type_tag() const override { return kTypeTag; }
 
   void Encode(Encoder* encoder, s2coding::CodingHint hint) const override {
@@ -947,6 +1042,9 @@ class S2Polygon final : public S2Region {
   // --s2debug flag.
   S2Debug s2debug_override_;
 
+  // The resource used for the vertices of loops created by this polygon.
+  S2MemoryResource* resource_ = nullptr;
+
   // True if InitOriented() was called and the given loops had inconsistent
   // orientations (i.e., it is not possible to construct a polygon such that
   // the interior is on the left-hand side of all loops).  We need to remember
@@ -984,6 +1082,87 @@ class S2Polygon final : public S2Region {
 #endif
 };
 
+// EncodedS2Polygon is a read-only view of a polygon encoded by
+// S2Polygon::Encode() or S2Polygon::EncodeUncompressed().  Initialization only
+// reads the small per-loop headers (the vertices of compressed loops are
+// skipped without being decoded), and loops are decoded only when a method
+// needs their vertices.  This makes it cheap to scan large numbers of encoded
+// polygons when most of them can be filtered out using their size or bounds.
+// Example usage:
+//
+//   EncodedS2Polygon polygon;
+//   Decoder decoder(data.data(), data.size());
+//   if (!polygon.Init(&decoder)) return false;
+//   if (polygon.GetRectBound().Contains(S2LatLng(p)) && polygon.Contains(p)) {
+//     ...
+//   }
+//
+// The results of all methods are identical to those of the decoded S2Polygon.
+// All methods are const and may be called concurrently.
+class EncodedS2Polygon {
+ public:
+  // Constructs an uninitialized object; requires Init() to be called.
+  EncodedS2Polygon() {}
+
+  // Initializes the view and advances "decoder" past the encoded polygon.
+  // Returns false if the encoding is invalid.
+  //
+  // REQUIRES: The Decoder data buffer must outlive this object.
+  bool Init(Decoder* decoder);
+
+  int num_loops() const { return loops_.size(); }
+
+  // Returns the total number of vertices in all loops.
+  int num_vertices() const { return num_vertices_; }
+
+  // Returns the number of vertices and the depth of the given loop.  (Loops
+  // at odd depths are holes.)
+  int loop_num_vertices(int i) const { return loops_[i].num_vertices; }
+  int loop_depth(int i) const { return loops_[i].depth; }
+
+  // Decodes the given loop.  (Init() validates the entire encoding, so this
+  // cannot fail.)  The vertices of uncompressed loops point directly into the
+  // encoded data (see S2Loop::DecodeWithinScope), so the loop must not
+  // outlive the Decoder data buffer.
+  std::unique_ptr<S2Loop> DecodeLoop(int i) const;
+
+  // Decodes the entire polygon using S2Polygon::DecodeWithinScope().  The
+  // same lifetime requirement applies.
+  std::unique_ptr<S2Polygon> Decode() const;
+
+  // Returns the same result as S2Polygon::GetRectBound().  Uncompressed
+  // polygons store their bound, and compressed polygons store the bounds of
+  // loops with at least 64 vertices, so this method only decodes small
+  // compressed shells.
+  S2LatLngRect GetRectBound() const;
+
+  // Returns the same result as S2Polygon::GetArea().  This decodes every
+  // loop.
+  double GetArea() const;
+
+  // Returns the same result as S2Polygon::Contains(p).  Loops whose stored
+  // bound does not contain "p" are not decoded, and the rest are tested by
+  // brute force (since their indexes would only be used once).
+  bool Contains(const S2Point& p) const;
+
+ private:
+  // The encoded data of the loop and the properties read during Init().
+  struct Loop : public S2Loop::EncodedProperties {
+    const char* data;
+    size_t size;
+  };
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool compressed_ = false;
+  int snap_level_ = 0;
+  int num_vertices_ = 0;
+  std::vector<Loop> loops_;
+
+  // The bound stored by the uncompressed encoding.
+  S2LatLngRect bound_;
+};
+
 
 //////////////////   Implementation details follow   ////////////////////
 
@@ -33,6 +33,7 @@
 #include "absl/base/macros.h"
 #include "absl/container/fixed_array.h"
 #include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
@@ -57,8 +58,10 @@
 #include "s2/s2edge_crossings.h"
 #include "s2/s2edge_distances.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng.h"
 #include "s2/s2loop.h"
+#include "s2/s2memory_tracker.h"
 #include "s2/s2metrics.h"
 #include "s2/s2padded_cell.h"
 #include "s2/s2pointutil.h"
@@ -71,6 +74,8 @@
 #include "s2/util/gtl/legacy_random_shuffle.h"
 #include "s2/util/math/matrix3x3.h"
 
+S2_DECLARE_bool(s2polygon_minimize_loop_indexes);
+
 using absl::StrCat;
 using s2builderutil::IntLatLngSnapFunction;
 using s2builderutil::S2PolygonLayer;
@@ -1789,6 +1794,217 @@ TEST_F(S2PolygonTestBase, Splitting) {
   SplitAndAssemble(*far_H_south_H_);
 }
 
+TEST(S2Polygon, ParallelDestructiveUnion) {
+  // Split a polygon into pieces and check that the parallel union
+  // reassembles it, independent of the number of threads.
+  S2Polygon polygon(S2Loop::MakeRegularLoop(
+      S2Point(1, 2, 3).Normalize(), S1Angle::Degrees(5), 100));
+  S2RegionCoverer::Options options;
+  options.set_max_cells(50);
+  S2CellUnion covering = S2RegionCoverer(options).GetCovering(polygon);
+  // The last result uses 4 threads taken from an executor.
+  S2ThreadPool pool(4);
+  unique_ptr<S2Polygon> results[3];
+  for (int i = 0; i < 3; ++i) {
+    vector<unique_ptr<S2Polygon>> pieces;
+    for (S2CellId cell_id : covering) {
+      auto piece = make_unique<S2Polygon>();
+      piece->InitToIntersection(polygon, S2Polygon(S2Cell(cell_id)));
+      pieces.push_back(std::move(piece));
+    }
+    auto result = S2Polygon::DestructiveUnion(
+        std::move(pieces), s2builderutil::IdentitySnapFunction(S1Angle::Zero()),
+        i == 1 ? 4 : 1, i == 2 ? &pool : nullptr);
+    EXPECT_TRUE(polygon.BoundaryNear(*result, S1Angle::Radians(2e-15)));
+    results[i] = std::move(result);
+  }
+  EXPECT_TRUE(results[0]->Equals(*results[1]));
+  EXPECT_TRUE(results[0]->Equals(*results[2]));
+
+  auto empty = S2Polygon::DestructiveUnion(
+      {}, s2builderutil::IdentitySnapFunction(), 4);
+  EXPECT_TRUE(empty->is_empty());
+}
+
+TEST(S2Polygon, ParallelInitOriented) {
+  // Build shells and holes as concentric loops with alternating orientations
+  // around several centers, and check that the result does not depend on the
+  // number of threads used to construct and normalize the loops.
+  vector<vector<S2Point>> vertices;
+  for (int c = 0; c < 10; ++c) {
+    S2Point center = S2LatLng::FromDegrees(0, 20 * c).ToPoint();
+    for (int k = 0; k < 5; ++k) {
+      auto loop = S2Loop::MakeRegularLoop(center, S1Angle::Degrees(5 - k),
+                                          20 + 10 * k);
+      S2PointLoopSpan span = loop->vertices_span();
+      vector<S2Point> v(span.begin(), span.end());
+      if (k % 2 == 1) std::reverse(v.begin(), v.end());
+      vertices.push_back(std::move(v));
+    }
+  }
+  S2Polygon expected;
+  {
+    vector<unique_ptr<S2Loop>> loops;
+    for (const auto& v : vertices) loops.push_back(make_unique<S2Loop>(v));
+    expected.InitOriented(std::move(loops));
+  }
+  ASSERT_EQ(50, expected.num_loops());
+  for (int num_threads : {1, 4}) {
+    vector<unique_ptr<S2Loop>> loops = S2Loop::MakeLoops(vertices, num_threads);
+    ASSERT_EQ(vertices.size(), loops.size());
+    for (int i = 0; i < vertices.size(); ++i) {
+      EXPECT_TRUE(loops[i]->Equals(S2Loop(vertices[i])));
+      EXPECT_EQ(S2Loop(vertices[i]).GetRectBound(), loops[i]->GetRectBound());
+    }
+    S2Polygon actual;
+    actual.InitOriented(std::move(loops), num_threads);
+    EXPECT_TRUE(expected.Equals(actual));
+    EXPECT_TRUE(actual.IsValid());
+  }
+  S2ThreadPool pool(4);
+  S2Polygon actual;
+  actual.InitOriented(
+      S2Loop::MakeLoops(vertices, 1, S2Debug::ALLOW, &pool), 1, &pool);
+  EXPECT_TRUE(expected.Equals(actual));
+}
+
+TEST(S2Polygon, MinimizeLoopIndexes) {
+  // Nesting large loops builds their indexes (see S2Loop::FindVertex).
+  S2Point center = S2Point(1, 2, 3).Normalize();
+  vector<unique_ptr<S2Loop>> loops;
+  for (int k = 0; k < 3; ++k) {
+    loops.push_back(S2Loop::MakeRegularLoop(
+        center, S1Angle::Degrees(3 - k), 1000));
+  }
+  S2Polygon polygon(std::move(loops));
+  ASSERT_EQ(3, polygon.num_loops());
+  size_t space_used = polygon.SpaceUsed();
+  size_t loop_space_used = polygon.loop(0)->SpaceUsed();
+
+  polygon.MinimizeLoopIndexes();
+  EXPECT_LT(polygon.SpaceUsed(), space_used);
+  size_t minimized_loop_space_used = polygon.loop(0)->SpaceUsed();
+  EXPECT_LT(minimized_loop_space_used, loop_space_used);
+
+  // Polygon-level queries do not rebuild the loop indexes, and loop-level
+  // queries still work.
+  // The loops are a shell, a hole, and a shell.
+  const S2Point& v0 = polygon.loop(0)->vertex(0);
+  EXPECT_TRUE(polygon.Contains(center));
+  EXPECT_FALSE(polygon.Contains(S2::Interpolate(center, v0, 0.5)));
+  EXPECT_TRUE(polygon.Contains(S2::Interpolate(center, v0, 0.8)));
+  EXPECT_EQ(minimized_loop_space_used, polygon.loop(0)->SpaceUsed());
+  EXPECT_TRUE(polygon.loop(0)->Contains(*polygon.loop(1)));
+  EXPECT_GT(polygon.loop(0)->SpaceUsed(), minimized_loop_space_used);
+
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_s2polygon_minimize_loop_indexes, true);
+  S2Polygon copy;
+  copy.Copy(&polygon);
+  EXPECT_TRUE(copy.Equals(polygon));
+  EXPECT_EQ(minimized_loop_space_used, copy.loop(0)->SpaceUsed());
+}
+
+TEST(S2Polygon, ParallelDestructiveUnionWithMemoryTracker) {
+  S2Polygon polygon(S2Loop::MakeRegularLoop(
+      S2Point(1, 2, 3).Normalize(), S1Angle::Degrees(5), 100));
+  S2RegionCoverer::Options options;
+  options.set_max_cells(50);
+  S2CellUnion covering = S2RegionCoverer(options).GetCovering(polygon);
+  auto make_pieces = [&]() {
+    vector<unique_ptr<S2Polygon>> pieces;
+    for (S2CellId cell_id : covering) {
+      auto piece = make_unique<S2Polygon>();
+      piece->InitToIntersection(polygon, S2Polygon(S2Cell(cell_id)));
+      pieces.push_back(std::move(piece));
+    }
+    return pieces;
+  };
+  const auto snap_function =
+      s2builderutil::IdentitySnapFunction(S1Angle::Zero());
+  auto expected =
+      S2Polygon::DestructiveUnion(make_pieces(), snap_function, 4);
+
+  // With no memory limit the result is the same as above.
+  S2MemoryTracker tracker;
+  unique_ptr<S2Polygon> result;
+  S2Error error;
+  ASSERT_TRUE(S2Polygon::DestructiveUnion(make_pieces(), snap_function, 4,
+                                          &tracker, &result, &error))
+      << error;
+  EXPECT_TRUE(expected->Equals(*result));
+  EXPECT_GT(tracker.max_usage_bytes(), 0);
+  EXPECT_EQ(0, tracker.usage_bytes());
+
+  // A limit smaller than the peak usage causes the union to fail.
+  S2MemoryTracker limited_tracker;
+  limited_tracker.set_limit_bytes(tracker.max_usage_bytes() / 2);
+  result.reset();
+  EXPECT_FALSE(S2Polygon::DestructiveUnion(make_pieces(), snap_function, 4,
+                                           &limited_tracker, &result, &error));
+  EXPECT_EQ(S2Error::RESOURCE_EXHAUSTED, error.code());
+  EXPECT_EQ(nullptr, result);
+}
+
+TEST(S2Polygon, InitToUnionMultiway) {
+  // Split a polygon into pieces and check that the multiway union
+  // reassembles it.
+  S2Polygon polygon(S2Loop::MakeRegularLoop(
+      S2Point(1, 2, 3).Normalize(), S1Angle::Degrees(5), 100));
+  S2RegionCoverer::Options options;
+  options.set_max_cells(50);
+  S2CellUnion covering = S2RegionCoverer(options).GetCovering(polygon);
+  vector<unique_ptr<S2Polygon>> pieces;
+  vector<const S2Polygon*> piece_ptrs;
+  for (S2CellId cell_id : covering) {
+    auto piece = make_unique<S2Polygon>();
+    piece->InitToIntersection(polygon, S2Polygon(S2Cell(cell_id)));
+    piece_ptrs.push_back(piece.get());
+    pieces.push_back(std::move(piece));
+  }
+  S2Polygon result;
+  S2Error error;
+  ASSERT_TRUE(result.InitToUnion(
+      piece_ptrs, s2builderutil::IdentitySnapFunction(S1Angle::Zero()),
+      &error)) << error;
+  EXPECT_TRUE(polygon.BoundaryNear(result, S1Angle::Radians(2e-15)));
+
+  // Empty input.
+  ASSERT_TRUE(result.InitToUnion({}, s2builderutil::IdentitySnapFunction(),
+                                 &error));
+  EXPECT_TRUE(result.is_empty());
+}
+
+TEST(S2Polygon, InitToUnionMultiwayHolesAndFull) {
+  // A polygon with a hole, plus a second polygon that fills part of the
+  // hole.
+  auto a = s2textformat::MakePolygonOrDie(
+      "0:0, 0:10, 10:10, 10:0; 2:2, 8:2, 8:8, 2:8");
+  auto b = s2textformat::MakePolygonOrDie("3:3, 3:5, 5:5, 5:3");
+  auto c = s2textformat::MakePolygonOrDie("20:20, 20:21, 21:21");
+  S2Polygon expected;
+  expected.InitToUnion(*a, *b);
+  S2Polygon expected_abc;
+  expected_abc.InitToUnion(expected, *c);
+
+  const auto snap_function = s2builderutil::IdentitySnapFunction();
+  S2Polygon result;
+  S2Error error;
+  ASSERT_TRUE(result.InitToUnion({a.get(), b.get(), c.get()}, snap_function,
+                                 &error)) << error;
+  EXPECT_TRUE(result.BoundaryNear(expected_abc, S1Angle::Radians(1e-15)));
+
+  // The result may be one of the inputs.
+  ASSERT_TRUE(a->InitToUnion({a.get(), b.get()}, snap_function, &error));
+  EXPECT_TRUE(a->BoundaryNear(expected, S1Angle::Radians(1e-15)));
+
+  // The union with the full polygon is full.
+  auto full = s2textformat::MakePolygonOrDie("full");
+  ASSERT_TRUE(result.InitToUnion({b.get(), full.get()}, snap_function,
+                                 &error));
+  EXPECT_TRUE(result.is_full());
+}
+
 TEST(S2Polygon, InitToCellUnionBorder) {
   // Test S2Polygon::InitToCellUnionBorder().
   // The main thing to check is that adjacent cells of different sizes get
@@ -2075,6 +2291,82 @@ TEST_F(S2PolygonTestBase, CompressedEncodedPolygonDecodesApproxEqual) {
   EXPECT_EQ(1, decoded_polygon.loop(1)->depth());
 }
 
+// Checks that the EncodedS2Polygon initialized from the given encoding has
+// the same properties as "expected".
+static void TestEncodedS2Polygon(const S2Polygon& expected,
+                                 const Encoder& encoder) {
+  Decoder decoder(encoder.base(), encoder.length());
+  EncodedS2Polygon actual;
+  ASSERT_TRUE(actual.Init(&decoder));
+  EXPECT_EQ(0, decoder.avail());
+  ASSERT_EQ(expected.num_loops(), actual.num_loops());
+  EXPECT_EQ(expected.num_vertices(), actual.num_vertices());
+  for (int i = 0; i < expected.num_loops(); ++i) {
+    EXPECT_EQ(expected.loop(i)->num_vertices(), actual.loop_num_vertices(i));
+    EXPECT_EQ(expected.loop(i)->depth(), actual.loop_depth(i));
+    EXPECT_TRUE(expected.loop(i)->Equals(*actual.DecodeLoop(i)));
+  }
+  EXPECT_TRUE(expected.Equals(*actual.Decode()));
+  EXPECT_EQ(expected.GetRectBound(), actual.GetRectBound());
+  EXPECT_EQ(expected.GetArea(), actual.GetArea());
+  S2LatLngRect bound = expected.GetRectBound().Expanded(
+      S2LatLng::FromDegrees(1, 1));
+  for (int i = 0; i < 1000; ++i) {
+    S2Point p = bound.is_empty() ? S2Testing::RandomPoint()
+                                 : S2Testing::SamplePoint(bound);
+    ASSERT_EQ(expected.Contains(p), actual.Contains(p));
+  }
+}
+
+TEST(EncodedS2Polygon, MatchesDecodedPolygon) {
+  // The shells have more and fewer vertices than the threshold at which
+  // compressed loops store their bound (64).
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  vector<unique_ptr<S2Loop>> loops;
+  S2Point center = S2LatLng::FromDegrees(10, 20).ToPoint();
+  loops.push_back(S2Loop::MakeRegularLoop(center, S1Angle::Degrees(5), 100));
+  loops.push_back(S2Loop::MakeRegularLoop(center, S1Angle::Degrees(2), 10));
+  loops.push_back(S2Loop::MakeRegularLoop(
+      S2LatLng::FromDegrees(10, 35).ToPoint(), S1Angle::Degrees(3), 20));
+  S2Polygon polygon(std::move(loops));
+
+  Encoder uncompressed;
+  polygon.EncodeUncompressed(&uncompressed);
+  TestEncodedS2Polygon(polygon, uncompressed);
+
+  S2Polygon snapped;
+  snapped.InitToSnapped(polygon);
+  Encoder compressed;
+  snapped.Encode(&compressed);
+  ASSERT_LT(compressed.length(), uncompressed.length());
+  TestEncodedS2Polygon(snapped, compressed);
+}
+
+TEST(EncodedS2Polygon, EmptyAndFull) {
+  S2Polygon empty;
+  Encoder empty_encoder;
+  empty.Encode(&empty_encoder);
+  TestEncodedS2Polygon(empty, empty_encoder);
+
+  S2Polygon full(make_unique<S2Loop>(S2Loop::kFull()));
+  Encoder full_encoder;
+  full.Encode(&full_encoder);
+  TestEncodedS2Polygon(full, full_encoder);
+}
+
+TEST(EncodedS2Polygon, TruncatedEncoding) {
+  auto polygon = s2textformat::MakePolygonOrDie("0:0, 0:2, 2:0; 5:5, 5:6, 6:5");
+  S2Polygon snapped;
+  snapped.InitToSnapped(*polygon);
+  for (const S2Polygon* p : {polygon.get(), &snapped}) {
+    Encoder encoder;
+    p->Encode(&encoder);
+    Decoder decoder(encoder.base(), encoder.length() - 1);
+    EncodedS2Polygon encoded;
+    EXPECT_FALSE(encoded.Init(&decoder));
+  }
+}
+
 // This test checks that S2Polygons created directly from S2Cells behave
 // identically to S2Polygons created from the vertices of those cells; this
 // previously was not the case, because S2Cells calculate their bounding
@@ -2091,6 +2383,34 @@ TEST(S2Polygon, TestS2CellConstructorAndContains) {
   EXPECT_TRUE(cell_as_polygon.Contains(&polygon_copy));
 }
 
+// Returns the number of calls to Contains(S2Point) that are needed before
+// the index of a polygon with the given number of vertices is built, or -1 if
+// the index is not built after "max_calls" calls.
+int GetNumContainsCallsBeforeIndexing(int num_vertices, int max_calls) {
+  const S2Point center = S2LatLng::FromDegrees(10, 10).ToPoint();
+  // Validation would build the index.
+  S2Polygon polygon(S2Loop::MakeRegularLoop(center, S1Angle::Degrees(1),
+                                            num_vertices),
+                    S2Debug::DISABLE);
+  for (int i = 0; i < max_calls; ++i) {
+    if (polygon.index().is_fresh()) return i;
+    EXPECT_TRUE(polygon.Contains(center));
+  }
+  return polygon.index().is_fresh() ? max_calls : -1;
+}
+
+TEST(S2Polygon, ContainsPointBuildsIndexAdaptively) {
+  // Polygons with few vertices never build their index, while polygons with
+  // slightly more vertices than that need more calls to do so than large
+  // polygons.
+  EXPECT_EQ(-1, GetNumContainsCallsBeforeIndexing(10, 1000));
+  int small_calls = GetNumContainsCallsBeforeIndexing(40, 1000);
+  int large_calls = GetNumContainsCallsBeforeIndexing(1000, 1000);
+  EXPECT_GT(small_calls, large_calls);
+  EXPECT_GE(large_calls, 20);
+  EXPECT_LE(large_calls, 25);
+}
+
 TEST(S2PolygonTest, Project) {
   unique_ptr<S2Polygon> polygon(MakePolygon(kNear0 + kNear2));
   S2Point point;
@@ -2844,7 +3164,14 @@ class S2PolygonDecodeTest : public ::testing::Test {
     polygon.set_s2debug_override(S2Debug::DISABLE);
     // This is expected to fail sometimes, and we don't know when,
     // so we don't check the return value.
-    static_cast<void>(polygon.Decode(&decoder_));
+    const char* data = decoder_.skip(0);
+    const size_t size = decoder_.avail();
+    bool success = polygon.Decode(&decoder_);
+
+    // EncodedS2Polygon accepts exactly the same encodings.
+    Decoder decoder(data, size);
+    EncodedS2Polygon encoded;
+    EXPECT_EQ(success, encoded.Init(&decoder));
   }
 
   // Random number generator.
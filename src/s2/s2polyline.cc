@@ -19,19 +19,23 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <functional>
 #include <memory>
-#include <set>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 #include "absl/container/fixed_array.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
+#include "absl/hash/hash.h"
 #include "absl/memory/memory.h"
 #include "absl/utility/utility.h"
 
 #include "s2/base/commandlineflags.h"
 #include "s2/base/logging.h"
+#include "s2/mutable_s2shape_index.h"
 #include "s2/s1angle.h"
 #include "s2/s1interval.h"
 #include "s2/s2builderutil_s2polyline_layer.h"
@@ -48,6 +52,7 @@
 #include "s2/s2pointutil.h"
 #include "s2/s2polyline_measures.h"
 #include "s2/s2predicates.h"
+#include "s2/s2shapeutil_visit_crossing_edge_pairs.h"
 #include "s2/util/coding/coder.h"
 #include "s2/util/math/matrix3x3.h"
 
@@ -57,7 +62,6 @@ using s2builderutil::S2PolylineLayer;
 using absl::make_unique;
 using std::max;
 using std::min;
-using std::set;
 using std::vector;
 
 static const unsigned char kCurrentLosslessEncodingVersionNumber = 1;
@@ -345,16 +349,25 @@ bool S2Polyline::Intersects(const S2Polyline& line) const {
     return false;
   }
 
-  // TODO(ericv): Use S2ShapeIndex here.
-  for (int i = 1; i < num_vertices(); ++i) {
-    S2EdgeCrosser crosser(&vertex(i - 1), &vertex(i), &line.vertex(0));
-    for (int j = 1; j < line.num_vertices(); ++j) {
-      if (crosser.CrossingSign(&line.vertex(j)) >= 0) {
-        return true;
-      }
+  // Testing every pair of edges is faster unless both polylines are long.
+  static constexpr int kMinVerticesForIndex = 32;
+  if (min(num_vertices(), line.num_vertices()) < kMinVerticesForIndex) {
+    absl::Span<const S2Point> chain(&line.vertex(0), line.num_vertices());
+    for (int i = 1; i < num_vertices(); ++i) {
+      S2EdgeCrosser crosser(&vertex(i - 1), &vertex(i));
+      if (crosser.FirstChainCrossing(chain) >= 0) return true;
     }
+    return false;
   }
-  return false;
+  MutableS2ShapeIndex a_index, b_index;
+  a_index.Add(make_unique<Shape>(this));
+  b_index.Add(make_unique<Shape>(&line));
+  return !s2shapeutil::VisitCrossingEdgePairs(
+      a_index, b_index, s2shapeutil::CrossingType::ALL,
+      [](const s2shapeutil::ShapeEdge& a, const s2shapeutil::ShapeEdge& b,
+         bool is_interior) {
+        return false;  // Stop at the first crossing.
+      });
 }
 
 void S2Polyline::Reverse() {
@@ -365,9 +378,7 @@ void S2Polyline::Reverse() {
 
 S2LatLngRect S2Polyline::GetRectBound() const {
   S2LatLngRectBounder bounder;
-  for (int i = 0; i < num_vertices(); ++i) {
-    bounder.AddPoint(vertex(i));
-  }
+  bounder.AddPoints(vertices_span());
   return bounder.GetBound();
 }
 
@@ -677,13 +688,17 @@ struct SearchState {
   bool i_in_progress;
 };
 
-// This operator is needed for storing SearchStates in a set.  The ordering
-// chosen has no special meaning.
-struct SearchStateKeyCompare {
-  bool operator() (const SearchState& a, const SearchState& b) const {
-    if (a.i != b.i) return a.i < b.i;
-    if (a.j != b.j) return a.j < b.j;
-    return a.i_in_progress < b.i_in_progress;
+// These operators are needed for storing SearchStates in a hash set.
+struct SearchStateHash {
+  size_t operator()(const SearchState& s) const {
+    return absl::Hash<std::tuple<int, int, bool>>()(
+        std::make_tuple(s.i, s.j, s.i_in_progress));
+  }
+};
+
+struct SearchStateEqual {
+  bool operator()(const SearchState& a, const SearchState& b) const {
+    return a.i == b.i && a.j == b.j && a.i_in_progress == b.i_in_progress;
   }
 };
 
@@ -731,15 +746,13 @@ bool S2Polyline::NearlyCovers(const S2Polyline& covered,
   // of visited states to avoid duplicating work.  With the set, the worst-case
   // number of states examined is O(n+m) where n = this->num_vertices() and m =
   // covered.num_vertices().  Without it, the amount of work could be as high as
-  // O((n*m)^2).  Using set, the running time is O((n*m) log (n*m)).
-  //
-  // TODO(user): Benchmark this, and see if the set is worth it.
+  // O((n*m)^2).  Using a hash set, the expected running time is O(n*m).
 
   if (covered.num_vertices() == 0) return true;
   if (this->num_vertices() == 0) return false;
 
   vector<SearchState> pending;
-  set<SearchState, SearchStateKeyCompare> done;
+  absl::flat_hash_set<SearchState, SearchStateHash, SearchStateEqual> done;
 
   // Find all possible starting states.
   for (int i = 0, next_i = NextDistinctVertex(*this, 0), next_next_i;
@@ -807,3 +820,71 @@ S2Shape::Chain S2Polyline::Shape::chain(int i) const {
   S2_DCHECK_EQ(i, 0);
   return Chain(0, Shape::num_edges());  // Avoid virtual call.
 }
+
+bool EncodedS2Polyline::Init(Decoder* decoder) {
+  data_ = decoder->skip(0);
+  if (decoder->avail() < sizeof(uint8)) return false;
+  const unsigned char version = decoder->get8();
+  if (version == kCurrentLosslessEncodingVersionNumber) {
+    compressed_ = false;
+    if (decoder->avail() < sizeof(uint32)) return false;
+    const uint32 num_vertices = decoder->get32();
+    if (decoder->avail() < num_vertices * sizeof(S2Point)) return false;
+    num_vertices_ = num_vertices;
+    vertex_data_ = decoder->skip(num_vertices * sizeof(S2Point));
+  } else if (version == kCurrentCompressedEncodingVersionNumber) {
+    compressed_ = true;
+    if (decoder->avail() < sizeof(uint8)) return false;
+    snap_level_ = decoder->get8();
+    if (snap_level_ > S2::kMaxCellLevel) return false;
+    uint32 num_vertices;
+    if (!decoder->get_varint32(&num_vertices)) return false;
+    num_vertices_ = num_vertices;
+    vertex_data_ = decoder->skip(0);
+    // Like S2Polyline::Decode(), empty polylines do not consume the rest of
+    // the (empty) point encoding.
+    if (num_vertices > 0 &&
+        !S2SkipPointsCompressed(decoder, snap_level_, num_vertices)) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+  size_ = decoder->skip(0) - data_;
+  return true;
+}
+
+void EncodedS2Polyline::GetVertices(vector<S2Point>* vertices) const {
+  vertices->resize(num_vertices_);
+  if (num_vertices_ == 0) return;
+  const char* limit = data_ + size_;
+  if (compressed_) {
+    Decoder decoder(vertex_data_, limit - vertex_data_);
+    S2_CHECK(S2DecodePointsCompressed(&decoder, snap_level_,
+                                      absl::MakeSpan(*vertices)));
+  } else {
+    // The vertices may not be aligned, so they are copied.
+    memcpy(vertices->data(), vertex_data_, num_vertices_ * sizeof(S2Point));
+  }
+}
+
+std::unique_ptr<S2Polyline> EncodedS2Polyline::Decode() const {
+  auto polyline = make_unique<S2Polyline>();
+  Decoder decoder(data_, size_);
+  S2_CHECK(polyline->Decode(&decoder));
+  return polyline;
+}
+
+S2LatLngRect EncodedS2Polyline::GetRectBound() const {
+  vector<S2Point> vertices;
+  GetVertices(&vertices);
+  S2LatLngRectBounder bounder;
+  bounder.AddPoints(vertices);
+  return bounder.GetBound();
+}
+
+S1Angle EncodedS2Polyline::GetLength() const {
+  vector<S2Point> vertices;
+  GetVertices(&vertices);
+  return S2::GetLength(vertices);
+}
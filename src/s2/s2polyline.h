@@ -164,6 +164,7 @@ class S2Polyline final : public S2Region {
   // given fraction of the polyline's total length.  Fractions less than zero
   // or greater than one are clamped.  The return value is unit length.  This
   // cost of this function is currently linear in the number of vertices.
+  // (See S2PolylineProjector for a version that takes logarithmic time.)
   // The polyline must not be empty.
   S2Point Interpolate(double fraction) const;
 
@@ -198,7 +199,8 @@ class S2Polyline final : public S2Region {
   // Given a point, returns a point on the polyline that is closest to the given
   // point.  See GetSuffix() for the meaning of "next_vertex", which is chosen
   // here w.r.t. the projected point as opposed to the interpolated point in
-  // GetSuffix().
+  // GetSuffix().  The cost of this function is linear in the number of
+  // vertices (see S2PolylineProjector).
   //
   // The polyline must be non-empty.
   S2Point Project(const S2Point& point, int* next_vertex) const;
@@ -216,9 +218,10 @@ class S2Polyline final : public S2Region {
   // polyline endpoint is the only intersection with the other polyline, the
   // function may return true or false arbitrarily.
   //
-  // The running time is quadratic in the number of vertices.  (To intersect
-  // polylines more efficiently, or compute the actual intersection geometry,
-  // use S2BooleanOperation.)
+  // Unless both polylines are short, this method builds a temporary
+  // S2ShapeIndex for each polyline and visits candidate edge pairs, so the
+  // running time is roughly linear in the number of vertices.  (To compute
+  // the actual intersection geometry, use S2BooleanOperation.)
   bool Intersects(const S2Polyline& line) const;
 #ifndef SWIG
   ABSL_DEPRECATED("Inline the implementation")
@@ -371,6 +374,11 @@ class S2Polyline final : public S2Region {
     ChainPosition chain_position(int e) const final {
       return ChainPosition(0, e);
     }
+    S2PointSpan GetChainVertices(int i,
+                                 std::vector<S2Point>* tmp) const final {
+      S2_DCHECK_EQ(i, 0);
+      return polyline_->vertices_span();
+    }
     TypeTag type_tag() const override { return kTypeTag; }
 
     void Encode(Encoder* encoder, s2coding::CodingHint hint) const override {
@@ -450,4 +458,50 @@ class S2Polyline final : public S2Region {
 #endif  // SWIG
 };
 
+// EncodedS2Polyline is a read-only view of a polyline encoded by
+// S2Polyline::Encode() or S2Polyline::EncodeMostCompact().  Initialization
+// only reads the header (the vertices of compressed polylines are skipped
+// without being decoded), and the vertices are decoded only when they are
+// needed.  Unlike S2Polyline::Decode(), this class never validates the
+// polyline, so methods such as GetRectBound() and GetLength() are much
+// cheaper than decoding the polyline when --s2debug is enabled.
+//
+// The results of all methods are identical to those of the decoded
+// S2Polyline.  All methods are const and may be called concurrently.
+class EncodedS2Polyline {
+ public:
+  // Constructs an uninitialized object; requires Init() to be called.
+  EncodedS2Polyline() {}
+
+  // Initializes the view and advances "decoder" past the encoded polyline.
+  // Returns false if the encoding is invalid.
+  //
+  // REQUIRES: The Decoder data buffer must outlive this object.
+  bool Init(Decoder* decoder);
+
+  int num_vertices() const { return num_vertices_; }
+
+  // Decodes the vertices into "*vertices".  (Init() validates the entire
+  // encoding, so this cannot fail.)
+  void GetVertices(std::vector<S2Point>* vertices) const;
+
+  // Decodes the polyline.  Note that this validates the polyline when
+  // --s2debug is enabled, just like S2Polyline::Decode().
+  std::unique_ptr<S2Polyline> Decode() const;
+
+  // Return the same results as the corresponding S2Polyline methods.
+  S2LatLngRect GetRectBound() const;
+  S1Angle GetLength() const;
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool compressed_ = false;
+  int snap_level_ = 0;
+  int num_vertices_ = 0;
+
+  // The encoded vertices (excluding the header).
+  const char* vertex_data_ = nullptr;
+};
+
 #endif  // S2_S2POLYLINE_H_
@@ -17,6 +17,7 @@
 #include "s2/s2polyline_alignment.h"
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <numeric>
 #include <sstream>
@@ -24,8 +25,10 @@
 #include <utility>
 #include <vector>
 
+#include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
 #include "absl/memory/memory.h"
+#include "s2/s2executor.h"
 #include "s2/s2polyline_alignment_internal.h"
 #include "s2/util/math/mathutil.h"
 
@@ -105,6 +108,23 @@ Window Window::Dilate(const int radius) const {
   return Window(new_strides);
 }
 
+ColumnStride BandColumnStride(const int row, const int rows, const int cols,
+                              const int radius) {
+  // The products may exceed the range of an int for very long polylines.
+  const int start = int64{row} * cols / rows;
+  const int end = (int64{row + 1} * cols + rows - 1) / rows;
+  return {std::max(0, start - radius), std::min(end + radius, cols)};
+}
+
+Window BandWindow(const int rows, const int cols, const int radius) {
+  S2_DCHECK(radius >= 0) << "Negative band radius.";
+  std::vector<ColumnStride> strides(rows);
+  for (int row = 0; row < rows; ++row) {
+    strides[row] = BandColumnStride(row, rows, cols, radius);
+  }
+  return Window(strides);
+}
+
 // Debug string implemented primarily for testing purposes.
 string Window::DebugString() const {
   std::stringstream buffer;
@@ -143,26 +163,55 @@ bool Window::IsValid() const {
   return true;
 }
 
+// The DP table for DynamicTimewarp.  Only the cells inside the search window
+// are stored, packed contiguously row by row, so the table needs space
+// proportional to the number of cells in the window rather than rows * cols.
+// A single WindowCostTable is reused by all the DynamicTimewarp calls made
+// while computing one approximate alignment, so that its buffers are only
+// allocated once.
+class WindowCostTable {
+ public:
+  // Resizes the table to hold the cells of the first "rows" rows of "w".
+  void Init(const Window& w, const int rows) {
+    offsets_.resize(rows);
+    int size = 0;
+    for (int row = 0; row < rows; ++row) {
+      const ColumnStride stride = w.GetColumnStride(row);
+      offsets_[row] = size - stride.start;
+      size += stride.end - stride.start;
+    }
+    costs_.resize(size);
+  }
+
+  // REQUIRES: (row, col) is inside the window.
+  double& operator()(const int row, const int col) {
+    return costs_[offsets_[row] + col];
+  }
+  double operator()(const int row, const int col) const {
+    return costs_[offsets_[row] + col];
+  }
+
+ private:
+  std::vector<int> offsets_;
+  std::vector<double> costs_;
+};
+
 inline double BoundsCheckedTableCost(const int row, const int col,
                                      const ColumnStride& stride,
-                                     const CostTable& table) {
+                                     const WindowCostTable& table) {
   if (row < 0 && col < 0) {
     return 0.0;
   } else if (row < 0 || col < 0 || !stride.InRange(col)) {
     return DOUBLE_MAX;
   } else {
-    return table[row][col];
+    return table(row, col);
   }
 }
 
 // Perform dynamic timewarping by filling in the DP table on cells that are
-// inside our search window. For an exact (all-squares) evaluation, this
-// incurs bounds checking overhead - we don't need to ensure that we're inside
-// the appropriate cells in the window, because it's guaranteed. Structuring
-// the program to reuse code for both the EXACT and WINDOWED cases by
-// abstracting EXACT as a window with full-covering strides is done for
-// maintainability reasons. One potential optimization here might be to overload
-// this function to skip bounds checking when the window is full.
+// inside our search window. Structuring the program to reuse code for both
+// the EXACT and WINDOWED cases by abstracting EXACT as a window with
+// full-covering strides is done for maintainability reasons.
 //
 // As a note of general interest, the Dynamic Timewarp algorithm as stated here
 // prefers shorter warp paths, when two warp paths might be equally costly. This
@@ -175,24 +224,36 @@ inline double BoundsCheckedTableCost(const int row, const int col,
 // This is the hottest routine in the whole package, please be careful to
 // profile any future changes made here.
 //
-// This method takes time proportional to the number of cells in the window,
-// which can range from O(max(a, b)) cells (best) to O(a*b) cells (worst)
+// This method takes time and space proportional to the number of cells in the
+// window, which can range from O(max(a, b)) cells (best) to O(a*b) cells
+// (worst).  "costs" is scratch space that may be reused across calls.
 VertexAlignment DynamicTimewarp(const S2Polyline& a, const S2Polyline& b,
-                                const Window& w) {
+                                const Window& w, WindowCostTable* costs_ptr) {
   const int rows = a.num_vertices();
-  const int cols = b.num_vertices();
-  auto costs = CostTable(rows, std::vector<double>(cols));
+  WindowCostTable& costs = *costs_ptr;
+  costs.Init(w, rows);
 
+  // Each cell is the cheapest of its three predecessors plus the distance
+  // between the two vertices.  The left predecessor is the cell we just
+  // computed, so it is carried in a register rather than reloaded.
   ColumnStride curr;
   ColumnStride prev = ColumnStride::All();
   for (int row = 0; row < rows; ++row) {
     curr = w.GetColumnStride(row);
+    const S2Point& a_vertex = a.vertex(row);
+    double l_cost = (row == 0) ? 0.0 : DOUBLE_MAX;
     for (int col = curr.start; col < curr.end; ++col) {
-      double d_cost = BoundsCheckedTableCost(row - 1, col - 1, prev, costs);
-      double u_cost = BoundsCheckedTableCost(row - 1, col - 0, prev, costs);
-      double l_cost = BoundsCheckedTableCost(row - 0, col - 1, curr, costs);
-      costs[row][col] = std::min({d_cost, u_cost, l_cost}) +
-                        (a.vertex(row) - b.vertex(col)).Norm2();
+      double prev_min;
+      if (row == 0) {
+        prev_min = l_cost;
+      } else {
+        double d_cost = prev.InRange(col - 1) ? costs(row - 1, col - 1)
+                                              : DOUBLE_MAX;
+        double u_cost = prev.InRange(col) ? costs(row - 1, col) : DOUBLE_MAX;
+        prev_min = std::min({d_cost, u_cost, l_cost});
+      }
+      l_cost = prev_min + (a_vertex - b.vertex(col)).Norm2();
+      costs(row, col) = l_cost;
     }
     prev = curr;
   }
@@ -231,7 +292,7 @@ VertexAlignment DynamicTimewarp(const S2Polyline& a, const S2Polyline& b,
     }
   }
   std::reverse(warp_path.begin(), warp_path.end());
-  return VertexAlignment(costs.back().back(), warp_path);
+  return VertexAlignment(costs(rows - 1, b.num_vertices() - 1), warp_path);
 }
 
 std::unique_ptr<S2Polyline> HalfResolution(const S2Polyline& in) {
@@ -280,19 +341,23 @@ double GetExactVertexAlignmentCost(const S2Polyline& a, const S2Polyline& b) {
   return cost.back();
 }
 
+namespace {
+
 VertexAlignment GetExactVertexAlignment(const S2Polyline& a,
-                                        const S2Polyline& b) {
+                                        const S2Polyline& b,
+                                        WindowCostTable* costs) {
   const int a_n = a.num_vertices();
   const int b_n = b.num_vertices();
   S2_CHECK(a_n > 0) << "A is empty polyline.";
   S2_CHECK(b_n > 0) << "B is empty polyline.";
   const auto w = Window(std::vector<ColumnStride>(a_n, {0, b_n}));
-  return DynamicTimewarp(a, b, w);
+  return DynamicTimewarp(a, b, w, costs);
 }
 
 VertexAlignment GetApproxVertexAlignment(const S2Polyline& a,
                                          const S2Polyline& b,
-                                         const int radius) {
+                                         const int radius,
+                                         WindowCostTable* costs) {
   // Determined experimentally, through benchmarking, as about the points at
   // which ExactAlignment is faster than ApproxAlignment, so we use these as
   // our switchover points to exact computation mode.
@@ -307,13 +372,13 @@ VertexAlignment GetApproxVertexAlignment(const S2Polyline& a,
   // If we've hit the point where doing a full, direct solve is guaranteed to
   // be faster, then terminate the recursion and do that.
   if (a_n - radius < kSizeSwitchover || b_n - radius < kSizeSwitchover) {
-    return GetExactVertexAlignment(a, b);
+    return GetExactVertexAlignment(a, b, costs);
   }
 
   // If we've hit the point where the window will be probably be so full that we
   // might as well compute an exact solution, then terminate recursion to do so.
   if (std::max(a_n, b_n) * (2 * radius + 1) > a_n * b_n * kDensitySwitchover) {
-    return GetExactVertexAlignment(a, b);
+    return GetExactVertexAlignment(a, b, costs);
   }
 
   // Otherwise, shrink the input polylines, recursively compute the vertex
@@ -321,9 +386,73 @@ VertexAlignment GetApproxVertexAlignment(const S2Polyline& a,
   // the projected alignment `proj` on an upsampled, dilated window.
   const auto a_half = HalfResolution(a);
   const auto b_half = HalfResolution(b);
-  const auto proj = GetApproxVertexAlignment(*a_half, *b_half, radius);
+  const auto proj = GetApproxVertexAlignment(*a_half, *b_half, radius, costs);
   const auto w = Window(proj.warp_path).Upsample(a_n, b_n).Dilate(radius);
-  return DynamicTimewarp(a, b, w);
+  return DynamicTimewarp(a, b, w, costs);
+}
+
+}  // namespace
+
+VertexAlignment GetExactVertexAlignment(const S2Polyline& a,
+                                        const S2Polyline& b) {
+  WindowCostTable costs;
+  return GetExactVertexAlignment(a, b, &costs);
+}
+
+VertexAlignment GetApproxVertexAlignment(const S2Polyline& a,
+                                         const S2Polyline& b,
+                                         const int radius) {
+  WindowCostTable costs;
+  return GetApproxVertexAlignment(a, b, radius, &costs);
+}
+
+VertexAlignment GetBandedVertexAlignment(const S2Polyline& a,
+                                         const S2Polyline& b,
+                                         const int radius) {
+  const int a_n = a.num_vertices();
+  const int b_n = b.num_vertices();
+  S2_CHECK(a_n > 0) << "A is empty polyline.";
+  S2_CHECK(b_n > 0) << "B is empty polyline.";
+  S2_CHECK(radius >= 0) << "Radius is negative.";
+  WindowCostTable costs;
+  return DynamicTimewarp(a, b, BandWindow(a_n, b_n, radius), &costs);
+}
+
+// This is the same recurrence as DynamicTimewarp restricted to the band, but
+// only the previous and current rows of the DP table are kept.  Each row is
+// stored starting at its first column in the band.
+double GetBandedVertexAlignmentCost(const S2Polyline& a, const S2Polyline& b,
+                                    const int radius) {
+  const int a_n = a.num_vertices();
+  const int b_n = b.num_vertices();
+  S2_CHECK(a_n > 0) << "A is empty polyline.";
+  S2_CHECK(b_n > 0) << "B is empty polyline.";
+  S2_CHECK(radius >= 0) << "Radius is negative.";
+  std::vector<double> prev_costs, curr_costs;
+  ColumnStride prev = {0, 0};
+  for (int row = 0; row < a_n; ++row) {
+    const ColumnStride curr = BandColumnStride(row, a_n, b_n, radius);
+    curr_costs.resize(curr.end - curr.start);
+    const S2Point& a_vertex = a.vertex(row);
+    double l_cost = (row == 0) ? 0.0 : DOUBLE_MAX;
+    for (int col = curr.start; col < curr.end; ++col) {
+      double prev_min;
+      if (row == 0) {
+        prev_min = l_cost;
+      } else {
+        double d_cost = prev.InRange(col - 1)
+                            ? prev_costs[col - 1 - prev.start] : DOUBLE_MAX;
+        double u_cost = prev.InRange(col)
+                            ? prev_costs[col - prev.start] : DOUBLE_MAX;
+        prev_min = std::min({d_cost, u_cost, l_cost});
+      }
+      l_cost = prev_min + (a_vertex - b.vertex(col)).Norm2();
+      curr_costs[col - curr.start] = l_cost;
+    }
+    prev_costs.swap(curr_costs);
+    prev = curr;
+  }
+  return prev_costs.back();
 }
 
 // This method calls the approx method with a reasonable default for radius.
@@ -338,17 +467,39 @@ VertexAlignment GetApproxVertexAlignment(const S2Polyline& a,
 // alignments. Specifically, because cost_fn(a, b) = cost_fn(b, a), and
 // cost_fn(a, a) = 0, we can compute only the lower triangle of cost matrix
 // and then mirror it across the diagonal to save on cost_fn invocations.
+//
+// When options.num_threads() > 1, the pairwise costs are computed in parallel
+// (each thread repeatedly claims the next unprocessed row of the triangle) and
+// then summed in the same order as the single-threaded version, so the result
+// does not depend on the number of threads.
 int GetMedoidPolyline(const std::vector<std::unique_ptr<S2Polyline>>& polylines,
                       const MedoidOptions options) {
   const int num_polylines = polylines.size();
   const bool approx = options.approx();
   S2_CHECK_GT(num_polylines, 0);
 
+  // pair_costs[i] stores the cost of aligning [i] with [j] for all j > i.
+  std::vector<std::vector<double>> pair_costs(num_polylines);
+  std::atomic<int> next_row(0);
+  auto compute_rows = [&]() {
+    for (int i; (i = next_row++) < num_polylines;) {
+      pair_costs[i].reserve(num_polylines - i - 1);
+      for (int j = i + 1; j < num_polylines; ++j) {
+        pair_costs[i].push_back(CostFn(*polylines[i], *polylines[j], approx));
+      }
+    }
+  };
+  const int num_threads = std::min(
+      S2NumThreads(options.executor(), options.num_threads()),
+      num_polylines - 1);
+  S2ParallelFor(options.executor(), std::max(1, num_threads),
+                [&](int) { compute_rows(); });
+
   // costs[i] stores total cost of aligning [i] with all other polylines.
   std::vector<double> costs(num_polylines, 0.0);
   for (int i = 0; i < num_polylines; ++i) {
     for (int j = i + 1; j < num_polylines; ++j) {
-      double cost = CostFn(*polylines[i], *polylines[j], approx);
+      double cost = pair_costs[i][j - i - 1];
       costs[i] += cost;
       costs[j] += cost;
     }
@@ -388,20 +539,38 @@ std::unique_ptr<S2Polyline> GetConsensusPolyline(
   if (options.seed_medoid()) {
     MedoidOptions medoid_options;
     medoid_options.set_approx(approx);
+    medoid_options.set_num_threads(options.num_threads());
+    medoid_options.set_executor(options.executor());
     seed_index = GetMedoidPolyline(polylines, medoid_options);
   }
   auto consensus = std::unique_ptr<S2Polyline>(polylines[seed_index]->Clone());
   const int num_consensus_vertices = consensus->num_vertices();
   S2_DCHECK_GT(num_consensus_vertices, 1);
 
+  // The alignments of each iteration are independent, so they are computed
+  // in parallel when options.num_threads() > 1.  The aligned vertices are then
+  // summed in input order so that the result does not depend on the number
+  // of threads.
+  const int num_threads = std::min(
+      S2NumThreads(options.executor(), options.num_threads()), num_polylines);
+  std::vector<WarpPath> warp_paths(num_polylines);
   bool converged = false;
   int iterations = 0;
   while (!converged && iterations < options.iteration_cap()) {
+    std::atomic<int> next_polyline(0);
+    auto compute_alignments = [&]() {
+      for (int i; (i = next_polyline++) < num_polylines;) {
+        warp_paths[i] =
+            AlignmentFn(*consensus, *polylines[i], approx).warp_path;
+      }
+    };
+    S2ParallelFor(options.executor(), num_threads,
+                  [&](int) { compute_alignments(); });
+
     std::vector<S2Point> points(num_consensus_vertices, S2Point());
-    for (const auto& polyline : polylines) {
-      const auto alignment = AlignmentFn(*consensus, *polyline, approx);
-      for (const auto& pair : alignment.warp_path) {
-        points[pair.first] += polyline->vertex(pair.second);
+    for (int i = 0; i < num_polylines; ++i) {
+      for (const auto& pair : warp_paths[i]) {
+        points[pair.first] += polylines[i]->vertex(pair.second);
       }
     }
     for (S2Point& p : points) {
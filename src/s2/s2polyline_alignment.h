@@ -20,6 +20,8 @@
 #include <memory>
 #include <vector>
 
+#include "s2/base/logging.h"
+#include "s2/s2executor.h"
 #include "s2/s2polyline.h"
 
 // This library provides code to compute vertex alignments between S2Polylines.
@@ -156,6 +158,24 @@ VertexAlignment GetApproxVertexAlignment(const S2Polyline& a,
 VertexAlignment GetApproxVertexAlignment(const S2Polyline& a,
                                          const S2Polyline& b);
 
+// GetBandedVertexAlignment takes two non-empty polylines `a` and `b` as input,
+// and returns the optimal vertex alignment among those whose warp path stays
+// within a fixed Sakoe-Chiba band around the diagonal. Vertex a.vertex(i) may
+// only be paired with vertices of `b` within `radius` positions of index
+// i * B / A. Unlike GetApproxVertexAlignment, no coarser alignments are
+// computed, so there are no intermediate polylines or recursion levels. This
+// method is O(A * radius + B) in both space and time complexity.
+VertexAlignment GetBandedVertexAlignment(const S2Polyline& a,
+                                         const S2Polyline& b, const int radius);
+
+// GetBandedVertexAlignmentCost returns the cost of the alignment computed by
+// GetBandedVertexAlignment, keeping only two rows of the band in memory. This
+// method is O(A * radius + B) in time but only O(B / A + radius) in space,
+// which makes it suitable for comparing very long polylines (e.g. GPS traces
+// with hundreds of thousands of vertices).
+double GetBandedVertexAlignmentCost(const S2Polyline& a, const S2Polyline& b,
+                                    const int radius);
+
 // GetMedoidPolyline returns the index `p` of a "medoid" polyline from a
 // non-empty collection of `polylines` such that
 //
@@ -178,8 +198,28 @@ class MedoidOptions {
   bool approx() const { return approx_; }
   void set_approx(bool approx) { approx_ = approx; }
 
+  // The maximum number of threads used to compute the pairwise alignment
+  // costs.  The result does not depend on this value.
+  //
+  // DEFAULT: 1
+  int num_threads() const { return num_threads_; }
+  void set_num_threads(int num_threads) {
+    S2_DCHECK_GE(num_threads, 1);
+    num_threads_ = num_threads;
+  }
+
+  // If non-null, the work is run on this executor rather than on newly
+  // created threads, and num_threads() is replaced by
+  // executor->num_threads().
+  //
+  // DEFAULT: nullptr
+  S2Executor* executor() const { return executor_; }
+  void set_executor(S2Executor* executor) { executor_ = executor; }
+
  private:
   bool approx_ = true;
+  int num_threads_ = 1;
+  S2Executor* executor_ = nullptr;
 };
 
 int GetMedoidPolyline(const std::vector<std::unique_ptr<S2Polyline>>& polylines,
@@ -232,10 +272,31 @@ class ConsensusOptions {
   int iteration_cap() const { return iteration_cap_; }
   void set_iteration_cap(int iteration_cap) { iteration_cap_ = iteration_cap; }
 
+  // The maximum number of threads used to compute the vertex alignments of
+  // each refining step (and the medoid, if seed_medoid = true).  The result
+  // does not depend on this value.
+  //
+  // DEFAULT: 1
+  int num_threads() const { return num_threads_; }
+  void set_num_threads(int num_threads) {
+    S2_DCHECK_GE(num_threads, 1);
+    num_threads_ = num_threads;
+  }
+
+  // If non-null, the work is run on this executor rather than on newly
+  // created threads, and num_threads() is replaced by
+  // executor->num_threads().
+  //
+  // DEFAULT: nullptr
+  S2Executor* executor() const { return executor_; }
+  void set_executor(S2Executor* executor) { executor_ = executor; }
+
  private:
   bool approx_ = true;
   bool seed_medoid_ = false;
   int iteration_cap_ = 5;
+  int num_threads_ = 1;
+  S2Executor* executor_ = nullptr;
 };
 
 std::unique_ptr<S2Polyline> GetConsensusPolyline(
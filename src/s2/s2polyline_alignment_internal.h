@@ -123,7 +123,7 @@ class Window {
   // Return the (bounds-checked) stride for this row.
   // If row < 0, returns ColumnStride::All()
   inline ColumnStride GetCheckedColumnStride(const int row) const {
-    return (row > 0) ? strides_[row] : ColumnStride::All();
+    return (row >= 0) ? strides_[row] : ColumnStride::All();
   }
 
   // Return a new, larger Window that is an upscaled version of this window
@@ -154,5 +154,16 @@ class Window {
 // Constructs and returns a new S2Polyline in linear time.
 std::unique_ptr<S2Polyline> HalfResolution(const S2Polyline& in);
 
+// Returns the stride of `row` in a Sakoe-Chiba band of half-width `radius`
+// around the diagonal of a `rows` x `cols` table. Row i covers the columns
+// that the diagonal passes through, i.e. [i * cols / rows, (i + 1) * cols /
+// rows) rounded outwards, widened by `radius` columns on each side.
+ColumnStride BandColumnStride(const int row, const int rows, const int cols,
+                              const int radius);
+
+// Returns the Window consisting of all the BandColumnStrides of a `rows` x
+// `cols` table.
+Window BandWindow(const int rows, const int cols, const int radius);
+
 }  // namespace s2polyline_alignment
 #endif  // S2_S2POLYLINE_ALIGNMENT_INTERNAL_H_
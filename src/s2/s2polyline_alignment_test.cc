@@ -25,6 +25,7 @@
 #include "absl/strings/str_format.h"
 
 #include "s2/s2cap.h"
+#include "s2/s2executor.h"
 #include "s2/s2loop.h"
 #include "s2/s2polyline_alignment_internal.h"
 #include "s2/s2testing.h"
@@ -277,6 +278,43 @@ TEST(S2PolylineAlignmentTest, DilatesWindowByVeryLargeRadius) {
   EXPECT_EQ("\n" + w_d.DebugString(), expected_output);
 }
 
+TEST(S2PolylineAlignmentTest, CreatesBandWindowRadiusZero) {
+  const Window w = BandWindow(5, 6, 0);
+  const string expected_output = R"(
+ * * . . . .
+ . * * . . .
+ . . * * . .
+ . . . * * .
+ . . . . * *
+)";
+  EXPECT_EQ("\n" + w.DebugString(), expected_output);
+}
+
+TEST(S2PolylineAlignmentTest, CreatesBandWindowRadiusOne) {
+  const Window w = BandWindow(5, 6, 1);
+  const string expected_output = R"(
+ * * * . . .
+ * * * * . .
+ . * * * * .
+ . . * * * *
+ . . . * * *
+)";
+  EXPECT_EQ("\n" + w.DebugString(), expected_output);
+}
+
+TEST(S2PolylineAlignmentTest, CreatesBandWindowFewerColumns) {
+  const Window w = BandWindow(6, 2, 0);
+  const string expected_output = R"(
+ * .
+ * .
+ * .
+ . *
+ . *
+ . *
+)";
+  EXPECT_EQ("\n" + w.DebugString(), expected_output);
+}
+
 TEST(S2PolylineAlignmentTest, HalvesZeroLengthPolyline) {
   const auto line = s2textformat::MakePolylineOrDie("");
   const auto halved = HalfResolution(*line);
@@ -466,6 +504,65 @@ TEST(S2PolylineAlignmentTest, FuzzedWithBruteForce) {
   }
 }
 
+// The windowed solver only fills in the cells of its search window, so check
+// that the cost it reports is the cost of the warp path it returns, and that
+// it is no better than the exact cost.
+TEST(S2PolylineAlignmentTest, ApproxCostMatchesWarpPath) {
+  const int kNumPolylines = 4;
+  const int kNumVertices = 512;
+  const double kPerturbation = 0.9;
+  const auto lines = GenPolylines(kNumPolylines, kNumVertices, kPerturbation);
+  for (int i = 0; i < kNumPolylines; ++i) {
+    for (int j = i + 1; j < kNumPolylines; ++j) {
+      const auto& a = *lines[i];
+      const auto& b = *lines[j];
+      const auto approx = GetApproxVertexAlignment(a, b);
+      ASSERT_EQ(approx.warp_path.front(), std::make_pair(0, 0));
+      ASSERT_EQ(approx.warp_path.back(),
+                std::make_pair(kNumVertices - 1, kNumVertices - 1));
+      double path_cost = 0;
+      for (const auto& pair : approx.warp_path) {
+        path_cost += (a.vertex(pair.first) - b.vertex(pair.second)).Norm2();
+      }
+      EXPECT_DOUBLE_EQ(path_cost, approx.alignment_cost);
+      EXPECT_GE(approx.alignment_cost, GetExactVertexAlignmentCost(a, b));
+    }
+  }
+}
+
+// A band that covers the whole table gives the exact alignment, and narrower
+// bands give alignments that are no better.  The cost-only method must agree
+// with the cost of the banded alignment.
+TEST(S2PolylineAlignmentTest, BandedAlignment) {
+  const int kNumPolylines = 4;
+  const int kNumVertices = 64;
+  const double kPerturbation = 1.5;
+  const auto lines = GenPolylines(kNumPolylines, kNumVertices, kPerturbation);
+  const auto shorter = HalfResolution(*lines[0]);
+  for (int i = 0; i < kNumPolylines; ++i) {
+    const auto& a = *lines[i];
+    for (const S2Polyline* b : {lines[(i + 1) % kNumPolylines].get(),
+                                shorter.get()}) {
+      const double exact_cost = GetExactVertexAlignmentCost(a, *b);
+      const auto full = GetBandedVertexAlignment(a, *b, kNumVertices);
+      EXPECT_EQ(full.alignment_cost, exact_cost);
+      EXPECT_EQ(full.warp_path, GetExactVertexAlignment(a, *b).warp_path);
+      EXPECT_EQ(GetBandedVertexAlignmentCost(a, *b, kNumVertices), exact_cost);
+      for (int radius : {0, 1, 4}) {
+        const auto banded = GetBandedVertexAlignment(a, *b, radius);
+        EXPECT_GE(banded.alignment_cost, exact_cost);
+        EXPECT_EQ(GetBandedVertexAlignmentCost(a, *b, radius),
+                  banded.alignment_cost);
+        double path_cost = 0;
+        for (const auto& pair : banded.warp_path) {
+          path_cost += (a.vertex(pair.first) - b->vertex(pair.second)).Norm2();
+        }
+        EXPECT_DOUBLE_EQ(path_cost, banded.alignment_cost);
+      }
+    }
+  }
+}
+
 // TESTS FOR TRAJECTORY CONSENSUS ALGORITHMS
 
 // Tests for GetMedoidPolyline
@@ -577,6 +674,26 @@ TEST(S2PolylineAlignmentTest, MedoidPolylineFewLargePolylines) {
   EXPECT_EQ(approx_medoid, approx_medoid_index);
 }
 
+TEST(S2PolylineAlignmentTest, MedoidPolylineMultipleThreads) {
+  const int num_polylines = 10;
+  const int num_vertices = 128;
+  const double perturb = 1.5;
+  const auto polylines = GenPolylines(num_polylines, num_vertices, perturb);
+  for (bool approx : {false, true}) {
+    MedoidOptions options;
+    options.set_approx(approx);
+    const auto expected = GetMedoidPolyline(polylines, options);
+    for (int num_threads : {2, 4, 16}) {
+      options.set_num_threads(num_threads);
+      EXPECT_EQ(GetMedoidPolyline(polylines, options), expected);
+    }
+    S2ThreadPool pool(4);
+    options.set_num_threads(1);
+    options.set_executor(&pool);
+    EXPECT_EQ(GetMedoidPolyline(polylines, options), expected);
+  }
+}
+
 // Tests for GetConsensusPolyline
 #if GTEST_HAS_DEATH_TEST
 TEST(S2PolylineAlignmentDeathTest, ConsensusPolylineNoPolylines) {
@@ -618,4 +735,23 @@ TEST(S2PolylineAlignmentTest, ConsensusPolylineOverlappingPolylines) {
   EXPECT_TRUE(result->ApproxEquals(*expected));
 }
 
+TEST(S2PolylineAlignmentTest, ConsensusPolylineMultipleThreads) {
+  const int num_polylines = 8;
+  const int num_vertices = 128;
+  const double perturb = 1.5;
+  const auto polylines = GenPolylines(num_polylines, num_vertices, perturb);
+  ConsensusOptions options;
+  options.set_seed_medoid(true);
+  const auto expected = GetConsensusPolyline(polylines, options);
+  for (int num_threads : {2, 4, 16}) {
+    options.set_num_threads(num_threads);
+    const auto result = GetConsensusPolyline(polylines, options);
+    EXPECT_TRUE(result->Equals(*expected));
+  }
+  S2ThreadPool pool(4);
+  options.set_num_threads(1);
+  options.set_executor(&pool);
+  EXPECT_TRUE(GetConsensusPolyline(polylines, options)->Equals(*expected));
+}
+
 }  // namespace s2polyline_alignment
@@ -0,0 +1,188 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2polyline_batch_simplifier.h"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "s2/s1chord_angle.h"
+#include "s2/s2polyline_simplifier.h"
+
+using std::vector;
+
+// The number of polylines claimed at a time by each thread.
+static constexpr int kPolylinesPerBatch = 64;
+
+// Simplifies polylines one at a time, reusing its temporary storage.  Each
+// thread uses its own Simplifier.
+class S2PolylineBatchSimplifier::Simplifier {
+ public:
+  explicit Simplifier(const Options& options);
+
+  void Run(S2PointSpan polyline, vector<int>* const levels[]);
+
+ private:
+  void SimplifyLevel(S2PointSpan v, const vector<int>& candidates,
+                     S1ChordAngle tolerance, vector<int>* output);
+
+  vector<S1ChordAngle> tolerances_;
+  S2PolylineSimplifier simplifier_;
+  vector<int> all_vertices_;
+};
+
+S2PolylineBatchSimplifier::Simplifier::Simplifier(const Options& options) {
+  for (S1Angle tolerance : options.tolerances()) {
+    tolerances_.push_back(S1ChordAngle(tolerance));
+  }
+}
+
+void S2PolylineBatchSimplifier::Simplifier::Run(
+    S2PointSpan polyline, vector<int>* const levels[]) {
+  // The first level chooses among all the input vertices, and each
+  // subsequent level chooses among the vertices of the previous level.
+  all_vertices_.resize(polyline.size());
+  std::iota(all_vertices_.begin(), all_vertices_.end(), 0);
+  for (int level = 0; level < tolerances_.size(); ++level) {
+    SimplifyLevel(polyline, level == 0 ? all_vertices_ : *levels[level - 1],
+                  tolerances_[level], levels[level]);
+  }
+}
+
+// Greedily extends each output edge as far as possible along "candidates",
+// requiring the edge to pass through the discs of radius "tolerance" around
+// all the input vertices that it replaces.  Edges of the previous level are
+// always acceptable, since they satisfied a smaller tolerance; they are
+// output directly in the rare cases where S2PolylineSimplifier rejects them
+// due to rounding or edge length.
+void S2PolylineBatchSimplifier::Simplifier::SimplifyLevel(
+    S2PointSpan v, const vector<int>& candidates, S1ChordAngle tolerance,
+    vector<int>* output) {
+  output->clear();
+  if (candidates.empty()) return;
+  output->push_back(candidates[0]);
+  auto add_vertex = [&v, output](int i) {
+    if (v[i] != v[output->back()]) output->push_back(i);
+  };
+
+  // "src" is the start of the current output edge, "end" is the furthest
+  // candidate that it can be extended to, and all input vertices before
+  // "next_target" have been added as target discs.  S2PolylineSimplifier
+  // only constrains the direction of the edge, so we also require the edge
+  // to be at least as long as the distance to every target vertex; this
+  // ensures that the edge passes through each disc before it ends.
+  int src = candidates[0], end = src, next_target = src + 1;
+  S1ChordAngle max_target_dist = S1ChordAngle::Zero();
+  simplifier_.Init(v[src]);
+  auto can_extend = [&](int dst) {
+    // A degenerate edge can only replace duplicate vertices.
+    if (v[dst] == v[src]) return next_target >= dst;
+    bool ok = true;
+    for (; next_target < dst; ++next_target) {
+      const S2Point& p = v[next_target];
+      if (!simplifier_.TargetDisc(p, tolerance)) ok = false;
+      max_target_dist = std::max(max_target_dist, S1ChordAngle(v[src], p));
+    }
+    return ok && max_target_dist <= S1ChordAngle(v[src], v[dst]) &&
+           simplifier_.Extend(v[dst]);
+  };
+  auto start_edge = [&](int i) {
+    src = end = i;
+    next_target = i + 1;
+    max_target_dist = S1ChordAngle::Zero();
+    simplifier_.Init(v[i]);
+  };
+  for (int k = 1; k < candidates.size(); ++k) {
+    const int c = candidates[k];
+    if (can_extend(c)) {
+      end = c;
+      continue;
+    }
+    if (end != src) {
+      // Output the furthest acceptable vertex and try again from there.
+      add_vertex(end);
+      start_edge(end);
+      if (can_extend(c)) {
+        end = c;
+        continue;
+      }
+    }
+    // The edge (src, c) belongs to the previous level.
+    add_vertex(c);
+    start_edge(c);
+  }
+  if (end != src) add_vertex(end);
+}
+
+void S2PolylineBatchSimplifier::Options::set_tolerances(
+    vector<S1Angle> tolerances) {
+  S2_DCHECK(std::is_sorted(tolerances.begin(), tolerances.end()));
+  S2_DCHECK(tolerances.empty() || tolerances[0] >= S1Angle::Zero());
+  tolerances_ = std::move(tolerances);
+}
+
+S2PolylineBatchSimplifier::S2PolylineBatchSimplifier(const Options& options) {
+  Init(options);
+}
+
+void S2PolylineBatchSimplifier::Init(const Options& options) {
+  options_ = options;
+}
+
+void S2PolylineBatchSimplifier::Simplify(
+    absl::Span<const S2PointSpan> polylines,
+    vector<vector<vector<int>>>* indices) const {
+  const int num_levels = options_.tolerances().size();
+  const int num_polylines = polylines.size();
+  indices->resize(num_levels);
+  for (auto& level : *indices) level.resize(num_polylines);
+
+  const int num_batches =
+      (num_polylines + kPolylinesPerBatch - 1) / kPolylinesPerBatch;
+  const int num_threads = std::max(
+      1, std::min(S2NumThreads(options_.executor(), options_.num_threads()),
+                  num_batches));
+  std::atomic<int> next_batch(0);
+  auto simplify_batches = [&](int) {
+    Simplifier simplifier(options_);
+    vector<vector<int>*> levels(num_levels);
+    for (int batch; (batch = next_batch.fetch_add(1)) < num_batches; ) {
+      const int begin = batch * kPolylinesPerBatch;
+      const int end = std::min(num_polylines, begin + kPolylinesPerBatch);
+      for (int i = begin; i < end; ++i) {
+        for (int level = 0; level < num_levels; ++level) {
+          levels[level] = &(*indices)[level][i];
+        }
+        simplifier.Run(polylines[i], levels.data());
+      }
+    }
+  };
+  S2ParallelFor(options_.executor(), num_threads, simplify_batches);
+}
+
+void S2PolylineBatchSimplifier::Simplify(
+    S2PointSpan polyline, vector<vector<int>>* indices) const {
+  const int num_levels = options_.tolerances().size();
+  indices->resize(num_levels);
+  vector<vector<int>*> levels(num_levels);
+  for (int level = 0; level < num_levels; ++level) {
+    levels[level] = &(*indices)[level];
+  }
+  Simplifier simplifier(options_);
+  simplifier.Run(polyline, levels.data());
+}
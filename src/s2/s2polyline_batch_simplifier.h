@@ -0,0 +1,125 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2POLYLINE_BATCH_SIMPLIFIER_H_
+#define S2_S2POLYLINE_BATCH_SIMPLIFIER_H_
+
+#include <vector>
+
+#include "absl/types/span.h"
+#include "s2/base/logging.h"
+#include "s2/s1angle.h"
+#include "s2/s2executor.h"
+#include "s2/s2point_span.h"
+
+// S2PolylineBatchSimplifier simplifies a large number of polylines at one or
+// more tolerances (levels of detail), using S2PolylineSimplifier.  It is
+// intended for applications such as building tile pyramids, where millions
+// of polylines need to be simplified and constructing an S2Builder (or other
+// per-polyline state) for each one would dominate the running time.
+//
+// Each simplified polyline consists of a subset of the input vertices,
+// including the first and last vertex.  Every output edge passes within the
+// tolerance of all the input vertices that it replaces (using conservative
+// exact predicates, see S2PolylineSimplifier), and output edges are never
+// longer than 90 degrees unless the corresponding input edge is.  Adjacent
+// duplicate vertices are not output.
+//
+// The levels are nested: the vertices of each level are a subset of the
+// vertices of the previous (finer) level, so that coarser levels can be
+// derived from finer ones.  Nevertheless each level is measured against
+// the original input vertices, so errors do not accumulate across levels.
+//
+// Example usage:
+//
+//   S2PolylineBatchSimplifier::Options options;
+//   options.set_tolerances({S1Angle::Degrees(0.001), S1Angle::Degrees(0.01)});
+//   options.set_num_threads(8);
+//   S2PolylineBatchSimplifier simplifier(options);
+//   vector<S2PointSpan> polylines = ...;
+//   vector<vector<vector<int>>> indices;
+//   simplifier.Simplify(polylines, &indices);
+//   // indices[level][i] holds the vertex indices of polyline i at "level".
+//
+// This class is thread-safe (Simplify() is const).
+class S2PolylineBatchSimplifier {
+ public:
+  class Options {
+   public:
+    // The simplification tolerances, one per level of detail.
+    //
+    // REQUIRES: The tolerances are non-negative and non-decreasing.
+    //
+    // DEFAULT: {S1Angle::Zero()}
+    const std::vector<S1Angle>& tolerances() const { return tolerances_; }
+    void set_tolerances(std::vector<S1Angle> tolerances);
+
+    // The maximum number of threads used to simplify the polylines.  Each
+    // thread repeatedly claims a small batch of polylines, so the work is
+    // balanced even when the polylines have very different sizes.  The
+    // output does not depend on the number of threads.
+    //
+    // DEFAULT: 1
+    int num_threads() const { return num_threads_; }
+    void set_num_threads(int num_threads) {
+      S2_DCHECK_GE(num_threads, 1);
+      num_threads_ = num_threads;
+    }
+
+    // If non-null, the polylines are simplified using this executor, and
+    // num_threads() is replaced by executor->num_threads().
+    //
+    // DEFAULT: nullptr
+    S2Executor* executor() const { return executor_; }
+    void set_executor(S2Executor* executor) { executor_ = executor; }
+
+   private:
+    std::vector<S1Angle> tolerances_ = {S1Angle::Zero()};
+    int num_threads_ = 1;
+    S2Executor* executor_ = nullptr;
+  };
+
+  // Default constructor; requires Init() to be called.
+  S2PolylineBatchSimplifier() = default;
+
+  explicit S2PolylineBatchSimplifier(const Options& options);
+
+  // Equivalent to the constructor above.
+  void Init(const Options& options);
+
+  const Options& options() const { return options_; }
+
+  // Simplifies the given polylines.  On return "indices" has one entry per
+  // tolerance, and (*indices)[level][i] contains the indices of the vertices
+  // of polylines[i] that are kept at that level.  Empty polylines yield
+  // empty index vectors.
+  //
+  // The existing vectors in "indices" are reused, so passing the same object
+  // to consecutive calls avoids most memory allocation.
+  void Simplify(absl::Span<const S2PointSpan> polylines,
+                std::vector<std::vector<std::vector<int>>>* indices) const;
+
+  // Simplifies a single polyline, setting (*indices)[level] to the indices of
+  // the vertices that are kept at each level.
+  void Simplify(S2PointSpan polyline,
+                std::vector<std::vector<int>>* indices) const;
+
+ private:
+  class Simplifier;
+
+  Options options_;
+};
+
+#endif  // S2_S2POLYLINE_BATCH_SIMPLIFIER_H_
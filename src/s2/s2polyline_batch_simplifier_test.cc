@@ -0,0 +1,151 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2polyline_batch_simplifier.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/flags/flag.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2edge_distances.h"
+#include "s2/s2executor.h"
+#include "s2/s2point.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using std::vector;
+
+namespace {
+
+// Returns a random walk with "num_vertices" vertices whose steps are at most
+// "max_step" long.
+vector<S2Point> RandomWalk(int num_vertices, S1Angle max_step) {
+  vector<S2Point> vertices;
+  S2Point p = S2Testing::RandomPoint();
+  for (int i = 0; i < num_vertices; ++i) {
+    vertices.push_back(p);
+    p = S2Testing::SamplePoint(S2Cap(p, max_step));
+  }
+  return vertices;
+}
+
+// Checks that "indices" describes a valid simplification of "v" with the
+// given tolerance.
+void CheckSimplification(const vector<S2Point>& v, const vector<int>& indices,
+                         S1Angle tolerance) {
+  if (v.empty()) {
+    EXPECT_TRUE(indices.empty());
+    return;
+  }
+  ASSERT_FALSE(indices.empty());
+  EXPECT_EQ(0, indices.front());
+  EXPECT_EQ(v.back(), v[indices.back()]);
+  for (int k = 0; k + 1 < indices.size(); ++k) {
+    const S2Point& a = v[indices[k]];
+    const S2Point& b = v[indices[k + 1]];
+    EXPECT_LT(indices[k], indices[k + 1]);
+    EXPECT_NE(a, b);
+    for (int i = indices[k] + 1; i < indices[k + 1]; ++i) {
+      EXPECT_LE(S2::GetDistance(v[i], a, b),
+                tolerance + S1Angle::Radians(1e-15)) << "vertex " << i;
+    }
+  }
+}
+
+TEST(S2PolylineBatchSimplifier, StraightLine) {
+  vector<S2Point> v;
+  for (int i = 0; i <= 100; ++i) {
+    v.push_back(S2LatLng::FromDegrees(0, 0.1 * i).ToPoint());
+  }
+  S2PolylineBatchSimplifier::Options options;
+  options.set_tolerances({S1Angle::Degrees(1e-6)});
+  S2PolylineBatchSimplifier simplifier(options);
+  vector<vector<int>> indices;
+  simplifier.Simplify(v, &indices);
+  ASSERT_EQ(1, indices.size());
+  EXPECT_EQ((vector<int>{0, 100}), indices[0]);
+}
+
+TEST(S2PolylineBatchSimplifier, DegeneratePolylines) {
+  S2PolylineBatchSimplifier::Options options;
+  options.set_tolerances({S1Angle::Zero(), S1Angle::Degrees(1)});
+  S2PolylineBatchSimplifier simplifier(options);
+  vector<vector<int>> indices;
+  simplifier.Simplify(S2PointSpan(), &indices);
+  EXPECT_EQ((vector<vector<int>>{{}, {}}), indices);
+
+  // Duplicate vertices are removed, but a loop that returns to its starting
+  // point may not be simplified to a single point.
+  auto v = s2textformat::ParsePointsOrDie("0:0, 0:0, 0:0");
+  simplifier.Simplify(v, &indices);
+  EXPECT_EQ((vector<vector<int>>{{0}, {0}}), indices);
+  v = s2textformat::ParsePointsOrDie("0:0, 0:0, 0:1, 0:1, 0:0");
+  simplifier.Simplify(v, &indices);
+  EXPECT_EQ((vector<vector<int>>{{0, 2, 4}, {0, 2, 4}}), indices);
+}
+
+TEST(S2PolylineBatchSimplifier, LevelsOfDetail) {
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  const vector<S1Angle> tolerances = {
+      S1Angle::Zero(), S1Angle::Degrees(0.001), S1Angle::Degrees(0.01),
+      S1Angle::Degrees(0.1)};
+  vector<vector<S2Point>> walks;
+  vector<S2PointSpan> polylines;
+  for (int i = 0; i < 300; ++i) {
+    walks.push_back(RandomWalk(S2Testing::rnd.Uniform(200),
+                               S1Angle::Degrees(0.005)));
+  }
+  for (const auto& walk : walks) polylines.push_back(walk);
+
+  S2PolylineBatchSimplifier::Options options;
+  options.set_tolerances(tolerances);
+  S2PolylineBatchSimplifier simplifier(options);
+  vector<vector<vector<int>>> indices;
+  simplifier.Simplify(polylines, &indices);
+  ASSERT_EQ(tolerances.size(), indices.size());
+  int num_vertices[4] = {0, 0, 0, 0};
+  for (int level = 0; level < tolerances.size(); ++level) {
+    ASSERT_EQ(walks.size(), indices[level].size());
+    for (int i = 0; i < walks.size(); ++i) {
+      const vector<int>& ids = indices[level][i];
+      CheckSimplification(walks[i], ids, tolerances[level]);
+      num_vertices[level] += ids.size();
+      if (level > 0) {
+        // Each level is a subset of the previous level.
+        const vector<int>& prev = indices[level - 1][i];
+        EXPECT_TRUE(std::includes(prev.begin(), prev.end(),
+                                  ids.begin(), ids.end()));
+      }
+    }
+  }
+  EXPECT_GT(num_vertices[0], 2 * num_vertices[2]);
+  EXPECT_GT(num_vertices[2], num_vertices[3]);
+
+  // The result does not depend on the number of threads or the executor.
+  S2ThreadPool pool(3);
+  for (int num_threads : {2, 4}) {
+    options.set_num_threads(num_threads);
+    options.set_executor(num_threads == 4 ? &pool : nullptr);
+    simplifier.Init(options);
+    vector<vector<vector<int>>> actual;
+    simplifier.Simplify(polylines, &actual);
+    EXPECT_EQ(indices, actual);
+  }
+}
+
+}  // namespace
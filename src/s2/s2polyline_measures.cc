@@ -17,10 +17,19 @@
 
 #include "s2/s2polyline_measures.h"
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <vector>
 
 #include "s2/base/logging.h"
 #include "s2/s2centroids.h"
+#include "s2/s2edge_distances.h"
+
+using std::max;
+using std::vector;
 
 namespace S2 {
 
@@ -40,4 +49,132 @@ S2Point GetCentroid(S2PointSpan polyline) {
   return centroid;
 }
 
+namespace {
+
+// The maximum number of edges in a leaf node of a CapTree.
+constexpr int kMaxLeafEdges = 16;
+
+// Conservative bound on the error in the distance lower bounds computed
+// below, which are derived from S1Angles between unit-length points.
+constexpr double kMaxBoundError = 1e-13;
+
+// A binary tree of bounding caps over consecutive ranges of polyline edges.
+// Edge "i" of the polyline is (polyline[i], polyline[i + 1]).
+class CapTree {
+ public:
+  struct Node {
+    int begin, end;    // The range of edges [begin, end).
+    S2Point center;    // The bounding cap center.
+    double radius;     // The bounding cap radius in radians.
+    int left, right;   // Child node ids, or -1 for leaf nodes.
+  };
+
+  explicit CapTree(S2PointSpan polyline) : polyline_(polyline) {
+    nodes_.reserve(4 * (num_edges() / kMaxLeafEdges + 1));
+    Build(0, num_edges());
+  }
+
+  int num_edges() const { return max<int>(1, polyline_.size() - 1); }
+  const Node& node(int id) const { return nodes_[id]; }
+
+  // Returns the endpoints of the given edge.  A polyline with one vertex has
+  // a single degenerate edge.
+  const S2Point& v0(int edge) const { return polyline_[edge]; }
+  const S2Point& v1(int edge) const {
+    return polyline_[std::min<int>(edge + 1, polyline_.size() - 1)];
+  }
+
+ private:
+  int Build(int begin, int end) {
+    // A great circle edge whose endpoints are contained by a cap of radius
+    // less than 90 degrees is also contained by that cap, so it is
+    // sufficient to bound the vertices.
+    S2Point sum;
+    for (int i = begin; i <= end && i < polyline_.size(); ++i) {
+      sum += polyline_[i];
+    }
+    int id = nodes_.size();
+    nodes_.push_back(Node{begin, end, S2Point(), M_PI, -1, -1});
+    if (sum != S2Point()) {
+      S2Point center = sum.Normalize();
+      double radius = 0;
+      for (int i = begin; i <= end && i < polyline_.size(); ++i) {
+        radius = max(radius, S1Angle(center, polyline_[i]).radians());
+      }
+      nodes_[id].center = center;
+      if (radius < M_PI_2 - kMaxBoundError) nodes_[id].radius = radius;
+    }
+    if (end - begin > kMaxLeafEdges) {
+      int mid = begin + (end - begin) / 2;
+      int left = Build(begin, mid);
+      int right = Build(mid, end);
+      nodes_[id].left = left;
+      nodes_[id].right = right;
+    }
+    return id;
+  }
+
+  S2PointSpan polyline_;
+  vector<Node> nodes_;
+};
+
+// Returns a lower bound on the distance in radians between any point
+// contained by cap "x" and any point contained by cap "y".
+double GetLowerBound(const CapTree::Node& x, const CapTree::Node& y) {
+  if (x.radius >= M_PI_2 || y.radius >= M_PI_2) return 0;
+  return S1Angle(x.center, y.center).radians() - x.radius - y.radius -
+         kMaxBoundError;
+}
+
+}  // namespace
+
+S1ChordAngle GetMinDistance(S2PointSpan a, S2PointSpan b) {
+  if (a.empty() || b.empty()) return S1ChordAngle::Infinity();
+  CapTree tree_a(a), tree_b(b);
+
+  // Visit pairs of nodes in order of increasing lower bound, stopping as soon
+  // as the lower bound is at least the minimum distance found so far.
+  using Entry = std::tuple<double, int, int>;
+  std::priority_queue<Entry, vector<Entry>, std::greater<Entry>> queue;
+  S1ChordAngle min_dist = S1ChordAngle::Infinity();
+  queue.emplace(0.0, 0, 0);
+  while (!queue.empty()) {
+    double bound;
+    int id_a, id_b;
+    std::tie(bound, id_a, id_b) = queue.top();
+    queue.pop();
+    if (bound >= min_dist.ToAngle().radians()) break;
+
+    const CapTree::Node& x = tree_a.node(id_a);
+    const CapTree::Node& y = tree_b.node(id_b);
+    if (x.left < 0 && y.left < 0) {
+      for (int i = x.begin; i < x.end; ++i) {
+        for (int j = y.begin; j < y.end; ++j) {
+          S2::UpdateEdgePairMinDistance(tree_a.v0(i), tree_a.v1(i),
+                                        tree_b.v0(j), tree_b.v1(j), &min_dist);
+        }
+      }
+      if (min_dist == S1ChordAngle::Zero()) break;
+      continue;
+    }
+    // Otherwise split the node with the larger bounding cap.
+    if (y.left < 0 || (x.left >= 0 && x.radius >= y.radius)) {
+      for (int child : {x.left, x.right}) {
+        double child_bound = GetLowerBound(tree_a.node(child), y);
+        if (child_bound < min_dist.ToAngle().radians()) {
+          queue.emplace(child_bound, child, id_b);
+        }
+      }
+    } else {
+      for (int child : {y.left, y.right}) {
+        double child_bound = GetLowerBound(x, tree_b.node(child));
+        if (child_bound < min_dist.ToAngle().radians()) {
+          queue.emplace(child_bound, id_a, child);
+        }
+      }
+    }
+  }
+  return min_dist;
+}
+
 }  // namespace S2
@@ -27,6 +27,7 @@
 #define S2_S2POLYLINE_MEASURES_H_
 
 #include "s2/s1angle.h"
+#include "s2/s1chord_angle.h"
 #include "s2/s2point.h"
 #include "s2/s2point_span.h"
 
@@ -48,6 +49,18 @@ S1Angle GetLength(S2PointSpan polyline);
 // the polyline, whose value is always zero if the polyline is degenerate.]
 S2Point GetCentroid(S2PointSpan polyline);
 
+// Returns the minimum distance between any edge of polyline "a" and any edge
+// of polyline "b".  The result is zero if the polylines intersect.  A
+// polyline with one vertex is treated as a single point, and the result is
+// S1ChordAngle::Infinity() if either polyline has no vertices.
+//
+// The result is exactly the same as calling S2::UpdateEdgePairMinDistance()
+// on every pair of edges, but the edges are grouped into a hierarchy of
+// bounding caps so that most edge pairs can be skipped.  This is usually
+// much faster than building an S2ShapeIndex and using S2ClosestEdgeQuery
+// when each polyline is only used once.
+S1ChordAngle GetMinDistance(S2PointSpan a, S2PointSpan b);
+
 }  // namespace S2
 
 #endif  // S2_S2POLYLINE_MEASURES_H_
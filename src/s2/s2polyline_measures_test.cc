@@ -22,6 +22,10 @@
 
 #include <gtest/gtest.h>
 #include "s2/s1angle.h"
+#include "s2/s1chord_angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2edge_distances.h"
+#include "s2/s2latlng.h"
 #include "s2/s2testing.h"
 
 using std::fabs;
@@ -54,4 +58,62 @@ TEST(GetLengthAndCentroid, GreatCircles) {
   }
 }
 
+// Returns the minimum distance between the two polylines by checking every
+// pair of edges.
+S1ChordAngle GetBruteForceMinDistance(const vector<S2Point>& a,
+                                      const vector<S2Point>& b) {
+  S1ChordAngle min_dist = S1ChordAngle::Infinity();
+  for (int i = 0; i + 1 < std::max<int>(a.size(), 2); ++i) {
+    for (int j = 0; j + 1 < std::max<int>(b.size(), 2); ++j) {
+      S2::UpdateEdgePairMinDistance(a[i], a[std::min<int>(i + 1, a.size() - 1)],
+                                    b[j], b[std::min<int>(j + 1, b.size() - 1)],
+                                    &min_dist);
+    }
+  }
+  return min_dist;
+}
+
+// Returns a random walk with "num_vertices" vertices starting near "center"
+// whose steps are at most "max_step" long.
+vector<S2Point> RandomWalk(const S2Point& center, int num_vertices,
+                           S1Angle max_step) {
+  vector<S2Point> vertices;
+  S2Point p = S2Testing::SamplePoint(S2Cap(center, S1Angle::Degrees(1)));
+  for (int i = 0; i < num_vertices; ++i) {
+    vertices.push_back(p);
+    p = S2Testing::SamplePoint(S2Cap(p, max_step));
+  }
+  return vertices;
+}
+
+TEST(GetMinDistance, MatchesBruteForce) {
+  for (int iter = 0; iter < 20; ++iter) {
+    // Choose polylines that are sometimes close together, sometimes
+    // intersecting, and sometimes far apart.
+    S2Point center = S2Testing::RandomPoint();
+    S2Point other = (iter % 3 == 0) ? S2Testing::RandomPoint() : center;
+    vector<S2Point> a = RandomWalk(
+        center, 1 + S2Testing::rnd.Uniform(300), S1Angle::Degrees(0.05));
+    vector<S2Point> b = RandomWalk(
+        other, 1 + S2Testing::rnd.Uniform(300), S1Angle::Degrees(0.05));
+    EXPECT_EQ(GetBruteForceMinDistance(a, b), S2::GetMinDistance(a, b));
+  }
+}
+
+TEST(GetMinDistance, SpecialCases) {
+  vector<S2Point> empty;
+  vector<S2Point> a = {S2LatLng::FromDegrees(0, 0).ToPoint(),
+                       S2LatLng::FromDegrees(0, 10).ToPoint()};
+  vector<S2Point> b = {S2LatLng::FromDegrees(-5, 5).ToPoint(),
+                       S2LatLng::FromDegrees(5, 5).ToPoint()};
+  vector<S2Point> c = {S2LatLng::FromDegrees(1, 3).ToPoint()};
+  EXPECT_EQ(S1ChordAngle::Infinity(), S2::GetMinDistance(empty, a));
+  EXPECT_EQ(S1ChordAngle::Infinity(), S2::GetMinDistance(a, empty));
+  EXPECT_EQ(S1ChordAngle::Zero(), S2::GetMinDistance(a, b));
+  EXPECT_NEAR(1, S2::GetMinDistance(a, c).ToAngle().degrees(), 1e-13);
+  EXPECT_EQ(S1ChordAngle(S2::GetDistance(c[0], b[0], b[1])),
+            S2::GetMinDistance(c, b));
+  EXPECT_EQ(S1ChordAngle::Zero(), S2::GetMinDistance(c, c));
+}
+
 }  // namespace
@@ -0,0 +1,113 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2polyline_projector.h"
+
+#include <algorithm>
+
+#include "absl/memory/memory.h"
+#include "s2/base/logging.h"
+#include "s2/s2edge_distances.h"
+
+using absl::make_unique;
+using std::min;
+
+S2PolylineProjector::S2PolylineProjector() {
+}
+
+S2PolylineProjector::S2PolylineProjector(const S2Polyline* polyline) {
+  Init(polyline);
+}
+
+void S2PolylineProjector::Init(const S2Polyline* polyline) {
+  S2_DCHECK_GT(polyline->num_vertices(), 0);
+  polyline_ = polyline;
+  cumulative_lengths_.clear();
+  cumulative_lengths_.reserve(polyline->num_vertices());
+  cumulative_lengths_.push_back(S1Angle::Zero());
+  for (int i = 1; i < polyline->num_vertices(); ++i) {
+    cumulative_lengths_.push_back(
+        cumulative_lengths_.back() +
+        S1Angle(polyline->vertex(i - 1), polyline->vertex(i)));
+  }
+  // The index is built now rather than lazily so that the cost of building
+  // it is not charged to the first call to Project().  (Polylines with one
+  // vertex have no edges and are handled separately.)
+  index_.Clear();
+  if (polyline->num_vertices() >= 2) {
+    index_.Add(make_unique<S2Polyline::Shape>(polyline));
+    index_.ForceBuild();
+  }
+  query_.Init(&index_);
+}
+
+S2Point S2PolylineProjector::Project(const S2Point& point, int* next_vertex) {
+  const S2Polyline& polyline = *polyline_;
+  if (polyline.num_vertices() == 1) {
+    // If there is only one vertex, it is always closest to any given point.
+    *next_vertex = 1;
+    return polyline.vertex(0);
+  }
+  S2ClosestEdgeQuery::PointTarget target(point);
+  int i = query_.FindClosestEdge(&target).edge_id() + 1;
+  S2_DCHECK_GE(i, 1);
+
+  // Compute the point on the edge found that is closest to the point given.
+  S2Point closest_point =
+      S2::Project(point, polyline.vertex(i - 1), polyline.vertex(i));
+  *next_vertex = i + (closest_point == polyline.vertex(i) ? 1 : 0);
+  return closest_point;
+}
+
+S2Point S2PolylineProjector::GetSuffix(double fraction,
+                                       int* next_vertex) const {
+  const S2Polyline& polyline = *polyline_;
+  if (fraction <= 0) {
+    *next_vertex = 1;
+    return polyline.vertex(0);
+  }
+  // Find the first vertex "i" whose cumulative length exceeds the target.
+  S1Angle target = fraction * length();
+  int i = std::upper_bound(cumulative_lengths_.begin(),
+                           cumulative_lengths_.end(), target) -
+          cumulative_lengths_.begin();
+  if (i == polyline.num_vertices()) {
+    *next_vertex = polyline.num_vertices();
+    return polyline.vertex(polyline.num_vertices() - 1);
+  }
+  // This interpolates with respect to arc length rather than straight-line
+  // distance, and produces a unit-length result.
+  S2Point result = S2::GetPointOnLine(polyline.vertex(i - 1),
+                                      polyline.vertex(i),
+                                      target - cumulative_lengths_[i - 1]);
+  // It is possible that (result == vertex(i)) due to rounding errors.
+  *next_vertex = (result == polyline.vertex(i)) ? (i + 1) : i;
+  return result;
+}
+
+S2Point S2PolylineProjector::Interpolate(double fraction) const {
+  int next_vertex;
+  return GetSuffix(fraction, &next_vertex);
+}
+
+double S2PolylineProjector::UnInterpolate(const S2Point& point,
+                                          int next_vertex) const {
+  if (polyline_->num_vertices() < 2) return 0;
+  S1Angle length_to_point = cumulative_lengths_[next_vertex - 1] +
+                            S1Angle(polyline_->vertex(next_vertex - 1), point);
+  // The ratio can be greater than 1.0 due to rounding errors or because the
+  // point is not exactly on the polyline.
+  return min(1.0, length_to_point / length());
+}
@@ -0,0 +1,98 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2POLYLINE_PROJECTOR_H_
+#define S2_S2POLYLINE_PROJECTOR_H_
+
+#include <vector>
+
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2point.h"
+#include "s2/s2polyline.h"
+
+// S2PolylineProjector answers linear referencing queries about a fixed
+// S2Polyline, i.e. it implements the S2Polyline methods Project(),
+// GetSuffix(), Interpolate() and UnInterpolate().  Those methods take time
+// linear in the number of polyline vertices, whereas this class precomputes
+// the cumulative length at each vertex and an S2ShapeIndex of the polyline
+// edges so that each query takes logarithmic time.  This is useful when many
+// points are referenced against the same long polyline (e.g., snapping GPS
+// points onto a route):
+//
+//   S2PolylineProjector projector(&route);
+//   for (const S2Point& p : gps_points) {
+//     int next_vertex;
+//     S2Point q = projector.Project(p, &next_vertex);
+//     double fraction = projector.UnInterpolate(q, next_vertex);
+//     ...
+//   }
+//
+// The results are the same as those of the corresponding S2Polyline methods
+// except for rounding errors, and except that Project() may choose a
+// different edge when several edges are (almost) equally close to the point.
+//
+// The polyline must persist for the lifetime of this object and must not be
+// modified.  This class is not thread-safe, since Project() uses an
+// S2ClosestEdgeQuery (see s2closest_edge_query.h).
+class S2PolylineProjector {
+ public:
+  // Default constructor; requires Init() to be called.
+  S2PolylineProjector();
+
+  // Convenience constructor that calls Init().
+  explicit S2PolylineProjector(const S2Polyline* polyline);
+
+  // Initializes the projector for the given polyline.
+  //
+  // REQUIRES: polyline->num_vertices() > 0
+  void Init(const S2Polyline* polyline);
+
+  const S2Polyline& polyline() const { return *polyline_; }
+
+  // Returns the length of the polyline.
+  S1Angle length() const { return cumulative_lengths_.back(); }
+
+  // Returns the length of the polyline from vertex 0 to vertex "i".
+  S1Angle cumulative_length(int i) const { return cumulative_lengths_[i]; }
+
+  // Like S2Polyline::Project().
+  S2Point Project(const S2Point& point, int* next_vertex);
+
+  // Like S2Polyline::GetSuffix().
+  S2Point GetSuffix(double fraction, int* next_vertex) const;
+
+  // Like S2Polyline::Interpolate().
+  S2Point Interpolate(double fraction) const;
+
+  // Like S2Polyline::UnInterpolate().  This method takes constant time.
+  double UnInterpolate(const S2Point& point, int next_vertex) const;
+
+ private:
+  const S2Polyline* polyline_ = nullptr;
+
+  // cumulative_lengths_[i] is the length of the polyline from vertex 0 to
+  // vertex i.
+  std::vector<S1Angle> cumulative_lengths_;
+
+  MutableS2ShapeIndex index_;
+  S2ClosestEdgeQuery query_;
+
+  S2PolylineProjector(const S2PolylineProjector&) = delete;
+  void operator=(const S2PolylineProjector&) = delete;
+};
+
+#endif  // S2_S2POLYLINE_PROJECTOR_H_
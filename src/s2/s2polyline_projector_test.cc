@@ -0,0 +1,114 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2polyline_projector.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2point.h"
+#include "s2/s2polyline.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using std::vector;
+
+namespace {
+
+// Returns a random walk with "num_vertices" vertices whose steps are at most
+// "max_step" long.
+vector<S2Point> RandomWalk(int num_vertices, S1Angle max_step) {
+  vector<S2Point> vertices;
+  S2Point p = S2Testing::RandomPoint();
+  for (int i = 0; i < num_vertices; ++i) {
+    vertices.push_back(p);
+    p = S2Testing::SamplePoint(S2Cap(p, max_step));
+  }
+  return vertices;
+}
+
+TEST(S2PolylineProjector, MatchesS2Polyline) {
+  const S1Angle kMaxError = S1Angle::Radians(1e-14);
+  for (int iter = 0; iter < 10; ++iter) {
+    S2Polyline polyline(RandomWalk(500, S1Angle::Degrees(0.1)));
+    S2PolylineProjector projector(&polyline);
+    EXPECT_EQ(polyline.GetLength().radians(), projector.length().radians());
+    for (int i = 0; i < 100; ++i) {
+      // Project points near the polyline.
+      S2Point p = S2Testing::SamplePoint(
+          S2Cap(polyline.vertex(S2Testing::rnd.Uniform(500)),
+                S1Angle::Degrees(0.5)));
+      int expected_next, actual_next;
+      S2Point expected = polyline.Project(p, &expected_next);
+      S2Point actual = projector.Project(p, &actual_next);
+      EXPECT_LE(S1Angle(p, actual), S1Angle(p, expected) + kMaxError);
+      if (actual == expected) {
+        EXPECT_EQ(expected_next, actual_next);
+        EXPECT_NEAR(polyline.UnInterpolate(expected, expected_next),
+                    projector.UnInterpolate(actual, actual_next), 1e-14);
+      }
+
+      // Interpolate at random fractions.
+      double fraction = S2Testing::rnd.UniformDouble(-0.1, 1.1);
+      expected = polyline.GetSuffix(fraction, &expected_next);
+      actual = projector.GetSuffix(fraction, &actual_next);
+      EXPECT_LE(S1Angle(expected, actual), kMaxError);
+      EXPECT_EQ(expected_next, actual_next);
+      EXPECT_EQ(actual, projector.Interpolate(fraction));
+      EXPECT_NEAR(polyline.UnInterpolate(actual, actual_next),
+                  projector.UnInterpolate(actual, actual_next), 1e-14);
+    }
+  }
+}
+
+TEST(S2PolylineProjector, SingleVertex) {
+  S2Polyline polyline(vector<S2Point>{S2Point(1, 0, 0)});
+  S2PolylineProjector projector(&polyline);
+  int next_vertex;
+  EXPECT_EQ(S2Point(1, 0, 0),
+            projector.Project(S2Point(0, 1, 0), &next_vertex));
+  EXPECT_EQ(1, next_vertex);
+  EXPECT_EQ(S2Point(1, 0, 0), projector.GetSuffix(0.5, &next_vertex));
+  EXPECT_EQ(1, next_vertex);
+  EXPECT_EQ(0, projector.UnInterpolate(S2Point(1, 0, 0), 1));
+}
+
+TEST(S2PolylineProjector, Endpoints) {
+  auto polyline = s2textformat::MakePolylineOrDie("0:0, 0:1, 0:2");
+  S2PolylineProjector projector(polyline.get());
+  EXPECT_DOUBLE_EQ(S1Angle::Degrees(1).radians(),
+                   projector.cumulative_length(1).radians());
+  int next_vertex;
+  EXPECT_EQ(polyline->vertex(0), projector.GetSuffix(-1, &next_vertex));
+  EXPECT_EQ(1, next_vertex);
+  EXPECT_EQ(polyline->vertex(2), projector.GetSuffix(2, &next_vertex));
+  EXPECT_EQ(3, next_vertex);
+
+  int expected_next_vertex;
+  S2Point mid = projector.GetSuffix(0.5, &next_vertex);
+  EXPECT_EQ(polyline->GetSuffix(0.5, &expected_next_vertex), mid);
+  EXPECT_EQ(expected_next_vertex, next_vertex);
+  EXPECT_DOUBLE_EQ(0.75, projector.UnInterpolate(
+      s2textformat::MakePointOrDie("0:1.5"), 2));
+
+  S2Point p = projector.Project(s2textformat::MakePointOrDie("1:3"),
+                                &next_vertex);
+  EXPECT_EQ(polyline->vertex(2), p);
+  EXPECT_EQ(3, next_vertex);
+}
+
+}  // namespace
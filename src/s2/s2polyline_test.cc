@@ -33,6 +33,7 @@
 #include "s2/s1angle.h"
 #include "s2/s2builderutil_snap_functions.h"
 #include "s2/s2cell.h"
+#include "s2/s2cell_id.h"
 #include "s2/s2coords.h"
 #include "s2/s2debug.h"
 #include "s2/s2latlng.h"
@@ -337,6 +338,23 @@ TEST(S2Polyline, IntersectsAtVertex) {
   EXPECT_TRUE(line1->Intersects(*line3.get()));
 }
 
+TEST(S2Polyline, IntersectsLongPolylines) {
+  // Polylines with enough vertices that an S2ShapeIndex is used.
+  vector<S2LatLng> equator, parallel, meridian, touching;
+  for (int i = 0; i < 100; ++i) {
+    equator.push_back(S2LatLng::FromDegrees(0, 0.1 * i));
+    parallel.push_back(S2LatLng::FromDegrees(0.5, 0.1 * i));
+    meridian.push_back(S2LatLng::FromDegrees(-5 + 0.1 * i, 5.05));
+    touching.push_back(S2LatLng::FromDegrees(-0.1 * i, 5));
+  }
+  S2Polyline line1(equator), line2(parallel), line3(meridian), line4(touching);
+  EXPECT_FALSE(line1.Intersects(line2));
+  EXPECT_TRUE(line1.Intersects(line3));
+  EXPECT_TRUE(line3.Intersects(line1));
+  EXPECT_TRUE(line1.Intersects(line4));
+  EXPECT_FALSE(line2.Intersects(line4));
+}
+
 TEST(S2Polyline, IntersectsVertexOnEdge)  {
   unique_ptr<S2Polyline> horizontal_left_to_right(MakePolyline("0:1, 0:3"));
   unique_ptr<S2Polyline> vertical_bottom_to_top(MakePolyline("-1:2, 0:2, 1:2"));
@@ -564,6 +582,47 @@ TEST(S2Polyline, DecodeCompressedCellLevelTooHigh) {
   EXPECT_FALSE(polyline.Decode(&decoder));
 }
 
+TEST(EncodedS2Polyline, MatchesDecodedPolyline) {
+  unique_ptr<S2Polyline> polyline(MakePolyline("0:0, 0:10, 10:20, 20:30"));
+  // Snap all vertices but the last one, to test off-center points.
+  vector<S2Point> snapped_vertices(polyline->vertices_span().begin(),
+                                   polyline->vertices_span().end());
+  for (int i = 0; i + 1 < snapped_vertices.size(); ++i) {
+    snapped_vertices[i] = S2CellId(snapped_vertices[i]).ToPoint();
+  }
+  S2Polyline snapped(snapped_vertices);
+  S2Polyline empty;
+  for (const S2Polyline* expected : {polyline.get(), &snapped, &empty}) {
+    for (bool compact : {false, true}) {
+      Encoder encoder;
+      if (compact) {
+        expected->EncodeMostCompact(&encoder);
+      } else {
+        expected->EncodeUncompressed(&encoder);
+      }
+      Decoder decoder(encoder.base(), encoder.length());
+      EncodedS2Polyline actual;
+      ASSERT_TRUE(actual.Init(&decoder));
+      Decoder expected_decoder(encoder.base(), encoder.length());
+      S2Polyline decoded;
+      ASSERT_TRUE(decoded.Decode(&expected_decoder));
+      EXPECT_EQ(expected_decoder.avail(), decoder.avail());
+      EXPECT_EQ(expected->num_vertices(), actual.num_vertices());
+      vector<S2Point> vertices;
+      actual.GetVertices(&vertices);
+      EXPECT_TRUE(S2Polyline(vertices).Equals(*expected));
+      EXPECT_TRUE(actual.Decode()->Equals(*expected));
+      EXPECT_EQ(expected->GetRectBound(), actual.GetRectBound());
+      EXPECT_EQ(expected->GetLength(), actual.GetLength());
+
+      if (expected->num_vertices() > 0) {
+        Decoder truncated(encoder.base(), encoder.length() - 1);
+        EXPECT_FALSE(actual.Init(&truncated));
+      }
+    }
+  }
+}
+
 TEST(S2PolylineShape, Basic) {
   unique_ptr<S2Polyline> polyline(MakePolyline("0:0, 1:0, 1:1, 2:1"));
   S2Polyline::Shape shape(polyline.get());
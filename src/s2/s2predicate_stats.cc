@@ -0,0 +1,202 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2predicate_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "absl/base/const_init.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "s2/s2predicates_internal.h"
+
+using std::string;
+using std::vector;
+
+namespace s2pred {
+
+using Predicate = PredicateStats::Predicate;
+using Method = PredicateStats::Method;
+
+constexpr int PredicateStats::kNumPredicates;
+constexpr int PredicateStats::kNumMethods;
+
+int64 PredicateStats::total(Predicate predicate) const {
+  int64 sum = 0;
+  for (int64 count : counts_[static_cast<int>(predicate)]) sum += count;
+  return sum;
+}
+
+string PredicateStats::ToString() const {
+  string result;
+  for (int p = 0; p < kNumPredicates; ++p) {
+    Predicate predicate = static_cast<Predicate>(p);
+    if (total(predicate) == 0) continue;
+    absl::StrAppend(&result, PredicateName(predicate), ":");
+    for (int m = 0; m < kNumMethods; ++m) {
+      if (counts_[p][m] == 0) continue;
+      absl::StrAppend(&result, " ", MethodName(static_cast<Method>(m)), "=",
+                      counts_[p][m]);
+    }
+    absl::StrAppend(&result, "\n");
+  }
+  return result;
+}
+
+const char* PredicateStats::PredicateName(Predicate predicate) {
+  switch (predicate) {
+    case Predicate::SIGN:                    return "Sign";
+    case Predicate::COMPARE_DISTANCES:       return "CompareDistances";
+    case Predicate::COMPARE_DISTANCE:        return "CompareDistance";
+    case Predicate::COMPARE_EDGE_DISTANCE:   return "CompareEdgeDistance";
+    case Predicate::COMPARE_EDGE_DIRECTIONS: return "CompareEdgeDirections";
+    case Predicate::EDGE_CIRCUMCENTER_SIGN:  return "EdgeCircumcenterSign";
+    case Predicate::VORONOI_SITE_EXCLUSION:  return "VoronoiSiteExclusion";
+  }
+  return "Unknown";
+}
+
+const char* PredicateStats::MethodName(Method method) {
+  switch (method) {
+    case Method::TRIAGE:      return "triage";
+    case Method::STABLE:      return "stable";
+    case Method::LONG_DOUBLE: return "long_double";
+    case Method::EXACT:       return "exact";
+    case Method::SYMBOLIC:    return "symbolic";
+  }
+  return "unknown";
+}
+
+#ifdef S2_PREDICATE_STATS
+
+namespace {
+
+using Counts = int64[PredicateStats::kNumPredicates]
+                    [PredicateStats::kNumMethods];
+
+// The counters for one thread.  Each counter is only modified by its own
+// thread, so it is updated with a relaxed load and store rather than an
+// atomic read-modify-write operation.  The atomic type only ensures that
+// GetPredicateStats() can read the counters of other threads safely.
+struct ThreadCounters {
+  ThreadCounters();
+  ~ThreadCounters();
+
+  void AddTo(Counts* counts) const {
+    for (int p = 0; p < PredicateStats::kNumPredicates; ++p) {
+      for (int m = 0; m < PredicateStats::kNumMethods; ++m) {
+        (*counts)[p][m] += counters[p][m].load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  std::atomic<int64> counters[PredicateStats::kNumPredicates]
+                             [PredicateStats::kNumMethods];
+};
+
+ABSL_CONST_INIT absl::Mutex registry_mutex(absl::kConstInit);
+
+// The counters of all running threads.  (Allocated on first use and never
+// deleted, so that threads may exit during program shutdown.)
+vector<const ThreadCounters*>* registry ABSL_GUARDED_BY(registry_mutex) =
+    nullptr;
+
+// The sum of the counts of all threads that have exited.
+Counts exited_counts ABSL_GUARDED_BY(registry_mutex) = {};
+
+// The total counts at the time of the last ResetPredicateStats() call.
+Counts reset_counts ABSL_GUARDED_BY(registry_mutex) = {};
+
+ThreadCounters::ThreadCounters() {
+  for (auto& row : counters) {
+    for (auto& counter : row) counter.store(0, std::memory_order_relaxed);
+  }
+  absl::MutexLock lock(&registry_mutex);
+  if (registry == nullptr) registry = new vector<const ThreadCounters*>;
+  registry->push_back(this);
+}
+
+ThreadCounters::~ThreadCounters() {
+  absl::MutexLock lock(&registry_mutex);
+  AddTo(&exited_counts);
+  registry->erase(std::find(registry->begin(), registry->end(), this));
+}
+
+ThreadCounters& GetThreadCounters() {
+  static thread_local ThreadCounters thread_counters;
+  return thread_counters;
+}
+
+// Sets "counts" to the total counts of all threads.
+void GetTotalCounts(Counts* counts)
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(registry_mutex) {
+  for (int p = 0; p < PredicateStats::kNumPredicates; ++p) {
+    for (int m = 0; m < PredicateStats::kNumMethods; ++m) {
+      (*counts)[p][m] = exited_counts[p][m];
+    }
+  }
+  if (registry == nullptr) return;
+  for (const ThreadCounters* thread_counters : *registry) {
+    thread_counters->AddTo(counts);
+  }
+}
+
+}  // namespace
+
+void RecordPredicateStat(Predicate predicate, Method method, int64 count) {
+  std::atomic<int64>& counter = GetThreadCounters().counters[
+      static_cast<int>(predicate)][static_cast<int>(method)];
+  counter.store(counter.load(std::memory_order_relaxed) + count,
+                std::memory_order_relaxed);
+}
+
+bool PredicateStatsEnabled() { return true; }
+
+PredicateStats GetPredicateStats() {
+  PredicateStats stats;
+  absl::MutexLock lock(&registry_mutex);
+  GetTotalCounts(&stats.counts_);
+  for (int p = 0; p < PredicateStats::kNumPredicates; ++p) {
+    for (int m = 0; m < PredicateStats::kNumMethods; ++m) {
+      stats.counts_[p][m] -= reset_counts[p][m];
+    }
+  }
+  return stats;
+}
+
+void ResetPredicateStats() {
+  // Other threads may be updating their counters concurrently, so rather
+  // than modifying them we remember the current totals.
+  absl::MutexLock lock(&registry_mutex);
+  GetTotalCounts(&reset_counts);
+}
+
+#else  // !S2_PREDICATE_STATS
+
+void RecordPredicateStat(Predicate, Method, int64) {}
+
+bool PredicateStatsEnabled() { return false; }
+
+PredicateStats GetPredicateStats() { return PredicateStats(); }
+
+void ResetPredicateStats() {}
+
+#endif  // S2_PREDICATE_STATS
+
+}  // namespace s2pred
@@ -0,0 +1,105 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2PREDICATE_STATS_H_
+#define S2_S2PREDICATE_STATS_H_
+
+#include <string>
+
+#include "s2/base/integral_types.h"
+
+namespace s2pred {
+
+// PredicateStats counts how often each exact predicate in s2predicates.h had
+// to fall back to more expensive arithmetic in order to determine its
+// result.  Normally almost every call is resolved using double precision;
+// inputs that frequently require exact arithmetic or symbolic perturbations
+// (e.g., many exactly collinear or duplicate points) can make geometric
+// operations much slower, and these statistics help to identify them.
+//
+// Counting is disabled by default.  It is compiled in by defining
+// S2_PREDICATE_STATS when building the library (e.g., by configuring CMake
+// with -DWITH_PREDICATE_STATS=ON).  The counters are thread-local, so the
+// overhead when enabled is a few instructions per predicate call.
+//
+// Each predicate call is counted once, according to the method that finally
+// determined its result.  Note that Sign() resolves most calls inline in
+// s2predicates.h; only the calls that reach ExpensiveSign() (and all the
+// triangles passed to the batched version of Sign()) are counted.
+//
+// Example usage:
+//
+//   s2pred::ResetPredicateStats();
+//   RunExpensiveOperation();
+//   S2_LOG(INFO) << s2pred::GetPredicateStats().ToString();
+class PredicateStats {
+ public:
+  enum class Predicate {
+    SIGN,
+    COMPARE_DISTANCES,
+    COMPARE_DISTANCE,
+    COMPARE_EDGE_DISTANCE,
+    COMPARE_EDGE_DIRECTIONS,
+    EDGE_CIRCUMCENTER_SIGN,
+    VORONOI_SITE_EXCLUSION,
+  };
+  static constexpr int kNumPredicates = 7;
+
+  // The method used to determine the result, in order of increasing cost.
+  enum class Method {
+    TRIAGE,       // Double precision with error bounds.
+    STABLE,       // A numerically stable double precision formula.
+    LONG_DOUBLE,  // "long double" precision with error bounds.
+    EXACT,        // Exact arithmetic.
+    SYMBOLIC,     // Symbolic perturbations.
+  };
+  static constexpr int kNumMethods = 5;
+
+  // Returns the number of calls to the given predicate that were resolved
+  // using the given method.
+  int64 count(Predicate predicate, Method method) const {
+    return counts_[static_cast<int>(predicate)][static_cast<int>(method)];
+  }
+
+  // Returns the total number of calls to the given predicate.
+  int64 total(Predicate predicate) const;
+
+  // Returns a human-readable summary of the non-zero counts.
+  std::string ToString() const;
+
+  static const char* PredicateName(Predicate predicate);
+  static const char* MethodName(Method method);
+
+ private:
+  friend PredicateStats GetPredicateStats();
+  int64 counts_[kNumPredicates][kNumMethods] = {};
+};
+
+// Returns true if the library was compiled with S2_PREDICATE_STATS.
+bool PredicateStatsEnabled();
+
+// Returns the counts summed over all threads (including threads that have
+// exited) since the last call to ResetPredicateStats().  Returns all zeros if
+// PredicateStatsEnabled() is false.  This method is thread-safe, but the
+// counts of threads that are calling predicates concurrently may not be
+// up to date.
+PredicateStats GetPredicateStats();
+
+// Resets the counts returned by GetPredicateStats() to zero.
+void ResetPredicateStats();
+
+}  // namespace s2pred
+
+#endif  // S2_S2PREDICATE_STATS_H_
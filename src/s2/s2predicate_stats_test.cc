@@ -0,0 +1,96 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2predicate_stats.h"
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "s2/s1chord_angle.h"
+#include "s2/s2point.h"
+#include "s2/s2predicates.h"
+
+using std::vector;
+
+namespace s2pred {
+namespace {
+
+using Predicate = PredicateStats::Predicate;
+using Method = PredicateStats::Method;
+
+// Three distinct points on the equator, whose sign can only be determined
+// using symbolic perturbations.
+const S2Point kA(1, 0, 0), kB(0, 1, 0), kC(-1, 0, 0);
+
+TEST(PredicateStats, CountsMethods) {
+  ResetPredicateStats();
+  EXPECT_EQ(0, GetPredicateStats().total(Predicate::SIGN));
+
+  EXPECT_NE(0, Sign(kA, kB, kC));
+  S2Point x(0, 0, 1), a(1, 0, 0), b(0, 1, 0);
+  EXPECT_NE(0, CompareDistances(x, a, b));  // Equidistant (symbolic).
+  EXPECT_EQ(-1, CompareDistance(a, b, S1ChordAngle::Straight()));
+
+  PredicateStats stats = GetPredicateStats();
+  if (!PredicateStatsEnabled()) {
+    for (int p = 0; p < PredicateStats::kNumPredicates; ++p) {
+      EXPECT_EQ(0, stats.total(static_cast<Predicate>(p)));
+    }
+    EXPECT_EQ("", stats.ToString());
+    return;
+  }
+  EXPECT_EQ(1, stats.count(Predicate::SIGN, Method::SYMBOLIC));
+  EXPECT_EQ(1, stats.count(Predicate::COMPARE_DISTANCES, Method::SYMBOLIC));
+  EXPECT_EQ(1, stats.count(Predicate::COMPARE_DISTANCE, Method::TRIAGE));
+  EXPECT_NE("", stats.ToString());
+
+  ResetPredicateStats();
+  EXPECT_EQ(0, GetPredicateStats().total(Predicate::SIGN));
+}
+
+TEST(PredicateStats, BatchedSign) {
+  vector<S2Point> a = {kA, S2Point(1, 0, 0)};
+  vector<S2Point> b = {kB, S2Point(0, 1, 0)};
+  vector<S2Point> c = {kC, S2Point(0, 0, 1)};
+  vector<int> signs(2);
+  ResetPredicateStats();
+  Sign(a, b, c, absl::MakeSpan(signs));
+  EXPECT_EQ(1, signs[1]);
+  if (!PredicateStatsEnabled()) return;
+  PredicateStats stats = GetPredicateStats();
+  EXPECT_EQ(1, stats.count(Predicate::SIGN, Method::TRIAGE));
+  EXPECT_EQ(1, stats.count(Predicate::SIGN, Method::SYMBOLIC));
+}
+
+TEST(PredicateStats, MultipleThreads) {
+  ResetPredicateStats();
+  constexpr int kNumThreads = 4, kNumCalls = 100;
+  vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([]() {
+      for (int i = 0; i < kNumCalls; ++i) Sign(kA, kB, kC);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  // The counts of threads that have exited are still reported.
+  if (!PredicateStatsEnabled()) return;
+  EXPECT_EQ(kNumThreads * kNumCalls,
+            GetPredicateStats().count(Predicate::SIGN, Method::SYMBOLIC));
+}
+
+}  // namespace
+}  // namespace s2pred
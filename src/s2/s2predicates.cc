@@ -35,9 +35,275 @@ using std::sqrt;
 
 namespace s2pred {
 
+using Predicate = PredicateStats::Predicate;
+using Method = PredicateStats::Method;
+
 // A predefined S1ChordAngle representing (approximately) 45 degrees.
 static const S1ChordAngle k45Degrees = S1ChordAngle::FromLength2(2 - M_SQRT2);
 
+// True if RecordPredicateStat() should be called.  When statistics are not
+// compiled in, this avoids calling a function that does nothing.
+#ifdef S2_PREDICATE_STATS
+static constexpr bool kRecordPredicateStats = true;
+#else
+static constexpr bool kRecordPredicateStats = false;
+#endif
+
+// Records that the given predicate was resolved using the given method (see
+// s2predicate_stats.h), and returns "result".
+template <class T>
+inline static T Resolved(Predicate predicate, Method method, T result) {
+  if (kRecordPredicateStats) RecordPredicateStat(predicate, method);
+  return result;
+}
+
+////////////////////////// ExpansionFloat //////////////////////////////
+//
+// The algorithms below are from Shewchuk's paper.  They require IEEE 754
+// arithmetic with round-to-even, and that the compiler does not fuse or
+// reorder floating-point operations (see _fp_contract_off.h).
+
+// The largest magnitude of any value or product, chosen so that Split()
+// does not overflow and sums of many products remain finite.
+static const double kMaxExpansionValue = std::ldexp(1.0, 995);
+
+// The smallest magnitude of any non-zero product.  This ensures that the
+// rounding error of every product is exactly representable (since the error
+// is a multiple of ulp(a) * ulp(b) >= |a * b| * 2**-106 >= 2**-1074).
+static const double kMinExpansionProduct = std::ldexp(1.0, -968);
+
+// Sets (x, y) such that x + y == a + b exactly, where x = fl(a + b).
+inline static void TwoSum(double a, double b, double* x, double* y) {
+  *x = a + b;
+  double b_virtual = *x - a;
+  double a_virtual = *x - b_virtual;
+  *y = (a - a_virtual) + (b - b_virtual);
+}
+
+// Like TwoSum, but requires that |a| >= |b| (or a == 0).
+inline static void FastTwoSum(double a, double b, double* x, double* y) {
+  *x = a + b;
+  *y = b - (*x - a);
+}
+
+// Splits "a" into two non-overlapping halves of at most 26 bits each.
+inline static void Split(double a, double* hi, double* lo) {
+  constexpr double kSplitter = 134217729.0;  // 2**27 + 1
+  double c = kSplitter * a;
+  *hi = c - (c - a);
+  *lo = a - *hi;
+}
+
+// Sets (x, y) such that x + y == a * b exactly, where x = fl(a * b).  Returns
+// false if the product might underflow or overflow.
+inline static bool TwoProduct(double a, double b, double* x, double* y) {
+  *x = a * b;
+  if (*x == 0 && (a == 0 || b == 0)) {
+    *y = 0;
+    return true;
+  }
+  if (!(std::fabs(*x) >= kMinExpansionProduct &&
+        std::fabs(*x) <= kMaxExpansionValue &&
+        std::fabs(a) <= kMaxExpansionValue &&
+        std::fabs(b) <= kMaxExpansionValue)) {
+    return false;
+  }
+  double a_hi, a_lo, b_hi, b_lo;
+  Split(a, &a_hi, &a_lo);
+  Split(b, &b_hi, &b_lo);
+  double err = *x - a_hi * b_hi;
+  err -= a_lo * b_hi;
+  err -= a_hi * b_lo;
+  *y = a_lo * b_lo - err;
+  return true;
+}
+
+// Sets h = e + f, where "e" and "f" are non-overlapping expansions sorted by
+// increasing magnitude, and returns the number of components of "h".  Zero
+// components are eliminated.  "h" must have room for (elen + flen) values.
+static int ExpansionSum(const double* e, int elen, const double* f, int flen,
+                        double* h) {
+  if (elen == 0 || flen == 0) {
+    if (elen == 0) std::copy(f, f + flen, h);
+    if (flen == 0) std::copy(e, e + elen, h);
+    return elen + flen;
+  }
+  // Merge the components by increasing magnitude, and then add them up from
+  // smallest to largest.  When this is done in place as below, each
+  // component that is output is a rounding error that is strictly smaller
+  // than the remaining sum, which keeps the result non-overlapping.
+  int i = 0, j = 0, hlen = 0;
+  auto next = [&]() {
+    return (j == flen ||
+            (i < elen && std::fabs(e[i]) <= std::fabs(f[j]))) ? e[i++]
+                                                                : f[j++];
+  };
+  double q = next();
+  while (i < elen || j < flen) {
+    double err;
+    TwoSum(q, next(), &q, &err);
+    if (err != 0) h[hlen++] = err;
+  }
+  if (q != 0) h[hlen++] = q;
+  return hlen;
+}
+
+// Sets h = e * b, where "e" is a non-overlapping expansion sorted by
+// increasing magnitude, and returns the number of components of "h" (or -1
+// if some product might underflow or overflow).  Zero components are
+// eliminated.  "h" must have room for (2 * elen) values.
+static int ScaleExpansion(const double* e, int elen, double b, double* h) {
+  if (elen == 0) return 0;
+  int hlen = 0;
+  double q, err;
+  if (!TwoProduct(e[0], b, &q, &err)) return -1;
+  if (err != 0) h[hlen++] = err;
+  for (int i = 1; i < elen; ++i) {
+    double product1, product0, sum;
+    if (!TwoProduct(e[i], b, &product1, &product0)) return -1;
+    TwoSum(q, product0, &sum, &err);
+    if (err != 0) h[hlen++] = err;
+    FastTwoSum(product1, sum, &q, &err);
+    if (err != 0) h[hlen++] = err;
+  }
+  if (q != 0) h[hlen++] = q;
+  return hlen;
+}
+
+// Replaces the expansion "e" in place by an equivalent expansion with the
+// fewest components that Shewchuk's compression algorithm can find, and
+// returns its number of components.
+static int CompressExpansion(double* e, int elen) {
+  if (elen <= 1) return elen;
+  int bottom = elen - 1;
+  double q = e[bottom];
+  for (int i = elen - 2; i >= 0; --i) {
+    double q_new, err;
+    FastTwoSum(q, e[i], &q_new, &err);
+    if (err != 0) {
+      e[bottom--] = q_new;
+      q = err;
+    } else {
+      q = q_new;
+    }
+  }
+  int top = 0;
+  for (int i = bottom + 1; i < elen; ++i) {
+    double q_new, err;
+    FastTwoSum(e[i], q, &q_new, &err);
+    if (err != 0) e[top++] = err;
+    q = q_new;
+  }
+  e[top++] = q;
+  return top;
+}
+
+ExpansionFloat::ExpansionFloat(double x) : size_(0), valid_(true) {
+  if (!(std::fabs(x) <= kMaxExpansionValue)) {
+    valid_ = false;  // Infinity, NaN, or too large.
+  } else if (x != 0) {
+    c_[size_++] = x;
+  }
+}
+
+ExpansionFloat::ExpansionFloat(const ExpansionFloat& x)
+    : size_(x.size_), valid_(x.valid_) {
+  std::copy(x.c_, x.c_ + x.size_, c_);
+}
+
+ExpansionFloat& ExpansionFloat::operator=(const ExpansionFloat& x) {
+  size_ = x.size_;
+  valid_ = x.valid_;
+  std::copy(x.c_, x.c_ + x.size_, c_);
+  return *this;
+}
+
+ExpansionFloat ExpansionFloat::Invalid() {
+  ExpansionFloat r;
+  r.valid_ = false;
+  return r;
+}
+
+// Sets this value to the expansion "c" (after compressing it), or marks it
+// invalid if there are too many components.
+void ExpansionFloat::Assign(const double* c, int size) {
+  if (size > kMaxComponents) {
+    valid_ = false;
+    size_ = 0;
+  } else {
+    size_ = size;
+    std::copy(c, c + size, c_);
+  }
+}
+
+int ExpansionFloat::sgn() const {
+  S2_DCHECK(valid_);
+  if (size_ == 0) return 0;
+  return (c_[size_ - 1] > 0) ? 1 : -1;
+}
+
+double ExpansionFloat::ToDouble() const {
+  double sum = 0;
+  for (int i = 0; i < size_; ++i) sum += c_[i];
+  return sum;
+}
+
+ExpansionFloat operator-(const ExpansionFloat& a) {
+  ExpansionFloat r = a;
+  for (int i = 0; i < r.size_; ++i) r.c_[i] = -r.c_[i];
+  return r;
+}
+
+ExpansionFloat operator+(const ExpansionFloat& a, const ExpansionFloat& b) {
+  if (!a.valid_ || !b.valid_) return ExpansionFloat::Invalid();
+  double h[2 * ExpansionFloat::kMaxComponents];
+  int hlen = ExpansionSum(a.c_, a.size_, b.c_, b.size_, h);
+  ExpansionFloat r;
+  r.Assign(h, CompressExpansion(h, hlen));
+  return r;
+}
+
+ExpansionFloat operator-(const ExpansionFloat& a, const ExpansionFloat& b) {
+  return a + (-b);
+}
+
+ExpansionFloat operator*(const ExpansionFloat& a, const ExpansionFloat& b) {
+  if (!a.valid_ || !b.valid_) return ExpansionFloat::Invalid();
+  // Multiply "a" by each component of the shorter expansion "b" and add up
+  // the partial products.
+  if (a.size_ < b.size_) return b * a;
+  constexpr int kMax = ExpansionFloat::kMaxComponents;
+  double product[2 * kMax], sum[3 * kMax], result[kMax];
+  int result_len = 0;
+  for (int i = 0; i < b.size_; ++i) {
+    int product_len = ScaleExpansion(a.c_, a.size_, b.c_[i], product);
+    if (product_len < 0) return ExpansionFloat::Invalid();
+    int sum_len = CompressExpansion(
+        sum, ExpansionSum(result, result_len, product, product_len, sum));
+    if (sum_len > kMax) return ExpansionFloat::Invalid();
+    std::copy(sum, sum + sum_len, result);
+    result_len = sum_len;
+  }
+  ExpansionFloat r;
+  r.Assign(result, result_len);
+  return r;
+}
+
+// Returns x.sgn().  (ExactFloat arithmetic is always exact.)
+inline static int Sgn(const ExactFloat& x, bool* /*valid*/) {
+  return x.sgn();
+}
+
+// Returns x.sgn() if "x" is valid, and otherwise sets "valid" to false and
+// returns 0.
+inline static int Sgn(const ExpansionFloat& x, bool* valid) {
+  if (!x.is_valid()) {
+    *valid = false;
+    return 0;
+  }
+  return x.sgn();
+}
+
 int Sign(const S2Point& a, const S2Point& b, const S2Point& c) {
   // We don't need RobustCrossProd() here because Sign() does its own
   // error estimation and calls ExpensiveSign() if there is any uncertainty
@@ -45,6 +311,36 @@ int Sign(const S2Point& a, const S2Point& b, const S2Point& c) {
   return Sign(a, b, c, a.CrossProd(b));
 }
 
+void Sign(absl::Span<const S2Point> a, absl::Span<const S2Point> b,
+          absl::Span<const S2Point> c, absl::Span<int> signs) {
+  S2_DCHECK_EQ(a.size(), signs.size());
+  S2_DCHECK_EQ(b.size(), signs.size());
+  S2_DCHECK_EQ(c.size(), signs.size());
+
+  // This is the same calculation as TriageSign(), but without the debug
+  // checks or early returns so that the loop can be vectorized.  Each
+  // iteration is a fixed sequence of multiplies and adds on its own
+  // triangle, so the compiler can vectorize it for whatever instruction set
+  // it targets and no hand-written intrinsics are needed.
+  const double kMaxDetError = 1.8274 * DBL_EPSILON;
+  const int n = signs.size();
+  for (int i = 0; i < n; ++i) {
+    double det = a[i].CrossProd(b[i]).DotProd(c[i]);
+    signs[i] = (det > kMaxDetError) - (det < -kMaxDetError);
+  }
+  // Now resolve the uncertain cases.  Normally there are very few of these.
+  int num_uncertain = 0;
+  for (int i = 0; i < n; ++i) {
+    if (signs[i] == 0) {
+      signs[i] = ExpensiveSign(a[i], b[i], c[i]);
+      ++num_uncertain;
+    }
+  }
+  if (kRecordPredicateStats) {
+    RecordPredicateStat(Predicate::SIGN, Method::TRIAGE, n - num_uncertain);
+  }
+}
+
 // Compute the determinant in a numerically stable way.  Unlike TriageSign(),
 // this method can usually compute the correct determinant sign even when all
 // three points are as collinear as possible.  For example if three points are
@@ -125,9 +421,13 @@ int StableSign(const S2Point& a, const S2Point& b, const S2Point& c) {
 //   "Simulation of Simplicity" (Edelsbrunner and Muecke, ACM Transactions on
 //   Graphics, 1990).
 //
-int SymbolicallyPerturbedSign(
-    const Vector3_xf& a, const Vector3_xf& b,
-    const Vector3_xf& c, const Vector3_xf& b_cross_c) {
+// The arithmetic type T is either ExactFloat or ExpansionFloat.  If any
+// ExpansionFloat value could not be computed exactly then "valid" is set to
+// false and the result should be ignored.
+template <class T>
+static int SymbolicallyPerturbedSign(
+    const Vector3<T>& a, const Vector3<T>& b,
+    const Vector3<T>& c, const Vector3<T>& b_cross_c, bool* valid) {
   // This method requires that the points are sorted in lexicographically
   // increasing order.  This is because every possible S2Point has its own
   // symbolic perturbation such that if A < B then the symbolic perturbation
@@ -186,38 +486,45 @@ int SymbolicallyPerturbedSign(
   // some of the signs are different because the opposite cross product is
   // used (e.g., B x C rather than C x B).
 
-  int det_sign = b_cross_c[2].sgn();            // da[2]
+  int det_sign = Sgn(b_cross_c[2], valid);      // da[2]
   if (det_sign != 0) return det_sign;
-  det_sign = b_cross_c[1].sgn();                // da[1]
+  det_sign = Sgn(b_cross_c[1], valid);          // da[1]
   if (det_sign != 0) return det_sign;
-  det_sign = b_cross_c[0].sgn();                // da[0]
+  det_sign = Sgn(b_cross_c[0], valid);          // da[0]
   if (det_sign != 0) return det_sign;
 
-  det_sign = (c[0]*a[1] - c[1]*a[0]).sgn();     // db[2]
+  det_sign = Sgn(c[0]*a[1] - c[1]*a[0], valid);  // db[2]
   if (det_sign != 0) return det_sign;
-  det_sign = c[0].sgn();                        // db[2] * da[1]
+  det_sign = Sgn(c[0], valid);                  // db[2] * da[1]
   if (det_sign != 0) return det_sign;
-  det_sign = -(c[1].sgn());                     // db[2] * da[0]
+  det_sign = -Sgn(c[1], valid);                 // db[2] * da[0]
   if (det_sign != 0) return det_sign;
-  det_sign = (c[2]*a[0] - c[0]*a[2]).sgn();     // db[1]
+  det_sign = Sgn(c[2]*a[0] - c[0]*a[2], valid);  // db[1]
   if (det_sign != 0) return det_sign;
-  det_sign = c[2].sgn();                        // db[1] * da[0]
+  det_sign = Sgn(c[2], valid);                  // db[1] * da[0]
   if (det_sign != 0) return det_sign;
   // The following test is listed in the paper, but it is redundant because
   // the previous tests guarantee that C == (0, 0, 0).
-  S2_DCHECK_EQ(0, (c[1]*a[2] - c[2]*a[1]).sgn());  // db[0]
+  S2_DCHECK_EQ(0, Sgn(c[1]*a[2] - c[2]*a[1], valid));  // db[0]
 
-  det_sign = (a[0]*b[1] - a[1]*b[0]).sgn();     // dc[2]
+  det_sign = Sgn(a[0]*b[1] - a[1]*b[0], valid);  // dc[2]
   if (det_sign != 0) return det_sign;
-  det_sign = -(b[0].sgn());                     // dc[2] * da[1]
+  det_sign = -Sgn(b[0], valid);                 // dc[2] * da[1]
   if (det_sign != 0) return det_sign;
-  det_sign = b[1].sgn();                        // dc[2] * da[0]
+  det_sign = Sgn(b[1], valid);                  // dc[2] * da[0]
   if (det_sign != 0) return det_sign;
-  det_sign = a[0].sgn();                        // dc[2] * db[1]
+  det_sign = Sgn(a[0], valid);                  // dc[2] * db[1]
   if (det_sign != 0) return det_sign;
   return 1;                                     // dc[2] * db[1] * da[0]
 }
 
+int SymbolicallyPerturbedSign(
+    const Vector3_xf& a, const Vector3_xf& b,
+    const Vector3_xf& c, const Vector3_xf& b_cross_c) {
+  bool valid = true;
+  return SymbolicallyPerturbedSign(a, b, c, b_cross_c, &valid);
+}
+
 // Compute the determinant using exact arithmetic and/or symbolic
 // permutations.  Requires that the three points are distinct.
 int ExactSign(const S2Point& a, const S2Point& b, const S2Point& c,
@@ -234,8 +541,24 @@ int ExactSign(const S2Point& a, const S2Point& b, const S2Point& c,
   if (*pa > *pb) { swap(pa, pb); perm_sign = -perm_sign; }
   S2_DCHECK(*pa < *pb && *pb < *pc);
 
-  // Construct multiple-precision versions of the sorted points and compute
-  // their exact 3x3 determinant.
+  // First try computing the exact determinant using ExpansionFloat, which
+  // does not allocate memory.  This succeeds except in the rare cases where
+  // some intermediate value underflows.
+  Vector3_ef ea = ToExpansion(*pa);
+  Vector3_ef eb = ToExpansion(*pb);
+  Vector3_ef ec = ToExpansion(*pc);
+  Vector3_ef eb_cross_ec = eb.CrossProd(ec);
+  bool valid = true;
+  int det_sign = Sgn(ea.DotProd(eb_cross_ec), &valid);
+  Method method = Method::EXACT;
+  if (det_sign == 0 && perturb && valid) {
+    det_sign = SymbolicallyPerturbedSign(ea, eb, ec, eb_cross_ec, &valid);
+    method = Method::SYMBOLIC;
+  }
+  if (valid) return Resolved(Predicate::SIGN, method, perm_sign * det_sign);
+
+  // Otherwise construct multiple-precision versions of the sorted points and
+  // compute their exact 3x3 determinant.
   Vector3_xf xa = ToExact(*pa);
   Vector3_xf xb = ToExact(*pb);
   Vector3_xf xc = ToExact(*pc);
@@ -248,14 +571,16 @@ int ExactSign(const S2Point& a, const S2Point& b, const S2Point& c,
   S2_DCHECK_LT(det.prec(), det.max_prec());
 
   // If the exact determinant is non-zero, we're done.
-  int det_sign = det.sgn();
+  det_sign = det.sgn();
+  method = Method::EXACT;
   if (det_sign == 0 && perturb) {
     // Otherwise, we need to resort to symbolic perturbations to resolve the
     // sign of the determinant.
     det_sign = SymbolicallyPerturbedSign(xa, xb, xc, xb_cross_xc);
     S2_DCHECK_NE(0, det_sign);
+    method = Method::SYMBOLIC;
   }
-  return perm_sign * det_sign;
+  return Resolved(Predicate::SIGN, method, perm_sign * det_sign);
 }
 
 // ExpensiveSign() uses arbitrary-precision arithmetic and the "simulation of
@@ -272,7 +597,9 @@ int ExactSign(const S2Point& a, const S2Point& b, const S2Point& c,
 int ExpensiveSign(const S2Point& a, const S2Point& b, const S2Point& c,
                   bool perturb) {
   // Return zero if and only if two points are the same.  This ensures (1).
-  if (a == b || b == c || c == a) return 0;
+  if (a == b || b == c || c == a) {
+    return Resolved(Predicate::SIGN, Method::TRIAGE, 0);
+  }
 
   // Next we try recomputing the determinant still using floating-point
   // arithmetic but in a more precise way.  This is more expensive than the
@@ -281,14 +608,11 @@ int ExpensiveSign(const S2Point& a, const S2Point& b, const S2Point& c,
   // compute the correct determinant sign in virtually all cases except when
   // the three points are truly collinear (e.g., three points on the equator).
   int det_sign = StableSign(a, b, c);
-  if (det_sign != 0) return det_sign;
+  if (det_sign != 0) return Resolved(Predicate::SIGN, Method::STABLE, det_sign);
 
   // TODO(ericv): Create a templated version of StableSign so that we can
   // retry in "long double" precision before falling back to ExactFloat.
 
-  // TODO(ericv): Optimize ExactFloat so that it stores up to 32 bytes of
-  // mantissa inline (without requiring memory allocation).
-
   // Otherwise fall back to exact arithmetic and symbolic permutations.
   return ExactSign(a, b, c, perturb);
 }
@@ -387,22 +711,31 @@ int TriageCompareSin2Distances(const Vector3<T>& x,
   return (diff > error) ? 1 : (diff < -error) ? -1 : 0;
 }
 
-int ExactCompareDistances(const Vector3_xf& x,
-                          const Vector3_xf& a, const Vector3_xf& b) {
+// The arithmetic type T is either ExactFloat or ExpansionFloat (see
+// SymbolicallyPerturbedSign).
+template <class T>
+static int ExactCompareDistances(const Vector3<T>& x, const Vector3<T>& a,
+                                 const Vector3<T>& b, bool* valid) {
   // This code produces the same result as though all points were reprojected
   // to lie exactly on the surface of the unit sphere.  It is based on testing
   // whether x.DotProd(a.Normalize()) < x.DotProd(b.Normalize()), reformulated
   // so that it can be evaluated using exact arithmetic.
-  ExactFloat cos_ax = x.DotProd(a);
-  ExactFloat cos_bx = x.DotProd(b);
+  T cos_ax = x.DotProd(a);
+  T cos_bx = x.DotProd(b);
   // If the two values have different signs, we need to handle that case now
   // before squaring them below.
-  int a_sign = cos_ax.sgn(), b_sign = cos_bx.sgn();
+  int a_sign = Sgn(cos_ax, valid), b_sign = Sgn(cos_bx, valid);
   if (a_sign != b_sign) {
     return (a_sign > b_sign) ? -1 : 1;  // If cos(AX) > cos(BX), then AX < BX.
   }
-  ExactFloat cmp = cos_bx * cos_bx * a.Norm2() - cos_ax * cos_ax * b.Norm2();
-  return a_sign * cmp.sgn();
+  T cmp = cos_bx * cos_bx * a.Norm2() - cos_ax * cos_ax * b.Norm2();
+  return a_sign * Sgn(cmp, valid);
+}
+
+int ExactCompareDistances(const Vector3_xf& x,
+                          const Vector3_xf& a, const Vector3_xf& b) {
+  bool valid = true;
+  return ExactCompareDistances(x, a, b, &valid);
 }
 
 // Given three points such that AX == BX (exactly), returns -1, 0, or +1
@@ -430,10 +763,13 @@ int SymbolicCompareDistances(const S2Point& x,
   return (a < b) ? 1 : (a > b) ? -1 : 0;
 }
 
-static int CompareSin2Distances(const S2Point& x,
-                                const S2Point& a, const S2Point& b) {
+// Also sets "method" to the method that determined the result (if any).
+static int CompareSin2Distances(const S2Point& x, const S2Point& a,
+                                const S2Point& b, Method* method) {
+  *method = Method::STABLE;
   int sign = TriageCompareSin2Distances(x, a, b);
   if (kHasLongDouble && sign == 0) {
+    *method = Method::LONG_DOUBLE;
     sign = TriageCompareSin2Distances(ToLD(x), ToLD(a), ToLD(b));
   }
   return sign;
@@ -445,11 +781,12 @@ int CompareDistances(const S2Point& x, const S2Point& a, const S2Point& b) {
   // over the entire range of possible angles.  (We can only use the sin^2
   // technique if both angles are less than 90 degrees or both angles are
   // greater than 90 degrees.)
+  constexpr Predicate kPredicate = Predicate::COMPARE_DISTANCES;
   int sign = TriageCompareCosDistances(x, a, b);
-  if (sign != 0) return sign;
+  if (sign != 0) return Resolved(kPredicate, Method::TRIAGE, sign);
 
   // Optimization for (a == b) to avoid falling back to exact arithmetic.
-  if (a == b) return 0;
+  if (a == b) return Resolved(kPredicate, Method::TRIAGE, 0);
 
   // It is much better numerically to compare distances using cos(angle) if
   // the distances are near 90 degrees and sin^2(angle) if the distances are
@@ -457,20 +794,27 @@ int CompareDistances(const S2Point& x, const S2Point& a, const S2Point& b) {
   // making this decision because the fact that the test above failed means
   // that angles "a" and "b" are very close together.
   double cos_ax = a.DotProd(x);
+  Method method = Method::LONG_DOUBLE;
   if (cos_ax > M_SQRT1_2) {
     // Angles < 45 degrees.
-    sign = CompareSin2Distances(x, a, b);
+    sign = CompareSin2Distances(x, a, b, &method);
   } else if (cos_ax < -M_SQRT1_2) {
     // Angles > 135 degrees.  sin^2(angle) is decreasing in this range.
-    sign = -CompareSin2Distances(x, a, b);
+    sign = -CompareSin2Distances(x, a, b, &method);
   } else if (kHasLongDouble) {
     // We've already tried double precision, so continue with "long double".
     sign = TriageCompareCosDistances(ToLD(x), ToLD(a), ToLD(b));
   }
-  if (sign != 0) return sign;
-  sign = ExactCompareDistances(ToExact(x), ToExact(a), ToExact(b));
-  if (sign != 0) return sign;
-  return SymbolicCompareDistances(x, a, b);
+  if (sign != 0) return Resolved(kPredicate, method, sign);
+  bool valid = true;
+  sign = ExactCompareDistances(ToExpansion(x), ToExpansion(a), ToExpansion(b),
+                               &valid);
+  if (!valid) {
+    sign = ExactCompareDistances(ToExact(x), ToExact(a), ToExact(b));
+  }
+  if (sign != 0) return Resolved(kPredicate, Method::EXACT, sign);
+  return Resolved(kPredicate, Method::SYMBOLIC,
+                  SymbolicCompareDistances(x, a, b));
 }
 
 template <class T>
@@ -521,26 +865,33 @@ int CompareDistance(const S2Point& x, const S2Point& y, S1ChordAngle r) {
   // As with CompareDistances(), we start by comparing dot products because
   // the sin^2 method is only valid when the distance XY and the limit "r" are
   // both less than 90 degrees.
+  constexpr Predicate kPredicate = Predicate::COMPARE_DISTANCE;
   int sign = TriageCompareCosDistance(x, y, r.length2());
-  if (sign != 0) return sign;
+  if (sign != 0) return Resolved(kPredicate, Method::TRIAGE, sign);
 
   // Optimization for (x == y) to avoid falling back to exact arithmetic.
-  if (r.length2() == 0 && x == y) return 0;
+  if (r.length2() == 0 && x == y) {
+    return Resolved(kPredicate, Method::TRIAGE, 0);
+  }
 
   // Unlike with CompareDistances(), it's not worth using the sin^2 method
   // when the distance limit is near 180 degrees because the S1ChordAngle
   // representation itself has has a rounding error of up to 2e-8 radians for
   // distances near 180 degrees.
+  Method method = Method::LONG_DOUBLE;
   if (r < k45Degrees) {
+    method = Method::STABLE;
     sign = TriageCompareSin2Distance(x, y, r.length2());
     if (kHasLongDouble && sign == 0) {
+      method = Method::LONG_DOUBLE;
       sign = TriageCompareSin2Distance(ToLD(x), ToLD(y), ToLD(r.length2()));
     }
   } else if (kHasLongDouble) {
     sign = TriageCompareCosDistance(ToLD(x), ToLD(y), ToLD(r.length2()));
   }
-  if (sign != 0) return sign;
-  return ExactCompareDistance(ToExact(x), ToExact(y), r.length2());
+  if (sign != 0) return Resolved(kPredicate, method, sign);
+  return Resolved(kPredicate, Method::EXACT,
+                  ExactCompareDistance(ToExact(x), ToExact(y), r.length2()));
 }
 
 // Helper function that compares the distance XY against the squared chord
@@ -757,17 +1108,21 @@ int CompareEdgeDistance(const S2Point& x, const S2Point& a0, const S2Point& a1,
   // the most common case -- the full test is in ExactCompareEdgeDistance.)
   S2_DCHECK_NE(a0, -a1);
 
+  constexpr Predicate kPredicate = Predicate::COMPARE_EDGE_DISTANCE;
   int sign = TriageCompareEdgeDistance(x, a0, a1, r.length2());
-  if (sign != 0) return sign;
+  if (sign != 0) return Resolved(kPredicate, Method::TRIAGE, sign);
 
   // Optimization for the case where the edge is degenerate.
-  if (a0 == a1) return CompareDistance(x, a0, r);
+  if (a0 == a1) {
+    return Resolved(kPredicate, Method::TRIAGE, CompareDistance(x, a0, r));
+  }
   if (kHasLongDouble) {
     sign = TriageCompareEdgeDistance(ToLD(x), ToLD(a0), ToLD(a1),
                                      ToLD(r.length2()));
-    if (sign != 0) return sign;
+    if (sign != 0) return Resolved(kPredicate, Method::LONG_DOUBLE, sign);
   }
-  return ExactCompareEdgeDistance(x, a0, a1, r);
+  return Resolved(kPredicate, Method::EXACT,
+                  ExactCompareEdgeDistance(x, a0, a1, r));
 }
 
 int CompareEdgePairDistance(const S2Point& a0, const S2Point& a1,
@@ -823,17 +1178,19 @@ int CompareEdgeDirections(const S2Point& a0, const S2Point& a1,
   S2_DCHECK_NE(a0, -a1);
   S2_DCHECK_NE(b0, -b1);
 
+  constexpr Predicate kPredicate = Predicate::COMPARE_EDGE_DIRECTIONS;
   int sign = TriageCompareEdgeDirections(a0, a1, b0, b1);
-  if (sign != 0) return sign;
+  if (sign != 0) return Resolved(kPredicate, Method::TRIAGE, sign);
 
   // Optimization for the case where either edge is degenerate.
-  if (a0 == a1 || b0 == b1) return 0;
+  if (a0 == a1 || b0 == b1) return Resolved(kPredicate, Method::TRIAGE, 0);
   if (kHasLongDouble) {
     sign = TriageCompareEdgeDirections(ToLD(a0), ToLD(a1), ToLD(b0), ToLD(b1));
-    if (sign != 0) return sign;
+    if (sign != 0) return Resolved(kPredicate, Method::LONG_DOUBLE, sign);
   }
-  return ExactCompareEdgeDirections(ToExact(a0), ToExact(a1),
-                                    ToExact(b0), ToExact(b1));
+  return Resolved(kPredicate, Method::EXACT,
+                  ExactCompareEdgeDirections(ToExact(a0), ToExact(a1),
+                                             ToExact(b0), ToExact(b1)));
 }
 
 // If triangle ABC has positive sign, returns its circumcenter.  If ABC has
@@ -890,13 +1247,18 @@ int TriageEdgeCircumcenterSign(const Vector3<T>& x0, const Vector3<T>& x1,
   return (result > result_error) ? 1 : (result < -result_error) ? -1 : 0;
 }
 
-int ExactEdgeCircumcenterSign(const Vector3_xf& x0, const Vector3_xf& x1,
-                              const Vector3_xf& a, const Vector3_xf& b,
-                              const Vector3_xf& c, int abc_sign) {
+// The arithmetic type T is either ExactFloat or ExpansionFloat (see
+// SymbolicallyPerturbedSign).
+template <class T>
+static int ExactEdgeCircumcenterSign(const Vector3<T>& x0, const Vector3<T>& x1,
+                                     const Vector3<T>& a, const Vector3<T>& b,
+                                     const Vector3<T>& c, int abc_sign,
+                                     bool* valid) {
   // Return zero if the edge X is degenerate.  (Also see the comments in
   // SymbolicEdgeCircumcenterSign.)
-  if (ArePointsLinearlyDependent(x0, x1)) {
-    S2_DCHECK_GT(x0.DotProd(x1), 0);  // Antipodal edges not allowed.
+  Vector3<T> nx = x0.CrossProd(x1);
+  if (Sgn(nx[0], valid) == 0 && Sgn(nx[1], valid) == 0 &&
+      Sgn(nx[2], valid) == 0) {
     return 0;
   }
   // The simplest predicate for testing whether the sign is positive is
@@ -946,27 +1308,26 @@ int ExactEdgeCircumcenterSign(const Vector3_xf& x0, const Vector3_xf& x1,
   //     abc2 = |A|^2 dBC^2
   //     bca2 = |B|^2 dCA^2
   //     cab2 = |C|^2 dAB^2
-  Vector3_xf nx = x0.CrossProd(x1);
-  ExactFloat dab = nx.DotProd(a.CrossProd(b));
-  ExactFloat dbc = nx.DotProd(b.CrossProd(c));
-  ExactFloat dca = nx.DotProd(c.CrossProd(a));
-  ExactFloat abc2 = a.Norm2() * (dbc * dbc);
-  ExactFloat bca2 = b.Norm2() * (dca * dca);
-  ExactFloat cab2 = c.Norm2() * (dab * dab);
+  T dab = nx.DotProd(a.CrossProd(b));
+  T dbc = nx.DotProd(b.CrossProd(c));
+  T dca = nx.DotProd(c.CrossProd(a));
+  T abc2 = a.Norm2() * (dbc * dbc);
+  T bca2 = b.Norm2() * (dca * dca);
+  T cab2 = c.Norm2() * (dab * dab);
 
   // If the two sides of (3) have different signs (including the case where
   // one side is zero) then we know the result.  Also, if both sides are zero
   // then we know the result.  The following logic encodes this.
-  int lhs3_sgn = dab.sgn(), rhs3_sgn = -dbc.sgn();
+  int lhs3_sgn = Sgn(dab, valid), rhs3_sgn = -Sgn(dbc, valid);
   int lhs2_sgn = max(-1, min(1, lhs3_sgn - rhs3_sgn));
   if (lhs2_sgn == 0 && lhs3_sgn != 0) {
     // Both sides of (3) have the same non-zero sign, so square both sides.
     // If both sides were negative then invert the result.
-    lhs2_sgn = (cab2 - abc2).sgn() * lhs3_sgn;
+    lhs2_sgn = Sgn(cab2 - abc2, valid) * lhs3_sgn;
   }
   // Now if the two sides of (2) have different signs then we know the result
   // of this entire function.
-  int rhs2_sgn = -dca.sgn();
+  int rhs2_sgn = -Sgn(dca, valid);
   int result = max(-1, min(1, lhs2_sgn - rhs2_sgn));
   if (result == 0 && lhs2_sgn != 0) {
     // Both sides of (2) have the same non-zero sign, so square both sides.
@@ -980,13 +1341,13 @@ int ExactEdgeCircumcenterSign(const Vector3_xf& x0, const Vector3_xf& x1,
     // (4)    2 |A| |C| dAB dBC > |B|^2 dCA^2 - |C|^2 dAB^2 - |A|^2 dBC^2 .
     //
     // Again, if the two sides have different signs then we know the result.
-    int lhs4_sgn = dab.sgn() * dbc.sgn();
-    ExactFloat rhs4 = bca2 - cab2 - abc2;
-    result = max(-1, min(1, lhs4_sgn - rhs4.sgn()));
+    int lhs4_sgn = Sgn(dab, valid) * Sgn(dbc, valid);
+    T rhs4 = bca2 - cab2 - abc2;
+    result = max(-1, min(1, lhs4_sgn - Sgn(rhs4, valid)));
     if (result == 0 && lhs4_sgn != 0) {
       // Both sides of (4) have the same non-zero sign, so square both sides.
       // If both sides were negative then invert the result.
-      result = (4 * abc2 * cab2 - rhs4 * rhs4).sgn() * lhs4_sgn;
+      result = Sgn(4 * abc2 * cab2 - rhs4 * rhs4, valid) * lhs4_sgn;
     }
     // Correct the sign if both sides of (2) were negative.
     result *= lhs2_sgn;
@@ -1001,6 +1362,34 @@ int ExactEdgeCircumcenterSign(const Vector3_xf& x0, const Vector3_xf& x1,
 // dependent).  Clients should never use this method, but it is useful here in
 // order to implement the combined pedestal/axis-aligned perturbation scheme
 // used by some methods (such as EdgeCircumcenterSign).
+int ExactEdgeCircumcenterSign(const Vector3_xf& x0, const Vector3_xf& x1,
+                              const Vector3_xf& a, const Vector3_xf& b,
+                              const Vector3_xf& c, int abc_sign) {
+  S2_DCHECK(!ArePointsAntipodal(x0, x1));  // Antipodal edges not allowed.
+  bool valid = true;
+  return ExactEdgeCircumcenterSign(x0, x1, a, b, c, abc_sign, &valid);
+}
+
+// Returns ExactEdgeCircumcenterSign(x0, x1, a, b, c, abc_sign) evaluated using
+// ExpansionFloat, or sets "valid" to false if some value could not be
+// computed exactly.
+static int ExpansionEdgeCircumcenterSign(const S2Point& x0, const S2Point& x1,
+                                         const S2Point& a, const S2Point& b,
+                                         const S2Point& c, int abc_sign,
+                                         bool* valid) {
+  // The predicate has degree 20, and so the low-order components of its
+  // terms would underflow for points of unit length.  Since the predicate is
+  // positively homogeneous in each argument, we scale all the points by a
+  // power of two (which is exact) to keep every product in range.
+  auto scale = [](const S2Point& p) {
+    constexpr int kExponent = 40;
+    return Vector3_ef(std::ldexp(p[0], kExponent), std::ldexp(p[1], kExponent),
+                      std::ldexp(p[2], kExponent));
+  };
+  return ExactEdgeCircumcenterSign(scale(x0), scale(x1), scale(a), scale(b),
+                                   scale(c), abc_sign, valid);
+}
+
 int UnperturbedSign(const S2Point& a, const S2Point& b, const S2Point& c) {
   int sign = TriageSign(a, b, c, a.CrossProd(b));
   if (sign == 0) sign = ExpensiveSign(a, b, c, false /*perturb*/);
@@ -1086,25 +1475,34 @@ int EdgeCircumcenterSign(const S2Point& x0, const S2Point& x1,
   // the most common case -- the full test is in ExactEdgeCircumcenterSign.)
   S2_DCHECK_NE(x0, -x1);
 
+  constexpr Predicate kPredicate = Predicate::EDGE_CIRCUMCENTER_SIGN;
   int abc_sign = Sign(a, b, c);
   int sign = TriageEdgeCircumcenterSign(x0, x1, a, b, c, abc_sign);
-  if (sign != 0) return sign;
+  if (sign != 0) return Resolved(kPredicate, Method::TRIAGE, sign);
 
   // Optimization for the cases that are going to return zero anyway, in order
   // to avoid falling back to exact arithmetic.
-  if (x0 == x1 || a == b || b == c || c == a) return 0;
+  if (x0 == x1 || a == b || b == c || c == a) {
+    return Resolved(kPredicate, Method::TRIAGE, 0);
+  }
   if (kHasLongDouble) {
     sign = TriageEdgeCircumcenterSign(
         ToLD(x0), ToLD(x1), ToLD(a), ToLD(b), ToLD(c), abc_sign);
-    if (sign != 0) return sign;
+    if (sign != 0) return Resolved(kPredicate, Method::LONG_DOUBLE, sign);
   }
-  sign = ExactEdgeCircumcenterSign(
-      ToExact(x0), ToExact(x1), ToExact(a), ToExact(b), ToExact(c), abc_sign);
-  if (sign != 0) return sign;
+  bool valid = true;
+  sign = ExpansionEdgeCircumcenterSign(x0, x1, a, b, c, abc_sign, &valid);
+  if (!valid) {
+    sign = ExactEdgeCircumcenterSign(
+        ToExact(x0), ToExact(x1), ToExact(a), ToExact(b), ToExact(c),
+        abc_sign);
+  }
+  if (sign != 0) return Resolved(kPredicate, Method::EXACT, sign);
 
   // Unlike the other methods, SymbolicEdgeCircumcenterSign does not depend
   // on the sign of triangle ABC.
-  return SymbolicEdgeCircumcenterSign(x0, x1, a, b, c);
+  return Resolved(kPredicate, Method::SYMBOLIC,
+                  SymbolicEdgeCircumcenterSign(x0, x1, a, b, c));
 }
 
 template <class T>
@@ -1442,19 +1840,27 @@ Excluded GetVoronoiSiteExclusion(const S2Point& a, const S2Point& b,
   // ensure that either A or B is considered closer (in a consistent way).
   // This also ensures that the choice of A or B does not depend on the
   // direction of X.
+  constexpr Predicate kPredicate = Predicate::VORONOI_SITE_EXCLUSION;
   if (s2pred::CompareDistances(x1, a, b) < 0) {
-    return Excluded::SECOND;  // Site A is closer to every point on X.
+    // Site A is closer to every point on X.
+    return Resolved(kPredicate, Method::TRIAGE, Excluded::SECOND);
   }
 
   Excluded result = TriageVoronoiSiteExclusion(a, b, x0, x1, r.length2());
-  if (result != Excluded::UNCERTAIN) return result;
+  if (result != Excluded::UNCERTAIN) {
+    return Resolved(kPredicate, Method::TRIAGE, result);
+  }
   if (kHasLongDouble) {
     result = TriageVoronoiSiteExclusion(ToLD(a), ToLD(b), ToLD(x0), ToLD(x1),
                                         ToLD(r.length2()));
-    if (result != Excluded::UNCERTAIN) return result;
+    if (result != Excluded::UNCERTAIN) {
+      return Resolved(kPredicate, Method::LONG_DOUBLE, result);
+    }
   }
-  return ExactVoronoiSiteExclusion(ToExact(a), ToExact(b), ToExact(x0),
-                                   ToExact(x1), r.length2());
+  return Resolved(kPredicate, Method::EXACT,
+                  ExactVoronoiSiteExclusion(ToExact(a), ToExact(b),
+                                            ToExact(x0), ToExact(x1),
+                                            r.length2()));
 }
 
 std::ostream& operator<<(std::ostream& os, Excluded excluded) {
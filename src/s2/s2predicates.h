@@ -52,6 +52,7 @@
 #include <ostream>
 
 #include "absl/flags/flag.h"
+#include "absl/types/span.h"
 #include "s2/_fp_contract_off.h"
 #include "s2/s1chord_angle.h"
 #include "s2/s2debug.h"
@@ -83,6 +84,16 @@ namespace s2pred {
 // involving antipodal points.
 int Sign(const S2Point& a, const S2Point& b, const S2Point& c);
 
+// Sets signs[i] = Sign(a[i], b[i], c[i]) for all i.  This is faster than
+// calling Sign() in a loop when many triangles need to be tested, because
+// the approximate determinants are computed by a simple loop that the
+// compiler can vectorize, and only the uncertain cases are then resolved
+// using ExpensiveSign().
+//
+// REQUIRES: a.size() == b.size() == c.size() == signs.size()
+void Sign(absl::Span<const S2Point> a, absl::Span<const S2Point> b,
+          absl::Span<const S2Point> c, absl::Span<int> signs);
+
 // Given 4 points on the unit sphere, return true if the edges OA, OB, and
 // OC are encountered in that order while sweeping CCW around the point O.
 // You can think of this as testing whether A <= B <= C with respect to the
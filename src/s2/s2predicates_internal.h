@@ -24,7 +24,9 @@
 #include <limits>
 
 #include "absl/base/casts.h"
+#include "s2/base/integral_types.h"
 #include "s2/s1chord_angle.h"
+#include "s2/s2predicate_stats.h"
 #include "s2/s2predicates.h"
 #include "s2/util/math/exactfloat/exactfloat.h"
 #include "s2/util/math/vector.h"
@@ -56,8 +58,86 @@ constexpr bool kHasLongDouble = (LD_ERR < DBL_ERR);
 // this symbol without first checking whether it already exists.
 constexpr double kSqrt3 = 1.7320508075688772935274463415058;
 
+// Records that "count" calls to the given predicate were resolved using the
+// given method (see s2predicate_stats.h).  This is a no-op unless the library
+// is compiled with S2_PREDICATE_STATS.  (It is defined in the .cc file so
+// that this header does not depend on how the library was compiled.)
+void RecordPredicateStat(PredicateStats::Predicate predicate,
+                         PredicateStats::Method method, int64 count = 1);
+
+// ExpansionFloat represents a number exactly as the sum of a sequence of
+// non-overlapping doubles (see Shewchuk, "Adaptive Precision Floating-Point
+// Arithmetic and Fast Robust Geometric Predicates", 1997).  It supports the
+// same arithmetic operations as ExactFloat that are needed by the exact
+// predicates below, but it never allocates memory and so it is much faster.
+//
+// The number of components is bounded, and products are exact only when
+// they do not underflow or overflow.  If a result cannot be represented
+// exactly then it is marked invalid (and so is any value computed from it).
+// In that case the caller should fall back to using ExactFloat.
+class ExpansionFloat {
+ public:
+  // The maximum number of components in a valid ExpansionFloat.
+  static constexpr int kMaxComponents = 64;
+
+  // Constructs an ExpansionFloat equal to zero.
+  ExpansionFloat() : size_(0), valid_(true) {}
+
+  // Constructs an ExpansionFloat equal to "x".  The result is invalid if "x"
+  // is not finite or its magnitude is too large (greater than 2**995).
+  ExpansionFloat(double x);  // NOLINT(runtime/explicit)
+  ExpansionFloat(int x)      // NOLINT(runtime/explicit)
+      : ExpansionFloat(static_cast<double>(x)) {}
+
+  ExpansionFloat(const ExpansionFloat& x);
+  ExpansionFloat& operator=(const ExpansionFloat& x);
+
+  // Returns true if this value was computed exactly.
+  bool is_valid() const { return valid_; }
+
+  // Returns +1 if this value is positive, -1 if it is negative, and 0 if it
+  // is zero.
+  //
+  // REQUIRES: is_valid()
+  int sgn() const;
+
+  // Returns the number of non-zero components.
+  int num_components() const { return size_; }
+
+  // Returns the nearest double to this value (for testing).
+  double ToDouble() const;
+
+  ExpansionFloat& operator+=(const ExpansionFloat& b) {
+    return *this = *this + b;
+  }
+
+  // Comparison is only supported for valid values.
+  friend bool operator<(const ExpansionFloat& a, const ExpansionFloat& b) {
+    return (a - b).sgn() < 0;
+  }
+
+  friend ExpansionFloat operator-(const ExpansionFloat& a);
+  friend ExpansionFloat operator+(const ExpansionFloat& a,
+                                  const ExpansionFloat& b);
+  friend ExpansionFloat operator-(const ExpansionFloat& a,
+                                  const ExpansionFloat& b);
+  friend ExpansionFloat operator*(const ExpansionFloat& a,
+                                  const ExpansionFloat& b);
+
+ private:
+  static ExpansionFloat Invalid();
+  void Assign(const double* c, int size);
+
+  int size_;
+  bool valid_;
+
+  // The non-zero components in order of increasing magnitude.
+  double c_[kMaxComponents];
+};
+
 using Vector3_ld = Vector3<long double>;
 using Vector3_xf = Vector3<ExactFloat>;
+using Vector3_ef = Vector3<ExpansionFloat>;
 
 inline static Vector3_ld ToLD(const S2Point& x) {
   return Vector3_ld::Cast(x);
@@ -71,6 +151,10 @@ inline static Vector3_xf ToExact(const S2Point& x) {
   return Vector3_xf::Cast(x);
 }
 
+inline static Vector3_ef ToExpansion(const S2Point& x) {
+  return Vector3_ef::Cast(x);
+}
+
 // Efficiently tests whether an ExactFloat vector is (0, 0, 0).
 inline static bool IsZero(const Vector3_xf& a) {
   return a[0].sgn() == 0 && a[1].sgn() == 0 && a[2].sgn() == 0;
@@ -70,6 +70,55 @@ TEST(rounding_epsilon, vs_numeric_limits) {
             rounding_epsilon<double>());
 }
 
+TEST(ExpansionFloat, MatchesExactFloat) {
+  // Evaluate polynomials of the same degree as the exact predicates on
+  // random inputs, and check that the results agree with ExactFloat.
+  auto random_double = []() {
+    return std::ldexp(S2Testing::rnd.RandDouble() - 0.5,
+                      -S2Testing::rnd.Uniform(30));
+  };
+  for (int iter = 0; iter < 1000; ++iter) {
+    double v[6];
+    for (double& x : v) x = random_double();
+    ExpansionFloat e[6];
+    ExactFloat xf[6];
+    for (int i = 0; i < 6; ++i) e[i] = v[i], xf[i] = v[i];
+    ExpansionFloat ef = (e[0] * e[1] - e[2] * e[3]) * (e[4] + e[5]) - e[0];
+    ExactFloat xff = (xf[0] * xf[1] - xf[2] * xf[3]) * (xf[4] + xf[5]) - xf[0];
+    ASSERT_TRUE(ef.is_valid());
+    EXPECT_EQ(xff.sgn(), ef.sgn());
+    EXPECT_DOUBLE_EQ(xff.ToDouble(), ef.ToDouble());
+    // The residual after subtracting the rounded value is also exact.
+    double d = xff.ToDouble();
+    EXPECT_EQ((xff - d).sgn(), (ef - d).sgn());
+
+    // Values that cancel exactly are zero.
+    EXPECT_EQ(0, (ef - ef).sgn());
+    EXPECT_EQ(0, (ef * ef - ef * ef).num_components());
+
+    // High-degree products remain exact.
+    ExpansionFloat ef4 = ef * ef * ef * ef;
+    ExactFloat xff4 = xff * xff * xff * xff;
+    if (ef4.is_valid()) {
+      double d4 = xff4.ToDouble();
+      EXPECT_EQ((xff4 - d4).sgn(), (ef4 - d4).sgn());
+    }
+  }
+}
+
+TEST(ExpansionFloat, InvalidResults) {
+  EXPECT_FALSE(ExpansionFloat(std::numeric_limits<double>::infinity())
+                   .is_valid());
+  EXPECT_FALSE(ExpansionFloat(std::ldexp(1.0, 1000)).is_valid());
+  // Products that might underflow are invalid, and so are values computed
+  // from them.
+  ExpansionFloat tiny(std::ldexp(1.0, -500));
+  EXPECT_FALSE((tiny * tiny).is_valid());
+  EXPECT_FALSE((tiny * tiny + 1).is_valid());
+  EXPECT_TRUE((ExpansionFloat(0) * tiny).is_valid());
+  EXPECT_EQ(0, (ExpansionFloat(0) * tiny).sgn());
+}
+
 TEST(Sign, CollinearPoints) {
   // The following points happen to be *exactly collinear* along a line that it
   // approximate tangent to the surface of the unit sphere.  In fact, C is the
@@ -118,6 +167,28 @@ TEST(Sign, CollinearPoints) {
   EXPECT_EQ(Sign(y1, y2, -y1), -Sign(-y1, y2, y1));
 }
 
+TEST(Sign, BatchMatchesSingleTriangles) {
+  // Include random triangles, degenerate triangles, and nearly collinear
+  // triangles that require ExpensiveSign().
+  vector<S2Point> a, b, c;
+  for (int i = 0; i < 1000; ++i) {
+    S2Point p = S2Testing::RandomPoint(), q = S2Testing::RandomPoint();
+    a.push_back(p);
+    b.push_back(q);
+    switch (i % 4) {
+      case 0: c.push_back(S2Testing::RandomPoint()); break;
+      case 1: c.push_back(i % 8 == 1 ? p : q); break;
+      case 2: c.push_back(S2::Interpolate(p, q, 0.5)); break;
+      case 3: c.push_back(-p); break;
+    }
+  }
+  vector<int> signs(a.size());
+  Sign(a, b, c, absl::MakeSpan(signs));
+  for (int i = 0; i < a.size(); ++i) {
+    EXPECT_EQ(Sign(a[i], b[i], c[i]), signs[i]) << i;
+  }
+}
+
 TEST(Sign, StableSignUnderflow) {
   // Verify that StableSign returns zero (indicating that the result is
   // uncertain) when its error calculation underflows.
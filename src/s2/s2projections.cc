@@ -19,6 +19,7 @@
 
 #include <cmath>
 
+#include "s2/base/logging.h"
 #include "s2/s2latlng.h"
 
 using std::fabs;
@@ -45,6 +46,24 @@ R2Point Projection::Interpolate(double f,
   return (1 - f) * a + f * b;
 }
 
+void Projection::Project(absl::Span<const S2Point> input,
+                         absl::Span<R2Point> output) const {
+  S2_DCHECK_EQ(input.size(), output.size());
+  for (int i = 0; i < input.size(); ++i) output[i] = Project(input[i]);
+}
+
+void Projection::Unproject(absl::Span<const R2Point> input,
+                           absl::Span<S2Point> output) const {
+  S2_DCHECK_EQ(input.size(), output.size());
+  for (int i = 0; i < input.size(); ++i) output[i] = Unproject(input[i]);
+}
+
+void Projection::FromLatLng(absl::Span<const S2LatLng> input,
+                            absl::Span<R2Point> output) const {
+  S2_DCHECK_EQ(input.size(), output.size());
+  for (int i = 0; i < input.size(); ++i) output[i] = FromLatLng(input[i]);
+}
+
 PlateCarreeProjection::PlateCarreeProjection(double x_scale)
     : x_wrap_(2 * x_scale),
       to_radians_(M_PI / x_scale),
@@ -73,6 +92,32 @@ R2Point PlateCarreeProjection::wrap_distance() const {
   return R2Point(x_wrap_, 0);
 }
 
+// The batch methods call the single-point methods of this (final) class
+// directly, which avoids virtual dispatch and allows them to be inlined.
+void PlateCarreeProjection::Project(absl::Span<const S2Point> input,
+                                    absl::Span<R2Point> output) const {
+  S2_DCHECK_EQ(input.size(), output.size());
+  for (int i = 0; i < input.size(); ++i) {
+    output[i] = PlateCarreeProjection::FromLatLng(S2LatLng(input[i]));
+  }
+}
+
+void PlateCarreeProjection::Unproject(absl::Span<const R2Point> input,
+                                      absl::Span<S2Point> output) const {
+  S2_DCHECK_EQ(input.size(), output.size());
+  for (int i = 0; i < input.size(); ++i) {
+    output[i] = PlateCarreeProjection::ToLatLng(input[i]).ToPoint();
+  }
+}
+
+void PlateCarreeProjection::FromLatLng(absl::Span<const S2LatLng> input,
+                                       absl::Span<R2Point> output) const {
+  S2_DCHECK_EQ(input.size(), output.size());
+  for (int i = 0; i < input.size(); ++i) {
+    output[i] = PlateCarreeProjection::FromLatLng(input[i]);
+  }
+}
+
 MercatorProjection::MercatorProjection(double max_x)
     : x_wrap_(2 * max_x),
       to_radians_(M_PI / max_x),
@@ -107,4 +152,28 @@ R2Point MercatorProjection::wrap_distance() const {
   return R2Point(x_wrap_, 0);
 }
 
+void MercatorProjection::Project(absl::Span<const S2Point> input,
+                                 absl::Span<R2Point> output) const {
+  S2_DCHECK_EQ(input.size(), output.size());
+  for (int i = 0; i < input.size(); ++i) {
+    output[i] = MercatorProjection::FromLatLng(S2LatLng(input[i]));
+  }
+}
+
+void MercatorProjection::Unproject(absl::Span<const R2Point> input,
+                                   absl::Span<S2Point> output) const {
+  S2_DCHECK_EQ(input.size(), output.size());
+  for (int i = 0; i < input.size(); ++i) {
+    output[i] = MercatorProjection::ToLatLng(input[i]).ToPoint();
+  }
+}
+
+void MercatorProjection::FromLatLng(absl::Span<const S2LatLng> input,
+                                    absl::Span<R2Point> output) const {
+  S2_DCHECK_EQ(input.size(), output.size());
+  for (int i = 0; i < input.size(); ++i) {
+    output[i] = MercatorProjection::FromLatLng(input[i]);
+  }
+}
+
 }  // namespace S2
@@ -22,6 +22,7 @@
 #ifndef S2_S2PROJECTIONS_H_
 #define S2_S2PROJECTIONS_H_
 
+#include "absl/types/span.h"
 #include "s2/r2.h"
 #include "s2/s2latlng.h"
 #include "s2/s2point.h"
@@ -52,6 +53,21 @@ class Projection {
   // implementation may be more efficient.
   virtual S2LatLng ToLatLng(const R2Point& p) const = 0;
 
+  // Batch versions of Project(), Unproject(), and FromLatLng() that convert
+  // each element of "input" and store the result in the corresponding element
+  // of "output".  The default implementations simply call the methods above
+  // for each point, but subclasses can override them to avoid making a
+  // virtual call per point (which also allows the compiler to vectorize the
+  // conversion loop).
+  //
+  // REQUIRES: input.size() == output.size()
+  virtual void Project(absl::Span<const S2Point> input,
+                       absl::Span<R2Point> output) const;
+  virtual void Unproject(absl::Span<const R2Point> input,
+                         absl::Span<S2Point> output) const;
+  virtual void FromLatLng(absl::Span<const S2LatLng> input,
+                          absl::Span<R2Point> output) const;
+
   // Returns the point obtained by interpolating the given fraction of the
   // distance along the line from A to B.  Almost all projections should
   // use the default implementation of this method, which simply interpolates
@@ -114,6 +130,12 @@ class PlateCarreeProjection final : public Projection {
   S2Point Unproject(const R2Point& p) const override;
   R2Point FromLatLng(const S2LatLng& ll) const override;
   S2LatLng ToLatLng(const R2Point& p) const override;
+  void Project(absl::Span<const S2Point> input,
+               absl::Span<R2Point> output) const override;
+  void Unproject(absl::Span<const R2Point> input,
+                 absl::Span<S2Point> output) const override;
+  void FromLatLng(absl::Span<const S2LatLng> input,
+                  absl::Span<R2Point> output) const override;
   R2Point wrap_distance() const override;
 
  private:
@@ -147,6 +169,12 @@ class MercatorProjection final : public Projection {
   S2Point Unproject(const R2Point& p) const override;
   R2Point FromLatLng(const S2LatLng& ll) const override;
   S2LatLng ToLatLng(const R2Point& p) const override;
+  void Project(absl::Span<const S2Point> input,
+               absl::Span<R2Point> output) const override;
+  void Unproject(absl::Span<const R2Point> input,
+                 absl::Span<S2Point> output) const override;
+  void FromLatLng(absl::Span<const S2LatLng> input,
+                  absl::Span<R2Point> output) const override;
   R2Point wrap_distance() const override;
 
  private:
@@ -18,6 +18,7 @@
 #include "s2/s2projections.h"
 
 #include <limits>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include "s2/s2latlng.h"
@@ -76,4 +77,35 @@ TEST(MercatorProjection, ProjectUnproject) {
                        S2LatLng::FromRadians(1, 0).ToPoint());
 }
 
+void TestBatchMethods(const Projection& projection) {
+  // The batch methods should yield exactly the same results as the
+  // single-point methods.
+  S2Testing::rnd.Reset(1);
+  std::vector<S2Point> points;
+  std::vector<S2LatLng> latlngs;
+  for (int i = 0; i < 100; ++i) {
+    points.push_back(S2Testing::RandomPoint());
+    latlngs.push_back(S2LatLng(points.back()));
+  }
+  std::vector<R2Point> projected(points.size());
+  projection.Project(points, absl::MakeSpan(projected));
+  std::vector<R2Point> from_latlngs(latlngs.size());
+  projection.FromLatLng(latlngs, absl::MakeSpan(from_latlngs));
+  std::vector<S2Point> unprojected(projected.size());
+  projection.Unproject(projected, absl::MakeSpan(unprojected));
+  for (int i = 0; i < points.size(); ++i) {
+    EXPECT_EQ(projection.Project(points[i]), projected[i]);
+    EXPECT_EQ(projection.FromLatLng(latlngs[i]), from_latlngs[i]);
+    EXPECT_EQ(projection.Unproject(projected[i]), unprojected[i]);
+  }
+}
+
+TEST(PlateCarreeProjection, BatchMethods) {
+  TestBatchMethods(PlateCarreeProjection(180));
+}
+
+TEST(MercatorProjection, BatchMethods) {
+  TestBatchMethods(MercatorProjection(180));
+}
+
 }  //  namespace S2
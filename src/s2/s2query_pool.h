@@ -0,0 +1,220 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2QUERY_POOL_H_
+#define S2_S2QUERY_POOL_H_
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "s2/base/integral_types.h"
+#include "s2/base/logging.h"
+
+// S2QueryPool is a thread-safe pool of query objects (such as
+// S2ClosestEdgeQuery, S2ClosestPointQuery, S2ClosestCellQuery, or
+// S2ContainsPointQuery) that all refer to the same index.  Query objects are
+// not thread-safe, and they are relatively expensive to construct since they
+// allocate priority queues, index coverings, and iterators.  A pool lets each
+// thread borrow an initialized query object for as long as it needs one, and
+// then reuse it for a later request rather than constructing a new one.
+// Example usage:
+//
+//   // Shared by all threads, e.g. a member of an RPC service.
+//   S2QueryPool<S2ClosestEdgeQuery> pool(&index, options);
+//   ...
+//   // In each request handler:
+//   auto query = pool.Borrow();
+//   S2ClosestEdgeQuery::PointTarget target(point);
+//   S1ChordAngle distance = query->GetDistance(&target);
+//
+// Borrow() returns a Handle that gives exclusive access to the query object
+// and returns it to the pool when the handle is destroyed.  The pool never
+// destroys query objects that are in use, and it holds at most as many
+// objects as were ever borrowed at the same time.
+//
+// The index must not be modified while any query objects are in use.  If the
+// index is modified, call Clear() afterwards so that new query objects are
+// constructed by later calls to Borrow().
+//
+// Note that a client that changes the state of a borrowed query object (e.g.
+// using S2ClosestEdgeQuery::mutable_options()) must restore that state before
+// returning it, since the object will be lent to other clients later.
+//
+// This class is thread-safe.  The internal lock is held only while handles
+// are borrowed and returned, and query objects are constructed without
+// holding the lock.
+template <class Query>
+class S2QueryPool {
+ public:
+  // Creates a pool whose query objects are constructed as "Query(args...)",
+  // e.g. S2QueryPool<S2ClosestEdgeQuery>(&index, options).  The arguments are
+  // copied, so objects that they point to (such as the index) must outlive
+  // the pool.
+  template <class... Args>
+  explicit S2QueryPool(const Args&... args)
+      : factory_([args...]() { return absl::make_unique<Query>(args...); }) {}
+
+  // REQUIRES: All handles have been returned to the pool.
+  ~S2QueryPool();
+
+  S2QueryPool(const S2QueryPool&) = delete;
+  S2QueryPool& operator=(const S2QueryPool&) = delete;
+
+  // A movable handle that gives exclusive access to a query object and
+  // returns it to the pool when the handle is destroyed.
+  class Handle {
+   public:
+    // Constructs an empty handle.
+    Handle() = default;
+    ~Handle() { Release(); }
+
+    Handle(Handle&& other) = default;
+    Handle& operator=(Handle&& other);
+
+    Query& operator*() const { return *query_; }
+    Query* operator->() const { return query_.get(); }
+    Query* get() const { return query_.get(); }
+
+    // Returns the query object to the pool early.  Afterwards the handle is
+    // empty.
+    void Release();
+
+   private:
+    friend class S2QueryPool;
+    Handle(S2QueryPool* pool, std::unique_ptr<Query> query, int64 generation)
+        : pool_(pool), query_(std::move(query)), generation_(generation) {}
+
+    S2QueryPool* pool_ = nullptr;
+    std::unique_ptr<Query> query_;
+    int64 generation_ = 0;  // The value of pool_->generation_ when borrowed.
+  };
+
+  // Returns a handle to an idle query object, constructing a new one if
+  // necessary.
+  Handle Borrow();
+
+  // Destroys all idle query objects.  Objects that are currently borrowed are
+  // destroyed when they are returned rather than being added back to the
+  // pool.  This method should be called after the index is modified.
+  void Clear();
+
+  // Returns the number of idle query objects held by the pool.
+  int num_idle() const;
+
+  // Returns the number of query objects that are currently borrowed.
+  int num_borrowed() const;
+
+ private:
+  void Return(std::unique_ptr<Query> query, int64 generation);
+
+  const std::function<std::unique_ptr<Query>()> factory_;
+
+  mutable absl::Mutex mutex_;
+  std::vector<std::unique_ptr<Query>> idle_ ABSL_GUARDED_BY(mutex_);
+  int num_borrowed_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  // Incremented by Clear().  Query objects borrowed before the most recent
+  // call to Clear() are not added back to the pool.
+  int64 generation_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+template <class Query>
+S2QueryPool<Query>::~S2QueryPool() {
+  S2_DCHECK_EQ(num_borrowed(), 0);
+}
+
+template <class Query>
+typename S2QueryPool<Query>::Handle& S2QueryPool<Query>::Handle::operator=(
+    Handle&& other) {
+  if (this != &other) {
+    Release();
+    pool_ = other.pool_;
+    query_ = std::move(other.query_);
+    generation_ = other.generation_;
+  }
+  return *this;
+}
+
+template <class Query>
+void S2QueryPool<Query>::Handle::Release() {
+  if (query_ != nullptr) pool_->Return(std::move(query_), generation_);
+  query_.reset();
+}
+
+template <class Query>
+typename S2QueryPool<Query>::Handle S2QueryPool<Query>::Borrow() {
+  std::unique_ptr<Query> query;
+  int64 generation;
+  {
+    absl::MutexLock lock(&mutex_);
+    ++num_borrowed_;
+    generation = generation_;
+    if (!idle_.empty()) {
+      query = std::move(idle_.back());
+      idle_.pop_back();
+    }
+  }
+  if (query == nullptr) query = factory_();
+  return Handle(this, std::move(query), generation);
+}
+
+template <class Query>
+void S2QueryPool<Query>::Return(std::unique_ptr<Query> query,
+                                int64 generation) {
+  {
+    absl::MutexLock lock(&mutex_);
+    S2_DCHECK_GT(num_borrowed_, 0);
+    --num_borrowed_;
+    if (generation == generation_) {
+      idle_.push_back(std::move(query));
+      return;
+    }
+  }
+  // The query object is stale and is destroyed without holding the lock.
+}
+
+template <class Query>
+void S2QueryPool<Query>::Clear() {
+  std::vector<std::unique_ptr<Query>> idle;
+  {
+    absl::MutexLock lock(&mutex_);
+    idle.swap(idle_);
+    ++generation_;
+  }
+  // The query objects are destroyed here, without holding the lock.
+}
+
+template <class Query>
+int S2QueryPool<Query>::num_idle() const {
+  absl::MutexLock lock(&mutex_);
+  return idle_.size();
+}
+
+template <class Query>
+int S2QueryPool<Query>::num_borrowed() const {
+  absl::MutexLock lock(&mutex_);
+  return num_borrowed_;
+}
+
+#endif  // S2_S2QUERY_POOL_H_
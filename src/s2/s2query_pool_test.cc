@@ -0,0 +1,128 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2query_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "absl/memory/memory.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s1chord_angle.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2loop.h"
+#include "s2/s2point.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using s2textformat::MakeIndexOrDie;
+using s2textformat::MakePointOrDie;
+using std::vector;
+
+namespace {
+
+TEST(S2QueryPool, ReusesQueryObjects) {
+  auto index = MakeIndexOrDie("# 0:0, 0:2 # 1:1, 1:3, 3:3, 3:1");
+  S2ClosestEdgeQuery::Options options;
+  options.set_max_results(1);
+  S2QueryPool<S2ClosestEdgeQuery> pool(index.get(), options);
+  EXPECT_EQ(0, pool.num_idle());
+  const S2ClosestEdgeQuery* first;
+  {
+    auto query = pool.Borrow();
+    first = query.get();
+    EXPECT_EQ(1, query->options().max_results());
+    EXPECT_EQ(1, pool.num_borrowed());
+    auto query2 = pool.Borrow();
+    EXPECT_NE(first, query2.get());
+    EXPECT_EQ(2, pool.num_borrowed());
+  }
+  EXPECT_EQ(0, pool.num_borrowed());
+  EXPECT_EQ(2, pool.num_idle());
+
+  // Handles can be moved and released early.
+  S2QueryPool<S2ClosestEdgeQuery>::Handle handle = pool.Borrow();
+  S2QueryPool<S2ClosestEdgeQuery>::Handle other = std::move(handle);
+  EXPECT_EQ(nullptr, handle.get());
+  EXPECT_EQ(1, pool.num_idle());
+  S2ClosestEdgeQuery::PointTarget target(MakePointOrDie("0:1"));
+  EXPECT_EQ(S1ChordAngle::Zero(), other->GetDistance(&target));
+  other.Release();
+  EXPECT_EQ(nullptr, other.get());
+  EXPECT_EQ(2, pool.num_idle());
+  EXPECT_EQ(0, pool.num_borrowed());
+}
+
+TEST(S2QueryPool, ClearDiscardsBorrowedObjects) {
+  auto index = MakeIndexOrDie("# # 0:0, 0:1, 1:0");
+  S2QueryPool<S2ContainsPointQuery<MutableS2ShapeIndex>> pool(
+      index.get(), S2ContainsPointQueryOptions(S2VertexModel::CLOSED));
+  auto query = pool.Borrow();
+  EXPECT_TRUE(query->Contains(MakePointOrDie("0:0")));
+  pool.Borrow();  // Returned immediately.
+  EXPECT_EQ(1, pool.num_idle());
+  pool.Clear();
+  EXPECT_EQ(0, pool.num_idle());
+  query.Release();
+  EXPECT_EQ(0, pool.num_idle());
+  EXPECT_EQ(0, pool.num_borrowed());
+  EXPECT_TRUE(pool.Borrow()->Contains(MakePointOrDie("0:0")));
+  EXPECT_EQ(1, pool.num_idle());
+}
+
+TEST(S2QueryPool, MultipleThreads) {
+  S2Testing::rnd.Reset(1);
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 20; ++i) {
+    index.Add(absl::make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+        S2Testing::RandomPoint(), S1Angle::Degrees(1), 100)));
+  }
+  vector<S2Point> points;
+  for (int i = 0; i < 400; ++i) points.push_back(S2Testing::RandomPoint());
+  vector<S1ChordAngle> expected;
+  S2ClosestEdgeQuery expected_query(&index);
+  for (const S2Point& point : points) {
+    S2ClosestEdgeQuery::PointTarget target(point);
+    expected.push_back(expected_query.GetDistance(&target));
+  }
+
+  S2QueryPool<S2ClosestEdgeQuery> pool(&index);
+  const int kNumThreads = 4;
+  vector<S1ChordAngle> actual(points.size());
+  std::atomic<int> next(0);
+  vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.push_back(std::thread([&]() {
+      for (int i; (i = next++) < points.size();) {
+        auto query = pool.Borrow();
+        S2ClosestEdgeQuery::PointTarget target(points[i]);
+        actual[i] = query->GetDistance(&target);
+      }
+    }));
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(expected, actual);
+  EXPECT_EQ(0, pool.num_borrowed());
+  EXPECT_GE(pool.num_idle(), 1);
+  EXPECT_LE(pool.num_idle(), kNumThreads);
+}
+
+}  // namespace
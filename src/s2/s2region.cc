@@ -19,8 +19,26 @@
 
 #include <vector>
 
+#include "s2/base/logging.h"
 #include "s2/s2cap.h"
+#include "s2/s2cell.h"
 
 void S2Region::GetCellUnionBound(std::vector<S2CellId> *cell_ids) const {
   return GetCapBound().GetCellUnionBound(cell_ids);
 }
+
+void S2Region::ContainsBatch(absl::Span<const S2Cell> cells,
+                             absl::Span<bool> result) const {
+  S2_DCHECK_EQ(cells.size(), result.size());
+  for (size_t k = 0; k < cells.size(); ++k) {
+    result[k] = Contains(cells[k]);
+  }
+}
+
+void S2Region::MayIntersectBatch(absl::Span<const S2Cell> cells,
+                                 absl::Span<bool> result) const {
+  S2_DCHECK_EQ(cells.size(), result.size());
+  for (size_t k = 0; k < cells.size(); ++k) {
+    result[k] = MayIntersect(cells[k]);
+  }
+}
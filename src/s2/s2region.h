@@ -20,6 +20,8 @@
 
 #include <vector>
 
+#include "absl/types/span.h"
+
 #include "s2/_fp_contract_off.h"
 #include "s2/s1angle.h"
 
@@ -83,6 +85,22 @@ class S2Region {
   // could not be determined.
   virtual bool Contains(const S2Cell& cell) const = 0;
 
+  // Sets result[k] = Contains(cells[k]) for every cell.  Like
+  // MayIntersectBatch() below, subtypes may override this method to test
+  // many cells at once more efficiently.  The default implementation simply
+  // calls Contains() for each cell.
+  //
+  // REQUIRES: result.size() == cells.size()
+  virtual void ContainsBatch(absl::Span<const S2Cell> cells,
+                             absl::Span<bool> result) const;
+
+  // Returns true if Contains(const S2Cell&) takes constant time.  In that
+  // case S2RegionCoverer::GetCovering() computes fixed-level coverings by
+  // subdividing only the cells that straddle the region boundary, and emits
+  // all the cells below a contained cell without testing them.  The default
+  // implementation returns false.
+  virtual bool HasFastCellContains() const { return false; }
+
   // If this method returns false, the region does not intersect the given
   // cell.  Otherwise, either the region intersects the cell, or the
   // intersection relationship could not be determined.
@@ -93,6 +111,15 @@ class S2Region {
   // returns true if the region intersect the cell and false otherwise.
   virtual bool MayIntersect(const S2Cell& cell) const = 0;
 
+  // Sets result[k] = MayIntersect(cells[k]) for every cell.  Subtypes may
+  // override this method to test many cells at once (e.g., the children of
+  // a cell being subdivided by S2RegionCoverer) more efficiently.  The
+  // default implementation simply calls MayIntersect() for each cell.
+  //
+  // REQUIRES: result.size() == cells.size()
+  virtual void MayIntersectBatch(absl::Span<const S2Cell> cells,
+                                 absl::Span<bool> result) const;
+
   // Returns true if and only if the given point is contained by the region.
   // The point 'p' is generally required to be unit length, although some
   // subtypes may relax this restriction.
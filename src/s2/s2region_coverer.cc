@@ -18,6 +18,7 @@
 #include "s2/s2region_coverer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
@@ -33,6 +34,7 @@
 #include "s2/s1angle.h"
 #include "s2/s2cap.h"
 #include "s2/s2cell_union.h"
+#include "s2/s2executor.h"
 #include "s2/s2metrics.h"
 #include "s2/s2region.h"
 
@@ -43,6 +45,7 @@ using std::vector;
 
 // Define storage for header file constants (the values are not needed here).
 constexpr int S2RegionCoverer::Options::kDefaultMaxCells;
+constexpr std::size_t S2RegionCoverer::kCandidateBlockSize;
 
 S2RegionCoverer::S2RegionCoverer(const S2RegionCoverer::Options& options) :
   options_(options) {
@@ -91,25 +94,38 @@ int S2RegionCoverer::Options::true_max_level() const {
 
 S2RegionCoverer::Candidate* S2RegionCoverer::NewCandidate(const S2Cell& cell) {
   if (!region_->MayIntersect(cell)) return nullptr;
+  return NewIntersectingCandidate(
+      cell, NeedsContains(cell.level()) && region_->Contains(cell));
+}
+
+inline bool S2RegionCoverer::NeedsContains(int level) const {
+  // For regular coverings, cells that can't be subdivided further are
+  // terminal whether or not they are contained.
+  return level >= options_.min_level() &&
+         (interior_covering_ ||
+          level + options_.level_mod() <= options_.max_level());
+}
 
+S2RegionCoverer::Candidate* S2RegionCoverer::NewIntersectingCandidate(
+    const S2Cell& cell, bool contains) {
   bool is_terminal = false;
   if (cell.level() >= options_.min_level()) {
     if (interior_covering_) {
-      if (region_->Contains(cell)) {
+      if (contains) {
         is_terminal = true;
       } else if (cell.level() + options_.level_mod() > options_.max_level()) {
         return nullptr;
       }
     } else {
       if (cell.level() + options_.level_mod() > options_.max_level() ||
-          region_->Contains(cell)) {
+          contains) {
         is_terminal = true;
       }
     }
   }
   ++candidates_created_counter_;
   const std::size_t max_children = is_terminal ? 0 : 1 << max_children_shift();
-  return new (max_children) Candidate(cell, max_children);
+  return new (AllocateCandidate(max_children)) Candidate(cell, max_children);
 }
 
 void S2RegionCoverer::DeleteCandidate(Candidate* candidate,
@@ -118,7 +134,50 @@ void S2RegionCoverer::DeleteCandidate(Candidate* candidate,
     for (int i = 0; i < candidate->num_children; ++i)
       DeleteCandidate(candidate->children[i], true);
   }
-  delete candidate;
+  FreeCandidate(candidate);
+}
+
+void* S2RegionCoverer::AllocateCandidate(std::size_t max_children) {
+  // The first word of each free candidate points to the next one.
+  Candidate*& free_list = free_candidates_[max_children > 0];
+  if (free_list != nullptr) {
+    Candidate* candidate = free_list;
+    free_list = *reinterpret_cast<Candidate**>(candidate);
+    return candidate;
+  }
+  constexpr std::size_t kAlign = alignof(Candidate);
+  std::size_t size = sizeof(Candidate) + max_children * sizeof(Candidate*);
+  size = (size + kAlign - 1) & ~(kAlign - 1);
+  S2_DCHECK_LE(size, kCandidateBlockSize);
+  if (candidate_block_offset_ + size > kCandidateBlockSize) {
+    if (num_candidate_blocks_used_ == candidate_blocks_.size()) {
+      candidate_blocks_.emplace_back(new char[kCandidateBlockSize]);
+    }
+    // Errors are detected by GetCoveringInternal(), since the memory must be
+    // returned regardless.
+    mem_tracker_->Tally(kCandidateBlockSize);
+    ++num_candidate_blocks_used_;
+    candidate_block_offset_ = 0;
+  }
+  char* block = candidate_blocks_[num_candidate_blocks_used_ - 1].get();
+  void* result = block + candidate_block_offset_;
+  candidate_block_offset_ += size;
+  return result;
+}
+
+void S2RegionCoverer::FreeCandidate(Candidate* candidate) {
+  Candidate*& free_list = free_candidates_[candidate->has_children_array];
+  candidate->~Candidate();
+  *reinterpret_cast<Candidate**>(candidate) = free_list;
+  free_list = candidate;
+}
+
+void S2RegionCoverer::ResetCandidates() {
+  // The size of non-terminal candidates depends on level_mod(), which may
+  // have changed since the previous call, so the free lists are discarded.
+  num_candidate_blocks_used_ = 0;
+  candidate_block_offset_ = kCandidateBlockSize;
+  free_candidates_[0] = free_candidates_[1] = nullptr;
 }
 
 int S2RegionCoverer::ExpandChildren(Candidate* candidate,
@@ -126,15 +185,32 @@ int S2RegionCoverer::ExpandChildren(Candidate* candidate,
   num_levels--;
   S2Cell child_cells[4];
   cell.Subdivide(child_cells);
+  // Test all the children at once, since some regions can do this more
+  // efficiently than testing them one at a time.
+  bool may_intersect[4];
+  region_->MayIntersectBatch(child_cells, may_intersect);
   int num_terminals = 0;
-  for (int i = 0; i < 4; ++i) {
-    if (num_levels > 0) {
-      if (region_->MayIntersect(child_cells[i])) {
+  if (num_levels > 0) {
+    for (int i = 0; i < 4; ++i) {
+      if (may_intersect[i]) {
         num_terminals += ExpandChildren(candidate, child_cells[i], num_levels);
       }
-      continue;
     }
-    Candidate* child = NewCandidate(child_cells[i]);
+    return num_terminals;
+  }
+  // Similarly, test all the intersecting children for containment at once.
+  S2Cell cells[4];
+  int num_cells = 0;
+  for (int i = 0; i < 4; ++i) {
+    if (may_intersect[i]) cells[num_cells++] = child_cells[i];
+  }
+  bool contains[4] = {false, false, false, false};
+  if (num_cells > 0 && NeedsContains(cells[0].level())) {
+    region_->ContainsBatch(absl::MakeConstSpan(cells, num_cells),
+                           absl::MakeSpan(contains, num_cells));
+  }
+  for (int i = 0; i < num_cells; ++i) {
+    Candidate* child = NewIntersectingCandidate(cells[i], contains[i]);
     if (child) {
       candidate->children[candidate->num_children++] = child;
       if (child->is_terminal) ++num_terminals;
@@ -147,6 +223,7 @@ void S2RegionCoverer::AddCandidate(Candidate* candidate) {
   if (candidate == nullptr) return;
 
   if (candidate->is_terminal) {
+    mem_tracker_->AddSpace(&result_, 1);
     result_.push_back(candidate->cell.id());
     DeleteCandidate(candidate, true);
     return;
@@ -210,7 +287,7 @@ void S2RegionCoverer::AdjustCellLevels(vector<S2CellId>* cells) const {
   cells->resize(out);
 }
 
-void S2RegionCoverer::GetInitialCandidates() {
+vector<S2CellId> S2RegionCoverer::GetInitialCells() const {
   // Optimization: start with a small (usually 4 cell) covering of the
   // region's bounding cap.
   S2RegionCoverer tmp_coverer;
@@ -219,11 +296,191 @@ void S2RegionCoverer::GetInitialCandidates() {
   vector<S2CellId> cells;
   tmp_coverer.GetFastCovering(*region_, &cells);
   AdjustCellLevels(&cells);
-  for (S2CellId cell_id : cells) {
+  return cells;
+}
+
+void S2RegionCoverer::GetInitialCandidates() {
+  for (S2CellId cell_id : GetInitialCells()) {
     AddCandidate(NewCandidate(S2Cell(cell_id)));
   }
 }
 
+void S2RegionCoverer::AddInteriorCell(const S2Cell& cell, bool contains,
+                                      vector<S2Cell>* contained,
+                                      vector<S2Cell>* partial) const {
+  // This follows the logic of NewIntersectingCandidate().
+  if (cell.level() >= options_.min_level()) {
+    if (contains) {
+      contained->push_back(cell);
+      return;
+    }
+    if (cell.level() + options_.level_mod() > options_.max_level()) return;
+  }
+  partial->push_back(cell);
+}
+
+void S2RegionCoverer::ExpandInteriorCell(const S2Cell& cell, int num_levels,
+                                         vector<S2Cell>* contained,
+                                         vector<S2Cell>* partial) const {
+  // This follows the logic of ExpandChildren().
+  num_levels--;
+  S2Cell child_cells[4];
+  cell.Subdivide(child_cells);
+  bool may_intersect[4];
+  region_->MayIntersectBatch(child_cells, may_intersect);
+  if (num_levels > 0) {
+    for (int i = 0; i < 4; ++i) {
+      if (may_intersect[i]) {
+        ExpandInteriorCell(child_cells[i], num_levels, contained, partial);
+      }
+    }
+    return;
+  }
+  S2Cell cells[4];
+  int num_cells = 0;
+  for (int i = 0; i < 4; ++i) {
+    if (may_intersect[i]) cells[num_cells++] = child_cells[i];
+  }
+  bool contains[4] = {false, false, false, false};
+  if (num_cells > 0 && NeedsContains(cells[0].level())) {
+    region_->ContainsBatch(absl::MakeConstSpan(cells, num_cells),
+                           absl::MakeSpan(contains, num_cells));
+  }
+  for (int i = 0; i < num_cells; ++i) {
+    AddInteriorCell(cells[i], contains[i], contained, partial);
+  }
+}
+
+void S2RegionCoverer::GetInteriorCells() {
+  // Unlike exterior coverings, interior coverings only output cells that are
+  // contained by the region, and the covering is complete as soon as it has
+  // max_cells() cells.  The priority queue pops the largest cells first,
+  // and among cells of the same size it pops those with the fewest children
+  // and then the fewest contained children.  This is equivalent to (and much
+  // cheaper than) expanding all the partially intersecting cells one level
+  // at a time and then visiting the expanded cells in that order, testing
+  // each cell only when its parent is expanded rather than when its parent
+  // is enqueued.  (The priority queue breaks any remaining ties in an
+  // unspecified order; here they are broken by the order of the cells.)
+  vector<S2Cell> frontier, contained;
+  for (S2CellId id : GetInitialCells()) {
+    S2Cell cell(id);
+    if (!region_->MayIntersect(cell)) continue;
+    AddInteriorCell(
+        cell, NeedsContains(cell.level()) && region_->Contains(cell),
+        &contained, &frontier);
+  }
+  const size_t max_cells = options_.max_cells();
+  for (const S2Cell& cell : contained) {
+    if (result_.size() >= max_cells) break;
+    mem_tracker_->AddSpace(&result_, 1);
+    result_.push_back(cell.id());
+  }
+
+  // The cells are expanded in batches, so that threads can be used when
+  // there are many cells at the same level.  The children of each cell are
+  // kept separately so that the result does not depend on the number of
+  // threads.
+  constexpr int kCellsPerThread = 64;
+  struct Expansion {
+    vector<S2Cell> contained, partial;
+  };
+  vector<Expansion> expansions;
+  vector<int> order;
+  vector<S2Cell> current, next;
+  while (!frontier.empty() && result_.size() < max_cells &&
+         mem_tracker_->ok()) {
+    // Expand the cells at the lowest level present (cells at other levels
+    // can only occur initially or when level_mod() > 1).
+    int level = S2CellId::kMaxLevel;
+    for (const S2Cell& cell : frontier) level = min(level, cell.level());
+    current.clear();
+    next.clear();
+    for (const S2Cell& cell : frontier) {
+      (cell.level() == level ? current : next).push_back(cell);
+    }
+    const int num_levels =
+        (level < options_.min_level()) ? 1 : options_.level_mod();
+    const size_t batch_size =
+        (num_threads_ == 1) ? 1 : num_threads_ * kCellsPerThread;
+    expansions.resize(current.size());
+    for (size_t begin = 0; begin < current.size(); begin += batch_size) {
+      const size_t end = min(current.size(), begin + batch_size);
+      auto expand = [&](size_t i, size_t limit) {
+        for (; i < limit; ++i) {
+          Expansion& expansion = expansions[i];
+          expansion.contained.clear();
+          expansion.partial.clear();
+          ExpandInteriorCell(current[i], num_levels, &expansion.contained,
+                             &expansion.partial);
+        }
+      };
+      const int num_threads =
+          min<size_t>(num_threads_, (end - begin + kCellsPerThread - 1) /
+                                        kCellsPerThread);
+      if (num_threads <= 1) {
+        expand(begin, end);
+      } else {
+        const size_t chunk = (end - begin + num_threads - 1) / num_threads;
+        S2ParallelFor(options_.executor(), num_threads, [&](int t) {
+          expand(min(end, begin + t * chunk),
+                 min(end, begin + (t + 1) * chunk));
+        });
+      }
+    }
+    // Visit the expanded cells in the order that the priority queue would
+    // have popped them (see AddCandidate).
+    order.resize(current.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int i, int j) {
+      const Expansion& a = expansions[i];
+      const Expansion& b = expansions[j];
+      const size_t a_children = a.contained.size() + a.partial.size();
+      const size_t b_children = b.contained.size() + b.partial.size();
+      if (a_children != b_children) return a_children < b_children;
+      return a.contained.size() < b.contained.size();
+    });
+    for (int i : order) {
+      if (result_.size() >= max_cells) break;
+      const Expansion& expansion = expansions[i];
+      for (const S2Cell& cell : expansion.contained) {
+        if (result_.size() >= max_cells) break;
+        mem_tracker_->AddSpace(&result_, 1);
+        result_.push_back(cell.id());
+      }
+      if (!mem_tracker_->AddSpace(&next, expansion.partial.size())) break;
+      next.insert(next.end(), expansion.partial.begin(),
+                  expansion.partial.end());
+    }
+    frontier.swap(next);
+  }
+}
+
+void S2RegionCoverer::GetFixedLevelCells() {
+  for (S2CellId id : GetInitialCells()) {
+    S2Cell cell(id);
+    if (region_->MayIntersect(cell)) AddFixedLevelCells(cell);
+  }
+}
+
+void S2RegionCoverer::AddFixedLevelCells(const S2Cell& cell) {
+  // As in GetCoveringInternal(), the result must still cover the region
+  // when the memory limit is exceeded.
+  if (!mem_tracker_->ok() || cell.level() == options_.max_level() ||
+      region_->Contains(cell)) {
+    mem_tracker_->AddSpace(&result_, 1);
+    result_.push_back(cell.id());
+    return;
+  }
+  S2Cell child_cells[4];
+  cell.Subdivide(child_cells);
+  bool may_intersect[4];
+  region_->MayIntersectBatch(child_cells, may_intersect);
+  for (int i = 0; i < 4; ++i) {
+    if (may_intersect[i]) AddFixedLevelCells(child_cells[i]);
+  }
+}
+
 void S2RegionCoverer::GetCoveringInternal(const S2Region& region) {
   // We check this on each call because of mutable_options().
   S2_DCHECK_LE(options_.min_level(), options_.max_level());
@@ -244,35 +501,37 @@ void S2RegionCoverer::GetCoveringInternal(const S2Region& region) {
 
   S2_DCHECK(pq_.empty());
   S2_DCHECK(result_.empty());
+  S2MemoryTracker::Client mem_tracker(options_.memory_tracker());
+  mem_tracker_ = &mem_tracker;
   region_ = &region;
   candidates_created_counter_ = 0;
+  ResetCandidates();
 
-  GetInitialCandidates();
-  while (!pq_.empty() &&
-         (!interior_covering_ || result_.size() < options_.max_cells())) {
+  if (!interior_covering_ && options_.min_level() == options_.max_level() &&
+      region.HasFastCellContains()) {
+    GetFixedLevelCells();
+  } else if (interior_covering_) {
+    GetInteriorCells();
+  } else {
+    GetInitialCandidates();
+  }
+  while (!pq_.empty() && mem_tracker.ok()) {
     Candidate* candidate = pq_.top().second;
     pq_.pop();
     S2_VLOG(2) << "Pop: " << candidate->cell.id();
-    // For interior coverings we keep subdividing no matter how many children
-    // the candidate has.  If we reach max_cells() before expanding all
-    // children, we will just use some of them.  For exterior coverings we
-    // cannot do this, because the result has to cover the whole region, so
-    // all children have to be used.  The (candidate->num_children == 1) case
+    // The result has to cover the whole region, so all children of a
+    // candidate have to be used.  The (candidate->num_children == 1) case
     // takes care of the situation when we already have more than max_cells()
     // in results (min_level is too high).  Subdividing the candidate with one
-    // child does no harm in this case.
-    if (interior_covering_ ||
-        candidate->cell.level() < options_.min_level() ||
+    // child does no harm in this case.  (Interior coverings do not use the
+    // priority queue; see GetInteriorCells.)
+    if (candidate->cell.level() < options_.min_level() ||
         candidate->num_children == 1 ||
         (result_.size() + pq_.size() + candidate->num_children <=
          options_.max_cells())) {
       // Expand this candidate into its children.
       for (int i = 0; i < candidate->num_children; ++i) {
-        if (interior_covering_ && result_.size() >= options_.max_cells()) {
-          DeleteCandidate(candidate->children[i], true);
-        } else {
-          AddCandidate(candidate->children[i]);
-        }
+        AddCandidate(candidate->children[i]);
       }
       DeleteCandidate(candidate, false);
     } else {
@@ -284,7 +543,13 @@ void S2RegionCoverer::GetCoveringInternal(const S2Region& region) {
       candidates_created_counter_ << " candidates created, " <<
       pq_.size() << " left";
   while (!pq_.empty()) {
-    DeleteCandidate(pq_.top().second, true);
+    // If the memory limit was exceeded, the remaining candidates are added
+    // to exterior coverings so that the result still covers the region.
+    Candidate* candidate = pq_.top().second;
+    if (!interior_covering_ && !mem_tracker.ok()) {
+      result_.push_back(candidate->cell.id());
+    }
+    DeleteCandidate(candidate, true);
     pq_.pop();
   }
   region_ = nullptr;
@@ -296,12 +561,22 @@ void S2RegionCoverer::GetCoveringInternal(const S2Region& region) {
   // reduces the number of cells returned in many cases, and it is cheap
   // compared to computing the covering in the first place.
   S2CellUnion::Normalize(&result_);
-  if (options_.min_level() > 0 || options_.level_mod() > 1) {
-    auto result_copy = result_;
-    S2CellUnion::Denormalize(result_copy, options_.min_level(),
-                             options_.level_mod(), &result_);
+  if (mem_tracker.ok() &&
+      (options_.min_level() > 0 || options_.level_mod() > 1)) {
+    // Denormalizing can multiply the number of cells enormously (e.g. when
+    // min_level() is large), so the output size is checked in advance.
+    uint64 size = S2CellUnion::DenormalizedSize(
+        result_, options_.min_level(), options_.level_mod());
+    // (The size is clamped so that the tally below cannot overflow.)
+    constexpr uint64 kMaxSize = uint64{1} << 59;
+    if (mem_tracker.Tally(min(size, kMaxSize) * sizeof(S2CellId))) {
+      auto result_copy = result_;
+      S2CellUnion::Denormalize(result_copy, options_.min_level(),
+                               options_.level_mod(), &result_);
+    }
   }
-  S2_DCHECK(IsCanonical(result_));
+  mem_tracker_ = nullptr;
+  S2_DCHECK(!mem_tracker.ok() || IsCanonical(result_));
 }
 
 void S2RegionCoverer::GetCovering(const S2Region& region,
@@ -330,6 +605,87 @@ S2CellUnion S2RegionCoverer::GetInteriorCovering(const S2Region& region) {
   return S2CellUnion::FromVerbatim(std::move(result_));
 }
 
+S2CellUnion S2RegionCoverer::GetInteriorCovering(const S2Region& region,
+                                                 int num_threads) {
+  S2_DCHECK_GE(num_threads, 1);
+  interior_covering_ = true;
+  num_threads_ = max(1, S2NumThreads(options_.executor(), num_threads));
+  GetCoveringInternal(region);
+  num_threads_ = 1;
+  return S2CellUnion::FromVerbatim(std::move(result_));
+}
+
+vector<S2CellUnion> S2RegionCoverer::GetCoverings(
+    absl::Span<const S2Region* const> regions, int num_threads) {
+  return GetCoveringsInternal(regions, num_threads, false);
+}
+
+vector<S2CellUnion> S2RegionCoverer::GetInteriorCoverings(
+    absl::Span<const S2Region* const> regions, int num_threads) {
+  return GetCoveringsInternal(regions, num_threads, true);
+}
+
+vector<S2CellUnion> S2RegionCoverer::GetCoveringsInternal(
+    absl::Span<const S2Region* const> regions, int num_threads,
+    bool interior) {
+  S2_DCHECK_GE(num_threads, 1);
+  vector<S2CellUnion> results(regions.size());
+  num_threads = max(1, min<int>(S2NumThreads(options_.executor(), num_threads),
+                                regions.size()));
+
+  // Regions are claimed in small groups to reduce contention on "next".
+  constexpr int kRegionsPerClaim = 8;
+  std::atomic<size_t> next(0);
+  auto cover_regions = [&](S2RegionCoverer* coverer) {
+    vector<S2CellId> cells;
+    for (;;) {
+      size_t begin = next.fetch_add(kRegionsPerClaim);
+      if (begin >= regions.size()) break;
+      size_t end = min(regions.size(), begin + kRegionsPerClaim);
+      for (size_t i = begin; i < end; ++i) {
+        if (interior) {
+          coverer->GetInteriorCovering(*regions[i], &cells);
+        } else {
+          coverer->GetCovering(*regions[i], &cells);
+        }
+        results[i] = S2CellUnion::FromVerbatim(std::move(cells));
+      }
+    }
+  };
+  S2MemoryTracker* tracker = options_.memory_tracker();
+  if (tracker == nullptr || num_threads == 1) {
+    vector<S2RegionCoverer> coverers;
+    coverers.reserve(num_threads - 1);
+    for (int i = 1; i < num_threads; ++i) coverers.emplace_back(options_);
+    S2ParallelFor(options_.executor(), num_threads, [&](int t) {
+      cover_regions(t == 0 ? this : &coverers[t - 1]);
+    });
+    return results;
+  }
+
+  // S2MemoryTracker is not thread-safe, so each thread uses its own tracker
+  // and the trackers share the memory that "tracker" has remaining.
+  S2MemoryBudget budget(
+      max<int64>(0, tracker->limit_bytes() - tracker->usage_bytes()));
+  vector<S2MemoryTracker> trackers(num_threads);
+  vector<S2RegionCoverer> coverers;
+  coverers.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    trackers[i].set_budget(&budget);
+    coverers.emplace_back(options_);
+    coverers.back().mutable_options()->set_memory_tracker(&trackers[i]);
+  }
+  S2ParallelFor(options_.executor(), num_threads,
+                [&](int t) { cover_regions(&coverers[t]); });
+  for (const S2MemoryTracker& thread_tracker : trackers) {
+    if (!thread_tracker.ok()) {
+      tracker->SetError(thread_tracker.error());
+      break;
+    }
+  }
+  return results;
+}
+
 void S2RegionCoverer::GetFastCovering(const S2Region& region,
                                       vector<S2CellId>* covering) {
   region.GetCellUnionBound(covering);
@@ -20,16 +20,20 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <memory>
 #include <new>
 #include <queue>
 #include <utility>
 #include <vector>
 
 #include "absl/base/macros.h"
+#include "absl/types/span.h"
 #include "s2/_fp_contract_off.h"
 #include "s2/s2cell.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2cell_union.h"
+#include "s2/s2executor.h"
+#include "s2/s2memory_tracker.h"
 
 class S2Region;
 
@@ -152,11 +156,56 @@ class S2RegionCoverer {
     // This is the maximum level that will actually be used in coverings.
     int true_max_level() const;
 
+    // Specifies that the memory used while computing coverings should be
+    // tracked and limited using the given S2MemoryTracker.  This includes
+    // the candidate cells and the output cells, including the cells
+    // generated by expanding the covering to satisfy min_level() and
+    // level_mod().  For example:
+    //
+    //   S2MemoryTracker tracker;
+    //   tracker.set_limit_bytes(100 << 20);  // 100 MB
+    //   S2RegionCoverer::Options options;
+    //   options.set_memory_tracker(&tracker);
+    //   S2RegionCoverer coverer(options);
+    //   S2CellUnion covering = coverer.GetCovering(region);
+    //   if (!tracker.ok()) {
+    //     S2_LOG(ERROR) << tracker.error();  // Memory limit exceeded
+    //   }
+    //
+    // If the limit is exceeded then the covering operation stops early.  A
+    // covering (GetCovering) still covers the region, but it may use larger
+    // cells than necessary and it may not satisfy min_level() or
+    // level_mod().  An interior covering (GetInteriorCovering) is still
+    // contained by the region but may be smaller than necessary.
+    //
+    // Memory is only tallied while a covering is being computed; it is
+    // released when the covering is returned.  The tracker may be shared
+    // with other operations in the calling thread (see GetCoverings() for
+    // multi-threaded coverings).
+    //
+    // DEFAULT: nullptr (memory tracking disabled)
+    S2MemoryTracker* memory_tracker() const { return memory_tracker_; }
+    void set_memory_tracker(S2MemoryTracker* tracker) {
+      memory_tracker_ = tracker;
+    }
+
+    // If non-null, the multi-threaded methods (GetCoverings(),
+    // GetInteriorCoverings(), and GetInteriorCovering() with "num_threads")
+    // run on this executor rather than on newly created threads, and their
+    // "num_threads" argument is replaced by executor->num_threads().  The
+    // executor must outlive the S2RegionCoverer.
+    //
+    // DEFAULT: nullptr
+    S2Executor* executor() const { return executor_; }
+    void set_executor(S2Executor* executor) { executor_ = executor; }
+
    protected:
     int max_cells_ = kDefaultMaxCells;
     int min_level_ = 0;
     int max_level_ = S2CellId::kMaxLevel;
     int level_mod_ = 1;
+    S2MemoryTracker* memory_tracker_ = nullptr;
+    S2Executor* executor_ = nullptr;
   };
 
   // Constructs an S2RegionCoverer with the given options.
@@ -193,6 +242,38 @@ class S2RegionCoverer {
   void GetInteriorCovering(const S2Region& region,
                            std::vector<S2CellId>* interior);
 
+  // Like GetInteriorCovering(), but uses up to "num_threads" threads
+  // (including the calling thread) to test the cells at each level of the
+  // covering against the region.  The result is identical to the
+  // single-threaded version.  This is useful for large values of
+  // max_cells(), or for regions whose Contains(S2Cell) method is expensive.
+  // The region must be safe to access from multiple threads concurrently,
+  // which is true of all the standard region types.
+  S2CellUnion GetInteriorCovering(const S2Region& region, int num_threads);
+
+  // Returns the coverings (GetCoverings) or interior coverings
+  // (GetInteriorCoverings) of all the given regions using the current
+  // options, in the same order as "regions".  The result for each region is
+  // identical to calling GetCovering() or GetInteriorCovering() on it.
+  //
+  // Up to "num_threads" threads are used (including the calling thread).
+  // Each thread has its own S2RegionCoverer, so that scratch state is reused
+  // across all the regions processed by that thread; this coverer is used by
+  // one of them.  Regions are handed out to threads dynamically, so
+  // that the work is balanced even when their complexity varies widely.  The
+  // regions must be safe to access from multiple threads concurrently, which
+  // is true of all the standard region types.
+  //
+  // If options().memory_tracker() is set and more than one thread is used,
+  // each thread tallies its memory using its own S2MemoryTracker, and these
+  // trackers share an S2MemoryBudget equal to the remaining memory allowed
+  // by options().memory_tracker().  The first error reported by any thread
+  // is copied to options().memory_tracker().
+  std::vector<S2CellUnion> GetCoverings(
+      absl::Span<const S2Region* const> regions, int num_threads = 1);
+  std::vector<S2CellUnion> GetInteriorCoverings(
+      absl::Span<const S2Region* const> regions, int num_threads = 1);
+
   // Like GetCovering(), except that this method is much faster and the
   // coverings are not as tight.  All of the usual parameters are respected
   // (max_cells, min_level, max_level, and level_mod), except that the
@@ -248,16 +329,9 @@ class S2RegionCoverer {
 
  private:
   struct Candidate {
-    void* operator new(std::size_t size, std::size_t max_children) {
-      return ::operator new (size + max_children * sizeof(Candidate *));
-    }
-
-    void operator delete(void* p) {
-      ::operator delete (p);
-    }
-
     Candidate(const S2Cell& cell, const std::size_t max_children)
-        : cell(cell), is_terminal(max_children == 0) {
+        : cell(cell), is_terminal(max_children == 0),
+          has_children_array(max_children > 0) {
       std::fill_n(&children[0], max_children,
                   absl::implicit_cast<Candidate*>(nullptr));
     }
@@ -268,6 +342,7 @@ class S2RegionCoverer {
 
     S2Cell cell;
     bool is_terminal;        // Cell should not be expanded further.
+    bool has_children_array;  // Space was allocated for "children".
     int num_children = 0;    // Number of children that intersect the region.
     Candidate* children[0];  // Actual size may be 0, 4, 16, or 64 elements.
   };
@@ -277,11 +352,30 @@ class S2RegionCoverer {
   // if it should not be expanded further.
   Candidate* NewCandidate(const S2Cell& cell);
 
+  // Like NewCandidate(), but assumes that the caller has already determined
+  // that the region may intersect the cell.  "contains" specifies whether the
+  // region contains the cell; it is only used if NeedsContains() is true for
+  // the cell's level.
+  Candidate* NewIntersectingCandidate(const S2Cell& cell, bool contains);
+
+  // Returns true if NewCandidate() needs to know whether the region contains
+  // cells at the given level.
+  bool NeedsContains(int level) const;
+
   // Returns the log base 2 of the maximum number of children of a candidate.
   int max_children_shift() const { return 2 * options().level_mod(); }
 
   // Frees the memory associated with a candidate.
-  static void DeleteCandidate(Candidate* candidate, bool delete_children);
+  void DeleteCandidate(Candidate* candidate, bool delete_children);
+
+  // Returns uninitialized memory for a candidate with the given maximum
+  // number of children, and returns such memory to the free list.
+  void* AllocateCandidate(std::size_t max_children);
+  void FreeCandidate(Candidate* candidate);
+
+  // Makes all candidate memory available for reuse.  Called at the start of
+  // each covering operation.
+  void ResetCandidates();
 
   // Processes a candidate by either adding it to the result_ vector or
   // expanding its children and inserting it into the priority queue.
@@ -296,9 +390,53 @@ class S2RegionCoverer {
   // Computes a set of initial candidates that cover the given region.
   void GetInitialCandidates();
 
+  // Returns a small set of cells that cover the given region, adjusted to
+  // satisfy level_mod().
+  std::vector<S2CellId> GetInitialCells() const;
+
+  // Implements GetCoveringInternal() for interior coverings.  Rather than
+  // using the priority queue, all the cells that partially intersect the
+  // region at a given level are expanded before any cells at the next
+  // level, so that the largest contained cells are found first.  The
+  // contained cells at each level are added in the same order as the
+  // priority queue would add them.
+  void GetInteriorCells();
+
+  // Expands "cell" by the given number of levels, appending the children
+  // that are contained by the region to "contained" and the children that
+  // intersect it and may still be subdivided to "partial".
+  void ExpandInteriorCell(const S2Cell& cell, int num_levels,
+                          std::vector<S2Cell>* contained,
+                          std::vector<S2Cell>* partial) const;
+
+  // Appends a cell that intersects the region to "contained" or "partial"
+  // (see ExpandInteriorCell), or discards it if it cannot contribute to an
+  // interior covering.
+  void AddInteriorCell(const S2Cell& cell, bool contains,
+                       std::vector<S2Cell>* contained,
+                       std::vector<S2Cell>* partial) const;
+
+  // Implements GetCoveringInternal() for exterior coverings when
+  // min_level() == max_level() and the region has a constant-time
+  // Contains(S2Cell).  Every cell at that level that intersects the region
+  // is part of the result regardless of max_cells(), so no priority queue is
+  // needed: cells that straddle the region boundary are subdivided, and
+  // cells contained by the region are added to result_ as they are (they
+  // are expanded to the fixed level when the result is denormalized).
+  void GetFixedLevelCells();
+
+  // Adds the cells at level max_level() below "cell" to result_ as
+  // described above.  REQUIRES: the region may intersect "cell".
+  void AddFixedLevelCells(const S2Cell& cell);
+
   // Generates a covering and stores it in result_.
   void GetCoveringInternal(const S2Region& region);
 
+  // Implements GetCoverings() and GetInteriorCoverings().
+  std::vector<S2CellUnion> GetCoveringsInternal(
+      absl::Span<const S2Region* const> regions, int num_threads,
+      bool interior);
+
   // If level > min_level(), then reduces "level" if necessary so that it also
   // satisfies level_mod().  Levels smaller than min_level() are not affected
   // (since cells at these levels are eventually expanded).
@@ -327,6 +465,10 @@ class S2RegionCoverer {
   // only valid) for the duration of a single GetCovering() call.
   const S2Region* region_ = nullptr;
 
+  // Tracks the memory used by the current GetCovering() call.  Like region_,
+  // this points to a local variable and is only valid during the call.
+  S2MemoryTracker::Client* mem_tracker_ = nullptr;
+
   // The set of S2CellIds that have been added to the covering so far.
   std::vector<S2CellId> result_;
 
@@ -350,8 +492,24 @@ class S2RegionCoverer {
   // True if we're computing an interior covering.
   bool interior_covering_;
 
+  // The number of threads used to compute interior coverings.
+  int num_threads_ = 1;
+
   // Counter of number of candidates created, for performance evaluation.
   int candidates_created_counter_;
+
+  // Candidates are allocated from fixed-size blocks owned by the coverer
+  // rather than individually from the heap.  Deleted candidates are kept on
+  // a free list (one for terminal candidates, which have no "children"
+  // array, and one for all others) so that they can be reused during the
+  // same covering operation, and all the blocks are reused by subsequent
+  // operations.  This means that a coverer retains the memory needed by
+  // the largest covering it has computed until it is destroyed.
+  static constexpr std::size_t kCandidateBlockSize = 16384;
+  std::vector<std::unique_ptr<char[]>> candidate_blocks_;
+  std::size_t num_candidate_blocks_used_ = 0;
+  std::size_t candidate_block_offset_ = kCandidateBlockSize;
+  Candidate* free_candidates_[2] = {nullptr, nullptr};
 };
 
 #endif  // S2_S2REGION_COVERER_H_
@@ -21,6 +21,7 @@
 #include <cmath>
 #include <cstdio>
 #include <limits>
+#include <memory>
 #include <queue>
 #include <string>
 #include <vector>
@@ -43,10 +44,16 @@
 #include "s2/s2cell.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2cell_union.h"
+#include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng.h"
+#include "s2/s2latlng_rect.h"
+#include "s2/s2memory_tracker.h"
+#include "s2/s2metrics.h"
 #include "s2/s2point.h"
 #include "s2/s2polyline.h"
 #include "s2/s2region.h"
+#include "s2/s2region_union.h"
 #include "s2/s2testing.h"
 
 using absl::StrCat;
@@ -158,6 +165,151 @@ TEST(S2RegionCoverer, RandomCaps) {
   }
 }
 
+TEST(S2RegionCoverer, ReuseAcrossCalls) {
+  // The coverer reuses its candidate memory between calls, including when
+  // level_mod() (and therefore the candidate size) changes.
+  S2RegionCoverer reused;
+  for (int i = 0; i < 100; ++i) {
+    S2RegionCoverer::Options options;
+    options.set_max_cells(1 + S2Testing::rnd.Uniform(200));
+    options.set_level_mod(1 + S2Testing::rnd.Uniform(3));
+    *reused.mutable_options() = options;
+    S2RegionCoverer fresh(options);
+    S2Cap cap = S2Testing::GetRandomCap(1e-6, 1e-1);
+    EXPECT_EQ(fresh.GetCovering(cap), reused.GetCovering(cap));
+    EXPECT_EQ(fresh.GetInteriorCovering(cap), reused.GetInteriorCovering(cap));
+  }
+}
+
+TEST(S2RegionCoverer, GetCoverings) {
+  S2RegionCoverer::Options options;
+  options.set_max_cells(20);
+  options.set_level_mod(2);
+  vector<S2Cap> caps;
+  for (int i = 0; i < 200; ++i) {
+    caps.push_back(S2Testing::GetRandomCap(1e-8, 1e-1));
+  }
+  vector<const S2Region*> regions;
+  for (const S2Cap& cap : caps) regions.push_back(&cap);
+  S2RegionCoverer coverer(options);
+  for (int num_threads : {1, 4}) {
+    vector<S2CellUnion> coverings = coverer.GetCoverings(regions, num_threads);
+    vector<S2CellUnion> interiors =
+        coverer.GetInteriorCoverings(regions, num_threads);
+    ASSERT_EQ(caps.size(), coverings.size());
+    ASSERT_EQ(caps.size(), interiors.size());
+    for (int i = 0; i < caps.size(); ++i) {
+      EXPECT_EQ(coverer.GetCovering(caps[i]), coverings[i]);
+      EXPECT_EQ(coverer.GetInteriorCovering(caps[i]), interiors[i]);
+    }
+  }
+  EXPECT_TRUE(coverer.GetCoverings({}, 4).empty());
+}
+
+TEST(S2RegionCoverer, GetCoveringsWithExecutor) {
+  S2RegionCoverer::Options options;
+  options.set_max_cells(200);
+  vector<S2Cap> caps;
+  for (int i = 0; i < 50; ++i) {
+    caps.push_back(S2Testing::GetRandomCap(1e-4, 1e-1));
+  }
+  vector<const S2Region*> regions;
+  for (const S2Cap& cap : caps) regions.push_back(&cap);
+  S2RegionCoverer coverer(options);
+  vector<S2CellUnion> expected = coverer.GetCoverings(regions);
+  vector<S2CellUnion> expected_interiors =
+      coverer.GetInteriorCoverings(regions);
+
+  S2ThreadPool pool(4);
+  options.set_executor(&pool);
+  S2RegionCoverer pool_coverer(options);
+  EXPECT_EQ(expected, pool_coverer.GetCoverings(regions));
+  EXPECT_EQ(expected_interiors, pool_coverer.GetInteriorCoverings(regions));
+  for (int i = 0; i < caps.size(); ++i) {
+    EXPECT_EQ(expected_interiors[i],
+              pool_coverer.GetInteriorCovering(caps[i], 1));
+  }
+}
+
+TEST(S2RegionCoverer, MemoryTracker) {
+  S2Cap cap(S2LatLng::FromDegrees(10, 20).ToPoint(), S1Angle::Degrees(1));
+  S2RegionCoverer::Options options;
+  options.set_max_cells(10000);
+  S2RegionCoverer untracked(options);
+  S2CellUnion expected = untracked.GetCovering(cap);
+  S2CellUnion expected_interior = untracked.GetInteriorCovering(cap);
+
+  // Without a limit, tracking does not affect the results and all of the
+  // tracked memory is released afterwards.
+  S2MemoryTracker tracker;
+  options.set_memory_tracker(&tracker);
+  S2RegionCoverer coverer(options);
+  EXPECT_EQ(expected, coverer.GetCovering(cap));
+  EXPECT_EQ(expected_interior, coverer.GetInteriorCovering(cap));
+  EXPECT_TRUE(tracker.ok());
+  EXPECT_EQ(0, tracker.usage_bytes());
+  EXPECT_GT(tracker.max_usage_bytes(), 0);
+
+  // With a small limit the covering is coarser, but it still covers the
+  // region.  Similarly the interior covering is still contained by it.
+  tracker.Reset();
+  tracker.set_limit_bytes(50000);
+  S2CellUnion covering = coverer.GetCovering(cap);
+  EXPECT_EQ(S2Error::RESOURCE_EXHAUSTED, tracker.error().code());
+  EXPECT_LT(covering.size(), expected.size());
+  S2Testing::CheckCovering(cap, covering, false);
+
+  tracker.Reset();
+  S2CellUnion interior = coverer.GetInteriorCovering(cap);
+  EXPECT_EQ(S2Error::RESOURCE_EXHAUSTED, tracker.error().code());
+  EXPECT_LT(interior.size(), expected_interior.size());
+  for (S2CellId id : interior) EXPECT_TRUE(cap.Contains(S2Cell(id)));
+  EXPECT_EQ(0, tracker.usage_bytes());
+}
+
+TEST(S2RegionCoverer, MemoryTrackerLimitsDenormalization) {
+  // A large min_level() can make the covering enormous even though the
+  // covering algorithm itself uses very little memory.
+  S2Cap cap(S2Point(1, 0, 0), S1Angle::Degrees(30));
+  S2MemoryTracker tracker;
+  tracker.set_limit_bytes(1 << 20);
+  S2RegionCoverer::Options options;
+  options.set_min_level(12);
+  options.set_memory_tracker(&tracker);
+  S2RegionCoverer coverer(options);
+  S2CellUnion covering = coverer.GetCovering(cap);
+  EXPECT_EQ(S2Error::RESOURCE_EXHAUSTED, tracker.error().code());
+  S2Testing::CheckCovering(cap, covering, false);
+  EXPECT_LT(covering.size() * sizeof(S2CellId), 1 << 20);
+}
+
+TEST(S2RegionCoverer, MemoryTrackerMultipleThreads) {
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  vector<S2Cap> caps;
+  for (int i = 0; i < 20; ++i) {
+    caps.push_back(S2Cap(S2Testing::RandomPoint(), S1Angle::Degrees(1)));
+  }
+  vector<const S2Region*> regions;
+  for (const S2Cap& cap : caps) regions.push_back(&cap);
+  S2MemoryTracker tracker;
+  S2RegionCoverer::Options options;
+  options.set_max_cells(10000);
+  options.set_memory_tracker(&tracker);
+  S2RegionCoverer coverer(options);
+  vector<S2CellUnion> expected = coverer.GetCoverings(regions, 1);
+  EXPECT_EQ(expected, coverer.GetCoverings(regions, 4));
+  EXPECT_TRUE(tracker.ok());
+  EXPECT_EQ(0, tracker.usage_bytes());
+
+  // The threads share the memory limit of "tracker".
+  tracker.set_limit_bytes(50000);
+  vector<S2CellUnion> coverings = coverer.GetCoverings(regions, 4);
+  EXPECT_EQ(S2Error::RESOURCE_EXHAUSTED, tracker.error().code());
+  for (int i = 0; i < caps.size(); ++i) {
+    S2Testing::CheckCovering(caps[i], coverings[i], false);
+  }
+}
+
 TEST(S2RegionCoverer, SimpleCoverings) {
   static const int kMaxLevel = S2CellId::kMaxLevel;
   S2RegionCoverer::Options options;
@@ -329,6 +481,88 @@ TEST(S2RegionCoverer, InteriorCovering) {
   }
 }
 
+TEST(S2RegionCoverer, InteriorCoveringPriorityOrder) {
+  // These coverings are limited by max_cells() in the middle of a level, so
+  // the cells at the last level depend on the order in which their parents
+  // are expanded.  The expected cells were computed by expanding the cells
+  // with a priority queue, which is how interior coverings used to be
+  // computed.
+  S2Cap cap(S2LatLng::FromDegrees(10, 20).ToPoint(), S1Angle::Degrees(10));
+  struct TestCase {
+    int max_cells, level_mod;
+    vector<string> expected;
+  };
+  vector<TestCase> test_cases = {
+      {8, 1, {"1094", "10b4", "10bc", "10d", "113", "16b4", "16d", "174c"}},
+      {8, 2, {"1091", "1093", "1095", "10d", "113", "116b", "116d", "16d"}},
+  };
+  for (const TestCase& test_case : test_cases) {
+    S2RegionCoverer::Options options;
+    options.set_max_cells(test_case.max_cells);
+    options.set_level_mod(test_case.level_mod);
+    S2RegionCoverer coverer(options);
+    vector<S2CellId> expected;
+    for (const string& token : test_case.expected) {
+      expected.push_back(S2CellId::FromToken(token));
+    }
+    EXPECT_EQ(expected, coverer.GetInteriorCovering(cap).cell_ids());
+    for (int num_threads : {1, 4}) {
+      EXPECT_EQ(expected,
+                coverer.GetInteriorCovering(cap, num_threads).cell_ids());
+    }
+  }
+}
+
+TEST(S2RegionCoverer, InteriorCoveringMultipleThreads) {
+  // The result must not depend on the number of threads, including when the
+  // covering is limited by max_cells() in the middle of a level.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  for (int iter = 0; iter < 5; ++iter) {
+    S2Cap cap(S2Testing::RandomPoint(), S1Angle::Degrees(10));
+    S2RegionCoverer::Options options;
+    options.set_max_cells(200 + 50 * iter);
+    options.set_level_mod(1 + iter % 2);
+    S2RegionCoverer coverer(options);
+    S2CellUnion expected = coverer.GetInteriorCovering(cap);
+    EXPECT_EQ(options.max_cells(), expected.size());
+    EXPECT_TRUE(cap.Contains(S2Cell(expected[0])));
+    for (int num_threads : {1, 2, 4}) {
+      EXPECT_EQ(expected, coverer.GetInteriorCovering(cap, num_threads));
+    }
+  }
+}
+
+TEST(S2RegionCoverer, FixedLevelCapsAndRects) {
+  // Caps and rectangles enumerate fixed-level coverings directly.  Wrapping
+  // them in an S2RegionUnion forces the general algorithm, which must give
+  // the same result.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  for (int iter = 0; iter < 20; ++iter) {
+    int level = S2Testing::rnd.Uniform(12);
+    S2RegionCoverer::Options options;
+    options.set_fixed_level(level);
+    options.set_level_mod(1 + iter % 3);
+    S2RegionCoverer coverer(options);
+    double size = (1 + 10 * S2Testing::rnd.RandDouble()) *
+                  S2::kAvgEdge.GetValue(level);
+    S2LatLng center(S2Testing::RandomPoint());
+    S2LatLng half_size = S2LatLng::FromRadians(size, 2 * size);
+    vector<std::unique_ptr<S2Region>> regions;
+    regions.emplace_back(new S2Cap(center.ToPoint(), S1Angle::Radians(size)));
+    regions.emplace_back(new S2LatLngRect(
+        (center - half_size).Normalized(), (center + half_size).Normalized()));
+    for (const auto& region : regions) {
+      vector<std::unique_ptr<S2Region>> wrapped;
+      wrapped.emplace_back(region->Clone());
+      S2RegionUnion general(std::move(wrapped));
+      EXPECT_FALSE(general.HasFastCellContains());
+      S2CellUnion covering = coverer.GetCovering(*region);
+      EXPECT_EQ(coverer.GetCovering(general), covering);
+      for (S2CellId id : covering) EXPECT_EQ(level, id.level());
+    }
+  }
+}
+
 TEST(GetFastCovering, HugeFixedLevelCovering) {
   // Test a "fast covering" with a huge number of cells due to min_level().
   S2RegionCoverer::Options options;
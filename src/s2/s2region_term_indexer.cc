@@ -75,6 +75,7 @@
 #include "s2/s2region_term_indexer.h"
 
 #include <cctype>
+#include <utility>
 
 #include "absl/strings/str_cat.h"
 
@@ -84,6 +85,8 @@
 #include "s2/s2cap.h"
 #include "s2/s2cell_id.h"
 #include "s2/s2region.h"
+#include "s2/util/bits/bits.h"
+#include "s2/util/endian/endian.h"
 
 using absl::string_view;
 using std::string;
@@ -115,17 +118,116 @@ S2RegionTermIndexer& S2RegionTermIndexer::operator=(S2RegionTermIndexer&&) =
 
 string S2RegionTermIndexer::GetTerm(TermType term_type, const S2CellId id,
                                     string_view prefix) const {
+  if (options_.binary_terms()) {
+    // Omit the trailing zero bytes of the term id.  Note that term ids are
+    // never zero.
+    uint64 term_id = GetTermId(term_type, id);
+    char bytes[sizeof(term_id)];
+    BigEndian::Store64(bytes, term_id);
+    int length = sizeof(term_id) - Bits::FindLSBSetNonZero64(term_id) / 8;
+    return absl::StrCat(prefix, string_view(bytes, length));
+  }
   // There are generally more ancestor terms than covering terms, so we add
   // the extra "marker" character to the covering terms to distinguish them.
+  char token[S2CellId::kMaxTokenLength];
+  string_view token_view(token, id.ToToken(token));
   if (term_type == TermType::ANCESTOR) {
-    return absl::StrCat(prefix, id.ToToken());
+    return absl::StrCat(prefix, token_view);
   } else {
-    return absl::StrCat(prefix, options_.marker(), id.ToToken());
+    return absl::StrCat(prefix, options_.marker(), token_view);
   }
 }
 
-vector<string> S2RegionTermIndexer::GetIndexTerms(const S2Point& point,
-                                                  string_view prefix) {
+uint64 S2RegionTermIndexer::GetTermId(TermType term_type, S2CellId id) {
+  if (term_type == TermType::ANCESTOR) return id.id();
+  S2_DCHECK(!id.is_leaf());
+  return id.id() | (id.lsb() >> 1);
+}
+
+string S2RegionTermIndexer::GetTermForId(uint64 term_id,
+                                         string_view prefix) const {
+  // Ancestor term ids are valid S2CellIds, whose lowest set bit is at an even
+  // position.
+  uint64 lsb = term_id & (~term_id + 1);
+  if (lsb & 0x5555555555555555ULL) {
+    return GetTerm(TermType::ANCESTOR, S2CellId(term_id), prefix);
+  }
+  return GetTerm(TermType::COVERING, S2CellId(term_id & ~lsb), prefix);
+}
+
+S2CellUnion S2RegionTermIndexer::GetCovering(const S2Region& region) {
+  // Note that options may have changed since the last call.
+  *coverer_.mutable_options() = options_;
+  return coverer_.GetCovering(region);
+}
+
+S2CellUnion S2RegionTermIndexer::GetCostModelCovering(
+    const S2Region& region, const TermCostFunction& term_cost) {
+  *coverer_.mutable_options() = options_;
+  coverer_.mutable_options()->set_max_cells(options_.cost_model_max_cells());
+  S2CellUnion covering = coverer_.GetCovering(region);
+
+  // Each group of covering cells with the same ancestor at min_level() is
+  // optimized separately.
+  vector<S2CellId> cells;
+  for (auto begin = covering.begin(); begin != covering.end(); ) {
+    S2CellId root = begin->parent(options_.min_level());
+    auto end = begin;
+    while (end != covering.end() && root.contains(*end)) ++end;
+    ChooseQueryCells(root, begin, end, term_cost, &cells);
+    begin = end;
+  }
+  return S2CellUnion::FromVerbatim(std::move(cells));
+}
+
+double S2RegionTermIndexer::ChooseQueryCells(
+    S2CellId id, vector<S2CellId>::const_iterator begin,
+    vector<S2CellId>::const_iterator end, const TermCostFunction& term_cost,
+    vector<S2CellId>* cells) const {
+  // The cost of querying "id" itself (see VisitQueryTerms).
+  double self_cost = term_cost(GetTermId(TermType::ANCESTOR, id));
+  if (!options_.index_contains_points_only() &&
+      options_.optimize_for_space() && id.level() < options_.true_max_level()) {
+    self_cost += term_cost(GetTermId(TermType::COVERING, id));
+  }
+  if (*begin == id) {
+    cells->push_back(id);
+    return self_cost;
+  }
+  // Otherwise compute the cost of querying the descendants of "id" instead,
+  // which also requires the covering term for "id".
+  size_t size = cells->size();
+  double split_cost = 0;
+  if (!options_.index_contains_points_only()) {
+    split_cost += term_cost(GetTermId(TermType::COVERING, id));
+  }
+  int child_level = id.level() + options_.level_mod();
+  while (begin != end) {
+    S2CellId child = begin->parent(child_level);
+    auto child_end = begin;
+    while (child_end != end && child.contains(*child_end)) ++child_end;
+    split_cost +=
+        ChooseQueryCells(child, begin, child_end, term_cost, cells);
+    begin = child_end;
+  }
+  if (self_cost <= split_cost) {
+    cells->resize(size);
+    cells->push_back(id);
+    return self_cost;
+  }
+  return split_cost;
+}
+
+void S2RegionTermIndexer::CheckCanonical(const S2CellUnion& covering) {
+  if (google::DEBUG_MODE) {
+    *coverer_.mutable_options() = options_;
+    S2_CHECK(coverer_.IsCanonical(covering));
+  }
+}
+
+template <class Visitor>
+void S2RegionTermIndexer::VisitIndexTerms(const S2Point& point,
+                                          const Visitor& visitor) const {
   // See the top of this file for an overview of the indexing strategy.
   //
   // The last cell generated by this loop is effectively the covering for
@@ -136,24 +238,15 @@ vector<string> S2RegionTermIndexer::GetIndexTerms(const S2Point& point,
   // max_level() != true_max_level() (see S2RegionCoverer::Options).
 
   const S2CellId id(point);
-  vector<string> terms;
   for (int level = options_.min_level(); level <= options_.max_level();
        level += options_.level_mod()) {
-    terms.push_back(GetTerm(TermType::ANCESTOR, id.parent(level), prefix));
+    visitor(TermType::ANCESTOR, id.parent(level));
   }
-  return terms;
 }
 
-vector<string> S2RegionTermIndexer::GetIndexTerms(const S2Region& region,
-                                                  string_view prefix) {
-  // Note that options may have changed since the last call.
-  *coverer_.mutable_options() = options_;
-  S2CellUnion covering = coverer_.GetCovering(region);
-  return GetIndexTermsForCanonicalCovering(covering, prefix);
-}
-
-vector<string> S2RegionTermIndexer::GetIndexTermsForCanonicalCovering(
-    const S2CellUnion& covering, string_view prefix) {
+template <class Visitor>
+void S2RegionTermIndexer::VisitIndexTerms(const S2CellUnion& covering,
+                                          const Visitor& visitor) const {
   // See the top of this file for an overview of the indexing strategy.
   //
   // Cells in the covering are normally indexed as covering terms.  If we are
@@ -164,11 +257,6 @@ vector<string> S2RegionTermIndexer::GetIndexTermsForCanonicalCovering(
   // that query regions will never contain a descendant of these cells.
 
   S2_CHECK(!options_.index_contains_points_only());
-  if (google::DEBUG_MODE) {
-    *coverer_.mutable_options() = options_;
-    S2_CHECK(coverer_.IsCanonical(covering));
-  }
-  vector<string> terms;
   S2CellId prev_id = S2CellId::None();
   int true_max_level = options_.true_max_level();
   for (S2CellId id : covering) {
@@ -181,11 +269,11 @@ vector<string> S2RegionTermIndexer::GetIndexTermsForCanonicalCovering(
 
     if (level < true_max_level) {
       // Add a covering term for this cell.
-      terms.push_back(GetTerm(TermType::COVERING, id, prefix));
+      visitor(TermType::COVERING, id);
     }
     if (level == true_max_level || !options_.optimize_for_space()) {
       // Add an ancestor term for this cell at the constrained level.
-      terms.push_back(GetTerm(TermType::ANCESTOR, id.parent(level), prefix));
+      visitor(TermType::ANCESTOR, id.parent(level));
     }
     // Finally, add ancestor terms for all the ancestors of this cell.
     while ((level -= options_.level_mod()) >= options_.min_level()) {
@@ -194,48 +282,38 @@ vector<string> S2RegionTermIndexer::GetIndexTermsForCanonicalCovering(
           prev_id.parent(level) == ancestor_id) {
         break;  // We have already processed this cell and its ancestors.
       }
-      terms.push_back(GetTerm(TermType::ANCESTOR, ancestor_id, prefix));
+      visitor(TermType::ANCESTOR, ancestor_id);
     }
     prev_id = id;
   }
-  return terms;
 }
 
-vector<string> S2RegionTermIndexer::GetQueryTerms(const S2Point& point,
-                                                  string_view prefix) {
+template <class Visitor>
+void S2RegionTermIndexer::VisitQueryTerms(const S2Point& point,
+                                          const Visitor& visitor) const {
   // See the top of this file for an overview of the indexing strategy.
 
   const S2CellId id(point);
-  vector<string> terms;
   // Recall that all true_max_level() cells are indexed only as ancestor terms.
   int level = options_.true_max_level();
-  terms.push_back(GetTerm(TermType::ANCESTOR, id.parent(level), prefix));
-  if (options_.index_contains_points_only()) return terms;
+  visitor(TermType::ANCESTOR, id.parent(level));
+  if (options_.index_contains_points_only()) return;
 
-  // Add covering terms for all the ancestor cells.
+  // Add covering terms for all the ancestor cells.  A leaf cell is skipped
+  // since covering terms are never indexed for true_max_level() cells (and
+  // leaf covering terms do not have a term id distinct from the ancestor
+  // term of the same cell, see GetTermId).
+  if (level == S2CellId::kMaxLevel) level -= options_.level_mod();
   for (; level >= options_.min_level(); level -= options_.level_mod()) {
-    terms.push_back(GetTerm(TermType::COVERING, id.parent(level), prefix));
+    visitor(TermType::COVERING, id.parent(level));
   }
-  return terms;
 }
 
-vector<string> S2RegionTermIndexer::GetQueryTerms(const S2Region& region,
-                                                  string_view prefix) {
-  // Note that options may have changed since the last call.
-  *coverer_.mutable_options() = options_;
-  S2CellUnion covering = coverer_.GetCovering(region);
-  return GetQueryTermsForCanonicalCovering(covering, prefix);
-}
-
-vector<string> S2RegionTermIndexer::GetQueryTermsForCanonicalCovering(
-    const S2CellUnion& covering, string_view prefix) {
+template <class Visitor>
+void S2RegionTermIndexer::VisitQueryTerms(const S2CellUnion& covering,
+                                          const Visitor& visitor) const {
   // See the top of this file for an overview of the indexing strategy.
 
-  if (google::DEBUG_MODE) {
-    *coverer_.mutable_options() = options_;
-    S2_CHECK(coverer_.IsCanonical(covering));
-  }
-  vector<string> terms;
   S2CellId prev_id = S2CellId::None();
   int true_max_level = options_.true_max_level();
   for (S2CellId id : covering) {
@@ -247,7 +325,7 @@ vector<string> S2RegionTermIndexer::GetQueryTermsForCanonicalCovering(
     S2_DCHECK_EQ(0, (level - options_.min_level()) % options_.level_mod());
 
     // Cells in the covering are always queried as ancestor terms.
-    terms.push_back(GetTerm(TermType::ANCESTOR, id, prefix));
+    visitor(TermType::ANCESTOR, id);
 
     // If the index only contains points, there are no covering terms.
     if (options_.index_contains_points_only()) continue;
@@ -256,7 +334,7 @@ vector<string> S2RegionTermIndexer::GetQueryTermsForCanonicalCovering(
     // also queried as covering terms (except for true_max_level() cells,
     // which are indexed and queried as ancestor cells only).
     if (options_.optimize_for_space() && level < true_max_level) {
-      terms.push_back(GetTerm(TermType::COVERING, id, prefix));
+      visitor(TermType::COVERING, id);
     }
     // Finally, add covering terms for all the ancestors of this cell.
     while ((level -= options_.level_mod()) >= options_.min_level()) {
@@ -265,9 +343,132 @@ vector<string> S2RegionTermIndexer::GetQueryTermsForCanonicalCovering(
           prev_id.parent(level) == ancestor_id) {
         break;  // We have already processed this cell and its ancestors.
       }
-      terms.push_back(GetTerm(TermType::COVERING, ancestor_id, prefix));
+      visitor(TermType::COVERING, ancestor_id);
     }
     prev_id = id;
   }
+}
+
+vector<string> S2RegionTermIndexer::GetIndexTerms(const S2Point& point,
+                                                  string_view prefix) {
+  vector<string> terms;
+  VisitIndexTerms(point, [&](TermType term_type, S2CellId id) {
+      terms.push_back(GetTerm(term_type, id, prefix));
+    });
+  return terms;
+}
+
+vector<string> S2RegionTermIndexer::GetIndexTerms(const S2Region& region,
+                                                  string_view prefix) {
+  return GetIndexTermsForCanonicalCovering(GetCovering(region), prefix);
+}
+
+vector<string> S2RegionTermIndexer::GetIndexTermsForCanonicalCovering(
+    const S2CellUnion& covering, string_view prefix) {
+  CheckCanonical(covering);
+  vector<string> terms;
+  VisitIndexTerms(covering, [&](TermType term_type, S2CellId id) {
+      terms.push_back(GetTerm(term_type, id, prefix));
+    });
+  return terms;
+}
+
+vector<string> S2RegionTermIndexer::GetQueryTerms(const S2Point& point,
+                                                  string_view prefix) {
+  vector<string> terms;
+  VisitQueryTerms(point, [&](TermType term_type, S2CellId id) {
+      terms.push_back(GetTerm(term_type, id, prefix));
+    });
+  return terms;
+}
+
+vector<string> S2RegionTermIndexer::GetQueryTerms(const S2Region& region,
+                                                  string_view prefix) {
+  return GetQueryTermsForCanonicalCovering(GetCovering(region), prefix);
+}
+
+vector<string> S2RegionTermIndexer::GetQueryTermsForCanonicalCovering(
+    const S2CellUnion& covering, string_view prefix) {
+  CheckCanonical(covering);
+  vector<string> terms;
+  VisitQueryTerms(covering, [&](TermType term_type, S2CellId id) {
+      terms.push_back(GetTerm(term_type, id, prefix));
+    });
   return terms;
 }
+
+vector<string> S2RegionTermIndexer::GetQueryTerms(
+    const S2Region& region, const TermCostFunction& term_cost,
+    string_view prefix) {
+  vector<string> terms;
+  VisitQueryTerms(GetCostModelCovering(region, term_cost),
+                  [&](TermType term_type, S2CellId id) {
+      terms.push_back(GetTerm(term_type, id, prefix));
+    });
+  return terms;
+}
+
+void S2RegionTermIndexer::GetIndexTermIds(const S2Region& region,
+                                          vector<uint64>* term_ids) {
+  GetIndexTermIdsForCanonicalCovering(GetCovering(region), term_ids);
+}
+
+void S2RegionTermIndexer::GetQueryTermIds(const S2Region& region,
+                                          vector<uint64>* term_ids) {
+  GetQueryTermIdsForCanonicalCovering(GetCovering(region), term_ids);
+}
+
+void S2RegionTermIndexer::GetQueryTermIds(const S2Region& region,
+                                          const TermCostFunction& term_cost,
+                                          vector<uint64>* term_ids) {
+  VisitQueryTerms(GetCostModelCovering(region, term_cost),
+                  [term_ids](TermType term_type, S2CellId id) {
+      term_ids->push_back(GetTermId(term_type, id));
+    });
+}
+
+void S2RegionTermIndexer::GetIndexTermIds(const S2Point& point,
+                                          vector<uint64>* term_ids) {
+  VisitIndexTerms(point, [term_ids](TermType term_type, S2CellId id) {
+      term_ids->push_back(GetTermId(term_type, id));
+    });
+}
+
+void S2RegionTermIndexer::GetQueryTermIds(const S2Point& point,
+                                          vector<uint64>* term_ids) {
+  VisitQueryTerms(point, [term_ids](TermType term_type, S2CellId id) {
+      term_ids->push_back(GetTermId(term_type, id));
+    });
+}
+
+void S2RegionTermIndexer::GetIndexTermIdsForCanonicalCovering(
+    const S2CellUnion& covering, vector<uint64>* term_ids) {
+  CheckCanonical(covering);
+  VisitIndexTerms(covering, [term_ids](TermType term_type, S2CellId id) {
+      term_ids->push_back(GetTermId(term_type, id));
+    });
+}
+
+void S2RegionTermIndexer::GetQueryTermIdsForCanonicalCovering(
+    const S2CellUnion& covering, vector<uint64>* term_ids) {
+  CheckCanonical(covering);
+  VisitQueryTerms(covering, [term_ids](TermType term_type, S2CellId id) {
+      term_ids->push_back(GetTermId(term_type, id));
+    });
+}
+
+void S2RegionTermIndexer::GetIndexTermIds(
+    absl::Span<const S2Region* const> regions, int num_threads,
+    vector<vector<uint64>>* term_ids) {
+  // Note that options may have changed since the last call.
+  *coverer_.mutable_options() = options_;
+  vector<S2CellUnion> coverings = coverer_.GetCoverings(regions, num_threads);
+  term_ids->resize(regions.size());
+  for (int i = 0; i < regions.size(); ++i) {
+    vector<uint64>* ids = &(*term_ids)[i];
+    ids->clear();
+    VisitIndexTerms(coverings[i], [ids](TermType term_type, S2CellId id) {
+        ids->push_back(GetTermId(term_type, id));
+      });
+  }
+}
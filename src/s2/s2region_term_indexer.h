@@ -97,11 +97,15 @@
 #ifndef S2_S2REGION_TERM_INDEXER_H_
 #define S2_S2REGION_TERM_INDEXER_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
+#include "s2/base/integral_types.h"
+#include "s2/s2cell_id.h"
 #include "s2/s2cell_union.h"
 #include "s2/s2region.h"
 #include "s2/s2region_coverer.h"
@@ -220,9 +224,36 @@ class S2RegionTermIndexer {
     char marker_character() const { return marker_[0]; }
     void set_marker_character(char ch);
 
+    // If true, terms are encoded in a compact binary format rather than as
+    // S2CellId tokens.  Each binary term consists of the prefix followed by
+    // the big-endian bytes of its term id (see GetTermForId), omitting any
+    // trailing zero bytes.  For example, terms for level 16 cells are 5
+    // bytes long rather than 9 or 10 characters.  All terms for cells at a
+    // given level have the same length, and terms sort in S2CellId order.
+    // The marker character is not used.
+    //
+    // Binary terms may contain any byte value (including '\0'), and they
+    // are not compatible with token terms: the index and the queries must
+    // use the same setting.
+    //
+    // DEFAULT: false
+    bool binary_terms() const { return binary_terms_; }
+    void set_binary_terms(bool value) { binary_terms_ = value; }
+
+    // The number of cells in the initial covering of a query region when
+    // its terms are chosen using a TermCostFunction (see GetQueryTermIds
+    // below).  Larger values let dense parts of the region be queried with
+    // smaller cells, at the cost of evaluating the cost function more often.
+    //
+    // DEFAULT: 64
+    int cost_model_max_cells() const { return cost_model_max_cells_; }
+    void set_cost_model_max_cells(int value) { cost_model_max_cells_ = value; }
+
    private:
     bool points_only_ = false;
     bool optimize_for_space_ = false;
+    bool binary_terms_ = false;
+    int cost_model_max_cells_ = 64;
     std::string marker_ = std::string(1, '$');
   };
 
@@ -287,9 +318,115 @@ class S2RegionTermIndexer {
   std::vector<std::string> GetQueryTermsForCanonicalCovering(
       const S2CellUnion& covering, absl::string_view prefix);
 
+  // The methods below return each term as a 64-bit integer rather than a
+  // string, which avoids allocating a string per term.  This is useful for
+  // systems that store integer postings keys (e.g., when indexing a very
+  // large number of documents).  Term ids are unique for a given marker
+  // character, and the term id of an ancestor term is simply the id() of its
+  // S2CellId.  Each term id corresponds to the string term returned by
+  // GetTermForId(), so the two representations may be mixed.  Note that term
+  // ids do not include a prefix.
+  //
+  // The term ids are appended to "term_ids", so that the terms of several
+  // regions can be collected in the same vector.
+  void GetIndexTermIds(const S2Region& region, std::vector<uint64>* term_ids);
+  void GetQueryTermIds(const S2Region& region, std::vector<uint64>* term_ids);
+  void GetIndexTermIds(const S2Point& point, std::vector<uint64>* term_ids);
+  void GetQueryTermIds(const S2Point& point, std::vector<uint64>* term_ids);
+  void GetIndexTermIdsForCanonicalCovering(const S2CellUnion& covering,
+                                           std::vector<uint64>* term_ids);
+  void GetQueryTermIdsForCanonicalCovering(const S2CellUnion& covering,
+                                           std::vector<uint64>* term_ids);
+
+  // Returns the expected cost of reading the posting list of the given term
+  // id from the index, e.g. the number of documents indexed under that term
+  // (see GetTermForId) plus a fixed cost per term looked up.  Only the
+  // relative values matter.
+  using TermCostFunction = std::function<double(uint64 term_id)>;
+
+  // Like GetQueryTermIds() and GetQueryTerms() above, but chooses the query
+  // terms so as to minimize the total cost of the posting lists read rather
+  // than using the max_cells() limit.  The region is first covered using
+  // cost_model_max_cells() cells, and then groups of these cells are
+  // replaced by their common ancestor wherever that is cheaper.  (Querying
+  // an ancestor reads one posting list that contains the documents of all
+  // its descendants, whereas querying its descendants reads one posting
+  // list each plus the covering term of the ancestor.)  The results of the
+  // query are a superset of what GetQueryTermIds() would return using
+  // max_cells() == cost_model_max_cells().
+  void GetQueryTermIds(const S2Region& region,
+                       const TermCostFunction& term_cost,
+                       std::vector<uint64>* term_ids);
+  std::vector<std::string> GetQueryTerms(const S2Region& region,
+                                         const TermCostFunction& term_cost,
+                                         absl::string_view prefix);
+
+  // Computes the index term ids of many regions, setting (*term_ids)[i] to
+  // the term ids for regions[i].  This is equivalent to calling
+  // GetIndexTermIds() for each region, except that the coverings (which
+  // dominate the running time) are computed using up to "num_threads"
+  // threads (see S2RegionCoverer::GetCoverings).
+  void GetIndexTermIds(absl::Span<const S2Region* const> regions,
+                       int num_threads,
+                       std::vector<std::vector<uint64>>* term_ids);
+
+  // Returns the string term corresponding to the given term id, i.e. the
+  // term that GetIndexTerms() or GetQueryTerms() would return with the
+  // given prefix.
+  std::string GetTermForId(uint64 term_id, absl::string_view prefix) const;
+
+  // Note that index and query terms can be generated from the same covering
+  // (rather than covering the region twice) by computing the covering once
+  // using an S2RegionCoverer with options() and then calling the
+  // *ForCanonicalCovering methods above.
+
  private:
   enum TermType { ANCESTOR, COVERING };
 
+  // Returns the term id for the given term.  Covering terms can be
+  // distinguished from ancestor terms by setting the bit just below
+  // S2CellId::lsb(), which yields an invalid S2CellId.  This does not work
+  // for leaf cells, and so the Visit methods below never generate covering
+  // terms for leaf cells.  (Leaf cells are always at true_max_level(), and
+  // those cells are indexed and queried as ancestor terms only.)
+  //
+  // REQUIRES: term_type == ANCESTOR || !id.is_leaf()
+  static uint64 GetTermId(TermType term_type, S2CellId id);
+
+  // Calls visitor(term_type, id) for each term of the given point or
+  // canonical covering.  The covering is not checked.
+  template <class Visitor>
+  void VisitIndexTerms(const S2Point& point, const Visitor& visitor) const;
+  template <class Visitor>
+  void VisitIndexTerms(const S2CellUnion& covering,
+                       const Visitor& visitor) const;
+  template <class Visitor>
+  void VisitQueryTerms(const S2Point& point, const Visitor& visitor) const;
+  template <class Visitor>
+  void VisitQueryTerms(const S2CellUnion& covering,
+                       const Visitor& visitor) const;
+
+  // Computes a covering of "region" using the current options.
+  S2CellUnion GetCovering(const S2Region& region);
+
+  // Returns the query cells chosen by the cost model for "region" (see
+  // GetQueryTermIds), in sorted order.
+  S2CellUnion GetCostModelCovering(const S2Region& region,
+                                   const TermCostFunction& term_cost);
+
+  // Chooses the query cells for the covering cells in [begin, end), all of
+  // which are descendants of "id" (or "id" itself), and appends them to
+  // "cells".  Returns the cost of the query terms for these cells and the
+  // covering terms for their ancestors below "id".
+  double ChooseQueryCells(S2CellId id,
+                          std::vector<S2CellId>::const_iterator begin,
+                          std::vector<S2CellId>::const_iterator end,
+                          const TermCostFunction& term_cost,
+                          std::vector<S2CellId>* cells) const;
+
+  // Checks (in debug mode) that "covering" is canonical.
+  void CheckCanonical(const S2CellUnion& covering);
+
   std::string GetTerm(TermType term_type, const S2CellId id,
                       absl::string_view prefix) const;
 
@@ -17,6 +17,7 @@
 
 #include "s2/s2region_term_indexer.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <memory>
 #include <set>
@@ -27,6 +28,7 @@
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/flags/flag.h"
+#include "absl/strings/string_view.h"
 
 #include "s2/base/commandlineflags.h"
 #include "s2/base/logging.h"
@@ -46,8 +48,38 @@ namespace {
 
 enum QueryType { POINT, CAP };
 
+// Converts term ids to the corresponding string terms.
+vector<string> GetTermsForIds(const S2RegionTermIndexer& indexer,
+                              const vector<uint64>& term_ids,
+                              absl::string_view prefix = "pre") {
+  vector<string> terms;
+  for (uint64 term_id : term_ids) {
+    terms.push_back(indexer.GetTermForId(term_id, prefix));
+  }
+  return terms;
+}
+
+// Returns the index terms (if "index" is true) or query terms for the given
+// point or region.  If "use_term_ids" is true, the terms are computed as
+// term ids and then converted to strings.
+template <class Region>
+vector<string> GetTerms(S2RegionTermIndexer* indexer, bool index,
+                        const Region& region, bool use_term_ids) {
+  if (!use_term_ids) {
+    return index ? indexer->GetIndexTerms(region, "pre")
+                 : indexer->GetQueryTerms(region, "pre");
+  }
+  vector<uint64> term_ids;
+  if (index) {
+    indexer->GetIndexTermIds(region, &term_ids);
+  } else {
+    indexer->GetQueryTermIds(region, &term_ids);
+  }
+  return GetTermsForIds(*indexer, term_ids);
+}
+
 void TestRandomCaps(const S2RegionTermIndexer::Options& options,
-                    QueryType query_type) {
+                    QueryType query_type, bool use_term_ids = false) {
   // This function creates an index consisting either of points (if
   // options.index_contains_points_only() is true) or S2Caps of random size.
   // It then executes queries consisting of points (if query_type == POINT)
@@ -65,12 +97,12 @@ void TestRandomCaps(const S2RegionTermIndexer::Options& options,
     vector<string> terms;
     if (options.index_contains_points_only()) {
       cap = S2Cap::FromPoint(S2Testing::RandomPoint());
-      terms = indexer.GetIndexTerms(cap.center(), "");
+      terms = GetTerms(&indexer, true, cap.center(), use_term_ids);
     } else {
       cap = S2Testing::GetRandomCap(
           0.3 * S2Cell::AverageArea(options.max_level()),
           4.0 * S2Cell::AverageArea(options.min_level()));
-      terms = indexer.GetIndexTerms(cap, "");
+      terms = GetTerms(&indexer, true, cap, use_term_ids);
     }
     caps.push_back(cap);
     coverings.push_back(coverer.GetCovering(cap));
@@ -86,12 +118,12 @@ void TestRandomCaps(const S2RegionTermIndexer::Options& options,
     vector<string> terms;
     if (query_type == QueryType::CAP) {
       cap = S2Cap::FromPoint(S2Testing::RandomPoint());
-      terms = indexer.GetQueryTerms(cap.center(), "");
+      terms = GetTerms(&indexer, false, cap.center(), use_term_ids);
     } else {
       cap = S2Testing::GetRandomCap(
           0.3 * S2Cell::AverageArea(options.max_level()),
           4.0 * S2Cell::AverageArea(options.min_level()));
-      terms = indexer.GetQueryTerms(cap, "");
+      terms = GetTerms(&indexer, false, cap, use_term_ids);
     }
     // Compute the expected results of the S2Cell query by brute force.
     S2CellUnion covering = coverer.GetCovering(cap);
@@ -170,6 +202,81 @@ TEST(S2RegionTermIndexer, IndexPointsQueryRegionsOptimizeSpace) {
   TestRandomCaps(options, QueryType::CAP);
 }
 
+TEST(S2RegionTermIndexer, IndexRegionsQueryRegionsBinaryTerms) {
+  S2RegionTermIndexer::Options options;
+  options.set_binary_terms(true);
+  options.set_min_level(0);                    // Use face cells.
+  options.set_max_level(16);
+  options.set_max_cells(20);
+  TestRandomCaps(options, QueryType::CAP);
+  options.set_optimize_for_space(true);
+  TestRandomCaps(options, QueryType::POINT);
+}
+
+TEST(S2RegionTermIndexer, IndexPointsQueryRegionsBinaryTerms) {
+  S2RegionTermIndexer::Options options;
+  options.set_binary_terms(true);
+  options.set_index_contains_points_only(true);
+  TestRandomCaps(options, QueryType::CAP);
+}
+
+TEST(S2RegionTermIndexer, BinaryTermLength) {
+  S2RegionTermIndexer::Options options;
+  options.set_binary_terms(true);
+  options.set_min_level(16);
+  options.set_max_level(16);
+  S2RegionTermIndexer indexer(options);
+  S2Point point = S2LatLng::FromDegrees(10, 20).ToPoint();
+  // There is one ancestor term and one covering term.  Level 16 cells use
+  // 3 + 2 * 16 + 1 bits, and covering terms use one more bit.
+  vector<string> terms = indexer.GetQueryTerms(point, "p");
+  ASSERT_EQ(2, terms.size());
+  EXPECT_EQ(6, terms[0].size());
+  EXPECT_EQ(6, terms[1].size());
+  EXPECT_NE(terms[0], terms[1]);
+
+  // The ancestor term consists of the first 5 bytes of the cell id.
+  uint64 id = S2CellId(point).parent(16).id();
+  string expected = "p";
+  for (int shift = 56; shift >= 24; shift -= 8) {
+    expected.push_back(static_cast<char>(id >> shift));
+  }
+  EXPECT_EQ(expected, terms[0]);
+}
+
+TEST(S2RegionTermIndexer, BinaryTermsLeafCells) {
+  // Leaf cells use all 64 bits of the term id, so their binary terms have no
+  // trailing zero bytes to omit.  Check that these terms round-trip through
+  // term ids and that queries find the expected documents.
+  S2RegionTermIndexer::Options options;
+  options.set_binary_terms(true);
+  options.set_min_level(20);
+  options.set_max_level(S2CellId::kMaxLevel);
+  S2RegionTermIndexer indexer(options);
+  for (int i = 0; i < 20; ++i) {
+    S2Point point = S2Testing::RandomPoint();
+    vector<uint64> term_ids;
+    indexer.GetQueryTermIds(point, &term_ids);
+    vector<string> terms = indexer.GetQueryTerms(point, "p");
+    EXPECT_EQ(terms, GetTermsForIds(indexer, term_ids, "p"));
+
+    // The first term is the ancestor term of the leaf cell, which consists
+    // of all 8 bytes of the cell id.
+    uint64 id = S2CellId(point).id();
+    string expected = "p";
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      expected.push_back(static_cast<char>(id >> shift));
+    }
+    ASSERT_FALSE(terms.empty());
+    EXPECT_EQ(expected, terms[0]);
+    EXPECT_EQ(id, term_ids[0]);
+  }
+  TestRandomCaps(options, QueryType::POINT);
+  TestRandomCaps(options, QueryType::CAP);
+  options.set_optimize_for_space(true);
+  TestRandomCaps(options, QueryType::POINT);
+}
+
 TEST(S2RegionTermIndexer, MarkerCharacter) {
   S2RegionTermIndexer::Options options;
   options.set_min_level(20);
@@ -211,6 +318,127 @@ TEST(S2RegionTermIndexer, MaxLevelSetLoosely) {
             indexer2.GetQueryTerms(cap, ""));
 }
 
+TEST(S2RegionTermIndexer, LeafCellTermIds) {
+  // When max_level() is S2CellId::kMaxLevel, point queries visit a covering
+  // term for a leaf cell, which has no term id of its own.  Check that term
+  // ids still find exactly the expected documents for both point and region
+  // queries.
+  for (bool optimize_for_space : {false, true}) {
+    S2RegionTermIndexer::Options options;
+    options.set_optimize_for_space(optimize_for_space);
+    options.set_min_level(20);
+    options.set_max_level(S2CellId::kMaxLevel);
+    options.set_max_cells(8);
+    TestRandomCaps(options, QueryType::POINT, true);
+    TestRandomCaps(options, QueryType::CAP, true);
+  }
+}
+
+TEST(S2RegionTermIndexer, TermIds) {
+  for (int i = 0; i < 3; ++i) {
+    S2RegionTermIndexer::Options options;
+    options.set_max_cells(20);
+    options.set_optimize_for_space(i == 1);
+    options.set_index_contains_points_only(i == 2);
+    S2RegionTermIndexer indexer(options);
+    vector<S2Cap> caps;
+    for (int j = 0; j < 20; ++j) {
+      caps.push_back(S2Testing::GetRandomCap(1e-12, 1e-3));
+      const S2Cap& cap = caps.back();
+      vector<uint64> term_ids;
+      if (!options.index_contains_points_only()) {
+        indexer.GetIndexTermIds(cap, &term_ids);
+        EXPECT_EQ(indexer.GetIndexTerms(cap, "pre"),
+                  GetTermsForIds(indexer, term_ids));
+      }
+      term_ids.clear();
+      indexer.GetQueryTermIds(cap, &term_ids);
+      EXPECT_EQ(indexer.GetQueryTerms(cap, "pre"),
+                GetTermsForIds(indexer, term_ids));
+
+      term_ids.clear();
+      indexer.GetIndexTermIds(cap.center(), &term_ids);
+      EXPECT_EQ(indexer.GetIndexTerms(cap.center(), "pre"),
+                GetTermsForIds(indexer, term_ids));
+      term_ids.clear();
+      indexer.GetQueryTermIds(cap.center(), &term_ids);
+      EXPECT_EQ(indexer.GetQueryTerms(cap.center(), "pre"),
+                GetTermsForIds(indexer, term_ids));
+    }
+    if (options.index_contains_points_only()) continue;
+
+    // Test the batch version.
+    vector<const S2Region*> regions;
+    for (const S2Cap& cap : caps) regions.push_back(&cap);
+    vector<vector<uint64>> batch_ids;
+    indexer.GetIndexTermIds(regions, 4, &batch_ids);
+    ASSERT_EQ(caps.size(), batch_ids.size());
+    for (int j = 0; j < caps.size(); ++j) {
+      EXPECT_EQ(indexer.GetIndexTerms(caps[j], "pre"),
+                GetTermsForIds(indexer, batch_ids[j]));
+    }
+  }
+}
+
+TEST(S2RegionTermIndexer, CostModelQueryTerms) {
+  // Index a dense cluster of small caps plus some scattered ones, and check
+  // that the terms chosen by the cost model find every document that the
+  // initial covering would find while reading fewer postings.
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  for (int i = 0; i < 3; ++i) {
+    S2RegionTermIndexer::Options options;
+    options.set_optimize_for_space(i == 1);
+    options.set_index_contains_points_only(i == 2);
+    options.set_cost_model_max_cells(32);
+    S2RegionTermIndexer indexer(options);
+    S2Cap cluster = S2Testing::GetRandomCap(1e-6, 1e-6);
+    absl::flat_hash_map<uint64, vector<int>> index;
+    for (int doc = 0; doc < 300; ++doc) {
+      S2Point center = doc < 250 ? S2Testing::SamplePoint(cluster)
+                                 : S2Testing::RandomPoint();
+      vector<uint64> term_ids;
+      if (options.index_contains_points_only()) {
+        indexer.GetIndexTermIds(center, &term_ids);
+      } else {
+        indexer.GetIndexTermIds(S2Cap(center, S1Angle::Radians(1e-5)),
+                                &term_ids);
+      }
+      for (uint64 term_id : term_ids) index[term_id].push_back(doc);
+    }
+    auto term_cost = [&index](uint64 term_id) {
+      auto it = index.find(term_id);
+      return 1.0 + (it == index.end() ? 0 : it->second.size());
+    };
+    // Returns the total cost and the documents found by the given terms.
+    auto lookup = [&](const vector<uint64>& term_ids, std::set<int>* docs) {
+      double cost = 0;
+      for (uint64 term_id : term_ids) {
+        cost += term_cost(term_id);
+        auto it = index.find(term_id);
+        if (it != index.end()) docs->insert(it->second.begin(),
+                                            it->second.end());
+      }
+      return cost;
+    };
+    for (int j = 0; j < 10; ++j) {
+      S2Cap query(S2Testing::SamplePoint(cluster),
+                  S1Angle::Radians(S2Testing::rnd.RandDouble() * 3e-3));
+      vector<uint64> expected_ids, actual_ids;
+      indexer.mutable_options()->set_max_cells(32);
+      indexer.GetQueryTermIds(query, &expected_ids);
+      indexer.mutable_options()->set_max_cells(8);
+      indexer.GetQueryTermIds(query, term_cost, &actual_ids);
+      EXPECT_EQ(indexer.GetQueryTerms(query, term_cost, "pre"),
+                GetTermsForIds(indexer, actual_ids));
+      std::set<int> expected, actual;
+      double expected_cost = lookup(expected_ids, &expected);
+      EXPECT_LE(lookup(actual_ids, &actual), expected_cost);
+      EXPECT_TRUE(std::includes(actual.begin(), actual.end(),
+                                expected.begin(), expected.end()));
+    }
+  }
+}
+
 TEST(S2RegionTermIndexer, MoveConstructor) {
   S2RegionTermIndexer x;
   x.mutable_options()->set_max_cells(12345);
@@ -0,0 +1,90 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2replicated_index.h"
+
+#include <memory>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "absl/memory/memory.h"
+#include "s2/util/coding/coder.h"
+#include "s2/base/logging.h"
+#include "s2/s2shapeutil_coding.h"
+
+using absl::make_unique;
+
+S2ReplicatedIndex::Options::Options() {
+}
+
+S2ReplicatedIndex::S2ReplicatedIndex() {
+}
+
+S2ReplicatedIndex::S2ReplicatedIndex(const Options& options)
+    : options_(options) {
+}
+
+S2ReplicatedIndex::~S2ReplicatedIndex() {
+}
+
+bool S2ReplicatedIndex::Init(absl::string_view encoded, S2Error* error) {
+  replicas_.clear();
+  return AddReplica(encoded, CurrentNumaNode(), error);
+}
+
+bool S2ReplicatedIndex::AddReplica(S2Error* error) {
+  S2_DCHECK(!replicas_.empty());
+  int node = CurrentNumaNode();
+  for (const auto& replica : replicas_) {
+    if (replica->node == node) return true;
+  }
+  return AddReplica(replicas_[0]->buffer->contents(), node, error);
+}
+
+bool S2ReplicatedIndex::AddReplica(absl::string_view encoded, int node,
+                                   S2Error* error) {
+  auto replica = make_unique<Replica>();
+  replica->node = node;
+  replica->buffer = S2PageBuffer::Copy(encoded, options_.huge_pages(), error);
+  if (replica->buffer == nullptr) return false;
+
+  Decoder decoder(replica->buffer->data(), replica->buffer->size());
+  if (!replica->index.Init(&decoder,
+                           s2shapeutil::LazyDecodeShapeFactory(&decoder))) {
+    error->Init(S2Error::DATA_LOSS, "Invalid encoded S2ShapeIndex");
+    return false;
+  }
+  replicas_.push_back(std::move(replica));
+  return true;
+}
+
+const EncodedS2ShapeIndex& S2ReplicatedIndex::index_for_node(int node) const {
+  S2_DCHECK(!replicas_.empty());
+  for (const auto& replica : replicas_) {
+    if (replica->node == node) return replica->index;
+  }
+  return replicas_[0]->index;
+}
+
+int S2ReplicatedIndex::CurrentNumaNode() {
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return node;
+#endif
+  return 0;
+}
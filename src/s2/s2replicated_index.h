@@ -0,0 +1,141 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2REPLICATED_INDEX_H_
+#define S2_S2REPLICATED_INDEX_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "s2/encoded_s2shape_index.h"
+#include "s2/s2error.h"
+#include "s2/s2page_buffer.h"
+
+// S2ReplicatedIndex keeps one copy of a large, frozen EncodedS2ShapeIndex
+// per NUMA node, so that query threads can read the copy that is local to
+// the node they are running on.  On multi-socket hosts this avoids the
+// remote memory latency and interconnect traffic of sharing a single copy,
+// at the cost of one copy of the encoded data per node.  Each copy is held
+// in an S2PageBuffer and can optionally use huge pages to reduce TLB misses.
+//
+// The encoded data must consist of an encoded tagged shape vector followed
+// by the encoded index, e.g.
+//
+//   Encoder encoder;
+//   s2shapeutil::CompactEncodeTaggedShapes(index, &encoder);
+//   index.Encode(&encoder);
+//
+// Replicas are placed using the kernel's "first touch" policy: each call to
+// AddReplica() copies the data on the calling thread and registers the copy
+// for the NUMA node that thread is running on.  The usual pattern is to call
+// AddReplica() once from a thread pinned to each node (e.g., from the first
+// worker thread of each per-node thread pool):
+//
+//   S2ReplicatedIndex replicas;
+//   if (!replicas.Init(encoded, &error)) return error;
+//   for (each NUMA node) {
+//     // On a thread pinned to that node:
+//     if (!replicas.AddReplica(&error)) return error;
+//   }
+//
+//   // Query threads:
+//   S2ClosestEdgeQuery query(&replicas.local_index());
+//
+// Since the query classes simply take an S2ShapeIndex pointer, the choice
+// of replica is made when the query object is constructed; query objects
+// should therefore be per-thread (as they must be anyway).
+//
+// This class does not depend on a NUMA library.  The current node is
+// obtained from getcpu() on Linux; on other platforms every thread is
+// assumed to run on node 0, and only one replica is useful.
+//
+// Thread-safety: Init() and AddReplica() must not be called concurrently
+// with any other method.  Once all replicas have been added, the const
+// methods may be called from any number of threads.
+class S2ReplicatedIndex {
+ public:
+  class Options {
+   public:
+    Options();
+
+    // If true, each replica is stored in transparent huge pages (see
+    // S2PageBuffer).
+    //
+    // DEFAULT: true
+    bool huge_pages() const { return huge_pages_; }
+    void set_huge_pages(bool huge_pages) { huge_pages_ = huge_pages; }
+
+   private:
+    bool huge_pages_ = true;
+  };
+
+  // Default constructor; requires Init() to be called.
+  S2ReplicatedIndex();
+  explicit S2ReplicatedIndex(const Options& options);
+  ~S2ReplicatedIndex();
+
+  const Options& options() const { return options_; }
+
+  // Copies "encoded" into a replica for the calling thread's NUMA node, and
+  // decodes the index.  "encoded" is not referenced after this call.
+  // Returns false and sets "error" on failure.
+  bool Init(absl::string_view encoded, S2Error* error);
+
+  // Copies the first replica into a new replica for the calling thread's
+  // NUMA node.  Does nothing if that node already has a replica.  Returns
+  // false and sets "error" on failure.
+  //
+  // REQUIRES: Init() has been called successfully.
+  bool AddReplica(S2Error* error);
+
+  int num_replicas() const { return replicas_.size(); }
+
+  // Returns the NUMA node of the given replica.
+  int replica_node(int i) const { return replicas_[i]->node; }
+
+  // Returns the replica for the given NUMA node, or the first replica if
+  // that node does not have one.
+  const EncodedS2ShapeIndex& index_for_node(int node) const;
+
+  // Returns the replica for the calling thread's NUMA node.  This costs a
+  // system call, so clients should call it once per query object rather
+  // than once per query.
+  const EncodedS2ShapeIndex& local_index() const {
+    return index_for_node(CurrentNumaNode());
+  }
+
+  // Returns the NUMA node of the CPU that the calling thread is running on,
+  // or 0 if this is not available.
+  static int CurrentNumaNode();
+
+ private:
+  struct Replica {
+    int node;
+    std::unique_ptr<S2PageBuffer> buffer;
+    EncodedS2ShapeIndex index;
+  };
+
+  // Copies "encoded" into a new replica for "node".
+  bool AddReplica(absl::string_view encoded, int node, S2Error* error);
+
+  Options options_;
+  std::vector<std::unique_ptr<Replica>> replicas_;
+
+  S2ReplicatedIndex(const S2ReplicatedIndex&) = delete;
+  void operator=(const S2ReplicatedIndex&) = delete;
+};
+
+#endif  // S2_S2REPLICATED_INDEX_H_
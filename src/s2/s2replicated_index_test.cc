@@ -0,0 +1,89 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2replicated_index.h"
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "s2/util/coding/coder.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2text_format.h"
+
+using std::string;
+
+namespace {
+
+#ifndef _WIN32
+
+string EncodeIndex(const MutableS2ShapeIndex& index) {
+  Encoder encoder;
+  s2shapeutil::CompactEncodeTaggedShapes(index, &encoder);
+  index.Encode(&encoder);
+  return string(encoder.base(), encoder.length());
+}
+
+TEST(S2ReplicatedIndex, LocalReplica) {
+  auto index = s2textformat::MakeIndexOrDie(
+      "# # 0:0, 0:10, 10:10, 10:0; 20:20, 20:30, 30:30, 30:20");
+  string encoded = EncodeIndex(*index);
+
+  S2ReplicatedIndex replicas;
+  S2Error error;
+  ASSERT_TRUE(replicas.Init(encoded, &error)) << error;
+  EXPECT_EQ(1, replicas.num_replicas());
+  EXPECT_EQ(S2ReplicatedIndex::CurrentNumaNode(), replicas.replica_node(0));
+
+  // Adding a replica from the same node does nothing.
+  ASSERT_TRUE(replicas.AddReplica(&error)) << error;
+  EXPECT_EQ(1, replicas.num_replicas());
+
+  // The encoded data is copied, so the original may be destroyed.
+  encoded.assign(encoded.size(), '\0');
+
+  const EncodedS2ShapeIndex& local = replicas.local_index();
+  EXPECT_EQ(&local, &replicas.index_for_node(replicas.replica_node(0)));
+  EXPECT_EQ(&local, &replicas.index_for_node(12345));  // Falls back.
+  ASSERT_EQ(1, local.num_shape_ids());
+  auto query = MakeS2ContainsPointQuery(&local);
+  EXPECT_TRUE(query.Contains(s2textformat::MakePointOrDie("5:5")));
+  EXPECT_FALSE(query.Contains(s2textformat::MakePointOrDie("15:15")));
+  EXPECT_TRUE(query.Contains(s2textformat::MakePointOrDie("25:25")));
+}
+
+TEST(S2ReplicatedIndex, WithoutHugePages) {
+  auto index = s2textformat::MakeIndexOrDie("0:0 # 1:1, 2:2 #");
+  S2ReplicatedIndex::Options options;
+  options.set_huge_pages(false);
+  S2ReplicatedIndex replicas(options);
+  S2Error error;
+  ASSERT_TRUE(replicas.Init(EncodeIndex(*index), &error)) << error;
+  EXPECT_EQ(2, replicas.local_index().num_shape_ids());
+}
+
+TEST(S2ReplicatedIndex, InvalidEncoding) {
+  S2ReplicatedIndex replicas;
+  S2Error error;
+  EXPECT_FALSE(replicas.Init("\xff\xff\xff", &error));
+  EXPECT_EQ(S2Error::DATA_LOSS, error.code());
+  EXPECT_EQ(0, replicas.num_replicas());
+}
+
+#endif  // _WIN32
+
+}  // namespace
@@ -18,9 +18,12 @@
 #ifndef S2_S2SHAPE_H_
 #define S2_S2SHAPE_H_
 
+#include <vector>
+
 #include "s2/base/integral_types.h"
 #include "s2/base/logging.h"
 #include "s2/s2point.h"
+#include "s2/s2point_span.h"
 #include "s2/s2pointutil.h"
 #include "s2/util/coding/coder.h"
 
@@ -236,6 +239,23 @@ class S2Shape {
   // where     pos == shape.chain_position(edge_id).
   virtual ChainPosition chain_position(int edge_id) const = 0;
 
+  // Returns the vertices of the given chain as a contiguous array.  If the
+  // chain has "n" edges, the array has (n + 1) vertices for polylines
+  // (dimension 1) and "n" vertices otherwise, so that edge "j" of the chain
+  // is (v[j], v[j + 1]) for polylines and (v[j], v[(j + 1) % n]) for points
+  // and polygons.  (This is the same convention as S2::GetChainVertices.)
+  //
+  // Shapes that store their vertices contiguously return a span that points
+  // into the shape itself, which lets clients stream the vertices without
+  // calling chain_edge() for every edge.  Other shapes copy the vertices
+  // into "tmp" (which then contains exactly the returned vertices) and
+  // return a span that points into it.  Either way the span remains valid
+  // until the shape or "tmp" is modified.
+  //
+  // The default implementation calls chain_edge() for every other edge.
+  virtual S2PointSpan GetChainVertices(int chain_id,
+                                       std::vector<S2Point>* tmp) const;
+
   // A unique id assigned to this shape by S2ShapeIndex.  Shape ids are
   // assigned sequentially starting from 0 in the order shapes are added.
   //
@@ -323,10 +343,33 @@ class S2Shape {
   S2Shape& operator=(S2Shape&&) = default;
 
  private:
+  friend class CompositeS2ShapeIndex;
   friend class EncodedS2ShapeIndex;
   friend class MutableS2ShapeIndex;
+  friend class OverlayS2ShapeIndex;
 
   int id_;  // Assigned by S2ShapeIndex when the shape is added.
 };
 
+
+//////////////////   Implementation details follow   ////////////////////
+
+
+inline S2PointSpan S2Shape::GetChainVertices(
+    int chain_id, std::vector<S2Point>* tmp) const {
+  int num_vertices = chain(chain_id).length + (dimension() == 1);
+  tmp->clear();
+  tmp->reserve(num_vertices);
+  int e = 0;
+  if (num_vertices & 1) {
+    tmp->push_back(chain_edge(chain_id, e++).v0);
+  }
+  for (; e < num_vertices; e += 2) {
+    Edge edge = chain_edge(chain_id, e);
+    tmp->push_back(edge.v0);
+    tmp->push_back(edge.v1);
+  }
+  return *tmp;
+}
+
 #endif  // S2_S2SHAPE_H_
@@ -17,6 +17,8 @@
 
 #include "s2/s2shape_index.h"
 
+#include <algorithm>
+
 bool S2ClippedShape::ContainsEdge(int id) const {
   // Linear search is fast because the number of edges per shape is typically
   // very small (less than 10).
@@ -54,6 +56,32 @@ S2ClippedShape* S2ShapeIndexCell::add_shapes(int n) {
   return &shapes_[size];
 }
 
+// Moves the edge ids of all clipped shapes that are not stored inline into a
+// single allocation, which is owned by the first such shape.  This saves one
+// heap allocation (and its overhead) per clipped shape and makes the edge ids
+// of the cell contiguous in memory.  Must be called once all the clipped
+// shapes have been added; calling it again has no effect.
+void S2ShapeIndexCell::CompactEdges() {
+  int num_allocated = 0, total_edges = 0;
+  for (const S2ClippedShape& s : shapes_) {
+    if (s.is_inline()) continue;
+    if (s.shares_edges_) return;  // Already compacted.
+    ++num_allocated;
+    total_edges += s.num_edges();
+  }
+  if (num_allocated <= 1) return;
+  int32* block = new int32[total_edges];
+  int32* next = block;
+  for (S2ClippedShape& s : shapes_) {
+    if (s.is_inline()) continue;
+    std::copy(s.edges_, s.edges_ + s.num_edges(), next);
+    s.Destruct();
+    s.edges_ = next;
+    s.shares_edges_ = (next != block);
+    next += s.num_edges();
+  }
+}
+
 void S2ShapeIndexCell::Encode(int num_shape_ids, Encoder* encoder) const {
   // The encoding is designed to be especially compact in certain common
   // situations:
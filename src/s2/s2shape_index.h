@@ -98,6 +98,7 @@ class S2ClippedShape {
   // This class may be copied by value, but note that it does *not* own its
   // underlying data.  (It is owned by the containing S2ShapeIndexCell.)
 
+  friend class CompositeS2ShapeIndex;
   friend class MutableS2ShapeIndex;
   friend class S2ShapeIndexCell;
   friend class S2Stats;
@@ -114,10 +115,12 @@ class S2ClippedShape {
   // clients that use S2Shapes consisting of a single edge.
   int32 shape_id_;
   uint32 contains_center_ : 1;  // shape contains the cell center
-  uint32 num_edges_ : 31;
+  uint32 shares_edges_ : 1;     // edges_ is freed by an earlier shape
+  uint32 num_edges_ : 30;
 
   // If there are more than two edges, this field holds a pointer.
-  // Otherwise it holds an array of edge ids.
+  // Otherwise it holds an array of edge ids.  (See also
+  // S2ShapeIndexCell::CompactEdges.)
   union {
     int32* edges_;  // Owned by the containing S2ShapeIndexCell.
     std::array<int32, 2> inline_edges_;
@@ -162,12 +165,14 @@ class S2ShapeIndexCell {
   bool Decode(int num_shape_ids, Decoder* decoder);
 
  private:
+  friend class CompositeS2ShapeIndex;
   friend class MutableS2ShapeIndex;
   friend class EncodedS2ShapeIndex;
   friend class S2Stats;
 
   // Internal methods are documented with their definitions.
   S2ClippedShape* add_shapes(int n);
+  void CompactEdges();
   static void EncodeEdges(const S2ClippedShape& clipped, Encoder* encoder);
   static bool DecodeEdges(int num_edges, S2ClippedShape* clipped,
                           Decoder* decoder);
@@ -328,6 +333,34 @@ class S2ShapeIndex {
   // Like all non-const methods, this method is not thread-safe.
   virtual void Minimize() = 0;
 
+  // Returns the endpoints of all the edges in the given cell of this index if
+  // the index keeps a copy of them (see MutableS2ShapeIndex::Options::
+  // cache_edges), and nullptr otherwise.  The edges of clipped(0) come first
+  // (in the order given by clipped(0).edge(j)), followed by the edges of
+  // clipped(1), and so on.  This saves calling S2Shape::edge(), which may
+  // involve a virtual call and decoding, in the inner loops of queries.
+  //
+  // Also returns nullptr if the cell has no edges.
+  virtual const S2Shape::Edge* cached_edges(
+      const S2ShapeIndexCell& cell) const {
+    return nullptr;
+  }
+
+  // Returns a single-precision copy of the edge endpoints of the given cell
+  // if the index keeps one (see MutableS2ShapeIndex::Options::
+  // cache_float_edges), and nullptr otherwise.  The edges are in the same
+  // order as cached_edges(), but stored as six arrays of cell.num_edges()
+  // floats each: the x, y, and z coordinates of all the v0 endpoints,
+  // followed by the x, y, and z coordinates of all the v1 endpoints.  In other
+  // words, coordinate "c" of endpoint "k" of edge "i" is at index
+  // ((3 * k + c) * cell.num_edges() + i).
+  //
+  // Also returns nullptr if the cell has no edges.
+  virtual const float* cached_float_edges(
+      const S2ShapeIndexCell& cell) const {
+    return nullptr;
+  }
+
   // The possible relationships between a "target" cell and the cells of the
   // S2ShapeIndex.  If the target is an index cell or is contained by an index
   // cell, it is "INDEXED".  If the target is subdivided into one or more
@@ -414,6 +447,14 @@ class S2ShapeIndex {
     // end of the index if no such cell exists.
     void Seek(S2CellId target) { iter_->Seek(target); }
 
+    // Returns true if Prefetch() may do anything for this iterator (see
+    // IteratorBase::can_prefetch).
+    bool can_prefetch() const { return iter_->can_prefetch(); }
+
+    // Hints that Seek(target) or Locate(target) is likely to be called soon
+    // (see IteratorBase::Prefetch).
+    void Prefetch(S2CellId target) const { iter_->Prefetch(target); }
+
     // Positions the iterator at the cell containing "target".  If no such cell
     // exists, returns false and leaves the iterator positioned arbitrarily.
     // The returned index cell is guaranteed to contain all edges that might
@@ -527,6 +568,18 @@ class S2ShapeIndex {
     // positioned arbitrarily.
     virtual CellRelation Locate(S2CellId target) = 0;
 
+    // Returns true if Prefetch() may do anything for this iterator.  Since
+    // Prefetch() is a virtual call, callers in inner loops should check this
+    // once and skip computing prefetch targets when it returns false.
+    virtual bool can_prefetch() const { return false; }
+
+    // Hints that Seek(target) or Locate(target) is likely to be called soon.
+    // Subtypes may start loading the index data needed to position the
+    // iterator so that the memory latency overlaps with other work.  This
+    // method does not change the iterator position.  The default
+    // implementation does nothing.
+    virtual void Prefetch(S2CellId target) const {}
+
    protected:
     IteratorBase() : id_(S2CellId::Sentinel()), cell_(nullptr) {}
 
@@ -612,6 +665,7 @@ inline void S2ClippedShape::Init(int32 shape_id, int32 num_edges) {
   shape_id_ = shape_id;
   num_edges_ = num_edges;
   contains_center_ = false;
+  shares_edges_ = false;
   if (!is_inline()) {
     edges_ = new int32[num_edges];
   }
@@ -622,7 +676,7 @@ inline void S2ClippedShape::Init(int32 shape_id, int32 num_edges) {
 // don't want to repeatedly copy and free the edge data.  Instead the data
 // is owned by the containing S2ShapeIndexCell.
 inline void S2ClippedShape::Destruct() {
-  if (!is_inline()) delete[] edges_;
+  if (!is_inline() && !shares_edges_) delete[] edges_;
 }
 
 inline bool S2ClippedShape::is_inline() const {
@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "s2/s2metrics.h"
 #include "s2/s2shape_index_region.h"
 
@@ -77,6 +78,84 @@ void S2ShapeIndexBufferedRegion::GetCellUnionBound(vector<S2CellId> *cellids)
   }
 }
 
+// Appends the cells at the given level that intersect "region" and are
+// descendants of "id" to "output", except that descendants contained by
+// "region" are appended without being subdivided.
+static void AppendIntersectingCells(
+    const S2ShapeIndexRegion<S2ShapeIndex>& region, S2CellId id, int level,
+    vector<S2CellId>* output) {
+  S2Cell cell(id);
+  if (!region.MayIntersect(cell)) return;
+  if (id.level() == level || region.Contains(cell)) {
+    output->push_back(id);
+    return;
+  }
+  for (S2CellId child = id.child_begin(); child != id.child_end();
+       child = child.next()) {
+    AppendIntersectingCells(region, child, level, output);
+  }
+}
+
+S2CellUnion S2ShapeIndexBufferedRegion::GetCoveringAtLevel(int level) const {
+  S2_DCHECK_GE(level, 0);
+  S2_DCHECK_LE(level, S2CellId::kMaxLevel);
+  if (radius_successor_ > S1ChordAngle::Straight()) {
+    return S2CellUnion::WholeSphere();
+  }
+  // First cover the unbuffered geometry.  Index cells at or below "level"
+  // are replaced by their ancestor at "level".  Larger index cells are
+  // either contained by the geometry (if they have no edges), or else they
+  // are subdivided to find the descendants at "level" that intersect it.
+  auto region = MakeS2ShapeIndexRegion(&index());
+  vector<S2CellId> seed_ids;
+  for (S2ShapeIndex::Iterator it(&index(), S2ShapeIndex::BEGIN); !it.done();
+       it.Next()) {
+    S2CellId id = it.id();
+    if (id.level() >= level) {
+      seed_ids.push_back(id.parent(level));
+    } else if (it.cell().num_edges() == 0) {
+      seed_ids.push_back(id);
+    } else {
+      AppendIntersectingCells(region, id, level, &seed_ids);
+    }
+  }
+  S2CellUnion seeds(std::move(seed_ids));
+
+  // Now expand the covering one ring of neighbors at a time.  A cell in ring
+  // "k" can be reached from a seed cell by crossing k-1 cells, so it is
+  // within k * kMaxDiag of the seed cell's geometry.  Cells in rings beyond
+  // the radius are tested explicitly, and only cells within the radius are
+  // expanded further.  This does not miss any cells because the geodesic
+  // from any point within the radius to the closest point of the geometry
+  // passes only through cells that are themselves within the radius.
+  const double max_diag = S2::kMaxDiag.GetValue(level);
+  vector<S2CellId> result = seeds.cell_ids();
+  vector<S2CellId> frontier, next, neighbors;
+  absl::flat_hash_set<S2CellId, S2CellIdHash> visited;
+  auto add_neighbors = [&](S2CellId id) {
+    neighbors.clear();
+    id.AppendAllNeighbors(level, &neighbors);
+    for (S2CellId nbr : neighbors) {
+      if (!seeds.Contains(nbr) && visited.insert(nbr).second) {
+        next.push_back(nbr);
+      }
+    }
+  };
+  for (S2CellId id : seeds) add_neighbors(id);
+  for (int ring = 1; !next.empty(); ++ring) {
+    frontier.swap(next);
+    next.clear();
+    bool within_radius =
+        S1ChordAngle(S1Angle::Radians(ring * max_diag)) <= radius_;
+    for (S2CellId id : frontier) {
+      if (!within_radius && !MayIntersect(S2Cell(id))) continue;
+      result.push_back(id);
+      add_neighbors(id);
+    }
+  }
+  return S2CellUnion(std::move(result));
+}
+
 bool S2ShapeIndexBufferedRegion::Contains(const S2Cell& cell) const {
   // Return true if the buffered region is guaranteed to cover whole globe.
   if (radius_successor_ > S1ChordAngle::Straight()) return true;
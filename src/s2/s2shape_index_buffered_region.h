@@ -76,6 +76,24 @@ class S2ShapeIndexBufferedRegion final : public S2Region {
   const S2ShapeIndex& index() const;
   S1ChordAngle radius() const;
 
+  // Returns a covering of the buffered region consisting of cells at the
+  // given level, except that groups of four sibling cells are replaced by
+  // their parent (see S2CellUnion::Normalize).  This is typically much
+  // faster than S2RegionCoverer since it does not test every candidate cell
+  // against the index.  Instead it starts with the level cells that cover
+  // the index itself, and then adds rings of neighboring cells (see
+  // S2CellId::AppendAllNeighbors) until the buffer radius is exhausted.
+  // Only cells in the outermost rings, which may or may not be within the
+  // radius, are tested using a distance query.
+  //
+  // The number of cells grows with both the size of the geometry and the
+  // number of cells spanned by the radius, so "level" should be chosen such
+  // that the cells are not much smaller than the radius, for example
+  // S2::kAvgEdge.GetClosestLevel(radius().ToAngle().radians()).
+  //
+  // REQUIRES: 0 <= level <= S2CellId::kMaxLevel
+  S2CellUnion GetCoveringAtLevel(int level) const;
+
   ////////////////////////////////////////////////////////////////////////
   // S2Region interface (see s2region.h for details):
 
@@ -120,6 +120,9 @@ TEST(S2ShapeIndexBufferedRegion, BufferedPointVsCap) {
 //
 // The "radius" parameter is an S1Angle for convenience.
 // TODO(ericv): Add Degrees, Radians, etc, methods to S1ChordAngle?
+void CheckBufferedCovering(const S2ShapeIndex& index, S1ChordAngle radius,
+                           const S2CellUnion& covering);
+
 void TestBufferIndex(const string& index_str, S1Angle radius_angle,
                      S2RegionCoverer* coverer) {
   auto index = MakeIndexOrDie(index_str);
@@ -135,6 +138,12 @@ void TestBufferIndex(const string& index_str, S1Angle radius_angle,
     }
     cout << "\n\n" << std::flush;
   }
+  CheckBufferedCovering(*index, radius, covering);
+}
+
+// Verifies that "covering" contains all points within "radius" of "index".
+void CheckBufferedCovering(const S2ShapeIndex& index, S1ChordAngle radius,
+                           const S2CellUnion& covering) {
   // Compute an S2Polygon representing the union of the cells in the covering.
   S2Polygon covering_polygon;
   covering_polygon.InitToCellUnionBorder(covering);
@@ -142,13 +151,13 @@ void TestBufferIndex(const string& index_str, S1Angle radius_angle,
   covering_index.Add(make_unique<S2Polygon::Shape>(&covering_polygon));
 
   // (a) Check that the covering contains the original index.
-  EXPECT_TRUE(S2BooleanOperation::Contains(covering_index, *index));
+  EXPECT_TRUE(S2BooleanOperation::Contains(covering_index, index));
 
   // (b) Check that the distance between the boundary of the covering and the
   // the original indexed geometry is at least "radius".
   S2ClosestEdgeQuery query(&covering_index);
   query.mutable_options()->set_include_interiors(false);
-  S2ClosestEdgeQuery::ShapeIndexTarget target(index.get());
+  S2ClosestEdgeQuery::ShapeIndexTarget target(&index);
   EXPECT_FALSE(query.IsDistanceLess(&target, radius));
 }
 
@@ -181,3 +190,55 @@ TEST(S2ShapeIndexBufferedRegion, HugeBufferRadius) {
   coverer.mutable_options()->set_max_cells(100);
   TestBufferIndex("10:20 # #", S1Angle::Degrees(200), &coverer);
 }
+
+// Checks that GetCoveringAtLevel() covers the buffered region, and that every
+// cell of the covering is within the buffer radius (to within a tiny error
+// due to the padding of index cells).
+void TestCoveringAtLevel(const string& index_str, S1Angle radius_angle,
+                         int level) {
+  auto index = MakeIndexOrDie(index_str);
+  S1ChordAngle radius(radius_angle);
+  S2ShapeIndexBufferedRegion region(index.get(), radius);
+  S2CellUnion covering = region.GetCoveringAtLevel(level);
+  CheckBufferedCovering(*index, radius, covering);
+  S2ShapeIndexBufferedRegion padded_region(
+      index.get(), radius_angle + S1Angle::Radians(1e-12));
+  for (S2CellId id : covering) {
+    EXPECT_LE(id.level(), level);
+    EXPECT_TRUE(padded_region.MayIntersect(S2Cell(id)));
+  }
+  // The covering should be at least as tight as S2RegionCoverer restricted
+  // to the same level, which tests every cell that it adds.
+  S2RegionCoverer coverer;
+  coverer.mutable_options()->set_fixed_level(level);
+  coverer.mutable_options()->set_max_cells(1 << 30);
+  S2CellUnion expected = coverer.GetCovering(region);
+  EXPECT_TRUE(covering.Difference(expected).empty());
+}
+
+TEST(S2ShapeIndexBufferedRegion, CoveringAtLevelPointSet) {
+  TestCoveringAtLevel("10:20 | 10:23 | 10:26 # #", S1Angle::Degrees(5), 6);
+}
+
+TEST(S2ShapeIndexBufferedRegion, CoveringAtLevelPolyline) {
+  TestCoveringAtLevel("# 10:5, 20:30, -10:60, -60:100 #",
+                      S1Angle::Degrees(2), 7);
+}
+
+TEST(S2ShapeIndexBufferedRegion, CoveringAtLevelPolygonWithHole) {
+  TestCoveringAtLevel("# # 10:10, 10:100, 70:0; 11:11, 69:0, 11:99",
+                      S1Angle::Degrees(2), 7);
+}
+
+TEST(S2ShapeIndexBufferedRegion, CoveringAtLevelZeroRadius) {
+  TestCoveringAtLevel("# # 10:10, 10:20, 20:15", S1Angle::Zero(), 10);
+}
+
+TEST(S2ShapeIndexBufferedRegion, CoveringAtLevelEdgeCases) {
+  auto empty = MakeIndexOrDie("# #");
+  EXPECT_TRUE(S2ShapeIndexBufferedRegion(empty.get(), S1Angle::Degrees(1))
+                  .GetCoveringAtLevel(5).empty());
+  auto point = MakeIndexOrDie("10:20 # #");
+  EXPECT_TRUE(S2ShapeIndexBufferedRegion(point.get(), S1Angle::Degrees(200))
+                  .GetCoveringAtLevel(5) == S2CellUnion::WholeSphere());
+}
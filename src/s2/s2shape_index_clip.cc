@@ -0,0 +1,376 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shape_index_clip.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "s2/r2.h"
+#include "s2/r2rect.h"
+#include "s2/s2cell.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2coords.h"
+#include "s2/s2edge_clipping.h"
+#include "s2/s2shape.h"
+
+using std::pair;
+using std::vector;
+
+namespace S2 {
+
+namespace {
+
+// An edge clipped to the cell.  "v0" is a new vertex on the cell boundary if
+// "enters" is true, and similarly for "v1" and "exits".
+struct ClippedEdge {
+  int edge_id;
+  S2Point v0, v1;
+  bool enters, exits;
+};
+
+// A chain of clipped edges.  Open pieces of polygons are joined together
+// along the cell boundary, which is parameterized by the distance "t" in the
+// range [0, 4) measured counterclockwise from cell vertex 0 (see below).
+struct Piece {
+  vector<S2Point> vertices;
+  double t_in, t_out;
+};
+
+class CellClipper {
+ public:
+  CellClipper(const S2ShapeIndex& index, S2CellId cell_id)
+      : index_(index), cell_id_(cell_id), cell_(cell_id),
+        face_(cell_id.face()), bound_(cell_id.GetBoundUV()) {
+    for (int k = 0; k < 4; ++k) vertices_[k] = cell_.GetVertex(k);
+  }
+
+  void Clip(vector<ClippedGeometry>* output);
+
+ private:
+  bool Contains(const S2Point& p, R2Point* uv) const;
+  R2Point ToUV(const S2Point& p) const;
+  double Perimeter(const R2Point& uv) const;
+  bool ClipEdge(const S2Shape::Edge& edge, ClippedEdge* result) const;
+  void ClipShape(int shape_id, const vector<int>& edge_ids,
+                 vector<ClippedGeometry>* output);
+  void BuildPieces(const S2Shape& shape, const vector<ClippedEdge>& edges,
+                   vector<Piece>* pieces) const;
+  void JoinPieces(const vector<Piece>& pieces,
+                  vector<vector<S2Point>>* loops) const;
+
+  const S2ShapeIndex& index_;
+  const S2CellId cell_id_;
+  const S2Cell cell_;
+  const int face_;
+  const R2Rect bound_;
+  S2Point vertices_[4];
+};
+
+// Returns true if "p" is inside the closed cell, and sets "uv" to its (u,v)
+// coordinates.
+bool CellClipper::Contains(const S2Point& p, R2Point* uv) const {
+  return S2::FaceXYZtoUV(face_, p, uv) && bound_.Contains(*uv);
+}
+
+// Returns the (u,v) coordinates of a point that is on or near the cell face.
+R2Point CellClipper::ToUV(const S2Point& p) const {
+  R2Point uv;
+  S2::ValidFaceXYZtoUV(face_, p, &uv);
+  return uv;
+}
+
+// Returns the position along the cell boundary of the boundary point closest
+// to "uv".  Cell vertex k (see S2Cell::GetVertex) is at position k, and the
+// position increases in counterclockwise order.
+double CellClipper::Perimeter(const R2Point& uv) const {
+  const R2Point& lo = bound_.lo();
+  const R2Point& hi = bound_.hi();
+  double du = bound_[0].GetLength(), dv = bound_[1].GetLength();
+  double d[4] = {std::fabs(uv[1] - lo[1]), std::fabs(uv[0] - hi[0]),
+                 std::fabs(uv[1] - hi[1]), std::fabs(uv[0] - lo[0])};
+  int side = std::min_element(d, d + 4) - d;
+  double t;
+  switch (side) {
+    case 0:  t = (uv[0] - lo[0]) / du; break;
+    case 1:  t = (uv[1] - lo[1]) / dv; break;
+    case 2:  t = (hi[0] - uv[0]) / du; break;
+    default: t = (hi[1] - uv[1]) / dv; break;
+  }
+  t = side + std::max(0.0, std::min(1.0, t));
+  return t >= 4 ? 0 : t;
+}
+
+// Clips "edge" to the cell.  Vertices inside the cell are kept exactly.
+// Returns false if the edge does not intersect the cell.
+bool CellClipper::ClipEdge(const S2Shape::Edge& edge,
+                           ClippedEdge* result) const {
+  R2Point a_uv, b_uv;
+  bool a_inside = Contains(edge.v0, &a_uv);
+  bool b_inside = Contains(edge.v1, &b_uv);
+  result->v0 = edge.v0;
+  result->v1 = edge.v1;
+  result->enters = !a_inside;
+  result->exits = !b_inside;
+  if (a_inside && b_inside) return true;
+
+  R2Point a_clip, b_clip;
+  if (!S2::ClipToFace(edge.v0, edge.v1, face_, &a_uv, &b_uv) ||
+      !S2::ClipEdge(a_uv, b_uv, bound_, &a_clip, &b_clip)) {
+    // Due to numerical errors this can happen when one endpoint is inside
+    // the cell, in which case the edge is degenerate within the cell.
+    if (a_inside) result->v1 = edge.v0;
+    if (b_inside) result->v0 = edge.v1;
+    return a_inside || b_inside;
+  }
+  if (!a_inside) result->v0 = S2::FaceUVtoXYZ(face_, a_clip).Normalize();
+  if (!b_inside) result->v1 = S2::FaceUVtoXYZ(face_, b_clip).Normalize();
+  // Discard edges that only touch the cell boundary.
+  return a_inside || b_inside || a_clip != b_clip;
+}
+
+// Joins consecutive clipped edges of the same chain into pieces.  Pieces of
+// polygon loops that are entirely inside the cell are closed, and are
+// appended with t_in == t_out == -1.
+void CellClipper::BuildPieces(const S2Shape& shape,
+                              const vector<ClippedEdge>& edges,
+                              vector<Piece>* pieces) const {
+  const bool is_polygon = shape.dimension() == 2;
+  auto find = [&edges](int edge_id) {
+    auto it = std::lower_bound(
+        edges.begin(), edges.end(), edge_id,
+        [](const ClippedEdge& e, int id) { return e.edge_id < id; });
+    if (it == edges.end() || it->edge_id != edge_id) return -1;
+    return static_cast<int>(it - edges.begin());
+  };
+  // Returns the index of the edge that follows (delta == 1) or precedes
+  // (delta == -1) the given edge in its chain, or -1 if there is none or it
+  // does not intersect the cell.
+  auto neighbor = [&](int i, int delta) {
+    S2Shape::ChainPosition pos = shape.chain_position(edges[i].edge_id);
+    S2Shape::Chain chain = shape.chain(pos.chain_id);
+    int offset = pos.offset + delta;
+    if (offset < 0 || offset >= chain.length) {
+      if (!is_polygon) return -1;
+      offset = (offset + chain.length) % chain.length;
+    }
+    return find(chain.start + offset);
+  };
+
+  vector<bool> used(edges.size(), false);
+  auto follow = [&](int start) {
+    Piece piece;
+    piece.vertices.push_back(edges[start].v0);
+    for (int i = start;;) {
+      used[i] = true;
+      piece.vertices.push_back(edges[i].v1);
+      if (edges[i].exits) break;
+      int next = neighbor(i, 1);
+      if (next < 0 || used[next] || edges[next].enters) break;
+      i = next;
+    }
+    return piece;
+  };
+  for (int i = 0; i < edges.size(); ++i) {
+    if (used[i]) continue;
+    if (!edges[i].enters) {
+      int prev = neighbor(i, -1);
+      if (prev >= 0 && !edges[prev].exits) continue;
+    }
+    pieces->push_back(follow(i));
+    Piece& piece = pieces->back();
+    piece.t_in = Perimeter(ToUV(piece.vertices.front()));
+    piece.t_out = Perimeter(ToUV(piece.vertices.back()));
+  }
+  // Any remaining edges belong to polygon loops inside the cell.
+  for (int i = 0; i < edges.size(); ++i) {
+    if (used[i]) continue;
+    pieces->push_back(follow(i));
+    Piece& piece = pieces->back();
+    piece.vertices.pop_back();  // The last vertex repeats the first.
+    piece.t_in = piece.t_out = -1;
+  }
+}
+
+// Joins the open polygon pieces into loops by walking counterclockwise along
+// the cell boundary from the end of each piece to the start of the next.
+void CellClipper::JoinPieces(const vector<Piece>& pieces,
+                             vector<vector<S2Point>>* loops) const {
+  vector<pair<double, int>> entries;
+  for (int i = 0; i < pieces.size(); ++i) {
+    if (pieces[i].t_in >= 0) entries.push_back({pieces[i].t_in, i});
+  }
+  std::sort(entries.begin(), entries.end());
+  vector<bool> used(pieces.size(), false);
+  for (const auto& entry : entries) {
+    int start = entry.second;
+    if (used[start]) continue;
+    vector<S2Point> loop;
+    for (int i = start;;) {
+      used[i] = true;
+      loop.insert(loop.end(), pieces[i].vertices.begin(),
+                  pieces[i].vertices.end());
+      double t_out = pieces[i].t_out;
+      auto it = std::lower_bound(entries.begin(), entries.end(),
+                                 pair<double, int>(t_out, -1));
+      if (it == entries.end()) it = entries.begin();
+      double t_in = it->first < t_out ? it->first + 4 : it->first;
+      for (int k = static_cast<int>(std::floor(t_out)) + 1; k < t_in; ++k) {
+        loop.push_back(vertices_[k & 3]);
+      }
+      i = it->second;
+      if (i == start || used[i]) break;
+    }
+    loops->push_back(std::move(loop));
+  }
+}
+
+void CellClipper::ClipShape(int shape_id, const vector<int>& edge_ids,
+                            vector<ClippedGeometry>* output) {
+  const S2Shape& shape = *index_.shape(shape_id);
+  ClippedGeometry result;
+  result.shape_id = shape_id;
+  result.dimension = shape.dimension();
+  if (result.dimension == 0) {
+    vector<S2Point> points;
+    for (int edge_id : edge_ids) {
+      S2Point p = shape.edge(edge_id).v0;
+      if (cell_id_.contains(S2CellId(p))) points.push_back(p);
+    }
+    if (!points.empty()) result.chains.push_back(std::move(points));
+  } else {
+    vector<ClippedEdge> edges;
+    ClippedEdge edge;
+    for (int edge_id : edge_ids) {
+      if (ClipEdge(shape.edge(edge_id), &edge)) {
+        edge.edge_id = edge_id;
+        edges.push_back(edge);
+      }
+    }
+    vector<Piece> pieces;
+    BuildPieces(shape, edges, &pieces);
+    if (result.dimension == 1) {
+      for (Piece& piece : pieces) {
+        result.chains.push_back(std::move(piece.vertices));
+      }
+    } else {
+      bool has_open_pieces = false;
+      for (Piece& piece : pieces) {
+        if (piece.t_in < 0) {
+          result.chains.push_back(std::move(piece.vertices));
+        } else {
+          has_open_pieces = true;
+        }
+      }
+      if (has_open_pieces) {
+        JoinPieces(pieces, &result.chains);
+      } else {
+        // No polygon edge crosses the cell boundary, so the boundary is
+        // either entirely inside or entirely outside the polygon.  We test
+        // the midpoint of a cell edge since polygon vertices are often
+        // located at cell vertices.
+        S2Point p = (vertices_[0] + vertices_[1]).Normalize();
+        S2ContainsPointQuery<S2ShapeIndex> query(&index_);
+        if (query.ShapeContains(shape, p)) {
+          result.chains.push_back(vector<S2Point>(vertices_, vertices_ + 4));
+        }
+      }
+    }
+  }
+  if (!result.chains.empty()) output->push_back(std::move(result));
+}
+
+void CellClipper::Clip(vector<ClippedGeometry>* output) {
+  // Collect the edges of each shape in the index cells that overlap the
+  // target cell, and the shapes that contain the center of such a cell.
+  S2ShapeIndex::Iterator it(&index_);
+  S2ShapeIndex::CellRelation relation = it.Locate(cell_id_);
+  if (relation == S2ShapeIndex::DISJOINT) return;
+  vector<pair<int, int>> shape_edges;  // (shape_id, edge_id)
+  for (; !it.done() && it.id().range_min() <= cell_id_.range_max();
+       it.Next()) {
+    const S2ShapeIndexCell& cell = it.cell();
+    for (int i = 0; i < cell.num_clipped(); ++i) {
+      const S2ClippedShape& clipped = cell.clipped(i);
+      if (clipped.num_edges() == 0) {
+        shape_edges.push_back({clipped.shape_id(), -1});
+      }
+      for (int j = 0; j < clipped.num_edges(); ++j) {
+        shape_edges.push_back({clipped.shape_id(), clipped.edge(j)});
+      }
+    }
+    if (relation == S2ShapeIndex::INDEXED) break;
+  }
+  std::sort(shape_edges.begin(), shape_edges.end());
+  shape_edges.erase(std::unique(shape_edges.begin(), shape_edges.end()),
+                    shape_edges.end());
+
+  vector<int> edge_ids;
+  for (int i = 0; i < shape_edges.size();) {
+    int shape_id = shape_edges[i].first;
+    edge_ids.clear();
+    for (; i < shape_edges.size() && shape_edges[i].first == shape_id; ++i) {
+      if (shape_edges[i].second >= 0) {
+        edge_ids.push_back(shape_edges[i].second);
+      }
+    }
+    ClipShape(shape_id, edge_ids, output);
+  }
+}
+
+}  // namespace
+
+void ClipToCell(const S2ShapeIndex& index, S2CellId cell_id,
+                vector<ClippedGeometry>* output) {
+  CellClipper(index, cell_id).Clip(output);
+}
+
+void ClipToCellsAtLevel(const S2ShapeIndex& index, int level,
+                        const ClipToCellsVisitor& visitor,
+                        int num_threads, S2Executor* executor) {
+  // Find the cells at the given level that intersect an index cell.
+  vector<S2CellId> cells;
+  for (S2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN); !it.done();
+       it.Next()) {
+    S2CellId id = it.id();
+    if (id.level() >= level) {
+      S2CellId parent = id.parent(level);
+      if (cells.empty() || cells.back() != parent) cells.push_back(parent);
+    } else {
+      for (S2CellId child = id.child_begin(level);
+           child != id.child_end(level); child = child.next()) {
+        cells.push_back(child);
+      }
+    }
+  }
+  if (cells.empty()) return;
+
+  num_threads = std::min<int>(
+      std::max(1, S2NumThreads(executor, num_threads)), cells.size());
+  S2ParallelFor(executor, num_threads, [&](int t) {
+    size_t begin = cells.size() * t / num_threads;
+    size_t end = cells.size() * (t + 1) / num_threads;
+    vector<ClippedGeometry> geometry;
+    for (size_t i = begin; i < end; ++i) {
+      geometry.clear();
+      ClipToCell(index, cells[i], &geometry);
+      visitor(cells[i], geometry);
+    }
+  });
+}
+
+}  // namespace S2
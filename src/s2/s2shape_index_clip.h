@@ -0,0 +1,85 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2SHAPE_INDEX_CLIP_H_
+#define S2_S2SHAPE_INDEX_CLIP_H_
+
+#include <functional>
+#include <vector>
+
+#include "s2/s2cell_id.h"
+#include "s2/s2executor.h"
+#include "s2/s2point.h"
+#include "s2/s2shape_index.h"
+
+namespace S2 {
+
+// The part of one shape of an S2ShapeIndex that lies within a cell.
+struct ClippedGeometry {
+  // The id of the shape in the index.
+  int shape_id;
+
+  // The dimension of the shape (see S2Shape::dimension).
+  int dimension;
+
+  // For points (dimension 0), a single chain containing the points within
+  // the cell.  For polylines (dimension 1), the pieces of the polylines
+  // within the cell.  For polygons (dimension 2), the loops of the clipped
+  // polygon, in the format expected by S2LaxPolygonShape (i.e., the interior
+  // is on the left and the first vertex is not repeated).
+  std::vector<std::vector<S2Point>> chains;
+};
+
+// Clips the contents of "index" to the given cell and appends the result to
+// "output", one entry per shape that intersects the cell in order of
+// increasing shape id.  This is much faster than intersecting the index
+// with a polygon for the cell using S2BooleanOperation, because only the
+// edges in the index cells that overlap "cell_id" are examined.
+//
+// Polygon boundaries that cross the cell are closed along the cell boundary,
+// and a polygon that contains the whole cell yields a loop consisting of the
+// four cell vertices.  Points are assigned to exactly one cell at each level
+// (the cell that contains their S2CellId), whereas polylines and polygons
+// include their parts that lie on the cell boundary.
+//
+// The clipping is done in the (u,v) coordinates of the cell face, so the new
+// vertices where edges cross the cell boundary are within about 1e-15
+// radians of the true intersection points.  Degeneracies (such as edges that
+// run exactly along the cell boundary) are not specially handled, so the
+// output is intended for rendering and similar uses rather than as input to
+// exact predicates.
+void ClipToCell(const S2ShapeIndex& index, S2CellId cell_id,
+                std::vector<ClippedGeometry>* output);
+
+// Called once for each cell by ClipToCellsAtLevel(), possibly concurrently
+// from several threads.
+using ClipToCellsVisitor = std::function<void(
+    S2CellId cell_id, const std::vector<ClippedGeometry>& geometry)>;
+
+// Calls ClipToCell() for every cell at the given level that intersects some
+// index cell and passes the result to "visitor".  The cells are divided
+// among up to "num_threads" threads (see S2ParallelFor for the meaning of
+// "executor"), and each thread visits its cells in increasing S2CellId order.
+//
+// Note that every cell at the given level that is contained by a polygon is
+// visited, which can be a large number of cells for polygons that are large
+// compared to the cells.
+void ClipToCellsAtLevel(const S2ShapeIndex& index, int level,
+                        const ClipToCellsVisitor& visitor,
+                        int num_threads = 1, S2Executor* executor = nullptr);
+
+}  // namespace S2
+
+#endif  // S2_S2SHAPE_INDEX_CLIP_H_
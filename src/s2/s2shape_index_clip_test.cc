@@ -0,0 +1,174 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shape_index_clip.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/synchronization/mutex.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2cell.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2executor.h"
+#include "s2/s2lax_polygon_shape.h"
+#include "s2/s2lax_polyline_shape.h"
+#include "s2/s2loop.h"
+#include "s2/s2polygon.h"
+#include "s2/s2polyline.h"
+#include "s2/s2shape_measures.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using std::vector;
+
+namespace S2 {
+namespace {
+
+double ClippedArea(const ClippedGeometry& geometry) {
+  return S2::GetArea(S2LaxPolygonShape(geometry.chains));
+}
+
+TEST(ClipToCell, EmptyIndex) {
+  MutableS2ShapeIndex index;
+  vector<ClippedGeometry> output;
+  ClipToCell(index, S2CellId::FromFace(0), &output);
+  EXPECT_TRUE(output.empty());
+}
+
+TEST(ClipToCell, PolygonContainsCell) {
+  auto index =
+      s2textformat::MakeIndexOrDie("# # -10:-10, -10:10, 10:10, 10:-10");
+  S2CellId id = S2CellId(s2textformat::MakePointOrDie("1:1")).parent(10);
+  vector<ClippedGeometry> output;
+  ClipToCell(*index, id, &output);
+  ASSERT_EQ(1, output.size());
+  EXPECT_EQ(0, output[0].shape_id);
+  EXPECT_EQ(2, output[0].dimension);
+  ASSERT_EQ(1, output[0].chains.size());
+  S2Cell cell(id);
+  ASSERT_EQ(4, output[0].chains[0].size());
+  for (int k = 0; k < 4; ++k) {
+    EXPECT_EQ(cell.GetVertex(k), output[0].chains[0][k]);
+  }
+
+  // A cell outside the polygon yields nothing.
+  output.clear();
+  ClipToCell(*index,
+             S2CellId(s2textformat::MakePointOrDie("20:20")).parent(10),
+             &output);
+  EXPECT_TRUE(output.empty());
+}
+
+TEST(ClipToCell, PointsAndPolylines) {
+  auto index = s2textformat::MakeIndexOrDie(
+      "0.1:0.1 | 5:5 # -1:0.2, 1:0.2 | 20:20, 21:21 #");
+  S2CellId id = S2CellId(s2textformat::MakePointOrDie("0:0")).parent(5);
+  ASSERT_TRUE(id.contains(S2CellId(s2textformat::MakePointOrDie("0.1:0.1"))));
+  vector<ClippedGeometry> output;
+  ClipToCell(*index, id, &output);
+
+  // Shape 0 contains the points, shape 1 the polylines.
+  ASSERT_EQ(2, output.size());
+  EXPECT_EQ(0, output[0].dimension);
+  ASSERT_EQ(1, output[0].chains.size());
+  EXPECT_EQ(vector<S2Point>{s2textformat::MakePointOrDie("0.1:0.1")},
+            output[0].chains[0]);
+
+  EXPECT_EQ(1, output[1].dimension);
+  ASSERT_EQ(1, output[1].chains.size());
+  const vector<S2Point>& piece = output[1].chains[0];
+  ASSERT_EQ(2, piece.size());
+  S2Cell cell(id);
+  S2Polyline input(vector<S2Point>{s2textformat::MakePointOrDie("-1:0.2"),
+                                   s2textformat::MakePointOrDie("1:0.2")});
+  int next_vertex;
+  for (const S2Point& p : piece) {
+    EXPECT_LT(cell.GetDistance(p).radians(), 1e-15);
+    EXPECT_LT(input.Project(p, &next_vertex).Angle(p), 1e-15);
+  }
+}
+
+TEST(ClipToCell, PolygonAreaMatchesIntersection) {
+  // Compares the area of clipped random polygons with the area of the
+  // intersection computed by S2Polygon.
+  for (int iter = 0; iter < 200; ++iter) {
+    S2Testing::rnd.Reset(iter + 1);
+    S2Point center = S2Testing::RandomPoint();
+    S1Angle radius = S1Angle::Radians(S2Testing::rnd.RandDouble() * 0.3);
+    int num_vertices = 3 + S2Testing::rnd.Uniform(50);
+    S2Polygon polygon(S2Loop::MakeRegularLoop(center, radius, num_vertices));
+    if (S2Testing::rnd.OneIn(2)) {
+      // Add a hole.
+      vector<std::unique_ptr<S2Loop>> loops;
+      loops.push_back(S2Loop::MakeRegularLoop(center, radius, num_vertices));
+      loops.push_back(S2Loop::MakeRegularLoop(center, 0.5 * radius, 7));
+      polygon.InitNested(std::move(loops));
+    }
+    MutableS2ShapeIndex index;
+    index.Add(make_unique<S2Polygon::Shape>(&polygon));
+
+    int level = S2Testing::rnd.Uniform(8);
+    S2CellId id = S2CellId(S2Testing::SamplePoint(S2Cap(center, radius)))
+                      .parent(level);
+    vector<ClippedGeometry> output;
+    ClipToCell(index, id, &output);
+
+    S2Polygon expected;
+    expected.InitToIntersection(polygon, S2Polygon(S2Cell(id)));
+    double actual_area = output.empty() ? 0 : ClippedArea(output[0]);
+    EXPECT_NEAR(expected.GetArea(), actual_area, 1e-12) << "iter " << iter;
+  }
+}
+
+TEST(ClipToCellsAtLevel, AreasSumToPolygonArea) {
+  S2Polygon polygon(S2Loop::MakeRegularLoop(
+      s2textformat::MakePointOrDie("10:20"), S1Angle::Degrees(15), 100));
+  MutableS2ShapeIndex index;
+  index.Add(make_unique<S2Polygon::Shape>(&polygon));
+
+  for (int num_threads : {1, 3}) {
+    absl::Mutex mutex;
+    double total_area = 0;
+    int num_cells = 0;
+    S2CellId last = S2CellId::None();
+    bool sorted = true;
+    ClipToCellsAtLevel(
+        index, 6,
+        [&](S2CellId id, const vector<ClippedGeometry>& geometry) {
+          absl::MutexLock lock(&mutex);
+          EXPECT_EQ(6, id.level());
+          ++num_cells;
+          if (num_threads == 1) {
+            sorted &= last < id;
+            last = id;
+          }
+          for (const ClippedGeometry& g : geometry) {
+            total_area += ClippedArea(g);
+          }
+        },
+        num_threads);
+    EXPECT_GT(num_cells, 100);
+    EXPECT_TRUE(sorted);
+    EXPECT_NEAR(polygon.GetArea(), total_area, 1e-11);
+  }
+}
+
+}  // namespace
+}  // namespace S2
@@ -0,0 +1,146 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shape_index_diff.h"
+
+#include <vector>
+
+#include "absl/base/casts.h"
+#include "s2/encoded_s2cell_id_vector.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/s2shape.h"
+
+using std::vector;
+
+// The current encoding version.  The hash function below is part of the
+// encoding, so it must not be changed without also changing this version.
+static const unsigned char kCurrentEncodingVersionNumber = 0;
+
+namespace {
+
+// A 64-bit hash whose output is stable across platforms and releases
+// (unlike HashMix or absl::Hash), so that hashes may be stored.
+class StableHash {
+ public:
+  void Mix(uint64 value) {
+    static const uint64 kMul = 0x9ddfea08eb382d69ULL;
+    hash_ = (hash_ ^ value) * kMul;
+    hash_ ^= hash_ >> 47;
+  }
+
+  void Mix(const S2Point& p) {
+    Mix(absl::bit_cast<uint64>(p.x()));
+    Mix(absl::bit_cast<uint64>(p.y()));
+    Mix(absl::bit_cast<uint64>(p.z()));
+  }
+
+  uint64 get() const { return hash_; }
+
+ private:
+  uint64 hash_ = 0xcbf29ce484222325ULL;
+};
+
+}  // namespace
+
+S2ShapeIndexCellHashes::S2ShapeIndexCellHashes(const S2ShapeIndex& index) {
+  Init(index);
+}
+
+void S2ShapeIndexCellHashes::Init(const S2ShapeIndex& index) {
+  cell_ids_.clear();
+  hashes_.clear();
+  for (S2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN); !it.done();
+       it.Next()) {
+    const S2ShapeIndexCell& cell = it.cell();
+    StableHash hash;
+    hash.Mix(cell.num_clipped());
+    for (int i = 0; i < cell.num_clipped(); ++i) {
+      const S2ClippedShape& clipped = cell.clipped(i);
+      const S2Shape* shape = index.shape(clipped.shape_id());
+      hash.Mix(clipped.shape_id());
+      hash.Mix(clipped.contains_center());
+      hash.Mix(clipped.num_edges());
+      for (int j = 0; j < clipped.num_edges(); ++j) {
+        S2Shape::Edge edge = shape->edge(clipped.edge(j));
+        hash.Mix(edge.v0);
+        hash.Mix(edge.v1);
+      }
+    }
+    cell_ids_.push_back(it.id());
+    hashes_.push_back(hash.get());
+  }
+}
+
+void S2ShapeIndexCellHashes::Encode(Encoder* encoder) const {
+  encoder->Ensure(1);
+  encoder->put8(kCurrentEncodingVersionNumber);
+  s2coding::EncodeS2CellIdVector(cell_ids_, encoder);
+  s2coding::EncodeUintVector<uint64>(hashes_, encoder);
+}
+
+bool S2ShapeIndexCellHashes::Decode(Decoder* decoder) {
+  if (decoder->avail() < 1) return false;
+  if (decoder->get8() != kCurrentEncodingVersionNumber) return false;
+  s2coding::EncodedS2CellIdVector cell_ids;
+  s2coding::EncodedUintVector<uint64> hashes;
+  if (!cell_ids.Init(decoder) || !hashes.Init(decoder)) return false;
+  if (cell_ids.size() != hashes.size()) return false;
+  cell_ids_ = cell_ids.Decode();
+  hashes_ = hashes.Decode();
+  return true;
+}
+
+namespace S2 {
+
+S2CellUnion GetChangedCells(const S2ShapeIndexCellHashes& a,
+                            const S2ShapeIndexCellHashes& b) {
+  // Both cell lists are sorted and consist of disjoint cells, so we can merge
+  // them in a single pass.  Two cells either are disjoint or one contains the
+  // other; in the latter case we report the larger cell and skip all the
+  // cells of the other index that it contains.
+  vector<S2CellId> changed;
+  int i = 0, j = 0;
+  while (i < a.num_cells() && j < b.num_cells()) {
+    S2CellId a_id = a.cell_id(i), b_id = b.cell_id(j);
+    if (a_id == b_id) {
+      if (a.hash(i) != b.hash(j)) changed.push_back(a_id);
+      ++i, ++j;
+    } else if (a_id.range_max() < b_id.range_min()) {
+      changed.push_back(a_id);
+      ++i;
+    } else if (b_id.range_max() < a_id.range_min()) {
+      changed.push_back(b_id);
+      ++j;
+    } else if (a_id.contains(b_id)) {
+      changed.push_back(a_id);
+      while (j < b.num_cells() && a_id.contains(b.cell_id(j))) ++j;
+      ++i;
+    } else {
+      changed.push_back(b_id);
+      while (i < a.num_cells() && b_id.contains(a.cell_id(i))) ++i;
+      ++j;
+    }
+  }
+  for (; i < a.num_cells(); ++i) changed.push_back(a.cell_id(i));
+  for (; j < b.num_cells(); ++j) changed.push_back(b.cell_id(j));
+  return S2CellUnion(std::move(changed));
+}
+
+S2CellUnion GetChangedCells(const S2ShapeIndex& a, const S2ShapeIndex& b) {
+  return GetChangedCells(S2ShapeIndexCellHashes(a),
+                         S2ShapeIndexCellHashes(b));
+}
+
+}  // namespace S2
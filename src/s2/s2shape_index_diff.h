@@ -0,0 +1,106 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2SHAPE_INDEX_DIFF_H_
+#define S2_S2SHAPE_INDEX_DIFF_H_
+
+#include <vector>
+
+#include "s2/base/integral_types.h"
+#include "s2/util/coding/coder.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2shape_index.h"
+
+// S2ShapeIndexCellHashes stores a 64-bit content hash for every cell of an
+// S2ShapeIndex.  Comparing the hashes of two versions of an index (see
+// S2::GetChangedCells below) yields the regions where their contents differ,
+// which can be used to invalidate only the affected tiles or coverings after
+// a dataset is re-ingested.
+//
+// The hashes are cheap to compute and can be encoded alongside an encoded
+// index, so that the previous version of a dataset does not need to be kept
+// around (or decoded) in order to find out what changed:
+//
+//   Encoder encoder;
+//   if (!s2shapeutil::CompactEncodeTaggedShapes(index, &encoder)) ...
+//   index.Encode(&encoder);
+//   S2ShapeIndexCellHashes(index).Encode(&encoder);
+//
+// The hash of a cell covers the ids of the shapes that intersect the cell,
+// whether each shape contains the cell center, and the exact coordinates of
+// every edge clipped to the cell.  It does not depend on the S2ShapeIndex
+// implementation, so for example a MutableS2ShapeIndex can be compared with
+// an EncodedS2ShapeIndex.  The hash function is part of the encoding and
+// will not change.
+class S2ShapeIndexCellHashes {
+ public:
+  // Constructs an empty object.
+  S2ShapeIndexCellHashes() = default;
+
+  // Convenience constructor that calls Init().
+  explicit S2ShapeIndexCellHashes(const S2ShapeIndex& index);
+
+  // Computes the hashes of all cells in the given index.
+  void Init(const S2ShapeIndex& index);
+
+  // Returns the number of index cells.
+  int num_cells() const { return static_cast<int>(cell_ids_.size()); }
+
+  // Returns the S2CellId and content hash of the given cell.  Cells are
+  // sorted in increasing S2CellId order.
+  S2CellId cell_id(int i) const { return cell_ids_[i]; }
+  uint64 hash(int i) const { return hashes_[i]; }
+
+  // Appends an encoded representation of the hashes to "encoder".
+  void Encode(Encoder* encoder) const;
+
+  // Decodes hashes that were encoded by Encode().  Returns false if the
+  // encoded data is invalid.
+  bool Decode(Decoder* decoder);
+
+ private:
+  std::vector<S2CellId> cell_ids_;
+  std::vector<uint64> hashes_;
+};
+
+namespace S2 {
+
+// Returns the region where the contents of two versions of an S2ShapeIndex
+// differ, expressed as a normalized S2CellUnion.  A cell is reported if it
+// appears in only one of the two indexes, or if it appears in both but its
+// content hash differs.  If the two indexes subdivide a region differently
+// (e.g., because the cell subdivision depends on nearby edges that changed),
+// the larger of the overlapping cells is reported.  Regions that are not
+// covered by any cell in either index (i.e., that are far from all edges and
+// not contained by any shape) are never reported.
+//
+// Changes are reported at the granularity of the index cells, so an index
+// with a small number of edges (which may consist of a single cell per face)
+// yields a coarse result.  MutableS2ShapeIndex::Options::max_edges_per_cell()
+// can be reduced to obtain finer results.
+//
+// Note that shapes are identified by their ids, so removing a shape from
+// the middle of an index changes the ids of all following shapes and
+// therefore all of the cells that they intersect.
+S2CellUnion GetChangedCells(const S2ShapeIndexCellHashes& a,
+                            const S2ShapeIndexCellHashes& b);
+
+// Convenience function that computes the cell hashes of both indexes.
+S2CellUnion GetChangedCells(const S2ShapeIndex& a, const S2ShapeIndex& b);
+
+}  // namespace S2
+
+#endif  // S2_S2SHAPE_INDEX_DIFF_H_
@@ -0,0 +1,132 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shape_index_diff.h"
+
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "s2/util/coding/coder.h"
+#include "s2/encoded_s2shape_index.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2error.h"
+#include "s2/s2latlng.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2text_format.h"
+
+using std::string;
+using std::unique_ptr;
+
+namespace {
+
+S2CellId CellAt(const string& latlng) {
+  return S2CellId(s2textformat::MakePointOrDie(latlng));
+}
+
+TEST(GetChangedCells, IdenticalIndexes) {
+  auto a = s2textformat::MakeIndexOrDie(
+      "1:1 # 0:0, 0:10 # 20:20, 20:30, 30:30");
+  auto b = s2textformat::MakeIndexOrDie(
+      "1:1 # 0:0, 0:10 # 20:20, 20:30, 30:30");
+  EXPECT_TRUE(S2::GetChangedCells(*a, *b).empty());
+}
+
+TEST(GetChangedCells, EmptyIndexes) {
+  MutableS2ShapeIndex a;
+  auto b = s2textformat::MakeIndexOrDie("# 0:0, 0:10 #");
+  EXPECT_TRUE(S2::GetChangedCells(a, a).empty());
+  S2CellUnion changed = S2::GetChangedCells(a, *b);
+  EXPECT_TRUE(changed.Contains(CellAt("0:0")));
+  EXPECT_TRUE(changed.Contains(CellAt("0:10")));
+  EXPECT_EQ(changed, S2::GetChangedCells(*b, a));
+}
+
+// Returns an index whose cells are subdivided as finely as possible, so that
+// changes are reported at a fine granularity.
+unique_ptr<MutableS2ShapeIndex> MakeFineIndex(const string& str) {
+  MutableS2ShapeIndex::Options options;
+  options.set_max_edges_per_cell(1);
+  auto index = absl::make_unique<MutableS2ShapeIndex>(options);
+  S2Error error;
+  EXPECT_TRUE(s2textformat::MakeIndex(str, index.get(), &error)) << error;
+  return index;
+}
+
+TEST(GetChangedCells, MovedVertex) {
+  // Only the region around the polyline whose vertex moved is reported.
+  auto a = MakeFineIndex(
+      "# 0:0, 0:1, 0:2 | 40:40, 40:41 # -20:-20, -20:-19, -19:-19");
+  auto b = MakeFineIndex(
+      "# 0:0, 0.5:1, 0:2 | 40:40, 40:41 # -20:-20, -20:-19, -19:-19");
+  S2CellUnion changed = S2::GetChangedCells(*a, *b);
+  EXPECT_FALSE(changed.empty());
+  EXPECT_TRUE(changed.Contains(CellAt("0:1")));
+  EXPECT_TRUE(changed.Contains(CellAt("0.5:1")));
+  EXPECT_FALSE(changed.Contains(CellAt("40:40.5")));
+  EXPECT_FALSE(changed.Contains(CellAt("-19.5:-19.5")));
+}
+
+TEST(GetChangedCells, AddedPolygon) {
+  // The interior of an added polygon is reported even far from its edges.
+  auto a = MakeFineIndex("# 40:40, 40:41 #");
+  auto b = MakeFineIndex("# 40:40, 40:41 # -30:-30, -30:30, 30:30, 30:-30");
+  S2CellUnion changed = S2::GetChangedCells(*a, *b);
+  EXPECT_TRUE(changed.Contains(CellAt("0:0")));
+  EXPECT_TRUE(changed.Contains(CellAt("-30:0")));
+  EXPECT_FALSE(changed.Contains(CellAt("40:40.5")));
+  EXPECT_FALSE(changed.Contains(CellAt("-50:0")));
+}
+
+TEST(S2ShapeIndexCellHashes, EncodedIndexMatchesMutableIndex) {
+  auto index = s2textformat::MakeIndexOrDie(
+      "1:1 | 2:2 # 0:0, 0:10 # 20:20, 20:30, 30:30");
+  Encoder encoder;
+  ASSERT_TRUE(s2shapeutil::CompactEncodeTaggedShapes(*index, &encoder));
+  index->Encode(&encoder);
+  S2ShapeIndexCellHashes(*index).Encode(&encoder);
+
+  Decoder decoder(encoder.base(), encoder.length());
+  EncodedS2ShapeIndex encoded;
+  ASSERT_TRUE(encoded.Init(&decoder,
+                           s2shapeutil::LazyDecodeShapeFactory(&decoder)));
+  S2ShapeIndexCellHashes decoded;
+  ASSERT_TRUE(decoded.Decode(&decoder));
+  EXPECT_EQ(0, decoder.avail());
+
+  S2ShapeIndexCellHashes expected(*index);
+  ASSERT_EQ(expected.num_cells(), decoded.num_cells());
+  for (int i = 0; i < expected.num_cells(); ++i) {
+    EXPECT_EQ(expected.cell_id(i), decoded.cell_id(i));
+    EXPECT_EQ(expected.hash(i), decoded.hash(i));
+  }
+  EXPECT_TRUE(S2::GetChangedCells(encoded, *index).empty());
+  EXPECT_TRUE(S2::GetChangedCells(decoded,
+                                  S2ShapeIndexCellHashes(encoded)).empty());
+}
+
+TEST(S2ShapeIndexCellHashes, DecodeInvalid) {
+  S2ShapeIndexCellHashes hashes;
+  Decoder empty(nullptr, 0);
+  EXPECT_FALSE(hashes.Decode(&empty));
+  const char kBadVersion[] = {5, 0, 0};
+  Decoder decoder(kBadVersion, sizeof(kBadVersion));
+  EXPECT_FALSE(hashes.Decode(&decoder));
+}
+
+}  // namespace
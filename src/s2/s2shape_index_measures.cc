@@ -18,11 +18,48 @@
 #include "s2/s2shape_index_measures.h"
 
 #include <algorithm>
+#include <atomic>
+#include <vector>
 
+#include "s2/base/logging.h"
+#include "s2/s2executor.h"
 #include "s2/s2shape_measures.h"
 
+using std::vector;
+
 namespace S2 {
 
+namespace {
+
+// Returns the sum of measure(shape) over all shapes of the index, where the
+// measures are computed using up to "num_threads" threads but summed in
+// shape id order so that the result is independent of "num_threads".
+// Missing shapes are skipped.
+template <class T, class Measure>
+T SumShapeMeasures(const S2ShapeIndex& index, int num_threads,
+                   S2Executor* executor, const Measure& measure) {
+  S2_DCHECK_GE(num_threads, 1);
+  const int num_shape_ids = index.num_shape_ids();
+  vector<T> values(num_shape_ids);
+  std::atomic<int> next_shape_id(0);
+  auto measure_shapes = [&]() {
+    for (int i; (i = next_shape_id.fetch_add(1)) < num_shape_ids; ) {
+      const S2Shape* shape = index.shape(i);
+      if (shape) values[i] = measure(*shape);
+    }
+  };
+  S2ParallelFor(executor,
+                std::max(1, std::min(S2NumThreads(executor, num_threads),
+                                     num_shape_ids)),
+                [&](int) { measure_shapes(); });
+
+  T sum = T();
+  for (const T& value : values) sum += value;
+  return sum;
+}
+
+}  // namespace
+
 int GetDimension(const S2ShapeIndex& index) {
   int dim = -1;
   for (int i = 0; i < index.num_shape_ids(); ++i) {
@@ -91,4 +128,41 @@ S2Point GetCentroid(const S2ShapeIndex& index) {
   return centroid;
 }
 
+S1Angle GetLength(const S2ShapeIndex& index, int num_threads,
+                  S2Executor* executor) {
+  return SumShapeMeasures<S1Angle>(
+      index, num_threads, executor,
+      [](const S2Shape& shape) { return S2::GetLength(shape); });
+}
+
+S1Angle GetPerimeter(const S2ShapeIndex& index, int num_threads,
+                     S2Executor* executor) {
+  return SumShapeMeasures<S1Angle>(
+      index, num_threads, executor,
+      [](const S2Shape& shape) { return S2::GetPerimeter(shape); });
+}
+
+double GetArea(const S2ShapeIndex& index, int num_threads,
+               S2Executor* executor) {
+  return SumShapeMeasures<double>(
+      index, num_threads, executor,
+      [](const S2Shape& shape) { return S2::GetArea(shape); });
+}
+
+double GetApproxArea(const S2ShapeIndex& index, int num_threads,
+                     S2Executor* executor) {
+  return SumShapeMeasures<double>(
+      index, num_threads, executor,
+      [](const S2Shape& shape) { return S2::GetApproxArea(shape); });
+}
+
+S2Point GetCentroid(const S2ShapeIndex& index, int num_threads,
+                    S2Executor* executor) {
+  const int dim = GetDimension(index);
+  return SumShapeMeasures<S2Point>(
+      index, num_threads, executor, [dim](const S2Shape& shape) {
+        return (shape.dimension() == dim) ? S2::GetCentroid(shape) : S2Point();
+      });
+}
+
 }  // namespace S2
@@ -23,6 +23,7 @@
 #define S2_S2SHAPE_INDEX_MEASURES_H_
 
 #include "s2/s1angle.h"
+#include "s2/s2executor.h"
 #include "s2/s2point.h"
 #include "s2/s2shape_index.h"
 
@@ -95,6 +96,27 @@ double GetApproxArea(const S2ShapeIndex& index);
 // centroids can simply be summed).
 S2Point GetCentroid(const S2ShapeIndex& index);
 
+// As above, but use up to "num_threads" threads to measure the shapes of the
+// index concurrently, which is useful for indexes with many shapes.  The
+// results are identical to those of the corresponding single-threaded
+// methods (the measures of the individual shapes are summed in shape id
+// order), and therefore do not depend on "num_threads".  Note that each
+// shape is measured by a single thread, so an index consisting of one large
+// polygon does not benefit.  See S2ParallelFor for the meaning of
+// "executor".
+//
+// REQUIRES: num_threads >= 1
+S1Angle GetLength(const S2ShapeIndex& index, int num_threads,
+                  S2Executor* executor = nullptr);
+S1Angle GetPerimeter(const S2ShapeIndex& index, int num_threads,
+                     S2Executor* executor = nullptr);
+double GetArea(const S2ShapeIndex& index, int num_threads,
+               S2Executor* executor = nullptr);
+double GetApproxArea(const S2ShapeIndex& index, int num_threads,
+                     S2Executor* executor = nullptr);
+S2Point GetCentroid(const S2ShapeIndex& index, int num_threads,
+                    S2Executor* executor = nullptr);
+
 }  // namespace S2
 
 #endif  // S2_S2SHAPE_INDEX_MEASURES_H_
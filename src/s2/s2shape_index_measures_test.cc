@@ -22,10 +22,13 @@
 #include "s2/s2shape_index_measures.h"
 
 #include <memory>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
 #include "s2/mutable_s2shape_index.h"
+#include "s2/s2executor.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
 #include "s2/s2point_vector_shape.h"
@@ -135,4 +138,32 @@ TEST(GetCentroid, Polygon) {
       S2::GetCentroid(*MakeIndexOrDie("5:5 # 6:6, 7:7 # 0:0, 0:90, 90:0"))));
 }
 
+TEST(ShapeIndexMeasures, MultiThreadedMatchesSingleThreaded) {
+  // Mixes many shapes of all dimensions, including a missing shape.
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 100; ++i) {
+    double lat = i % 80, lng = i * 3.5 - 170;
+    index.Add(s2textformat::MakeLaxPolygonOrDie(absl::StrFormat(
+        "%f:%f, %f:%f, %f:%f", lat, lng, lat, lng + 1, lat + 1, lng)));
+    index.Add(s2textformat::MakeLaxPolylineOrDie(absl::StrFormat(
+        "%f:%f, %f:%f", lat, lng, lat + 2, lng + 2)));
+  }
+  index.Add(make_unique<S2PointVectorShape>(
+      std::vector<S2Point>{S2Point(1, 0, 0)}));
+  index.Release(7);
+  for (int num_threads : {1, 2, 3, 8}) {
+    EXPECT_EQ(S2::GetLength(index), S2::GetLength(index, num_threads));
+    EXPECT_EQ(S2::GetPerimeter(index), S2::GetPerimeter(index, num_threads));
+    EXPECT_EQ(S2::GetArea(index), S2::GetArea(index, num_threads));
+    EXPECT_EQ(S2::GetApproxArea(index),
+              S2::GetApproxArea(index, num_threads));
+    EXPECT_EQ(S2::GetCentroid(index), S2::GetCentroid(index, num_threads));
+  }
+  S2ThreadPool pool(4);
+  EXPECT_EQ(S2::GetArea(index), S2::GetArea(index, 1, &pool));
+  EXPECT_EQ(S2::GetCentroid(index), S2::GetCentroid(index, 1, &pool));
+  MutableS2ShapeIndex empty;
+  EXPECT_EQ(0, S2::GetArea(empty, 4));
+}
+
 }  // namespace
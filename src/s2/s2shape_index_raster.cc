@@ -0,0 +1,129 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shape_index_raster.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/container/inlined_vector.h"
+#include "s2/s2cell_union.h"
+
+using std::vector;
+
+constexpr S2CellIndex::Label S2ShapeIndexRaster::kBoundaryLabel;
+
+S2ShapeIndexRaster::S2ShapeIndexRaster() {
+}
+
+S2ShapeIndexRaster::S2ShapeIndexRaster(const S2ShapeIndex* index,
+                                       const Options& options) {
+  Init(index, options);
+}
+
+void S2ShapeIndexRaster::Init(const S2ShapeIndex* index,
+                              const Options& options) {
+  index_ = index;
+  query_.Init(index, options);
+  cell_index_.Clear();
+
+  // Points and polylines only contain their vertices, and only in the CLOSED
+  // model.
+  bool closed = options.vertex_model() == S2VertexModel::CLOSED;
+  vector<vector<S2CellId>> interior_cells(index->num_shape_ids());
+  vector<S2CellId> boundary_cells;
+  for (S2ShapeIndex::Iterator it(index, S2ShapeIndex::BEGIN); !it.done();
+       it.Next()) {
+    const S2ShapeIndexCell& cell = it.cell();
+    bool is_boundary = false;
+    for (int s = 0; s < cell.num_clipped(); ++s) {
+      const S2ClippedShape& clipped = cell.clipped(s);
+      if (clipped.num_edges() == 0) {
+        if (clipped.contains_center()) {
+          interior_cells[clipped.shape_id()].push_back(it.id());
+        }
+      } else if (closed || index->shape(clipped.shape_id())->dimension() == 2) {
+        is_boundary = true;
+      }
+    }
+    if (is_boundary) boundary_cells.push_back(it.id());
+  }
+  // Normalizing each set of cells replaces groups of four siblings by their
+  // parent, which makes the raster smaller.
+  for (int i = 0; i < interior_cells.size(); ++i) {
+    if (interior_cells[i].empty()) continue;
+    cell_index_.Add(S2CellUnion(std::move(interior_cells[i])), i);
+  }
+  cell_index_.Add(S2CellUnion(std::move(boundary_cells)), kBoundaryLabel);
+  cell_index_.Build();
+}
+
+template <class Visitor>
+bool S2ShapeIndexRaster::VisitLabels(const S2Point& p,
+                                     const Visitor& visitor) const {
+  S2CellIndex::RangeIterator range(&cell_index_);
+  range.Seek(S2CellId(p));
+  if (range.is_empty()) return true;
+  S2CellIndex::ContentsIterator contents(&cell_index_);
+  for (contents.StartUnion(range); !contents.done(); contents.Next()) {
+    if (!visitor(contents.label())) return false;
+  }
+  return true;
+}
+
+S2ShapeIndexRaster::Classification S2ShapeIndexRaster::Classify(
+    const S2Point& p) const {
+  Classification result = Classification::OUTSIDE;
+  VisitLabels(p, [&result](S2CellIndex::Label label) {
+      if (label != kBoundaryLabel) {
+        result = Classification::INSIDE;
+        return false;
+      }
+      result = Classification::UNKNOWN;
+      return true;
+    });
+  return result;
+}
+
+bool S2ShapeIndexRaster::Contains(const S2Point& p) {
+  switch (Classify(p)) {
+    case Classification::OUTSIDE: return false;
+    case Classification::INSIDE: return true;
+    default: return query_.Contains(p);
+  }
+}
+
+bool S2ShapeIndexRaster::VisitContainingShapes(const S2Point& p,
+                                               const ShapeVisitor& visitor) {
+  absl::InlinedVector<S2CellIndex::Label, 8> shape_ids;
+  bool is_boundary = false;
+  VisitLabels(p, [&](S2CellIndex::Label label) {
+      if (label == kBoundaryLabel) {
+        is_boundary = true;
+        return false;
+      }
+      shape_ids.push_back(label);
+      return true;
+    });
+  if (is_boundary) return query_.VisitContainingShapes(p, visitor);
+
+  // Visit the shapes in the same order as S2ContainsPointQuery.
+  std::sort(shape_ids.begin(), shape_ids.end());
+  for (int shape_id : shape_ids) {
+    if (!visitor(index_->shape(shape_id))) return false;
+  }
+  return true;
+}
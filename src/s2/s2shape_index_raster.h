@@ -0,0 +1,117 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2SHAPE_INDEX_RASTER_H_
+#define S2_S2SHAPE_INDEX_RASTER_H_
+
+#include <functional>
+#include <limits>
+
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_index.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2point.h"
+#include "s2/s2shape.h"
+#include "s2/s2shape_index.h"
+
+// S2ShapeIndexRaster speeds up point containment tests against an
+// S2ShapeIndex that is no longer modified (e.g., a set of geofences).  It
+// precomputes which index cells are entirely inside each shape (i.e., the
+// shape has no edges in the cell but contains its center), and which cells
+// contain edges that might affect containment.  The interior cells of each
+// shape are normalized (so that groups of four sibling cells are replaced by
+// their parent) and stored in an S2CellIndex.  A point can then usually be
+// classified from its S2CellId alone: if it is not in any cell with edges,
+// then the shapes that contain it are exactly those whose interior cells
+// contain it, and no edge tests are needed.  Otherwise the point is tested
+// using S2ContainsPointQuery.  Example usage:
+//
+//   S2ShapeIndexRaster raster(&index);
+//   for (const S2Point& point : points) {
+//     if (raster.Contains(point)) ...
+//   }
+//
+// The results are identical to S2ContainsPointQuery with the same options.
+// The index must not be modified after the raster has been built (call
+// Init() again if it is).
+//
+// This class is not thread-safe, except that Classify() may be called
+// concurrently.  To use the other methods in parallel, each thread should
+// construct its own instance.
+class S2ShapeIndexRaster {
+ public:
+  using Options = S2ContainsPointQueryOptions;
+
+  // Default constructor; requires Init() to be called.
+  S2ShapeIndexRaster();
+
+  // Convenience constructor that calls Init().
+  explicit S2ShapeIndexRaster(const S2ShapeIndex* index,
+                              const Options& options = Options());
+
+  S2ShapeIndexRaster(const S2ShapeIndexRaster&) = delete;
+  void operator=(const S2ShapeIndexRaster&) = delete;
+
+  // Builds the raster for the given index.  This visits every index cell
+  // once.  Note that the options affect which cells need edge tests: unless
+  // the vertex model is CLOSED, points and polylines never contain any point
+  // and so their edges are ignored.
+  void Init(const S2ShapeIndex* index, const Options& options = Options());
+
+  const S2ShapeIndex& index() const { return *index_; }
+  const Options& options() const { return query_.options(); }
+
+  // The result of Classify().
+  enum class Classification {
+    OUTSIDE,  // No shape contains the point.
+    INSIDE,   // Some shape contains the point.
+    UNKNOWN   // Edges near the point must be tested.
+  };
+
+  // Classifies "p" using only the precomputed cell labels.  This method is
+  // thread-safe.
+  Classification Classify(const S2Point& p) const;
+
+  // Returns true if any shape in the index contains "p".  Equivalent to
+  // S2ContainsPointQuery::Contains(p).
+  bool Contains(const S2Point& p);
+
+  // Visits all shapes in the index that contain "p", terminating early if
+  // the given visitor returns false (in which case this method returns false
+  // as well).  Each shape is visited at most once.  Equivalent to
+  // S2ContainsPointQuery::VisitContainingShapes(p).
+  using ShapeVisitor = std::function<bool (S2Shape* shape)>;
+  bool VisitContainingShapes(const S2Point& p, const ShapeVisitor& visitor);
+
+  // Returns the number of cells stored in the raster.
+  int num_cells() const { return cell_index_.num_cells(); }
+
+ private:
+  // The label of cells where edges must be tested.  (Other labels are shape
+  // ids.)
+  static constexpr S2CellIndex::Label kBoundaryLabel =
+      std::numeric_limits<S2CellIndex::Label>::max();
+
+  // Visits the labels of the cells that contain "p" until "visitor" returns
+  // false, and returns false in that case.
+  template <class Visitor>
+  bool VisitLabels(const S2Point& p, const Visitor& visitor) const;
+
+  const S2ShapeIndex* index_ = nullptr;
+  S2CellIndex cell_index_;
+  S2ContainsPointQuery<S2ShapeIndex> query_;
+};
+
+#endif  // S2_S2SHAPE_INDEX_RASTER_H_
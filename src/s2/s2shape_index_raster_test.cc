@@ -0,0 +1,126 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shape_index_raster.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "absl/memory/memory.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2loop.h"
+#include "s2/s2point_vector_shape.h"
+#include "s2/s2polyline.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using s2textformat::MakeIndexOrDie;
+using s2textformat::MakePointOrDie;
+using std::vector;
+
+namespace {
+
+using Classification = S2ShapeIndexRaster::Classification;
+
+vector<S2Shape*> GetContainingShapes(S2ShapeIndexRaster* raster,
+                                     const S2Point& p) {
+  vector<S2Shape*> shapes;
+  raster->VisitContainingShapes(p, [&shapes](S2Shape* shape) {
+      shapes.push_back(shape);
+      return true;
+    });
+  return shapes;
+}
+
+// Checks that the raster gives the same results as S2ContainsPointQuery for
+// the given points, and returns the number of points that were classified
+// without testing edges.
+int TestRaster(const S2ShapeIndex& index, const vector<S2Point>& points,
+               S2VertexModel vertex_model) {
+  S2ContainsPointQueryOptions options(vertex_model);
+  S2ShapeIndexRaster raster(&index, options);
+  auto query = MakeS2ContainsPointQuery(&index, options);
+  int num_classified = 0;
+  for (const S2Point& p : points) {
+    bool contains = query.Contains(p);
+    EXPECT_EQ(contains, raster.Contains(p));
+    EXPECT_EQ(query.GetContainingShapes(p), GetContainingShapes(&raster, p));
+    Classification classification = raster.Classify(p);
+    if (classification != Classification::UNKNOWN) {
+      EXPECT_EQ(contains, classification == Classification::INSIDE);
+      ++num_classified;
+    }
+  }
+  return num_classified;
+}
+
+TEST(S2ShapeIndexRaster, EmptyIndex) {
+  MutableS2ShapeIndex index;
+  S2ShapeIndexRaster raster(&index);
+  S2Point p = MakePointOrDie("1:1");
+  EXPECT_EQ(Classification::OUTSIDE, raster.Classify(p));
+  EXPECT_FALSE(raster.Contains(p));
+  EXPECT_EQ(0, raster.num_cells());
+}
+
+TEST(S2ShapeIndexRaster, FullPolygon) {
+  auto index = MakeIndexOrDie("# # full");
+  S2ShapeIndexRaster raster(index.get());
+  EXPECT_EQ(Classification::INSIDE, raster.Classify(MakePointOrDie("1:1")));
+  EXPECT_TRUE(raster.Contains(MakePointOrDie("-50:120")));
+}
+
+TEST(S2ShapeIndexRaster, MatchesContainsPointQuery) {
+  S2Testing::rnd.Reset(1);
+  const S1Angle kMaxLoopRadius = S2Testing::KmToAngle(10);
+  const S2Cap center_cap(S2Testing::RandomPoint(), kMaxLoopRadius);
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 50; ++i) {
+    index.Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+        S2Testing::SamplePoint(center_cap),
+        S2Testing::rnd.RandDouble() * kMaxLoopRadius, 20)));
+  }
+  vector<S2Point> vertices;
+  for (int i = 0; i < 10; ++i) {
+    vertices.push_back(S2Testing::SamplePoint(center_cap));
+  }
+  index.Add(make_unique<S2Polyline::OwningShape>(
+      make_unique<S2Polyline>(vertices)));
+  index.Add(make_unique<S2PointVectorShape>(vertices));
+
+  // Include points outside the loops and vertices of every shape.
+  const S2Cap query_cap(center_cap.center(), 3 * kMaxLoopRadius);
+  vector<S2Point> points;
+  for (int i = 0; i < 2000; ++i) {
+    points.push_back(S2Testing::SamplePoint(query_cap));
+  }
+  for (const S2Shape* shape : index) {
+    points.push_back(shape->edge(0).v0);
+  }
+  for (S2VertexModel vertex_model : {S2VertexModel::OPEN,
+                                     S2VertexModel::SEMI_OPEN,
+                                     S2VertexModel::CLOSED}) {
+    // Most points should not need any edge tests.
+    EXPECT_GT(TestRaster(index, points, vertex_model), points.size() / 2);
+  }
+}
+
+}  // namespace
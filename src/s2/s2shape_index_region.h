@@ -20,6 +20,8 @@
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+#include "s2/base/logging.h"
 #include "s2/s2cap.h"
 #include "s2/s2cell.h"
 #include "s2/s2cell_id.h"
@@ -29,6 +31,7 @@
 #include "s2/s2edge_crosser.h"
 #include "s2/s2latlng_rect.h"
 #include "s2/s2region.h"
+#include "s2/s2region_coverer.h"
 #include "s2/s2shape_index.h"
 
 // This class wraps an S2ShapeIndex object with the additional methods needed
@@ -104,6 +107,15 @@ class S2ShapeIndexRegion final : public S2Region {
   // error is less than 10 * DBL_EPSILON radians (or about 15 nanometers).
   bool MayIntersect(const S2Cell& target) const override;
 
+  // Batch versions of Contains(S2Cell) and MayIntersect(S2Cell).  When
+  // consecutive cells are contained by the same index cell (e.g., the
+  // children of a cell being subdivided by S2RegionCoverer), the index is
+  // only searched once for all of them.
+  void ContainsBatch(absl::Span<const S2Cell> cells,
+                     absl::Span<bool> result) const override;
+  void MayIntersectBatch(absl::Span<const S2Cell> cells,
+                         absl::Span<bool> result) const override;
+
   // A function that is called with shapes that intersect a target S2Cell.
   // "contains_target" means that the shape fully contains the target S2Cell.
   // The function should return true to continue visiting intersecting shapes,
@@ -125,6 +137,22 @@ class S2ShapeIndexRegion final : public S2Region {
   bool VisitIntersectingShapes(const S2Cell& target,
                                const ShapeVisitor& visitor);
 
+  // Returns a covering (GetCovering) or interior covering
+  // (GetInteriorCovering) of the indexed geometry that satisfies the given
+  // options.  When the index has no more cells than options.max_cells(),
+  // this is equivalent to S2RegionCoverer(options).GetCovering(*this).
+  // Otherwise the covering is computed from the index cells themselves:
+  // every index cell (or, for interior coverings, every index cell that is
+  // entirely contained by some polygon) is used as a starting covering and
+  // then coarsened to satisfy the options.  This avoids testing each
+  // candidate cell against the indexed edges, which makes it much faster for
+  // large indexes.  The result is a valid (interior) covering, but since it
+  // is never finer than the index cells it may be slightly looser than the
+  // one produced by S2RegionCoverer.
+  S2CellUnion GetCovering(const S2RegionCoverer::Options& options) const;
+  S2CellUnion GetInteriorCovering(
+      const S2RegionCoverer::Options& options) const;
+
   // Returns true if the given point is contained by any two-dimensional shape
   // (i.e., polygon).  Boundaries are treated as being semi-open (i.e., the
   // same rules as S2Polygon).  Zero and one-dimensional shapes are ignored by
@@ -137,6 +165,24 @@ class S2ShapeIndexRegion final : public S2Region {
   static void CoverRange(S2CellId first, S2CellId last,
                          std::vector<S2CellId> *cell_ids);
 
+  S2CellUnion GetCoveringInternal(const S2RegionCoverer::Options& options,
+                                  bool interior) const;
+
+  // Positions iter_ at the index cell containing "target" if possible, and
+  // returns the relationship between "target" and the index.  "indexed"
+  // should be true if iter_ was left at an index cell by a previous call,
+  // in which case the index is not searched again if that cell contains
+  // "target".  It is updated to reflect the new state of iter_.
+  S2ShapeIndex::CellRelation LocateNext(const S2Cell& target,
+                                        bool* indexed) const;
+
+  // Implementations of Contains(S2Cell) and MayIntersect(S2Cell) given the
+  // relationship between "target" and the index (see LocateNext).
+  bool ContainsLocated(const S2Cell& target,
+                       S2ShapeIndex::CellRelation relation) const;
+  bool MayIntersectLocated(const S2Cell& target,
+                           S2ShapeIndex::CellRelation relation) const;
+
   // Returns true if the indexed shape "clipped" in the indexed cell "id"
   // contains the point "p".
   //
@@ -279,10 +325,95 @@ inline bool S2ShapeIndexRegion<IndexType>::Contains(
   return contains_query_.ShapeContains(iter_.id(), clipped, p);
 }
 
+template <class IndexType>
+S2CellUnion S2ShapeIndexRegion<IndexType>::GetCovering(
+    const S2RegionCoverer::Options& options) const {
+  return GetCoveringInternal(options, false /*interior*/);
+}
+
+template <class IndexType>
+S2CellUnion S2ShapeIndexRegion<IndexType>::GetInteriorCovering(
+    const S2RegionCoverer::Options& options) const {
+  return GetCoveringInternal(options, true /*interior*/);
+}
+
+template <class IndexType>
+S2CellUnion S2ShapeIndexRegion<IndexType>::GetCoveringInternal(
+    const S2RegionCoverer::Options& options, bool interior) const {
+  // Every index cell intersects the indexed geometry, since index cells are
+  // created only if they have at least one edge or are entirely contained by
+  // a polygon.  An index cell is contained by a polygon if the polygon has no
+  // edges in the cell and contains its center.
+  std::vector<S2CellId> cell_ids;
+  for (iter_.Begin(); !iter_.done(); iter_.Next()) {
+    if (interior) {
+      const S2ShapeIndexCell& cell = iter_.cell();
+      bool contained = false;
+      for (int s = 0; s < cell.num_clipped() && !contained; ++s) {
+        const S2ClippedShape& clipped = cell.clipped(s);
+        contained = clipped.num_edges() == 0 && clipped.contains_center();
+      }
+      if (!contained) continue;
+    }
+    cell_ids.push_back(iter_.id());
+  }
+  S2RegionCoverer coverer(options);
+  if (cell_ids.size() <= static_cast<size_t>(options.max_cells())) {
+    // The index is small enough that the generic algorithm is cheap, and it
+    // can also produce cells that are smaller than the index cells.
+    return interior ? coverer.GetInteriorCovering(*this)
+                    : coverer.GetCovering(*this);
+  }
+  // The index cells are sorted and disjoint, so no normalization is needed.
+  S2CellUnion cells = S2CellUnion::FromVerbatim(std::move(cell_ids));
+  return interior ? coverer.GetInteriorCovering(cells)
+                  : coverer.GetCovering(cells);
+}
+
 template <class IndexType>
 bool S2ShapeIndexRegion<IndexType>::Contains(const S2Cell& target) const {
+  return ContainsLocated(target, iter_.Locate(target.id()));
+}
+
+template <class IndexType>
+bool S2ShapeIndexRegion<IndexType>::MayIntersect(const S2Cell& target) const {
+  return MayIntersectLocated(target, iter_.Locate(target.id()));
+}
+
+template <class IndexType>
+void S2ShapeIndexRegion<IndexType>::ContainsBatch(
+    absl::Span<const S2Cell> cells, absl::Span<bool> result) const {
+  S2_DCHECK_EQ(cells.size(), result.size());
+  bool indexed = false;
+  for (size_t k = 0; k < cells.size(); ++k) {
+    result[k] = ContainsLocated(cells[k], LocateNext(cells[k], &indexed));
+  }
+}
+
+template <class IndexType>
+void S2ShapeIndexRegion<IndexType>::MayIntersectBatch(
+    absl::Span<const S2Cell> cells, absl::Span<bool> result) const {
+  S2_DCHECK_EQ(cells.size(), result.size());
+  bool indexed = false;
+  for (size_t k = 0; k < cells.size(); ++k) {
+    result[k] = MayIntersectLocated(cells[k], LocateNext(cells[k], &indexed));
+  }
+}
+
+template <class IndexType>
+S2ShapeIndex::CellRelation S2ShapeIndexRegion<IndexType>::LocateNext(
+    const S2Cell& target, bool* indexed) const {
+  if (*indexed && iter_.id().contains(target.id())) {
+    return S2ShapeIndex::INDEXED;
+  }
   S2ShapeIndex::CellRelation relation = iter_.Locate(target.id());
+  *indexed = (relation == S2ShapeIndex::INDEXED);
+  return relation;
+}
 
+template <class IndexType>
+bool S2ShapeIndexRegion<IndexType>::ContainsLocated(
+    const S2Cell& target, S2ShapeIndex::CellRelation relation) const {
   // If the relation is DISJOINT, then "target" is not contained.  Similarly if
   // the relation is SUBDIVIDED then "target" is not contained, since index
   // cells are subdivided only if they (nearly) intersect too many edges.
@@ -311,9 +442,8 @@ bool S2ShapeIndexRegion<IndexType>::Contains(const S2Cell& target) const {
 }
 
 template <class IndexType>
-bool S2ShapeIndexRegion<IndexType>::MayIntersect(const S2Cell& target) const {
-  S2ShapeIndex::CellRelation relation = iter_.Locate(target.id());
-
+bool S2ShapeIndexRegion<IndexType>::MayIntersectLocated(
+    const S2Cell& target, S2ShapeIndex::CellRelation relation) const {
   // If "target" does not overlap any index cell, there is no intersection.
   if (relation == S2ShapeIndex::DISJOINT) return false;
 
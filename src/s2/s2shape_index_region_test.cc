@@ -21,14 +21,20 @@
 
 #include <gtest/gtest.h>
 
+#include "absl/flags/flag.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
 
 #include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
 #include "s2/s2lax_loop_shape.h"
 #include "s2/s2lax_polyline_shape.h"
+#include "s2/s2loop.h"
 #include "s2/s2point_vector_shape.h"
+#include "s2/s2region_coverer.h"
 #include "s2/s2testing.h"
+#include "s2/s2text_format.h"
 #include "s2/s2wrapped_shape.h"
 
 using absl::make_unique;
@@ -246,6 +252,88 @@ class VisitIntersectingShapesTest {
   vector<unique_ptr<MutableS2ShapeIndex>> shape_indexes_;
 };
 
+TEST(S2ShapeIndexRegion, BatchMethodsMatchSingleCellMethods) {
+  // Test batches of sibling cells (which usually share an index cell) as
+  // well as batches of unrelated cells.
+  MutableS2ShapeIndex index;
+  index.Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+      S2Point(1, 0, 0), S1Angle::Degrees(1), 1000)));
+  index.Add(s2textformat::MakeLaxPolylineOrDie("-1:-1, 1:1, 2:-1"));
+  auto region = MakeS2ShapeIndexRegion(&index);
+  S2Testing::rnd.Reset(absl::GetFlag(FLAGS_s2_random_seed));
+  const S2Cap cap(S2Point(1, 0, 0), S1Angle::Degrees(2));
+  for (int iter = 0; iter < 500; ++iter) {
+    vector<S2Cell> cells;
+    S2CellId id = S2CellId(S2Testing::SamplePoint(cap)).parent(
+        S2Testing::rnd.Uniform(20));
+    if (iter % 2 == 0) {
+      for (S2CellId c = id.child_begin(id.level() + 2);
+           c != id.child_end(id.level() + 2); c = c.next()) {
+        cells.push_back(S2Cell(c));
+      }
+    } else {
+      for (int k = 0; k < 10; ++k) {
+        cells.push_back(S2Cell(S2CellId(S2Testing::SamplePoint(cap))
+                               .parent(S2Testing::rnd.Uniform(20))));
+      }
+    }
+    std::unique_ptr<bool[]> contains(new bool[cells.size()]);
+    std::unique_ptr<bool[]> intersects(new bool[cells.size()]);
+    region.ContainsBatch(cells, absl::MakeSpan(contains.get(), cells.size()));
+    region.MayIntersectBatch(cells,
+                             absl::MakeSpan(intersects.get(), cells.size()));
+    for (int k = 0; k < cells.size(); ++k) {
+      EXPECT_EQ(region.Contains(cells[k]), contains[k]) << cells[k].id();
+      EXPECT_EQ(region.MayIntersect(cells[k]), intersects[k]) << cells[k].id();
+    }
+  }
+}
+
+TEST(S2ShapeIndexRegion, GetCoveringOfLargeIndex) {
+  // A loop with many vertices, so that the index has many more cells than
+  // max_cells() and the coverings are computed from the index cells.
+  auto loop = S2Loop::MakeRegularLoop(S2Point(1, 1, 1).Normalize(),
+                                      S1Angle::Degrees(10), 20000);
+  MutableS2ShapeIndex index;
+  index.Add(make_unique<S2Loop::Shape>(loop.get()));
+  auto region = MakeS2ShapeIndexRegion(&index);
+  S2RegionCoverer::Options options;
+  options.set_max_cells(16);
+  options.set_level_mod(2);
+  S2RegionCoverer coverer(options);
+
+  S2CellUnion covering = region.GetCovering(options);
+  EXPECT_LE(covering.size(), options.max_cells());
+  EXPECT_TRUE(coverer.IsCanonical(covering));
+  for (int i = 0; i < loop->num_vertices(); i += 100) {
+    EXPECT_TRUE(covering.Contains(loop->vertex(i)));
+  }
+  EXPECT_TRUE(covering.Contains(loop->GetCentroid().Normalize()));
+
+  S2CellUnion interior = region.GetInteriorCovering(options);
+  EXPECT_FALSE(interior.empty());
+  EXPECT_LE(interior.size(), options.max_cells());
+  for (S2CellId id : interior) {
+    EXPECT_TRUE(loop->Contains(S2Cell(id)));
+  }
+
+  // The covering is not much larger than the generic one.
+  S2CellUnion generic = coverer.GetCovering(region);
+  EXPECT_LT(covering.ApproxArea(), 1.5 * generic.ApproxArea());
+}
+
+TEST(S2ShapeIndexRegion, GetCoveringOfSmallIndex) {
+  // Small indexes use the generic algorithm.
+  auto index = s2textformat::MakeIndexOrDie("# # 0:0, 0:10, 10:10, 10:0");
+  auto region = MakeS2ShapeIndexRegion(index.get());
+  S2RegionCoverer::Options options;
+  options.set_max_cells(20);
+  S2RegionCoverer coverer(options);
+  EXPECT_EQ(coverer.GetCovering(region), region.GetCovering(options));
+  EXPECT_EQ(coverer.GetInteriorCovering(region),
+            region.GetInteriorCovering(options));
+}
+
 TEST(VisitIntersectingShapes, Points) {
   vector<S2Point> vertices;
   for (int i = 0; i < 100; ++i) {
@@ -0,0 +1,201 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shape_index_shard_map.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "s2/base/logging.h"
+#include "s2/encoded_s2cell_id_vector.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s2region_coverer.h"
+#include "s2/s2wrapped_shape.h"
+#include "s2/util/coding/varint.h"
+
+using absl::make_unique;
+using std::vector;
+
+// When adding a new encoding, be aware that old binaries will not be able
+// to decode it.
+static const unsigned char kCurrentEncodingVersionNumber = 1;
+
+namespace {
+
+// An S2WrappedShape that also reports the type tag of the wrapped shape, so
+// that it can be encoded as the original shape type.
+class ShardShape final : public S2WrappedShape {
+ public:
+  explicit ShardShape(const S2Shape* shape)
+      : S2WrappedShape(shape), type_tag_(shape->type_tag()) {}
+
+  TypeTag type_tag() const override { return type_tag_; }
+
+ private:
+  TypeTag type_tag_;
+};
+
+}  // namespace
+
+S2ShapeIndexShardMap::S2ShapeIndexShardMap(const S2ShapeIndex& index,
+                                           int num_shards) {
+  Init(index, num_shards);
+}
+
+void S2ShapeIndexShardMap::Init(const S2ShapeIndex& index, int num_shards) {
+  S2_DCHECK_GE(num_shards, 1);
+  starts_.clear();
+  num_edges_.clear();
+  shape_ids_.clear();
+
+  // Count the edges in each index cell.
+  vector<S2CellId> cell_ids;
+  vector<int64> cell_edges;
+  int64 total_edges = 0;
+  for (S2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN); !it.done();
+       it.Next()) {
+    int64 num_edges = 0;
+    const S2ShapeIndexCell& cell = it.cell();
+    for (int s = 0; s < cell.num_clipped(); ++s) {
+      num_edges += cell.clipped(s).num_edges();
+    }
+    cell_ids.push_back(it.id());
+    cell_edges.push_back(num_edges);
+    total_edges += num_edges;
+  }
+
+  // Start a new shard whenever the number of edges in the preceding cells
+  // reaches the next multiple of (total_edges / num_shards).  Shard 0 always
+  // starts at the beginning of the S2CellId space.
+  const double edges_per_shard = static_cast<double>(total_edges) / num_shards;
+  vector<int> last_shard(index.num_shape_ids(), -1);
+  int64 edges_before = 0;
+  S2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN);
+  for (int i = 0; i < cell_ids.size(); ++i, it.Next()) {
+    if (starts_.empty()) {
+      starts_.push_back(S2CellId::Begin(S2CellId::kMaxLevel));
+      num_edges_.push_back(0);
+      shape_ids_.emplace_back();
+    } else if (static_cast<int>(starts_.size()) < num_shards &&
+               num_edges_.back() > 0 &&
+               edges_before >= starts_.size() * edges_per_shard) {
+      starts_.push_back(cell_ids[i].range_min());
+      num_edges_.push_back(0);
+      shape_ids_.emplace_back();
+    }
+    const int shard = static_cast<int>(starts_.size()) - 1;
+    num_edges_.back() += cell_edges[i];
+    edges_before += cell_edges[i];
+    const S2ShapeIndexCell& cell = it.cell();
+    for (int s = 0; s < cell.num_clipped(); ++s) {
+      int shape_id = cell.clipped(s).shape_id();
+      if (last_shard[shape_id] != shard) {
+        last_shard[shape_id] = shard;
+        shape_ids_.back().push_back(shape_id);
+      }
+    }
+  }
+  if (starts_.empty()) {
+    starts_.push_back(S2CellId::Begin(S2CellId::kMaxLevel));
+    num_edges_.push_back(0);
+    shape_ids_.emplace_back();
+  }
+  for (vector<int>& ids : shape_ids_) {
+    std::sort(ids.begin(), ids.end());
+  }
+}
+
+int S2ShapeIndexShardMap::GetShard(S2CellId leaf) const {
+  return std::upper_bound(starts_.begin() + 1, starts_.end(), leaf) -
+         starts_.begin() - 1;
+}
+
+vector<int> S2ShapeIndexShardMap::GetShards(const S2CellUnion& cells) const {
+  vector<int> shards;
+  for (S2CellId id : cells) {
+    int last = GetShard(id.range_max());
+    for (int i = GetShard(id.range_min()); i <= last; ++i) {
+      shards.push_back(i);
+    }
+  }
+  std::sort(shards.begin(), shards.end());
+  shards.erase(std::unique(shards.begin(), shards.end()), shards.end());
+  return shards;
+}
+
+vector<int> S2ShapeIndexShardMap::GetShards(const S2Cap& cap) const {
+  if (num_shards() == 1) return {0};
+  S2RegionCoverer coverer;
+  return GetShards(coverer.GetCovering(cap));
+}
+
+bool S2ShapeIndexShardMap::EncodeShard(
+    const S2ShapeIndex& index, int shard,
+    const s2shapeutil::ShapeEncoder& shape_encoder, Encoder* encoder) const {
+  const vector<int>& ids = shape_ids_[shard];
+  MutableS2ShapeIndex shard_index;
+  for (int id : ids) {
+    shard_index.Add(make_unique<ShardShape>(index.shape(id)));
+  }
+  // Encode the original shapes rather than their wrappers.
+  auto encode_original = [&](const S2Shape& shape, Encoder* sub_encoder) {
+    return shape_encoder(*index.shape(ids[shape.id()]), sub_encoder);
+  };
+  if (!s2shapeutil::EncodeTaggedShapes(shard_index, encode_original,
+                                       encoder)) {
+    return false;
+  }
+  shard_index.Encode(encoder);
+  return true;
+}
+
+void S2ShapeIndexShardMap::Encode(Encoder* encoder) const {
+  encoder->Ensure(1 + Varint::kMax32);
+  encoder->put8(kCurrentEncodingVersionNumber);
+  encoder->put_varint32(num_shards());
+  s2coding::EncodeS2CellIdVector(starts_, encoder);
+  for (int i = 0; i < num_shards(); ++i) {
+    encoder->Ensure(Varint::kMax64);
+    encoder->put_varint64(num_edges_[i]);
+    vector<uint32> ids(shape_ids_[i].begin(), shape_ids_[i].end());
+    s2coding::EncodeUintVector<uint32>(ids, encoder);
+  }
+}
+
+bool S2ShapeIndexShardMap::Init(Decoder* decoder) {
+  if (decoder->avail() < 1) return false;
+  if (decoder->get8() != kCurrentEncodingVersionNumber) return false;
+  uint32 num_shards;
+  if (!decoder->get_varint32(&num_shards) || num_shards == 0) return false;
+  s2coding::EncodedS2CellIdVector starts;
+  if (!starts.Init(decoder) || starts.size() != num_shards) return false;
+  starts_ = starts.Decode();
+  num_edges_.resize(num_shards);
+  shape_ids_.assign(num_shards, vector<int>());
+  for (int i = 0; i < num_shards; ++i) {
+    uint64 num_edges;
+    if (!decoder->get_varint64(&num_edges)) return false;
+    num_edges_[i] = num_edges;
+    s2coding::EncodedUintVector<uint32> ids;
+    if (!ids.Init(decoder)) return false;
+    shape_ids_[i] = vector<int>(ids.size());
+    for (int j = 0; j < ids.size(); ++j) shape_ids_[i][j] = ids[j];
+  }
+  return true;
+}
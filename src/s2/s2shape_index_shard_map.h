@@ -0,0 +1,140 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2SHAPE_INDEX_SHARD_MAP_H_
+#define S2_S2SHAPE_INDEX_SHARD_MAP_H_
+
+#include <vector>
+
+#include "s2/base/integral_types.h"
+#include "s2/s2cap.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2point.h"
+#include "s2/s2shape_index.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/util/coding/coder.h"
+
+// S2ShapeIndexShardMap partitions an S2ShapeIndex into "shards" that can be
+// stored and queried on different machines.  Each shard covers a contiguous
+// range of leaf S2CellIds, and the ranges are chosen so that the shards
+// contain approximately the same number of index edges.  The shard map acts
+// as the manifest: it records the S2CellId range of each shard along with
+// the shapes that it contains, and routes queries to the shards that need
+// to see them.  For example:
+//
+//   S2ShapeIndexShardMap shard_map(index, 16);
+//   for (int i = 0; i < shard_map.num_shards(); ++i) {
+//     Encoder encoder;
+//     shard_map.EncodeShard(index, i, s2shapeutil::CompactEncodeShape,
+//                           &encoder);
+//     ... store the encoded shard ...
+//   }
+//   Encoder manifest;
+//   shard_map.Encode(&manifest);
+//
+//   // Point containment only needs the shard containing the point.
+//   int shard = shard_map.GetShard(point);
+//
+//   // S2ClosestEdgeQuery with a max_distance needs only the shards that
+//   // intersect the disc around the target.
+//   for (int shard : shard_map.GetShards(S2Cap(point, max_distance))) ...
+//
+// Every shape that intersects a shard's S2CellId range (including polygons
+// whose interior covers part of the range) is stored in full in that shard,
+// so each shard is a valid S2ShapeIndex and any query whose target lies
+// within the shard's range gives the same results as the original index.
+// The cost is that shapes near shard boundaries are stored more than once.
+// Shapes are renumbered within each shard; shard_shape_ids() maps them back
+// to the shape ids of the original index.
+class S2ShapeIndexShardMap {
+ public:
+  // Constructs an empty shard map; requires Init() to be called.
+  S2ShapeIndexShardMap() {}
+
+  // Convenience constructor that calls Init().
+  S2ShapeIndexShardMap(const S2ShapeIndex& index, int num_shards);
+
+  // Partitions the given index into at most "num_shards" shards.  (Fewer
+  // shards are created if the index has fewer cells than "num_shards".)
+  // Shard boundaries always fall between index cells.
+  //
+  // REQUIRES: num_shards >= 1
+  void Init(const S2ShapeIndex& index, int num_shards);
+
+  // Returns the number of shards.
+  int num_shards() const { return static_cast<int>(starts_.size()); }
+
+  // Returns the first leaf S2CellId of the given shard.  Shard "i" covers the
+  // leaf cells from shard_start(i) up to (but not including) shard_start(i +
+  // 1), and the last shard extends to S2CellId::End(S2CellId::kMaxLevel).
+  S2CellId shard_start(int i) const { return starts_[i]; }
+
+  // Returns the number of index edges in the given shard, i.e. the sum over
+  // all of its index cells of the number of clipped edges.  This is a
+  // measure of the shard's load.
+  int64 shard_num_edges(int i) const { return num_edges_[i]; }
+
+  // Returns the shape ids in the original index of the shapes in the given
+  // shard, in increasing order.  Shape "j" of the shard is shape
+  // shard_shape_ids(i)[j] of the original index.
+  const std::vector<int>& shard_shape_ids(int i) const {
+    return shape_ids_[i];
+  }
+
+  // Returns the shard containing the given leaf cell or point.
+  int GetShard(S2CellId leaf) const;
+  int GetShard(const S2Point& point) const { return GetShard(S2CellId(point)); }
+
+  // Returns the shards that intersect the given cell union or cap, in
+  // increasing order.  For example, S2ClosestEdgeQuery with a maximum
+  // distance "d" to a point "p" only needs the shards returned by
+  // GetShards(S2Cap(p, d)).
+  std::vector<int> GetShards(const S2CellUnion& cells) const;
+  std::vector<int> GetShards(const S2Cap& cap) const;
+
+  // Encodes the shapes of the given shard using "shape_encoder", followed by
+  // an index of those shapes, in the format used by
+  // s2shapeutil::EncodeTaggedShapes() and MutableS2ShapeIndex::Encode().
+  // The shard can therefore be decoded as usual:
+  //
+  //   EncodedS2ShapeIndex shard;
+  //   shard.Init(&decoder, s2shapeutil::LazyDecodeShapeFactory(&decoder));
+  //
+  // Returns false if "shape_encoder" fails.
+  //
+  // REQUIRES: "index" is the index that this shard map was built from.
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  bool EncodeShard(const S2ShapeIndex& index, int shard,
+                   const s2shapeutil::ShapeEncoder& shape_encoder,
+                   Encoder* encoder) const;
+
+  // Appends an encoded representation of the shard map to "encoder".
+  //
+  // REQUIRES: "encoder" uses the default constructor, so that its buffer
+  //           can be enlarged as necessary by calling Ensure(int).
+  void Encode(Encoder* encoder) const;
+
+  // Decodes a shard map encoded by Encode(), returning true on success.
+  bool Init(Decoder* decoder);
+
+ private:
+  std::vector<S2CellId> starts_;
+  std::vector<int64> num_edges_;
+  std::vector<std::vector<int>> shape_ids_;
+};
+
+#endif  // S2_S2SHAPE_INDEX_SHARD_MAP_H_
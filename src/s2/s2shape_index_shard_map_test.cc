@@ -0,0 +1,180 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shape_index_shard_map.h"
+
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "absl/memory/memory.h"
+#include "s2/encoded_s2shape_index.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s1chord_angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2closest_edge_query.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2lax_polyline_shape.h"
+#include "s2/s2loop.h"
+#include "s2/s2point_vector_shape.h"
+#include "s2/s2polygon.h"
+#include "s2/s2shapeutil_coding.h"
+#include "s2/s2testing.h"
+
+using absl::make_unique;
+using std::pair;
+using std::set;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// Returns an index containing polygons, polylines, and points clustered
+// around a few random centers (so that the edge density is very uneven).
+unique_ptr<MutableS2ShapeIndex> MakeIndex() {
+  auto index = make_unique<MutableS2ShapeIndex>();
+  for (int c = 0; c < 3; ++c) {
+    S2Cap cluster(S2Testing::RandomPoint(), S1Angle::Degrees(10));
+    for (int i = 0; i < 10; ++i) {
+      index->Add(make_unique<S2Polygon::OwningShape>(
+          make_unique<S2Polygon>(S2Loop::MakeRegularLoop(
+              S2Testing::SamplePoint(cluster), S1Angle::Degrees(2), 50))));
+      vector<S2Point> vertices;
+      for (int j = 0; j < 20; ++j) {
+        vertices.push_back(S2Testing::SamplePoint(cluster));
+      }
+      index->Add(make_unique<S2LaxPolylineShape>(vertices));
+      index->Add(make_unique<S2PointVectorShape>(vertices));
+    }
+  }
+  // A large polygon whose interior covers several shards.
+  index->Add(make_unique<S2Polygon::OwningShape>(
+      make_unique<S2Polygon>(S2Loop::MakeRegularLoop(
+          S2Testing::RandomPoint(), S1Angle::Degrees(60), 10))));
+  return index;
+}
+
+// Decodes each shard of the given shard map.
+vector<unique_ptr<EncodedS2ShapeIndex>> EncodeAndDecodeShards(
+    const S2ShapeIndex& index, const S2ShapeIndexShardMap& shard_map,
+    vector<std::string>* buffers) {
+  vector<unique_ptr<EncodedS2ShapeIndex>> shards;
+  buffers->resize(shard_map.num_shards());
+  for (int i = 0; i < shard_map.num_shards(); ++i) {
+    Encoder encoder;
+    EXPECT_TRUE(shard_map.EncodeShard(index, i,
+                                      s2shapeutil::CompactEncodeShape,
+                                      &encoder));
+    (*buffers)[i].assign(encoder.base(), encoder.length());
+    Decoder decoder((*buffers)[i].data(), (*buffers)[i].size());
+    shards.push_back(make_unique<EncodedS2ShapeIndex>());
+    EXPECT_TRUE(shards.back()->Init(
+        &decoder, s2shapeutil::LazyDecodeShapeFactory(&decoder)));
+  }
+  return shards;
+}
+
+TEST(S2ShapeIndexShardMap, BalancesEdges) {
+  S2Testing::rnd.Reset(1);
+  auto index = MakeIndex();
+  S2ShapeIndexShardMap shard_map(*index, 8);
+  ASSERT_EQ(8, shard_map.num_shards());
+  EXPECT_EQ(S2CellId::Begin(S2CellId::kMaxLevel), shard_map.shard_start(0));
+  int64 total_edges = 0;
+  for (int i = 0; i < shard_map.num_shards(); ++i) {
+    total_edges += shard_map.shard_num_edges(i);
+    if (i > 0) {
+      EXPECT_LT(shard_map.shard_start(i - 1), shard_map.shard_start(i));
+    }
+  }
+  // Shards exceed their share only by the edges of the index cells at their
+  // boundaries.
+  for (int i = 0; i < shard_map.num_shards(); ++i) {
+    EXPECT_LE(shard_map.shard_num_edges(i), 1.25 * total_edges / 8);
+  }
+}
+
+TEST(S2ShapeIndexShardMap, RoutesQueries) {
+  S2Testing::rnd.Reset(2);
+  auto index = MakeIndex();
+  S2ShapeIndexShardMap shard_map(*index, 5);
+
+  // Round-trip the shard map through its encoding.
+  Encoder encoder;
+  shard_map.Encode(&encoder);
+  Decoder decoder(encoder.base(), encoder.length());
+  S2ShapeIndexShardMap manifest;
+  ASSERT_TRUE(manifest.Init(&decoder));
+  ASSERT_EQ(shard_map.num_shards(), manifest.num_shards());
+  for (int i = 0; i < manifest.num_shards(); ++i) {
+    EXPECT_EQ(shard_map.shard_start(i), manifest.shard_start(i));
+    EXPECT_EQ(shard_map.shard_num_edges(i), manifest.shard_num_edges(i));
+    EXPECT_EQ(shard_map.shard_shape_ids(i), manifest.shard_shape_ids(i));
+  }
+  vector<std::string> buffers;
+  auto shards = EncodeAndDecodeShards(*index, shard_map, &buffers);
+
+  auto query = MakeS2ContainsPointQuery(index.get());
+  const S1ChordAngle kMaxDistance(S1Angle::Degrees(3));
+  S2ClosestEdgeQuery::Options options;
+  options.set_max_distance(kMaxDistance);
+  S2ClosestEdgeQuery closest_query(index.get(), options);
+  for (int iter = 0; iter < 50; ++iter) {
+    S2Point p = S2Testing::RandomPoint();
+
+    // Point containment only needs one shard.
+    int shard = manifest.GetShard(p);
+    const vector<int>& ids = manifest.shard_shape_ids(shard);
+    set<int> expected, actual;
+    for (const S2Shape* shape : query.GetContainingShapes(p)) {
+      expected.insert(shape->id());
+    }
+    auto shard_query = MakeS2ContainsPointQuery(shards[shard].get());
+    for (const S2Shape* shape : shard_query.GetContainingShapes(p)) {
+      actual.insert(ids[shape->id()]);
+    }
+    EXPECT_EQ(expected, actual);
+
+    // Closest edges need the shards that intersect the search radius.
+    S2ClosestEdgeQuery::PointTarget target(p);
+    set<pair<int, int>> expected_edges, actual_edges;
+    for (const auto& result : closest_query.FindClosestEdges(&target)) {
+      expected_edges.insert({result.shape_id(), result.edge_id()});
+    }
+    for (int i : manifest.GetShards(S2Cap(p, kMaxDistance))) {
+      S2ClosestEdgeQuery shard_closest(shards[i].get(), options);
+      for (const auto& result : shard_closest.FindClosestEdges(&target)) {
+        actual_edges.insert({manifest.shard_shape_ids(i)[result.shape_id()],
+                             result.edge_id()});
+      }
+    }
+    EXPECT_EQ(expected_edges, actual_edges);
+  }
+}
+
+TEST(S2ShapeIndexShardMap, EmptyIndex) {
+  MutableS2ShapeIndex index;
+  S2ShapeIndexShardMap shard_map(index, 4);
+  ASSERT_EQ(1, shard_map.num_shards());
+  EXPECT_EQ(0, shard_map.GetShard(S2Testing::RandomPoint()));
+  EXPECT_EQ(vector<int>{0}, shard_map.GetShards(S2Cap::Full()));
+  EXPECT_TRUE(shard_map.shard_shape_ids(0).empty());
+}
+
+}  // namespace
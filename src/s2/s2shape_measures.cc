@@ -32,11 +32,10 @@ namespace S2 {
 S1Angle GetLength(const S2Shape& shape) {
   if (shape.dimension() != 1) return S1Angle::Zero();
   S1Angle length;
-  vector<S2Point> vertices;
+  vector<S2Point> tmp;
   int num_chains = shape.num_chains();
   for (int chain_id = 0; chain_id < num_chains; ++chain_id) {
-    GetChainVertices(shape, chain_id, &vertices);
-    length += S2::GetLength(vertices);
+    length += S2::GetLength(shape.GetChainVertices(chain_id, &tmp));
   }
   return length;
 }
@@ -44,11 +43,12 @@ S1Angle GetLength(const S2Shape& shape) {
 S1Angle GetPerimeter(const S2Shape& shape) {
   if (shape.dimension() != 2) return S1Angle::Zero();
   S1Angle perimeter;
-  vector<S2Point> vertices;
+  vector<S2Point> tmp;
   int num_chains = shape.num_chains();
   for (int chain_id = 0; chain_id < num_chains; ++chain_id) {
-    GetChainVertices(shape, chain_id, &vertices);
-    perimeter += S2::GetPerimeter(S2PointLoopSpan(vertices));
+    S2PointSpan vertices = shape.GetChainVertices(chain_id, &tmp);
+    perimeter += S2::GetPerimeter(
+        S2PointLoopSpan(vertices.data(), vertices.size()));
   }
   return perimeter;
 }
@@ -78,13 +78,14 @@ double GetArea(const S2Shape& shape) {
   // sign.
   double area = 0;
   double max_error = 0;
-  vector<S2Point> vertices;
+  vector<S2Point> tmp;
   int num_chains = shape.num_chains();
   for (int chain_id = 0; chain_id < num_chains; ++chain_id) {
-    GetChainVertices(shape, chain_id, &vertices);
-    area += S2::GetSignedArea(S2PointLoopSpan(vertices));
+    S2PointSpan span = shape.GetChainVertices(chain_id, &tmp);
+    S2PointLoopSpan vertices(span.data(), span.size());
+    area += S2::GetSignedArea(vertices);
     if (google::DEBUG_MODE) {
-      max_error += S2::GetCurvatureMaxError(S2PointLoopSpan(vertices));
+      max_error += S2::GetCurvatureMaxError(vertices);
     }
   }
   // Note that S2::GetSignedArea() guarantees that the full loop (containing
@@ -98,11 +99,12 @@ double GetApproxArea(const S2Shape& shape) {
   if (shape.dimension() != 2) return 0.0;
 
   double area = 0;
-  vector<S2Point> vertices;
+  vector<S2Point> tmp;
   int num_chains = shape.num_chains();
   for (int chain_id = 0; chain_id < num_chains; ++chain_id) {
-    GetChainVertices(shape, chain_id, &vertices);
-    area += S2::GetApproxArea(S2PointLoopSpan(vertices));
+    S2PointSpan vertices = shape.GetChainVertices(chain_id, &tmp);
+    area += S2::GetApproxArea(
+        S2PointLoopSpan(vertices.data(), vertices.size()));
   }
   // Special case to ensure that full polygons are handled correctly.
   if (area <= 4 * M_PI) return area;
@@ -111,22 +113,20 @@ double GetApproxArea(const S2Shape& shape) {
 
 S2Point GetCentroid(const S2Shape& shape) {
   S2Point centroid;
-  vector<S2Point> vertices;
+  vector<S2Point> tmp;
   int dimension = shape.dimension();
   int num_chains = shape.num_chains();
   for (int chain_id = 0; chain_id < num_chains; ++chain_id) {
-    switch (dimension) {
-      case 0:
-        centroid += shape.edge(chain_id).v0;
-        break;
-      case 1:
-        GetChainVertices(shape, chain_id, &vertices);
-        centroid += S2::GetCentroid(S2PointSpan(vertices));
-        break;
-      default:
-        GetChainVertices(shape, chain_id, &vertices);
-        centroid += S2::GetCentroid(S2PointLoopSpan(vertices));
-        break;
+    if (dimension == 0) {
+      centroid += shape.edge(chain_id).v0;
+      continue;
+    }
+    S2PointSpan vertices = shape.GetChainVertices(chain_id, &tmp);
+    if (dimension == 1) {
+      centroid += S2::GetCentroid(vertices);
+    } else {
+      centroid += S2::GetCentroid(
+          S2PointLoopSpan(vertices.data(), vertices.size()));
     }
   }
   return centroid;
@@ -134,18 +134,9 @@ S2Point GetCentroid(const S2Shape& shape) {
 
 void GetChainVertices(const S2Shape& shape, int chain_id,
                       std::vector<S2Point>* vertices) {
-  S2Shape::Chain chain = shape.chain(chain_id);
-  int num_vertices = chain.length + (shape.dimension() == 1);
-  vertices->clear();
-  vertices->reserve(num_vertices);
-  int e = 0;
-  if (num_vertices & 1) {
-    vertices->push_back(shape.chain_edge(chain_id, e++).v0);
-  }
-  for (; e < num_vertices; e += 2) {
-    auto edge = shape.chain_edge(chain_id, e);
-    vertices->push_back(edge.v0);
-    vertices->push_back(edge.v1);
+  S2PointSpan span = shape.GetChainVertices(chain_id, vertices);
+  if (span.data() != vertices->data()) {
+    vertices->assign(span.begin(), span.end());
   }
 }
 
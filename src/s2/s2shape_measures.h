@@ -85,8 +85,8 @@ S2Point GetCentroid(const S2Shape& shape);
 // If dimension == 1, the chain will have (chain.length + 1) vertices, and
 // otherwise it will have (chain.length) vertices.
 //
-// This is a low-level helper method used in the implementations of some of
-// the methods above.
+// This is a low-level helper method.  Note that S2Shape::GetChainVertices()
+// is more efficient when the vertices do not need to be copied.
 void GetChainVertices(const S2Shape& shape, int chain_id,
                       std::vector<S2Point>* vertices);
 
@@ -21,13 +21,17 @@
 
 #include "s2/s2shape_measures.h"
 
+#include <vector>
+
 #include <gtest/gtest.h>
 #include "s2/mutable_s2shape_index.h"
 #include "s2/s2edge_vector_shape.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
+#include "s2/s2point_vector_shape.h"
 #include "s2/s2pointutil.h"
 #include "s2/s2polygon.h"
+#include "s2/s2polyline.h"
 #include "s2/s2text_format.h"
 
 using s2textformat::MakeIndexOrDie;
@@ -35,6 +39,7 @@ using s2textformat::MakeLaxPolygonOrDie;
 using s2textformat::MakeLaxPolylineOrDie;
 using s2textformat::MakePolygonOrDie;
 using s2textformat::ParsePointsOrDie;
+using std::vector;
 
 namespace {
 
@@ -136,4 +141,47 @@ TEST(GetCentroid, Polygon) {
       S2::GetCentroid(*MakeLaxPolygonOrDie("0:0, 0:90, 90:0"))));
 }
 
+// Checks that S2Shape::GetChainVertices() agrees with the default
+// implementation (which is based on chain_edge()) for every chain.
+void TestGetChainVertices(const S2Shape& shape) {
+  vector<S2Point> tmp, expected;
+  for (int i = 0; i < shape.num_chains(); ++i) {
+    S2PointSpan actual = shape.GetChainVertices(i, &tmp);
+    shape.S2Shape::GetChainVertices(i, &expected);
+    EXPECT_EQ(expected, vector<S2Point>(actual.begin(), actual.end()));
+    vector<S2Point> copied;
+    S2::GetChainVertices(shape, i, &copied);
+    EXPECT_EQ(expected, copied);
+  }
+}
+
+TEST(GetChainVertices, AllShapeTypes) {
+  auto polygon = MakePolygonOrDie(
+      "0:0, 0:5, 5:5, 5:0; 1:1, 1:2, 2:2, 2:1; 9:9, 9:12, 12:12");
+  TestGetChainVertices(S2Polygon::Shape(polygon.get()));
+  auto full = MakePolygonOrDie("full");
+  TestGetChainVertices(S2Polygon::Shape(full.get()));
+  auto polyline = s2textformat::MakePolylineOrDie("0:0, 0:5, 3:7");
+  TestGetChainVertices(S2Polyline::Shape(polyline.get()));
+  auto lax_polygon = MakeLaxPolygonOrDie("0:0, 0:5, 5:5; 7:7; full");
+  TestGetChainVertices(*lax_polygon);
+  TestGetChainVertices(*MakeLaxPolylineOrDie("0:0, 1:1, 2:0"));
+  S2PointVectorShape points(ParsePointsOrDie("0:0, 1:1, 2:2"));
+  TestGetChainVertices(points);
+
+  Encoder encoder;
+  lax_polygon->Encode(&encoder, s2coding::CodingHint::COMPACT);
+  Decoder decoder(encoder.base(), encoder.length());
+  EncodedS2LaxPolygonShape encoded_polygon;
+  ASSERT_TRUE(encoded_polygon.Init(&decoder));
+  TestGetChainVertices(encoded_polygon);
+
+  Encoder encoder2;
+  points.Encode(&encoder2, s2coding::CodingHint::FAST);
+  Decoder decoder2(encoder2.base(), encoder2.length());
+  EncodedS2PointVectorShape encoded_points;
+  ASSERT_TRUE(encoded_points.Init(&decoder2));
+  TestGetChainVertices(encoded_points);
+}
+
 }  // namespace
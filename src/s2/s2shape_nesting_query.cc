@@ -20,16 +20,18 @@
 #include <climits>
 #include <vector>
 
-#include "absl/container/fixed_array.h"
-#include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_format.h"
-#include "s2/util/bitmap/bitmap.h"
+#include "absl/strings/str_join.h"
 #include "s2/s2crossing_edge_query.h"
+#include "s2/s2executor.h"
 #include "s2/s2latlng.h"
 #include "s2/s2predicates.h"
 
 using std::vector;
-using util::bitmap::Bitmap64;
+
+// The minimum number of chains that each thread should classify when
+// Options::num_threads() > 1.
+static constexpr int kMinChainsPerThread = 100;
 
 // Takes N equally spaced points from the given chain of the shape and finds
 // the one closest to the target point, returning its index.
@@ -72,6 +74,88 @@ static inline S2Shape::Edge PrevChainEdge(const S2Shape* shape, int chain,
   return shape->chain_edge(chain, index);
 }
 
+// Computes the possible parents of the given chain by finding the chains
+// crossed by a segment from vertices[1] of the datum shell to a point on the
+// chain.  Each crossed chain whose edges are crossed an odd number of times is
+// a possible parent.  "parents" is set to these chain ids in increasing
+// order; "crossing_query", "edges" and "crossed_chains" are temporary storage
+// that is reused between calls.
+static void GetPossibleParents(const S2Shape& shape, int chain,
+                               int datum_shell, const S2Point vertices[3],
+                               S2CrossingEdgeQuery* crossing_query,
+                               vector<s2shapeutil::ShapeEdge>* edges,
+                               vector<int32>* crossed_chains,
+                               vector<int32>* parents) {
+  S2_VLOG(1) << "Processing chain " << chain;
+  const S2Point& start_point = vertices[1];
+
+  // Find a close point on the target chain out of 4 equally spaced ones.
+  int end_idx = ClosestOfNPoints(start_point, shape, chain, 4);
+  S2Point end_point = shape.chain_edge(chain, end_idx).v0;
+
+  // We need to know whether we're inside the datum shell at the end, so we
+  // need to properly seed its starting state.  If we start by entering the
+  // datum shell's interior _and_ end by arriving from the target chain's
+  // interior, we set it to true.
+  //
+  // As we cross edges from the datum to the target chain the total number of
+  // datum shell _or_ target chain edges we'll cross is either even or odd.
+  // Each of these edges toggles our "insideness" relative to the datum shell,
+  bool inside_datum = false;
+  if (s2pred::OrderedCCW(vertices[2], end_point, vertices[0], start_point)) {
+    S2_VLOG(1) << "  Edge starts into interior of datum chain";
+    inside_datum = true;
+  }
+
+  // Arriving from the interior of the target chain?
+  bool inside_chain = false;
+  S2Point next = NextChainEdge(&shape, chain, end_idx).v0;
+  S2Point prev = PrevChainEdge(&shape, chain, end_idx).v0;
+  if (s2pred::OrderedCCW(next, start_point, prev, end_point)) {
+    S2_VLOG(1) << "  Edge ends from interior of target chain";
+    inside_chain = true;
+  }
+
+  // Query all the edges crossed by the line from the datum shell to a point
+  // on this chain.  Only look at edges that belong to the requested shape.
+  // Using INTERIOR here will avoid returning the two edges on the datum and
+  // target shells that are touched by the endpoints of our line segment.
+  crossing_query->GetCrossingEdges(start_point, end_point, shape,
+                                   s2shapeutil::CrossingType::INTERIOR,
+                                   edges);
+  crossed_chains->clear();
+  for (const auto& edge : *edges) {
+    crossed_chains->push_back(shape.chain_position(edge.id().edge_id).chain_id);
+  }
+  std::sort(crossed_chains->begin(), crossed_chains->end());
+
+  // Each crossing toggles our "insideness" relative to the crossed chain, so
+  // the chains that are crossed an odd number of times are possible parents.
+  parents->clear();
+  for (auto it = crossed_chains->begin(); it != crossed_chains->end(); ) {
+    auto run_end = std::upper_bound(it, crossed_chains->end(), *it);
+    const int32 other_chain = *it;
+    const bool odd = (run_end - it) % 2 != 0;
+    it = run_end;
+    S2_VLOG(1) << "  Crosses chain " << other_chain;
+    if (other_chain == datum_shell) {
+      inside_datum ^= odd;
+    } else if (other_chain == chain) {
+      inside_chain ^= odd;
+    } else if (odd) {
+      parents->push_back(other_chain);
+    }
+  }
+
+  // The datum shell is a potential parent if both the datum shell and target
+  // chain states are set.  (The target chain is never its own parent.)
+  if (inside_datum && inside_chain) {
+    parents->insert(std::lower_bound(parents->begin(), parents->end(),
+                                     datum_shell),
+                    datum_shell);
+  }
+}
+
 S2ShapeNestingQuery::S2ShapeNestingQuery(const S2ShapeIndex* index,
                                          const Options& options) {
   Init(index, options);
@@ -83,9 +167,6 @@ void S2ShapeNestingQuery::Init(const S2ShapeIndex* index,
   options_ = options;
 }
 
-// Finds three consecutive vertices that aren't degenerate and stores them in
-// the given array.  Returns false if there aren't three consecutive
-// non-degenerate points.
 vector<S2ShapeNestingQuery::ChainRelation>
 S2ShapeNestingQuery::ComputeShapeNesting(int shape_id) {
   const S2Shape* shape = index_->shape(shape_id);
@@ -101,113 +182,84 @@ S2ShapeNestingQuery::ComputeShapeNesting(int shape_id) {
     return {ChainRelation::MakeShell()};
   }
 
-  // Sets to track possible parents and possible children for each chain.
-  absl::FixedArray<Bitmap64> parents(num_chains, Bitmap64(num_chains, false));
-  absl::FixedArray<Bitmap64> children(num_chains, Bitmap64(num_chains, false));
+  // The possible parents of each chain, as sorted vectors of chain ids.  A
+  // segment from the datum shell to a chain typically crosses only a few other
+  // chains, so these sets are small even when the shape has many chains.
+  vector<vector<int32>> parents(num_chains);
 
   // We'll compute edge crossings along a line segment from the datum shell to a
   // random point on the other chains.  This choice is arbitrary, so we'll use
   // the first vertex of edge 1 so we can easily get the next and previous
   // points to check for orientation.
-  int32 datum_shell = options().datum_strategy()(shape);
+  const int32 datum_shell = options().datum_strategy()(shape);
   const S2Point vertices[3] = {
       shape->chain_edge(datum_shell, 0).v0,
       shape->chain_edge(datum_shell, 1).v0,
       shape->chain_edge(datum_shell, 2).v0,
   };
-  const S2Point start_point = vertices[1];
 
-  S2CrossingEdgeQuery crossing_query(index_);
-  vector<s2shapeutil::ShapeEdge> edges;
-  for (int chain = 0; chain < num_chains; ++chain) {
-    if (chain == datum_shell) {
-      continue;
-    }
-    S2_VLOG(1) << "Processing chain " << chain;
-
-    // Find a close point on the target chain out of 4 equally spaced ones.
-    int end_idx = ClosestOfNPoints(start_point, *shape, chain, 4);
-    S2Point end_point = shape->chain_edge(chain, end_idx).v0;
-
-    // We need to know whether we're inside the datum shell at the end, so we
-    // need to properly seed its starting state.  If we start by entering the
-    // datum shell's interior _and_ end by arriving from the target chain's
-    // interior, we set it to true.
-    //
-    // As we cross edges from the datum to the target chain the total number of
-    // datum shell _or_ target chain edges we'll cross is either even or odd.
-    // Each of these edges toggles our "insideness" relative to the datum shell,
-    if (s2pred::OrderedCCW(vertices[2], end_point, vertices[0], start_point)) {
-      S2_VLOG(1) << "  Edge starts into interior of datum chain";
-      parents[chain].Set(datum_shell, true);
-      children[datum_shell].Set(chain, true);
-    }
-
-    // Arriving from the interior of the target chain?
-    S2Point next = NextChainEdge(shape, chain, end_idx).v0;
-    S2Point prev = PrevChainEdge(shape, chain, end_idx).v0;
-    if (s2pred::OrderedCCW(next, start_point, prev, end_point)) {
-      S2_VLOG(1) << "  Edge ends from interior of target chain";
-      parents[chain].Set(chain, true);
-    }
-    S2_VLOG(2) << "    Initial set: " << parents[chain].ToString(8);
-
-    // Query all the edges crossed by the line from the datum shell to a point
-    // on this chain.  Only look at edges that belong to the requested shape.
-    // Using INTERIOR here will avoid returning the two edges on the datum and
-    // target shells that are touched by the endpoints of our line segment.
-    crossing_query.GetCrossingEdges(start_point, end_point, *shape,
-                                    s2shapeutil::CrossingType::INTERIOR,
-                                    &edges);
-
-    // Walk through the intersected chains and toggle corresponding bits.
-    for (const auto& edge : edges) {
-      int32 other_chain = shape->chain_position(edge.id().edge_id).chain_id;
-
-      parents[chain].Toggle(other_chain);
-      if (other_chain != chain) {
-        children[other_chain].Toggle(chain);
-      }
-      S2_VLOG(1) << "  Crosses chain " << other_chain;
-      S2_VLOG(2) << "    Parent set: " << parents[chain].ToString(8);
+  // The chains are classified independently of each other, so they can be
+  // divided among several threads.  Each thread processes a contiguous range
+  // of chains using its own crossing edge query.
+  const int num_threads =
+      std::max(1, std::min(S2NumThreads(options_.executor(),
+                                        options_.num_threads()),
+                           num_chains / kMinChainsPerThread));
+  auto classify_block = [&](int block) {
+    S2CrossingEdgeQuery crossing_query(index_);
+    vector<s2shapeutil::ShapeEdge> edges;
+    vector<int32> crossed_chains;
+    const int begin = int64{num_chains} * block / num_threads;
+    const int end = int64{num_chains} * (block + 1) / num_threads;
+    for (int chain = begin; chain < end; ++chain) {
+      if (chain == datum_shell) continue;
+      GetPossibleParents(*shape, chain, datum_shell, vertices,
+                         &crossing_query, &edges, &crossed_chains,
+                         &parents[chain]);
     }
-
-    // Now set the final state.  Remove the target chain from its own parent set
-    // to make following logic simpler.  The datum shell is a potential parent
-    // if both parent and target chain bits are set.
-    parents[chain].Set(datum_shell, parents[chain].Get(datum_shell) &&
-                                        parents[chain].Get(chain));
-    parents[chain].Set(chain, false);
+  };
+  if (num_threads == 1) {
+    classify_block(0);
+  } else {
+    S2ParallelFor(options_.executor(), num_threads, classify_block);
   }
 
   if (S2_VLOG_IS_ON(2)) {
     S2_LOG(INFO) << "Current parent set";
     for (int chain = 0; chain < num_chains; ++chain) {
       S2_LOG(INFO) << "  " << absl::StrFormat("%2d", chain) << ": "
-                << parents[chain].ToString(8);
+                << absl::StrJoin(parents[chain], " ");
     }
   }
 
+  // The possible children of each chain, i.e. the chains that have it as a
+  // possible parent.  These are also sorted since the chains are visited in
+  // increasing order.
+  vector<vector<int32>> children(num_chains);
+  for (int chain = 0; chain < num_chains; ++chain) {
+    for (int32 parent : parents[chain]) children[parent].push_back(chain);
+  }
+
   // Look at each chain with a single parent and remove the parent from any of
   // its child chains.  This enforces the constraint that if A is a parent of B
   // and B is a parent of C, then A shouldn't directly be a parent of C.
   for (int current_chain = 0; current_chain < num_chains; ++current_chain) {
-    if (parents[current_chain].GetOnesCount() != 1) {
+    if (parents[current_chain].size() != 1) {
       continue;
     }
-
-    Bitmap64::size_type parent_chain;
-    parents[current_chain].FindFirstSetBit(&parent_chain);
+    const int32 parent_chain = parents[current_chain][0];
 
     int next_chain = current_chain;
-    Bitmap64::size_type child = 0;
-    for (; children[current_chain].FindNextSetBit(&child); child++) {
-      if (parents[child].Get(parent_chain)) {
-        parents[child].Set(parent_chain, false);
+    for (int32 child : children[current_chain]) {
+      vector<int32>& child_parents = parents[child];
+      auto it = std::lower_bound(child_parents.begin(), child_parents.end(),
+                                 parent_chain);
+      if (it != child_parents.end() && *it == parent_chain) {
+        child_parents.erase(it);
 
         // If this chain has a single parent now, we have to process it as well,
         // so if we've already passed it in the outer loop, we have to back up.
-        if (parents[child].GetOnesCount() == 1 && child < next_chain) {
+        if (child_parents.size() == 1 && child < next_chain) {
           next_chain = child;
         }
       }
@@ -218,7 +270,7 @@ S2ShapeNestingQuery::ComputeShapeNesting(int shape_id) {
       S2_LOG(INFO) << "  Parent set now:";
       for (int chain = 0; chain < num_chains; ++chain) {
         S2_LOG(INFO) << "  " << absl::StrFormat("%2d", chain) << ": "
-                  << parents[chain].ToString(8);
+                  << absl::StrJoin(parents[chain], " ");
       }
     }
 
@@ -232,10 +284,10 @@ S2ShapeNestingQuery::ComputeShapeNesting(int shape_id) {
   // to point to parent and vice-versa.
   vector<ChainRelation> relations(num_chains);
   for (int chain = 0; chain < num_chains; ++chain) {
-    S2_DCHECK_LE(parents[chain].GetOnesCount(), 1);
+    S2_DCHECK_LE(parents[chain].size(), 1);
 
-    Bitmap64::size_type parent;
-    if (parents[chain].FindFirstSetBit(&parent)) {
+    if (!parents[chain].empty()) {
+      const int32 parent = parents[chain][0];
       relations[chain].SetParent(parent);
       relations[parent].AddHole(chain);
     }
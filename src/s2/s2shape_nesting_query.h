@@ -21,6 +21,8 @@
 #include <vector>
 
 #include "absl/container/inlined_vector.h"
+#include "s2/base/logging.h"
+#include "s2/s2executor.h"
 #include "s2/s2shape_index.h"
 
 // On a sphere, polygon hierarchy is ambiguous.  If you imagine two chains
@@ -87,8 +89,36 @@ class S2ShapeNestingQuery {
       return *this;
     }
 
+    // The maximum number of threads used to classify the chains of a shape.
+    // Each chain is classified by finding the edges crossed by a segment
+    // from the datum shell to that chain, which is independent of the other
+    // chains and dominates the running time for shapes with many chains.
+    // The result does not depend on the number of threads.
+    //
+    // REQUIRES: The S2Shape methods of the shape are thread-safe.
+    //
+    // DEFAULT: 1
+    int num_threads() const { return num_threads_; }
+    Options& set_num_threads(int num_threads) {
+      S2_DCHECK_GE(num_threads, 1);
+      num_threads_ = num_threads;
+      return *this;
+    }
+
+    // If non-null, the chains are classified using this executor, and
+    // num_threads() is replaced by executor->num_threads().
+    //
+    // DEFAULT: nullptr
+    S2Executor* executor() const { return executor_; }
+    Options& set_executor(S2Executor* executor) {
+      executor_ = executor;
+      return *this;
+    }
+
    private:
     S2DatumStrategy datum_strategy_;
+    int num_threads_ = 1;
+    S2Executor* executor_ = nullptr;
   };
 
   // `ChainRelation` models the parent/child relationship between chains in a
@@ -179,6 +209,10 @@ class S2ShapeNestingQuery {
   //
   // The returned `ChainRelation` instances are in 1:1 correspondence with the
   // chains in the shape, i.e. chain id 3 responds to `result[3]`.
+  //
+  // The running time is dominated by one edge crossing query per chain, and
+  // memory usage is proportional to the number of chains plus the number of
+  // chains crossed by those queries.
   std::vector<ChainRelation> ComputeShapeNesting(int shape_id);
 
  private:
@@ -25,6 +25,7 @@
 #include "absl/memory/memory.h"
 #include "absl/strings/str_format.h"
 #include "s2/mutable_s2shape_index.h"
+#include "s2/s2executor.h"
 #include "s2/s2polygon.h"
 #include "s2/s2testing.h"
 #include "s2/s2text_format.h"
@@ -364,6 +365,47 @@ TEST(S2ShapeNestingQuery, ExactPathIsIrrelevant) {
   }
 }
 
+TEST(S2ShapeNestingQuery, MultipleThreadsGiveSameResult) {
+  // A large shell with a grid of lakes, each of which contains an island.
+  const S2LatLng kCenter = S2LatLng::FromDegrees(0.0, 0.0);
+  vector<RingSpec> rings = {RingSpec{kCenter, 40.0}};
+  for (int i = 0; i < 20; ++i) {
+    for (int j = 0; j < 20; ++j) {
+      S2LatLng center = S2LatLng::FromDegrees(-19 + 2 * i, -19 + 2 * j);
+      rings.push_back(RingSpec{center, 0.8, true});
+      rings.push_back(RingSpec{center, 0.4});
+    }
+  }
+  MutableS2ShapeIndex index;
+  int id = index.Add(RingShape(8, rings));
+
+  S2ShapeNestingQuery query(&index);
+  vector<S2ShapeNestingQuery::ChainRelation> expected =
+      query.ComputeShapeNesting(id);
+  ASSERT_EQ(expected.size(), rings.size());
+  EXPECT_TRUE(expected[0].is_shell());
+  EXPECT_EQ(expected[0].num_holes(), 400);
+  for (int chain = 1; chain < rings.size(); chain += 2) {
+    EXPECT_EQ(expected[chain].parent_id(), 0);
+    EXPECT_TRUE(expected[chain + 1].is_shell());
+  }
+
+  S2ThreadPool pool(3);
+  for (int num_threads : {2, 4}) {
+    S2ShapeNestingQuery::Options options;
+    options.set_num_threads(num_threads);
+    if (num_threads == 4) options.set_executor(&pool);
+    query.Init(&index, options);
+    vector<S2ShapeNestingQuery::ChainRelation> relations =
+        query.ComputeShapeNesting(id);
+    ASSERT_EQ(relations.size(), expected.size());
+    for (int chain = 0; chain < relations.size(); ++chain) {
+      EXPECT_EQ(relations[chain].parent_id(), expected[chain].parent_id());
+      EXPECT_EQ(relations[chain].holes(), expected[chain].holes());
+    }
+  }
+}
+
 struct NestingTestCase {
   int depth;        // How many nested loops to generate
   int first_chain;  // Which nested loop is the first loop in the list
@@ -17,12 +17,17 @@
 
 #include "s2/s2shapeutil_coding.h"
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
 #include "s2/encoded_s2point_vector.h"
 #include "s2/encoded_string_vector.h"
+#include "s2/s2executor.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
 #include "s2/s2point_vector_shape.h"
@@ -31,6 +36,7 @@
 #include "s2/s2wrapped_shape.h"
 
 using std::make_shared;
+using std::string;
 using absl::make_unique;
 using std::unique_ptr;
 using std::vector;
@@ -148,6 +154,86 @@ bool CompactEncodeTaggedShapes(const S2ShapeIndex& index, Encoder* encoder) {
   return EncodeTaggedShapes(index, CompactEncodeShape, encoder);
 }
 
+bool EncodeTaggedShapes(const S2ShapeIndex& index,
+                        const ShapeEncoder& shape_encoder, int num_threads,
+                        Encoder* encoder, S2Executor* executor) {
+  S2_DCHECK_GE(num_threads, 1);
+  // Shapes are encoded in groups of consecutive shape ids, and each group is
+  // encoded into its own buffer by whichever thread claims it.
+  constexpr int kShapesPerGroup = 256;
+  const int num_shapes = index.num_shape_ids();
+  const int num_groups = (num_shapes + kShapesPerGroup - 1) / kShapesPerGroup;
+  num_threads =
+      std::max(1, std::min(S2NumThreads(executor, num_threads), num_groups));
+  if (num_threads == 1) {
+    return EncodeTaggedShapes(index, shape_encoder, encoder);
+  }
+
+  vector<s2coding::StringVectorEncoder> groups(num_groups);
+  std::atomic<int> next_group(0);
+  std::atomic<bool> ok(true);
+  auto encode_groups = [&]() {
+    for (int g; ok && (g = next_group.fetch_add(1)) < num_groups; ) {
+      int end = std::min(num_shapes, (g + 1) * kShapesPerGroup);
+      for (int id = g * kShapesPerGroup; id < end; ++id) {
+        S2Shape* shape = index.shape(id);
+        Encoder* sub_encoder = groups[g].AddViaEncoder();
+        if (shape == nullptr) continue;  // Encode as zero bytes.
+
+        sub_encoder->Ensure(Encoder::kVarintMax32);
+        sub_encoder->put_varint32(shape->type_tag());
+        if (!shape_encoder(*shape, sub_encoder)) {
+          ok = false;
+          return;
+        }
+      }
+    }
+  };
+  S2ParallelFor(executor, num_threads, [&](int) { encode_groups(); });
+  if (!ok) return false;
+  s2coding::StringVectorEncoder::Encode(groups, encoder);
+  return true;
+}
+
+bool FastEncodeTaggedShapes(const S2ShapeIndex& index, int num_threads,
+                            Encoder* encoder, S2Executor* executor) {
+  return EncodeTaggedShapes(index, FastEncodeShape, num_threads, encoder,
+                            executor);
+}
+
+bool CompactEncodeTaggedShapes(const S2ShapeIndex& index, int num_threads,
+                               Encoder* encoder, S2Executor* executor) {
+  return EncodeTaggedShapes(index, CompactEncodeShape, num_threads, encoder,
+                            executor);
+}
+
+bool EncodeDedupedTaggedShapes(const S2ShapeIndex& index,
+                               const ShapeEncoder& shape_encoder,
+                               Encoder* encoder) {
+  // Maps each distinct encoding to its position in "shape_vector".
+  absl::flat_hash_map<string, uint32> encoding_map;
+  s2coding::StringVectorEncoder shape_vector;
+  vector<uint32> encodings;
+  encodings.reserve(index.num_shape_ids());
+  Encoder shape_encoding;
+  for (S2Shape* shape : index) {
+    shape_encoding.clear();
+    if (shape != nullptr) {  // Null shapes are encoded as zero bytes.
+      shape_encoding.Ensure(Encoder::kVarintMax32);
+      shape_encoding.put_varint32(shape->type_tag());
+      if (!shape_encoder(*shape, &shape_encoding)) return false;
+    }
+    auto ins = encoding_map.emplace(
+        string(shape_encoding.base(), shape_encoding.length()),
+        encoding_map.size());
+    if (ins.second) shape_vector.Add(ins.first->first);
+    encodings.push_back(ins.first->second);
+  }
+  shape_vector.Encode(encoder);
+  s2coding::EncodeUintVector<uint32>(encodings, encoder);
+  return true;
+}
+
 TaggedShapeFactory::TaggedShapeFactory(const ShapeDecoder& shape_decoder,
                                        Decoder* decoder)
     : shape_decoder_(shape_decoder) {
@@ -161,6 +247,25 @@ unique_ptr<S2Shape> TaggedShapeFactory::operator[](int shape_id) const {
   return shape_decoder_(tag, &decoder);
 }
 
+DedupedTaggedShapeFactory::DedupedTaggedShapeFactory(
+    const ShapeDecoder& shape_decoder, Decoder* decoder)
+    : shape_decoder_(shape_decoder) {
+  if (!encoded_shapes_.Init(decoder) || !encodings_.Init(decoder)) {
+    encoded_shapes_.Clear();
+    encodings_.Clear();
+  }
+}
+
+unique_ptr<S2Shape> DedupedTaggedShapeFactory::operator[](
+    int shape_id) const {
+  uint32 i = encodings_[shape_id];
+  if (i >= encoded_shapes_.size()) return nullptr;
+  Decoder decoder = encoded_shapes_.GetDecoder(i);
+  S2Shape::TypeTag tag;
+  if (!decoder.get_varint32(&tag)) return nullptr;
+  return shape_decoder_(tag, &decoder);
+}
+
 TaggedShapeFactory FullDecodeShapeFactory(Decoder* decoder) {
   return TaggedShapeFactory(FullDecodeShape, decoder);
 }
@@ -169,6 +274,28 @@ TaggedShapeFactory LazyDecodeShapeFactory(Decoder* decoder) {
   return TaggedShapeFactory(LazyDecodeShape, decoder);
 }
 
+ByteSourceTaggedShapeFactory::ByteSourceTaggedShapeFactory(
+    const ShapeDecoder& shape_decoder)
+    : shape_decoder_(shape_decoder),
+      encoded_shapes_(make_shared<S2ByteSourceStringVector>()) {
+}
+
+bool ByteSourceTaggedShapeFactory::Init(const S2ByteSource* source,
+                                        uint64* offset) {
+  encoded_shapes_ = make_shared<S2ByteSourceStringVector>();
+  return encoded_shapes_->Init(source, offset);
+}
+
+unique_ptr<S2Shape> ByteSourceTaggedShapeFactory::operator[](
+    int shape_id) const {
+  string data;
+  if (!encoded_shapes_->Read(shape_id, &data)) return nullptr;
+  Decoder decoder(data.data(), data.size());
+  S2Shape::TypeTag tag;
+  if (!decoder.get_varint32(&tag)) return nullptr;
+  return shape_decoder_(tag, &decoder);
+}
+
 VectorShapeFactory::VectorShapeFactory(vector<unique_ptr<S2Shape>> shapes)
     : shared_shapes_(
           make_shared<vector<unique_ptr<S2Shape>>>(std::move(shapes))) {
@@ -38,6 +38,9 @@
 
 #include "s2/util/coding/coder.h"
 #include "s2/encoded_string_vector.h"
+#include "s2/encoded_uint_vector.h"
+#include "s2/s2byte_source.h"
+#include "s2/s2executor.h"
 #include "s2/s2shape.h"
 #include "s2/s2shape_index.h"
 
@@ -134,6 +137,39 @@ bool FastEncodeTaggedShapes(const S2ShapeIndex& index, Encoder* encoder);
 //           can be enlarged as necessary by calling Ensure(int).
 bool CompactEncodeTaggedShapes(const S2ShapeIndex& index, Encoder* encoder);
 
+// Like the functions above, but uses up to "num_threads" threads (including
+// the calling thread) to encode the shapes.  Each thread encodes groups of
+// consecutive shapes into its own buffers, which are then concatenated.  The
+// output is identical to the single-threaded version.  If "executor" is
+// non-null the groups are encoded on it, and "num_threads" is replaced by
+// executor->num_threads().
+//
+// REQUIRES: "shape_encoder" and index.shape() are safe to call concurrently
+//           (which is true of the standard encoders and index types).
+// REQUIRES: "encoder" uses the default constructor, so that its buffer
+//           can be enlarged as necessary by calling Ensure(int).
+bool EncodeTaggedShapes(const S2ShapeIndex& index,
+                        const ShapeEncoder& shape_encoder, int num_threads,
+                        Encoder* encoder, S2Executor* executor = nullptr);
+bool FastEncodeTaggedShapes(const S2ShapeIndex& index, int num_threads,
+                            Encoder* encoder, S2Executor* executor = nullptr);
+bool CompactEncodeTaggedShapes(const S2ShapeIndex& index, int num_threads,
+                               Encoder* encoder,
+                               S2Executor* executor = nullptr);
+
+// Like EncodeTaggedShapes(), but stores each distinct shape encoding only
+// once.  Shapes whose encodings (including the type tag) are identical are
+// found by hashing, and each shape id then refers to the single stored copy.
+// This reduces the encoding size when many shapes are exact copies of each
+// other (e.g., the same building footprint in several layers).  The result
+// must be decoded using DedupedTaggedShapeFactory.
+//
+// REQUIRES: "encoder" uses the default constructor, so that its buffer
+//           can be enlarged as necessary by calling Ensure(int).
+bool EncodeDedupedTaggedShapes(const S2ShapeIndex& index,
+                               const ShapeEncoder& shape_encoder,
+                               Encoder* encoder);
+
 // A ShapeFactory that decodes a vector generated by EncodeTaggedShapes()
 // above.  Example usage:
 //
@@ -163,6 +199,41 @@ class TaggedShapeFactory : public S2ShapeIndex::ShapeFactory {
   s2coding::EncodedStringVector encoded_shapes_;
 };
 
+// A ShapeFactory that decodes a vector generated by
+// EncodeDedupedTaggedShapes().  Each shape id still yields its own S2Shape,
+// but when LazyDecodeShape is used the shapes that share an encoding also
+// share the underlying encoded data.  Example usage:
+//
+//   index.Init(decoder, s2shapeutil::DedupedTaggedShapeFactory(
+//       s2shapeutil::LazyDecodeShape, decoder));
+//
+// REQUIRES: The Decoder data buffer must outlive all calls to the given
+//           ShapeFactory (not including its destructor).
+class DedupedTaggedShapeFactory : public S2ShapeIndex::ShapeFactory {
+ public:
+  // Returns an empty vector and/or null S2Shapes on decoding errors.
+  DedupedTaggedShapeFactory(const ShapeDecoder& shape_decoder,
+                            Decoder* decoder);
+
+  int size() const override { return encodings_.size(); }
+
+  // Returns the number of distinct shape encodings.
+  int num_encodings() const { return encoded_shapes_.size(); }
+
+  std::unique_ptr<S2Shape> operator[](int shape_id) const override;
+
+  std::unique_ptr<ShapeFactory> Clone() const override {
+    return absl::make_unique<DedupedTaggedShapeFactory>(*this);
+  }
+
+ private:
+  ShapeDecoder shape_decoder_;
+  s2coding::EncodedStringVector encoded_shapes_;
+
+  // The position of each shape's encoding in "encoded_shapes_".
+  s2coding::EncodedUintVector<uint32> encodings_;
+};
+
 // Convenience function that calls TaggedShapeFactory using FullDecodeShape
 // as the ShapeDecoder.
 TaggedShapeFactory FullDecodeShapeFactory(Decoder* decoder);
@@ -171,6 +242,44 @@ TaggedShapeFactory FullDecodeShapeFactory(Decoder* decoder);
 // as the ShapeDecoder.
 TaggedShapeFactory LazyDecodeShapeFactory(Decoder* decoder);
 
+// A ShapeFactory that reads a vector generated by EncodeTaggedShapes() from
+// an S2ByteSource, reading each shape only when it is requested (see
+// EncodedS2ShapeIndex::Init(const S2ByteSource*, ...)).  Only the offsets of
+// the shapes are kept in memory.  Example usage:
+//
+//   ByteSourceTaggedShapeFactory shape_factory;
+//   if (!shape_factory.Init(source, &offset) ||
+//       !index.Init(source, &offset, shape_factory)) { ... }
+//
+// Since each shape is decoded from a temporary buffer, "shape_decoder" must
+// produce shapes that do not refer to the encoded data (e.g. FullDecodeShape,
+// but not LazyDecodeShape).
+class ByteSourceTaggedShapeFactory : public S2ShapeIndex::ShapeFactory {
+ public:
+  explicit ByteSourceTaggedShapeFactory(
+      const ShapeDecoder& shape_decoder = FullDecodeShape);
+
+  // Reads the shape offsets from the encoding at "*offset" in "source", and
+  // advances "*offset" past the end of the encoded shapes.  Returns false on
+  // errors.  The source must outlive this object and its clones.
+  bool Init(const S2ByteSource* source, uint64* offset);
+
+  int size() const override { return encoded_shapes_->size(); }
+
+  // Returns nullptr on read or decoding errors.
+  std::unique_ptr<S2Shape> operator[](int shape_id) const override;
+
+  std::unique_ptr<ShapeFactory> Clone() const override {
+    return absl::make_unique<ByteSourceTaggedShapeFactory>(*this);
+  }
+
+ private:
+  ShapeDecoder shape_decoder_;
+
+  // Since this class is copyable, the offsets are shared between clones.
+  std::shared_ptr<S2ByteSourceStringVector> encoded_shapes_;
+};
+
 // A ShapeFactory that simply returns shapes from the given vector.
 //
 // REQUIRES: Each shape is requested at most once.  (This implies that when
@@ -23,7 +23,9 @@
 
 #include <gtest/gtest.h>
 #include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
 #include "s2/util/coding/coder.h"
+#include "s2/s2executor.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
 #include "s2/s2point_vector_shape.h"
@@ -61,6 +63,68 @@ TEST(FastEncodeTaggedShapes, MixedShapes) {
             s2textformat::ToString(decoded_index));
 }
 
+TEST(EncodeTaggedShapes, MultipleThreads) {
+  // The output must be identical to the single-threaded encoding, including
+  // the encoding of removed (null) shapes.
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 1000; ++i) {
+    index.Add(s2textformat::MakeLaxPolylineOrDie(
+        absl::StrCat(i % 90, ":0, ", i % 90, ":", 1 + i / 90)));
+  }
+  index.Release(17);
+  index.Release(600);
+  for (bool compact : {false, true}) {
+    Encoder expected;
+    ASSERT_TRUE(compact ? CompactEncodeTaggedShapes(index, &expected)
+                        : FastEncodeTaggedShapes(index, &expected));
+    for (int num_threads : {1, 2, 8}) {
+      Encoder actual;
+      ASSERT_TRUE(compact
+                      ? CompactEncodeTaggedShapes(index, num_threads, &actual)
+                      : FastEncodeTaggedShapes(index, num_threads, &actual));
+      EXPECT_EQ(string(expected.base(), expected.length()),
+                string(actual.base(), actual.length()));
+    }
+    S2ThreadPool pool(4);
+    Encoder actual;
+    ASSERT_TRUE(compact
+                    ? CompactEncodeTaggedShapes(index, 1, &actual, &pool)
+                    : FastEncodeTaggedShapes(index, 1, &actual, &pool));
+    EXPECT_EQ(string(expected.base(), expected.length()),
+              string(actual.base(), actual.length()));
+  }
+}
+
+TEST(EncodeDedupedTaggedShapes, DuplicateShapes) {
+  MutableS2ShapeIndex index;
+  for (int i = 0; i < 100; ++i) {
+    index.Add(s2textformat::MakeLaxPolygonOrDie(
+        absl::StrCat(i % 3, ":0, ", i % 3, ":1, ", 1 + i % 3, ":0")));
+  }
+  index.Add(s2textformat::MakeLaxPolylineOrDie("5:5, 6:6"));
+  index.Release(17);
+  for (bool lazy : {false, true}) {
+    Encoder encoder;
+    ASSERT_TRUE(EncodeDedupedTaggedShapes(index, FastEncodeShape, &encoder));
+    Encoder expected;
+    ASSERT_TRUE(FastEncodeTaggedShapes(index, &expected));
+    EXPECT_LT(encoder.length(), expected.length() / 10);
+    index.Encode(&encoder);
+
+    Decoder decoder(encoder.base(), encoder.length());
+    DedupedTaggedShapeFactory factory(
+        lazy ? LazyDecodeShape : FullDecodeShape, &decoder);
+    EXPECT_EQ(index.num_shape_ids(), factory.size());
+    // Three distinct polygons, one polyline, and one null shape.
+    EXPECT_EQ(5, factory.num_encodings());
+    MutableS2ShapeIndex decoded_index;
+    ASSERT_TRUE(decoded_index.Init(&decoder, factory));
+    EXPECT_EQ(nullptr, decoded_index.shape(17));
+    EXPECT_EQ(s2textformat::ToString(index),
+              s2textformat::ToString(decoded_index));
+  }
+}
+
 TEST(DecodeTaggedShapes, DecodeFromByteString) {
   auto index = s2textformat::MakeIndexOrDie(
       "0:0 | 0:1 # 1:1, 1:2, 1:3 # 2:2; 2:3, 2:4, 3:3");
@@ -0,0 +1,103 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shapeutil_get_edges.h"
+
+#include <typeinfo>
+
+#include "s2/base/logging.h"
+#include "s2/s2lax_polygon_shape.h"
+#include "s2/s2lax_polyline_shape.h"
+#include "s2/s2point_vector_shape.h"
+#include "s2/s2polygon.h"
+#include "s2/s2polyline.h"
+
+namespace s2shapeutil {
+
+namespace {
+
+// Fetches edges[i] = shape.edge(edge_id(i)) for 0 <= i < n.  Since edge()
+// is declared "final" in all the shape types below, these calls are not
+// virtual when "ShapeType" is a concrete type.
+template <class ShapeType, class EdgeIdFunction>
+void GetEdgesImpl(const ShapeType& shape, int n,
+                  const EdgeIdFunction& edge_id, S2Shape::Edge* edges) {
+  for (int i = 0; i < n; ++i) {
+    edges[i] = shape.edge(edge_id(i));
+  }
+}
+
+template <class ShapeType>
+bool HasType(const std::type_info& type) {
+  // Comparing addresses is much cheaper than type_info::operator==.  The only
+  // effect of a false negative (e.g., duplicate type_info objects across
+  // shared libraries) is that the slower virtual method calls are used.
+  return &type == &typeid(ShapeType);
+}
+
+// Determines the concrete type of "shape" by checking for an exact match
+// with each of the given types (since subtypes may override methods) and
+// calls GetEdgesImpl() with the first type that matches.
+template <class... ShapeTypes>
+struct EdgeGetter;
+
+template <>
+struct EdgeGetter<> {
+  template <class EdgeIdFunction>
+  static void Get(const std::type_info& type, const S2Shape& shape, int n,
+                  const EdgeIdFunction& edge_id, S2Shape::Edge* edges) {
+    GetEdgesImpl(shape, n, edge_id, edges);
+  }
+};
+
+template <class ShapeType, class... Rest>
+struct EdgeGetter<ShapeType, Rest...> {
+  template <class EdgeIdFunction>
+  static void Get(const std::type_info& type, const S2Shape& shape, int n,
+                  const EdgeIdFunction& edge_id, S2Shape::Edge* edges) {
+    if (HasType<ShapeType>(type)) {
+      GetEdgesImpl(static_cast<const ShapeType&>(shape), n, edge_id, edges);
+    } else {
+      EdgeGetter<Rest...>::Get(type, shape, n, edge_id, edges);
+    }
+  }
+};
+
+// The shape types that are dispatched statically, roughly in order of how
+// frequently they are used.
+using LibraryEdgeGetter = EdgeGetter<
+    S2Polygon::Shape, S2Polygon::OwningShape, S2LaxPolygonShape,
+    EncodedS2LaxPolygonShape, S2LaxPolylineShape, EncodedS2LaxPolylineShape,
+    S2Polyline::Shape, S2Polyline::OwningShape, S2PointVectorShape,
+    EncodedS2PointVectorShape>;
+
+}  // namespace
+
+void GetEdges(const S2Shape& shape, absl::Span<const ShapeEdgeId> ids,
+              S2Shape::Edge* edges) {
+  const ShapeEdgeId* data = ids.data();
+  LibraryEdgeGetter::Get(typeid(shape), shape, static_cast<int>(ids.size()),
+                         [data](int i) { return data[i].edge_id; }, edges);
+}
+
+void GetClippedEdges(const S2Shape& shape, const S2ClippedShape& clipped,
+                     int begin, int end, S2Shape::Edge* edges) {
+  S2_DCHECK(0 <= begin && begin <= end && end <= clipped.num_edges());
+  LibraryEdgeGetter::Get(
+      typeid(shape), shape, end - begin,
+      [&clipped, begin](int i) { return clipped.edge(begin + i); }, edges);
+}
+
+}  // namespace s2shapeutil
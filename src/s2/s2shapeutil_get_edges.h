@@ -0,0 +1,48 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2SHAPEUTIL_GET_EDGES_H_
+#define S2_S2SHAPEUTIL_GET_EDGES_H_
+
+#include "absl/types/span.h"
+#include "s2/s2shape.h"
+#include "s2/s2shape_index.h"
+#include "s2/s2shapeutil_shape_edge_id.h"
+
+namespace s2shapeutil {
+
+// Sets edges[i] = shape.edge(ids[i].edge_id) for all "i".  (The shape_id
+// field of "ids" is ignored.)
+//
+// This is equivalent to calling S2Shape::edge() in a loop, except that the
+// concrete type of "shape" is determined just once.  For the shape types
+// defined in this library (S2Polygon::Shape, S2LaxPolygonShape,
+// EncodedS2LaxPolylineShape, etc) the edges are then fetched using
+// non-virtual calls, which is significantly faster in the inner loops of
+// queries such as S2ContainsPointQuery and S2CrossingEdgeQuery.  Other shape
+// types simply use S2Shape::edge().
+void GetEdges(const S2Shape& shape, absl::Span<const ShapeEdgeId> ids,
+              S2Shape::Edge* edges);
+
+// Sets edges[i - begin] = shape.edge(clipped.edge(i)) for all "i" in the
+// range [begin, end), using the same method as above.
+//
+// REQUIRES: 0 <= begin <= end <= clipped.num_edges()
+void GetClippedEdges(const S2Shape& shape, const S2ClippedShape& clipped,
+                     int begin, int end, S2Shape::Edge* edges);
+
+}  // namespace s2shapeutil
+
+#endif  // S2_S2SHAPEUTIL_GET_EDGES_H_
@@ -0,0 +1,118 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shapeutil_get_edges.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "s2/util/coding/coder.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s2lax_loop_shape.h"
+#include "s2/s2lax_polygon_shape.h"
+#include "s2/s2lax_polyline_shape.h"
+#include "s2/s2point_vector_shape.h"
+#include "s2/s2polygon.h"
+#include "s2/s2polyline.h"
+#include "s2/s2text_format.h"
+#include "s2/s2wrapped_shape.h"
+
+using absl::make_unique;
+using s2shapeutil::ShapeEdgeId;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// Checks that GetEdges() and GetClippedEdges() return the same edges as
+// S2Shape::edge().
+void TestGetEdges(const S2Shape& shape) {
+  vector<ShapeEdgeId> ids;
+  for (int e = shape.num_edges() - 1; e >= 0; e -= 2) {
+    ids.push_back(ShapeEdgeId(shape.id(), e));
+  }
+  vector<S2Shape::Edge> edges(ids.size());
+  s2shapeutil::GetEdges(shape, ids, edges.data());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    EXPECT_EQ(shape.edge(ids[i].edge_id), edges[i]);
+  }
+
+  MutableS2ShapeIndex index;
+  index.Add(make_unique<S2WrappedShape>(&shape));
+  for (MutableS2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN);
+       !it.done(); it.Next()) {
+    const S2ClippedShape& clipped = it.cell().clipped(0);
+    int n = clipped.num_edges();
+    edges.resize(n);
+    s2shapeutil::GetClippedEdges(shape, clipped, n / 2, n, edges.data());
+    for (int i = n / 2; i < n; ++i) {
+      EXPECT_EQ(shape.edge(clipped.edge(i)), edges[i - n / 2]);
+    }
+  }
+}
+
+TEST(GetEdges, LibraryShapeTypes) {
+  auto polygon =
+      s2textformat::MakePolygonOrDie("0:0, 0:5, 5:5; 9:9, 9:12, 12:12");
+  TestGetEdges(S2Polygon::Shape(polygon.get()));
+  TestGetEdges(S2Polygon::OwningShape(absl::WrapUnique(polygon->Clone())));
+
+  auto polyline = s2textformat::MakePolylineOrDie("0:0, 0:5, 3:7, 8:8");
+  TestGetEdges(S2Polyline::Shape(polyline.get()));
+  TestGetEdges(S2Polyline::OwningShape(absl::WrapUnique(polyline->Clone())));
+
+  auto lax_polygon = s2textformat::MakeLaxPolygonOrDie("0:0, 0:5, 5:5; 7:7");
+  TestGetEdges(*lax_polygon);
+  auto lax_polyline = s2textformat::MakeLaxPolylineOrDie("0:0, 1:1, 2:0, 3:1");
+  TestGetEdges(*lax_polyline);
+  S2PointVectorShape points(s2textformat::ParsePointsOrDie("0:0, 1:1, 2:2"));
+  TestGetEdges(points);
+
+  // Encoded shape types.
+  Encoder encoder;
+  lax_polygon->Encode(&encoder, s2coding::CodingHint::FAST);
+  Decoder decoder(encoder.base(), encoder.length());
+  EncodedS2LaxPolygonShape encoded_polygon;
+  ASSERT_TRUE(encoded_polygon.Init(&decoder));
+  TestGetEdges(encoded_polygon);
+
+  Encoder encoder2;
+  lax_polyline->Encode(&encoder2, s2coding::CodingHint::COMPACT);
+  Decoder decoder2(encoder2.base(), encoder2.length());
+  EncodedS2LaxPolylineShape encoded_polyline;
+  ASSERT_TRUE(encoded_polyline.Init(&decoder2));
+  TestGetEdges(encoded_polyline);
+
+  Encoder encoder3;
+  points.Encode(&encoder3, s2coding::CodingHint::FAST);
+  Decoder decoder3(encoder3.base(), encoder3.length());
+  EncodedS2PointVectorShape encoded_points;
+  ASSERT_TRUE(encoded_points.Init(&decoder3));
+  TestGetEdges(encoded_points);
+}
+
+TEST(GetEdges, OtherShapeTypes) {
+  // Shape types that GetEdges() does not handle specially fall back to the
+  // virtual S2Shape::edge() method.
+  S2LaxLoopShape loop(s2textformat::ParsePointsOrDie("0:0, 0:3, 3:3, 3:0"));
+  TestGetEdges(loop);
+  S2LaxClosedPolylineShape closed(
+      s2textformat::ParsePointsOrDie("0:0, 0:3, 3:3"));
+  TestGetEdges(closed);
+}
+
+}  // namespace
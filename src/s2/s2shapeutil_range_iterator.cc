@@ -29,6 +29,11 @@ void RangeIterator::Next() {
   Refresh();
 }
 
+void RangeIterator::Seek(S2CellId target) {
+  it_.Seek(target);
+  Refresh();
+}
+
 void RangeIterator::SeekTo(const RangeIterator& target) {
   it_.Seek(target.range_min());
   // If the current cell does not overlap "target", it is possible that the
@@ -45,6 +45,9 @@ class RangeIterator {
   void Next();
   bool done() { return it_.done(); }
 
+  // Position the iterator at the first cell such that id() >= target.
+  void Seek(S2CellId target);
+
   // Position the iterator at the first cell that overlaps or follows
   // "target", i.e. such that range_max() >= target.range_min().
   void SeekTo(const RangeIterator& target);
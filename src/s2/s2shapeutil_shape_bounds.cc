@@ -0,0 +1,172 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shapeutil_shape_bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "s2/base/logging.h"
+#include "s2/r1interval.h"
+#include "s2/s1angle.h"
+#include "s2/s1interval.h"
+#include "s2/s2latlng.h"
+#include "s2/s2latlng_rect_bounder.h"
+#include "s2/s2shapeutil_contains_brute_force.h"
+#include "s2/util/endian/endian.h"
+
+using std::max;
+using std::min;
+using std::vector;
+
+namespace s2shapeutil {
+
+namespace {
+
+// The E7 representations of 90 and 180 degrees.
+constexpr int32 kMaxLatE7 = 900000000;
+constexpr int32 kMaxLngE7 = 1800000000;
+
+// Converts an E7 coordinate to radians, mapping the extreme values exactly to
+// "max_radians" so that the poles and the antimeridian are preserved.
+double E7ToRadians(int32 e7, int32 max_e7, double max_radians) {
+  if (e7 >= max_e7) return max_radians;
+  if (e7 <= -max_e7) return -max_radians;
+  return S1Angle::E7(e7).radians();
+}
+
+int32 FloorE7(double radians, int32 max_e7) {
+  double e7 = std::floor(S1Angle::Radians(radians).degrees() * 1e7);
+  return static_cast<int32>(max<double>(-max_e7, min<double>(max_e7, e7)));
+}
+
+int32 CeilE7(double radians, int32 max_e7) {
+  double e7 = std::ceil(S1Angle::Radians(radians).degrees() * 1e7);
+  return static_cast<int32>(max<double>(-max_e7, min<double>(max_e7, e7)));
+}
+
+void EncodeRect(const S2LatLngRect& rect, Encoder* encoder) {
+  int32 lat_lo = 1, lat_hi = 0, lng_lo = 1, lng_hi = 0;  // Empty.
+  if (!rect.is_empty()) {
+    // Expanding the rectangle by one E7 unit before rounding outward ensures
+    // that the bound remains conservative despite any errors in converting
+    // the E7 values back to radians.
+    S2LatLngRect r = rect.Expanded(S2LatLng::FromE7(1, 1));
+    lat_lo = FloorE7(r.lat().lo(), kMaxLatE7);
+    lat_hi = CeilE7(r.lat().hi(), kMaxLatE7);
+    if (r.lng().is_full()) {
+      lng_lo = -kMaxLngE7;
+      lng_hi = kMaxLngE7;
+    } else {
+      lng_lo = FloorE7(r.lng().lo(), kMaxLngE7);
+      lng_hi = CeilE7(r.lng().hi(), kMaxLngE7);
+      // Rounding an inverted interval outward can close the gap entirely.
+      if (r.lng().is_inverted() && lng_lo <= lng_hi) {
+        lng_lo = -kMaxLngE7;
+        lng_hi = kMaxLngE7;
+      }
+    }
+  }
+  encoder->put32(lat_lo);
+  encoder->put32(lat_hi);
+  encoder->put32(lng_lo);
+  encoder->put32(lng_hi);
+}
+
+}  // namespace
+
+S2LatLngRect GetRectBound(const S2Shape& shape) {
+  if (shape.is_full()) return S2LatLngRect::Full();
+  S2LatLngRect bound = S2LatLngRect::Empty();
+  if (shape.dimension() == 0) {
+    for (int e = 0; e < shape.num_edges(); ++e) {
+      bound.AddPoint(shape.edge(e).v0);
+    }
+    return bound;
+  }
+  // As with S2Loop, the bound of each chain includes the maximum latitudes
+  // attained along the interior of its edges.
+  for (int i = 0; i < shape.num_chains(); ++i) {
+    S2Shape::Chain chain = shape.chain(i);
+    if (chain.length == 0) continue;
+    S2LatLngRectBounder bounder;
+    for (int j = 0; j < chain.length; ++j) {
+      bounder.AddPoint(shape.chain_edge(i, j).v0);
+    }
+    bounder.AddPoint(shape.chain_edge(i, chain.length - 1).v1);
+    bound = bound.Union(bounder.GetBound());
+  }
+  if (shape.dimension() == 2) {
+    // A polygon may also contain one or both poles (see S2Loop::InitBound).
+    if (ContainsBruteForce(shape, S2Point(0, 0, 1))) {
+      bound = S2LatLngRect(R1Interval(bound.lat().lo(), M_PI_2),
+                           S1Interval::Full());
+    }
+    if (bound.lng().is_full() &&
+        ContainsBruteForce(shape, S2Point(0, 0, -1))) {
+      bound.mutable_lat()->set_lo(-M_PI_2);
+    }
+  }
+  return bound;
+}
+
+void EncodeShapeBounds(const S2ShapeIndex& index, Encoder* encoder) {
+  const int num_shape_ids = index.num_shape_ids();
+  encoder->Ensure(Encoder::kVarintMax32);
+  encoder->put_varint32(num_shape_ids);
+  for (int id = 0; id < num_shape_ids; ++id) {
+    const S2Shape* shape = index.shape(id);
+    encoder->Ensure(4 * sizeof(int32));
+    EncodeRect(shape ? GetRectBound(*shape) : S2LatLngRect::Empty(), encoder);
+  }
+  S2_DCHECK_GE(encoder->avail(), 0);
+}
+
+bool EncodedShapeBounds::Init(Decoder* decoder) {
+  uint32 num_shape_ids;
+  if (!decoder->get_varint32(&num_shape_ids)) return false;
+  if (num_shape_ids > decoder->avail() / kBoundSize) return false;
+  num_shape_ids_ = num_shape_ids;
+  data_ = decoder->skip(num_shape_ids * kBoundSize);
+  return true;
+}
+
+S2LatLngRect EncodedShapeBounds::GetRectBound(int shape_id) const {
+  S2_DCHECK_GE(shape_id, 0);
+  S2_DCHECK_LT(shape_id, num_shape_ids_);
+  const char* p = data_ + shape_id * kBoundSize;
+  const int32 lat_lo = LittleEndian::Load32(p);
+  const int32 lat_hi = LittleEndian::Load32(p + 4);
+  const int32 lng_lo = LittleEndian::Load32(p + 8);
+  const int32 lng_hi = LittleEndian::Load32(p + 12);
+  if (lat_lo > lat_hi) return S2LatLngRect::Empty();
+  R1Interval lat(E7ToRadians(lat_lo, kMaxLatE7, M_PI_2),
+                 E7ToRadians(lat_hi, kMaxLatE7, M_PI_2));
+  if (lng_lo == -kMaxLngE7 && lng_hi == kMaxLngE7) {
+    return S2LatLngRect(lat, S1Interval::Full());
+  }
+  return S2LatLngRect(lat, S1Interval(E7ToRadians(lng_lo, kMaxLngE7, M_PI),
+                                      E7ToRadians(lng_hi, kMaxLngE7, M_PI)));
+}
+
+void EncodedShapeBounds::GetShapeIdsThatMayIntersect(
+    const S2LatLngRect& rect, vector<int>* shape_ids) const {
+  for (int id = 0; id < num_shape_ids_; ++id) {
+    if (MayIntersect(id, rect)) shape_ids->push_back(id);
+  }
+}
+
+}  // namespace s2shapeutil
@@ -0,0 +1,96 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2SHAPEUTIL_SHAPE_BOUNDS_H_
+#define S2_S2SHAPEUTIL_SHAPE_BOUNDS_H_
+
+#include <vector>
+
+#include "s2/base/integral_types.h"
+#include "s2/s2latlng_rect.h"
+#include "s2/s2shape.h"
+#include "s2/s2shape_index.h"
+#include "s2/util/coding/coder.h"
+
+namespace s2shapeutil {
+
+// Returns a bounding latitude-longitude rectangle for the given shape.  The
+// bound is conservative: every point of the shape (including the interior of
+// polygons) is contained by the rectangle.  The running time is linear in the
+// number of edges.
+S2LatLngRect GetRectBound(const S2Shape& shape);
+
+// Encodes the bounding rectangle of every shape in the index, so that the
+// shapes of an EncodedS2ShapeIndex can be filtered by location without
+// decoding them (see EncodedShapeBounds below).  The bounds are stored as four
+// E7 coordinates (16 bytes) per shape, rounded outward so that they remain
+// conservative.  Missing (removed) shapes have empty bounds.
+//
+// This is a separate section rather than part of the index encoding, so that
+// existing encodings remain valid; typically it is written next to the
+// encoded shapes and index:
+//
+//   s2shapeutil::CompactEncodeTaggedShapes(index, &encoder);
+//   s2shapeutil::EncodeShapeBounds(index, &encoder);
+//   index.Encode(&encoder);
+//
+// REQUIRES: "encoder" uses the default constructor, so that its buffer
+//           can be enlarged as necessary by calling Ensure(int).
+void EncodeShapeBounds(const S2ShapeIndex& index, Encoder* encoder);
+
+// The bounds encoded by EncodeShapeBounds().  Individual bounds are decoded
+// only when they are accessed, so initialization takes constant time and no
+// memory is used beyond the encoded data.  All methods are thread-safe.
+class EncodedShapeBounds {
+ public:
+  // Constructs an uninitialized object; requires Init() to be called.
+  EncodedShapeBounds() {}
+
+  // Initializes the bounds and advances "decoder" past them.  Returns false
+  // if the encoding is invalid.
+  //
+  // REQUIRES: The Decoder data buffer must outlive this object.
+  bool Init(Decoder* decoder);
+
+  // Returns the number of shape ids, which is the same as the num_shape_ids()
+  // of the encoded index.
+  int num_shape_ids() const { return num_shape_ids_; }
+
+  // Returns the encoded bound of the given shape.  This bound is slightly
+  // larger than GetRectBound() due to rounding.
+  S2LatLngRect GetRectBound(int shape_id) const;
+
+  // Returns true if the given shape might intersect "rect".  Returns false
+  // only if the shape definitely does not intersect it.
+  bool MayIntersect(int shape_id, const S2LatLngRect& rect) const {
+    return GetRectBound(shape_id).Intersects(rect);
+  }
+
+  // Appends the ids of all shapes that might intersect "rect" to "shape_ids"
+  // in increasing order.
+  void GetShapeIdsThatMayIntersect(const S2LatLngRect& rect,
+                                   std::vector<int>* shape_ids) const;
+
+ private:
+  // The size of each encoded bound.
+  static constexpr int kBoundSize = 4 * sizeof(int32);
+
+  int num_shape_ids_ = 0;
+  const char* data_ = nullptr;
+};
+
+}  // namespace s2shapeutil
+
+#endif  // S2_S2SHAPEUTIL_SHAPE_BOUNDS_H_
@@ -0,0 +1,120 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shapeutil_shape_bounds.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2latlng.h"
+#include "s2/s2loop.h"
+#include "s2/s2polygon.h"
+#include "s2/s2polyline.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using s2textformat::MakeIndexOrDie;
+using s2textformat::MakePointOrDie;
+using std::vector;
+
+namespace s2shapeutil {
+
+namespace {
+
+TEST(GetRectBound, MatchesS2Polygon) {
+  // Includes a polygon containing the north pole and a hole.
+  for (const char* str : {"0:0, 0:10, 10:0", "80:0, 80:120, 80:-120",
+                          "0:0, 0:10, 10:10, 10:0; 2:2, 8:2, 8:8, 2:8",
+                          "full"}) {
+    auto polygon = s2textformat::MakePolygonOrDie(str);
+    S2Polygon::Shape shape(polygon.get());
+    EXPECT_EQ(polygon->GetRectBound(), GetRectBound(shape)) << str;
+  }
+  auto loop = S2Loop::MakeRegularLoop(MakePointOrDie("-89:-179"),
+                                      S1Angle::Degrees(10), 100);
+  S2Loop::Shape shape(loop.get());
+  EXPECT_EQ(loop->GetRectBound(), GetRectBound(shape));
+}
+
+TEST(GetRectBound, MatchesS2Polyline) {
+  for (const char* str :
+           {"0:0, 0:90", "0:179, 0:-179", "10:10, 20:20, 10:30"}) {
+    auto polyline = s2textformat::MakePolylineOrDie(str);
+    S2Polyline::Shape shape(polyline.get());
+    EXPECT_EQ(polyline->GetRectBound(), GetRectBound(shape)) << str;
+  }
+}
+
+TEST(GetRectBound, Points) {
+  auto index = MakeIndexOrDie("1:2 | 3:-4 # #");
+  S2LatLngRect expected = S2LatLngRect::FromPoint(
+      S2LatLng(MakePointOrDie("1:2")));
+  expected.AddPoint(MakePointOrDie("3:-4"));
+  EXPECT_EQ(expected, GetRectBound(*index->shape(0)));
+}
+
+TEST(EncodedShapeBounds, Basic) {
+  auto index = MakeIndexOrDie(
+      "1:2 | 3:-4 # 0:179, 0:-179 # 0:0, 0:10, 10:0; 80:0, 80:120, 80:-120");
+  index->Add(make_unique<S2Polygon::OwningShape>(
+      make_unique<S2Polygon>(make_unique<S2Loop>(S2Loop::kFull()))));
+  index->Add(make_unique<S2Polygon::OwningShape>(make_unique<S2Polygon>()));
+  index->Release(2);  // Shape 2 is now missing.
+
+  Encoder encoder;
+  EncodeShapeBounds(*index, &encoder);
+  EXPECT_EQ(1 + 16 * index->num_shape_ids(), encoder.length());
+  Decoder decoder(encoder.base(), encoder.length());
+  EncodedShapeBounds bounds;
+  ASSERT_TRUE(bounds.Init(&decoder));
+  EXPECT_EQ(0, decoder.avail());
+  ASSERT_EQ(index->num_shape_ids(), bounds.num_shape_ids());
+  for (int id = 0; id < index->num_shape_ids(); ++id) {
+    const S2Shape* shape = index->shape(id);
+    S2LatLngRect expected =
+        shape ? GetRectBound(*shape) : S2LatLngRect::Empty();
+    S2LatLngRect actual = bounds.GetRectBound(id);
+    EXPECT_TRUE(actual.Contains(expected)) << id << ": " << actual;
+    EXPECT_TRUE(actual.ApproxEquals(expected, S1Angle::E7(3)))
+        << id << ": " << actual;
+  }
+  EXPECT_TRUE(bounds.GetRectBound(1).lng().is_inverted());
+  EXPECT_TRUE(bounds.GetRectBound(2).is_empty());
+  EXPECT_TRUE(bounds.GetRectBound(3).is_full());
+  EXPECT_TRUE(bounds.GetRectBound(4).is_empty());
+
+  vector<int> shape_ids;
+  bounds.GetShapeIdsThatMayIntersect(
+      S2LatLngRect(S2LatLng::FromDegrees(-1, 178),
+                   S2LatLng::FromDegrees(1, 179.5)), &shape_ids);
+  EXPECT_EQ((vector<int>{1, 3}), shape_ids);
+}
+
+TEST(EncodedShapeBounds, TruncatedEncoding) {
+  auto index = MakeIndexOrDie("1:2 # 0:0, 1:1 #");
+  Encoder encoder;
+  EncodeShapeBounds(*index, &encoder);
+  Decoder decoder(encoder.base(), encoder.length() - 1);
+  EncodedShapeBounds bounds;
+  EXPECT_FALSE(bounds.Init(&decoder));
+}
+
+}  // namespace
+
+}  // namespace s2shapeutil
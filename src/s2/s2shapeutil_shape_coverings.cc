@@ -0,0 +1,114 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shapeutil_shape_coverings.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "s2/base/logging.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2executor.h"
+
+using std::max;
+using std::min;
+using std::pair;
+using std::vector;
+
+namespace s2shapeutil {
+
+namespace {
+
+// The index cells are divided into ranges according to their ancestor at
+// this level, giving 384 ranges that are claimed by the threads one at a
+// time.
+constexpr int kRangeLevel = 3;
+
+// Shapes are canonicalized in groups of this size.
+constexpr int kShapesPerGroup = 64;
+
+}  // namespace
+
+vector<S2CellUnion> GetShapeCoverings(const S2ShapeIndex& index,
+                                      const S2RegionCoverer::Options& options,
+                                      int num_threads) {
+  S2_DCHECK_GE(num_threads, 1);
+  S2Executor* executor = options.executor();
+  num_threads = max(1, S2NumThreads(executor, num_threads));
+
+  // Creating an iterator brings the index up to date, so that the threads
+  // below only read it.
+  if (S2ShapeIndex::Iterator(&index, S2ShapeIndex::BEGIN).done()) {
+    return vector<S2CellUnion>(index.num_shape_ids());
+  }
+
+  // For each range, find the (shape_id, cell_id) pairs of the index cells
+  // whose range_min() belongs to it.  (Index cells may be larger than the
+  // ranges.)
+  const int num_ranges = 6 << (2 * kRangeLevel);
+  vector<vector<pair<int, S2CellId>>> presence(num_ranges);
+  // Each thread claims one range at a time.
+  std::atomic<int> next_range(0);
+  S2ParallelFor(executor, min(num_threads, num_ranges), [&](int) {
+    S2ShapeIndex::Iterator it(&index);
+    for (int r; (r = next_range.fetch_add(1)) < num_ranges; ) {
+      S2CellId range = S2CellId::Begin(kRangeLevel).advance(r);
+      S2CellId lo = range.range_min(), hi = range.range_max();
+      it.Seek(lo);
+      if (!it.done() && it.id().range_min() < lo) it.Next();
+      for (; !it.done() && it.id().range_min() <= hi; it.Next()) {
+        const S2ShapeIndexCell& cell = it.cell();
+        for (int i = 0; i < cell.num_clipped(); ++i) {
+          presence[r].emplace_back(cell.clipped(i).shape_id(), it.id());
+        }
+      }
+    }
+  });
+
+  // Distribute the cells to the shapes.  Since the ranges are in S2CellId
+  // order, the cells of each shape are sorted.
+  vector<vector<S2CellId>> cell_ids(index.num_shape_ids());
+  for (auto& range : presence) {
+    for (const auto& entry : range) {
+      cell_ids[entry.first].push_back(entry.second);
+    }
+    vector<pair<int, S2CellId>>().swap(range);
+  }
+
+  // Finally canonicalize the coverings.
+  S2RegionCoverer::Options coverer_options = options;
+  coverer_options.set_memory_tracker(nullptr);
+  const int num_shape_ids = index.num_shape_ids();
+  vector<S2CellUnion> result(num_shape_ids);
+  const int num_groups = (num_shape_ids + kShapesPerGroup - 1) /
+                         kShapesPerGroup;
+  std::atomic<int> next_group(0);
+  S2ParallelFor(executor, min(num_threads, num_groups), [&](int) {
+    S2RegionCoverer coverer(coverer_options);
+    for (int g; (g = next_group.fetch_add(1)) < num_groups; ) {
+      int end = min(num_shape_ids, (g + 1) * kShapesPerGroup);
+      for (int i = g * kShapesPerGroup; i < end; ++i) {
+        if (cell_ids[i].empty()) continue;
+        coverer.CanonicalizeCovering(&cell_ids[i]);
+        result[i] = S2CellUnion::FromVerbatim(std::move(cell_ids[i]));
+      }
+    }
+  });
+  return result;
+}
+
+}  // namespace s2shapeutil
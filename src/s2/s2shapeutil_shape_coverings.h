@@ -0,0 +1,53 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2SHAPEUTIL_SHAPE_COVERINGS_H_
+#define S2_S2SHAPEUTIL_SHAPE_COVERINGS_H_
+
+#include <vector>
+
+#include "s2/s2cell_union.h"
+#include "s2/s2region_coverer.h"
+#include "s2/s2shape_index.h"
+
+namespace s2shapeutil {
+
+// Returns a covering of every shape in the index, such that result[i] covers
+// index.shape(i).  Missing (removed) shapes have empty coverings.
+//
+// Rather than covering each shape with an S2RegionCoverer, the coverings are
+// computed in a single pass over the index cells: a shape's covering is the
+// union of the index cells where the shape is present (i.e., where the shape
+// has edges or contains the cell), which is then canonicalized to satisfy
+// "options" (see S2RegionCoverer::CanonicalizeCovering).  The coverings are
+// therefore only as fine as the index cells.  This is much faster than
+// covering each shape separately when the index has many shapes (since each
+// index cell is visited once rather than once per shape), but coverings of
+// shapes in sparse parts of the index may be coarser.
+//
+// The index cells are divided into ranges that are processed using up to
+// "num_threads" threads, and the coverings are then canonicalized using the
+// same threads.  The results do not depend on the number of threads.  If
+// options.executor() is non-null the threads are taken from it, and
+// "num_threads" is replaced by executor->num_threads().
+//
+// Note that options.memory_tracker() is ignored.
+std::vector<S2CellUnion> GetShapeCoverings(
+    const S2ShapeIndex& index, const S2RegionCoverer::Options& options,
+    int num_threads = 1);
+
+}  // namespace s2shapeutil
+
+#endif  // S2_S2SHAPEUTIL_SHAPE_COVERINGS_H_
@@ -0,0 +1,135 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shapeutil_shape_coverings.h"
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "s2/base/casts.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2cap.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2cell_union.h"
+#include "s2/s2executor.h"
+#include "s2/s2loop.h"
+#include "s2/s2point_vector_shape.h"
+#include "s2/s2polyline.h"
+#include "s2/s2region_coverer.h"
+#include "s2/s2testing.h"
+
+using absl::make_unique;
+using std::vector;
+
+namespace s2shapeutil {
+
+namespace {
+
+// Returns an index of small loops, polylines, and points scattered around a
+// region of the sphere, where shape 3 has been removed.
+std::unique_ptr<MutableS2ShapeIndex> MakeTestIndex() {
+  S2Testing::rnd.Reset(1);
+  auto index = make_unique<MutableS2ShapeIndex>();
+  S2Cap region(S2Testing::RandomPoint(), S1Angle::Degrees(5));
+  for (int i = 0; i < 100; ++i) {
+    S2Point center = S2Testing::SamplePoint(region);
+    S1Angle radius = S1Angle::Degrees(0.5 * S2Testing::rnd.RandDouble());
+    switch (i % 3) {
+      case 0:
+        index->Add(make_unique<S2Loop::OwningShape>(
+            S2Loop::MakeRegularLoop(center, radius, 8)));
+        break;
+      case 1:
+        index->Add(make_unique<S2Polyline::OwningShape>(
+            make_unique<S2Polyline>(vector<S2Point>{
+                center, S2Testing::SamplePoint(S2Cap(center, radius))})));
+        break;
+      default:
+        index->Add(make_unique<S2PointVectorShape>(vector<S2Point>{center}));
+    }
+  }
+  index->Release(3);
+  return index;
+}
+
+TEST(GetShapeCoverings, CoversShapes) {
+  auto index = MakeTestIndex();
+  S2RegionCoverer::Options options;
+  options.set_max_cells(6);
+  vector<S2CellUnion> coverings = GetShapeCoverings(*index, options, 1);
+  ASSERT_EQ(index->num_shape_ids(), coverings.size());
+  EXPECT_TRUE(coverings[3].empty());
+  S2RegionCoverer coverer(options);
+  for (int i = 0; i < index->num_shape_ids(); ++i) {
+    const S2Shape* shape = index->shape(i);
+    if (shape == nullptr) continue;
+    EXPECT_TRUE(coverer.IsCanonical(coverings[i]));
+    for (int e = 0; e < shape->num_edges(); ++e) {
+      EXPECT_TRUE(coverings[i].Contains(shape->edge(e).v0));
+      EXPECT_TRUE(coverings[i].Contains(shape->edge(e).v1));
+    }
+    if (shape->dimension() == 2) {
+      // The loops are small, so they contain their centroid.
+      S2Point center = down_cast<const S2Loop::Shape*>(shape)
+                           ->loop()->GetCentroid().Normalize();
+      EXPECT_TRUE(coverings[i].Contains(center));
+    }
+  }
+}
+
+TEST(GetShapeCoverings, MatchesIndexCells) {
+  // Without limits, each covering is the union of the index cells where the
+  // shape is present.
+  auto index = MakeTestIndex();
+  S2RegionCoverer::Options options;
+  options.set_max_cells(1 << 30);
+  vector<vector<S2CellId>> expected(index->num_shape_ids());
+  for (MutableS2ShapeIndex::Iterator it(index.get(), S2ShapeIndex::BEGIN);
+       !it.done(); it.Next()) {
+    for (int i = 0; i < it.cell().num_clipped(); ++i) {
+      expected[it.cell().clipped(i).shape_id()].push_back(it.id());
+    }
+  }
+  vector<S2CellUnion> coverings = GetShapeCoverings(*index, options, 1);
+  for (int i = 0; i < index->num_shape_ids(); ++i) {
+    EXPECT_EQ(S2CellUnion(expected[i]), coverings[i]);
+  }
+}
+
+TEST(GetShapeCoverings, MultipleThreads) {
+  auto index = MakeTestIndex();
+  S2RegionCoverer::Options options;
+  options.set_max_cells(4);
+  options.set_level_mod(2);
+  vector<S2CellUnion> expected = GetShapeCoverings(*index, options, 1);
+  for (int num_threads : {2, 8}) {
+    EXPECT_EQ(expected, GetShapeCoverings(*index, options, num_threads));
+  }
+  S2ThreadPool pool(4);
+  options.set_executor(&pool);
+  EXPECT_EQ(expected, GetShapeCoverings(*index, options));
+}
+
+TEST(GetShapeCoverings, EmptyIndex) {
+  MutableS2ShapeIndex index;
+  EXPECT_TRUE(GetShapeCoverings(index, S2RegionCoverer::Options(), 4).empty());
+}
+
+}  // namespace
+
+}  // namespace s2shapeutil
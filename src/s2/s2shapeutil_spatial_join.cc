@@ -0,0 +1,296 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shapeutil_spatial_join.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "s2/base/integral_types.h"
+#include "s2/s2cell_id.h"
+#include "s2/s2contains_point_query.h"
+#include "s2/s2edge_crosser.h"
+#include "s2/s2executor.h"
+#include "s2/s2shapeutil_range_iterator.h"
+
+using std::vector;
+
+namespace s2shapeutil {
+
+namespace {
+
+// The minimum number of index cells (or candidate pairs) that are worth
+// processing in a separate thread.
+constexpr int kMinCellsPerThread = 100;
+
+// Maps each candidate pair to whether the two shapes are already known to
+// intersect.
+using CandidateMap = absl::flat_hash_map<ShapeIdPair, bool>;
+
+// ShapeJoiner merges the index cells of A and B within a given S2CellId
+// range, recording each pair of shapes that appear in overlapping cells.
+// When "test_edges" is true it also tests the edges of each such pair for
+// crossings, which proves that the shapes intersect.
+class ShapeJoiner {
+ public:
+  ShapeJoiner(const S2ShapeIndex& a_index, const S2ShapeIndex& b_index,
+              bool test_edges)
+      : a_index_(a_index), b_index_(b_index), test_edges_(test_edges) {
+  }
+
+  // Processes the index cells between the leaf cell ids "begin" (inclusive)
+  // and "end" (exclusive), which must not fall strictly inside any index
+  // cell of A or B.
+  void Join(S2CellId begin, S2CellId end);
+
+  CandidateMap* mutable_candidates() { return &candidates_; }
+
+ private:
+  // Records all pairs of shapes in the given overlapping index cells.
+  void JoinCells(const S2ShapeIndexCell& a_cell,
+                 const S2ShapeIndexCell& b_cell);
+
+  // Returns true if any edge of "a_clipped" crosses any edge of "b_clipped".
+  bool EdgesCross(const S2ClippedShape& a_clipped,
+                  const S2ClippedShape& b_clipped) const;
+
+  const S2ShapeIndex& a_index_;
+  const S2ShapeIndex& b_index_;
+  const bool test_edges_;
+  CandidateMap candidates_;
+};
+
+void ShapeJoiner::Join(S2CellId begin, S2CellId end) {
+  RangeIterator ai(a_index_), bi(b_index_);
+  ai.Seek(begin);
+  bi.Seek(begin);
+  while (ai.range_min() < end && bi.range_min() < end) {
+    if (ai.range_max() < bi.range_min()) {
+      // The A and B cells don't overlap, and A precedes B.
+      ai.SeekTo(bi);
+    } else if (bi.range_max() < ai.range_min()) {
+      // The A and B cells don't overlap, and B precedes A.
+      bi.SeekTo(ai);
+    } else {
+      // One cell contains the other.  Join the larger cell with every cell
+      // of the other index that it contains.
+      int64 ab_relation = ai.id().lsb() - bi.id().lsb();
+      if (ab_relation > 0) {
+        do {
+          JoinCells(ai.cell(), bi.cell());
+          bi.Next();
+        } while (bi.range_min() <= ai.range_max());
+        ai.Next();
+      } else if (ab_relation < 0) {
+        do {
+          JoinCells(ai.cell(), bi.cell());
+          ai.Next();
+        } while (ai.range_min() <= bi.range_max());
+        bi.Next();
+      } else {
+        JoinCells(ai.cell(), bi.cell());
+        ai.Next();
+        bi.Next();
+      }
+    }
+  }
+}
+
+void ShapeJoiner::JoinCells(const S2ShapeIndexCell& a_cell,
+                            const S2ShapeIndexCell& b_cell) {
+  for (int i = 0; i < a_cell.num_clipped(); ++i) {
+    const S2ClippedShape& a_clipped = a_cell.clipped(i);
+    for (int j = 0; j < b_cell.num_clipped(); ++j) {
+      const S2ClippedShape& b_clipped = b_cell.clipped(j);
+      bool& intersects = candidates_[ShapeIdPair(a_clipped.shape_id(),
+                                                 b_clipped.shape_id())];
+      if (intersects || !test_edges_) continue;
+      if (a_clipped.num_edges() == 0 && b_clipped.num_edges() == 0) {
+        // Both shapes contain the entire cell.
+        intersects = true;
+      } else {
+        intersects = EdgesCross(a_clipped, b_clipped);
+      }
+    }
+  }
+}
+
+bool ShapeJoiner::EdgesCross(const S2ClippedShape& a_clipped,
+                             const S2ClippedShape& b_clipped) const {
+  const S2Shape& a_shape = *a_index_.shape(a_clipped.shape_id());
+  const S2Shape& b_shape = *b_index_.shape(b_clipped.shape_id());
+  for (int i = 0; i < a_clipped.num_edges(); ++i) {
+    S2Shape::Edge a = a_shape.edge(a_clipped.edge(i));
+    S2CopyingEdgeCrosser crosser(a.v0, a.v1);
+    for (int j = 0; j < b_clipped.num_edges(); ++j) {
+      S2Shape::Edge b = b_shape.edge(b_clipped.edge(j));
+      if (crosser.CrossingSign(b.v0, b.v1) >= 0) return true;
+    }
+  }
+  return false;
+}
+
+// Returns the largest leaf cell id that is less than or equal to "split" and
+// does not fall strictly inside any index cell of A or B.
+S2CellId AdjustSplit(const S2ShapeIndex& a_index, const S2ShapeIndex& b_index,
+                     S2CellId split) {
+  S2ShapeIndex::Iterator ai(&a_index), bi(&b_index);
+  for (;;) {
+    // Moving the split to the start of a cell of one index may move it
+    // inside a cell of the other index, so repeat until neither index has a
+    // cell that contains it.
+    S2CellId old_split = split;
+    if (ai.Locate(split) == S2ShapeIndex::INDEXED) split = ai.id().range_min();
+    if (bi.Locate(split) == S2ShapeIndex::INDEXED) split = bi.id().range_min();
+    if (split == old_split) return split;
+  }
+}
+
+// Returns the number of cells in the given index.
+int CountCells(const S2ShapeIndex& index) {
+  int num_cells = 0;
+  for (S2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN);
+       !it.done(); it.Next()) {
+    ++num_cells;
+  }
+  return num_cells;
+}
+
+// Merges the two indexes using up to "num_threads" threads, and returns the
+// candidate pairs (see ShapeJoiner).
+CandidateMap JoinIndexes(const S2ShapeIndex& a_index,
+                         const S2ShapeIndex& b_index, bool test_edges,
+                         int num_threads, S2Executor* executor) {
+  // Choose the split points using the cells of the index with more cells.
+  vector<S2CellId> cell_ids;
+  if (num_threads > 1) {
+    const S2ShapeIndex& split_index =
+        CountCells(a_index) >= CountCells(b_index) ? a_index : b_index;
+    for (S2ShapeIndex::Iterator it(&split_index, S2ShapeIndex::BEGIN);
+         !it.done(); it.Next()) {
+      cell_ids.push_back(it.id());
+    }
+  }
+  const int num_cells = cell_ids.size();
+  num_threads = std::max(1, std::min(num_threads,
+                                     num_cells / kMinCellsPerThread));
+  vector<S2CellId> splits(num_threads + 1);
+  splits[0] = S2CellId::Begin(S2CellId::kMaxLevel);
+  splits[num_threads] = S2CellId::Sentinel();
+  for (int t = 1; t < num_threads; ++t) {
+    S2CellId split = cell_ids[int64{num_cells} * t / num_threads].range_min();
+    splits[t] = std::max(splits[t - 1], AdjustSplit(a_index, b_index, split));
+  }
+  vector<ShapeJoiner> joiners(num_threads,
+                              ShapeJoiner(a_index, b_index, test_edges));
+  S2ParallelFor(executor, num_threads, [&joiners, &splits](int t) {
+    joiners[t].Join(splits[t], splits[t + 1]);
+  });
+
+  // A pair of shapes may appear in the ranges of several threads.
+  CandidateMap* candidates = joiners[0].mutable_candidates();
+  for (int t = 1; t < num_threads; ++t) {
+    for (const auto& entry : *joiners[t].mutable_candidates()) {
+      (*candidates)[entry.first] |= entry.second;
+    }
+  }
+  return std::move(*candidates);
+}
+
+// Returns the pairs in the given map in sorted order.
+vector<ShapeIdPair> GetSortedPairs(const CandidateMap& candidates) {
+  vector<ShapeIdPair> result;
+  result.reserve(candidates.size());
+  for (const auto& entry : candidates) result.push_back(entry.first);
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// Returns true if "x_shape" is a polygon that contains the first vertex of
+// any chain of "y_shape".  (Each chain is connected, so if "x_shape" and
+// "y_shape" do not have any edge crossings then every chain of "y_shape" is
+// either entirely inside or entirely outside "x_shape".)
+bool ContainsAnyChain(S2ContainsPointQuery<S2ShapeIndex>* x_query,
+                      const S2Shape& x_shape, const S2Shape& y_shape) {
+  if (x_shape.dimension() < 2) return false;
+  for (int i = 0; i < y_shape.num_chains(); ++i) {
+    if (y_shape.chain(i).length == 0) continue;
+    if (x_query->ShapeContains(x_shape, y_shape.chain_edge(i, 0).v0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+vector<ShapeIdPair> GetCandidateShapePairs(const S2ShapeIndex& a_index,
+                                           const S2ShapeIndex& b_index,
+                                           int num_threads,
+                                           S2Executor* executor) {
+  num_threads = S2NumThreads(executor, num_threads);
+  return GetSortedPairs(
+      JoinIndexes(a_index, b_index, false, num_threads, executor));
+}
+
+vector<ShapeIdPair> GetIntersectingShapePairs(const S2ShapeIndex& a_index,
+                                              const S2ShapeIndex& b_index,
+                                              int num_threads,
+                                              S2Executor* executor) {
+  num_threads = S2NumThreads(executor, num_threads);
+  CandidateMap candidates =
+      JoinIndexes(a_index, b_index, true, num_threads, executor);
+
+  // The remaining candidates intersect only if one shape contains the other
+  // (since their edges do not cross).  These are tested in parallel by
+  // dividing them into contiguous blocks.
+  vector<ShapeIdPair> untested;
+  for (const auto& entry : candidates) {
+    if (!entry.second) untested.push_back(entry.first);
+  }
+  const int num_untested = untested.size();
+  num_threads = std::max(1, std::min(num_threads,
+                                     num_untested / kMinCellsPerThread));
+  auto test_block = [&](int t) {
+    S2ContainsPointQueryOptions options(S2VertexModel::CLOSED);
+    auto a_query = MakeS2ContainsPointQuery(&a_index, options);
+    auto b_query = MakeS2ContainsPointQuery(&b_index, options);
+    int begin = int64{num_untested} * t / num_threads;
+    int end = int64{num_untested} * (t + 1) / num_threads;
+    for (int i = begin; i < end; ++i) {
+      const S2Shape& a_shape = *a_index.shape(untested[i].first);
+      const S2Shape& b_shape = *b_index.shape(untested[i].second);
+      if (!ContainsAnyChain(&a_query, a_shape, b_shape) &&
+          !ContainsAnyChain(&b_query, b_shape, a_shape)) {
+        untested[i].first = -1;  // Mark the pair as disjoint.
+      }
+    }
+  };
+  S2ParallelFor(executor, num_threads, test_block);
+
+  vector<ShapeIdPair> result;
+  for (const auto& entry : candidates) {
+    if (entry.second) result.push_back(entry.first);
+  }
+  for (const ShapeIdPair& pair : untested) {
+    if (pair.first >= 0) result.push_back(pair);
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+}  // namespace s2shapeutil
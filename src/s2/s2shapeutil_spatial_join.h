@@ -0,0 +1,65 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2SHAPEUTIL_SPATIAL_JOIN_H_
+#define S2_S2SHAPEUTIL_SPATIAL_JOIN_H_
+
+#include <utility>
+#include <vector>
+
+#include "s2/s2executor.h"
+#include "s2/s2shape_index.h"
+
+namespace s2shapeutil {
+
+// A pair (a_shape_id, b_shape_id) consisting of a shape id from the first
+// index followed by a shape id from the second index.
+using ShapeIdPair = std::pair<int, int>;
+
+// Returns all pairs of shapes (one from each index) that might intersect,
+// i.e. that both appear in some pair of overlapping index cells.  This is a
+// superset of the pairs returned by GetIntersectingShapePairs(), and is much
+// cheaper to compute.  The result is sorted and has no duplicates.
+//
+// The two indexes are merged by iterating over their cells in S2CellId
+// order, and when "num_threads" > 1 the S2CellId range is split into up to
+// that many contiguous pieces that are processed concurrently.  (Small
+// indexes are processed using fewer threads.)  If "executor" is non-null the
+// pieces are processed on it, and "num_threads" is replaced by
+// executor->num_threads().
+std::vector<ShapeIdPair> GetCandidateShapePairs(
+    const S2ShapeIndex& a_index, const S2ShapeIndex& b_index,
+    int num_threads = 1, S2Executor* executor = nullptr);
+
+// Returns all pairs of shapes (one from each index) that intersect.  Shapes
+// are considered to be closed, i.e. two shapes intersect if their edges
+// cross or share a vertex, or if one shape is a polygon that contains some
+// point of the other shape.  (Point containment is defined as for
+// S2ContainsPointQuery with S2VertexModel::CLOSED; note that polylines do
+// not contain any points other than their vertices.)  The result is sorted
+// and has no duplicates.
+//
+// This is much faster than testing each candidate pair separately (e.g.,
+// using S2BooleanOperation::Intersects), because the edge crossings are
+// found while the two indexes are merged.  Only the candidate pairs whose
+// boundaries do not intersect need further point containment tests.  The
+// "num_threads" and "executor" arguments are as above.
+std::vector<ShapeIdPair> GetIntersectingShapePairs(
+    const S2ShapeIndex& a_index, const S2ShapeIndex& b_index,
+    int num_threads = 1, S2Executor* executor = nullptr);
+
+}  // namespace s2shapeutil
+
+#endif  // S2_S2SHAPEUTIL_SPATIAL_JOIN_H_
@@ -0,0 +1,148 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/s2shapeutil_spatial_join.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "absl/memory/memory.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
+#include "s2/s2boolean_operation.h"
+#include "s2/s2cap.h"
+#include "s2/s2executor.h"
+#include "s2/s2loop.h"
+#include "s2/s2point_vector_shape.h"
+#include "s2/s2polyline.h"
+#include "s2/s2testing.h"
+#include "s2/s2text_format.h"
+#include "s2/s2wrapped_shape.h"
+
+using absl::make_unique;
+using std::vector;
+
+namespace s2shapeutil {
+
+namespace {
+
+// Adds a mixture of random loops, polylines, and points within "cap".
+void AddRandomShapes(const S2Cap& cap, MutableS2ShapeIndex* index) {
+  for (int i = 0; i < 40; ++i) {
+    index->Add(make_unique<S2Loop::OwningShape>(S2Loop::MakeRegularLoop(
+        S2Testing::SamplePoint(cap),
+        0.2 * S2Testing::rnd.RandDouble() * cap.GetRadius(), 10)));
+  }
+  for (int i = 0; i < 20; ++i) {
+    vector<S2Point> vertices;
+    for (int j = 0; j < 3; ++j) {
+      vertices.push_back(S2Testing::SamplePoint(cap));
+    }
+    index->Add(make_unique<S2Polyline::OwningShape>(
+        make_unique<S2Polyline>(vertices)));
+  }
+  vector<S2Point> points;
+  for (int i = 0; i < 20; ++i) {
+    points.push_back(S2Testing::SamplePoint(cap));
+  }
+  index->Add(make_unique<S2PointVectorShape>(std::move(points)));
+}
+
+// Returns the intersecting pairs by testing every pair of shapes using
+// S2BooleanOperation.
+vector<ShapeIdPair> GetIntersectingShapePairsBruteForce(
+    const S2ShapeIndex& a_index, const S2ShapeIndex& b_index) {
+  S2BooleanOperation::Options options;
+  options.set_polygon_model(S2BooleanOperation::PolygonModel::CLOSED);
+  options.set_polyline_model(S2BooleanOperation::PolylineModel::CLOSED);
+  vector<ShapeIdPair> result;
+  for (const S2Shape* a_shape : a_index) {
+    MutableS2ShapeIndex a_shape_index;
+    a_shape_index.Add(make_unique<S2WrappedShape>(a_shape));
+    for (const S2Shape* b_shape : b_index) {
+      MutableS2ShapeIndex b_shape_index;
+      b_shape_index.Add(make_unique<S2WrappedShape>(b_shape));
+      if (S2BooleanOperation::Intersects(a_shape_index, b_shape_index,
+                                         options)) {
+        result.push_back(ShapeIdPair(a_shape->id(), b_shape->id()));
+      }
+    }
+  }
+  return result;
+}
+
+TEST(GetIntersectingShapePairs, NoIntersections) {
+  auto a = s2textformat::MakeIndexOrDie("0:0 # 1:1, 1:2 # 5:5, 5:6, 6:5");
+  auto b = s2textformat::MakeIndexOrDie(
+      "3:3 # 3:4, 4:4 # 10:10, 10:11, 11:10");
+  EXPECT_EQ(vector<ShapeIdPair>{}, GetIntersectingShapePairs(*a, *b));
+}
+
+TEST(GetIntersectingShapePairs, AllDimensions) {
+  // Shape 0 of A is a point inside polygon 2 of B, shape 1 is a polyline
+  // that shares a vertex with polyline 1 of B, and shape 2 is a polygon that
+  // contains polygon 2 of B.
+  auto a = s2textformat::MakeIndexOrDie(
+      "0.5:0.5 # 5:5, 5:6 # -1:-1, -1:3, 3:3, 3:-1");
+  auto b = s2textformat::MakeIndexOrDie(
+      "20:20 # 5:6, 6:6 # 0:0, 0:1, 1:1, 1:0");
+  vector<ShapeIdPair> expected = {{0, 2}, {1, 1}, {2, 2}};
+  EXPECT_EQ(expected, GetIntersectingShapePairs(*a, *b));
+  vector<ShapeIdPair> candidates = GetCandidateShapePairs(*a, *b);
+  EXPECT_TRUE(std::includes(candidates.begin(), candidates.end(),
+                            expected.begin(), expected.end()));
+}
+
+TEST(GetIntersectingShapePairs, FullPolygon) {
+  auto a = s2textformat::MakeIndexOrDie("# # full");
+  auto b = s2textformat::MakeIndexOrDie("1:1 # 3:3, 4:4 #");
+  vector<ShapeIdPair> expected = {{0, 0}, {0, 1}};
+  EXPECT_EQ(expected, GetIntersectingShapePairs(*a, *b));
+  vector<ShapeIdPair> reversed = {{0, 0}, {1, 0}};
+  EXPECT_EQ(reversed, GetIntersectingShapePairs(*b, *a));
+}
+
+TEST(GetIntersectingShapePairs, RandomShapesMatchBruteForce) {
+  S2Testing::rnd.Reset(1);
+  const S2Cap cap(S2Testing::RandomPoint(), S2Testing::KmToAngle(100));
+  // Use small index cells so that several threads are used.
+  MutableS2ShapeIndex::Options options;
+  options.set_max_edges_per_cell(1);
+  MutableS2ShapeIndex a(options), b(options);
+  AddRandomShapes(cap, &a);
+  AddRandomShapes(cap, &b);
+  vector<ShapeIdPair> expected = GetIntersectingShapePairsBruteForce(a, b);
+  EXPECT_FALSE(expected.empty());
+  vector<ShapeIdPair> candidates = GetCandidateShapePairs(a, b);
+  EXPECT_TRUE(std::includes(candidates.begin(), candidates.end(),
+                            expected.begin(), expected.end()));
+  EXPECT_LT(candidates.size(), a.num_shape_ids() * b.num_shape_ids());
+  EXPECT_GE(a.GetStats().num_cells, 4 * 100);
+  for (int num_threads : {1, 4}) {
+    EXPECT_EQ(expected, GetIntersectingShapePairs(a, b, num_threads));
+    EXPECT_EQ(candidates, GetCandidateShapePairs(a, b, num_threads));
+  }
+  S2ThreadPool pool(4);
+  EXPECT_EQ(expected, GetIntersectingShapePairs(a, b, 1, &pool));
+  EXPECT_EQ(candidates, GetCandidateShapePairs(a, b, 1, &pool));
+}
+
+}  // namespace
+
+}  // namespace s2shapeutil
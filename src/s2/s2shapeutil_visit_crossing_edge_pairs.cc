@@ -17,9 +17,15 @@
 
 #include "s2/s2shapeutil_visit_crossing_edge_pairs.h"
 
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "absl/types/span.h"
 #include "s2/s2crossing_edge_query.h"
 #include "s2/s2edge_crosser.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
 #include "s2/s2shapeutil_range_iterator.h"
 #include "s2/s2wedge_relations.h"
 
@@ -124,12 +130,97 @@ static bool VisitCrossings(
   return true;
 }
 
+// The minimum number of index cells that are worth visiting in a separate
+// thread.
+static constexpr int kMinCellsPerThread = 100;
+
+// Like VisitCrossings() above, but only visits the index cells in "cell_ids"
+// (which must be consecutive cells of "index").  This is called by thread
+// "thread", and it returns false without visiting any further cells as soon
+// as *stop_thread < thread (see VisitCrossingsInParallel).
+static bool VisitCrossings(
+    const S2ShapeIndex& index, absl::Span<const S2CellId> cell_ids,
+    CrossingType type, bool need_adjacent, int thread,
+    const std::atomic<int>* stop_thread, const EdgePairVisitor& visitor) {
+  if (cell_ids.empty()) return true;
+  ShapeEdgeVector shape_edges;
+  S2ShapeIndex::Iterator it(&index);
+  it.Seek(cell_ids[0]);
+  for (S2CellId id : cell_ids) {
+    S2_DCHECK_EQ(id, it.id());
+    if (stop_thread->load(std::memory_order_relaxed) < thread) return false;
+    GetShapeEdges(index, it.cell(), &shape_edges);
+    if (!VisitCrossings(shape_edges, type, need_adjacent, visitor)) {
+      return false;
+    }
+    it.Next();
+  }
+  return true;
+}
+
+// Splits the cells of "index" into at most "num_threads" ranges of
+// consecutive cells, and visits the crossings in each range using a separate
+// thread.  The visitor for range "t" is make_visitor(t, &stop_thread).
+// Every thread whose index is greater than "stop_thread" stops as soon as
+// possible, so a visitor can cancel all threads by setting stop_thread to
+// -1, or cancel only the threads visiting later cells by setting it to "t".
+//
+// Returns false if any visitor returned false.
+template <class MakeVisitor>
+static bool VisitCrossingsInParallel(const S2ShapeIndex& index,
+                                     CrossingType type, bool need_adjacent,
+                                     int num_threads, S2Executor* executor,
+                                     const MakeVisitor& make_visitor) {
+  vector<S2CellId> cell_ids;
+  for (S2ShapeIndex::Iterator it(&index, S2ShapeIndex::BEGIN);
+       !it.done(); it.Next()) {
+    cell_ids.push_back(it.id());
+  }
+  const int num_cells = cell_ids.size();
+  num_threads = std::max(1, std::min(num_threads,
+                                     num_cells / kMinCellsPerThread));
+  std::atomic<int> stop_thread(num_threads);
+  std::atomic<bool> result(true);
+  auto visit_range = [&](int t) {
+    int begin = int64{num_cells} * t / num_threads;
+    int end = int64{num_cells} * (t + 1) / num_threads;
+    EdgePairVisitor visitor = make_visitor(t, &stop_thread);
+    if (!VisitCrossings(index, absl::MakeConstSpan(cell_ids).subspan(
+                                   begin, end - begin),
+                        type, need_adjacent, t, &stop_thread, visitor)) {
+      result = false;
+    }
+  };
+  S2ParallelFor(executor, num_threads, visit_range);
+  return result;
+}
+
 bool VisitCrossingEdgePairs(const S2ShapeIndex& index, CrossingType type,
                             const EdgePairVisitor& visitor) {
   const bool need_adjacent = (type == CrossingType::ALL);
   return VisitCrossings(index, type, need_adjacent, visitor);
 }
 
+bool VisitCrossingEdgePairs(const S2ShapeIndex& index, CrossingType type,
+                            const EdgePairVisitor& visitor, int num_threads,
+                            S2Executor* executor) {
+  const bool need_adjacent = (type == CrossingType::ALL);
+  num_threads = S2NumThreads(executor, num_threads);
+  if (num_threads <= 1) {
+    return VisitCrossings(index, type, need_adjacent, visitor);
+  }
+  return VisitCrossingsInParallel(
+      index, type, need_adjacent, num_threads, executor,
+      [&visitor](int t, std::atomic<int>* stop_thread) {
+        return [&visitor, stop_thread](const ShapeEdge& a, const ShapeEdge& b,
+                                       bool is_interior) {
+          if (visitor(a, b, is_interior)) return true;
+          stop_thread->store(-1, std::memory_order_relaxed);
+          return false;
+        };
+      });
+}
+
 //////////////////////////////////////////////////////////////////////
 
 // IndexCrosser is a helper class for finding the edge crossings between a
@@ -307,18 +398,29 @@ bool IndexCrosser::VisitCrossings(RangeIterator* ai, RangeIterator* bi) {
   return true;
 }
 
-bool VisitCrossingEdgePairs(const S2ShapeIndex& a_index,
-                            const S2ShapeIndex& b_index,
-                            CrossingType type, const EdgePairVisitor& visitor) {
+// Visits the crossings between the edges of A and B in index cells between
+// the leaf cell ids "begin" (inclusive) and "end" (exclusive), which must not
+// fall strictly inside any index cell of A or B.  Terminates early and
+// returns false if the visitor returns false or (when "stop" is non-null)
+// *stop becomes true.
+static bool VisitCrossings(const S2ShapeIndex& a_index,
+                           const S2ShapeIndex& b_index, CrossingType type,
+                           const EdgePairVisitor& visitor, S2CellId begin,
+                           S2CellId end, const std::atomic<bool>* stop) {
   // We look for S2CellId ranges where the indexes of A and B overlap, and
   // then test those edges for crossings.
 
   // TODO(ericv): Use brute force if the total number of edges is small enough
   // (using a larger threshold if the S2ShapeIndex is not constructed yet).
   RangeIterator ai(a_index), bi(b_index);
+  ai.Seek(begin);
+  bi.Seek(begin);
   IndexCrosser ab(a_index, b_index, type, visitor, false);  // Tests A against B
   IndexCrosser ba(b_index, a_index, type, visitor, true);   // Tests B against A
-  while (!ai.done() || !bi.done()) {
+  while (ai.range_min() < end || bi.range_min() < end) {
+    if (stop != nullptr && stop->load(std::memory_order_relaxed)) {
+      return false;
+    }
     if (ai.range_max() < bi.range_min()) {
       // The A and B cells don't overlap, and A precedes B.
       ai.SeekTo(bi);
@@ -347,6 +449,78 @@ bool VisitCrossingEdgePairs(const S2ShapeIndex& a_index,
   return true;
 }
 
+bool VisitCrossingEdgePairs(const S2ShapeIndex& a_index,
+                            const S2ShapeIndex& b_index,
+                            CrossingType type, const EdgePairVisitor& visitor) {
+  return VisitCrossings(a_index, b_index, type, visitor,
+                        S2CellId::Begin(S2CellId::kMaxLevel),
+                        S2CellId::Sentinel(), nullptr);
+}
+
+// Returns the largest leaf cell id that is less than or equal to "split" and
+// does not fall strictly inside any index cell of A or B.
+static S2CellId AdjustSplit(const S2ShapeIndex& a_index,
+                            const S2ShapeIndex& b_index, S2CellId split) {
+  S2ShapeIndex::Iterator ai(&a_index), bi(&b_index);
+  for (;;) {
+    // Moving the split to the start of a containing cell of one index may
+    // move it inside a cell of the other index, so repeat until neither
+    // index has a cell that contains it.  (This terminates because the split
+    // only moves backwards, to the start of a larger cell each time.)
+    S2CellId old_split = split;
+    if (ai.Locate(split) == S2ShapeIndex::INDEXED) split = ai.id().range_min();
+    if (bi.Locate(split) == S2ShapeIndex::INDEXED) split = bi.id().range_min();
+    if (split == old_split) return split;
+  }
+}
+
+bool VisitCrossingEdgePairs(const S2ShapeIndex& a_index,
+                            const S2ShapeIndex& b_index,
+                            CrossingType type, const EdgePairVisitor& visitor,
+                            int num_threads, S2Executor* executor) {
+  num_threads = S2NumThreads(executor, num_threads);
+  if (num_threads <= 1) {
+    return VisitCrossingEdgePairs(a_index, b_index, type, visitor);
+  }
+  // Choose the split points using the cells of the index with more cells.
+  vector<S2CellId> a_ids, b_ids;
+  for (S2ShapeIndex::Iterator it(&a_index, S2ShapeIndex::BEGIN);
+       !it.done(); it.Next()) {
+    a_ids.push_back(it.id());
+  }
+  for (S2ShapeIndex::Iterator it(&b_index, S2ShapeIndex::BEGIN);
+       !it.done(); it.Next()) {
+    b_ids.push_back(it.id());
+  }
+  const vector<S2CellId>& cell_ids = a_ids.size() >= b_ids.size() ? a_ids
+                                                                   : b_ids;
+  const int num_cells = cell_ids.size();
+  num_threads = std::max(1, std::min(num_threads,
+                                     num_cells / kMinCellsPerThread));
+  vector<S2CellId> splits(num_threads + 1);
+  splits[0] = S2CellId::Begin(S2CellId::kMaxLevel);
+  splits[num_threads] = S2CellId::Sentinel();
+  for (int t = 1; t < num_threads; ++t) {
+    S2CellId split = cell_ids[int64{num_cells} * t / num_threads].range_min();
+    splits[t] = std::max(splits[t - 1], AdjustSplit(a_index, b_index, split));
+  }
+  std::atomic<bool> stop(false);
+  auto visit_range = [&](int t) {
+    if (!VisitCrossings(
+            a_index, b_index, type,
+            [&](const ShapeEdge& a, const ShapeEdge& b, bool is_interior) {
+              if (visitor(a, b, is_interior)) return true;
+              stop.store(true, std::memory_order_relaxed);
+              return false;
+            },
+            splits[t], splits[t + 1], &stop)) {
+      stop.store(true, std::memory_order_relaxed);
+    }
+  };
+  S2ParallelFor(executor, num_threads, visit_range);
+  return !stop;
+}
+
 //////////////////////////////////////////////////////////////////////
 
 // Helper function that formats a loop error message.  If the loop belongs to
@@ -424,18 +598,55 @@ static bool FindCrossingError(const S2Shape& shape,
 }
 
 bool FindSelfIntersection(const S2ShapeIndex& index, S2Error* error) {
+  return FindSelfIntersection(index, error, 1);
+}
+
+bool FindSelfIntersection(const S2ShapeIndex& index, S2Error* error,
+                          int num_threads, S2Executor* executor) {
   if (index.num_shape_ids() == 0) return false;
+  num_threads = S2NumThreads(executor, num_threads);
   S2_DCHECK_EQ(1, index.num_shape_ids());
   const S2Shape& shape = *index.shape(0);
 
   // Visit all crossing pairs except possibly for ones of the form (AB, BC),
   // since such pairs are very common and FindCrossingError() only needs pairs
   // of the form (AB, AC).
-  return !VisitCrossings(
-      index, CrossingType::ALL, false /*need_adjacent*/,
-      [&](const ShapeEdge& a, const ShapeEdge& b, bool is_interior) {
-        return !FindCrossingError(shape, a, b, is_interior, error);
+  if (num_threads <= 1) {
+    return !VisitCrossings(
+        index, CrossingType::ALL, false /*need_adjacent*/,
+        [&](const ShapeEdge& a, const ShapeEdge& b, bool is_interior) {
+          return !FindCrossingError(shape, a, b, is_interior, error);
+        });
+  }
+  // Each thread records the first error in its own range of cells, and
+  // stops the threads that visit later cells.  The error reported is the one
+  // from the first range that has an error, which is the same error that is
+  // found by the single-threaded algorithm.
+  vector<S2Error> errors(num_threads);
+  vector<char> found(num_threads, false);
+  VisitCrossingsInParallel(
+      index, CrossingType::ALL, false /*need_adjacent*/, num_threads,
+      executor, [&](int t, std::atomic<int>* stop_thread) {
+        return [&, t, stop_thread](const ShapeEdge& a, const ShapeEdge& b,
+                                   bool is_interior) {
+          if (!FindCrossingError(shape, a, b, is_interior, &errors[t])) {
+            return true;
+          }
+          found[t] = true;
+          int old_stop = stop_thread->load(std::memory_order_relaxed);
+          while (t < old_stop && !stop_thread->compare_exchange_weak(
+                                     old_stop, t, std::memory_order_relaxed)) {
+          }
+          return false;
+        };
       });
+  for (int t = 0; t < num_threads; ++t) {
+    if (found[t]) {
+      *error = errors[t];
+      return true;
+    }
+  }
+  return false;
 }
 
 }  // namespace s2shapeutil
@@ -21,6 +21,7 @@
 #include <functional>
 
 #include "s2/s2crossing_edge_query.h"
+#include "s2/s2executor.h"
 #include "s2/s2shape_index.h"
 #include "s2/s2shapeutil_shape_edge.h"
 
@@ -47,6 +48,17 @@ using EdgePairVisitor = std::function<
 bool VisitCrossingEdgePairs(const S2ShapeIndex& index, CrossingType type,
                             const EdgePairVisitor& visitor);
 
+// As above, but partitions the index cells into contiguous ranges that are
+// visited by up to "num_threads" threads.  (Small indexes are visited using
+// fewer threads.)  The visitor may therefore be called concurrently from
+// several threads and must be thread-safe.  If the visitor returns false,
+// the other threads stop soon afterwards, although a few more crossings may
+// be visited in the meantime.  If "executor" is non-null the ranges are
+// visited on it, and "num_threads" is replaced by executor->num_threads().
+bool VisitCrossingEdgePairs(const S2ShapeIndex& index, CrossingType type,
+                            const EdgePairVisitor& visitor, int num_threads,
+                            S2Executor* executor = nullptr);
+
 // Like the above, but visits all pairs of crossing edges where one edge comes
 // from each S2ShapeIndex.
 //
@@ -55,6 +67,17 @@ bool VisitCrossingEdgePairs(const S2ShapeIndex& a_index,
                             const S2ShapeIndex& b_index,
                             CrossingType type, const EdgePairVisitor& visitor);
 
+// As above, but splits the S2CellId ranges covered by the two indexes into
+// up to "num_threads" contiguous pieces whose boundaries do not fall inside
+// any index cell, and visits the crossings within each piece using a
+// separate thread.  As with the single-index version, the visitor must be
+// thread-safe, and if it returns false the other threads stop soon
+// afterwards.  The "executor" argument is as above.
+bool VisitCrossingEdgePairs(const S2ShapeIndex& a_index,
+                            const S2ShapeIndex& b_index,
+                            CrossingType type, const EdgePairVisitor& visitor,
+                            int num_threads, S2Executor* executor = nullptr);
+
 // Given an S2ShapeIndex containing a single polygonal shape (e.g., an
 // S2Polygon or S2Loop), return true if any loop has a self-intersection
 // (including duplicate vertices) or crosses any other loop (including vertex
@@ -68,6 +91,12 @@ bool VisitCrossingEdgePairs(const S2ShapeIndex& a_index,
 // duplicate vertices and edges are allowed, but loop crossings are not).
 bool FindSelfIntersection(const S2ShapeIndex& index, S2Error* error);
 
+// As above, but uses up to "num_threads" threads to find the crossing edge
+// pairs (see S2ParallelFor for the meaning of "executor").  The result
+// (including the error) is the same as above.
+bool FindSelfIntersection(const S2ShapeIndex& index, S2Error* error,
+                          int num_threads, S2Executor* executor = nullptr);
+
 }  // namespace s2shapeutil
 
 #endif  // S2_S2SHAPEUTIL_VISIT_CROSSING_EDGE_PAIRS_H_
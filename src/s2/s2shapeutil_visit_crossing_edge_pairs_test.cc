@@ -26,11 +26,15 @@
 
 #include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 
 #include "s2/mutable_s2shape_index.h"
+#include "s2/s1angle.h"
 #include "s2/s2edge_crossings.h"
 #include "s2/s2edge_vector_shape.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
+#include "s2/s2latlng.h"
 #include "s2/s2loop.h"
 #include "s2/s2polygon.h"
 #include "s2/s2shapeutil_contains_brute_force.h"
@@ -127,6 +131,103 @@ TEST(GetCrossingEdgePairs, EdgeGrid) {
   TestGetCrossingEdgePairs(index, CrossingType::INTERIOR);
 }
 
+TEST(GetCrossingEdgePairs, MultipleThreads) {
+  // Check that the multi-threaded version visits the same crossings.
+  const int kGridSize = 60;
+  MutableS2ShapeIndex index;
+  auto shape = make_unique<S2EdgeVectorShape>();
+  for (int i = 0; i <= kGridSize; ++i) {
+    shape->Add(S2LatLng::FromDegrees(0, i).ToPoint(),
+              S2LatLng::FromDegrees(kGridSize, i).ToPoint());
+    shape->Add(S2LatLng::FromDegrees(i, 0).ToPoint(),
+              S2LatLng::FromDegrees(i, kGridSize).ToPoint());
+  }
+  index.Add(std::move(shape));
+  for (CrossingType type : {CrossingType::ALL, CrossingType::INTERIOR}) {
+    absl::Mutex mutex;
+    EdgePairVector edge_pairs;
+    EXPECT_TRUE(VisitCrossingEdgePairs(
+        index, type,
+        [&](const ShapeEdge& a, const ShapeEdge& b, bool) {
+          absl::MutexLock lock(&mutex);
+          edge_pairs.push_back(std::make_pair(a.id(), b.id()));
+          return true;
+        },
+        4));
+    std::sort(edge_pairs.begin(), edge_pairs.end());
+    edge_pairs.erase(std::unique(edge_pairs.begin(), edge_pairs.end()),
+                     edge_pairs.end());
+    EXPECT_EQ(GetCrossings(index, type), edge_pairs);
+
+    // Returning false stops the visit.
+    EXPECT_FALSE(VisitCrossingEdgePairs(
+        index, type, [](const ShapeEdge&, const ShapeEdge&, bool) {
+          return false;
+        }, 4));
+  }
+}
+
+// Returns the crossings between the two indexes, visited using the given
+// number of threads (see S2ParallelFor for the meaning of "executor").
+EdgePairVector GetCrossings(const S2ShapeIndex& a_index,
+                            const S2ShapeIndex& b_index, CrossingType type,
+                            int num_threads, S2Executor* executor = nullptr) {
+  absl::Mutex mutex;
+  EdgePairVector edge_pairs;
+  EXPECT_TRUE(VisitCrossingEdgePairs(
+      a_index, b_index, type,
+      [&](const ShapeEdge& a, const ShapeEdge& b, bool) {
+        absl::MutexLock lock(&mutex);
+        edge_pairs.push_back(std::make_pair(a.id(), b.id()));
+        return true;
+      },
+      num_threads, executor));
+  std::sort(edge_pairs.begin(), edge_pairs.end());
+  edge_pairs.erase(std::unique(edge_pairs.begin(), edge_pairs.end()),
+                   edge_pairs.end());
+  return edge_pairs;
+}
+
+TEST(VisitCrossingEdgePairs, TwoIndexesMultipleThreads) {
+  // Index A is a dense grid of short edges, while index B consists of a few
+  // long edges (so that its cells are much larger than those of A) plus a
+  // dense set of short edges in a different region.
+  MutableS2ShapeIndex a_index, b_index;
+  auto a_shape = make_unique<S2EdgeVectorShape>();
+  for (int i = 0; i < 100; ++i) {
+    for (int j = 0; j < 20; ++j) {
+      a_shape->Add(S2LatLng::FromDegrees(0.1 * i, 0.5 * j).ToPoint(),
+                   S2LatLng::FromDegrees(0.1 * i + 0.15, 0.5 * j).ToPoint());
+    }
+  }
+  a_index.Add(std::move(a_shape));
+  auto b_shape = make_unique<S2EdgeVectorShape>();
+  for (int j = 0; j < 5; ++j) {
+    b_shape->Add(S2LatLng::FromDegrees(-1, 2.1 * j).ToPoint(),
+                 S2LatLng::FromDegrees(11, 2.1 * j + 0.3).ToPoint());
+  }
+  for (int i = 0; i < 40; ++i) {
+    for (int j = 0; j < 40; ++j) {
+      b_shape->Add(S2LatLng::FromDegrees(0.2 * i, 0.2 * j + 5).ToPoint(),
+                   S2LatLng::FromDegrees(0.2 * i, 0.2 * j + 5.25).ToPoint());
+    }
+  }
+  b_index.Add(std::move(b_shape));
+  for (CrossingType type : {CrossingType::ALL, CrossingType::INTERIOR}) {
+    EdgePairVector expected = GetCrossings(a_index, b_index, type, 1);
+    EXPECT_FALSE(expected.empty());
+    for (int num_threads : {2, 3, 8}) {
+      EXPECT_EQ(expected, GetCrossings(a_index, b_index, type, num_threads));
+      EXPECT_FALSE(VisitCrossingEdgePairs(
+          a_index, b_index, type,
+          [](const ShapeEdge&, const ShapeEdge&, bool) { return false; },
+          num_threads));
+    }
+    S2ThreadPool pool(4);
+    EXPECT_EQ(expected, GetCrossings(a_index, b_index, type, 1, &pool));
+  }
+}
+
 // Return true if any loop crosses any other loop (including vertex crossings
 // and duplicate edges), or any loop has a self-intersection (including
 // duplicate vertices).
@@ -187,4 +288,31 @@ TEST(FindSelfIntersection, Basic) {
                   true);  // vertex crossing
 }
 
+TEST(FindSelfIntersection, MultipleThreads) {
+  // Check that the multi-threaded version reports the same error as the
+  // single-threaded version, i.e. the error in the first index cell.
+  const int kNumVertices = 20000;
+  unique_ptr<S2Loop> regular = S2Loop::MakeRegularLoop(
+      S2Point(1, 0, 0), S1Angle::Degrees(10), kNumVertices);
+  vector<S2Point> vertices(&regular->vertex(0),
+                           &regular->vertex(0) + kNumVertices);
+  S2Loop valid(vertices, S2Debug::DISABLE);
+  S2Error error;
+  EXPECT_FALSE(valid.FindValidationError(&error, 4));
+
+  // Create several crossings by swapping pairs of adjacent vertices.
+  for (int i : {17000, 5000, 12000}) std::swap(vertices[i], vertices[i + 1]);
+  S2Loop invalid(vertices, S2Debug::DISABLE);
+  S2Error expected, actual;
+  ASSERT_TRUE(invalid.FindValidationError(&expected));
+  ASSERT_TRUE(invalid.FindValidationError(&actual, 4));
+  EXPECT_EQ(expected.code(), actual.code());
+  EXPECT_EQ(expected.text(), actual.text());
+
+  S2ThreadPool pool(4);
+  S2Error pool_error;
+  ASSERT_TRUE(invalid.FindValidationError(&pool_error, 1, &pool));
+  EXPECT_EQ(expected.text(), pool_error.text());
+}
+
 }  // namespace s2shapeutil
@@ -15,24 +15,28 @@
 
 #include "s2/s2text_format.h"
 
+#include <cstdlib>
 #include <memory>
 #include <string>
+#include <system_error>
 #include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/charconv.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/strip.h"
 
 #include "s2/base/logging.h"
-#include "s2/strings/serialize.h"
 #include "s2/mutable_s2shape_index.h"
 #include "s2/s2latlng.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
 #include "s2/s2loop.h"
+#include "s2/s2error.h"
 #include "s2/s2point_vector_shape.h"
 #include "s2/s2polygon.h"
 #include "s2/s2polyline.h"
@@ -40,28 +44,103 @@
 using absl::Span;
 using absl::string_view;
 using absl::make_unique;
-using std::pair;
 using std::string;
 using std::unique_ptr;
 using std::vector;
 
 namespace s2textformat {
 
-static vector<string_view> SplitString(string_view str, char separator) {
-  vector<string_view> result =
-      absl::StrSplit(str, separator, absl::SkipWhitespace());
-  for (auto& e : result) {
-    e = absl::StripAsciiWhitespace(e);
+// Calls "visitor" with each item of "str" separated by "separator", in
+// order, with leading and trailing whitespace removed.  Items that are empty
+// or consist only of whitespace are skipped.  Returns false as soon as
+// "visitor" does.
+template <class Visitor>
+static bool VisitItems(string_view str, char separator,
+                       const Visitor& visitor) {
+  for (;;) {
+    size_t end = str.find(separator);
+    string_view item = absl::StripAsciiWhitespace(str.substr(0, end));
+    if (!item.empty() && !visitor(item)) return false;
+    if (end == string_view::npos) return true;
+    str.remove_prefix(end + 1);
   }
-  return result;
 }
 
-static bool ParseDouble(const string& str, double* value) {
+// Parses "str" as strtod() does, and returns true if all of "str" was
+// consumed.
+static bool ParseDouble(string_view str, double* value) {
+  // absl::from_chars() does not skip leading whitespace, but otherwise it
+  // yields the same (correctly rounded) result as strtod() without needing
+  // a NUL-terminated copy of "str".
+  while (!str.empty() && absl::ascii_isspace(str.front())) str.remove_prefix(1);
+  const char* end = str.data() + str.size();
+  absl::from_chars_result result = absl::from_chars(str.data(), end, *value);
+  if (result.ec == std::errc() && result.ptr == end) return true;
+
+  // Fall back to strtod() for the inputs that absl::from_chars() rejects
+  // (such as a leading '+', hexadecimal values, out-of-range values, or the
+  // empty string) so that the accepted syntax does not change.
+  string copy(str);
   char* end_ptr = nullptr;
-  *value = strtod(str.c_str(), &end_ptr);
+  *value = strtod(copy.c_str(), &end_ptr);
   return end_ptr && *end_ptr == 0;
 }
 
+// Calls "visitor" with each S2LatLng in a string of comma-separated
+// "lat:lng" pairs (see ParseLatLngs).  Returns false if "str" is invalid, in
+// which case "bad_entry" (if non-null) is set to the offending pair.
+template <class Visitor>
+static bool VisitLatLngs(string_view str, const Visitor& visitor,
+                         string_view* bad_entry = nullptr) {
+  if (str.empty()) return true;
+  for (;;) {
+    size_t comma = str.find(',');
+    string_view entry = str.substr(0, comma);
+    size_t colon = entry.find(':');
+    double lat, lng;
+    if (colon == string_view::npos ||
+        entry.find(':', colon + 1) != string_view::npos ||
+        !ParseDouble(entry.substr(0, colon), &lat) ||
+        !ParseDouble(entry.substr(colon + 1), &lng)) {
+      if (bad_entry != nullptr) *bad_entry = entry;
+      return false;
+    }
+    visitor(S2LatLng::FromDegrees(lat, lng));
+    if (comma == string_view::npos) return true;
+    str.remove_prefix(comma + 1);
+  }
+}
+
+// Like ParsePoints(), but reports invalid input using "error".
+static bool ParsePoints(string_view str, vector<S2Point>* vertices,
+                        S2Error* error) {
+  string_view bad_entry;
+  if (!VisitLatLngs(str, [vertices](const S2LatLng& latlng) {
+        vertices->push_back(latlng.ToPoint());
+      }, &bad_entry)) {
+    error->Init(S2Error::INVALID_ARGUMENT,
+                "Invalid latitude:longitude pair \"%s\"", bad_entry);
+    return false;
+  }
+  return true;
+}
+
+// Appends the loops of an S2LaxPolygonShape in the format accepted by
+// MakeLaxPolygon() to "loops", reporting invalid input using "error".
+static bool ParseLaxPolygonLoops(string_view str,
+                                 vector<vector<S2Point>>* loops,
+                                 S2Error* error) {
+  return VisitItems(str, ';', [loops, error](string_view loop_str) {
+      if (loop_str == "full") {
+        loops->emplace_back();
+      } else if (loop_str != "empty") {
+        loops->emplace_back();
+        return ParsePoints(loop_str, &loops->back(), error);
+      }
+      return true;
+    });
+}
+
 vector<S2LatLng> ParseLatLngsOrDie(string_view str) {
   vector<S2LatLng> latlngs;
   S2_CHECK(ParseLatLngs(str, &latlngs)) << ": str == \"" << str << "\"";
@@ -69,16 +148,9 @@ vector<S2LatLng> ParseLatLngsOrDie(string_view str) {
 }
 
 bool ParseLatLngs(string_view str, vector<S2LatLng>* latlngs) {
-  vector<pair<string, string>> ps;
-  if (!strings::DictionaryParse(str, &ps)) return false;
-  for (const auto& p : ps) {
-    double lat;
-    if (!ParseDouble(p.first, &lat)) return false;
-    double lng;
-    if (!ParseDouble(p.second, &lng)) return false;
-    latlngs->push_back(S2LatLng::FromDegrees(lat, lng));
-  }
-  return true;
+  return VisitLatLngs(str, [latlngs](const S2LatLng& latlng) {
+      latlngs->push_back(latlng);
+    });
 }
 
 vector<S2Point> ParsePointsOrDie(string_view str) {
@@ -88,12 +160,9 @@ vector<S2Point> ParsePointsOrDie(string_view str) {
 }
 
 bool ParsePoints(string_view str, vector<S2Point>* vertices) {
-  vector<S2LatLng> latlngs;
-  if (!ParseLatLngs(str, &latlngs)) return false;
-  for (const auto& latlng : latlngs) {
-    vertices->push_back(latlng.ToPoint());
-  }
-  return true;
+  return VisitLatLngs(str, [vertices](const S2LatLng& latlng) {
+      vertices->push_back(latlng.ToPoint());
+    });
 }
 
 S2Point MakePointOrDie(string_view str) {
@@ -151,10 +220,13 @@ S2CellId MakeCellIdOrDie(string_view str) {
 
 bool MakeCellUnion(string_view str, S2CellUnion* cell_union) {
   vector<S2CellId> cell_ids;
-  for (const auto& cell_str : SplitString(str, ',')) {
-    S2CellId cell_id;
-    if (!MakeCellId(cell_str, &cell_id)) return false;
-    cell_ids.push_back(cell_id);
+  if (!VisitItems(str, ',', [&cell_ids](string_view cell_str) {
+        S2CellId cell_id;
+        if (!MakeCellId(cell_str, &cell_id)) return false;
+        cell_ids.push_back(cell_id);
+        return true;
+      })) {
+    return false;
   }
   *cell_union = S2CellUnion(std::move(cell_ids));
   return true;
@@ -223,14 +295,16 @@ static bool InternalMakePolygon(string_view str,
                                 bool normalize_loops,
                                 unique_ptr<S2Polygon>* polygon) {
   if (str == "empty") str = "";
-  vector<string_view> loop_strs = SplitString(str, ';');
   vector<unique_ptr<S2Loop>> loops;
-  for (const auto& loop_str : loop_strs) {
-    std::unique_ptr<S2Loop> loop;
-    if (!MakeLoop(loop_str, &loop, debug_override)) return false;
-    // Don't normalize loops that were explicitly specified as "full".
-    if (normalize_loops && !loop->is_full()) loop->Normalize();
-    loops.push_back(std::move(loop));
+  if (!VisitItems(str, ';', [&](string_view loop_str) {
+        std::unique_ptr<S2Loop> loop;
+        if (!MakeLoop(loop_str, &loop, debug_override)) return false;
+        // Don't normalize loops that were explicitly specified as "full".
+        if (normalize_loops && !loop->is_full()) loop->Normalize();
+        loops.push_back(std::move(loop));
+        return true;
+      })) {
+    return false;
   }
   *polygon = make_unique<S2Polygon>(std::move(loops), debug_override);
   return true;
@@ -267,17 +341,9 @@ unique_ptr<S2LaxPolygonShape> MakeLaxPolygonOrDie(string_view str) {
 
 bool MakeLaxPolygon(string_view str,
                     unique_ptr<S2LaxPolygonShape>* lax_polygon) {
-  vector<string_view> loop_strs = SplitString(str, ';');
   vector<vector<S2Point>> loops;
-  for (const auto& loop_str : loop_strs) {
-    if (loop_str == "full") {
-      loops.push_back(vector<S2Point>());
-    } else if (loop_str != "empty") {
-      vector<S2Point> points;
-      if (!ParsePoints(loop_str, &points)) return false;
-      loops.push_back(points);
-    }
-  }
+  S2Error error;
+  if (!ParseLaxPolygonLoops(str, &loops, &error)) return false;
   *lax_polygon = make_unique<S2LaxPolygonShape>(loops);
   return true;
 }
@@ -289,28 +355,63 @@ unique_ptr<MutableS2ShapeIndex> MakeIndexOrDie(string_view str) {
 }
 
 bool MakeIndex(string_view str, std::unique_ptr<MutableS2ShapeIndex>* index) {
-  vector<string_view> strs = absl::StrSplit(str, '#');
-  S2_DCHECK_EQ(3, strs.size()) << "Must contain two # characters: " << str;
+  S2Error error;
+  return MakeIndex(str, index->get(), &error);
+}
 
+bool MakeIndex(string_view str, MutableS2ShapeIndex* index, S2Error* error) {
+  string_view parts[3];
+  int num_parts = 0;
+  for (string_view part : absl::StrSplit(str, '#')) {
+    if (num_parts == 3) {
+      num_parts = 4;
+      break;
+    }
+    parts[num_parts++] = part;
+  }
+  if (num_parts != 3) {
+    error->Init(S2Error::INVALID_ARGUMENT, "Must contain two # characters");
+    return false;
+  }
+
+  // The shapes are added to the index only once the whole string has been
+  // parsed successfully.
+  vector<unique_ptr<S2Shape>> shapes;
   vector<S2Point> points;
-  for (const auto& point_str : SplitString(strs[0], '|')) {
-    S2Point point;
-    if (!MakePoint(point_str, &point)) return false;
-    points.push_back(point);
+  if (!VisitItems(parts[0], '|', [&](string_view point_str) {
+        size_t size = points.size();
+        if (!ParsePoints(point_str, &points, error)) return false;
+        if (points.size() != size + 1) {
+          error->Init(S2Error::INVALID_ARGUMENT,
+                      "Expected exactly one point: \"%s\"", point_str);
+          return false;
+        }
+        return true;
+      })) {
+    return false;
   }
   if (!points.empty()) {
-    (*index)->Add(make_unique<S2PointVectorShape>(std::move(points)));
+    shapes.push_back(make_unique<S2PointVectorShape>(std::move(points)));
   }
-  for (const auto& line_str : SplitString(strs[1], '|')) {
-    std::unique_ptr<S2LaxPolylineShape> lax_polyline;
-    if (!MakeLaxPolyline(line_str, &lax_polyline)) return false;
-    (*index)->Add(std::move(lax_polyline));
+  vector<S2Point> vertices;
+  if (!VisitItems(parts[1], '|', [&](string_view line_str) {
+        vertices.clear();
+        if (!ParsePoints(line_str, &vertices, error)) return false;
+        shapes.push_back(make_unique<S2LaxPolylineShape>(vertices));
+        return true;
+      })) {
+    return false;
   }
-  for (const auto& polygon_str : SplitString(strs[2], '|')) {
-    std::unique_ptr<S2LaxPolygonShape> lax_polygon;
-    if (!MakeLaxPolygon(polygon_str, &lax_polygon)) return false;
-    (*index)->Add(std::move(lax_polygon));
+  vector<vector<S2Point>> loops;
+  if (!VisitItems(parts[2], '|', [&](string_view polygon_str) {
+        loops.clear();
+        if (!ParseLaxPolygonLoops(polygon_str, &loops, error)) return false;
+        shapes.push_back(make_unique<S2LaxPolygonShape>(loops));
+        return true;
+      })) {
+    return false;
   }
+  for (auto& shape : shapes) index->Add(std::move(shape));
   return true;
 }
 
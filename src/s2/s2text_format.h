@@ -43,6 +43,7 @@
 #include "s2/s2polyline.h"  // TODO(user,b/207351837): Remove.
 
 class MutableS2ShapeIndex;
+class S2Error;
 class S2LaxPolygonShape;
 class S2LaxPolylineShape;
 class S2Loop;
@@ -250,6 +251,14 @@ std::unique_ptr<MutableS2ShapeIndex> MakeIndexOrDie(absl::string_view str);
 ABSL_MUST_USE_RESULT bool MakeIndex(
     absl::string_view str, std::unique_ptr<MutableS2ShapeIndex>* index);
 
+// As above, but adds the shapes to an existing index and reports invalid
+// input using "error".  The shapes are added only if the whole string is
+// valid.  The string is parsed in a single pass without splitting it into
+// temporary strings, so this is suitable for loading large inputs.
+ABSL_MUST_USE_RESULT bool MakeIndex(absl::string_view str,
+                                    MutableS2ShapeIndex* index,
+                                    S2Error* error);
+
 // Convert an S2Point, S2LatLng, S2LatLngRect, S2CellId, S2CellUnion, loop,
 // polyline, or polygon to the string format above.
 std::string ToString(const S2Point& point);
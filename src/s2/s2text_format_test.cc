@@ -15,6 +15,7 @@
 
 #include "s2/s2text_format.h"
 
+#include <cmath>
 #include <memory>
 #include <string>
 #include <vector>
@@ -27,6 +28,7 @@
 
 #include "s2/mutable_s2shape_index.h"
 #include "s2/s1angle.h"
+#include "s2/s2error.h"
 #include "s2/s2latlng.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2lax_polyline_shape.h"
@@ -472,4 +474,45 @@ TEST(SafeMakeIndex, InvalidInput) {
   EXPECT_FALSE(s2textformat::MakeIndex("# blah #", &index));
 }
 
+TEST(SafeMakeIndex, ExistingIndexWithError) {
+  MutableS2ShapeIndex index;
+  S2Error error;
+  ASSERT_TRUE(s2textformat::MakeIndex(
+      "1:2 | 3:4 # 0:0, 0:1 # 0:0, 0:3, 3:0; 1:1, 2:1, 1:2 | full",
+      &index, &error));
+  ASSERT_TRUE(s2textformat::MakeIndex("# 5:5, 6:6 #", &index, &error));
+  EXPECT_EQ("1:2 | 3:4 # 0:0, 0:1 | 5:5, 6:6 # "
+            "0:0, 0:3, 3:0; 1:1, 2:1, 1:2 | full",
+            s2textformat::ToString(index));
+
+  // Nothing is added to the index when the input is invalid.
+  EXPECT_FALSE(s2textformat::MakeIndex("# 0:0 # 1:1, x:2", &index, &error));
+  EXPECT_EQ(S2Error::INVALID_ARGUMENT, error.code());
+  EXPECT_EQ("Invalid latitude:longitude pair \" x:2\"", error.text());
+  EXPECT_EQ(5, index.num_shape_ids());
+
+  EXPECT_FALSE(s2textformat::MakeIndex("0:0, 1:1 # #", &index, &error));
+  EXPECT_EQ("Expected exactly one point: \"0:0, 1:1\"", error.text());
+  EXPECT_FALSE(s2textformat::MakeIndex("0:0 #", &index, &error));
+  EXPECT_EQ("Must contain two # characters", error.text());
+  EXPECT_FALSE(s2textformat::MakeIndex("# # # #", &index, &error));
+  EXPECT_EQ(5, index.num_shape_ids());
+}
+
+TEST(ParseLatLngs, AcceptsStrtodSyntax) {
+  // The parser accepts the same numeric syntax as strtod().
+  vector<S2LatLng> latlngs;
+  ASSERT_TRUE(s2textformat::ParseLatLngs(
+      "+1.5:-2e1,  0x1p1:.25, 1e400:0", &latlngs));
+  ASSERT_EQ(3, latlngs.size());
+  EXPECT_EQ(S2LatLng::FromDegrees(1.5, -20), latlngs[0]);
+  EXPECT_EQ(S2LatLng::FromDegrees(2, 0.25), latlngs[1]);
+  EXPECT_EQ(S2LatLng::FromDegrees(HUGE_VAL, 0), latlngs[2]);
+
+  EXPECT_FALSE(s2textformat::ParseLatLngs("1:2,", &latlngs));
+  EXPECT_FALSE(s2textformat::ParseLatLngs("1:2:3", &latlngs));
+  EXPECT_FALSE(s2textformat::ParseLatLngs("1 :2", &latlngs));
+  EXPECT_FALSE(s2textformat::ParseLatLngs("1:2x", &latlngs));
+}
+
 }  // namespace
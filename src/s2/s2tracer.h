@@ -0,0 +1,103 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_S2TRACER_H_
+#define S2_S2TRACER_H_
+
+#include "s2/base/integral_types.h"
+
+// Counts attached to the end of each S2Tracer span.  Fields that do not
+// apply to a given span are -1.
+struct S2TraceCounts {
+  // The number of Voronoi sites (or output vertices) at the end of the span.
+  int64 num_sites = -1;
+
+  // The number of edges processed or produced by the span.
+  int64 num_edges = -1;
+
+  // The number of edge crossings found by the span.
+  int64 num_crossings = -1;
+};
+
+// S2Tracer is an interface for observing the phases of expensive S2
+// operations, e.g. to feed them into a distributed tracing system.  Classes
+// that support it accept a tracer through their Options (currently
+// S2Builder and S2BooleanOperation).  Example usage:
+//
+//   class MyTracer : public S2Tracer {
+//    public:
+//     void StartSpan(const char* name) override { ... }
+//     void EndSpan(const char* name, const S2TraceCounts& counts) override {
+//       ...
+//     }
+//   };
+//   MyTracer tracer;
+//   S2Builder::Options options;
+//   options.set_tracer(&tracer);
+//
+// Spans are properly nested, and each StartSpan() call is followed by an
+// EndSpan() call with the same name (even when the operation fails).  Span
+// names are string literals such as "S2Builder::ChooseSites" and are not
+// guaranteed to be stable across releases.  Spans are reported on the thread
+// that called the operation, so the tracer need not be thread-safe unless it
+// is shared by operations running concurrently.
+//
+// When no tracer is set, the cost of each span is a single pointer test.
+class S2Tracer {
+ public:
+  virtual ~S2Tracer() = default;
+
+  // Called when the phase "name" starts.
+  virtual void StartSpan(const char* name) = 0;
+
+  // Called when the phase "name" ends.
+  virtual void EndSpan(const char* name, const S2TraceCounts& counts) = 0;
+};
+
+// A helper that reports a span to an optional S2Tracer for the lifetime of
+// this object.  Counts may be set at any point before the span ends, e.g.
+//
+//   S2TraceSpan span(options_.tracer(), "S2Builder::ChooseSites");
+//   ...
+//   span.counts().num_sites = sites_.size();
+class S2TraceSpan {
+ public:
+  // Starts a span if "tracer" is non-null.  "name" must outlive this object.
+  S2TraceSpan(S2Tracer* tracer, const char* name)
+      : tracer_(tracer), name_(name) {
+    if (tracer_) tracer_->StartSpan(name_);
+  }
+
+  ~S2TraceSpan() {
+    if (tracer_) tracer_->EndSpan(name_, counts_);
+  }
+
+  // Returns true if the span is being reported.  This can be used to avoid
+  // computing counts that are not free.
+  bool enabled() const { return tracer_ != nullptr; }
+
+  // The counts reported when the span ends.
+  S2TraceCounts& counts() { return counts_; }
+
+ private:
+  S2Tracer* const tracer_;
+  const char* const name_;
+  S2TraceCounts counts_;
+
+  S2TraceSpan(const S2TraceSpan&) = delete;
+  void operator=(const S2TraceSpan&) = delete;
+};
+
+#endif  // S2_S2TRACER_H_
@@ -18,6 +18,7 @@
 
 #include "s2/s2winding_operation.h"
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 
@@ -34,6 +35,8 @@
 #include "s2/s2shapeutil_shape_edge_id.h"
 
 using absl::make_unique;
+using std::max;
+using std::min;
 using std::unique_ptr;
 using std::vector;
 
@@ -57,6 +60,10 @@ using WindingRule = S2WindingOperation::WindingRule;
 
 namespace s2builderutil {
 
+// The minimum number of graph edges that each thread should process when
+// the boundary of the result is computed in parallel.
+static constexpr int kMinEdgesPerThread = 10000;
+
 // The purpose of WindingOracle is to compute winding numbers with respect to
 // a set of input loops after snapping.  It is given the input edges (via
 // S2Builder), the output eges (an S2Builder::Graph), and the winding number
@@ -73,6 +80,18 @@ class WindingOracle {
   // Returns the winding number at the given point after snapping.
   int GetWindingNumber(const S2Point& p);
 
+  // Like GetWindingNumber(p), except that the reference point and its
+  // winding number are supplied by the caller (and updated to "p" and its
+  // winding number).  This allows several threads to compute winding numbers
+  // concurrently, each starting from its own reference point.
+  //
+  // REQUIRES: BuildIndex() has been called.
+  int GetWindingNumber(const S2Point& p, S2Point* ref_p,
+                       int* ref_winding) const;
+
+  // Builds the index used to count edge crossings.
+  void BuildIndex();
+
   // Returns the current reference point.
   S2Point current_ref_point() const { return ref_p_; }
 
@@ -80,7 +99,9 @@ class WindingOracle {
   int current_ref_winding() const { return ref_winding_; }
 
  private:
-  int SignedCrossingDelta(S2EdgeCrosser* crosser, EdgeId e);
+  int SignedCrossingDelta(S2CopyingEdgeCrosser* crosser, EdgeId e) const;
+  int GetCrossingDelta(const S2Point& a, const S2Point& b,
+                       bool brute_force) const;
 
   const Graph& g_;
 
@@ -150,10 +171,10 @@ WindingOracle::WindingOracle(
 }
 
 // Returns the change in winding number due to crossing the given graph edge.
-inline int WindingOracle::SignedCrossingDelta(S2EdgeCrosser* crosser,
-                                              EdgeId e) {
-  return crosser->SignedEdgeOrVertexCrossing(&g_.vertex(g_.edge(e).first),
-                                             &g_.vertex(g_.edge(e).second));
+inline int WindingOracle::SignedCrossingDelta(S2CopyingEdgeCrosser* crosser,
+                                              EdgeId e) const {
+  return crosser->SignedEdgeOrVertexCrossing(g_.vertex(g_.edge(e).first),
+                                             g_.vertex(g_.edge(e).second));
 }
 
 // Returns the winding number at the given point "p".
@@ -161,18 +182,9 @@ int WindingOracle::GetWindingNumber(const S2Point& p) {
   // Count signed edge crossings starting from the reference point, whose
   // winding number is known.  If we need to do this many times then we build
   // an S2ShapeIndex to speed up this process.
-  S2EdgeCrosser crosser(&ref_p_, &p);
-  int winding = ref_winding_;
-  if (--brute_force_winding_tests_left_ >= 0) {
-    for (EdgeId e = 0; e < g_.num_edges(); ++e) {
-      winding += SignedCrossingDelta(&crosser, e);
-    }
-  } else {
-    S2CrossingEdgeQuery query(&index_);
-    for (ShapeEdgeId id : query.GetCandidates(ref_p_, p, *index_.shape(0))) {
-      winding += SignedCrossingDelta(&crosser, id.edge_id);
-    }
-  }
+  int winding = ref_winding_ + GetCrossingDelta(
+      ref_p_, p, --brute_force_winding_tests_left_ >= 0);
+
   // It turns out that GetWindingNumber() is called with a sequence of points
   // that are sorted in approximate S2CellId order.  This means that if we
   // update our reference point as we go along, the edges for which we need to
@@ -182,6 +194,38 @@ int WindingOracle::GetWindingNumber(const S2Point& p) {
   return winding;
 }
 
+int WindingOracle::GetWindingNumber(const S2Point& p, S2Point* ref_p,
+                                    int* ref_winding) const {
+  S2_DCHECK(index_.is_fresh());
+  *ref_winding += GetCrossingDelta(*ref_p, p, false);
+  *ref_p = p;
+  return *ref_winding;
+}
+
+void WindingOracle::BuildIndex() {
+  brute_force_winding_tests_left_ = 0;
+  index_.ForceBuild();
+}
+
+// Returns the change in winding number along the edge AB, either by testing
+// every graph edge or by using the index.
+int WindingOracle::GetCrossingDelta(const S2Point& a, const S2Point& b,
+                                    bool brute_force) const {
+  S2CopyingEdgeCrosser crosser(a, b);
+  int delta = 0;
+  if (brute_force) {
+    for (EdgeId e = 0; e < g_.num_edges(); ++e) {
+      delta += SignedCrossingDelta(&crosser, e);
+    }
+  } else {
+    S2CrossingEdgeQuery query(&index_);
+    for (ShapeEdgeId id : query.GetCandidates(a, b, *index_.shape(0))) {
+      delta += SignedCrossingDelta(&crosser, id.edge_id);
+    }
+  }
+  return delta;
+}
+
 // The actual winding number operation is implemented as an S2Builder layer.
 class WindingLayer : public S2Builder::Layer {
  public:
@@ -197,13 +241,23 @@ class WindingLayer : public S2Builder::Layer {
 
  private:
   bool ComputeBoundary(const Graph& g, WindingOracle* oracle, S2Error* error);
+  bool ComputeBoundaryInParallel(const Graph& g, int num_threads,
+                                 WindingOracle* oracle,
+                                 const vector<EdgeId>& sibling_map,
+                                 vector<EdgeId>* left_turn_map,
+                                 vector<int>* edge_winding);
+  bool VisitComponent(const Graph& g, EdgeId e0,
+                      const vector<EdgeId>& sibling_map,
+                      vector<EdgeId>* left_turn_map, vector<int>* edge_winding,
+                      vector<EdgeId>* frontier, vector<Edge>* edges,
+                      vector<InputEdgeIdSetId>* input_edge_ids,
+                      S2MemoryTracker::Client* tracker) const;
   EdgeId GetContainingLoopEdge(VertexId v, EdgeId start, const Graph& g,
                                const vector<EdgeId>& left_turn_map,
                                const vector<EdgeId>& sibling_map) const;
   bool MatchesRule(int winding) const;
   bool MatchesDegeneracy(int winding, int winding_minus, int winding_plus)
       const;
-  inline void OutputEdge(const Graph& g, EdgeId e);
 
   // Constructor parameters.
   const S2WindingOperation& op_;
@@ -316,6 +370,16 @@ bool WindingLayer::ComputeBoundary(const Graph& g, WindingOracle* oracle,
 
   // A map from EdgeId to the winding number of the region it bounds.
   vector<int> edge_winding(g.num_edges());
+  const int num_threads = static_cast<int>(max<int64>(
+      1, min<int64>(S2NumThreads(g.executor(), g.num_threads()),
+                    g.num_edges() / kMinEdgesPerThread)));
+  if (num_threads > 1) {
+    if (!ComputeBoundaryInParallel(g, num_threads, oracle, sibling_map,
+                                   &left_turn_map, &edge_winding)) {
+      return false;
+    }
+    return tracker_.Tally(-kTempUsage);
+  }
   vector<EdgeId> frontier;  // Unexplored sibling edges.
   for (EdgeId e_min = 0; e_min < g.num_edges(); ++e_min) {
     if (left_turn_map[e_min] < 0) continue;  // Already visited.
@@ -331,48 +395,158 @@ bool WindingLayer::ComputeBoundary(const Graph& g, WindingOracle* oracle,
     VertexId v0 = g.edge(e_min).second;
     EdgeId e0 = GetContainingLoopEdge(v0, e_min, g, left_turn_map, sibling_map);
     edge_winding[e0] = oracle->GetWindingNumber(g.vertex(v0));
+    if (!VisitComponent(g, e0, sibling_map, &left_turn_map, &edge_winding,
+                        &frontier, &result_edges_, &result_input_edge_ids_,
+                        &tracker_)) {
+      return false;
+    }
+  }
+  tracker_.Untally(frontier);
+  return tracker_.Tally(-kTempUsage);
+}
 
-    // Now visit all loop edges in this connected component of the graph.
-    // "frontier" is a stack of unexplored siblings of the edges visited far.
-    if (!tracker_.AddSpace(&frontier, 1)) return false;
-    frontier.push_back(e0);
-    while (!frontier.empty()) {
-      EdgeId e = frontier.back();
-      frontier.pop_back();
-      if (left_turn_map[e] < 0) continue;  // Already visited.
-
-      // Visit all edges of the loop starting at "e".
-      int winding = edge_winding[e];
-      for (EdgeId next; left_turn_map[e] >= 0; e = next) {
-        // Count signed edge crossings to determine the winding number of
-        // the sibling region.  Input edges that snapped to "e" decrease the
-        // winding number by one (since we cross them from left to right),
-        // while input edges that snapped to its sibling edge increase the
-        // winding number by one (since we cross them from right to left).
-        EdgeId sibling = sibling_map[e];
-        int winding_minus = g.input_edge_ids(e).size();
-        int winding_plus = g.input_edge_ids(sibling).size();
-        int sibling_winding = winding - winding_minus + winding_plus;
-
-        // Output all edges that bound the region selected by the winding
-        // rule, plus certain degenerate edges.
-        if ((MatchesRule(winding) && !MatchesRule(sibling_winding)) ||
-            MatchesDegeneracy(winding, winding_minus, winding_plus)) {
-          OutputEdge(g, e);
-        }
-        next = left_turn_map[e];
-        left_turn_map[e] = -1;
-        // If the sibling hasn't been visited yet, add it to the frontier.
-        if (left_turn_map[sibling] >= 0) {
-          edge_winding[sibling] = sibling_winding;
-          if (!tracker_.AddSpace(&frontier, 1)) return false;
-          frontier.push_back(sibling);
+// Like the loop in ComputeBoundary(), but divides the connected components
+// into "num_threads" groups of consecutive components that are visited in
+// parallel.  Since graph vertices are sorted in S2CellId order, each group
+// covers a spatially coherent set of components, and therefore each group
+// counts crossings starting from its own reference point (which is updated
+// as the group is visited, as in WindingOracle::GetWindingNumber).  The
+// output edges of the groups are concatenated in order, so that the result
+// is the same as the single-threaded result.  Memory used by the output
+// edges is tallied only after all groups have been visited.
+bool WindingLayer::ComputeBoundaryInParallel(
+    const Graph& g, int num_threads, WindingOracle* oracle,
+    const vector<EdgeId>& sibling_map, vector<EdgeId>* left_turn_map,
+    vector<int>* edge_winding) {
+  // First find the connected components (identified by their minimum edge
+  // id) and count their edges.  This does not require any geometric tests.
+  vector<EdgeId> component_starts;
+  vector<int> component_sizes;
+  {
+    vector<bool> visited(g.num_edges());
+    vector<EdgeId> frontier;
+    for (EdgeId e_min = 0; e_min < g.num_edges(); ++e_min) {
+      if (visited[e_min]) continue;
+      int size = 0;
+      frontier.push_back(e_min);
+      while (!frontier.empty()) {
+        EdgeId e = frontier.back();
+        frontier.pop_back();
+        for (; !visited[e]; e = (*left_turn_map)[e]) {
+          visited[e] = true;
+          ++size;
+          if (!visited[sibling_map[e]]) frontier.push_back(sibling_map[e]);
         }
       }
+      component_starts.push_back(e_min);
+      component_sizes.push_back(size);
     }
   }
-  tracker_.Untally(frontier);
-  return tracker_.Tally(-kTempUsage);
+
+  // Divide the components into groups with similar numbers of edges.
+  const int num_components = component_starts.size();
+  vector<int> group_start = {0};
+  int64 group_edges = 0;
+  for (int i = 0; i + 1 < num_components && group_start.size() < num_threads;
+       ++i) {
+    group_edges += component_sizes[i];
+    if (group_edges * num_threads >=
+        int64{g.num_edges()} * group_start.size()) {
+      group_start.push_back(i + 1);
+    }
+  }
+  group_start.push_back(num_components);
+  const int num_groups = group_start.size() - 1;
+
+  // All groups share the index used to count crossings.
+  oracle->BuildIndex();
+  vector<vector<Edge>> group_edge_list(num_groups);
+  vector<vector<InputEdgeIdSetId>> group_input_edge_ids(num_groups);
+  S2ParallelFor(g.executor(), num_groups, [&](int t) {
+    S2Point ref_p = oracle->current_ref_point();
+    int ref_winding = oracle->current_ref_winding();
+    S2MemoryTracker::Client untracked;
+    vector<EdgeId> frontier;
+    for (int i = group_start[t]; i < group_start[t + 1]; ++i) {
+      EdgeId e_min = component_starts[i];
+      VertexId v0 = g.edge(e_min).second;
+      EdgeId e0 = GetContainingLoopEdge(v0, e_min, g, *left_turn_map,
+                                        sibling_map);
+      (*edge_winding)[e0] =
+          oracle->GetWindingNumber(g.vertex(v0), &ref_p, &ref_winding);
+      VisitComponent(g, e0, sibling_map, left_turn_map, edge_winding,
+                     &frontier, &group_edge_list[t], &group_input_edge_ids[t],
+                     &untracked);
+    }
+  });
+  int64 num_result_edges = 0;
+  for (const auto& edges : group_edge_list) num_result_edges += edges.size();
+  if (!tracker_.AddSpace(&result_edges_, num_result_edges)) return false;
+  if (!tracker_.AddSpace(&result_input_edge_ids_, num_result_edges)) {
+    return false;
+  }
+  for (int t = 0; t < num_groups; ++t) {
+    result_edges_.insert(result_edges_.end(), group_edge_list[t].begin(),
+                         group_edge_list[t].end());
+    result_input_edge_ids_.insert(result_input_edge_ids_.end(),
+                                  group_input_edge_ids[t].begin(),
+                                  group_input_edge_ids[t].end());
+  }
+  return true;
+}
+
+// Visits all loop edges in the connected component of the graph containing
+// "e0", given that edge_winding[e0] is the winding number of the region to
+// its left.  Edges that bound the region selected by the winding rule (plus
+// certain degenerate edges) are appended to "edges" and "input_edge_ids".
+// Returns false if the memory limit of "tracker" is exceeded.
+bool WindingLayer::VisitComponent(
+    const Graph& g, EdgeId e0, const vector<EdgeId>& sibling_map,
+    vector<EdgeId>* left_turn_map, vector<int>* edge_winding,
+    vector<EdgeId>* frontier, vector<Edge>* edges,
+    vector<InputEdgeIdSetId>* input_edge_ids,
+    S2MemoryTracker::Client* tracker) const {
+  // "frontier" is a stack of unexplored siblings of the edges visited far.
+  if (!tracker->AddSpace(frontier, 1)) return false;
+  frontier->push_back(e0);
+  while (!frontier->empty()) {
+    EdgeId e = frontier->back();
+    frontier->pop_back();
+    if ((*left_turn_map)[e] < 0) continue;  // Already visited.
+
+    // Visit all edges of the loop starting at "e".
+    int winding = (*edge_winding)[e];
+    for (EdgeId next; (*left_turn_map)[e] >= 0; e = next) {
+      // Count signed edge crossings to determine the winding number of
+      // the sibling region.  Input edges that snapped to "e" decrease the
+      // winding number by one (since we cross them from left to right),
+      // while input edges that snapped to its sibling edge increase the
+      // winding number by one (since we cross them from right to left).
+      EdgeId sibling = sibling_map[e];
+      int winding_minus = g.input_edge_ids(e).size();
+      int winding_plus = g.input_edge_ids(sibling).size();
+      int sibling_winding = winding - winding_minus + winding_plus;
+
+      // Output all edges that bound the region selected by the winding
+      // rule, plus certain degenerate edges.
+      if ((MatchesRule(winding) && !MatchesRule(sibling_winding)) ||
+          MatchesDegeneracy(winding, winding_minus, winding_plus)) {
+        if (!tracker->AddSpace(edges, 1)) return false;
+        if (!tracker->AddSpace(input_edge_ids, 1)) return false;
+        edges->push_back(g.edge(e));
+        input_edge_ids->push_back(g.input_edge_id_set_id(e));
+      }
+      next = (*left_turn_map)[e];
+      (*left_turn_map)[e] = -1;
+      // If the sibling hasn't been visited yet, add it to the frontier.
+      if ((*left_turn_map)[sibling] >= 0) {
+        (*edge_winding)[sibling] = sibling_winding;
+        if (!tracker->AddSpace(frontier, 1)) return false;
+        frontier->push_back(sibling);
+      }
+    }
+  }
+  return true;
 }
 
 // Given an incoming edge "start" to a vertex "v", returns an edge of the loop
@@ -451,14 +625,6 @@ bool WindingLayer::MatchesDegeneracy(int winding, int winding_minus,
   }
 }
 
-// Adds an edge to the set of output edges.
-inline void WindingLayer::OutputEdge(const Graph& g, EdgeId e) {
-  if (!tracker_.AddSpace(&result_edges_, 1)) return;
-  if (!tracker_.AddSpace(&result_input_edge_ids_, 1)) return;
-  result_edges_.push_back(g.edge(e));
-  result_input_edge_ids_.push_back(g.input_edge_id_set_id(e));
-}
-
 }  // namespace s2builderutil
 
 S2WindingOperation::Options::Options()
@@ -473,7 +639,9 @@ S2WindingOperation::Options::Options(const SnapFunction& snap_function)
 S2WindingOperation::Options::Options(const Options& options)
     : snap_function_(options.snap_function_->Clone()),
       include_degeneracies_(options.include_degeneracies_),
-      memory_tracker_(options.memory_tracker_) {
+      memory_tracker_(options.memory_tracker_),
+      num_threads_(options.num_threads_),
+      executor_(options.executor_) {
 }
 
 S2WindingOperation::Options& S2WindingOperation::Options::operator=(
@@ -481,6 +649,8 @@ S2WindingOperation::Options& S2WindingOperation::Options::operator=(
   snap_function_ = options.snap_function_->Clone();
   include_degeneracies_ = options.include_degeneracies_;
   memory_tracker_ = options.memory_tracker_;
+  num_threads_ = options.num_threads_;
+  executor_ = options.executor_;
   return *this;
 }
 
@@ -511,6 +681,23 @@ void S2WindingOperation::Options::set_memory_tracker(S2MemoryTracker* tracker) {
   memory_tracker_ = tracker;
 }
 
+int S2WindingOperation::Options::num_threads() const {
+  return num_threads_;
+}
+
+void S2WindingOperation::Options::set_num_threads(int num_threads) {
+  S2_DCHECK_GE(num_threads, 1);
+  num_threads_ = num_threads;
+}
+
+S2Executor* S2WindingOperation::Options::executor() const {
+  return executor_;
+}
+
+void S2WindingOperation::Options::set_executor(S2Executor* executor) {
+  executor_ = executor;
+}
+
 S2WindingOperation::S2WindingOperation() {
 }
 
@@ -525,6 +712,8 @@ void S2WindingOperation::Init(std::unique_ptr<S2Builder::Layer> result_layer,
   S2Builder::Options builder_options{options_.snap_function()};
   builder_options.set_split_crossing_edges(true);
   builder_options.set_memory_tracker(options.memory_tracker());
+  builder_options.set_num_threads(options.num_threads());
+  builder_options.set_executor(options.executor());
   builder_.Init(builder_options);
   builder_.StartLayer(make_unique<s2builderutil::WindingLayer>(
       this, std::move(result_layer)));
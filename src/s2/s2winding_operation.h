@@ -22,6 +22,7 @@
 
 #include "s2/s2builder.h"
 #include "s2/s2builder_graph.h"
+#include "s2/s2executor.h"
 
 namespace s2builderutil { class WindingLayer; }  // Forward declaration
 
@@ -143,6 +144,32 @@ class S2WindingOperation {
     S2MemoryTracker* memory_tracker() const;
     void set_memory_tracker(S2MemoryTracker* tracker);
 
+    // The maximum number of threads used by Build().  This is passed to the
+    // underlying S2Builder (see S2Builder::Options::num_threads) and is also
+    // used to compute the winding numbers of the snapped regions: the
+    // connected components of the snapped loops are divided into groups of
+    // consecutive components (which are spatially coherent, since vertices
+    // are sorted in S2CellId order), and each group computes winding numbers
+    // starting from its own reference point.  This is much faster when the
+    // input consists of many overlapping loops (e.g., the buffered circles
+    // of a large point set).  The output does not depend on the number of
+    // threads.
+    //
+    // Note that when multiple threads are used, memory used by the output
+    // boundary edges is tallied only after all components have been visited.
+    //
+    // DEFAULT: 1
+    int num_threads() const;
+    void set_num_threads(int num_threads);
+
+    // If non-null, the parallel parts of Build() are run on this executor
+    // rather than on newly created threads, and num_threads() is replaced by
+    // executor->num_threads().  The executor must outlive the operation.
+    //
+    // DEFAULT: nullptr
+    S2Executor* executor() const;
+    void set_executor(S2Executor* executor);
+
     // Options may be assigned and copied.
     Options(const Options& options);
     Options& operator=(const Options& options);
@@ -151,6 +178,8 @@ class S2WindingOperation {
     std::unique_ptr<S2Builder::SnapFunction> snap_function_;
     bool include_degeneracies_ = false;
     S2MemoryTracker* memory_tracker_ = nullptr;
+    int num_threads_ = 1;
+    S2Executor* executor_ = nullptr;
   };
 
   // Default constructor; requires Init() to be called.
@@ -28,6 +28,8 @@
 #include "s2/s2builderutil_snap_functions.h"
 #include "s2/s2cap.h"
 #include "s2/s2error.h"
+#include "s2/s2executor.h"
+#include "s2/s2latlng.h"
 #include "s2/s2lax_polygon_shape.h"
 #include "s2/s2loop.h"
 #include "s2/s2testing.h"
@@ -271,6 +273,45 @@ TEST(S2WindingOperation, SymmetricDifferenceDegeneracies) {
       "", "2:2; 5:5");
 }
 
+// Returns the result of applying the given winding rule to many clusters of
+// overlapping circles, using the given number of threads.
+string GetOverlappingCirclesResult(int num_threads, S2Executor* executor,
+                                   int ref_winding, WindingRule rule) {
+  S2WindingOperation::Options options{IntLatLngSnapFunction(5)};
+  options.set_num_threads(num_threads);
+  options.set_executor(executor);
+  S2LaxPolygonShape result;
+  S2WindingOperation winding_op(
+      make_unique<s2builderutil::LaxPolygonLayer>(&result), options);
+  for (int i = 0; i < 15; ++i) {
+    for (int j = 0; j < 15; ++j) {
+      for (int k = 0; k < 2; ++k) {
+        S2Point center = S2LatLng::FromDegrees(2 * i + 0.1 * k,
+                                               2 * j + 0.05 * k).ToPoint();
+        auto loop = S2Loop::MakeRegularLoop(center, S1Angle::Degrees(0.3), 30);
+        winding_op.AddLoop(loop->vertices_span());
+      }
+    }
+  }
+  S2Error error;
+  EXPECT_TRUE(winding_op.Build(s2textformat::MakePointOrDie("-10:-10"),
+                               ref_winding, rule, &error)) << error;
+  return s2textformat::ToString(result);
+}
+
+TEST(S2WindingOperation, ResultDoesNotDependOnNumThreads) {
+  // Each cluster of circles is a separate connected component, so the
+  // components are divided among the threads.  Winding number -1 selects the
+  // regions where at least two circles overlap.
+  S2ThreadPool pool(3);
+  for (WindingRule rule : {WindingRule::POSITIVE, WindingRule::ODD}) {
+    string expected = GetOverlappingCirclesResult(1, nullptr, -1, rule);
+    EXPECT_NE("", expected);
+    EXPECT_EQ(expected, GetOverlappingCirclesResult(4, nullptr, -1, rule));
+    EXPECT_EQ(expected, GetOverlappingCirclesResult(1, &pool, -1, rule));
+  }
+}
+
 TEST(S2WindingOperationOptions, SetGetSnapFunction) {
   // Prevent these from being detected as dead code.
   S2WindingOperation::Options opts;
@@ -19,11 +19,10 @@
 #define S2_SEQUENCE_LEXICON_H_
 
 #include <functional>
-#include <limits>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "s2/base/integral_types.h"
-#include "s2/util/gtl/dense_hash_set.h"
 #include "s2/util/hash/mix.h"
 
 // SequenceLexicon is a class for compactly representing sequences of values
@@ -69,6 +68,11 @@ class SequenceLexicon {
   // Clears all data from the lexicon.
   void Clear();
 
+  // Reserves space for at least "num_sequences" sequences containing a total
+  // of "num_values" values, which avoids rehashing and reallocation when the
+  // approximate size of the lexicon is known in advance.
+  void Reserve(size_t num_sequences, size_t num_values);
+
   // Add the given sequence of values to the lexicon if it is not already
   // present, and return its integer id.  Ids are assigned sequentially
   // starting from zero.  "begin" and "end" are forward iterators over a
@@ -108,9 +112,6 @@ class SequenceLexicon {
 
  private:
   friend class IdKeyEqual;
-  // Choose kEmptyKey to be the last key that will ever be generated.
-  static const uint32 kEmptyKey = std::numeric_limits<uint32>::max();
-
   class IdHasher {
    public:
     IdHasher(const Hasher& hasher, const SequenceLexicon* lexicon);
@@ -131,7 +132,7 @@ class SequenceLexicon {
     const SequenceLexicon* lexicon_;
   };
 
-  using IdSet = gtl::dense_hash_set<uint32, IdHasher, IdKeyEqual>;
+  using IdSet = absl::flat_hash_set<uint32, IdHasher, IdKeyEqual>;
 
   std::vector<T> values_;
   std::vector<uint32> begins_;
@@ -142,9 +143,6 @@ class SequenceLexicon {
 //////////////////   Implementation details follow   ////////////////////
 
 
-template <class T, class Hasher, class KeyEqual>
-const uint32 SequenceLexicon<T, Hasher, KeyEqual>::kEmptyKey;
-
 template <class T, class Hasher, class KeyEqual>
 SequenceLexicon<T, Hasher, KeyEqual>::IdHasher::IdHasher(
     const Hasher& hasher, const SequenceLexicon* lexicon)
@@ -183,9 +181,6 @@ template <class T, class Hasher, class KeyEqual>
 bool SequenceLexicon<T, Hasher, KeyEqual>::IdKeyEqual::operator()(
     uint32 id1, uint32 id2) const {
   if (id1 == id2) return true;
-  if (id1 == lexicon_->kEmptyKey || id2 == lexicon_->kEmptyKey) {
-    return false;
-  }
   SequenceLexicon::Sequence seq1 = lexicon_->sequence(id1);
   SequenceLexicon::Sequence seq2 = lexicon_->sequence(id2);
   return (seq1.size() == seq2.size() &&
@@ -197,7 +192,6 @@ SequenceLexicon<T, Hasher, KeyEqual>::SequenceLexicon(const Hasher& hasher,
                                                       const KeyEqual& key_equal)
     : id_set_(0, IdHasher(hasher, this),
               IdKeyEqual(key_equal, this)) {
-  id_set_.set_empty_key(kEmptyKey);
   begins_.push_back(0);
 }
 
@@ -206,8 +200,8 @@ SequenceLexicon<T, Hasher, KeyEqual>::SequenceLexicon(const SequenceLexicon& x)
     : values_(x.values_), begins_(x.begins_),
       // Unfortunately we can't copy "id_set_" because we need to change the
       // "this" pointers associated with hasher() and key_equal().
-      id_set_(x.id_set_.begin(), x.id_set_.end(), kEmptyKey, 0,
-              IdHasher(x.id_set_.hash_funct().hasher(), this),
+      id_set_(x.id_set_.begin(), x.id_set_.end(), 0,
+              IdHasher(x.id_set_.hash_function().hasher(), this),
               IdKeyEqual(x.id_set_.key_eq().key_equal(), this)) {
 }
 
@@ -216,8 +210,8 @@ SequenceLexicon<T, Hasher, KeyEqual>::SequenceLexicon(SequenceLexicon&& x)
     : values_(std::move(x.values_)), begins_(std::move(x.begins_)),
       // Unfortunately we can't move "id_set_" because we need to change the
       // "this" pointers associated with hasher() and key_equal().
-      id_set_(x.id_set_.begin(), x.id_set_.end(), kEmptyKey, 0,
-              IdHasher(x.id_set_.hash_funct().hasher(), this),
+      id_set_(x.id_set_.begin(), x.id_set_.end(), 0,
+              IdHasher(x.id_set_.hash_function().hasher(), this),
               IdKeyEqual(x.id_set_.key_eq().key_equal(), this)) {
 }
 
@@ -229,8 +223,8 @@ SequenceLexicon<T, Hasher, KeyEqual>::operator=(const SequenceLexicon& x) {
   begins_ = x.begins_;
   // Unfortunately we can't copy-assign "id_set_" because we need to change
   // the "this" pointers associated with hasher() and key_equal().
-  id_set_ = IdSet(x.id_set_.begin(), x.id_set_.end(), kEmptyKey, 0,
-                  IdHasher(x.id_set_.hash_funct().hasher(), this),
+  id_set_ = IdSet(x.id_set_.begin(), x.id_set_.end(), 0,
+                  IdHasher(x.id_set_.hash_function().hasher(), this),
                   IdKeyEqual(x.id_set_.key_eq().key_equal(), this));
   return *this;
 }
@@ -243,8 +237,8 @@ SequenceLexicon<T, Hasher, KeyEqual>::operator=(SequenceLexicon&& x) {
   begins_ = std::move(x.begins_);
   // Unfortunately we can't move-assign "id_set_" because we need to change
   // the "this" pointers associated with hasher() and key_equal().
-  id_set_ = IdSet(x.id_set_.begin(), x.id_set_.end(), kEmptyKey, 0,
-                  IdHasher(x.id_set_.hash_funct().hasher(), this),
+  id_set_ = IdSet(x.id_set_.begin(), x.id_set_.end(), 0,
+                  IdHasher(x.id_set_.hash_function().hasher(), this),
                   IdKeyEqual(x.id_set_.key_eq().key_equal(), this));
   return *this;
 }
@@ -257,6 +251,14 @@ void SequenceLexicon<T, Hasher, KeyEqual>::Clear() {
   begins_.push_back(0);
 }
 
+template <class T, class Hasher, class KeyEqual>
+void SequenceLexicon<T, Hasher, KeyEqual>::Reserve(size_t num_sequences,
+                                                   size_t num_values) {
+  values_.reserve(num_values);
+  begins_.reserve(num_sequences + 1);
+  id_set_.reserve(num_sequences);
+}
+
 template <class T, class Hasher, class KeyEqual>
 template <class FwdIterator>
 uint32 SequenceLexicon<T, Hasher, KeyEqual>::Add(FwdIterator begin,
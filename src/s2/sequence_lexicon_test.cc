@@ -68,6 +68,19 @@ TEST(SequenceLexicon, Clear) {
   EXPECT_EQ(1, lex.Add(Seq{1}));
 }
 
+TEST(SequenceLexicon, Reserve) {
+  SequenceLexicon<int64> lex;
+  lex.Reserve(100, 1000);
+  for (int i = 0; i < 200; ++i) {
+    EXPECT_EQ(i, lex.Add(Seq{i, i + 1, i + 2}));
+  }
+  for (int i = 0; i < 200; ++i) {
+    EXPECT_EQ(i, lex.Add(Seq{i, i + 1, i + 2}));
+    ExpectSequence(Seq{i, i + 1, i + 2}, lex.sequence(i));
+  }
+  EXPECT_EQ(200, lex.size());
+}
+
 TEST(SequenceLexicon, CopyConstructor) {
   auto original = make_unique<SequenceLexicon<int64>>();
   EXPECT_EQ(0, original->Add(Seq{1, 2}));
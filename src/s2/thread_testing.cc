@@ -67,6 +67,10 @@ void ReaderWriterTest::ReaderLoop() {
 }
 
 void ReaderWriterTest::Run(int num_readers, int iters) {
+  // Reset the state left by any previous call, before the readers start.
+  lock_.Lock();
+  num_writes_ = 0;
+  lock_.Unlock();
   ReaderThreadPool pool(std::bind(&ReaderWriterTest::ReaderLoop, this),
                         num_readers);
   lock_.Lock();
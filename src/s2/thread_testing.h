@@ -35,7 +35,7 @@ class ReaderWriterTest {
   virtual ~ReaderWriterTest() {}
 
   // Create the given number of reader threads and execute the given number of
-  // (write, read) iterations.
+  // (write, read) iterations.  Run() may be called more than once.
   void Run(int num_readers, int iters);
 
   // The writer thread calls the following function once between reads.
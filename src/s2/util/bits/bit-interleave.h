@@ -15,7 +15,9 @@
 
 // Author: jyrki@google.com (Jyrki Alakuijala)
 //
-// Interleaving bits quickly by table lookup.
+// Interleaving bits quickly by table lookup.  When compiled for a processor
+// with BMI2 instructions (e.g., with -mbmi2 or -march=haswell), the
+// two-argument functions use PDEP/PEXT instead.
 
 #ifndef S2_UTIL_BITS_BIT_INTERLEAVE_H_
 #define S2_UTIL_BITS_BIT_INTERLEAVE_H_
@@ -38,6 +40,14 @@ void DeinterleaveUint8(uint16 code, uint8 *val0, uint8 *val1);
 void DeinterleaveUint16(uint32 code, uint16 *val0, uint16 *val1);
 void DeinterleaveUint32(uint64 code, uint32 *val0, uint32 *val1);
 
+// Batch versions of InterleaveUint32 and DeinterleaveUint32 that convert "n"
+// values at once.  These use table-free code that the compiler can
+// vectorize, and are faster than calling the functions above in a loop.
+void InterleaveUint32(const uint32 *val0, const uint32 *val1, int n,
+                      uint64 *codes);
+void DeinterleaveUint32(const uint64 *codes, int n, uint32 *val0,
+                        uint32 *val1);
+
 // These functions interleave three arguments into the return value.
 // The 0-bit in val0 will be the 0-bit in the return value.
 // The 0-bit in val1 will be the 1-bit in the return value.
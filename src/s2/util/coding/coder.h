@@ -252,6 +252,12 @@ class Decoder {
   bool get_varint32(uint32* v);
   bool get_varint64(uint64* v);
 
+  // Decodes "n" consecutive varints into v[0..n-1].  Returns false if "n"
+  // valid varints are not available, in which case the decoder is not
+  // updated.  This is faster than calling get_varintXX in a loop.
+  bool get_varint32_array(int n, uint32* v);
+  bool get_varint64_array(int n, uint64* v);
+
   size_t pos() const;
   // Return number of bytes decoded so far
 
@@ -558,4 +564,26 @@ inline bool Decoder::get_varint64(uint64* v) {
   return true;
 }
 
+inline bool Decoder::get_varint32_array(int n, uint32* v) {
+  const char* const r = Varint::Parse32ArrayWithLimit(
+      reinterpret_cast<const char*>(buf_),
+      reinterpret_cast<const char*>(limit_), n, v);
+  if (r == nullptr) {
+    return false;
+  }
+  buf_ = reinterpret_cast<const unsigned char*>(r);
+  return true;
+}
+
+inline bool Decoder::get_varint64_array(int n, uint64* v) {
+  const char* const r = Varint::Parse64ArrayWithLimit(
+      reinterpret_cast<const char*>(buf_),
+      reinterpret_cast<const char*>(limit_), n, v);
+  if (r == nullptr) {
+    return false;
+  }
+  buf_ = reinterpret_cast<const unsigned char*>(r);
+  return true;
+}
+
 #endif  // S2_UTIL_CODING_CODER_H_
@@ -274,6 +274,40 @@ const char* Varint::Parse64Fallback(const char* p, uint64* OUTPUT) {
   }
  }
 
+// Shared implementation of Parse32ArrayWithLimit and Parse64ArrayWithLimit.
+// Most of the values are parsed by the inline function "Parse", which has a
+// fast path for one-byte values but requires kMax bytes to be available, so
+// the bounds check is needed only once per value.  (Branch-free SWAR
+// decoding of 8-byte words was also tried, but was slower because each
+// value's length must be known before the next value can be decoded.)
+template <class T, int kMax, const char* (*Parse)(const char*, T*),
+          const char* (*ParseWithLimit)(const char*, const char*, T*)>
+static inline const char* ParseArrayWithLimit(const char* p, const char* limit,
+                                              int n, T* OUTPUT) {
+  int i = 0;
+  for (; i < n && limit - p >= kMax; ++i) {
+    p = Parse(p, &OUTPUT[i]);
+    if (p == nullptr) return nullptr;
+  }
+  for (; i < n; ++i) {
+    p = ParseWithLimit(p, limit, &OUTPUT[i]);
+    if (p == nullptr) return nullptr;
+  }
+  return p;
+}
+
+const char* Varint::Parse32ArrayWithLimit(const char* p, const char* l, int n,
+                                          uint32* OUTPUT) {
+  return ParseArrayWithLimit<uint32, kMax32, Varint::Parse32,
+                             Varint::Parse32WithLimit>(p, l, n, OUTPUT);
+}
+
+const char* Varint::Parse64ArrayWithLimit(const char* p, const char* l, int n,
+                                          uint64* OUTPUT) {
+  return ParseArrayWithLimit<uint64, kMax64, Varint::Parse64,
+                             Varint::Parse64WithLimit>(p, l, n, OUTPUT);
+}
+
 const char* Varint::Skip32BackwardSlow(const char* p, const char* b) {
   const unsigned char* ptr = reinterpret_cast<const unsigned char*>(p);
   const unsigned char* base = reinterpret_cast<const unsigned char*>(b);
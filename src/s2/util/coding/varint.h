@@ -87,6 +87,17 @@ class Varint {
   static const char* Parse64WithLimit(const char* ptr, const char* limit,
                                       uint64* OUTPUT);
 
+  // Attempts to parse "n" consecutive varints from a prefix of the bytes in
+  // [ptr,limit-1] and store them in OUTPUT[0..n-1].  Never reads a character
+  // at or beyond limit.  Returns a pointer just past the last varint, or
+  // nullptr if "n" valid varints were not found (in which case the contents
+  // of OUTPUT are unspecified).  This is faster than calling
+  // ParseXXWithLimit in a loop.
+  static const char* Parse32ArrayWithLimit(const char* ptr, const char* limit,
+                                           int n, uint32* OUTPUT);
+  static const char* Parse64ArrayWithLimit(const char* ptr, const char* limit,
+                                           int n, uint64* OUTPUT);
+
   // REQUIRES   "ptr" points to the first byte of a varint-encoded value.
   // EFFECTS     Scans until the end of the varint and returns a pointer just
   //             past the last byte. Returns nullptr if "ptr" does not point to
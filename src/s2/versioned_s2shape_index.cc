@@ -0,0 +1,106 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/versioned_s2shape_index.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+
+#include "s2/base/logging.h"
+#include "s2/s2point_vector_shape.h"
+#include "s2/s2wrapped_shape.h"
+
+using absl::make_unique;
+using std::shared_ptr;
+using std::unique_ptr;
+using std::vector;
+
+// A published version consists of the index together with the shapes that
+// it refers to, so that the shapes remain alive as long as the index does.
+struct VersionedS2ShapeIndex::Version {
+  vector<shared_ptr<const S2Shape>> shapes;
+  MutableS2ShapeIndex index;
+};
+
+VersionedS2ShapeIndex::VersionedS2ShapeIndex()
+    : VersionedS2ShapeIndex(Options()) {
+}
+
+VersionedS2ShapeIndex::VersionedS2ShapeIndex(const Options& options)
+    : options_(options),
+      current_(std::make_shared<MutableS2ShapeIndex>(options)) {
+}
+
+VersionedS2ShapeIndex::~VersionedS2ShapeIndex() = default;
+
+VersionedS2ShapeIndex::Snapshot VersionedS2ShapeIndex::snapshot() const {
+  return std::atomic_load(&current_);
+}
+
+int VersionedS2ShapeIndex::Add(unique_ptr<S2Shape> shape) {
+  absl::MutexLock l(&writer_mutex_);
+  shapes_.push_back(std::move(shape));
+  return shapes_.size() - 1;
+}
+
+void VersionedS2ShapeIndex::Release(int shape_id) {
+  absl::MutexLock l(&writer_mutex_);
+  S2_DCHECK(shapes_[shape_id] != nullptr);
+  shapes_[shape_id].reset();
+}
+
+void VersionedS2ShapeIndex::Publish() {
+  // Copy the queued updates, and then build the new version without holding
+  // the lock so that Add() and Release() are not blocked by the build.
+  auto version = std::make_shared<Version>();
+  uint64 sequence;
+  {
+    absl::MutexLock l(&writer_mutex_);
+    version->shapes = shapes_;
+    sequence = ++next_sequence_;
+  }
+  version->index.Init(options_);
+  for (const auto& shape : version->shapes) {
+    if (shape != nullptr) {
+      version->index.Add(make_unique<S2WrappedShape>(shape.get()));
+    } else {
+      // Reserve the shape id of a removed shape so that the ids of all
+      // subsequent shapes are preserved.  Releasing a shape that has not
+      // been indexed yet is free.
+      version->index.Release(
+          version->index.Add(make_unique<S2PointVectorShape>()));
+    }
+  }
+  // Build the index before publishing it so that readers never need to wait.
+  version->index.ForceBuild();
+  Snapshot snapshot(version, &version->index);
+  {
+    // A concurrent Publish() that copied the updates later may have
+    // finished first, in which case its version must not be replaced.
+    absl::MutexLock l(&publish_mutex_);
+    if (sequence > published_sequence_) {
+      published_sequence_ = sequence;
+      std::atomic_store(&current_, std::move(snapshot));
+    }
+  }
+  num_versions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+int VersionedS2ShapeIndex::num_versions() const {
+  return num_versions_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,140 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef S2_VERSIONED_S2SHAPE_INDEX_H_
+#define S2_VERSIONED_S2SHAPE_INDEX_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+#include "s2/base/integral_types.h"
+#include "s2/mutable_s2shape_index.h"
+#include "s2/s2shape.h"
+
+// VersionedS2ShapeIndex maintains a sequence of immutable MutableS2ShapeIndex
+// snapshots, allowing geometry to be ingested while other threads continue
+// to query the previous version of the index without blocking.
+//
+// MutableS2ShapeIndex applies updates lazily on the first subsequent query,
+// and any other thread that queries the index while the update is being
+// applied must wait for it to finish.  Furthermore the caller must ensure
+// that no other thread is reading the index while Add() or Release() is
+// called.  VersionedS2ShapeIndex avoids both problems: updates are queued by
+// a writer, and Publish() builds a complete new index off to the side and
+// then installs it with an atomic pointer swap.  Readers simply query
+// whichever snapshot was current when they called snapshot(), and each
+// snapshot remains valid for as long as any reader holds a reference to it.
+//
+// Example usage:
+//
+//   VersionedS2ShapeIndex index;
+//
+//   // Writer thread:
+//   index.Add(std::move(shape));
+//   index.Publish();
+//
+//   // Reader threads:
+//   VersionedS2ShapeIndex::Snapshot snapshot = index.snapshot();
+//   auto query = MakeS2ContainsPointQuery(snapshot.get());
+//   ... use query ...
+//
+// Shape ids are stable across versions, i.e. a given shape has the same
+// id() in every snapshot that contains it.  Each snapshot indexes its
+// shapes through S2WrappedShape objects, which means that the type_tag()
+// and user_data() of the original shapes are not available from snapshots.
+//
+// Each version is built from scratch, so the cost of Publish() is
+// proportional to the total size of the geometry rather than to the size of
+// the update.  This class is therefore intended for indexes that are updated
+// in batches.  Options::num_threads() can be used to reduce the build time.
+//
+// This class is thread-safe: all methods may be called concurrently.
+// (Writers are serialized internally.)
+class VersionedS2ShapeIndex {
+ public:
+  using Options = MutableS2ShapeIndex::Options;
+
+  // A reference-counted handle to one published version of the index.  The
+  // index is fully built, so const operations never need to apply updates.
+  using Snapshot = std::shared_ptr<const MutableS2ShapeIndex>;
+
+  // Creates an index whose initial snapshot is empty.
+  VersionedS2ShapeIndex();
+
+  // Creates an index where every version is built with the given options.
+  explicit VersionedS2ShapeIndex(const Options& options);
+
+  ~VersionedS2ShapeIndex();
+
+  // Returns the most recently published version of the index.  This method
+  // never waits for Publish() to build a new version.
+  Snapshot snapshot() const;
+
+  // Queues the given shape to be added to the next published version, and
+  // returns the id that the shape will have in that version.
+  int Add(std::unique_ptr<S2Shape> shape);
+
+  // Queues the given shape to be removed from the next published version.
+  // The shape itself is destroyed once no remaining snapshot refers to it.
+  void Release(int shape_id);
+
+  // Builds a new version of the index containing all the updates queued so
+  // far, and then makes it visible to subsequent calls to snapshot().  The
+  // queued updates are copied under a lock but the new version is built
+  // without holding it, so Add() and Release() may be called by other
+  // threads during the build (their updates go into the next version).  If
+  // several threads call Publish() concurrently, the version containing the
+  // most recent updates is the one that remains visible.
+  void Publish();
+
+  // Returns the number of times that Publish() has been called.
+  int num_versions() const;
+
+ private:
+  struct Version;
+
+  const Options options_;
+
+  mutable absl::Mutex writer_mutex_;
+
+  // The shapes in the next version of the index, indexed by shape id.  Shapes
+  // are shared with all the published versions that contain them.
+  std::vector<std::shared_ptr<const S2Shape>> shapes_
+      ABSL_GUARDED_BY(writer_mutex_);
+
+  // The number of times that the queued updates have been copied by
+  // Publish().  Each new version is numbered by this sequence.
+  uint64 next_sequence_ ABSL_GUARDED_BY(writer_mutex_) = 0;
+
+  // Serializes installing new versions, so that a version is only installed
+  // if it is newer than the current one.
+  absl::Mutex publish_mutex_;
+  uint64 published_sequence_ ABSL_GUARDED_BY(publish_mutex_) = 0;
+
+  std::atomic<int> num_versions_{0};
+
+  // The current version.  This field is only accessed using the
+  // std::atomic_load and std::atomic_store overloads for std::shared_ptr.
+  Snapshot current_;
+
+  VersionedS2ShapeIndex(const VersionedS2ShapeIndex&) = delete;
+  void operator=(const VersionedS2ShapeIndex&) = delete;
+};
+
+#endif  // S2_VERSIONED_S2SHAPE_INDEX_H_
@@ -0,0 +1,157 @@
+// Copyright 2022 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS-IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "s2/versioned_s2shape_index.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_format.h"
+
+#include "s2/s2contains_point_query.h"
+#include "s2/s2lax_polygon_shape.h"
+#include "s2/s2text_format.h"
+
+using absl::make_unique;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+// Returns a 10x10 degree square whose southwest corner is at (0, lng).
+unique_ptr<S2Shape> MakeSquare(int lng) {
+  return s2textformat::MakeLaxPolygonOrDie(absl::StrFormat(
+      "0:%d, 0:%d, 10:%d, 10:%d", lng, lng + 10, lng + 10, lng));
+}
+
+S2Point SquareCenter(int lng) {
+  return s2textformat::MakePointOrDie(absl::StrFormat("5:%d", lng + 5));
+}
+
+TEST(VersionedS2ShapeIndex, EmptyInitialSnapshot) {
+  VersionedS2ShapeIndex index;
+  auto snapshot = index.snapshot();
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_EQ(0, snapshot->num_shape_ids());
+  EXPECT_EQ(0, index.num_versions());
+}
+
+TEST(VersionedS2ShapeIndex, UpdatesVisibleOnlyAfterPublish) {
+  VersionedS2ShapeIndex index;
+  EXPECT_EQ(0, index.Add(MakeSquare(0)));
+  EXPECT_EQ(1, index.Add(MakeSquare(20)));
+  EXPECT_EQ(0, index.snapshot()->num_shape_ids());
+  index.Publish();
+  auto v1 = index.snapshot();
+  ASSERT_EQ(2, v1->num_shape_ids());
+  EXPECT_TRUE(v1->is_fresh());
+
+  // Removing a shape does not affect snapshots that have already been taken,
+  // and shape ids are preserved across versions.
+  index.Release(0);
+  EXPECT_EQ(2, index.Add(MakeSquare(40)));
+  index.Publish();
+  auto v2 = index.snapshot();
+  EXPECT_EQ(2, index.num_versions());
+  ASSERT_EQ(3, v2->num_shape_ids());
+  EXPECT_EQ(nullptr, v2->shape(0));
+  EXPECT_EQ(1, v2->shape(1)->id());
+  EXPECT_EQ(2, v2->shape(2)->id());
+
+  auto q1 = MakeS2ContainsPointQuery(v1.get());
+  auto q2 = MakeS2ContainsPointQuery(v2.get());
+  EXPECT_TRUE(q1.Contains(SquareCenter(0)));
+  EXPECT_FALSE(q1.Contains(SquareCenter(40)));
+  EXPECT_FALSE(q2.Contains(SquareCenter(0)));
+  EXPECT_TRUE(q2.Contains(SquareCenter(20)));
+  EXPECT_TRUE(q2.Contains(SquareCenter(40)));
+}
+
+TEST(VersionedS2ShapeIndex, SnapshotOutlivesIndex) {
+  VersionedS2ShapeIndex::Snapshot snapshot;
+  {
+    VersionedS2ShapeIndex index;
+    index.Add(MakeSquare(0));
+    index.Publish();
+    snapshot = index.snapshot();
+  }
+  EXPECT_TRUE(MakeS2ContainsPointQuery(snapshot.get()).Contains(
+      SquareCenter(0)));
+}
+
+TEST(VersionedS2ShapeIndex, ConcurrentReadersAndWriter) {
+  // Readers query whatever version is current while the writer repeatedly
+  // adds a shape and publishes.  Every snapshot must be internally
+  // consistent, i.e. it contains exactly the shapes that were published.
+  MutableS2ShapeIndex::Options options;
+  options.set_num_threads(2);
+  VersionedS2ShapeIndex index(options);
+  const int kNumVersions = 20;
+  std::atomic<bool> done(false);
+  std::atomic<int> num_errors(0);
+  vector<std::thread> readers;
+  for (int i = 0; i < 3; ++i) {
+    readers.emplace_back([&]() {
+      while (!done.load()) {
+        auto snapshot = index.snapshot();
+        auto query = MakeS2ContainsPointQuery(snapshot.get());
+        const int num_shapes = snapshot->num_shape_ids();
+        for (int id = 0; id < num_shapes; ++id) {
+          if (!query.Contains(SquareCenter(id * 20 - 170))) ++num_errors;
+        }
+        if (query.Contains(SquareCenter(num_shapes * 20 - 170))) ++num_errors;
+      }
+    });
+  }
+  for (int i = 0; i < kNumVersions / 2; ++i) {
+    index.Add(MakeSquare(i * 20 - 170));
+    index.Publish();
+  }
+  done = true;
+  for (auto& reader : readers) reader.join();
+  EXPECT_EQ(0, num_errors.load());
+  EXPECT_EQ(kNumVersions / 2, index.snapshot()->num_shape_ids());
+}
+
+TEST(VersionedS2ShapeIndex, ConcurrentWritersAndPublishers) {
+  // Shapes may be added while other threads are publishing, and the final
+  // version contains every shape once all the threads have published.
+  VersionedS2ShapeIndex index;
+  const int kNumThreads = 4, kShapesPerThread = 5;
+  vector<std::thread> writers;
+  for (int t = 0; t < kNumThreads; ++t) {
+    writers.emplace_back([&index, t]() {
+      for (int i = 0; i < kShapesPerThread; ++i) {
+        index.Add(MakeSquare((t * kShapesPerThread + i) * 15 - 170));
+        index.Publish();
+      }
+    });
+  }
+  for (auto& writer : writers) writer.join();
+  EXPECT_EQ(kNumThreads * kShapesPerThread, index.num_versions());
+  auto snapshot = index.snapshot();
+  ASSERT_EQ(kNumThreads * kShapesPerThread, snapshot->num_shape_ids());
+  auto query = MakeS2ContainsPointQuery(snapshot.get());
+  for (int i = 0; i < kNumThreads * kShapesPerThread; ++i) {
+    EXPECT_TRUE(query.Contains(SquareCenter(i * 15 - 170)));
+  }
+}
+
+}  // namespace